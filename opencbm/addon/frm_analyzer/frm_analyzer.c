@@ -43,6 +43,8 @@ static void help()
 "                           instead of zeroes\n"
 "  -s, --status             display drive status after formatting\n"
 "  -p, --progress           display progress indicator\n"
+"  -b, --batch              format and analyze every track, one after the\n"
+"                           other, and summarize the speed zones\n"
 "\n"
 );
 }
@@ -52,6 +54,106 @@ static void hint(char *s)
     fprintf(stderr, "Try `%s' -h for more information.\n", s);
 }
 
+/*
+ * Pattern analyzer, get the length of the PLL synchronization period
+ * from the data which was read back; if the written sequence is not
+ * found, this is the size of the data.
+ */
+static int pll_sync_length(const unsigned char *data, int size)
+{
+        // search the last byte triple consisting of: 0x49, 0x24, 0x92
+        //
+    int k;
+    const unsigned char pattern[]={0x49, 0x24, 0x92};
+    // const unsigned char pattern[]={0xdb, 0x6d, 0xb6};
+
+    for(k=size-3; k>=0; --k)
+    {
+        if(data[k]==pattern[0] && data[k+1]==pattern[1] && data[k+2]==pattern[2]) break;
+    }
+    if(k<0)
+    {
+        // no part of the written sequence was found
+        k=size;
+    }
+    else
+    {
+            // now search the beginning of that "010010010010010010010010..." bit stream
+        while(k>=0 && data[k]==pattern[0] && data[k+1]==pattern[1] && data[k+2]==pattern[2])
+        {
+            k-=3;
+        }
+        k+=3;
+
+            // do single byte decreases
+        if(k>=1 && data[k-1]==pattern[2]) --k;
+        if(k>=1 && data[k-1]==pattern[1]) --k;
+        if(k>=1 && data[k-1]==pattern[0]) --k;
+    }
+    return k;
+}
+
+/*
+ * Batch mode: format and analyze the tracks from 1 to the end track,
+ * one after the other, and display the PLL synchronization length of
+ * every track and a summary of every speed zone.
+ */
+static int analyze_disk(CBM_FILE fd, unsigned char drive, unsigned char tracks,
+                        unsigned char orig, unsigned char bump,
+                        unsigned char show_progress, const char *name)
+{
+    static const int zone_start[] = { 1, 18, 25, 31, 256 };
+    int length[256];
+    unsigned char data[0x100];
+    char cmd[40];
+    int track, zone;
+
+    printf("Result with Pattern: 0x%02X / %3d\n\n"
+           "track  PLL synchronization length  drive status\n", orig, orig);
+
+    for(track = 1; track <= tracks; track++)
+    {
+        cbm_upload(fd, drive, 0x0300, dskfrmt, sizeof(dskfrmt));
+        sprintf(cmd, "M-E%c%c%c%c%c%c0:%s", 3, 3, track + 1,
+                orig, track == 1 ? bump : 0, show_progress, name);
+        cbm_exec_command(fd, drive, cmd, 11+strlen(name));
+        cbm_device_status(fd, drive, cmd, sizeof(cmd));
+
+        if (cbm_download(fd, drive, 0x0500, data, sizeof(data)) != sizeof(data))
+        {
+            fprintf(stderr, "error reading data!\n");
+            return 1;
+        }
+        length[track] = pll_sync_length(data, sizeof(data));
+
+        printf("  %2d             %3d              %s\n", track, length[track], cmd);
+    }
+
+    printf("\n");
+    for(zone = 0; zone < 4; zone++)
+    {
+        int min = sizeof(data), max = 0, sum = 0, count = 0;
+
+        for(track = zone_start[zone]; track < zone_start[zone + 1] && track <= tracks; track++)
+        {
+            if(length[track] == sizeof(data))
+            {
+                continue;   // the written sequence was not found
+            }
+            if(length[track] < min) min = length[track];
+            if(length[track] > max) max = length[track];
+            sum += length[track];
+            count++;
+        }
+        if(count)
+        {
+            printf("speed zone %d: PLL synchronization length %3d..%3d, average %5.1f\n",
+                   3 - zone, min, max, (float)sum / count);
+        }
+    }
+    return 0;
+}
+
 int ARCH_MAINDECL main(int argc, char *argv[])
 {
     int status = 0, id_ofs = 0, name_len, i;
@@ -60,6 +162,7 @@ int ARCH_MAINDECL main(int argc, char *argv[])
     unsigned char drive, tracks = 35, bump = 1, orig = 0x4b, show_progress = 0;
     char cmd[40], name[20], *arg;
     int erroroccured = 0;
+    int batch = 0;
     char *adapter = NULL;
     int option;
 
@@ -75,6 +178,7 @@ int ARCH_MAINDECL main(int argc, char *argv[])
 
         { "status"     , no_argument      , NULL, 's' },
         { "progress"   , no_argument      , NULL, 'p' },
+        { "batch"      , no_argument      , NULL, 'b' },
 
         /* undocumented */
         { "end-track"  , required_argument, NULL, 't' },
@@ -82,7 +186,7 @@ int ARCH_MAINDECL main(int argc, char *argv[])
     };
 
 //    const char shortopts[] ="hVnxospt:";
-    const char shortopts[] ="hVnxf:spt:";
+    const char shortopts[] ="hVnxf:spbt:";
 
 
     while((option = getopt_long(argc, argv, shortopts, longopts, NULL)) != -1)
@@ -104,6 +208,8 @@ orig=arch_atoc(optarg);
                       return 0;
             case 'p': show_progress = 1;
                       break;
+            case 'b': batch = 1;
+                      break;
             case 't': tracks = arch_atoc(optarg);
                       break;
             case '@': if (adapter == NULL)
@@ -162,6 +268,14 @@ orig=arch_atoc(optarg);
 
     if(cbm_driver_open_ex(&fd, adapter) == 0)
     {
+        if(batch)
+        {
+            i = analyze_disk(fd, drive, tracks, orig, bump, show_progress, name);
+            cbm_driver_close(fd);
+            cbmlibmisc_strfree(adapter);
+            return i;
+        }
+
         cbm_upload(fd, drive, 0x0300, dskfrmt, sizeof(dskfrmt));
         sprintf(cmd, "M-E%c%c%c%c%c%c0:%s", 3, 3, tracks + 1,
                 orig, bump, show_progress, name);
@@ -225,37 +339,7 @@ orig=arch_atoc(optarg);
 
 
 #if 1
-                // TODO, Pattern analyzer, get the lenght of the PLL synchronization period
-                //
-                    // search the last byte triple consisting of: 0x49, 0x24, 0x92
-                    //
-                int k;
-                const unsigned char pattern[]={0x49, 0x24, 0x92};
-                // const unsigned char pattern[]={0xdb, 0x6d, 0xb6};
-
-                for(k=sizeof(data)-3; k>=0; --k)
-                {
-                    if(data[k]==pattern[0] && data[k+1]==pattern[1] && data[k+2]==pattern[2]) break;
-                }
-                if(k<0)
-                {
-                    // no part of the written sequence was found
-                    k=sizeof(data);
-                }
-                else
-                {
-                        // now search the beginning of that "010010010010010010010010..." bit stream
-                    while(k>=0 && data[k]==pattern[0] && data[k+1]==pattern[1] && data[k+2]==pattern[2])
-                    {
-                        k-=3;
-                    }
-                    k+=3;
-
-                        // do single byte decreases
-                    if(k>=1 && data[k-1]==pattern[2]) --k;
-                    if(k>=1 && data[k-1]==pattern[1]) --k;
-                    if(k>=1 && data[k-1]==pattern[0]) --k;
-                }
+                int k = pll_sync_length(data, sizeof(data));
 
                 printf("Result with Pattern: 0x%02X / %3d, formatted on track %2d, PLL synchronization length: %3d\n", orig, orig, tracks, k);
 
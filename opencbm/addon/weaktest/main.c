@@ -37,6 +37,7 @@ const unsigned char syncmark[] = {
 
 /* setable via command line */
 static d64copy_severity_e verbosity = sev_warning;
+static int reads = 8;
 
 /* other globals */
 static CBM_FILE fd_cbm;
@@ -58,6 +59,8 @@ static void help()
 "  -h, --help               display this help and exit\n"
 "  -V, --version            display version information and exit\n"
 "  -@, --adapter=plugin:bus tell OpenCBM which backend plugin and bus to use\n"
+"  -r, --reads=COUNT        read the block COUNT times to find the weak bits\n"
+"                           (1..255, default 8)\n"
 "\n"
 );
 }
@@ -137,6 +140,11 @@ static const unsigned char warp_write_1571[] =
 #include "warpwrite1571.inc"
 };
 
+static const unsigned char weak_scan_1541[] =
+{
+#include "weakscan1541.inc"
+};
+
 static const unsigned char turbo_read_1541[] =
 {
 #include "turboread1541.inc"
@@ -235,15 +243,17 @@ static int testLastDirectorySectorWithWeakBits(
     unsigned char track, unsigned char se)
 {
     unsigned char gcr[GCRBUFSIZE];
+    unsigned char weak[GCRBUFSIZE];
     char trackmap[21+1];
-    int st, i;
+    d64copy_disk disk;
+    int st, i, decode_st;
 
     SETSTATEDEBUG((void)0);
     // warp write
     send_turbo(fd_cbm, cbm_drive, 1, 1, setup.drive_type == cbm_dt_cbm1541 ? 0 : 1);
 
     SETSTATEDEBUG((void)0);
-    if(target->open_disk(fd_cbm, &setup, (void*)(ULONG_PTR)cbm_drive, 1,
+    if(target->open_disk(&disk, fd_cbm, &setup, (void*)(ULONG_PTR)cbm_drive, 1,
                       turbo_routine_starter, my_message_cb) == 0)
     {
         for(i=0; i<GCRBUFSIZE; i++)
@@ -257,8 +267,8 @@ static int testLastDirectorySectorWithWeakBits(
         printGcrBuffer(gcr, 0);
 
         SETSTATEDEBUG((void)0);
-        st = target->write_block(track, se, gcr, GCRBUFSIZE-1, 0);
-        target->close_disk();
+        st = target->write_block(disk, track, se, gcr, GCRBUFSIZE-1, 0);
+        target->close_disk(disk);
 
         if(st)
         {
@@ -268,22 +278,28 @@ static int testLastDirectorySectorWithWeakBits(
 
         SETSTATEDEBUG((void)0);
 
-        // warp read
-        send_turbo(fd_cbm, cbm_drive, 0, 1, setup.drive_type == cbm_dt_cbm1541 ? 0 : 1);
+        // warp read of all the reads at once, the drive compares them
+        cbm_upload(fd_cbm, cbm_drive, 0x500, weak_scan_1541, sizeof(weak_scan_1541));
 
         SETSTATEDEBUG((void)0);
-        if(target->open_disk(fd_cbm, &setup, (void*)(ULONG_PTR)cbm_drive, 0,
+        if(target->open_disk(&disk, fd_cbm, &setup, (void*)(ULONG_PTR)cbm_drive, 0,
                           turbo_routine_starter, my_message_cb) == 0)
         {
             // set up the map with sectors to copy
             memset(trackmap, bs_dont_copy, sizeof(trackmap));
             trackmap[se] = bs_must_copy;
             SETSTATEDEBUG((void)0);
-            target->send_track_map(track, trackmap, 1);
+            target->send_track_map(disk, track, trackmap, (unsigned char)reads);
 
             SETSTATEDEBUG((void)0);
-            st = target->read_gcr_block(&se, gcr);
-            target->close_disk();
+            st = target->read_gcr_raw(disk, &se, gcr, &decode_st);
+            if(0 == st)
+            {
+                // the bits which changed in the other reads
+                SETSTATEDEBUG((void)0);
+                st = target->read_gcr_raw(disk, &se, weak, &decode_st);
+            }
+            target->close_disk(disk);
 
             if(st)
             {
@@ -299,6 +315,9 @@ static int testLastDirectorySectorWithWeakBits(
             printf("\nRead back weak bit area XOR'ed with input vector");
             printGcrBuffer(gcr, 1);
 
+            printf("\nBits which changed in %d reads", reads);
+            printGcrBuffer(weak, 1);
+
             return 0;
         }
     }
@@ -404,9 +423,10 @@ int ARCH_MAINDECL main(int argc, char *argv[])
         { "help"       , no_argument      , NULL, 'h' },
         { "version"    , no_argument      , NULL, 'V' },
         { "adapter"    , required_argument, NULL, '@' },
+        { "reads"      , required_argument, NULL, 'r' },
         { NULL         , 0                , NULL, 0   }
     };
-    const char shortopts[] ="hV";
+    const char shortopts[] ="hVr:";
 
     while((option = getopt_long(argc, argv, shortopts, longopts, NULL)) != -1)
     {
@@ -425,6 +445,14 @@ int ARCH_MAINDECL main(int argc, char *argv[])
                           return 1;
                       }
                       break;
+            case 'r': reads = atoi(optarg);
+                      if(reads < 1 || reads > 255)
+                      {
+                          fprintf(stderr, "invalid number of reads: %s\n", optarg);
+                          hint(argv[0]);
+                          return 1;
+                      }
+                      break;
             case 0:   break; // needed for --no-warp
             default : hint(argv[0]);
                       return 1;
@@ -10,6 +10,7 @@
 #include "arch.h"
 
 #include <sys/stat.h>
+#include <sys/mman.h>
 
 
 /*! \brief Obtain the size of a given file
@@ -44,3 +45,45 @@ int arch_filesize(const char *Filename, off_t *Filesize)
 
     return ret;
 }
+
+/*! \brief Map a file into memory
+
+ \param Fileno
+   The file descriptor of the open file.
+
+ \param Size
+   The number of bytes at the start of the file to map.
+   The file must be at least that large.
+
+ \param Writable
+   != 0: Changes to the memory are written back to the file.
+   The file must have been opened for writing then.
+
+ \return
+   The address of the mapping, or NULL if the file could not
+   be mapped.
+*/
+
+void *arch_map_file(int Fileno, size_t Size, int Writable)
+{
+    void *address;
+
+    address = mmap(NULL, Size, Writable ? PROT_READ | PROT_WRITE : PROT_READ,
+                   MAP_SHARED, Fileno, 0);
+
+    return address == MAP_FAILED ? NULL : address;
+}
+
+/*! \brief Remove the mapping of a file
+
+ \param Address
+   The address returned by arch_map_file().
+
+ \param Size
+   The size given to arch_map_file().
+*/
+
+void arch_unmap_file(void *Address, size_t Size)
+{
+    munmap(Address, Size);
+}
@@ -60,3 +60,17 @@ void arch_sleep_s(unsigned int Seconds)
 
     nanosleep(&time_to_sleep, NULL);
 }
+
+/*! \brief The current time in microseconds
+
+ \return
+   A monotonic time in microseconds. Only the difference
+   between two values is meaningful.
+*/
+double arch_time_us(void)
+{
+    struct timespec now;
+
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return now.tv_sec * 1e6 + now.tv_nsec / 1e3;
+}
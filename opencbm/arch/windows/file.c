@@ -50,3 +50,59 @@ int arch_filesize(const char *Filename, off_t *Filesize)
 
     return ret;
 }
+
+/*! \brief Map a file into memory
+
+ \param Fileno
+   The file descriptor of the open file.
+
+ \param Size
+   The number of bytes at the start of the file to map.
+   The file must be at least that large.
+
+ \param Writable
+   != 0: Changes to the memory are written back to the file.
+   The file must have been opened for writing then.
+
+ \return
+   The address of the mapping, or NULL if the file could not
+   be mapped.
+*/
+
+void *arch_map_file(int Fileno, size_t Size, int Writable)
+{
+    HANDLE file = (HANDLE) _get_osfhandle(Fileno);
+    HANDLE mapping;
+    void *address = NULL;
+
+    if (file != INVALID_HANDLE_VALUE && Size > 0)
+    {
+        mapping = CreateFileMapping(file, NULL,
+            Writable ? PAGE_READWRITE : PAGE_READONLY, 0, (DWORD) Size, NULL);
+
+        if (mapping)
+        {
+            address = MapViewOfFile(mapping,
+                Writable ? FILE_MAP_WRITE : FILE_MAP_READ, 0, 0, Size);
+
+            /* the view keeps the mapping alive */
+            CloseHandle(mapping);
+        }
+    }
+
+    return address;
+}
+
+/*! \brief Remove the mapping of a file
+
+ \param Address
+   The address returned by arch_map_file().
+
+ \param Size
+   The size given to arch_map_file().
+*/
+
+void arch_unmap_file(void *Address, size_t Size)
+{
+    UnmapViewOfFile(Address);
+}
@@ -69,3 +69,20 @@ void arch_sleep_s(unsigned int Seconds)
 
     return 0;
 }
+
+/*! \brief The current time in microseconds
+
+ \return
+   A monotonic time in microseconds. Only the difference
+   between two values is meaningful.
+*/
+double arch_time_us(void)
+{
+    static LARGE_INTEGER frequency;
+    LARGE_INTEGER counter;
+
+    if (frequency.QuadPart == 0)
+        QueryPerformanceFrequency(&frequency);
+    QueryPerformanceCounter(&counter);
+    return (double)counter.QuadPart * 1e6 / (double)frequency.QuadPart;
+}
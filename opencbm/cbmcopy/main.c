@@ -123,6 +123,12 @@ static void help(const char *prog)
 "Options for writing:\n"
 "  -f, --file-type            specify CBM file type (D,P,S,U)\n"
 "  -R, --raw                  skip test for PC64 (.p00) and T64 input file\n"
+"  -i, --interleave=VALUE     sector interleave of the file on the disk,\n"
+"                             0 keeps the one of the drive (1541/1570/1571\n"
+"                             only, default: best for the transfer mode)\n"
+"  -u, --update               only write the files which are not on the disk\n"
+"                             with the same contents yet; a file which differs\n"
+"                             is replaced. Needs a turbo transfer mode.\n"
 "\n", prog);
 }
 
@@ -172,6 +178,154 @@ static void char_star_opt_once(const char **arg,
 }
 
 
+/* the file a CBM file is read into, block by block */
+typedef struct
+{
+    FILE *file;
+    const char *name;
+    size_t written;
+    int address;    /* load address override, -1: none */
+} output_file;
+
+static int write_output(void *context, const unsigned char *data, size_t size)
+{
+    output_file *out = context;
+    unsigned char block[254];
+
+    if(out->written == 0 && out->address >= 0 && size > 1 && size <= sizeof(block))
+    {
+        memcpy(block, data, size);
+        block[0] = out->address % 0x100;
+        block[1] = out->address / 0x100;
+
+        my_message_cb( sev_debug, "override address: $%02x%02x",
+                       block[1], block[0] );
+        data = block;
+    }
+
+    if(fwrite(data, size, 1, out->file) != 1)
+    {
+        my_message_cb(sev_warning, "could not write %s: %s",
+                      out->name, arch_strerror(arch_get_errno()));
+        return -1;
+    }
+    out->written += size;
+    return 0;
+}
+
+
+/* remove the file cbmname (up to its ",type,W") from the disk */
+static int scratch_file(CBM_FILE fd, unsigned char drive, const char *cbmname)
+{
+    char cmd[FN_BUFFER_SIZE + 3];
+    char status[40];
+    const char *end;
+
+    end = strchr(cbmname, ',');
+    if(end == NULL)
+    {
+        end = strchr(cbmname, '\0');
+    }
+    sprintf(cmd, "S0:%.*s", (int) (end - cbmname), cbmname);
+
+    if(cbm_exec_command(fd, drive, cmd, 0) != 0)
+    {
+        return 1;
+    }
+    /* "01, FILES SCRATCHED" is no error */
+    return cbm_device_status(fd, drive, status, sizeof(status)) > 1;
+}
+
+
+/* a file given on the command line, and where it starts on the disk */
+typedef struct
+{
+    int arg;
+    int track;      /* 0: not known */
+    int sector;
+} file_location;
+
+static int compare_location(const void *a, const void *b)
+{
+    const file_location *la = a;
+    const file_location *lb = b;
+
+    if(la->track != lb->track)
+    {
+        /* files which have not been found stay behind the others */
+        if(la->track == 0 || lb->track == 0)
+        {
+            return la->track == 0 ? 1 : -1;
+        }
+        return la->track - lb->track;
+    }
+    if(la->sector != lb->sector)
+    {
+        return la->sector - lb->sector;
+    }
+    return la->arg - lb->arg;
+}
+
+/*
+ * sort the files to read by their start track, so the head moves
+ * across the disk only once instead of seeking back and forth
+ */
+static void order_by_location(cbmcopy_session *session, char **argv,
+                              file_location *files, int num_files)
+{
+    char **names;
+    int *track;
+    int *sector;
+    int ok;
+    int i;
+
+    names = calloc(num_files, sizeof(*names));
+    track = calloc(num_files, sizeof(*track));
+    sector = calloc(num_files, sizeof(*sector));
+    ok = names && track && sector;
+
+    for(i = 0; ok && i < num_files; i++)
+    {
+        names[i] = arch_strdup(argv[files[i].arg]);
+        if(names[i])
+        {
+            cbm_ascii2petscii(names[i]);
+        }
+        else
+        {
+            ok = 0;
+        }
+    }
+
+    if(ok && cbmcopy_session_locate_files(session, num_files,
+                                          (const char * const *)names,
+                                          track, sector) == 0)
+    {
+        for(i = 0; i < num_files; i++)
+        {
+            files[i].track = track[i];
+            files[i].sector = sector[i];
+        }
+        qsort(files, num_files, sizeof(*files), compare_location);
+    }
+    else
+    {
+        my_message_cb(sev_debug, "directory not read, keeping the file order");
+    }
+
+    if(names)
+    {
+        for(i = 0; i < num_files; i++)
+        {
+            if(names[i]) free(names[i]);
+        }
+    }
+    if(names) free(names);
+    if(track) free(track);
+    if(sector) free(sector);
+}
+
+
 int ARCH_MAINDECL main(int argc, char **argv)
 {
     CBM_FILE fd;
@@ -186,9 +340,14 @@ int ARCH_MAINDECL main(int argc, char **argv)
     int num_entries;
     int num_files;
     int rv;
+    int err;
     int i;
     int write;
     cbmcopy_settings *settings;
+    cbmcopy_session *session;
+    file_location *files;
+    int file_index;
+    output_file out;
     char auto_name[17];
     char auto_type = '\0';
     char output_type = '\0';
@@ -200,9 +359,11 @@ int ARCH_MAINDECL main(int argc, char **argv)
     const char *tm = NULL;
     const char *dt = NULL;
     int force_raw = 0;
+    int update = 0;
     int address = -1;
     const char *output_name = NULL;
     const char *address_str = NULL;
+    const char *interleave_str = NULL;
     char *fs_name;
 
     input_reader *readers[] =
@@ -231,10 +392,12 @@ int ARCH_MAINDECL main(int argc, char **argv)
         { "output"          , required_argument, NULL, 'o' },
         { "raw"             , no_argument      , NULL, 'R' },
         { "address"         , no_argument      , NULL, 'a' },
+        { "interleave"      , required_argument, NULL, 'i' },
+        { "update"          , no_argument      , NULL, 'u' },
         { NULL              , 0                , NULL, 0   }
     };
 
-    const char shortopts[] ="hVqvrwnt:d:f:o:Ra:@:";
+    const char shortopts[] ="hVqvrwnt:d:f:o:Ra:i:u@:";
 
     if(NULL == (tail = strrchr(argv[0], '/')))
     {
@@ -311,6 +474,12 @@ int ARCH_MAINDECL main(int argc, char **argv)
             case 'a': /* override-address */
                 char_star_opt_once(&address_str, "--address", argv);
                 break;
+            case 'i': /* --interleave */
+                char_star_opt_once(&interleave_str, "--interleave", argv);
+                break;
+            case 'u': /* --update */
+                update = 1;
+                break;
             case '@': /* choose adapter */
                 if (adapter == NULL)
                     adapter = cbmlibmisc_strdup(optarg);
@@ -405,6 +574,28 @@ int ARCH_MAINDECL main(int argc, char **argv)
         }
     }
 
+    /* check interleave */
+    if(interleave_str)
+    {
+        settings->interleave = strtol(interleave_str, &tail, 0);
+        if(*tail || settings->interleave < 0 || settings->interleave > 20)
+        {
+            my_message_cb(sev_fatal, "--interleave invalid: %s", interleave_str);
+            hint(argv[0]);
+            return 1;
+        }
+        if(!write)
+        {
+            my_message_cb(sev_warning, "--interleave ignored");
+        }
+    }
+
+    if(update && !write)
+    {
+        my_message_cb(sev_warning, "--update ignored");
+        update = 0;
+    }
+
     /* first non-option is device number */
     if(optind == argc)
     {
@@ -455,9 +646,28 @@ int ARCH_MAINDECL main(int argc, char **argv)
 
         arch_set_ctrlbreak_handler(reset);
 
-        while(++optind < argc)
+        session = cbmcopy_session_open(fd, settings, drive, my_message_cb);
+        files = calloc(num_files, sizeof(*files));
+        if(session == NULL || files == NULL)
+        {
+            cbmcopy_session_close( session );
+            cbm_driver_close( fd );
+            my_message_cb(sev_fatal, "Out of memory");
+            exit(1);
+        }
+
+        for(file_index = 0; file_index < num_files; file_index++)
+        {
+            files[file_index].arg = optind + 1 + file_index;
+        }
+        if(!write && num_files > 1)
+        {
+            order_by_location(session, argv, files, num_files);
+        }
+
+        for(file_index = 0; file_index < num_files; file_index++)
         {
-            fname = argv[optind];
+            fname = argv[files[file_index].arg];
             if(write)
             {
                 rd = readers[0];
@@ -535,11 +745,24 @@ int ARCH_MAINDECL main(int argc, char **argv)
                                                filedata[1], filedata[0] );
 
                             }
-                            if(cbmcopy_write_file(fd, settings, drive,
-                                                  buf, strlen(buf),
-                                                  filedata, filesize,
-                                                  my_message_cb,
-                                                  my_status_cb) == 0)
+                            err = update ?
+                                cbmcopy_session_compare_file(session, buf,
+                                                             filedata,
+                                                             (int) filesize) : 2;
+                            if(err == 0)
+                            {
+                                my_message_cb( sev_info, "unchanged, not written" );
+                            }
+                            else if(err != 2 && scratch_file(fd, drive, buf) != 0)
+                            {
+                                my_message_cb( sev_warning,
+                                               "could not replace the file" );
+                                rv = 1;
+                            }
+                            else if(cbmcopy_session_write_file(session,
+                                                          buf, strlen(buf),
+                                                          filedata, filesize,
+                                                          my_status_cb) == 0)
                             {
                                 printf("\n");
                                 rv = cbm_device_status( fd, drive,
@@ -614,6 +837,8 @@ int ARCH_MAINDECL main(int argc, char **argv)
                 if(!fs_name)
                 {
                     /* should not happen... */
+                    free( files );
+                    cbmcopy_session_close( session );
                     cbm_driver_close( fd );
                     my_message_cb(sev_fatal, "Out of memory");
                     exit(1);
@@ -621,51 +846,47 @@ int ARCH_MAINDECL main(int argc, char **argv)
 
                 my_message_cb( sev_info, "reading %s -> %s", fname, fs_name );
 
-                if(cbmcopy_read_file(fd, settings, drive, buf, strlen(buf),
-                                     &filedata, &filesize,
-                                     my_message_cb, my_status_cb) == 0)
-                {
-                    rv = cbm_device_status( fd, drive, buf, sizeof(buf) );
-                    my_message_cb( rv ? sev_warning : sev_info, "%s", buf );
+                out.file = fopen(fs_name, "wb");
+                out.name = fs_name;
+                out.written = 0;
+                out.address = address;
 
-                    file = fopen(fs_name, "wb");
-                    if(file)
+                if(out.file == NULL)
+                {
+                    my_message_cb(sev_warning,
+                                  "could not open %s: %s",
+                                  fs_name, arch_strerror(arch_get_errno()));
+                }
+                else
+                {
+                    if(files[file_index].track)
                     {
-                        if(filedata)
-                        {
-                            if(address >= 0 && filesize > 1)
-                            {
-                                filedata[0] = address % 0x100;
-                                filedata[1] = address / 0x100;
-
-                                my_message_cb( sev_debug,
-                                               "override address: $%02x%02x",
-                                               filedata[1], filedata[0] );
-                            }
-                            if(fwrite(filedata, filesize, 1, file) != 1)
-                            {
-                                my_message_cb(sev_warning,
-                                              "could not write %s: %s",
-                                              fs_name, arch_strerror(arch_get_errno()));
-                            }
-                        }
-                        fclose(file);
+                        /* already found in the directory, no need to search again */
+                        err = cbmcopy_session_stream_file_ts(session,
+                                                             files[file_index].track,
+                                                             files[file_index].sector,
+                                                             write_output, &out,
+                                                             my_status_cb);
                     }
                     else
                     {
-                        my_message_cb(sev_warning,
-                                      "could not open %s: %s",
-                                      fs_name, arch_strerror(arch_get_errno()));
+                        err = cbmcopy_session_stream_file(session, buf, strlen(buf),
+                                                          write_output, &out,
+                                                          my_status_cb);
                     }
+                    fclose(out.file);
 
-                    if(filedata)
+                    if(err == 0)
                     {
-                        free(filedata);
+                        rv = cbm_device_status( fd, drive, buf, sizeof(buf) );
+                        my_message_cb( rv ? sev_warning : sev_info, "%s", buf );
+                    }
+                    else
+                    {
+                        /* do not leave an incomplete file behind */
+                        remove(fs_name);
+                        my_message_cb(sev_warning, "error reading %s", buf);
                     }
-                }
-                else
-                {
-                    my_message_cb(sev_warning, "error reading %s", buf);
                 }
                 if(fs_name)
                 {
@@ -673,6 +894,8 @@ int ARCH_MAINDECL main(int argc, char **argv)
                 }
             }
         }
+        free( files );
+        cbmcopy_session_close( session );
         cbm_driver_close( fd );
 
         if(rv)
@@ -12,6 +12,7 @@
 
 #include "opencbm.h"
 #include "opencbm-dos.h"
+#include "libtrans.h"
 
 #include "cbmctrl.h"
 
@@ -50,6 +51,7 @@ typedef struct {
     int version; //!< option: print version information
     char *adapter; //!< option: an explicit adapter was specified
     PETSCII_RAW petsciiraw; //!< option: The user requested PETSCII or RAW, or nothing
+    int actionoptions; //!< the options of the action are being processed (=1), or not yet (=0)
 } OPTIONS;
 
 typedef int (*mainfunc)(CBM_FILE fd, OPTIONS * const options);
@@ -239,12 +241,11 @@ static int get_argument_file_for_read(OPTIONS * const options, FILE **f, char **
 static int
 process_individual_option(OPTIONS * const options, const char short_options[], struct option long_options[])
 {
-    static int firstcall = 1;
     int option;
 
-    if (firstcall)
+    if (!options->actionoptions)
     {
-        firstcall = 0;
+        options->actionoptions = 1;
 
         optind = 0;
 
@@ -1062,6 +1063,333 @@ static int do_command(CBM_FILE fd, OPTIONS * const options)
     return rv;
 }
 
+/*
+ * the channel and the DOS buffer do_dir_fast() reads the blocks into;
+ * the buffers of the 1541/1570/1571 start at $0300, one page each
+ */
+#define DIR_FAST_CHANNEL  2
+#define DIR_FAST_BUFFER   2
+
+/* the directory track of the 1541/1570/1571 */
+#define DIR_FAST_TRACK    18
+
+/* the directory chain cannot be longer than the track, minus the BAM */
+#define DIR_FAST_MAX_BLOCKS 18
+
+/*
+ * read a block into the DOS buffer with U1, and get it from there
+ * with one memory read. The library keeps the directory track as long
+ * as the BAM does not change, so a listing repeated in a script only
+ * reads the BAM again.
+ */
+static int dir_fast_read_block(CBM_FILE fd, unsigned char device,
+                               unsigned char track, unsigned char sector,
+                               unsigned char *block)
+{
+    char status[40];
+
+    if (cbm_dos_dir_block_read(fd, device, DIR_FAST_CHANNEL, DIR_FAST_BUFFER, track, sector, block) < 0)
+    {
+        cbm_device_status(fd, device, status, sizeof(status));
+        fprintf(stderr, "could not read block %u/%u: %s\n", track, sector, cbm_petscii2ascii(status));
+        return 1;
+    }
+
+    return 0;
+}
+
+/*
+ * output count characters of a directory block the way the drive
+ * does it, with the shifted spaces (0xA0) as padding
+ */
+static void dir_fast_print(const unsigned char *text, int count, PETSCII_RAW petsciiraw)
+{
+    int i;
+
+    for (i = 0; i < count; i++)
+    {
+        char c = (char) (text[i] == 0xA0 ? ' ' : text[i]);
+
+        putchar(petsciiraw == PA_PETSCII ? cbm_petscii2ascii_c(c) : c);
+    }
+}
+
+/*
+ * where dir_fast_list() gets the blocks of the directory track from:
+ * a drive, or a disk image file
+ */
+typedef int (*dir_fast_block_reader)(void *context, unsigned char track,
+                                     unsigned char sector, unsigned char *block);
+
+/* a drive, read with dir_fast_read_block() */
+struct dir_fast_drive
+{
+    CBM_FILE fd;
+    unsigned char device;
+};
+
+static int dir_fast_read_drive_block(void *context, unsigned char track,
+                                     unsigned char sector, unsigned char *block)
+{
+    struct dir_fast_drive *drive = context;
+
+    return dir_fast_read_block(drive->fd, drive->device, track, sector, block);
+}
+
+/*
+ * output the listing of the directory track, built from its blocks the
+ * way the drive would output it
+ */
+static int dir_fast_list(dir_fast_block_reader read_block, void *context,
+                         PETSCII_RAW petsciiraw)
+{
+    static const char * const filetypes[] = { "DEL", "SEQ", "PRG", "USR", "REL" };
+
+    unsigned char bam[256];
+    unsigned char block[256];
+    unsigned int blocks_free = 0;
+    unsigned char track, sector;
+    int count;
+    int t;
+    int rv;
+
+    rv = read_block(context, DIR_FAST_TRACK, 0, bam);
+
+    if (rv == 0)
+    {
+        // the header, just as the drive outputs it
+
+        printf("0 \"");
+        dir_fast_print(&bam[0x90], 16, petsciiraw);
+        printf("\" ");
+        dir_fast_print(&bam[0xA2], 5, petsciiraw);
+        putchar('\n');
+
+        for (t = 1; t <= 35; t++)
+        {
+            if (t != DIR_FAST_TRACK)
+                blocks_free += bam[t * 4];
+        }
+
+        // a double sided 1571 disk counts the free blocks of the second side, too
+
+        if (bam[3] & 0x80)
+        {
+            for (t = 36; t <= 70; t++)
+            {
+                if (t != DIR_FAST_TRACK + 35)
+                    blocks_free += bam[0xDD + t - 36];
+            }
+        }
+
+        track = bam[0];
+        sector = bam[1];
+
+        for (count = 0; track != 0 && rv == 0; count++)
+        {
+            int entry;
+
+            if (track != DIR_FAST_TRACK || count >= DIR_FAST_MAX_BLOCKS)
+            {
+                fprintf(stderr, "invalid directory chain at %u/%u!\n", track, sector);
+                rv = 1;
+                break;
+            }
+
+            rv = read_block(context, track, sector, block);
+
+            for (entry = 0; entry < 256 && rv == 0; entry += 32)
+            {
+                const unsigned char *p = &block[entry];
+                unsigned int blocks = p[30] | p[31] << 8;
+                int namelen;
+
+                if (p[2] == 0)
+                    continue;
+
+                for (namelen = 0; namelen < 16 && p[5 + namelen] != 0xA0; namelen++)
+                    ;
+
+                printf("%u ", blocks);
+                printf("%s", blocks < 10 ? "   " : blocks < 100 ? "  " : " ");
+                putchar('"');
+                dir_fast_print(&p[5], namelen, petsciiraw);
+                putchar('"');
+                printf("%*s", 16 - namelen, "");
+                putchar((p[2] & 0x80) ? ' ' : '*');
+                printf("%s", (p[2] & 0x07) < 5 ? filetypes[p[2] & 0x07] : "???");
+                putchar((p[2] & 0x40) ? '<' : ' ');
+                putchar('\n');
+            }
+
+            track = block[0];
+            sector = block[1];
+        }
+
+        if (rv == 0)
+        {
+            printf("%u BLOCKS FREE.\n", blocks_free);
+        }
+    }
+
+    return rv;
+}
+
+/*
+ * display directory by reading the directory track directly, instead
+ * of letting the drive format the listing byte by byte
+ */
+static int do_dir_fast(CBM_FILE fd, OPTIONS * const options, unsigned char device)
+{
+    struct dir_fast_drive drive;
+    char status[40];
+    int rv;
+
+    if (cbm_dos_open_channel_specific(fd, device, DIR_FAST_CHANNEL, DIR_FAST_BUFFER) != 0
+        || cbm_device_status(fd, device, status, sizeof(status)) != 0)
+    {
+        fprintf(stderr, "could not open a channel for the directory!\n");
+        cbm_close(fd, device, DIR_FAST_CHANNEL);
+        return 1;
+    }
+
+    drive.fd = fd;
+    drive.device = device;
+    rv = dir_fast_list(dir_fast_read_drive_block, &drive, options->petsciiraw);
+
+    cbm_close(fd, device, DIR_FAST_CHANNEL);
+
+    if (rv == 0)
+    {
+        cbm_device_status(fd, device, status, sizeof(status));
+        if (options->petsciiraw == PA_PETSCII) {
+            cbm_petscii2ascii(status);
+        }
+        printf("%s\n", status);
+    }
+
+    return rv;
+}
+
+/*
+ * the directory track of a .d64 or .d71 image: the tracks before it
+ * have 21 sectors each, on every kind of these images
+ */
+#define IMGDIR_TRACK_OFFSET (17 * 21 * 256L)
+#define IMGDIR_SECTORS      19
+
+/* the sizes of the images imgdir knows, with and without error info */
+static const long imgdir_sizes[] =
+{
+    174848, 175531,     /* 35 tracks */
+    196608, 197376,     /* 40 tracks */
+    349696, 351062      /* 70 tracks, .d71 */
+};
+
+/* the directory track of an image file, read at once */
+struct dir_fast_image
+{
+    const char *name;
+    unsigned char track[IMGDIR_SECTORS * 256];
+};
+
+static int dir_fast_read_image_block(void *context, unsigned char track,
+                                     unsigned char sector, unsigned char *block)
+{
+    struct dir_fast_image *image = context;
+
+    if (track != DIR_FAST_TRACK || sector >= IMGDIR_SECTORS)
+    {
+        fprintf(stderr, "%s: invalid block %u/%u!\n", image->name, track, sector);
+        return 1;
+    }
+
+    memcpy(block, &image->track[sector * 256], 256);
+    return 0;
+}
+
+/*
+ * read the directory track of an image file; the rest of the image is
+ * not needed for the listing, so it is not read at all
+ */
+static int imgdir_read(struct dir_fast_image *image)
+{
+    FILE *f;
+    long size;
+    size_t i;
+    int rv = 1;
+
+    f = fopen(image->name, "rb");
+    if (f == NULL)
+    {
+        fprintf(stderr, "could not open %s!\n", image->name);
+        return 1;
+    }
+
+    if (fseek(f, 0, SEEK_END) == 0 && (size = ftell(f)) >= 0)
+    {
+        for (i = 0; i < sizeof(imgdir_sizes) / sizeof(imgdir_sizes[0]); i++)
+        {
+            if (size == imgdir_sizes[i])
+                break;
+        }
+
+        if (i == sizeof(imgdir_sizes) / sizeof(imgdir_sizes[0]))
+        {
+            fprintf(stderr, "%s is no .d64 or .d71 image!\n", image->name);
+        }
+        else if (fseek(f, IMGDIR_TRACK_OFFSET, SEEK_SET) != 0
+            || fread(image->track, sizeof(image->track), 1, f) != 1)
+        {
+            fprintf(stderr, "could not read %s!\n", image->name);
+        }
+        else
+        {
+            rv = 0;
+        }
+    }
+
+    fclose(f);
+    return rv;
+}
+
+/*
+ * display the directories of disk image files, without a drive
+ */
+static int do_imgdir(CBM_FILE fd, OPTIONS * const options)
+{
+    struct dir_fast_image image;
+    int count = options->argc;
+    int rv = 0;
+    int i;
+
+    if (count < 1)
+    {
+        fprintf(stderr, "no <image> given!\n");
+        return 1;
+    }
+
+    for (i = 0; i < count; i++)
+    {
+        image.name = options->argv[i];
+
+        // tell the listings apart, as ls does
+
+        if (count > 1)
+            printf("%s%s:\n", i > 0 ? "\n" : "", image.name);
+
+        if (imgdir_read(&image) != 0
+            || dir_fast_list(dir_fast_read_image_block, &image, options->petsciiraw) != 0)
+        {
+            rv = 1;
+        }
+    }
+
+    options->argc = 0;
+
+    return rv;
+}
+
 /*
  * display directory
  */
@@ -1075,11 +1403,33 @@ static int do_dir(CBM_FILE fd, OPTIONS * const options)
         unsigned char unit;   /* 0, 1, ... */
     } command = { NULL, NULL, 0, 0 };
 
-    int rv;
+    int fast = 0;
+    int rv = 0;
+    int o;
 
-    rv = skip_options(options);
+    static const char short_options[] = "+f";
+    static struct option long_options[] =
+    {
+        {"fast", no_argument, NULL, 'f'},
+        {NULL,   no_argument, NULL, 0  }
+    };
 
-    rv = rv || get_argument_int_as_primary_address(options, &command.device);
+    // first of all, process the options given
+
+    while ((o = process_individual_option(options, short_options, long_options)) != EOF)
+    {
+        switch (o)
+        {
+        case 'f':
+            fast = 1;
+            break;
+
+        default:
+            return 1;
+        }
+    }
+
+    rv = get_argument_int_as_primary_address(options, &command.device);
 
     if ( !rv && options->argc > 0) {
         command.filename = options->argv[0];
@@ -1096,6 +1446,26 @@ static int do_dir(CBM_FILE fd, OPTIONS * const options)
     if (rv || check_if_parameters_ok(options))
         return 1;
 
+    if (fast)
+    {
+        enum cbm_device_type_e device_type;
+
+        if (command.filename != NULL)
+        {
+            fprintf(stderr, "a <filespec> cannot be used with -f, using the normal listing.\n");
+        }
+        else if (cbm_identify(fd, command.device, &device_type, NULL) == 0
+            && (device_type == cbm_dt_cbm1541 || device_type == cbm_dt_cbm1570
+                || device_type == cbm_dt_cbm1571))
+        {
+            return do_dir_fast(fd, options, command.device);
+        }
+        else
+        {
+            fprintf(stderr, "-f needs a 1541, 1570 or 1571 drive, using the normal listing.\n");
+        }
+    }
+
     command.str = cbmlibmisc_sprintf("$%s", (command.filename ? command.filename : ""));
     if (options->petsciiraw == PA_PETSCII) {
         cbm_ascii2petscii(command.str);
@@ -1224,6 +1594,69 @@ do_download_callback(
     return 0;
 }
 
+/* the options of download and upload */
+static const char transfer_short_options[] = "+t:";
+static struct option transfer_long_options[] =
+{
+    {"transfer", required_argument, NULL, 't'},
+    {NULL,       no_argument,       NULL, 0  }
+};
+
+/*
+ * get the libtrans transfer for its name
+ */
+static int
+get_transfer(const char *name, int *transfer)
+{
+    if (strcmp(name, "s1") == 0 || strcmp(name, "serial1") == 0)
+        *transfer = opencbm_transfer_serial1;
+    else if (strcmp(name, "s2") == 0 || strcmp(name, "serial2") == 0)
+        *transfer = opencbm_transfer_serial2;
+    else if (strcmp(name, "pp") == 0 || strcmp(name, "parallel") == 0)
+        *transfer = opencbm_transfer_parallel;
+    else if (strcmp(name, "auto") == 0)
+        *transfer = opencbm_transfer_auto;
+    else
+    {
+        fprintf(stderr, "unknown transfer '%s'\n", name);
+        return 1;
+    }
+
+    return 0;
+}
+
+/*
+ * process the options of download and upload: the transfer
+ * through the libtrans turbo routines, if any. *transfer is
+ * -1 if the memory is to be transferred with M-R or M-W.
+ */
+static int
+process_transfer_options(OPTIONS * const options, int *transfer)
+{
+    int c;
+
+    *transfer = -1;
+
+    while ((c = process_individual_option(options, transfer_short_options, transfer_long_options)) != EOF)
+    {
+        switch (c)
+        {
+        case 't':
+            if (get_transfer(optarg, transfer))
+                return 1;
+            break;
+
+        default:
+            return 1;
+        }
+    }
+
+    if (*transfer != -1)
+        libopencbmtransfer_set_transfer((opencbm_transfer_t) *transfer);
+
+    return 0;
+}
+
 /*
  * read device memory, dump to stdout or a file
  */
@@ -1234,10 +1667,11 @@ static int do_download(CBM_FILE fd, OPTIONS * const options)
     char *tail;
     uint8_t *buf = NULL;
     FILE *f;
+    int transfer;
 
     char *tmpstring;
 
-    if (skip_options(options))
+    if (process_transfer_options(options, &transfer))
         return 1;
 
     // process the drive number (unit)
@@ -1287,7 +1721,13 @@ static int do_download(CBM_FILE fd, OPTIONS * const options)
                 fprintf(stderr, "Could not allocate memory for transfer!\n");
                 break;
         }
-        read = cbm_dos_memory_read(fd, buf, count, unit, addr, count, do_download_callback, &addr);
+        if (transfer != -1) {
+            read = libopencbmtransfer_download(fd, unit, addr, buf, count);
+            libopencbmtransfer_detach(fd, unit);
+        }
+        else {
+            read = cbm_dos_memory_read(fd, buf, count, unit, addr, count, do_download_callback, &addr);
+        }
         if (read != 0) {
             rv = 1;
             fprintf(stderr, "A transfer error occurred!\n");
@@ -1330,8 +1770,9 @@ static int do_upload(CBM_FILE fd, OPTIONS * const options)
     unsigned int buflen = 65537;
     unsigned char *buf;
     FILE *f;
+    int transfer;
 
-    if (skip_options(options))
+    if (process_transfer_options(options, &transfer))
         return 1;
 
     // process the drive number (unit)
@@ -1418,7 +1859,15 @@ static int do_upload(CBM_FILE fd, OPTIONS * const options)
             buf[i] = cbm_ascii2petscii_c(buf[i]);
     }
 
-    rv = (cbm_upload(fd, unit, addr, buf, size) == (int)size) ? 0 : 1;
+    if (transfer != -1)
+    {
+        rv = libopencbmtransfer_upload(fd, unit, addr, buf, size);
+        libopencbmtransfer_detach(fd, unit);
+    }
+    else
+    {
+        rv = (cbm_upload(fd, unit, addr, buf, size) == (int)size) ? 0 : 1;
+    }
 
     if ( rv != 0 ) {
         fprintf(stderr, "A transfer error occurred!\n");
@@ -1429,6 +1878,144 @@ static int do_upload(CBM_FILE fd, OPTIONS * const options)
     return rv;
 }
 
+/*
+ * the drive memory the benchmark writes to: the DOS buffers, which
+ * are not used while the drive is idle. Their contents are restored
+ * afterwards.
+ */
+#define BENCH_WRITE_ADDRESS 0x300
+#define BENCH_WRITE_SIZE    0x500
+
+/* the drive memory the benchmark reads from: the ROM */
+#define BENCH_READ_ADDRESS  0xC000
+
+/* the number of status requests to measure the command latency */
+#define BENCH_STATUS_COUNT  16
+
+/*
+ * output one result of the benchmark
+ */
+static void bench_report(const char *name, unsigned int bytes, double start, int rv)
+{
+    double us = arch_time_us() - start;
+
+    if (rv != 0)
+        printf("%-24s failed\n", name);
+    else if (bytes == 0)
+        printf("%-24s %8.2f ms per request\n", name, us / 1000 / BENCH_STATUS_COUNT);
+    else
+        printf("%-24s %6u bytes in %8.2f ms: %8.0f bytes/s\n",
+            name, bytes, us / 1000, us > 0 ? bytes * 1e6 / us : 0);
+}
+
+/*
+ * measure the throughput of the transfers with a drive
+ */
+static int do_bench(CBM_FILE fd, OPTIONS * const options)
+{
+    unsigned char unit;
+    unsigned int size = 0x1000;
+    unsigned int write_size;
+    int transfer = -1;
+    unsigned char *buf;
+    unsigned char saved[BENCH_WRITE_SIZE];
+    char status[40];
+    char *tail;
+    double start;
+    int rv = 0;
+    int i;
+    int c;
+
+    static const char short_options[] = "+s:t:";
+    static struct option long_options[] =
+    {
+        {"size",     required_argument, NULL, 's'},
+        {"transfer", required_argument, NULL, 't'},
+        {NULL,       no_argument,       NULL, 0  }
+    };
+
+    // first of all, process the options given
+
+    while ((c = process_individual_option(options, short_options, long_options)) != EOF)
+    {
+        switch (c)
+        {
+        case 's':
+            size = strtoul(optarg, &tail, 0);
+            if (size == 0 || size > 0x10000 - BENCH_READ_ADDRESS || *tail)
+            {
+                fprintf(stderr, "invalid size: %s\n", optarg);
+                return 1;
+            }
+            break;
+
+        case 't':
+            if (get_transfer(optarg, &transfer))
+                return 1;
+            break;
+
+        default:
+            return 1;
+        }
+    }
+
+    if (get_argument_int_as_primary_address(options, &unit))
+        return 1;
+
+    if (check_if_parameters_ok(options))
+        return 1;
+
+    buf = malloc(size);
+    if (!buf)
+    {
+        fprintf(stderr, "Not enough memory for buffer.\n");
+        return 1;
+    }
+
+    write_size = size < BENCH_WRITE_SIZE ? size : BENCH_WRITE_SIZE;
+
+    start = arch_time_us();
+    for (i = 0; i < BENCH_STATUS_COUNT; i++)
+        cbm_device_status(fd, unit, status, sizeof(status));
+    bench_report("command latency", 0, start, 0);
+
+    start = arch_time_us();
+    rv = cbm_download(fd, unit, BENCH_READ_ADDRESS, buf, size) == (int) size ? 0 : 1;
+    bench_report("M-R read", size, start, rv);
+
+    start = arch_time_us();
+    rv = cbm_dos_memory_read(fd, buf, size, unit, BENCH_READ_ADDRESS, size, NULL, NULL);
+    bench_report("batched M-R read", size, start, rv);
+
+    // write the buffers back as they were, so the drive is not disturbed
+
+    if (cbm_dos_memory_read(fd, saved, write_size, unit, BENCH_WRITE_ADDRESS, write_size, NULL, NULL) == 0)
+    {
+        start = arch_time_us();
+        rv = cbm_upload(fd, unit, BENCH_WRITE_ADDRESS, saved, write_size) == (int) write_size ? 0 : 1;
+        bench_report("M-W write", write_size, start, rv);
+    }
+    else
+    {
+        bench_report("M-W write", write_size, 0, 1);
+    }
+
+    if (transfer != -1)
+    {
+        libopencbmtransfer_set_transfer((opencbm_transfer_t) transfer);
+
+        start = arch_time_us();
+        rv = libopencbmtransfer_download(fd, unit, BENCH_READ_ADDRESS, buf, size);
+        bench_report("turbo read", size, start, rv);
+
+        libopencbmtransfer_remove(fd, unit);
+    }
+
+    free(buf);
+
+    return 0;
+}
+
 /*
  * identify connected devices
  */
@@ -1542,6 +2129,132 @@ static int do_detect(CBM_FILE fd, OPTIONS * const options)
     return num_devices > 0 ? 0 : 1;
 }
 
+static volatile int sniff_stop = 0;
+
+static void ARCH_SIGNALDECL sniff_ctrlbreak(int dummy)
+{
+    if (sniff_stop++)
+        exit(1);
+}
+
+static void sniff_line(FILE *f, double t, double delta, int lines)
+{
+    fprintf(f, "%12.6f %+12.1f  %-4s %-4s %-4s %-5s %-3s\n",
+            t / 1000000.0, delta,
+            (lines & IEC_ATN)   ? "ATN"   : "-",
+            (lines & IEC_CLOCK) ? "CLK"   : "-",
+            (lines & IEC_DATA)  ? "DATA"  : "-",
+            (lines & IEC_RESET) ? "RESET" : "-",
+            (lines & IEC_SRQ)   ? "SRQ"   : "-");
+}
+
+/*
+ * watch the lines of the IEC bus without taking part, and output every
+ * change with the time it was seen at
+ */
+static int do_sniff(CBM_FILE fd, OPTIONS * const options)
+{
+    FILE *f;
+    double seconds = 0;
+    unsigned long count = 0;
+    unsigned long changes = 0;
+    unsigned long polls = 0;
+    double start, now, last_change;
+    int last_lines;
+    int lines;
+    char *tail;
+    int rv = 0;
+    int c;
+
+    static const char short_options[] = "+t:c:";
+    static struct option long_options[] =
+    {
+        {"time",  required_argument, NULL, 't'},
+        {"count", required_argument, NULL, 'c'},
+        {NULL,    no_argument,       NULL, 0  }
+    };
+
+    // first of all, process the options given
+
+    while ((c = process_individual_option(options, short_options, long_options)) != EOF)
+    {
+        switch (c)
+        {
+        case 't':
+            seconds = strtod(optarg, &tail);
+            if (seconds <= 0 || *tail)
+            {
+                fprintf(stderr, "invalid time: %s\n", optarg);
+                return 1;
+            }
+            break;
+
+        case 'c':
+            count = strtoul(optarg, &tail, 0);
+            if (count == 0 || *tail)
+            {
+                fprintf(stderr, "invalid count: %s\n", optarg);
+                return 1;
+            }
+            break;
+
+        default:
+            return 1;
+        }
+    }
+
+    if (get_argument_file_for_write(options, &f))
+        return 1;
+
+    sniff_stop = 0;
+    arch_set_ctrlbreak_handler(sniff_ctrlbreak);
+
+    fprintf(f, "# %10s %12s  lines asserted\n", "seconds", "+us");
+
+    start = arch_time_us();
+    last_change = start;
+    last_lines = cbm_iec_poll(fd);
+    sniff_line(f, 0, 0, last_lines);
+
+    while (!sniff_stop)
+    {
+        lines = cbm_iec_poll(fd);
+        now = arch_time_us();
+        polls++;
+
+        if (lines < 0)
+        {
+            fprintf(stderr, "could not read the lines of the IEC bus\n");
+            rv = 1;
+            break;
+        }
+
+        if (lines != last_lines)
+        {
+            sniff_line(f, now - start, now - last_change, lines);
+            last_lines = lines;
+            last_change = now;
+            if (count && ++changes >= count)
+                break;
+        }
+
+        if (seconds > 0 && now - start >= seconds * 1000000.0)
+            break;
+    }
+
+    now = arch_time_us();
+
+    // the time between two polls is the resolution of the times
+
+    fprintf(stderr, "%lu changes in %.3f s, one poll every %.1f us\n",
+            changes, (now - start) / 1000000.0,
+            polls ? (now - start) / polls : 0.0);
+
+    fclose(f);
+
+    return rv;
+}
+
 /*
  * wait until user changes the disk
  */
@@ -1635,6 +2348,12 @@ static int do_change(CBM_FILE fd, OPTIONS * const options)
     return rv;
 }
 
+/*! the maximum length of a line in a script for do_script() */
+#define SCRIPT_LINE_MAX 1024
+
+/*! the maximum number of arguments in a line of a script */
+#define SCRIPT_ARGS_MAX 64
+
 struct prog
 {
     int      need_driver;
@@ -1646,6 +2365,185 @@ struct prog
     char    *help_text;
 };
 
+static struct prog *
+process_cmdline_find_command(OPTIONS *options);
+
+/*
+ * Split a line of a script into its arguments. The line is changed in place,
+ * argv[] points into it. Arguments are separated by white space; an argument
+ * in double quotes may contain white space, or be empty (""). A '#' at the
+ * start of an argument starts a comment.
+ * Returns the number of arguments, or -1 on an error.
+ */
+static int
+split_script_line(char *line, char *argv[], int max_args)
+{
+    int argc = 0;
+
+    for (;;)
+    {
+        while (*line == ' ' || *line == '\t' || *line == '\r' || *line == '\n')
+            line++;
+
+        if (*line == 0 || *line == '#')
+            break;
+
+        if (argc == max_args)
+        {
+            fprintf(stderr, "Too many arguments, only %u are allowed.\n", max_args);
+            return -1;
+        }
+
+        if (*line == '"')
+        {
+            argv[argc++] = ++line;
+
+            while (*line && *line != '"')
+                line++;
+
+            if (*line == 0)
+            {
+                fprintf(stderr, "Missing closing quote.\n");
+                return -1;
+            }
+        }
+        else
+        {
+            argv[argc++] = line;
+
+            while (*line && *line != ' ' && *line != '\t' && *line != '\r' && *line != '\n')
+                line++;
+
+            if (*line == 0)
+                break;
+        }
+
+        *line++ = 0;
+    }
+
+    return argc;
+}
+
+/*
+ * Execute the actions given in a script, one per line,
+ * all with the one driver handle opened by main()
+ */
+static int do_script(CBM_FILE fd, OPTIONS * const options)
+{
+    FILE *f;
+    char *fn;
+    char line[SCRIPT_LINE_MAX];
+    char *argv[SCRIPT_ARGS_MAX + 1];
+    unsigned int lineno = 0;
+    int keep_going = 0;
+    int errors = 0;
+    int rv;
+    int c;
+
+    static const char short_options[] = "+k";
+    static struct option long_options[] =
+    {
+        {"keep-going", no_argument, NULL, 'k'},
+        {NULL,         no_argument, NULL, 0  }
+    };
+
+    // first of all, process the options given
+
+    while ((c = process_individual_option(options, short_options, long_options)) != EOF)
+    {
+        switch (c)
+        {
+        case 'k':
+            keep_going = 1;
+            break;
+
+        default:
+            return 1;
+        }
+    }
+
+    if (get_argument_file_for_read(options, &f, &fn))
+        return 1;
+
+    while (fgets(line, sizeof(line), f) != NULL)
+    {
+        OPTIONS lineoptions;
+        struct prog *pprog;
+        int argc;
+
+        ++lineno;
+
+        if (strchr(line, '\n') == NULL && !feof(f))
+        {
+            fprintf(stderr, "%s:%u: line too long, aborting...\n", fn, lineno);
+            errors++;
+            break;
+        }
+
+        // argv[0] is the name of the action, just as on the command-line
+
+        argc = split_script_line(line, argv, SCRIPT_ARGS_MAX);
+
+        if (argc < 0)
+        {
+            fprintf(stderr, "%s:%u: invalid line.\n", fn, lineno);
+            rv = 1;
+        }
+        else if (argc == 0)
+        {
+            continue;
+        }
+        else
+        {
+            argv[argc] = NULL;
+
+            lineoptions = *options;
+            lineoptions.argc = argc;
+            lineoptions.argv = argv;
+            lineoptions.actionoptions = 0;
+
+            pprog = process_cmdline_find_command(&lineoptions);
+
+            if (pprog == NULL || pprog->prog == do_script)
+            {
+                fprintf(stderr, "%s:%u: invalid command '%s'.\n", fn, lineno, argv[0]);
+                rv = 1;
+            }
+            else
+            {
+                // if neither PETSCII or RAW was specified, use default for that command
+                if (options->petsciiraw == PA_UNSPEC)
+                    lineoptions.petsciiraw = pprog->petsciiraw;
+
+                arch_set_errno(0);
+
+                rv = pprog->prog(fd, &lineoptions) != 0;
+                if (rv)
+                {
+                    if (arch_get_errno())
+                        arch_error(0, arch_get_errno(), "%s:%u: %s", fn, lineno, pprog->name);
+                    else
+                        fprintf(stderr, "%s:%u: %s failed.\n", fn, lineno, pprog->name);
+                }
+            }
+        }
+
+        if (rv)
+        {
+            errors++;
+
+            if (!keep_going)
+                break;
+        }
+    }
+
+    if (f != stdin)
+        fclose(f);
+
+    return errors != 0;
+}
+
+
 static struct prog prog_table[] =
 {
 #ifdef DBG_TEST_UPDOWN
@@ -1788,16 +2686,39 @@ static struct prog prog_table[] =
         "NOTE: You have to give the commands in lower-case letters.\n"
         "      Upper case will NOT work!\n" },
 
-    {1, "dir"     , PA_PETSCII, do_dir     , "<device> [<filespec>]",
+    {1, "dir"     , PA_PETSCII, do_dir     , "[-f|--fast] <device> [<filespec>]",
         "output the directory of the disk in the specified drive",
         "This command gets the directory of a disk in the drive.\n\n"
+        "-f, --fast reads the directory track in whole blocks and builds the\n"
+        "           listing on the PC, instead of reading the listing byte by\n"
+        "           byte. This works with 1541, 1570 and 1571 drives only.\n"
         "<device>   is the device number of the drive (bus ID).\n"
         "<filespec> can be used to restrict the number of files. wildcards\n"
-        "           are allowed, but drive limitations apply." },
-
-    {1, "download", PA_RAW,     do_download, "<device> <adr> <count> [<file>]",
+        "           are allowed, but drive limitations apply. <filespec>\n"
+        "           cannot be used with -f." },
+
+    {0, "imgdir"  , PA_PETSCII, do_imgdir  , "<image> [<image2> ... <imageN>]",
+        "output the directories of disk image files",
+        "This command outputs the directories of .d64 and .d71 image files,\n"
+        "the same way as 'dir --fast' does for a disk; no drive is needed.\n"
+        "Only the directory track of an image is read, so a whole archive of\n"
+        "images is catalogued quickly.\n"
+        "<image>    is the name of an image file. With more than one, every\n"
+        "           listing is headed by the name of its image." },
+
+    {1, "download", PA_RAW,     do_download, "[-t <transfer>] <device> <adr> <count> [<file>]",
         "download memory contents from the floppy drive",
         "With this command, you can get data from the floppy drive memory.\n"
+        "-t <transfer>, --transfer=<transfer>\n"
+        "         transfer the memory through turbo routines in the drive,\n"
+        "         with <transfer> one of s1, s2, pp or auto; auto takes pp\n"
+        "         with an XP1541 cable, s2 with no other drive on the bus, and\n"
+        "         s1 otherwise. Small ranges, and ranges\n"
+        "         which overlap the turbo routines at $0500-$05FF and\n"
+        "         $0700-$07FF, are transferred normally. The turbo\n"
+        "         routines are left in the drive's memory afterwards;\n"
+        "         as long as they are there, the next transfer does\n"
+        "         not need to upload them again.\n"
         "<device> is the device number of the drive.\n"
         "<adr>    is the starting address of the memory region to get.\n"
         "         it can be given in decimal or in hex (with a 0x prefix).\n"
@@ -1810,9 +2731,19 @@ static struct prog prog_table[] =
         " cbmctrl download 8 0xc000 0x4000 1541ROM.BIN\n"
         " * reads the 1541 ROM (from $C000 to $FFFF) from drive 8 into 1541ROM.BIN" },
 
-    {1, "upload"  , PA_RAW,     do_upload  , "<device> <adr> [<file>]",
+    {1, "upload"  , PA_RAW,     do_upload  , "[-t <transfer>] <device> <adr> [<file>]",
         "upload memory contents to the floppy drive",
         "With this command, you can write data to the floppy drive memory.\n"
+        "-t <transfer>, --transfer=<transfer>\n"
+        "         transfer the memory through turbo routines in the drive,\n"
+        "         with <transfer> one of s1, s2, pp or auto; auto takes pp\n"
+        "         with an XP1541 cable, s2 with no other drive on the bus, and\n"
+        "         s1 otherwise. Small ranges, and ranges\n"
+        "         which overlap the turbo routines at $0500-$05FF and\n"
+        "         $0700-$07FF, are transferred normally. The turbo\n"
+        "         routines are left in the drive's memory afterwards;\n"
+        "         as long as they are there, the next transfer does\n"
+        "         not need to upload them again.\n"
         "<device> is the device number of the drive.\n"
         "<adr>    is the starting address of the memory region to write to.\n"
         "         it can be given in decimal or in hex (with a 0x prefix).\n"
@@ -1825,6 +2756,19 @@ static struct prog prog_table[] =
         " cbmctrl upload 8 0x500 BUFFER2.BIN\n"
         " * writes the file BUFFER2.BIN to drive 8, address $500." },
 
+    {1, "bench"   , PA_UNSPEC,  do_bench   , "[-s <size>] [-t <transfer>] <device>",
+        "measure the throughput of the transfers with the floppy drive",
+        "This command measures how fast the transfers with a drive are.\n"
+        "It measures the latency of a command, reading the drive's ROM with\n"
+        "M-R, single and batched, and writing the DOS buffers from $0300 to\n"
+        "$07FF with M-W. The contents of the buffers are restored.\n\n"
+        "-s <size>, --size=<size>\n"
+        "         the number of bytes to read (default: 4096).\n"
+        "-t <transfer>, --transfer=<transfer>\n"
+        "         read the ROM through turbo routines with <transfer>, too;\n"
+        "         one of s1, s2, pp or auto. The bus is reset afterwards.\n"
+        "<device> is the device number of the drive." },
+
     {1, "srq"     , PA_UNSPEC,  do_iec_srq  , "",
         "Set the srq line on the IEC bus.",
         "This command unconditionally sets the SRQ line on the IEC bus." },
@@ -1882,6 +2826,27 @@ static struct prog prog_table[] =
         "Use option --verbose for verbose output.\n"
         "Use option --parcheck for more thorough testing of the parallel cable.\n" },
 
+    {1, "sniff"   , PA_UNSPEC,  do_sniff   , "[-t <seconds>] [-c <count>] [<file>]",
+        "watch the lines of the IEC bus and log every change with its time",
+        "This command watches the ATN, CLK, DATA, RESET and SRQ lines of the\n"
+        "IEC bus, without driving any of them, and outputs a line with the\n"
+        "lines asserted whenever they change: the time since the start in\n"
+        "seconds, the time since the previous change in microseconds, and\n"
+        "the names of the lines which are asserted now.\n"
+        "The lines are polled as fast as the adapter answers; the time\n"
+        "between two polls, which is output at the end, is the resolution of\n"
+        "the times. Changes which are shorter than that may be missed.\n\n"
+        "-t <seconds>, --time=<seconds>\n"
+        "         stop after <seconds> seconds (default: until Ctrl+C).\n"
+        "-c <count>, --count=<count>\n"
+        "         stop after <count> changes.\n"
+        "<file>   (optional) file name of a file to write the changes to.\n"
+        "         If this name is not given or it is a dash ('-'), the\n"
+        "         changes will be written to stdout, normally the console.\n\n"
+        "Example:\n"
+        " cbmctrl sniff -t 10 bus.log\n"
+        " * logs the changes of the IEC bus lines for 10 seconds." },
+
     {1, "change"  , PA_UNSPEC,  do_change  , "<device>",
         "wait for a disk to be changed in the specified drive",
         "This command waits for a disk to be changed in the specified drive.\n\n"
@@ -1893,6 +2858,32 @@ static struct prog prog_table[] =
         "Because of this, just opening the drive and closing it again (without\n"
         "actually removing the disk) will not work in most cases." },
 
+    {1, "script"  , PA_UNSPEC,  do_script  , "[-k|--keep-going] [<file>]",
+        "execute the actions given in a script",
+        "This command executes a sequence of actions, one per line, with the\n"
+        "same access to the driver. Thus, the driver is only opened once for\n"
+        "all of them, and e.g. a lock ... unlock sequence is not broken.\n\n"
+        "<file>   (optional) file name of the script. If this name is not given\n"
+        "         or it is a dash ('-'), the script is read from stdin.\n\n"
+        "Each line consists of an action and its options and arguments, just as\n"
+        "on the command-line. Arguments are separated by white space; enclose an\n"
+        "argument in double quotes if it contains white space, or to give an\n"
+        "empty argument (\"\"). Empty lines and everything after a '#' at the\n"
+        "start of an argument are ignored.\n"
+        "The global options (--petscii, --raw, ...) apply to all of the actions.\n\n"
+        "The script stops at the first action that fails, unless the option\n"
+        "-k or --keep-going is given.\n\n"
+        "Example:\n"
+        " cbmctrl script - <<EOF\n"
+        " lock\n"
+        " command 8 \"I0:\"\n"
+        " status 8\n"
+        " unlock\n"
+        " EOF\n\n"
+        "NOTES:\n"
+        "- If the script is read from stdin, the actions cannot read from stdin.\n"
+        "- A script cannot execute another script." },
+
     {0, NULL, PA_UNSPEC, NULL, NULL, NULL}
 };
 
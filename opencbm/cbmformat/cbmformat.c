@@ -42,6 +42,9 @@ static void help()
 "                             (0x4b, 0x01...) instead of zeroes\n"
 "  -s, --status               display drive status after formatting\n"
 "  -p, --progress             display progress indicator\n"
+"  -q, --quick                only write a new BAM and directory to a disk\n"
+"                             which is formatted already. Without an ID,\n"
+"                             the disk keeps its ID\n"
 "\n"
 );
 }
@@ -51,6 +54,116 @@ static void hint(char *s)
     fprintf(stderr, "Try `%s' -h for more information.\n", s);
 }
 
+/* the number of sectors of a track */
+static unsigned char sectors(unsigned char track)
+{
+    return track < 18 ? 21 : track < 25 ? 19 : track < 31 ? 18 : 17;
+}
+
+/* the BAM entry of an empty track */
+static void bam_track(unsigned char *entry, unsigned char track)
+{
+    unsigned long map = (1UL << sectors(track)) - 1;
+
+    if(track == 18)
+    {
+        map &= ~3UL;    /* BAM and first directory block */
+    }
+    entry[0] = (unsigned char) (sectors(track) - (track == 18 ? 2 : 0));
+    entry[1] = (unsigned char) (map & 0xff);
+    entry[2] = (unsigned char) ((map >> 8) & 0xff);
+    entry[3] = (unsigned char) ((map >> 16) & 0xff);
+}
+
+/*
+ * Quick format of a disk formatted before: only the BAM and the first
+ * directory block on track 18 are written, the other blocks are left
+ * as they are. Without an ID, the disk keeps the one it has.
+ */
+static int quick_format(CBM_FILE fd, unsigned char drive, const char *name,
+                        int id_ofs, unsigned char tracks)
+{
+    unsigned char bam[256], dir[256], id[2];
+    char cmd[40];
+    int name_len = id_ofs ? id_ofs : (int) strlen(name);
+    int err, t;
+
+    if(name_len > 16)
+    {
+        fprintf(stderr, "Disk name too long\n");
+        return 1;
+    }
+
+    if(cbm_open(fd, drive, 2, "#", 1) != 0)
+    {
+        return 1;
+    }
+
+    /* the disk must have been formatted, and we need its ID */
+    cbm_exec_command(fd, drive, "U1:2 0 18 0", 11);
+    err = cbm_device_status(fd, drive, cmd, sizeof(cmd));
+    if(err)
+    {
+        fprintf(stderr, "Cannot quick format, the disk must be formatted "
+                        "already: %s\n", cmd);
+        cbm_close(fd, drive, 2);
+        return 1;
+    }
+    cbm_exec_command(fd, drive, "B-P2 0", 6);
+    cbm_talk(fd, drive, 2);
+    err = cbm_raw_read(fd, bam, sizeof(bam)) != sizeof(bam);
+    cbm_untalk(fd);
+
+    if(!err)
+    {
+        if(id_ofs)
+        {
+            const char *new_id = name + id_ofs + 1;
+
+            bam[0xa2] = new_id[0] ? (unsigned char) new_id[0] : 0xa0;
+            bam[0xa3] = new_id[0] && new_id[1] ? (unsigned char) new_id[1] : 0xa0;
+        }
+        memcpy(id, bam + 0xa2, 2);
+        memset(bam, 0, sizeof(bam));
+        bam[0] = 18;
+        bam[1] = 1;
+        bam[2] = 0x41;
+        for(t = 1; t <= tracks; t++)
+        {
+            bam_track(bam + (t <= 35 ? 4 * t : 0xc0 + 4 * (t - 36)), t);
+        }
+        memset(bam + 0x90, 0xa0, 0x1b);
+        memcpy(bam + 0x90, name, name_len);
+        memcpy(bam + 0xa2, id, 2);
+        bam[0xa5] = '2';
+        bam[0xa6] = 0x41;
+
+        memset(dir, 0, sizeof(dir));
+        dir[1] = 0xff;
+
+        for(t = 0; t < 2 && !err; t++)
+        {
+            cbm_exec_command(fd, drive, "B-P2 0", 6);
+            cbm_listen(fd, drive, 2);
+            err = cbm_raw_write(fd, t ? dir : bam, 256) != 256;
+            cbm_unlisten(fd);
+            sprintf(cmd, "U2:2 0 18 %d", t);
+            cbm_exec_command(fd, drive, cmd, strlen(cmd));
+            err = err || cbm_device_status(fd, drive, cmd, sizeof(cmd)) != 0;
+        }
+    }
+    cbm_close(fd, drive, 2);
+
+    /* let the DOS read the new BAM */
+    cbm_exec_command(fd, drive, "I0", 2);
+
+    if(err)
+    {
+        fprintf(stderr, "Quick format failed\n");
+    }
+    return err;
+}
+
 int ARCH_MAINDECL main(int argc, char *argv[])
 {
     int status = 0, id_ofs = 0, name_len, i;
@@ -58,6 +171,7 @@ int ARCH_MAINDECL main(int argc, char *argv[])
     unsigned char drive, tracks = 35, bump = 1, orig = 0, show_progress = 0;
     unsigned char verify = 0;
     unsigned char demagnetize = 0;
+    unsigned char quick = 0;
     char cmd[40], name[20], *arg;
     int err = 0;
     char *adapter = NULL;
@@ -75,13 +189,14 @@ int ARCH_MAINDECL main(int argc, char *argv[])
         { "progress"   , no_argument      , NULL, 'p' },
         { "verify"     , no_argument      , NULL, 'v' },
         { "clear"      , no_argument      , NULL, 'c' },
+        { "quick"      , no_argument      , NULL, 'q' },
 
         /* undocumented */
         { "end-track"  , required_argument, NULL, 't' },
         { NULL         , 0                , NULL, 0   }
     };
 
-    const char shortopts[] ="hVnxospvct:@:";
+    const char shortopts[] ="hVnxospvcqt:@:";
     while((option = getopt_long(argc, argv, shortopts, longopts, NULL)) != -1)
     {
         switch(option)
@@ -104,6 +219,8 @@ int ARCH_MAINDECL main(int argc, char *argv[])
                       break;
             case 'c': demagnetize = 1;
                       break;
+            case 'q': quick = 1;
+                      break;
             case 't': tracks = arch_atoc(optarg);
                       break;
             case '@': if (adapter == NULL)
@@ -160,6 +277,25 @@ int ARCH_MAINDECL main(int argc, char *argv[])
     }
     name[name_len] = 0;
 
+    if(quick)
+    {
+        if(cbm_driver_open_ex(&fd, adapter) != 0)
+        {
+            arch_error(0, arch_get_errno(), "%s", cbm_get_driver_name_ex(adapter));
+            cbmlibmisc_strfree(adapter);
+            return 1;
+        }
+        err = quick_format(fd, drive, name, id_ofs, tracks);
+        if(!err && status)
+        {
+            cbm_device_status(fd, drive, cmd, sizeof(cmd));
+            printf("%s\n", cmd);
+        }
+        cbm_driver_close(fd);
+        cbmlibmisc_strfree(adapter);
+        return err;
+    }
+
     if(cbm_driver_open_ex(&fd, adapter) == 0)
     {
         cbm_upload(fd, drive, 0x0500, dskfrmt, sizeof(dskfrmt));
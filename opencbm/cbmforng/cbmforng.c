@@ -11,20 +11,64 @@
 #include "cbmforng.h"
 #include "libmisc.h"
 
+#ifndef WIN32
+# include <pthread.h>
+#endif
+
 static unsigned char dskfrmt[] = {
 #include "cbmforng.inc"
 };
 
+/*
+ * the maximum number of drives which can be formatted with one call
+ */
+#define MAX_DRIVES 8
+
+typedef struct
+{
+    const char   *spec;             // the drive as given on the command line
+    unsigned char drive;
+    int           format_error;     // error of the status after formatting
+    int           berror;           // error of the last status read
+    char          status[40];       // the status after formatting
+    char          final[40];        // the status after all is done
+#if defined(DebugFormat) && DebugFormat!=0
+    int           have_debug;
+    unsigned char debug[0x100];     // logging buffer of the floppy stub
+#endif
+} FormatDrive;
+
+typedef struct
+{
+    char         *adapter;          // NULL for the default adapter
+    FormatDrive  *drives[MAX_DRIVES];
+    int           count;
+    int           error;            // != 0: the driver could not be opened
+    int           errnum;
+} FormatBus;
+
+    /*
+     * the parameters are the same for all drives
+     */
+static struct FormatParameters parmBlock;
+static char name[20];
+static int name_len;
+static unsigned char endtrack = 35;
+
 static void help()
 {
     printf(
 #ifdef CBMFORNG
-"Usage: cbmforng [OPTION]... DRIVE NAME,ID\n"
+"Usage: cbmforng [OPTION]... DRIVE... NAME,ID\n"
 #else
-"Usage: cbmformat [OPTION]... DRIVE NAME,ID\n"
+"Usage: cbmformat [OPTION]... DRIVE... NAME,ID\n"
 #endif
 "Fast and reliable CBM-1541 disk formatter\n"
 "\n"
+"  DRIVE may be given as <adapter>=<drive> to use another adapter than the\n"
+"  one given with -@. Up to 8 drives are formatted with the same NAME,ID;\n"
+"  drives on different adapters are formatted at the same time.\n"
+"\n"
 "  -h, --help                 display this help and exit\n"
 "  -V, --version              display version information and exit\n"
 "  -@, --adapter=plugin:bus   tell OpenCBM which backend plugin and bus to use\n"
@@ -35,7 +79,8 @@ static void help()
 "  -c, --clear                clear (demagnetize) this disk.\n"
 "                             this is highly recommended if this disk\n"
 "                             is used for the first time.\n"
-"  -v, --verify               verify each track after it is written\n"
+"  -v, --verify               verify each track after it is written, in the\n"
+"                             same pass, and report the tracks which failed\n"
 "  -o, --original             fill sectors with the original pattern\n"
 "                             (0x4b, 0x01...) instead of zeroes\n"
 "  -s, --status               display drive status after formatting\n"
@@ -113,16 +158,287 @@ static void prepareFmtPattern(struct FormatParameters *GCRbuf, unsigned char pat
     gcr_4_to_5_encode(source, GCRbuf->CHDR2ND, sizeof(source), sizeof(GCRbuf->CHDR2ND));
 }
 
-int ARCH_MAINDECL main(int argc, char *argv[])
+#if defined(DebugFormat) && DebugFormat!=0  // verbose output
+static void printDebugBuffer(unsigned char *data, unsigned int size)
+{
+    float RPMval;
+    int sectors, virtGAPsze, remainder, trackTailGAP, flags, retry = 0, lastTr;
+    const char *vrfy;
+    unsigned int i;
+
+    printf("Track|Retry|sctrs|slctd|| GAP |modulo |modulo|tail| Verify  | RPM  |\n"
+           "     |     |     | GAP ||adjst|complmt| dvsr |GAP |         |      |\n"
+           "-----+-----+-----+-----++-----+-------+------+----+---------+------+\n");
+
+    lastTr=-1;
+    for (i=0; i < size; i+=4)
+    {
+        if(data[i]==0) break;   // no more data is available
+
+        if(data[i]==lastTr) retry++;
+        else                retry=0;
+        lastTr=data[i];
+
+        if(data[i]>=25)         // preselect track dependent constants
+        {
+            if(data[i]>=31) sectors=17, RPMval=60000000.0f/16;
+            else            sectors=18, RPMval=60000000.0f/15;
+        }
+        else
+        {
+            if(data[i]>=18) sectors=19, RPMval=60000000.0f/14;
+            else            sectors=21, RPMval=60000000.0f/13;
+        }
+
+            // separate some flags
+        flags=(data[i+3]>>6)&0x03;
+        data[i+3]&=0x3f;
+
+        switch(flags)
+        {
+            case 0x01: vrfy="SYNC fail"; break;
+            case 0x02: vrfy="   OK    "; break;
+            case 0x03: vrfy="vrfy fail"; break;
+            default:   vrfy="   ./.   ";
+        }
+
+            // recalculation of the track tail GAP out of the
+            // choosen GAP for this track, the new GAP size
+            // adjustment and the complement of the remainder
+            // of the adjustment division
+
+        virtGAPsze=data[i+1]        -5; // virtual GAP increase to
+            // prevent reformatting, when only one byte is missing
+            // and other offset compensations
+
+
+        remainder=((data[i+2]==0xff) ? virtGAPsze : sectors)
+                     - data[i+3];
+
+
+        trackTailGAP=((data[i+2]==0xff) ? 0 : data[i+2]*sectors + virtGAPsze)
+                     + remainder;
+
+            // the following constants are nybble based (double the
+            // size of the well known constants for SYNC lengths,
+            // block header size, data block GAP and data block)
+            //
+            // (0x01&data[i+1]&sectors) is a correction term, if "half
+            // GAPs" are written and the number of sectors is odd
+            //
+        // RPMval / (sectors * (10+20+18+10 + 650 + data[i+1]) - (0x01&data[i+1]&sectors) + trackTailGAP - data[i+1])
+
+        RPMval = (flags != 0x01) ?
+            RPMval / (sectors * (10+20+18+10 + 650 + data[i+1]) - (0x01&data[i+1]&sectors) + trackTailGAP - data[i+1])
+            : 0;
+
+        printf(" %3u | ", data[i]);
+        if(retry>0) printf("%3u", retry);
+        else        printf("   ");
+
+       /*      " |sctrs |slctd   || GAP    |modulo    |modulo   |tail | Verify  | RPM  |\n"
+        *      " |      | GAP    ||adjst   |complmt   |         | GAP |         |      |\n"
+        *      "-+----- +-----   ++-----   +-------   +------   +---- +---------+------+\n"
+        */
+        printf(" |  %2u |$%02X.%d||$%02X.%d| $%02X.%d | $%02X.%d|$%03X|%9s|%6.2f|\n",
+               sectors,
+               data[i+1]>>1,                       (data[i+1]<<3)&8,            // selected GAP
+               (((signed char)data[i+2])>>1)&0xFF, (data[i+2]<<3)&8,            // GAP adjust
+               data[i+3]>>1,                       (data[i+3]<<3)&8,            // modulo complement
+               remainder>>1,                       (remainder<<3)&8,            // modulo
+               (trackTailGAP>>1) + 1,                                           // track tail GAP (with roundup)
+               vrfy, RPMval);
+    }
+    printf("\n  *) Note: The fractional parts of all the GAP based numbers shown here\n"
+             "           (sedecimal values) are given due to nybble based calculations.\n");
+}
+
+    /*
+     * The floppy stub verifies each track right after it has been
+     * written, by comparing the GCR data read back with the patterns
+     * it was written from. A track is retried until its verification
+     * succeeds, so the last logging entry of every track tells if it
+     * is good. Returns the number of tracks which did not verify.
+     */
+static int printVerifyResult(const unsigned char *data, unsigned int size,
+                             unsigned char starttrack, unsigned char endtrack)
+{
+    unsigned char verified[43];
+    unsigned int i;
+    int tracks = 0, failed = 0, retries = 0, lastTr = -1;
+
+    memset(verified, 0, sizeof(verified));
+
+    for (i=0; i < size; i+=4)
+    {
+        if(data[i]==0) break;   // no more data is available
+        if(data[i] >= sizeof(verified)) break;
+
+        if(data[i]==lastTr) retries++;
+        lastTr=data[i];
+
+            // verified OK, if both flags are %10
+        verified[data[i]] = ((data[i+3]>>6)&0x03) == 0x02;
+    }
+
+    for (i=starttrack; i <= endtrack && i < sizeof(verified); i++)
+    {
+        tracks++;
+        if(!verified[i])
+        {
+            if(failed++ == 0) printf("Verify failed on track(s):");
+            printf(" %u", i);
+        }
+    }
+    if(failed) printf("\n");
+
+    printf("Verify: %d of %d tracks OK, %d retries\n", tracks - failed, tracks, retries);
+
+    return failed;
+}
+#endif
+
+static void formatDrive(CBM_FILE fd, FormatDrive *d)
+{
+    unsigned char track;
+    char cmd[40];
+
+    cbm_upload(fd, d->drive, 0x0300, dskfrmt, sizeof(dskfrmt));
+    cbm_upload(fd, d->drive, 0x0200 - sizeof(parmBlock), ((char *)(&parmBlock)), sizeof(parmBlock));
+
+    sprintf(cmd, "M-E%c%c0:%s", 3, 3, name);
+    cbm_exec_command(fd, d->drive, cmd, 7+name_len);
+    d->berror = cbm_device_status(fd, d->drive, d->status, sizeof(d->status));
+    d->format_error = d->berror;
+
+#if defined(DebugFormat) && DebugFormat!=0  // verbose output
+        // in case of an error, get the logging buffer from 0x0700 instead of 0x0500
+    d->have_debug = cbm_download(fd, d->drive, d->berror?0x0700:0x0500, d->debug, sizeof(d->debug)) == sizeof(d->debug);
+    d->berror = cbm_device_status(fd, d->drive, cmd, sizeof(cmd));
+#endif
+    if(!d->berror && (endtrack > 35))
+    {
+        cbm_open(fd, d->drive, 2, "#", 1);
+        cbm_exec_command(fd, d->drive, "U1:2 0 18 0", 11);
+        cbm_exec_command(fd, d->drive, "B-P2 192", 8);
+        cbm_listen(fd, d->drive, 2);
+        for(track = endtrack; track > 35; track--)
+        {
+            cbm_raw_write(fd, "\021\377\377\001", 4);
+        }
+        cbm_unlisten(fd);
+        cbm_exec_command(fd, d->drive, "U2:2 0 18 0", 11);
+        cbm_close(fd, d->drive, 2);
+    }
+    if(!d->berror)
+    {
+        cbm_device_status(fd, d->drive, d->final, sizeof(d->final));
+    }
+}
+
+    /*
+     * A 1541 running the formatter does not answer ATN before it is
+     * done, thus, it blocks the bus for all the other drives on it.
+     * The drives of one adapter are formatted one after the other,
+     * only different adapters work at the same time.
+     */
+static void formatBus(FormatBus *bus)
 {
-    int status = 0, id_ofs = 0, name_len;
     CBM_FILE fd;
-    unsigned char drive, starttrack = 1, endtrack = 35, bump = 1, orig = 0;
+    int i;
+
+    if(cbm_driver_open_ex(&fd, bus->adapter) != 0)
+    {
+        bus->error = 1;
+        bus->errnum = arch_get_errno();
+        return;
+    }
+
+    for(i = 0; i < bus->count; i++)
+    {
+        formatDrive(fd, bus->drives[i]);
+    }
+
+    cbm_driver_close(fd);
+}
+
+#ifdef WIN32
+static DWORD WINAPI formatBusThread(LPVOID Context)
+{
+    formatBus(Context);
+    return 0;
+}
+#else
+static void *formatBusThread(void *Context)
+{
+    formatBus(Context);
+    return NULL;
+}
+#endif
+
+static void formatAllBuses(FormatBus *buses, int count)
+{
+#ifdef WIN32
+    HANDLE threads[MAX_DRIVES];
+#else
+    pthread_t threads[MAX_DRIVES];
+#endif
+    int started[MAX_DRIVES];
+    int i;
+
+    if(count == 1)
+    {
+        formatBus(&buses[0]);
+        return;
+    }
+
+    for(i = 0; i < count; i++)
+    {
+#ifdef WIN32
+        threads[i] = CreateThread(NULL, 0, formatBusThread, &buses[i], 0, NULL);
+        started[i] = threads[i] != NULL;
+#else
+        started[i] = pthread_create(&threads[i], NULL, formatBusThread, &buses[i]) == 0;
+#endif
+    }
+
+    for(i = 0; i < count; i++)
+    {
+        if(!started[i])
+        {
+            // no thread for this one, format its drives here
+            formatBus(&buses[i]);
+            continue;
+        }
+#ifdef WIN32
+        WaitForSingleObject(threads[i], INFINITE);
+        CloseHandle(threads[i]);
+#else
+        pthread_join(threads[i], NULL);
+#endif
+    }
+}
+
+static int sameAdapter(const char *a, const char *b)
+{
+    if(a == NULL || b == NULL)
+    {
+        return a == b;
+    }
+    return strcmp(a, b) == 0;
+}
+
+int ARCH_MAINDECL main(int argc, char *argv[])
+{
+    int status = 0, id_ofs = 0;
+    unsigned char starttrack = 1, bump = 1, orig = 0;
     unsigned char verify = 0, demagnetize = 0, retries = 7;
-    char cmd[40], name[20], *arg;
-    struct FormatParameters parmBlock;
-    int berror = 0;
+    char *arg;
     char *adapter = NULL;
+    FormatDrive drives[MAX_DRIVES];
+    FormatBus buses[MAX_DRIVES];
+    int drive_count = 0, bus_count = 0, rv = 0;
+    int i, j;
     int option;
 
     struct option longopts[] =
@@ -197,21 +513,71 @@ int ARCH_MAINDECL main(int argc, char *argv[])
         }
     }
 
-    if(optind + 2 != argc)
+    if(optind + 2 > argc)
     {
-        fprintf(stderr, "Usage: %s [OPTION]... DRIVE NAME,ID\n", argv[0]);
+        fprintf(stderr, "Usage: %s [OPTION]... DRIVE... NAME,ID\n", argv[0]);
         hint(argv[0]);
         return 1;
     }
 
-    arg = argv[optind++];
-    drive = arch_atoc(arg);
-    if(drive < 8 || drive > 11)
+    if(argc - optind - 1 > MAX_DRIVES)
     {
-        fprintf(stderr, "Invalid drive number (%s)\n", arg);
+        fprintf(stderr, "Too many drives, at most %d can be formatted at once\n", MAX_DRIVES);
         return 1;
     }
 
+    memset(drives, 0, sizeof(drives));
+    memset(buses, 0, sizeof(buses));
+
+    while(optind + 1 < argc)
+    {
+        FormatDrive *d = &drives[drive_count];
+        char *drive_adapter = adapter;
+
+        arg = argv[optind++];
+        d->spec = arg;
+
+        if(strchr(arg, '=') != NULL)
+        {
+            drive_adapter = cbmlibmisc_strndup(arg, strchr(arg, '=') - arg);
+            arg = strchr(arg, '=') + 1;
+        }
+
+        d->drive = arch_atoc(arg);
+        if(d->drive < 8 || d->drive > 11)
+        {
+            fprintf(stderr, "Invalid drive number (%s)\n", arg);
+            return 1;
+        }
+
+        for(i = 0; i < bus_count; i++)
+        {
+            if(sameAdapter(buses[i].adapter, drive_adapter))
+            {
+                break;
+            }
+        }
+        if(i == bus_count)
+        {
+            buses[bus_count++].adapter = drive_adapter;
+        }
+        else if(drive_adapter != adapter)
+        {
+            cbmlibmisc_strfree(drive_adapter);
+        }
+
+        for(j = 0; j < buses[i].count; j++)
+        {
+            if(buses[i].drives[j]->drive == d->drive)
+            {
+                fprintf(stderr, "Drive %s given more than once\n", d->spec);
+                return 1;
+            }
+        }
+        buses[i].drives[buses[i].count++] = d;
+        drive_count++;
+    }
+
     arg      = argv[optind++];
     name_len = 0;
     while(*arg)
@@ -243,19 +609,14 @@ int ARCH_MAINDECL main(int argc, char *argv[])
         return 1;
     }
 
-    if(cbm_driver_open_ex(&fd, adapter) == 0)
-    {
-        cbm_upload(fd, drive, 0x0300, dskfrmt, sizeof(dskfrmt));
-
-
-        prepareFmtPattern(&parmBlock, orig, endtrack, name[id_ofs+1], name[id_ofs+2]);
-        parmBlock.P_STRCK=starttrack;   // start track parameter
-        parmBlock.P_ETRCK=endtrack+1;   // end track parameter
-        parmBlock.P_RETRY=(retries & ~0xC0) | (bump?0x40:0xC0);
-                                        // number of retries (per disk, not per track)
-        parmBlock.P_DOBMP=bump;         // flag, if an initial head bump should be done
-        parmBlock.P_DEMAG=demagnetize;  // flag, if the disk should be demagnetized
-        parmBlock.P_VRIFY=verify;       // flag, if the disk should be verified
+    prepareFmtPattern(&parmBlock, orig, endtrack, name[id_ofs+1], name[id_ofs+2]);
+    parmBlock.P_STRCK=starttrack;   // start track parameter
+    parmBlock.P_ETRCK=endtrack+1;   // end track parameter
+    parmBlock.P_RETRY=(retries & ~0xC0) | (bump?0x40:0xC0);
+                                    // number of retries (per disk, not per track)
+    parmBlock.P_DOBMP=bump;         // flag, if an initial head bump should be done
+    parmBlock.P_DEMAG=demagnetize;  // flag, if the disk should be demagnetized
+    parmBlock.P_VRIFY=verify;       // flag, if the disk should be verified
 
 #if 0       // for checking the generated format patterns
 {
@@ -271,149 +632,62 @@ int ARCH_MAINDECL main(int argc, char *argv[])
     printf(" $%02X\n", ((char *)(&parmBlock))[j]&0xFF);
 }
 #endif
-        cbm_upload(fd, drive, 0x0200 - sizeof(parmBlock), ((char *)(&parmBlock)), sizeof(parmBlock));
 
-        sprintf(cmd, "M-E%c%c0:%s", 3, 3, name);
-        cbm_exec_command(fd, drive, cmd, 7+name_len);
-        berror = cbm_device_status(fd, drive, cmd, sizeof(cmd));
+    formatAllBuses(buses, bus_count);
 
-        if(berror && status)
+    for(i = 0; i < bus_count; i++)
+    {
+        if(buses[i].error)
         {
-            printf("%s\n", cmd);
+            arch_error(0, buses[i].errnum, "%s", cbm_get_driver_name_ex(buses[i].adapter));
+            rv = 1;
+            continue;
         }
 
-#if defined(DebugFormat) && DebugFormat!=0  // verbose output
+        for(j = 0; j < buses[i].count; j++)
         {
-            float RPMval;
-            int sectors, virtGAPsze, remainder, trackTailGAP, flags, retry = 0, lastTr;
-            const char *vrfy;
-            unsigned char data[0x100];
+            FormatDrive *d = buses[i].drives[j];
 
-                // in case of an error, get the logging buffer from 0x0700 instead of 0x0500
-            if (cbm_download(fd, drive, berror?0x0700:0x0500, data, sizeof(data)) == sizeof(data))
+            if(drive_count > 1)
             {
-                int i;
-                printf("Track|Retry|sctrs|slctd|| GAP |modulo |modulo|tail| Verify  | RPM  |\n"
-                       "     |     |     | GAP ||adjst|complmt| dvsr |GAP |         |      |\n"
-                       "-----+-----+-----+-----++-----+-------+------+----+---------+------+\n");
-
-                lastTr=-1;
-                for (i=0; i < sizeof(data); i+=4)
+                printf("%s:\n", d->spec);
+            }
+            if(d->format_error && status)
+            {
+                printf("%s\n", d->status);
+            }
+#if defined(DebugFormat) && DebugFormat!=0  // verbose output
+            if(d->have_debug)
+            {
+                printDebugBuffer(d->debug, sizeof(d->debug));
+                if(verify && printVerifyResult(d->debug, sizeof(d->debug), starttrack, endtrack))
                 {
-                    if(data[i]==0) break;   // no more data is available
-
-                    if(data[i]==lastTr) retry++;
-                    else                retry=0;
-                    lastTr=data[i];
-
-                    if(data[i]>=25)         // preselect track dependent constants
-                    {
-                        if(data[i]>=31) sectors=17, RPMval=60000000.0f/16;
-                        else            sectors=18, RPMval=60000000.0f/15;
-                    }
-                    else
-                    {
-                        if(data[i]>=18) sectors=19, RPMval=60000000.0f/14;
-                        else            sectors=21, RPMval=60000000.0f/13;
-                    }
-
-                        // separate some flags
-                    flags=(data[i+3]>>6)&0x03;
-                    data[i+3]&=0x3f;
-
-                    switch(flags)
-                    {
-                        case 0x01: vrfy="SYNC fail"; break;
-                        case 0x02: vrfy="   OK    "; break;
-                        case 0x03: vrfy="vrfy fail"; break;
-                        default:   vrfy="   ./.   ";
-                    }
-
-                        // recalculation of the track tail GAP out of the
-                        // choosen GAP for this track, the new GAP size
-                        // adjustment and the complement of the remainder
-                        // of the adjustment division
-
-                    virtGAPsze=data[i+1]        -5; // virtual GAP increase to
-                        // prevent reformatting, when only one byte is missing
-                        // and other offset compensations
-
-
-                    remainder=((data[i+2]==0xff) ? virtGAPsze : sectors)
-                                 - data[i+3];
-
-
-                    trackTailGAP=((data[i+2]==0xff) ? 0 : data[i+2]*sectors + virtGAPsze)
-                                 + remainder;
-
-                        // the following constants are nybble based (double the
-                        // size of the well known constants for SYNC lengths,
-                        // block header size, data block GAP and data block)
-                        //
-                        // (0x01&data[i+1]&sectors) is a correction term, if "half
-                        // GAPs" are written and the number of sectors is odd
-                        //
-                    // RPMval / (sectors * (10+20+18+10 + 650 + data[i+1]) - (0x01&data[i+1]&sectors) + trackTailGAP - data[i+1])
-
-                    RPMval = (flags != 0x01) ?
-                        RPMval / (sectors * (10+20+18+10 + 650 + data[i+1]) - (0x01&data[i+1]&sectors) + trackTailGAP - data[i+1])
-                        : 0;
-
-                    printf(" %3u | ", data[i]);
-                    if(retry>0) printf("%3u", retry);
-                    else        printf("   ");
-
-                   /*      " |sctrs |slctd   || GAP    |modulo    |modulo   |tail | Verify  | RPM  |\n"
-                    *      " |      | GAP    ||adjst   |complmt   |         | GAP |         |      |\n"
-                    *      "-+----- +-----   ++-----   +-------   +------   +---- +---------+------+\n"
-                    */
-                    printf(" |  %2u |$%02X.%d||$%02X.%d| $%02X.%d | $%02X.%d|$%03X|%9s|%6.2f|\n",
-                           sectors,
-                           data[i+1]>>1,                       (data[i+1]<<3)&8,            // selected GAP
-                           (((signed char)data[i+2])>>1)&0xFF, (data[i+2]<<3)&8,            // GAP adjust
-                           data[i+3]>>1,                       (data[i+3]<<3)&8,            // modulo complement
-                           remainder>>1,                       (remainder<<3)&8,            // modulo
-                           (trackTailGAP>>1) + 1,                                           // track tail GAP (with roundup)
-                           vrfy, RPMval);
+                    rv = 1;
                 }
-                printf("\n  *) Note: The fractional parts of all the GAP based numbers shown here\n"
-                         "           (sedecimal values) are given due to nybble based calculations.\n");
             }
             else
             {
                 fprintf(stderr, "error reading debug logging data!\n");
             }
-        }
-        berror = cbm_device_status(fd, drive, cmd, sizeof(cmd));
 #endif
-        if(!berror && (endtrack > 35))
-        {
-            cbm_open(fd, drive, 2, "#", 1);
-            cbm_exec_command(fd, drive, "U1:2 0 18 0", 11);
-            cbm_exec_command(fd, drive, "B-P2 192", 8);
-            cbm_listen(fd, drive, 2);
-            while(endtrack > 35)
+            if(d->format_error)
             {
-                cbm_raw_write(fd, "\021\377\377\001", 4);
-                endtrack--;
+                rv = 1;
+            }
+            if(!d->berror && status)
+            {
+                printf("%s\n", d->final);
             }
-            cbm_unlisten(fd);
-            cbm_exec_command(fd, drive, "U2:2 0 18 0", 11);
-            cbm_close(fd, drive, 2);
-        }
-        if(!berror && status)
-        {
-            cbm_device_status(fd, drive, cmd, sizeof(cmd));
-            printf("%s\n", cmd);
         }
-        cbm_driver_close(fd);
-        cbmlibmisc_strfree(adapter);
-        return 0;
     }
-    else
+
+    for(i = 0; i < bus_count; i++)
     {
-        arch_error(0, arch_get_errno(), "%s", cbm_get_driver_name_ex(adapter));
-        cbmlibmisc_strfree(adapter);
-        return 1;
+        if(buses[i].adapter != adapter)
+        {
+            cbmlibmisc_strfree(buses[i].adapter);
+        }
     }
+    cbmlibmisc_strfree(adapter);
+    return rv;
 }
@@ -0,0 +1,688 @@
+/*
+ *  This program is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU General Public License
+ *  as published by the Free Software Foundation; either version
+ *  2 of the License, or (at your option) any later version.
+ *
+*/
+
+/*
+ * Mount the disk in a drive as a read-only file system with FUSE.
+ *
+ * Nothing is read when the file system is mounted: a block is read from
+ * the drive with U1 when it is needed first, and kept in a cache which
+ * holds the whole disk. Listing the directory reads the directory track
+ * only, and a file is read only as far as it is accessed; the chain of
+ * its blocks is followed along. Whenever the directory is listed, the
+ * header block is read again. If it has changed, there is another disk
+ * in the drive, and the cache is dropped.
+ */
+
+#define FUSE_USE_VERSION 26
+
+#include "opencbm.h"
+#include "opencbm-dos.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <fuse.h>
+#include <getopt.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "arch.h"
+#include "libmisc.h"
+
+#define BLOCKSIZE  256
+#define BLOCKDATA  254
+
+/* the channel the blocks are read into */
+#define CBMFS_CHANNEL 2
+
+/* more blocks than a disk has: a chain this long loops */
+#define MAX_CHAIN  3200
+
+/* the directory blocks followed at most */
+#define MAX_DIR_BLOCKS 40
+
+typedef struct
+{
+    unsigned char header_track;
+    unsigned char header_sector;
+    unsigned char dir_track;
+    unsigned char dir_sector;
+    int tracks;
+    int max_sectors;
+} disk_layout;
+
+static const disk_layout layout_1541 = { 18, 0, 18, 1, 35, 21 };
+static const disk_layout layout_1571 = { 18, 0, 18, 1, 70, 21 };
+static const disk_layout layout_1581 = { 40, 0, 40, 3, 80, 40 };
+
+typedef struct
+{
+    char name[16 + 5];
+    unsigned char track;
+    unsigned char sector;
+    int blocks;
+
+    /* the blocks of the file, as far as the chain has been followed */
+    unsigned char (*chain)[2];
+    int chain_len;
+    int complete;
+    off_t size;       /* only valid if complete */
+} dir_entry;
+
+static struct
+{
+    CBM_FILE fd;
+    int fd_valid;
+    char *adapter;
+    unsigned char drive;
+    int channel_open;
+
+    disk_layout layout;
+    unsigned char *cache;   /* BLOCKSIZE bytes for every block of the disk */
+    unsigned char *cached;  /* != 0: the block is in the cache */
+
+    dir_entry *entries;
+    int entry_count;
+    int dir_valid;
+
+    pthread_mutex_t lock;
+} fs;
+
+static const char *type_ext[] = { "del", "seq", "prg", "usr", "rel" };
+
+
+static int sectors_on_track(int track)
+{
+    if(fs.layout.max_sectors == 40)
+    {
+        return 40;
+    }
+    if(track > 35)
+    {
+        /* the second side of a 1571 disk */
+        track -= 35;
+    }
+    if(track < 18) return 21;
+    if(track < 25) return 19;
+    if(track < 31) return 18;
+    return 17;
+}
+
+static int block_index(unsigned char tr, unsigned char se)
+{
+    if(tr < 1 || tr > fs.layout.tracks || se >= sectors_on_track(tr))
+    {
+        return -1;
+    }
+    return (tr - 1) * fs.layout.max_sectors + se;
+}
+
+static int fetch_block(unsigned char tr, unsigned char se, unsigned char *block)
+{
+    char status[40];
+
+    if(!fs.fd_valid)
+    {
+        return -1;
+    }
+
+    if(!fs.channel_open)
+    {
+        if(cbm_dos_open_channel_generic(fs.fd, fs.drive, CBMFS_CHANNEL) != 0)
+        {
+            return -1;
+        }
+        fs.channel_open = 1;
+    }
+
+    if(cbm_dos_cmd_u1_block_read(fs.fd, fs.drive, CBMFS_CHANNEL, 0, tr, se) < 0 ||
+       cbm_device_status(fs.fd, fs.drive, status, sizeof(status)) != 0)
+    {
+        return -1;
+    }
+
+    if(cbm_dos_channel_read(fs.fd, fs.drive, CBMFS_CHANNEL,
+                            BLOCKSIZE, block, BLOCKSIZE) != BLOCKSIZE)
+    {
+        return -1;
+    }
+    return 0;
+}
+
+static const unsigned char *get_block(unsigned char tr, unsigned char se)
+{
+    int i = block_index(tr, se);
+
+    if(i < 0)
+    {
+        return NULL;
+    }
+
+    if(!fs.cached[i])
+    {
+        if(fetch_block(tr, se, fs.cache + i * BLOCKSIZE) != 0)
+        {
+            return NULL;
+        }
+        fs.cached[i] = 1;
+    }
+    return fs.cache + i * BLOCKSIZE;
+}
+
+static void drop_cache(void)
+{
+    int i;
+
+    memset(fs.cached, 0, fs.layout.tracks * fs.layout.max_sectors);
+
+    for(i = 0; i < fs.entry_count; i++)
+    {
+        free(fs.entries[i].chain);
+    }
+    free(fs.entries);
+    fs.entries = NULL;
+    fs.entry_count = 0;
+    fs.dir_valid = 0;
+}
+
+/* read the header block again, and drop the cache if the disk has changed */
+static int check_disk(void)
+{
+    unsigned char header[BLOCKSIZE];
+    int i = block_index(fs.layout.header_track, fs.layout.header_sector);
+
+    if(fetch_block(fs.layout.header_track, fs.layout.header_sector, header) != 0)
+    {
+        drop_cache();
+        return -EIO;
+    }
+
+    if(!fs.cached[i] || memcmp(fs.cache + i * BLOCKSIZE, header, BLOCKSIZE) != 0)
+    {
+        drop_cache();
+        memcpy(fs.cache + i * BLOCKSIZE, header, BLOCKSIZE);
+        fs.cached[i] = 1;
+    }
+    return 0;
+}
+
+static dir_entry *find_entry(const char *name)
+{
+    int i;
+
+    for(i = 0; i < fs.entry_count; i++)
+    {
+        if(strcmp(fs.entries[i].name, name) == 0)
+        {
+            return &fs.entries[i];
+        }
+    }
+    return NULL;
+}
+
+static void add_entry(const unsigned char *d)
+{
+    dir_entry *e;
+    char name[sizeof(e->name)];
+    int type = d[2] & 0x07;
+    int i, len;
+
+    if(type >= (int)(sizeof(type_ext) / sizeof(type_ext[0])))
+    {
+        /* a partition of the 1581 */
+        return;
+    }
+
+    for(len = 16; len > 0 && d[5 + len - 1] == 0xa0; len--)
+        ;
+    for(i = 0; i < len; i++)
+    {
+        char c = cbm_petscii2ascii_c(d[5 + i]);
+        name[i] = (c == '/' || (unsigned char) c < 0x20) ? '_' : c;
+    }
+    sprintf(name + len, ".%s", type_ext[type]);
+
+    if(find_entry(name) != NULL)
+    {
+        return;
+    }
+
+    e = realloc(fs.entries, (fs.entry_count + 1) * sizeof(*e));
+    if(e == NULL)
+    {
+        return;
+    }
+    fs.entries = e;
+    e += fs.entry_count++;
+
+    memset(e, 0, sizeof(*e));
+    strcpy(e->name, name);
+    e->track  = d[3];
+    e->sector = d[4];
+    e->blocks = d[30] | (d[31] << 8);
+}
+
+static int read_directory(void)
+{
+    const unsigned char *blk;
+    unsigned char tr = fs.layout.dir_track;
+    unsigned char se = fs.layout.dir_sector;
+    int count, e;
+
+    for(count = 0; tr != 0 && count < MAX_DIR_BLOCKS; count++)
+    {
+        blk = get_block(tr, se);
+        if(blk == NULL)
+        {
+            return -EIO;
+        }
+
+        for(e = 0; e < 8; e++)
+        {
+            /* only files which have been closed */
+            if(blk[e * 32 + 2] & 0x80)
+            {
+                add_entry(blk + e * 32);
+            }
+        }
+
+        tr = blk[0];
+        se = blk[1];
+    }
+
+    fs.dir_valid = 1;
+    return 0;
+}
+
+static int make_directory_valid(void)
+{
+    int rv;
+
+    if(fs.dir_valid)
+    {
+        return 0;
+    }
+
+    rv = check_disk();
+    if(rv == 0)
+    {
+        rv = read_directory();
+    }
+    return rv;
+}
+
+/* follow the chain of a file until it has at least count blocks, or is complete */
+static int follow_chain(dir_entry *e, int count)
+{
+    const unsigned char *blk;
+    unsigned char tr, se;
+    void *p;
+
+    while(!e->complete && e->chain_len < count)
+    {
+        if(e->chain_len == 0)
+        {
+            tr = e->track;
+            se = e->sector;
+        }
+        else
+        {
+            blk = get_block(e->chain[e->chain_len - 1][0],
+                            e->chain[e->chain_len - 1][1]);
+            if(blk == NULL)
+            {
+                return -EIO;
+            }
+            tr = blk[0];
+            se = blk[1];
+        }
+
+        if(tr == 0)
+        {
+            /* the last block tells how many of its bytes are used */
+            e->complete = 1;
+            e->size = e->chain_len == 0 ? 0 :
+                (off_t) (e->chain_len - 1) * BLOCKDATA + (se > 0 ? se - 1 : 0);
+            break;
+        }
+
+        if(e->chain_len >= MAX_CHAIN || block_index(tr, se) < 0)
+        {
+            return -EIO;
+        }
+
+        if(e->chain_len % 64 == 0)
+        {
+            p = realloc(e->chain, (e->chain_len + 64) * sizeof(e->chain[0]));
+            if(p == NULL)
+            {
+                return -ENOMEM;
+            }
+            e->chain = p;
+        }
+        e->chain[e->chain_len][0] = tr;
+        e->chain[e->chain_len][1] = se;
+        e->chain_len++;
+    }
+    return 0;
+}
+
+static int cbmfs_getattr(const char *path, struct stat *st)
+{
+    dir_entry *e;
+    int rv;
+
+    memset(st, 0, sizeof(*st));
+
+    if(strcmp(path, "/") == 0)
+    {
+        st->st_mode = S_IFDIR | 0555;
+        st->st_nlink = 2;
+        return 0;
+    }
+
+    pthread_mutex_lock(&fs.lock);
+
+    rv = make_directory_valid();
+    if(rv == 0)
+    {
+        e = find_entry(path + 1);
+        if(e == NULL)
+        {
+            rv = -ENOENT;
+        }
+        else
+        {
+            st->st_mode = S_IFREG | 0444;
+            st->st_nlink = 1;
+            /* the exact size is only known once the chain has been followed */
+            st->st_size = e->complete ? e->size : (off_t) e->blocks * BLOCKDATA;
+            st->st_blocks = (off_t) e->blocks * BLOCKSIZE / 512;
+        }
+    }
+
+    pthread_mutex_unlock(&fs.lock);
+    return rv;
+}
+
+static int cbmfs_readdir(const char *path, void *buf, fuse_fill_dir_t filler,
+                         off_t offset, struct fuse_file_info *fi)
+{
+    int i, rv;
+
+    if(strcmp(path, "/") != 0)
+    {
+        return -ENOENT;
+    }
+
+    pthread_mutex_lock(&fs.lock);
+
+    /* a new disk may have been put into the drive */
+    rv = check_disk();
+    if(rv == 0 && !fs.dir_valid)
+    {
+        rv = read_directory();
+    }
+
+    if(rv == 0)
+    {
+        filler(buf, ".", NULL, 0);
+        filler(buf, "..", NULL, 0);
+        for(i = 0; i < fs.entry_count; i++)
+        {
+            filler(buf, fs.entries[i].name, NULL, 0);
+        }
+    }
+
+    pthread_mutex_unlock(&fs.lock);
+    return rv;
+}
+
+static int cbmfs_open(const char *path, struct fuse_file_info *fi)
+{
+    int rv;
+
+    if((fi->flags & O_ACCMODE) != O_RDONLY)
+    {
+        return -EROFS;
+    }
+
+    pthread_mutex_lock(&fs.lock);
+    rv = make_directory_valid();
+    if(rv == 0 && find_entry(path + 1) == NULL)
+    {
+        rv = -ENOENT;
+    }
+    pthread_mutex_unlock(&fs.lock);
+
+    /* the size given by getattr is only a guess until the file is read */
+    fi->direct_io = 1;
+    return rv;
+}
+
+static int cbmfs_read(const char *path, char *buf, size_t size, off_t offset,
+                      struct fuse_file_info *fi)
+{
+    const unsigned char *blk;
+    dir_entry *e;
+    int n, rv = 0;
+    int done = 0;
+    size_t bytes, pos;
+
+    pthread_mutex_lock(&fs.lock);
+
+    e = fs.dir_valid ? find_entry(path + 1) : NULL;
+    if(e == NULL)
+    {
+        /* the disk has been changed since the file was opened */
+        pthread_mutex_unlock(&fs.lock);
+        return -EIO;
+    }
+
+    while((size_t) done < size)
+    {
+        n   = (int) (offset / BLOCKDATA);
+        pos = (size_t) (offset % BLOCKDATA);
+
+        rv = follow_chain(e, n + 1);
+        if(rv != 0 || e->chain_len <= n)
+        {
+            break;
+        }
+
+        blk = get_block(e->chain[n][0], e->chain[n][1]);
+        if(blk == NULL)
+        {
+            rv = -EIO;
+            break;
+        }
+
+        bytes = blk[0] ? BLOCKDATA : (blk[1] > 0 ? blk[1] - 1 : 0);
+        if(pos >= bytes)
+        {
+            break;
+        }
+        bytes -= pos;
+        if(bytes > size - done)
+        {
+            bytes = size - done;
+        }
+
+        memcpy(buf + done, blk + 2 + pos, bytes);
+        done   += (int) bytes;
+        offset += bytes;
+    }
+
+    pthread_mutex_unlock(&fs.lock);
+    return done > 0 ? done : rv;
+}
+
+/* the driver is opened here, as FUSE may have forked into the background */
+static void *cbmfs_init(struct fuse_conn_info *conn)
+{
+    enum cbm_device_type_e type;
+
+    pthread_mutex_lock(&fs.lock);
+
+    fs.fd_valid = cbm_driver_open_ex(&fs.fd, fs.adapter) == 0;
+
+    if(fs.fd_valid && cbm_identify(fs.fd, fs.drive, &type, NULL) == 0)
+    {
+        if(type == cbm_dt_cbm1581)
+        {
+            fs.layout = layout_1581;
+        }
+        else if(type == cbm_dt_cbm1571)
+        {
+            fs.layout = layout_1571;
+        }
+    }
+
+    pthread_mutex_unlock(&fs.lock);
+    return NULL;
+}
+
+static void cbmfs_destroy(void *private_data)
+{
+    pthread_mutex_lock(&fs.lock);
+
+    drop_cache();
+
+    if(fs.fd_valid)
+    {
+        if(fs.channel_open)
+        {
+            cbm_close(fs.fd, fs.drive, CBMFS_CHANNEL);
+        }
+        cbm_driver_close(fs.fd);
+        fs.fd_valid = 0;
+    }
+
+    pthread_mutex_unlock(&fs.lock);
+}
+
+static struct fuse_operations cbmfs_ops;
+
+static void help(void)
+{
+    printf(
+"Usage: cbmfs [OPTION]... DRIVE MOUNTPOINT [FUSE OPTION]...\n"
+"Mount the disk in DRIVE as a read-only file system at MOUNTPOINT.\n"
+"\n"
+"Options:\n"
+"  -h, --help                  display this help and exit\n"
+"  -V, --version               display version information and exit\n"
+"  -@, --adapter=plugin:bus    tell OpenCBM which backend plugin and bus to use\n"
+"\n"
+"The blocks are read from the drive when they are needed first, and kept\n"
+"until another disk is found in the drive when the directory is listed.\n"
+"The FUSE OPTIONs are given to FUSE; unmount with fusermount -u MOUNTPOINT.\n"
+"\n"
+);
+}
+
+static void hint(char *s)
+{
+    fprintf(stderr, "Try `%s' --help for more information.\n", s);
+}
+
+int ARCH_MAINDECL main(int argc, char *argv[])
+{
+    struct option longopts[] =
+    {
+        { "help"       , no_argument      , NULL, 'h' },
+        { "version"    , no_argument      , NULL, 'V' },
+        { "adapter"    , required_argument, NULL, '@' },
+        { NULL         , 0                , NULL, 0   }
+    };
+    /* stop at DRIVE: the options after MOUNTPOINT belong to FUSE */
+    const char shortopts[] = "+hV@:";
+
+    CBM_FILE fd;
+    char **fuse_argv;
+    int fuse_argc;
+    int option;
+    int rv;
+
+    while((option = getopt_long(argc, argv, shortopts, longopts, NULL)) != -1)
+    {
+        switch(option)
+        {
+            case 'h': help();
+                      return 0;
+            case 'V': printf("cbmfs %s\n", OPENCBM_VERSION);
+                      return 0;
+            case '@': if (fs.adapter == NULL)
+                          fs.adapter = cbmlibmisc_strdup(optarg);
+                      else
+                      {
+                          fprintf(stderr, "--adapter/-@ given more than once.");
+                          hint(argv[0]);
+                          return 1;
+                      }
+                      break;
+            default : hint(argv[0]);
+                      return 1;
+        }
+    }
+
+    if(optind + 2 > argc)
+    {
+        fprintf(stderr, "Usage: %s [OPTION]... DRIVE MOUNTPOINT [FUSE OPTION]...\n", argv[0]);
+        hint(argv[0]);
+        return 1;
+    }
+
+    fs.drive = arch_atoc(argv[optind]);
+    fs.layout = layout_1541;
+    pthread_mutex_init(&fs.lock, NULL);
+
+    /* a disk as large as the largest which is supported */
+    fs.cache  = malloc(layout_1581.tracks * layout_1581.max_sectors * BLOCKSIZE);
+    fs.cached = calloc(layout_1581.tracks * layout_1581.max_sectors, 1);
+    fuse_argv = malloc((argc - optind + 2) * sizeof(char *));
+    if(fs.cache == NULL || fs.cached == NULL || fuse_argv == NULL)
+    {
+        fprintf(stderr, "no memory\n");
+        return 1;
+    }
+
+    /* find out now if there is an adapter, not after FUSE went to the background */
+    if(cbm_driver_open_ex(&fd, fs.adapter) != 0)
+    {
+        arch_error(0, arch_get_errno(), "%s", cbm_get_driver_name_ex(fs.adapter));
+        return 1;
+    }
+    cbm_driver_close(fd);
+
+    fuse_argc = 0;
+    fuse_argv[fuse_argc++] = argv[0];
+    for(option = optind + 1; option < argc; option++)
+    {
+        fuse_argv[fuse_argc++] = argv[option];
+    }
+    fuse_argv[fuse_argc++] = "-oro";
+    fuse_argv[fuse_argc] = NULL;
+
+    cbmfs_ops.getattr = cbmfs_getattr;
+    cbmfs_ops.readdir = cbmfs_readdir;
+    cbmfs_ops.open    = cbmfs_open;
+    cbmfs_ops.read    = cbmfs_read;
+    cbmfs_ops.init    = cbmfs_init;
+    cbmfs_ops.destroy = cbmfs_destroy;
+
+    rv = fuse_main(fuse_argc, fuse_argv, &cbmfs_ops, NULL);
+
+    free(fuse_argv);
+    free(fs.cache);
+    free(fs.cached);
+    cbmlibmisc_strfree(fs.adapter);
+
+    return rv;
+}
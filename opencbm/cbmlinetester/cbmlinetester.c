@@ -72,6 +72,8 @@ static void help()
         "\n"
         "  -i, --interactive          Use the tool interactively (only with ncurses)\n"
         "  -p, --poll                 Poll the values of the lines\n"
+        "  -t, --timing               Measure the latencies of the bus and of the drives\n"
+        "  -n, --samples=N            Number of samples for --timing (default 100)\n"
         "\n"
         "  -r, --reset                SET the RESET line\n"
         "  -R, --RESET                RELEASE the RESET line\n"
@@ -117,6 +119,169 @@ static void printpoll(CBM_FILE fd)
     printf("line status: %s\n", getLineStatus(poll_status));
 }
 
+/*! the time to wait for a line to change while measuring the timing, in us */
+#define TIMING_TIMEOUT_US 10000.0
+
+typedef struct timing_stat_s
+{
+    double min;
+    double max;
+    double sum;
+    unsigned int count;
+    unsigned int timeouts;
+} timing_stat_t;
+
+static void timing_add(timing_stat_t *stat, double us)
+{
+    if (stat->count == 0 || us < stat->min) {
+        stat->min = us;
+    }
+    if (stat->count == 0 || us > stat->max) {
+        stat->max = us;
+    }
+    stat->sum += us;
+    stat->count++;
+}
+
+static void timing_print(const char *name, const timing_stat_t *stat)
+{
+    if (stat->count == 0) {
+        printf("%-32s        -        -        -", name);
+    }
+    else {
+        printf("%-32s %8.1f %8.1f %8.1f", name,
+            stat->min, stat->sum / stat->count, stat->max);
+    }
+
+    if (stat->timeouts) {
+        printf("  (%u timeouts)", stat->timeouts);
+    }
+    printf("\n");
+}
+
+/*
+ * Wait until the lines in mask have the state given in state, by
+ * polling them. Returns the time it took since start, or a negative
+ * value if the lines did not change in time.
+ */
+static double timing_wait(CBM_FILE fd, int mask, int state, double start)
+{
+    double now;
+
+    do {
+        now = arch_time_us();
+        if ((cbm_iec_poll(fd) & mask) == state) {
+            return now - start;
+        }
+    } while (now - start < TIMING_TIMEOUT_US);
+
+    return -1.0;
+}
+
+static void timing_loopback(CBM_FILE fd, int line, unsigned int samples,
+                            timing_stat_t *set, timing_stat_t *release)
+{
+    unsigned int i;
+    double start, us;
+
+    for (i = 0; i < samples; i++) {
+        start = arch_time_us();
+        cbm_iec_set(fd, line);
+        us = timing_wait(fd, line, line, start);
+        if (us < 0) {
+            set->timeouts++;
+        }
+        else {
+            timing_add(set, us);
+        }
+
+        start = arch_time_us();
+        cbm_iec_release(fd, line);
+        us = timing_wait(fd, line, 0, start);
+        if (us < 0) {
+            release->timeouts++;
+        }
+        else {
+            timing_add(release, us);
+        }
+    }
+}
+
+/*
+ * Characterise the timing of the bus: how long the calls into the
+ * adapter take, how long it takes until the adapter sees its own
+ * lines change, and how fast the drives answer ATN by pulling DATA.
+ */
+static void timing(CBM_FILE fd, unsigned int samples)
+{
+    timing_stat_t poll_stat = { 0 };
+    timing_stat_t setrelease_stat = { 0 };
+    timing_stat_t clock_set = { 0 }, clock_release = { 0 };
+    timing_stat_t data_set = { 0 }, data_release = { 0 };
+    timing_stat_t atn_ack = { 0 }, atn_release = { 0 };
+    unsigned int i;
+    double start, us;
+
+    cbm_iec_release(fd, IEC_ATN | IEC_CLOCK | IEC_DATA);
+
+    for (i = 0; i < samples; i++) {
+        start = arch_time_us();
+        cbm_iec_poll(fd);
+        timing_add(&poll_stat, arch_time_us() - start);
+    }
+
+    for (i = 0; i < samples; i++) {
+        start = arch_time_us();
+        cbm_iec_setrelease(fd, 0, IEC_CLOCK);
+        timing_add(&setrelease_stat, arch_time_us() - start);
+    }
+
+    timing_loopback(fd, IEC_CLOCK, samples, &clock_set, &clock_release);
+    timing_loopback(fd, IEC_DATA, samples, &data_set, &data_release);
+
+    if (cbm_iec_get(fd, IEC_DATA)) {
+        printf("DATA is held by another device, not measuring the ATN response.\n");
+    }
+    else {
+        for (i = 0; i < samples; i++) {
+            start = arch_time_us();
+            cbm_iec_set(fd, IEC_ATN);
+            us = timing_wait(fd, IEC_DATA, IEC_DATA, start);
+            if (us < 0) {
+                atn_ack.timeouts++;
+            }
+            else {
+                timing_add(&atn_ack, us);
+            }
+
+            start = arch_time_us();
+            cbm_iec_release(fd, IEC_ATN);
+            us = timing_wait(fd, IEC_DATA, 0, start);
+            if (us < 0) {
+                atn_release.timeouts++;
+            }
+            else {
+                timing_add(&atn_release, us);
+            }
+        }
+    }
+
+    printf("%u samples, times in us\n", samples);
+    printf("%-32s %8s %8s %8s\n", "", "min", "avg", "max");
+    timing_print("cbm_iec_poll()", &poll_stat);
+    timing_print("cbm_iec_setrelease()", &setrelease_stat);
+    timing_print("CLOCK set, until seen", &clock_set);
+    timing_print("CLOCK release, until seen", &clock_release);
+    timing_print("DATA set, until seen", &data_set);
+    timing_print("DATA release, until seen", &data_release);
+    timing_print("ATN set, until drive DATA", &atn_ack);
+    timing_print("ATN release, until drive DATA", &atn_release);
+
+    if (atn_ack.count == 0) {
+        printf("No drive answered ATN; is a drive connected and switched on?\n");
+    }
+}
+
 #ifdef HAVE_NCURSES
 static void printpollw(CBM_FILE fd)
 {
@@ -189,6 +354,8 @@ int ARCH_MAINDECL main(int argc, char *argv[])
     int releasemask = 0;
 
     int do_poll = 0;
+    int do_timing = 0;
+    unsigned int samples = 100;
 #ifdef HAVE_NCURSES
     int do_interactive = 0;
 #endif // #ifdef HAVE_NCURSES
@@ -205,6 +372,8 @@ int ARCH_MAINDECL main(int argc, char *argv[])
         { "interactive", no_argument      , NULL, 'i' },
 #endif // #ifdef HAVE_NCURSES
         { "poll"       , no_argument      , NULL, 'p' },
+        { "timing"     , no_argument      , NULL, 't' },
+        { "samples"    , required_argument, NULL, 'n' },
         { "reset"      , no_argument      , NULL, 'r' },
         { "atn"        , no_argument      , NULL, 'a' },
         { "clock"      , no_argument      , NULL, 'c' },
@@ -218,7 +387,7 @@ int ARCH_MAINDECL main(int argc, char *argv[])
         { NULL         , 0                , NULL, 0   }
     };
 
-    static const char shortopts[] ="hV@:pracdsRACDS"
+    static const char shortopts[] ="hV@:ptn:racdsRACDS"
 #ifdef HAVE_NCURSES
                                    "i"
 #endif // #ifdef HAVE_NCURSES
@@ -247,6 +416,15 @@ int ARCH_MAINDECL main(int argc, char *argv[])
 #endif // #ifdef HAVE_NCURSES
             case 'p': do_poll = 1;
                       break;
+            case 't': do_timing = 1;
+                      break;
+            case 'n': if (atoi(optarg) < 1) {
+                          fprintf(stderr, "--samples/-n must be at least 1.\n");
+                          hint(argv[0]);
+                          return 1;
+                      }
+                      samples = atoi(optarg);
+                      break;
             case 'r': setmask |= IEC_RESET;
                       break;
             case 'a': setmask |= IEC_ATN;
@@ -323,6 +501,10 @@ int ARCH_MAINDECL main(int argc, char *argv[])
             printpoll(fd);
         }
 
+        if (do_timing) {
+            timing(fd, samples);
+        }
+
         error_return = 0;
 
     } while (0);
@@ -26,6 +26,9 @@ static unsigned char cbmrpm41[] = {
 static CBM_FILE fd;
 static unsigned char drive;
 
+/* set by the CTRL-C handler of the RPM monitor to end the monitoring */
+static volatile int monitorStop = 0;
+
 const static unsigned short timerShotMain = sizeof(cbmDev_StartAddress) + offsetof(struct ExecBuffer_MemoryLayout, Timer24BitGroup);
 const static unsigned short UcmdTblAddr   = sizeof(cbmDev_StartAddress) + offsetof(struct ExecBuffer_MemoryLayout, CommandVectorsTable_impl);
 
@@ -69,10 +72,14 @@ help()
         "                                 3 - RPM with linear regression and ANOVAR\n"
         "                                 4 - for RPM adjustment, with exponentially\n"
         "                                     moving average\n"
+        "                                 5 - continuous RPM monitor on the start\n"
+        "                                     track, until <CTRL>-C is pressed\n"
         "\n"
         "  -s, --status               display drive status after the measurements\n"
         "  -x, --extended             measure out a 40 track disk\n"
         "  -r, --retries=n            number of measurement retries for each track\n"
+        "  -i, --interval=MS          time between two samples of the RPM monitor\n"
+        "                             (0 <= MS <= 10000, default 1000)\n"
         "\n"
         "  -b, --begin-track=TRACK    set start track (1 <= start <= end)\n"
         "  -e, --end-track=TRACK      set end track  (start <= end <= 42)\n"
@@ -124,6 +131,16 @@ handle_CTRL_C(int dummy)
     exit(1);
 }
 
+static void ARCH_SIGNALDECL
+handle_CTRL_C_monitor(int dummy)
+{
+    /*
+     * do not reset the bus while the RPM monitor is running, let
+     * it finish the current sample and clean up the drive instead
+     */
+    monitorStop = 1;
+}
+
 static int
 cbm_sendUxCommand(CBM_FILE HandleDevice, unsigned char DeviceAddress, enum UcmdVectorNames UxCommand)
 {
@@ -533,6 +550,73 @@ do_RPMadjustment(unsigned char track, unsigned char dummy, int sec, unsigned cha
     return 0;
 }
 
+static int
+do_RPMmonitor(unsigned char track, unsigned char dummy, int sec, unsigned int interval)   // end track not needed
+{
+    GroupOfMeasurements measureGroup;
+    unsigned int lastValue, delta, rotations, samples = 0;
+    float RPM, RPMmin = 0.0f, RPMmax = 0.0f, RPMavg = 0.0f;
+
+    /*
+     * Unlike the other jobs, only one sample is taken for every
+     * line update, and the host sleeps in between. The sectors
+     * are synchronised to the disk, thus the distance of two
+     * samples is a multiple of the rotation time, which can be
+     * recovered by rounding, as long as the RPM is within a few
+     * percent of 300 and the interval is well below the wrap
+     * around of the 32 bit timer extension.
+     */
+
+    printf("Monitoring track %d, press <CTRL>-C to stop.\n\n", track);
+    printf("  sample | rot. |  delta |     RPM |     min |     max | average\n"
+           "     No. |  (#) |  (~us) | (1/min) | (1/min) | (1/min) | (1/min)\n"
+           "---------+------+--------+---------+---------+---------+---------\n");
+
+    arch_set_ctrlbreak_handler(handle_CTRL_C_monitor);
+
+    if( measure_2cyleJitter(fd, drive, track, limitSectorNo41(track, sec), 0,
+        &measureGroup, 0
+        ) != 0) return 1;
+
+    while( !monitorStop )
+    {
+        if(interval > 0) arch_sleep_ms(interval);
+
+        lastValue = measureGroup.startValue;
+        if( measure_2cyleJitter(fd, drive, track, limitSectorNo41(track, sec), 0,
+            &measureGroup, 0
+            ) != 0) return 1;
+
+        delta = measureGroup.startValue - lastValue;
+
+        // overflow correction, needs integer division
+        rotations = (delta + 100000) / 200000;
+        if(rotations == 0) continue;
+
+        RPM = 60000000.0f * rotations / delta;
+
+        if(samples++ == 0)
+        {
+            RPMmin = RPMmax = RPMavg = RPM;
+        }
+        else
+        {
+            if(RPM < RPMmin) RPMmin = RPM;
+            if(RPM > RPMmax) RPMmax = RPM;
+            // cumulative moving average
+            RPMavg += (RPM - RPMavg) / samples;
+        }
+
+        printf("\r%8u | %4u | %6u | %7.3f | %7.3f | %7.3f | %7.3f",
+               samples, rotations, delta / rotations, RPM, RPMmin, RPMmax, RPMavg);
+        fflush(stdout);
+    }
+    printf("\n");
+
+    arch_set_ctrlbreak_handler(handle_CTRL_C);
+
+    return 0;
+}
 
 int ARCH_MAINDECL
 main(int argc, char *argv[])
@@ -543,6 +627,7 @@ main(int argc, char *argv[])
     char *arg;
     char *adapter = NULL;
     int sector = 0, berror = 0;
+    unsigned int interval = 1000;
     int option;
 
     struct option longopts[] =
@@ -557,6 +642,7 @@ main(int argc, char *argv[])
         { "begin-track", required_argument, NULL, 'b' },
         { "end-track"  , required_argument, NULL, 'e' },
         { "sector"     , required_argument, NULL, 'c' },
+        { "interval"   , required_argument, NULL, 'i' },
 /*
         { "quiet"      , no_argument      , NULL, 'q' },
         { "verbose"    , no_argument      , NULL, 'v' },
@@ -566,7 +652,7 @@ main(int argc, char *argv[])
     };
 
     // const char shortopts[] ="hVj:sr:xb:e:c:qvn";
-    const char shortopts[] ="hVj:sxr:b:e:c:@:";
+    const char shortopts[] ="hVj:sxr:b:e:c:i:@:";
 
 
     while((option = getopt_long(argc, argv, shortopts, longopts, NULL)) != -1)
@@ -595,6 +681,9 @@ main(int argc, char *argv[])
                       break;
             case 'c': sector = atoi(optarg);
                       break;
+            case 'i': interval = atoi(optarg) < 0 ? 0 : atoi(optarg);
+                      if(interval>10000) interval = 10000;
+                      break;
             case '@': if (adapter == NULL)
                           adapter = cbmlibmisc_strdup(optarg);
                       else
@@ -690,6 +779,10 @@ main(int argc, char *argv[])
 
         switch(job)
         {
+        case 5:
+            if( do_RPMmonitor    (begintrack, endtrack, sector, interval)
+                != 0 ) continue;    // jump to begin of do{}while(0);
+            break;
         case 4:
             if( do_RPMadjustment (begintrack, endtrack, sector, retries)
                 != 0 ) continue;    // jump to begin of do{}while(0);
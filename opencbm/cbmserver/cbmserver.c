@@ -0,0 +1,561 @@
+/*
+ *  This program is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU General Public License
+ *  as published by the Free Software Foundation; either version
+ *  2 of the License, or (at your option) any later version.
+*/
+
+/*
+ * cbmserver gives several clients on the network access to one
+ * adapter, cf. opencbm-net.h and the xnet plugin.
+ *
+ * The requests of the clients are run one after the other. A client
+ * keeps the bus for itself while it has it locked, and while it has
+ * a LISTEN or TALK open, so the bytes of two clients never mix on
+ * the bus. In the meantime, the other clients have to wait.
+ */
+
+#include "opencbm.h"
+#include "opencbm-net.h"
+
+#include <getopt.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <sys/types.h>
+#include <sys/select.h>
+#include <sys/socket.h>
+#include <sys/uio.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <netdb.h>
+#include <unistd.h>
+
+#include "arch.h"
+#include "libmisc.h"
+
+/* the maximum number of clients connected at the same time */
+#define MAX_CLIENTS 16
+
+/* the maximum number of sockets to listen on, e.g. IPv4 and IPv6 */
+#define MAX_LISTEN 4
+
+struct client
+{
+    int sock;           /* the connection; -1 if the entry is unused */
+    int locked;         /* != 0: the client has called cbm_lock() */
+    int transaction;    /* != 0: the client has a LISTEN or TALK open */
+    char name[64];      /* the address of the client, for the messages */
+};
+
+static struct client clients[MAX_CLIENTS];
+
+/* the client which has the bus for itself; NULL if none */
+static struct client *owner = NULL;
+
+/* the buffer for the data of the requests and the answers */
+static unsigned char data[OPENCBM_NET_MAX_DATA];
+
+static int verbose = 0;
+
+static void help()
+{
+    printf(
+"Usage: cbmserver [OPTION]...\n"
+"Give clients on the network access to the adapter\n"
+"\n"
+"  -h, --help                 display this help and exit\n"
+"  -V, --version              display version information and exit\n"
+"  -@, --adapter=plugin:bus   tell OpenCBM which backend plugin and bus to use\n"
+"\n"
+"  -a, --address=ADDRESS      accept connections on this local address, or on\n"
+"                             all addresses with 'all' (default: loopback only)\n"
+"  -p, --port=PORT            listen on this TCP port (default: " OPENCBM_NET_DEFAULT_PORT ")\n"
+"  -v, --verbose              report the clients connecting and leaving\n"
+"\n"
+);
+}
+
+static void hint(char *s)
+{
+    fprintf(stderr, "Try `%s' -h for more information.\n", s);
+}
+
+/*
+ * send the parts of an answer with as few calls as possible; the socket
+ * has TCP_NODELAY set, so sending them one by one would also cost one
+ * segment (and one wake-up of the client) for each of them
+ */
+static int send_all(int sock, struct iovec *iov, int count)
+{
+    struct msghdr msg;
+
+    memset(&msg, 0, sizeof msg);
+    msg.msg_iov = iov;
+    msg.msg_iovlen = count;
+
+    while (msg.msg_iovlen > 0)
+    {
+        ssize_t sent = sendmsg(sock, &msg, 0);
+
+        if (sent <= 0)
+            return -1;
+
+        // skip what has been sent, the rest goes out with the next call
+
+        while (msg.msg_iovlen > 0 && (size_t) sent >= msg.msg_iov->iov_len)
+        {
+            sent -= msg.msg_iov->iov_len;
+            msg.msg_iov++;
+            msg.msg_iovlen--;
+        }
+
+        if (msg.msg_iovlen > 0)
+        {
+            msg.msg_iov->iov_base = (unsigned char *) msg.msg_iov->iov_base + sent;
+            msg.msg_iov->iov_len -= sent;
+        }
+    }
+
+    return 0;
+}
+
+static int recv_all(int sock, void *buffer, size_t length)
+{
+    unsigned char *p = buffer;
+
+    while (length > 0)
+    {
+        ssize_t received = recv(sock, p, length, 0);
+
+        if (received <= 0)
+            return -1;
+
+        p += received;
+        length -= received;
+    }
+
+    return 0;
+}
+
+/*
+ * open the sockets to listen on, for the loopback addresses, for all
+ * local addresses (with "all"), or only for the given one
+ *
+ * There is no authentication of the clients, so other hosts have to
+ * be let in explicitly.
+ */
+static int open_listen_sockets(const char *address, const char *port, int *socks)
+{
+    struct addrinfo hints, *addresses, *ai;
+    int count = 0;
+    int rv;
+
+    memset(&hints, 0, sizeof hints);
+    hints.ai_family = AF_UNSPEC;
+    hints.ai_socktype = SOCK_STREAM;
+
+    if (address != NULL && strcmp(address, "all") == 0)
+    {
+        // no address with AI_PASSIVE gives the wildcard addresses
+        hints.ai_flags = AI_PASSIVE;
+        address = NULL;
+    }
+
+    // no address without AI_PASSIVE gives the loopback addresses
+    rv = getaddrinfo(address, port, &hints, &addresses);
+    if (rv != 0)
+    {
+        fprintf(stderr, "cannot resolve %s: %s\n", address ? address : port, gai_strerror(rv));
+        return 0;
+    }
+
+    for (ai = addresses; ai != NULL && count < MAX_LISTEN; ai = ai->ai_next)
+    {
+        int one = 1;
+        int sock = socket(ai->ai_family, ai->ai_socktype, ai->ai_protocol);
+
+        if (sock < 0)
+            continue;
+
+        setsockopt(sock, SOL_SOCKET, SO_REUSEADDR, &one, sizeof one);
+#ifdef IPV6_V6ONLY
+        if (ai->ai_family == AF_INET6)
+            setsockopt(sock, IPPROTO_IPV6, IPV6_V6ONLY, &one, sizeof one);
+#endif
+
+        if (bind(sock, ai->ai_addr, ai->ai_addrlen) != 0 || listen(sock, 4) != 0)
+        {
+            close(sock);
+            continue;
+        }
+
+        socks[count++] = sock;
+    }
+
+    freeaddrinfo(addresses);
+
+    if (count == 0)
+        fprintf(stderr, "cannot listen on port %s\n", port);
+
+    return count;
+}
+
+static void accept_client(int listen_sock)
+{
+    struct sockaddr_storage address;
+    socklen_t address_length = sizeof address;
+    char host[48], service[16];
+    int one = 1;
+    int sock;
+    int i;
+
+    sock = accept(listen_sock, (struct sockaddr *) &address, &address_length);
+    if (sock < 0)
+        return;
+
+    for (i = 0; i < MAX_CLIENTS && clients[i].sock >= 0; i++)
+        ;
+
+    if (i == MAX_CLIENTS)
+    {
+        fprintf(stderr, "too many clients, rejecting a new one\n");
+        close(sock);
+        return;
+    }
+
+    setsockopt(sock, IPPROTO_TCP, TCP_NODELAY, &one, sizeof one);
+
+    clients[i].sock = sock;
+    clients[i].locked = 0;
+    clients[i].transaction = 0;
+
+    if (getnameinfo((struct sockaddr *) &address, address_length,
+                    host, sizeof host, service, sizeof service,
+                    NI_NUMERICHOST | NI_NUMERICSERV) == 0)
+        snprintf(clients[i].name, sizeof clients[i].name, "%s:%s", host, service);
+    else
+        strcpy(clients[i].name, "(unknown)");
+
+    if (verbose)
+    {
+        printf("%s connected\n", clients[i].name);
+        fflush(stdout);
+    }
+}
+
+/*
+ * remove a client; if it had the bus for itself, it is
+ * released, so the other clients can go on
+ */
+static void drop_client(CBM_FILE fd, struct client *client)
+{
+    if (verbose)
+    {
+        printf("%s disconnected\n", client->name);
+        fflush(stdout);
+    }
+
+    if (client->transaction)
+    {
+        cbm_unlisten(fd);
+        cbm_untalk(fd);
+    }
+
+    if (client->locked)
+        cbm_unlock(fd);
+
+    if (owner == client)
+        owner = NULL;
+
+    close(client->sock);
+    client->sock = -1;
+}
+
+/*
+ * read one request of the client, run it and send the answer
+ */
+static int serve_request(CBM_FILE fd, struct client *client)
+{
+    opencbm_net_request_t request;
+    opencbm_net_answer_t answer;
+    struct iovec iov[2];
+    unsigned long length;
+    unsigned long answer_length = 0;
+    int result = 0;
+
+    if (recv_all(client->sock, &request, sizeof request))
+        return 1;
+
+    length = OPENCBM_NET_GET32(request.Length);
+    if (length > OPENCBM_NET_MAX_DATA)
+        return 1;
+
+    if (request.Command == OPENCBM_NET_RAW_WRITE && recv_all(client->sock, data, length))
+        return 1;
+
+    switch (request.Command)
+    {
+    case OPENCBM_NET_HELLO:
+        result = (request.Arg1 == OPENCBM_NET_VERSION) ? OPENCBM_NET_VERSION : -1;
+        break;
+
+    case OPENCBM_NET_LOCK:
+        if (!client->locked)
+            cbm_lock(fd);
+        client->locked = 1;
+        break;
+
+    case OPENCBM_NET_UNLOCK:
+        if (client->locked)
+            cbm_unlock(fd);
+        client->locked = 0;
+        break;
+
+    case OPENCBM_NET_RAW_WRITE:
+        result = cbm_raw_write(fd, data, length);
+        break;
+
+    case OPENCBM_NET_RAW_READ:
+        result = cbm_raw_read(fd, data, length);
+        if (result > 0)
+            answer_length = result;
+        break;
+
+    case OPENCBM_NET_OPEN:
+        result = cbm_open(fd, request.Arg1, request.Arg2, NULL, 0);
+        client->transaction = 1;
+        break;
+
+    case OPENCBM_NET_CLOSE:
+        result = cbm_close(fd, request.Arg1, request.Arg2);
+        break;
+
+    case OPENCBM_NET_LISTEN:
+        result = cbm_listen(fd, request.Arg1, request.Arg2);
+        client->transaction = 1;
+        break;
+
+    case OPENCBM_NET_TALK:
+        result = cbm_talk(fd, request.Arg1, request.Arg2);
+        client->transaction = 1;
+        break;
+
+    case OPENCBM_NET_UNLISTEN:
+        result = cbm_unlisten(fd);
+        client->transaction = 0;
+        break;
+
+    case OPENCBM_NET_UNTALK:
+        result = cbm_untalk(fd);
+        client->transaction = 0;
+        break;
+
+    case OPENCBM_NET_GET_EOI:
+        result = cbm_get_eoi(fd);
+        break;
+
+    case OPENCBM_NET_CLEAR_EOI:
+        result = cbm_clear_eoi(fd);
+        break;
+
+    case OPENCBM_NET_RESET:
+        result = cbm_reset(fd);
+        client->transaction = 0;
+        break;
+
+    case OPENCBM_NET_PP_READ:
+        result = cbm_pp_read(fd);
+        break;
+
+    case OPENCBM_NET_PP_WRITE:
+        cbm_pp_write(fd, request.Arg1);
+        break;
+
+    case OPENCBM_NET_IEC_POLL:
+        result = cbm_iec_poll(fd);
+        break;
+
+    case OPENCBM_NET_IEC_SETRELEASE:
+        cbm_iec_setrelease(fd, request.Arg1, request.Arg2);
+        break;
+
+    case OPENCBM_NET_IEC_WAIT:
+        result = cbm_iec_wait(fd, request.Arg1, request.Arg2);
+        break;
+
+    default:
+        result = -1;
+        break;
+    }
+
+    // the client keeps the bus as long as it might not be done with it
+
+    owner = (client->locked || client->transaction) ? client : NULL;
+
+    OPENCBM_NET_PUT32(answer.Result, (long) result);
+    OPENCBM_NET_PUT32(answer.Length, answer_length);
+
+    iov[0].iov_base = &answer;
+    iov[0].iov_len = sizeof answer;
+    iov[1].iov_base = data;
+    iov[1].iov_len = answer_length;
+
+    if (send_all(client->sock, iov, answer_length ? 2 : 1))
+        return 1;
+
+    return 0;
+}
+
+static int serve(CBM_FILE fd, int *listen_socks, int listen_count)
+{
+    /* the client to serve first, so all of them get their turn */
+    int next = 0;
+
+    for (;;)
+    {
+        fd_set readable;
+        int maxfd = -1;
+        int i;
+
+        FD_ZERO(&readable);
+
+        for (i = 0; i < listen_count; i++)
+        {
+            FD_SET(listen_socks[i], &readable);
+            if (listen_socks[i] > maxfd)
+                maxfd = listen_socks[i];
+        }
+
+        // while a client has the bus, only its requests are run
+
+        for (i = 0; i < MAX_CLIENTS; i++)
+        {
+            if (clients[i].sock >= 0 && (owner == NULL || owner == &clients[i]))
+            {
+                FD_SET(clients[i].sock, &readable);
+                if (clients[i].sock > maxfd)
+                    maxfd = clients[i].sock;
+            }
+        }
+
+        if (select(maxfd + 1, &readable, NULL, NULL, NULL) < 0)
+        {
+            perror("select");
+            return 1;
+        }
+
+        for (i = 0; i < listen_count; i++)
+        {
+            if (FD_ISSET(listen_socks[i], &readable))
+                accept_client(listen_socks[i]);
+        }
+
+        for (i = 0; i < MAX_CLIENTS; i++)
+        {
+            struct client *client = &clients[(next + i) % MAX_CLIENTS];
+
+            if (client->sock < 0 || !FD_ISSET(client->sock, &readable))
+                continue;
+
+            // another client might have taken the bus in the meantime
+
+            if (owner != NULL && owner != client)
+                continue;
+
+            if (serve_request(fd, client))
+                drop_client(fd, client);
+        }
+
+        next = (next + 1) % MAX_CLIENTS;
+    }
+}
+
+int ARCH_MAINDECL main(int argc, char *argv[])
+{
+    CBM_FILE fd;
+    char *adapter = NULL;
+    char *address = NULL;
+    char *port = OPENCBM_NET_DEFAULT_PORT;
+    int listen_socks[MAX_LISTEN];
+    int listen_count;
+    int option;
+    int rv;
+    int i;
+
+    struct option longopts[] =
+    {
+        { "help"       , no_argument      , NULL, 'h' },
+        { "version"    , no_argument      , NULL, 'V' },
+        { "adapter"    , required_argument, NULL, '@' },
+        { "address"    , required_argument, NULL, 'a' },
+        { "port"       , required_argument, NULL, 'p' },
+        { "verbose"    , no_argument      , NULL, 'v' },
+        { NULL         , 0                , NULL, 0   }
+    };
+
+    const char shortopts[] ="hV@:a:p:v";
+
+    while((option = getopt_long(argc, argv, shortopts, longopts, NULL)) != -1)
+    {
+        switch(option)
+        {
+            case 'h': help();
+                      return 0;
+            case 'V': printf("cbmserver %s\n", OPENCBM_VERSION);
+                      return 0;
+            case '@': if (adapter == NULL)
+                          adapter = cbmlibmisc_strdup(optarg);
+                      else
+                      {
+                          fprintf(stderr, "--adapter/-@ given more than once.");
+                          hint(argv[0]);
+                          return 1;
+                      }
+                      break;
+            case 'a': address = optarg;
+                      break;
+            case 'p': port = optarg;
+                      break;
+            case 'v': verbose = 1;
+                      break;
+            default : hint(argv[0]);
+                      return 1;
+        }
+    }
+
+    if (optind != argc)
+    {
+        fprintf(stderr, "Usage: %s [OPTION]...\n", argv[0]);
+        hint(argv[0]);
+        return 1;
+    }
+
+    // a client going away must not terminate the server
+
+    signal(SIGPIPE, SIG_IGN);
+
+    for (i = 0; i < MAX_CLIENTS; i++)
+        clients[i].sock = -1;
+
+    listen_count = open_listen_sockets(address, port, listen_socks);
+    if (listen_count == 0)
+        return 1;
+
+    if (cbm_driver_open_ex(&fd, adapter) != 0)
+    {
+        arch_error(0, arch_get_errno(), "%s", cbm_get_driver_name_ex(adapter));
+        cbmlibmisc_strfree(adapter);
+        return 1;
+    }
+
+    cbmlibmisc_strfree(adapter);
+
+    rv = serve(fd, listen_socks, listen_count);
+
+    cbm_driver_close(fd);
+
+    return rv;
+}
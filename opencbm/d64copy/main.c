@@ -19,15 +19,58 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <time.h>
 
 
 /* setable via command line */
 static d64copy_severity_e verbosity = sev_warning;
 static int no_progress = 0;
+static int disk_batch = -1;
+static const char *convert_to = NULL;
+static int convert_jobs = 0;
+static const char *metrics_file = NULL;
+static FILE *track_report = NULL;
 
 /* other globals */
 static CBM_FILE fd_cbm;
 
+/* the number of times ^C has been pressed */
+static volatile int interrupted = 0;
+
+/* the adapters opened for the drives of a --disk-batch with several drives */
+#define MAX_STATIONS 8
+static CBM_FILE adapter_fd[MAX_STATIONS];
+static int adapters_open = 0;
+
+/* the counters written to the metrics file */
+static struct
+{
+    const char *drive;
+    int disks_ok;
+    int disks_failed;
+    long blocks;
+    long block_errors;
+    int busy;
+    double started;
+    double last_seconds;
+    int last_blocks;
+    time_t last_done;
+} metrics;
+
+/* the track the track report is collecting the blocks of */
+static struct
+{
+    int disk;
+    int track;
+    int sectors;
+    int copied;
+    int failed;
+    int revolution_us;
+    double started;
+} report;
+
+static void my_message_cb(int severity, const char *format, ...);
+
 
 static int is_cbm(char *name)
 {
@@ -36,10 +79,175 @@ static int is_cbm(char *name)
 }
 
 
+/*
+ * write the counters in the OpenMetrics text format, to be picked up by
+ * the textfile collector of a Prometheus node exporter. The file is
+ * written as FILE.tmp and renamed, so it is never seen half written.
+ */
+static void write_metrics(void)
+{
+    const char *d = metrics.drive;
+    char *tmp;
+    FILE *f;
+
+    if(metrics_file == NULL)
+    {
+        return;
+    }
+
+    tmp = malloc(strlen(metrics_file) + 5);
+    if(tmp == NULL)
+    {
+        return;
+    }
+    sprintf(tmp, "%s.tmp", metrics_file);
+
+    f = fopen(tmp, "w");
+    if(f == NULL)
+    {
+        my_message_cb(1, "cannot write %s", tmp);
+        free(tmp);
+        return;
+    }
+
+    fprintf(f, "# TYPE d64copy_disks counter\n"
+               "# HELP d64copy_disks Disks copied.\n"
+               "d64copy_disks_total{drive=\"%s\",result=\"ok\"} %d\n"
+               "d64copy_disks_total{drive=\"%s\",result=\"failed\"} %d\n",
+               d, metrics.disks_ok, d, metrics.disks_failed);
+    fprintf(f, "# TYPE d64copy_blocks counter\n"
+               "# HELP d64copy_blocks Blocks copied.\n"
+               "d64copy_blocks_total{drive=\"%s\"} %ld\n", d, metrics.blocks);
+    fprintf(f, "# TYPE d64copy_block_errors counter\n"
+               "# HELP d64copy_block_errors Failed reads or writes of a block, retries included.\n"
+               "d64copy_block_errors_total{drive=\"%s\"} %ld\n", d, metrics.block_errors);
+    fprintf(f, "# TYPE d64copy_busy gauge\n"
+               "# HELP d64copy_busy 1 while a disk is copied.\n"
+               "d64copy_busy{drive=\"%s\"} %d\n", d, metrics.busy);
+    fprintf(f, "# TYPE d64copy_last_disk_seconds gauge\n"
+               "# UNIT d64copy_last_disk_seconds seconds\n"
+               "# HELP d64copy_last_disk_seconds Time taken by the last disk.\n"
+               "d64copy_last_disk_seconds{drive=\"%s\"} %.3f\n", d, metrics.last_seconds);
+    fprintf(f, "# TYPE d64copy_last_disk_blocks gauge\n"
+               "# HELP d64copy_last_disk_blocks Blocks copied from the last disk.\n"
+               "d64copy_last_disk_blocks{drive=\"%s\"} %d\n", d, metrics.last_blocks);
+    fprintf(f, "# TYPE d64copy_last_disk_timestamp_seconds gauge\n"
+               "# UNIT d64copy_last_disk_timestamp_seconds seconds\n"
+               "# HELP d64copy_last_disk_timestamp_seconds When the last disk was done.\n"
+               "d64copy_last_disk_timestamp_seconds{drive=\"%s\"} %ld\n",
+               d, (long) metrics.last_done);
+    fprintf(f, "# EOF\n");
+
+    if(fclose(f) != 0)
+    {
+        my_message_cb(1, "cannot write %s", tmp);
+        remove(tmp);
+    }
+    else
+    {
+#ifdef WIN32
+        /* rename() does not replace a file on Windows */
+        remove(metrics_file);
+#endif
+        if(rename(tmp, metrics_file) != 0)
+        {
+            my_message_cb(1, "cannot rename %s to %s", tmp, metrics_file);
+            remove(tmp);
+        }
+    }
+    free(tmp);
+}
+
+/*
+ * one line of the track report per track: the blocks copied, the failed
+ * attempts to read or write a block, and the time spent on the track
+ */
+static void report_track_end(void)
+{
+    double now = arch_time_us();
+
+    if(track_report != NULL && report.track != 0)
+    {
+        fprintf(track_report, "%d,%d,%d,%d,%d,%.3f,%.2f\n",
+                report.disk, report.track, report.sectors,
+                report.copied, report.failed,
+                (now - report.started) / 1000000.0,
+                report.revolution_us ? 60000000.0 / report.revolution_us : 0.0);
+        fflush(track_report);
+    }
+    report.track = 0;
+    report.started = now;
+}
+
+static void report_block(int track, int sectors, int failed, int revolution_us)
+{
+    if(track_report == NULL)
+    {
+        return;
+    }
+
+    if(track != report.track)
+    {
+        report_track_end();
+        report.track = track;
+        report.sectors = sectors;
+        report.copied = 0;
+        report.failed = 0;
+    }
+    report.revolution_us = revolution_us;
+
+    if(failed)
+    {
+        report.failed++;
+    }
+    else
+    {
+        report.copied++;
+    }
+}
+
+static int open_track_report(const char *name)
+{
+    track_report = fopen(name, "w");
+    if(track_report == NULL)
+    {
+        my_message_cb(0, "cannot create %s", name);
+        return 1;
+    }
+    fprintf(track_report, "disk,track,sectors,copied,failed,seconds,rpm\n");
+    return 0;
+}
+
+static void metrics_disk_begin(void)
+{
+    metrics.busy = 1;
+    metrics.started = arch_time_us();
+    write_metrics();
+}
+
+static void metrics_disk_end(int rv)
+{
+    metrics.busy = 0;
+    metrics.last_seconds = (arch_time_us() - metrics.started) / 1000000.0;
+    metrics.last_blocks = rv >= 0 ? rv : 0;
+    metrics.last_done = time(NULL);
+    if(rv >= 0)
+    {
+        metrics.disks_ok++;
+        metrics.blocks += rv;
+    }
+    else
+    {
+        metrics.disks_failed++;
+    }
+    write_metrics();
+}
+
+
 static void help()
 {
     printf(
-"Usage: d64copy [OPTION]... [SOURCE] [TARGET]\n"
+"Usage: d64copy [OPTION]... [SOURCE] [TARGET]...\n"
 "Copy .d64 disk images to a CBM-1541 or compatible drive and vice versa\n"
 "\n"
 "Options:\n"
@@ -59,13 +267,16 @@ static void help()
 "                              serial1 or s1\n"
 "                              serial2 or s2\n"
 "                              parallel       (fastest)\n"
+"                              parallel2 or p2\n"
 "                            (can be abbreviated, if unambiguous)\n"
 "                            `original' and `serial1' should work in any case;\n"
 "                            `serial2' won't work if more than one device is\n"
 "                            connected to the IEC bus;\n"
 "                            `parallel' needs a XP1541/XP1571 cable in addition\n"
-"                            to the serial one.\n"
-"                            `auto' tries to determine the best option.\n"
+"                            to the serial one. `parallel2' uses the same\n"
+"                            cable with one byte per handshake, as cbmcopy.\n"
+"                            `auto' measures the modes which can work, and\n"
+"                            uses the fastest one.\n"
 "\n"
 "  -i, --interleave=VALUE    set interleave value; ignored when reading with\n"
 "                            warp mode; default values are:\n"
@@ -76,6 +287,7 @@ static void help()
 "                              serial1       4            6\n"
 "                              serial2      13           12\n"
 "                              parallel      7            4\n"
+"                              parallel2     7            4\n"
 "\n"
 "                            INTERLEAVE is ignored when reading with warp mode;\n"
 "                            if data transfer is very slow, increasing this\n"
@@ -101,6 +313,11 @@ static void help()
 "\n"
 "  -r, --retry-count=COUNT   set retry count\n"
 "\n"
+"  -P, --defer-retries       retry the blocks which have failed after all\n"
+"                            tracks have been copied once, instead of right\n"
+"                            away on their track: the good tracks do not\n"
+"                            wait for the retries of a bad one.\n"
+"\n"
 "  -E, --error-map=WHEN      control whether the error map is appended.\n"
 "                            possible values for WHEN are (abbreviations\n"
 "                            available):\n"
@@ -111,6 +328,88 @@ static void help()
 "  -2, --two-sided           two-sided disk transfer (.d71): Requires 1571.\n"
 "                            Warp mode is not available for .d71 images.\n"
 "\n"
+"  -A, --adaptive            adapt retries and interleave to the errors and\n"
+"                            the speed seen while copying.\n"
+"\n"
+"  -R, --resume              resume an interrupted copy to an image file:\n"
+"                            only the blocks not copied yet are read.\n"
+"                            The progress is kept in IMAGE.chk meanwhile.\n"
+"\n"
+"  -U, --update              update an existing image file or disk: the\n"
+"                            drive computes a checksum of every block, and\n"
+"                            only the blocks which differ between the image\n"
+"                            and the disk are read or written.\n"
+"\n"
+"  -y, --verify              verify the disk written: the drive computes a\n"
+"                            checksum of every block written. The blocks\n"
+"                            which differ are written again, as often as\n"
+"                            the retry count, but once at least.\n"
+"\n"
+"  -M, --manifest=FILE       add the CRC-32 of the image file written to FILE,\n"
+"                            in the format of a .sfv file. It is computed\n"
+"                            while the blocks arrive.\n"
+"\n"
+"  -Z, --container=FILE      move the image file into the zip archive FILE\n"
+"                            when it has been written. With --disk-batch, all\n"
+"                            the disks end up in FILE, which has an index of\n"
+"                            them and can be opened by the usual tools.\n"
+"\n"
+"  -x, --extract=DIR         write the files on the disk to the directory DIR\n"
+"                            as well, while it is read to an image: the disk\n"
+"                            is read only once. Existing files are not\n"
+"                            overwritten, the new ones get a number then.\n"
+"\n"
+"  -m, --metrics=FILE        keep the counters of the disks and blocks copied\n"
+"                            in FILE, in the OpenMetrics text format, for the\n"
+"                            textfile collector of a Prometheus node exporter.\n"
+"                            FILE is rewritten before and after every disk.\n"
+"\n"
+"  -T, --track-report=FILE   write a line for every track copied to FILE as\n"
+"                            comma separated values: disk, track, sectors,\n"
+"                            blocks copied, failed reads or writes of a block,\n"
+"                            the seconds spent on the track and the speed of\n"
+"                            the disk in rpm, measured from the blocks read\n"
+"                            in warp mode (0 otherwise). A track copied again\n"
+"                            in a later pass gets a line again.\n"
+"\n"
+"  -C, --convert=EXT         convert every image given to an image with the\n"
+"                            same name and the extension EXT, e.g. d64, g64\n"
+"                            or ddi, without a drive. The images are\n"
+"                            converted at the same time by several threads.\n"
+"\n"
+"  -j, --jobs=COUNT          convert COUNT images at the same time\n"
+"                            (default: one per processor).\n"
+"\n"
+"  -D, --disk-batch=COUNT    read COUNT disks one after another without being\n"
+"                            asked (0: until interrupted): whenever a disk has\n"
+"                            been read, the next one is read as soon as it is\n"
+"                            put into the drive. The number of the disk is\n"
+"                            put into the name of TARGET: image-001.d64, ...\n"
+"                            SOURCE can be a list of drives, each one on an\n"
+"                            adapter of its own if wanted:\n"
+"                            8,9,8@xum1541:1. They all read disks at the same\n"
+"                            time, and whichever has a disk ready takes the\n"
+"                            next number.\n"
+"\n"
+"An image TARGET of `-' writes the image to stdout. Images written to\n"
+"stdout or to a pipe are kept in memory and sent in order.\n"
+"An image SOURCE of `-' reads the image from stdin. Images read from stdin,\n"
+"a pipe or a *.gz file are written to the disk while they arrive; they have\n"
+"35 tracks, or the END track given.\n"
+"Images named *.gz are written gzip compressed.\n"
+"Images named *.g64 hold the GCR data of the tracks, as warp mode moves\n"
+"it; a block which could not be read is written with the same error.\n"
+"Images named *.ddi hold the numbers of their blocks in the block store\n"
+"blocks.dds/blocks.ddx next to them, which all the .ddi images of the\n"
+"directory share; a block found on several disks is only stored once.\n"
+"If both SOURCE and TARGET are drives, the disk is copied from drive to\n"
+"drive, with the `original' transfer; the blocks go over the bus only once.\n"
+"If SOURCE is an image and more than one TARGET drive is given, the image\n"
+"is written to all of them at the same time by the disk controllers of the\n"
+"drives; TRANSFER and warp mode are not used then.\n"
+"If neither SOURCE nor TARGET is a drive, SOURCE is converted to the format\n"
+"of TARGET. Images named *.nib, as nibread writes them, can be read, too.\n"
+"\n"
 );
 }
 
@@ -141,51 +440,63 @@ static void my_message_cb(int severity, const char *format, ...)
     }
 }
 
-static int my_status_cb(d64copy_status status)
+static void track_to_string(const char *bam, char *trackmap)
 {
-    static char trackmap[MAX_SECTORS+1];
-    static int last_track;
-    char *s;
-    char *d;
-
     static const char bs2char[] =
     {
         ' ', '.', '-', '?', '*'
     };
 
-    if(status.track == 0)
+    for(; *bam; bam++, trackmap++)
+    {
+        *trackmap = bs2char[(int)*bam];
+    }
+    *trackmap = '\0';
+}
+
+static int my_status_cb(const d64copy_status *status)
+{
+    static int last_track;
+    char trackmap[MAX_SECTORS+1];
+
+    if(status->track == 0)
     {
         last_track = 0;
+        report.disk++;
+        report_track_end();
         return 0;
     }
 
+    if(status->read_result || status->write_result)
+    {
+        metrics.block_errors++;
+    }
+
+    report_block(status->track,
+                 (int) strlen(status->bam[status->track-1]),
+                 status->read_result || status->write_result,
+                 status->revolution_us);
+
     if(no_progress)
     {
         return 0;
     }
 
-    if(last_track != status.track)
+    if(last_track != status->track)
     {
         if(last_track)
         {
+            track_to_string(status->bam[last_track-1], trackmap);
             printf("\r%2d: %-24s               \n", last_track, trackmap);
         }
-
-        for(s = status.bam[status.track-1], d = trackmap; *s; s++, d++)
-        {
-            *d = bs2char[(int)*s];
-        }
-        *d = '\0';
-        last_track = status.track;
+        last_track = status->track;
     }
 
-    trackmap[status.sector] =
-        bs2char[(status.read_result ||
-                 status.write_result) ? bs_error : bs_copied];
+    track_to_string(status->bam[status->track-1], trackmap);
 
-    printf("\r%2d: %-24s%3d%%  %4d/%d", status.track, trackmap,
-           100 * status.sectors_processed / status.total_sectors,
-           status.sectors_processed, status.total_sectors);
+    printf("\r%2d: %-24s%3d%%  %4d/%d", status->track, trackmap,
+           100 * status->sectors_processed / status->total_sectors,
+           status->sectors_processed, status->total_sectors);
 
     fflush(stdout);
     return 0;
@@ -196,6 +507,20 @@ static void ARCH_SIGNALDECL reset(int dummy)
 {
     CBM_FILE fd_cbm_local;
 
+    /*
+     * the first time, the copies end their turbo at the next track, which
+     * leaves the drives ready without a reset. If they do not get there,
+     * e.g. as a drive does not answer, the next time resets the bus.
+     */
+    if(interrupted++ == 0)
+    {
+        fprintf(stderr, "\nSIGINT caught X-(  Stopping at the next track, "
+                        "again to reset the IEC bus...\n");
+        d64copy_abort();
+        arch_set_ctrlbreak_handler(reset);
+        return;
+    }
+
     /*
      * remember fd_cbm, and make the global one invalid
      * so that no routine can call a cbm_...() routine
@@ -209,11 +534,169 @@ static void ARCH_SIGNALDECL reset(int dummy)
     printDebugLibD64Counters(my_message_cb);
 #endif
     d64copy_cleanup();
+    if(adapters_open)
+    {
+        int i;
+
+        for(i = 0; i < adapters_open; i++)
+        {
+            cbm_reset(adapter_fd[i]);
+            cbm_driver_close(adapter_fd[i]);
+        }
+        exit(1);
+    }
     cbm_reset(fd_cbm_local);
     cbm_driver_close(fd_cbm_local);
     exit(1);
 }
 
+static void ARCH_SIGNALDECL stop_convert(int dummy)
+{
+    if(interrupted++ == 0)
+    {
+        fprintf(stderr, "\nSIGINT caught X-(  Stopping the conversion...\n");
+        d64copy_abort();
+        arch_set_ctrlbreak_handler(stop_convert);
+        return;
+    }
+    exit(1);
+}
+
+static int convert(d64copy_settings *settings, char *src_arg, char *dst_arg)
+{
+    int rv;
+
+    arch_set_ctrlbreak_handler(stop_convert);
+
+    rv = d64copy_convert_image(settings, src_arg, dst_arg, my_message_cb);
+    if(rv > 0)
+    {
+        my_message_cb(1, "%d blocks could not be read from %s", rv, src_arg);
+    }
+    else if(rv == 0)
+    {
+        my_message_cb(2, "%s converted to %s", src_arg, dst_arg);
+    }
+    return rv < 0;
+}
+
+static int convert_all(d64copy_settings *settings, int count, char **images)
+{
+    int rv;
+
+    arch_set_ctrlbreak_handler(stop_convert);
+
+    rv = d64copy_convert_images(settings, (const char * const *)images, count,
+                                convert_to, convert_jobs, my_message_cb);
+    printf("%d of %d images converted without errors.\n", rv, count);
+    return rv != count;
+}
+
+static int same_adapter(const char *a, const char *b)
+{
+    if(a == NULL || b == NULL)
+    {
+        return a == b;
+    }
+    return strcmp(a, b) == 0;
+}
+
+/*
+ * --disk-batch with a SOURCE of DRIVE[@ADAPTER][,DRIVE[@ADAPTER]]...:
+ * all drives read disks at the same time. A drive without an ADAPTER is
+ * on the one given with -@.
+ */
+static int read_batch(d64copy_settings *settings, char *src_arg,
+                      const char *dst_arg, char *adapter)
+{
+    d64copy_station stations[MAX_STATIONS];
+    char *adapter_name[MAX_STATIONS];
+    char *drive, *at;
+    int count = 0;
+    int rv = 0;
+    int i;
+
+    for(drive = strtok(src_arg, ","); drive != NULL && rv == 0;
+        drive = strtok(NULL, ","))
+    {
+        at = strchr(drive, '@');
+        if(at != NULL)
+        {
+            *at++ = '\0';
+        }
+        else
+        {
+            at = adapter;
+        }
+
+        if(!is_cbm(drive))
+        {
+            my_message_cb(0, "invalid drive: %s", drive);
+            rv = 1;
+            break;
+        }
+        if(count == MAX_STATIONS)
+        {
+            my_message_cb(0, "--disk-batch reads with at most %d drives", MAX_STATIONS);
+            rv = 1;
+            break;
+        }
+
+        for(i = 0; i < adapters_open; i++)
+        {
+            if(same_adapter(adapter_name[i], at))
+            {
+                break;
+            }
+        }
+        if(i == adapters_open)
+        {
+            if(cbm_driver_open_ex(&adapter_fd[i], at) != 0)
+            {
+                arch_error(0, arch_get_errno(), "%s", cbm_get_driver_name_ex(at));
+                rv = 1;
+                break;
+            }
+            adapter_name[i] = at;
+            adapters_open++;
+        }
+
+        stations[count].cbm_fd = adapter_fd[i];
+        stations[count].drive = atoi(drive);
+        for(i = 0; i < count; i++)
+        {
+            if(stations[i].cbm_fd == stations[count].cbm_fd &&
+               stations[i].drive == stations[count].drive)
+            {
+                my_message_cb(0, "drive %s given more than once", drive);
+                rv = 1;
+            }
+        }
+        count++;
+    }
+
+    if(rv == 0)
+    {
+        arch_set_ctrlbreak_handler(reset);
+
+        rv = d64copy_read_batch(stations, count, settings, dst_arg,
+                                disk_batch, my_message_cb);
+        if(rv >= 0)
+        {
+            printf("%d disks read.\n", rv);
+        }
+        rv = 0;
+    }
+
+    for(i = 0; i < adapters_open; i++)
+    {
+        cbm_driver_close(adapter_fd[i]);
+    }
+    adapters_open = 0;
+
+    return rv;
+}
+
 int ARCH_MAINDECL main(int argc, char *argv[])
 {
     d64copy_settings *settings = d64copy_get_default_settings();
@@ -248,12 +731,25 @@ int ARCH_MAINDECL main(int argc, char *argv[])
         { "bam-save"   , no_argument      , NULL, 'B' },
         { "drive-type" , required_argument, NULL, 'd' },
         { "retry-count", required_argument, NULL, 'r' },
+        { "defer-retries", no_argument    , NULL, 'P' },
         { "two-sided"  , no_argument      , NULL, '2' },
         { "error-map"  , required_argument, NULL, 'E' },
+        { "resume"     , no_argument      , NULL, 'R' },
+        { "adaptive"   , no_argument      , NULL, 'A' },
+        { "update"     , no_argument      , NULL, 'U' },
+        { "verify"     , no_argument      , NULL, 'y' },
+        { "manifest"   , required_argument, NULL, 'M' },
+        { "container"  , required_argument, NULL, 'Z' },
+        { "extract"    , required_argument, NULL, 'x' },
+        { "disk-batch" , required_argument, NULL, 'D' },
+        { "convert"    , required_argument, NULL, 'C' },
+        { "jobs"       , required_argument, NULL, 'j' },
+        { "metrics"    , required_argument, NULL, 'm' },
+        { "track-report", required_argument, NULL, 'T' },
         { NULL         , 0                , NULL, 0   }
     };
 
-    const char shortopts[] ="hVwqbBt:i:s:e:d:r:2vnE:@:";
+    const char shortopts[] ="hVwqbBt:i:s:e:d:r:P2vnE:RAUyM:Z:x:D:C:j:m:T:@:";
 
     while((option = getopt_long(argc, argv, shortopts, longopts, NULL)) != -1)
     {
@@ -303,8 +799,51 @@ int ARCH_MAINDECL main(int argc, char *argv[])
                       break;
             case 'r': settings->retries = atoi(optarg);
                       break;
+            case 'P': settings->defer_retries = 1;
+                      break;
             case '2': settings->two_sided = 1;
                       break;
+            case 'R': settings->resume = 1;
+                      break;
+            case 'A': settings->adaptive = 1;
+                      break;
+            case 'U': settings->update = 1;
+                      break;
+            case 'y': settings->verify = 1;
+                      break;
+            case 'M': settings->manifest = optarg;
+                      break;
+            case 'Z': settings->container = optarg;
+                      break;
+            case 'x': settings->extract = optarg;
+                      break;
+            case 'D': disk_batch = atoi(optarg);
+                      if(disk_batch < 0)
+                      {
+                          hint(argv[0]);
+                          return 1;
+                      }
+                      break;
+            case 'C': convert_to = optarg[0] == '.' ? optarg + 1 : optarg;
+                      break;
+            case 'j': convert_jobs = atoi(optarg);
+                      if(convert_jobs < 0)
+                      {
+                          hint(argv[0]);
+                          return 1;
+                      }
+                      break;
+            case 'm': metrics_file = optarg;
+                      break;
+            case 'T': if(track_report != NULL)
+                      {
+                          fclose(track_report);
+                      }
+                      if(open_track_report(optarg) != 0)
+                      {
+                          return 1;
+                      }
+                      break;
             case 'E': l = strlen(optarg);
                       if(strncmp(optarg, "always", l) == 0)
                       {
@@ -358,9 +897,35 @@ int ARCH_MAINDECL main(int argc, char *argv[])
 
     my_message_cb(3, "transfer mode is %d", settings->transfer_mode );
 
-    if(optind + 2 != argc)
+    if(convert_to != NULL)
     {
-        fprintf(stderr, "Usage: %s [OPTION]... [SOURCE] [TARGET]\n", argv[0]);
+        if(optind >= argc)
+        {
+            fprintf(stderr, "Usage: %s --convert=EXT [OPTION]... IMAGE...\n", argv[0]);
+            hint(argv[0]);
+            return 1;
+        }
+        for(l = optind; l < argc; l++)
+        {
+            if(is_cbm(argv[l]))
+            {
+                my_message_cb(0, "--convert converts image files, not drives");
+                return 1;
+            }
+        }
+        rv = convert_all(settings, argc - optind, argv + optind);
+        if(track_report != NULL)
+        {
+            fclose(track_report);
+        }
+        cbmlibmisc_strfree(adapter);
+        free(settings);
+        return rv;
+    }
+
+    if(optind + 2 > argc)
+    {
+        fprintf(stderr, "Usage: %s [OPTION]... [SOURCE] [TARGET]...\n", argv[0]);
         hint(argv[0]);
         return 1;
     }
@@ -368,31 +933,159 @@ int ARCH_MAINDECL main(int argc, char *argv[])
     src_arg = argv[optind];
     dst_arg = argv[optind+1];
 
+    if(disk_batch >= 0 && strpbrk(src_arg, ",@") != NULL)
+    {
+        if(optind + 2 != argc || is_cbm(dst_arg) || strcmp(dst_arg, "-") == 0)
+        {
+            my_message_cb(0, "--disk-batch reads disks from a drive to image files");
+            rv = 1;
+        }
+        else if(metrics_file != NULL || track_report != NULL)
+        {
+            my_message_cb(0, "--metrics and --track-report need a single drive");
+            rv = 1;
+        }
+        else
+        {
+            rv = read_batch(settings, src_arg, dst_arg, adapter);
+        }
+        if(track_report != NULL)
+        {
+            fclose(track_report);
+        }
+        cbmlibmisc_strfree(adapter);
+        free(settings);
+        return rv;
+    }
+
     src_is_cbm = is_cbm(src_arg);
     dst_is_cbm = is_cbm(dst_arg);
 
-    if(src_is_cbm == dst_is_cbm)
+    for(l = optind + 2; l < argc; l++)
+    {
+        if(src_is_cbm || !is_cbm(argv[l]) || !dst_is_cbm)
+        {
+            my_message_cb(0, "with several TARGETs, SOURCE must be an image and all TARGETs drives");
+            return 1;
+        }
+    }
+
+    if(disk_batch >= 0 && (!src_is_cbm || dst_is_cbm || strcmp(dst_arg, "-") == 0))
     {
-        my_message_cb(0, "either source or target must be a CBM drive");
+        my_message_cb(0, "--disk-batch reads disks from a drive to image files");
         return 1;
     }
 
+    if(settings->extract != NULL && (!src_is_cbm || dst_is_cbm))
+    {
+        my_message_cb(1, "--extract only applies when a disk is read to an image");
+    }
+
+    if(settings->verify && (src_is_cbm || !dst_is_cbm))
+    {
+        my_message_cb(1, "--verify only applies when an image is written to a disk");
+    }
+
+    metrics.drive = src_is_cbm ? src_arg : dst_arg;
+
+    if(strcmp(dst_arg, "-") == 0)
+    {
+        /* the image goes to stdout */
+        no_progress = 1;
+    }
+
+    if(!src_is_cbm && !dst_is_cbm)
+    {
+        if(optind + 2 != argc || strcmp(dst_arg, "-") == 0)
+        {
+            my_message_cb(0, "an image is converted to one image file");
+            return 1;
+        }
+        rv = convert(settings, src_arg, dst_arg);
+        if(track_report != NULL)
+        {
+            fclose(track_report);
+        }
+        cbmlibmisc_strfree(adapter);
+        free(settings);
+        return rv;
+    }
+
     if(cbm_driver_open_ex(&fd_cbm, adapter) == 0)
     {
         /*
          * If the user specified auto transfer mode, find out
          * which transfer mode to use.
          */
-        settings->transfer_mode =
-            d64copy_check_auto_transfer_mode(fd_cbm,
-                settings->transfer_mode,
-                atoi(src_is_cbm ? src_arg : dst_arg));
+        if((!src_is_cbm || !dst_is_cbm) && optind + 2 == argc)
+        {
+            settings->transfer_mode =
+                d64copy_check_auto_transfer_mode(fd_cbm,
+                    settings->transfer_mode,
+                    atoi(src_is_cbm ? src_arg : dst_arg));
+        }
 
         my_message_cb(3, "decided to use transfer mode %d", settings->transfer_mode );
 
         arch_set_ctrlbreak_handler(reset);
 
-        if(src_is_cbm)
+        if(disk_batch < 0)
+        {
+            metrics_disk_begin();
+        }
+
+        if(optind + 2 < argc)
+        {
+            int drives[4];
+            int count = 0;
+
+            for(l = optind + 1; l < argc && count < 4; l++)
+            {
+                drives[count++] = atoi(argv[l]);
+            }
+            rv = d64copy_write_image_multi(fd_cbm, settings, src_arg,
+                    drives, count, my_message_cb, my_status_cb);
+        }
+        else if(src_is_cbm && dst_is_cbm)
+        {
+            rv = d64copy_copy_disk(fd_cbm, settings, atoi(src_arg), atoi(dst_arg),
+                    my_message_cb, my_status_cb);
+        }
+        else if(disk_batch >= 0)
+        {
+            int disk;
+            char *name;
+
+            for(disk = 1; disk_batch == 0 || disk <= disk_batch; disk++)
+            {
+                if(disk > 1 &&
+                   d64copy_wait_disk_change(fd_cbm, atoi(src_arg), my_message_cb) != 0)
+                {
+                    break;
+                }
+
+                name = d64copy_batch_image_name(dst_arg, disk);
+                if(name == NULL)
+                {
+                    my_message_cb(0, "no memory");
+                    break;
+                }
+
+                my_message_cb(1, "reading disk %d to %s", disk, name);
+                metrics_disk_begin();
+                rv = d64copy_read_image(fd_cbm, settings, atoi(src_arg), name,
+                        my_message_cb, my_status_cb);
+                report_track_end();
+                metrics_disk_end(rv);
+                if(!no_progress && rv >= 0)
+                {
+                    printf("\n%d blocks copied.\n", rv);
+                }
+                free(name);
+            }
+            rv = -1;
+        }
+        else if(src_is_cbm)
         {
             rv = d64copy_read_image(fd_cbm, settings, atoi(src_arg), dst_arg,
                     my_message_cb, my_status_cb);
@@ -403,6 +1096,12 @@ int ARCH_MAINDECL main(int argc, char *argv[])
                     my_message_cb, my_status_cb);
         }
 
+        if(disk_batch < 0)
+        {
+            report_track_end();
+            metrics_disk_end(rv);
+        }
+
         if(!no_progress && rv >= 0)
         {
             printf("\n%d blocks copied.\n", rv);
@@ -416,6 +1115,11 @@ int ARCH_MAINDECL main(int argc, char *argv[])
         arch_error(0, arch_get_errno(), "%s", cbm_get_driver_name_ex(adapter));
     }
 
+    if(track_report != NULL)
+    {
+        fclose(track_report);
+    }
+
     cbmlibmisc_strfree(adapter);
     free(settings);
 
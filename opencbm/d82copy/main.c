@@ -138,6 +138,10 @@ static void help()
 "  -2, --two-sided           two-sided disk transfer (.d82): Requires CBM-8250\n"
 "                            or SFD-1001 diskette drive.\n"
 "\n"
+"If SOURCE and TARGET are the two drives of one unit, like 8:0 and 8:1,\n"
+"the disk is copied by the duplicate command of the DOS, without any\n"
+"transfer over the bus.\n"
+"\n"
 );
 }
 
@@ -404,6 +408,29 @@ int ARCH_MAINDECL main(int argc, char *argv[])
     src_is_cbm = cbm_address_extract_drive_and_medium(src_arg, &src_unit);
     dst_is_cbm = cbm_address_extract_drive_and_medium(dst_arg, &dst_unit);
 
+    if(src_is_cbm && dst_is_cbm &&
+       (src_unit & 0x7f) == (dst_unit & 0x7f) && src_unit != dst_unit)
+    {
+        /* both drives of one unit: the DOS copies on its own */
+        if(cbm_driver_open_ex(&fd_cbm, adapter) != 0)
+        {
+            arch_error(0, arch_get_errno(), "%s", cbm_get_driver_name_ex(adapter));
+            cbmlibmisc_strfree(adapter);
+            free(settings);
+            return 1;
+        }
+        rv = d82copy_duplicate_disk(fd_cbm, settings, src_unit, dst_unit,
+                my_message_cb);
+        if(!no_progress && rv >= 0)
+        {
+            printf("%d blocks copied.\n", rv);
+        }
+        cbm_driver_close(fd_cbm);
+        cbmlibmisc_strfree(adapter);
+        free(settings);
+        return rv < 0;
+    }
+
     if(src_is_cbm == dst_is_cbm)
     {
         my_message_cb(0, "either source or target must be a CBM drive");
@@ -30,10 +30,22 @@ static char *rcsid =
 /* setable via command line */
 static imgcopy_severity_e verbosity = sev_warning;
 static int no_progress = 0;
+static FILE *track_report = NULL;
 
 /* other globals */
 static CBM_FILE fd_cbm;
 
+/* the track the track report is collecting the blocks of */
+static struct
+{
+    int disk;
+    int track;
+    int sectors;
+    int copied;
+    int failed;
+    double started;
+} report;
+
 
 static int is_cbm(char *name)
 {
@@ -50,6 +62,7 @@ static void help(void)
 "Copy .d81 disk images to a 1581 or compatible drive and vice versa\n"
 "\n"
 "The extension of Imagfile select Imagefiletype (.d64, .d71, .d80, .d81, .d82)\n"
+"An additional .gz extension writes the image gzip compressed.\n"
 "\n"
 "Options:\n"
 "  -h, --help               display this help and exit\n"
@@ -106,6 +119,11 @@ static void help(void)
 "\n"
 "  -2, --two-sided          two-sided disk transfer (.d82): Requires CBM-8250 or SFD-1001.\n"
 "\n"
+"  -T, --track-report=FILE  write a line for every track copied to FILE as\n"
+"                           comma separated values: disk, track, sectors,\n"
+"                           blocks copied, failed reads or writes of a block\n"
+"                           and the seconds spent on the track.\n"
+"\n"
 );
 }
 
@@ -143,6 +161,64 @@ static void my_message_cb(int severity, const char *format, ...)
     }
 }
 
+//
+// one line of the track report per track: the blocks copied, the failed
+// attempts to read or write a block, and the time spent on the track
+//
+static void report_track_end(void)
+{
+    double now = arch_time_us();
+
+    if(track_report != NULL && report.track != 0)
+    {
+        fprintf(track_report, "%d,%d,%d,%d,%d,%.3f\n",
+                report.disk, report.track, report.sectors,
+                report.copied, report.failed,
+                (now - report.started) / 1000000.0);
+        fflush(track_report);
+    }
+    report.track = 0;
+    report.started = now;
+}
+
+static void report_block(int track, int sectors, int failed)
+{
+    if(track_report == NULL)
+    {
+        return;
+    }
+
+    if(track != report.track)
+    {
+        report_track_end();
+        report.track = track;
+        report.sectors = sectors;
+        report.copied = 0;
+        report.failed = 0;
+    }
+
+    if(failed)
+    {
+        report.failed++;
+    }
+    else
+    {
+        report.copied++;
+    }
+}
+
+static int open_track_report(const char *name)
+{
+    track_report = fopen(name, "w");
+    if(track_report == NULL)
+    {
+        my_message_cb(0, "cannot create %s", name);
+        return 1;
+    }
+    fprintf(track_report, "disk,track,sectors,copied,failed,seconds\n");
+    return 0;
+}
+
 //
 // print status line while copy
 //
@@ -161,9 +237,14 @@ static int my_status_cb(imgcopy_status status)
     if(status.track == 0)
     {
         last_track = 0;
+        report.disk++;
+        report_track_end();
         return 0;
     }
 
+    report_block(status.track, (int) strlen(status.bam[status.track-1]),
+                 status.read_result || status.write_result);
+
     if(no_progress)
     {
         return 0;
@@ -262,10 +343,11 @@ int ARCH_MAINDECL main(int argc, char *argv[])
         { "one-sided"  , no_argument      , NULL, '1' },
         { "two-sided"  , no_argument      , NULL, '2' },
         { "error-map"  , required_argument, NULL, 'E' },
+        { "track-report", required_argument, NULL, 'T' },
         { NULL         , 0                , NULL, 0   }
     };
 
-    const char shortopts[] ="hVwqbBt:i:s:e:d:r:2vnE:@:";
+    const char shortopts[] ="hVwqbBt:i:s:e:d:r:2vnE:T:@:";
 
     while((c=getopt_long(argc, argv, shortopts, longopts, NULL)) != -1)
     {
@@ -356,6 +438,15 @@ int ARCH_MAINDECL main(int argc, char *argv[])
                       break;
             case '2': settings->two_sided = 1;
                       break;
+            case 'T': if(track_report != NULL)
+                      {
+                          fclose(track_report);
+                      }
+                      if(open_track_report(optarg) != 0)
+                      {
+                          return 1;
+                      }
+                      break;
             case 'E': l = strlen(optarg);
                       if(strncmp(optarg, "always", l) == 0)
                       {
@@ -454,6 +545,8 @@ int ARCH_MAINDECL main(int argc, char *argv[])
                     my_message_cb, my_status_cb);
         }
 
+        report_track_end();
+
         if(!no_progress && rv >= 0)
         {
             printf("\n%d blocks copied.\n", rv);
@@ -467,6 +560,11 @@ int ARCH_MAINDECL main(int argc, char *argv[])
         arch_error(0, arch_get_errno(), "%s", cbm_get_driver_name_ex(adapter));
     }
 
+    if(track_report != NULL)
+    {
+        fclose(track_report);
+    }
+
     cbmlibmisc_strfree(adapter);
     free(settings);
 
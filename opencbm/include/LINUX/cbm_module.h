@@ -22,7 +22,8 @@
 #endif
 #endif
 
-/* all values needed by PARBURST_READ_TRACK and PARBURST_WRITE_TRACK */
+/* all values needed by PARBURST_READ_TRACK and PARBURST_WRITE_TRACK,
+ * and by the block transfers of the S1, S2 and PP protocols */
 typedef struct PARBURST_RW_VALUE {
     unsigned char *buffer;
     int length;
@@ -55,4 +56,27 @@ typedef struct PARBURST_RW_VALUE {
 #define CBMCTRL_PARBURST_WRITE_TRACK _IOW(CBMCTRL_BASE, 20, PARBURST_RW_VALUE)
 #define CBMCTRL_PARBURST_READ_TRACK_VAR    _IOW(CBMCTRL_BASE, 21, PARBURST_RW_VALUE)
 
+/* block transfers with the fast protocols, return the number of bytes transferred */
+#define CBMCTRL_S1_READ_N     _IOW(CBMCTRL_BASE, 22, PARBURST_RW_VALUE)
+#define CBMCTRL_S1_WRITE_N    _IOW(CBMCTRL_BASE, 23, PARBURST_RW_VALUE)
+#define CBMCTRL_S2_READ_N     _IOW(CBMCTRL_BASE, 24, PARBURST_RW_VALUE)
+#define CBMCTRL_S2_WRITE_N    _IOW(CBMCTRL_BASE, 25, PARBURST_RW_VALUE)
+#define CBMCTRL_PP_DC_READ_N  _IOW(CBMCTRL_BASE, 26, PARBURST_RW_VALUE)
+#define CBMCTRL_PP_DC_WRITE_N _IOW(CBMCTRL_BASE, 27, PARBURST_RW_VALUE)
+
+/* run a sequence of IEC line operations, returns the number of operations run */
+#define CBMCTRL_IEC_PROGRAM   _IOWR(CBMCTRL_BASE, 28, PARBURST_RW_VALUE)
+
+/* the operations of CBMCTRL_IEC_PROGRAM: byte pairs of opcode and argument,
+ * the same values as CBM_IEC_PROG_* in opencbm.h */
+#define CBMCTRL_PROG_SET          0x01 /* set the lines in arg */
+#define CBMCTRL_PROG_RELEASE      0x02 /* release the lines in arg */
+#define CBMCTRL_PROG_SETRELEASE   0x03 /* set the lines in arg >> 4, release those in arg & 0x0f */
+#define CBMCTRL_PROG_WAIT_SET     0x04 /* wait until the line in arg is set */
+#define CBMCTRL_PROG_WAIT_RELEASE 0x05 /* wait until the line in arg is released */
+#define CBMCTRL_PROG_POLL         0x06 /* arg = the state of the lines */
+#define CBMCTRL_PROG_DELAY        0x07 /* wait arg microseconds */
+#define CBMCTRL_PROG_PP_READ      0x08 /* arg = the parallel data lines */
+#define CBMCTRL_PROG_PP_WRITE     0x09 /* write arg to the parallel data lines */
+
 #endif
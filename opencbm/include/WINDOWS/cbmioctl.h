@@ -346,6 +346,44 @@ typedef CBMT_IEC_DBG_VALUE CBMT_IEC_DBG_WRITE;
 #define CBMCTRL_PARBURST_READ_TRACK_VAR \
                             _CBMIO(CBMCTRL_BASE, 29) // -                    CBMT_PARBURST_READ_TRACK_OUT
 
+//! IOCTL for reading a block with protocol serial-1
+#define CBMCTRL_S1_READ_N     _CBMIO(CBMCTRL_BASE, 30) // -                    UCHAR array
+//! IOCTL for writing a block with protocol serial-1
+#define CBMCTRL_S1_WRITE_N    _CBMIO(CBMCTRL_BASE, 31) // UCHAR array          -
+//! IOCTL for reading a block with protocol serial-2
+#define CBMCTRL_S2_READ_N     _CBMIO(CBMCTRL_BASE, 32) // -                    UCHAR array
+//! IOCTL for writing a block with protocol serial-2
+#define CBMCTRL_S2_WRITE_N    _CBMIO(CBMCTRL_BASE, 33) // UCHAR array          -
+//! IOCTL for reading a block with the parallel protocol (even length)
+#define CBMCTRL_PP_DC_READ_N  _CBMIO(CBMCTRL_BASE, 34) // -                    UCHAR array
+//! IOCTL for writing a block with the parallel protocol (even length)
+#define CBMCTRL_PP_DC_WRITE_N _CBMIO(CBMCTRL_BASE, 35) // UCHAR array          -
+
+//! IOCTL for running a sequence of IEC line operations
+#define CBMCTRL_IEC_PROGRAM   _CBMIO(CBMCTRL_BASE, 36) // UCHAR array          UCHAR array
+
+/* the operations of CBMCTRL_IEC_PROGRAM: byte pairs of opcode and argument,
+ * the same values as CBM_IEC_PROG_* in opencbm.h */
+
+//! CBMCTRL_IEC_PROGRAM: set the lines in the argument
+#define CBMCTRL_PROG_SET          0x01
+//! CBMCTRL_IEC_PROGRAM: release the lines in the argument
+#define CBMCTRL_PROG_RELEASE      0x02
+//! CBMCTRL_IEC_PROGRAM: set the lines in argument >> 4, release those in argument & 0x0f
+#define CBMCTRL_PROG_SETRELEASE   0x03
+//! CBMCTRL_IEC_PROGRAM: wait until the line in the argument is set
+#define CBMCTRL_PROG_WAIT_SET     0x04
+//! CBMCTRL_IEC_PROGRAM: wait until the line in the argument is released
+#define CBMCTRL_PROG_WAIT_RELEASE 0x05
+//! CBMCTRL_IEC_PROGRAM: the argument is replaced by the state of the lines
+#define CBMCTRL_PROG_POLL         0x06
+//! CBMCTRL_IEC_PROGRAM: wait the argument in microseconds
+#define CBMCTRL_PROG_DELAY        0x07
+//! CBMCTRL_IEC_PROGRAM: the argument is replaced by the parallel data lines
+#define CBMCTRL_PROG_PP_READ      0x08
+//! CBMCTRL_IEC_PROGRAM: write the argument to the parallel data lines
+#define CBMCTRL_PROG_PP_WRITE     0x09
+
 /* these are the return codes of CBMCTRL_I_INSTALL: */
 
 //! CBMCTRL_I_INSTALL: The driver could not be opened
@@ -76,6 +76,9 @@ extern void arch_sleep_us(unsigned int Microseconds);
 extern void arch_sleep_ms(unsigned int Milliseconds);
 extern void arch_sleep_s(unsigned int Seconds);
 
+/* monotonic time in microseconds, for measuring durations */
+extern double arch_time_us(void);
+
 #include <string.h>
 
 #define arch_strcasecmp(_x,_y)     ARCH_CBM_LINUX_WIN(strcasecmp(_x,_y), _stricmp(_x,_y))
@@ -115,6 +118,10 @@ extern void arch_sleep_s(unsigned int Seconds);
 
 int arch_filesize(const char *Filename, off_t *Filesize);
 
+/* map the first Size bytes of an open file into memory */
+extern void *arch_map_file(int Fileno, size_t Size, int Writable);
+extern void arch_unmap_file(void *Address, size_t Size);
+
 #define arch_strdup(_x) ARCH_CBM_LINUX_WIN(strdup(_x), _strdup(_x))
 
 #define arch_fileno(_x) ARCH_CBM_LINUX_WIN(fileno(_x), _fileno(_x))
@@ -125,6 +132,8 @@ int arch_filesize(const char *Filename, off_t *Filesize);
 
 #define arch_fdopen(_x, _y) ARCH_CBM_LINUX_WIN(fdopen(_x, _y), _fdopen(_x, _y))
 
+#define arch_dup(_x) ARCH_CBM_LINUX_WIN(dup(_x), _dup(_x))
+
 #define arch_snprintf ARCH_CBM_LINUX_WIN(snprintf, _snprintf)
 #define arch_vsnprintf ARCH_CBM_LINUX_WIN(vsnprintf, _vsnprintf)
 
@@ -0,0 +1,76 @@
+/*
+ *  This program is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU General Public License
+ *  as published by the Free Software Foundation; either version
+ *  2 of the License, or (at your option) any later version.
+ *
+*/
+
+/*! **************************************************************
+** \file include/blockpipe.h \n
+** \n
+** \brief Pipeline between reading blocks and writing them
+**
+****************************************************************/
+
+#ifndef CBM_BLOCKPIPE_H
+#define CBM_BLOCKPIPE_H
+
+/* number of blocks which can be in the pipeline at the same time */
+#define BLOCKPIPE_DEPTH 40
+
+/* the largest block (or undecoded GCR block) which can be put in */
+#define BLOCKPIPE_DATA_MAX 512
+
+typedef struct {
+    unsigned char tr;
+    unsigned char se;
+    int size;
+    int decode;         /* != 0: data is to be decoded before writing */
+    int read_result;
+    int write_result;
+    unsigned char data[BLOCKPIPE_DATA_MAX];
+} blockpipe_block;
+
+/* writes the block, returns the write result */
+typedef int (*blockpipe_write_t)(void *context, blockpipe_block *block);
+
+/* decodes the data of the block in place (setting its size), returns the read result */
+typedef int (*blockpipe_decode_t)(void *context, blockpipe_block *block);
+
+typedef struct blockpipe_s blockpipe;
+
+/*
+ * start a worker which writes the blocks with write(). decode may be
+ * NULL if no block is ever put in with decode set.
+ * returns NULL if no worker could be started; the blocks must be
+ * written directly then.
+ */
+extern blockpipe *blockpipe_start(blockpipe_write_t write,
+                                  blockpipe_decode_t decode, void *context);
+
+/*
+ * number of blocks put in whose results have not been got back yet.
+ * a block may only be put in if this is less than BLOCKPIPE_DEPTH.
+ */
+extern int blockpipe_pending(blockpipe *p);
+
+/*
+ * put a block in. If decode is set, the worker calls decode() on it
+ * first, and the result of that becomes the read result.
+ */
+extern void blockpipe_put(blockpipe *p, unsigned char tr, unsigned char se,
+                          const unsigned char *data, int size,
+                          int read_result, int decode);
+
+/*
+ * get back the result of the oldest block which has been written.
+ * returns 0 if there is none; if wait is set, this only happens
+ * when there is no block left in the pipeline at all.
+ */
+extern int blockpipe_get(blockpipe *p, blockpipe_block *done, int wait);
+
+/* write all blocks still in the pipeline, and end the worker */
+extern void blockpipe_stop(blockpipe *p);
+
+#endif /* #ifndef CBM_BLOCKPIPE_H */
@@ -20,6 +20,7 @@ typedef struct
 {
     int transfer_mode;
     enum cbm_device_type_e drive_type;
+    int interleave;     /* for writing; -1: best for the transfer mode, 0: the drive's own */
 } cbmcopy_settings;
 
 typedef enum
@@ -97,6 +98,86 @@ extern int cbmcopy_read_file_ts(CBM_FILE cbm_fd,
                                 cbmcopy_message_cb msg_cb,
                                 cbmcopy_status_cb status_cb);
 
+/*
+ * transfer more than one file in one session: the drive is identified
+ * and the turbo is uploaded only once, not for every file. The single
+ * file functions above are wrappers around a session of one file.
+ * cbmcopy_session_open() returns NULL if out of memory.
+ */
+typedef struct cbmcopy_session_s cbmcopy_session;
+
+extern cbmcopy_session *cbmcopy_session_open(CBM_FILE cbm_fd,
+                                             cbmcopy_settings *settings,
+                                             int drive,
+                                             cbmcopy_message_cb msg_cb);
+
+extern int cbmcopy_session_write_file(cbmcopy_session *session,
+                                      const char *cbmname,
+                                      int cbmname_size,
+                                      const unsigned char *filedata,
+                                      int filedata_size,
+                                      cbmcopy_status_cb status_cb);
+
+extern int cbmcopy_session_read_file(cbmcopy_session *session,
+                                     const char *cbmname,
+                                     int cbmname_size,
+                                     unsigned char **filedata,
+                                     size_t *filedata_size,
+                                     cbmcopy_status_cb status_cb);
+
+extern int cbmcopy_session_read_file_ts(cbmcopy_session *session,
+                                        int track, int sector,
+                                        unsigned char **filedata,
+                                        size_t *filedata_size,
+                                        cbmcopy_status_cb status_cb);
+
+/*
+ * read a file without keeping all of it in memory: data_cb() is called
+ * with the data of every block as soon as it has been read. If it
+ * returns != 0, the rest of the file is still read from the drive,
+ * but dropped, and the read fails.
+ */
+typedef int (*cbmcopy_data_cb)(void *context, const unsigned char *data, size_t size);
+
+extern int cbmcopy_session_stream_file(cbmcopy_session *session,
+                                       const char *cbmname,
+                                       int cbmname_size,
+                                       cbmcopy_data_cb data_cb,
+                                       void *context,
+                                       cbmcopy_status_cb status_cb);
+
+extern int cbmcopy_session_stream_file_ts(cbmcopy_session *session,
+                                          int track, int sector,
+                                          cbmcopy_data_cb data_cb,
+                                          void *context,
+                                          cbmcopy_status_cb status_cb);
+
+/*
+ * look up the start track and sector of the given files (in PETSCII,
+ * '*' and '?' are allowed) in the directory, so the files can be read
+ * in the order they are located on the disk, with as few seeks as
+ * possible. track[i] is 0 if file i has not been found. Returns != 0
+ * if the directory could not be read; this needs a turbo transfer mode.
+ */
+extern int cbmcopy_session_locate_files(cbmcopy_session *session,
+                                        int count,
+                                        const char * const *cbmnames,
+                                        int *track, int *sector);
+
+/*
+ * tell if the file cbmname (in PETSCII, as given to write_file) is on the
+ * disk with just this data: the directory tells the type and the size,
+ * and only a file which matches these is read and compared. Returns 0 if
+ * the file is the same, 1 if it differs, 2 if it is not on the disk, and
+ * -1 if the disk could not be read; this needs a turbo transfer mode.
+ */
+extern int cbmcopy_session_compare_file(cbmcopy_session *session,
+                                        const char *cbmname,
+                                        const unsigned char *filedata,
+                                        int filedata_size);
+
+extern void cbmcopy_session_close(cbmcopy_session *session);
+
 #ifdef __cplusplus
 }
 #endif
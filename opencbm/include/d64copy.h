@@ -57,6 +57,14 @@ typedef struct
     enum cbm_device_type_e drive_type;
     d64copy_bam_mode bam_mode;
     d64copy_error_mode error_mode;
+    int resume;         /* != 0: skip the blocks already in the image file */
+    int adaptive;       /* != 0: adapt retries and interleave while copying */
+    int update;         /* != 0: only copy the blocks which differ between the image file and the disk */
+    const char *manifest; /* != NULL: the CRC of the image file written is added to this file */
+    int defer_retries;  /* != 0: retry the failed blocks after all tracks have been copied once */
+    const char *container; /* != NULL: the image file written is moved into this zip archive */
+    const char *extract; /* != NULL: the files on the disk read are written to this directory, too */
+    int verify;         /* != 0: the drive verifies the blocks written to the disk */
 } d64copy_settings;
 
 typedef struct
@@ -67,6 +75,7 @@ typedef struct
     int write_result;
     int sectors_processed;
     int total_sectors;
+    int revolution_us;  /* one revolution of the disk, measured on this track while reading it in warp mode; 0: not known */
     d64copy_settings *settings;
     char bam[MAX_TRACKS][MAX_SECTORS+1];
 } d64copy_status;
@@ -80,7 +89,12 @@ typedef enum
 } d64copy_severity_e;
 
 typedef void (*d64copy_message_cb)(int d64copy_severity_e, const char *format, ...);
-typedef int (*d64copy_status_cb)(d64copy_status status);
+/*
+ * called once before copying, with track == 0, and after every block.
+ * track and sector denote the block just processed, its state in bam
+ * has already been updated. The status is only valid during the call.
+ */
+typedef int (*d64copy_status_cb)(const d64copy_status *status);
 
 #ifdef LIBD64COPY_DEBUG
 /*
@@ -121,6 +135,14 @@ extern d64copy_settings *d64copy_get_default_settings(void);
  */
 extern int d64copy_sector_count(int two_sided, int track);
 
+/*
+ * copy a disk to an image file, or an image file to a disk.
+ * all the state of a copy is local to the call, thus, more than one
+ * copy can run at the same time in different threads, as long as each
+ * of them uses its own settings. copies running at the same time on
+ * the same cbm_fd must be serialized by the caller, however, as they
+ * share the bus.
+ */
 extern int d64copy_read_image(CBM_FILE cbm_fd,
                               d64copy_settings *settings,
                               int src_drive,
@@ -135,8 +157,115 @@ extern int d64copy_write_image(CBM_FILE cbm_fd,
                                d64copy_message_cb msg_cb,
                                d64copy_status_cb status_cb);
 
+/*
+ * write an image to several drives on the same bus at once. The drives
+ * write the blocks with jobs of their disk controllers, without a turbo;
+ * the transfer mode and warp setting are not used. returns the number
+ * of blocks written on all drives together.
+ */
+extern int d64copy_write_image_multi(CBM_FILE cbm_fd,
+                                     d64copy_settings *settings,
+                                     const char *src_image,
+                                     const int *dst_drives,
+                                     int count,
+                                     d64copy_message_cb msg_cb,
+                                     d64copy_status_cb status_cb);
+
+/*
+ * copy a disk from one drive to another one on the same bus. The blocks
+ * go from drive to drive directly, the host does not send them again.
+ */
+extern int d64copy_copy_disk(CBM_FILE cbm_fd,
+                             d64copy_settings *settings,
+                             int src_drive,
+                             int dst_drive,
+                             d64copy_message_cb msg_cb,
+                             d64copy_status_cb status_cb);
+
+/*
+ * wait until the disk in the drive has been changed, for reading one disk
+ * after another without being asked. returns 0 when a new disk can be
+ * read, -1 if the drive does not answer.
+ */
+extern int d64copy_wait_disk_change(CBM_FILE cbm_fd,
+                                    int drive,
+                                    d64copy_message_cb msg_cb);
+
+/*
+ * one drive for d64copy_read_batch(). Drives with the same cbm_fd are on
+ * the same bus.
+ */
+typedef struct
+{
+    CBM_FILE cbm_fd;
+    int drive;
+} d64copy_station;
+
+/*
+ * read disks with several drives, on one or more adapters, to image files
+ * named like image with the number of the disk: image-001.d64, ... Every
+ * drive reads the disk in it, and then the next one as soon as it is put
+ * in; the next number is taken by the drive which has its disk ready first.
+ * Stops after disks disks (0: until interrupted). returns the number of
+ * disks read without errors.
+ */
+extern int d64copy_read_batch(const d64copy_station *stations,
+                              int count,
+                              const d64copy_settings *settings,
+                              const char *image,
+                              int disks,
+                              d64copy_message_cb msg_cb);
+
+/*
+ * the name of image with the number of the disk before the extension,
+ * as used by d64copy_read_batch(). Must be free()'d after use.
+ */
+extern char *d64copy_batch_image_name(const char *image, int number);
+
+/*
+ * convert an image file to another format without a drive, e.g. a .g64
+ * or .nib image to a .d64 image; the formats are chosen by the names.
+ * returns the number of blocks which could not be read from the source,
+ * or -1 if the conversion failed.
+ */
+extern int d64copy_convert_image(const d64copy_settings *settings,
+                                 const char *src_image,
+                                 const char *dst_image,
+                                 d64copy_message_cb msg_cb);
+
+/*
+ * convert count images to images with the same names and the extension
+ * extension (without the dot), with jobs threads at the same time (0: as
+ * many as there are processors). returns the number of images converted
+ * without errors.
+ */
+extern int d64copy_convert_images(const d64copy_settings *settings,
+                                  const char * const *images,
+                                  int count,
+                                  const char *extension,
+                                  int jobs,
+                                  d64copy_message_cb msg_cb);
+
+/*
+ * the name of image with its extension replaced by extension, as used by
+ * d64copy_convert_images(). Must be free()'d after use.
+ */
+extern char *d64copy_convert_image_name(const char *image, const char *extension);
+
+/*
+ * finish the image files of all copies which are running, e.g. when the
+ * program is interrupted. The copies must not be continued afterwards.
+ */
 extern void d64copy_cleanup(void);
 
+/*
+ * stop all copies which are running where the next track starts. The
+ * turbo is ended as after a complete copy, so the drives are back in
+ * their DOS and the bus does not need a reset. May be called from a
+ * signal handler. The copies return -1, and none can be started anymore.
+ */
+extern void d64copy_abort(void);
+
 #ifdef __cplusplus
 }
 #endif
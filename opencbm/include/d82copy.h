@@ -153,6 +153,17 @@ extern int d82copy_write_image(CBM_FILE cbm_fd,
                                d82copy_message_cb msg_cb,
                                d82copy_status_cb status_cb);
 
+/*
+ * copy the disk of one drive of a dual drive unit to the other one with
+ * the duplicate command of the DOS. returns the number of blocks of the
+ * disk, or -1 on error.
+ */
+extern int d82copy_duplicate_disk(CBM_FILE cbm_fd,
+                                  d82copy_settings *settings,
+                                  int src_unit,
+                                  int dst_unit,
+                                  d82copy_message_cb msg_cb);
+
 extern void d82copy_cleanup(void);
 
 
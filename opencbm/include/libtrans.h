@@ -24,7 +24,8 @@ enum opencbm_transfer_e
 {
     opencbm_transfer_serial1,
     opencbm_transfer_serial2,
-    opencbm_transfer_parallel
+    opencbm_transfer_parallel,
+    opencbm_transfer_auto
 } opencbm_transfer_t;
 
 int
@@ -45,9 +46,22 @@ int
 libopencbmtransfer_write_mem(CBM_FILE HandleDevice, unsigned char DeviceAddress,
                             unsigned char Buffer[], unsigned int MemoryAddress, unsigned int Length);
 
+int
+libopencbmtransfer_upload(CBM_FILE HandleDevice, unsigned char DeviceAddress,
+                          unsigned int MemoryAddress, const unsigned char Program[],
+                          unsigned int Length);
+
+int
+libopencbmtransfer_download(CBM_FILE HandleDevice, unsigned char DeviceAddress,
+                            unsigned int MemoryAddress, unsigned char Buffer[],
+                            unsigned int Length);
+
 int
 libopencbmtransfer_remove(CBM_FILE HandleDevice, unsigned char DeviceAddress);
 
+int
+libopencbmtransfer_detach(CBM_FILE HandleDevice, unsigned char DeviceAddress);
+
 #ifdef LIBOCT_STATE_DEBUG
 extern void libopencbmtransfer_printStateDebugCounters(FILE *channel);
 #endif
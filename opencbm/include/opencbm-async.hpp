@@ -0,0 +1,413 @@
+/*
+ *  This program is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU General Public License
+ *  as published by the Free Software Foundation; either version
+ *  2 of the License, or (at your option) any later version.
+ *
+ */
+
+/*! **************************************************************
+** \file include/opencbm-async.hpp \n
+** \n
+** \brief C++ interface to the asynchronous bus operations
+**
+** The requests of cbm_async_submit() as C++ objects which can be
+** awaited by a coroutine (C++20), or waited for by any other code.
+**
+** The library calls the completion callback on its worker thread,
+** and it still uses the request afterwards. Thus, a coroutine is
+** not resumed in the callback: the callback hands it over to the
+** async_context, and async_context::run() resumes it on the thread
+** of the caller, once the worker is done with the request. Then
+** the coroutine may submit the next request right away.
+**
+** \code
+**   opencbm::async_task read_status(opencbm::async_context &ctx, char *buf)
+**   {
+**       if (co_await ctx.talk(8, 15) == 0) {
+**           int n = co_await ctx.raw_read(buf, 40);
+**           co_await ctx.untalk();
+**           ...
+**       }
+**   }
+**
+**   opencbm::async_context ctx(fd);
+**   read_status(ctx, buf);
+**   ctx.run();
+** \endcode
+**
+****************************************************************/
+
+#ifndef OPENCBM_ASYNC_HPP
+#define OPENCBM_ASYNC_HPP
+
+#include "opencbm.h"
+
+#include <condition_variable>
+#include <cstddef>
+#include <cstring>
+#include <deque>
+#include <exception>
+#include <mutex>
+
+#if defined(__cpp_impl_coroutine) && defined(__has_include)
+# if __has_include(<coroutine>)
+#  include <coroutine>
+#  define OPENCBM_ASYNC_COROUTINES 1
+# endif
+#endif
+
+namespace opencbm {
+
+class async_context;
+
+/*! \brief One bus operation, run by the worker of the library
+
+ An async_request is made by the functions of async_context. It
+ is run either by awaiting it in a coroutine, or with submit()
+ and wait(). It must not be moved or destroyed while it is
+ pending, as the library holds a pointer to it.
+*/
+class async_request
+{
+public:
+    async_request(async_context &Context, enum cbm_async_type_e Type,
+                  unsigned char DeviceAddress = 0, unsigned char SecondaryAddress = 0,
+                  void *Buffer = NULL, size_t Count = 0);
+
+    /*! Only a request which has not been submitted yet can be moved */
+    async_request(async_request &&Other)
+        : context_(Other.context_), request_(Other.request_),
+          submitted_(false), completed_(false)
+    {
+    }
+
+    /*! A pending request must be waited for before it goes away */
+    ~async_request()
+    {
+        if (submitted_ && !completed_) {
+            wait();
+        }
+    }
+
+    /*! \brief Queue the request; returns 0 on success, -1 on error */
+    int submit();
+
+    /*! \brief Wait for the request; returns the result of the operation */
+    int wait();
+
+    /*! \brief != 0 if the request has been run */
+    int done();
+
+    /*! \brief The result: what the synchronous function would have returned */
+    int result() const
+    {
+        return request_.result;
+    }
+
+#ifdef OPENCBM_ASYNC_COROUTINES
+    /*! \brief Awaiting a request submits it; the coroutine is resumed by async_context::run() */
+    bool await_ready() const noexcept
+    {
+        return false;
+    }
+
+    bool await_suspend(std::coroutine_handle<> Handle);
+
+    int await_resume()
+    {
+        return request_.result;
+    }
+#endif
+
+private:
+    async_request(const async_request &) = delete;
+    async_request &operator=(const async_request &) = delete;
+
+    static void CBMAPIDECL completed(cbm_async_request_t *Request, void *Context);
+
+    friend class async_context;
+
+    async_context      &context_;
+    cbm_async_request_t request_;
+    bool                submitted_;
+    bool                completed_;
+#ifdef OPENCBM_ASYNC_COROUTINES
+    std::coroutine_handle<> waiter_;
+#endif
+};
+
+/*! \brief The requests on one handle, and the coroutines which await them
+
+ The handle must stay open while the context is in use. Do not use
+ it with the synchronous functions while requests are pending.
+*/
+class async_context
+{
+public:
+    explicit async_context(CBM_FILE HandleDevice)
+        : handle_(HandleDevice), pending_(0)
+    {
+    }
+
+    /*! All requests must have been run before the context goes away */
+    ~async_context()
+    {
+        cbm_async_flush(handle_);
+    }
+
+    CBM_FILE handle() const
+    {
+        return handle_;
+    }
+
+    /*! \brief cbm_raw_write() of Count bytes of Buffer */
+    async_request raw_write(const void *Buffer, size_t Count)
+    {
+        return async_request(*this, cbm_async_raw_write, 0, 0, const_cast<void *>(Buffer), Count);
+    }
+
+    /*! \brief cbm_raw_read() of Count bytes into Buffer */
+    async_request raw_read(void *Buffer, size_t Count)
+    {
+        return async_request(*this, cbm_async_raw_read, 0, 0, Buffer, Count);
+    }
+
+    /*! \brief cbm_listen() */
+    async_request listen(unsigned char DeviceAddress, unsigned char SecondaryAddress)
+    {
+        return async_request(*this, cbm_async_listen, DeviceAddress, SecondaryAddress);
+    }
+
+    /*! \brief cbm_talk() */
+    async_request talk(unsigned char DeviceAddress, unsigned char SecondaryAddress)
+    {
+        return async_request(*this, cbm_async_talk, DeviceAddress, SecondaryAddress);
+    }
+
+    /*! \brief cbm_unlisten() */
+    async_request unlisten()
+    {
+        return async_request(*this, cbm_async_unlisten);
+    }
+
+    /*! \brief cbm_untalk() */
+    async_request untalk()
+    {
+        return async_request(*this, cbm_async_untalk);
+    }
+
+    /*! \brief cbm_open() with the file name Name, which must stay valid until the request is done */
+    async_request open(unsigned char DeviceAddress, unsigned char SecondaryAddress, const char *Name)
+    {
+        return async_request(*this, cbm_async_open, DeviceAddress, SecondaryAddress,
+                             const_cast<char *>(Name), Name ? std::strlen(Name) : 0);
+    }
+
+    /*! \brief cbm_close() */
+    async_request close(unsigned char DeviceAddress, unsigned char SecondaryAddress)
+    {
+        return async_request(*this, cbm_async_close, DeviceAddress, SecondaryAddress);
+    }
+
+    /*! \brief Resume the coroutines whose requests have been run
+
+     Returns when no awaited request is pending anymore, that is,
+     when all coroutines on this context have finished or wait for
+     something else. Call it from one thread only.
+    */
+    void run()
+    {
+        while (run_one(true)) {
+        }
+    }
+
+    /*! \brief Resume the coroutines which can go on now, without waiting
+
+     Returns the number of coroutines resumed.
+    */
+    int poll()
+    {
+        int count = 0;
+
+        while (run_one(false)) {
+            ++count;
+        }
+        return count;
+    }
+
+private:
+    async_context(const async_context &) = delete;
+    async_context &operator=(const async_context &) = delete;
+
+    friend class async_request;
+
+    /*! \internal \brief Resume the next coroutine; false if there is none (now) */
+    bool run_one(bool Block)
+    {
+        async_request *request;
+
+        {
+            std::unique_lock<std::mutex> lock(lock_);
+
+            while (Block && completed_.empty() && pending_ != 0) {
+                cond_.wait(lock);
+            }
+            if (completed_.empty()) {
+                return false;
+            }
+            request = completed_.front();
+            completed_.pop_front();
+            --pending_;
+        }
+
+        /* the worker may still be about to mark it as done */
+        request->wait();
+
+#ifdef OPENCBM_ASYNC_COROUTINES
+        if (request->waiter_) {
+            std::coroutine_handle<> waiter = request->waiter_;
+
+            request->waiter_ = std::coroutine_handle<>();
+            waiter.resume();
+        }
+#endif
+        return true;
+    }
+
+    CBM_FILE                   handle_;
+    std::mutex                 lock_;
+    std::condition_variable    cond_;
+    std::deque<async_request *> completed_;
+    unsigned int               pending_;   /*!< the awaited requests not resumed yet */
+};
+
+inline
+async_request::async_request(async_context &Context, enum cbm_async_type_e Type,
+                             unsigned char DeviceAddress, unsigned char SecondaryAddress,
+                             void *Buffer, size_t Count)
+    : context_(Context), submitted_(false), completed_(false)
+{
+    std::memset(&request_, 0, sizeof(request_));
+    request_.type              = Type;
+    request_.device_address    = DeviceAddress;
+    request_.secondary_address = SecondaryAddress;
+    request_.buffer            = Buffer;
+    request_.count             = Count;
+    request_.result            = -1;
+}
+
+inline int
+async_request::submit()
+{
+    if (submitted_) {
+        return -1;
+    }
+
+    /* once it is queued, the request may be done and gone at any time */
+    submitted_ = true;
+    if (cbm_async_submit(context_.handle_, &request_) != 0) {
+        submitted_ = false;
+        return -1;
+    }
+    return 0;
+}
+
+inline int
+async_request::wait()
+{
+    if (submitted_ && !completed_) {
+        cbm_async_wait(context_.handle_, &request_);
+        completed_ = true;
+    }
+    return request_.result;
+}
+
+inline int
+async_request::done()
+{
+    if (submitted_ && !completed_) {
+        return cbm_async_test(context_.handle_, &request_);
+    }
+    return 1;
+}
+
+inline void CBMAPIDECL
+async_request::completed(cbm_async_request_t *Request, void *Context)
+{
+    async_request *request = static_cast<async_request *>(Context);
+    async_context &context = request->context_;
+
+    (void) Request;
+
+    std::lock_guard<std::mutex> lock(context.lock_);
+    context.completed_.push_back(request);
+    context.cond_.notify_one();
+}
+
+#ifdef OPENCBM_ASYNC_COROUTINES
+
+inline bool
+async_request::await_suspend(std::coroutine_handle<> Handle)
+{
+    waiter_ = Handle;
+    request_.callback = completed;
+    request_.context  = this;
+
+    {
+        std::lock_guard<std::mutex> lock(context_.lock_);
+        ++context_.pending_;
+    }
+
+    if (submit() != 0) {
+        /* go on at once, with the result -1 */
+        std::lock_guard<std::mutex> lock(context_.lock_);
+        --context_.pending_;
+        waiter_ = std::coroutine_handle<>();
+        return false;
+    }
+    return true;
+}
+
+/*! \brief The return type of a coroutine which awaits async_requests
+
+ The coroutine starts at once and runs until it awaits the first
+ request; it frees itself when it is done. An exception which
+ leaves it ends the program, as there is nobody to catch it.
+*/
+class async_task
+{
+public:
+    struct promise_type
+    {
+        async_task get_return_object() noexcept
+        {
+            return async_task();
+        }
+
+        std::suspend_never initial_suspend() noexcept
+        {
+            return std::suspend_never();
+        }
+
+        std::suspend_never final_suspend() noexcept
+        {
+            return std::suspend_never();
+        }
+
+        void return_void() noexcept
+        {
+        }
+
+        void unhandled_exception() noexcept
+        {
+            std::terminate();
+        }
+    };
+};
+
+#endif /* #ifdef OPENCBM_ASYNC_COROUTINES */
+
+} /* namespace opencbm */
+
+#endif /* #ifndef OPENCBM_ASYNC_HPP */
@@ -94,6 +94,25 @@ struct opencbm_dos_cmd {
     };
 } opencbm_dos_cmd;
 
+/** @brief Describes a relative file opened with cbm_rel_open() */
+typedef
+struct cbm_rel_file {
+    /** the file handle of the driver */
+    CBM_FILE     HandleDevice;
+
+    /** the address of the device the file is on */
+    uint8_t      DeviceAddress;
+
+    /** the channel (secondary address) the file is open on */
+    uint8_t      Channel;
+
+    /** the length of the records of the file */
+    uint8_t      RecordLength;
+
+    /** the record the DOS is at, 0 if it is not known */
+    unsigned int NextRecord;
+} cbm_rel_file;
+
 /** @brief DOS: Function prototype for callback when reading/writing floppy memory
 
  When the floppy memory is written to with cbm_dos_memory_write(),
@@ -262,6 +281,61 @@ cbm_dos_channel_read(
         size_t    BufferSize
         );
 
+EXTERN int CBMAPIDECL
+cbm_dos_dir_block_read(
+        CBM_FILE  HandleDevice,
+        uint8_t   DeviceAddress,
+        uint8_t   Channel,
+        uint8_t   BufferNumber,
+        uint8_t   Track,
+        uint8_t   Sector,
+        uint8_t * Block
+        );
+
+EXTERN void CBMAPIDECL
+cbm_dos_dir_cache_invalidate(
+        CBM_FILE  HandleDevice,
+        uint8_t   DeviceAddress
+        );
+
+EXTERN void CBMAPIDECL
+cbm_dos_dir_cache_flush(
+        CBM_FILE  HandleDevice
+        );
+
+/* record access to relative files: */
+
+EXTERN int CBMAPIDECL
+cbm_rel_open(
+        CBM_FILE      HandleDevice,
+        uint8_t       DeviceAddress,
+        uint8_t       Channel,
+        const char *  Name,
+        uint8_t       RecordLength,
+        cbm_rel_file *Rel
+        );
+
+EXTERN int CBMAPIDECL
+cbm_rel_read(
+        cbm_rel_file *Rel,
+        uint16_t      Record,
+        uint8_t *     Buffer,
+        size_t        BufferSize
+        );
+
+EXTERN int CBMAPIDECL
+cbm_rel_write(
+        cbm_rel_file *  Rel,
+        uint16_t        Record,
+        const uint8_t * Buffer,
+        size_t          Count
+        );
+
+EXTERN int CBMAPIDECL
+cbm_rel_close(
+        cbm_rel_file *Rel
+        );
+
 /** @} */
 
 #ifdef __cplusplus
@@ -0,0 +1,93 @@
+/*
+ *  This program is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU General Public License
+ *  as published by the Free Software Foundation; either version
+ *  2 of the License, or (at your option) any later version.
+*/
+
+/*! **************************************************************
+** \file include/opencbm-net.h \n
+** \n
+** \brief Protocol between cbmserver and the xnet plugin
+**
+** cbmserver gives the clients on the network access to one adapter.
+** The xnet plugin is such a client: it sends every plugin call as one
+** request, and waits for the answer.
+**
+** Every request starts with an opencbm_net_request_t, followed by
+** Length bytes of data for the commands which write something.
+** Every answer starts with an opencbm_net_answer_t, followed by
+** Length bytes of data for the commands which read something.
+** All values are sent with the most significant byte first.
+**
+****************************************************************/
+
+#ifndef OPENCBM_NET_H
+#define OPENCBM_NET_H
+
+/*! the TCP port cbmserver listens on if none is given */
+#define OPENCBM_NET_DEFAULT_PORT "1541"
+
+/*! the version of the protocol, checked with OPENCBM_NET_HELLO */
+#define OPENCBM_NET_VERSION 1
+
+/*! the maximum number of data bytes of a request or an answer */
+#define OPENCBM_NET_MAX_DATA 0x10000
+
+/*! the commands of the requests */
+typedef enum opencbm_net_command_e
+{
+    OPENCBM_NET_HELLO = 0,     /*!< Arg1 = OPENCBM_NET_VERSION; answered with the server's version */
+    OPENCBM_NET_LOCK,          /*!< cbm_lock(); also keeps the bus for this client */
+    OPENCBM_NET_UNLOCK,        /*!< cbm_unlock() */
+    OPENCBM_NET_RAW_WRITE,     /*!< cbm_raw_write() of the data */
+    OPENCBM_NET_RAW_READ,      /*!< cbm_raw_read() of Length bytes */
+    OPENCBM_NET_OPEN,          /*!< OPEN Arg1, Arg2, without a file name */
+    OPENCBM_NET_CLOSE,         /*!< cbm_close(Arg1, Arg2) */
+    OPENCBM_NET_LISTEN,        /*!< cbm_listen(Arg1, Arg2) */
+    OPENCBM_NET_TALK,          /*!< cbm_talk(Arg1, Arg2) */
+    OPENCBM_NET_UNLISTEN,      /*!< cbm_unlisten() */
+    OPENCBM_NET_UNTALK,        /*!< cbm_untalk() */
+    OPENCBM_NET_GET_EOI,       /*!< cbm_get_eoi() */
+    OPENCBM_NET_CLEAR_EOI,     /*!< cbm_clear_eoi() */
+    OPENCBM_NET_RESET,         /*!< cbm_reset() */
+    OPENCBM_NET_PP_READ,       /*!< cbm_pp_read() */
+    OPENCBM_NET_PP_WRITE,      /*!< cbm_pp_write(Arg1) */
+    OPENCBM_NET_IEC_POLL,      /*!< cbm_iec_poll() */
+    OPENCBM_NET_IEC_SETRELEASE,/*!< cbm_iec_setrelease(Arg1, Arg2) */
+    OPENCBM_NET_IEC_WAIT,      /*!< cbm_iec_wait(Arg1, Arg2) */
+    OPENCBM_NET_LAST           /*!< the number of commands; not a command itself */
+} opencbm_net_command_t;
+
+/*! the header of a request */
+typedef struct opencbm_net_request_s
+{
+    unsigned char Command;     /*!< one of opencbm_net_command_t */
+    unsigned char Arg1;        /*!< the first argument of the command */
+    unsigned char Arg2;        /*!< the second argument of the command */
+    unsigned char Reserved;    /*!< always 0 */
+    unsigned char Length[4];   /*!< the number of bytes, to write or to read */
+} opencbm_net_request_t;
+
+/*! the header of an answer */
+typedef struct opencbm_net_answer_s
+{
+    unsigned char Result[4];   /*!< the return value of the command, signed */
+    unsigned char Length[4];   /*!< the number of data bytes following */
+} opencbm_net_answer_t;
+
+/*! store a 32 bit value in the byte order of the protocol */
+#define OPENCBM_NET_PUT32(_p, _v) \
+    do { \
+        (_p)[0] = (unsigned char) ((unsigned long) (_v) >> 24); \
+        (_p)[1] = (unsigned char) ((unsigned long) (_v) >> 16); \
+        (_p)[2] = (unsigned char) ((unsigned long) (_v) >>  8); \
+        (_p)[3] = (unsigned char) ((unsigned long) (_v)      ); \
+    } while (0)
+
+/*! get a 32 bit value in the byte order of the protocol */
+#define OPENCBM_NET_GET32(_p) \
+    (  ((unsigned long) (_p)[0] << 24) | ((unsigned long) (_p)[1] << 16) \
+     | ((unsigned long) (_p)[2] <<  8) |  (unsigned long) (_p)[3])
+
+#endif /* #ifndef OPENCBM_NET_H */
@@ -133,6 +133,42 @@ typedef int CBMAPIDECL opencbm_plugin_raw_write_t(CBM_FILE HandleDevice, const v
 */
 typedef int CBMAPIDECL opencbm_plugin_raw_read_t(CBM_FILE HandleDevice, void *Buffer, size_t Count);
 
+/*! \brief Write data from several buffers to the IEC serial bus
+
+ \param HandleDevice
+   A CBM_FILE which contains the file handle of the driver.
+
+ \param Iov
+   Pointer to an array of buffers which are written one after the
+   other, as if they were one buffer.
+
+ \param IovCount
+   The number of entries in the Iov array.
+
+ \return
+   >= 0: The actual number of bytes written.
+   <0  indicates an error.
+*/
+typedef int CBMAPIDECL opencbm_plugin_raw_writev_t(CBM_FILE HandleDevice, const cbm_iovec_t *Iov, unsigned int IovCount);
+
+/*! \brief Read data from the IEC serial bus into several buffers
+
+ \param HandleDevice
+   A CBM_FILE which contains the file handle of the driver.
+
+ \param Iov
+   Pointer to an array of buffers which are filled one after the
+   other, as if they were one buffer.
+
+ \param IovCount
+   The number of entries in the Iov array.
+
+ \return
+   >= 0: The actual number of bytes read.
+   <0  indicates an error.
+*/
+typedef int CBMAPIDECL opencbm_plugin_raw_readv_t(CBM_FILE HandleDevice, const cbm_iovec_t *Iov, unsigned int IovCount);
+
 /*! \brief @@@@@ \todo document
 
  \param HandleDevice
@@ -416,6 +452,23 @@ typedef int CBMAPIDECL opencbm_plugin_s1_read_n_t (CBM_FILE HandleDevice,
 */
 typedef int CBMAPIDECL opencbm_plugin_s1_write_n_t(CBM_FILE HandleDevice, const unsigned char *data, unsigned int size);
 
+/*! \brief read a block of GCR data with protocol serial-1, decoded by the OpenCBM backend
+
+ \param HandleDevice
+   Pointer to a CBM_FILE which will contain the file handle of the OpenCBM backend
+
+ \param data
+    Pointer to a buffer which will contain the decoded data, (size / 5) * 4 bytes
+
+ \param size
+    The number of GCR bytes to read from the drive
+
+ \return
+    The number of decoded bytes, 0 on OpenCBM backend error.
+    If the backend cannot decode GCR data or there is a fatal error, returns -1.
+*/
+typedef int CBMAPIDECL opencbm_plugin_s1_read_gcr_n_t (CBM_FILE HandleDevice,       unsigned char *data, unsigned int size);
+
 /*! \brief read a block of data from the OpenCBM backend with protocol serial-2
 
  \param HandleDevice
@@ -450,6 +503,23 @@ typedef int CBMAPIDECL opencbm_plugin_s2_read_n_t (CBM_FILE HandleDevice,
 */
 typedef int CBMAPIDECL opencbm_plugin_s2_write_n_t(CBM_FILE HandleDevice, const unsigned char *data, unsigned int size);
 
+/*! \brief read a block of GCR data with protocol serial-2, decoded by the OpenCBM backend
+
+ \param HandleDevice
+   Pointer to a CBM_FILE which will contain the file handle of the OpenCBM backend
+
+ \param data
+    Pointer to a buffer which will contain the decoded data, (size / 5) * 4 bytes
+
+ \param size
+    The number of GCR bytes to read from the drive
+
+ \return
+    The number of decoded bytes, 0 on OpenCBM backend error.
+    If the backend cannot decode GCR data or there is a fatal error, returns -1.
+*/
+typedef int CBMAPIDECL opencbm_plugin_s2_read_gcr_n_t (CBM_FILE HandleDevice,       unsigned char *data, unsigned int size);
+
 /*! \brief read a block of data from the OpenCBM backend with protocol parallel/d64copy
 
  \param HandleDevice
@@ -518,6 +588,23 @@ typedef int CBMAPIDECL opencbm_plugin_pp_dc_read_n_t (CBM_FILE HandleDevice,
 */
 typedef int CBMAPIDECL opencbm_plugin_pp_dc_write_n_t(CBM_FILE HandleDevice, const unsigned char *data, unsigned int size);
 
+/*! \brief read a block of GCR data with protocol parallel/d64copy, decoded by the OpenCBM backend
+
+ \param HandleDevice
+   Pointer to a CBM_FILE which will contain the file handle of the OpenCBM backend
+
+ \param data
+    Pointer to a buffer which will contain the decoded data, (size / 5) * 4 bytes
+
+ \param size
+    The number of GCR bytes to read from the drive
+
+ \return
+    The number of decoded bytes, 0 on OpenCBM backend error.
+    If the backend cannot decode GCR data or there is a fatal error, returns -1.
+*/
+typedef int CBMAPIDECL opencbm_plugin_pp_dc_read_gcr_n_t (CBM_FILE HandleDevice,       unsigned char *data, unsigned int size);
+
 /*! \brief read a block of data from the OpenCBM backend with protocol parallel/cbmcopy
 
  \param HandleDevice
@@ -571,6 +658,240 @@ typedef int CBMAPIDECL opencbm_plugin_iec_dbg_read_t(CBM_FILE HandleDevice);
 */
 typedef int CBMAPIDECL opencbm_plugin_iec_dbg_write_t(CBM_FILE HandleDevice, unsigned char Value);
 
+/*! \brief types of the entries of an opencbm_plugin_batch_t() call */
+enum opencbm_plugin_batch_type {
+    OPENCBM_PLUGIN_BATCH_WRITE,          /**< write data, as with cbm_raw_write() */
+    OPENCBM_PLUGIN_BATCH_WRITE_ATN,      /**< write data under ATN, as for listen, open, close, unlisten or untalk */
+    OPENCBM_PLUGIN_BATCH_WRITE_ATN_TALK, /**< write data under ATN and turn the bus around afterwards, as for talk */
+    OPENCBM_PLUGIN_BATCH_READ            /**< read data, as with cbm_raw_read() */
+};
+
+/*! \brief one entry of an opencbm_plugin_batch_t() call */
+typedef
+struct opencbm_plugin_batch_entry_s {
+    enum opencbm_plugin_batch_type   type;   /**< the IEC primitive to run */
+    unsigned char                  * data;   /**< the data to write, or the buffer for the data to read */
+    size_t                           size;   /**< the number of bytes to write, or the number of bytes to read at most */
+    int                              result; /**< on return: the number of bytes read or written, or -1 if the entry failed or was skipped */
+} opencbm_plugin_batch_entry_t;
+
+/*! \brief Run a list of IEC primitives in one go
+
+ \param HandleDevice
+   A CBM_FILE which contains the file handle of the driver.
+
+ \param Entries
+   Pointer to an array of the primitives to run.
+
+ \param Count
+   The number of entries in the Entries array.
+
+ \return
+   0 if all entries succeeded, else the number (starting at 1) of the
+   first entry that failed. If there is a fatal error, returns -1.
+
+ \remark
+   After an entry has failed, only the following
+   OPENCBM_PLUGIN_BATCH_WRITE_ATN entries are still run, so that a
+   closing unlisten or untalk is never skipped.
+*/
+typedef int CBMAPIDECL opencbm_plugin_batch_t(CBM_FILE HandleDevice, opencbm_plugin_batch_entry_t *Entries, unsigned int Count);
+
+/*! \brief Switch deferred status for writes on or off
+
+ \param HandleDevice
+   A CBM_FILE which contains the file handle of the driver.
+
+ \param Enable
+   If not zero, writes do not wait for their status anymore; a failure
+   is only reported by opencbm_plugin_flush_deferred_status_t().
+   If zero, each write waits for its status again.
+
+ \return
+   The previous state (0 or 1), or -1 if the device does not support
+   deferred status.
+*/
+typedef int CBMAPIDECL opencbm_plugin_set_deferred_status_t(CBM_FILE HandleDevice, int Enable);
+
+/*! \brief Collect the status of the deferred writes
+
+ \param HandleDevice
+   A CBM_FILE which contains the file handle of the driver.
+
+ \return
+   0 if all writes since the last call succeeded, else the number of
+   writes that failed. If there is a fatal error, returns -1.
+*/
+typedef int CBMAPIDECL opencbm_plugin_flush_deferred_status_t(CBM_FILE HandleDevice);
+
+/*! \brief Write to the memory of a drive, run by the adapter
+
+ \param HandleDevice
+   A CBM_FILE which contains the file handle of the driver.
+
+ \param DeviceAddress
+   The address of the device on the IEC serial bus.
+
+ \param MemoryAddress
+   The address in the drive's memory to write to.
+
+ \param Buffer
+   Pointer to the bytes to be written.
+
+ \param Count
+   The number of bytes to be written.
+
+ \return
+   The number of bytes written, or -1 if the adapter cannot do this
+   or there was a fatal error.
+*/
+typedef int CBMAPIDECL opencbm_plugin_memory_write_t(CBM_FILE HandleDevice, unsigned char DeviceAddress, unsigned int MemoryAddress, const unsigned char *Buffer, unsigned int Count);
+
+/*! \brief Read from the memory of a drive, run by the adapter
+
+ \param HandleDevice
+   A CBM_FILE which contains the file handle of the driver.
+
+ \param DeviceAddress
+   The address of the device on the IEC serial bus.
+
+ \param MemoryAddress
+   The address in the drive's memory to read from.
+
+ \param Buffer
+   Pointer to a buffer which will hold the bytes read.
+
+ \param Count
+   The number of bytes to be read. The range must not cross a page
+   (256 bytes) of the drive's memory.
+
+ \return
+   The number of bytes read, or -1 if the adapter cannot do this
+   or there was a fatal error.
+*/
+typedef int CBMAPIDECL opencbm_plugin_memory_read_t(CBM_FILE HandleDevice, unsigned char DeviceAddress, unsigned int MemoryAddress, unsigned char *Buffer, unsigned int Count);
+
+/*! \brief Write drive code the adapter keeps on its own, instead of the code itself
+
+ \param HandleDevice
+   A CBM_FILE which contains the file handle of the driver.
+
+ \param DeviceAddress
+   The address of the device on the IEC serial bus.
+
+ \param MemoryAddress
+   The address in the drive's memory to write to.
+
+ \param Buffer
+   Pointer to the whole drive code. The adapter identifies the code
+   by it; the bytes themselves need not be sent.
+
+ \param Count
+   The number of bytes of the drive code.
+
+ \return
+   The number of bytes written, 0 if the adapter does not have this
+   drive code, or -1 if the adapter cannot do this or there was a
+   fatal error.
+*/
+typedef int CBMAPIDECL opencbm_plugin_code_upload_t(CBM_FILE HandleDevice, unsigned char DeviceAddress, unsigned int MemoryAddress, const unsigned char *Buffer, unsigned int Count);
+
+/*! \brief Wait for a line to have a specific state, with a timeout
+
+ \param HandleDevice
+   A CBM_FILE which contains the file handle of the driver.
+
+ \param Line
+   The line to be waited for, exactly one of IEC_DATA, IEC_CLOCK,
+   IEC_ATN, and IEC_RESET.
+
+ \param State
+   If zero, then wait for this line to be deactivated. \n
+   If not zero, then wait for this line to be activated.
+
+ \param TimeoutMs
+   The time to wait at most, in milliseconds. 0 waits forever.
+
+ \return
+   The state of the IEC bus on return (like cbm_iec_poll()), -1 if
+   the timeout expired, or -2 if the adapter cannot do this.
+*/
+typedef int CBMAPIDECL opencbm_plugin_iec_wait_timeout_t(CBM_FILE HandleDevice, int Line, int State, unsigned int TimeoutMs);
+
+/*! \brief Run a sequence of IEC line operations
+
+ \param HandleDevice
+   A CBM_FILE which contains the file handle of the driver.
+
+ \param Program
+   The operations, pairs of a CBM_IEC_PROG_* opcode and its argument.
+   The results of CBM_IEC_PROG_POLL and CBM_IEC_PROG_PP_READ replace
+   their argument.
+
+ \param Length
+   The length of Program in bytes, which is even.
+
+ \return
+   The number of operations run, which is less than Length / 2 if
+   the program was interrupted, -1 on an error, or -2 if the adapter
+   cannot do this.
+*/
+typedef int CBMAPIDECL opencbm_plugin_iec_program_t(CBM_FILE HandleDevice, unsigned char *Program, unsigned int Length);
+
+/*! \brief TAPE: Capture a tape chunk by chunk
+
+ \param HandleDevice
+   A CBM_FILE which contains the file handle of the driver.
+
+ \param Buffer
+   The buffer for one chunk of the capture data. It is used over and
+   over again.
+
+ \param Buffer_Length
+   The size of Buffer; it must be a multiple of 64 bytes.
+
+ \param Callback
+   Called with every chunk as soon as it has been read. If it returns
+   != 0, the capture is broken off.
+
+ \param Context
+   Passed unchanged to Callback.
+
+ \param Status
+   The return status.
+
+ \param BytesRead
+   The number of bytes read in total.
+
+ \return
+   != 0 on success.
+*/
+typedef int CBMAPIDECL opencbm_plugin_tap_capture_t(CBM_FILE HandleDevice, unsigned char *Buffer, unsigned int Buffer_Length, cbm_tap_capture_callback_t Callback, void *Context, int *Status, int *BytesRead);
+
+/*! \brief TAPE: Write a tape chunk by chunk
+
+ \param HandleDevice
+   A CBM_FILE which contains the file handle of the driver.
+
+ \param Callback
+   Called for every chunk to be written. It returns the length of the
+   chunk, 0 at the end of the data, or < 0 to break off the write. The
+   first chunk starts with the 5 bytes length header of the tape data.
+
+ \param Context
+   Passed unchanged to Callback.
+
+ \param Status
+   The return status.
+
+ \param BytesWritten
+   The number of bytes written in total.
+
+ \return
+   != 0 on success.
+*/
+typedef int CBMAPIDECL opencbm_plugin_tap_write_t(CBM_FILE HandleDevice, cbm_tap_write_callback_t Callback, void *Context, int *Status, int *BytesWritten);
+
 /*! \brief Get a memory area which contains the configuration data
 
  \return
@@ -679,6 +1000,24 @@ struct opencbm_plugin_s {
     opencbm_plugin_get_list_of_configuration_parameter_t * opencbm_plugin_get_list_of_configuration_parameter;
     opencbm_plugin_set_configuration_parameter_t         * opencbm_plugin_set_configuration_parameter;
 
+    opencbm_plugin_batch_t                      * opencbm_plugin_batch;                      /*!< pointer to a opencbm_plugin_batch_t() function */
+
+    opencbm_plugin_set_deferred_status_t        * opencbm_plugin_set_deferred_status;        /*!< pointer to a opencbm_plugin_set_deferred_status_t() function */
+    opencbm_plugin_flush_deferred_status_t      * opencbm_plugin_flush_deferred_status;      /*!< pointer to a opencbm_plugin_flush_deferred_status_t() function */
+
+    opencbm_plugin_raw_writev_t                 * opencbm_plugin_raw_writev;                 /*!< pointer to a opencbm_plugin_raw_writev_t() function */
+    opencbm_plugin_raw_readv_t                  * opencbm_plugin_raw_readv;                  /*!< pointer to a opencbm_plugin_raw_readv_t() function */
+
+    opencbm_plugin_memory_write_t               * opencbm_plugin_memory_write;               /*!< pointer to a opencbm_plugin_memory_write_t() function */
+    opencbm_plugin_memory_read_t                * opencbm_plugin_memory_read;                /*!< pointer to a opencbm_plugin_memory_read_t() function */
+    opencbm_plugin_code_upload_t                * opencbm_plugin_code_upload;                /*!< pointer to a opencbm_plugin_code_upload_t() function */
+
+    opencbm_plugin_iec_wait_timeout_t           * opencbm_plugin_iec_wait_timeout;           /*!< pointer to a opencbm_plugin_iec_wait_timeout_t() function */
+    opencbm_plugin_iec_program_t                * opencbm_plugin_iec_program;                /*!< pointer to a opencbm_plugin_iec_program_t() function */
+
+    opencbm_plugin_tap_capture_t                * opencbm_plugin_tap_capture;                /*!< pointer to a opencbm_plugin_tap_capture_t() function */
+    opencbm_plugin_tap_write_t                  * opencbm_plugin_tap_write;                  /*!< pointer to a opencbm_plugin_tap_write_t() function */
+
 } opencbm_plugin_t;
 
 #endif // #ifndef OPENCBM_PLUGIN_H
@@ -100,6 +100,18 @@ extern void vdd_usleep(CBM_FILE f, unsigned int howlong);
 #define IEC_RESET  0x08 /*!< Specify the RESET line */
 #define IEC_SRQ    0x10 /*!< Specify the SRQ line */
 
+/* operations of the programs run by cbm_iec_program(),
+   each one is followed by its argument byte */
+#define CBM_IEC_PROG_SET          0x01 /*!< Set the lines given by the argument */
+#define CBM_IEC_PROG_RELEASE      0x02 /*!< Release the lines given by the argument */
+#define CBM_IEC_PROG_SETRELEASE   0x03 /*!< Set the lines in the upper, release those in the lower nibble of the argument */
+#define CBM_IEC_PROG_WAIT_SET     0x04 /*!< Wait until the line given by the argument is set */
+#define CBM_IEC_PROG_WAIT_RELEASE 0x05 /*!< Wait until the line given by the argument is released */
+#define CBM_IEC_PROG_POLL         0x06 /*!< Replace the argument by the state of the lines, like cbm_iec_poll() */
+#define CBM_IEC_PROG_DELAY        0x07 /*!< Wait as many microseconds as the argument gives */
+#define CBM_IEC_PROG_PP_READ      0x08 /*!< Replace the argument by the byte on the parallel port */
+#define CBM_IEC_PROG_PP_WRITE     0x09 /*!< Write the argument to the parallel port */
+
 /* specifiers for the IEEE-488 bus lines  */
 #define IEE_NDAC    0x01 /*!< Specify the NDAC line */
 #define IEE_NRFD    0x02 /*!< Specify the NRFD line */
@@ -126,7 +138,8 @@ enum cbm_device_type_e
     cbm_dt_cbm8050,      /*!< The device is a CBM-8050             */
     cbm_dt_cbm8250,      /*!< The device is a CBM-8250 or SFD-1001 */
     cbm_dt_sfd1001,      /*!< The device is a SFD-1001             */
-    cbm_dt_fdx000        /*!< The device is a CMD FD2000 or FD4000 */
+    cbm_dt_fdx000,       /*!< The device is a CMD FD2000 or FD4000 */
+    cbm_dt_sd2iec        /*!< The device is a SD2IEC or uIEC, without a drive ROM */
 };
 
 /*! Specifies the type of a cable for cbm_identify() */
@@ -137,12 +150,99 @@ enum cbm_cable_type_e
     cbm_ct_xp1541        /*!< The device does have a parallel cable */
 };
 
+/*! Specifies one buffer for cbm_raw_readv() and cbm_raw_writev() */
+typedef
+struct cbm_iovec_s
+{
+    void   *iov_base; /*!< The start of the buffer */
+    size_t  iov_len;  /*!< The size of the buffer in bytes */
+} cbm_iovec_t;
+
+/*! The operation of a cbm_async_request_t */
+enum cbm_async_type_e
+{
+    cbm_async_raw_write, /*!< cbm_raw_write() of buffer, count */
+    cbm_async_raw_read,  /*!< cbm_raw_read() into buffer, count */
+    cbm_async_listen,    /*!< cbm_listen() of device_address, secondary_address */
+    cbm_async_talk,      /*!< cbm_talk() of device_address, secondary_address */
+    cbm_async_unlisten,  /*!< cbm_unlisten() */
+    cbm_async_untalk,    /*!< cbm_untalk() */
+    cbm_async_open,      /*!< cbm_open() of device_address, secondary_address, with the file name in buffer, count */
+    cbm_async_close,     /*!< cbm_close() of device_address, secondary_address */
+    cbm_async_parallel_burst_write_n,    /*!< cbm_parallel_burst_write_n() of buffer, count */
+    cbm_async_parallel_burst_write_track /*!< cbm_parallel_burst_write_track() of buffer, count */
+};
+
+struct cbm_async_request_s;
+
+/*! Called by the worker of cbm_async_submit() when a request has been run */
+typedef void (CBMAPIDECL *cbm_async_callback_t)(struct cbm_async_request_s *Request, void *Context);
+
+/*! One bus operation for cbm_async_submit() */
+typedef
+struct cbm_async_request_s
+{
+    enum cbm_async_type_e type;              /*!< The operation to run */
+    unsigned char         device_address;    /*!< The device address, if the operation needs one */
+    unsigned char         secondary_address; /*!< The secondary address, if the operation needs one */
+    void                 *buffer;            /*!< The data to write or the buffer to read into, if the operation needs one */
+    size_t                count;             /*!< The size of buffer in bytes */
+    cbm_async_callback_t  callback;          /*!< Called when the request has been run, or NULL */
+    void                 *context;           /*!< Given to callback verbatim */
+    int                   result;            /*!< Filled in: the return value of the operation */
+
+    /* the following is used by the library only */
+    volatile int                state;      /*!< Do not use: the state of the request */
+    struct cbm_async_request_s *next;       /*!< Do not use: the next request in the queue */
+    void                       *event;      /*!< Do not use: signals the completion to a waiter */
+} cbm_async_request_t;
+
+struct cbm_bus_task_s;
+
+/*! One step of a cbm_bus_task_t: returns how many ms the drive is busy now, or < 0 when the task is done */
+typedef int (CBMAPIDECL *cbm_bus_step_t)(CBM_FILE HandleDevice, struct cbm_bus_task_s *Task);
+
+/*! The work on one drive for cbm_bus_schedule() */
+typedef
+struct cbm_bus_task_s
+{
+    cbm_bus_step_t step;         /*!< Called whenever the task gets the bus */
+    void          *context;      /*!< For the use of step */
+
+    /* the following is used by the library only */
+    double         wake_time;    /*!< Do not use: the time the drive is expected to be done */
+    int            done;         /*!< Do not use: != 0 if the task is done */
+} cbm_bus_task_t;
+
+/*! Describes one track for cbm_parallel_burst_read_tracks() and cbm_parallel_burst_write_tracks() */
+typedef
+struct cbm_parallel_burst_track_s
+{
+    unsigned char *command;        /*!< Drive command sent with cbm_parallel_burst_write_n() before the track is transferred, or NULL */
+    unsigned int   command_length; /*!< The length of command in bytes */
+    unsigned char *buffer;         /*!< The buffer which receives the track data, or holds the data to write */
+    unsigned int   length;         /*!< The size of buffer in bytes */
+    int            variable;       /*!< != 0: read with cbm_parallel_burst_read_track_var(); unused for writing */
+    int            result;         /*!< Filled in: the return value of the track read or write */
+} cbm_parallel_burst_track_t;
+
+/*! Called by cbm_parallel_burst_read_tracks() after each track, and by cbm_parallel_burst_write_tracks() to fill each track; return != 0 to stop */
+typedef int (CBMAPIDECL *cbm_parallel_burst_track_callback_t)(void *Context, cbm_parallel_burst_track_t *Track, unsigned int Index);
+
+/*! Called by cbm_tap_capture() for every chunk of capture data; return != 0 to break off the capture */
+typedef int (CBMAPIDECL *cbm_tap_capture_callback_t)(void *Context, const unsigned char *Buffer, unsigned int Length);
+
+/*! Called by cbm_tap_write() for the next chunk of tape data; returns its length, 0 at the end, < 0 to break off the write */
+typedef int (CBMAPIDECL *cbm_tap_write_callback_t)(void *Context, const unsigned char **Buffer);
+
 /*! \todo FIXME: port isn't used yet */
 EXTERN int CBMAPIDECL cbm_driver_open(CBM_FILE *f, int port);
 EXTERN int CBMAPIDECL cbm_driver_open_ex(CBM_FILE *f, char * adapter);
 EXTERN void CBMAPIDECL cbm_driver_close(CBM_FILE f);
 EXTERN void CBMAPIDECL cbm_lock(CBM_FILE f);
 EXTERN void CBMAPIDECL cbm_unlock(CBM_FILE f);
+EXTERN int CBMAPIDECL cbm_session_begin(CBM_FILE f);
+EXTERN void CBMAPIDECL cbm_session_end(CBM_FILE f);
 
 /*! \todo FIXME: port isn't used yet */
 EXTERN const char * CBMAPIDECL cbm_get_driver_name(int port);
@@ -156,6 +256,18 @@ EXTERN int CBMAPIDECL cbm_close(CBM_FILE f, unsigned char dev, unsigned char sec
 
 EXTERN int CBMAPIDECL cbm_raw_read(CBM_FILE f, void *buf, size_t size);
 EXTERN int CBMAPIDECL cbm_raw_write(CBM_FILE f, const void *buf, size_t size);
+EXTERN int CBMAPIDECL cbm_raw_readv(CBM_FILE f, const cbm_iovec_t *iov, unsigned int iovcnt);
+EXTERN int CBMAPIDECL cbm_raw_writev(CBM_FILE f, const cbm_iovec_t *iov, unsigned int iovcnt);
+
+EXTERN int CBMAPIDECL cbm_async_submit(CBM_FILE f, cbm_async_request_t *request);
+EXTERN int CBMAPIDECL cbm_async_test(CBM_FILE f, cbm_async_request_t *request);
+EXTERN int CBMAPIDECL cbm_async_wait(CBM_FILE f, cbm_async_request_t *request);
+EXTERN void CBMAPIDECL cbm_async_flush(CBM_FILE f);
+
+EXTERN int CBMAPIDECL cbm_bus_schedule(CBM_FILE f, cbm_bus_task_t *tasks, unsigned int count);
+EXTERN int CBMAPIDECL cbm_drive_job_start(CBM_FILE f, unsigned char dev, unsigned char buffer,
+                                          unsigned char job, unsigned char track, unsigned char sector);
+EXTERN int CBMAPIDECL cbm_drive_job_poll(CBM_FILE f, unsigned char dev, unsigned char buffer);
 
 EXTERN int CBMAPIDECL cbm_unlisten(CBM_FILE f);
 EXTERN int CBMAPIDECL cbm_untalk(CBM_FILE f);
@@ -174,16 +286,30 @@ EXTERN void CBMAPIDECL cbm_iec_set(CBM_FILE f, int line);
 EXTERN void CBMAPIDECL cbm_iec_release(CBM_FILE f, int line);
 EXTERN void CBMAPIDECL cbm_iec_setrelease(CBM_FILE f, int set, int release);
 EXTERN int CBMAPIDECL cbm_iec_wait(CBM_FILE f, int line, int state);
+EXTERN int CBMAPIDECL cbm_iec_wait_timeout(CBM_FILE f, int line, int state, unsigned int timeout_ms);
+EXTERN int CBMAPIDECL cbm_iec_program(CBM_FILE f, unsigned char *program, unsigned int length);
 
 EXTERN int CBMAPIDECL cbm_upload(CBM_FILE f, unsigned char dev, int adr, const void *prog, size_t size);
+EXTERN int CBMAPIDECL cbm_upload_resident(CBM_FILE f, unsigned char dev, int adr, const void *prog, size_t size);
+EXTERN int CBMAPIDECL cbm_upload_packed(CBM_FILE f, unsigned char dev, int adr, const void *prog, size_t size, int work, size_t work_size);
+EXTERN void CBMAPIDECL cbm_upload_cache_flush(CBM_FILE f);
 EXTERN int CBMAPIDECL cbm_download(CBM_FILE f, unsigned char dev, int adr, void *dbuf, size_t size);
 
 EXTERN int CBMAPIDECL cbm_device_status(CBM_FILE f, unsigned char dev, void *buf, size_t bufsize);
 EXTERN int CBMAPIDECL cbm_exec_command(CBM_FILE f, unsigned char dev, const void *cmd, size_t len);
 
+EXTERN int CBMAPIDECL cbm_set_deferred_status(CBM_FILE f, int enable);
+EXTERN int CBMAPIDECL cbm_flush_deferred_status(CBM_FILE f);
+
+EXTERN int CBMAPIDECL cbm_adapter_memory_write(CBM_FILE f, unsigned char dev, unsigned int adr, const unsigned char *buf, unsigned int count);
+EXTERN int CBMAPIDECL cbm_adapter_code_upload(CBM_FILE f, unsigned char dev, unsigned int adr, const unsigned char *buf, unsigned int count);
+EXTERN int CBMAPIDECL cbm_adapter_memory_read(CBM_FILE f, unsigned char dev, unsigned int adr, unsigned char *buf, unsigned int count);
+EXTERN int CBMAPIDECL cbm_batch_memory_read(CBM_FILE f, unsigned char dev, unsigned int adr, unsigned char *buf, unsigned int count);
+
 EXTERN int CBMAPIDECL cbm_identify(CBM_FILE f, unsigned char drv,
                                    enum cbm_device_type_e *t,
                                    const char **type_str);
+EXTERN void CBMAPIDECL cbm_identify_cache_flush(CBM_FILE f);
 
 EXTERN unsigned int CBMAPIDECL cbm_determine_pport_address(enum cbm_device_type_e CbmDeviceType);
 
@@ -191,6 +317,7 @@ EXTERN int CBMAPIDECL cbm_identify_xp1541(CBM_FILE HandleDevice,
                                           unsigned char DeviceAddress,
                                           enum cbm_device_type_e *CbmDeviceType,
                                           enum cbm_cable_type_e *CableType);
+EXTERN void CBMAPIDECL cbm_identify_xp1541_cache_flush(CBM_FILE f);
 
 
 EXTERN char CBMAPIDECL cbm_petscii2ascii_c(char character);
@@ -202,6 +329,10 @@ EXTERN int CBMAPIDECL gcr_5_to_4_decode(const unsigned char *source, unsigned ch
                                         size_t sourceLength,         size_t destLength);
 EXTERN int CBMAPIDECL gcr_4_to_5_encode(const unsigned char *source, unsigned char *dest,
                                         size_t sourceLength,         size_t destLength);
+EXTERN int CBMAPIDECL gcr_5_to_4_decode_track(const unsigned char *source, unsigned char *dest,
+                                              size_t sourceLength,         size_t destLength);
+EXTERN int CBMAPIDECL gcr_4_to_5_encode_track(const unsigned char *source, unsigned char *dest,
+                                              size_t sourceLength,         size_t destLength);
 
 
 #if DBG
@@ -220,6 +351,10 @@ EXTERN int CBMAPIDECL cbm_parallel_burst_write_n(CBM_FILE HandleDevice, unsigned
 EXTERN int CBMAPIDECL  cbm_parallel_burst_read_track(CBM_FILE f, unsigned char *buffer, unsigned int length);
 EXTERN int CBMAPIDECL  cbm_parallel_burst_read_track_var(CBM_FILE f, unsigned char *buffer, unsigned int length);
 EXTERN int CBMAPIDECL cbm_parallel_burst_write_track(CBM_FILE f, unsigned char *buffer, unsigned int length);
+EXTERN int CBMAPIDECL cbm_parallel_burst_write_tracks(CBM_FILE f, cbm_parallel_burst_track_t *tracks, unsigned int count,
+                                                      cbm_parallel_burst_track_callback_t callback, void *context);
+EXTERN int CBMAPIDECL cbm_parallel_burst_read_tracks(CBM_FILE f, cbm_parallel_burst_track_t *tracks, unsigned int count,
+                                                     cbm_parallel_burst_track_callback_t callback, void *context);
 
 /* parallel burst functions end */
 
@@ -249,6 +384,8 @@ EXTERN int CBMAPIDECL cbm_tap_get_ver(CBM_FILE f, int *Status);
 EXTERN int CBMAPIDECL cbm_tap_download_config(CBM_FILE f, unsigned char *Buffer, unsigned int Buffer_Length, int *Status, int *BytesRead);
 EXTERN int CBMAPIDECL cbm_tap_upload_config(CBM_FILE f, unsigned char *Buffer, unsigned int Length, int *Status, int *BytesWritten);
 EXTERN int CBMAPIDECL cbm_tap_break(CBM_FILE f);
+EXTERN int CBMAPIDECL cbm_tap_capture(CBM_FILE f, unsigned char *Buffer, unsigned int Buffer_Length, cbm_tap_capture_callback_t Callback, void *Context, int *Status, int *BytesRead);
+EXTERN int CBMAPIDECL cbm_tap_write(CBM_FILE f, cbm_tap_write_callback_t Callback, void *Context, int *Status, int *BytesWritten);
 
 /* tape capture functions end */
 
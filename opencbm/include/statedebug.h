@@ -8,15 +8,26 @@
  *  Copyright 2011 Spiro Trikaliotis
 */
 
+/*
+ * A trace point is a constant which is put into the read-only data by
+ * the compiler: so, marking the state only needs one store of a constant
+ * address, even in the bit loops of the transfer routines. Without
+ * DEBUG_STATEDEBUG, SETSTATEDEBUG() does not generate any code at all.
+ */
+typedef struct statedebug_tracepoint_s {
+    const char * FileName;
+    int          LineNumber;
+} statedebug_tracepoint_t;
+
 #ifdef DEBUG_STATEDEBUG
-    extern volatile int DebugLineNumber, DebugBlockCount,
-                        DebugByteCount, DebugBitCount;
-    extern volatile char *     DebugFileName;
+    extern volatile int DebugBlockCount, DebugByteCount, DebugBitCount;
+    extern const statedebug_tracepoint_t * volatile DebugTracePoint;
 
-#   define SETSTATEDEBUG(_x)  \
-        DebugLineNumber=__LINE__; \
-        DebugFileName  =__FILE__; \
-        (_x)
+#   define SETSTATEDEBUG(_x) do { \
+        static const statedebug_tracepoint_t statedebug_here = { __FILE__, __LINE__ }; \
+        DebugTracePoint = &statedebug_here; \
+        (_x); \
+    } while (0)
 
     extern void DebugPrintDebugCounters(void);
 
@@ -91,6 +91,10 @@ EXTERN opencbm_plugin_pp_dc_write_n_t              opencbm_plugin_pp_dc_write_n;
 EXTERN opencbm_plugin_pp_cc_read_n_t               opencbm_plugin_pp_cc_read_n;
 EXTERN opencbm_plugin_pp_cc_write_n_t              opencbm_plugin_pp_cc_write_n;
 
+EXTERN opencbm_plugin_s1_read_gcr_n_t              opencbm_plugin_s1_read_gcr_n;
+EXTERN opencbm_plugin_s2_read_gcr_n_t              opencbm_plugin_s2_read_gcr_n;
+EXTERN opencbm_plugin_pp_dc_read_gcr_n_t           opencbm_plugin_pp_dc_read_gcr_n;
+
 EXTERN opencbm_plugin_iec_dbg_read_t               opencbm_plugin_iec_dbg_read;
 EXTERN opencbm_plugin_iec_dbg_write_t              opencbm_plugin_iec_dbg_write;
 
@@ -100,4 +104,17 @@ EXTERN opencbm_plugin_uninit_t                     opencbm_plugin_uninit;
 EXTERN opencbm_plugin_get_list_of_configuration_parameter_t opencbm_plugin_get_list_of_configuration_parameter;
 EXTERN opencbm_plugin_set_configuration_parameter_t         opencbm_plugin_set_configuration_parameter;
 
+EXTERN opencbm_plugin_batch_t                      opencbm_plugin_batch;
+EXTERN opencbm_plugin_set_deferred_status_t        opencbm_plugin_set_deferred_status;
+EXTERN opencbm_plugin_flush_deferred_status_t      opencbm_plugin_flush_deferred_status;
+EXTERN opencbm_plugin_raw_writev_t                 opencbm_plugin_raw_writev;
+EXTERN opencbm_plugin_raw_readv_t                  opencbm_plugin_raw_readv;
+EXTERN opencbm_plugin_memory_write_t               opencbm_plugin_memory_write;
+EXTERN opencbm_plugin_memory_read_t                opencbm_plugin_memory_read;
+EXTERN opencbm_plugin_code_upload_t                opencbm_plugin_code_upload;
+EXTERN opencbm_plugin_iec_wait_timeout_t           opencbm_plugin_iec_wait_timeout;
+EXTERN opencbm_plugin_iec_program_t                opencbm_plugin_iec_program;
+EXTERN opencbm_plugin_tap_capture_t                opencbm_plugin_tap_capture;
+EXTERN opencbm_plugin_tap_write_t                  opencbm_plugin_tap_write;
+
 #endif // #ifndef ARCHLIB_H
@@ -0,0 +1,571 @@
+/*
+ *      This program is free software; you can redistribute it and/or
+ *      modify it under the terms of the GNU General Public License
+ *      as published by the Free Software Foundation; either version
+ *      2 of the License, or (at your option) any later version.
+ *
+*/
+
+/*! **************************************************************
+** \file lib/async.c \n
+** \n
+** \brief Shared library / DLL for accessing the driver:
+**        Asynchronous submission and completion of bus operations
+**
+****************************************************************/
+
+/*! Mark: We are in user-space (for debug.h) */
+#define DBG_USERMODE
+
+/*! The name of the executable */
+#define DBG_PROGNAME "OPENCBM.DLL"
+
+#include "debug.h"
+
+#include <stdlib.h>
+
+//! mark: We are building the DLL */
+#define DLL
+#include "opencbm.h"
+#include "async.h"
+
+#ifndef WIN32
+# include <pthread.h>
+#endif
+
+/* the states of a cbm_async_request_t */
+#define ASYNC_STATE_QUEUED  1 /*!< the request waits in the queue */
+#define ASYNC_STATE_RUNNING 2 /*!< the worker runs the request */
+#define ASYNC_STATE_DONE    3 /*!< the request has been run */
+
+/*! \brief The queue and the worker of one handle */
+typedef
+struct async_handle_s
+{
+    CBM_FILE               HandleDevice; /*!< the handle the requests are run on */
+    cbm_async_request_t   *Head;         /*!< the first request in the queue */
+    cbm_async_request_t   *Tail;         /*!< the last request in the queue */
+    unsigned int           Pending;      /*!< the number of requests not done yet */
+    int                    Stop;         /*!< != 0: the worker ends when the queue is empty */
+    struct async_handle_s *Next;         /*!< the next handle with a worker */
+
+#ifdef WIN32
+    CRITICAL_SECTION       Lock;         /*!< protects the queue and the states of its requests */
+    HANDLE                 WorkEvent;    /*!< set when there is something for the worker to do */
+    HANDLE                 IdleEvent;    /*!< set while there is no request pending */
+    HANDLE                 Thread;       /*!< the worker */
+#else
+    pthread_mutex_t        Lock;         /*!< protects the queue and the states of its requests */
+    pthread_cond_t         WorkCond;     /*!< signalled when there is something for the worker to do */
+    pthread_cond_t         DoneCond;     /*!< signalled when a request has been run */
+    pthread_t              Thread;       /*!< the worker */
+#endif
+} async_handle_t;
+
+/*! \brief All handles which have a worker */
+static async_handle_t *Async_handles = NULL;
+
+#ifdef WIN32
+
+static LONG volatile Async_handles_lock_flag = 0;
+
+static void
+async_handles_lock(void)
+{
+    while (InterlockedExchange((LONG *) &Async_handles_lock_flag, 1) != 0) {
+        Sleep(0);
+    }
+}
+
+static void
+async_handles_unlock(void)
+{
+    InterlockedExchange((LONG *) &Async_handles_lock_flag, 0);
+}
+
+# define async_lock(_ah)   EnterCriticalSection(&(_ah)->Lock)
+# define async_unlock(_ah) LeaveCriticalSection(&(_ah)->Lock)
+
+#else
+
+static pthread_mutex_t Async_handles_mutex = PTHREAD_MUTEX_INITIALIZER;
+
+static void
+async_handles_lock(void)
+{
+    pthread_mutex_lock(&Async_handles_mutex);
+}
+
+static void
+async_handles_unlock(void)
+{
+    pthread_mutex_unlock(&Async_handles_mutex);
+}
+
+# define async_lock(_ah)   pthread_mutex_lock(&(_ah)->Lock)
+# define async_unlock(_ah) pthread_mutex_unlock(&(_ah)->Lock)
+
+#endif
+
+/*! \internal \brief Run one request with the synchronous functions */
+static int
+async_run(CBM_FILE HandleDevice, cbm_async_request_t *Request)
+{
+    switch (Request->type)
+    {
+    case cbm_async_raw_write:
+        return cbm_raw_write(HandleDevice, Request->buffer, Request->count);
+
+    case cbm_async_raw_read:
+        return cbm_raw_read(HandleDevice, Request->buffer, Request->count);
+
+    case cbm_async_listen:
+        return cbm_listen(HandleDevice, Request->device_address, Request->secondary_address);
+
+    case cbm_async_talk:
+        return cbm_talk(HandleDevice, Request->device_address, Request->secondary_address);
+
+    case cbm_async_unlisten:
+        return cbm_unlisten(HandleDevice);
+
+    case cbm_async_untalk:
+        return cbm_untalk(HandleDevice);
+
+    case cbm_async_open:
+        return cbm_open(HandleDevice, Request->device_address, Request->secondary_address,
+                        Request->buffer, Request->count);
+
+    case cbm_async_close:
+        return cbm_close(HandleDevice, Request->device_address, Request->secondary_address);
+
+    case cbm_async_parallel_burst_write_n:
+        return cbm_parallel_burst_write_n(HandleDevice, Request->buffer, (unsigned int) Request->count);
+
+    case cbm_async_parallel_burst_write_track:
+        return cbm_parallel_burst_write_track(HandleDevice, Request->buffer, (unsigned int) Request->count);
+    }
+
+    DBG_ERROR((DBG_PREFIX "unknown request type %u", Request->type));
+    return -1;
+}
+
+/*! \internal \brief The worker of a handle: run the queued requests in order */
+#ifdef WIN32
+static DWORD WINAPI
+async_worker(LPVOID Parameter)
+#else
+static void *
+async_worker(void *Parameter)
+#endif
+{
+    async_handle_t *ah = Parameter;
+
+    async_lock(ah);
+
+    for (;;) {
+        cbm_async_request_t *request;
+
+        while (ah->Head == NULL && !ah->Stop) {
+#ifdef WIN32
+            async_unlock(ah);
+            WaitForSingleObject(ah->WorkEvent, INFINITE);
+            async_lock(ah);
+#else
+            pthread_cond_wait(&ah->WorkCond, &ah->Lock);
+#endif
+        }
+
+        if (ah->Head == NULL) {
+            break;
+        }
+
+        request = ah->Head;
+        ah->Head = request->next;
+        if (ah->Head == NULL) {
+            ah->Tail = NULL;
+        }
+        request->state = ASYNC_STATE_RUNNING;
+
+        async_unlock(ah);
+
+        request->result = async_run(ah->HandleDevice, request);
+
+        if (request->callback) {
+            request->callback(request, request->context);
+        }
+
+        async_lock(ah);
+
+        /* after this, the request belongs to the caller again */
+        request->state = ASYNC_STATE_DONE;
+        --ah->Pending;
+
+#ifdef WIN32
+        if (request->event) {
+            SetEvent(request->event);
+        }
+        if (ah->Pending == 0) {
+            SetEvent(ah->IdleEvent);
+        }
+#else
+        pthread_cond_broadcast(&ah->DoneCond);
+#endif
+    }
+
+    async_unlock(ah);
+
+#ifdef WIN32
+    return 0;
+#else
+    return NULL;
+#endif
+}
+
+/*! \internal \brief Free a handle's queue; its worker must not be running */
+static void
+async_handle_free(async_handle_t *ah)
+{
+#ifdef WIN32
+    if (ah->WorkEvent) {
+        CloseHandle(ah->WorkEvent);
+    }
+    if (ah->IdleEvent) {
+        CloseHandle(ah->IdleEvent);
+    }
+    DeleteCriticalSection(&ah->Lock);
+#else
+    pthread_cond_destroy(&ah->DoneCond);
+    pthread_cond_destroy(&ah->WorkCond);
+    pthread_mutex_destroy(&ah->Lock);
+#endif
+    free(ah);
+}
+
+/*! \internal \brief Find the queue of a handle
+
+ \param HandleDevice
+   A CBM_FILE which contains the file handle of the driver.
+
+ \param Create
+   != 0: Create the queue and start its worker if there is none yet.
+
+ \return
+   The queue, or NULL if there is none (and it could not be created).
+*/
+static async_handle_t *
+async_handle_get(CBM_FILE HandleDevice, int Create)
+{
+    async_handle_t *ah;
+
+    async_handles_lock();
+
+    for (ah = Async_handles; ah != NULL; ah = ah->Next) {
+        if (ah->HandleDevice == HandleDevice) {
+            break;
+        }
+    }
+
+    if (ah == NULL && Create) {
+        ah = calloc(1, sizeof *ah);
+
+        if (ah != NULL) {
+            int error;
+
+            ah->HandleDevice = HandleDevice;
+
+#ifdef WIN32
+            InitializeCriticalSection(&ah->Lock);
+            ah->WorkEvent = CreateEvent(NULL, FALSE, FALSE, NULL);
+            ah->IdleEvent = CreateEvent(NULL, TRUE, TRUE, NULL);
+            error = ah->WorkEvent == NULL || ah->IdleEvent == NULL;
+            if (!error) {
+                ah->Thread = CreateThread(NULL, 0, async_worker, ah, 0, NULL);
+                error = ah->Thread == NULL;
+            }
+#else
+            pthread_mutex_init(&ah->Lock, NULL);
+            pthread_cond_init(&ah->WorkCond, NULL);
+            pthread_cond_init(&ah->DoneCond, NULL);
+            error = pthread_create(&ah->Thread, NULL, async_worker, ah) != 0;
+#endif
+
+            if (error) {
+                DBG_ERROR((DBG_PREFIX "could not start the worker"));
+                async_handle_free(ah);
+                ah = NULL;
+            }
+            else {
+                ah->Next = Async_handles;
+                Async_handles = ah;
+            }
+        }
+    }
+
+    async_handles_unlock();
+
+    return ah;
+}
+
+/** @{ @ingroup opencbm_iec */
+
+/*! \brief Submit a bus operation to be run asynchronously
+
+ This function queues a request and returns at once. The
+ requests of a handle are run one after the other, in the
+ order they have been submitted, by a worker thread of the
+ library. The caller can prepare the next transfer or
+ compute in the meantime, and learns about the completion
+ with cbm_async_test(), cbm_async_wait() or the callback.
+
+ \param HandleDevice
+   A CBM_FILE which contains the file handle of the driver.
+
+ \param Request
+   Pointer to the request. The type and the parameters the
+   operation needs must be filled in; callback can be NULL.
+   The request, and the buffer it points to, must stay valid
+   and must not be changed until it has been completed.
+
+ \return
+   0 if the request has been queued, -1 on error.
+
+ \remark
+   When the request has been run, its result member holds
+   what the synchronous function (cf. cbm_async_type_e) would
+   have returned, and its callback is called on the worker
+   thread.\n
+   While requests are pending on a handle, do not use that
+   handle with the synchronous functions; call
+   cbm_async_flush() first. cbm_driver_close() runs all
+   pending requests before it closes the handle.
+
+ If cbm_driver_open() did not succeed, it is illegal to
+ call this function.
+*/
+
+int CBMAPIDECL
+cbm_async_submit(CBM_FILE HandleDevice, cbm_async_request_t *Request)
+{
+    async_handle_t *ah;
+
+    FUNC_ENTER();
+
+    FUNC_PARAM((DBG_PREFIX "HandleDevice = %p, Request = %p", HandleDevice, Request));
+
+    DBG_ASSERT(Request != NULL);
+
+    ah = async_handle_get(HandleDevice, 1);
+
+    if (ah == NULL || Request == NULL) {
+        FUNC_LEAVE_INT(-1);
+    }
+
+    Request->state = ASYNC_STATE_QUEUED;
+    Request->next = NULL;
+    Request->event = NULL;
+
+    async_lock(ah);
+
+    if (ah->Tail) {
+        ah->Tail->next = Request;
+    }
+    else {
+        ah->Head = Request;
+    }
+    ah->Tail = Request;
+    ++ah->Pending;
+
+#ifdef WIN32
+    ResetEvent(ah->IdleEvent);
+    SetEvent(ah->WorkEvent);
+#else
+    pthread_cond_signal(&ah->WorkCond);
+#endif
+
+    async_unlock(ah);
+
+    FUNC_LEAVE_INT(0);
+}
+
+/*! \brief Test if an asynchronous bus operation has completed
+
+ \param HandleDevice
+   A CBM_FILE which contains the file handle of the driver.
+
+ \param Request
+   Pointer to a request given to cbm_async_submit() before.
+
+ \return
+   1 if the request has been run, 0 if it is still pending.
+
+ If cbm_driver_open() did not succeed, it is illegal to
+ call this function.
+*/
+
+int CBMAPIDECL
+cbm_async_test(CBM_FILE HandleDevice, cbm_async_request_t *Request)
+{
+    async_handle_t *ah;
+    int done = 1;
+
+    FUNC_ENTER();
+
+    ah = async_handle_get(HandleDevice, 0);
+
+    if (ah != NULL) {
+        async_lock(ah);
+        done = Request->state == ASYNC_STATE_DONE;
+        async_unlock(ah);
+    }
+
+    FUNC_LEAVE_INT(done);
+}
+
+/*! \brief Wait for an asynchronous bus operation to complete
+
+ \param HandleDevice
+   A CBM_FILE which contains the file handle of the driver.
+
+ \param Request
+   Pointer to a request given to cbm_async_submit() before.
+   Only one thread may wait for a given request.
+
+ \return
+   The result of the request.
+
+ If cbm_driver_open() did not succeed, it is illegal to
+ call this function.
+*/
+
+int CBMAPIDECL
+cbm_async_wait(CBM_FILE HandleDevice, cbm_async_request_t *Request)
+{
+    async_handle_t *ah;
+
+    FUNC_ENTER();
+
+    ah = async_handle_get(HandleDevice, 0);
+
+    if (ah != NULL) {
+        async_lock(ah);
+
+#ifdef WIN32
+        if (Request->state != ASYNC_STATE_DONE) {
+            HANDLE event = CreateEvent(NULL, TRUE, FALSE, NULL);
+
+            Request->event = event;
+            async_unlock(ah);
+
+            if (event == NULL) {
+                /* no event available: poll instead */
+                while (cbm_async_test(HandleDevice, Request) == 0) {
+                    Sleep(1);
+                }
+            }
+            else {
+                WaitForSingleObject(event, INFINITE);
+            }
+
+            async_lock(ah);
+            Request->event = NULL;
+            if (event) {
+                CloseHandle(event);
+            }
+        }
+#else
+        while (Request->state != ASYNC_STATE_DONE) {
+            pthread_cond_wait(&ah->DoneCond, &ah->Lock);
+        }
+#endif
+
+        async_unlock(ah);
+    }
+
+    FUNC_LEAVE_INT(Request->result);
+}
+
+/*! \brief Wait until all asynchronous bus operations have completed
+
+ \param HandleDevice
+   A CBM_FILE which contains the file handle of the driver.
+
+ Afterwards, the handle can be used with the synchronous
+ functions again.
+
+ If cbm_driver_open() did not succeed, it is illegal to
+ call this function.
+*/
+
+void CBMAPIDECL
+cbm_async_flush(CBM_FILE HandleDevice)
+{
+    async_handle_t *ah;
+
+    FUNC_ENTER();
+
+    ah = async_handle_get(HandleDevice, 0);
+
+    if (ah != NULL) {
+#ifdef WIN32
+        WaitForSingleObject(ah->IdleEvent, INFINITE);
+#else
+        async_lock(ah);
+        while (ah->Pending != 0) {
+            pthread_cond_wait(&ah->DoneCond, &ah->Lock);
+        }
+        async_unlock(ah);
+#endif
+    }
+
+    FUNC_LEAVE();
+}
+
+/** @} */
+
+/*! \internal \brief Stop the worker of a handle that is being closed
+
+ All requests still pending are run before.
+
+ \param HandleDevice
+   A CBM_FILE which contains the file handle of the driver.
+*/
+void
+cbm_async_uninit(CBM_FILE HandleDevice)
+{
+    async_handle_t *ah, **pah;
+
+    FUNC_ENTER();
+
+    async_handles_lock();
+
+    for (pah = &Async_handles; (ah = *pah) != NULL; pah = &ah->Next) {
+        if (ah->HandleDevice == HandleDevice) {
+            *pah = ah->Next;
+            break;
+        }
+    }
+
+    async_handles_unlock();
+
+    if (ah != NULL) {
+        async_lock(ah);
+        ah->Stop = 1;
+#ifdef WIN32
+        SetEvent(ah->WorkEvent);
+#else
+        pthread_cond_signal(&ah->WorkCond);
+#endif
+        async_unlock(ah);
+
+#ifdef WIN32
+        WaitForSingleObject(ah->Thread, INFINITE);
+        CloseHandle(ah->Thread);
+#else
+        pthread_join(ah->Thread, NULL);
+#endif
+
+        async_handle_free(ah);
+    }
+
+    FUNC_LEAVE();
+}
@@ -0,0 +1,23 @@
+/*
+ *      This program is free software; you can redistribute it and/or
+ *      modify it under the terms of the GNU General Public License
+ *      as published by the Free Software Foundation; either version
+ *      2 of the License, or (at your option) any later version.
+ *
+*/
+
+/*! **************************************************************
+** \file lib/async.h \n
+** \n
+** \brief Internal interface of the asynchronous bus operations
+**
+****************************************************************/
+
+#ifndef CBM_LIB_ASYNC_H
+#define CBM_LIB_ASYNC_H
+
+#include "opencbm.h"
+
+extern void cbm_async_uninit(CBM_FILE HandleDevice);
+
+#endif /* #ifndef CBM_LIB_ASYNC_H */
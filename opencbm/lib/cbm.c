@@ -33,6 +33,8 @@
 
 #include <stdlib.h>
 #include <string.h>
+#include <sys/types.h>
+#include <sys/stat.h>
 
 #include "libmisc.h"
 
@@ -41,6 +43,8 @@
 #include "opencbm.h"
 #include "opencbm-dos.h"
 #include "archlib.h"
+#include "async.h"
+#include "trace.h"
 
 #include "opencbm-plugin.h"
 
@@ -141,17 +145,231 @@ int plugin_set_inactive(const char PluginName[])
 }
 
 
-/*! \brief @@@@@ \todo document */
+/*! \brief A loaded plugin */
 struct plugin_information_s {
-    SHARED_OBJECT_HANDLE Library; /*!< \brief @@@@@ \todo document */
-    opencbm_plugin_t     Plugin;  /*!< \brief @@@@@ \todo document */
+    SHARED_OBJECT_HANDLE Library; /*!< \brief the handle of the shared object of the plugin */
+    opencbm_plugin_t     Plugin;  /*!< \brief the entry points of the plugin */
+    cbm_trace_t *        Trace;   /*!< \brief the trace of the calls into the plugin; NULL if not traced */
+    cbm_replay_t *       Replay;  /*!< \brief the recorded session replayed instead of the plugin; NULL if none */
+
+    char *               Name;           /*!< \brief the adapter name it was loaded for; NULL for the default one */
+    unsigned int         ReferenceCount; /*!< \brief the number of open handles, plus the opens and name queries in progress; the calls on a handle take none */
+    struct plugin_information_s * Next;  /*!< \brief the next loaded plugin */
 };
 
-/*! \brief @@@@@ \todo document */
+/*! \brief A loaded plugin */
 typedef struct plugin_information_s plugin_information_t;
 
-static
-struct plugin_information_s Plugin_information = { 0 };
+/*! \brief The plugin an open handle belongs to */
+typedef struct plugin_handle_s {
+    CBM_FILE               HandleDevice; /*!< \brief the handle the plugin returned from opencbm_plugin_driver_open() */
+    plugin_information_t * Plugin;       /*!< \brief the plugin the handle belongs to */
+} plugin_handle_t;
+
+/*! \brief All loaded plugins */
+static plugin_information_t * Plugin_list = NULL;
+
+/*! \brief The plugin loaded last; used by the functions that do not get a handle */
+static plugin_information_t * Plugin_last = NULL;
+
+/*! \brief Stands in for a plugin if no plugin is loaded at all */
+static plugin_information_t Plugin_none = { 0 };
+
+/*! \brief All open handles, with the plugins they belong to */
+static plugin_handle_t * Plugin_handles = NULL;
+static unsigned int      Plugin_handles_count = 0; /*!< \brief number of used entries in Plugin_handles */
+static unsigned int      Plugin_handles_size  = 0; /*!< \brief number of allocated entries in Plugin_handles */
+
+/*
+ * All of the above is protected by one lock, so that several
+ * threads can open, use and close handles at the same time.
+ * The plugin calls themselves are not serialized: Using the
+ * same handle from different threads at the same time is
+ * still up to the caller (cf. cbm_lock()).
+ */
+#ifdef WIN32
+
+static LONG volatile Plugin_lock_flag = 0;
+
+static void
+plugin_lock(void)
+{
+    while (InterlockedExchange((LONG *) &Plugin_lock_flag, 1) != 0) {
+        Sleep(0);
+    }
+}
+
+static void
+plugin_unlock(void)
+{
+    InterlockedExchange((LONG *) &Plugin_lock_flag, 0);
+}
+
+#else
+
+#include <pthread.h>
+
+static pthread_mutex_t Plugin_lock_mutex = PTHREAD_MUTEX_INITIALIZER;
+
+static void
+plugin_lock(void)
+{
+    pthread_mutex_lock(&Plugin_lock_mutex);
+}
+
+static void
+plugin_unlock(void)
+{
+    pthread_mutex_unlock(&Plugin_lock_mutex);
+}
+
+#endif
+
+/*
+ * The handle of the session the calling thread has started with
+ * cbm_session_begin(), if any: As long as the session lasts, the
+ * plugin of this handle is found without taking the lock.
+ */
+#ifdef _MSC_VER
+# define PLUGIN_THREAD_LOCAL __declspec(thread)
+#else
+# define PLUGIN_THREAD_LOCAL __thread
+#endif
+
+static PLUGIN_THREAD_LOCAL CBM_FILE               Plugin_session_handle;
+static PLUGIN_THREAD_LOCAL plugin_information_t * Plugin_session_plugin = NULL;
+static PLUGIN_THREAD_LOCAL unsigned int           Plugin_session_count  = 0;
+
+/*
+ * Counts the calls into the plugins. A status which has been read
+ * stays known as long as this has not changed, cf. cbm_device_status().
+ */
+#ifdef WIN32
+static LONG volatile Plugin_call_generation = 0;
+#else
+static long volatile Plugin_call_generation = 0;
+#endif
+
+#ifdef WIN32
+# define PLUGIN_CALL_COUNT() InterlockedIncrement((LONG *) &Plugin_call_generation)
+#else
+# define PLUGIN_CALL_COUNT() __sync_add_and_fetch(&Plugin_call_generation, 1)
+#endif
+
+/*! \internal \brief Get the plugin an open handle belongs to
+
+ \param HandleDevice
+   A CBM_FILE which contains the file handle of the driver.
+
+ \return
+   The plugin the handle has been opened with. For a handle
+   that is not known (for example, one that has not been
+   opened with cbm_driver_open()), the plugin loaded last.
+   This is never NULL.
+*/
+static plugin_information_t *
+plugin_of_handle(CBM_FILE HandleDevice)
+{
+    plugin_information_t * plugin = NULL;
+    unsigned int i;
+
+    PLUGIN_CALL_COUNT();
+
+    if (Plugin_session_plugin && Plugin_session_handle == HandleDevice) {
+        return Plugin_session_plugin;
+    }
+
+    plugin_lock();
+
+    for (i = 0; i < Plugin_handles_count; i++) {
+        if (Plugin_handles[i].HandleDevice == HandleDevice) {
+            plugin = Plugin_handles[i].Plugin;
+            break;
+        }
+    }
+
+    if (plugin == NULL) {
+        plugin = Plugin_last ? Plugin_last : &Plugin_none;
+    }
+
+    plugin_unlock();
+
+    return plugin;
+}
+
+/*! \brief The entry points of the plugin HandleDevice belongs to
+
+ Every use looks the handle up, so functions which need more
+ than one entry point keep the result in a local variable.
+*/
+#define PLUGIN(_handle) (plugin_of_handle(_handle)->Plugin)
+
+/*! \internal \brief Get the trace of the plugin an open handle belongs to
+
+ \param HandleDevice
+   A CBM_FILE which contains the file handle of the driver.
+
+ \return
+   The trace, or NULL if the calls into the plugin are not traced.
+*/
+cbm_trace_t *
+cbm_trace_of_handle(CBM_FILE HandleDevice)
+{
+    return plugin_of_handle(HandleDevice)->Trace;
+}
+
+/*! \internal \brief Get the replay of the plugin an open handle belongs to
+
+ \param HandleDevice
+   A CBM_FILE which contains the file handle of the driver.
+
+ \return
+   The replay, or NULL if the plugin itself is used.
+*/
+cbm_replay_t *
+cbm_replay_of_handle(CBM_FILE HandleDevice)
+{
+    return plugin_of_handle(HandleDevice)->Replay;
+}
+
+/*! \internal \brief Get a setting from the environment, or else from the section of the plugin
+
+ \return
+   The value, which has to be freed with cbmlibmisc_strfree(), or NULL
+   if it is not set.
+*/
+static char *
+plugin_get_setting(opencbm_configuration_handle Handle, const char *PluginName,
+                   const char *EnvironmentName, const char *EntryName)
+{
+    const char * env = getenv(EnvironmentName);
+    char * value = NULL;
+
+    if (env && env[0]) {
+        value = cbmlibmisc_strdup(env);
+    }
+    else if (opencbm_configuration_get_data(Handle, PluginName, EntryName, &value)) {
+        value = NULL;
+    }
+
+    if (value && value[0] == 0) {
+        cbmlibmisc_strfree(value);
+        value = NULL;
+    }
+
+    return value;
+}
+
+/*! \internal \brief Check if a setting is true (1, yes or true) */
+static int
+plugin_setting_is_true(const char *Value)
+{
+    return Value != NULL
+        && (  strtol(Value, NULL, 0) != 0
+           || arch_strcasecmp(Value, "yes") == 0
+           || arch_strcasecmp(Value, "true") == 0
+           );
+}
 
 struct plugin_read_pointer
 {
@@ -208,10 +426,18 @@ static struct plugin_read_pointer plugin_pointer_to_read_optional[] =
     PLUGIN_POINTER_DEF(opencbm_plugin_parallel_burst_write),
     PLUGIN_POINTER_DEF(opencbm_plugin_parallel_burst_read_track),
     PLUGIN_POINTER_DEF(opencbm_plugin_parallel_burst_write_track),
+    PLUGIN_POINTER_DEF(opencbm_plugin_parallel_burst_read_track_var),
+    PLUGIN_POINTER_DEF(opencbm_plugin_parallel_burst_read_n),
+    PLUGIN_POINTER_DEF(opencbm_plugin_parallel_burst_write_n),
     PLUGIN_POINTER_DEF(opencbm_plugin_pp_read),
     PLUGIN_POINTER_DEF(opencbm_plugin_pp_write),
     PLUGIN_POINTER_DEF(opencbm_plugin_get_list_of_configuration_parameter),
     PLUGIN_POINTER_DEF(opencbm_plugin_set_configuration_parameter),
+    PLUGIN_POINTER_DEF(opencbm_plugin_batch),
+    PLUGIN_POINTER_DEF(opencbm_plugin_iec_wait_timeout),
+    PLUGIN_POINTER_DEF(opencbm_plugin_iec_program),
+    PLUGIN_POINTER_DEF(opencbm_plugin_tap_capture),
+    PLUGIN_POINTER_DEF(opencbm_plugin_tap_write),
     PLUGIN_POINTER_END()
 };
 
@@ -258,6 +484,33 @@ static struct plugin_read_pointer plugin_pointer_to_read_tape[] =
     PLUGIN_POINTER_END()
 };
 
+static struct plugin_read_pointer plugin_pointer_to_read_deferred_status[] =
+{
+    PLUGIN_POINTER_DEF(opencbm_plugin_set_deferred_status),
+    PLUGIN_POINTER_DEF(opencbm_plugin_flush_deferred_status),
+    PLUGIN_POINTER_END()
+};
+
+static struct plugin_read_pointer plugin_pointer_to_read_raw_readv_writev[] =
+{
+    PLUGIN_POINTER_DEF(opencbm_plugin_raw_writev),
+    PLUGIN_POINTER_DEF(opencbm_plugin_raw_readv),
+    PLUGIN_POINTER_END()
+};
+
+static struct plugin_read_pointer plugin_pointer_to_read_memory[] =
+{
+    PLUGIN_POINTER_DEF(opencbm_plugin_memory_write),
+    PLUGIN_POINTER_DEF(opencbm_plugin_memory_read),
+    PLUGIN_POINTER_END()
+};
+
+static struct plugin_read_pointer plugin_pointer_to_read_code_upload[] =
+{
+    PLUGIN_POINTER_DEF(opencbm_plugin_code_upload),
+    PLUGIN_POINTER_END()
+};
+
 
 struct plugin_read_pointer_group
 {
@@ -277,6 +530,10 @@ static struct plugin_read_pointer_group read_pointer_group[] =
     { plugin_pointer_to_read_pp_readwrite, PRP_OPTIONAL_ALL_OR_NOTHING },
     { plugin_pointer_to_read_srq_burst, PRP_OPTIONAL_ALL_OR_NOTHING },
     { plugin_pointer_to_read_tape, PRP_OPTIONAL_ALL_OR_NOTHING },
+    { plugin_pointer_to_read_deferred_status, PRP_OPTIONAL_ALL_OR_NOTHING },
+    { plugin_pointer_to_read_raw_readv_writev, PRP_OPTIONAL_ALL_OR_NOTHING },
+    { plugin_pointer_to_read_memory, PRP_OPTIONAL_ALL_OR_NOTHING },
+    { plugin_pointer_to_read_code_upload, PRP_OPTIONAL },
     { NULL, PRP_OPTIONAL }
 };
 
@@ -470,6 +727,54 @@ static int initialize_plugin_configuration(char *plugin_name, plugin_information
     return error;
 }
 
+/*
+ * The parsed configuration file. Every plugin which is loaded needs it;
+ * instead of parsing the file again each time, it is kept, and only
+ * parsed again if the file has changed in the meantime, as told by
+ * its time stamp and size. This is protected by the plugin lock.
+ */
+static opencbm_configuration_handle Configuration_cache = NULL;
+static char *                       Configuration_cache_filename = NULL; /*!< \brief the file Configuration_cache has been parsed from */
+static struct stat                  Configuration_cache_stat;            /*!< \brief the state of that file when it was parsed */
+
+/*! \internal \brief Get the parsed configuration file
+
+ \param Filename
+   The name of the configuration file.
+
+ \return
+   The handle of the configuration file, or NULL if it cannot be
+   opened. It must not be closed, it stays valid until the next call.
+*/
+static opencbm_configuration_handle
+configuration_cache_open(const char *Filename)
+{
+    struct stat filestat;
+
+    if (stat(Filename, &filestat) != 0) {
+        memset(&filestat, 0, sizeof(filestat));
+    }
+
+    if (Configuration_cache != NULL
+        && strcmp(Configuration_cache_filename, Filename) == 0
+        && filestat.st_mtime == Configuration_cache_stat.st_mtime
+        && filestat.st_size == Configuration_cache_stat.st_size)
+    {
+        DBG_PRINT((DBG_PREFIX "Using the cached contents of config file '%s'.", Filename));
+        return Configuration_cache;
+    }
+
+    opencbm_configuration_close(Configuration_cache);
+    cbmlibmisc_strfree(Configuration_cache_filename);
+
+    Configuration_cache_filename = cbmlibmisc_strdup(Filename);
+    Configuration_cache = Configuration_cache_filename
+        ? opencbm_configuration_open(Filename) : NULL;
+    Configuration_cache_stat = filestat;
+
+    return Configuration_cache;
+}
+
 static int
 initialize_plugin_pointer(plugin_information_t *Plugin_information, const char * const Adapter)
 {
@@ -479,6 +784,9 @@ initialize_plugin_pointer(plugin_information_t *Plugin_information, const char *
 
     char * plugin_name = NULL;
     char * plugin_location = NULL;
+    char * trace_filename = NULL;
+    char * replay_filename = NULL;
+    char * replay_timing = NULL;
 
     opencbm_configuration_handle handle_configuration = NULL;
 
@@ -493,7 +801,7 @@ initialize_plugin_pointer(plugin_information_t *Plugin_information, const char *
             break;
         }
 
-        handle_configuration = opencbm_configuration_open(configurationFilename);
+        handle_configuration = configuration_cache_open(configurationFilename);
 
         if (handle_configuration)
         {
@@ -588,10 +896,47 @@ initialize_plugin_pointer(plugin_information_t *Plugin_information, const char *
                             plugin_location));
             }
         }
-    } while (0);
 
-    opencbm_configuration_close(handle_configuration);
+        //
+        // replay a recorded session instead of using the plugin if
+        // OPENCBM_REPLAY is set, or if there is a "replay" entry in
+        // the section of the plugin
+        //
+        if (!error) {
+            replay_filename = plugin_get_setting(handle_configuration, plugin_name,
+                "OPENCBM_REPLAY", "replay");
+            replay_timing = plugin_get_setting(handle_configuration, plugin_name,
+                "OPENCBM_REPLAY_TIMING", "replay-timing");
+
+            if (replay_filename) {
+                Plugin_information->Replay = cbm_replay_install(&Plugin_information->Plugin,
+                    replay_filename, plugin_setting_is_true(replay_timing));
+
+                /* do not silently fall back to the hardware */
+                if (Plugin_information->Replay == NULL) {
+                    error = 1;
+                }
+            }
+        }
+
+        //
+        // trace the calls into the plugin if OPENCBM_TRACE is set,
+        // or if there is a "trace" entry in the section of the plugin
+        //
+        if (!error) {
+            trace_filename = plugin_get_setting(handle_configuration, plugin_name,
+                "OPENCBM_TRACE", "trace");
+
+            if (trace_filename) {
+                Plugin_information->Trace = cbm_trace_install(&Plugin_information->Plugin,
+                    plugin_name, trace_filename);
+            }
+        }
+    } while (0);
 
+    cbmlibmisc_strfree(replay_timing);
+    cbmlibmisc_strfree(replay_filename);
+    cbmlibmisc_strfree(trace_filename);
     cbmlibmisc_strfree(plugin_name);
     cbmlibmisc_strfree(plugin_location);
     cbmlibmisc_strfree(configurationFilename);
@@ -600,47 +945,204 @@ initialize_plugin_pointer(plugin_information_t *Plugin_information, const char *
 }
 
 static void
-uninitialize_plugin(void)
+uninitialize_plugin(plugin_information_t *Plugin_information)
 {
     FUNC_ENTER();
 
-    if (Plugin_information.Library != NULL)
+    if (Plugin_information->Trace != NULL)
     {
-        if (Plugin_information.Plugin.opencbm_plugin_uninit) {
-            Plugin_information.Plugin.opencbm_plugin_uninit();
+        cbm_trace_uninstall(&Plugin_information->Plugin, Plugin_information->Trace);
+        Plugin_information->Trace = NULL;
+    }
+
+    if (Plugin_information->Replay != NULL)
+    {
+        cbm_replay_uninstall(&Plugin_information->Plugin, Plugin_information->Replay);
+        Plugin_information->Replay = NULL;
+    }
+
+    if (Plugin_information->Library != NULL)
+    {
+        if (Plugin_information->Plugin.opencbm_plugin_uninit) {
+            Plugin_information->Plugin.opencbm_plugin_uninit();
         }
 
-        plugin_unload(Plugin_information.Library);
+        plugin_unload(Plugin_information->Library);
 
-        Plugin_information.Library = NULL;
+        Plugin_information->Library = NULL;
     }
 
     FUNC_LEAVE();
 }
 
+/*! \internal \brief Compare two adapter names; NULL is the default adapter */
 static int
+plugin_name_equal(const char *Name1, const char *Name2)
+{
+    if (Name1 == NULL || Name2 == NULL) {
+        return Name1 == Name2;
+    }
+
+    return strcmp(Name1, Name2) == 0;
+}
+
+/*! \internal \brief Get a plugin, loading it if it is not loaded yet
+
+ \param Adapter
+   The name of the adapter, or NULL for the default one.
+
+ \return
+   The plugin, or NULL if it could not be loaded. Every plugin
+   returned has to be given back with release_plugin().
+*/
+static plugin_information_t *
 initialize_plugin(const char * const Adapter)
 {
-    /* if library is already opened and initialized correctly then
-       this function returns OK */
-    int error = 0;
+    plugin_information_t *plugin;
 
     FUNC_ENTER();
 
     FUNC_PARAM((DBG_PREFIX "Adapter = '%s' (%p)", Adapter ? Adapter : "(null)", Adapter));
 
-    /* init pointers if library was not yet opened */
-    if (Plugin_information.Library == NULL)
-    {
-        /* if pointer init failed then close library and make Library NULL */
-        error = initialize_plugin_pointer(&Plugin_information, Adapter);
-        if(error != 0)
-        {
-            uninitialize_plugin();
+    plugin_lock();
+
+    /* if the library is already opened and initialized correctly, just use it */
+    for (plugin = Plugin_list; plugin != NULL; plugin = plugin->Next) {
+        if (plugin_name_equal(plugin->Name, Adapter)) {
+            break;
         }
     }
 
-    FUNC_LEAVE_INT(error);
+    if (plugin == NULL) {
+        plugin = calloc(1, sizeof *plugin);
+
+        if (plugin != NULL) {
+            plugin->Name = Adapter ? cbmlibmisc_strdup(Adapter) : NULL;
+
+            /* if pointer init failed then close library and forget about it */
+            if ((Adapter && plugin->Name == NULL)
+                || initialize_plugin_pointer(plugin, Adapter) != 0)
+            {
+                uninitialize_plugin(plugin);
+                cbmlibmisc_strfree(plugin->Name);
+                free(plugin);
+                plugin = NULL;
+            }
+            else {
+                plugin->Next = Plugin_list;
+                Plugin_list = plugin;
+            }
+        }
+    }
+
+    if (plugin != NULL) {
+        ++plugin->ReferenceCount;
+        Plugin_last = plugin;
+    }
+
+    plugin_unlock();
+
+    FUNC_LEAVE_PTR(plugin, plugin_information_t *);
+}
+
+/*! \internal \brief Give back a plugin got from initialize_plugin()
+
+ The plugin is unloaded when its last user gives it back.
+
+ \param Plugin_information
+   The plugin to give back.
+*/
+static void
+release_plugin(plugin_information_t *Plugin_information)
+{
+    FUNC_ENTER();
+
+    plugin_lock();
+
+    if (--Plugin_information->ReferenceCount == 0) {
+        plugin_information_t **pp;
+
+        for (pp = &Plugin_list; *pp != NULL; pp = &(*pp)->Next) {
+            if (*pp == Plugin_information) {
+                *pp = Plugin_information->Next;
+                break;
+            }
+        }
+
+        if (Plugin_last == Plugin_information) {
+            Plugin_last = Plugin_list;
+        }
+
+        uninitialize_plugin(Plugin_information);
+        cbmlibmisc_strfree(Plugin_information->Name);
+        free(Plugin_information);
+    }
+
+    plugin_unlock();
+
+    FUNC_LEAVE();
+}
+
+/*! \internal \brief Remember the plugin an open handle belongs to
+
+ \return
+   0 on success, 1 if there is not enough memory.
+*/
+static int
+plugin_handle_add(CBM_FILE HandleDevice, plugin_information_t *Plugin_information)
+{
+    int error = 0;
+
+    plugin_lock();
+
+    if (Plugin_handles_count == Plugin_handles_size) {
+        unsigned int size = Plugin_handles_size ? 2 * Plugin_handles_size : 4;
+        plugin_handle_t *handles = realloc(Plugin_handles, size * sizeof *handles);
+
+        if (handles == NULL) {
+            error = 1;
+        }
+        else {
+            Plugin_handles = handles;
+            Plugin_handles_size = size;
+        }
+    }
+
+    if (!error) {
+        Plugin_handles[Plugin_handles_count].HandleDevice = HandleDevice;
+        Plugin_handles[Plugin_handles_count].Plugin = Plugin_information;
+        ++Plugin_handles_count;
+    }
+
+    plugin_unlock();
+
+    return error;
+}
+
+/*! \internal \brief Forget the plugin of a handle that is being closed
+
+ \return
+   The plugin the handle belonged to, or NULL if it was not known.
+*/
+static plugin_information_t *
+plugin_handle_remove(CBM_FILE HandleDevice)
+{
+    plugin_information_t *plugin = NULL;
+    unsigned int i;
+
+    plugin_lock();
+
+    for (i = 0; i < Plugin_handles_count; i++) {
+        if (Plugin_handles[i].HandleDevice == HandleDevice) {
+            plugin = Plugin_handles[i].Plugin;
+            Plugin_handles[i] = Plugin_handles[--Plugin_handles_count];
+            break;
+        }
+    }
+
+    plugin_unlock();
+
+    return plugin;
 }
 
 /** @} */
@@ -735,13 +1237,11 @@ cbm_split_adapter_in_name_and_port(char * Adapter, char ** Port)
 const char * CBMAPIDECL
 cbm_get_driver_name_ex(char * Adapter)
 {
-    const char *ret = NULL;
-
     static const char * buffer = NULL;
     char *adapter_stripped = NULL;
     char *port = NULL;
 
-    int error;
+    plugin_information_t *plugin;
 
     FUNC_ENTER();
 
@@ -763,17 +1263,16 @@ cbm_get_driver_name_ex(char * Adapter)
             Adapter, adapter_stripped, port));
     }
 
-    error = initialize_plugin(adapter_stripped);
+    plugin = initialize_plugin(adapter_stripped);
 
-    if (error == 0) {
-        ret = Plugin_information.Plugin.opencbm_plugin_get_driver_name(port);
+    if (plugin != NULL) {
+        buffer = cbmlibmisc_strdup(plugin->Plugin.opencbm_plugin_get_driver_name(port));
+        release_plugin(plugin);
     }
     else {
-        ret = "NO PLUGIN DRIVER!";
+        buffer = cbmlibmisc_strdup("NO PLUGIN DRIVER!");
     }
 
-    buffer = cbmlibmisc_strdup(ret);
-
     cbmlibmisc_strfree(adapter_stripped);
     cbmlibmisc_strfree(port);
 
@@ -842,6 +1341,7 @@ cbm_driver_open_ex(CBM_FILE *HandleDevice, char * Adapter)
     int error;
     char * port = NULL;
     char * adapter_stripped = NULL;
+    plugin_information_t *plugin;
 
     FUNC_ENTER();
 
@@ -857,12 +1357,24 @@ cbm_driver_open_ex(CBM_FILE *HandleDevice, char * Adapter)
             Adapter, adapter_stripped, port));
     }
 
-    error = initialize_plugin(adapter_stripped);
+    plugin = initialize_plugin(adapter_stripped);
 
     cbmlibmisc_strfree(adapter_stripped);
 
-    if (error == 0) {
-        error = Plugin_information.Plugin.opencbm_plugin_driver_open(HandleDevice, port);
+    if (plugin == NULL) {
+        error = 1;
+    }
+    else {
+        error = plugin->Plugin.opencbm_plugin_driver_open(HandleDevice, port);
+
+        if (error == 0 && plugin_handle_add(*HandleDevice, plugin) != 0) {
+            plugin->Plugin.opencbm_plugin_driver_close(*HandleDevice);
+            error = 1;
+        }
+
+        if (error != 0) {
+            release_plugin(plugin);
+        }
     }
 
     cbmlibmisc_strfree(port);
@@ -928,13 +1440,32 @@ cbm_driver_open(CBM_FILE *HandleDevice, int PortNumber)
 void CBMAPIDECL
 cbm_driver_close(CBM_FILE HandleDevice)
 {
+    plugin_information_t *plugin;
+
     FUNC_ENTER();
 
     FUNC_PARAM((DBG_PREFIX "HandleDevice = %p", HandleDevice));
 
-    Plugin_information.Plugin.opencbm_plugin_driver_close(HandleDevice);
+    cbm_async_uninit(HandleDevice);
+
+    cbm_identify_cache_flush(HandleDevice);
+    cbm_upload_cache_flush(HandleDevice);
+    cbm_dos_dir_cache_flush(HandleDevice);
+
+    /* a new handle might get the same value: forget its statuses */
+    PLUGIN_CALL_COUNT();
+
+    if (Plugin_session_plugin && Plugin_session_handle == HandleDevice) {
+        Plugin_session_plugin = NULL;
+        Plugin_session_count = 0;
+    }
+
+    plugin = plugin_handle_remove(HandleDevice);
 
-    uninitialize_plugin();
+    if (plugin != NULL) {
+        plugin->Plugin.opencbm_plugin_driver_close(HandleDevice);
+        release_plugin(plugin);
+    }
 
     FUNC_LEAVE();
 }
@@ -966,12 +1497,14 @@ cbm_driver_close(CBM_FILE HandleDevice)
 void CBMAPIDECL
 cbm_lock(CBM_FILE HandleDevice)
 {
+    opencbm_plugin_t *plugin = &PLUGIN(HandleDevice);
+
     FUNC_ENTER();
 
     FUNC_PARAM((DBG_PREFIX "HandleDevice = %p", HandleDevice));
 
-    if (Plugin_information.Plugin.opencbm_plugin_lock)
-        Plugin_information.Plugin.opencbm_plugin_lock(HandleDevice);
+    if (plugin->opencbm_plugin_lock)
+        plugin->opencbm_plugin_lock(HandleDevice);
 
     FUNC_LEAVE();
 }
@@ -996,27 +1529,122 @@ cbm_lock(CBM_FILE HandleDevice)
 void CBMAPIDECL
 cbm_unlock(CBM_FILE HandleDevice)
 {
+    opencbm_plugin_t *plugin = &PLUGIN(HandleDevice);
+
     FUNC_ENTER();
 
     FUNC_PARAM((DBG_PREFIX "HandleDevice = %p", HandleDevice));
 
-    if (Plugin_information.Plugin.opencbm_plugin_unlock)
-        Plugin_information.Plugin.opencbm_plugin_unlock(HandleDevice);
+    if (plugin->opencbm_plugin_unlock)
+        plugin->opencbm_plugin_unlock(HandleDevice);
 
     FUNC_LEAVE();
 }
 
-/*-------------------------------------------------------------------*/
-/*--------- BASIC I/O -----------------------------------------------*/
+/*! \brief Start a session on a handle
 
-/*! \brief Write data to the IEC serial bus
+ This function starts a session of the calling thread on the
+ handle: It locks the driver onto the port (cf. cbm_lock()),
+ and until the session is ended, the calls with this handle
+ from this thread do not need to look up the handle again.
 
- This function sends data after a cbm_listen().
+ A program which does many small operations should put them
+ into a session.
 
  \param HandleDevice
    A CBM_FILE which contains the file handle of the driver.
 
- \param Buffer
+ \return
+   0 on success; -1 if the handle is not open, or if the
+   thread already has a session on another handle.
+
+ \remark
+ Every successful call must be balanced by a call to
+ cbm_session_end(). Sessions on the same handle can be nested.
+ While the session lasts, the handle must not be closed by
+ another thread; closing it in the same thread ends the session.
+*/
+
+int CBMAPIDECL
+cbm_session_begin(CBM_FILE HandleDevice)
+{
+    plugin_information_t * plugin = NULL;
+    unsigned int i;
+
+    FUNC_ENTER();
+
+    FUNC_PARAM((DBG_PREFIX "HandleDevice = %p", HandleDevice));
+
+    if (Plugin_session_plugin) {
+        if (Plugin_session_handle != HandleDevice) {
+            FUNC_LEAVE_INT(-1);
+        }
+        ++Plugin_session_count;
+        FUNC_LEAVE_INT(0);
+    }
+
+    plugin_lock();
+
+    for (i = 0; i < Plugin_handles_count; i++) {
+        if (Plugin_handles[i].HandleDevice == HandleDevice) {
+            plugin = Plugin_handles[i].Plugin;
+            break;
+        }
+    }
+
+    plugin_unlock();
+
+    if (plugin == NULL) {
+        FUNC_LEAVE_INT(-1);
+    }
+
+    cbm_lock(HandleDevice);
+
+    Plugin_session_handle = HandleDevice;
+    Plugin_session_plugin = plugin;
+    Plugin_session_count  = 1;
+
+    FUNC_LEAVE_INT(0);
+}
+
+/*! \brief End a session on a handle
+
+ This function ends a session which has been started with
+ cbm_session_begin(). When the outermost session ends, the
+ driver is unlocked from the port (cf. cbm_unlock()).
+
+ \param HandleDevice
+   A CBM_FILE which contains the file handle of the driver.
+*/
+
+void CBMAPIDECL
+cbm_session_end(CBM_FILE HandleDevice)
+{
+    FUNC_ENTER();
+
+    FUNC_PARAM((DBG_PREFIX "HandleDevice = %p", HandleDevice));
+
+    if (Plugin_session_plugin && Plugin_session_handle == HandleDevice) {
+        if (--Plugin_session_count == 0) {
+            cbm_unlock(HandleDevice);
+            Plugin_session_plugin = NULL;
+        }
+    }
+
+    FUNC_LEAVE();
+}
+
+/*-------------------------------------------------------------------*/
+/*--------- BASIC I/O -----------------------------------------------*/
+
+/*! \brief Write data to the IEC serial bus
+
+ This function sends data after a cbm_listen().
+
+ \param HandleDevice
+   A CBM_FILE which contains the file handle of the driver.
+
+ \param Buffer
    Pointer to a buffer which hold the bytes to write to the bus.
 
  \param Count
@@ -1044,7 +1672,7 @@ cbm_raw_write(CBM_FILE HandleDevice, const void *Buffer, size_t Count)
     DBG_MEMDUMP("cbm_raw_write", Buffer, Count);
 #endif
 
-    FUNC_LEAVE_INT(Plugin_information.Plugin.opencbm_plugin_raw_write(HandleDevice,Buffer, Count));
+    FUNC_LEAVE_INT(PLUGIN(HandleDevice).opencbm_plugin_raw_write(HandleDevice,Buffer, Count));
 }
 
 
@@ -1080,7 +1708,7 @@ cbm_raw_read(CBM_FILE HandleDevice, void *Buffer, size_t Count)
 
     FUNC_PARAM((DBG_PREFIX "HandleDevice = %p, Buffer = %p, Count = %u", HandleDevice, Buffer, (int)Count));
 
-    bytesRead = Plugin_information.Plugin.opencbm_plugin_raw_read(HandleDevice, Buffer, Count);
+    bytesRead = PLUGIN(HandleDevice).opencbm_plugin_raw_read(HandleDevice, Buffer, Count);
 
 #ifdef DBG_DUMP_RAW_READ
     DBG_MEMDUMP("cbm_raw_read", Buffer, bytesRead);
@@ -1089,6 +1717,124 @@ cbm_raw_read(CBM_FILE HandleDevice, void *Buffer, size_t Count)
     FUNC_LEAVE_INT(bytesRead);
 }
 
+/*! \brief Write data from several buffers to the IEC serial bus
+
+ This function sends data after a cbm_listen(), taking it from
+ the buffers one after the other. It behaves like a cbm_raw_write()
+ of all buffers concatenated, but without the need to copy them
+ together first.
+
+ \param HandleDevice
+   A CBM_FILE which contains the file handle of the driver.
+
+ \param Iov
+   Pointer to an array of buffers which hold the bytes to write.
+
+ \param IovCount
+   The number of entries in the Iov array.
+
+ \return
+   >= 0: The actual number of bytes written.
+   <0  indicates an error.
+
+ This function tries to write all bytes. Anyway, if an error
+ occurs, this function can stop prematurely.
+
+ If cbm_driver_open() did not succeed, it is illegal to
+ call this function.
+*/
+
+int CBMAPIDECL
+cbm_raw_writev(CBM_FILE HandleDevice, const cbm_iovec_t *Iov, unsigned int IovCount)
+{
+    opencbm_plugin_t *plugin = &PLUGIN(HandleDevice);
+    int bytesWritten = 0;
+    unsigned int i;
+
+    FUNC_ENTER();
+
+    FUNC_PARAM((DBG_PREFIX "HandleDevice = %p, Iov = %p, IovCount = %u", HandleDevice, Iov, IovCount));
+
+    if (plugin->opencbm_plugin_raw_writev) {
+        bytesWritten = plugin->opencbm_plugin_raw_writev(HandleDevice, Iov, IovCount);
+    }
+    else {
+        for (i = 0; i < IovCount; i++) {
+            int rv = cbm_raw_write(HandleDevice, Iov[i].iov_base, Iov[i].iov_len);
+
+            if (rv < 0) {
+                if (bytesWritten == 0)
+                    bytesWritten = rv;
+                break;
+            }
+            bytesWritten += rv;
+            if ((size_t) rv != Iov[i].iov_len)
+                break;
+        }
+    }
+
+    FUNC_LEAVE_INT(bytesWritten);
+}
+
+/*! \brief Read data from the IEC serial bus into several buffers
+
+ This function retrieves data after a cbm_talk(), filling the
+ buffers one after the other. It behaves like a cbm_raw_read()
+ into one buffer which is split up afterwards, but the data is
+ read into its final place directly.
+
+ \param HandleDevice
+   A CBM_FILE which contains the file handle of the driver.
+
+ \param Iov
+   Pointer to an array of buffers which will hold the bytes read.
+
+ \param IovCount
+   The number of entries in the Iov array.
+
+ \return
+   >= 0: The actual number of bytes read.
+   <0  indicates an error.
+
+ At most the sum of the sizes of all buffers is read. If less
+ bytes are read, the remaining buffers are left untouched.
+
+ If cbm_driver_open() did not succeed, it is illegal to
+ call this function.
+*/
+
+int CBMAPIDECL
+cbm_raw_readv(CBM_FILE HandleDevice, const cbm_iovec_t *Iov, unsigned int IovCount)
+{
+    opencbm_plugin_t *plugin = &PLUGIN(HandleDevice);
+    int bytesRead = 0;
+    unsigned int i;
+
+    FUNC_ENTER();
+
+    FUNC_PARAM((DBG_PREFIX "HandleDevice = %p, Iov = %p, IovCount = %u", HandleDevice, Iov, IovCount));
+
+    if (plugin->opencbm_plugin_raw_readv) {
+        bytesRead = plugin->opencbm_plugin_raw_readv(HandleDevice, Iov, IovCount);
+    }
+    else {
+        for (i = 0; i < IovCount; i++) {
+            int rv = cbm_raw_read(HandleDevice, Iov[i].iov_base, Iov[i].iov_len);
+
+            if (rv < 0) {
+                if (bytesRead == 0)
+                    bytesRead = rv;
+                break;
+            }
+            bytesRead += rv;
+            if ((size_t) rv != Iov[i].iov_len)
+                break;
+        }
+    }
+
+    FUNC_LEAVE_INT(bytesRead);
+}
+
 /*! \brief Send a LISTEN on the IEC serial bus
 
  This function sends a LISTEN on the IEC serial bus.
@@ -1119,7 +1865,7 @@ cbm_listen(CBM_FILE HandleDevice, unsigned char DeviceAddress, unsigned char Sec
 
     FUNC_PARAM((DBG_PREFIX "HandleDevice = %p, DeviceAddress = %02X, SecondaryAddress = %02X", HandleDevice, DeviceAddress, SecondaryAddress));
 
-    FUNC_LEAVE_INT(Plugin_information.Plugin.opencbm_plugin_listen(HandleDevice, DeviceAddress, SecondaryAddress));
+    FUNC_LEAVE_INT(PLUGIN(HandleDevice).opencbm_plugin_listen(HandleDevice, DeviceAddress, SecondaryAddress));
 }
 
 /*! \brief Send a TALK on the IEC serial bus
@@ -1152,7 +1898,7 @@ cbm_talk(CBM_FILE HandleDevice, unsigned char DeviceAddress, unsigned char Secon
 
     FUNC_PARAM((DBG_PREFIX "HandleDevice = %p, DeviceAddress = %02X, SecondaryAddress = %02X", HandleDevice, DeviceAddress, SecondaryAddress));
 
-    FUNC_LEAVE_INT(Plugin_information.Plugin.opencbm_plugin_talk(HandleDevice, DeviceAddress, SecondaryAddress));
+    FUNC_LEAVE_INT(PLUGIN(HandleDevice).opencbm_plugin_talk(HandleDevice, DeviceAddress, SecondaryAddress));
 }
 
 /*! \brief Open a file on the IEC serial bus
@@ -1197,7 +1943,12 @@ cbm_open(CBM_FILE HandleDevice, unsigned char DeviceAddress, unsigned char Secon
                 Filename ? Filename : "(null)", Filename,
                 FilenameLength));
 
-    returnValue = Plugin_information.Plugin.opencbm_plugin_open(HandleDevice, DeviceAddress, SecondaryAddress);
+    /* a file other than a direct access channel or the directory might change the disk */
+    if (Filename == NULL || (*(const char *) Filename != '#' && *(const char *) Filename != '$')) {
+        cbm_dos_dir_cache_invalidate(HandleDevice, DeviceAddress);
+    }
+
+    returnValue = PLUGIN(HandleDevice).opencbm_plugin_open(HandleDevice, DeviceAddress, SecondaryAddress);
 
     if (returnValue == 0)
     {
@@ -1257,7 +2008,7 @@ cbm_close(CBM_FILE HandleDevice, unsigned char DeviceAddress, unsigned char Seco
     FUNC_PARAM((DBG_PREFIX "HandleDevice = %p, DeviceAddress = %02X, SecondaryAddress = %02X",
                 HandleDevice, DeviceAddress, SecondaryAddress));
 
-    FUNC_LEAVE_INT(Plugin_information.Plugin.opencbm_plugin_close(HandleDevice, DeviceAddress, SecondaryAddress));
+    FUNC_LEAVE_INT(PLUGIN(HandleDevice).opencbm_plugin_close(HandleDevice, DeviceAddress, SecondaryAddress));
 }
 
 /*! \brief Send an UNLISTEN on the IEC serial bus
@@ -1287,7 +2038,7 @@ cbm_unlisten(CBM_FILE HandleDevice)
 
     FUNC_PARAM((DBG_PREFIX "HandleDevice = %p", HandleDevice));
 
-    FUNC_LEAVE_INT(Plugin_information.Plugin.opencbm_plugin_unlisten(HandleDevice));
+    FUNC_LEAVE_INT(PLUGIN(HandleDevice).opencbm_plugin_unlisten(HandleDevice));
 }
 
 /*! \brief Send an UNTALK on the IEC serial bus
@@ -1317,7 +2068,7 @@ cbm_untalk(CBM_FILE HandleDevice)
 
     FUNC_PARAM((DBG_PREFIX "HandleDevice = %p", HandleDevice));
 
-    FUNC_LEAVE_INT(Plugin_information.Plugin.opencbm_plugin_untalk(HandleDevice));
+    FUNC_LEAVE_INT(PLUGIN(HandleDevice).opencbm_plugin_untalk(HandleDevice));
 }
 
 
@@ -1348,7 +2099,7 @@ cbm_get_eoi(CBM_FILE HandleDevice)
 
     FUNC_PARAM((DBG_PREFIX "HandleDevice = %p", HandleDevice));
 
-    FUNC_LEAVE_INT(Plugin_information.Plugin.opencbm_plugin_get_eoi(HandleDevice));
+    FUNC_LEAVE_INT(PLUGIN(HandleDevice).opencbm_plugin_get_eoi(HandleDevice));
 }
 
 /*! \brief Reset the EOI flag
@@ -1373,7 +2124,7 @@ cbm_clear_eoi(CBM_FILE HandleDevice)
 
     FUNC_PARAM((DBG_PREFIX "HandleDevice = %p", HandleDevice));
 
-    FUNC_LEAVE_INT(Plugin_information.Plugin.opencbm_plugin_clear_eoi(HandleDevice));
+    FUNC_LEAVE_INT(PLUGIN(HandleDevice).opencbm_plugin_clear_eoi(HandleDevice));
 }
 
 /*! \brief RESET all devices
@@ -1404,7 +2155,11 @@ cbm_reset(CBM_FILE HandleDevice)
 
     FUNC_PARAM((DBG_PREFIX "HandleDevice = %p", HandleDevice));
 
-    FUNC_LEAVE_INT(Plugin_information.Plugin.opencbm_plugin_reset(HandleDevice));
+    cbm_identify_cache_flush(HandleDevice);
+    cbm_upload_cache_flush(HandleDevice);
+    cbm_dos_dir_cache_flush(HandleDevice);
+
+    FUNC_LEAVE_INT(PLUGIN(HandleDevice).opencbm_plugin_reset(HandleDevice));
 }
 
 
@@ -1437,14 +2192,15 @@ cbm_reset(CBM_FILE HandleDevice)
 unsigned char CBMAPIDECL
 cbm_pp_read(CBM_FILE HandleDevice)
 {
+    opencbm_plugin_t *plugin = &PLUGIN(HandleDevice);
     unsigned char ret = -1;
 
     FUNC_ENTER();
 
     FUNC_PARAM((DBG_PREFIX "HandleDevice = %p", HandleDevice));
 
-    if (Plugin_information.Plugin.opencbm_plugin_pp_read)
-        ret = Plugin_information.Plugin.opencbm_plugin_pp_read(HandleDevice);
+    if (plugin->opencbm_plugin_pp_read)
+        ret = plugin->opencbm_plugin_pp_read(HandleDevice);
 
     FUNC_LEAVE_UCHAR(ret);
 }
@@ -1477,12 +2233,14 @@ cbm_pp_read(CBM_FILE HandleDevice)
 void CBMAPIDECL
 cbm_pp_write(CBM_FILE HandleDevice, unsigned char Byte)
 {
+    opencbm_plugin_t *plugin = &PLUGIN(HandleDevice);
+
     FUNC_ENTER();
 
     FUNC_PARAM((DBG_PREFIX "HandleDevice = %p, Byte = %02X", HandleDevice, Byte));
 
-    if (Plugin_information.Plugin.opencbm_plugin_pp_write)
-        Plugin_information.Plugin.opencbm_plugin_pp_write(HandleDevice, Byte);
+    if (plugin->opencbm_plugin_pp_write)
+        plugin->opencbm_plugin_pp_write(HandleDevice, Byte);
 
     FUNC_LEAVE();
 }
@@ -1515,7 +2273,7 @@ cbm_iec_poll(CBM_FILE HandleDevice)
 
     FUNC_PARAM((DBG_PREFIX "HandleDevice = %p", HandleDevice));
 
-    FUNC_LEAVE_INT(Plugin_information.Plugin.opencbm_plugin_iec_poll(HandleDevice));
+    FUNC_LEAVE_INT(PLUGIN(HandleDevice).opencbm_plugin_iec_poll(HandleDevice));
 }
 
 
@@ -1540,14 +2298,16 @@ cbm_iec_poll(CBM_FILE HandleDevice)
 void CBMAPIDECL
 cbm_iec_set(CBM_FILE HandleDevice, int Line)
 {
+    opencbm_plugin_t *plugin = &PLUGIN(HandleDevice);
+
     FUNC_ENTER();
 
     FUNC_PARAM((DBG_PREFIX "HandleDevice = %p, Line = %02X", HandleDevice, Line));
 
-    if (Plugin_information.Plugin.opencbm_plugin_iec_set)
-        Plugin_information.Plugin.opencbm_plugin_iec_set(HandleDevice, Line);
+    if (plugin->opencbm_plugin_iec_set)
+        plugin->opencbm_plugin_iec_set(HandleDevice, Line);
     else
-        Plugin_information.Plugin.opencbm_plugin_iec_setrelease(HandleDevice, Line, 0);
+        plugin->opencbm_plugin_iec_setrelease(HandleDevice, Line, 0);
 
     FUNC_LEAVE();
 }
@@ -1573,14 +2333,16 @@ cbm_iec_set(CBM_FILE HandleDevice, int Line)
 void CBMAPIDECL
 cbm_iec_release(CBM_FILE HandleDevice, int Line)
 {
+    opencbm_plugin_t *plugin = &PLUGIN(HandleDevice);
+
     FUNC_ENTER();
 
     FUNC_PARAM((DBG_PREFIX "HandleDevice = %p, Line = %02X", HandleDevice, Line));
 
-    if (Plugin_information.Plugin.opencbm_plugin_iec_release)
-        Plugin_information.Plugin.opencbm_plugin_iec_release(HandleDevice, Line);
+    if (plugin->opencbm_plugin_iec_release)
+        plugin->opencbm_plugin_iec_release(HandleDevice, Line);
     else
-        Plugin_information.Plugin.opencbm_plugin_iec_setrelease(HandleDevice, 0, Line);
+        plugin->opencbm_plugin_iec_setrelease(HandleDevice, 0, Line);
 
     FUNC_LEAVE();
 }
@@ -1619,7 +2381,7 @@ cbm_iec_setrelease(CBM_FILE HandleDevice, int Set, int Release)
 
     FUNC_PARAM((DBG_PREFIX "HandleDevice = %p, Set = %02X, Release = %02X", HandleDevice, Set, Release));
 
-    Plugin_information.Plugin.opencbm_plugin_iec_setrelease(HandleDevice, Set, Release);
+    PLUGIN(HandleDevice).opencbm_plugin_iec_setrelease(HandleDevice, Set, Release);
 
     FUNC_LEAVE();
 }
@@ -1657,126 +2419,504 @@ cbm_iec_wait(CBM_FILE HandleDevice, int Line, int State)
 
     FUNC_PARAM((DBG_PREFIX "HandleDevice = %p, Line = %02X, State = %02X", HandleDevice, Line, State));
 
-    FUNC_LEAVE_INT(Plugin_information.Plugin.opencbm_plugin_iec_wait(HandleDevice, Line, State));
+    FUNC_LEAVE_INT(PLUGIN(HandleDevice).opencbm_plugin_iec_wait(HandleDevice, Line, State));
 }
 
-/*! \brief Get the (logical) state of a line on the IEC serial bus
+/*! The longest sleep between two polls of cbm_iec_wait_timeout(), in us */
+#define CBM_IEC_WAIT_MAX_SLEEP_US 1000
 
- This function gets the (logical) state of a line on the IEC serial bus.
+/*! \brief Wait for a line to have a specific state, with a timeout
+
+ This function waits for a line to enter a specific state
+ on the IEC serial bus, but gives up after the given time.
+
+ If the plugin can wait on the adapter itself, this is a single
+ request. Otherwise, the bus is polled with cbm_iec_poll(), sleeping
+ in between with a delay that doubles up to 1 ms. Thus, the host CPU
+ is not kept busy even for long waits, while short waits still return
+ quickly.
 
  \param HandleDevice
    A CBM_FILE which contains the file handle of the driver.
 
  \param Line
-   The line to be tested. This must be exactly one of
+   The line to be waited for. This must be exactly one of
    IEC_DATA, IEC_CLOCK, IEC_ATN, and IEC_RESET.
 
+ \param State
+   If zero, then wait for this line to be deactivated. \n
+   If not zero, then wait for this line to be activated.
+
+ \param TimeoutMs
+   The time to wait at most, in milliseconds. 0 waits forever, like
+   cbm_iec_wait(). The timeout is a lower bound; the function may
+   return somewhat later.
+
  \return
-   1 if the line is set, 0 if it is not
+   The state of the IEC bus on return (like cbm_iec_poll), or -1 if
+   the line did not reach the state in time.
 
  If cbm_driver_open() did not succeed, it is illegal to
  call this function.
-
- \bug
-   This function can't signal an error, thus, be careful!
 */
 
 int CBMAPIDECL
-cbm_iec_get(CBM_FILE HandleDevice, int Line)
+cbm_iec_wait_timeout(CBM_FILE HandleDevice, int Line, int State, unsigned int TimeoutMs)
 {
+    opencbm_plugin_t *plugin = &PLUGIN(HandleDevice);
+    unsigned int sleep_us = 10;
+    unsigned long waited_us = 0;
+    int rv;
+
     FUNC_ENTER();
 
-    FUNC_PARAM((DBG_PREFIX "HandleDevice = %p, Line = %02X", HandleDevice, Line));
+    FUNC_PARAM((DBG_PREFIX "HandleDevice = %p, Line = %02X, State = %02X, TimeoutMs = %u", HandleDevice, Line, State, TimeoutMs));
+
+    if (TimeoutMs == 0)
+        FUNC_LEAVE_INT(plugin->opencbm_plugin_iec_wait(HandleDevice, Line, State));
+
+    if (plugin->opencbm_plugin_iec_wait_timeout) {
+        rv = plugin->opencbm_plugin_iec_wait_timeout(HandleDevice, Line, State, TimeoutMs);
+        if (rv != -2)
+            FUNC_LEAVE_INT(rv);
+    }
+
+    for (;;) {
+        rv = plugin->opencbm_plugin_iec_poll(HandleDevice);
+        if (((rv & Line) != 0) == (State != 0))
+            break;
+
+        if (waited_us >= (unsigned long) TimeoutMs * 1000) {
+            rv = -1;
+            break;
+        }
+
+        arch_sleep_us(sleep_us);
+        waited_us += sleep_us;
+        if (sleep_us < CBM_IEC_WAIT_MAX_SLEEP_US)
+            sleep_us = (sleep_us * 2 > CBM_IEC_WAIT_MAX_SLEEP_US) ? CBM_IEC_WAIT_MAX_SLEEP_US : sleep_us * 2;
+    }
 
-    FUNC_LEAVE_INT((Plugin_information.Plugin.opencbm_plugin_iec_poll(HandleDevice)&Line) != 0 ? 1 : 0);
+    FUNC_LEAVE_INT(rv);
 }
 
-/** @} */
+/*! \internal \brief Check if a program for cbm_iec_program() can be run
 
-/*-------------------------------------------------------------------*/
-/*--------- HELPER FUNCTIONS ----------------------------------------*/
+ \return
+   1 if all operations are known and have valid arguments, else 0.
+*/
+static int
+cbm_iec_program_valid(CBM_FILE HandleDevice, const unsigned char *Program, unsigned int Length)
+{
+    opencbm_plugin_t *plugin = &PLUGIN(HandleDevice);
+    const unsigned char lines = IEC_DATA | IEC_CLOCK | IEC_ATN | IEC_RESET;
+    unsigned int i;
 
-/** @{ @ingroup opencbm_dos
- */
+    if (Length & 1)
+        return 0;
 
-/*! \brief Read the drive status from a floppy
+    for (i = 0; i < Length; i += 2) {
+        switch (Program[i]) {
+        case CBM_IEC_PROG_SET:
+        case CBM_IEC_PROG_RELEASE:
+            if (Program[i + 1] & ~lines)
+                return 0;
+            break;
+        case CBM_IEC_PROG_WAIT_SET:
+        case CBM_IEC_PROG_WAIT_RELEASE:
+            if (Program[i + 1] != IEC_DATA && Program[i + 1] != IEC_CLOCK && Program[i + 1] != IEC_ATN)
+                return 0;
+            break;
+        case CBM_IEC_PROG_PP_READ:
+            if (plugin->opencbm_plugin_pp_read == NULL)
+                return 0;
+            break;
+        case CBM_IEC_PROG_PP_WRITE:
+            if (plugin->opencbm_plugin_pp_write == NULL)
+                return 0;
+            break;
+        case CBM_IEC_PROG_SETRELEASE:
+        case CBM_IEC_PROG_POLL:
+        case CBM_IEC_PROG_DELAY:
+            break;
+        default:
+            return 0;
+        }
+    }
+    return 1;
+}
 
- This function reads the drive status of a connected
- floppy drive.
+/*! \brief Run a sequence of IEC line operations
+
+ This function runs a program of line operations on the IEC serial
+ bus. Each operation is a pair of bytes: one of the CBM_IEC_PROG_*
+ opcodes, followed by its argument. The results of CBM_IEC_PROG_POLL
+ and CBM_IEC_PROG_PP_READ replace their argument in Program.
+
+ If the plugin can run the program on its own (like the Linux and
+ Windows drivers of the XA1541/XM1541 cables do in the kernel), this
+ is a single request, and the operations follow each other without
+ the latency of one call per line change. Otherwise, every operation is done
+ with the corresponding cbm_iec_*() or cbm_pp_*() function.
 
  \param HandleDevice
    A CBM_FILE which contains the file handle of the driver.
 
- \param DeviceAddress
-   The address of the device on the IEC serial bus. This
-   is known as primary address, too.
-
- \param Buffer
-   Pointer to a buffer which will hold the drive's status after
-   successfull calling,
+ \param Program
+   The program, which is changed in place as described above.
 
- \param BufferLength
-   The length of the buffer pointed to by Buffer in bytes.
+ \param Length
+   The length of Program in bytes, which must be even.
 
  \return
-   Returns the int representation of the drive status,
-   that is, the numerical value of the first return
-   value from the drive. This is the error number.
-
- This function will never write more than BufferLength bytes.
- Nevertheless, the buffer will always be terminated with
- a trailing zero.
-
- If an error occurs, this function returns a
- "99, DRIVER ERROR,00,00\r" and the value 99.
+   The number of operations run, which is less than Length / 2 if
+   the program was interrupted by a signal; or -1 if the program
+   is not valid or could not be run. An invalid program is not run
+   at all.
 
  If cbm_driver_open() did not succeed, it is illegal to
  call this function.
 */
 
 int CBMAPIDECL
-cbm_device_status(CBM_FILE HandleDevice, unsigned char DeviceAddress,
-                  void *Buffer, size_t BufferLength)
+cbm_iec_program(CBM_FILE HandleDevice, unsigned char *Program, unsigned int Length)
 {
-    int retValue;
+    opencbm_plugin_t *plugin = &PLUGIN(HandleDevice);
+    unsigned int i;
+    int rv;
 
     FUNC_ENTER();
 
-    FUNC_PARAM((DBG_PREFIX "HandleDevice = %p, DeviceAddress = %u, Buffer = %p, BufferLength = %u",
-                HandleDevice, DeviceAddress,
-                Buffer, (int)BufferLength));
+    FUNC_PARAM((DBG_PREFIX "HandleDevice = %p, Program = %p, Length = %u", HandleDevice, Program, Length));
 
-    DBG_ASSERT(Buffer && (BufferLength > 0));
+    if (!cbm_iec_program_valid(HandleDevice, Program, Length))
+        FUNC_LEAVE_INT(-1);
 
-    do {
-        char *bufferToWrite = Buffer;
+    if (plugin->opencbm_plugin_iec_program) {
+        rv = plugin->opencbm_plugin_iec_program(HandleDevice, Program, Length);
+        if (rv != -2)
+            FUNC_LEAVE_INT(rv);
+    }
 
-        // Pre-occupy return value
+    for (i = 0; i < Length; i += 2) {
+        unsigned char arg = Program[i + 1];
 
-        retValue = 99;
+        switch (Program[i]) {
+        case CBM_IEC_PROG_SET:
+            if (arg)
+                plugin->opencbm_plugin_iec_setrelease(HandleDevice, arg, 0);
+            break;
+        case CBM_IEC_PROG_RELEASE:
+            if (arg)
+                plugin->opencbm_plugin_iec_setrelease(HandleDevice, 0, arg);
+            break;
+        case CBM_IEC_PROG_SETRELEASE:
+            plugin->opencbm_plugin_iec_setrelease(HandleDevice, arg >> 4, arg & 0x0f);
+            break;
+        case CBM_IEC_PROG_WAIT_SET:
+        case CBM_IEC_PROG_WAIT_RELEASE:
+            if (plugin->opencbm_plugin_iec_wait(HandleDevice, arg,
+                    Program[i] == CBM_IEC_PROG_WAIT_SET) < 0)
+                FUNC_LEAVE_INT(i / 2);
+            break;
+        case CBM_IEC_PROG_POLL:
+            Program[i + 1] = (unsigned char) plugin->opencbm_plugin_iec_poll(HandleDevice);
+            break;
+        case CBM_IEC_PROG_DELAY:
+            if (arg)
+                arch_sleep_us(arg);
+            break;
+        case CBM_IEC_PROG_PP_READ:
+            Program[i + 1] = plugin->opencbm_plugin_pp_read(HandleDevice);
+            break;
+        case CBM_IEC_PROG_PP_WRITE:
+            plugin->opencbm_plugin_pp_write(HandleDevice, arg);
+            break;
+        }
+    }
 
-        /*
-         * Memory for the error code. This is longer than the error buffer
-         * in the floppy, that is, this must suffice in all cases.
-         */
-        uint8_t buffer_local[40] = { 0 };
+    FUNC_LEAVE_INT(Length / 2);
+}
 
-        int rv = cbm_dos_channel_read(HandleDevice, DeviceAddress, 15, sizeof buffer_local, buffer_local, sizeof buffer_local);
+/*! \brief Get the (logical) state of a line on the IEC serial bus
 
-        DBG_ASSERT(rv <= sizeof buffer_local);
+ This function gets the (logical) state of a line on the IEC serial bus.
 
-        if (rv < 0) {
-            strncpy(Buffer, "99 DRIVER ERROR,01,00\r", BufferLength);
-        }
-        else {
-            char * p_end;
+ \param HandleDevice
+   A CBM_FILE which contains the file handle of the driver.
 
-            /* make sure the string is 0-terminated */
+ \param Line
+   The line to be tested. This must be exactly one of
+   IEC_DATA, IEC_CLOCK, IEC_ATN, and IEC_RESET.
 
-            if (rv < sizeof buffer_local) {
-                buffer_local[rv] = 0;
-            }
-            else {
+ \return
+   1 if the line is set, 0 if it is not
+
+ If cbm_driver_open() did not succeed, it is illegal to
+ call this function.
+
+ \bug
+   This function can't signal an error, thus, be careful!
+*/
+
+int CBMAPIDECL
+cbm_iec_get(CBM_FILE HandleDevice, int Line)
+{
+    FUNC_ENTER();
+
+    FUNC_PARAM((DBG_PREFIX "HandleDevice = %p, Line = %02X", HandleDevice, Line));
+
+    FUNC_LEAVE_INT((PLUGIN(HandleDevice).opencbm_plugin_iec_poll(HandleDevice)&Line) != 0 ? 1 : 0);
+}
+
+/** @} */
+
+/*-------------------------------------------------------------------*/
+/*--------- HELPER FUNCTIONS ----------------------------------------*/
+
+/** @{ @ingroup opencbm_dos
+ */
+
+/*! \internal \brief Read from a channel with one batch of the plugin
+
+ This function does the same as cbm_dos_channel_read(), but it
+ lets the plugin run the TALK, the read and the UNTALK back to back.
+
+ \param HandleDevice
+   A CBM_FILE which contains the file handle of the driver.
+
+ \param DeviceAddress
+   The address of the device on the IEC serial bus.
+
+ \param ChannelNumber
+   The channel to read from.
+
+ \param Buffer
+   Pointer to a buffer which will hold the bytes read.
+
+ \param MaxCount
+   The number of bytes to read at most.
+
+ \return
+   The number of bytes read, or -1 on error. If the plugin
+   does not support batches, -2 is returned; the caller has
+   to fall back to cbm_dos_channel_read() then.
+*/
+static int
+cbm_batch_channel_read(CBM_FILE HandleDevice, unsigned char DeviceAddress,
+                       unsigned char ChannelNumber, void *Buffer, size_t MaxCount)
+{
+    opencbm_plugin_t *plugin = &PLUGIN(HandleDevice);
+    unsigned char talk[2] = { 0x40, 0x60 };
+    unsigned char untalk[1] = { 0x5f };
+    opencbm_plugin_batch_entry_t entries[3];
+    int rv;
+
+    FUNC_ENTER();
+
+    if (plugin->opencbm_plugin_batch == NULL) {
+        FUNC_LEAVE_INT(-2);
+    }
+
+    talk[0] |= DeviceAddress;
+    talk[1] |= ChannelNumber;
+
+    entries[0].type = OPENCBM_PLUGIN_BATCH_WRITE_ATN_TALK;
+    entries[0].data = talk;
+    entries[0].size = sizeof talk;
+    entries[1].type = OPENCBM_PLUGIN_BATCH_READ;
+    entries[1].data = Buffer;
+    entries[1].size = MaxCount;
+    entries[2].type = OPENCBM_PLUGIN_BATCH_WRITE_ATN;
+    entries[2].data = untalk;
+    entries[2].size = sizeof untalk;
+
+    rv = plugin->opencbm_plugin_batch(HandleDevice, entries, 3);
+
+    if (rv < 0 || rv == 1) {
+        /* fatal error, or talk failed */
+        rv = -1;
+    }
+    else {
+        /* a failed read just returns no data, as with cbm_raw_read() */
+        rv = entries[1].result < 0 ? 0 : entries[1].result;
+    }
+
+    FUNC_LEAVE_INT(rv);
+}
+
+/*
+ * After its status has been read, a drive reports "00, OK,00,00"
+ * until it is told to do something. Thus, as long as there has not
+ * been any call into the plugin since, the status is known without
+ * asking the drive again. This spares the bus when a program polls
+ * the status.
+ */
+#define STATUS_CACHE_SIZE 4
+
+static const char Status_cache_ok[] = "00, OK,00,00";
+
+typedef
+struct status_cache_entry_s
+{
+    CBM_FILE      HandleDevice;
+    unsigned char DeviceAddress;
+    int           valid;
+    long          generation;  /*!< Plugin_call_generation after the status has been read */
+} status_cache_entry_t;
+
+static status_cache_entry_t Status_cache[STATUS_CACHE_SIZE];
+static unsigned int Status_cache_next = 0;
+
+/*! \internal \brief Remember that a status has just been read */
+static void
+status_cache_store(CBM_FILE HandleDevice, unsigned char DeviceAddress)
+{
+    status_cache_entry_t *entry = NULL;
+    unsigned int i;
+
+    plugin_lock();
+
+    for (i = 0; i < STATUS_CACHE_SIZE; i++) {
+        if (Status_cache[i].valid
+            && Status_cache[i].HandleDevice == HandleDevice
+            && Status_cache[i].DeviceAddress == DeviceAddress)
+        {
+            entry = &Status_cache[i];
+            break;
+        }
+    }
+
+    if (entry == NULL) {
+        entry = &Status_cache[Status_cache_next];
+        Status_cache_next = (Status_cache_next + 1) % STATUS_CACHE_SIZE;
+    }
+
+    entry->HandleDevice = HandleDevice;
+    entry->DeviceAddress = DeviceAddress;
+    entry->generation = Plugin_call_generation;
+    entry->valid = 1;
+
+    plugin_unlock();
+}
+
+/*! \internal \brief Find out if the status of a device is still known */
+static int
+status_cache_valid(CBM_FILE HandleDevice, unsigned char DeviceAddress)
+{
+    int valid = 0;
+    unsigned int i;
+
+    plugin_lock();
+
+    for (i = 0; i < STATUS_CACHE_SIZE; i++) {
+        if (Status_cache[i].valid
+            && Status_cache[i].HandleDevice == HandleDevice
+            && Status_cache[i].DeviceAddress == DeviceAddress)
+        {
+            valid = Status_cache[i].generation == Plugin_call_generation;
+            break;
+        }
+    }
+
+    plugin_unlock();
+
+    return valid;
+}
+
+/*! \brief Read the drive status from a floppy
+
+ This function reads the drive status of a connected
+ floppy drive.
+
+ \param HandleDevice
+   A CBM_FILE which contains the file handle of the driver.
+
+ \param DeviceAddress
+   The address of the device on the IEC serial bus. This
+   is known as primary address, too.
+
+ \param Buffer
+   Pointer to a buffer which will hold the drive's status after
+   successfull calling,
+
+ \param BufferLength
+   The length of the buffer pointed to by Buffer in bytes.
+
+ \return
+   Returns the int representation of the drive status,
+   that is, the numerical value of the first return
+   value from the drive. This is the error number.
+
+ This function will never write more than BufferLength bytes.
+ Nevertheless, the buffer will always be terminated with
+ a trailing zero.
+
+ If an error occurs, this function returns a
+ "99, DRIVER ERROR,00,00\r" and the value 99.
+
+ After the status has been read, the drive reports "00, OK,00,00"
+ until it is told to do something. So, if the handle has not been
+ used in any other way since the last call for this device, this
+ status is returned without asking the drive again.
+
+ If cbm_driver_open() did not succeed, it is illegal to
+ call this function.
+*/
+
+int CBMAPIDECL
+cbm_device_status(CBM_FILE HandleDevice, unsigned char DeviceAddress,
+                  void *Buffer, size_t BufferLength)
+{
+    int retValue;
+
+    FUNC_ENTER();
+
+    FUNC_PARAM((DBG_PREFIX "HandleDevice = %p, DeviceAddress = %u, Buffer = %p, BufferLength = %u",
+                HandleDevice, DeviceAddress,
+                Buffer, (int)BufferLength));
+
+    DBG_ASSERT(Buffer && (BufferLength > 0));
+
+    if (status_cache_valid(HandleDevice, DeviceAddress)) {
+        strncpy(Buffer, Status_cache_ok, BufferLength);
+        ((char *) Buffer)[BufferLength - 1] = 0;
+        FUNC_LEAVE_INT(0);
+    }
+
+    do {
+        char *bufferToWrite = Buffer;
+
+        // Pre-occupy return value
+
+        retValue = 99;
+
+        /*
+         * Memory for the error code. This is longer than the error buffer
+         * in the floppy, that is, this must suffice in all cases.
+         */
+        uint8_t buffer_local[40] = { 0 };
+
+        int rv = cbm_batch_channel_read(HandleDevice, DeviceAddress, 15, buffer_local, sizeof buffer_local);
+
+        if (rv == -2) {
+            rv = cbm_dos_channel_read(HandleDevice, DeviceAddress, 15, sizeof buffer_local, buffer_local, sizeof buffer_local);
+        }
+
+        DBG_ASSERT(rv <= sizeof buffer_local);
+
+        if (rv < 0) {
+            strncpy(Buffer, "99 DRIVER ERROR,01,00\r", BufferLength);
+        }
+        else {
+            char * p_end;
+
+            /* make sure the string is 0-terminated */
+
+            if (rv < sizeof buffer_local) {
+                buffer_local[rv] = 0;
+            }
+            else {
                 buffer_local[sizeof buffer_local - 1] = 0;
             }
 
@@ -1818,12 +2958,40 @@ cbm_device_status(CBM_FILE HandleDevice, unsigned char DeviceAddress,
                 }
             }
         }
+        else if (rv > 0) {
+            status_cache_store(HandleDevice, DeviceAddress);
+        }
 
     } while (0);
 
     FUNC_LEAVE_INT(retValue);
 }
 
+/*
+ * The commands which only read the disk or the memory of the drive.
+ * All others might change the directory, cf. cbm_dos_dir_block_read().
+ */
+static int
+command_only_reads(const void *Command, size_t Size)
+{
+    static const char * const read_commands[] = { "M-R", "U1", "UA", "B-P" };
+    unsigned int i;
+
+    if (Size == 0) {
+        Size = strlen(Command);
+    }
+
+    for (i = 0; i < sizeof read_commands / sizeof read_commands[0]; i++) {
+        size_t len = strlen(read_commands[i]);
+
+        if (Size >= len && memcmp(Command, read_commands[i], len) == 0) {
+            return 1;
+        }
+    }
+
+    return 0;
+}
+
 /*! \brief Executes a command in the floppy drive.
 
  This function Executes a command in the connected floppy drive.
@@ -1838,39 +3006,441 @@ cbm_device_status(CBM_FILE HandleDevice, unsigned char DeviceAddress,
  \param Command
    Pointer to a string which holds the command to be executed.
 
- \param Size
-   The length of the command in bytes. If zero, the Command
-   has to be a null-terminated string.
+ \param Size
+   The length of the command in bytes. If zero, the Command
+   has to be a null-terminated string.
+
+ \return
+   0 on success.
+
+ If cbm_driver_open() did not succeed, it is illegal to
+ call this function.
+*/
+
+int CBMAPIDECL
+cbm_exec_command(CBM_FILE HandleDevice, unsigned char DeviceAddress,
+                 const void *Command, size_t Size)
+{
+    opencbm_plugin_t *plugin = &PLUGIN(HandleDevice);
+    int rv;
+
+    FUNC_ENTER();
+
+    FUNC_PARAM((DBG_PREFIX "HandleDevice = %p, DeviceAddress = %u, Command = '%s' (%p), Size = %u",
+                HandleDevice, DeviceAddress,
+                Command ? Command : "(null)", Command, (int)Size));
+
+    DBG_ASSERT(Command);
+
+    if (!command_only_reads(Command, Size)) {
+        cbm_dos_dir_cache_invalidate(HandleDevice, DeviceAddress);
+    }
+
+    if (plugin->opencbm_plugin_batch) {
+        unsigned char listen[2] = { 0x20, 0x6f };
+        unsigned char unlisten[1] = { 0x3f };
+        opencbm_plugin_batch_entry_t entries[3];
+
+        if(Size == 0) {
+            Size = (size_t) strlen(Command);
+        }
+
+        listen[0] |= DeviceAddress;
+
+        entries[0].type = OPENCBM_PLUGIN_BATCH_WRITE_ATN;
+        entries[0].data = listen;
+        entries[0].size = sizeof listen;
+        entries[1].type = OPENCBM_PLUGIN_BATCH_WRITE;
+        entries[1].data = (unsigned char *) Command;
+        entries[1].size = Size;
+        entries[2].type = OPENCBM_PLUGIN_BATCH_WRITE_ATN;
+        entries[2].data = unlisten;
+        entries[2].size = sizeof unlisten;
+
+        rv = plugin->opencbm_plugin_batch(HandleDevice, entries, 3);
+
+        /* the unlisten is no part of the result, as with the code below */
+        rv = (rv == 1 || rv == 2 || rv < 0) ? 1 : 0;
+        FUNC_LEAVE_INT(rv);
+    }
+
+    rv = cbm_listen(HandleDevice, DeviceAddress, 15);
+    if(rv == 0) {
+        if(Size == 0) {
+            Size = (size_t) strlen(Command);
+        }
+        rv = (size_t) cbm_raw_write(HandleDevice, Command, Size) != Size;
+    }
+    cbm_unlisten(HandleDevice);
+
+    FUNC_LEAVE_INT(rv);
+}
+
+/*! \brief Switch deferred status for writes on or off
+
+ With deferred status, writes to the IEC bus (and thus
+ cbm_exec_command(), cbm_listen() and the like) do not wait until
+ the device has reported their status. Instead, failures are
+ collected and reported by the next call to cbm_flush_deferred_status().
+ This saves a round trip per write on USB adapters.
+
+ \param HandleDevice
+   A CBM_FILE which contains the file handle of the driver.
+
+ \param Enable
+   If not zero, switch deferred status on; if zero, switch it off.
+
+ \return
+   The previous state (0 or 1), or -1 if the driver or the device
+   does not support deferred status.
+
+ Functions that read from the bus are not affected. As the write
+ functions report success while deferred status is on, call
+ cbm_flush_deferred_status() before relying on their result.
+
+ If cbm_driver_open() did not succeed, it is illegal to
+ call this function.
+*/
+
+int CBMAPIDECL
+cbm_set_deferred_status(CBM_FILE HandleDevice, int Enable)
+{
+    opencbm_plugin_t *plugin = &PLUGIN(HandleDevice);
+    int rv = -1;
+
+    FUNC_ENTER();
+
+    FUNC_PARAM((DBG_PREFIX "HandleDevice = %p, Enable = %d", HandleDevice, Enable));
+
+    if (plugin->opencbm_plugin_set_deferred_status)
+        rv = plugin->opencbm_plugin_set_deferred_status(HandleDevice, Enable);
+
+    FUNC_LEAVE_INT(rv);
+}
+
+/*! \brief Collect the status of the deferred writes
+
+ This function is the sync point for cbm_set_deferred_status(): It
+ reports if any of the writes since the last call failed.
+
+ \param HandleDevice
+   A CBM_FILE which contains the file handle of the driver.
+
+ \return
+   0 if all writes succeeded, else the number of writes that failed.
+   If there is a fatal error, returns -1.
+
+ If deferred status is not supported, this function always returns 0.
+
+ If cbm_driver_open() did not succeed, it is illegal to
+ call this function.
+*/
+
+int CBMAPIDECL
+cbm_flush_deferred_status(CBM_FILE HandleDevice)
+{
+    opencbm_plugin_t *plugin = &PLUGIN(HandleDevice);
+    int rv = 0;
+
+    FUNC_ENTER();
+
+    FUNC_PARAM((DBG_PREFIX "HandleDevice = %p", HandleDevice));
+
+    if (plugin->opencbm_plugin_flush_deferred_status)
+        rv = plugin->opencbm_plugin_flush_deferred_status(HandleDevice);
+
+    FUNC_LEAVE_INT(rv);
+}
+
+/*! \brief Write to the memory of a drive, with the adapter running the "M-W" commands
+
+ On adapters with their own processor (like the xum1541), the adapter
+ splits the data into "M-W" commands and runs them on its own. This
+ saves several USB round trips per command.
+
+ \param HandleDevice
+   A CBM_FILE which contains the file handle of the driver.
+
+ \param DeviceAddress
+   The address of the device on the IEC serial bus. This
+   is known as primary address, too.
+
+ \param MemoryAddress
+   The address in the drive's memory to write to.
+
+ \param Buffer
+   Pointer to the bytes to be written.
+
+ \param Count
+   The number of bytes to be written.
+
+ \return
+   The number of bytes written. If the driver or the adapter does
+   not support this, or if there is a fatal error, returns -1.
+   cbm_dos_memory_write() uses this if available.
+
+ If cbm_driver_open() did not succeed, it is illegal to
+ call this function.
+*/
+
+int CBMAPIDECL
+cbm_adapter_memory_write(CBM_FILE HandleDevice, unsigned char DeviceAddress,
+                         unsigned int MemoryAddress, const unsigned char *Buffer,
+                         unsigned int Count)
+{
+    opencbm_plugin_t *plugin = &PLUGIN(HandleDevice);
+    int rv = -1;
+
+    FUNC_ENTER();
+
+    FUNC_PARAM((DBG_PREFIX "HandleDevice = %p, DeviceAddress = %u, MemoryAddress = %04x, Buffer = %p, Count = %u",
+                HandleDevice, DeviceAddress, MemoryAddress, Buffer, Count));
+
+    if (plugin->opencbm_plugin_memory_write)
+        rv = plugin->opencbm_plugin_memory_write(HandleDevice,
+            DeviceAddress, MemoryAddress, Buffer, Count);
+
+    FUNC_LEAVE_INT(rv);
+}
+
+/*! \brief Write drive code the adapter keeps on its own to the memory of a drive
+
+ Some adapters (like the xum1541) can keep a library of drive code.
+ The code is identified by its contents, so only a checksum has to
+ be sent to the adapter, not the code itself.
+
+ \param HandleDevice
+   A CBM_FILE which contains the file handle of the driver.
+
+ \param DeviceAddress
+   The address of the device on the IEC serial bus. This
+   is known as primary address, too.
+
+ \param MemoryAddress
+   The address in the drive's memory to write to.
+
+ \param Buffer
+   Pointer to the whole drive code. A part of it is not found in
+   the library, so do not split it up.
+
+ \param Count
+   The number of bytes of the drive code.
+
+ \return
+   The number of bytes written, 0 if the adapter does not have this
+   drive code. If the driver or the adapter does not support this,
+   or if there is a fatal error, returns -1.
+   cbm_dos_memory_write() uses this if available.
+
+ If cbm_driver_open() did not succeed, it is illegal to
+ call this function.
+*/
+
+int CBMAPIDECL
+cbm_adapter_code_upload(CBM_FILE HandleDevice, unsigned char DeviceAddress,
+                        unsigned int MemoryAddress, const unsigned char *Buffer,
+                        unsigned int Count)
+{
+    opencbm_plugin_t *plugin = &PLUGIN(HandleDevice);
+    int rv = -1;
+
+    FUNC_ENTER();
+
+    FUNC_PARAM((DBG_PREFIX "HandleDevice = %p, DeviceAddress = %u, MemoryAddress = %04x, Buffer = %p, Count = %u",
+                HandleDevice, DeviceAddress, MemoryAddress, Buffer, Count));
+
+    if (plugin->opencbm_plugin_code_upload)
+        rv = plugin->opencbm_plugin_code_upload(HandleDevice,
+            DeviceAddress, MemoryAddress, Buffer, Count);
+
+    FUNC_LEAVE_INT(rv);
+}
+
+/*! \brief Read from the memory of a drive, with the adapter running the "M-R" command
+
+ This is the counterpart of cbm_adapter_memory_write().
+
+ \param HandleDevice
+   A CBM_FILE which contains the file handle of the driver.
+
+ \param DeviceAddress
+   The address of the device on the IEC serial bus. This
+   is known as primary address, too.
+
+ \param MemoryAddress
+   The address in the drive's memory to read from.
+
+ \param Buffer
+   Pointer to a buffer which will hold the bytes read.
+
+ \param Count
+   The number of bytes to be read. As with a "M-R" command, the range
+   must not cross a page (256 bytes) of the drive's memory.
+
+ \return
+   The number of bytes read. If the driver or the adapter does
+   not support this, or if there is a fatal error, returns -1.
+   cbm_dos_memory_read() uses this if available.
+
+ If cbm_driver_open() did not succeed, it is illegal to
+ call this function.
+*/
+
+int CBMAPIDECL
+cbm_adapter_memory_read(CBM_FILE HandleDevice, unsigned char DeviceAddress,
+                        unsigned int MemoryAddress, unsigned char *Buffer,
+                        unsigned int Count)
+{
+    opencbm_plugin_t *plugin = &PLUGIN(HandleDevice);
+    int rv = -1;
+
+    FUNC_ENTER();
+
+    FUNC_PARAM((DBG_PREFIX "HandleDevice = %p, DeviceAddress = %u, MemoryAddress = %04x, Buffer = %p, Count = %u",
+                HandleDevice, DeviceAddress, MemoryAddress, Buffer, Count));
+
+    if (plugin->opencbm_plugin_memory_read)
+        rv = plugin->opencbm_plugin_memory_read(HandleDevice,
+            DeviceAddress, MemoryAddress, Buffer, Count);
+
+    FUNC_LEAVE_INT(rv);
+}
+
+/*! The number of "M-R" commands cbm_batch_memory_read() sends in one batch */
+#define CBM_BATCH_MEMORY_READ_CHUNKS 8
+
+/*! \brief Read from the memory of a drive, with several "M-R" commands in one batch
+
+ This function splits the range into "M-R" commands that do not cross
+ a page of the drive's memory. Up to CBM_BATCH_MEMORY_READ_CHUNKS of
+ them, each with the talk, the read and the untalk of its answer, are
+ given to the plugin as one batch. On USB adapters, this replaces
+ two round trips per command by one round trip per batch.
+
+ \param HandleDevice
+   A CBM_FILE which contains the file handle of the driver.
+
+ \param DeviceAddress
+   The address of the device on the IEC serial bus. This
+   is known as primary address, too.
+
+ \param MemoryAddress
+   The address in the drive's memory to read from.
+
+ \param Buffer
+   Pointer to a buffer which will hold the bytes read.
+
+ \param Count
+   The number of bytes to be read.
 
  \return
-   0 on success.
+   The number of bytes read from the start of the range, counting
+   complete "M-R" commands only. Reading stops at the first command
+   which failed or returned less than requested; the caller has to
+   read the rest on its own. If the driver does not support batches,
+   or if there is a fatal error, returns -1.
+   cbm_dos_memory_read() uses this if available.
 
  If cbm_driver_open() did not succeed, it is illegal to
  call this function.
 */
 
 int CBMAPIDECL
-cbm_exec_command(CBM_FILE HandleDevice, unsigned char DeviceAddress,
-                 const void *Command, size_t Size)
+cbm_batch_memory_read(CBM_FILE HandleDevice, unsigned char DeviceAddress,
+                      unsigned int MemoryAddress, unsigned char *Buffer,
+                      unsigned int Count)
 {
-    int rv;
+    opencbm_plugin_t *plugin = &PLUGIN(HandleDevice);
+    unsigned char listen[2] = { 0x20, 0x6f };
+    unsigned char unlisten[1] = { 0x3f };
+    unsigned char talk[2] = { 0x40, 0x6f };
+    unsigned char untalk[1] = { 0x5f };
+
+    unsigned char command[CBM_BATCH_MEMORY_READ_CHUNKS][6];
+    unsigned char answer[CBM_BATCH_MEMORY_READ_CHUNKS][0x100 + 1];
+    unsigned int  chunk_size[CBM_BATCH_MEMORY_READ_CHUNKS];
+    opencbm_plugin_batch_entry_t entries[6 * CBM_BATCH_MEMORY_READ_CHUNKS];
+
+    int rv = 0;
 
     FUNC_ENTER();
 
-    FUNC_PARAM((DBG_PREFIX "HandleDevice = %p, DeviceAddress = %u, Command = '%s' (%p), Size = %u",
-                HandleDevice, DeviceAddress,
-                Command ? Command : "(null)", Command, (int)Size));
+    FUNC_PARAM((DBG_PREFIX "HandleDevice = %p, DeviceAddress = %u, MemoryAddress = %04x, Buffer = %p, Count = %u",
+                HandleDevice, DeviceAddress, MemoryAddress, Buffer, Count));
 
-    DBG_ASSERT(Command);
+    if (plugin->opencbm_plugin_batch == NULL) {
+        FUNC_LEAVE_INT(-1);
+    }
 
-    rv = cbm_listen(HandleDevice, DeviceAddress, 15);
-    if(rv == 0) {
-        if(Size == 0) {
-            Size = (size_t) strlen(Command);
+    listen[0] |= DeviceAddress;
+    talk[0] |= DeviceAddress;
+
+    while (Count > 0) {
+        unsigned int chunks, i;
+        int failed;
+
+        for (chunks = 0; chunks < CBM_BATCH_MEMORY_READ_CHUNKS && Count > 0; chunks++) {
+            opencbm_plugin_batch_entry_t *entry = &entries[6 * chunks];
+            unsigned int size = 0x100 - (MemoryAddress & 0xFFu);
+
+            if (size > Count) {
+                size = Count;
+            }
+
+            command[chunks][0] = 'M';
+            command[chunks][1] = '-';
+            command[chunks][2] = 'R';
+            command[chunks][3] = (unsigned char) MemoryAddress;
+            command[chunks][4] = (unsigned char) (MemoryAddress >> 8);
+            command[chunks][5] = (unsigned char) size;
+            chunk_size[chunks] = size;
+
+            entry[0].type = OPENCBM_PLUGIN_BATCH_WRITE_ATN;
+            entry[0].data = listen;
+            entry[0].size = sizeof listen;
+            entry[1].type = OPENCBM_PLUGIN_BATCH_WRITE;
+            entry[1].data = command[chunks];
+            entry[1].size = sizeof command[chunks];
+            entry[2].type = OPENCBM_PLUGIN_BATCH_WRITE_ATN;
+            entry[2].data = unlisten;
+            entry[2].size = sizeof unlisten;
+            entry[3].type = OPENCBM_PLUGIN_BATCH_WRITE_ATN_TALK;
+            entry[3].data = talk;
+            entry[3].size = sizeof talk;
+            /* one more byte for the CR the drive sends after the data */
+            entry[4].type = OPENCBM_PLUGIN_BATCH_READ;
+            entry[4].data = answer[chunks];
+            entry[4].size = size + 1;
+            entry[5].type = OPENCBM_PLUGIN_BATCH_WRITE_ATN;
+            entry[5].data = untalk;
+            entry[5].size = sizeof untalk;
+
+            MemoryAddress += size;
+            Count -= size;
+        }
+
+        failed = plugin->opencbm_plugin_batch(HandleDevice, entries, 6 * chunks);
+
+        if (failed < 0) {
+            rv = -1;
+            break;
+        }
+
+        for (i = 0; i < chunks; i++) {
+            if ((failed && (unsigned int) failed <= 6 * i + 5)
+                || entries[6 * i + 4].result < (int) chunk_size[i]) {
+                break;
+            }
+
+            memcpy(Buffer, answer[i], chunk_size[i]);
+            Buffer += chunk_size[i];
+            rv += chunk_size[i];
+        }
+
+        if (i < chunks) {
+            break;
         }
-        rv = (size_t) cbm_raw_write(HandleDevice, Command, Size) != Size;
     }
-    cbm_unlisten(HandleDevice);
 
     FUNC_LEAVE_INT(rv);
 }
@@ -1900,14 +3470,15 @@ cbm_exec_command(CBM_FILE HandleDevice, unsigned char DeviceAddress,
 unsigned char CBMAPIDECL
 cbm_parallel_burst_read(CBM_FILE HandleDevice)
 {
+    opencbm_plugin_t *plugin = &PLUGIN(HandleDevice);
     unsigned char ret = 0;
 
     FUNC_ENTER();
 
     FUNC_PARAM((DBG_PREFIX "HandleDevice = %p", HandleDevice));
 
-    if (Plugin_information.Plugin.opencbm_plugin_parallel_burst_read)
-        ret = Plugin_information.Plugin.opencbm_plugin_parallel_burst_read(HandleDevice);
+    if (plugin->opencbm_plugin_parallel_burst_read)
+        ret = plugin->opencbm_plugin_parallel_burst_read(HandleDevice);
 
     FUNC_LEAVE_UCHAR(ret);
 }
@@ -1932,12 +3503,14 @@ cbm_parallel_burst_read(CBM_FILE HandleDevice)
 void CBMAPIDECL
 cbm_parallel_burst_write(CBM_FILE HandleDevice, unsigned char Value)
 {
+    opencbm_plugin_t *plugin = &PLUGIN(HandleDevice);
+
     FUNC_ENTER();
 
     FUNC_PARAM((DBG_PREFIX "HandleDevice = %p, Value = %02X", HandleDevice, Value));
 
-    if (Plugin_information.Plugin.opencbm_plugin_parallel_burst_write)
-        Plugin_information.Plugin.opencbm_plugin_parallel_burst_write(HandleDevice, Value);
+    if (plugin->opencbm_plugin_parallel_burst_write)
+        plugin->opencbm_plugin_parallel_burst_write(HandleDevice, Value);
 
     FUNC_LEAVE();
 }
@@ -1946,6 +3519,7 @@ int CBMAPIDECL
 cbm_parallel_burst_read_n(CBM_FILE HandleDevice, unsigned char *Buffer,
     unsigned int Length)
 {
+    opencbm_plugin_t *plugin = &PLUGIN(HandleDevice);
     unsigned int i;
     int rv;
 
@@ -1954,12 +3528,12 @@ cbm_parallel_burst_read_n(CBM_FILE HandleDevice, unsigned char *Buffer,
     FUNC_PARAM((DBG_PREFIX "HandleDevice = %p, Buffer = %p, Length = %u",
                 HandleDevice, Buffer, Length));
 
-    if (Plugin_information.Plugin.opencbm_plugin_parallel_burst_read_n) {
-        rv = Plugin_information.Plugin.opencbm_plugin_parallel_burst_read_n(
+    if (plugin->opencbm_plugin_parallel_burst_read_n) {
+        rv = plugin->opencbm_plugin_parallel_burst_read_n(
             HandleDevice, Buffer, Length);
     } else {
         for (i = 0; i < Length; i++) {
-            Buffer[i] = Plugin_information.Plugin
+            Buffer[i] = PLUGIN(HandleDevice)
                 .opencbm_plugin_parallel_burst_read(HandleDevice);
         }
         rv = Length;
@@ -1972,6 +3546,7 @@ int CBMAPIDECL
 cbm_parallel_burst_write_n(CBM_FILE HandleDevice, unsigned char *Buffer,
     unsigned int Length)
 {
+    opencbm_plugin_t *plugin = &PLUGIN(HandleDevice);
     unsigned int i;
     int rv;
 
@@ -1980,12 +3555,12 @@ cbm_parallel_burst_write_n(CBM_FILE HandleDevice, unsigned char *Buffer,
     FUNC_PARAM((DBG_PREFIX "HandleDevice = %p, Buffer = %p, Length = %u",
                 HandleDevice, Buffer, Length));
 
-    if (Plugin_information.Plugin.opencbm_plugin_parallel_burst_write_n) {
-        rv = Plugin_information.Plugin.opencbm_plugin_parallel_burst_write_n(
+    if (plugin->opencbm_plugin_parallel_burst_write_n) {
+        rv = plugin->opencbm_plugin_parallel_burst_write_n(
             HandleDevice, Buffer, Length);
     } else {
         for (i = 0; i < Length; i++) {
-            Plugin_information.Plugin.opencbm_plugin_parallel_burst_write(
+            plugin->opencbm_plugin_parallel_burst_write(
                 HandleDevice, Buffer[i]);
         }
         rv = Length;
@@ -2021,6 +3596,7 @@ cbm_parallel_burst_write_n(CBM_FILE HandleDevice, unsigned char *Buffer,
 int CBMAPIDECL
 cbm_parallel_burst_read_track(CBM_FILE HandleDevice, unsigned char *Buffer, unsigned int Length)
 {
+    opencbm_plugin_t *plugin = &PLUGIN(HandleDevice);
     int ret = -1;
 
     FUNC_ENTER();
@@ -2028,8 +3604,8 @@ cbm_parallel_burst_read_track(CBM_FILE HandleDevice, unsigned char *Buffer, unsi
     FUNC_PARAM((DBG_PREFIX "HandleDevice = %p, Buffer = %p, Length = %u",
                 HandleDevice, Buffer, Length));
 
-    if (Plugin_information.Plugin.opencbm_plugin_parallel_burst_read_track)
-        ret = Plugin_information.Plugin.opencbm_plugin_parallel_burst_read_track(HandleDevice, Buffer, Length);
+    if (plugin->opencbm_plugin_parallel_burst_read_track)
+        ret = plugin->opencbm_plugin_parallel_burst_read_track(HandleDevice, Buffer, Length);
 
     FUNC_LEAVE_INT(ret);
 }
@@ -2058,6 +3634,7 @@ cbm_parallel_burst_read_track(CBM_FILE HandleDevice, unsigned char *Buffer, unsi
 int CBMAPIDECL
 cbm_parallel_burst_read_track_var(CBM_FILE HandleDevice, unsigned char *Buffer, unsigned int Length)
 {
+    opencbm_plugin_t *plugin = &PLUGIN(HandleDevice);
     int ret = -1;
 
     FUNC_ENTER();
@@ -2065,8 +3642,8 @@ cbm_parallel_burst_read_track_var(CBM_FILE HandleDevice, unsigned char *Buffer,
     FUNC_PARAM((DBG_PREFIX "HandleDevice = %p, Buffer = %p, Length = %u",
                 HandleDevice, Buffer, Length));
 
-    if (Plugin_information.Plugin.opencbm_plugin_parallel_burst_read_track)
-        ret = Plugin_information.Plugin.opencbm_plugin_parallel_burst_read_track_var(HandleDevice, Buffer, Length);
+    if (plugin->opencbm_plugin_parallel_burst_read_track_var)
+        ret = plugin->opencbm_plugin_parallel_burst_read_track_var(HandleDevice, Buffer, Length);
 
     FUNC_LEAVE_INT(ret);
 }
@@ -2098,6 +3675,7 @@ cbm_parallel_burst_read_track_var(CBM_FILE HandleDevice, unsigned char *Buffer,
 int CBMAPIDECL
 cbm_parallel_burst_write_track(CBM_FILE HandleDevice, unsigned char *Buffer, unsigned int Length)
 {
+    opencbm_plugin_t *plugin = &PLUGIN(HandleDevice);
     int ret = -1;
 
     FUNC_ENTER();
@@ -2105,8 +3683,302 @@ cbm_parallel_burst_write_track(CBM_FILE HandleDevice, unsigned char *Buffer, uns
     FUNC_PARAM((DBG_PREFIX "HandleDevice = %p, Buffer = %p, Length = %u",
                 HandleDevice, Buffer, Length));
 
-    if (Plugin_information.Plugin.opencbm_plugin_parallel_burst_write_track)
-        ret = Plugin_information.Plugin.opencbm_plugin_parallel_burst_write_track(HandleDevice, Buffer, Length);
+    if (plugin->opencbm_plugin_parallel_burst_write_track)
+        ret = plugin->opencbm_plugin_parallel_burst_write_track(HandleDevice, Buffer, Length);
+
+    FUNC_LEAVE_INT(ret);
+}
+
+/*! \brief PARBURST: Send the command of a track to the drive
+
+ Internal helper for cbm_parallel_burst_read_tracks().
+*/
+
+static int
+parallel_burst_send_track_command(CBM_FILE HandleDevice, cbm_parallel_burst_track_t *Track)
+{
+    if (Track->command == NULL || Track->command_length == 0)
+        return 0;
+
+    if (cbm_parallel_burst_write_n(HandleDevice, Track->command, Track->command_length)
+        != (int) Track->command_length)
+        return -1;
+
+    return 0;
+}
+
+/*! \brief PARBURST: Read the data of a track from the drive
+
+ Internal helper for cbm_parallel_burst_read_tracks().
+*/
+
+static int
+parallel_burst_read_one_track(CBM_FILE HandleDevice, cbm_parallel_burst_track_t *Track)
+{
+    if (Track->variable)
+        Track->result = cbm_parallel_burst_read_track_var(HandleDevice, Track->buffer, Track->length);
+    else
+        Track->result = cbm_parallel_burst_read_track(HandleDevice, Track->buffer, Track->length);
+
+    return Track->result > 0 ? 0 : -1;
+}
+
+/*! \brief PARBURST: Read a sequence of tracks
+
+ This function is a helper function for parallel burst:
+ It reads a list of tracks, e.g. a whole disk, in one go.
+
+ For every entry in Tracks, the command (if any) is sent to the
+ drive with cbm_parallel_burst_write_n(), and the track is read
+ with cbm_parallel_burst_read_track() or, if the entry is marked
+ as variable, cbm_parallel_burst_read_track_var().
+
+ The command for the next track is sent before Callback is called
+ for the current one. Thus, the drive already steps and waits for
+ the next track while the caller processes the data it has just
+ received.
+
+ \param HandleDevice
+   A CBM_FILE which contains the file handle of the driver.
+
+ \param Tracks
+   Array of Count track descriptions. On return, the result member
+   of every processed entry holds the return value of its read.
+
+ \param Count
+   The number of entries in Tracks.
+
+ \param Callback
+   Called after each track has been read and the command for the
+   next one has been sent; may be NULL. If it returns != 0, no
+   further track is processed. A track whose command has already
+   been sent is still read (into its buffer), so that the drive
+   is not left waiting.
+
+ \param Context
+   Passed unchanged to Callback.
+
+ \return
+   The number of tracks which have been handed to Callback (or read,
+   if Callback is NULL); -1 if the first track could not be read.
+
+ Every command must make the drive send exactly one track;
+ otherwise, the read and the command of the following
+ entries get out of sync.
+
+ If cbm_driver_open() did not succeed, it is illegal to
+ call this function.
+
+ Note that a plugin is not required to implement this function.
+ If the plugin does not implement reading a track, it will return -1.
+*/
+
+int CBMAPIDECL
+cbm_parallel_burst_read_tracks(CBM_FILE HandleDevice, cbm_parallel_burst_track_t *Tracks,
+                               unsigned int Count, cbm_parallel_burst_track_callback_t Callback,
+                               void *Context)
+{
+    unsigned int i;
+    int ret = -1;
+
+    FUNC_ENTER();
+
+    FUNC_PARAM((DBG_PREFIX "HandleDevice = %p, Tracks = %p, Count = %u, Callback = %p, Context = %p",
+                HandleDevice, Tracks, Count, Callback, Context));
+
+    do {
+        if (PLUGIN(HandleDevice).opencbm_plugin_parallel_burst_read_track == NULL)
+            break;
+
+        if (Count == 0) {
+            ret = 0;
+            break;
+        }
+
+        if (parallel_burst_send_track_command(HandleDevice, &Tracks[0]))
+            break;
+
+        for (i = 0; i < Count; i++) {
+            int next_sent = 0;
+
+            if (parallel_burst_read_one_track(HandleDevice, &Tracks[i]))
+                break;
+
+            if (i + 1 < Count) {
+                if (parallel_burst_send_track_command(HandleDevice, &Tracks[i + 1]) == 0)
+                    next_sent = 1;
+                else
+                    Count = i + 1;
+            }
+
+            if (Callback && Callback(Context, &Tracks[i], i)) {
+                if (next_sent)
+                    parallel_burst_read_one_track(HandleDevice, &Tracks[i + 1]);
+                i++;
+                break;
+            }
+        }
+
+        ret = i > 0 ? (int) i : -1;
+
+    } while (0);
+
+    FUNC_LEAVE_INT(ret);
+}
+
+/*! \brief PARBURST: Start writing a track
+
+ Internal helper for cbm_parallel_burst_write_tracks().
+ Request must point to two requests. Returns 1 if the command
+ and the data of the track have been queued; 0 if there is no
+ worker, and the track has been written already.
+*/
+
+static int
+parallel_burst_start_track_write(CBM_FILE HandleDevice, cbm_parallel_burst_track_t *Track,
+                                 cbm_async_request_t *Request)
+{
+    memset(Request, 0, 2 * sizeof(*Request));
+
+    Request[0].type = cbm_async_parallel_burst_write_n;
+    Request[0].buffer = Track->command;
+    Request[0].count = Track->command != NULL ? Track->command_length : 0;
+
+    Request[1].type = cbm_async_parallel_burst_write_track;
+    Request[1].buffer = Track->buffer;
+    Request[1].count = Track->length;
+
+    if (Request[0].count == 0 || cbm_async_submit(HandleDevice, &Request[0]) == 0) {
+        if (cbm_async_submit(HandleDevice, &Request[1]) == 0)
+            return 1;
+
+        /* the command is queued already, wait for it */
+        if (Request[0].count != 0
+            && cbm_async_wait(HandleDevice, &Request[0]) != (int) Request[0].count) {
+            Track->result = -1;
+            return 0;
+        }
+    }
+    else if (parallel_burst_send_track_command(HandleDevice, Track)) {
+        Track->result = -1;
+        return 0;
+    }
+
+    Track->result = cbm_parallel_burst_write_track(HandleDevice, Track->buffer, Track->length);
+    return 0;
+}
+
+/*! \brief PARBURST: Wait until the track queued before has been written
+
+ Internal helper for cbm_parallel_burst_write_tracks().
+*/
+
+static void
+parallel_burst_wait_track_write(CBM_FILE HandleDevice, cbm_parallel_burst_track_t *Track,
+                                cbm_async_request_t *Request)
+{
+    if (Request[0].count != 0)
+        cbm_async_wait(HandleDevice, &Request[0]);
+    cbm_async_wait(HandleDevice, &Request[1]);
+
+    if (Request[0].count != 0 && Request[0].result != (int) Request[0].count)
+        Track->result = -1;
+    else
+        Track->result = Request[1].result;
+}
+
+/*! \brief PARBURST: Write a sequence of tracks
+
+ This function is a helper function for parallel burst:
+ It writes a list of tracks, e.g. a whole disk, in one go.
+
+ For every entry in Tracks, the command (if any) is sent to the
+ drive with cbm_parallel_burst_write_n(), and the data is written
+ with cbm_parallel_burst_write_track().
+
+ Before a track is written, Callback is called to fill it in.
+ The transfers are run by the worker of cbm_async_submit(), so
+ that Callback fills the next track while the current one is
+ still being sent to the drive. Thus, the caller need not have
+ the whole disk in memory: two buffers, used in turn, are enough.
+
+ \param HandleDevice
+   A CBM_FILE which contains the file handle of the driver.
+
+ \param Tracks
+   Array of Count track descriptions. On return, the result member
+   of every processed entry holds the return value of its write.
+
+ \param Count
+   The number of entries in Tracks.
+
+ \param Callback
+   Called for every track before it is written, with the entry
+   to fill in (command, buffer and length); may be NULL, if all
+   entries are filled in already. If it returns != 0, the track
+   is not written, and neither are the following ones. Callback
+   must not use HandleDevice, and must not change the buffer of
+   the track before, which may still be sent at that time.
+
+ \param Context
+   Passed unchanged to Callback.
+
+ \return
+   The number of tracks which have been written; -1 if the first
+   track could not be written.
+
+ If cbm_driver_open() did not succeed, it is illegal to
+ call this function.
+
+ Note that a plugin is not required to implement this function.
+ If the plugin does not implement writing a track, it will return -1.
+*/
+
+int CBMAPIDECL
+cbm_parallel_burst_write_tracks(CBM_FILE HandleDevice, cbm_parallel_burst_track_t *Tracks,
+                                unsigned int Count, cbm_parallel_burst_track_callback_t Callback,
+                                void *Context)
+{
+    cbm_async_request_t request[2];
+    unsigned int i;
+    int ret = -1;
+
+    FUNC_ENTER();
+
+    FUNC_PARAM((DBG_PREFIX "HandleDevice = %p, Tracks = %p, Count = %u, Callback = %p, Context = %p",
+                HandleDevice, Tracks, Count, Callback, Context));
+
+    do {
+        if (PLUGIN(HandleDevice).opencbm_plugin_parallel_burst_write_track == NULL)
+            break;
+
+        if (Count == 0 || (Callback && Callback(Context, &Tracks[0], 0))) {
+            ret = 0;
+            break;
+        }
+
+        for (i = 0; i < Count; i++) {
+            int stop = 0;
+            int queued = parallel_burst_start_track_write(HandleDevice, &Tracks[i], request);
+
+            if (i + 1 < Count && Callback)
+                stop = Callback(Context, &Tracks[i + 1], i + 1);
+
+            if (queued)
+                parallel_burst_wait_track_write(HandleDevice, &Tracks[i], request);
+
+            if (Tracks[i].result <= 0)
+                break;
+
+            if (stop) {
+                i++;
+                break;
+            }
+        }
+
+        ret = i > 0 ? (int) i : -1;
+
+    } while (0);
 
     FUNC_LEAVE_INT(ret);
 }
@@ -2131,14 +4003,15 @@ cbm_parallel_burst_write_track(CBM_FILE HandleDevice, unsigned char *Buffer, uns
 unsigned char CBMAPIDECL
 cbm_srq_burst_read(CBM_FILE HandleDevice)
 {
+    opencbm_plugin_t *plugin = &PLUGIN(HandleDevice);
     unsigned char ret = 0;
 
     FUNC_ENTER();
 
     FUNC_PARAM((DBG_PREFIX "HandleDevice = %p", HandleDevice));
 
-    if (Plugin_information.Plugin.opencbm_plugin_srq_burst_read)
-        ret = Plugin_information.Plugin.opencbm_plugin_srq_burst_read(HandleDevice);
+    if (plugin->opencbm_plugin_srq_burst_read)
+        ret = plugin->opencbm_plugin_srq_burst_read(HandleDevice);
 
     FUNC_LEAVE_UCHAR(ret);
 }
@@ -2163,12 +4036,14 @@ cbm_srq_burst_read(CBM_FILE HandleDevice)
 void CBMAPIDECL
 cbm_srq_burst_write(CBM_FILE HandleDevice, unsigned char Value)
 {
+    opencbm_plugin_t *plugin = &PLUGIN(HandleDevice);
+
     FUNC_ENTER();
 
     FUNC_PARAM((DBG_PREFIX "HandleDevice = %p, Value = %02X", HandleDevice, Value));
 
-    if (Plugin_information.Plugin.opencbm_plugin_srq_burst_write)
-        Plugin_information.Plugin.opencbm_plugin_srq_burst_write(HandleDevice, Value);
+    if (plugin->opencbm_plugin_srq_burst_write)
+        plugin->opencbm_plugin_srq_burst_write(HandleDevice, Value);
 
     FUNC_LEAVE();
 }
@@ -2177,6 +4052,7 @@ int CBMAPIDECL
 cbm_srq_burst_read_n(CBM_FILE HandleDevice, unsigned char *Buffer,
     unsigned int Length)
 {
+    opencbm_plugin_t *plugin = &PLUGIN(HandleDevice);
     unsigned int i;
     int rv;
 
@@ -2185,12 +4061,12 @@ cbm_srq_burst_read_n(CBM_FILE HandleDevice, unsigned char *Buffer,
     FUNC_PARAM((DBG_PREFIX "HandleDevice = %p, Buffer = %p, Length = %u",
                 HandleDevice, Buffer, Length));
 
-    if (Plugin_information.Plugin.opencbm_plugin_srq_burst_read_n) {
-        rv = Plugin_information.Plugin.opencbm_plugin_srq_burst_read_n(
+    if (plugin->opencbm_plugin_srq_burst_read_n) {
+        rv = plugin->opencbm_plugin_srq_burst_read_n(
             HandleDevice, Buffer, Length);
     } else {
         for (i = 0; i < Length; i++) {
-            Buffer[i] = Plugin_information.Plugin
+            Buffer[i] = PLUGIN(HandleDevice)
                 .opencbm_plugin_srq_burst_read(HandleDevice);
         }
         rv = Length;
@@ -2203,6 +4079,7 @@ int CBMAPIDECL
 cbm_srq_burst_write_n(CBM_FILE HandleDevice, unsigned char *Buffer,
     unsigned int Length)
 {
+    opencbm_plugin_t *plugin = &PLUGIN(HandleDevice);
     unsigned int i;
     int rv;
 
@@ -2211,12 +4088,12 @@ cbm_srq_burst_write_n(CBM_FILE HandleDevice, unsigned char *Buffer,
     FUNC_PARAM((DBG_PREFIX "HandleDevice = %p, Buffer = %p, Length = %u",
                 HandleDevice, Buffer, Length));
 
-    if (Plugin_information.Plugin.opencbm_plugin_srq_burst_write_n) {
-        rv = Plugin_information.Plugin.opencbm_plugin_srq_burst_write_n(
+    if (plugin->opencbm_plugin_srq_burst_write_n) {
+        rv = plugin->opencbm_plugin_srq_burst_write_n(
             HandleDevice, Buffer, Length);
     } else {
         for (i = 0; i < Length; i++) {
-            Plugin_information.Plugin.opencbm_plugin_srq_burst_write(
+            plugin->opencbm_plugin_srq_burst_write(
                 HandleDevice, Buffer[i]);
         }
         rv = Length;
@@ -2252,6 +4129,7 @@ cbm_srq_burst_write_n(CBM_FILE HandleDevice, unsigned char *Buffer,
 int CBMAPIDECL
 cbm_srq_burst_read_track(CBM_FILE HandleDevice, unsigned char *Buffer, unsigned int Length)
 {
+    opencbm_plugin_t *plugin = &PLUGIN(HandleDevice);
     int ret = -1;
 
     FUNC_ENTER();
@@ -2259,8 +4137,8 @@ cbm_srq_burst_read_track(CBM_FILE HandleDevice, unsigned char *Buffer, unsigned
     FUNC_PARAM((DBG_PREFIX "HandleDevice = %p, Buffer = %p, Length = %u",
                 HandleDevice, Buffer, Length));
 
-    if (Plugin_information.Plugin.opencbm_plugin_srq_burst_read_track)
-        ret = Plugin_information.Plugin.opencbm_plugin_srq_burst_read_track(HandleDevice, Buffer, Length);
+    if (plugin->opencbm_plugin_srq_burst_read_track)
+        ret = plugin->opencbm_plugin_srq_burst_read_track(HandleDevice, Buffer, Length);
 
     FUNC_LEAVE_INT(ret);
 }
@@ -2292,6 +4170,7 @@ cbm_srq_burst_read_track(CBM_FILE HandleDevice, unsigned char *Buffer, unsigned
 int CBMAPIDECL
 cbm_srq_burst_write_track(CBM_FILE HandleDevice, unsigned char *Buffer, unsigned int Length)
 {
+    opencbm_plugin_t *plugin = &PLUGIN(HandleDevice);
     int ret = -1;
 
     FUNC_ENTER();
@@ -2299,8 +4178,8 @@ cbm_srq_burst_write_track(CBM_FILE HandleDevice, unsigned char *Buffer, unsigned
     FUNC_PARAM((DBG_PREFIX "HandleDevice = %p, Buffer = %p, Length = %u",
                 HandleDevice, Buffer, Length));
 
-    if (Plugin_information.Plugin.opencbm_plugin_srq_burst_write_track)
-        ret = Plugin_information.Plugin.opencbm_plugin_srq_burst_write_track(HandleDevice, Buffer, Length);
+    if (plugin->opencbm_plugin_srq_burst_write_track)
+        ret = plugin->opencbm_plugin_srq_burst_write_track(HandleDevice, Buffer, Length);
 
     FUNC_LEAVE_INT(ret);
 }
@@ -2332,12 +4211,13 @@ cbm_srq_burst_write_track(CBM_FILE HandleDevice, unsigned char *Buffer, unsigned
 int CBMAPIDECL
 cbm_tap_prepare_capture(CBM_FILE HandleDevice, int *Status)
 {
+    opencbm_plugin_t *plugin = &PLUGIN(HandleDevice);
     int ret = -1;
 
     FUNC_ENTER();
 
-    if (Plugin_information.Plugin.opencbm_plugin_tap_prepare_capture)
-        ret = Plugin_information.Plugin.opencbm_plugin_tap_prepare_capture(HandleDevice, Status);
+    if (plugin->opencbm_plugin_tap_prepare_capture)
+        ret = plugin->opencbm_plugin_tap_prepare_capture(HandleDevice, Status);
 
     FUNC_LEAVE_INT(ret);
 }
@@ -2365,12 +4245,13 @@ cbm_tap_prepare_capture(CBM_FILE HandleDevice, int *Status)
 int CBMAPIDECL
 cbm_tap_prepare_write(CBM_FILE HandleDevice, int *Status)
 {
+    opencbm_plugin_t *plugin = &PLUGIN(HandleDevice);
     int ret = -1;
 
     FUNC_ENTER();
 
-    if (Plugin_information.Plugin.opencbm_plugin_tap_prepare_write)
-        ret = Plugin_information.Plugin.opencbm_plugin_tap_prepare_write(HandleDevice, Status);
+    if (plugin->opencbm_plugin_tap_prepare_write)
+        ret = plugin->opencbm_plugin_tap_prepare_write(HandleDevice, Status);
 
     FUNC_LEAVE_INT(ret);
 }
@@ -2398,12 +4279,13 @@ cbm_tap_prepare_write(CBM_FILE HandleDevice, int *Status)
 int CBMAPIDECL
 cbm_tap_get_sense(CBM_FILE HandleDevice, int *Status)
 {
+    opencbm_plugin_t *plugin = &PLUGIN(HandleDevice);
     int ret = -1;
 
     FUNC_ENTER();
 
-    if (Plugin_information.Plugin.opencbm_plugin_tap_get_sense)
-        ret = Plugin_information.Plugin.opencbm_plugin_tap_get_sense(HandleDevice, Status);
+    if (plugin->opencbm_plugin_tap_get_sense)
+        ret = plugin->opencbm_plugin_tap_get_sense(HandleDevice, Status);
 
     FUNC_LEAVE_INT(ret);
 }
@@ -2431,12 +4313,13 @@ cbm_tap_get_sense(CBM_FILE HandleDevice, int *Status)
 int CBMAPIDECL
 cbm_tap_wait_for_stop_sense(CBM_FILE HandleDevice, int *Status)
 {
+    opencbm_plugin_t *plugin = &PLUGIN(HandleDevice);
     int ret = -1;
 
     FUNC_ENTER();
 
-    if (Plugin_information.Plugin.opencbm_plugin_tap_wait_for_stop_sense)
-        ret = Plugin_information.Plugin.opencbm_plugin_tap_wait_for_stop_sense(HandleDevice, Status);
+    if (plugin->opencbm_plugin_tap_wait_for_stop_sense)
+        ret = plugin->opencbm_plugin_tap_wait_for_stop_sense(HandleDevice, Status);
 
     FUNC_LEAVE_INT(ret);
 }
@@ -2461,12 +4344,13 @@ cbm_tap_wait_for_stop_sense(CBM_FILE HandleDevice, int *Status)
 int CBMAPIDECL
 cbm_tap_wait_for_play_sense(CBM_FILE HandleDevice, int *Status)
 {
+    opencbm_plugin_t *plugin = &PLUGIN(HandleDevice);
     int ret = -1;
 
     FUNC_ENTER();
 
-    if (Plugin_information.Plugin.opencbm_plugin_tap_wait_for_play_sense)
-        ret = Plugin_information.Plugin.opencbm_plugin_tap_wait_for_play_sense(HandleDevice, Status);
+    if (plugin->opencbm_plugin_tap_wait_for_play_sense)
+        ret = plugin->opencbm_plugin_tap_wait_for_play_sense(HandleDevice, Status);
 
     FUNC_LEAVE_INT(ret);
 }
@@ -2494,12 +4378,13 @@ cbm_tap_wait_for_play_sense(CBM_FILE HandleDevice, int *Status)
 int CBMAPIDECL
 cbm_tap_motor_on(CBM_FILE HandleDevice, int *Status)
 {
+    opencbm_plugin_t *plugin = &PLUGIN(HandleDevice);
     int ret = -1;
 
     FUNC_ENTER();
 
-    if (Plugin_information.Plugin.opencbm_plugin_tap_motor_on)
-        ret = Plugin_information.Plugin.opencbm_plugin_tap_motor_on(HandleDevice, Status);
+    if (plugin->opencbm_plugin_tap_motor_on)
+        ret = plugin->opencbm_plugin_tap_motor_on(HandleDevice, Status);
 
     FUNC_LEAVE_INT(ret);
 }
@@ -2527,12 +4412,13 @@ cbm_tap_motor_on(CBM_FILE HandleDevice, int *Status)
 int CBMAPIDECL
 cbm_tap_motor_off(CBM_FILE HandleDevice, int *Status)
 {
+    opencbm_plugin_t *plugin = &PLUGIN(HandleDevice);
     int ret = -1;
 
     FUNC_ENTER();
 
-    if (Plugin_information.Plugin.opencbm_plugin_tap_motor_off)
-        ret = Plugin_information.Plugin.opencbm_plugin_tap_motor_off(HandleDevice, Status);
+    if (plugin->opencbm_plugin_tap_motor_off)
+        ret = plugin->opencbm_plugin_tap_motor_off(HandleDevice, Status);
 
     FUNC_LEAVE_INT(ret);
 }
@@ -2569,12 +4455,65 @@ cbm_tap_motor_off(CBM_FILE HandleDevice, int *Status)
 int CBMAPIDECL
 cbm_tap_start_capture(CBM_FILE HandleDevice, unsigned char *Buffer, unsigned int Buffer_Length, int *Status, int *BytesRead)
 {
+    opencbm_plugin_t *plugin = &PLUGIN(HandleDevice);
+    int ret = -1;
+
+    FUNC_ENTER();
+
+    if (plugin->opencbm_plugin_tap_start_capture)
+        ret = plugin->opencbm_plugin_tap_start_capture(HandleDevice, Buffer, Buffer_Length, Status, BytesRead);
+
+    FUNC_LEAVE_INT(ret);
+}
+
+/*! \brief TAPE: Capture a tape chunk by chunk
+
+ This function is a helper function for tape:
+ It starts the actual tape capture, like cbm_tap_start_capture(), but
+ hands the capture data to Callback as it arrives. Buffer only has to
+ hold one chunk, so the length of the tape is not limited by memory.
+
+ \param HandleDevice
+   A CBM_FILE which contains the file handle of the driver.
+
+ \param Buffer
+   Pointer to a buffer for one chunk of the capture data.
+
+ \param Buffer_Length
+   The length of the Buffer; it must be a multiple of 64 bytes.
+
+ \param Callback
+   Called with every chunk read. If it returns != 0, the capture is
+   broken off as with cbm_tap_break().
+
+ \param Context
+   Passed unchanged to Callback.
+
+ \param Status
+   The return status.
+
+ \param BytesRead
+   The number of bytes read in total.
+
+ \return
+   != 0 on success, -1 if the plugin cannot capture chunk by chunk.
+
+ If cbm_driver_open() did not succeed, it is illegal to
+ call this function.
+
+ Note that a plugin is not required to implement this function.
+*/
+
+int CBMAPIDECL
+cbm_tap_capture(CBM_FILE HandleDevice, unsigned char *Buffer, unsigned int Buffer_Length, cbm_tap_capture_callback_t Callback, void *Context, int *Status, int *BytesRead)
+{
+    opencbm_plugin_t *plugin = &PLUGIN(HandleDevice);
     int ret = -1;
 
     FUNC_ENTER();
 
-    if (Plugin_information.Plugin.opencbm_plugin_tap_start_capture)
-        ret = Plugin_information.Plugin.opencbm_plugin_tap_start_capture(HandleDevice, Buffer, Buffer_Length, Status, BytesRead);
+    if (plugin->opencbm_plugin_tap_capture)
+        ret = plugin->opencbm_plugin_tap_capture(HandleDevice, Buffer, Buffer_Length, Callback, Context, Status, BytesRead);
 
     FUNC_LEAVE_INT(ret);
 }
@@ -2611,12 +4550,64 @@ cbm_tap_start_capture(CBM_FILE HandleDevice, unsigned char *Buffer, unsigned int
 int CBMAPIDECL
 cbm_tap_start_write(CBM_FILE HandleDevice, unsigned char *Buffer, unsigned int Length, int *Status, int *BytesWritten)
 {
+    opencbm_plugin_t *plugin = &PLUGIN(HandleDevice);
+    int ret = -1;
+
+    FUNC_ENTER();
+
+    if (plugin->opencbm_plugin_tap_start_write)
+        ret = plugin->opencbm_plugin_tap_start_write(HandleDevice, Buffer, Length, Status, BytesWritten);
+
+    FUNC_LEAVE_INT(ret);
+}
+
+/*! \brief TAPE: Write a tape chunk by chunk
+
+ This function is a helper function for tape:
+ It starts the actual tape write, like cbm_tap_start_write(), but
+ gets the data from Callback chunk by chunk. Thus, the caller can
+ prepare the next chunk while the previous one is being written, and
+ the tape data never has to be in memory as a whole.
+
+ \param HandleDevice
+   A CBM_FILE which contains the file handle of the driver.
+
+ \param Callback
+   Called for every chunk to be written; it sets the pointer to the
+   chunk and returns its length, 0 at the end of the data, or < 0 to
+   break off the write as with cbm_tap_break(). A chunk must stay valid
+   until Callback is called again. The first chunk starts with the
+   5 bytes length header, every chunk except the last one must be a
+   multiple of 64 bytes long.
+
+ \param Context
+   Passed unchanged to Callback.
+
+ \param Status
+   The return status.
+
+ \param BytesWritten
+   The number of bytes written in total.
+
+ \return
+   != 0 on success, -1 if the plugin cannot write chunk by chunk.
+
+ If cbm_driver_open() did not succeed, it is illegal to
+ call this function.
+
+ Note that a plugin is not required to implement this function.
+*/
+
+int CBMAPIDECL
+cbm_tap_write(CBM_FILE HandleDevice, cbm_tap_write_callback_t Callback, void *Context, int *Status, int *BytesWritten)
+{
+    opencbm_plugin_t *plugin = &PLUGIN(HandleDevice);
     int ret = -1;
 
     FUNC_ENTER();
 
-    if (Plugin_information.Plugin.opencbm_plugin_tap_start_write)
-        ret = Plugin_information.Plugin.opencbm_plugin_tap_start_write(HandleDevice, Buffer, Length, Status, BytesWritten);
+    if (plugin->opencbm_plugin_tap_write)
+        ret = plugin->opencbm_plugin_tap_write(HandleDevice, Callback, Context, Status, BytesWritten);
 
     FUNC_LEAVE_INT(ret);
 }
@@ -2642,12 +4633,13 @@ cbm_tap_start_write(CBM_FILE HandleDevice, unsigned char *Buffer, unsigned int L
 int CBMAPIDECL
 cbm_tap_get_ver(CBM_FILE HandleDevice, int *Status)
 {
+    opencbm_plugin_t *plugin = &PLUGIN(HandleDevice);
     int ret = -1;
 
     FUNC_ENTER();
 
-    if (Plugin_information.Plugin.opencbm_plugin_tap_get_ver)
-        ret = Plugin_information.Plugin.opencbm_plugin_tap_get_ver(HandleDevice, Status);
+    if (plugin->opencbm_plugin_tap_get_ver)
+        ret = plugin->opencbm_plugin_tap_get_ver(HandleDevice, Status);
 
     FUNC_LEAVE_INT(ret);
 }
@@ -2656,12 +4648,13 @@ cbm_tap_get_ver(CBM_FILE HandleDevice, int *Status)
 int CBMAPIDECL
 cbm_tap_break(CBM_FILE HandleDevice)
 {
+    opencbm_plugin_t *plugin = &PLUGIN(HandleDevice);
     int ret = -1;
 
     FUNC_ENTER();
 
-    if (Plugin_information.Plugin.opencbm_plugin_tap_break)
-        ret = Plugin_information.Plugin.opencbm_plugin_tap_break(HandleDevice);
+    if (plugin->opencbm_plugin_tap_break)
+        ret = plugin->opencbm_plugin_tap_break(HandleDevice);
 
     FUNC_LEAVE_INT(ret);
 }
@@ -2699,12 +4692,13 @@ cbm_tap_break(CBM_FILE HandleDevice)
 int CBMAPIDECL
 cbm_tap_download_config(CBM_FILE HandleDevice, unsigned char *Buffer, unsigned int Buffer_Length, int *Status, int *BytesRead)
 {
+    opencbm_plugin_t *plugin = &PLUGIN(HandleDevice);
     int ret = -1;
 
     FUNC_ENTER();
 
-    if (Plugin_information.Plugin.opencbm_plugin_tap_download_config)
-        ret = Plugin_information.Plugin.opencbm_plugin_tap_download_config(HandleDevice, Buffer, Buffer_Length, Status, BytesRead);
+    if (plugin->opencbm_plugin_tap_download_config)
+        ret = plugin->opencbm_plugin_tap_download_config(HandleDevice, Buffer, Buffer_Length, Status, BytesRead);
 
     FUNC_LEAVE_INT(ret);
 }
@@ -2741,12 +4735,13 @@ cbm_tap_download_config(CBM_FILE HandleDevice, unsigned char *Buffer, unsigned i
 int CBMAPIDECL
 cbm_tap_upload_config(CBM_FILE HandleDevice, unsigned char *Buffer, unsigned int Length, int *Status, int *BytesWritten)
 {
+    opencbm_plugin_t *plugin = &PLUGIN(HandleDevice);
     int ret = -1;
 
     FUNC_ENTER();
 
-    if (Plugin_information.Plugin.opencbm_plugin_tap_upload_config)
-        ret = Plugin_information.Plugin.opencbm_plugin_tap_upload_config(HandleDevice, Buffer, Length, Status, BytesWritten);
+    if (plugin->opencbm_plugin_tap_upload_config)
+        ret = plugin->opencbm_plugin_tap_upload_config(HandleDevice, Buffer, Length, Status, BytesWritten);
 
     FUNC_LEAVE_INT(ret);
 }
@@ -2778,8 +4773,12 @@ cbm_get_plugin_function_address(const char * Functionname)
 
     FUNC_ENTER();
 
-    if (Plugin_information.Library)
-        pointer = plugin_get_address(Plugin_information.Library, Functionname);
+    plugin_lock();
+
+    if (Plugin_last && Plugin_last->Library)
+        pointer = plugin_get_address(Plugin_last->Library, Functionname);
+
+    plugin_unlock();
 
     FUNC_LEAVE_PTR(pointer, void*);
 }
@@ -2810,14 +4809,15 @@ cbm_get_plugin_function_address(const char * Functionname)
 int CBMAPIDECL
 cbm_iec_dbg_read(CBM_FILE HandleDevice)
 {
+    opencbm_plugin_t *plugin = &PLUGIN(HandleDevice);
     int returnValue = -1;
 
     FUNC_ENTER();
 
     FUNC_PARAM((DBG_PREFIX "HandleDevice = %p", HandleDevice));
 
-    if ( Plugin_information.Plugin.opencbm_plugin_iec_dbg_read ) {
-        returnValue = Plugin_information.Plugin.opencbm_plugin_iec_dbg_read(HandleDevice);
+    if ( plugin->opencbm_plugin_iec_dbg_read ) {
+        returnValue = plugin->opencbm_plugin_iec_dbg_read(HandleDevice);
     }
 
     FUNC_LEAVE_INT(returnValue);
@@ -2855,14 +4855,15 @@ cbm_iec_dbg_read(CBM_FILE HandleDevice)
 int CBMAPIDECL
 cbm_iec_dbg_write(CBM_FILE HandleDevice, unsigned char Value)
 {
+    opencbm_plugin_t *plugin = &PLUGIN(HandleDevice);
     int returnValue = -1;
 
     FUNC_ENTER();
 
     FUNC_PARAM((DBG_PREFIX "HandleDevice = %p, Value = %02X", HandleDevice, Value));
 
-    if ( Plugin_information.Plugin.opencbm_plugin_iec_dbg_write ) {
-        returnValue = Plugin_information.Plugin.opencbm_plugin_iec_dbg_write(HandleDevice, Value);
+    if ( plugin->opencbm_plugin_iec_dbg_write ) {
+        returnValue = plugin->opencbm_plugin_iec_dbg_write(HandleDevice, Value);
     }
 
     FUNC_LEAVE_INT(returnValue);
@@ -28,6 +28,7 @@
 #include "debug.h"
 
 #include <stdlib.h>
+#include <string.h>
 
 //! mark: We are building the DLL */
 #define DLL
@@ -38,10 +39,134 @@
 
 /** @{ @ingroup opencbm_dos */
 
+/*! Number of drives remembered by the cbm_identify() cache */
+#define IDENTIFY_CACHE_SIZE 16
+
+/*! One drive remembered by the cbm_identify() cache */
+typedef
+struct identify_cache_entry_s
+{
+    int                    valid;         /*!< != 0 if this entry is in use */
+    CBM_FILE               HandleDevice;  /*!< the handle the drive was identified on */
+    unsigned char          DeviceAddress; /*!< the address of the drive */
+    enum cbm_device_type_e DeviceType;    /*!< the identified device type */
+    const char            *DeviceString;  /*!< the identified name, or DeviceFootprint */
+    char                   DeviceFootprint[sizeof("*unknown*, footprint=<....>")]; /*!< the name of an unknown drive */
+} identify_cache_entry_t;
+
+static identify_cache_entry_t identify_cache[IDENTIFY_CACHE_SIZE];
+static unsigned int identify_cache_next = 0; /*!< next entry to replace */
+
+static identify_cache_entry_t *
+identify_cache_find(CBM_FILE HandleDevice, unsigned char DeviceAddress)
+{
+    unsigned int i;
+
+    for (i = 0; i < IDENTIFY_CACHE_SIZE; i++) {
+        if (identify_cache[i].valid
+            && identify_cache[i].HandleDevice == HandleDevice
+            && identify_cache[i].DeviceAddress == DeviceAddress) {
+            return &identify_cache[i];
+        }
+    }
+
+    return NULL;
+}
+
+static void
+identify_cache_store(CBM_FILE HandleDevice, unsigned char DeviceAddress,
+                     enum cbm_device_type_e DeviceType, const char *DeviceString,
+                     const char *UnknownDevice)
+{
+    identify_cache_entry_t *entry = identify_cache_find(HandleDevice, DeviceAddress);
+
+    if (entry == NULL) {
+        entry = &identify_cache[identify_cache_next];
+        identify_cache_next = (identify_cache_next + 1) % IDENTIFY_CACHE_SIZE;
+    }
+
+    entry->valid         = 1;
+    entry->HandleDevice  = HandleDevice;
+    entry->DeviceAddress = DeviceAddress;
+    entry->DeviceType    = DeviceType;
+
+    if (DeviceString == UnknownDevice) {
+        /* the footprint buffer gets overwritten by the next unknown drive */
+        strcpy(entry->DeviceFootprint, UnknownDevice);
+        entry->DeviceString = entry->DeviceFootprint;
+    }
+    else {
+        entry->DeviceString = DeviceString;
+    }
+}
+
+/*
+ * The SD2IEC and the uIEC have no ROM of a CBM drive, thus, no footprint
+ * at 0xFF40. They tell their name in the message of the "UI" command.
+ * As "UI" resets the DOS of a real drive, it is sent only to drives with
+ * an unknown footprint.
+ */
+static int
+identify_sd2iec(CBM_FILE HandleDevice, unsigned char DeviceAddress)
+{
+    char status[48];
+
+    if (cbm_exec_command(HandleDevice, DeviceAddress, "UI", 2) != 0) {
+        return 0;
+    }
+
+    if (cbm_device_status(HandleDevice, DeviceAddress, status, sizeof status) != 73) {
+        return 0;
+    }
+
+    return strstr(status, "SD2IEC") != NULL || strstr(status, "UIEC") != NULL;
+}
+
+/*! \brief Forget the cached identification of drives
+
+ cbm_identify() remembers the drives it has identified on
+ every handle, so that repeated calls do not need to talk
+ to the drive again. This function makes it forget all
+ drives of a handle, so that the next cbm_identify() asks
+ the drive again. Call it if a drive has been replaced or
+ its ROM has been switched while the handle stays open.
+
+ The cable found by cbm_identify_xp1541() is forgotten, too.
+
+ cbm_reset() and cbm_driver_close() call this function
+ automatically.
+
+ \param HandleDevice
+   A CBM_FILE which contains the file handle of the driver.
+*/
+
+void CBMAPIDECL
+cbm_identify_cache_flush(CBM_FILE HandleDevice)
+{
+    unsigned int i;
+
+    FUNC_ENTER();
+
+    for (i = 0; i < IDENTIFY_CACHE_SIZE; i++) {
+        if (identify_cache[i].HandleDevice == HandleDevice) {
+            identify_cache[i].valid = 0;
+        }
+    }
+
+    cbm_identify_xp1541_cache_flush(HandleDevice);
+
+    FUNC_LEAVE();
+}
+
 /*! \brief Identify the connected floppy drive.
 
  This function tries to identify a connected floppy drive.
- For this, it performs some M-R operations.
+ For this, it performs some M-R operations. A drive with an
+ unknown footprint gets a "UI" command, too, which tells if
+ it is a SD2IEC. The result is
+ remembered for the handle, so that later calls for the same
+ drive return without any bus traffic, until
+ cbm_identify_cache_flush() is called.
 
  \param HandleDevice
    A CBM_FILE which contains the file handle of the driver.
@@ -87,6 +212,14 @@ cbm_identify(CBM_FILE HandleDevice, unsigned char DeviceAddress,
 
     do {
         uint8_t buf[2];
+        identify_cache_entry_t *cached = identify_cache_find(HandleDevice, DeviceAddress);
+
+        if (cached) {
+            deviceType   = cached->DeviceType;
+            deviceString = (char *) cached->DeviceString;
+            rv = 0;
+            break;
+        }
 
         /* get footprint from 0xFF40 */
         if ((rv = cbm_dos_memory_read(HandleDevice, buf, sizeof buf, DeviceAddress, 0xFF40u, 2, NULL, NULL)) < 0) {
@@ -240,8 +373,16 @@ cbm_identify(CBM_FILE HandleDevice, unsigned char DeviceAddress,
                 break;
         }
 
+        if (deviceType == cbm_dt_unknown
+            && identify_sd2iec(HandleDevice, DeviceAddress)) {
+            deviceType = cbm_dt_sd2iec;
+            deviceString = "SD2IEC";
+        }
+
         rv = 0;
 
+        identify_cache_store(HandleDevice, DeviceAddress, deviceType, deviceString, unknownDevice);
+
     } while (0);
 
 
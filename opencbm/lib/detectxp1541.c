@@ -38,6 +38,90 @@
 
 /** @{ @ingroup opencbm_dos */
 
+/*! Number of drives remembered by the cbm_identify_xp1541() cache */
+#define XP1541_CACHE_SIZE 16
+
+/*! One drive remembered by the cbm_identify_xp1541() cache */
+typedef
+struct xp1541_cache_entry_s
+{
+    int                    valid;         /*!< != 0 if this entry is in use */
+    CBM_FILE               HandleDevice;  /*!< the handle the cable was tested on */
+    unsigned char          DeviceAddress; /*!< the address of the drive */
+    enum cbm_device_type_e DeviceType;    /*!< the device type the cable was tested for */
+    enum cbm_cable_type_e  CableType;     /*!< the detected cable type */
+} xp1541_cache_entry_t;
+
+static xp1541_cache_entry_t xp1541_cache[XP1541_CACHE_SIZE];
+static unsigned int xp1541_cache_next = 0; /*!< next entry to replace */
+
+static xp1541_cache_entry_t *
+xp1541_cache_find(CBM_FILE HandleDevice, unsigned char DeviceAddress)
+{
+    unsigned int i;
+
+    for (i = 0; i < XP1541_CACHE_SIZE; i++) {
+        if (xp1541_cache[i].valid
+            && xp1541_cache[i].HandleDevice == HandleDevice
+            && xp1541_cache[i].DeviceAddress == DeviceAddress) {
+            return &xp1541_cache[i];
+        }
+    }
+
+    return NULL;
+}
+
+static void
+xp1541_cache_store(CBM_FILE HandleDevice, unsigned char DeviceAddress,
+                   enum cbm_device_type_e DeviceType, enum cbm_cable_type_e CableType)
+{
+    xp1541_cache_entry_t *entry = xp1541_cache_find(HandleDevice, DeviceAddress);
+
+    if (entry == NULL) {
+        entry = &xp1541_cache[xp1541_cache_next];
+        xp1541_cache_next = (xp1541_cache_next + 1) % XP1541_CACHE_SIZE;
+    }
+
+    entry->valid         = 1;
+    entry->HandleDevice  = HandleDevice;
+    entry->DeviceAddress = DeviceAddress;
+    entry->DeviceType    = DeviceType;
+    entry->CableType     = CableType;
+}
+
+/*! \brief Forget the cached cable detection of drives
+
+ cbm_identify_xp1541() remembers the cable it has found for
+ every drive of a handle, as the test writes to the PIA of
+ the drive and waits for it twice. This function makes it
+ forget all drives of a handle, so that the next
+ cbm_identify_xp1541() tests the cable again. Call it if a
+ cable has been connected or removed while the handle stays
+ open.
+
+ cbm_identify_cache_flush() calls this function, thus, so do
+ cbm_reset() and cbm_driver_close().
+
+ \param HandleDevice
+   A CBM_FILE which contains the file handle of the driver.
+*/
+
+void CBMAPIDECL
+cbm_identify_xp1541_cache_flush(CBM_FILE HandleDevice)
+{
+    unsigned int i;
+
+    FUNC_ENTER();
+
+    for (i = 0; i < XP1541_CACHE_SIZE; i++) {
+        if (xp1541_cache[i].HandleDevice == HandleDevice) {
+            xp1541_cache[i].valid = 0;
+        }
+    }
+
+    FUNC_LEAVE();
+}
+
 /*! \brief \internal Set the PIA back to input mode
 
  This function sets the parallel port PIA back to input mode.
@@ -203,7 +287,9 @@ cbm_determine_pport_address(enum cbm_device_type_e CbmDeviceType)
 /*! \brief Identify the cable connected to a specific floppy drive.
 
  This function tries to identify if the given floppy drive has an
- XP1541 cable connected.
+ XP1541 cable connected. The result is remembered for the handle,
+ so that later calls for the same drive return without any bus
+ traffic, until cbm_identify_xp1541_cache_flush() is called.
 
  \param HandleDevice
    A CBM_FILE which contains the file handle of the driver.
@@ -244,6 +330,8 @@ cbm_identify_xp1541(CBM_FILE HandleDevice, unsigned char DeviceAddress,
     do
     {
         unsigned int piaAddress;
+        xp1541_cache_entry_t *cached;
+        int test;
         DBGDO(int value);
 
         if (!CableType)
@@ -265,6 +353,16 @@ cbm_identify_xp1541(CBM_FILE HandleDevice, unsigned char DeviceAddress,
         if (!CbmDeviceType)
             CbmDeviceType = &localDummyDeviceType;
 
+        cached = xp1541_cache_find(HandleDevice, DeviceAddress);
+
+        if (cached && (*CbmDeviceType == cbm_dt_unknown
+                       || *CbmDeviceType == cached->DeviceType))
+        {
+            *CbmDeviceType = cached->DeviceType;
+            *CableType = cached->CableType;
+            break;
+        }
+
         if (*CbmDeviceType == cbm_dt_unknown)
         {
             ret = cbm_identify(HandleDevice, DeviceAddress,
@@ -289,7 +387,10 @@ cbm_identify_xp1541(CBM_FILE HandleDevice, unsigned char DeviceAddress,
          * cable could be located. This, report "no parallel cable".
          */
         if (piaAddress == 0)
+        {
+            xp1541_cache_store(HandleDevice, DeviceAddress, *CbmDeviceType, *CableType);
             break;
+        }
 
         /*
          * Set parallel port into input mode.
@@ -301,11 +402,21 @@ cbm_identify_xp1541(CBM_FILE HandleDevice, unsigned char DeviceAddress,
         /*
          * Try to write some patterns and check if we see them:
          */
-        if (output_pia(HandleDevice, DeviceAddress, piaAddress, 0x55))
-            break;
+        test = output_pia(HandleDevice, DeviceAddress, piaAddress, 0x55);
+
+        if (test == 0)
+            test = output_pia(HandleDevice, DeviceAddress, piaAddress, 0xAA);
 
-        if (output_pia(HandleDevice, DeviceAddress, piaAddress, 0xAA))
+        if (test)
+        {
+            /*
+             * Only remember a pattern which was not read back; if the
+             * drive did not answer, the next call tries again.
+             */
+            if (test > 0)
+                xp1541_cache_store(HandleDevice, DeviceAddress, *CbmDeviceType, *CableType);
             break;
+        }
 
         /*
          * Ok, it has worked: We have a parallel cable.
@@ -322,6 +433,8 @@ cbm_identify_xp1541(CBM_FILE HandleDevice, unsigned char DeviceAddress,
             pia_to_inputmode(HandleDevice, DeviceAddress, piaAddress);
         }
 
+        xp1541_cache_store(HandleDevice, DeviceAddress, *CbmDeviceType, *CableType);
+
     } while (0);
 
     FUNC_LEAVE_INT(ret);
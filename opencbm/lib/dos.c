@@ -27,6 +27,7 @@
 #include "debug.h"
 
 #include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
 
 /** mark: We are building the DLL */
@@ -67,6 +68,7 @@
  *
  * - cbm_dos_memory_read()
  * - cbm_dos_memory_write()
+ * - cbm_dos_dir_block_read()
  *
  * These functions can be configured with the help of:
  *
@@ -78,6 +80,7 @@
 /** @{ @ingroup opencbm_dos */
 
 #define CBM_DOS_MAX_MEMORY_READ  0x100 /**< @brief maximum number of bytes that can be read with M-R command */
+#define CBM_DOS_BATCH_MEMORY_READ 0x400 /**< @brief maximum number of bytes cbm_dos_memory_read() reads with one cbm_batch_memory_read() */
 #define CBM_DOS_MAX_MEMORY_WRITE 0x23  /**< @brief maximum number of bytes that can be written with M-W command */
 
 /** @brief DOS1 compatibility flag
@@ -1469,6 +1472,16 @@ cbm_dos_memory_write_set_max_retries(
    Of course, writing to working areas (page 0, 1 and 2) can be problematic
    as it might disturb the transmission or the operation of the floppy drive.
    \n
+   If no retries are set with cbm_dos_memory_write_set_max_retries(), the
+   M-W commands are sent with deferred status (cf. cbm_set_deferred_status())
+   and only checked at the end. \n
+   \n
+   If the adapter keeps this drive code on its own (cf.
+   cbm_adapter_code_upload()), only the checksum of it is sent. \n
+   \n
+   If the adapter can run the M-W commands on its own (cf.
+   cbm_adapter_memory_write()), it is used for as much as it succeeds. \n
+   \n
    This function works on all floppy drives.
 */
 int CBMAPIDECL
@@ -1493,9 +1506,82 @@ cbm_dos_memory_write(
 
     int retrycounter;
 
+    int deferred_status_old = -1;
+
+    int adapter_done;
+
+    int adapter_reported = -1;
+
     FUNC_ENTER();
 
-    for (offset_start = 0; offset_start < Count; offset_start += count_missing) {
+    /* The adapter knows drive code by all of it, so try this before
+     * splitting it up into pages. If it has not written all of it,
+     * all of it is written again below.
+     */
+    if (Count != 0
+            && cbm_adapter_code_upload(HandleDevice, DeviceAddress,
+                MemoryAddress, Buffer, Count) == Count) {
+        if (Callback) {
+            Callback(
+                    Callback_Context,
+                    MemoryAddress + Count,
+                    MemoryAddress + Count,
+                    0,
+                    100
+                    );
+        }
+        FUNC_LEAVE_INT(0);
+    }
+
+    /* Let the adapter run the M-W commands on its own if it can.
+     * It gets one page at a time, so the callback is still called
+     * as often as below. If it fails, the loop below takes over.
+     */
+    for (adapter_done = 0; adapter_done < Count; adapter_done += rv) {
+        count_missing = Count - adapter_done;
+        if (count_missing > 0x100) {
+            count_missing = 0x100;
+        }
+
+        if (Callback
+                && Callback(
+                    Callback_Context,
+                    MemoryAddress + adapter_done,
+                    MemoryAddress + adapter_done + count_missing - 1,
+                    count_missing,
+                    (100 * adapter_done) / Count
+                    )
+           )
+        {
+            FUNC_LEAVE_INT(-1);
+        }
+        adapter_reported = adapter_done;
+
+        rv = cbm_adapter_memory_write(HandleDevice, DeviceAddress,
+                MemoryAddress + adapter_done, Buffer + adapter_done, count_missing);
+
+        if (rv != count_missing) {
+            if (rv > 0) {
+                adapter_done += rv;
+            }
+            rv = -1;
+            break;
+        }
+    }
+    /* the page the adapter has failed on has been reported already */
+    callback_next = adapter_reported < 0 ? adapter_done : adapter_reported + 0x100;
+    if (Count != 0 && adapter_done == Count) {
+        rv = 0;
+    }
+
+    /* Without retries, there is no need to check each M-W on its own,
+     * so let the driver queue them and check for errors at the end.
+     */
+    if (cbm_dos_memory_write_max_retries == 0 && adapter_done != Count) {
+        deferred_status_old = cbm_set_deferred_status(HandleDevice, 1);
+    }
+
+    for (offset_start = adapter_done; offset_start < Count; offset_start += count_missing) {
 
         /* how many bytes are left? */
         count_missing = Count - offset_start;
@@ -1540,6 +1626,13 @@ cbm_dos_memory_write(
         }
     }
 
+    if (deferred_status_old >= 0) {
+        if (cbm_flush_deferred_status(HandleDevice) != 0) {
+            rv = -1;
+        }
+        cbm_set_deferred_status(HandleDevice, deferred_status_old);
+    }
+
     if (rv == 0 && Callback) {
         Callback(
                 Callback_Context,
@@ -1603,6 +1696,11 @@ cbm_dos_memory_write(
    cbm_dos_cmd_memory_read_dos1(). It can read up to 64 KB of memory
    at once. \n
    \n
+   If the adapter can run the M-R commands on its own (cf.
+   cbm_adapter_memory_read()), it is used for every part that it reads
+   completely. Otherwise, if the driver supports batches, several M-R
+   commands are pipelined in one batch (cf. cbm_batch_memory_read()). \n
+   \n
    This function works on all floppy drives.
 */
 int CBMAPIDECL
@@ -1632,8 +1730,14 @@ cbm_dos_memory_read(
 
     int retrycounter;
 
+    int use_adapter;
+    int use_batch;
+
     FUNC_ENTER();
 
+    use_adapter = !cbm_dos_dos1_compatibility;
+    use_batch = !cbm_dos_dos1_compatibility;
+
     if (cbm_dos_dos1_compatibility) {
         memory_read_max = 1;
     }
@@ -1655,15 +1759,26 @@ cbm_dos_memory_read(
         /* how many bytes are left? */
         count_missing = offset_end - offset_start;
 
-        /* if we need more byte than we can read at once, limit the number of bytes
-         * to read to the maximum
+        /* Once it is known that the adapter cannot run the M-R commands,
+         * pipeline several of them in one batch. The batch takes care of
+         * the page boundaries on its own.
          */
-        if (count_missing > memory_read_max) {
-            count_missing = memory_read_max;
+        if (use_batch && !use_adapter && count_missing <= BufferSize - buffer_write_offset) {
+            if (count_missing > CBM_DOS_BATCH_MEMORY_READ) {
+                count_missing = CBM_DOS_BATCH_MEMORY_READ;
+            }
         }
+        else {
+            /* if we need more byte than we can read at once, limit the number of bytes
+             * to read to the maximum
+             */
+            if (count_missing > memory_read_max) {
+                count_missing = memory_read_max;
+            }
 
-        if ((offset_start & 0xFFu) + count_missing > 0x100) {
-            count_missing = 0x100 - (offset_start & 0xFFu);
+            if ((offset_start & 0xFFu) + count_missing > 0x100) {
+                count_missing = 0x100 - (offset_start & 0xFFu);
+            }
         }
 
         if (Callback
@@ -1680,6 +1795,46 @@ cbm_dos_memory_read(
             break;
         }
 
+        /* Let the adapter run the M-R command on its own if it can.
+         * Anything but a complete read is done again the usual way below,
+         * which knows how to handle the special cases.
+         */
+        if (use_adapter && count_missing <= BufferSize - buffer_write_offset) {
+            rv = cbm_adapter_memory_read(HandleDevice, DeviceAddress,
+                    memory_page + offset_start, Buffer + buffer_write_offset, count_missing);
+            if (rv == count_missing) {
+                buffer_write_offset += count_missing;
+                rv = 0;
+                continue;
+            }
+            if (rv < 0) {
+                use_adapter = 0;
+            }
+        }
+        else if (use_batch && count_missing <= BufferSize - buffer_write_offset) {
+            rv = cbm_batch_memory_read(HandleDevice, DeviceAddress,
+                    memory_page + offset_start, Buffer + buffer_write_offset, count_missing);
+            if (rv > 0) {
+                /* everything up to the first failed M-R command */
+                count_missing = rv;
+                buffer_write_offset += count_missing;
+                rv = 0;
+                continue;
+            }
+            if (rv < 0) {
+                use_batch = 0;
+            }
+
+            /* the first M-R command failed: do it again the usual way */
+            count_missing = offset_end - offset_start;
+            if (count_missing > memory_read_max) {
+                count_missing = memory_read_max;
+            }
+            if ((offset_start & 0xFFu) + count_missing > 0x100) {
+                count_missing = 0x100 - (offset_start & 0xFFu);
+            }
+        }
+
         for (retrycounter = cbm_dos_memory_read_max_retries; retrycounter >= 0; --retrycounter) {
             if (cbm_dos_dos1_compatibility) {
                 rv = cbm_dos_cmd_memory_read_dos1(HandleDevice, Buffer + buffer_write_offset, BufferSize - buffer_write_offset,
@@ -1772,4 +1927,264 @@ cbm_dos_channel_read(
     FUNC_LEAVE_INT(rv);
 }
 
+/*! Number of drives whose directory track cbm_dos_dir_block_read() remembers */
+#define DIR_CACHE_SIZE 16
+
+/*! The blocks of a directory track that can be remembered: the 40 of the 1581 */
+#define DIR_CACHE_SECTORS 40
+
+/*! The directory track of one drive remembered by cbm_dos_dir_block_read() */
+typedef
+struct dir_cache_entry_s
+{
+    int       valid;         /*!< != 0 if this entry is in use */
+    CBM_FILE  HandleDevice;  /*!< the handle the blocks were read on */
+    uint8_t   DeviceAddress; /*!< the address of the drive */
+    uint8_t   Track;         /*!< the directory track */
+    int       validated;     /*!< != 0: the BAM has been compared since the last command which may have changed the disk */
+    uint8_t   cached[DIR_CACHE_SECTORS]; /*!< != 0: the block is in Blocks */
+    uint8_t * Blocks;        /*!< 256 bytes for every block of the track */
+} dir_cache_entry_t;
+
+static dir_cache_entry_t dir_cache[DIR_CACHE_SIZE];
+static unsigned int dir_cache_next = 0; /*!< next entry to replace */
+
+static dir_cache_entry_t *
+dir_cache_find(CBM_FILE HandleDevice, uint8_t DeviceAddress)
+{
+    unsigned int i;
+
+    for (i = 0; i < DIR_CACHE_SIZE; i++) {
+        if (dir_cache[i].valid
+            && dir_cache[i].HandleDevice == HandleDevice
+            && dir_cache[i].DeviceAddress == DeviceAddress) {
+            return &dir_cache[i];
+        }
+    }
+
+    return NULL;
+}
+
+/*! \internal Remember the BAM block just read; if it has changed, forget the other blocks */
+static void
+dir_cache_store_bam(CBM_FILE HandleDevice, uint8_t DeviceAddress, uint8_t Track, const uint8_t *Block)
+{
+    dir_cache_entry_t *entry = dir_cache_find(HandleDevice, DeviceAddress);
+
+    if (entry == NULL) {
+        entry = &dir_cache[dir_cache_next];
+        dir_cache_next = (dir_cache_next + 1) % DIR_CACHE_SIZE;
+        entry->valid = 0;
+    }
+
+    if (entry->Blocks == NULL) {
+        entry->Blocks = malloc(DIR_CACHE_SECTORS * 256);
+        if (entry->Blocks == NULL) {
+            entry->valid = 0;
+            return;
+        }
+    }
+
+    if (!entry->valid || entry->Track != Track || !entry->cached[0]
+        || memcmp(entry->Blocks, Block, 256) != 0)
+    {
+        memset(entry->cached, 0, sizeof entry->cached);
+        memcpy(entry->Blocks, Block, 256);
+        entry->cached[0] = 1;
+    }
+
+    entry->valid         = 1;
+    entry->HandleDevice  = HandleDevice;
+    entry->DeviceAddress = DeviceAddress;
+    entry->Track         = Track;
+    entry->validated     = 1;
+}
+
+/*! \internal Read a block with U1 into a DOS buffer, and get it with a memory read */
+static int
+dos_block_read(CBM_FILE HandleDevice, uint8_t DeviceAddress, uint8_t Channel,
+               uint8_t BufferNumber, uint8_t Track, uint8_t Sector, uint8_t *Block)
+{
+    char status[40];
+
+    if (cbm_dos_cmd_u1_block_read(HandleDevice, DeviceAddress, Channel, 0, Track, Sector) < 0) {
+        return -1;
+    }
+
+    if (cbm_device_status(HandleDevice, DeviceAddress, status, sizeof status) != 0) {
+        DBG_WARN((DBG_PREFIX "reading block %u/%u failed: %s", Track, Sector, status));
+        return -1;
+    }
+
+    if (cbm_dos_memory_read(HandleDevice, Block, 256, DeviceAddress,
+                            (uint16_t) (0x300 + BufferNumber * 0x100), 256, NULL, NULL) != 0) {
+        return -1;
+    }
+
+    return 0;
+}
+
+/** @brief DOS: Read a block of the directory track
+
+ This function reads a block with U1 into the buffer of a channel,
+ and gets it from there with cbm_dos_memory_read().
+
+ The blocks of the directory track are remembered for every drive,
+ across calls: the BAM (sector 0) is read from the disk every time,
+ but as long as it has not changed, the other blocks of the track are
+ taken from the cache. Thus, a directory listing costs one block read
+ as long as the disk has not been written to. If a block other than
+ the BAM is asked for after a command which may have changed the disk,
+ the BAM is read and compared first.
+
+ @param[in] HandleDevice
+   A CBM_FILE which contains the file handle of the driver.
+
+ @param[in] DeviceAddress
+   The address of the device on the IEC serial bus. This
+   is known as primary address, too.
+
+ @param[in] Channel
+   The channel opened with cbm_dos_open_channel_specific().
+
+ @param[in] BufferNumber
+   The buffer the channel has been opened on. The buffers must start
+   at 0x0300, one page each, as with the 1541, 1570, 1571 and 1581.
+
+ @param[in] Track
+   The directory track: 18 for the 1541, 1570 and 1571, 40 for the 1581.
+
+ @param[in] Sector
+   The number of the sector that should be read.
+
+ @param[out] Block
+   A buffer of 256 bytes for the block.
+
+ @retval 0 if the block has been read
+ @retval "< 0" if an error occurred
+
+ @remark
+   - The cache of a drive is only kept as long as its BAM does not
+     change. Commands sent with cbm_exec_command() and files opened with
+     cbm_open() make the next call compare the BAM again, except for
+     commands and channels which only read. If a program changes a
+     directory entry in another way, without changing the BAM, it
+     must call cbm_dos_dir_cache_invalidate().
+   - cbm_reset() and cbm_driver_close() forget all drives of the
+     handle, cf. cbm_dos_dir_cache_flush().
+*/
+int CBMAPIDECL
+cbm_dos_dir_block_read(
+        CBM_FILE  HandleDevice,
+        uint8_t   DeviceAddress,
+        uint8_t   Channel,
+        uint8_t   BufferNumber,
+        uint8_t   Track,
+        uint8_t   Sector,
+        uint8_t * Block
+        )
+{
+    dir_cache_entry_t *entry;
+    uint8_t bam[256];
+    int rv = -1;
+
+    FUNC_ENTER();
+
+    do {
+        entry = dir_cache_find(HandleDevice, DeviceAddress);
+
+        if (Sector != 0 && Sector < DIR_CACHE_SECTORS
+            && entry != NULL && entry->Track == Track && entry->cached[Sector])
+        {
+            if (!entry->validated) {
+                if (dos_block_read(HandleDevice, DeviceAddress, Channel, BufferNumber, Track, 0, bam) < 0) {
+                    break;
+                }
+                dir_cache_store_bam(HandleDevice, DeviceAddress, Track, bam);
+            }
+
+            if (entry->valid && entry->Track == Track && entry->cached[Sector]) {
+                memcpy(Block, entry->Blocks + Sector * 256, 256);
+                rv = 0;
+                break;
+            }
+        }
+
+        if ((rv = dos_block_read(HandleDevice, DeviceAddress, Channel, BufferNumber, Track, Sector, Block)) < 0) {
+            break;
+        }
+
+        if (Sector == 0) {
+            dir_cache_store_bam(HandleDevice, DeviceAddress, Track, Block);
+        }
+        else {
+            entry = dir_cache_find(HandleDevice, DeviceAddress);
+
+            if (entry != NULL && entry->validated && entry->Track == Track && Sector < DIR_CACHE_SECTORS) {
+                memcpy(entry->Blocks + Sector * 256, Block, 256);
+                entry->cached[Sector] = 1;
+            }
+        }
+
+    } while (0);
+
+    FUNC_LEAVE_INT(rv);
+}
+
+/** @brief DOS: Compare the BAM of a drive again before using its cached directory
+
+ After this call, cbm_dos_dir_block_read() reads the BAM of the drive
+ again before it takes another block of the directory track from the
+ cache.
+
+ cbm_exec_command() and cbm_open() call this function for everything
+ which may change the disk.
+
+ @param[in] HandleDevice
+   A CBM_FILE which contains the file handle of the driver.
+
+ @param[in] DeviceAddress
+   The address of the device on the IEC serial bus. This
+   is known as primary address, too.
+*/
+void CBMAPIDECL
+cbm_dos_dir_cache_invalidate(
+        CBM_FILE  HandleDevice,
+        uint8_t   DeviceAddress
+        )
+{
+    dir_cache_entry_t *entry = dir_cache_find(HandleDevice, DeviceAddress);
+
+    if (entry != NULL) {
+        entry->validated = 0;
+    }
+}
+
+/** @brief DOS: Forget the cached directory tracks of all drives of a handle
+
+ cbm_reset() and cbm_driver_close() call this function.
+
+ @param[in] HandleDevice
+   A CBM_FILE which contains the file handle of the driver.
+*/
+void CBMAPIDECL
+cbm_dos_dir_cache_flush(
+        CBM_FILE  HandleDevice
+        )
+{
+    unsigned int i;
+
+    FUNC_ENTER();
+
+    for (i = 0; i < DIR_CACHE_SIZE; i++) {
+        if (dir_cache[i].HandleDevice == HandleDevice) {
+            dir_cache[i].valid = 0;
+            free(dir_cache[i].Blocks);
+            dir_cache[i].Blocks = NULL;
+        }
+    }
+
+    FUNC_LEAVE();
+}
+
 /** @} */
@@ -33,6 +33,14 @@
 
 /** @{ @ingroup opencbm_dos */
 
+    /* 255 denotes illegal GCR bytes, for error checking extensions */
+static const unsigned char decodeGCR[32] =
+    {255,255,255,255,255,255,255,255,255,  8,  0,  1,255, 12,  4,  5,
+     255,255,  2,  3,255, 15,  6,  7,255,  9, 10, 11,255, 13, 14,255 };
+
+static const unsigned char encodeGCR[16] =
+    { 10, 11, 18, 19, 14, 15, 22, 23, 9, 25, 26, 27, 13, 29, 30, 21 };
+
 /*! \brief Decode GCR data
 
  This function decodes a buffer of 5 GCR bytes into a buffer
@@ -108,11 +116,6 @@ gcr_5_to_4_decode(const unsigned char *source, unsigned char *dest,
     {
         int i;
 
-            /* 255 denotes illegal GCR bytes, for error checking extensions */
-        static const unsigned char decodeGCR[32] =
-            {255,255,255,255,255,255,255,255,255,  8,  0,  1,255, 12,  4,  5,
-             255,255,  2,  3,255, 15,  6,  7,255,  9, 10, 11,255, 13, 14,255 };
-
             /* at least 24 bits for shifting into bits 16...20 */
         register unsigned int tdest, nybble;
 
@@ -231,8 +234,6 @@ gcr_4_to_5_encode(const unsigned char *source, unsigned char *dest,
     }
     else
     {
-        static const unsigned char encodeGCR[16] =
-            { 10, 11, 18, 19, 14, 15, 22, 23, 9, 25, 26, 27, 13, 29, 30, 21 };
         int i;
             /* at least 16 bits for overflow shifting */
         register unsigned int tdest = 0;
@@ -268,4 +269,187 @@ gcr_4_to_5_encode(const unsigned char *source, unsigned char *dest,
     return rv;
 }
 
+/*! \brief Decode a whole track (or block) of GCR data
+
+ This function decodes consecutive groups of 5 GCR bytes into
+ groups of 4 plain bytes in one call. It yields the same
+ result as calling gcr_5_to_4_decode() for every group in
+ turn, but without the per-group call and bounds checking
+ overhead, which makes it the function of choice for decoding
+ complete sectors or tracks.
+
+ \param source
+   The pointer to the source buffer of read-only GCR bytes
+
+ \param dest
+   The pointer to the destination buffer of plain bytes
+
+ \param sourceLength
+   The size of the source buffer.
+
+ \param destLength
+   The size of the destination buffer.
+
+ \return
+   -1 means failure due to invalid buffer pointers. Otherwise,
+   the number of 5 byte groups which contained illegal GCR
+   nybble codes is returned, thus 0 means success.
+
+ Remarks:
+
+ Exactly min(sourceLength / 5, destLength / 4) groups are
+ converted. Trailing bytes which do not make up a complete
+ group are left alone; use gcr_5_to_4_decode() to convert
+ them partially.
+
+ The buffers must either be distinct, or dest must be equal
+ to source for an in-place conversion.
+*/
+
+int CBMAPIDECL
+gcr_5_to_4_decode_track(const unsigned char *source, unsigned char *dest,
+                        size_t sourceLength,         size_t destLength)
+{
+    int rv;
+
+    FUNC_ENTER();
+
+    DBG_ASSERT( (source != NULL ) && (dest != NULL) );
+    DBG_ASSERT( (dest == source) || (dest + destLength <= source)
+                                 || (dest >= source + sourceLength) );
+
+    if( (source == NULL) || (dest == NULL) )
+    {
+        rv = -1;
+    }
+    else
+    {
+        size_t groups = sourceLength / 5;
+
+        if (groups > destLength / 4)
+        {
+            groups = destLength / 4;
+        }
+
+        rv = 0;
+
+        for(; groups > 0; groups--, source += 5, dest += 4)
+        {
+                /* the first 32 of the 40 GCR bits of this group */
+            register unsigned long tsrc =
+                  ((unsigned long) source[0] << 24)
+                | ((unsigned long) source[1] << 16)
+                | ((unsigned long) source[2] <<  8)
+                |  (unsigned long) source[3];
+            register unsigned char last = source[4];
+
+            unsigned char n0 = decodeGCR[ (tsrc >> 27) & 0x1f ];
+            unsigned char n1 = decodeGCR[ (tsrc >> 22) & 0x1f ];
+            unsigned char n2 = decodeGCR[ (tsrc >> 17) & 0x1f ];
+            unsigned char n3 = decodeGCR[ (tsrc >> 12) & 0x1f ];
+            unsigned char n4 = decodeGCR[ (tsrc >>  7) & 0x1f ];
+            unsigned char n5 = decodeGCR[ (tsrc >>  2) & 0x1f ];
+            unsigned char n6 = decodeGCR[ ((tsrc << 3) | (last >> 5)) & 0x1f ];
+            unsigned char n7 = decodeGCR[ last & 0x1f ];
+
+                // illegal codes decode to 255, legal ones never
+                // have any of the upper nybble bits set
+            if ((n0 | n1 | n2 | n3 | n4 | n5 | n6 | n7) & 0xf0)
+            {
+                rv++;
+            }
+
+            dest[0] = (unsigned char) ((n0 << 4) | (n1 & 0x0f));
+            dest[1] = (unsigned char) ((n2 << 4) | (n3 & 0x0f));
+            dest[2] = (unsigned char) ((n4 << 4) | (n5 & 0x0f));
+            dest[3] = (unsigned char) ((n6 << 4) | (n7 & 0x0f));
+        }
+    }
+
+    FUNC_LEAVE_INT(rv);
+    return rv;
+}
+
+/*! \brief Encode a whole track (or block) into GCR data
+
+ This function encodes consecutive groups of 4 plain bytes
+ into groups of 5 GCR bytes in one call. It yields the same
+ result as calling gcr_4_to_5_encode() for every group in
+ turn, but without the per-group call overhead.
+
+ \param source
+   The pointer to the source buffer of read-only plain bytes
+
+ \param dest
+   The pointer to the destination buffer of GCR bytes
+
+ \param sourceLength
+   The size of the source buffer.
+
+ \param destLength
+   The size of the destination buffer.
+
+ \return
+   0 means success, -1 means failure due to invalid buffer
+   pointers.
+
+ Remarks:
+
+ Exactly min(sourceLength / 4, destLength / 5) groups are
+ converted. Trailing bytes which do not make up a complete
+ group are left alone; use gcr_4_to_5_encode() to convert
+ them partially.
+
+ The buffers must not overlap, since the output is larger
+ than the input.
+*/
+
+int CBMAPIDECL
+gcr_4_to_5_encode_track(const unsigned char *source, unsigned char *dest,
+                        size_t sourceLength,         size_t destLength)
+{
+    int rv;
+
+    FUNC_ENTER();
+
+    DBG_ASSERT( (source != NULL ) && (dest != NULL) );
+    DBG_ASSERT( (dest + destLength <= source) || (dest >= source + sourceLength) );
+
+    if( (source == NULL) || (dest == NULL) )
+    {
+        rv = -1;
+    }
+    else
+    {
+        size_t groups = sourceLength / 4;
+
+        if (groups > destLength / 5)
+        {
+            groups = destLength / 5;
+        }
+
+        rv = 0;
+
+        for(; groups > 0; groups--, source += 4, dest += 5)
+        {
+                /* 10 GCR bits for every plain byte */
+            register unsigned int p0, p1, p2, p3;
+
+            p0 = (encodeGCR[source[0] >> 4] << 5) | encodeGCR[source[0] & 0x0f];
+            p1 = (encodeGCR[source[1] >> 4] << 5) | encodeGCR[source[1] & 0x0f];
+            p2 = (encodeGCR[source[2] >> 4] << 5) | encodeGCR[source[2] & 0x0f];
+            p3 = (encodeGCR[source[3] >> 4] << 5) | encodeGCR[source[3] & 0x0f];
+
+            dest[0] = (unsigned char) ( p0 >> 2);
+            dest[1] = (unsigned char) ((p0 << 6) | (p1 >> 4));
+            dest[2] = (unsigned char) ((p1 << 4) | (p2 >> 6));
+            dest[3] = (unsigned char) ((p2 << 2) | (p3 >> 8));
+            dest[4] = (unsigned char) ( p3);
+        }
+    }
+
+    FUNC_LEAVE_INT(rv);
+    return rv;
+}
+
 /** @} */
@@ -8,6 +8,7 @@
 */
 
 #include <fcntl.h>
+#include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <sys/ioctl.h>
@@ -17,16 +18,31 @@
 #include "opencbm.h"
 #include "cbm_module.h"
 
-static char *cbm_dev_name = "/dev/cbm";
+static char cbm_dev_name[32];
 
-const char *opencbm_plugin_get_driver_name(int port)
+/*
+ * Port "0" (or none) is /dev/cbm, the first port of the driver;
+ * port "N" is /dev/cbmN, one of the further ports of the driver.
+ */
+const char *opencbm_plugin_get_driver_name(const char * const Port)
 {
+    int portNumber = 0;
+
+    if(Port != NULL) {
+        portNumber = strtoul(Port, NULL, 10);
+    }
+
+    if(portNumber == 0) {
+        strcpy(cbm_dev_name, "/dev/cbm");
+    } else {
+        snprintf(cbm_dev_name, sizeof(cbm_dev_name), "/dev/cbm%d", portNumber);
+    }
     return cbm_dev_name;
 }
 
-int opencbm_plugin_driver_open(CBM_FILE *f, int port)
+int opencbm_plugin_driver_open(CBM_FILE *f, const char * const Port)
 {
-    *f = open(cbm_dev_name, O_RDWR);
+    *f = open(opencbm_plugin_get_driver_name(Port), O_RDWR);
     return (*f < 0) ? -1 : 0; /* FIXME */
 }
 
@@ -197,3 +213,23 @@ void opencbm_plugin_iec_setrelease(CBM_FILE f, int set, int release)
     int arg = (set<<8) | release;
     ioctl(f, CBMCTRL_IEC_SETRELEASE, &arg);
 }
+
+int opencbm_plugin_iec_program(CBM_FILE f, unsigned char *program, unsigned int length)
+{
+    PARBURST_RW_VALUE mv;
+    int rv;
+
+    mv.buffer = program;
+    mv.length = length;
+    rv = ioctl(f, CBMCTRL_IEC_PROGRAM, &mv);
+#ifdef __FreeBSD__
+    /* the FreeBSD driver returns the number of operations in mv.length */
+    if (rv == 0)
+        return mv.length;
+#endif
+    if (rv >= 0)
+        return rv;
+    if ((errno == EINVAL) || (errno == ENOTTY))
+        return -2; /* the driver cannot run programs */
+    return (errno == EINTR) ? 0 : -1;
+}
@@ -0,0 +1,176 @@
+/*
+ *  This program is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU General Public License
+ *  as published by the Free Software Foundation; either version
+ *  2 of the License, or (at your option) any later version.
+*/
+
+#include <stdlib.h>
+#include <sys/ioctl.h>
+#include <unistd.h>
+#include <errno.h>
+
+#include "opencbm.h"
+#include "cbm_module.h"
+#include "archlib.h"
+
+/*
+ * Block transfers with the fast protocols, done by the driver.
+ *
+ * A driver without these ioctls rejects them; then the transfer is done
+ * here line by line, with the same handshakes as the driver.
+ */
+
+static int get_line(CBM_FILE f, int line)
+{
+    return (opencbm_plugin_iec_poll(f) & line) != 0;
+}
+
+static void wait_line(CBM_FILE f, int line, int state)
+{
+    while (get_line(f, line) != state)
+        ;
+}
+
+static int s1_write_byte(CBM_FILE f, unsigned char c)
+{
+    int i, bit;
+
+    for (i = 7; i >= 0; i--) {
+        bit = (c >> i) & 1;
+        if (bit) opencbm_plugin_iec_set(f, IEC_DATA); else opencbm_plugin_iec_release(f, IEC_DATA);
+        opencbm_plugin_iec_release(f, IEC_CLOCK);
+        wait_line(f, IEC_CLOCK, 1);
+        if (bit) opencbm_plugin_iec_release(f, IEC_DATA); else opencbm_plugin_iec_set(f, IEC_DATA);
+        wait_line(f, IEC_CLOCK, 0);
+        opencbm_plugin_iec_setrelease(f, IEC_CLOCK, IEC_DATA);
+        wait_line(f, IEC_DATA, 1);
+    }
+    return 0;
+}
+
+static int s1_read_byte(CBM_FILE f)
+{
+    int i, b, c = 0;
+
+    for (i = 0; i < 8; i++) {
+        wait_line(f, IEC_DATA, 0);
+        opencbm_plugin_iec_release(f, IEC_CLOCK);
+        b = get_line(f, IEC_CLOCK);
+        if (b) c |= 1 << i;
+        opencbm_plugin_iec_set(f, IEC_DATA);
+        wait_line(f, IEC_CLOCK, !b);
+        opencbm_plugin_iec_release(f, IEC_DATA);
+        wait_line(f, IEC_DATA, 1);
+        opencbm_plugin_iec_set(f, IEC_CLOCK);
+    }
+    return c;
+}
+
+static int s2_write_byte(CBM_FILE f, unsigned char c)
+{
+    int i;
+
+    for (i = 0; i < 8; i += 2) {
+        if ((c >> i) & 1) opencbm_plugin_iec_set(f, IEC_DATA); else opencbm_plugin_iec_release(f, IEC_DATA);
+        opencbm_plugin_iec_release(f, IEC_ATN);
+        wait_line(f, IEC_CLOCK, 0);
+        if ((c >> (i + 1)) & 1) opencbm_plugin_iec_set(f, IEC_DATA); else opencbm_plugin_iec_release(f, IEC_DATA);
+        opencbm_plugin_iec_set(f, IEC_ATN);
+        wait_line(f, IEC_CLOCK, 1);
+    }
+    opencbm_plugin_iec_release(f, IEC_DATA);
+    return 0;
+}
+
+static int s2_read_byte(CBM_FILE f)
+{
+    int i, c = 0;
+
+    for (i = 0; i < 8; i += 2) {
+        wait_line(f, IEC_CLOCK, 0);
+        if (get_line(f, IEC_DATA)) c |= 1 << i;
+        opencbm_plugin_iec_release(f, IEC_ATN);
+        wait_line(f, IEC_CLOCK, 1);
+        if (get_line(f, IEC_DATA)) c |= 1 << (i + 1);
+        opencbm_plugin_iec_set(f, IEC_ATN);
+    }
+    return c;
+}
+
+static int transfer_n(CBM_FILE f, unsigned long cmd, unsigned char *data, unsigned int size)
+{
+    PARBURST_RW_VALUE mv;
+    unsigned int i;
+    int rv;
+
+    mv.buffer = data;
+    mv.length = size;
+    rv = ioctl(f, cmd, &mv);
+#ifdef __FreeBSD__
+    /* the FreeBSD driver cannot return a count: all or nothing */
+    if (rv == 0)
+        return size;
+#endif
+    if (rv >= 0)
+        return rv;
+    if ((errno != EINVAL) && (errno != ENOTTY))
+        return (errno == EINTR) ? 0 : -1;
+
+    /* no fast protocols in the driver */
+    for (i = 0; i < size; i++) {
+        switch (cmd) {
+        case CBMCTRL_S1_READ_N:  data[i] = s1_read_byte(f);  break;
+        case CBMCTRL_S1_WRITE_N: s1_write_byte(f, data[i]);  break;
+        case CBMCTRL_S2_READ_N:  data[i] = s2_read_byte(f);  break;
+        case CBMCTRL_S2_WRITE_N: s2_write_byte(f, data[i]);  break;
+        case CBMCTRL_PP_DC_READ_N:
+            wait_line(f, IEC_DATA, 1);
+            data[i++] = opencbm_plugin_pp_read(f);
+            opencbm_plugin_iec_release(f, IEC_CLOCK);
+            wait_line(f, IEC_DATA, 0);
+            data[i] = opencbm_plugin_pp_read(f);
+            opencbm_plugin_iec_set(f, IEC_CLOCK);
+            break;
+        case CBMCTRL_PP_DC_WRITE_N:
+            wait_line(f, IEC_DATA, 1);
+            opencbm_plugin_pp_write(f, data[i++]);
+            opencbm_plugin_iec_release(f, IEC_CLOCK);
+            wait_line(f, IEC_DATA, 0);
+            opencbm_plugin_pp_write(f, data[i]);
+            opencbm_plugin_iec_set(f, IEC_CLOCK);
+            break;
+        }
+    }
+    return size;
+}
+
+int opencbm_plugin_s1_read_n(CBM_FILE f, unsigned char *data, unsigned int size)
+{
+    return transfer_n(f, CBMCTRL_S1_READ_N, data, size);
+}
+
+int opencbm_plugin_s1_write_n(CBM_FILE f, const unsigned char *data, unsigned int size)
+{
+    return transfer_n(f, CBMCTRL_S1_WRITE_N, (unsigned char *) data, size);
+}
+
+int opencbm_plugin_s2_read_n(CBM_FILE f, unsigned char *data, unsigned int size)
+{
+    return transfer_n(f, CBMCTRL_S2_READ_N, data, size);
+}
+
+int opencbm_plugin_s2_write_n(CBM_FILE f, const unsigned char *data, unsigned int size)
+{
+    return transfer_n(f, CBMCTRL_S2_WRITE_N, (unsigned char *) data, size);
+}
+
+int opencbm_plugin_pp_dc_read_n(CBM_FILE f, unsigned char *data, unsigned int size)
+{
+    return transfer_n(f, CBMCTRL_PP_DC_READ_N, data, size & ~1u);
+}
+
+int opencbm_plugin_pp_dc_write_n(CBM_FILE f, const unsigned char *data, unsigned int size)
+{
+    return transfer_n(f, CBMCTRL_PP_DC_WRITE_N, (unsigned char *) data, size & ~1u);
+}
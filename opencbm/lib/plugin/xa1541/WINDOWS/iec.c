@@ -977,6 +977,56 @@ opencbm_plugin_iec_wait(CBM_FILE HandleDevice, int Line, int State)
     FUNC_LEAVE_INT(result.Line);
 }
 
+/*! \brief Run a sequence of IEC line operations
+
+ This function runs a program of line operations on the IEC serial
+ bus in the driver, with one IOCTL for the whole program.
+
+ \param HandleDevice
+   A CBM_FILE which contains the file handle of the driver.
+
+ \param Program
+   The operations, pairs of a CBM_IEC_PROG_* opcode and its argument.
+   The results of CBM_IEC_PROG_POLL and CBM_IEC_PROG_PP_READ replace
+   their argument.
+
+ \param Length
+   The length of Program in bytes.
+
+ \return
+   The number of operations run; -1 if the program could not be
+   run or was cancelled, or -2 if the driver cannot run programs.
+
+ If cbm_driver_open() did not succeed, it is illegal to
+ call this function.
+*/
+
+int CBMAPIDECL
+opencbm_plugin_iec_program(CBM_FILE HandleDevice, unsigned char *Program, unsigned int Length)
+{
+    int returnValue = -1;
+
+    FUNC_ENTER();
+
+    if (cbm_ioctl(HandleDevice, CBMCTRL(IEC_PROGRAM), Program, Length, Program, Length))
+    {
+        returnValue = Length / 2;
+    }
+    else
+    {
+        switch (GetLastError())
+        {
+        case ERROR_INVALID_FUNCTION:
+        case ERROR_INVALID_PARAMETER:
+            // an older driver which does not know CBMCTRL_IEC_PROGRAM
+            returnValue = -2;
+            break;
+        }
+    }
+
+    FUNC_LEAVE_INT(returnValue);
+}
+
 #if DBG
 
 /*! \brief Output contents of the debugging buffer
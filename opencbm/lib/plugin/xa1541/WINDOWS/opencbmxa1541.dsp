@@ -124,6 +124,10 @@ SOURCE=.\parport.c
 # End Source File
 # Begin Source File
 
+SOURCE=.\s1_s2_pp.c
+# End Source File
+# Begin Source File
+
 SOURCE=.\service.c
 # End Source File
 # Begin Source File
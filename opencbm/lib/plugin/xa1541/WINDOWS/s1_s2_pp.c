@@ -0,0 +1,178 @@
+/*
+ *      This program is free software; you can redistribute it and/or
+ *      modify it under the terms of the GNU General Public License
+ *      as published by the Free Software Foundation; either version
+ *      2 of the License, or (at your option) any later version.
+*/
+
+/*! **************************************************************
+** \file lib/plugin/xa1541/WINDOWS/s1_s2_pp.c \n
+** \n
+** \brief Shared library / DLL for accessing the driver: Code for the
+**        fast protocols serial-1, serial-2 and parallel, windows specific code
+**
+** The transfers are done by the driver, with one IOCTL per block.
+**
+****************************************************************/
+
+#include <windows.h>
+#include <windowsx.h>
+
+/*! Mark: We are in user-space (for debug.h) */
+#define DBG_USERMODE
+
+/*! The name of the executable */
+#define DBG_PROGNAME "OPENCBM-XA1541.DLL"
+
+#include "debug.h"
+
+#include <winioctl.h>
+#include "cbmioctl.h"
+
+#include <stdlib.h>
+
+//! mark: We are building the DLL */
+
+#include "i_opencbm.h"
+
+#define OPENCBM_PLUGIN
+#include "archlib.h"
+
+
+/*! \brief Read data with serial1 protocol
+
+  \param HandleDevice
+    A CBM_FILE which contains the file handle of the driver.
+
+  \param data
+    Pointer to the data buffer which will hold the bytes read.
+
+  \param size
+    The number of bytes to read.
+
+  \return
+    The number of bytes actually read, 0 on driver error.
+*/
+int CBMAPIDECL
+opencbm_plugin_s1_read_n(CBM_FILE HandleDevice, unsigned char *data, unsigned int size)
+{
+    FUNC_ENTER();
+
+    FUNC_LEAVE_INT(cbm_ioctl(HandleDevice, CBMCTRL(S1_READ_N), NULL, 0, data, size) ? size : 0);
+}
+
+/*! \brief Write data with serial1 protocol
+
+  \param HandleDevice
+    A CBM_FILE which contains the file handle of the driver.
+
+  \param data
+    Pointer to the data buffer with the bytes to be written.
+
+  \param size
+    The number of bytes to write.
+
+  \return
+    The number of bytes actually written, 0 on driver error.
+*/
+int CBMAPIDECL
+opencbm_plugin_s1_write_n(CBM_FILE HandleDevice, const unsigned char *data, unsigned int size)
+{
+    FUNC_ENTER();
+
+    FUNC_LEAVE_INT(cbm_ioctl(HandleDevice, CBMCTRL(S1_WRITE_N), (PVOID) data, size, NULL, 0) ? size : 0);
+}
+
+/*! \brief Read data with serial2 protocol
+
+  \param HandleDevice
+    A CBM_FILE which contains the file handle of the driver.
+
+  \param data
+    Pointer to the data buffer which will hold the bytes read.
+
+  \param size
+    The number of bytes to read.
+
+  \return
+    The number of bytes actually read, 0 on driver error.
+*/
+int CBMAPIDECL
+opencbm_plugin_s2_read_n(CBM_FILE HandleDevice, unsigned char *data, unsigned int size)
+{
+    FUNC_ENTER();
+
+    FUNC_LEAVE_INT(cbm_ioctl(HandleDevice, CBMCTRL(S2_READ_N), NULL, 0, data, size) ? size : 0);
+}
+
+/*! \brief Write data with serial2 protocol
+
+  \param HandleDevice
+    A CBM_FILE which contains the file handle of the driver.
+
+  \param data
+    Pointer to the data buffer with the bytes to be written.
+
+  \param size
+    The number of bytes to write.
+
+  \return
+    The number of bytes actually written, 0 on driver error.
+*/
+int CBMAPIDECL
+opencbm_plugin_s2_write_n(CBM_FILE HandleDevice, const unsigned char *data, unsigned int size)
+{
+    FUNC_ENTER();
+
+    FUNC_LEAVE_INT(cbm_ioctl(HandleDevice, CBMCTRL(S2_WRITE_N), (PVOID) data, size, NULL, 0) ? size : 0);
+}
+
+/*! \brief Read data with the parallel protocol
+
+  \param HandleDevice
+    A CBM_FILE which contains the file handle of the driver.
+
+  \param data
+    Pointer to the data buffer which will hold the bytes read.
+
+  \param size
+    The number of bytes to read. The protocol transfers byte pairs,
+    an odd byte at the end is not read.
+
+  \return
+    The number of bytes actually read, 0 on driver error.
+*/
+int CBMAPIDECL
+opencbm_plugin_pp_dc_read_n(CBM_FILE HandleDevice, unsigned char *data, unsigned int size)
+{
+    FUNC_ENTER();
+
+    size &= ~1u;
+
+    FUNC_LEAVE_INT(cbm_ioctl(HandleDevice, CBMCTRL(PP_DC_READ_N), NULL, 0, data, size) ? size : 0);
+}
+
+/*! \brief Write data with the parallel protocol
+
+  \param HandleDevice
+    A CBM_FILE which contains the file handle of the driver.
+
+  \param data
+    Pointer to the data buffer with the bytes to be written.
+
+  \param size
+    The number of bytes to write. The protocol transfers byte pairs,
+    an odd byte at the end is not written.
+
+  \return
+    The number of bytes actually written, 0 on driver error.
+*/
+int CBMAPIDECL
+opencbm_plugin_pp_dc_write_n(CBM_FILE HandleDevice, const unsigned char *data, unsigned int size)
+{
+    FUNC_ENTER();
+
+    size &= ~1u;
+
+    FUNC_LEAVE_INT(cbm_ioctl(HandleDevice, CBMCTRL(PP_DC_WRITE_N), (PVOID) data, size, NULL, 0) ? size : 0);
+}
@@ -0,0 +1,720 @@
+/*
+ *  This program is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU General Public License
+ *  as published by the Free Software Foundation; either version
+ *  2 of the License, or (at your option) any later version.
+*/
+
+/*
+ * The XA1541 and XM1541 cables without the cbm kernel module: the lines
+ * of the parallel port are driven from user space through ppdev. The IEC
+ * protocol is the one of sys/linux/cbm_module.c, with the interrupt of
+ * the ACK line replaced by polling.
+ *
+ * The kernel module turns the interrupts off while a byte goes over the
+ * bus. Here, the thread is made a real-time thread for the transfers
+ * instead, so that it is not preempted in the middle of a byte. This needs
+ * the right to use SCHED_FIFO (CAP_SYS_NICE, or an RLIMIT_RTPRIO); without
+ * it, the transfers still work on a machine which is not too busy. The
+ * priority is taken from XA1541PPDEV_RTPRIO; 0 there turns this off.
+ *
+ * Port "0" (or none) is /dev/parport0, port "N" is /dev/parportN. The
+ * cable is found out as by the kernel module; XA1541PPDEV_CABLE set to
+ * "xa1541" or "xm1541" overrides this.
+ */
+
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <sys/ioctl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+#include <errno.h>
+#include <time.h>
+#include <pthread.h>
+#include <sched.h>
+
+#include <linux/ppdev.h>
+#include <linux/parport.h>
+
+#include "opencbm.h"
+
+/* the ports which can be open at the same time */
+#define PPDEV_MAX_PORTS      4
+
+/* the real-time priority of the transfers, if not given otherwise */
+#define PPDEV_RTPRIO_DEFAULT 50
+
+/* lpt output lines */
+#define ATN_OUT    0x01
+#define CLK_OUT    0x02
+#define DATA_OUT   0x04
+#define RESET      0x08
+
+/* lpt input lines */
+#define ATN_IN     0x10
+#define CLK_IN     0x20
+#define DATA_IN    0x40
+
+#define WAIT_SLEEP_MIN_US 20    /* first sleep of wait_line()             */
+#define WAIT_SLEEP_MAX_US 1000  /* longest sleep of wait_line()           */
+
+struct ppdev_port {
+    int fd;                     /* -1 if the entry is not in use */
+    unsigned char out_bits, out_eor;
+    int data_reverse;
+    int eoi;
+    int cable;
+
+    int rt_depth;               /* rt_enter() without rt_leave() yet */
+    int rt_active;              /* the thread has been made real-time */
+    int old_policy;
+    struct sched_param old_param;
+};
+
+static struct ppdev_port ppdev_ports[PPDEV_MAX_PORTS] = {
+    { -1 }, { -1 }, { -1 }, { -1 }
+};
+
+static char ppdev_dev_name[32];
+
+static struct ppdev_port *port_of(CBM_FILE f)
+{
+    int i;
+
+    for (i = 0; i < PPDEV_MAX_PORTS; i++) {
+        if (ppdev_ports[i].fd == f && f >= 0)
+            return &ppdev_ports[i];
+    }
+    return NULL;
+}
+
+/*
+ *  access to the port
+ */
+static unsigned char poll_status(struct ppdev_port *p)
+{
+    unsigned char c = 0;
+
+    ioctl(p->fd, PPRSTATUS, &c);
+    return c;
+}
+
+static unsigned char ctrl_read(struct ppdev_port *p)
+{
+    unsigned char c = 0;
+
+    ioctl(p->fd, PPRCONTROL, &c);
+    return c;
+}
+
+static void ctrl_write(struct ppdev_port *p, unsigned char c)
+{
+    /* ppdev only passes on the four lines of the control port */
+    c &= 0x0f;
+    ioctl(p->fd, PPWCONTROL, &c);
+}
+
+#define GET(line)        ((poll_status(p) & (line)) == 0 ? 1 : 0)
+#define SET(line)        (ctrl_write(p, p->out_eor ^ (p->out_bits |= (line))))
+#define RELEASE(line)    (ctrl_write(p, p->out_eor ^ (p->out_bits &= ~(line))))
+#define SET_RELEASE(s,r) (ctrl_write(p, p->out_eor ^ \
+                              (p->out_bits = (p->out_bits | (s)) & ~(r))))
+
+static void set_data_direction(struct ppdev_port *p, int reverse)
+{
+    ioctl(p->fd, PPDATADIR, &reverse);
+    p->data_reverse = reverse;
+}
+
+/*
+ *  timing: busy waits for the handshakes, sleeps for anything longer
+ */
+static void udelay(unsigned int us)
+{
+    struct timespec start, now;
+
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    do {
+        clock_gettime(CLOCK_MONOTONIC, &now);
+    } while ((now.tv_sec - start.tv_sec) * 1000000L
+             + (now.tv_nsec - start.tv_nsec) / 1000 < (long) us);
+}
+
+static void sleep_us(unsigned int us)
+{
+    struct timespec ts;
+
+    ts.tv_sec = us / 1000000;
+    ts.tv_nsec = (us % 1000000) * 1000L;
+    while (nanosleep(&ts, &ts) != 0 && errno == EINTR)
+        ;
+}
+
+/*
+ *  real-time scheduling of the transfers
+ */
+static int rt_priority(void)
+{
+    static int priority = -1;
+    const char *val;
+
+    if (priority < 0) {
+        val = getenv("XA1541PPDEV_RTPRIO");
+        priority = val ? atoi(val) : PPDEV_RTPRIO_DEFAULT;
+        if (priority < 0)
+            priority = 0;
+        if (priority > sched_get_priority_max(SCHED_FIFO))
+            priority = sched_get_priority_max(SCHED_FIFO);
+    }
+    return priority;
+}
+
+static void rt_enter(struct ppdev_port *p)
+{
+    struct sched_param param;
+
+    if (p->rt_depth++ > 0 || rt_priority() == 0)
+        return;
+
+    p->rt_active = 0;
+    if (pthread_getschedparam(pthread_self(), &p->old_policy, &p->old_param) == 0) {
+        memset(&param, 0, sizeof param);
+        param.sched_priority = rt_priority();
+        p->rt_active = pthread_setschedparam(pthread_self(), SCHED_FIFO, &param) == 0;
+    }
+}
+
+static void rt_leave(struct ppdev_port *p)
+{
+    if (--p->rt_depth > 0)
+        return;
+
+    if (p->rt_active) {
+        pthread_setschedparam(pthread_self(), p->old_policy, &p->old_param);
+        p->rt_active = 0;
+    }
+}
+
+/*
+ *  wait until line is set (state != 0) or released (state == 0)
+ *
+ *  Busy wait for spin_us first, as the drive answers quickly most of
+ *  the time. Then sleep, doubling the time up to WAIT_SLEEP_MAX_US.
+ */
+static void wait_line(struct ppdev_port *p, unsigned char line, int state, int spin_us)
+{
+    int i, sleep = WAIT_SLEEP_MIN_US;
+
+    state = state ? 1 : 0;
+
+    for (i = 0; GET(line) != state; i++) {
+        if (i < spin_us) {
+            udelay(1);
+            continue;
+        }
+
+        sleep_us(sleep);
+
+        if (sleep < WAIT_SLEEP_MAX_US)
+            sleep = (sleep * 2 < WAIT_SLEEP_MAX_US) ? sleep * 2 : WAIT_SLEEP_MAX_US;
+    }
+}
+
+static int check_if_bus_free(struct ppdev_port *p)
+{
+    int ret = 0;
+
+    do {
+        RELEASE(ATN_OUT | CLK_OUT | DATA_OUT | RESET);
+
+        /* wait for the drive to have time to react */
+        sleep_us(100);
+
+        /* assert ATN */
+        SET(ATN_OUT);
+
+        /* now, wait for the drive to have time to react */
+        sleep_us(100);
+
+        /* if DATA is still unset, we have a problem. */
+        if (!GET(DATA_IN))
+            break;
+
+        /* ok, at least one drive reacted. Now, test releasing ATN: */
+
+        RELEASE(ATN_OUT);
+        sleep_us(100);
+
+        if (!GET(DATA_IN))
+            ret = 1;
+
+    } while (0);
+
+    RELEASE(ATN_OUT | CLK_OUT | DATA_OUT | RESET);
+
+    return ret;
+}
+
+static void do_reset(struct ppdev_port *p)
+{
+    int i;
+
+    RELEASE(DATA_OUT | ATN_OUT | CLK_OUT);
+    set_data_direction(p, 0);
+    SET(RESET);
+    sleep_us(100000);   /* 100ms */
+    RELEASE(RESET);
+
+    /* wait for the bus to be free */
+    for (i = 0; i < 1000 && !check_if_bus_free(p); i++)
+        sleep_us(1000);
+}
+
+/*
+ *  send byte
+ */
+static int send_byte(struct ppdev_port *p, int b)
+{
+    int i, ack = 0;
+
+    for (i = 0; i < 8; i++) {
+        udelay(70);
+        if (!((b >> i) & 1))
+            SET(DATA_OUT);
+        RELEASE(CLK_OUT);
+        udelay(20);
+        SET_RELEASE(CLK_OUT, DATA_OUT);
+    }
+
+    for (i = 0; (i < 20) && !(ack = GET(DATA_IN)); i++)
+        udelay(100);
+
+    return ack;
+}
+
+/*
+ *  wait until listener is ready to receive; with EOI, the listener
+ *  acknowledges it by setting DATA and releasing it again
+ */
+static void wait_for_listener(struct ppdev_port *p, int eoi)
+{
+    RELEASE(CLK_OUT);
+    wait_line(p, DATA_IN, 0, 1000);
+    if (eoi) {
+        wait_line(p, DATA_IN, 1, 1000);
+        wait_line(p, DATA_IN, 0, 1000);
+    }
+    SET(CLK_OUT);
+}
+
+static int raw_write(struct ppdev_port *p, const unsigned char *buf, size_t cnt, int atn, int talk)
+{
+    int i;
+    int rv = 0;
+    size_t sent = 0;
+
+    p->eoi = 0;
+
+    RELEASE(DATA_OUT);
+    SET(CLK_OUT | (atn ? ATN_OUT : 0));
+
+    for (i = 0; (i < 100) && !GET(DATA_IN); i++)
+        udelay(10);
+
+    if (!GET(DATA_IN)) {
+        RELEASE(CLK_OUT | ATN_OUT);
+        return -ENODEV;
+    }
+
+    sleep_us(20000);    /* 20ms */
+
+    rt_enter(p);
+    while (cnt > sent && rv == 0) {
+        udelay(50);
+        if (GET(DATA_IN)) {
+            wait_for_listener(p, (sent == (cnt - 1)) && (atn == 0));
+
+            if (send_byte(p, buf[sent])) {
+                sent++;
+                udelay(100);
+            } else {
+                rv = -EIO;
+            }
+        } else {
+            rv = -ENODEV;
+        }
+    }
+
+    if (talk && (rv == 0)) {
+        SET(DATA_OUT);
+        RELEASE(ATN_OUT);
+
+        RELEASE(CLK_OUT);
+        for (i = 0; (i < 100) && !GET(CLK_IN); i++)
+            udelay(10);
+        if (!GET(CLK_IN))
+            rv = -ENODEV;
+    } else {
+        RELEASE(ATN_OUT);
+    }
+    rt_leave(p);
+    udelay(100);
+
+    return (rv < 0) ? rv : (int)sent;
+}
+
+static int raw_read(struct ppdev_port *p, unsigned char *buf, size_t count)
+{
+    size_t received = 0;
+    int i, b, bit;
+    int ok = 0;
+
+    if (p->eoi)
+        return 0;
+
+    rt_enter(p);
+    do {
+        /* wait for the talker to be ready to send */
+        wait_line(p, CLK_IN, 0, 1000);
+
+        RELEASE(DATA_OUT);
+        for (i = 0; (i < 40) && !(ok = GET(CLK_IN)); i++)
+            udelay(10);
+        if (!ok) {
+            /* device signals eoi */
+            p->eoi = 1;
+            SET(DATA_OUT);
+            udelay(70);
+            RELEASE(DATA_OUT);
+        }
+        for (i = 0; i < 100 && !(ok = GET(CLK_IN)); i++)
+            udelay(20);
+        for (bit = b = 0; (bit < 8) && ok; bit++) {
+            for (i = 0; (i < 200) && !(ok = (GET(CLK_IN) == 0)); i++)
+                udelay(10);
+            if (ok) {
+                b >>= 1;
+                if (GET(DATA_IN) == 0)
+                    b |= 0x80;
+                for (i = 0; i < 100 && !(ok = GET(CLK_IN)); i++)
+                    udelay(20);
+            }
+        }
+        if (ok) {
+            SET(DATA_OUT);
+            buf[received++] = (unsigned char) b;
+
+            if (received % 256) {
+                udelay(50);
+            } else {
+                /* let the other threads have some time, too */
+                rt_leave(p);
+                sched_yield();
+                rt_enter(p);
+            }
+        }
+
+    } while (received < count && ok && !p->eoi);
+    rt_leave(p);
+
+    return ok ? (int)received : -EIO;
+}
+
+/*
+ *  the plugin interface
+ */
+const char *opencbm_plugin_get_driver_name(const char * const Port)
+{
+    int portNumber = 0;
+
+    if (Port != NULL) {
+        portNumber = strtoul(Port, NULL, 10);
+    }
+
+    snprintf(ppdev_dev_name, sizeof(ppdev_dev_name), "/dev/parport%d", portNumber);
+    return ppdev_dev_name;
+}
+
+int opencbm_plugin_driver_open(CBM_FILE *f, const char * const Port)
+{
+    struct ppdev_port *p = NULL;
+    const char *val;
+    unsigned char in, out;
+    int i, fd;
+
+    *f = -1;
+
+    for (i = 0; i < PPDEV_MAX_PORTS && p == NULL; i++) {
+        if (ppdev_ports[i].fd < 0)
+            p = &ppdev_ports[i];
+    }
+    if (p == NULL)
+        return -1;
+
+    fd = open(opencbm_plugin_get_driver_name(Port), O_RDWR);
+    if (fd < 0)
+        return -1;
+
+    /* no other driver must write to the port while it is ours */
+    ioctl(fd, PPEXCL);
+    if (ioctl(fd, PPCLAIM)) {
+        fprintf(stderr, "%s: cannot claim the port: %s\n",
+                opencbm_plugin_get_driver_name(Port), strerror(errno));
+        close(fd);
+        return -1;
+    }
+
+    memset(p, 0, sizeof *p);
+    p->fd = fd;
+
+    val = getenv("XA1541PPDEV_CABLE");
+    if (val != NULL && strcasecmp(val, "xa1541") == 0) {
+        p->cable = 1;
+    } else if (val != NULL && strcasecmp(val, "xm1541") == 0) {
+        p->cable = 0;
+    } else {
+        in = GET(ATN_IN);
+        out = (ctrl_read(p) & ATN_OUT) ? 1 : 0;
+        p->cable = (in != out);
+    }
+
+    p->out_eor = p->cable ? 0xcb : 0xc4;
+    p->out_bits = (ctrl_read(p) ^ p->out_eor) &
+        (DATA_OUT | CLK_OUT | ATN_OUT | RESET);
+
+    if (p->out_bits & RESET)
+        do_reset(p);
+
+    RELEASE(RESET | DATA_OUT | ATN_OUT | CLK_OUT);
+    set_data_direction(p, 0);
+
+    /* no page fault must get in the way of a transfer */
+    if (rt_priority() > 0)
+        mlockall(MCL_CURRENT | MCL_FUTURE);
+
+    *f = fd;
+    return 0;
+}
+
+void opencbm_plugin_driver_close(CBM_FILE f)
+{
+    struct ppdev_port *p = port_of(f);
+
+    if (p == NULL)
+        return;
+
+    ioctl(p->fd, PPRELEASE);
+    close(p->fd);
+    p->fd = -1;
+}
+
+int opencbm_plugin_raw_write(CBM_FILE f, const void *buf, size_t size)
+{
+    struct ppdev_port *p = port_of(f);
+
+    return p ? raw_write(p, buf, size, 0, 0) : -EBADF;
+}
+
+int opencbm_plugin_raw_read(CBM_FILE f, void *buf, size_t size)
+{
+    struct ppdev_port *p = port_of(f);
+
+    return p ? raw_read(p, buf, size) : -EBADF;
+}
+
+static int send_command(CBM_FILE f, unsigned char c0, unsigned char c1, int count, int talk)
+{
+    struct ppdev_port *p = port_of(f);
+    unsigned char buf[2];
+    int rv;
+
+    if (p == NULL)
+        return -EBADF;
+
+    buf[0] = c0;
+    buf[1] = c1;
+    rv = raw_write(p, buf, count, 1, talk);
+    return rv > 0 ? 0 : rv;
+}
+
+int opencbm_plugin_listen(CBM_FILE f, unsigned char dev, unsigned char secadr)
+{
+    return send_command(f, 0x20 | (dev & 0x1f), 0x60 | (secadr & 0x0f), 2, 0);
+}
+
+int opencbm_plugin_talk(CBM_FILE f, unsigned char dev, unsigned char secadr)
+{
+    return send_command(f, 0x40 | (dev & 0x1f), 0x60 | (secadr & 0x0f), 2, 1);
+}
+
+int opencbm_plugin_open(CBM_FILE f, unsigned char dev, unsigned char secadr)
+{
+    return send_command(f, 0x20 | (dev & 0x1f), 0xf0 | (secadr & 0x0f), 2, 0);
+}
+
+int opencbm_plugin_close(CBM_FILE f, unsigned char dev, unsigned char secadr)
+{
+    int rv = send_command(f, 0x20 | (dev & 0x1f), 0xe0 | (secadr & 0x0f), 2, 0);
+
+    if (rv == 0) {
+        /* issue an unlisten */
+        send_command(f, 0x3f, 0, 1, 0);
+    }
+    return rv;
+}
+
+int opencbm_plugin_unlisten(CBM_FILE f)
+{
+    return send_command(f, 0x3f, 0, 1, 0);
+}
+
+int opencbm_plugin_untalk(CBM_FILE f)
+{
+    return send_command(f, 0x5f, 0, 1, 0);
+}
+
+int opencbm_plugin_get_eoi(CBM_FILE f)
+{
+    struct ppdev_port *p = port_of(f);
+
+    return p ? (p->eoi ? 1 : 0) : -EBADF;
+}
+
+int opencbm_plugin_clear_eoi(CBM_FILE f)
+{
+    struct ppdev_port *p = port_of(f);
+
+    if (p == NULL)
+        return -EBADF;
+    p->eoi = 0;
+    return 0;
+}
+
+int opencbm_plugin_reset(CBM_FILE f)
+{
+    struct ppdev_port *p = port_of(f);
+
+    if (p == NULL)
+        return -EBADF;
+    do_reset(p);
+    return 0;
+}
+
+unsigned char opencbm_plugin_pp_read(CBM_FILE f)
+{
+    struct ppdev_port *p = port_of(f);
+    unsigned char c = 0xff;
+
+    if (p == NULL)
+        return 0;
+    if (!p->data_reverse) {
+        ioctl(p->fd, PPWDATA, &c);
+        set_data_direction(p, 1);
+    }
+    ioctl(p->fd, PPRDATA, &c);
+    return c;
+}
+
+void opencbm_plugin_pp_write(CBM_FILE f, unsigned char c)
+{
+    struct ppdev_port *p = port_of(f);
+
+    if (p == NULL)
+        return;
+    if (p->data_reverse)
+        set_data_direction(p, 0);
+    ioctl(p->fd, PPWDATA, &c);
+}
+
+static unsigned char out_mask(int lines)
+{
+    unsigned char mask = 0;
+
+    if (lines & IEC_DATA)
+        mask |= DATA_OUT;
+    if (lines & IEC_CLOCK)
+        mask |= CLK_OUT;
+    if (lines & IEC_ATN)
+        mask |= ATN_OUT;
+    if (lines & IEC_RESET)
+        mask |= RESET;
+    return mask;
+}
+
+int opencbm_plugin_iec_poll(CBM_FILE f)
+{
+    struct ppdev_port *p = port_of(f);
+    unsigned char c;
+    int rv = 0;
+
+    if (p == NULL)
+        return -EBADF;
+
+    c = poll_status(p);
+    if ((c & DATA_IN) == 0)
+        rv |= IEC_DATA;
+    if ((c & CLK_IN) == 0)
+        rv |= IEC_CLOCK;
+    if ((c & ATN_IN) == 0)
+        rv |= IEC_ATN;
+    return rv;
+}
+
+int opencbm_plugin_iec_get(CBM_FILE f, int line)
+{
+    int rv = opencbm_plugin_iec_poll(f);
+
+    return rv < 0 ? rv : (rv & line) != 0;
+}
+
+void opencbm_plugin_iec_set(CBM_FILE f, int line)
+{
+    struct ppdev_port *p = port_of(f);
+
+    if (p != NULL)
+        SET(out_mask(line));
+}
+
+void opencbm_plugin_iec_release(CBM_FILE f, int line)
+{
+    struct ppdev_port *p = port_of(f);
+
+    if (p != NULL)
+        RELEASE(out_mask(line));
+}
+
+void opencbm_plugin_iec_setrelease(CBM_FILE f, int set, int release)
+{
+    struct ppdev_port *p = port_of(f);
+
+    if (p != NULL)
+        SET_RELEASE(out_mask(set), out_mask(release));
+}
+
+int opencbm_plugin_iec_wait(CBM_FILE f, int line, int state)
+{
+    struct ppdev_port *p = port_of(f);
+    unsigned char mask;
+
+    if (p == NULL)
+        return -EBADF;
+
+    switch (line) {
+    case IEC_DATA:
+        mask = DATA_IN;
+        break;
+    case IEC_CLOCK:
+        mask = CLK_IN;
+        break;
+    case IEC_ATN:
+        mask = ATN_IN;
+        break;
+    default:
+        return -EINVAL;
+    }
+    wait_line(p, mask, state, 200);
+    return opencbm_plugin_iec_poll(f);
+}
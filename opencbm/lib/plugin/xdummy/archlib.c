@@ -41,6 +41,11 @@
 /*! mark: We are building the DLL */
 #define OPENCBM_PLUGIN
 #include "archlib.h"
+#include "arch.h"
+
+#ifndef WIN32
+#include <time.h>
+#endif
 
 #ifdef WIN32
 #define PLUGIN_HANDLE_MAGIC ((CBM_FILE)-1)
@@ -89,6 +94,75 @@ static unsigned char statusTemplateOkBuffer[] = { "00, OK,00,00\x0d" };
 #define min(_x, _y) ((_x) < (_y) ? (_x) : (_y))
 #endif
 
+/*
+ * Timing of the simulated drive: Every bus command (LISTEN, TALK,
+ * OPEN, CLOSE, UNLISTEN, UNTALK and RESET) takes sim_latency_us,
+ * every byte read or written takes 1/sim_throughput seconds.
+ *
+ * The time the drive is busy accumulates in sim_due. Only when it
+ * is far enough in the future, we actually sleep. This way, the
+ * average speed is right even with a coarse sleep granularity.
+ */
+static unsigned int sim_latency_us  = 0; /* 0: no latency */
+static unsigned int sim_throughput  = 0; /* in bytes/s; 0: no limit */
+static double       sim_due         = 0; /* the time the drive is done, in us */
+
+/* do not sleep for less than this, in us */
+#define SIM_MIN_SLEEP_US 1000
+
+/* the current time in us */
+static double
+sim_now(void)
+{
+#ifdef WIN32
+    static LARGE_INTEGER frequency;
+    LARGE_INTEGER counter;
+
+    if (frequency.QuadPart == 0)
+        QueryPerformanceFrequency(&frequency);
+    QueryPerformanceCounter(&counter);
+    return (double)counter.QuadPart * 1e6 / (double)frequency.QuadPart;
+#else
+    struct timespec now;
+
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return now.tv_sec * 1e6 + now.tv_nsec / 1e3;
+#endif
+}
+
+/* let the simulated drive be busy for some time */
+static void
+sim_busy(double Microseconds)
+{
+    double now;
+
+    if (Microseconds <= 0)
+        return;
+
+    now = sim_now();
+    if (sim_due < now)
+        sim_due = now;
+    sim_due += Microseconds;
+
+    if (sim_due - now >= SIM_MIN_SLEEP_US)
+        arch_sleep_us((unsigned int) (sim_due - now));
+}
+
+/* a bus command for the simulated drive */
+static void
+sim_command(void)
+{
+    sim_busy(sim_latency_us);
+}
+
+/* a transfer of some bytes with the simulated drive */
+static void
+sim_transfer(size_t Bytes)
+{
+    if (sim_throughput != 0)
+        sim_busy(Bytes * 1e6 / sim_throughput);
+}
+
 static void
 init_iec_devices(void)
 {
@@ -227,6 +301,56 @@ opencbm_plugin_driver_close(CBM_FILE HandleDevice)
 }
 
 
+/*! \brief configuration data we are interested in
+ There are the configuration data entries that we want to have
+ in our plugin.
+*/
+static opencbm_plugin_configuration_data_t configurationData[] =
+{
+        { OPENCBM_PLUGIN_CONFIGURATION_DATA_TYPE_UINTEGER,  "latency"    },
+        { OPENCBM_PLUGIN_CONFIGURATION_DATA_TYPE_UINTEGER,  "throughput" },
+        { OPENCBM_PLUGIN_CONFIGURATION_DATA_TYPE_LASTENTRY, ""           }
+};
+
+/*! \brief Get a memory area which contains the configuration data
+
+ \return
+    Pointer to a memory area that contains the names and the types of the
+    configuration data that are wanted.
+
+ \remark
+    The plugin fills the buffer and returns it with this function.
+    The opencbm DLL/.SO will fill in the known data values into this buffer.
+
+    The DLL/SO will call this function, and afterwards, it will call
+    the opencbm_plugin_set_configuration_parameter() function.
+*/
+opencbm_plugin_configuration_data_t * CBMAPIDECL
+opencbm_plugin_get_list_of_configuration_parameter(void)
+{
+    return configurationData;
+}
+
+/*! \brief Set the configuration data
+
+ \param ConfigurationData
+    The buffer returned by opencbm_plugin_get_list_of_configuration_parameter(),
+    with the values filled in.
+
+ \remark
+    "latency" is the time every bus command of the simulated drive
+    takes, in microseconds. "throughput" is the speed of the data
+    transfers with it, in bytes per second. If they are not given, the
+    drive is as fast as possible.
+*/
+void CBMAPIDECL
+opencbm_plugin_set_configuration_parameter(opencbm_plugin_configuration_data_t * ConfigurationData)
+{
+    sim_latency_us = ConfigurationData[0].isValid ? ConfigurationData[0].uinteger : 0;
+    sim_throughput = ConfigurationData[1].isValid ? ConfigurationData[1].uinteger : 0;
+}
+
+
 /*! \brief Lock the parallel port for the driver
 
  This function locks the driver onto the parallel port. This way,
@@ -324,6 +448,8 @@ opencbm_plugin_raw_write(CBM_FILE HandleDevice, const void *Buffer, size_t Count
 
     DBG_ASSERT(HandleDevice == PLUGIN_HANDLE_MAGIC);
 
+    sim_transfer(Count);
+
     FUNC_LEAVE_INT(Count);
 }
 
@@ -375,6 +501,8 @@ opencbm_plugin_raw_read(CBM_FILE HandleDevice, void *Buffer, size_t Count)
         }
     }
 
+    sim_transfer(count_to_copy);
+
     FUNC_LEAVE_INT(count_to_copy);
 }
 
@@ -413,6 +541,8 @@ opencbm_plugin_listen(CBM_FILE HandleDevice, unsigned char DeviceAddress, unsign
 
     DBG_ASSERT(HandleDevice == PLUGIN_HANDLE_MAGIC);
 
+    sim_command();
+
     DBG_ASSERT(plugin_iec_listener == 0);
     plugin_iec_listener = &iec_devices[DeviceAddress & 0xf][SecondaryAddress & 0xf];
 
@@ -452,6 +582,8 @@ opencbm_plugin_talk(CBM_FILE HandleDevice, unsigned char DeviceAddress, unsigned
 
     DBG_ASSERT(HandleDevice == PLUGIN_HANDLE_MAGIC);
 
+    sim_command();
+
     DBG_ASSERT(plugin_iec_talker == 0);
     plugin_iec_talker = &iec_devices[DeviceAddress & 0xf][SecondaryAddress & 0xf];
 
@@ -489,6 +621,8 @@ opencbm_plugin_open(CBM_FILE HandleDevice, unsigned char DeviceAddress, unsigned
 
     DBG_ASSERT(HandleDevice == PLUGIN_HANDLE_MAGIC);
 
+    sim_command();
+
     DBG_ASSERT(plugin_iec_listener == 0);
     plugin_iec_listener = &iec_devices[DeviceAddress & 0xf][SecondaryAddress & 0xf];
 
@@ -528,6 +662,8 @@ opencbm_plugin_close(CBM_FILE HandleDevice, unsigned char DeviceAddress, unsigne
 
     DBG_ASSERT(HandleDevice == PLUGIN_HANDLE_MAGIC);
 
+    sim_command();
+
     FUNC_LEAVE_INT(0);
 }
 
@@ -560,6 +696,8 @@ opencbm_plugin_unlisten(CBM_FILE HandleDevice)
 
     DBG_ASSERT(HandleDevice == PLUGIN_HANDLE_MAGIC);
 
+    sim_command();
+
     DBG_ASSERT(plugin_iec_listener != 0);
     plugin_iec_listener = 0;
 
@@ -595,6 +733,8 @@ opencbm_plugin_untalk(CBM_FILE HandleDevice)
 
     DBG_ASSERT(HandleDevice == PLUGIN_HANDLE_MAGIC);
 
+    sim_command();
+
     DBG_ASSERT(plugin_iec_talker != 0);
 
     /* if we reach end of the data, start at the beginning the next time */
@@ -701,6 +841,8 @@ opencbm_plugin_reset(CBM_FILE HandleDevice)
 
     DBG_ASSERT(HandleDevice == PLUGIN_HANDLE_MAGIC);
 
+    sim_command();
+
     FUNC_LEAVE_INT(0);
 }
 
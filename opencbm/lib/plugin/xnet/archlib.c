@@ -0,0 +1,587 @@
+/*
+ *      This program is free software; you can redistribute it and/or
+ *      modify it under the terms of the GNU General Public License
+ *      as published by the Free Software Foundation; either version
+ *      2 of the License, or (at your option) any later version.
+*/
+
+/*! **************************************************************
+** \file lib/plugin/xnet/archlib.c \n
+** \n
+** \brief plugin which accesses the adapter of a cbmserver on the network
+**
+** Every plugin call is sent to the server as one request, cf.
+** opencbm-net.h. The server runs it with its own adapter, and sends
+** back the result. The port specification is "host" or "host:port";
+** if it is not given, the server on the local machine is used.
+**
+****************************************************************/
+
+/*! Mark: We are in user-space (for debug.h) */
+#define DBG_USERMODE
+
+/*! The name of the executable */
+#define DBG_PROGNAME "OPENCBM-XNET.DLL"
+
+#include "debug.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <netdb.h>
+#include <unistd.h>
+
+/*! mark: We are building the DLL */
+#define OPENCBM_PLUGIN
+#include "archlib.h"
+#include "arch.h"
+#include "libmisc.h"
+
+#include "opencbm-net.h"
+
+#ifdef MSG_NOSIGNAL
+/*! do not get a SIGPIPE if the server went away */
+# define XNET_SEND_FLAGS MSG_NOSIGNAL
+#else
+# define XNET_SEND_FLAGS 0
+#endif
+
+/*! the server to use if the port specification does not name one */
+#define XNET_DEFAULT_HOST "localhost"
+
+
+/*-------------------------------------------------------------------*/
+/*--------- TALKING TO THE SERVER -----------------------------------*/
+
+/*! \internal \brief Send all bytes of a buffer to the server */
+static int
+xnet_send_all(CBM_FILE HandleDevice, const void *Buffer, size_t Length)
+{
+    const unsigned char *p = Buffer;
+
+    while (Length > 0)
+    {
+        ssize_t sent = send(HandleDevice, p, Length, XNET_SEND_FLAGS);
+
+        if (sent <= 0)
+            return -1;
+
+        p += sent;
+        Length -= sent;
+    }
+
+    return 0;
+}
+
+/*! \internal \brief Receive exactly Length bytes from the server */
+static int
+xnet_recv_all(CBM_FILE HandleDevice, void *Buffer, size_t Length)
+{
+    unsigned char *p = Buffer;
+
+    while (Length > 0)
+    {
+        ssize_t received = recv(HandleDevice, p, Length, 0);
+
+        if (received <= 0)
+            return -1;
+
+        p += received;
+        Length -= received;
+    }
+
+    return 0;
+}
+
+/*! \internal \brief Let the server run a command
+
+ \param HandleDevice
+   A CBM_FILE which contains the file handle of the driver,
+   that is, the connection to the server.
+
+ \param Command
+   The command to run, one of opencbm_net_command_t.
+
+ \param Arg1, Arg2
+   The arguments of the command.
+
+ \param WriteBuffer
+   The data the command writes; NULL if it does not write anything.
+
+ \param Length
+   The number of bytes in WriteBuffer, or the number of bytes to
+   read into ReadBuffer.
+
+ \param ReadBuffer
+   The buffer for the data the command reads; NULL if it does
+   not read anything.
+
+ \param Result
+   Pointer to an int which will hold the return value of the
+   command on the server.
+
+ \return
+   The number of bytes read into ReadBuffer, or -1 if the
+   communication with the server failed.
+*/
+static int
+xnet_request(CBM_FILE HandleDevice, opencbm_net_command_t Command,
+             unsigned char Arg1, unsigned char Arg2,
+             const void *WriteBuffer, unsigned int Length,
+             void *ReadBuffer, int *Result)
+{
+    opencbm_net_request_t request;
+    opencbm_net_answer_t answer;
+    unsigned long answer_length;
+
+    FUNC_ENTER();
+
+    DBG_ASSERT(Length <= OPENCBM_NET_MAX_DATA);
+
+    *Result = -1;
+
+    request.Command = (unsigned char) Command;
+    request.Arg1 = Arg1;
+    request.Arg2 = Arg2;
+    request.Reserved = 0;
+    OPENCBM_NET_PUT32(request.Length, Length);
+
+    if (xnet_send_all(HandleDevice, &request, sizeof request)
+        || (WriteBuffer && Length && xnet_send_all(HandleDevice, WriteBuffer, Length))
+        || xnet_recv_all(HandleDevice, &answer, sizeof answer))
+    {
+        DBG_ERROR((DBG_PREFIX "connection to the server failed"));
+        FUNC_LEAVE_INT(-1);
+    }
+
+    answer_length = OPENCBM_NET_GET32(answer.Length);
+
+    if (answer_length > (ReadBuffer ? Length : 0)
+        || (answer_length && xnet_recv_all(HandleDevice, ReadBuffer, answer_length)))
+    {
+        DBG_ERROR((DBG_PREFIX "invalid answer from the server"));
+        FUNC_LEAVE_INT(-1);
+    }
+
+    *Result = (int) (long) OPENCBM_NET_GET32(answer.Result);
+
+    FUNC_LEAVE_INT((int) answer_length);
+}
+
+/*! \internal \brief Let the server run a command without data
+
+ \return
+   The return value of the command on the server, or -1 if the
+   communication with the server failed.
+*/
+static int
+xnet_command(CBM_FILE HandleDevice, opencbm_net_command_t Command,
+             unsigned char Arg1, unsigned char Arg2)
+{
+    int result;
+
+    xnet_request(HandleDevice, Command, Arg1, Arg2, NULL, 0, NULL, &result);
+
+    return result;
+}
+
+
+/*-------------------------------------------------------------------*/
+/*--------- OPENCBM ARCH FUNCTIONS ----------------------------------*/
+
+/*! \brief Get the name of the driver for a specific port
+
+ \param Port
+   The server, "host" or "host:port". If not set (== NULL),
+   the server on the local machine is used.
+
+ \return
+   Returns a pointer to a null-terminated string containing the
+   driver name.
+*/
+const char * CBMAPIDECL
+opencbm_plugin_get_driver_name(const char * const Port)
+{
+    UNREFERENCED_PARAMETER(Port);
+
+    FUNC_ENTER();
+
+    FUNC_LEAVE_STRING("xnet");
+}
+
+/*! \brief Opens the driver, that is, connects to the server
+
+ \param HandleDevice
+   Pointer to a CBM_FILE which will contain the file handle of the driver.
+
+ \param Port
+   The server, "host" or "host:port". If not set (== NULL),
+   the server on the local machine is used.
+
+ \return
+   ==0: This function completed successfully
+   !=0: otherwise
+*/
+int CBMAPIDECL
+opencbm_plugin_driver_open(CBM_FILE *HandleDevice, const char * const Port)
+{
+    struct addrinfo hints;
+    struct addrinfo *addresses = NULL;
+    struct addrinfo *address;
+    char *host = NULL;
+    const char *service = OPENCBM_NET_DEFAULT_PORT;
+    int sock = -1;
+    int result;
+    int error = 1;
+
+    FUNC_ENTER();
+
+    FUNC_PARAM((DBG_PREFIX "HandleDevice = %p, Port = '%s' (%p)", HandleDevice, Port ? Port : "(null)", Port));
+
+    do {
+        char *colon;
+
+        host = cbmlibmisc_strdup((Port && *Port) ? Port : XNET_DEFAULT_HOST);
+        if (host == NULL)
+            break;
+
+        // "host:port"; more than one colon is an IPv6 address without a port
+
+        colon = strrchr(host, ':');
+        if (colon && colon == strchr(host, ':'))
+        {
+            *colon = 0;
+            service = colon + 1;
+        }
+
+        memset(&hints, 0, sizeof hints);
+        hints.ai_family = AF_UNSPEC;
+        hints.ai_socktype = SOCK_STREAM;
+
+        if (getaddrinfo(host, service, &hints, &addresses) != 0)
+        {
+            DBG_ERROR((DBG_PREFIX "cannot resolve '%s'", Port ? Port : ""));
+            break;
+        }
+
+        for (address = addresses; address != NULL; address = address->ai_next)
+        {
+            sock = socket(address->ai_family, address->ai_socktype, address->ai_protocol);
+            if (sock < 0)
+                continue;
+
+            if (connect(sock, address->ai_addr, address->ai_addrlen) == 0)
+                break;
+
+            close(sock);
+            sock = -1;
+        }
+
+        if (sock < 0)
+        {
+            DBG_ERROR((DBG_PREFIX "cannot connect to the server"));
+            break;
+        }
+
+        // every request is small and waits for its answer, do not delay it
+
+        result = 1;
+        setsockopt(sock, IPPROTO_TCP, TCP_NODELAY, &result, sizeof result);
+
+        if (xnet_command(sock, OPENCBM_NET_HELLO, OPENCBM_NET_VERSION, 0) != OPENCBM_NET_VERSION)
+        {
+            DBG_ERROR((DBG_PREFIX "the server does not speak protocol version %u", OPENCBM_NET_VERSION));
+            close(sock);
+            sock = -1;
+            break;
+        }
+
+        *HandleDevice = sock;
+        error = 0;
+
+    } while (0);
+
+    if (addresses)
+        freeaddrinfo(addresses);
+
+    cbmlibmisc_strfree(host);
+
+    FUNC_LEAVE_INT(error);
+}
+
+/*! \brief Closes the driver, that is, the connection to the server
+
+ \param HandleDevice
+   A CBM_FILE which contains the file handle of the driver.
+
+ The server releases the bus if this client still holds it.
+*/
+void CBMAPIDECL
+opencbm_plugin_driver_close(CBM_FILE HandleDevice)
+{
+    FUNC_ENTER();
+
+    close(HandleDevice);
+
+    FUNC_LEAVE();
+}
+
+/*! \brief Lock the adapter of the server for this client
+
+ While it is locked, the server does not run the requests of
+ other clients.
+*/
+void CBMAPIDECL
+opencbm_plugin_lock(CBM_FILE HandleDevice)
+{
+    FUNC_ENTER();
+
+    xnet_command(HandleDevice, OPENCBM_NET_LOCK, 0, 0);
+
+    FUNC_LEAVE();
+}
+
+/*! \brief Unlock the adapter of the server again */
+void CBMAPIDECL
+opencbm_plugin_unlock(CBM_FILE HandleDevice)
+{
+    FUNC_ENTER();
+
+    xnet_command(HandleDevice, OPENCBM_NET_UNLOCK, 0, 0);
+
+    FUNC_LEAVE();
+}
+
+/*! \brief Write data to the IEC serial bus
+
+ \return
+   >= 0: The actual number of bytes written.
+   <0  indicates an error.
+*/
+int CBMAPIDECL
+opencbm_plugin_raw_write(CBM_FILE HandleDevice, const void *Buffer, size_t Count)
+{
+    const unsigned char *p = Buffer;
+    int written = 0;
+
+    FUNC_ENTER();
+
+    while (Count > 0)
+    {
+        unsigned int chunk = Count > OPENCBM_NET_MAX_DATA ? OPENCBM_NET_MAX_DATA : (unsigned int) Count;
+        int result;
+
+        if (xnet_request(HandleDevice, OPENCBM_NET_RAW_WRITE, 0, 0, p, chunk, NULL, &result) < 0)
+            FUNC_LEAVE_INT(written ? written : -1);
+
+        if (result <= 0)
+            FUNC_LEAVE_INT(written ? written : result);
+
+        written += result;
+
+        if ((unsigned int) result < chunk)
+            break;
+
+        p += chunk;
+        Count -= chunk;
+    }
+
+    FUNC_LEAVE_INT(written);
+}
+
+/*! \brief Read data from the IEC serial bus
+
+ \return
+   >= 0: The actual number of bytes read.
+   <0  indicates an error.
+*/
+int CBMAPIDECL
+opencbm_plugin_raw_read(CBM_FILE HandleDevice, void *Buffer, size_t Count)
+{
+    unsigned char *p = Buffer;
+    int read = 0;
+
+    FUNC_ENTER();
+
+    while (Count > 0)
+    {
+        unsigned int chunk = Count > OPENCBM_NET_MAX_DATA ? OPENCBM_NET_MAX_DATA : (unsigned int) Count;
+        int result;
+
+        if (xnet_request(HandleDevice, OPENCBM_NET_RAW_READ, 0, 0, NULL, chunk, p, &result) < 0)
+            FUNC_LEAVE_INT(read ? read : -1);
+
+        if (result <= 0)
+            FUNC_LEAVE_INT(read ? read : result);
+
+        read += result;
+
+        if ((unsigned int) result < chunk)
+            break;
+
+        p += chunk;
+        Count -= chunk;
+    }
+
+    FUNC_LEAVE_INT(read);
+}
+
+/*! \brief Send a LISTEN on the IEC serial bus */
+int CBMAPIDECL
+opencbm_plugin_listen(CBM_FILE HandleDevice, unsigned char DeviceAddress, unsigned char SecondaryAddress)
+{
+    FUNC_ENTER();
+
+    FUNC_LEAVE_INT(xnet_command(HandleDevice, OPENCBM_NET_LISTEN, DeviceAddress, SecondaryAddress));
+}
+
+/*! \brief Send a TALK on the IEC serial bus */
+int CBMAPIDECL
+opencbm_plugin_talk(CBM_FILE HandleDevice, unsigned char DeviceAddress, unsigned char SecondaryAddress)
+{
+    FUNC_ENTER();
+
+    FUNC_LEAVE_INT(xnet_command(HandleDevice, OPENCBM_NET_TALK, DeviceAddress, SecondaryAddress));
+}
+
+/*! \brief Open a file on the IEC serial bus */
+int CBMAPIDECL
+opencbm_plugin_open(CBM_FILE HandleDevice, unsigned char DeviceAddress, unsigned char SecondaryAddress)
+{
+    FUNC_ENTER();
+
+    FUNC_LEAVE_INT(xnet_command(HandleDevice, OPENCBM_NET_OPEN, DeviceAddress, SecondaryAddress));
+}
+
+/*! \brief Close a file on the IEC serial bus */
+int CBMAPIDECL
+opencbm_plugin_close(CBM_FILE HandleDevice, unsigned char DeviceAddress, unsigned char SecondaryAddress)
+{
+    FUNC_ENTER();
+
+    FUNC_LEAVE_INT(xnet_command(HandleDevice, OPENCBM_NET_CLOSE, DeviceAddress, SecondaryAddress));
+}
+
+/*! \brief Send an UNLISTEN on the IEC serial bus */
+int CBMAPIDECL
+opencbm_plugin_unlisten(CBM_FILE HandleDevice)
+{
+    FUNC_ENTER();
+
+    FUNC_LEAVE_INT(xnet_command(HandleDevice, OPENCBM_NET_UNLISTEN, 0, 0));
+}
+
+/*! \brief Send an UNTALK on the IEC serial bus */
+int CBMAPIDECL
+opencbm_plugin_untalk(CBM_FILE HandleDevice)
+{
+    FUNC_ENTER();
+
+    FUNC_LEAVE_INT(xnet_command(HandleDevice, OPENCBM_NET_UNTALK, 0, 0));
+}
+
+/*! \brief Get EOI flag after bus read */
+int CBMAPIDECL
+opencbm_plugin_get_eoi(CBM_FILE HandleDevice)
+{
+    FUNC_ENTER();
+
+    FUNC_LEAVE_INT(xnet_command(HandleDevice, OPENCBM_NET_GET_EOI, 0, 0));
+}
+
+/*! \brief Reset the EOI flag */
+int CBMAPIDECL
+opencbm_plugin_clear_eoi(CBM_FILE HandleDevice)
+{
+    FUNC_ENTER();
+
+    FUNC_LEAVE_INT(xnet_command(HandleDevice, OPENCBM_NET_CLEAR_EOI, 0, 0));
+}
+
+/*! \brief RESET all devices */
+int CBMAPIDECL
+opencbm_plugin_reset(CBM_FILE HandleDevice)
+{
+    FUNC_ENTER();
+
+    FUNC_LEAVE_INT(xnet_command(HandleDevice, OPENCBM_NET_RESET, 0, 0));
+}
+
+
+/*-------------------------------------------------------------------*/
+/*--------- LOW-LEVEL PORT ACCESS -----------------------------------*/
+
+/*! \brief Read a byte from a XP1541/XP1571 cable */
+unsigned char CBMAPIDECL
+opencbm_plugin_pp_read(CBM_FILE HandleDevice)
+{
+    FUNC_ENTER();
+
+    FUNC_LEAVE_UCHAR((unsigned char) xnet_command(HandleDevice, OPENCBM_NET_PP_READ, 0, 0));
+}
+
+/*! \brief Write a byte to a XP1541/XP1571 cable */
+void CBMAPIDECL
+opencbm_plugin_pp_write(CBM_FILE HandleDevice, unsigned char Byte)
+{
+    FUNC_ENTER();
+
+    xnet_command(HandleDevice, OPENCBM_NET_PP_WRITE, Byte, 0);
+
+    FUNC_LEAVE();
+}
+
+/*! \brief Read status of all bus lines */
+int CBMAPIDECL
+opencbm_plugin_iec_poll(CBM_FILE HandleDevice)
+{
+    FUNC_ENTER();
+
+    FUNC_LEAVE_INT(xnet_command(HandleDevice, OPENCBM_NET_IEC_POLL, 0, 0));
+}
+
+/*! \brief Activate a line on the IEC serial bus */
+void CBMAPIDECL
+opencbm_plugin_iec_set(CBM_FILE HandleDevice, int Line)
+{
+    FUNC_ENTER();
+
+    xnet_command(HandleDevice, OPENCBM_NET_IEC_SETRELEASE, (unsigned char) Line, 0);
+
+    FUNC_LEAVE();
+}
+
+/*! \brief Deactivate a line on the IEC serial bus */
+void CBMAPIDECL
+opencbm_plugin_iec_release(CBM_FILE HandleDevice, int Line)
+{
+    FUNC_ENTER();
+
+    xnet_command(HandleDevice, OPENCBM_NET_IEC_SETRELEASE, 0, (unsigned char) Line);
+
+    FUNC_LEAVE();
+}
+
+/*! \brief Activate and deactive a line on the IEC serial bus */
+void CBMAPIDECL
+opencbm_plugin_iec_setrelease(CBM_FILE HandleDevice, int Set, int Release)
+{
+    FUNC_ENTER();
+
+    xnet_command(HandleDevice, OPENCBM_NET_IEC_SETRELEASE, (unsigned char) Set, (unsigned char) Release);
+
+    FUNC_LEAVE();
+}
+
+/*! \brief Wait for a line to have a specific state */
+int CBMAPIDECL
+opencbm_plugin_iec_wait(CBM_FILE HandleDevice, int Line, int State)
+{
+    FUNC_ENTER();
+
+    FUNC_LEAVE_INT(xnet_command(HandleDevice, OPENCBM_NET_IEC_WAIT, (unsigned char) Line, (unsigned char) State));
+}
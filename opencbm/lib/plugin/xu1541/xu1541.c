@@ -126,7 +126,12 @@ int xu1541_init(struct opencbm_usb_handle **HandleXu1541_p) {
   errno = 0;
 
 #elif HAVE_LIBUSB1
-  usb.init(&HandleXu1541->ctx);
+  if (dynlibusb_context_get(&HandleXu1541->ctx) != LIBUSB_SUCCESS) {
+    xu1541_dbg(0, "libusb could not be initialised");
+    free(HandleXu1541);
+    *HandleXu1541_p = NULL;
+    return -1;
+  }
 #endif
 
 #if HAVE_LIBUSB0
@@ -177,7 +182,7 @@ int xu1541_init(struct opencbm_usb_handle **HandleXu1541_p) {
   cnt = usb.get_device_list(HandleXu1541->ctx, &list);
   if (cnt < 0) {
     xu1541_dbg(0, "enumeration error: %s", usb.error_name((int)cnt));
-    usb.exit(HandleXu1541->ctx);
+    dynlibusb_context_release(HandleXu1541->ctx);
     free(HandleXu1541);
     HandleXu1541 = NULL;
     return -1;
@@ -230,7 +235,7 @@ int xu1541_init(struct opencbm_usb_handle **HandleXu1541_p) {
 
   if (HandleXu1541->devh == NULL) {
     fprintf(stderr, "error: no xu1541 device found\n");
-    usb.exit(HandleXu1541->ctx);
+    dynlibusb_context_release(HandleXu1541->ctx);
     free(HandleXu1541);
     HandleXu1541 = NULL;
     return -1;
@@ -329,7 +334,7 @@ void xu1541_close(struct opencbm_usb_handle *HandleXu1541)
 
     usb.close(HandleXu1541->devh);
 #if HAVE_LIBUSB1
-    usb.exit(HandleXu1541->ctx);
+    dynlibusb_context_release(HandleXu1541->ctx);
 #endif
 
     free(HandleXu1541);
@@ -752,7 +757,7 @@ int xu1541_special_write(struct opencbm_usb_handle *HandleXu1541, int mode, cons
     while(size > 0)
     {
         int wr;
-        uint16_t bytes2write = (size>128)?128:size;
+        uint16_t bytes2write = (size>XU1541_SPECIAL_XFER_SIZE)?XU1541_SPECIAL_XFER_SIZE:size;
 
 #if HAVE_LIBUSB0
         if((wr = usb.control_msg(HandleXu1541->devh,
@@ -811,7 +816,7 @@ int xu1541_special_read(struct opencbm_usb_handle *HandleXu1541, int mode, unsig
     while(size > 0)
     {
         int rd;
-        uint16_t bytes2read = (size>128)?128:size;
+        uint16_t bytes2read = (size>XU1541_SPECIAL_XFER_SIZE)?XU1541_SPECIAL_XFER_SIZE:size;
 
 #if HAVE_LIBUSB0
         if((rd = usb.control_msg(HandleXu1541->devh,
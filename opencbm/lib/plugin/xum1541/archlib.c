@@ -49,6 +49,7 @@
 #include "xum1541.h"
 
 unsigned int xum1541_usb_quirks_mode;
+unsigned int xum1541_usb_transfer_size;
 
 /*-------------------------------------------------------------------*/
 /*--------- OPENCBM ARCH FUNCTIONS ----------------------------------*/
@@ -141,6 +142,7 @@ opencbm_plugin_driver_close(CBM_FILE HandleDevice)
 static opencbm_plugin_configuration_data_t configurationData[] =
 {
         { OPENCBM_PLUGIN_CONFIGURATION_DATA_TYPE_UINTEGER,  "usb-quirks" },
+        { OPENCBM_PLUGIN_CONFIGURATION_DATA_TYPE_UINTEGER,  "usb-transfer-size" },
         { OPENCBM_PLUGIN_CONFIGURATION_DATA_TYPE_LASTENTRY, ""           }
 };
 
@@ -188,6 +190,7 @@ void CBMAPIDECL
 opencbm_plugin_set_configuration_parameter(opencbm_plugin_configuration_data_t * ConfigurationData)
 {
     xum1541_usb_quirks_mode = ConfigurationData[0].isValid ? ConfigurationData[0].integer : 0;
+    xum1541_usb_transfer_size = ConfigurationData[1].isValid ? ConfigurationData[1].uinteger : 0;
 }
 
 
@@ -304,6 +307,57 @@ opencbm_plugin_raw_read(CBM_FILE HandleDevice, void *Buffer, size_t Count)
 }
 
 
+/*! \brief Write data from several buffers to the IEC serial bus
+
+ This function sends data after a cbm_listen().
+
+ \param HandleDevice
+   A CBM_FILE which contains the file handle of the driver.
+
+ \param Iov
+   Pointer to an array of buffers which hold the bytes to write to the bus.
+
+ \param IovCount
+   Number of entries in the Iov array.
+
+ \return
+   Number of bytes written
+
+ If cbm_driver_open() did not succeed, it is illegal to
+ call this function.
+*/
+
+int CBMAPIDECL
+opencbm_plugin_raw_writev(CBM_FILE HandleDevice, const cbm_iovec_t *Iov, unsigned int IovCount)
+{
+    return xum1541_writev((struct opencbm_usb_handle *)HandleDevice, XUM1541_CBM, Iov, IovCount);
+}
+
+/*! \brief Read data from the IEC serial bus into several buffers
+
+ This function retrieves data after a cbm_talk().
+
+ \param HandleDevice
+   A CBM_FILE which contains the file handle of the driver.
+
+ \param Iov
+   Pointer to an array of buffers which will hold the bytes read.
+
+ \param IovCount
+   Number of entries in the Iov array.
+
+ \return
+   Number of bytes read
+
+ If cbm_driver_open() did not succeed, it is illegal to
+ call this function.
+*/
+
+int CBMAPIDECL
+opencbm_plugin_raw_readv(CBM_FILE HandleDevice, const cbm_iovec_t *Iov, unsigned int IovCount)
+{
+    return xum1541_readv((struct opencbm_usb_handle *)HandleDevice, XUM1541_CBM, Iov, IovCount);
+}
 
 /*! \brief Send a LISTEN on the IEC serial bus
 
@@ -773,6 +827,200 @@ opencbm_plugin_iec_wait(CBM_FILE HandleDevice, int Line, int State)
     return xum1541_ioctl((struct opencbm_usb_handle *)HandleDevice, XUM1541_IEC_WAIT, Line, State);
 }
 
+/*! \brief Wait for a line to have a specific state, with a timeout
+
+ \param HandleDevice
+   A CBM_FILE which contains the file handle of the driver.
+
+ \param Line
+   The line to be waited for. This must be exactly one of
+   IEC_DATA, IEC_CLOCK, IEC_ATN, and IEC_RESET.
+
+ \param State
+   If zero, then wait for this line to be deactivated. \n
+   If not zero, then wait for this line to be activated.
+
+ \param TimeoutMs
+   The time to wait at most, in milliseconds.
+
+ \return
+   The state of the IEC bus on return (like cbm_iec_poll), -1 on
+   timeout, or -2 if the firmware cannot time out the wait.
+
+ If cbm_driver_open() did not succeed, it is illegal to
+ call this function.
+*/
+
+int CBMAPIDECL
+opencbm_plugin_iec_wait_timeout(CBM_FILE HandleDevice, int Line, int State, unsigned int TimeoutMs)
+{
+    return xum1541_iec_wait_timeout((struct opencbm_usb_handle *)HandleDevice, Line, State, TimeoutMs);
+}
+
+/*! \brief Run a list of bus primitives at once
+
+ This function runs the given LISTEN/TALK/UNLISTEN/UNTALK, raw write and
+ raw read primitives back to back, using a single command to the
+ xum1541 device if the firmware supports it.
+
+ \param HandleDevice
+   A CBM_FILE which contains the file handle of the driver.
+
+ \param Entries
+   Pointer to an array of the primitives to run.
+
+ \param Count
+   The number of entries in the Entries array.
+
+ \return
+   0 if all entries succeeded, else the number (starting at 1) of the
+   first entry that failed. If there is a fatal error, returns -1.
+
+ If cbm_driver_open() did not succeed, it is illegal to
+ call this function.
+*/
+
+int CBMAPIDECL
+opencbm_plugin_batch(CBM_FILE HandleDevice, opencbm_plugin_batch_entry_t *Entries, unsigned int Count)
+{
+    return xum1541_batch((struct opencbm_usb_handle *)HandleDevice, Entries, Count);
+}
+
+/*! \brief Switch deferred status for writes on or off
+
+ \param HandleDevice
+   A CBM_FILE which contains the file handle of the driver.
+
+ \param Enable
+   If not zero, writes do not wait for their status anymore.
+
+ \return
+   The previous state (0 or 1), or -1 if the device does not support
+   deferred status.
+
+ If cbm_driver_open() did not succeed, it is illegal to
+ call this function.
+*/
+
+int CBMAPIDECL
+opencbm_plugin_set_deferred_status(CBM_FILE HandleDevice, int Enable)
+{
+    return xum1541_set_deferred_status((struct opencbm_usb_handle *)HandleDevice, Enable);
+}
+
+/*! \brief Collect the status of the deferred writes
+
+ \param HandleDevice
+   A CBM_FILE which contains the file handle of the driver.
+
+ \return
+   0 if all deferred writes succeeded, else the number of writes
+   that failed. If there is a fatal error, returns -1.
+
+ If cbm_driver_open() did not succeed, it is illegal to
+ call this function.
+*/
+
+int CBMAPIDECL
+opencbm_plugin_flush_deferred_status(CBM_FILE HandleDevice)
+{
+    return xum1541_flush_deferred_status((struct opencbm_usb_handle *)HandleDevice);
+}
+
+/*! \brief Write to the memory of a drive, run by the adapter
+
+ \param HandleDevice
+   A CBM_FILE which contains the file handle of the driver.
+
+ \param DeviceAddress
+   The address of the device on the IEC serial bus.
+
+ \param MemoryAddress
+   The address in the drive's memory to write to.
+
+ \param Buffer
+   Pointer to the bytes to be written.
+
+ \param Count
+   The number of bytes to be written.
+
+ \return
+   The number of bytes written, or -1 if the firmware does not
+   support this or there was a fatal error.
+
+ If cbm_driver_open() did not succeed, it is illegal to
+ call this function.
+*/
+
+int CBMAPIDECL
+opencbm_plugin_memory_write(CBM_FILE HandleDevice, unsigned char DeviceAddress, unsigned int MemoryAddress, const unsigned char *Buffer, unsigned int Count)
+{
+    return xum1541_memory_write((struct opencbm_usb_handle *)HandleDevice, DeviceAddress, MemoryAddress, Buffer, Count);
+}
+
+/*! \brief Read from the memory of a drive, run by the adapter
+
+ \param HandleDevice
+   A CBM_FILE which contains the file handle of the driver.
+
+ \param DeviceAddress
+   The address of the device on the IEC serial bus.
+
+ \param MemoryAddress
+   The address in the drive's memory to read from.
+
+ \param Buffer
+   Pointer to a buffer which will hold the bytes read.
+
+ \param Count
+   The number of bytes to be read; the range must not cross a page.
+
+ \return
+   The number of bytes read, or -1 if the firmware does not
+   support this or there was a fatal error.
+
+ If cbm_driver_open() did not succeed, it is illegal to
+ call this function.
+*/
+
+int CBMAPIDECL
+opencbm_plugin_memory_read(CBM_FILE HandleDevice, unsigned char DeviceAddress, unsigned int MemoryAddress, unsigned char *Buffer, unsigned int Count)
+{
+    return xum1541_memory_read((struct opencbm_usb_handle *)HandleDevice, DeviceAddress, MemoryAddress, Buffer, Count);
+}
+
+/*! \brief Write drive code the adapter keeps in its flash
+
+ \param HandleDevice
+   A CBM_FILE which contains the file handle of the driver.
+
+ \param DeviceAddress
+   The address of the device on the IEC serial bus.
+
+ \param MemoryAddress
+   The address in the drive's memory to write to.
+
+ \param Buffer
+   Pointer to the whole drive code.
+
+ \param Count
+   The number of bytes of the drive code.
+
+ \return
+   The number of bytes written, 0 if the adapter does not have
+   this drive code, or -1 if the firmware does not support this
+   or there was a fatal error.
+
+ If cbm_driver_open() did not succeed, it is illegal to
+ call this function.
+*/
+
+int CBMAPIDECL
+opencbm_plugin_code_upload(CBM_FILE HandleDevice, unsigned char DeviceAddress, unsigned int MemoryAddress, const unsigned char *Buffer, unsigned int Count)
+{
+    return xum1541_code_upload((struct opencbm_usb_handle *)HandleDevice, DeviceAddress, MemoryAddress, Buffer, Count);
+}
+
 /*! \brief Sends a command to the xum1541 device
 
  This function sends a control message respectively a command to the xum1541 device.
@@ -565,6 +565,52 @@ opencbm_plugin_tap_start_capture(CBM_FILE HandleDevice, unsigned char *Buffer, u
     return result;
 }
 
+/*! \brief TAPE: Capture a tape chunk by chunk
+
+ This function is a helper function for tape:
+ It starts the actual tape capture, handing the data to Callback
+ chunk by chunk.
+
+ \param HandleDevice
+   A CBM_FILE which contains the file handle of the driver.
+
+ \param Buffer
+   Pointer to a buffer for one chunk of the capture data.
+
+ \param Buffer_Length
+   The length of the Buffer.
+
+ \param Callback
+   Called with every chunk read; != 0 breaks off the capture.
+
+ \param Context
+   Passed unchanged to Callback.
+
+ \param Status
+   The return status.
+
+ \param BytesRead
+   The number of bytes read in total.
+
+ \return
+   != 0 on success.
+
+ If cbm_driver_open() did not succeed, it is illegal to
+ call this function.
+
+ Note that a plugin is not required to implement this function.
+*/
+
+int CBMAPIDECL
+opencbm_plugin_tap_capture(CBM_FILE HandleDevice, unsigned char *Buffer, unsigned int Buffer_Length, cbm_tap_capture_callback_t Callback, void *Context, int *Status, int *BytesRead)
+{
+    int result = xum1541_tap_capture((struct opencbm_usb_handle *)HandleDevice, Buffer, Buffer_Length, Callback, Context, Status, BytesRead);
+    if (result <= 0) {
+        DBG_WARN((DBG_PREFIX "opencbm_plugin_tap_capture: returned with error %d", result));
+    }
+    return result;
+}
+
 /*! \brief TAPE: Start write
 
  This function is a helper function for tape:
@@ -604,6 +650,46 @@ opencbm_plugin_tap_start_write(CBM_FILE HandleDevice, unsigned char *Buffer, uns
     return result;
 }
 
+/*! \brief TAPE: Write a tape chunk by chunk
+
+ This function is a helper function for tape:
+ It starts the actual tape write, getting the data from Callback
+ chunk by chunk.
+
+ \param HandleDevice
+   A CBM_FILE which contains the file handle of the driver.
+
+ \param Callback
+   Called for every chunk to be written.
+
+ \param Context
+   Passed unchanged to Callback.
+
+ \param Status
+   The return status.
+
+ \param BytesWritten
+   The number of bytes written in total.
+
+ \return
+   != 0 on success.
+
+ If cbm_driver_open() did not succeed, it is illegal to
+ call this function.
+
+ Note that a plugin is not required to implement this function.
+*/
+
+int CBMAPIDECL
+opencbm_plugin_tap_write(CBM_FILE HandleDevice, cbm_tap_write_callback_t Callback, void *Context, int *Status, int *BytesWritten)
+{
+    int result = xum1541_tap_write((struct opencbm_usb_handle *)HandleDevice, Callback, Context, Status, BytesWritten);
+    if (result <= 0) {
+        DBG_WARN((DBG_PREFIX "opencbm_plugin_tap_write: returned with error %d", result));
+    }
+    return result;
+}
+
 /*! \brief TAPE: Return tape firmware version
 
  This function is a helper function for tape:
@@ -72,6 +72,28 @@ opencbm_plugin_s1_read_n(CBM_FILE HandleDevice, unsigned char *data, unsigned in
     return xum1541_read((struct opencbm_usb_handle *)HandleDevice, XUM1541_S1, data, size);
 }
 
+/*! \brief Read GCR data with serial1 protocol, decoded by the xum1541
+
+  \param HandleDevice
+    A CBM_FILE which contains the file handle of the driver.
+
+  \param data
+    Pointer to the data buffer which will hold the decoded bytes,
+    (size / 5) * 4 of them.
+
+  \param size
+    The number of GCR bytes to read from the drive.
+
+  \return
+    The number of decoded bytes actually read, 0 on device error. If the
+    xum1541 cannot decode GCR data or there is a fatal error, returns -1.
+*/
+int CBMAPIDECL
+opencbm_plugin_s1_read_gcr_n(CBM_FILE HandleDevice, unsigned char *data, unsigned int size)
+{
+    return xum1541_read_gcr((struct opencbm_usb_handle *)HandleDevice, XUM1541_S1, data, size);
+}
+
 /*! \brief Write data with serial1 protocol
 
   \param HandleDevice
@@ -114,6 +136,28 @@ opencbm_plugin_s2_read_n(CBM_FILE HandleDevice, unsigned char *data, unsigned in
     return xum1541_read((struct opencbm_usb_handle *)HandleDevice, XUM1541_S2, data, size);
 }
 
+/*! \brief Read GCR data with serial2 protocol, decoded by the xum1541
+
+  \param HandleDevice
+    A CBM_FILE which contains the file handle of the driver.
+
+  \param data
+    Pointer to the data buffer which will hold the decoded bytes,
+    (size / 5) * 4 of them.
+
+  \param size
+    The number of GCR bytes to read from the drive.
+
+  \return
+    The number of decoded bytes actually read, 0 on device error. If the
+    xum1541 cannot decode GCR data or there is a fatal error, returns -1.
+*/
+int CBMAPIDECL
+opencbm_plugin_s2_read_gcr_n(CBM_FILE HandleDevice, unsigned char *data, unsigned int size)
+{
+    return xum1541_read_gcr((struct opencbm_usb_handle *)HandleDevice, XUM1541_S2, data, size);
+}
+
 /*! \brief Write data with serial2 protocol
 
   \param HandleDevice
@@ -156,6 +200,28 @@ opencbm_plugin_pp_dc_read_n(CBM_FILE HandleDevice, unsigned char *data, unsigned
     return xum1541_read((struct opencbm_usb_handle *)HandleDevice, XUM1541_PP, data, size);
 }
 
+/*! \brief Read GCR data with parallel protocol, decoded by the xum1541
+
+  \param HandleDevice
+    A CBM_FILE which contains the file handle of the driver.
+
+  \param data
+    Pointer to the data buffer which will hold the decoded bytes,
+    (size / 5) * 4 of them.
+
+  \param size
+    The number of GCR bytes to read from the drive.
+
+  \return
+    The number of decoded bytes actually read, 0 on device error. If the
+    xum1541 cannot decode GCR data or there is a fatal error, returns -1.
+*/
+int CBMAPIDECL
+opencbm_plugin_pp_dc_read_gcr_n(CBM_FILE HandleDevice, unsigned char *data, unsigned int size)
+{
+    return xum1541_read_gcr((struct opencbm_usb_handle *)HandleDevice, XUM1541_PP, data, size);
+}
+
 /*! \brief Write data with parallel protocol (d64copy)
 
   \param HandleDevice
@@ -23,6 +23,21 @@
 // This XUM1541 plugin has tape support.
 #define TAPE_SUPPORT 1
 
+// ... and can read the firmware profile.
+#define PROFILE_SUPPORT 1
+
+// ... and knows about the fast serial (SRQ) commands.
+#define SRQ_NIB_SUPPORT 1
+
+// ... and can upload the drive code kept in the flash of the device.
+#define XUM1541_CODELIB 1
+
+#ifdef WIN32
+#include <windows.h>
+#else
+#include <time.h>
+#endif
+
 #include <stdlib.h>
 #include <stdarg.h>
 #include <stdio.h>
@@ -132,6 +147,189 @@ xum1541_print_data(int level, const char *op, const unsigned char *data, unsigne
     }
 }
 
+/*! \internal \brief Statistics for one kind of command */
+struct xum1541_stat {
+    unsigned long calls;                          /*!< number of calls */
+    double bytes;                                 /*!< number of bytes transferred */
+    double time_us;                               /*!< accumulated time, in microseconds */
+    unsigned long latency[XUM1541_STATS_BUCKETS]; /*!< bucket n: calls that took less than 2^n us */
+};
+
+static int stats_enabled = -1; /*!< \internal \brief collect statistics (XUM1541_STATS set), or not */
+
+/*! \internal \brief statistics per command; for read and write, also per protocol */
+static struct xum1541_stat xum1541_stats[XUM1541_STAT_COUNT][XUM1541_STATS_PROTOCOLS];
+
+/*! \internal \brief Get a timestamp for the statistics
+
+ \return
+   The time, in microseconds, since some fixed point in the past;
+   or 0 if no statistics are collected, so nothing is done then.
+*/
+static double
+xum1541_stats_start(void)
+{
+#ifdef WIN32
+    static LARGE_INTEGER frequency;
+    LARGE_INTEGER counter;
+#else
+    struct timespec now;
+#endif
+
+    if (stats_enabled == -1) {
+        char *val = getenv("XUM1541_STATS");
+        stats_enabled = (val != NULL && atoi(val) != 0);
+    }
+    if (!stats_enabled)
+        return 0;
+
+#ifdef WIN32
+    if (frequency.QuadPart == 0)
+        QueryPerformanceFrequency(&frequency);
+    QueryPerformanceCounter(&counter);
+    return (double)counter.QuadPart * 1e6 / (double)frequency.QuadPart;
+#else
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return now.tv_sec * 1e6 + now.tv_nsec / 1e3;
+#endif
+}
+
+/*! \internal \brief Account a finished command in the statistics
+
+ \param type
+   The kind of command, one of the XUM1541_STAT_ values
+
+ \param mode
+   For read and write: the protocol (e.g., XUM1541_CBM). Else, 0.
+
+ \param bytes
+   The number of bytes transferred, if any
+
+ \param start
+   The value xum1541_stats_start() returned before the command
+*/
+static void
+xum1541_stats_record(int type, unsigned char mode, int bytes, double start)
+{
+    struct xum1541_stat *stat;
+    double elapsed;
+    unsigned long us;
+    int bucket;
+
+    if (!stats_enabled)
+        return;
+
+    elapsed = xum1541_stats_start() - start;
+    stat = &xum1541_stats[type][XUM_RW_PROTO(mode) >> 4];
+    stat->calls++;
+    if (bytes > 0)
+        stat->bytes += bytes;
+    stat->time_us += elapsed;
+
+    us = (elapsed > 0) ? (unsigned long)elapsed : 0;
+    for (bucket = 0; bucket < XUM1541_STATS_BUCKETS - 1 && us != 0; bucket++)
+        us >>= 1;
+    stat->latency[bucket]++;
+}
+
+/*! \internal \brief Output the collected statistics to stderr */
+static void
+xum1541_stats_dump(void)
+{
+    static const char *types[XUM1541_STAT_COUNT] = {
+        "read", "write", "batch", "ioctl", "control"
+    };
+    static const char *protocols[XUM1541_STATS_PROTOCOLS] = {
+        "", "cbm", "s1", "s2", "pp", "p2", "nib", "nib_command",
+        "nib_srq", "nib_srq_command", "tap", "tap_config",
+        "proto12", "proto13", "proto14", "proto15"
+    };
+    struct xum1541_stat *stat;
+    int type, proto, bucket;
+
+    if (stats_enabled != 1)
+        return;
+
+    fprintf(stderr, "[XUM1541] statistics (latency bucket n: less than 2^n us):\n");
+    for (type = 0; type < XUM1541_STAT_COUNT; type++) {
+        for (proto = 0; proto < XUM1541_STATS_PROTOCOLS; proto++) {
+            stat = &xum1541_stats[type][proto];
+            if (stat->calls == 0)
+                continue;
+
+            fprintf(stderr, "[XUM1541] %s%s%s: %lu calls, %.0f bytes, %.0f us "
+                "(%.1f us/call, %.1f KB/s)\n",
+                types[type], proto ? " " : "", protocols[proto],
+                stat->calls, stat->bytes, stat->time_us,
+                stat->time_us / stat->calls,
+                stat->time_us > 0 ? stat->bytes * 1e6 / 1024 / stat->time_us : 0.0);
+            fprintf(stderr, "[XUM1541]   latency:");
+            for (bucket = 0; bucket < XUM1541_STATS_BUCKETS; bucket++) {
+                if (stat->latency[bucket] != 0)
+                    fprintf(stderr, " %d:%lu", bucket, stat->latency[bucket]);
+            }
+            fprintf(stderr, "\n");
+        }
+    }
+}
+
+/*! \internal \brief Output the firmware profile of this session to stderr
+
+ Only done together with the statistics, and if the firmware supports
+ XUM1541_CAP_PROFILE.
+
+ \param HandleXum1541
+   A XUM1541_HANDLE which contains the file handle of the USB device.
+*/
+static void
+xum1541_profile_dump(struct opencbm_usb_handle *HandleXum1541)
+{
+    static const char *protocols[XUM1541_STATS_PROTOCOLS] = {
+        "", "cbm", "s1", "s2", "pp", "p2", "nib", "nib_command",
+        "nib_srq", "nib_srq_command", "tap", "tap_config",
+        "proto12", "proto13", "proto14", "proto15"
+    };
+    static const char *others[XUM_PROF_SLOTS - XUM_PROF_SLOT_BATCH] = {
+        "batch", "memwrite", "memread", "ioctl"
+    };
+    unsigned char profile[XUM_PROFILE_SIZE], *p;
+    unsigned long cycles, usbWait, count;
+    double khz;
+    int slot;
+
+    if (stats_enabled != 1 ||
+        (HandleXum1541->capabilities & XUM1541_CAP_PROFILE) == 0)
+        return;
+
+    if (xum1541_get_profile(HandleXum1541, profile, sizeof(profile), 0) != sizeof(profile))
+        return;
+
+    khz = profile[0] | (profile[1] << 8);
+    if (khz == 0)
+        return;
+
+    fprintf(stderr, "[XUM1541] firmware profile (%.0f kHz):\n", khz);
+    for (slot = 0; slot < XUM_PROF_SLOTS; slot++) {
+        p = &profile[2 + slot * XUM_PROF_SLOT_SIZE];
+        cycles = p[0] | (p[1] << 8) | ((unsigned long)p[2] << 16) | ((unsigned long)p[3] << 24);
+        usbWait = p[4] | (p[5] << 8) | ((unsigned long)p[6] << 16) | ((unsigned long)p[7] << 24);
+        count = p[8] | (p[9] << 8);
+        if (count == 0)
+            continue;
+
+        if (slot < XUM_PROF_SLOT_BATCH) {
+            fprintf(stderr, "[XUM1541] device %s %s", slot < 16 ? "read" : "write",
+                protocols[slot & 15]);
+        } else {
+            fprintf(stderr, "[XUM1541] device %s", others[slot - XUM_PROF_SLOT_BATCH]);
+        }
+        fprintf(stderr, ": %lu commands, %lu cycles (%.1f us/command), "
+            "%lu cycles USB wait (%.1f%%)\n",
+            count, cycles, cycles * 1e3 / khz / count,
+            usbWait, cycles ? usbWait * 100.0 / cycles : 0.0);
+    }
+}
+
 // Cleanup after a failure
 static void
 xum1541_cleanup(struct opencbm_usb_handle *HandleXum1541, char *msg, ...)
@@ -149,6 +347,108 @@ xum1541_cleanup(struct opencbm_usb_handle *HandleXum1541, char *msg, ...)
     }
 }
 
+#if HAVE_LIBUSB1
+/*! \internal \brief The device found by the last successful enumeration
+
+ Opening the same adapter again (e.g., cbm_driver_open() after
+ cbm_driver_close() in the same process) tries this device first,
+ instead of opening every xum1541 to query its strings.
+*/
+static struct {
+    int valid;          /*!< there is a cached device */
+    int portNumber;     /*!< the PortNumber it was found for */
+    int serialNumber;   /*!< the serial number of the device; differs from portNumber for the default device */
+    uint8_t bus;        /*!< the bus number of the device */
+    uint8_t address;    /*!< the address of the device on the bus */
+} xum1541_enum_cache;
+
+/*! \internal \brief Remember the device an enumeration has opened in xum1541_enum_cache
+
+ \param device
+   The device that has been opened
+
+ \param PortNumber
+   The (normalised) serial number the device has been looked for with
+
+ \param serialnum
+   The serial number of the device
+*/
+static void
+xum1541_enumerate_remember(libusb_device *device, int PortNumber, int serialnum)
+{
+    xum1541_enum_cache.valid = 1;
+    xum1541_enum_cache.portNumber = PortNumber;
+    xum1541_enum_cache.serialNumber = serialnum;
+    xum1541_enum_cache.bus = usb.get_bus_number(device);
+    xum1541_enum_cache.address = usb.get_device_address(device);
+}
+
+/*! \internal \brief Try to open the device remembered in xum1541_enum_cache
+
+ \param HandleXum1541
+   The handle to store the opened device into
+
+ \param list
+   The current list of USB devices
+
+ \param cnt
+   The number of entries in list
+
+ \param PortNumber
+   The (normalised) serial number of the device to open
+
+ \return
+   1 if the cached device could be opened and still has the serial
+   number it had, 0 otherwise.
+*/
+static int
+xum1541_enumerate_cached(struct opencbm_usb_handle *HandleXum1541,
+    libusb_device **list, ssize_t cnt, int PortNumber)
+{
+    struct libusb_device_descriptor descriptor;
+    struct opencbm_usb_handle found = { NULL, NULL };
+    unsigned char string[8];
+    int len, serialnum;
+    ssize_t i;
+
+    if (!xum1541_enum_cache.valid || xum1541_enum_cache.portNumber != PortNumber)
+        return 0;
+
+    for (i = 0; i < cnt; i++) {
+        if (usb.get_bus_number(list[i]) != xum1541_enum_cache.bus ||
+            usb.get_device_address(list[i]) != xum1541_enum_cache.address)
+            continue;
+
+        if (LIBUSB_SUCCESS != usb.get_device_descriptor(list[i], &descriptor) ||
+            descriptor.idVendor != XUM1541_VID || descriptor.idProduct != XUM1541_PID)
+            break;
+        if (LIBUSB_SUCCESS != usb.open(list[i], &found.devh))
+            break;
+
+        // Make sure it is still the same adapter
+        serialnum = 0;
+        len = usb.get_string_descriptor_ascii(found.devh, descriptor.iSerialNumber,
+            string, sizeof(string) - 1);
+        if (len > 0 && len <= 3) {
+            string[len] = '\0';
+            serialnum = atoi((char *)string);
+        }
+        if (serialnum != xum1541_enum_cache.serialNumber) {
+            xum1541_cleanup(&found, NULL);
+            break;
+        }
+
+        xum1541_dbg(0, "using cached xum1541 on bus %d, device %d",
+            xum1541_enum_cache.bus, xum1541_enum_cache.address);
+        HandleXum1541->devh = found.devh;
+        return 1;
+    }
+
+    xum1541_enum_cache.valid = 0;
+    return 0;
+}
+#endif
+
 // USB bus enumeration
 static int
 xum1541_enumerate(struct opencbm_usb_handle *HandleXum1541, int PortNumber)
@@ -274,6 +574,11 @@ xum1541_enumerate(struct opencbm_usb_handle *HandleXum1541, int PortNumber)
         return -1;
     }
 
+    if (xum1541_enumerate_cached(HandleXum1541, list, cnt, PortNumber)) {
+        usb.free_device_list(list, 1);
+        return 0;
+    }
+
     for (i = 0; i < cnt; i++)
     {
         libusb_device *device = list[i];
@@ -332,6 +637,7 @@ xum1541_enumerate(struct opencbm_usb_handle *HandleXum1541, int PortNumber)
         if (PortNumber == serialnum) {
             xum1541_dbg(0, "xum1541 serial number: %3u", serialnum);
             HandleXum1541->devh = found.devh;
+            xum1541_enumerate_remember(device, PortNumber, serialnum);
             break;
         }
 
@@ -350,6 +656,8 @@ xum1541_enumerate(struct opencbm_usb_handle *HandleXum1541, int PortNumber)
         err = usb.open(preferredDefaultHandle, &HandleXum1541->devh);
         if (LIBUSB_SUCCESS != err)
             fprintf(stderr, "error: Cannot open USB device: %s\n", usb.error_name(err));
+        else
+            xum1541_enumerate_remember(preferredDefaultHandle, PortNumber, leastserial);
     }
 
     usb.free_device_list(list, 1);
@@ -407,14 +715,29 @@ xum1541_device_path(int PortNumber)
         return NULL;
     }
     HandleXum1541->devh = NULL;
+    HandleXum1541->capabilities = 0;
+    HandleXum1541->status_int = 0;
+    HandleXum1541->defer_status = 0;
+    HandleXum1541->jiffy = 0;
+    HandleXum1541->deferred_writes = 0;
+    HandleXum1541->deferred_failures = 0;
 
 #if HAVE_LIBUSB1
-    usb.init(&HandleXum1541->ctx);
+    HandleXum1541->pending_in_len = 0;
+    HandleXum1541->dev_mem = NULL;
+    HandleXum1541->dev_mem_failed = 0;
+    if (dynlibusb_context_get(&HandleXum1541->ctx) != LIBUSB_SUCCESS) {
+        free(HandleXum1541);
+        return NULL;
+    }
 #endif
 
     arch_snprintf(dev_path, sizeof(dev_path), XUM1541_PREFIX);
 
     if (xum1541_enumerate(HandleXum1541, PortNumber) < 0) {
+#if HAVE_LIBUSB1
+        dynlibusb_context_release(HandleXum1541->ctx);
+#endif
         free(HandleXum1541);
         return NULL;
     }
@@ -457,6 +780,14 @@ xum1541_clear_halt(struct opencbm_usb_handle *Xum1541Handle)
             usb.error_name(ret));
         return -1;
     }
+    if (Xum1541Handle->status_int) {
+        ret = usb.clear_halt(Xum1541Handle->devh, XUM_INT_IN_ENDPOINT | LIBUSB_ENDPOINT_IN);
+        if (ret != 0) {
+            fprintf(stderr, "USB clear halt request failed for status ep: %s\n",
+                usb.error_name(ret));
+            return -1;
+        }
+    }
 
 #if HAVE_LIBUSB0
 
@@ -516,8 +847,10 @@ xum1541_init(struct opencbm_usb_handle **HandleXum1541_p, int PortNumber)
     struct opencbm_usb_handle *HandleXum1541;
     unsigned char devInfo[XUM_DEVINFO_SIZE], devStatus;
     uint8_t cmd;
+    uint16_t initFlags;
     int len, ret;
     int success = 0;
+    char *val;
 
     if (HandleXum1541_p == NULL) {
         perror("xum1541_init: HandleXum1541_p is NULL");
@@ -535,18 +868,21 @@ xum1541_init(struct opencbm_usb_handle **HandleXum1541_p, int PortNumber)
     HandleXum1541->devh = NULL;
 
 #if HAVE_LIBUSB1
-    usb.init(&HandleXum1541->ctx);
-#endif
-
-    if (xum1541_enumerate(HandleXum1541, PortNumber) < 0) {
-        fprintf(stderr, "error: no xum1541 device found\n");
+    HandleXum1541->dev_mem = NULL;
+    HandleXum1541->dev_mem_failed = 0;
+    if (dynlibusb_context_get(&HandleXum1541->ctx) != LIBUSB_SUCCESS) {
+        fprintf(stderr, "error: libusb could not be initialised\n");
+        free(HandleXum1541);
+        *HandleXum1541_p = NULL;
         return -1;
     }
+#endif
 
-    if (HandleXum1541->devh == NULL) {
+    if (xum1541_enumerate(HandleXum1541, PortNumber) < 0
+        || HandleXum1541->devh == NULL) {
         fprintf(stderr, "error: no xum1541 device found\n");
 #if HAVE_LIBUSB1
-        usb.exit(HandleXum1541->ctx);
+        dynlibusb_context_release(HandleXum1541->ctx);
 #endif
         free(HandleXum1541);
         *HandleXum1541_p = NULL;
@@ -605,14 +941,28 @@ xum1541_init(struct opencbm_usb_handle **HandleXum1541_p, int PortNumber)
 	    }
         }
 
+        /*
+         * If the previous session was interrupted, the firmware resets
+         * the drives, and the next command waits until they are up again.
+         * If asked to, only let it release the bus and go on at once.
+         */
+        val = getenv("XUM1541_NO_RESET");
+        initFlags = (val != NULL && atoi(val) != 0) ? XUM1541_INIT_NO_RESET : 0;
+
+        /*
+         * Ask for the status on the interrupt endpoint. Older firmware
+         * ignores the flag and does not report XUM1541_CAP_STATUS_INT.
+         */
+        initFlags |= XUM1541_INIT_STATUS_INT;
+
         // Check the basic device info message for firmware version
         memset(devInfo, 0, sizeof(devInfo));
 #if HAVE_LIBUSB0
         len = usb.control_msg(HandleXum1541->devh, USB_TYPE_CLASS | USB_ENDPOINT_IN,
-            XUM1541_INIT, 0, 0, (char*)devInfo, sizeof(devInfo), USB_TIMEOUT);
+            XUM1541_INIT, initFlags, 0, (char*)devInfo, sizeof(devInfo), USB_TIMEOUT);
 #elif HAVE_LIBUSB1
         len = usb.control_transfer(HandleXum1541->devh, LIBUSB_REQUEST_TYPE_CLASS | LIBUSB_ENDPOINT_IN,
-            XUM1541_INIT, 0, 0, devInfo, sizeof(devInfo), USB_TIMEOUT);
+            XUM1541_INIT, initFlags, 0, devInfo, sizeof(devInfo), USB_TIMEOUT);
 #endif
         if (len < 2) {
             fprintf(stderr, "USB request for XUM1541 info failed: %s\n",
@@ -622,6 +972,13 @@ xum1541_init(struct opencbm_usb_handle **HandleXum1541_p, int PortNumber)
         if (xum1541_check_version(devInfo[0]) != 0) {
             break;
         }
+        // Older firmware only reports the low byte of the capabilities
+        HandleXum1541->capabilities = devInfo[1];
+        if (len >= 4) {
+            HandleXum1541->capabilities |= devInfo[3] << 8;
+        }
+        HandleXum1541->status_int =
+            (HandleXum1541->capabilities & XUM1541_CAP_STATUS_INT) != 0;
         if (len >= 4) {
             xum1541_dbg(0, "device capabilities %02x status %02x",
                 devInfo[1], devInfo[2]);
@@ -630,7 +987,8 @@ xum1541_init(struct opencbm_usb_handle **HandleXum1541_p, int PortNumber)
         // Check for the xum1541's current status. (Not the drive.)
         devStatus = devInfo[2];
         if ((devStatus & XUM1541_DOING_RESET) != 0) {
-            fprintf(stderr, "previous command was interrupted, resetting\n");
+            fprintf(stderr, "previous command was interrupted, %s\n",
+                (initFlags & XUM1541_INIT_NO_RESET) ? "releasing the bus" : "resetting");
             // Clear the stalls on both endpoints
             if (xum1541_clear_halt(HandleXum1541) < 0) {
                 break;
@@ -657,11 +1015,41 @@ xum1541_init(struct opencbm_usb_handle **HandleXum1541_p, int PortNumber)
 
         success = 1;
 
+        // Use JiffyDOS with drives that support it, if asked to
+        if ((HandleXum1541->capabilities & XUM1541_CAP_JIFFY) != 0) {
+            val = getenv("XUM1541_JIFFY");
+            HandleXum1541->jiffy = (val != NULL && atoi(val) != 0);
+        }
+
+        /*
+         * Use 1571/1581 fast serial, if asked to. The setting survives
+         * in the firmware, so also turn it off if not.
+         */
+        if ((HandleXum1541->capabilities & XUM1541_CAP_FAST_SERIAL) != 0 &&
+            (devStatus & (XUM1541_IEEE488_PRESENT | XUM1541_TAPE_PRESENT)) == 0) {
+            val = getenv("XUM1541_FAST_SERIAL");
+            xum1541_ioctl(HandleXum1541, XUM1541_IEC_FAST_SERIAL,
+                val != NULL && atoi(val) != 0, 0);
+        }
+
+        // Let the firmware profile start with this session, if it is output
+        xum1541_stats_start();
+        if (stats_enabled == 1 &&
+            (HandleXum1541->capabilities & XUM1541_CAP_PROFILE) != 0) {
+            unsigned char profile[XUM_PROFILE_SIZE];
+            xum1541_get_profile(HandleXum1541, profile, sizeof(profile), 1);
+        }
+
         // extended compile infos are not supported in firmware versions < 8
         if (devInfo[0] < 8) {
             break;
         }
 
+        // they are only output for debugging, don't waste the time otherwise
+        if (debug_level < 1) {
+            break;
+        }
+
         /*
          * Check if the firmware supports the extended compile info commands
          * and, if so, print their results to the debug log.
@@ -722,8 +1110,11 @@ xum1541_close(struct opencbm_usb_handle *HandleXum1541)
     int ret;
 
     xum1541_dbg(0, "Closing USB link");
+    xum1541_stats_dump();
 
     if (HandleXum1541->devh != NULL) {
+        xum1541_profile_dump(HandleXum1541);
+
 #if HAVE_LIBUSB0
         ret = usb.control_msg(HandleXum1541->devh, USB_TYPE_CLASS | USB_ENDPOINT_OUT,
             XUM1541_SHUTDOWN, 0, 0, NULL, 0, 1000);
@@ -748,11 +1139,13 @@ xum1541_close(struct opencbm_usb_handle *HandleXum1541)
         // LIBUSB_ERROR_NOT_FOUND means the interface was never claimed
         if (ret != LIBUSB_SUCCESS && ret != LIBUSB_ERROR_NOT_FOUND)
             fprintf(stderr, "USB release intf error: %d %s\n", ret, usb.error_name(ret));
+        if (HandleXum1541->dev_mem != NULL)
+            usb.dev_mem_free(HandleXum1541->devh, HandleXum1541->dev_mem, XUM1541_DEV_MEM_SIZE);
         usb.close(HandleXum1541->devh);
 #endif
     }
 #if HAVE_LIBUSB1
-    usb.exit(HandleXum1541->ctx);
+    dynlibusb_context_release(HandleXum1541->ctx);
 #endif
 
     free(HandleXum1541);
@@ -774,6 +1167,7 @@ int
 xum1541_control_msg(struct opencbm_usb_handle *HandleXum1541, unsigned int cmd)
 {
     int nBytes;
+    double start = xum1541_stats_start();
 
     xum1541_dbg(1, "control msg %d", cmd);
 
@@ -790,121 +1184,557 @@ xum1541_control_msg(struct opencbm_usb_handle *HandleXum1541, unsigned int cmd)
         exit(-1); /** \todo WHY? */
     }
 
+    xum1541_stats_record(XUM1541_STAT_CONTROL, 0, 0, start);
     return nBytes;
 }
 
-static int
-xum1541_wait_status(struct opencbm_usb_handle *HandleXum1541)
+/*! \internal \brief Get the maximum size of one bulk data transfer
+
+ \return
+   xum1541_usb_transfer_size rounded down to whole packets, if it is
+   set and smaller than XUM_MAX_XFER_SIZE; else XUM_MAX_XFER_SIZE.
+*/
+static size_t
+xum1541_max_transfer_size(void)
 {
-    int nBytes, deviceBusy, ret=0;
-    unsigned char statusBuf[XUM_STATUSBUF_SIZE];
+    size_t max = xum1541_usb_transfer_size / XUM1541_IOV_ALIGN * XUM1541_IOV_ALIGN;
 
-    xum1541_dbg(2, "xum1541_wait_status checking for status");
-    deviceBusy = 1;
-    while (deviceBusy) {
-#if HAVE_LIBUSB0
-        nBytes = usb.bulk_read(HandleXum1541->devh,
-            XUM_BULK_IN_ENDPOINT | USB_ENDPOINT_IN,
-            (char*)statusBuf, XUM_STATUSBUF_SIZE, LIBUSB_NO_TIMEOUT);
-#elif HAVE_LIBUSB1
-        nBytes = 0;
-        ret = usb.bulk_transfer(HandleXum1541->devh,
-            XUM_BULK_IN_ENDPOINT | LIBUSB_ENDPOINT_IN,
-            statusBuf, XUM_STATUSBUF_SIZE, &nBytes, LIBUSB_NO_TIMEOUT);
-#endif
-        if (nBytes == XUM_STATUSBUF_SIZE) {
-            switch (XUM_GET_STATUS(statusBuf)) {
-            case XUM1541_IO_BUSY:
-                xum1541_dbg(2, "device busy, waiting");
-                break;
-            case XUM1541_IO_ERROR:
-                fprintf(stderr, "device reports error\n");
-                /* FALLTHROUGH */
-            case XUM1541_IO_READY:
-                deviceBusy = 0;
-                break;
-            default:
-                fprintf(stderr, "unknown status value: %d\n",
-                    XUM_GET_STATUS(statusBuf));
-                exit(-1);
-            }
-        } else {
-            fprintf(stderr, "USB error in xum1541_wait_status: %s\n",
-                usb.error_name(ret));
-            exit(-1); /** \todo WHY? */
-        }
-    }
+    if (max == 0 || max > XUM_MAX_XFER_SIZE)
+        max = XUM_MAX_XFER_SIZE;
+    return max;
+}
 
-    // Once we have a valid response (done ok), get extended status
-    if (XUM_GET_STATUS(statusBuf) == XUM1541_IO_READY)
-        ret = XUM_GET_STATUS_VAL(statusBuf);
-    else
-        ret = -1;
+#if HAVE_LIBUSB1
+/*! \internal \brief Get the size of the bulk transfers for a data phase
 
-    xum1541_dbg(2, "return val = %x", ret);
-    return ret;
+ The data phase is split so that all XUM1541_ASYNC_DEPTH transfers are
+ in flight even for medium sized transfers, e.g. a single track, but
+ none gets smaller than XUM1541_ASYNC_MIN_CHUNK or larger than the
+ configured maximum.
+
+ \param size
+   The size of the whole data phase
+
+ \return
+   The size of one transfer; a multiple of XUM1541_IOV_ALIGN.
+*/
+static size_t
+xum1541_async_chunk_size(size_t size)
+{
+    size_t chunk, max = xum1541_max_transfer_size();
+
+    chunk = (size + XUM1541_ASYNC_DEPTH - 1) / XUM1541_ASYNC_DEPTH;
+    chunk = (chunk + XUM1541_IOV_ALIGN - 1) / XUM1541_IOV_ALIGN * XUM1541_IOV_ALIGN;
+    if (chunk < XUM1541_ASYNC_MIN_CHUNK)
+        chunk = XUM1541_ASYNC_MIN_CHUNK;
+    if (chunk > max)
+        chunk = max;
+    return chunk;
 }
 
-// Macro to enforce disk/tape mode.
-// Checks if xum1541_ioctl/xum1541_read/xum1541_write command is allowed in currently set disk/tape mode.
-#define RefuseToWorkInWrongMode \
-    {                                                                                                    \
-        if (/*uh->*/DeviceDriveMode == DeviceDriveMode_Uninit)                                               \
-        {                                                                                                \
-            xum1541_dbg(1, "[RefuseToWorkInWrongMode] cmd blocked - No disk or tape mode set.");         \
-            return XUM1541_Error_NoDiskTapeMode;                                                         \
-        }                                                                                                \
-                                                                                                         \
-        if (isTapeCmd)                                                                                   \
-        {                                                                                                \
-            if (/*uh->*/DeviceDriveMode == DeviceDriveMode_NoTapeSupport)                                \
-            {                                                                                            \
-                xum1541_dbg(1, "[RefuseToWorkInWrongMode] cmd blocked - Firmware has no tape support."); \
-                return XUM1541_Error_NoTapeSupport;                                                      \
-            }                                                                                            \
-                                                                                                         \
-            if (/*uh->*/DeviceDriveMode == DeviceDriveMode_Disk)                                             \
-            {                                                                                            \
-                xum1541_dbg(1, "[RefuseToWorkInWrongMode] cmd blocked - Tape cmd in disk mode.");        \
-                return XUM1541_Error_TapeCmdInDiskMode;                                                  \
-            }                                                                                            \
-        }                                                                                                \
-        else /*isDiskCmd*/                                                                               \
-        {                                                                                                \
-            if (/*uh->*/DeviceDriveMode == DeviceDriveMode_Tape)                                             \
-            {                                                                                            \
-                xum1541_dbg(1, "[RefuseToWorkInWrongMode] cmd blocked - Disk cmd in tape mode.");        \
-                return XUM1541_Error_DiskCmdInTapeMode;                                                  \
-            }                                                                                            \
-        }                                                                                                \
-    }
+/*! \internal \brief One bulk transfer queued by xum1541_async_transfer() */
+struct xum1541_async_slot {
+    struct libusb_transfer *transfer; /*!< the libusb transfer itself */
+    int completed;                    /*!< set by xum1541_async_callback() */
+    unsigned char *dev_mem;           /*!< the buffer in device memory of this slot, or NULL */
+    unsigned char *data;              /*!< the caller's buffer, if dev_mem is used */
+};
 
-/*! \brief Perform an ioctl on the xum1541, which is any command other than
-    read/write or special device management commands such as INIT and RESET.
+/*! \internal \brief Get the buffers in device memory for a data phase
 
  \param HandleXum1541
    A XUM1541_HANDLE which contains the file handle of the USB device.
 
- \param cmd
-   The command to run.
-
- \param addr
-   The IEC device to use or 0 if not needed.
-
- \param secaddr
-   The IEC secondary address to use or 0 if not needed.
+ \param size
+   The size of the data phase.
 
  \return
-   Returns the device status byte, which is 0 if the command does not
-   have a return value. For some commands, the status byte gives
-   info from the device such as the active IEC lines.
+   The XUM1541_DEV_MEM_SIZE bytes of device memory, allocated on the
+   first large data phase and kept until the device is closed; NULL if
+   the data phase is small, or if libusb or the kernel cannot provide
+   device memory. The transfers use the caller's buffer then.
 */
-int
-xum1541_ioctl(struct opencbm_usb_handle *HandleXum1541, unsigned int cmd, unsigned int addr, unsigned int secaddr)
+static unsigned char *
+xum1541_dev_mem(struct opencbm_usb_handle *HandleXum1541, size_t size)
 {
-    int nBytes, ret = 0;
-    unsigned char cmdBuf[XUM_CMDBUF_SIZE];
-    BOOL isTapeCmd = ((XUM1541_TAP_MOTOR_ON <= cmd) && (cmd <= XUM1541_TAP_MOTOR_OFF));
+    if (size < XUM1541_DEV_MEM_MIN ||
+        (xum1541_usb_quirks_mode & XUM1541_USB_QUIRKS_MODE_NO_DEV_MEM) != 0)
+        return NULL;
+
+    if (HandleXum1541->dev_mem == NULL && !HandleXum1541->dev_mem_failed) {
+        if (usb.dev_mem_alloc != NULL)
+            HandleXum1541->dev_mem = usb.dev_mem_alloc(HandleXum1541->devh, XUM1541_DEV_MEM_SIZE);
+        if (HandleXum1541->dev_mem == NULL) {
+            xum1541_dbg(1, "no device memory, using the caller's buffers");
+            HandleXum1541->dev_mem_failed = 1;
+        }
+    }
+    return HandleXum1541->dev_mem;
+}
+
+/*! \internal \brief Completion callback for the queued bulk transfers
+
+ \param transfer
+   The transfer that has been completed, has failed or has been cancelled.
+*/
+static void LIBUSB_CALL
+xum1541_async_callback(struct libusb_transfer *transfer)
+{
+    *(int *)transfer->user_data = 1;
+}
+
+/*! \internal \brief Queue one bulk transfer
+
+ \param HandleXum1541
+   A XUM1541_HANDLE which contains the file handle of the USB device.
+
+ \param slot
+   The slot whose transfer is to be queued.
+
+ \param endpoint
+   The endpoint (including the direction bit) to use.
+
+ \param buffer
+   The data buffer of the transfer. If the slot has a buffer in device
+   memory, the data goes through there.
+
+ \param length
+   The length of the transfer.
+
+ \return
+   LIBUSB_SUCCESS on success, else a libusb error code.
+*/
+static int
+xum1541_async_submit(struct opencbm_usb_handle *HandleXum1541,
+    struct xum1541_async_slot *slot, unsigned char endpoint,
+    unsigned char *buffer, int length)
+{
+    slot->completed = 0;
+    if (slot->dev_mem != NULL) {
+        slot->data = buffer;
+        if (!(endpoint & LIBUSB_ENDPOINT_IN))
+            memcpy(slot->dev_mem, buffer, length);
+        buffer = slot->dev_mem;
+    }
+    libusb_fill_bulk_transfer(slot->transfer, HandleXum1541->devh, endpoint,
+        buffer, length, xum1541_async_callback, &slot->completed,
+        LIBUSB_NO_TIMEOUT);
+    return usb.submit_transfer(slot->transfer);
+}
+
+/*! \internal \brief Wait until a queued bulk transfer has finished
+
+ \param HandleXum1541
+   A XUM1541_HANDLE which contains the file handle of the USB device.
+
+ \param slot
+   The slot to wait for.
+
+ \return
+   LIBUSB_SUCCESS if the transfer completed, else the libusb error code
+   libusb_bulk_transfer() would have returned for it.
+*/
+static int
+xum1541_async_wait(struct opencbm_usb_handle *HandleXum1541, struct xum1541_async_slot *slot)
+{
+    int ret;
+
+    while (!slot->completed) {
+        ret = usb.handle_events_completed(HandleXum1541->ctx, &slot->completed);
+        if (ret < 0 && ret != LIBUSB_ERROR_INTERRUPTED) {
+            // same as libusb's own synchronous wrappers: give up on the transfer
+            usb.cancel_transfer(slot->transfer);
+        }
+    }
+
+    // The caller's buffer gets what was read, as without device memory
+    if (slot->dev_mem != NULL && (slot->transfer->endpoint & LIBUSB_ENDPOINT_IN) &&
+        slot->transfer->actual_length > 0)
+        memcpy(slot->data, slot->dev_mem, slot->transfer->actual_length);
+
+    switch (slot->transfer->status) {
+    case LIBUSB_TRANSFER_COMPLETED:
+        return LIBUSB_SUCCESS;
+    case LIBUSB_TRANSFER_TIMED_OUT:
+        return LIBUSB_ERROR_TIMEOUT;
+    case LIBUSB_TRANSFER_STALL:
+        return LIBUSB_ERROR_PIPE;
+    case LIBUSB_TRANSFER_OVERFLOW:
+        return LIBUSB_ERROR_OVERFLOW;
+    case LIBUSB_TRANSFER_NO_DEVICE:
+        return LIBUSB_ERROR_NO_DEVICE;
+    case LIBUSB_TRANSFER_CANCELLED:
+        return LIBUSB_ERROR_INTERRUPTED;
+    default:
+        return LIBUSB_ERROR_IO;
+    }
+}
+
+/*! \internal \brief Send a command block and run its data phase with
+    several bulk transfers queued at once
+
+ \param HandleXum1541
+   A XUM1541_HANDLE which contains the file handle of the USB device.
+
+ \param cmdBuf
+   The XUM_CMDBUF_SIZE bytes command block to send first, or NULL if only
+   the data phase is to be run.
+
+ \param endpoint
+   The endpoint (including the direction bit) of the data phase.
+
+ \param data
+   The buffer for the data phase.
+
+ \param size
+   The number of bytes of the data phase.
+
+ \param transferred
+   Pointer to storage which gets the number of bytes actually transferred
+   in the data phase.
+
+ \param cmdFailed
+   Pointer to storage which is set to 1 if the command block itself
+   could not be sent, 0 otherwise.
+
+ \return
+   LIBUSB_SUCCESS on success, else the libusb error code of the first
+   transfer that failed.
+
+ \remark
+   This is the libusb 1.0 replacement for the synchronous
+   usb.bulk_transfer() loop. The command block and up to
+   XUM1541_ASYNC_DEPTH data transfers (sized by xum1541_async_chunk_size())
+   are queued back to back, and every finished transfer is
+   resubmitted right away, so the bus is never idle waiting for the host.
+
+   As in the synchronous loop, a short transfer ends the data phase. The
+   transfers queued behind it are cancelled; if one of them has caught
+   some bytes anyway (the status block following a tape read), these are
+   remembered in pending_in and consumed by xum1541_wait_status().
+
+   On Windows, libusb 1.0 submits these transfers as overlapped WinUSB
+   requests, so several of them are pending in the driver at the same
+   time, as with a native WinUSB backend.
+*/
+static int
+xum1541_async_transfer(struct opencbm_usb_handle *HandleXum1541,
+    unsigned char *cmdBuf, unsigned char endpoint, unsigned char *data,
+    size_t size, size_t *transferred, int *cmdFailed)
+{
+    struct xum1541_async_slot cmdSlot, slots[XUM1541_ASYNC_DEPTH], *slot;
+    unsigned int nSlots, head, inflight, i;
+    size_t queued, chunk, chunkSize = xum1541_async_chunk_size(size);
+    unsigned char *devMem = xum1541_dev_mem(HandleXum1541, size);
+    int ret = LIBUSB_SUCCESS, status, actual, done;
+
+    *transferred = 0;
+    *cmdFailed = 0;
+    head = inflight = 0;
+    queued = 0;
+    done = 0;
+    if (cmdBuf != NULL)
+        HandleXum1541->pending_in_len = 0;
+
+    cmdSlot.transfer = usb.alloc_transfer(0);
+    cmdSlot.dev_mem = NULL;
+    if (cmdSlot.transfer == NULL) {
+        *cmdFailed = 1;
+        return LIBUSB_ERROR_NO_MEM;
+    }
+
+    for (nSlots = 0; nSlots < XUM1541_ASYNC_DEPTH; nSlots++) {
+        slots[nSlots].transfer = usb.alloc_transfer(0);
+        if (slots[nSlots].transfer == NULL)
+            break;
+        slots[nSlots].dev_mem = devMem ? devMem + nSlots * XUM_MAX_XFER_SIZE : NULL;
+    }
+
+    do {
+        if (nSlots == 0) {
+            *cmdFailed = 1;
+            ret = LIBUSB_ERROR_NO_MEM;
+            break;
+        }
+
+        if (cmdBuf != NULL) {
+            ret = xum1541_async_submit(HandleXum1541, &cmdSlot,
+                XUM_BULK_OUT_ENDPOINT | LIBUSB_ENDPOINT_OUT, cmdBuf, XUM_CMDBUF_SIZE);
+            if (ret != LIBUSB_SUCCESS) {
+                *cmdFailed = 1;
+                break;
+            }
+        }
+
+        // Queue the first data transfers right behind the command block
+        while (inflight < nSlots && queued < size) {
+            chunk = size - queued;
+            if (chunk > chunkSize)
+                chunk = chunkSize;
+            ret = xum1541_async_submit(HandleXum1541, &slots[inflight],
+                endpoint, data + queued, (int)chunk);
+            if (ret != LIBUSB_SUCCESS)
+                break;
+            queued += chunk;
+            inflight++;
+        }
+
+        if (cmdBuf != NULL) {
+            status = xum1541_async_wait(HandleXum1541, &cmdSlot);
+            if (status != LIBUSB_SUCCESS) {
+                *cmdFailed = 1;
+                ret = status;
+            }
+        }
+        if (ret != LIBUSB_SUCCESS) {
+            done = 1;
+            for (i = 0; i < inflight; i++)
+                usb.cancel_transfer(slots[i].transfer);
+        }
+
+        while (inflight > 0) {
+            slot = &slots[head];
+            status = xum1541_async_wait(HandleXum1541, slot);
+            actual = slot->transfer->actual_length;
+            head = (head + 1) % nSlots;
+            inflight--;
+
+            if (done) {
+                // A transfer behind the end of the data phase caught some data
+                if (actual > 0 && (endpoint & LIBUSB_ENDPOINT_IN)) {
+                    if (HandleXum1541->pending_in_len + actual <= (int)sizeof(HandleXum1541->pending_in)) {
+                        memcpy(&HandleXum1541->pending_in[HandleXum1541->pending_in_len],
+                            slot->transfer->buffer, actual);
+                        HandleXum1541->pending_in_len += actual;
+                    } else {
+                        fprintf(stderr, "xum1541: discarding %d unexpected bytes\n", actual);
+                    }
+                }
+                continue;
+            }
+
+            if (status != LIBUSB_SUCCESS) {
+                ret = status;
+                done = 1;
+            } else {
+                xum1541_print_data(2, (endpoint & LIBUSB_ENDPOINT_IN) ? "read" : "wrote",
+                    slot->transfer->buffer, actual);
+                *transferred += actual;
+
+                /*
+                 * If we transferred less than we requested (or 0), the
+                 * transfer is done even if we had more data still.
+                 */
+                if (actual < slot->transfer->length)
+                    done = 1;
+            }
+
+            if (done) {
+                for (i = 0; i < inflight; i++)
+                    usb.cancel_transfer(slots[(head + i) % nSlots].transfer);
+                continue;
+            }
+
+            // Reuse the slot for the next chunk, if there is any
+            if (queued < size) {
+                chunk = size - queued;
+                if (chunk > chunkSize)
+                    chunk = chunkSize;
+                status = xum1541_async_submit(HandleXum1541,
+                    &slots[(head + inflight) % nSlots], endpoint,
+                    data + queued, (int)chunk);
+                if (status != LIBUSB_SUCCESS) {
+                    ret = status;
+                    done = 1;
+                    for (i = 0; i < inflight; i++)
+                        usb.cancel_transfer(slots[(head + i) % nSlots].transfer);
+                    continue;
+                }
+                queued += chunk;
+                inflight++;
+            }
+        }
+    } while (0);
+
+    for (i = 0; i < nSlots; i++)
+        usb.free_transfer(slots[i].transfer);
+    usb.free_transfer(cmdSlot.transfer);
+
+    return ret;
+}
+#endif
+
+static int
+xum1541_wait_status(struct opencbm_usb_handle *HandleXum1541)
+{
+    int nBytes, deviceBusy, ret=0;
+    unsigned char statusBuf[XUM_STATUSBUF_SIZE];
+
+    xum1541_dbg(2, "xum1541_wait_status checking for status");
+    deviceBusy = 1;
+    while (deviceBusy) {
+#if HAVE_LIBUSB0
+        if (HandleXum1541->status_int) {
+            // The host controller polls the endpoint, we just wait for it
+            nBytes = usb.interrupt_read(HandleXum1541->devh,
+                XUM_INT_IN_ENDPOINT | USB_ENDPOINT_IN,
+                (char*)statusBuf, XUM_STATUSBUF_SIZE, LIBUSB_NO_TIMEOUT);
+        } else {
+            nBytes = usb.bulk_read(HandleXum1541->devh,
+                XUM_BULK_IN_ENDPOINT | USB_ENDPOINT_IN,
+                (char*)statusBuf, XUM_STATUSBUF_SIZE, LIBUSB_NO_TIMEOUT);
+        }
+#elif HAVE_LIBUSB1
+        nBytes = 0;
+        if (HandleXum1541->status_int) {
+            // The host controller polls the endpoint, we just wait for it
+            ret = usb.interrupt_transfer(HandleXum1541->devh,
+                XUM_INT_IN_ENDPOINT | LIBUSB_ENDPOINT_IN,
+                statusBuf, XUM_STATUSBUF_SIZE, &nBytes, LIBUSB_NO_TIMEOUT);
+        } else if (HandleXum1541->pending_in_len >= XUM_STATUSBUF_SIZE) {
+            // A queued transfer of the last data phase already caught the status
+            nBytes = XUM_STATUSBUF_SIZE;
+            memcpy(statusBuf, HandleXum1541->pending_in, XUM_STATUSBUF_SIZE);
+            HandleXum1541->pending_in_len -= XUM_STATUSBUF_SIZE;
+            memmove(HandleXum1541->pending_in,
+                &HandleXum1541->pending_in[XUM_STATUSBUF_SIZE],
+                HandleXum1541->pending_in_len);
+            ret = 0;
+        } else {
+            if (HandleXum1541->pending_in_len > 0) {
+                // The status comes in one packet, so these bytes are not part of it
+                xum1541_dbg(1, "dropping %d bytes caught before the status",
+                    HandleXum1541->pending_in_len);
+                HandleXum1541->pending_in_len = 0;
+            }
+            ret = usb.bulk_transfer(HandleXum1541->devh,
+                XUM_BULK_IN_ENDPOINT | LIBUSB_ENDPOINT_IN,
+                statusBuf, XUM_STATUSBUF_SIZE, &nBytes, LIBUSB_NO_TIMEOUT);
+        }
+#endif
+        if (nBytes == XUM_STATUSBUF_SIZE) {
+            switch (XUM_GET_STATUS(statusBuf)) {
+            case XUM1541_IO_BUSY:
+                xum1541_dbg(2, "device busy, waiting");
+                break;
+            case XUM1541_IO_ERROR:
+                fprintf(stderr, "device reports error\n");
+                /* FALLTHROUGH */
+            case XUM1541_IO_READY:
+                deviceBusy = 0;
+                break;
+            default:
+                fprintf(stderr, "unknown status value: %d\n",
+                    XUM_GET_STATUS(statusBuf));
+                exit(-1);
+            }
+        } else {
+            fprintf(stderr, "USB error in xum1541_wait_status: %s\n",
+                usb.error_name(ret));
+            exit(-1); /** \todo WHY? */
+        }
+    }
+
+    // Once we have a valid response (done ok), get extended status
+    if (XUM_GET_STATUS(statusBuf) == XUM1541_IO_READY)
+        ret = XUM_GET_STATUS_VAL(statusBuf);
+    else
+        ret = -1;
+
+    xum1541_dbg(2, "return val = %x", ret);
+    return ret;
+}
+
+// Macro to enforce disk/tape mode.
+// Checks if xum1541_ioctl/xum1541_read/xum1541_write command is allowed in currently set disk/tape mode.
+#define RefuseToWorkInWrongMode \
+    {                                                                                                    \
+        if (/*uh->*/DeviceDriveMode == DeviceDriveMode_Uninit)                                               \
+        {                                                                                                \
+            xum1541_dbg(1, "[RefuseToWorkInWrongMode] cmd blocked - No disk or tape mode set.");         \
+            return XUM1541_Error_NoDiskTapeMode;                                                         \
+        }                                                                                                \
+                                                                                                         \
+        if (isTapeCmd)                                                                                   \
+        {                                                                                                \
+            if (/*uh->*/DeviceDriveMode == DeviceDriveMode_NoTapeSupport)                                \
+            {                                                                                            \
+                xum1541_dbg(1, "[RefuseToWorkInWrongMode] cmd blocked - Firmware has no tape support."); \
+                return XUM1541_Error_NoTapeSupport;                                                      \
+            }                                                                                            \
+                                                                                                         \
+            if (/*uh->*/DeviceDriveMode == DeviceDriveMode_Disk)                                             \
+            {                                                                                            \
+                xum1541_dbg(1, "[RefuseToWorkInWrongMode] cmd blocked - Tape cmd in disk mode.");        \
+                return XUM1541_Error_TapeCmdInDiskMode;                                                  \
+            }                                                                                            \
+        }                                                                                                \
+        else /*isDiskCmd*/                                                                               \
+        {                                                                                                \
+            if (/*uh->*/DeviceDriveMode == DeviceDriveMode_Tape)                                             \
+            {                                                                                            \
+                xum1541_dbg(1, "[RefuseToWorkInWrongMode] cmd blocked - Disk cmd in tape mode.");        \
+                return XUM1541_Error_DiskCmdInTapeMode;                                                  \
+            }                                                                                            \
+        }                                                                                                \
+    }
+
+/*! \brief Perform an ioctl on the xum1541, which is any command other than
+    read/write or special device management commands such as INIT and RESET.
+
+ \param HandleXum1541
+   A XUM1541_HANDLE which contains the file handle of the USB device.
+
+ \param cmd
+   The command to run.
+
+ \param addr
+   The IEC device to use or 0 if not needed.
+
+ \param secaddr
+   The IEC secondary address to use or 0 if not needed.
+
+ \return
+   Returns the device status byte, which is 0 if the command does not
+   have a return value. For some commands, the status byte gives
+   info from the device such as the active IEC lines.
+*/
+int
+xum1541_ioctl(struct opencbm_usb_handle *HandleXum1541, unsigned int cmd, unsigned int addr, unsigned int secaddr)
+{
+    return xum1541_ioctl_arg(HandleXum1541, cmd, addr, secaddr, 0);
+}
+
+/*! \brief Perform an ioctl on the xum1541 with an additional argument
+
+ Like xum1541_ioctl(), but also fills in the last byte of the
+ command block, which some commands use as an argument.
+
+ \param HandleXum1541
+   A XUM1541_HANDLE which contains the file handle of the USB device.
+
+ \param cmd
+   The command to run.
+
+ \param addr
+   The IEC device to use or 0 if not needed.
+
+ \param secaddr
+   The IEC secondary address to use or 0 if not needed.
+
+ \param arg
+   The additional argument of the command, 0 if not needed.
+
+ \return
+   Returns the device status byte, like xum1541_ioctl().
+*/
+int
+xum1541_ioctl_arg(struct opencbm_usb_handle *HandleXum1541, unsigned int cmd, unsigned int addr, unsigned int secaddr, unsigned int arg)
+{
+    int nBytes, ret = 0;
+    unsigned char cmdBuf[XUM_CMDBUF_SIZE];
+    BOOL isTapeCmd = ((XUM1541_TAP_MOTOR_ON <= cmd) && (cmd <= XUM1541_TAP_MOTOR_OFF));
+    double start = xum1541_stats_start();
 
     xum1541_dbg(1, "ioctl %d for device %d, sub %d", cmd, addr, secaddr);
 
@@ -913,7 +1743,7 @@ xum1541_ioctl(struct opencbm_usb_handle *HandleXum1541, unsigned int cmd, unsign
     cmdBuf[0] = (unsigned char)cmd;
     cmdBuf[1] = (unsigned char)addr;
     cmdBuf[2] = (unsigned char)secaddr;
-    cmdBuf[3] = 0;
+    cmdBuf[3] = (unsigned char)arg;
 
     // Send the 4-byte command block
 #if HAVE_LIBUSB0
@@ -939,9 +1769,54 @@ xum1541_ioctl(struct opencbm_usb_handle *HandleXum1541, unsigned int cmd, unsign
     // If we have a valid response, return extended status
     ret = xum1541_wait_status(HandleXum1541);
     xum1541_dbg(2, "return val = %x", ret);
+    xum1541_stats_record(XUM1541_STAT_IOCTL, 0, 0, start);
     return ret;
 }
 
+/*! \brief Wait for an IEC line with a timeout run by the xum1541
+
+ The firmware takes the timeout in units of 10 ms, at most 255 of
+ them. Longer timeouts are split into several XUM1541_IEC_WAIT
+ commands.
+
+ \param HandleXum1541
+   A XUM1541_HANDLE which contains the file handle of the USB device.
+
+ \param line
+   The line to be waited for.
+
+ \param state
+   If zero, wait for the line to be deactivated, else to be activated.
+
+ \param timeout_ms
+   The time to wait at most in milliseconds; must not be 0.
+
+ \return
+   The state of the IEC bus on return, -1 if the timeout expired, or
+   -2 if the firmware does not support XUM1541_CAP_WAIT_TIMEOUT.
+*/
+int
+xum1541_iec_wait_timeout(struct opencbm_usb_handle *HandleXum1541, int line, int state, unsigned int timeout_ms)
+{
+    unsigned int ticks = (timeout_ms + 9) / 10;
+    unsigned int chunk;
+    int ret;
+
+    if ((HandleXum1541->capabilities & XUM1541_CAP_WAIT_TIMEOUT) == 0)
+        return -2;
+
+    while (ticks != 0) {
+        chunk = (ticks > 255) ? 255 : ticks;
+        ticks -= chunk;
+
+        ret = xum1541_ioctl_arg(HandleXum1541, XUM1541_IEC_WAIT, line, state, chunk);
+        if (((ret & line) != 0) == (state != 0))
+            return ret;
+    }
+
+    return -1;
+}
+
 /*! \brief Send tape operations abort command to the xum1541 device
 
  \param HandleXum1541
@@ -956,290 +1831,1404 @@ xum1541_tap_break(struct opencbm_usb_handle *HandleXum1541)
     BOOL isTapeCmd = TRUE;
     RefuseToWorkInWrongMode; // Check if command allowed in current disk/tape mode.
 
-    xum1541_dbg(1, "[xum1541_tap_break] Sending tape break command.");
+    xum1541_dbg(1, "[xum1541_tap_break] Sending tape break command.");
+
+    return xum1541_control_msg(HandleXum1541, XUM1541_TAP_BREAK);
+}
+
+/*! \internal \brief Recover from a stall of the bulk out endpoint during a tape write
+
+ \param HandleXum1541
+   A XUM1541_HANDLE which contains the file handle of the USB device.
+*/
+static void
+xum1541_tape_stall_recovery(struct opencbm_usb_handle *HandleXum1541)
+{
+    int ret = 0;
+
+#if HAVE_LIBUSB0
+    if (usb.resetep(HandleXum1541->devh, XUM_BULK_OUT_ENDPOINT | USB_ENDPOINT_OUT) < 0) {
+#elif HAVE_LIBUSB1
+    ret = usb.clear_halt(HandleXum1541->devh, XUM_BULK_OUT_ENDPOINT | LIBUSB_ENDPOINT_OUT);
+    if (ret < 0) {
+#endif
+        fprintf(stderr, "USB reset ep request failed for out ep (tape stall): %s\n", usb.error_name(ret));
+    }
+#if HAVE_LIBUSB0
+    if (usb.control_msg(HandleXum1541->devh, USB_RECIP_ENDPOINT, USB_REQ_CLEAR_FEATURE, 0, XUM_BULK_OUT_ENDPOINT, NULL, 0, USB_TIMEOUT) < 0) {
+#elif HAVE_LIBUSB1
+    ret = usb.control_transfer(HandleXum1541->devh, LIBUSB_RECIPIENT_ENDPOINT, LIBUSB_REQUEST_CLEAR_FEATURE, 0, XUM_BULK_OUT_ENDPOINT, NULL, 0, USB_TIMEOUT); /** \todo */
+    if (ret < 0) {
+
+#endif
+        fprintf(stderr, "USB error in xum1541_control_msg (tape stall): %s\n", usb.error_name(ret));
+    }
+}
+
+/*! \internal \brief Send a command block followed by its data phase
+
+ \param HandleXum1541
+   A XUM1541_HANDLE which contains the file handle of the USB device.
+
+ \param cmdBuf
+   The XUM_CMDBUF_SIZE bytes command block, or NULL if the command has
+   already been sent (as for the chunks of a tape write).
+
+ \param data
+    Pointer to buffer which contains the data to be written to the xum1541
+
+ \param size
+    The number of bytes to write to the xum1541
+
+ \param isTapeCmd
+    TRUE if this is a tape command; in this case, a stall of the
+    endpoint ends the data phase without being a fatal error.
+
+ \return
+    The number of bytes actually written. If there is a fatal error,
+    returns -1.
+*/
+static int
+xum1541_write_data(struct opencbm_usb_handle *HandleXum1541, unsigned char *cmdBuf, const unsigned char *data, size_t size, BOOL isTapeCmd)
+{
+    int wr, ret=0;
+    size_t bytesWritten, bytes2write;
+
+#if HAVE_LIBUSB1
+    if ( ! (xum1541_usb_quirks_mode & XUM1541_USB_QUIRKS_MODE_SYNC_TRANSFERS) )
+    {
+        int cmdFailed;
+
+        ret = xum1541_async_transfer(HandleXum1541, cmdBuf,
+            XUM_BULK_OUT_ENDPOINT | LIBUSB_ENDPOINT_OUT,
+            (unsigned char *)data, size, &bytesWritten, &cmdFailed);
+        if (cmdFailed) {
+            fprintf(stderr, "USB error in write cmd: %s\n",
+                usb.error_name(ret));
+            return -1;
+        }
+        if (ret != LIBUSB_SUCCESS) {
+            if (isTapeCmd)
+            {
+                xum1541_tape_stall_recovery(HandleXum1541);
+                return bytesWritten;
+            }
+            fprintf(stderr, "USB error in write data: %s\n",
+                usb.error_name(ret));
+            return -1;
+        }
+    }
+    else
+    {
+#endif
+    if (cmdBuf != NULL) {
+#if HAVE_LIBUSB0
+        wr = usb.bulk_write(HandleXum1541->devh,
+            XUM_BULK_OUT_ENDPOINT | USB_ENDPOINT_OUT,
+            (char *)cmdBuf, XUM_CMDBUF_SIZE, LIBUSB_NO_TIMEOUT);
+#elif HAVE_LIBUSB1
+        ret = usb.bulk_transfer(HandleXum1541->devh,
+            XUM_BULK_OUT_ENDPOINT | LIBUSB_ENDPOINT_OUT,
+            cmdBuf, XUM_CMDBUF_SIZE, &wr, LIBUSB_NO_TIMEOUT);
+#endif
+
+#if HAVE_LIBUSB0
+        if (wr < 0) {
+#elif HAVE_LIBUSB1
+        if (ret != LIBUSB_SUCCESS) {
+#endif
+            fprintf(stderr, "USB error in write cmd: %s\n",
+                usb.error_name(ret));
+            return -1;
+        }
+    }
+
+    bytesWritten = 0;
+    while (bytesWritten < size) {
+        bytes2write = size - bytesWritten;
+        if (bytes2write > xum1541_max_transfer_size())
+            bytes2write = xum1541_max_transfer_size();
+#if HAVE_LIBUSB0
+        wr = usb.bulk_write(HandleXum1541->devh,
+            XUM_BULK_OUT_ENDPOINT | USB_ENDPOINT_OUT,
+            (char *)data, bytes2write, LIBUSB_NO_TIMEOUT);
+#elif HAVE_LIBUSB1
+        wr = 0;
+        ret = usb.bulk_transfer(HandleXum1541->devh,
+            XUM_BULK_OUT_ENDPOINT | LIBUSB_ENDPOINT_OUT,
+            (unsigned char *)data, bytes2write, &wr, LIBUSB_NO_TIMEOUT);
+#endif
+
+#if HAVE_LIBUSB0
+        if (wr < 0) {
+#elif HAVE_LIBUSB1
+        if (ret != LIBUSB_SUCCESS) {
+#endif
+            if (isTapeCmd)
+            {
+                xum1541_tape_stall_recovery(HandleXum1541);
+                return bytesWritten;
+            }
+            fprintf(stderr, "USB error in write data: %s\n",
+                usb.error_name(ret));
+            return -1;
+        }
+
+        xum1541_print_data(2, "wrote", data, wr);
+
+        data += wr;
+        bytesWritten += wr;
+
+        /*
+         * If we wrote less than we requested (or 0), the transfer is done
+         * even if we had more data to write still.
+         */
+        if (wr < (int)bytes2write)
+            break;
+    }
+#if HAVE_LIBUSB1
+    }
+#endif
+
+    return bytesWritten;
+}
+
+/*! \brief Write data to the xum1541 device
+
+ \param HandleXum1541
+   A XUM1541_HANDLE which contains the file handle of the USB device.
+
+ \param mode
+    Drive protocol to use to read the data from the device (e.g,
+    XUM1541_CBM is normal IEC wire protocol).
+
+ \param data
+    Pointer to buffer which contains the data to be written to the xum1541
+
+ \param size
+    The number of bytes to write to the xum1541
+
+ \return
+    The number of bytes actually written, 0 on device error. If there is a
+    fatal error, returns -1.
+*/
+int
+xum1541_write(struct opencbm_usb_handle *HandleXum1541, unsigned char modeFlags, const unsigned char *data, size_t size)
+{
+    int mode, ret=0;
+    size_t bytesWritten;
+    unsigned char cmdBuf[XUM_CMDBUF_SIZE];
+    BOOL isTapeCmd = ((modeFlags == XUM1541_TAP) || (modeFlags == XUM1541_TAP_CONFIG));
+    double start = xum1541_stats_start();
+
+    mode = modeFlags & 0xf0;
+    xum1541_dbg(1, "write %d %d bytes from address %p flags %x",
+        mode, size, data, modeFlags & 0x0f);
+
+    RefuseToWorkInWrongMode; // Check if command allowed in current disk/tape mode.
+
+    // Send the write command
+    cmdBuf[0] = XUM1541_WRITE;
+    cmdBuf[1] = modeFlags;
+    if (mode == XUM1541_CBM && HandleXum1541->defer_status)
+        cmdBuf[1] |= XUM_WRITE_DEFER;
+    if (mode == XUM1541_CBM && (modeFlags & XUM_WRITE_ATN) != 0 &&
+        HandleXum1541->jiffy)
+        cmdBuf[1] |= XUM_WRITE_JIFFY;
+    cmdBuf[2] = size & 0xff;
+    cmdBuf[3] = (size >> 8) & 0xff;
+    bytesWritten = xum1541_write_data(HandleXum1541, cmdBuf, data, size, isTapeCmd);
+    if ((int)bytesWritten < 0)
+        return -1;
+
+    // With deferred status, the device does not send one. Assume success.
+    if (cmdBuf[1] & XUM_WRITE_DEFER) {
+        HandleXum1541->deferred_writes++;
+        xum1541_dbg(2, "write done, status deferred");
+        xum1541_stats_record(XUM1541_STAT_WRITE, modeFlags, (int)bytesWritten, start);
+        return bytesWritten;
+    }
+
+    // If this is the CBM protocol, wait for the status message.
+    if (mode == XUM1541_CBM) {
+        ret = xum1541_wait_status(HandleXum1541);
+        if (ret >= 0)
+            xum1541_dbg(2, "wait done, extended status %d", ret);
+        else
+            xum1541_dbg(2, "wait done with error");
+        bytesWritten = ret;
+    }
+
+    xum1541_dbg(2, "write done, got %d bytes", bytesWritten);
+    xum1541_stats_record(XUM1541_STAT_WRITE, modeFlags, (int)bytesWritten, start);
+    return bytesWritten;
+}
+
+/*! \brief Wrapper for xum1541_write() forcing xum1541_wait_status(), with additional parameters:
+
+ \param Status
+   The return status.
+
+ \param BytesWritten
+   The number of bytes written.
+
+ \return
+     1 : Finished successfully.
+    <0 : Fatal error.
+*/
+
+int
+xum1541_write_ext(struct opencbm_usb_handle *HandleXum1541, unsigned char modeFlags, const unsigned char *data, size_t size, int *Status, int *BytesWritten)
+{
+    xum1541_dbg(1, "[xum1541_write_ext]");
+    *BytesWritten = xum1541_write(HandleXum1541, modeFlags, data, size);
+    if (*BytesWritten < 0)
+        return *BytesWritten;
+    xum1541_dbg(2, "[xum1541_write_ext] BytesWritten = %d", *BytesWritten);
+    *Status = xum1541_wait_status(HandleXum1541);
+    xum1541_dbg(2, "[xum1541_write_ext] Status = %d", *Status);
+    return 1;
+}
+
+/*! \brief Write a tape, getting the data from a callback chunk by chunk
+
+ The callback is asked for the next chunk only when the previous one has
+ been sent, so it can prepare one chunk while the other one is on its
+ way. Thus, the whole tape data never has to be in memory.
+
+ \param HandleXum1541
+   A XUM1541_HANDLE which contains the file handle of the USB device.
+
+ \param callback
+    Sets the pointer to the next chunk and returns its length, 0 at the
+    end of the data, or < 0 to break off the write. The first chunk
+    starts with the 5 bytes length header of the tape data; every chunk
+    except the last one must be a multiple of the USB packet size.
+
+ \param context
+    Passed unchanged to callback.
+
+ \param Status
+   The return status.
+
+ \param BytesWritten
+   The number of bytes written in total.
+
+ \return
+     1 : Finished successfully.
+    <0 : Fatal error.
+*/
+int
+xum1541_tap_write(struct opencbm_usb_handle *HandleXum1541, cbm_tap_write_callback_t callback, void *context, int *Status, int *BytesWritten)
+{
+    unsigned char cmdBuf[XUM_CMDBUF_SIZE], *sendCmd;
+    const unsigned char *data;
+    int len, ret;
+    unsigned int total;
+    BOOL isTapeCmd = TRUE;
+    double start = xum1541_stats_start();
+
+    xum1541_dbg(1, "[xum1541_tap_write]");
+
+    RefuseToWorkInWrongMode; // Check if command allowed in current disk/tape mode.
+
+    *BytesWritten = 0;
+
+    len = callback(context, &data);
+    if (len < 5 || data[0] != 0x80) {
+        xum1541_dbg(1, "[xum1541_tap_write] no length header in first chunk");
+        return -1;
+    }
+
+    // The command gets the length of all of the data, as with xum1541_write().
+    total = ((data[1] << 24) | (data[2] << 16) | (data[3] << 8) | data[4]) + 5;
+    cmdBuf[0] = XUM1541_WRITE;
+    cmdBuf[1] = XUM1541_TAP;
+    cmdBuf[2] = total & 0xff;
+    cmdBuf[3] = (total >> 8) & 0xff;
+    sendCmd = cmdBuf;
+
+    while (len > 0) {
+        ret = xum1541_write_data(HandleXum1541, sendCmd, data, len, isTapeCmd);
+        if (ret < 0)
+            return -1;
+        sendCmd = NULL;
+        *BytesWritten += ret;
+
+        // A stall of the endpoint (stop pressed) ends the write.
+        if (ret < len)
+            break;
+
+        len = callback(context, &data);
+        if (len < 0) {
+            xum1541_dbg(1, "[xum1541_tap_write] breaking off the write");
+            xum1541_tap_break(HandleXum1541);
+        }
+    }
+
+    xum1541_dbg(2, "[xum1541_tap_write] BytesWritten = %d", *BytesWritten);
+    xum1541_stats_record(XUM1541_STAT_WRITE, XUM1541_TAP, *BytesWritten, start);
+    *Status = xum1541_wait_status(HandleXum1541);
+    xum1541_dbg(2, "[xum1541_tap_write] Status = %d", *Status);
+    return 1;
+}
+
+/*! \brief Wrapper for xum1541_read() forcing xum1541_wait_status(), with additional parameters:
+
+ \param Status
+   The return status.
+
+ \param BytesRead
+   The number of bytes read.
+
+ \return
+     1 : Finished successfully.
+    <0 : Fatal error.
+*/
+
+int
+xum1541_read_ext(struct opencbm_usb_handle *HandleXum1541, unsigned char mode, unsigned char *data, size_t size, int *Status, int *BytesRead)
+{
+    xum1541_dbg(1, "[xum1541_read_ext]");
+    *BytesRead = xum1541_read(HandleXum1541, mode, data, size);
+    if (*BytesRead < 0)
+        return *BytesRead;
+    xum1541_dbg(2, "[xum1541_read_ext] BytesRead = %d", *BytesRead);
+    *Status = xum1541_wait_status(HandleXum1541);
+    xum1541_dbg(2, "[xum1541_read_ext] Status = %d", *Status);
+    return 1;
+}
+
+/*! \internal \brief Run the data phase of a read, optionally sending
+    the command block first
+
+ \param HandleXum1541
+   A XUM1541_HANDLE which contains the file handle of the USB device.
+
+ \param cmdBuf
+   The XUM_CMDBUF_SIZE bytes command block, or NULL if the command has
+   already been sent (as for the reads of a batch).
+
+ \param data
+    Pointer to a buffer which will contain the data read from the xum1541
+
+ \param size
+    The number of bytes to read from the xum1541
+
+ \return
+    The number of bytes actually read. If there is a fatal error,
+    returns -1.
+*/
+static int
+xum1541_read_data(struct opencbm_usb_handle *HandleXum1541, unsigned char *cmdBuf, unsigned char *data, size_t size)
+{
+    int rd, ret;
+    size_t bytesRead, bytes2read;
+
+#if HAVE_LIBUSB1
+    if ( ! (xum1541_usb_quirks_mode & XUM1541_USB_QUIRKS_MODE_SYNC_TRANSFERS) )
+    {
+        int cmdFailed;
+
+        ret = xum1541_async_transfer(HandleXum1541, cmdBuf,
+            XUM_BULK_IN_ENDPOINT | LIBUSB_ENDPOINT_IN,
+            data, size, &bytesRead, &cmdFailed);
+        if (cmdFailed) {
+            fprintf(stderr, "USB error in read cmd: %s\n",
+                usb.error_name(ret));
+            return -1;
+        }
+        if (ret != LIBUSB_SUCCESS) {
+            fprintf(stderr, "USB error in read data(%p, %d): %s\n",
+               data, (int)size, usb.error_name(ret));
+            return -1;
+        }
+        return bytesRead;
+    }
+#endif
+
+    if (cmdBuf != NULL) {
+#if HAVE_LIBUSB0
+        ret = 0;
+        rd = usb.bulk_write(HandleXum1541->devh,
+            XUM_BULK_OUT_ENDPOINT | USB_ENDPOINT_OUT,
+            (char *)cmdBuf, XUM_CMDBUF_SIZE, LIBUSB_NO_TIMEOUT);
+#elif HAVE_LIBUSB1
+        ret = usb.bulk_transfer(HandleXum1541->devh,
+            XUM_BULK_OUT_ENDPOINT | LIBUSB_ENDPOINT_OUT,
+            cmdBuf, XUM_CMDBUF_SIZE, &rd, LIBUSB_NO_TIMEOUT);
+#endif
+#if HAVE_LIBUSB0
+        if (rd < 0) {
+#elif HAVE_LIBUSB1
+        if (ret != LIBUSB_SUCCESS) {
+#endif
+            fprintf(stderr, "USB error in read cmd: %s\n",
+                usb.error_name(ret));
+            return -1;
+        }
+    }
+
+    // Read the actual data now that it's ready.
+    bytesRead = 0;
+    while (bytesRead < size) {
+        bytes2read = size - bytesRead;
+        if (bytes2read > xum1541_max_transfer_size())
+            bytes2read = xum1541_max_transfer_size();
+#if HAVE_LIBUSB0
+        ret = 0;
+        rd = usb.bulk_read(HandleXum1541->devh,
+            XUM_BULK_IN_ENDPOINT | USB_ENDPOINT_IN,
+            (char *)data, bytes2read, LIBUSB_NO_TIMEOUT);
+#elif HAVE_LIBUSB1
+        ret = usb.bulk_transfer(HandleXum1541->devh,
+            XUM_BULK_IN_ENDPOINT | LIBUSB_ENDPOINT_IN,
+            data, bytes2read, &rd, LIBUSB_NO_TIMEOUT);
+#endif
+#if HAVE_LIBUSB0
+        if (rd < 0) {
+#elif HAVE_LIBUSB1
+        if (ret != LIBUSB_SUCCESS) {
+#endif
+            fprintf(stderr, "USB error in read data(%p, %d): %s\n",
+               data, (int)size, usb.error_name(ret));
+            return -1;
+        }
+
+        xum1541_print_data(2, "read", data, rd);
+
+        data += rd;
+        bytesRead += rd;
+
+        /*
+         * If we read less than we requested (or 0), the transfer is done
+         * even if we had more data to read still.
+         */
+        if (rd < (int)bytes2read)
+            break;
+    }
+
+    return bytesRead;
+}
+
+/*! \brief Read data from the xum1541 device
+
+ \param HandleXum1541
+   A XUM1541_HANDLE which contains the file handle of the USB device.
+
+ \param mode
+    Drive protocol to use to read the data from the device (e.g,
+    XUM1541_CBM is normal IEC wire protocol).
+
+ \param data
+    Pointer to a buffer which will contain the data read from the xum1541
+
+ \param size
+    The number of bytes to read from the xum1541
+
+ \return
+    The number of bytes actually read, 0 on device error. If there is a
+    fatal error, returns -1.
+*/
+int
+xum1541_read(struct opencbm_usb_handle *HandleXum1541, unsigned char mode, unsigned char *data, size_t size)
+{
+    int bytesRead;
+    unsigned char cmdBuf[XUM_CMDBUF_SIZE];
+    BOOL isTapeCmd = ((mode == XUM1541_TAP) || (mode == XUM1541_TAP_CONFIG));
+    double start = xum1541_stats_start();
+
+    xum1541_dbg(1, "read %d %d bytes to address %p",
+               mode, size, data);
+
+    RefuseToWorkInWrongMode; // Check if command allowed in current disk/tape mode.
+
+    // Send the read command
+    cmdBuf[0] = XUM1541_READ;
+    cmdBuf[1] = mode;
+    cmdBuf[2] = size & 0xff;
+    cmdBuf[3] = (size >> 8) & 0xff;
+
+    bytesRead = xum1541_read_data(HandleXum1541, cmdBuf, data, size);
+    if (bytesRead < 0)
+        return -1;
+
+    xum1541_dbg(2, "read done, got %d bytes", bytesRead);
+    xum1541_stats_record(XUM1541_STAT_READ, mode, bytesRead, start);
+    return bytesRead;
+}
+
+/*! \brief Capture a tape, handing the data to a callback chunk by chunk
+
+ The capture data is read into the same buffer over and over again, and
+ every chunk is handed to the callback as soon as it has arrived. Thus,
+ the whole capture never has to fit into memory.
+
+ \param HandleXum1541
+   A XUM1541_HANDLE which contains the file handle of the USB device.
+
+ \param data
+    Pointer to the buffer for one chunk of the capture data
+
+ \param size
+    The size of the buffer. It must be a multiple of the USB packet size,
+    as the end of the capture is recognized by a short read.
+
+ \param callback
+    Called with every chunk read. If it returns != 0, the capture is
+    broken off; the rest of the data is still read, but discarded.
+
+ \param context
+    Passed unchanged to callback.
+
+ \param Status
+   The return status.
+
+ \param BytesRead
+   The number of bytes read in total.
+
+ \return
+     1 : Finished successfully.
+    <0 : Fatal error.
+*/
+int
+xum1541_tap_capture(struct opencbm_usb_handle *HandleXum1541, unsigned char *data, size_t size, cbm_tap_capture_callback_t callback, void *context, int *Status, int *BytesRead)
+{
+    unsigned char cmdBuf[XUM_CMDBUF_SIZE], *sendCmd;
+    int ret, broken = 0;
+    BOOL isTapeCmd = TRUE;
+    double start = xum1541_stats_start();
+
+    xum1541_dbg(1, "[xum1541_tap_capture] chunks of %d bytes", size);
+
+    RefuseToWorkInWrongMode; // Check if command allowed in current disk/tape mode.
+
+    // The firmware sends the capture until it is finished, whatever the size.
+    cmdBuf[0] = XUM1541_READ;
+    cmdBuf[1] = XUM1541_TAP;
+    cmdBuf[2] = size & 0xff;
+    cmdBuf[3] = (size >> 8) & 0xff;
+    sendCmd = cmdBuf;
+
+    *BytesRead = 0;
+    do {
+        ret = xum1541_read_data(HandleXum1541, sendCmd, data, size);
+        if (ret < 0)
+            return -1;
+        sendCmd = NULL;
+        *BytesRead += ret;
+
+        if (ret > 0 && !broken && callback(context, data, ret) != 0) {
+            xum1541_dbg(1, "[xum1541_tap_capture] breaking off the capture");
+            xum1541_tap_break(HandleXum1541);
+            broken = 1;
+        }
+    } while ((size_t)ret == size);
+
+    xum1541_dbg(2, "[xum1541_tap_capture] BytesRead = %d", *BytesRead);
+    xum1541_stats_record(XUM1541_STAT_READ, XUM1541_TAP, *BytesRead, start);
+    *Status = xum1541_wait_status(HandleXum1541);
+    xum1541_dbg(2, "[xum1541_tap_capture] Status = %d", *Status);
+    return 1;
+}
+
+/*! \brief Read GCR data from the drive, decoded by the xum1541 device
+
+ \param HandleXum1541
+   A XUM1541_HANDLE which contains the file handle of the USB device.
+
+ \param mode
+    Drive protocol to use to read the data from the device (XUM1541_S1,
+    XUM1541_S2 or XUM1541_PP).
+
+ \param data
+    Pointer to a buffer which will contain the decoded data,
+    (gcrSize / 5) * 4 bytes
+
+ \param gcrSize
+    The number of GCR bytes to read from the drive
+
+ \return
+    The number of decoded bytes actually read, 0 on device error. If the
+    firmware does not support XUM1541_CAP_GCR or there is a fatal error,
+    returns -1.
+
+ \remark
+    Every 5 GCR bytes are decoded into 4 bytes while they are read from
+    the drive. Invalid GCR codes are decoded as 0xf nibbles, so damaged
+    data is still caught by the id and checksum checks of the caller.
+*/
+int
+xum1541_read_gcr(struct opencbm_usb_handle *HandleXum1541, unsigned char mode, unsigned char *data, size_t gcrSize)
+{
+    int bytesRead;
+    unsigned char cmdBuf[XUM_CMDBUF_SIZE];
+    BOOL isTapeCmd = FALSE;
+    double start = xum1541_stats_start();
+
+    xum1541_dbg(1, "read gcr %d %d bytes to address %p",
+               mode, gcrSize, data);
+
+    RefuseToWorkInWrongMode; // Check if command allowed in current disk/tape mode.
+
+    if ((HandleXum1541->capabilities & XUM1541_CAP_GCR) == 0 ||
+        gcrSize > XUM_MAX_XFER_SIZE) {
+        return -1;
+    }
+
+    // Send the read command
+    cmdBuf[0] = XUM1541_READ;
+    cmdBuf[1] = mode | XUM_READ_GCR;
+    cmdBuf[2] = gcrSize & 0xff;
+    cmdBuf[3] = (gcrSize >> 8) & 0xff;
+
+    bytesRead = xum1541_read_data(HandleXum1541, cmdBuf, data, (gcrSize / 5) * 4);
+    if (bytesRead < 0)
+        return -1;
+
+    xum1541_dbg(2, "read gcr done, got %d bytes", bytesRead);
+    xum1541_stats_record(XUM1541_STAT_READ, mode, bytesRead, start);
+    return bytesRead;
+}
+
+/*! \brief Write data from several buffers to the xum1541 device
+
+ The buffers are sent as one write command, so the device sees the same
+ as with one xum1541_write() of all buffers concatenated.
+
+ \param HandleXum1541
+   A XUM1541_HANDLE which contains the file handle of the USB device.
+
+ \param modeFlags
+    Drive protocol to use to write the data to the device (e.g,
+    XUM1541_CBM is normal IEC wire protocol), and protocol flags.
+
+ \param iov
+    Pointer to an array of buffers to write to the xum1541
+
+ \param iovcnt
+    The number of entries in the iov array
+
+ \return
+    The number of bytes actually written, 0 on device error. If there is a
+    fatal error, returns -1.
+
+ \remark
+    The command block and the write data have to travel in one data
+    phase. The buffers are copied together for that, one round trip
+    is much more expensive than copying at most 64 KB.
+*/
+int
+xum1541_writev(struct opencbm_usb_handle *HandleXum1541, unsigned char modeFlags, const cbm_iovec_t *iov, unsigned int iovcnt)
+{
+    unsigned char *data, *p;
+    size_t size;
+    unsigned int i;
+    int ret;
+
+    if (iovcnt == 1)
+        return xum1541_write(HandleXum1541, modeFlags, iov[0].iov_base, iov[0].iov_len);
+
+    size = 0;
+    for (i = 0; i < iovcnt; i++)
+        size += iov[i].iov_len;
+
+    data = (size <= 0xffff) ? malloc(size ? size : 1) : NULL;
+    if (data == NULL) {
+        // Too big for one command: write the buffers one by one
+        size = 0;
+        for (i = 0; i < iovcnt; i++) {
+            ret = xum1541_write(HandleXum1541, modeFlags, iov[i].iov_base, iov[i].iov_len);
+            if (ret < 0)
+                return -1;
+            size += ret;
+            if ((size_t)ret != iov[i].iov_len)
+                break;
+        }
+        return size;
+    }
+
+    for (p = data, i = 0; i < iovcnt; i++) {
+        memcpy(p, iov[i].iov_base, iov[i].iov_len);
+        p += iov[i].iov_len;
+    }
+
+    ret = xum1541_write(HandleXum1541, modeFlags, data, size);
+    free(data);
+    return ret;
+}
+
+/*! \brief Read data from the xum1541 device into several buffers
+
+ The data is requested with one read command. Each buffer whose size
+ is a multiple of XUM1541_IOV_ALIGN (and the last one) is filled by
+ the USB transfer directly, without copying. As USB packets cannot be
+ split, the data from the first odd-sized buffer on is read into a
+ temporary buffer and copied.
+
+ \param HandleXum1541
+   A XUM1541_HANDLE which contains the file handle of the USB device.
+
+ \param mode
+    Drive protocol to use to read the data from the device (e.g,
+    XUM1541_CBM is normal IEC wire protocol).
+
+ \param iov
+    Pointer to an array of buffers which will contain the data read from
+    the xum1541
+
+ \param iovcnt
+    The number of entries in the iov array
+
+ \return
+    The number of bytes actually read, 0 on device error. If there is a
+    fatal error, returns -1.
+*/
+int
+xum1541_readv(struct opencbm_usb_handle *HandleXum1541, unsigned char mode, const cbm_iovec_t *iov, unsigned int iovcnt)
+{
+    unsigned char cmdBuf[XUM_CMDBUF_SIZE], *sendCmd, *data;
+    size_t size, bytesRead, rest;
+    unsigned int i;
+    int ret;
+    BOOL isTapeCmd = ((mode == XUM1541_TAP) || (mode == XUM1541_TAP_CONFIG));
+    double start = xum1541_stats_start();
+
+    size = 0;
+    for (i = 0; i < iovcnt; i++)
+        size += iov[i].iov_len;
+
+    xum1541_dbg(1, "readv %d %d bytes to %d buffers", mode, size, iovcnt);
+
+    RefuseToWorkInWrongMode; // Check if command allowed in current disk/tape mode.
+
+    if (size > 0xffff) {
+        // Too big for one command: read the buffers one by one
+        bytesRead = 0;
+        for (i = 0; i < iovcnt; i++) {
+            ret = xum1541_read(HandleXum1541, mode, iov[i].iov_base, iov[i].iov_len);
+            if (ret < 0)
+                return -1;
+            bytesRead += ret;
+            if ((size_t)ret != iov[i].iov_len)
+                break;
+        }
+        return bytesRead;
+    }
+
+    // Send the read command along with the first transfer
+    cmdBuf[0] = XUM1541_READ;
+    cmdBuf[1] = mode;
+    cmdBuf[2] = size & 0xff;
+    cmdBuf[3] = (size >> 8) & 0xff;
+    sendCmd = cmdBuf;
+
+    bytesRead = 0;
+    for (i = 0; i < iovcnt; i++) {
+        if (iov[i].iov_len == 0)
+            continue;
+
+        if (iov[i].iov_len % XUM1541_IOV_ALIGN != 0 && i != iovcnt - 1) {
+            // Odd size in between, read the rest and scatter it
+            rest = size - bytesRead;
+            data = malloc(rest);
+            if (data == NULL)
+                return -1;
+            ret = xum1541_read_data(HandleXum1541, sendCmd, data, rest);
+            if (ret >= 0) {
+                size_t copied = 0, len;
+
+                for (; i < iovcnt && copied < (size_t)ret; i++) {
+                    len = iov[i].iov_len;
+                    if (len > (size_t)ret - copied)
+                        len = ret - copied;
+                    memcpy(iov[i].iov_base, data + copied, len);
+                    copied += len;
+                }
+                bytesRead += ret;
+            }
+            free(data);
+            if (ret < 0)
+                return -1;
+            break;
+        }
+
+        ret = xum1541_read_data(HandleXum1541, sendCmd, iov[i].iov_base, iov[i].iov_len);
+        if (ret < 0)
+            return -1;
+        sendCmd = NULL;
+        bytesRead += ret;
+        if ((size_t)ret != iov[i].iov_len)
+            break;
+    }
+
+    // Nothing to read at all, but the device still expects the command
+    if (size == 0) {
+        if (xum1541_read_data(HandleXum1541, sendCmd, NULL, 0) < 0)
+            return -1;
+    }
+
+    xum1541_dbg(2, "readv done, got %d bytes", bytesRead);
+    xum1541_stats_record(XUM1541_STAT_READ, mode, (int)bytesRead, start);
+    return bytesRead;
+}
+
+/*! \internal \brief Get the XUM1541_CBM mode flags for a batch entry
+
+ \param Type
+   The type of the batch entry.
+
+ \return
+   The mode flags to use with xum1541_write() or xum1541_read().
+*/
+static unsigned char
+xum1541_batch_mode(enum opencbm_plugin_batch_type Type)
+{
+    switch (Type) {
+    case OPENCBM_PLUGIN_BATCH_WRITE_ATN:
+        return XUM1541_CBM | XUM_WRITE_ATN;
+    case OPENCBM_PLUGIN_BATCH_WRITE_ATN_TALK:
+        return XUM1541_CBM | XUM_WRITE_ATN | XUM_WRITE_TALK;
+    default:
+        return XUM1541_CBM;
+    }
+}
+
+/*! \internal \brief Run a batch entry by entry
+
+ This is used for firmware without XUM1541_CAP_BATCH, and for batches
+ that do not fit into a single XUM1541_BATCH command. It has the same
+ semantics as a XUM1541_BATCH command run by the device.
+
+ \param HandleXum1541
+   A XUM1541_HANDLE which contains the file handle of the USB device.
+
+ \param Entries
+   Pointer to an array of the primitives to run.
+
+ \param Count
+   The number of entries in the Entries array.
+
+ \return
+   0 if all entries succeeded, else the number (starting at 1) of the
+   first entry that failed. If there is a fatal error, returns -1.
+*/
+static int
+xum1541_batch_single(struct opencbm_usb_handle *HandleXum1541,
+    opencbm_plugin_batch_entry_t *Entries, unsigned int Count)
+{
+    unsigned int i;
+    int failed = 0, ret;
+
+    for (i = 0; i < Count; i++) {
+        if (failed && Entries[i].type != OPENCBM_PLUGIN_BATCH_WRITE_ATN) {
+            Entries[i].result = -1;
+            continue;
+        }
+
+        if (Entries[i].type == OPENCBM_PLUGIN_BATCH_READ) {
+            ret = 0;
+            if (Entries[i].size != 0)
+                ret = xum1541_read(HandleXum1541, XUM1541_CBM, Entries[i].data, Entries[i].size);
+            if (ret < 0)
+                return -1;
+            if (ret == 0 && Entries[i].size != 0 && !failed)
+                failed = i + 1;
+        } else {
+            ret = xum1541_write(HandleXum1541, xum1541_batch_mode(Entries[i].type),
+                Entries[i].data, Entries[i].size);
+            if (ret < 0)
+                return -1;
+            if (ret != (int)Entries[i].size && !failed)
+                failed = i + 1;
+        }
+        Entries[i].result = ret;
+    }
+
+    return failed;
+}
+
+/*! \brief Run a list of CBM protocol primitives with one command
+
+ All entries are sent to the device with a single XUM1541_BATCH command,
+ which runs them back to back and answers with one status. This saves
+ the USB round trip per primitive that xum1541_write() and
+ xum1541_read() need.
+
+ \param HandleXum1541
+   A XUM1541_HANDLE which contains the file handle of the USB device.
+
+ \param Entries
+   Pointer to an array of the primitives to run. On return, the result
+   member of each entry is set.
+
+ \param Count
+   The number of entries in the Entries array.
+
+ \return
+   0 if all entries succeeded, else the number (starting at 1) of the
+   first entry that failed. If there is a fatal error, returns -1.
+
+ \remark
+   As the status only tells which entry failed first, the result of a
+   write is its size if it was run successfully, and -1 otherwise.
+*/
+int
+xum1541_batch(struct opencbm_usb_handle *HandleXum1541,
+    opencbm_plugin_batch_entry_t *Entries, unsigned int Count)
+{
+    unsigned char cmdBuf[XUM_CMDBUF_SIZE], *list, *p;
+    size_t listLen;
+    unsigned int i;
+    int failed, ret;
+    BOOL isTapeCmd = FALSE, hasReads = FALSE;
+    double start = xum1541_stats_start();
+
+    xum1541_dbg(1, "batch of %d entries", Count);
+
+    RefuseToWorkInWrongMode; // Check if command allowed in current disk/tape mode.
+
+    if ((HandleXum1541->capabilities & XUM1541_CAP_BATCH) == 0) {
+        return xum1541_batch_single(HandleXum1541, Entries, Count);
+    }
+
+    // Determine the length of the list of command blocks and write data
+    listLen = 0;
+    for (i = 0; i < Count; i++) {
+        listLen += XUM_CMDBUF_SIZE;
+        if (Entries[i].type != OPENCBM_PLUGIN_BATCH_READ)
+            listLen += Entries[i].size;
+        else if (Entries[i].size > XUM_MAX_XFER_SIZE)
+            break;
+        else
+            hasReads = TRUE;
+    }
+    if (i < Count || listLen > 0xffff) {
+        return xum1541_batch_single(HandleXum1541, Entries, Count);
+    }
+
+    list = malloc(listLen);
+    if (list == NULL) {
+        return xum1541_batch_single(HandleXum1541, Entries, Count);
+    }
+
+    for (p = list, i = 0; i < Count; i++) {
+        p[0] = (Entries[i].type == OPENCBM_PLUGIN_BATCH_READ) ? XUM1541_READ : XUM1541_WRITE;
+        p[1] = xum1541_batch_mode(Entries[i].type);
+        if ((p[1] & XUM_WRITE_ATN) != 0 && HandleXum1541->jiffy)
+            p[1] |= XUM_WRITE_JIFFY;
+        p[2] = Entries[i].size & 0xff;
+        p[3] = (Entries[i].size >> 8) & 0xff;
+        p += XUM_CMDBUF_SIZE;
+        if (Entries[i].type != OPENCBM_PLUGIN_BATCH_READ) {
+            memcpy(p, Entries[i].data, Entries[i].size);
+            p += Entries[i].size;
+        }
+    }
+
+    // Only a batch of writes can leave out its status
+    cmdBuf[0] = XUM1541_BATCH;
+    cmdBuf[1] = (HandleXum1541->defer_status && !hasReads) ? XUM_WRITE_DEFER : 0;
+    cmdBuf[2] = listLen & 0xff;
+    cmdBuf[3] = (listLen >> 8) & 0xff;
+
+    ret = xum1541_write_data(HandleXum1541, cmdBuf, list, listLen, FALSE);
+    free(list);
+    if (ret != (int)listLen) {
+        return -1;
+    }
+
+    if (cmdBuf[1] & XUM_WRITE_DEFER) {
+        for (i = 0; i < Count; i++)
+            Entries[i].result = (int) Entries[i].size;
+        HandleXum1541->deferred_writes++;
+        xum1541_dbg(2, "batch done, status deferred");
+        xum1541_stats_record(XUM1541_STAT_BATCH, 0, (int)listLen, start);
+        return 0;
+    }
+
+    // Fetch the data of the reads, in order
+    for (i = 0; i < Count; i++) {
+        if (Entries[i].type != OPENCBM_PLUGIN_BATCH_READ)
+            continue;
+        ret = 0;
+        if (Entries[i].size != 0) {
+            ret = xum1541_read_data(HandleXum1541, NULL, Entries[i].data, Entries[i].size);
+            if (ret < 0)
+                return -1;
+        }
+        Entries[i].result = ret;
+    }
+
+    failed = xum1541_wait_status(HandleXum1541);
+    if (failed < 0) {
+        return -1;
+    }
+
+    for (i = 0; i < Count; i++) {
+        if (Entries[i].type == OPENCBM_PLUGIN_BATCH_READ) {
+            if (failed != 0 && i + 1 > (unsigned int) failed)
+                Entries[i].result = -1;
+        } else if (failed == 0 || i + 1 < (unsigned int) failed
+            || (i + 1 > (unsigned int) failed && Entries[i].type == OPENCBM_PLUGIN_BATCH_WRITE_ATN)) {
+            Entries[i].result = (int) Entries[i].size;
+        } else {
+            Entries[i].result = -1;
+        }
+    }
+
+    xum1541_dbg(2, "batch done, first failed entry %d", failed);
+    xum1541_stats_record(XUM1541_STAT_BATCH, 0, (int)listLen, start);
+    return failed;
+}
+
+/*! \internal \brief CRC-32 of drive code, as the device computes it for XUM1541_CODEUPLOAD
+
+ \param data
+   Pointer to the drive code.
+
+ \param size
+   The number of bytes of the drive code.
+
+ \return
+   The CRC-32 (as used by zip) of the drive code.
+*/
+static unsigned long
+xum1541_code_crc32(const unsigned char *data, size_t size)
+{
+    unsigned long crc = 0xffffffffUL;
+    int bit;
+
+    while (size-- != 0) {
+        crc ^= *data++;
+        for (bit = 0; bit < 8; bit++) {
+            crc = (crc >> 1) ^ ((crc & 1) ? 0xedb88320UL : 0);
+        }
+    }
+    return ~crc & 0xffffffffUL;
+}
+
+/*! \brief Let the device upload drive code it keeps in its flash
+
+ \param HandleXum1541
+   A XUM1541_HANDLE which contains the file handle of the USB device.
+
+ \param device
+   The IEC device number of the drive.
+
+ \param address
+   The address in the drive's memory to write to.
+
+ \param data
+   Pointer to the whole drive code. Only its CRC is sent to the device.
+
+ \param size
+   The number of bytes of the drive code.
+
+ \return
+   The number of bytes written, 0 if the device does not have this
+   drive code, or -1 if the firmware does not support XUM1541_CAP_CODELIB
+   or there was a fatal error.
+*/
+int
+xum1541_code_upload(struct opencbm_usb_handle *HandleXum1541, unsigned char device, unsigned int address, const unsigned char *data, size_t size)
+{
+    unsigned char cmdBuf[XUM_CMDBUF_SIZE], req[XUM_CODEUPLOAD_SIZE];
+    unsigned long crc;
+    int ret;
+    BOOL isTapeCmd = FALSE;
+    double start = xum1541_stats_start();
+
+    RefuseToWorkInWrongMode; // Check if command allowed in current disk/tape mode.
+
+    if ((HandleXum1541->capabilities & XUM1541_CAP_CODELIB) == 0 ||
+        size > 0xffff) {
+        return -1;
+    }
+
+    // Small writes are not drive code, don't waste a round trip on them
+    if (size <= XUM_MEM_WRITE_CHUNK) {
+        return 0;
+    }
+
+    crc = xum1541_code_crc32(data, size);
+    req[0] = address & 0xff;
+    req[1] = (address >> 8) & 0xff;
+    req[2] = crc & 0xff;
+    req[3] = (crc >> 8) & 0xff;
+    req[4] = (crc >> 16) & 0xff;
+    req[5] = (crc >> 24) & 0xff;
+
+    cmdBuf[0] = XUM1541_CODEUPLOAD;
+    cmdBuf[1] = device;
+    cmdBuf[2] = size & 0xff;
+    cmdBuf[3] = (size >> 8) & 0xff;
+    if (xum1541_write_data(HandleXum1541, cmdBuf, req, sizeof(req), FALSE) != sizeof(req)) {
+        return -1;
+    }
+
+    ret = xum1541_wait_status(HandleXum1541);
+    xum1541_dbg(2, "code upload done, %d bytes", ret);
+    if (ret > 0) {
+        xum1541_stats_record(XUM1541_STAT_WRITE, XUM1541_CBM, ret, start);
+    }
+    return ret;
+}
+
+/*! \brief Write to the memory of a drive, with the device running the "M-W" commands
+
+ \param HandleXum1541
+   A XUM1541_HANDLE which contains the file handle of the USB device.
+
+ \param device
+   The IEC device number of the drive.
+
+ \param address
+   The address in the drive's memory to write to.
+
+ \param data
+   Pointer to the bytes to be written.
+
+ \param size
+   The number of bytes to be written.
+
+ \return
+   The number of bytes written, or -1 if the firmware does not support
+   XUM1541_CAP_MEMRW or there was a fatal error.
+
+*/
+int
+xum1541_memory_write(struct opencbm_usb_handle *HandleXum1541, unsigned char device, unsigned int address, const unsigned char *data, size_t size)
+{
+    unsigned char cmdBuf[XUM_CMDBUF_SIZE], *buf;
+    int ret;
+    BOOL isTapeCmd = FALSE;
+    double start = xum1541_stats_start();
+
+    xum1541_dbg(1, "memory write %d bytes to %d:%04x", size, device, address);
+
+    RefuseToWorkInWrongMode; // Check if command allowed in current disk/tape mode.
+
+    if ((HandleXum1541->capabilities & XUM1541_CAP_MEMRW) == 0 ||
+        size == 0 || size > 0xffff - 2) {
+        return -1;
+    }
+
+    // The data phase starts with the drive address
+    buf = malloc(size + 2);
+    if (buf == NULL) {
+        return -1;
+    }
+    buf[0] = address & 0xff;
+    buf[1] = (address >> 8) & 0xff;
+    memcpy(buf + 2, data, size);
+
+    cmdBuf[0] = XUM1541_MEMWRITE;
+    cmdBuf[1] = device;
+    cmdBuf[2] = size & 0xff;
+    cmdBuf[3] = (size >> 8) & 0xff;
+    ret = xum1541_write_data(HandleXum1541, cmdBuf, buf, size + 2, FALSE);
+    free(buf);
+    if (ret != (int)size + 2) {
+        return -1;
+    }
 
-    return xum1541_control_msg(HandleXum1541, XUM1541_TAP_BREAK);
+    ret = xum1541_wait_status(HandleXum1541);
+    xum1541_dbg(2, "memory write done, %d bytes", ret);
+    xum1541_stats_record(XUM1541_STAT_WRITE, XUM1541_CBM, ret, start);
+    return ret;
 }
 
-/*! \brief Write data to the xum1541 device
+/*! \brief Read from the memory of a drive, with the device running the "M-R" command
 
  \param HandleXum1541
    A XUM1541_HANDLE which contains the file handle of the USB device.
 
- \param mode
-    Drive protocol to use to read the data from the device (e.g,
-    XUM1541_CBM is normal IEC wire protocol).
+ \param device
+   The IEC device number of the drive.
+
+ \param address
+   The address in the drive's memory to read from.
 
  \param data
-    Pointer to buffer which contains the data to be written to the xum1541
+   Pointer to a buffer which will hold the bytes read.
 
  \param size
-    The number of bytes to write to the xum1541
+   The number of bytes to be read. The range must not cross a page
+   of the drive's memory.
 
  \return
-    The number of bytes actually written, 0 on device error. If there is a
-    fatal error, returns -1.
+   The number of bytes read, or -1 if the firmware does not support
+   XUM1541_CAP_MEMRW or there was a fatal error.
 */
 int
-xum1541_write(struct opencbm_usb_handle *HandleXum1541, unsigned char modeFlags, const unsigned char *data, size_t size)
+xum1541_memory_read(struct opencbm_usb_handle *HandleXum1541, unsigned char device, unsigned int address, unsigned char *data, size_t size)
 {
-    int wr, mode, ret=0;
-    size_t bytesWritten, bytes2write;
-    unsigned char cmdBuf[XUM_CMDBUF_SIZE];
-    BOOL isTapeCmd = ((modeFlags == XUM1541_TAP) || (modeFlags == XUM1541_TAP_CONFIG));
+    unsigned char cmdBuf[XUM_CMDBUF_SIZE], addr[2];
+    int ret;
+    BOOL isTapeCmd = FALSE;
+    double start = xum1541_stats_start();
 
-    mode = modeFlags & 0xf0;
-    xum1541_dbg(1, "write %d %d bytes from address %p flags %x",
-        mode, size, data, modeFlags & 0x0f);
+    xum1541_dbg(1, "memory read %d bytes from %d:%04x", size, device, address);
 
     RefuseToWorkInWrongMode; // Check if command allowed in current disk/tape mode.
 
-    // Send the write command
-    cmdBuf[0] = XUM1541_WRITE;
-    cmdBuf[1] = modeFlags;
+    if ((HandleXum1541->capabilities & XUM1541_CAP_MEMRW) == 0 ||
+        size == 0 || (address & 0xff) + size > XUM_MEM_READ_CHUNK) {
+        return -1;
+    }
+
+    addr[0] = address & 0xff;
+    addr[1] = (address >> 8) & 0xff;
+
+    cmdBuf[0] = XUM1541_MEMREAD;
+    cmdBuf[1] = device;
     cmdBuf[2] = size & 0xff;
     cmdBuf[3] = (size >> 8) & 0xff;
-#if HAVE_LIBUSB0
-    wr = usb.bulk_write(HandleXum1541->devh,
-        XUM_BULK_OUT_ENDPOINT | USB_ENDPOINT_OUT,
-        (char *)cmdBuf, sizeof(cmdBuf), LIBUSB_NO_TIMEOUT);
-#elif HAVE_LIBUSB1
-    ret = usb.bulk_transfer(HandleXum1541->devh,
-        XUM_BULK_OUT_ENDPOINT | LIBUSB_ENDPOINT_OUT,
-        cmdBuf, sizeof(cmdBuf), &wr, LIBUSB_NO_TIMEOUT);
-#endif
+    if (xum1541_write_data(HandleXum1541, cmdBuf, addr, sizeof(addr), FALSE) != sizeof(addr)) {
+        return -1;
+    }
 
-#if HAVE_LIBUSB0
-    if (wr < 0) {
-#elif HAVE_LIBUSB1
-    if (ret != LIBUSB_SUCCESS) {
-#endif
-        fprintf(stderr, "USB error in write cmd: %s\n",
-            usb.error_name(ret));
+    if (xum1541_read_data(HandleXum1541, NULL, data, size) < 0) {
         return -1;
     }
 
-    bytesWritten = 0;
-    while (bytesWritten < size) {
-        bytes2write = size - bytesWritten;
-        if (bytes2write > XUM_MAX_XFER_SIZE)
-            bytes2write = XUM_MAX_XFER_SIZE;
-#if HAVE_LIBUSB0
-        wr = usb.bulk_write(HandleXum1541->devh,
-            XUM_BULK_OUT_ENDPOINT | USB_ENDPOINT_OUT,
-            (char *)data, bytes2write, LIBUSB_NO_TIMEOUT);
-#elif HAVE_LIBUSB1
-        wr = 0;
-        ret = usb.bulk_transfer(HandleXum1541->devh,
-            XUM_BULK_OUT_ENDPOINT | LIBUSB_ENDPOINT_OUT,
-            (unsigned char *)data, bytes2write, &wr, LIBUSB_NO_TIMEOUT);
-#endif
+    ret = xum1541_wait_status(HandleXum1541);
+    xum1541_dbg(2, "memory read done, %d bytes", ret);
+    xum1541_stats_record(XUM1541_STAT_READ, XUM1541_CBM, ret, start);
+    return ret;
+}
 
-#if HAVE_LIBUSB0
-        if (wr < 0) {
-#elif HAVE_LIBUSB1
-        if (ret != LIBUSB_SUCCESS) {
-#endif
-            if (isTapeCmd)
-            {
-#if HAVE_LIBUSB0
-                if (usb.resetep(HandleXum1541->devh, XUM_BULK_OUT_ENDPOINT | USB_ENDPOINT_OUT) < 0) {
-#elif HAVE_LIBUSB1
-                ret = usb.clear_halt(HandleXum1541->devh, XUM_BULK_OUT_ENDPOINT | LIBUSB_ENDPOINT_OUT);
-                if (ret < 0) {
-#endif
-                    fprintf(stderr, "USB reset ep request failed for out ep (tape stall): %s\n", usb.error_name(ret));
-                }
-#if HAVE_LIBUSB0
-                if (usb.control_msg(HandleXum1541->devh, USB_RECIP_ENDPOINT, USB_REQ_CLEAR_FEATURE, 0, XUM_BULK_OUT_ENDPOINT, NULL, 0, USB_TIMEOUT) < 0) {
-#elif HAVE_LIBUSB1
-                ret = usb.control_transfer(HandleXum1541->devh, LIBUSB_RECIPIENT_ENDPOINT, LIBUSB_REQUEST_CLEAR_FEATURE, 0, XUM_BULK_OUT_ENDPOINT, NULL, 0, USB_TIMEOUT); /** \todo */
-                if (ret < 0) {
+/*! \brief Read the firmware profile from the xum1541 device
 
-#endif
-                    fprintf(stderr, "USB error in xum1541_control_msg (tape stall): %s\n", usb.error_name(ret));
-                }
-                return bytesWritten;
-            }
-            fprintf(stderr, "USB error in write data: %s\n",
-                usb.error_name(ret));
-            return -1;
-        }
+ \param HandleXum1541
+   A XUM1541_HANDLE which contains the file handle of the USB device.
 
-        xum1541_print_data(2, "wrote", data, wr);
+ \param data
+   Pointer to a buffer which will contain the profile, see
+   XUM1541_GET_PROFILE for its layout.
 
-        data += wr;
-        bytesWritten += wr;
+ \param size
+   The size of the buffer, at most XUM_PROFILE_SIZE bytes are used.
 
-        /*
-         * If we wrote less than we requested (or 0), the transfer is done
-         * even if we had more data to write still.
-         */
-        if (wr < (int)bytes2write)
-            break;
-    }
+ \param clear
+   If non-zero, the device clears its profile after sending it.
 
-    // If this is the CBM protocol, wait for the status message.
-    if (mode == XUM1541_CBM) {
-        ret = xum1541_wait_status(HandleXum1541);
-        if (ret >= 0)
-            xum1541_dbg(2, "wait done, extended status %d", ret);
-        else
-            xum1541_dbg(2, "wait done with error");
-        bytesWritten = ret;
-    }
+ \return
+   The number of bytes read, or -1 if the firmware does not support
+   XUM1541_CAP_PROFILE or there was a fatal error.
 
-    xum1541_dbg(2, "write done, got %d bytes", bytesWritten);
-    return bytesWritten;
-}
+ \remark
+   The profile is counted in CPU cycles of the device: the time of the
+   bulk commands, by protocol, and how much of this was spent waiting
+   for the host to serve the USB endpoints.
+*/
+int
+xum1541_get_profile(struct opencbm_usb_handle *HandleXum1541, unsigned char *data, size_t size, int clear)
+{
+    unsigned char cmdBuf[XUM_CMDBUF_SIZE];
 
-/*! \brief Wrapper for xum1541_write() forcing xum1541_wait_status(), with additional parameters:
+    xum1541_dbg(1, "get profile, %d bytes%s", size, clear ? ", clear" : "");
 
- \param Status
-   The return status.
+    if ((HandleXum1541->capabilities & XUM1541_CAP_PROFILE) == 0)
+        return -1;
+    if (size > XUM_PROFILE_SIZE)
+        size = XUM_PROFILE_SIZE;
 
- \param BytesWritten
-   The number of bytes written.
+    cmdBuf[0] = XUM1541_GET_PROFILE;
+    cmdBuf[1] = clear ? XUM_PROFILE_CLEAR : 0;
+    cmdBuf[2] = size & 0xff;
+    cmdBuf[3] = (size >> 8) & 0xff;
 
- \return
-     1 : Finished successfully.
-    <0 : Fatal error.
-*/
+    if (xum1541_read_data(HandleXum1541, cmdBuf, data, size) < 0)
+        return -1;
 
-int
-xum1541_write_ext(struct opencbm_usb_handle *HandleXum1541, unsigned char modeFlags, const unsigned char *data, size_t size, int *Status, int *BytesWritten)
-{
-    xum1541_dbg(1, "[xum1541_write_ext]");
-    *BytesWritten = xum1541_write(HandleXum1541, modeFlags, data, size);
-    if (*BytesWritten < 0)
-        return *BytesWritten;
-    xum1541_dbg(2, "[xum1541_write_ext] BytesWritten = %d", *BytesWritten);
-    *Status = xum1541_wait_status(HandleXum1541);
-    xum1541_dbg(2, "[xum1541_write_ext] Status = %d", *Status);
-    return 1;
+    return xum1541_wait_status(HandleXum1541);
 }
 
-/*! \brief Wrapper for xum1541_read() forcing xum1541_wait_status(), with additional parameters:
-
- \param Status
-   The return status.
+/*! \brief Fetch the number of failed deferred writes from the device
 
- \param BytesRead
-   The number of bytes read.
+ \param HandleXum1541
+   A XUM1541_HANDLE which contains the file handle of the USB device.
 
  \return
-     1 : Finished successfully.
-    <0 : Fatal error.
+   0 on success, -1 on a fatal error.
 */
-
-int
-xum1541_read_ext(struct opencbm_usb_handle *HandleXum1541, unsigned char mode, unsigned char *data, size_t size, int *Status, int *BytesRead)
+static int
+xum1541_collect_deferred_status(struct opencbm_usb_handle *HandleXum1541)
 {
-    xum1541_dbg(1, "[xum1541_read_ext]");
-    *BytesRead = xum1541_read(HandleXum1541, mode, data, size);
-    if (*BytesRead < 0)
-        return *BytesRead;
-    xum1541_dbg(2, "[xum1541_read_ext] BytesRead = %d", *BytesRead);
-    *Status = xum1541_wait_status(HandleXum1541);
-    xum1541_dbg(2, "[xum1541_read_ext] Status = %d", *Status);
-    return 1;
+    int ret;
+
+    if (HandleXum1541->deferred_writes == 0)
+        return 0;
+
+    ret = xum1541_ioctl(HandleXum1541, XUM1541_GET_DEFERRED, 0, 0);
+    if (ret < 0)
+        return -1;
+
+    xum1541_dbg(2, "%d of %d deferred writes failed", ret,
+        HandleXum1541->deferred_writes);
+    HandleXum1541->deferred_writes = 0;
+    HandleXum1541->deferred_failures += ret;
+    return 0;
 }
 
-/*! \brief Read data from the xum1541 device
+/*! \brief Switch deferred status for CBM protocol writes on or off
+
+ With deferred status, XUM1541_CBM writes and batches without reads are
+ sent with XUM_WRITE_DEFER, so the host does not wait for their status.
+ The device counts the failures until xum1541_flush_deferred_status()
+ asks for them.
 
  \param HandleXum1541
    A XUM1541_HANDLE which contains the file handle of the USB device.
 
- \param mode
-    Drive protocol to use to read the data from the device (e.g,
-    XUM1541_CBM is normal IEC wire protocol).
-
- \param data
-    Pointer to a buffer which will contain the data read from the xum1541
-
- \param size
-    The number of bytes to read from the xum1541
+ \param Enable
+   If not zero, switch deferred status on; if zero, switch it off.
 
  \return
-    The number of bytes actually read, 0 on device error. If there is a
-    fatal error, returns -1.
+   The previous state (0 or 1), or -1 if the firmware does not support
+   XUM1541_CAP_DEFER or there was a fatal error.
+
+ \remark
+   Switching deferred status off collects the pending failures, so they
+   are still reported by the next xum1541_flush_deferred_status().
 */
 int
-xum1541_read(struct opencbm_usb_handle *HandleXum1541, unsigned char mode, unsigned char *data, size_t size)
+xum1541_set_deferred_status(struct opencbm_usb_handle *HandleXum1541, int Enable)
 {
-    int rd, ret;
-    size_t bytesRead, bytes2read;
-    unsigned char cmdBuf[XUM_CMDBUF_SIZE];
-    BOOL isTapeCmd = ((mode == XUM1541_TAP) || (mode == XUM1541_TAP_CONFIG));
+    int old = HandleXum1541->defer_status;
 
-    xum1541_dbg(1, "read %d %d bytes to address %p",
-               mode, size, data);
+    if ((HandleXum1541->capabilities & XUM1541_CAP_DEFER) == 0)
+        return -1;
 
-    RefuseToWorkInWrongMode; // Check if command allowed in current disk/tape mode.
+    xum1541_dbg(1, "deferred status %s", Enable ? "on" : "off");
 
-    // Send the read command
-    cmdBuf[0] = XUM1541_READ;
-    cmdBuf[1] = mode;
-    cmdBuf[2] = size & 0xff;
-    cmdBuf[3] = (size >> 8) & 0xff;
-#if HAVE_LIBUSB0
-    ret = 0;
-    rd = usb.bulk_write(HandleXum1541->devh,
-        XUM_BULK_OUT_ENDPOINT | USB_ENDPOINT_OUT,
-        (char *)cmdBuf, sizeof(cmdBuf), LIBUSB_NO_TIMEOUT);
-#elif HAVE_LIBUSB1
-    ret = usb.bulk_transfer(HandleXum1541->devh,
-        XUM_BULK_OUT_ENDPOINT | LIBUSB_ENDPOINT_OUT,
-        cmdBuf, sizeof(cmdBuf), &rd, LIBUSB_NO_TIMEOUT);
-#endif
-#if HAVE_LIBUSB0
-    if (rd < 0) {
-#elif HAVE_LIBUSB1
-    if (ret != LIBUSB_SUCCESS) {
-#endif
-        fprintf(stderr, "USB error in read cmd: %s\n",
-            usb.error_name(ret));
+    if (!Enable && xum1541_collect_deferred_status(HandleXum1541) < 0)
         return -1;
-    }
 
-    // Read the actual data now that it's ready.
-    bytesRead = 0;
-    while (bytesRead < size) {
-        bytes2read = size - bytesRead;
-        if (bytes2read > XUM_MAX_XFER_SIZE)
-            bytes2read = XUM_MAX_XFER_SIZE;
-#if HAVE_LIBUSB0
-        rd = usb.bulk_read(HandleXum1541->devh,
-            XUM_BULK_IN_ENDPOINT | USB_ENDPOINT_IN,
-            (char *)data, bytes2read, LIBUSB_NO_TIMEOUT);
-#elif HAVE_LIBUSB1
-        ret = usb.bulk_transfer(HandleXum1541->devh,
-            XUM_BULK_IN_ENDPOINT | LIBUSB_ENDPOINT_IN,
-            data, bytes2read, &rd, LIBUSB_NO_TIMEOUT);
-#endif
-#if HAVE_LIBUSB0
-        if (rd < 0) {
-#elif HAVE_LIBUSB1
-        if (ret != LIBUSB_SUCCESS) {
-#endif
-            fprintf(stderr, "USB error in read data(%p, %d): %s\n",
-               data, (int)size, usb.error_name(ret));
-            return -1;
-        }
+    HandleXum1541->defer_status = Enable ? 1 : 0;
+    return old;
+}
 
-        xum1541_print_data(2, "read", data, rd);
+/*! \brief Report the failures of the deferred writes
 
-        data += rd;
-        bytesRead += rd;
+ \param HandleXum1541
+   A XUM1541_HANDLE which contains the file handle of the USB device.
 
-        /*
-         * If we read less than we requested (or 0), the transfer is done
-         * even if we had more data to read still.
-         */
-        if (rd < (int)bytes2read)
-            break;
-    }
+ \return
+   0 if all deferred writes since the last call succeeded, else the
+   number of writes that failed. If there is a fatal error, returns -1.
+*/
+int
+xum1541_flush_deferred_status(struct opencbm_usb_handle *HandleXum1541)
+{
+    int ret;
 
-    xum1541_dbg(2, "read done, got %d bytes", bytesRead);
-    return bytesRead;
+    if (xum1541_collect_deferred_status(HandleXum1541) < 0)
+        return -1;
+
+    ret = HandleXum1541->deferred_failures;
+    HandleXum1541->deferred_failures = 0;
+    return ret;
 }
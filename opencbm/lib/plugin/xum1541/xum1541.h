@@ -10,6 +10,7 @@
 #define XUM1541_H
 
 #include "opencbm.h"
+#include "opencbm-plugin.h"
 
 #include "usbcommon.h"
 
@@ -33,6 +34,8 @@ CTASSERT(sizeof(CBM_FILE) >= sizeof(usb_dev_handle *));
 enum xum1541_usb_quirks_enum {
   XUM1541_USB_QUIRKS_MODE_CONFIG_ONCE_ONLY = 0x01,  /**< if set, usb set configuration will not be send if the configuration is already set */
   XUM1541_USB_QUIRKS_MODE_ALT_SETTING      = 0x02,  /**< if set, set "alt setting" as last step of initialization */
+  XUM1541_USB_QUIRKS_MODE_SYNC_TRANSFERS   = 0x04,  /**< if set, do not queue bulk transfers asynchronously (libusb 1.0 only) */
+  XUM1541_USB_QUIRKS_MODE_NO_DEV_MEM       = 0x08,  /**< if set, do not use buffers in device memory for the queued transfers */
 };
 
 /** \brief Quirks mode
@@ -42,6 +45,13 @@ enum xum1541_usb_quirks_enum {
  */
 extern unsigned int xum1541_usb_quirks_mode;
 
+/** \brief Maximum size of one bulk data transfer
+
+  Set by the configuration entry "usb-transfer-size". If 0 (not set),
+  XUM_MAX_XFER_SIZE is used. Values are rounded down to whole packets.
+ */
+extern unsigned int xum1541_usb_transfer_size;
+
 /*
  * Make our control transfer timeout 10% later than the device itself
  * times out. This is used for both the INIT and RESET messages since
@@ -53,6 +63,45 @@ extern unsigned int xum1541_usb_quirks_mode;
 // libusb value for "wait forever" (signed int)
 #define LIBUSB_NO_TIMEOUT   0x7fffffff
 
+// Number of bulk data transfers kept queued at once (libusb 1.0 only)
+#define XUM1541_ASYNC_DEPTH 4
+
+/*
+ * Smallest bulk data transfer xum1541_async_transfer() splits a data phase
+ * into. Below this, the per-transfer overhead eats up what is gained by
+ * queueing several of them.
+ */
+#define XUM1541_ASYNC_MIN_CHUNK 512
+
+/*
+ * Data phases from this size on are run through buffers in device memory
+ * (libusb_dev_mem_alloc()), one of XUM_MAX_XFER_SIZE bytes per queued
+ * transfer. On Linux, these are mapped from usbfs, so the kernel does not
+ * need to copy the data to its own buffer or pin the pages of ours.
+ */
+#define XUM1541_DEV_MEM_MIN     4096
+#define XUM1541_DEV_MEM_SIZE    (XUM1541_ASYNC_DEPTH * XUM_MAX_XFER_SIZE)
+
+/*
+ * Statistics, collected if the environment variable XUM1541_STATS is set
+ * to a non-zero value and output when the device is closed. Read and
+ * write commands are also split by protocol (upper nibble of the mode).
+ */
+#define XUM1541_STAT_READ       0
+#define XUM1541_STAT_WRITE      1
+#define XUM1541_STAT_BATCH      2
+#define XUM1541_STAT_IOCTL      3
+#define XUM1541_STAT_CONTROL    4
+#define XUM1541_STAT_COUNT      5
+#define XUM1541_STATS_PROTOCOLS 16 // number of protocol values
+#define XUM1541_STATS_BUCKETS   24 // log2 latency buckets, up to 16 s
+
+/*
+ * The largest bulk endpoint size of all boards. xum1541_readv() can read
+ * into a buffer directly if its size is a multiple of this.
+ */
+#define XUM1541_IOV_ALIGN   64
+
 // the maximum value for all allowed xum1541 serial numbers
 #define MAX_ALLOWED_XUM1541_SERIALNUM 255
 
@@ -68,6 +117,11 @@ void xum1541_close(struct opencbm_usb_handle *HandleXum1541);
 int xum1541_control_msg(struct opencbm_usb_handle *HandleXum1541, unsigned int cmd);
 int xum1541_ioctl(struct opencbm_usb_handle *HandleXum1541, unsigned int cmd,
     unsigned int addr, unsigned int secaddr);
+int xum1541_ioctl_arg(struct opencbm_usb_handle *HandleXum1541, unsigned int cmd,
+    unsigned int addr, unsigned int secaddr, unsigned int arg);
+
+// Wait for an IEC line, giving up after a timeout (XUM1541_CAP_WAIT_TIMEOUT)
+int xum1541_iec_wait_timeout(struct opencbm_usb_handle *HandleXum1541, int line, int state, unsigned int timeout_ms);
 
 // Read/write data in normal CBM and speeder protocol modes
 int xum1541_write(struct opencbm_usb_handle *HandleXum1541, unsigned char mode,
@@ -81,4 +135,39 @@ int xum1541_read_ext(struct opencbm_usb_handle *HandleXum1541, unsigned char mod
 
 int xum1541_tap_break(struct opencbm_usb_handle *HandleXum1541);
 
+// Capture a tape, handing the data to a callback chunk by chunk
+int xum1541_tap_capture(struct opencbm_usb_handle *HandleXum1541,
+    unsigned char *data, size_t size, cbm_tap_capture_callback_t callback,
+    void *context, int *Status, int *BytesRead);
+
+// Write a tape, getting the data from a callback chunk by chunk
+int xum1541_tap_write(struct opencbm_usb_handle *HandleXum1541,
+    cbm_tap_write_callback_t callback, void *context,
+    int *Status, int *BytesWritten);
+
+// Run a list of CBM protocol primitives with a single command
+int xum1541_batch(struct opencbm_usb_handle *HandleXum1541,
+    opencbm_plugin_batch_entry_t *Entries, unsigned int Count);
+
+// Scatter/gather versions of xum1541_write() and xum1541_read()
+int xum1541_writev(struct opencbm_usb_handle *HandleXum1541, unsigned char modeFlags, const cbm_iovec_t *iov, unsigned int iovcnt);
+int xum1541_readv(struct opencbm_usb_handle *HandleXum1541, unsigned char mode, const cbm_iovec_t *iov, unsigned int iovcnt);
+
+// Deferred status for CBM protocol writes
+int xum1541_set_deferred_status(struct opencbm_usb_handle *HandleXum1541, int Enable);
+int xum1541_flush_deferred_status(struct opencbm_usb_handle *HandleXum1541);
+
+// GCR data read with XUM_READ_GCR, decoded by the device
+int xum1541_read_gcr(struct opencbm_usb_handle *HandleXum1541, unsigned char mode, unsigned char *data, size_t gcrSize);
+
+// Firmware profile, counted in cycles of the device
+int xum1541_get_profile(struct opencbm_usb_handle *HandleXum1541, unsigned char *data, size_t size, int clear);
+
+// Drive memory access run by the device ("M-W"/"M-R" offload)
+int xum1541_memory_write(struct opencbm_usb_handle *HandleXum1541, unsigned char device, unsigned int address, const unsigned char *data, size_t size);
+int xum1541_memory_read(struct opencbm_usb_handle *HandleXum1541, unsigned char device, unsigned int address, unsigned char *data, size_t size);
+
+// Drive code kept in the flash of the device
+int xum1541_code_upload(struct opencbm_usb_handle *HandleXum1541, unsigned char device, unsigned int address, const unsigned char *data, size_t size);
+
 #endif // XUM1541_H
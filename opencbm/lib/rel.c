@@ -0,0 +1,360 @@
+/*
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version
+ * 2 of the License, or (at your option) any later version.
+ *
+*/
+
+/** **************************************************************
+** @file lib/rel.c \n
+** \n
+** @brief DOS level functions: record access to relative files
+**
+****************************************************************/
+
+/** Mark: We are in user-space (for debug.h) */
+#define DBG_USERMODE
+
+/** The name of the executable */
+#define DBG_PROGNAME "OPENCBM.DLL"
+
+#include "debug.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+/** mark: We are building the DLL */
+#define DLL
+#include "opencbm-dos.h"
+#include "archlib.h"
+
+
+/** @page opencbm_dos_rel Record access to relative files
+ *
+ * A relative (REL) file is opened with cbm_rel_open(); its records are
+ * read with cbm_rel_read() and written with cbm_rel_write().
+ *
+ * The DOS finds a record with the help of the side sectors of the file:
+ * every side sector lists 120 data blocks. It keeps the side sector of
+ * the current record in a buffer of its own, so positioning to a record
+ * listed in the same side sector does not read the disk again.
+ * Additionally, the DOS goes on to the next record on its own whenever a
+ * record has been read or written completely. These functions remember
+ * the record the DOS is at, so the P(osition) command - and the status
+ * read after it - is only sent if the records are not accessed one after
+ * another. Thus, reading or writing records in ascending order costs one
+ * bus transaction per record, and the side sectors are only read by the
+ * DOS when the next one is needed.
+ */
+
+/** @{ @ingroup opencbm_dos */
+
+/** the maximum length of a record */
+#define CBM_REL_MAX_RECORD_LENGTH 254
+
+/** DOS status: the record does not exist (yet) */
+#define CBM_REL_RECORD_NOT_PRESENT 50
+
+/** @brief DOS: Open a relative file
+
+ This function opens a relative file on the floppy, or creates it if
+ it does not exist yet.
+
+ @param[in] HandleDevice
+   A CBM_FILE which contains the file handle of the driver.
+
+ @param[in] DeviceAddress
+   The address of the device on the IEC serial bus. This
+   is known as primary address, too.
+
+ @param[in] Channel
+   The channel (secondary address) to open the file on, 2 to 14.
+
+ @param[in] Name
+   The name of the file, in PETSCII.
+
+ @param[in] RecordLength
+   The length of the records of the file, 1 to 254. For an existing
+   file, this must be the length it has been created with.
+
+ @param[out] Rel
+   Pointer to the cbm_rel_file that describes the opened file.
+
+ @retval 0 if the file was opened
+ @retval "< 0" if an error occurred
+
+ @remark
+   - Close the file with cbm_rel_close().
+*/
+int CBMAPIDECL
+cbm_rel_open(
+        CBM_FILE      HandleDevice,
+        uint8_t       DeviceAddress,
+        uint8_t       Channel,
+        const char *  Name,
+        uint8_t       RecordLength,
+        cbm_rel_file *Rel
+        )
+{
+    char status[40];
+    char *open_string;
+    size_t len;
+    int rv = -1;
+
+    FUNC_ENTER();
+
+    do {
+        if (Channel < 2 || Channel > 14 || RecordLength == 0 || RecordLength > CBM_REL_MAX_RECORD_LENGTH) {
+            break;
+        }
+
+        len = strlen(Name);
+        open_string = malloc(len + 4);
+        if (open_string == NULL) {
+            break;
+        }
+
+        memcpy(open_string, Name, len);
+        open_string[len++] = ',';
+        open_string[len++] = 'L';
+        open_string[len++] = ',';
+        open_string[len++] = (char) RecordLength;
+
+        rv = cbm_open(HandleDevice, DeviceAddress, Channel, open_string, len);
+        free(open_string);
+
+        if (rv < 0) {
+            break;
+        }
+
+        /* a new file reports that its first record is not present */
+        rv = cbm_device_status(HandleDevice, DeviceAddress, status, sizeof status);
+        if (rv >= 20 && rv != CBM_REL_RECORD_NOT_PRESENT) {
+            DBG_WARN((DBG_PREFIX "open of relative file failed: %s", status));
+            cbm_close(HandleDevice, DeviceAddress, Channel);
+            rv = -1;
+            break;
+        }
+
+        Rel->HandleDevice = HandleDevice;
+        Rel->DeviceAddress = DeviceAddress;
+        Rel->Channel = Channel;
+        Rel->RecordLength = RecordLength;
+        /* opening a relative file leaves the DOS at its first record */
+        Rel->NextRecord = 1;
+        rv = 0;
+
+    } while (0);
+
+    FUNC_LEAVE_INT(rv);
+}
+
+/** @brief DOS: position to a record of a relative file
+
+ The P(osition) command is only sent if the DOS is not at the record
+ already.
+
+ @param[in] Rel
+   The relative file.
+
+ @param[in] Record
+   The number of the record, starting with 1.
+
+ @param[in] ForWriting
+   != 0 if the record is to be written; it does not need to exist then.
+
+ @retval 0 if the DOS is at the record
+ @retval "< 0" if the record does not exist or an error occurred
+*/
+static int
+cbm_rel_position(
+        cbm_rel_file *Rel,
+        uint16_t      Record,
+        int           ForWriting
+        )
+{
+    char status[40];
+    uint8_t cmd[5];
+    int rv;
+
+    if (Record == 0) {
+        return -1;
+    }
+
+    if (Rel->NextRecord == Record) {
+        return 0;
+    }
+
+    cmd[0] = 'P';
+    cmd[1] = (uint8_t) (0x60 | Rel->Channel);
+    cmd[2] = (uint8_t) (Record & 0xff);
+    cmd[3] = (uint8_t) (Record >> 8);
+    cmd[4] = 1;
+
+    Rel->NextRecord = 0;
+
+    if (cbm_exec_command(Rel->HandleDevice, Rel->DeviceAddress, cmd, sizeof cmd) != 0) {
+        return -1;
+    }
+
+    rv = cbm_device_status(Rel->HandleDevice, Rel->DeviceAddress, status, sizeof status);
+    if (rv == CBM_REL_RECORD_NOT_PRESENT && ForWriting) {
+        /* the DOS adds the records up to this one when it is written */
+        rv = 0;
+    }
+    if (rv >= 20) {
+        return -1;
+    }
+
+    Rel->NextRecord = Record;
+    return 0;
+}
+
+/** @brief DOS: Read a record of a relative file
+
+ @param[in] Rel
+   The relative file.
+
+ @param[in] Record
+   The number of the record, starting with 1.
+
+ @param[out] Buffer
+   The buffer for the record.
+
+ @param[in] BufferSize
+   The size of Buffer. If it is smaller than the record, only the
+   start of the record is read.
+
+ @return
+   The number of bytes read; the DOS does not send the zero bytes at
+   the end of a record. "< 0" if the record does not exist or an
+   error occurred.
+*/
+int CBMAPIDECL
+cbm_rel_read(
+        cbm_rel_file *Rel,
+        uint16_t      Record,
+        uint8_t *     Buffer,
+        size_t        BufferSize
+        )
+{
+    size_t count = Rel->RecordLength;
+    int rv = -1;
+
+    FUNC_ENTER();
+
+    if (count > BufferSize) {
+        count = BufferSize;
+    }
+
+    do {
+        if (cbm_rel_position(Rel, Record, 0) < 0) {
+            break;
+        }
+
+        /* if this read is not completed, the DOS stays in the record */
+        Rel->NextRecord = 0;
+
+        if (cbm_talk(Rel->HandleDevice, Rel->DeviceAddress, Rel->Channel) != 0) {
+            break;
+        }
+
+        rv = cbm_raw_read(Rel->HandleDevice, Buffer, count);
+
+        if (rv >= 0 && ((size_t) rv < count || count == Rel->RecordLength || cbm_get_eoi(Rel->HandleDevice))) {
+            /* the record has been read to its end */
+            Rel->NextRecord = Record + 1;
+        }
+
+        cbm_untalk(Rel->HandleDevice);
+
+    } while (0);
+
+    FUNC_LEAVE_INT(rv);
+}
+
+/** @brief DOS: Write a record of a relative file
+
+ @param[in] Rel
+   The relative file.
+
+ @param[in] Record
+   The number of the record, starting with 1. If the file does not
+   have this record yet, it is extended.
+
+ @param[in] Buffer
+   The data of the record.
+
+ @param[in] Count
+   The number of bytes in Buffer, at most the length of the records.
+   The DOS fills the rest of the record with zero bytes.
+
+ @return
+   The number of bytes written, "< 0" if an error occurred.
+*/
+int CBMAPIDECL
+cbm_rel_write(
+        cbm_rel_file *  Rel,
+        uint16_t        Record,
+        const uint8_t * Buffer,
+        size_t          Count
+        )
+{
+    int rv = -1;
+
+    FUNC_ENTER();
+
+    do {
+        if (Count == 0 || Count > Rel->RecordLength) {
+            break;
+        }
+
+        if (cbm_rel_position(Rel, Record, 1) < 0) {
+            break;
+        }
+
+        Rel->NextRecord = 0;
+
+        if (cbm_listen(Rel->HandleDevice, Rel->DeviceAddress, Rel->Channel) != 0) {
+            break;
+        }
+
+        rv = cbm_raw_write(Rel->HandleDevice, Buffer, Count);
+
+        /* the DOS finishes the record with the unlisten */
+        cbm_unlisten(Rel->HandleDevice);
+
+        if (rv == (int) Count) {
+            Rel->NextRecord = Record + 1;
+        }
+
+    } while (0);
+
+    FUNC_LEAVE_INT(rv);
+}
+
+/** @brief DOS: Close a relative file
+
+ @param[in] Rel
+   The relative file.
+
+ @retval 0 if the file was closed
+ @retval "< 0" if an error occurred
+*/
+int CBMAPIDECL
+cbm_rel_close(
+        cbm_rel_file *Rel
+        )
+{
+    int rv;
+
+    FUNC_ENTER();
+
+    rv = cbm_close(Rel->HandleDevice, Rel->DeviceAddress, Rel->Channel);
+    Rel->NextRecord = 0;
+
+    FUNC_LEAVE_INT(rv);
+}
+
+/** @} */
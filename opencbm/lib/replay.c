@@ -0,0 +1,937 @@
+/*
+ *      This program is free software; you can redistribute it and/or
+ *      modify it under the terms of the GNU General Public License
+ *      as published by the Free Software Foundation; either version
+ *      2 of the License, or (at your option) any later version.
+ *
+*/
+
+/*! **************************************************************
+** \file lib/replay.c \n
+** \n
+** \brief Shared library / DLL for accessing the driver:
+**        Replay of a bus session recorded with the trace
+**
+** Instead of calling into the plugin, the calls are answered from
+** a trace file written before (cf. trace.c). The results and the
+** data read are taken from the file, the arguments and the data
+** written are compared to it. Thus, a session recorded once with
+** real hardware can be run again without it, for regression tests
+** and benchmarks of the host side.
+**
+** Only the entry points the recorded plugin had are offered, so
+** the library takes the same paths as in the recorded session.
+**
+****************************************************************/
+
+/*! Mark: We are in user-space (for debug.h) */
+#define DBG_USERMODE
+
+/*! The name of the executable */
+#define DBG_PROGNAME "OPENCBM.DLL"
+
+#include "debug.h"
+
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+//! mark: We are building the DLL */
+#define DLL
+#include "opencbm.h"
+#include "opencbm-plugin.h"
+#include "trace.h"
+#include "arch.h"
+
+#ifdef WIN32
+# include <windows.h>
+#else
+# include <pthread.h>
+#endif
+
+/*! The number of mismatches that are reported in detail */
+#define REPLAY_MAX_REPORTS 10
+
+/*! \brief One recorded call */
+struct replay_record {
+    enum cbm_trace_call call;     /*!< the call */
+    char               *args;     /*!< the arguments, as written by the trace */
+    int                 result;   /*!< the result of the call */
+    double              duration; /*!< the time the call took, in microseconds */
+    unsigned char      *data;     /*!< the data written or read; for a batch, of all entries */
+    int                 length;   /*!< the number of bytes in data */
+
+    unsigned int        entries;      /*!< for a batch: the number of entries */
+    char               *entry_type;   /*!< for a batch: the types of the entries ('w', 'a', 't', 'r') */
+    int                *entry_result; /*!< for a batch: the results of the entries */
+    int                *entry_offset; /*!< for a batch: the offsets of the data of the entries in data */
+};
+
+/*! \brief The replay of one recorded session */
+struct cbm_replay_s {
+    opencbm_plugin_t      Original;           /*!< the entry points of the plugin itself */
+    struct replay_record *Records;            /*!< the recorded calls */
+    unsigned int          Count;              /*!< the number of recorded calls */
+    unsigned int          Next;               /*!< the next call to replay */
+    int                   Present[TRACE_COUNT]; /*!< != 0 for the entry points the recorded plugin had */
+    int                   Timing;             /*!< != 0: take as long as the recorded calls */
+    unsigned long         Mismatches;         /*!< the number of calls that did not match the recording */
+
+#ifdef WIN32
+    CRITICAL_SECTION      Lock;               /*!< protects Next and Mismatches */
+#else
+    pthread_mutex_t       Lock;               /*!< protects Next and Mismatches */
+#endif
+};
+
+static void
+replay_lock(cbm_replay_t *Replay)
+{
+#ifdef WIN32
+    EnterCriticalSection(&Replay->Lock);
+#else
+    pthread_mutex_lock(&Replay->Lock);
+#endif
+}
+
+static void
+replay_unlock(cbm_replay_t *Replay)
+{
+#ifdef WIN32
+    LeaveCriticalSection(&Replay->Lock);
+#else
+    pthread_mutex_unlock(&Replay->Lock);
+#endif
+}
+
+/*-------------------------------------------------------------------*/
+/*--------- READING THE TRACE FILE ----------------------------------*/
+
+/*! \internal \brief Find a call by its name in the trace
+
+ \return
+   The call, or TRACE_COUNT if the name is not known.
+*/
+static enum cbm_trace_call
+replay_call_by_name(const char *Name, size_t Length)
+{
+    int i;
+
+    for (i = 0; i < TRACE_COUNT; i++) {
+        if (strlen(cbm_trace_call_name[i]) == Length
+            && strncmp(cbm_trace_call_name[i], Name, Length) == 0)
+        {
+            break;
+        }
+    }
+
+    return (enum cbm_trace_call) i;
+}
+
+/*! \internal \brief Read one line of any length
+
+ \return
+   The line without the line feed, which has to be freed with free(),
+   or NULL at the end of the file or if there is not enough memory.
+*/
+static char *
+replay_read_line(FILE *File)
+{
+    size_t size = 256, length = 0;
+    char *line = malloc(size);
+
+    while (line != NULL && fgets(line + length, (int) (size - length), File) != NULL) {
+        length += strlen(line + length);
+
+        if (length > 0 && line[length - 1] == '\n') {
+            line[--length] = 0;
+            return line;
+        }
+
+        if (length + 1 == size) {
+            char *bigger = realloc(line, size * 2);
+
+            if (bigger == NULL) {
+                free(line);
+                return NULL;
+            }
+            line = bigger;
+            size *= 2;
+        }
+    }
+
+    if (line != NULL && length == 0) {
+        free(line);
+        line = NULL;
+    }
+
+    return line;
+}
+
+/*! \internal \brief Parse the list of entry points in the header of the trace */
+static void
+replay_parse_entry_points(cbm_replay_t *Replay, const char *List)
+{
+    while (*List) {
+        const char *end;
+        enum cbm_trace_call call;
+
+        while (*List == ' ')
+            ++List;
+        for (end = List; *end && *end != ' '; ++end)
+            ;
+
+        call = replay_call_by_name(List, end - List);
+        if (call != TRACE_COUNT)
+            Replay->Present[call] = 1;
+
+        List = end;
+    }
+}
+
+/*! \internal \brief Parse the recorded data of a call, after the result
+
+ \return
+   0 on success, else the line is malformed or there is not enough memory.
+*/
+static int
+replay_parse_data(struct replay_record *Record, const char *Data)
+{
+    size_t maxlength = strlen(Data) / 3 + 1;
+    unsigned int maxentries = 0;
+    const char *p;
+
+    for (p = Data; *p; ++p) {
+        if (*p == '|')
+            ++maxentries;
+    }
+
+    Record->data = malloc(maxlength);
+    if (Record->data == NULL)
+        return 1;
+
+    if (maxentries) {
+        Record->entry_type = malloc(maxentries);
+        Record->entry_result = malloc(maxentries * sizeof(int));
+        Record->entry_offset = malloc(maxentries * sizeof(int));
+        if (!Record->entry_type || !Record->entry_result || !Record->entry_offset)
+            return 1;
+    }
+
+    p = Data;
+    while (*p) {
+        char *end;
+
+        if (*p == ' ' || *p == ':') {
+            ++p;
+        }
+        else if (*p == '|') {
+            /* " | <type><result>" starts the next entry of a batch */
+            for (++p; *p == ' '; ++p)
+                ;
+            if (*p == 0 || Record->entries == maxentries)
+                return 1;
+            Record->entry_type[Record->entries] = *p++;
+            Record->entry_result[Record->entries] = (int) strtol(p, &end, 10);
+            Record->entry_offset[Record->entries] = Record->length;
+            if (end == p)
+                return 1;
+            ++Record->entries;
+            p = end;
+        }
+        else {
+            unsigned long value = strtoul(p, &end, 16);
+
+            if (end == p || value > 0xff || (size_t) Record->length == maxlength)
+                return 1;
+            Record->data[Record->length++] = (unsigned char) value;
+            p = end;
+        }
+    }
+
+    return 0;
+}
+
+/*! \internal \brief Parse the line of one call
+
+ \return
+   0 on success, else the line is malformed or there is not enough memory.
+*/
+static int
+replay_parse_record(struct replay_record *Record, const char *Line)
+{
+    unsigned long sequence;
+    double start;
+    const char *name, *args, *end;
+    char *endresult;
+    int n = 0;
+
+    memset(Record, 0, sizeof *Record);
+
+    if (sscanf(Line, "%lu %lf %lf %n", &sequence, &start, &Record->duration, &n) < 3 || n == 0)
+        return 1;
+
+    name = Line + n;
+    args = strchr(name, '(');
+    if (args == NULL)
+        return 1;
+
+    Record->call = replay_call_by_name(name, args - name);
+    if (Record->call == TRACE_COUNT)
+        return 1;
+
+    ++args;
+    end = strstr(args, ") = ");
+    if (end == NULL)
+        return 1;
+
+    Record->args = malloc(end - args + 1);
+    if (Record->args == NULL)
+        return 1;
+    memcpy(Record->args, args, end - args);
+    Record->args[end - args] = 0;
+
+    end += 4;
+    Record->result = (int) strtol(end, &endresult, 10);
+    if (endresult == end)
+        return 1;
+
+    return replay_parse_data(Record, endresult);
+}
+
+static void
+replay_free_record(struct replay_record *Record)
+{
+    free(Record->args);
+    free(Record->data);
+    free(Record->entry_type);
+    free(Record->entry_result);
+    free(Record->entry_offset);
+}
+
+/*! \internal \brief Read all calls of a trace file
+
+ \return
+   0 on success, else the trace file could not be read.
+*/
+static int
+replay_load(cbm_replay_t *Replay, const char *Filename)
+{
+    unsigned int size = 0, lineno = 0;
+    int error = 0;
+    char *line;
+    FILE *file;
+
+    file = fopen(Filename, "r");
+    if (file == NULL) {
+        fprintf(stderr, "opencbm replay: cannot open '%s'\n", Filename);
+        return 1;
+    }
+
+    while (!error && (line = replay_read_line(file)) != NULL) {
+        ++lineno;
+
+        if (strncmp(line, "# entry points:", 15) == 0) {
+            replay_parse_entry_points(Replay, line + 15);
+        }
+        else if (line[0] != '#' && line[0] != 0) {
+            if (Replay->Count == size) {
+                struct replay_record *records;
+
+                size = size ? 2 * size : 256;
+                records = realloc(Replay->Records, size * sizeof *records);
+                if (records == NULL) {
+                    error = 1;
+                }
+                else {
+                    Replay->Records = records;
+                }
+            }
+
+            if (!error) {
+                error = replay_parse_record(&Replay->Records[Replay->Count], line);
+                if (error) {
+                    replay_free_record(&Replay->Records[Replay->Count]);
+                    fprintf(stderr, "opencbm replay: '%s' line %u is malformed\n",
+                        Filename, lineno);
+                }
+                else {
+                    ++Replay->Count;
+                }
+            }
+        }
+
+        free(line);
+    }
+
+    fclose(file);
+
+    return error;
+}
+
+/*-------------------------------------------------------------------*/
+/*--------- MATCHING THE CALLS --------------------------------------*/
+
+/*! \internal \brief Report that a call does not match the recording */
+static void
+replay_mismatch(cbm_replay_t *Replay, const char *Format, ...)
+{
+    va_list args;
+
+    if (Replay->Mismatches++ >= REPLAY_MAX_REPORTS)
+        return;
+
+    fprintf(stderr, "opencbm replay: call %u: ", Replay->Next);
+    va_start(args, Format);
+    vfprintf(stderr, Format, args);
+    va_end(args);
+    fputc('\n', stderr);
+}
+
+/*! \internal \brief Get the recorded call for a call
+
+ The arguments and the data written are compared to the recording.
+ If the recording has another call at this place, or it has ended,
+ the call is not consumed, and NULL is returned.
+
+ \param Replay
+   The replay.
+
+ \param Call
+   The call that is made.
+
+ \param Data
+   The data the call writes, or NULL if it does not write any.
+
+ \param Length
+   The number of bytes the call writes.
+
+ \param Format
+   printf() format of the arguments of the call, as for the trace,
+   followed by them.
+
+ \return
+   The recorded call, or NULL if it does not match.
+*/
+static struct replay_record *
+replay_next(cbm_replay_t *Replay, enum cbm_trace_call Call,
+            const void *Data, int Length, const char *Format, ...)
+{
+    struct replay_record *record = NULL;
+    char args[64];
+    va_list ap;
+
+    va_start(ap, Format);
+    arch_vsnprintf(args, sizeof args, Format, ap);
+    va_end(ap);
+    args[sizeof args - 1] = 0;
+
+    replay_lock(Replay);
+
+    if (Replay->Next == Replay->Count) {
+        replay_mismatch(Replay, "%s(%s) after the end of the recording",
+            cbm_trace_call_name[Call], args);
+    }
+    else if (Replay->Records[Replay->Next].call != Call) {
+        replay_mismatch(Replay, "%s(%s) instead of %s(%s)",
+            cbm_trace_call_name[Call], args,
+            cbm_trace_call_name[Replay->Records[Replay->Next].call],
+            Replay->Records[Replay->Next].args);
+    }
+    else {
+        record = &Replay->Records[Replay->Next];
+
+        if (strcmp(record->args, args) != 0) {
+            replay_mismatch(Replay, "%s(%s) instead of %s(%s)",
+                cbm_trace_call_name[Call], args,
+                cbm_trace_call_name[Call], record->args);
+        }
+        else if (Data != NULL && (Length != record->length
+                 || memcmp(Data, record->data, Length) != 0))
+        {
+            replay_mismatch(Replay, "%s(%s) writes other data than recorded",
+                cbm_trace_call_name[Call], args);
+        }
+
+        ++Replay->Next;
+    }
+
+    replay_unlock(Replay);
+
+    if (record && Replay->Timing && record->duration >= 1)
+        arch_sleep_us((unsigned int) record->duration);
+
+    return record;
+}
+
+/*! \internal \brief Copy the recorded data of a read call
+
+ \return
+   The result of the recorded call.
+*/
+static int
+replay_read(const struct replay_record *Record, void *Buffer, size_t Count)
+{
+    size_t length = Record->length;
+
+    if (length > Count)
+        length = Count;
+    if (length > 0)
+        memcpy(Buffer, Record->data, length);
+
+    return Record->result;
+}
+
+/*-------------------------------------------------------------------*/
+/*--------- REPLAYED ENTRY POINTS -----------------------------------*/
+
+/*
+ * The arguments are formatted the same way as by the traced entry
+ * points in trace.c, so that they can be compared.
+ */
+
+static const char * CBMAPIDECL
+replay_get_driver_name(const char * const Port)
+{
+    UNREFERENCED_PARAMETER(Port);
+
+    return "replay";
+}
+
+/*! \internal \brief Its address is the handle of a replay, there is no device */
+static int replay_device;
+
+static int CBMAPIDECL
+replay_driver_open(CBM_FILE *HandleDevice, const char * const Port)
+{
+    UNREFERENCED_PARAMETER(Port);
+
+    *HandleDevice = (CBM_FILE) &replay_device;
+
+    return 0;
+}
+
+static void CBMAPIDECL
+replay_driver_close(CBM_FILE HandleDevice)
+{
+    UNREFERENCED_PARAMETER(HandleDevice);
+}
+
+static int CBMAPIDECL
+replay_raw_write(CBM_FILE HandleDevice, const void *Buffer, size_t Count)
+{
+    struct replay_record *record = replay_next(cbm_replay_of_handle(HandleDevice),
+        TRACE_RAW_WRITE, NULL, 0, "%lu", (unsigned long) Count);
+
+    if (record == NULL)
+        return -1;
+
+    /* only the bytes that were written have been recorded */
+    if (record->result > 0 && ((size_t) record->result > Count
+        || memcmp(Buffer, record->data, record->result) != 0))
+    {
+        cbm_replay_t *replay = cbm_replay_of_handle(HandleDevice);
+
+        replay_lock(replay);
+        replay_mismatch(replay, "raw_write(%lu) writes other data than recorded",
+            (unsigned long) Count);
+        replay_unlock(replay);
+    }
+
+    return record->result;
+}
+
+static int CBMAPIDECL
+replay_raw_read(CBM_FILE HandleDevice, void *Buffer, size_t Count)
+{
+    struct replay_record *record = replay_next(cbm_replay_of_handle(HandleDevice),
+        TRACE_RAW_READ, NULL, 0, "%lu", (unsigned long) Count);
+
+    return record ? replay_read(record, Buffer, Count) : -1;
+}
+
+static int CBMAPIDECL
+replay_raw_writev(CBM_FILE HandleDevice, const cbm_iovec_t *Iov, unsigned int IovCount)
+{
+    struct replay_record *record = replay_next(cbm_replay_of_handle(HandleDevice),
+        TRACE_RAW_WRITEV, NULL, 0, "%u", IovCount);
+
+    UNREFERENCED_PARAMETER(Iov);
+
+    return record ? record->result : -1;
+}
+
+static int CBMAPIDECL
+replay_raw_readv(CBM_FILE HandleDevice, const cbm_iovec_t *Iov, unsigned int IovCount)
+{
+    struct replay_record *record = replay_next(cbm_replay_of_handle(HandleDevice),
+        TRACE_RAW_READV, NULL, 0, "%u", IovCount);
+    unsigned int i;
+    int offset = 0;
+
+    if (record == NULL)
+        return -1;
+
+    for (i = 0; i < IovCount && offset < record->length; i++) {
+        int len = record->length - offset;
+
+        if ((size_t) len > Iov[i].iov_len)
+            len = (int) Iov[i].iov_len;
+        memcpy(Iov[i].iov_base, record->data + offset, len);
+        offset += len;
+    }
+
+    return record->result;
+}
+
+/*! \internal \brief Define a replayed entry point that addresses a device */
+#define REPLAY_ADDRESSED(_func, _call) \
+    static int CBMAPIDECL \
+    replay_##_func(CBM_FILE HandleDevice, unsigned char DeviceAddress, unsigned char SecondaryAddress) \
+    { \
+        struct replay_record *record = replay_next(cbm_replay_of_handle(HandleDevice), \
+            _call, NULL, 0, "%u, %u", DeviceAddress, SecondaryAddress); \
+        return record ? record->result : -1; \
+    }
+
+REPLAY_ADDRESSED(open,   TRACE_OPEN)
+REPLAY_ADDRESSED(close,  TRACE_CLOSE)
+REPLAY_ADDRESSED(listen, TRACE_LISTEN)
+REPLAY_ADDRESSED(talk,   TRACE_TALK)
+
+/*! \internal \brief Define a replayed entry point that only gets the handle */
+#define REPLAY_SIMPLE(_func, _call) \
+    static int CBMAPIDECL \
+    replay_##_func(CBM_FILE HandleDevice) \
+    { \
+        struct replay_record *record = replay_next(cbm_replay_of_handle(HandleDevice), \
+            _call, NULL, 0, ""); \
+        return record ? record->result : -1; \
+    }
+
+REPLAY_SIMPLE(unlisten,              TRACE_UNLISTEN)
+REPLAY_SIMPLE(untalk,                TRACE_UNTALK)
+REPLAY_SIMPLE(get_eoi,               TRACE_GET_EOI)
+REPLAY_SIMPLE(clear_eoi,             TRACE_CLEAR_EOI)
+REPLAY_SIMPLE(reset,                 TRACE_RESET)
+REPLAY_SIMPLE(iec_poll,              TRACE_IEC_POLL)
+REPLAY_SIMPLE(flush_deferred_status, TRACE_FLUSH_DEFERRED_STATUS)
+
+/*! \internal \brief Define a replayed entry point that reads a byte */
+#define REPLAY_BYTE_READ(_func, _call) \
+    static unsigned char CBMAPIDECL \
+    replay_##_func(CBM_FILE HandleDevice) \
+    { \
+        struct replay_record *record = replay_next(cbm_replay_of_handle(HandleDevice), \
+            _call, NULL, 0, ""); \
+        return record ? (unsigned char) record->result : 0; \
+    }
+
+REPLAY_BYTE_READ(pp_read,             TRACE_PP_READ)
+REPLAY_BYTE_READ(parallel_burst_read, TRACE_PARALLEL_BURST_READ)
+REPLAY_BYTE_READ(srq_burst_read,      TRACE_SRQ_BURST_READ)
+
+/*! \internal \brief Define a replayed entry point that writes a byte */
+#define REPLAY_BYTE_WRITE(_func, _call) \
+    static void CBMAPIDECL \
+    replay_##_func(CBM_FILE HandleDevice, unsigned char Value) \
+    { \
+        replay_next(cbm_replay_of_handle(HandleDevice), _call, NULL, 0, "%u", Value); \
+    }
+
+REPLAY_BYTE_WRITE(pp_write,             TRACE_PP_WRITE)
+REPLAY_BYTE_WRITE(parallel_burst_write, TRACE_PARALLEL_BURST_WRITE)
+REPLAY_BYTE_WRITE(srq_burst_write,      TRACE_SRQ_BURST_WRITE)
+
+/*! \internal \brief Define a replayed entry point that reads a block */
+#define REPLAY_BLOCK_READ(_func, _call) \
+    static int CBMAPIDECL \
+    replay_##_func(CBM_FILE HandleDevice, unsigned char *Buffer, unsigned int Length) \
+    { \
+        struct replay_record *record = replay_next(cbm_replay_of_handle(HandleDevice), \
+            _call, NULL, 0, "%u", Length); \
+        return record ? replay_read(record, Buffer, Length) : -1; \
+    }
+
+/*! \internal \brief Define a replayed entry point that writes a block */
+#define REPLAY_BLOCK_WRITE(_func, _call) \
+    static int CBMAPIDECL \
+    replay_##_func(CBM_FILE HandleDevice, unsigned char *Buffer, unsigned int Length) \
+    { \
+        struct replay_record *record = replay_next(cbm_replay_of_handle(HandleDevice), \
+            _call, NULL, 0, "%u", Length); \
+        UNREFERENCED_PARAMETER(Buffer); \
+        return record ? record->result : -1; \
+    }
+
+REPLAY_BLOCK_READ(parallel_burst_read_n,          TRACE_PARALLEL_BURST_READ_N)
+REPLAY_BLOCK_WRITE(parallel_burst_write_n,        TRACE_PARALLEL_BURST_WRITE_N)
+REPLAY_BLOCK_READ(parallel_burst_read_track,      TRACE_PARALLEL_BURST_READ_TRACK)
+REPLAY_BLOCK_READ(parallel_burst_read_track_var,  TRACE_PARALLEL_BURST_READ_TRACK_VAR)
+REPLAY_BLOCK_WRITE(parallel_burst_write_track,    TRACE_PARALLEL_BURST_WRITE_TRACK)
+REPLAY_BLOCK_READ(srq_burst_read_n,               TRACE_SRQ_BURST_READ_N)
+REPLAY_BLOCK_WRITE(srq_burst_write_n,             TRACE_SRQ_BURST_WRITE_N)
+REPLAY_BLOCK_READ(srq_burst_read_track,           TRACE_SRQ_BURST_READ_TRACK)
+REPLAY_BLOCK_WRITE(srq_burst_write_track,         TRACE_SRQ_BURST_WRITE_TRACK)
+
+/*! \internal \brief Define a replayed entry point that sets or releases lines */
+#define REPLAY_LINES(_func, _call) \
+    static void CBMAPIDECL \
+    replay_##_func(CBM_FILE HandleDevice, int Line) \
+    { \
+        replay_next(cbm_replay_of_handle(HandleDevice), _call, NULL, 0, "%u", Line); \
+    }
+
+REPLAY_LINES(iec_set,     TRACE_IEC_SET)
+REPLAY_LINES(iec_release, TRACE_IEC_RELEASE)
+
+static void CBMAPIDECL
+replay_iec_setrelease(CBM_FILE HandleDevice, int Set, int Release)
+{
+    replay_next(cbm_replay_of_handle(HandleDevice), TRACE_IEC_SETRELEASE, NULL, 0,
+        "%u, %u", Set, Release);
+}
+
+static int CBMAPIDECL
+replay_iec_wait(CBM_FILE HandleDevice, int Line, int State)
+{
+    struct replay_record *record = replay_next(cbm_replay_of_handle(HandleDevice),
+        TRACE_IEC_WAIT, NULL, 0, "%u, %u", Line, State);
+
+    return record ? record->result : -1;
+}
+
+static int CBMAPIDECL
+replay_iec_wait_timeout(CBM_FILE HandleDevice, int Line, int State, unsigned int TimeoutMs)
+{
+    struct replay_record *record = replay_next(cbm_replay_of_handle(HandleDevice),
+        TRACE_IEC_WAIT_TIMEOUT, NULL, 0, "%u, %u, %u", Line, State, TimeoutMs);
+
+    return record ? record->result : -1;
+}
+
+static int CBMAPIDECL
+replay_iec_program(CBM_FILE HandleDevice, unsigned char *Program, unsigned int Length)
+{
+    struct replay_record *record = replay_next(cbm_replay_of_handle(HandleDevice),
+        TRACE_IEC_PROGRAM, NULL, 0, "%u", Length);
+
+    /* the recording has the program with the results in place */
+    return record ? replay_read(record, Program, Length) : -1;
+}
+
+static int CBMAPIDECL
+replay_batch(CBM_FILE HandleDevice, opencbm_plugin_batch_entry_t *Entries, unsigned int Count)
+{
+    struct replay_record *record = replay_next(cbm_replay_of_handle(HandleDevice),
+        TRACE_BATCH, NULL, 0, "%u", Count);
+    unsigned int i;
+
+    if (record == NULL)
+        return -1;
+
+    for (i = 0; i < Count; i++) {
+        Entries[i].result = -1;
+
+        if (i >= record->entries)
+            continue;
+
+        Entries[i].result = record->entry_result[i];
+
+        if (Entries[i].type == OPENCBM_PLUGIN_BATCH_READ && record->entry_result[i] > 0) {
+            size_t length = record->entry_result[i];
+
+            if (length > Entries[i].size)
+                length = Entries[i].size;
+            memcpy(Entries[i].data, record->data + record->entry_offset[i], length);
+        }
+    }
+
+    return record->result;
+}
+
+static int CBMAPIDECL
+replay_set_deferred_status(CBM_FILE HandleDevice, int Enable)
+{
+    struct replay_record *record = replay_next(cbm_replay_of_handle(HandleDevice),
+        TRACE_SET_DEFERRED_STATUS, NULL, 0, "%d", Enable);
+
+    return record ? record->result : -1;
+}
+
+static int CBMAPIDECL
+replay_memory_write(CBM_FILE HandleDevice, unsigned char DeviceAddress, unsigned int MemoryAddress, const unsigned char *Buffer, unsigned int Count)
+{
+    struct replay_record *record = replay_next(cbm_replay_of_handle(HandleDevice),
+        TRACE_MEMORY_WRITE, Buffer, Count, "%u, 0x%04x, %u", DeviceAddress, MemoryAddress, Count);
+
+    return record ? record->result : -1;
+}
+
+static int CBMAPIDECL
+replay_memory_read(CBM_FILE HandleDevice, unsigned char DeviceAddress, unsigned int MemoryAddress, unsigned char *Buffer, unsigned int Count)
+{
+    struct replay_record *record = replay_next(cbm_replay_of_handle(HandleDevice),
+        TRACE_MEMORY_READ, NULL, 0, "%u, 0x%04x, %u", DeviceAddress, MemoryAddress, Count);
+
+    return record ? replay_read(record, Buffer, Count) : -1;
+}
+
+static int CBMAPIDECL
+replay_code_upload(CBM_FILE HandleDevice, unsigned char DeviceAddress, unsigned int MemoryAddress, const unsigned char *Buffer, unsigned int Count)
+{
+    struct replay_record *record = replay_next(cbm_replay_of_handle(HandleDevice),
+        TRACE_CODE_UPLOAD, Buffer, Count, "%u, 0x%04x, %u", DeviceAddress, MemoryAddress, Count);
+
+    return record ? record->result : -1;
+}
+
+/*-------------------------------------------------------------------*/
+/*--------- INSTALLATION --------------------------------------------*/
+
+/*! \internal \brief Replace an entry point by its replayed version if the recorded plugin had it, else remove it */
+#define REPLAY_INSTALL(_replay, _plugin, _func, _call) \
+    do { \
+        (_plugin)->opencbm_plugin_##_func = (_replay)->Present[_call] ? replay_##_func : NULL; \
+    } while (0)
+
+/*! \brief Replay a recorded bus session instead of calling into a plugin
+
+ The entry points of the plugin that open the driver, transfer data
+ or access the bus are replaced by versions that answer from the
+ recording. The others cannot be used with a replay.
+
+ \param Plugin
+   The entry points of the plugin; they are changed in place.
+
+ \param Filename
+   The name of the trace file with the recorded session.
+
+ \param Timing
+   If not zero, every call takes as long as it did in the recording.
+   Otherwise, the calls return immediately.
+
+ \return
+   The replay, which has to be given to cbm_replay_uninstall() before
+   the plugin is unloaded, or NULL if the recording could not be read.
+   In this case, Plugin is not changed.
+*/
+cbm_replay_t *
+cbm_replay_install(opencbm_plugin_t *Plugin, const char *Filename, int Timing)
+{
+    cbm_replay_t *replay;
+
+    FUNC_ENTER();
+
+    replay = calloc(1, sizeof *replay);
+    if (replay == NULL)
+        FUNC_LEAVE_PTR(NULL, cbm_replay_t *);
+
+    if (replay_load(replay, Filename) != 0) {
+        unsigned int i;
+
+        for (i = 0; i < replay->Count; i++)
+            replay_free_record(&replay->Records[i]);
+        free(replay->Records);
+        free(replay);
+        FUNC_LEAVE_PTR(NULL, cbm_replay_t *);
+    }
+
+#ifdef WIN32
+    InitializeCriticalSection(&replay->Lock);
+#else
+    pthread_mutex_init(&replay->Lock, NULL);
+#endif
+
+    replay->Timing = Timing;
+    replay->Original = *Plugin;
+
+    Plugin->opencbm_plugin_get_driver_name = replay_get_driver_name;
+    Plugin->opencbm_plugin_driver_open = replay_driver_open;
+    Plugin->opencbm_plugin_driver_close = replay_driver_close;
+
+    REPLAY_INSTALL(replay, Plugin, raw_write,                     TRACE_RAW_WRITE);
+    REPLAY_INSTALL(replay, Plugin, raw_read,                      TRACE_RAW_READ);
+    REPLAY_INSTALL(replay, Plugin, raw_writev,                    TRACE_RAW_WRITEV);
+    REPLAY_INSTALL(replay, Plugin, raw_readv,                     TRACE_RAW_READV);
+    REPLAY_INSTALL(replay, Plugin, open,                          TRACE_OPEN);
+    REPLAY_INSTALL(replay, Plugin, close,                         TRACE_CLOSE);
+    REPLAY_INSTALL(replay, Plugin, listen,                        TRACE_LISTEN);
+    REPLAY_INSTALL(replay, Plugin, talk,                          TRACE_TALK);
+    REPLAY_INSTALL(replay, Plugin, unlisten,                      TRACE_UNLISTEN);
+    REPLAY_INSTALL(replay, Plugin, untalk,                        TRACE_UNTALK);
+    REPLAY_INSTALL(replay, Plugin, get_eoi,                       TRACE_GET_EOI);
+    REPLAY_INSTALL(replay, Plugin, clear_eoi,                     TRACE_CLEAR_EOI);
+    REPLAY_INSTALL(replay, Plugin, reset,                         TRACE_RESET);
+    REPLAY_INSTALL(replay, Plugin, pp_read,                       TRACE_PP_READ);
+    REPLAY_INSTALL(replay, Plugin, pp_write,                      TRACE_PP_WRITE);
+    REPLAY_INSTALL(replay, Plugin, iec_poll,                      TRACE_IEC_POLL);
+    REPLAY_INSTALL(replay, Plugin, iec_set,                       TRACE_IEC_SET);
+    REPLAY_INSTALL(replay, Plugin, iec_release,                   TRACE_IEC_RELEASE);
+    REPLAY_INSTALL(replay, Plugin, iec_setrelease,                TRACE_IEC_SETRELEASE);
+    REPLAY_INSTALL(replay, Plugin, iec_wait,                      TRACE_IEC_WAIT);
+    REPLAY_INSTALL(replay, Plugin, iec_wait_timeout,              TRACE_IEC_WAIT_TIMEOUT);
+    REPLAY_INSTALL(replay, Plugin, iec_program,                   TRACE_IEC_PROGRAM);
+    REPLAY_INSTALL(replay, Plugin, parallel_burst_read,           TRACE_PARALLEL_BURST_READ);
+    REPLAY_INSTALL(replay, Plugin, parallel_burst_write,          TRACE_PARALLEL_BURST_WRITE);
+    REPLAY_INSTALL(replay, Plugin, parallel_burst_read_n,         TRACE_PARALLEL_BURST_READ_N);
+    REPLAY_INSTALL(replay, Plugin, parallel_burst_write_n,        TRACE_PARALLEL_BURST_WRITE_N);
+    REPLAY_INSTALL(replay, Plugin, parallel_burst_read_track,     TRACE_PARALLEL_BURST_READ_TRACK);
+    REPLAY_INSTALL(replay, Plugin, parallel_burst_read_track_var, TRACE_PARALLEL_BURST_READ_TRACK_VAR);
+    REPLAY_INSTALL(replay, Plugin, parallel_burst_write_track,    TRACE_PARALLEL_BURST_WRITE_TRACK);
+    REPLAY_INSTALL(replay, Plugin, srq_burst_read,                TRACE_SRQ_BURST_READ);
+    REPLAY_INSTALL(replay, Plugin, srq_burst_write,               TRACE_SRQ_BURST_WRITE);
+    REPLAY_INSTALL(replay, Plugin, srq_burst_read_n,              TRACE_SRQ_BURST_READ_N);
+    REPLAY_INSTALL(replay, Plugin, srq_burst_write_n,             TRACE_SRQ_BURST_WRITE_N);
+    REPLAY_INSTALL(replay, Plugin, srq_burst_read_track,          TRACE_SRQ_BURST_READ_TRACK);
+    REPLAY_INSTALL(replay, Plugin, srq_burst_write_track,         TRACE_SRQ_BURST_WRITE_TRACK);
+    REPLAY_INSTALL(replay, Plugin, batch,                         TRACE_BATCH);
+    REPLAY_INSTALL(replay, Plugin, set_deferred_status,           TRACE_SET_DEFERRED_STATUS);
+    REPLAY_INSTALL(replay, Plugin, flush_deferred_status,         TRACE_FLUSH_DEFERRED_STATUS);
+    REPLAY_INSTALL(replay, Plugin, memory_write,                  TRACE_MEMORY_WRITE);
+    REPLAY_INSTALL(replay, Plugin, memory_read,                   TRACE_MEMORY_READ);
+    REPLAY_INSTALL(replay, Plugin, code_upload,                   TRACE_CODE_UPLOAD);
+
+    FUNC_LEAVE_PTR(replay, cbm_replay_t *);
+}
+
+/*! \brief Stop a replay
+
+ If not all of the session was replayed as recorded, this is
+ reported on stderr. The original entry points of the plugin
+ are restored.
+
+ \param Plugin
+   The entry points of the plugin, as changed by cbm_replay_install().
+
+ \param Replay
+   The replay cbm_replay_install() returned.
+*/
+void
+cbm_replay_uninstall(opencbm_plugin_t *Plugin, cbm_replay_t *Replay)
+{
+    unsigned int i;
+
+    FUNC_ENTER();
+
+    *Plugin = Replay->Original;
+
+    if (Replay->Mismatches != 0 || Replay->Next != Replay->Count) {
+        fprintf(stderr, "opencbm replay: %u of %u calls replayed, %lu mismatches\n",
+            Replay->Next, Replay->Count, Replay->Mismatches);
+    }
+
+#ifdef WIN32
+    DeleteCriticalSection(&Replay->Lock);
+#else
+    pthread_mutex_destroy(&Replay->Lock);
+#endif
+
+    for (i = 0; i < Replay->Count; i++)
+        replay_free_record(&Replay->Records[i]);
+    free(Replay->Records);
+    free(Replay);
+
+    FUNC_LEAVE();
+}
@@ -0,0 +1,267 @@
+/*
+ *      This program is free software; you can redistribute it and/or
+ *      modify it under the terms of the GNU General Public License
+ *      as published by the Free Software Foundation; either version
+ *      2 of the License, or (at your option) any later version.
+ *
+*/
+
+/*! **************************************************************
+** \file lib/schedule.c \n
+** \n
+** \brief Shared library / DLL for accessing the driver:
+**        Sharing one bus between the work on several drives
+**
+****************************************************************/
+
+/*! Mark: We are in user-space (for debug.h) */
+#define DBG_USERMODE
+
+/*! The name of the executable */
+#define DBG_PROGNAME "OPENCBM.DLL"
+
+#include "debug.h"
+
+//! mark: We are building the DLL */
+#define DLL
+#include "opencbm.h"
+#include "arch.h"
+
+/*! The address of the job codes in the drive memory */
+#define DRIVE_JOB_CODES        0x0000
+
+/*! The address of the track and sector of the jobs in the drive memory */
+#define DRIVE_JOB_TRACKSECTOR  0x0006
+
+/*! The number of buffers of a 1541 which can have a job */
+#define DRIVE_JOB_BUFFERS      5
+
+/*! A job code of the drive is finished if it is below this */
+#define DRIVE_JOB_RUNNING      0x80
+
+/** @{ @ingroup opencbm_iec */
+
+/*! \brief Run the tasks of several drives on one bus
+
+ This function runs the tasks until all of them are done.
+ Each task is one drive's work, split into steps: A step
+ uses the bus, for example to give the drive a job, and then
+ tells how long the drive will be busy with it. In the
+ meantime, the steps of the other tasks get the bus. So, the
+ drives on the bus work at the same time, instead of one
+ after the other.
+
+ The tasks get the bus in turn: Of the tasks which are not
+ busy anymore, the one after the task of the last step runs
+ next. If all of them are busy, the function sleeps until
+ the first one is expected to be done.
+
+ \param HandleDevice
+   A CBM_FILE which contains the file handle of the driver.
+
+ \param Tasks
+   Pointer to an array of the tasks. The step member of all of
+   them must be filled in.
+
+ \param Count
+   The number of entries in Tasks.
+
+ \return
+   0 if all tasks are done, -1 if the parameters are invalid.
+
+ \remark
+   A step must leave the bus idle when it returns: no device
+   may be a listener or a talker anymore. A drive which
+   executes a DOS command blocks the bus until it is done;
+   only work which runs in the drive on its own, like the
+   jobs of cbm_drive_job_start(), can overlap.
+
+ If cbm_driver_open() did not succeed, it is illegal to
+ call this function.
+*/
+
+int CBMAPIDECL
+cbm_bus_schedule(CBM_FILE HandleDevice, cbm_bus_task_t *Tasks, unsigned int Count)
+{
+    unsigned int pending = 0;
+    unsigned int last;
+    unsigned int i;
+
+    FUNC_ENTER();
+
+    FUNC_PARAM((DBG_PREFIX "HandleDevice = %p, Tasks = %p, Count = %u",
+        HandleDevice, Tasks, Count));
+
+    if (Tasks == NULL && Count > 0) {
+        FUNC_LEAVE_INT(-1);
+    }
+
+    for (i = 0; i < Count; i++) {
+        if (Tasks[i].step == NULL) {
+            FUNC_LEAVE_INT(-1);
+        }
+        Tasks[i].wake_time = 0;
+        Tasks[i].done = 0;
+        ++pending;
+    }
+
+    last = Count - 1;
+
+    while (pending > 0) {
+        double now = arch_time_us();
+        double wake = 0;
+        int ready = -1;
+        int busy_ms;
+
+        /* find the next task in turn which is not busy anymore */
+
+        for (i = 1; i <= Count; i++) {
+            cbm_bus_task_t *task = &Tasks[(last + i) % Count];
+
+            if (task->done) {
+                continue;
+            }
+
+            if (task->wake_time <= now) {
+                ready = (last + i) % Count;
+                break;
+            }
+
+            if (wake == 0 || task->wake_time < wake) {
+                wake = task->wake_time;
+            }
+        }
+
+        if (ready < 0) {
+            arch_sleep_us((unsigned int) (wake - now) + 1);
+            continue;
+        }
+
+        last = ready;
+
+        busy_ms = Tasks[ready].step(HandleDevice, &Tasks[ready]);
+
+        if (busy_ms < 0) {
+            Tasks[ready].done = 1;
+            --pending;
+        }
+        else {
+            Tasks[ready].wake_time = arch_time_us() + busy_ms * 1000.0;
+        }
+    }
+
+    FUNC_LEAVE_INT(0);
+}
+
+/*! \brief Start a job in the drive
+
+ This function gives the disk controller of a drive a job,
+ like reading a sector into a buffer, with two M-W commands.
+ The controller works on its own; the DOS, and thus the bus,
+ is free in the meantime. With cbm_drive_job_poll(), the
+ caller learns when the job is done.
+
+ \param HandleDevice
+   A CBM_FILE which contains the file handle of the driver.
+
+ \param DeviceAddress
+   The address of the device on the IEC serial bus. This
+   is known as primary address, too.
+
+ \param Buffer
+   The number of the buffer of the job (0 to 4): The buffer
+   is at $0300 + Buffer * $100 in the drive memory.
+
+ \param Job
+   The job code, like 0x80 for reading a sector, or 0x90 for
+   writing it. The drive of the job is in the lowest bit.
+
+ \param Track
+   The track of the job.
+
+ \param Sector
+   The sector of the job.
+
+ \return
+   0 on success, -1 on error.
+
+ If cbm_driver_open() did not succeed, it is illegal to
+ call this function.
+*/
+
+int CBMAPIDECL
+cbm_drive_job_start(CBM_FILE HandleDevice, unsigned char DeviceAddress,
+                    unsigned char Buffer, unsigned char Job,
+                    unsigned char Track, unsigned char Sector)
+{
+    unsigned char tracksector[2];
+
+    FUNC_ENTER();
+
+    FUNC_PARAM((DBG_PREFIX "device = %u, buffer = %u, job = $%02x, track = %u, sector = %u",
+        DeviceAddress, Buffer, Job, Track, Sector));
+
+    if (Buffer >= DRIVE_JOB_BUFFERS || Job < DRIVE_JOB_RUNNING) {
+        FUNC_LEAVE_INT(-1);
+    }
+
+    tracksector[0] = Track;
+    tracksector[1] = Sector;
+
+    /* the job code must come last: the controller starts as soon as it sees it */
+
+    if (cbm_upload(HandleDevice, DeviceAddress, DRIVE_JOB_TRACKSECTOR + 2 * Buffer,
+            tracksector, sizeof tracksector) != sizeof tracksector
+        || cbm_upload(HandleDevice, DeviceAddress, DRIVE_JOB_CODES + Buffer,
+            &Job, 1) != 1)
+    {
+        FUNC_LEAVE_INT(-1);
+    }
+
+    FUNC_LEAVE_INT(0);
+}
+
+/*! \brief Look if a job in the drive is done
+
+ This function reads the job code of a buffer with an M-R
+ command, to find out if the job started with
+ cbm_drive_job_start() is done.
+
+ \param HandleDevice
+   A CBM_FILE which contains the file handle of the driver.
+
+ \param DeviceAddress
+   The address of the device on the IEC serial bus. This
+   is known as primary address, too.
+
+ \param Buffer
+   The number of the buffer of the job (0 to 4).
+
+ \return
+   0 if the job is still running; the result of the job
+   (1 means success, like the "00, OK" of the DOS) if it
+   is done; -1 on error.
+
+ If cbm_driver_open() did not succeed, it is illegal to
+ call this function.
+*/
+
+int CBMAPIDECL
+cbm_drive_job_poll(CBM_FILE HandleDevice, unsigned char DeviceAddress,
+                   unsigned char Buffer)
+{
+    unsigned char job;
+
+    FUNC_ENTER();
+
+    if (Buffer >= DRIVE_JOB_BUFFERS
+        || cbm_download(HandleDevice, DeviceAddress, DRIVE_JOB_CODES + Buffer,
+               &job, 1) != 1)
+    {
+        FUNC_LEAVE_INT(-1);
+    }
+
+    FUNC_LEAVE_INT(job >= DRIVE_JOB_RUNNING ? 0 : job);
+}
+
+/** @} */
@@ -0,0 +1,755 @@
+/*
+ *      This program is free software; you can redistribute it and/or
+ *      modify it under the terms of the GNU General Public License
+ *      as published by the Free Software Foundation; either version
+ *      2 of the License, or (at your option) any later version.
+ *
+*/
+
+/*! **************************************************************
+** \file lib/trace.c \n
+** \n
+** \brief Shared library / DLL for accessing the driver:
+**        Trace of the bus level calls into a plugin
+**
+** The trace sits between the library and a plugin: The entry points
+** of the plugin are replaced by functions that call the original
+** ones, time them and write one line per call to the trace file:
+**
+**   \<seq\> \<start\> \<duration\> \<name\>(\<args\>) = \<result\> [: \<data\>]
+**
+** \<start\> and \<duration\> are given in microseconds, \<start\>
+** relative to loading the plugin. \<data\> are the bytes written or
+** read, in hex. Lines starting with '#' are comments; when the plugin
+** is unloaded, a summary of all calls is appended as such.
+**
+****************************************************************/
+
+/*! Mark: We are in user-space (for debug.h) */
+#define DBG_USERMODE
+
+/*! The name of the executable */
+#define DBG_PROGNAME "OPENCBM.DLL"
+
+#include "debug.h"
+
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+//! mark: We are building the DLL */
+#define DLL
+#include "opencbm.h"
+#include "opencbm-plugin.h"
+#include "trace.h"
+
+#ifdef WIN32
+# include <windows.h>
+#else
+# include <pthread.h>
+# include <time.h>
+#endif
+
+/*! \brief The names of the calls in the trace file, indexed by enum cbm_trace_call */
+const char * const cbm_trace_call_name[TRACE_COUNT] = {
+    "raw_write",
+    "raw_read",
+    "raw_writev",
+    "raw_readv",
+    "open",
+    "close",
+    "listen",
+    "talk",
+    "unlisten",
+    "untalk",
+    "get_eoi",
+    "clear_eoi",
+    "reset",
+    "pp_read",
+    "pp_write",
+    "iec_poll",
+    "iec_set",
+    "iec_release",
+    "iec_setrelease",
+    "iec_wait",
+    "iec_wait_timeout",
+    "iec_program",
+    "parallel_burst_read",
+    "parallel_burst_write",
+    "parallel_burst_read_n",
+    "parallel_burst_write_n",
+    "parallel_burst_read_track",
+    "parallel_burst_read_track_var",
+    "parallel_burst_write_track",
+    "srq_burst_read",
+    "srq_burst_write",
+    "srq_burst_read_n",
+    "srq_burst_write_n",
+    "srq_burst_read_track",
+    "srq_burst_write_track",
+    "batch",
+    "set_deferred_status",
+    "flush_deferred_status",
+    "memory_write",
+    "memory_read",
+    "code_upload"
+};
+
+/*! \brief The accounting of one traced call */
+struct trace_stat {
+    unsigned long calls;   /*!< the number of calls */
+    unsigned long errors;  /*!< the number of calls that returned a negative value */
+    unsigned long bytes;   /*!< the number of bytes transferred */
+    double        time_us; /*!< the time spent in the calls */
+    double        max_us;  /*!< the longest of the calls */
+};
+
+/*! \brief The trace of one loaded plugin */
+struct cbm_trace_s {
+    opencbm_plugin_t  Original;          /*!< the entry points of the plugin itself */
+    char             *PluginName;        /*!< the name of the plugin, for the trace file */
+    FILE             *File;              /*!< the trace file */
+    double            Start;             /*!< the time the trace was started */
+    unsigned long     Sequence;          /*!< the number of the next call */
+    struct trace_stat Stat[TRACE_COUNT]; /*!< the accounting of the calls */
+
+#ifdef WIN32
+    CRITICAL_SECTION  Lock;              /*!< protects the file and the accounting */
+#else
+    pthread_mutex_t   Lock;              /*!< protects the file and the accounting */
+#endif
+};
+
+/*! \internal \brief The current time in microseconds */
+static double
+trace_now(void)
+{
+#ifdef WIN32
+    static LARGE_INTEGER frequency;
+    LARGE_INTEGER counter;
+
+    if (frequency.QuadPart == 0)
+        QueryPerformanceFrequency(&frequency);
+    QueryPerformanceCounter(&counter);
+    return (double)counter.QuadPart * 1e6 / (double)frequency.QuadPart;
+#else
+    struct timespec now;
+
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return now.tv_sec * 1e6 + now.tv_nsec / 1e3;
+#endif
+}
+
+static void
+trace_lock(cbm_trace_t *Trace)
+{
+#ifdef WIN32
+    EnterCriticalSection(&Trace->Lock);
+#else
+    pthread_mutex_lock(&Trace->Lock);
+#endif
+}
+
+static void
+trace_unlock(cbm_trace_t *Trace)
+{
+#ifdef WIN32
+    LeaveCriticalSection(&Trace->Lock);
+#else
+    pthread_mutex_unlock(&Trace->Lock);
+#endif
+}
+
+/*! \internal \brief Start the line of a call that has returned
+
+ This accounts for the call and writes everything up to the result.
+ The trace stays locked until trace_line_end() is called; the data
+ of the call can be added with trace_line_data() in between.
+
+ \param Trace
+   The trace to write to.
+
+ \param Call
+   The call that has returned.
+
+ \param Start
+   The value of trace_now() before the call.
+
+ \param Result
+   The return value of the call; 0 for calls without one.
+
+ \param Bytes
+   The number of bytes the call transferred.
+
+ \param Format
+   printf() format of the arguments of the call, followed by them.
+*/
+static void
+trace_line_begin(cbm_trace_t *Trace, enum cbm_trace_call Call, double Start,
+                 int Result, int Bytes, const char *Format, ...)
+{
+    double elapsed = trace_now() - Start;
+    struct trace_stat *stat = &Trace->Stat[Call];
+    va_list args;
+
+    trace_lock(Trace);
+
+    stat->calls++;
+    if (Result < 0)
+        stat->errors++;
+    if (Bytes > 0)
+        stat->bytes += Bytes;
+    stat->time_us += elapsed;
+    if (elapsed > stat->max_us)
+        stat->max_us = elapsed;
+
+    fprintf(Trace->File, "%lu %.1f %.1f %s(", Trace->Sequence++,
+        Start - Trace->Start, elapsed, cbm_trace_call_name[Call]);
+
+    va_start(args, Format);
+    vfprintf(Trace->File, Format, args);
+    va_end(args);
+
+    fprintf(Trace->File, ") = %d", Result);
+}
+
+/*! \internal \brief Add data to the line of a call
+
+ \param Trace
+   The trace to write to; trace_line_begin() must have been called.
+
+ \param Data
+   The bytes to add.
+
+ \param Length
+   The number of bytes to add; nothing is written if this is not positive.
+*/
+static void
+trace_line_data(cbm_trace_t *Trace, const void *Data, int Length)
+{
+    const unsigned char *data = Data;
+
+    if (Length <= 0 || data == NULL)
+        return;
+
+    fputs(" :", Trace->File);
+    while (Length-- > 0)
+        fprintf(Trace->File, " %02x", *data++);
+}
+
+/*! \internal \brief End the line of a call, and unlock the trace */
+static void
+trace_line_end(cbm_trace_t *Trace)
+{
+    fputc('\n', Trace->File);
+    trace_unlock(Trace);
+}
+
+/*! \internal \brief Write the line of a call without data */
+#define TRACE_LINE(_trace, _args) \
+    do { \
+        trace_line_begin _args; \
+        trace_line_end(_trace); \
+    } while (0)
+
+/*! \internal \brief Write the line of a call, with its data */
+#define TRACE_LINE_DATA(_trace, _data, _length, _args) \
+    do { \
+        trace_line_begin _args; \
+        trace_line_data((_trace), (_data), (_length)); \
+        trace_line_end(_trace); \
+    } while (0)
+
+/*! \internal \brief Add the data of a scatter/gather call
+
+ \param Trace
+   The trace to write to; trace_line_begin() must have been called.
+
+ \param Iov
+   The buffers of the call.
+
+ \param IovCount
+   The number of entries in Iov.
+
+ \param Length
+   The number of bytes that have been transferred, which are dumped.
+*/
+static void
+trace_line_iov(cbm_trace_t *Trace, const cbm_iovec_t *Iov, unsigned int IovCount, int Length)
+{
+    unsigned int i;
+
+    for (i = 0; i < IovCount && Length > 0; i++) {
+        int len = (Iov[i].iov_len < (size_t) Length) ? (int) Iov[i].iov_len : Length;
+
+        trace_line_data(Trace, Iov[i].iov_base, len);
+        Length -= len;
+    }
+}
+
+/*-------------------------------------------------------------------*/
+/*--------- TRACED ENTRY POINTS -------------------------------------*/
+
+/*
+ * Each of these calls the original entry point of the plugin the
+ * handle belongs to and traces the call. The functions are only
+ * installed for the entry points the plugin actually has.
+ */
+
+/*! \internal \brief The original entry point _func of the plugin of the trace */
+#define ORIGINAL(_trace, _func) ((_trace)->Original.opencbm_plugin_##_func)
+
+static int CBMAPIDECL
+trace_raw_write(CBM_FILE HandleDevice, const void *Buffer, size_t Count)
+{
+    cbm_trace_t *trace = cbm_trace_of_handle(HandleDevice);
+    double start = trace_now();
+    int rv = ORIGINAL(trace, raw_write)(HandleDevice, Buffer, Count);
+
+    TRACE_LINE_DATA(trace, Buffer, rv,
+        (trace, TRACE_RAW_WRITE, start, rv, rv, "%lu", (unsigned long) Count));
+    return rv;
+}
+
+static int CBMAPIDECL
+trace_raw_read(CBM_FILE HandleDevice, void *Buffer, size_t Count)
+{
+    cbm_trace_t *trace = cbm_trace_of_handle(HandleDevice);
+    double start = trace_now();
+    int rv = ORIGINAL(trace, raw_read)(HandleDevice, Buffer, Count);
+
+    TRACE_LINE_DATA(trace, Buffer, rv,
+        (trace, TRACE_RAW_READ, start, rv, rv, "%lu", (unsigned long) Count));
+    return rv;
+}
+
+static int CBMAPIDECL
+trace_raw_writev(CBM_FILE HandleDevice, const cbm_iovec_t *Iov, unsigned int IovCount)
+{
+    cbm_trace_t *trace = cbm_trace_of_handle(HandleDevice);
+    double start = trace_now();
+    int rv = ORIGINAL(trace, raw_writev)(HandleDevice, Iov, IovCount);
+
+    trace_line_begin(trace, TRACE_RAW_WRITEV, start, rv, rv, "%u", IovCount);
+    trace_line_iov(trace, Iov, IovCount, rv);
+    trace_line_end(trace);
+    return rv;
+}
+
+static int CBMAPIDECL
+trace_raw_readv(CBM_FILE HandleDevice, const cbm_iovec_t *Iov, unsigned int IovCount)
+{
+    cbm_trace_t *trace = cbm_trace_of_handle(HandleDevice);
+    double start = trace_now();
+    int rv = ORIGINAL(trace, raw_readv)(HandleDevice, Iov, IovCount);
+
+    trace_line_begin(trace, TRACE_RAW_READV, start, rv, rv, "%u", IovCount);
+    trace_line_iov(trace, Iov, IovCount, rv);
+    trace_line_end(trace);
+    return rv;
+}
+
+/*! \internal \brief Define a traced entry point that addresses a device */
+#define TRACE_ADDRESSED(_func, _call) \
+    static int CBMAPIDECL \
+    trace_##_func(CBM_FILE HandleDevice, unsigned char DeviceAddress, unsigned char SecondaryAddress) \
+    { \
+        cbm_trace_t *trace = cbm_trace_of_handle(HandleDevice); \
+        double start = trace_now(); \
+        int rv = ORIGINAL(trace, _func)(HandleDevice, DeviceAddress, SecondaryAddress); \
+        TRACE_LINE(trace, \
+            (trace, _call, start, rv, 0, "%u, %u", DeviceAddress, SecondaryAddress)); \
+        return rv; \
+    }
+
+TRACE_ADDRESSED(open,   TRACE_OPEN)
+TRACE_ADDRESSED(close,  TRACE_CLOSE)
+TRACE_ADDRESSED(listen, TRACE_LISTEN)
+TRACE_ADDRESSED(talk,   TRACE_TALK)
+
+/*! \internal \brief Define a traced entry point that only gets the handle */
+#define TRACE_SIMPLE(_func, _call) \
+    static int CBMAPIDECL \
+    trace_##_func(CBM_FILE HandleDevice) \
+    { \
+        cbm_trace_t *trace = cbm_trace_of_handle(HandleDevice); \
+        double start = trace_now(); \
+        int rv = ORIGINAL(trace, _func)(HandleDevice); \
+        TRACE_LINE(trace, (trace, _call, start, rv, 0, "")); \
+        return rv; \
+    }
+
+TRACE_SIMPLE(unlisten,              TRACE_UNLISTEN)
+TRACE_SIMPLE(untalk,                TRACE_UNTALK)
+TRACE_SIMPLE(get_eoi,               TRACE_GET_EOI)
+TRACE_SIMPLE(clear_eoi,             TRACE_CLEAR_EOI)
+TRACE_SIMPLE(reset,                 TRACE_RESET)
+TRACE_SIMPLE(iec_poll,              TRACE_IEC_POLL)
+TRACE_SIMPLE(flush_deferred_status, TRACE_FLUSH_DEFERRED_STATUS)
+
+/*! \internal \brief Define a traced entry point that reads a byte */
+#define TRACE_BYTE_READ(_func, _call) \
+    static unsigned char CBMAPIDECL \
+    trace_##_func(CBM_FILE HandleDevice) \
+    { \
+        cbm_trace_t *trace = cbm_trace_of_handle(HandleDevice); \
+        double start = trace_now(); \
+        unsigned char rv = ORIGINAL(trace, _func)(HandleDevice); \
+        TRACE_LINE(trace, (trace, _call, start, rv, 1, "")); \
+        return rv; \
+    }
+
+TRACE_BYTE_READ(pp_read,              TRACE_PP_READ)
+TRACE_BYTE_READ(parallel_burst_read,  TRACE_PARALLEL_BURST_READ)
+TRACE_BYTE_READ(srq_burst_read,       TRACE_SRQ_BURST_READ)
+
+/*! \internal \brief Define a traced entry point that writes a byte */
+#define TRACE_BYTE_WRITE(_func, _call) \
+    static void CBMAPIDECL \
+    trace_##_func(CBM_FILE HandleDevice, unsigned char Value) \
+    { \
+        cbm_trace_t *trace = cbm_trace_of_handle(HandleDevice); \
+        double start = trace_now(); \
+        ORIGINAL(trace, _func)(HandleDevice, Value); \
+        TRACE_LINE(trace, (trace, _call, start, 0, 1, "%u", Value)); \
+    }
+
+TRACE_BYTE_WRITE(pp_write,             TRACE_PP_WRITE)
+TRACE_BYTE_WRITE(parallel_burst_write, TRACE_PARALLEL_BURST_WRITE)
+TRACE_BYTE_WRITE(srq_burst_write,      TRACE_SRQ_BURST_WRITE)
+
+/*! \internal \brief Define a traced entry point that transfers a block */
+#define TRACE_BLOCK(_func, _call) \
+    static int CBMAPIDECL \
+    trace_##_func(CBM_FILE HandleDevice, unsigned char *Buffer, unsigned int Length) \
+    { \
+        cbm_trace_t *trace = cbm_trace_of_handle(HandleDevice); \
+        double start = trace_now(); \
+        int rv = ORIGINAL(trace, _func)(HandleDevice, Buffer, Length); \
+        TRACE_LINE_DATA(trace, Buffer, rv, \
+            (trace, _call, start, rv, rv, "%u", Length)); \
+        return rv; \
+    }
+
+TRACE_BLOCK(parallel_burst_read_n,         TRACE_PARALLEL_BURST_READ_N)
+TRACE_BLOCK(parallel_burst_write_n,        TRACE_PARALLEL_BURST_WRITE_N)
+TRACE_BLOCK(parallel_burst_read_track,     TRACE_PARALLEL_BURST_READ_TRACK)
+TRACE_BLOCK(parallel_burst_read_track_var, TRACE_PARALLEL_BURST_READ_TRACK_VAR)
+TRACE_BLOCK(parallel_burst_write_track,    TRACE_PARALLEL_BURST_WRITE_TRACK)
+TRACE_BLOCK(srq_burst_read_n,              TRACE_SRQ_BURST_READ_N)
+TRACE_BLOCK(srq_burst_write_n,             TRACE_SRQ_BURST_WRITE_N)
+TRACE_BLOCK(srq_burst_read_track,          TRACE_SRQ_BURST_READ_TRACK)
+TRACE_BLOCK(srq_burst_write_track,         TRACE_SRQ_BURST_WRITE_TRACK)
+
+/*! \internal \brief Define a traced entry point that sets or releases lines */
+#define TRACE_LINES(_func, _call) \
+    static void CBMAPIDECL \
+    trace_##_func(CBM_FILE HandleDevice, int Line) \
+    { \
+        cbm_trace_t *trace = cbm_trace_of_handle(HandleDevice); \
+        double start = trace_now(); \
+        ORIGINAL(trace, _func)(HandleDevice, Line); \
+        TRACE_LINE(trace, (trace, _call, start, 0, 0, "%u", Line)); \
+    }
+
+TRACE_LINES(iec_set,     TRACE_IEC_SET)
+TRACE_LINES(iec_release, TRACE_IEC_RELEASE)
+
+static void CBMAPIDECL
+trace_iec_setrelease(CBM_FILE HandleDevice, int Set, int Release)
+{
+    cbm_trace_t *trace = cbm_trace_of_handle(HandleDevice);
+    double start = trace_now();
+
+    ORIGINAL(trace, iec_setrelease)(HandleDevice, Set, Release);
+    TRACE_LINE(trace,
+        (trace, TRACE_IEC_SETRELEASE, start, 0, 0, "%u, %u", Set, Release));
+}
+
+static int CBMAPIDECL
+trace_iec_wait(CBM_FILE HandleDevice, int Line, int State)
+{
+    cbm_trace_t *trace = cbm_trace_of_handle(HandleDevice);
+    double start = trace_now();
+    int rv = ORIGINAL(trace, iec_wait)(HandleDevice, Line, State);
+
+    TRACE_LINE(trace,
+        (trace, TRACE_IEC_WAIT, start, rv, 0, "%u, %u", Line, State));
+    return rv;
+}
+
+static int CBMAPIDECL
+trace_iec_wait_timeout(CBM_FILE HandleDevice, int Line, int State, unsigned int TimeoutMs)
+{
+    cbm_trace_t *trace = cbm_trace_of_handle(HandleDevice);
+    double start = trace_now();
+    int rv = ORIGINAL(trace, iec_wait_timeout)(HandleDevice, Line, State, TimeoutMs);
+
+    TRACE_LINE(trace,
+        (trace, TRACE_IEC_WAIT_TIMEOUT, start, rv, 0, "%u, %u, %u", Line, State, TimeoutMs));
+    return rv;
+}
+
+/* the program is dumped as it is on return, with the results in place */
+static int CBMAPIDECL
+trace_iec_program(CBM_FILE HandleDevice, unsigned char *Program, unsigned int Length)
+{
+    cbm_trace_t *trace = cbm_trace_of_handle(HandleDevice);
+    double start = trace_now();
+    int rv = ORIGINAL(trace, iec_program)(HandleDevice, Program, Length);
+
+    TRACE_LINE_DATA(trace, Program, (int) Length,
+        (trace, TRACE_IEC_PROGRAM, start, rv, 0, "%u", Length));
+    return rv;
+}
+
+/*! \internal \brief The letters of the batch entry types in the trace file */
+static const char trace_batch_type[] = { 'w', 'a', 't', 'r' };
+
+static int CBMAPIDECL
+trace_batch(CBM_FILE HandleDevice, opencbm_plugin_batch_entry_t *Entries, unsigned int Count)
+{
+    cbm_trace_t *trace = cbm_trace_of_handle(HandleDevice);
+    double start = trace_now();
+    int rv = ORIGINAL(trace, batch)(HandleDevice, Entries, Count);
+    int bytes = 0;
+    unsigned int i;
+
+    for (i = 0; i < Count; i++) {
+        if (Entries[i].result > 0)
+            bytes += Entries[i].result;
+    }
+
+    /* every entry is dumped as " <type><result>", followed by its data */
+    trace_line_begin(trace, TRACE_BATCH, start, rv, bytes, "%u", Count);
+    for (i = 0; i < Count; i++) {
+        fprintf(trace->File, " | %c%d", trace_batch_type[Entries[i].type & 3], Entries[i].result);
+        trace_line_data(trace, Entries[i].data, Entries[i].result);
+    }
+    trace_line_end(trace);
+    return rv;
+}
+
+static int CBMAPIDECL
+trace_set_deferred_status(CBM_FILE HandleDevice, int Enable)
+{
+    cbm_trace_t *trace = cbm_trace_of_handle(HandleDevice);
+    double start = trace_now();
+    int rv = ORIGINAL(trace, set_deferred_status)(HandleDevice, Enable);
+
+    TRACE_LINE(trace,
+        (trace, TRACE_SET_DEFERRED_STATUS, start, rv, 0, "%d", Enable));
+    return rv;
+}
+
+static int CBMAPIDECL
+trace_memory_write(CBM_FILE HandleDevice, unsigned char DeviceAddress, unsigned int MemoryAddress, const unsigned char *Buffer, unsigned int Count)
+{
+    cbm_trace_t *trace = cbm_trace_of_handle(HandleDevice);
+    double start = trace_now();
+    int rv = ORIGINAL(trace, memory_write)(HandleDevice, DeviceAddress, MemoryAddress, Buffer, Count);
+
+    TRACE_LINE_DATA(trace, Buffer, rv,
+        (trace, TRACE_MEMORY_WRITE, start, rv, rv, "%u, 0x%04x, %u", DeviceAddress, MemoryAddress, Count));
+    return rv;
+}
+
+static int CBMAPIDECL
+trace_memory_read(CBM_FILE HandleDevice, unsigned char DeviceAddress, unsigned int MemoryAddress, unsigned char *Buffer, unsigned int Count)
+{
+    cbm_trace_t *trace = cbm_trace_of_handle(HandleDevice);
+    double start = trace_now();
+    int rv = ORIGINAL(trace, memory_read)(HandleDevice, DeviceAddress, MemoryAddress, Buffer, Count);
+
+    TRACE_LINE_DATA(trace, Buffer, rv,
+        (trace, TRACE_MEMORY_READ, start, rv, rv, "%u, 0x%04x, %u", DeviceAddress, MemoryAddress, Count));
+    return rv;
+}
+
+static int CBMAPIDECL
+trace_code_upload(CBM_FILE HandleDevice, unsigned char DeviceAddress, unsigned int MemoryAddress, const unsigned char *Buffer, unsigned int Count)
+{
+    cbm_trace_t *trace = cbm_trace_of_handle(HandleDevice);
+    double start = trace_now();
+    int rv = ORIGINAL(trace, code_upload)(HandleDevice, DeviceAddress, MemoryAddress, Buffer, Count);
+
+    TRACE_LINE_DATA(trace, Buffer, Count,
+        (trace, TRACE_CODE_UPLOAD, start, rv, rv, "%u, 0x%04x, %u", DeviceAddress, MemoryAddress, Count));
+    return rv;
+}
+
+/*-------------------------------------------------------------------*/
+/*--------- INSTALLATION --------------------------------------------*/
+
+/*! \internal \brief Replace an entry point of the plugin by its traced version, if the plugin has it
+
+ The entry points which are there are listed in the trace file,
+ so that a replay can offer the same ones.
+*/
+#define TRACE_INSTALL(_trace, _plugin, _func) \
+    do { \
+        if ((_plugin)->opencbm_plugin_##_func) { \
+            (_plugin)->opencbm_plugin_##_func = trace_##_func; \
+            fputs(" " #_func, (_trace)->File); \
+        } \
+    } while (0)
+
+/*! \brief Start to trace the calls into a plugin
+
+ The entry points of the plugin that transfer data or access the
+ bus are replaced by versions that trace each call. Entry points
+ the plugin does not have stay NULL, so that the library still
+ falls back the same way as without the trace. The tape functions
+ are not traced.
+
+ \param Plugin
+   The entry points of the plugin; they are changed in place.
+
+ \param PluginName
+   The name of the plugin, for the trace file. Can be NULL.
+
+ \param Filename
+   The name of the trace file. If it is "-", stderr is used.
+
+ \return
+   The trace, which has to be given to cbm_trace_uninstall() before
+   the plugin is unloaded, or NULL if the trace could not be started.
+   In this case, Plugin is not changed.
+*/
+cbm_trace_t *
+cbm_trace_install(opencbm_plugin_t *Plugin, const char *PluginName, const char *Filename)
+{
+    cbm_trace_t *trace;
+
+    FUNC_ENTER();
+
+    trace = calloc(1, sizeof *trace);
+    if (trace == NULL)
+        FUNC_LEAVE_PTR(NULL, cbm_trace_t *);
+
+    if (strcmp(Filename, "-") == 0) {
+        trace->File = stderr;
+    }
+    else {
+        trace->File = fopen(Filename, "w");
+        if (trace->File == NULL) {
+            DBG_ERROR((DBG_PREFIX "Cannot open trace file '%s'", Filename));
+            free(trace);
+            FUNC_LEAVE_PTR(NULL, cbm_trace_t *);
+        }
+    }
+
+    if (PluginName) {
+        trace->PluginName = malloc(strlen(PluginName) + 1);
+        if (trace->PluginName)
+            strcpy(trace->PluginName, PluginName);
+    }
+
+#ifdef WIN32
+    InitializeCriticalSection(&trace->Lock);
+#else
+    pthread_mutex_init(&trace->Lock, NULL);
+#endif
+
+    trace->Original = *Plugin;
+    trace->Start = trace_now();
+
+    fprintf(trace->File, "# opencbm trace of plugin %s\n",
+        trace->PluginName ? trace->PluginName : "(default)");
+
+    fputs("# entry points:", trace->File);
+    TRACE_INSTALL(trace, Plugin, raw_write);
+    TRACE_INSTALL(trace, Plugin, raw_read);
+    TRACE_INSTALL(trace, Plugin, raw_writev);
+    TRACE_INSTALL(trace, Plugin, raw_readv);
+    TRACE_INSTALL(trace, Plugin, open);
+    TRACE_INSTALL(trace, Plugin, close);
+    TRACE_INSTALL(trace, Plugin, listen);
+    TRACE_INSTALL(trace, Plugin, talk);
+    TRACE_INSTALL(trace, Plugin, unlisten);
+    TRACE_INSTALL(trace, Plugin, untalk);
+    TRACE_INSTALL(trace, Plugin, get_eoi);
+    TRACE_INSTALL(trace, Plugin, clear_eoi);
+    TRACE_INSTALL(trace, Plugin, reset);
+    TRACE_INSTALL(trace, Plugin, pp_read);
+    TRACE_INSTALL(trace, Plugin, pp_write);
+    TRACE_INSTALL(trace, Plugin, iec_poll);
+    TRACE_INSTALL(trace, Plugin, iec_set);
+    TRACE_INSTALL(trace, Plugin, iec_release);
+    TRACE_INSTALL(trace, Plugin, iec_setrelease);
+    TRACE_INSTALL(trace, Plugin, iec_wait);
+    TRACE_INSTALL(trace, Plugin, iec_wait_timeout);
+    TRACE_INSTALL(trace, Plugin, iec_program);
+    TRACE_INSTALL(trace, Plugin, parallel_burst_read);
+    TRACE_INSTALL(trace, Plugin, parallel_burst_write);
+    TRACE_INSTALL(trace, Plugin, parallel_burst_read_n);
+    TRACE_INSTALL(trace, Plugin, parallel_burst_write_n);
+    TRACE_INSTALL(trace, Plugin, parallel_burst_read_track);
+    TRACE_INSTALL(trace, Plugin, parallel_burst_read_track_var);
+    TRACE_INSTALL(trace, Plugin, parallel_burst_write_track);
+    TRACE_INSTALL(trace, Plugin, srq_burst_read);
+    TRACE_INSTALL(trace, Plugin, srq_burst_write);
+    TRACE_INSTALL(trace, Plugin, srq_burst_read_n);
+    TRACE_INSTALL(trace, Plugin, srq_burst_write_n);
+    TRACE_INSTALL(trace, Plugin, srq_burst_read_track);
+    TRACE_INSTALL(trace, Plugin, srq_burst_write_track);
+    TRACE_INSTALL(trace, Plugin, batch);
+    TRACE_INSTALL(trace, Plugin, set_deferred_status);
+    TRACE_INSTALL(trace, Plugin, flush_deferred_status);
+    TRACE_INSTALL(trace, Plugin, memory_write);
+    TRACE_INSTALL(trace, Plugin, memory_read);
+    TRACE_INSTALL(trace, Plugin, code_upload);
+    fputc('\n', trace->File);
+
+    FUNC_LEAVE_PTR(trace, cbm_trace_t *);
+}
+
+/*! \brief Stop to trace the calls into a plugin
+
+ The summary of all calls is written to the trace file, and the
+ original entry points of the plugin are restored.
+
+ \param Plugin
+   The entry points of the plugin, as changed by cbm_trace_install().
+
+ \param Trace
+   The trace cbm_trace_install() returned.
+*/
+void
+cbm_trace_uninstall(opencbm_plugin_t *Plugin, cbm_trace_t *Trace)
+{
+    int i;
+
+    FUNC_ENTER();
+
+    *Plugin = Trace->Original;
+
+    fprintf(Trace->File, "# summary: name calls errors bytes total_us avg_us max_us\n");
+    for (i = 0; i < TRACE_COUNT; i++) {
+        struct trace_stat *stat = &Trace->Stat[i];
+
+        if (stat->calls == 0)
+            continue;
+
+        fprintf(Trace->File, "# %s %lu %lu %lu %.1f %.1f %.1f\n",
+            cbm_trace_call_name[i], stat->calls, stat->errors, stat->bytes,
+            stat->time_us, stat->time_us / stat->calls, stat->max_us);
+    }
+
+    if (Trace->File == stderr)
+        fflush(Trace->File);
+    else
+        fclose(Trace->File);
+
+#ifdef WIN32
+    DeleteCriticalSection(&Trace->Lock);
+#else
+    pthread_mutex_destroy(&Trace->Lock);
+#endif
+
+    free(Trace->PluginName);
+    free(Trace);
+
+    FUNC_LEAVE();
+}
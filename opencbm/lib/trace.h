@@ -0,0 +1,86 @@
+/*
+ *      This program is free software; you can redistribute it and/or
+ *      modify it under the terms of the GNU General Public License
+ *      as published by the Free Software Foundation; either version
+ *      2 of the License, or (at your option) any later version.
+ *
+*/
+
+/*! **************************************************************
+** \file lib/trace.h \n
+** \n
+** \brief Internal interface of the bus trace and replay of the plugin calls
+**
+****************************************************************/
+
+#ifndef CBM_LIB_TRACE_H
+#define CBM_LIB_TRACE_H
+
+#include "opencbm.h"
+#include "opencbm-plugin.h"
+
+/*! \brief The calls that are traced */
+enum cbm_trace_call {
+    TRACE_RAW_WRITE,
+    TRACE_RAW_READ,
+    TRACE_RAW_WRITEV,
+    TRACE_RAW_READV,
+    TRACE_OPEN,
+    TRACE_CLOSE,
+    TRACE_LISTEN,
+    TRACE_TALK,
+    TRACE_UNLISTEN,
+    TRACE_UNTALK,
+    TRACE_GET_EOI,
+    TRACE_CLEAR_EOI,
+    TRACE_RESET,
+    TRACE_PP_READ,
+    TRACE_PP_WRITE,
+    TRACE_IEC_POLL,
+    TRACE_IEC_SET,
+    TRACE_IEC_RELEASE,
+    TRACE_IEC_SETRELEASE,
+    TRACE_IEC_WAIT,
+    TRACE_IEC_WAIT_TIMEOUT,
+    TRACE_IEC_PROGRAM,
+    TRACE_PARALLEL_BURST_READ,
+    TRACE_PARALLEL_BURST_WRITE,
+    TRACE_PARALLEL_BURST_READ_N,
+    TRACE_PARALLEL_BURST_WRITE_N,
+    TRACE_PARALLEL_BURST_READ_TRACK,
+    TRACE_PARALLEL_BURST_READ_TRACK_VAR,
+    TRACE_PARALLEL_BURST_WRITE_TRACK,
+    TRACE_SRQ_BURST_READ,
+    TRACE_SRQ_BURST_WRITE,
+    TRACE_SRQ_BURST_READ_N,
+    TRACE_SRQ_BURST_WRITE_N,
+    TRACE_SRQ_BURST_READ_TRACK,
+    TRACE_SRQ_BURST_WRITE_TRACK,
+    TRACE_BATCH,
+    TRACE_SET_DEFERRED_STATUS,
+    TRACE_FLUSH_DEFERRED_STATUS,
+    TRACE_MEMORY_WRITE,
+    TRACE_MEMORY_READ,
+    TRACE_CODE_UPLOAD,
+    TRACE_COUNT
+};
+
+extern const char * const cbm_trace_call_name[TRACE_COUNT];
+
+/*! \brief The trace of one loaded plugin */
+typedef struct cbm_trace_s cbm_trace_t;
+
+extern cbm_trace_t * cbm_trace_install(opencbm_plugin_t *Plugin, const char *PluginName, const char *Filename);
+extern void cbm_trace_uninstall(opencbm_plugin_t *Plugin, cbm_trace_t *Trace);
+
+/*! \brief The replay of a recorded session instead of a plugin */
+typedef struct cbm_replay_s cbm_replay_t;
+
+extern cbm_replay_t * cbm_replay_install(opencbm_plugin_t *Plugin, const char *Filename, int Timing);
+extern void cbm_replay_uninstall(opencbm_plugin_t *Plugin, cbm_replay_t *Replay);
+
+/* implemented in cbm.c */
+extern cbm_trace_t * cbm_trace_of_handle(CBM_FILE HandleDevice);
+extern cbm_replay_t * cbm_replay_of_handle(CBM_FILE HandleDevice);
+
+#endif /* #ifndef CBM_LIB_TRACE_H */
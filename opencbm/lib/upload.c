@@ -26,12 +26,131 @@
 #include "debug.h"
 
 #include <stdlib.h>
+#include <string.h>
 
 //! mark: We are building the DLL */
 #define DLL
 #include "opencbm.h"
 #include "opencbm-dos.h"
 
+/*! Number of programs remembered by the cbm_upload_resident() cache */
+#define UPLOAD_CACHE_SIZE 16
+
+/*! One program remembered by the cbm_upload_resident() cache */
+typedef
+struct upload_cache_entry_s
+{
+    int           valid;           /*!< != 0 if this entry is in use */
+    CBM_FILE      HandleDevice;    /*!< the handle the program was uploaded on */
+    unsigned char DeviceAddress;   /*!< the address of the drive */
+    int           DriveMemAddress; /*!< where the program was stored */
+    size_t        Size;            /*!< the size of the program */
+    unsigned long Hash;            /*!< the hash of the program */
+} upload_cache_entry_t;
+
+static upload_cache_entry_t upload_cache[UPLOAD_CACHE_SIZE];
+static unsigned int upload_cache_next = 0; /*!< next entry to replace */
+
+/*! \internal \brief FNV-1a hash of a program */
+static unsigned long
+upload_hash(const void *Program, size_t Size)
+{
+    const unsigned char *p = Program;
+    unsigned long hash = 2166136261ul;
+
+    while (Size-- > 0) {
+        hash = ((hash ^ *p++) * 16777619ul) & 0xFFFFFFFFul;
+    }
+    return hash;
+}
+
+/*! \internal \brief Forget all programs which overlap the given drive memory */
+static void
+upload_cache_forget(CBM_FILE HandleDevice, unsigned char DeviceAddress,
+                    int DriveMemAddress, size_t Size)
+{
+    unsigned int i;
+
+    for (i = 0; i < UPLOAD_CACHE_SIZE; i++) {
+        upload_cache_entry_t *entry = &upload_cache[i];
+
+        if (entry->valid
+            && entry->HandleDevice == HandleDevice
+            && entry->DeviceAddress == DeviceAddress
+            && entry->DriveMemAddress < DriveMemAddress + (int) Size
+            && DriveMemAddress < entry->DriveMemAddress + (int) entry->Size) {
+            entry->valid = 0;
+        }
+    }
+}
+
+static upload_cache_entry_t *
+upload_cache_find(CBM_FILE HandleDevice, unsigned char DeviceAddress,
+                  int DriveMemAddress, size_t Size, unsigned long Hash)
+{
+    unsigned int i;
+
+    for (i = 0; i < UPLOAD_CACHE_SIZE; i++) {
+        if (upload_cache[i].valid
+            && upload_cache[i].HandleDevice == HandleDevice
+            && upload_cache[i].DeviceAddress == DeviceAddress
+            && upload_cache[i].DriveMemAddress == DriveMemAddress
+            && upload_cache[i].Size == Size
+            && upload_cache[i].Hash == Hash) {
+            return &upload_cache[i];
+        }
+    }
+
+    return NULL;
+}
+
+static void
+upload_cache_store(CBM_FILE HandleDevice, unsigned char DeviceAddress,
+                   int DriveMemAddress, size_t Size, unsigned long Hash)
+{
+    upload_cache_entry_t *entry = &upload_cache[upload_cache_next];
+
+    upload_cache_next = (upload_cache_next + 1) % UPLOAD_CACHE_SIZE;
+
+    entry->valid           = 1;
+    entry->HandleDevice    = HandleDevice;
+    entry->DeviceAddress   = DeviceAddress;
+    entry->DriveMemAddress = DriveMemAddress;
+    entry->Size            = Size;
+    entry->Hash            = Hash;
+}
+
+/*! \brief Forget the programs uploaded with cbm_upload_resident()
+
+ cbm_upload_resident() remembers the programs it has uploaded on
+ every handle. This function makes it forget all of them, so that
+ the next cbm_upload_resident() uploads the program in any case.
+ Call it if the memory of a drive has been cleared, for example,
+ by switching it off, while the handle stays open.
+
+ cbm_reset() and cbm_driver_close() call this function
+ automatically.
+
+ \param HandleDevice
+   A CBM_FILE which contains the file handle of the driver.
+*/
+
+void CBMAPIDECL
+cbm_upload_cache_flush(CBM_FILE HandleDevice)
+{
+    unsigned int i;
+
+    FUNC_ENTER();
+
+    for (i = 0; i < UPLOAD_CACHE_SIZE; i++) {
+        if (upload_cache[i].HandleDevice == HandleDevice) {
+            upload_cache[i].valid = 0;
+        }
+    }
+
+    FUNC_LEAVE();
+}
+
 /*! \brief Upload a program into a floppy's drive memory.
 
  This function writes a program into the drive's memory
@@ -72,6 +191,9 @@ cbm_upload(CBM_FILE HandleDevice, unsigned char DeviceAddress,
 
     FUNC_ENTER();
 
+    /* whatever has been there before is overwritten now */
+    upload_cache_forget(HandleDevice, DeviceAddress, DriveMemAddress, Size);
+
     rv = cbm_dos_memory_write(HandleDevice, DeviceAddress, DriveMemAddress, Size, Program, NULL, NULL);
 
     if (rv == 0) {
@@ -81,6 +203,369 @@ cbm_upload(CBM_FILE HandleDevice, unsigned char DeviceAddress,
     FUNC_LEAVE_INT(rv);
 }
 
+/*! \brief Upload a program into a floppy's drive memory, unless it is already there.
+
+ This function works like cbm_upload(), but remembers the
+ programs it has uploaded. If the same program is to be
+ uploaded to the same place of the same drive again, the
+ drive memory is read back with "M-R" commands first. Only
+ if it differs, the program is uploaded. As M-R transfers
+ far more bytes per command than M-W, this saves most of
+ the time needed for repeatedly uploading a drive code.
+
+ A program which is not known to be there is uploaded
+ right away, without reading back the drive memory.
+
+ \param HandleDevice
+   A CBM_FILE which contains the file handle of the driver.
+
+ \param DeviceAddress
+   The address of the device on the IEC serial bus. This
+   is known as primary address, too.
+
+ \param DriveMemAddress
+   The address in the drive's memory where the program is to be
+   stored.
+
+ \param Program
+   Pointer to a byte buffer which holds the program in the
+   caller's address space.
+
+ \param Size
+   The size of the program to be stored, in bytes.
+
+ \return
+   Returns the number of bytes in program memory, that is,
+   Size if the program is there now. If it does not equal
+   Size, than an error occurred.
+   Specifically, -1 is returned on transfer errors.
+
+ If cbm_driver_open() did not succeed, it is illegal to
+ call this function.
+*/
+
+int CBMAPIDECL
+cbm_upload_resident(CBM_FILE HandleDevice, unsigned char DeviceAddress,
+                    int DriveMemAddress, const void *Program, size_t Size)
+{
+    unsigned long hash;
+    unsigned char *resident;
+    int rv;
+
+    FUNC_ENTER();
+
+    hash = upload_hash(Program, Size);
+
+    if (upload_cache_find(HandleDevice, DeviceAddress, DriveMemAddress, Size, hash) != NULL) {
+
+        resident = malloc(Size);
+
+        if (resident != NULL) {
+            rv = cbm_download(HandleDevice, DeviceAddress, DriveMemAddress, resident, Size);
+
+            if (rv == (int) Size && memcmp(resident, Program, Size) == 0) {
+                DBG_PRINT((DBG_PREFIX "program at $%04x is still resident", DriveMemAddress));
+                free(resident);
+                FUNC_LEAVE_INT(rv);
+            }
+            free(resident);
+        }
+    }
+
+    rv = cbm_upload(HandleDevice, DeviceAddress, DriveMemAddress, Program, Size);
+
+    if (rv == (int) Size) {
+        upload_cache_store(HandleDevice, DeviceAddress, DriveMemAddress, Size, hash);
+    }
+
+    FUNC_LEAVE_INT(rv);
+}
+
+/*
+ * Packed uploads: the program is packed on the host, and a small routine
+ * unpacks it in the drive. The packed stream is a sequence of
+ *
+ *   $01-$7F  n:  n literal bytes follow
+ *   $80-$FF  n:  copy (n & $7F) + 2 bytes from d + 1 bytes back,
+ *                with d in the next byte
+ *   $00:         the end
+ *
+ * The bytes are copied one after the other, thus, a copy may overlap the
+ * bytes it produces, as usual with LZ77.
+ */
+
+/*! The offset of the packed stream in the work area; the size of the unpacker */
+#define UNPACK_DATA     0x5C
+
+/*! The shortest copy; the longest one; the farthest one */
+#define PACK_MIN_MATCH  3
+#define PACK_MAX_MATCH  (0x7F + 2)
+#define PACK_MAX_DIST   0x100
+
+/*! The longest run of literal bytes */
+#define PACK_MAX_LITERAL 0x7F
+
+/*! The bytes of the "M-E" command which starts the unpacker */
+#define UNPACK_EXEC_COST 5
+
+/*
+ * The unpacker. It uses no zero page: the pointers are the operands of
+ * the loads and stores in get, put and cp, which are set by the host
+ * before the upload (see unpack_code_patch[]).
+ */
+static const unsigned char unpack_code[UNPACK_DATA] =
+{
+    0x20, 0x38, 0x00,       /* 00 loop:  jsr get     */
+    0xaa,                   /* 03        tax         */
+    0xf0, 0x31,             /* 04        beq done    */
+    0x30, 0x0b,             /* 06        bmi match   */
+    0x20, 0x38, 0x00,       /* 08 lit:   jsr get     */
+    0x20, 0x44, 0x00,       /* 0b        jsr put     */
+    0xca,                   /* 0e        dex         */
+    0xd0, 0xf7,             /* 0f        bne lit     */
+    0xf0, 0xed,             /* 11        beq loop    */
+    0x29, 0x7f,             /* 13 match: and #$7f    */
+    0xaa,                   /* 15        tax         */
+    0xe8,                   /* 16        inx         */
+    0xe8,                   /* 17        inx         */
+    0x20, 0x38, 0x00,       /* 18        jsr get     */
+    0x49, 0xff,             /* 1b        eor #$ff    */
+    0x18,                   /* 1d        clc         */
+    0x6d, 0x45, 0x00,       /* 1e        adc put+1   */
+    0x8d, 0x51, 0x00,       /* 21        sta cp+1    */
+    0xad, 0x46, 0x00,       /* 24        lda put+2   */
+    0x69, 0xff,             /* 27        adc #$ff    */
+    0x8d, 0x52, 0x00,       /* 29        sta cp+2    */
+    0x20, 0x50, 0x00,       /* 2c copy:  jsr cp      */
+    0x20, 0x44, 0x00,       /* 2f        jsr put     */
+    0xca,                   /* 32        dex         */
+    0xd0, 0xf7,             /* 33        bne copy    */
+    0xf0, 0xc9,             /* 35        beq loop    */
+    0x60,                   /* 37 done:  rts         */
+    0xad, 0x00, 0x00,       /* 38 get:   lda data    */
+    0xee, 0x39, 0x00,       /* 3b        inc get+1   */
+    0xd0, 0x03,             /* 3e        bne +       */
+    0xee, 0x3a, 0x00,       /* 40        inc get+2   */
+    0x60,                   /* 43 +      rts         */
+    0x8d, 0x00, 0x00,       /* 44 put:   sta target  */
+    0xee, 0x45, 0x00,       /* 47        inc put+1   */
+    0xd0, 0x03,             /* 4a        bne +       */
+    0xee, 0x46, 0x00,       /* 4c        inc put+2   */
+    0x60,                   /* 4f +      rts         */
+    0xad, 0x00, 0x00,       /* 50 cp:    lda from    */
+    0xee, 0x51, 0x00,       /* 53        inc cp+1    */
+    0xd0, 0x03,             /* 56        bne +       */
+    0xee, 0x52, 0x00,       /* 58        inc cp+2    */
+    0x60                    /* 5b +      rts         */
+};
+
+/*! The absolute operands of unpack_code[] which point into the unpacker itself */
+static const unsigned char unpack_code_patch[] =
+{
+    0x01, 0x09, 0x0c, 0x19, 0x1f, 0x22, 0x25, 0x2a, 0x2d, 0x30,
+    0x3c, 0x41, 0x48, 0x4d, 0x54, 0x59
+};
+
+/*! The operands of get and put: the packed stream and the target */
+#define UNPACK_GET_OPERAND 0x39
+#define UNPACK_PUT_OPERAND 0x45
+
+/*! \internal \brief Pack a program; returns the size of the packed stream
+
+ Packed is filled with at most MaxPacked bytes. If the packed stream
+ would be longer, MaxPacked + 1 is returned.
+*/
+static size_t
+upload_pack(const unsigned char *Program, size_t Size,
+            unsigned char *Packed, size_t MaxPacked)
+{
+    size_t in = 0, out = 0;
+    size_t literal = 0;     /* the position of the count of the current literal run */
+    size_t literals = 0;    /* the bytes in the current literal run */
+
+    while (in < Size) {
+        size_t best = 0, best_dist = 0;
+        size_t dist;
+
+        for (dist = 1; dist <= PACK_MAX_DIST && dist <= in; dist++) {
+            size_t len = 0;
+
+            while (len < PACK_MAX_MATCH && in + len < Size
+                   && Program[in + len] == Program[in + len - dist]) {
+                len++;
+            }
+            if (len > best) {
+                best = len;
+                best_dist = dist;
+            }
+        }
+
+        if (best >= PACK_MIN_MATCH) {
+            if (out + 2 > MaxPacked) {
+                return MaxPacked + 1;
+            }
+            Packed[out++] = (unsigned char) (0x80 | (best - 2));
+            Packed[out++] = (unsigned char) (best_dist - 1);
+            in += best;
+            literals = 0;
+        }
+        else {
+            if (literals == 0 || literals == PACK_MAX_LITERAL) {
+                if (out + 1 > MaxPacked) {
+                    return MaxPacked + 1;
+                }
+                literal = out++;
+                literals = 0;
+            }
+            if (out + 1 > MaxPacked) {
+                return MaxPacked + 1;
+            }
+            Packed[out++] = Program[in++];
+            Packed[literal] = (unsigned char) ++literals;
+        }
+    }
+
+    if (out + 1 > MaxPacked) {
+        return MaxPacked + 1;
+    }
+    Packed[out++] = 0;
+
+    return out;
+}
+
+/*! \brief Upload a program packed, and unpack it in the drive
+
+ This function works like cbm_upload_resident(), but a program
+ which has to be uploaded is packed first. The packed program and
+ a routine to unpack it are written into the work area of the
+ drive with "M-W" commands, then, the routine is started with
+ "M-E" and writes the program to its place.
+
+ As M-W transfers very few bytes per command, this saves time
+ whenever the program packs well. If it does not save any bytes,
+ or if it does not fit into the work area, the program is
+ uploaded as it is.
+
+ \param HandleDevice
+   A CBM_FILE which contains the file handle of the driver.
+
+ \param DeviceAddress
+   The address of the device on the IEC serial bus. This
+   is known as primary address, too.
+
+ \param DriveMemAddress
+   The address in the drive's memory where the program is to be
+   stored.
+
+ \param Program
+   Pointer to a byte buffer which holds the program in the
+   caller's address space.
+
+ \param Size
+   The size of the program to be stored, in bytes.
+
+ \param WorkMemAddress
+   The address of drive memory which may be overwritten, e.g.
+   an unused buffer. It must not overlap the program.
+
+ \param WorkSize
+   The size of the work area, in bytes.
+
+ \return
+   Returns the number of bytes in program memory, that is,
+   Size if the program is there now. If it does not equal
+   Size, than an error occurred.
+   Specifically, -1 is returned on transfer errors.
+
+ If cbm_driver_open() did not succeed, it is illegal to
+ call this function.
+*/
+
+int CBMAPIDECL
+cbm_upload_packed(CBM_FILE HandleDevice, unsigned char DeviceAddress,
+                  int DriveMemAddress, const void *Program, size_t Size,
+                  int WorkMemAddress, size_t WorkSize)
+{
+    unsigned char exec_cmd[UNPACK_EXEC_COST];
+    unsigned char *work;
+    unsigned long hash;
+    size_t packed, max_packed;
+    unsigned int i;
+    int rv;
+
+    FUNC_ENTER();
+
+    hash = upload_hash(Program, Size);
+
+    if (WorkSize <= UNPACK_DATA
+        || (WorkMemAddress < DriveMemAddress + (int) Size
+            && DriveMemAddress < WorkMemAddress + (int) WorkSize)
+        || upload_cache_find(HandleDevice, DeviceAddress, DriveMemAddress, Size, hash) != NULL) {
+        /* nothing to pack into, or possibly not needed at all */
+        rv = cbm_upload_resident(HandleDevice, DeviceAddress, DriveMemAddress, Program, Size);
+        FUNC_LEAVE_INT(rv);
+    }
+
+    /* the packed program must save more than the unpacker and M-E cost */
+    max_packed = WorkSize - UNPACK_DATA;
+    if (Size < UNPACK_DATA + UNPACK_EXEC_COST) {
+        max_packed = 0;
+    }
+    else if (max_packed > Size - UNPACK_DATA - UNPACK_EXEC_COST) {
+        max_packed = Size - UNPACK_DATA - UNPACK_EXEC_COST;
+    }
+
+    work = malloc(UNPACK_DATA + max_packed + 1);
+    packed = work == NULL || max_packed == 0 ? max_packed + 1
+           : upload_pack(Program, Size, work + UNPACK_DATA, max_packed);
+
+    if (packed > max_packed) {
+        DBG_PRINT((DBG_PREFIX "program for $%04x does not pack, uploading it as it is", DriveMemAddress));
+        free(work);
+        rv = cbm_upload_resident(HandleDevice, DeviceAddress, DriveMemAddress, Program, Size);
+        FUNC_LEAVE_INT(rv);
+    }
+
+    memcpy(work, unpack_code, UNPACK_DATA);
+    for (i = 0; i < sizeof(unpack_code_patch); i++) {
+        int adr = WorkMemAddress + work[unpack_code_patch[i]];
+
+        work[unpack_code_patch[i]]     = (unsigned char) (adr & 0xFF);
+        work[unpack_code_patch[i] + 1] = (unsigned char) (adr >> 8);
+    }
+    work[UNPACK_GET_OPERAND]     = (unsigned char) ((WorkMemAddress + UNPACK_DATA) & 0xFF);
+    work[UNPACK_GET_OPERAND + 1] = (unsigned char) ((WorkMemAddress + UNPACK_DATA) >> 8);
+    work[UNPACK_PUT_OPERAND]     = (unsigned char) (DriveMemAddress & 0xFF);
+    work[UNPACK_PUT_OPERAND + 1] = (unsigned char) (DriveMemAddress >> 8);
+
+    DBG_PRINT((DBG_PREFIX "uploading %u bytes for $%04x packed to %u bytes",
+        (unsigned int) Size, DriveMemAddress, (unsigned int) packed));
+
+    rv = cbm_upload(HandleDevice, DeviceAddress, WorkMemAddress, work, UNPACK_DATA + packed);
+    free(work);
+
+    if (rv == (int) (UNPACK_DATA + packed)) {
+        exec_cmd[0] = 'M';
+        exec_cmd[1] = '-';
+        exec_cmd[2] = 'E';
+        exec_cmd[3] = (unsigned char) (WorkMemAddress & 0xFF);
+        exec_cmd[4] = (unsigned char) (WorkMemAddress >> 8);
+
+        upload_cache_forget(HandleDevice, DeviceAddress, DriveMemAddress, Size);
+        rv = cbm_exec_command(HandleDevice, DeviceAddress, exec_cmd, sizeof(exec_cmd)) == 0
+            ? (int) Size : -1;
+    }
+    else {
+        rv = -1;
+    }
+
+    if (rv == (int) Size) {
+        upload_cache_store(HandleDevice, DeviceAddress, DriveMemAddress, Size, hash);
+    }
+
+    FUNC_LEAVE_INT(rv);
+}
+
 /*! \brief Download data from a floppy's drive memory.
 
  This function reads data from the drive's memory via
@@ -61,6 +61,39 @@ transfers[] =
     { NULL, NULL, NULL }
 };
 
+/*
+ * sector interleave for writing with each transfer mode. The drive only
+ * gets the next block after it has written the previous one, thus, the
+ * interleave has to cover the time needed for the transfer of a block.
+ * 0 leaves the interleave of the DOS as it is.
+ */
+static const int write_interleave[] = { 6, 6, 12, 4, 0 };
+
+/* where the 1541 and 1571 DOS keep the interleave for the next block of a file */
+#define DOS_INTERLEAVE 0x69
+
+/*
+ * a session keeps what only has to be done once when more than one
+ * file is transferred to or from the same drive: the drive type is
+ * identified, a 1570/1571 is switched to 1571 mode, and the turbo is
+ * uploaded for the first file only. For the following files, the drive
+ * code is only checked to be still resident (see cbm_upload_resident()).
+ */
+struct cbmcopy_session_s
+{
+    CBM_FILE fd;
+    unsigned char drive;
+    cbmcopy_settings *settings;
+    cbmcopy_message_cb msg_cb;
+    int drive_mode_set;     /* != 0: 1570/1571 already switched to 1571 mode */
+    int interleave_set;     /* != 0: the DOS interleave has been changed */
+    unsigned char old_interleave;
+    int files;              /* files transferred successfully */
+    int blocks;             /* blocks transferred in this session */
+    unsigned char *dir;     /* the directory as last read, NULL if not known */
+    size_t dir_size;
+};
+
 static int check_drive_type(CBM_FILE fd, unsigned char drive,
                             cbmcopy_settings *settings,
                             cbmcopy_message_cb msg_cb)
@@ -82,6 +115,104 @@ static int check_drive_type(CBM_FILE fd, unsigned char drive,
 }
 
 
+static const unsigned char *select_turbo(cbmcopy_session *session, int write,
+                                         int *turbo_size)
+{
+    const unsigned char *turbo;
+
+    switch(session->settings->drive_type)
+    {
+        case cbm_dt_cbm1541:
+            turbo = write ? turbowrite1541 : turboread1541;
+            *turbo_size = write ? sizeof(turbowrite1541) : sizeof(turboread1541);
+            break;
+        case cbm_dt_cbm1570:
+        case cbm_dt_cbm1571:
+            if(!session->drive_mode_set)
+            {
+                cbm_exec_command( session->fd, session->drive, "U0>M1", 0 );
+                session->drive_mode_set = 1;
+            }
+            turbo = write ? turbowrite1571 : turboread1571;
+            *turbo_size = write ? sizeof(turbowrite1571) : sizeof(turboread1571);
+            break;
+        case cbm_dt_cbm1581:
+            turbo = write ? turbowrite1581 : turboread1581;
+            *turbo_size = write ? sizeof(turbowrite1581) : sizeof(turboread1581);
+            break;
+        default: /* unreachable */
+            session->msg_cb( sev_warning, "*** unknown drive type" );
+            /* fall through */
+        case cbm_dt_cbm4040:
+        case cbm_dt_cbm8050:
+        case cbm_dt_cbm8250:
+        case cbm_dt_sfd1001:
+        case cbm_dt_sd2iec:
+            turbo = NULL;
+            *turbo_size = 0;
+            break;
+    }
+
+    if(transfers[session->settings->transfer_mode].abbrev[0] == 'o')
+    {
+        /* if "original" transfer mode - no drive code can be used */
+        turbo = NULL;
+        *turbo_size = 0;
+    }
+    return turbo;
+}
+
+/*
+ * let the DOS place the blocks of the file with the interleave which
+ * suits the transfer. Only the 1541 and 1571 DOS have it in a place
+ * known here; it is restored when the session ends.
+ */
+static void set_write_interleave(cbmcopy_session *session)
+{
+    unsigned char interleave;
+    int value;
+
+    if(session->interleave_set)
+    {
+        return;
+    }
+
+    switch(session->settings->drive_type)
+    {
+        case cbm_dt_cbm1541:
+        case cbm_dt_cbm1570:
+        case cbm_dt_cbm1571:
+            break;
+        default:
+            return;
+    }
+
+    value = session->settings->interleave;
+    if(value < 0)
+    {
+        value = write_interleave[session->settings->transfer_mode];
+    }
+    if(value == 0)
+    {
+        return;
+    }
+
+    if(cbm_download(session->fd, session->drive, DOS_INTERLEAVE,
+                    &session->old_interleave, 1) != 1)
+    {
+        return;
+    }
+
+    interleave = (unsigned char) value;
+    if(cbm_upload(session->fd, session->drive, DOS_INTERLEAVE,
+                  &interleave, 1) == 1)
+    {
+        session->msg_cb( sev_debug, "write interleave %d (was %d)",
+                         value, session->old_interleave );
+        session->interleave_set = 1;
+    }
+}
+
 static int send_turbo(CBM_FILE fd, unsigned char drive, int write,
                       const cbmcopy_settings *settings,
                       const unsigned char *turbo, size_t turbo_size,
@@ -99,7 +230,7 @@ static int send_turbo(CBM_FILE fd, unsigned char drive, int write,
     {
         if(turbo_size)
         {
-            cbm_upload( fd, drive, 0x500, turbo, turbo_size );
+            cbm_upload_resident( fd, drive, 0x500, turbo, turbo_size );
             msg_cb( sev_debug, "uploading %d bytes turbo code", turbo_size );
             if(trf->upload_turbo(fd, drive, settings->drive_type, write) == 0)
             {
@@ -133,72 +264,31 @@ static int send_turbo(CBM_FILE fd, unsigned char drive, int write,
 }
 
 
-static int cbmcopy_read(CBM_FILE fd,
-                        cbmcopy_settings *settings,
-                        unsigned char drive,
+static int session_read(cbmcopy_session *session,
                         int track, int sector,
                         const char *cbmname,
                         int cbmname_len,
-                        unsigned char **filedata,
-                        size_t *filedata_size,
-                        cbmcopy_message_cb msg_cb,
+                        cbmcopy_data_cb data_cb,
+                        void *context,
                         cbmcopy_status_cb status_cb)
 {
+    CBM_FILE fd = session->fd;
+    unsigned char drive = session->drive;
+    cbmcopy_settings *settings = session->settings;
+    cbmcopy_message_cb msg_cb = session->msg_cb;
     int rv;
     int i;
     int turbo_size;
     int error;
+    int rejected;
     unsigned char buf[48];
+    unsigned char block[254];
     const unsigned char *turbo;
     const transfer_funcs *trf;
     int blocks_read;
 
-    *filedata = NULL;
-    *filedata_size = 0;
-
-    msg_cb( sev_debug, "using transfer mode '%s'",
-            transfers[settings->transfer_mode].name);
     trf = transfers[settings->transfer_mode].trf;
-
-    if(check_drive_type( fd, drive, settings, msg_cb ))
-    {
-        return -1;
-    }
-
-    switch(settings->drive_type)
-    {
-        case cbm_dt_cbm1541:
-            turbo = turboread1541;
-            turbo_size = sizeof(turboread1541);
-            break;
-        case cbm_dt_cbm1570:
-        case cbm_dt_cbm1571:
-            cbm_exec_command( fd, drive, "U0>M1", 0 );
-            turbo = turboread1571;
-            turbo_size = sizeof(turboread1571);
-            break;
-        case cbm_dt_cbm1581:
-            turbo = turboread1581;
-            turbo_size = sizeof(turboread1581);
-            break;
-        default: /* unreachable */
-            msg_cb( sev_warning, "*** unknown drive type" );
-            /* fall through */
-        case cbm_dt_cbm4040:
-        case cbm_dt_cbm8050:
-        case cbm_dt_cbm8250:
-        case cbm_dt_sfd1001:
-            turbo = NULL;
-            turbo_size = 0;
-            break;
-    }
-
-    if(transfers[settings->transfer_mode].abbrev[0] == 'o')
-    {
-        /* if "original" transfer mode - no drive code can be used */
-        turbo = NULL;
-        turbo_size = 0;
-    }
+    turbo = select_turbo( session, 0, &turbo_size );
 
     if(cbmname)
     {
@@ -225,6 +315,7 @@ static int cbmcopy_read(CBM_FILE fd,
 
     blocks_read = 0;
     error = 0;
+    rejected = 0;
 
     if(track)
     {
@@ -258,64 +349,53 @@ static int cbmcopy_read(CBM_FILE fd,
 
             SETSTATEDEBUG(DebugBlockCount++);    // preset condition
 
-            /* @SRT: FIXME! the next statement is dangerous: If there
-             * is no memory block large enough for reallocating, the
-             * memory block is not freed, but realloc() returns NULL,
-             * thus, we have a memory leak.
-             */
-             /* reserve additional memory to hold to up an additional full block */
-            *filedata = realloc(*filedata, *filedata_size + 254);
-            SETSTATEDEBUG((void)0);    // after check_error condition
-            if(*filedata)
-            {
-                /* read block, let the block reader also handle the initial length byte */
-                i = trf->read_blk( fd, (*filedata) + blocks_read * 254, 254, msg_cb);
-                msg_cb( sev_debug, "number of bytes read for block %d: %d", blocks_read, i );
+            /* read block, let the block reader also handle the initial length byte */
+            i = trf->read_blk( fd, block, sizeof(block), msg_cb);
+            msg_cb( sev_debug, "number of bytes read for block %d: %d", blocks_read, i );
 
-                SETSTATEDEBUG((void)0);    // afterread condition
+            SETSTATEDEBUG((void)0);    // afterread condition
 
-                /*
-                 * FIXME: Find and eliminate the real protocol races to
-                 *        eliminate the rare hangups with the 1581 based
-                 *        turbo routines (bugs suspected in 6502 code)
-                 *
-                 * Hotfix proposion for the 1581 protocols:
-                 *    add a little delay at the end of the loop
-                 *       "hmmmm, if we know that the drive is busy
-                 *        now, shouldn't we wait for it then?"
-                 *    add a little delay after the turbo start
-                 */
-                arch_sleep_ms(1);
+            /*
+             * FIXME: Find and eliminate the real protocol races to
+             *        eliminate the rare hangups with the 1581 based
+             *        turbo routines (bugs suspected in 6502 code)
+             *
+             * Hotfix proposion for the 1581 protocols:
+             *    add a little delay at the end of the loop
+             *       "hmmmm, if we know that the drive is busy
+             *        now, shouldn't we wait for it then?"
+             *    add a little delay after the turbo start
+             */
+            arch_sleep_ms(1);
 
-                if( i < 255)
-                {
-                    if( i >= 0 )
-                    {
-                        /* in case of original transfers, there is no extra length byte transfer,    */
-                        /* whenever 254 bytes are read from a block a count value of 255 is returned */
-                        /* and if this was the last block, 0 bytes are read with the next block call */
-                        *filedata_size += i;
-                    }
-                    else
-                    {
-                        rv = -1;
-                    }
-                    break;
-                }
-                else
-                {
-                    /* more blocks are following, a full block was transferred */
-                    *filedata_size += 254;
-                }
+            if( i < 0 )
+            {
+                rv = -1;
+                break;
+            }
 
-                SETSTATEDEBUG((void)0);    // afterread condition
-                status_cb( ++blocks_read );
+            /*
+             * in case of original transfers, there is no extra length byte transfer,
+             * whenever 254 bytes are read from a block a count value of 255 is returned
+             * and if this was the last block, 0 bytes are read with the next block call.
+             * If the receiver does not take the data, the rest of the file is still
+             * read (and dropped), as the drive cannot be stopped in the middle.
+             */
+            if( i > 0 && !rejected &&
+                data_cb( context, block, i < 255 ? i : 254 ) != 0 )
+            {
+                msg_cb( sev_warning, "file data could not be stored" );
+                rejected = 1;
             }
-            else
+
+            if( i < 255 )
             {
-                SETSTATEDEBUG((void)0);    // afterread condition
-                /* FIXME */
+                break;
             }
+
+            /* more blocks are following, a full block was transferred */
+            SETSTATEDEBUG((void)0);    // afterread condition
+            status_cb( ++blocks_read );
         }
         msg_cb( sev_debug, "done" );
         SETSTATEDEBUG(DebugBlockCount=-1);   // turbo sent condition
@@ -340,9 +420,19 @@ static int cbmcopy_read(CBM_FILE fd,
         {
             msg_cb( sev_warning, "file copy ended with error status: %s", buf );
         }
+        else if(rejected)
+        {
+            rv = -1;
+        }
     }
 
     cbm_close( fd, drive, SA_READ );
+
+    session->blocks += blocks_read;
+    if(rv == 0)
+    {
+        session->files++;
+    }
     return rv;
 }
 
@@ -429,22 +519,8 @@ int cbmcopy_check_auto_transfer_mode(CBM_FILE cbm_fd, int auto_transfermode, int
         unsigned char testdrive;
 
         /*
-         * Test the cable
-         */
-
-        if (cbm_identify_xp1541(cbm_fd, (unsigned char)drive, NULL, &cable_type) == 0)
-        {
-            if (cable_type == cbm_ct_xp1541)
-            {
-                /*
-                 * We have a parallel cable, use that
-                 */
-                return cbmcopy_get_transfer_mode_index("parallel");
-            }
-        }
-
-        /*
-         * lookup drivetyp, if IEEE-488 drive, use original
+         * lookup drivetyp, if IEEE-488 drive or SD2IEC, use original.
+         * This comes first, as these do not run the cable test either.
          */
 
         if (cbm_identify(cbm_fd, (unsigned char)drive, &device_type, NULL) == 0)
@@ -455,8 +531,10 @@ int cbmcopy_check_auto_transfer_mode(CBM_FILE cbm_fd, int auto_transfermode, int
                 case cbm_dt_cbm8050:
                 case cbm_dt_cbm8250:
                 case cbm_dt_sfd1001:
+                case cbm_dt_sd2iec:
                     /*
-                     * We are using an IEEE-488 drive, use original transfer mode
+                     * We are using an IEEE-488 drive or one without drive
+                     * code, use original transfer mode
                      */
                     return cbmcopy_get_transfer_mode_index("original");
 
@@ -468,6 +546,21 @@ int cbmcopy_check_auto_transfer_mode(CBM_FILE cbm_fd, int auto_transfermode, int
             }
         }
 
+        /*
+         * Test the cable
+         */
+
+        if (cbm_identify_xp1541(cbm_fd, (unsigned char)drive, NULL, &cable_type) == 0)
+        {
+            if (cable_type == cbm_ct_xp1541)
+            {
+                /*
+                 * We have a parallel cable, use that
+                 */
+                return cbmcopy_get_transfer_mode_index("parallel");
+            }
+        }
+
         /*
          * We do not have a parallel cable. Check if we are the only drive
          * on the bus, so we can use serial2, at least.
@@ -508,73 +601,45 @@ cbmcopy_settings *cbmcopy_get_default_settings(void)
     {
         settings->drive_type    = cbm_dt_unknown; /* auto detect later on */
         settings->transfer_mode = 0;
+        settings->interleave    = -1; /* best for the transfer mode */
     }
     return settings;
 }
 
 
 
-int cbmcopy_write_file(CBM_FILE fd,
-                       cbmcopy_settings *settings,
-                       int drivei,
-                       const char *cbmname,
-                       int cbmname_len,
-                       const unsigned char *filedata,
-                       int filedata_size,
-                       cbmcopy_message_cb msg_cb,
-                       cbmcopy_status_cb status_cb)
+int cbmcopy_session_write_file(cbmcopy_session *session,
+                               const char *cbmname,
+                               int cbmname_len,
+                               const unsigned char *filedata,
+                               int filedata_size,
+                               cbmcopy_status_cb status_cb)
 {
+    CBM_FILE fd = session->fd;
+    unsigned char drive = session->drive;
+    cbmcopy_settings *settings = session->settings;
+    cbmcopy_message_cb msg_cb = session->msg_cb;
     int rv;
     int i;
     int turbo_size;
-    unsigned char drive = (unsigned char) drivei; //! \todo Find better solution
     unsigned char buf[48];
     const unsigned char *turbo;
     const transfer_funcs *trf;
     int blocks_written;
 
-    msg_cb( sev_debug, "using transfer mode `%s'",
-            transfers[settings->transfer_mode].name);
     trf = transfers[settings->transfer_mode].trf;
+    turbo = select_turbo( session, 1, &turbo_size );
 
-    if(check_drive_type( fd, drive, settings, msg_cb ))
-    {
-        return -1;
-    }
-
-    switch(settings->drive_type)
+    /* the directory gets a new entry */
+    if(session->dir)
     {
-        case cbm_dt_cbm1541:
-            turbo = turbowrite1541;
-            turbo_size = sizeof(turbowrite1541);
-            break;
-        case cbm_dt_cbm1570:
-        case cbm_dt_cbm1571:
-            cbm_exec_command( fd, drive, "U0>M1", 0 );
-            turbo = turbowrite1571;
-            turbo_size = sizeof(turbowrite1571);
-            break;
-        case cbm_dt_cbm1581:
-            turbo = turbowrite1581;
-            turbo_size = sizeof(turbowrite1581);
-            break;
-        default: /* unreachable */
-            msg_cb( sev_warning, "*** unknown drive type" );
-            /* fall through */
-        case cbm_dt_cbm4040:
-        case cbm_dt_cbm8050:
-        case cbm_dt_cbm8250:
-        case cbm_dt_sfd1001:
-            turbo = NULL;
-            turbo_size = 0;
-            break;
+        free(session->dir);
+        session->dir = NULL;
     }
 
-    if(transfers[settings->transfer_mode].abbrev[0] == 'o')
+    if(turbo)
     {
-        /* if "original" transfer mode - no drive code can be used */
-        turbo = NULL;
-        turbo_size = 0;
+        set_write_interleave( session );
     }
 
     cbm_open( fd, drive, SA_WRITE, NULL, 0 );
@@ -666,6 +731,411 @@ int cbmcopy_write_file(CBM_FILE fd,
         }
     }
     cbm_close( fd, drive, SA_WRITE );
+
+    session->blocks += blocks_written;
+    if(rv == 0)
+    {
+        session->files++;
+    }
+    return rv;
+}
+
+
+cbmcopy_session *cbmcopy_session_open(CBM_FILE fd,
+                                      cbmcopy_settings *settings,
+                                      int drive,
+                                      cbmcopy_message_cb msg_cb)
+{
+    cbmcopy_session *session;
+
+    session = calloc(1, sizeof(*session));
+    if(session == NULL)
+    {
+        msg_cb( sev_fatal, "Out of memory" );
+        return NULL;
+    }
+
+    session->fd = fd;
+    session->drive = (unsigned char) drive;
+    session->settings = settings;
+    session->msg_cb = msg_cb;
+
+    msg_cb( sev_debug, "using transfer mode `%s'",
+            transfers[settings->transfer_mode].name);
+
+    check_drive_type( fd, session->drive, settings, msg_cb );
+
+    return session;
+}
+
+
+void cbmcopy_session_close(cbmcopy_session *session)
+{
+    if(session == NULL)
+    {
+        return;
+    }
+    if(session->interleave_set)
+    {
+        cbm_upload( session->fd, session->drive, DOS_INTERLEAVE,
+                    &session->old_interleave, 1 );
+    }
+    if(session->files > 1)
+    {
+        session->msg_cb( sev_info, "%d files, %d blocks transferred",
+                         session->files, session->blocks );
+    }
+    if(session->dir)
+    {
+        free(session->dir);
+    }
+    free(session);
+}
+
+
+/* collects the blocks of a file in one buffer */
+typedef struct
+{
+    unsigned char *data;
+    size_t size;
+} file_buffer;
+
+static int buffer_data(void *context, const unsigned char *data, size_t size)
+{
+    file_buffer *fb = context;
+    unsigned char *grown;
+
+    grown = realloc(fb->data, fb->size + size);
+    if(grown == NULL)
+    {
+        /* fb->data is still valid, and freed by the caller */
+        return -1;
+    }
+    memcpy(grown + fb->size, data, size);
+    fb->data = grown;
+    fb->size += size;
+    return 0;
+}
+
+static int session_read_buffer(cbmcopy_session *session,
+                               int track, int sector,
+                               const char *cbmname,
+                               int cbmname_len,
+                               unsigned char **filedata,
+                               size_t *filedata_size,
+                               cbmcopy_status_cb status_cb)
+{
+    file_buffer fb;
+    int rv;
+
+    fb.data = NULL;
+    fb.size = 0;
+
+    rv = session_read(session, track, sector, cbmname, cbmname_len,
+                      buffer_data, &fb, status_cb);
+
+    *filedata = fb.data;
+    *filedata_size = fb.size;
+    return rv;
+}
+
+
+int cbmcopy_session_read_file(cbmcopy_session *session,
+                              const char *cbmname,
+                              int cbmname_len,
+                              unsigned char **filedata,
+                              size_t *filedata_size,
+                              cbmcopy_status_cb status_cb)
+{
+    return session_read_buffer(session, 0, 0, cbmname, cbmname_len,
+                               filedata, filedata_size, status_cb);
+}
+
+
+int cbmcopy_session_read_file_ts(cbmcopy_session *session,
+                                 int track, int sector,
+                                 unsigned char **filedata,
+                                 size_t *filedata_size,
+                                 cbmcopy_status_cb status_cb)
+{
+    return session_read_buffer(session, track, sector, NULL, 0,
+                               filedata, filedata_size, status_cb);
+}
+
+
+int cbmcopy_session_stream_file(cbmcopy_session *session,
+                                const char *cbmname,
+                                int cbmname_len,
+                                cbmcopy_data_cb data_cb,
+                                void *context,
+                                cbmcopy_status_cb status_cb)
+{
+    return session_read(session, 0, 0, cbmname, cbmname_len,
+                        data_cb, context, status_cb);
+}
+
+
+int cbmcopy_session_stream_file_ts(cbmcopy_session *session,
+                                   int track, int sector,
+                                   cbmcopy_data_cb data_cb,
+                                   void *context,
+                                   cbmcopy_status_cb status_cb)
+{
+    return session_read(session, track, sector, NULL, 0,
+                        data_cb, context, status_cb);
+}
+
+
+static int no_status(int blocks_processed)
+{
+    return 0;
+}
+
+
+/* match a CBM file name against a DOS pattern with '*' and '?' */
+static int name_matches(const unsigned char *name, const char *pattern)
+{
+    const char *colon;
+    int i;
+
+    /* skip a drive number, stop at a file type */
+    colon = strchr(pattern, ':');
+    if(colon)
+    {
+        pattern = colon + 1;
+    }
+
+    for(i = 0; i < 16 && *pattern && *pattern != ','; i++, pattern++)
+    {
+        if(*pattern == '*')
+        {
+            return 1;
+        }
+        if(name[i] == 0xa0 || (*pattern != '?' && *pattern != (char)name[i]))
+        {
+            return 0;
+        }
+    }
+    if(*pattern == '*')
+    {
+        return 1;
+    }
+    return (*pattern == '\0' || *pattern == ',') && (i == 16 || name[i] == 0xa0);
+}
+
+
+/*
+ * read the directory into session->dir, unless it is there already
+ * from an earlier call. Returns != 0 if it could not be read.
+ */
+static int session_read_dir(cbmcopy_session *session)
+{
+    int dir_track;
+    int dir_sector;
+    int files;
+    int blocks;
+    int rv;
+
+    if(session->dir)
+    {
+        return 0;
+    }
+
+    if(transfers[session->settings->transfer_mode].abbrev[0] == 'o')
+    {
+        /* reading by track/sector needs the turbo */
+        return -1;
+    }
+
+    switch(session->settings->drive_type)
+    {
+        case cbm_dt_cbm1541:
+        case cbm_dt_cbm1570:
+        case cbm_dt_cbm1571:
+            dir_track = 18;
+            dir_sector = 1;
+            break;
+        case cbm_dt_cbm1581:
+            dir_track = 40;
+            dir_sector = 3;
+            break;
+        default:
+            return -1;
+    }
+
+    session->msg_cb( sev_debug, "reading directory at %d/%d",
+                     dir_track, dir_sector );
+
+    /* the directory does not count as a transferred file */
+    files = session->files;
+    blocks = session->blocks;
+    rv = session_read_buffer(session, dir_track, dir_sector, NULL, 0,
+                             &session->dir, &session->dir_size, no_status);
+    session->files = files;
+    session->blocks = blocks;
+
+    if(rv != 0)
+    {
+        if(session->dir)
+        {
+            free(session->dir);
+            session->dir = NULL;
+        }
+        return -1;
+    }
+    return 0;
+}
+
+/*
+ * the link bytes of the blocks are not transferred, thus, the
+ * 32 byte entries (without the link bytes of the first entry of
+ * each block) start at multiples of 254 + 32 * n.
+ */
+#define DIR_NEXT_ENTRY(pos) ((pos) + (((pos) % 254 == 224) ? 30 : 32))
+
+int cbmcopy_session_locate_files(cbmcopy_session *session,
+                                 int count,
+                                 const char * const *cbmnames,
+                                 int *track, int *sector)
+{
+    const unsigned char *dir;
+    size_t pos;
+    int found;
+    int i;
+
+    for(i = 0; i < count; i++)
+    {
+        track[i] = sector[i] = 0;
+    }
+
+    if(session_read_dir(session) != 0)
+    {
+        return -1;
+    }
+    dir = session->dir;
+
+    found = 0;
+    for(pos = 0; pos + 19 <= session->dir_size; pos = DIR_NEXT_ENTRY(pos))
+    {
+        if(dir[pos] == 0)
+        {
+            /* deleted or unused entry */
+            continue;
+        }
+        for(i = 0; i < count; i++)
+        {
+            if(track[i] == 0 && name_matches(&dir[pos + 3], cbmnames[i]))
+            {
+                track[i] = dir[pos + 1];
+                sector[i] = dir[pos + 2];
+                found++;
+            }
+        }
+    }
+    session->msg_cb( sev_debug, "%d of %d files found in the directory",
+                     found, count );
+
+    return 0;
+}
+
+
+int cbmcopy_session_compare_file(cbmcopy_session *session,
+                                 const char *cbmname,
+                                 const unsigned char *filedata,
+                                 int filedata_size)
+{
+    static const char types[] = "DSPUR";
+    const unsigned char *dir;
+    const char *type;
+    unsigned char *data;
+    size_t data_size;
+    size_t pos;
+    int blocks;
+    int files;
+    int rv;
+
+    if(session_read_dir(session) != 0)
+    {
+        return -1;
+    }
+    dir = session->dir;
+
+    for(pos = 0; pos + 30 <= session->dir_size; pos = DIR_NEXT_ENTRY(pos))
+    {
+        /* only closed files */
+        if((dir[pos] & 0x80) && name_matches(&dir[pos + 3], cbmname))
+        {
+            break;
+        }
+    }
+    if(pos + 30 > session->dir_size)
+    {
+        return 2;
+    }
+
+    /* the file type, if there is one in cbmname */
+    type = strchr(cbmname, ',');
+    if(type && type[1] && type[1] != 'W' &&
+       (dir[pos] & 0x07) < sizeof(types) - 1 &&
+       types[dir[pos] & 0x07] != type[1])
+    {
+        return 1;
+    }
+
+    /* a file of another size needs not be read at all */
+    blocks = filedata_size > 0 ? (filedata_size + 253) / 254 : 1;
+    if(dir[pos + 28] + 256 * dir[pos + 29] != blocks)
+    {
+        return 1;
+    }
+
+    /* comparing does not count as a transferred file */
+    files = session->files;
+    blocks = session->blocks;
+    rv = session_read_buffer(session, dir[pos + 1], dir[pos + 2], NULL, 0,
+                             &data, &data_size, no_status);
+    session->files = files;
+    session->blocks = blocks;
+
+    if(rv == 0)
+    {
+        rv = data_size != (size_t) filedata_size ||
+             memcmp(data, filedata, data_size) != 0;
+    }
+    else
+    {
+        rv = -1;
+    }
+    if(data)
+    {
+        free(data);
+    }
+    return rv;
+}
+
+
+/* just a wrapper */
+int cbmcopy_write_file(CBM_FILE fd,
+                       cbmcopy_settings *settings,
+                       int drive,
+                       const char *cbmname,
+                       int cbmname_len,
+                       const unsigned char *filedata,
+                       int filedata_size,
+                       cbmcopy_message_cb msg_cb,
+                       cbmcopy_status_cb status_cb)
+{
+    cbmcopy_session *session;
+    int rv;
+
+    session = cbmcopy_session_open(fd, settings, drive, msg_cb);
+    if(session == NULL)
+    {
+        return -1;
+    }
+    rv = cbmcopy_session_write_file(session, cbmname, cbmname_len,
+                                    filedata, filedata_size, status_cb);
+    cbmcopy_session_close(session);
     return rv;
 }
 
@@ -680,11 +1150,18 @@ int cbmcopy_read_file_ts(CBM_FILE fd,
                          cbmcopy_message_cb msg_cb,
                          cbmcopy_status_cb status_cb)
 {
-    return cbmcopy_read(fd, settings, (unsigned char) drive,
-                        track, sector,
-                        NULL, 0,
-                        filedata, filedata_size,
-                        msg_cb, status_cb);
+    cbmcopy_session *session;
+    int rv;
+
+    session = cbmcopy_session_open(fd, settings, drive, msg_cb);
+    if(session == NULL)
+    {
+        return -1;
+    }
+    rv = cbmcopy_session_read_file_ts(session, track, sector,
+                                      filedata, filedata_size, status_cb);
+    cbmcopy_session_close(session);
+    return rv;
 }
 
 
@@ -699,11 +1176,18 @@ int cbmcopy_read_file(CBM_FILE fd,
                       cbmcopy_message_cb msg_cb,
                       cbmcopy_status_cb status_cb)
 {
-    return cbmcopy_read(fd, settings, (unsigned char) drive,
-                        0, 0,
-                        cbmname, cbmname_len,
-                        filedata, filedata_size,
-                        msg_cb, status_cb);
+    cbmcopy_session *session;
+    int rv;
+
+    session = cbmcopy_session_open(fd, settings, drive, msg_cb);
+    if(session == NULL)
+    {
+        return -1;
+    }
+    rv = cbmcopy_session_read_file(session, cbmname, cbmname_len,
+                                   filedata, filedata_size, status_cb);
+    cbmcopy_session_close(session);
+    return rv;
 }
 
 /*! \brief write a data block of a file with a sequence of byte transfers
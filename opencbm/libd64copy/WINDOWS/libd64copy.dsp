@@ -85,18 +85,66 @@ LIB32=link.exe -lib
 # PROP Default_Filter "cpp;c;cxx;rc;def;r;odl;idl;hpj;bat"
 # Begin Source File
 
+SOURCE=..\adaptive.c
+# End Source File
+# Begin Source File
+
+SOURCE=..\batch.c
+# End Source File
+# Begin Source File
+
+SOURCE=..\container.c
+# End Source File
+# Begin Source File
+
+SOURCE=..\convert.c
+# End Source File
+# Begin Source File
+
+SOURCE=..\d2d.c
+# End Source File
+# Begin Source File
+
 SOURCE=..\d64copy.c
 # End Source File
 # Begin Source File
 
+SOURCE=..\ddi.c
+# End Source File
+# Begin Source File
+
+SOURCE=..\digest.c
+# End Source File
+# Begin Source File
+
+SOURCE=..\diskchange.c
+# End Source File
+# Begin Source File
+
+SOURCE=..\extract.c
+# End Source File
+# Begin Source File
+
+SOURCE=..\fanout.c
+# End Source File
+# Begin Source File
+
 SOURCE=..\fs.c
 # End Source File
 # Begin Source File
 
+SOURCE=..\g64.c
+# End Source File
+# Begin Source File
+
 SOURCE=..\gcr.c
 # End Source File
 # Begin Source File
 
+SOURCE=..\p2.c
+# End Source File
+# Begin Source File
+
 SOURCE=..\pp.c
 # End Source File
 # Begin Source File
@@ -111,6 +159,10 @@ SOURCE=..\s2.c
 
 SOURCE=..\std.c
 # End Source File
+# Begin Source File
+
+SOURCE=..\update.c
+# End Source File
 # End Group
 # Begin Group "Header Files"
 
@@ -133,6 +185,68 @@ SOURCE=..\gcr.h
 # PROP Default_Filter "a65"
 # Begin Source File
 
+SOURCE=..\p21541.a65
+
+!IF  "$(CFG)" == "libd64copy - Win32 Release"
+
+# Begin Custom Build
+InputDir=\cygwin\home\tri\cbm\opencbm\libd64copy
+InputPath=..\p21541.a65
+InputName=p21541
+
+"$(InputDir)\$(InputName).inc" : $(SOURCE) "$(INTDIR)" "$(OUTDIR)"
+	..\..\WINDOWS\buildoneinc ..\.. $(InputPath)
+
+# End Custom Build
+
+!ELSEIF  "$(CFG)" == "libd64copy - Win32 Debug"
+
+# Begin Custom Build
+InputDir=\cygwin\home\tri\cbm\opencbm\libd64copy
+InputPath=..\p21541.a65
+InputName=p21541
+
+"$(InputDir)\$(InputName).inc" : $(SOURCE) "$(INTDIR)" "$(OUTDIR)"
+	..\..\WINDOWS\buildoneinc ..\.. $(InputPath)
+
+# End Custom Build
+
+!ENDIF 
+
+# End Source File
+# Begin Source File
+
+SOURCE=..\p21571.a65
+
+!IF  "$(CFG)" == "libd64copy - Win32 Release"
+
+# Begin Custom Build
+InputDir=\cygwin\home\tri\cbm\opencbm\libd64copy
+InputPath=..\p21571.a65
+InputName=p21571
+
+"$(InputDir)\$(InputName).inc" : $(SOURCE) "$(INTDIR)" "$(OUTDIR)"
+	..\..\WINDOWS\buildoneinc ..\.. $(InputPath)
+
+# End Custom Build
+
+!ELSEIF  "$(CFG)" == "libd64copy - Win32 Debug"
+
+# Begin Custom Build
+InputDir=\cygwin\home\tri\cbm\opencbm\libd64copy
+InputPath=..\p21571.a65
+InputName=p21571
+
+"$(InputDir)\$(InputName).inc" : $(SOURCE) "$(INTDIR)" "$(OUTDIR)"
+	..\..\WINDOWS\buildoneinc ..\.. $(InputPath)
+
+# End Custom Build
+
+!ENDIF 
+
+# End Source File
+# Begin Source File
+
 SOURCE=..\pp1541.a65
 
 !IF  "$(CFG)" == "libd64copy - Win32 Release"
@@ -0,0 +1,166 @@
+/*
+ *  This program is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU General Public License
+ *  as published by the Free Software Foundation; either version
+ *  2 of the License, or (at your option) any later version.
+ *
+*/
+
+/*
+ * Adaptive copy parameters: the retry count and the interleave are
+ * adjusted while copying, from what the tracks copied so far tell.
+ *
+ * Retries: a retry pass which recovers at least one sector is not
+ * counted against the retry count (up to ADAPTIVE_MAX_EXTRA passes per
+ * track). If many sectors failed and not a single one was ever recovered
+ * by retrying, further retries are given up for the rest of the disk.
+ *
+ * Interleave: the time per block of the first pass over each track is
+ * measured. Starting with the default, the interleave is changed by one
+ * for the next track as long as this gets faster, first upwards, then
+ * downwards. The search starts again in every speed zone, as the number
+ * of sectors changes there.
+ */
+
+#include "d64copy_int.h"
+
+#include <string.h>
+
+/* additional retry passes per track, if a retry pass has been successful */
+#define ADAPTIVE_MAX_EXTRA 4
+
+/* failed sectors without any recovery after which retries are given up */
+#define ADAPTIVE_HOPELESS 16
+
+/* a change of the interleave must be this much faster to be kept */
+#define ADAPTIVE_GAIN 0.97
+
+void d64copy_adaptive_init(d64copy_adaptive *a, const d64copy_settings *settings,
+                           int tune_interleave)
+{
+    memset(a, 0, sizeof(*a));
+
+    a->enabled = settings->adaptive;
+    a->interleave = settings->interleave;
+    a->tune_interleave = a->enabled && tune_interleave && a->interleave > 0;
+    a->best_interleave = a->interleave;
+    a->step = 1;
+}
+
+int d64copy_adaptive_retries(d64copy_adaptive *a, int retries,
+                             d64copy_message_cb message_cb)
+{
+    if(a->enabled && retries > 0 &&
+       a->failed >= ADAPTIVE_HOPELESS && a->recovered == 0)
+    {
+        if(!a->hopeless)
+        {
+            message_cb(2, "adaptive: retries do not help, giving them up");
+            a->hopeless = 1;
+        }
+        return 0;
+    }
+    return retries;
+}
+
+int d64copy_adaptive_retry_done(d64copy_adaptive *a, int errors_before,
+                                int errors_after)
+{
+    int recovered = errors_before - errors_after;
+
+    if(recovered > 0)
+    {
+        a->recovered += recovered;
+    }
+    if(!a->enabled || recovered <= 0 || a->extra >= ADAPTIVE_MAX_EXTRA)
+    {
+        return 1;
+    }
+    /* this pass has been worth it, try another one for free */
+    a->extra++;
+    return 0;
+}
+
+void d64copy_adaptive_track_start(d64copy_adaptive *a, int sectors)
+{
+    a->extra = 0;
+    a->first_pass = 1;
+    a->blocks = 0;
+
+    if(sectors != a->zone_sectors)
+    {
+        /* new speed zone: the search begins anew from the best so far */
+        a->zone_sectors = sectors;
+        a->interleave = a->best_interleave;
+        a->best_time = 0;
+        a->step = 1;
+        a->settled = 0;
+    }
+
+    if(a->interleave >= sectors)
+    {
+        a->interleave = sectors - 1;
+    }
+
+    a->start = arch_time_us();
+}
+
+void d64copy_adaptive_pass_done(d64copy_adaptive *a, int blocks, int errors)
+{
+    if(a->first_pass)
+    {
+        a->first_pass = 0;
+        a->blocks = blocks;
+        a->elapsed = arch_time_us() - a->start;
+        a->failed += errors;
+    }
+}
+
+void d64copy_adaptive_track_done(d64copy_adaptive *a, d64copy_message_cb message_cb)
+{
+    double per_block;
+    int next;
+
+    if(!a->tune_interleave || a->settled || a->blocks == 0)
+    {
+        return;
+    }
+
+    per_block = a->elapsed / a->blocks;
+
+    if(a->best_time == 0 || per_block < a->best_time * ADAPTIVE_GAIN)
+    {
+        a->best_time = per_block;
+        a->best_interleave = a->interleave;
+    }
+    else if(a->step > 0)
+    {
+        /* going up did not help, try going down from the best one */
+        a->step = -1;
+        a->interleave = a->best_interleave;
+    }
+    else
+    {
+        a->settled = 1;
+        a->interleave = a->best_interleave;
+        message_cb(3, "adaptive: interleave %d (%.0f us per block)",
+                   a->interleave, a->best_time);
+        return;
+    }
+
+    next = a->interleave + a->step;
+    if(next < 1 || next >= a->zone_sectors)
+    {
+        if(a->step > 0 && a->best_interleave > 1)
+        {
+            a->step = -1;
+            next = a->best_interleave - 1;
+        }
+        else
+        {
+            a->settled = 1;
+            next = a->best_interleave;
+        }
+    }
+    a->interleave = next;
+}
@@ -0,0 +1,349 @@
+/*
+ *  This program is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU General Public License
+ *  as published by the Free Software Foundation; either version
+ *  2 of the License, or (at your option) any later version.
+ *
+*/
+
+/*
+ * Reading a pile of disks with several drives, on one adapter or more.
+ * Every drive has a thread of its own, which waits for a disk to be put
+ * into it and reads it. The numbers of the disks, and thus, the names of
+ * the images, are not given to the drives in advance: the drive whose
+ * disk is ready takes the next one. So a faster drive, or one which is
+ * fed more often, reads more disks, and no drive waits for the others.
+ *
+ * The drives on the same adapter share the bus: a drive takes it for a
+ * whole disk, as the turbo owns the bus for that time, but only for the
+ * single looks at the sensor while it waits for the next disk. Thus, the
+ * disk of a drive should not be changed while another drive on the same
+ * bus is reading: the sensor is not looked at then, and the change may
+ * be missed. Drives on adapters of their own do not wait for each other.
+ */
+
+#include "d64copy_int.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef WIN32
+# include <windows.h>
+#else
+# include <pthread.h>
+#endif
+
+/* the drives which share one bus */
+typedef struct
+{
+    CBM_FILE cbm_fd;
+#ifdef WIN32
+    CRITICAL_SECTION lock;
+#else
+    pthread_mutex_t lock;
+#endif
+} batch_bus;
+
+typedef struct batch_s batch;
+
+typedef struct
+{
+    batch *b;
+    batch_bus *bus;
+    int drive;
+    d64copy_settings settings;
+#ifdef WIN32
+    HANDLE thread;
+#else
+    pthread_t thread;
+#endif
+    int running;
+} batch_station;
+
+struct batch_s
+{
+    const char *image;
+    int disks;                      /* 0: until interrupted */
+    int next;                       /* the number of the next disk */
+    int ok;                         /* the disks read without errors */
+    d64copy_message_cb message_cb;
+#ifdef WIN32
+    CRITICAL_SECTION lock;
+#else
+    pthread_mutex_t lock;
+#endif
+};
+
+#ifdef WIN32
+# define batch_lock(_l)   EnterCriticalSection(_l)
+# define batch_unlock(_l) LeaveCriticalSection(_l)
+#else
+# define batch_lock(_l)   pthread_mutex_lock(_l)
+# define batch_unlock(_l) pthread_mutex_unlock(_l)
+#endif
+
+char *d64copy_batch_image_name(const char *image, int number)
+{
+    const char *base, *dot;
+    char *name;
+    size_t len;
+
+    base = strrchr(image, '/');
+#ifdef WIN32
+    dot = strrchr(image, '\\');
+    if(dot != NULL && (base == NULL || dot > base))
+    {
+        base = dot;
+    }
+#endif
+    base = base ? base + 1 : image;
+
+    dot = strchr(base, '.');
+    len = dot ? (size_t)(dot - image) : strlen(image);
+
+    name = malloc(strlen(image) + 12);
+    if(name != NULL)
+    {
+        memcpy(name, image, len);
+        sprintf(name + len, "-%03d%s", number, image + len);
+    }
+    return name;
+}
+
+static int batch_full(batch *b)
+{
+    int full;
+
+    batch_lock(&b->lock);
+    full = d64copy_aborted() || (b->disks != 0 && b->next > b->disks);
+    batch_unlock(&b->lock);
+    return full;
+}
+
+/* the number of the disk which is ready in a drive, 0 if there are enough */
+static int batch_take(batch *b)
+{
+    int number = 0;
+
+    batch_lock(&b->lock);
+    if(!d64copy_aborted() && (b->disks == 0 || b->next <= b->disks))
+    {
+        number = b->next++;
+    }
+    batch_unlock(&b->lock);
+    return number;
+}
+
+static int batch_bus_cb(void *context, int lock)
+{
+    batch_station *st = context;
+
+    if(lock)
+    {
+        /* stop waiting for a disk which is not needed anymore */
+        if(batch_full(st->b))
+        {
+            return 1;
+        }
+        batch_lock(&st->bus->lock);
+    }
+    else
+    {
+        batch_unlock(&st->bus->lock);
+    }
+    return 0;
+}
+
+static int batch_status_cb(const d64copy_status *status)
+{
+    /* the progress of several drives at once is not shown */
+    return 0;
+}
+
+static void batch_run(batch_station *st)
+{
+    batch *b = st->b;
+    CBM_FILE fd = st->bus->cbm_fd;
+    char *name;
+    int number, rv;
+    int first = 1;
+
+    batch_lock(&st->bus->lock);
+    st->settings.transfer_mode =
+        d64copy_check_auto_transfer_mode(fd, st->settings.transfer_mode,
+                                         st->drive);
+    batch_unlock(&st->bus->lock);
+
+    for(;;)
+    {
+        /* the disk in the drive at the start is read right away */
+        if(!first &&
+           d64copy_wait_disk_change_shared(fd, st->drive, b->message_cb,
+                                           batch_bus_cb, st) != 0)
+        {
+            break;
+        }
+        first = 0;
+
+        number = batch_take(b);
+        if(number == 0)
+        {
+            break;
+        }
+
+        name = d64copy_batch_image_name(b->image, number);
+        if(name == NULL)
+        {
+            b->message_cb(0, "no memory");
+            break;
+        }
+
+        b->message_cb(1, "drive %d: reading disk %d to %s",
+                      st->drive, number, name);
+
+        batch_lock(&st->bus->lock);
+        rv = d64copy_read_image(fd, &st->settings, st->drive, name,
+                                b->message_cb, batch_status_cb);
+        batch_unlock(&st->bus->lock);
+
+        if(rv >= 0)
+        {
+            b->message_cb(2, "drive %d: %d blocks copied to %s",
+                          st->drive, rv, name);
+            batch_lock(&b->lock);
+            b->ok++;
+            batch_unlock(&b->lock);
+        }
+        else
+        {
+            b->message_cb(1, "drive %d: reading disk %d failed",
+                          st->drive, number);
+        }
+        free(name);
+    }
+}
+
+#ifdef WIN32
+static DWORD WINAPI batch_worker(LPVOID arg)
+#else
+static void *batch_worker(void *arg)
+#endif
+{
+    batch_run(arg);
+#ifdef WIN32
+    return 0;
+#else
+    return NULL;
+#endif
+}
+
+int d64copy_read_batch(const d64copy_station *stations,
+                       int count,
+                       const d64copy_settings *settings,
+                       const char *image,
+                       int disks,
+                       d64copy_message_cb msg_cb)
+{
+    batch b;
+    batch_bus *buses;
+    batch_station *st;
+    int nbuses = 0;
+    int i, j;
+
+    if(count < 1)
+    {
+        return -1;
+    }
+
+    buses = calloc(count, sizeof(*buses));
+    st = calloc(count, sizeof(*st));
+    if(buses == NULL || st == NULL)
+    {
+        msg_cb(0, "no memory");
+        free(buses);
+        free(st);
+        return -1;
+    }
+
+    memset(&b, 0, sizeof(b));
+    b.image = image;
+    b.disks = disks;
+    b.next = 1;
+    b.message_cb = msg_cb;
+#ifdef WIN32
+    InitializeCriticalSection(&b.lock);
+#else
+    pthread_mutex_init(&b.lock, NULL);
+#endif
+
+    for(i = 0; i < count; i++)
+    {
+        for(j = 0; j < nbuses; j++)
+        {
+            if(buses[j].cbm_fd == stations[i].cbm_fd)
+            {
+                break;
+            }
+        }
+        if(j == nbuses)
+        {
+            buses[j].cbm_fd = stations[i].cbm_fd;
+#ifdef WIN32
+            InitializeCriticalSection(&buses[j].lock);
+#else
+            pthread_mutex_init(&buses[j].lock, NULL);
+#endif
+            nbuses++;
+        }
+
+        st[i].b = &b;
+        st[i].bus = &buses[j];
+        st[i].drive = stations[i].drive;
+        st[i].settings = *settings;
+
+#ifdef WIN32
+        st[i].thread = CreateThread(NULL, 0, batch_worker, &st[i], 0, NULL);
+        st[i].running = st[i].thread != NULL;
+#else
+        st[i].running = pthread_create(&st[i].thread, NULL, batch_worker,
+                                       &st[i]) == 0;
+#endif
+        if(!st[i].running)
+        {
+            msg_cb(0, "drive %d: cannot start a thread", st[i].drive);
+        }
+    }
+
+    for(i = 0; i < count; i++)
+    {
+        if(st[i].running)
+        {
+#ifdef WIN32
+            WaitForSingleObject(st[i].thread, INFINITE);
+            CloseHandle(st[i].thread);
+#else
+            pthread_join(st[i].thread, NULL);
+#endif
+        }
+    }
+
+    for(j = 0; j < nbuses; j++)
+    {
+#ifdef WIN32
+        DeleteCriticalSection(&buses[j].lock);
+#else
+        pthread_mutex_destroy(&buses[j].lock);
+#endif
+    }
+#ifdef WIN32
+    DeleteCriticalSection(&b.lock);
+#else
+    pthread_mutex_destroy(&b.lock);
+#endif
+
+    free(buses);
+    free(st);
+
+    return b.ok;
+}
@@ -0,0 +1,428 @@
+/*
+ *  This program is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU General Public License
+ *  as published by the Free Software Foundation; either version
+ *  2 of the License, or (at your option) any later version.
+ *
+*/
+
+/*
+ * The images of a batch can be collected in one container instead of a
+ * file each: a zip archive whose entries are stored, not compressed. Its
+ * central directory is the index of the images, so a single image can be
+ * found without reading the others, and the archive can be opened by the
+ * usual tools and emulators.
+ *
+ * An image is added when it has been written completely: its entry goes
+ * where the central directory has been, and the directory, with the new
+ * entry added, is written behind it again. Thus, the container is a
+ * valid archive after every image. The copies in this process add their
+ * images one at a time; other processes adding to the same container at
+ * the same time are not allowed.
+ */
+
+#include "d64copy_int.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "arch.h"
+
+#ifdef WIN32
+# include <windows.h>
+#endif
+
+#define ZIP_LOCAL_SIZE      30
+#define ZIP_CENTRAL_SIZE    46
+#define ZIP_END_SIZE        22
+#define ZIP_MAX_COMMENT     0xffff
+#define ZIP_MAX_ENTRIES     0xffff
+
+#define ZIP_LOCAL_SIG       0x04034b50UL
+#define ZIP_CENTRAL_SIG     0x02014b50UL
+#define ZIP_END_SIG         0x06054b50UL
+
+/* version 1.0 is enough for stored entries */
+#define ZIP_VERSION         10
+
+/* the copies in this process add their images one at a time */
+#ifdef WIN32
+
+static LONG volatile container_lock_flag = 0;
+
+static void container_lock(void)
+{
+    while(InterlockedExchange((LONG *) &container_lock_flag, 1) != 0)
+    {
+        Sleep(0);
+    }
+}
+
+static void container_unlock(void)
+{
+    InterlockedExchange((LONG *) &container_lock_flag, 0);
+}
+
+#else
+
+#include <pthread.h>
+
+static pthread_mutex_t container_mutex = PTHREAD_MUTEX_INITIALIZER;
+
+static void container_lock(void)
+{
+    pthread_mutex_lock(&container_mutex);
+}
+
+static void container_unlock(void)
+{
+    pthread_mutex_unlock(&container_mutex);
+}
+
+#endif
+
+static void put_le16(unsigned char *p, unsigned int value)
+{
+    p[0] = (unsigned char) value;
+    p[1] = (unsigned char) (value >> 8);
+}
+
+static void put_le32(unsigned char *p, unsigned long value)
+{
+    p[0] = (unsigned char) value;
+    p[1] = (unsigned char) (value >> 8);
+    p[2] = (unsigned char) (value >> 16);
+    p[3] = (unsigned char) (value >> 24);
+}
+
+static unsigned int get_le16(const unsigned char *p)
+{
+    return p[0] | (p[1] << 8);
+}
+
+static unsigned long get_le32(const unsigned char *p)
+{
+    return (unsigned long) p[0] | ((unsigned long) p[1] << 8) |
+           ((unsigned long) p[2] << 16) | ((unsigned long) p[3] << 24);
+}
+
+/* the name of the entry: the name of the image without its directory */
+static const char *entry_name(const char *image)
+{
+    const char *base = strrchr(image, '/');
+#ifdef WIN32
+    const char *p = strrchr(image, '\\');
+
+    if(p != NULL && (base == NULL || p > base))
+    {
+        base = p;
+    }
+#endif
+    return base ? base + 1 : image;
+}
+
+/*
+ * find the central directory of the container: its offset, size and
+ * number of entries. Returns != 0 if the file is not a zip archive.
+ */
+static int find_directory(FILE *f, long size, long *dir_offset,
+                          long *dir_size, unsigned int *entries)
+{
+    unsigned char *tail, *p;
+    long tail_size = size < ZIP_END_SIZE + ZIP_MAX_COMMENT ?
+                     size : ZIP_END_SIZE + ZIP_MAX_COMMENT;
+    int rv = 1;
+
+    if(tail_size < ZIP_END_SIZE)
+    {
+        return 1;
+    }
+
+    tail = malloc(tail_size);
+    if(tail == NULL)
+    {
+        return 1;
+    }
+
+    /* the end record is the last thing in the file, but for a comment */
+    if(fseek(f, size - tail_size, SEEK_SET) == 0 &&
+       fread(tail, tail_size, 1, f) == 1)
+    {
+        for(p = tail + tail_size - ZIP_END_SIZE; p >= tail; p--)
+        {
+            if(get_le32(p) == ZIP_END_SIG)
+            {
+                *entries = get_le16(p + 10);
+                *dir_size = (long) get_le32(p + 12);
+                *dir_offset = (long) get_le32(p + 16);
+                rv = *dir_offset + *dir_size > size - (tail_size - (p - tail));
+                break;
+            }
+        }
+    }
+    free(tail);
+    return rv;
+}
+
+/* != 0 if the central directory has an entry with this name already */
+static int has_entry(const unsigned char *dir, long dir_size,
+                     unsigned int entries, const char *name)
+{
+    size_t name_len = strlen(name);
+    long ofs = 0;
+
+    while(entries-- > 0 && ofs + ZIP_CENTRAL_SIZE <= dir_size)
+    {
+        const unsigned char *e = dir + ofs;
+        size_t n = get_le16(e + 28);
+
+        if(n == name_len && ofs + ZIP_CENTRAL_SIZE + (long) n <= dir_size &&
+           memcmp(e + ZIP_CENTRAL_SIZE, name, n) == 0)
+        {
+            return 1;
+        }
+        ofs += ZIP_CENTRAL_SIZE + n + get_le16(e + 30) + get_le16(e + 32);
+    }
+    return 0;
+}
+
+/* fill in the fields the local and the central header have in common */
+static void put_entry_fields(unsigned char *p, unsigned long dos_time,
+                             unsigned long crc, unsigned long size,
+                             size_t name_len)
+{
+    put_le16(p, ZIP_VERSION);       /* version needed to extract */
+    put_le16(p + 2, 0);             /* flags */
+    put_le16(p + 4, 0);             /* stored */
+    put_le32(p + 6, dos_time);
+    put_le32(p + 10, crc);
+    put_le32(p + 14, size);         /* compressed size */
+    put_le32(p + 18, size);
+    put_le16(p + 22, (unsigned int) name_len);
+    put_le16(p + 24, 0);            /* extra field */
+}
+
+/* the current time, in the MS-DOS format of the archive */
+static unsigned long dos_now(void)
+{
+    time_t now = time(NULL);
+    struct tm *t = localtime(&now);
+
+    if(t == NULL || t->tm_year < 80)
+    {
+        return 0x00210000UL;        /* 1980-01-01 */
+    }
+    return ((unsigned long) (t->tm_year - 80) << 25) |
+           ((unsigned long) (t->tm_mon + 1) << 21) |
+           ((unsigned long) t->tm_mday << 16) |
+           ((unsigned long) t->tm_hour << 11) |
+           ((unsigned long) t->tm_min << 5) |
+           ((unsigned long) t->tm_sec >> 1);
+}
+
+/*
+ * write the central directory and the end record behind it, which ends
+ * the archive. Returns != 0 on error.
+ */
+static int write_directory(FILE *f, const unsigned char *dir, long dir_size,
+                           long dir_offset, unsigned int entries)
+{
+    unsigned char end[ZIP_END_SIZE];
+
+    memset(end, 0, sizeof(end));
+    put_le32(end, ZIP_END_SIG);
+    put_le16(end + 8, entries);
+    put_le16(end + 10, entries);
+    put_le32(end + 12, (unsigned long) dir_size);
+    put_le32(end + 16, (unsigned long) dir_offset);
+
+    /* a comment the archive had before is dropped */
+    return fseek(f, dir_offset, SEEK_SET) != 0 ||
+           (dir_size > 0 && fwrite(dir, dir_size, 1, f) != 1) ||
+           fwrite(end, sizeof(end), 1, f) != 1 ||
+           fflush(f) != 0 ||
+           arch_ftruncate(arch_fileno(f), dir_offset + dir_size + ZIP_END_SIZE) < 0;
+}
+
+static int add_image(const char *container, const char *image,
+                     d64copy_message_cb message_cb)
+{
+    const char *name = entry_name(image);
+    size_t name_len = strlen(name);
+    unsigned char header[ZIP_CENTRAL_SIZE];
+    unsigned char buf[4096];
+    unsigned char *dir = NULL;
+    long dir_offset = 0, dir_size = 0, size = 0;
+    unsigned long crc = 0, dos_time = dos_now(), image_size = 0;
+    unsigned int entries = 0;
+    int touched = 0;
+    off_t filesize;
+    FILE *f, *img;
+    size_t n;
+    int rv = 1;
+
+    if(arch_filesize(image, &filesize) != 0)
+    {
+        message_cb(1, "could not stat %s", image);
+        return 1;
+    }
+
+    img = fopen(image, "rb");
+    if(img == NULL)
+    {
+        message_cb(1, "could not open %s", image);
+        return 1;
+    }
+
+    f = fopen(container, "r+b");
+    if(f == NULL)
+    {
+        f = fopen(container, "w+b");
+    }
+    if(f == NULL)
+    {
+        message_cb(1, "could not open container %s", container);
+        fclose(img);
+        return 1;
+    }
+
+    do
+    {
+        if(fseek(f, 0, SEEK_END) != 0 || (size = ftell(f)) < 0)
+        {
+            break;
+        }
+
+        if(size > 0)
+        {
+            if(find_directory(f, size, &dir_offset, &dir_size, &entries) != 0)
+            {
+                message_cb(1, "%s is not a zip archive", container);
+                break;
+            }
+            if(entries >= ZIP_MAX_ENTRIES)
+            {
+                message_cb(1, "container %s is full", container);
+                break;
+            }
+            dir = malloc(dir_size + ZIP_CENTRAL_SIZE + name_len);
+            if(dir == NULL ||
+               fseek(f, dir_offset, SEEK_SET) != 0 ||
+               (dir_size > 0 && fread(dir, dir_size, 1, f) != 1))
+            {
+                message_cb(1, "could not read the index of %s", container);
+                break;
+            }
+            if(has_entry(dir, dir_size, entries, name))
+            {
+                message_cb(1, "%s is in %s already", name, container);
+                break;
+            }
+        }
+        else
+        {
+            dir = malloc(ZIP_CENTRAL_SIZE + name_len);
+            if(dir == NULL)
+            {
+                message_cb(0, "no memory");
+                break;
+            }
+        }
+
+        /* the entry replaces the central directory ... */
+        memset(header, 0, ZIP_LOCAL_SIZE);
+        put_le32(header, ZIP_LOCAL_SIG);
+        put_entry_fields(header + 4, dos_time, 0, 0, name_len);
+        touched = 1;
+        if(fseek(f, dir_offset, SEEK_SET) != 0 ||
+           fwrite(header, ZIP_LOCAL_SIZE, 1, f) != 1 ||
+           fwrite(name, name_len, 1, f) != 1)
+        {
+            break;
+        }
+
+        while((n = fread(buf, 1, sizeof(buf), img)) > 0)
+        {
+            crc = d64copy_crc32(crc, buf, n);
+            image_size += n;
+            if(fwrite(buf, n, 1, f) != 1)
+            {
+                break;
+            }
+        }
+        if(ferror(img) || ferror(f) || image_size != (unsigned long) filesize)
+        {
+            message_cb(1, "could not copy %s to %s", image, container);
+            break;
+        }
+
+        /* ... now that the CRC is known, the header can be completed */
+        put_entry_fields(header + 4, dos_time, crc, image_size, name_len);
+        if(fseek(f, dir_offset, SEEK_SET) != 0 ||
+           fwrite(header, ZIP_LOCAL_SIZE, 1, f) != 1)
+        {
+            break;
+        }
+
+        /* ... and goes into the directory, behind the other images */
+        memset(header, 0, ZIP_CENTRAL_SIZE);
+        put_le32(header, ZIP_CENTRAL_SIG);
+        put_le16(header + 4, ZIP_VERSION);  /* version made by */
+        put_entry_fields(header + 6, dos_time, crc, image_size, name_len);
+        put_le32(header + 42, (unsigned long) dir_offset);
+        memcpy(dir + dir_size, header, ZIP_CENTRAL_SIZE);
+        memcpy(dir + dir_size + ZIP_CENTRAL_SIZE, name, name_len);
+
+        if(write_directory(f, dir, dir_size + ZIP_CENTRAL_SIZE + (long) name_len,
+                           dir_offset + ZIP_LOCAL_SIZE + (long) name_len + (long) image_size,
+                           entries + 1) != 0)
+        {
+            break;
+        }
+        rv = 0;
+    } while(0);
+
+    /* the images added before must stay in the container */
+    if(rv != 0 && touched && size > 0)
+    {
+        clearerr(f);
+        if(write_directory(f, dir, dir_size, dir_offset, entries) != 0)
+        {
+            message_cb(0, "could not restore the index of %s", container);
+        }
+    }
+
+    if(rv != 0 && size == 0)
+    {
+        /* do not leave an empty container behind */
+        fclose(f);
+        f = NULL;
+        arch_unlink(container);
+    }
+    else if(rv != 0)
+    {
+        message_cb(0, "could not add %s to %s", image, container);
+    }
+
+    free(dir);
+    if(f != NULL)
+    {
+        fclose(f);
+    }
+    fclose(img);
+    return rv;
+}
+
+int d64copy_container_add(const char *container, const char *image,
+                          d64copy_message_cb message_cb)
+{
+    int rv;
+
+    container_lock();
+    rv = add_image(container, image, message_cb);
+    container_unlock();
+
+    return rv;
+}
@@ -0,0 +1,314 @@
+/*
+ *  This program is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU General Public License
+ *  as published by the Free Software Foundation; either version
+ *  2 of the License, or (at your option) any later version.
+ *
+*/
+
+/*
+ * Converting image files from one format to another one without a drive,
+ * e.g. a .g64 or .nib image to a .d64 image. The blocks are read with the
+ * transfer of the source image and written with the one of the target,
+ * together with the status they have been read with: a block which is
+ * damaged in a .g64 image keeps its error in the error info of a .d64.
+ *
+ * Several images are converted by worker threads: each one takes the
+ * next image which is not converted yet, as the images differ in size
+ * and thus, in the time they need.
+ */
+
+#include "d64copy_int.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef WIN32
+# include <windows.h>
+#else
+# include <pthread.h>
+# include <unistd.h>
+#endif
+
+typedef struct
+{
+    const d64copy_settings *settings;
+    const char * const *images;
+    int count;
+    const char *extension;
+    int next;                       /* the index of the next image */
+    int ok;                         /* the images converted without errors */
+    d64copy_message_cb message_cb;
+#ifdef WIN32
+    CRITICAL_SECTION lock;
+#else
+    pthread_mutex_t lock;
+#endif
+} convert_batch;
+
+#ifdef WIN32
+# define convert_lock(_l)   EnterCriticalSection(_l)
+# define convert_unlock(_l) LeaveCriticalSection(_l)
+#else
+# define convert_lock(_l)   pthread_mutex_lock(_l)
+# define convert_unlock(_l) pthread_mutex_unlock(_l)
+#endif
+
+int d64copy_convert_image(const d64copy_settings *settings,
+                          const char *src_image,
+                          const char *dst_image,
+                          d64copy_message_cb msg_cb)
+{
+    d64copy_settings s = *settings;
+    const transfer_funcs *src, *dst;
+    d64copy_disk src_disk, dst_disk;
+    unsigned char block[BLOCKSIZE];
+    int tr, se, status, errors = 0;
+
+    src = d64copy_image_transfer(src_image);
+    dst = d64copy_image_transfer(dst_image);
+
+    /* there is nothing to resume or update on a new image */
+    s.resume = 0;
+    s.update = 0;
+
+    if(src->open_disk(&src_disk, CBM_FILE_INVALID, &s, src_image, 0, NULL, msg_cb) != 0)
+    {
+        return -1;
+    }
+    if(dst->open_disk(&dst_disk, CBM_FILE_INVALID, &s, dst_image, 1, NULL, msg_cb) != 0)
+    {
+        src->close_disk(src_disk);
+        return -1;
+    }
+
+    for(tr = s.start_track; tr <= s.end_track && !d64copy_aborted(); tr++)
+    {
+        for(se = 0; se < d64copy_sector_count(s.two_sided, tr); se++)
+        {
+            status = src->read_block(src_disk, (unsigned char) tr,
+                                     (unsigned char) se, block);
+            if(status)
+            {
+                msg_cb(2, "%s: %d/%d: read error %d",
+                       src_image, tr, se, status);
+                errors++;
+            }
+            if(dst->write_block(dst_disk, (unsigned char) tr,
+                                (unsigned char) se, block, BLOCKSIZE,
+                                status) != 0)
+            {
+                msg_cb(0, "%s: could not write %d/%d", dst_image, tr, se);
+                errors = -1;
+                break;
+            }
+        }
+        if(errors < 0)
+        {
+            break;
+        }
+    }
+
+    dst->close_disk(dst_disk);
+    src->close_disk(src_disk);
+
+    return d64copy_aborted() ? -1 : errors;
+}
+
+char *d64copy_convert_image_name(const char *image, const char *extension)
+{
+    const char *base, *dot;
+    char *name;
+    size_t len;
+
+    base = strrchr(image, '/');
+#ifdef WIN32
+    dot = strrchr(image, '\\');
+    if(dot != NULL && (base == NULL || dot > base))
+    {
+        base = dot;
+    }
+#endif
+    base = base ? base + 1 : image;
+
+    dot = strrchr(base, '.');
+    len = dot ? (size_t)(dot - image) : strlen(image);
+
+    name = malloc(len + strlen(extension) + 2);
+    if(name != NULL)
+    {
+        memcpy(name, image, len);
+        sprintf(name + len, ".%s", extension);
+    }
+    return name;
+}
+
+/* the index of the next image, -1 if all are taken */
+static int convert_take(convert_batch *b)
+{
+    int index = -1;
+
+    convert_lock(&b->lock);
+    if(!d64copy_aborted() && b->next < b->count)
+    {
+        index = b->next++;
+    }
+    convert_unlock(&b->lock);
+    return index;
+}
+
+static void convert_run(convert_batch *b)
+{
+    const char *src;
+    char *dst;
+    int index, rv;
+
+    while((index = convert_take(b)) >= 0)
+    {
+        src = b->images[index];
+        dst = d64copy_convert_image_name(src, b->extension);
+        if(dst == NULL)
+        {
+            b->message_cb(0, "no memory");
+            break;
+        }
+
+        if(strcmp(src, dst) == 0)
+        {
+            b->message_cb(0, "%s is a .%s image already", src, b->extension);
+            free(dst);
+            continue;
+        }
+
+        rv = d64copy_convert_image(b->settings, src, dst, b->message_cb);
+        if(rv == 0)
+        {
+            b->message_cb(2, "%s converted to %s", src, dst);
+            convert_lock(&b->lock);
+            b->ok++;
+            convert_unlock(&b->lock);
+        }
+        else if(rv > 0)
+        {
+            b->message_cb(1, "%s converted to %s, %d blocks with errors",
+                          src, dst, rv);
+        }
+        else
+        {
+            b->message_cb(1, "converting %s failed", src);
+        }
+        free(dst);
+    }
+}
+
+#ifdef WIN32
+static DWORD WINAPI convert_worker(LPVOID arg)
+#else
+static void *convert_worker(void *arg)
+#endif
+{
+    convert_run(arg);
+#ifdef WIN32
+    return 0;
+#else
+    return NULL;
+#endif
+}
+
+static int online_cpus(void)
+{
+#ifdef WIN32
+    SYSTEM_INFO info;
+
+    GetSystemInfo(&info);
+    return (int) info.dwNumberOfProcessors;
+#elif defined(_SC_NPROCESSORS_ONLN)
+    long n = sysconf(_SC_NPROCESSORS_ONLN);
+
+    return n > 0 ? (int) n : 1;
+#else
+    return 1;
+#endif
+}
+
+int d64copy_convert_images(const d64copy_settings *settings,
+                           const char * const *images,
+                           int count,
+                           const char *extension,
+                           int jobs,
+                           d64copy_message_cb msg_cb)
+{
+    convert_batch b;
+#ifdef WIN32
+    HANDLE *threads;
+#else
+    pthread_t *threads;
+#endif
+    int running = 0;
+    int i;
+
+    if(count < 1)
+    {
+        return 0;
+    }
+    if(jobs < 1)
+    {
+        jobs = online_cpus();
+    }
+    if(jobs > count)
+    {
+        jobs = count;
+    }
+
+    memset(&b, 0, sizeof(b));
+    b.settings = settings;
+    b.images = images;
+    b.count = count;
+    b.extension = extension;
+    b.message_cb = msg_cb;
+#ifdef WIN32
+    InitializeCriticalSection(&b.lock);
+#else
+    pthread_mutex_init(&b.lock, NULL);
+#endif
+
+    /* with one job, the images are converted by the caller's thread */
+    threads = jobs > 1 ? calloc(jobs, sizeof(*threads)) : NULL;
+    for(i = 0; threads != NULL && i < jobs; i++)
+    {
+#ifdef WIN32
+        threads[running] = CreateThread(NULL, 0, convert_worker, &b, 0, NULL);
+        if(threads[running] != NULL)
+#else
+        if(pthread_create(&threads[running], NULL, convert_worker, &b) == 0)
+#endif
+        {
+            running++;
+        }
+    }
+
+    if(running == 0)
+    {
+        convert_run(&b);
+    }
+
+    for(i = 0; i < running; i++)
+    {
+#ifdef WIN32
+        WaitForSingleObject(threads[i], INFINITE);
+        CloseHandle(threads[i]);
+#else
+        pthread_join(threads[i], NULL);
+#endif
+    }
+    free(threads);
+
+#ifdef WIN32
+    DeleteCriticalSection(&b.lock);
+#else
+    pthread_mutex_destroy(&b.lock);
+#endif
+
+    return b.ok;
+}
@@ -0,0 +1,158 @@
+/*
+ *  This program is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU General Public License
+ *  as published by the Free Software Foundation; either version
+ *  2 of the License, or (at your option) any later version.
+ *
+*/
+
+/*
+ * Copy from one drive to another one on the same bus. Both drives have
+ * a buffer opened on channel 2. For every block, the destination is
+ * made a listener on it, and then the source the talker: thus, the
+ * destination drive gets the block into its buffer right from the bus
+ * while the host reads it, and the host never has to send it again.
+ * Writing the block then only needs the U2 command.
+ *
+ * Blocks which could not be read are written the standard way, so the
+ * destination gets whatever the caller hands in.
+ */
+
+#include "opencbm.h"
+#include "d64copy_int.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+
+typedef struct
+{
+    unsigned char drive;
+    CBM_FILE fd_cbm;
+    d64copy_d2d *d2d;
+} d2d_disk;
+
+static int read_block(d64copy_disk disk, unsigned char tr, unsigned char se, unsigned char *block)
+{
+    d2d_disk *d = disk;
+    d64copy_d2d *d2d = d->d2d;
+    CBM_FILE fd_cbm = d->fd_cbm;
+    char cmd[48];
+    int rv = 1;
+
+    d2d->valid = 0;
+
+    sprintf(cmd, "U1:2 0 %d %d", tr, se);
+    if(cbm_exec_command(fd_cbm, d2d->src_drive, cmd, 0) == 0) {
+        rv = cbm_device_status(fd_cbm, d2d->src_drive, cmd, sizeof(cmd));
+        if(rv == 0) {
+            rv = 1;
+            if(cbm_exec_command(fd_cbm, d2d->src_drive, "B-P2 0", 0) == 0 &&
+               cbm_exec_command(fd_cbm, d2d->dst_drive, "B-P2 0", 0) == 0) {
+                /* the destination listens along while the host reads */
+                if(cbm_listen(fd_cbm, d2d->dst_drive, 2) == 0) {
+                    if(cbm_talk(fd_cbm, d2d->src_drive, 2) == 0) {
+                                                                        SETSTATEDEBUG(DebugByteCount=0);
+                        rv = cbm_raw_read(fd_cbm, block, BLOCKSIZE) != BLOCKSIZE;
+                                                                        SETSTATEDEBUG(DebugByteCount=-1);
+                        cbm_untalk(fd_cbm);
+                    }
+                    cbm_unlisten(fd_cbm);
+                }
+            }
+            if(rv == 0) {
+                d2d->tr = tr;
+                d2d->se = se;
+                d2d->valid = 1;
+            }
+        }
+    }
+    return rv;
+}
+
+static int write_block(d64copy_disk disk, unsigned char tr, unsigned char se, const unsigned char *blk, int size, int read_status)
+{
+    d2d_disk *d = disk;
+    d64copy_d2d *d2d = d->d2d;
+    CBM_FILE fd_cbm = d->fd_cbm;
+    unsigned char drive = d->drive;
+    char cmd[48];
+    int  rv = 0;
+
+    if(!d2d->valid || read_status != 0 || d2d->tr != tr || d2d->se != se)
+    {
+        /* not in the buffer of the destination, send it */
+        rv = 1;
+        if(cbm_exec_command(fd_cbm, drive, "B-P2 0", 0) == 0)
+        {
+            if(cbm_listen(fd_cbm, drive, 2) == 0)
+            {
+                                                                        SETSTATEDEBUG(DebugByteCount=0);
+                rv = cbm_raw_write(fd_cbm, blk, size) != size;
+                                                                        SETSTATEDEBUG(DebugByteCount=-1);
+                cbm_unlisten(fd_cbm);
+            }
+        }
+    }
+    d2d->valid = 0;
+
+    if(rv == 0)
+    {
+        sprintf(cmd ,"U2:2 0 %d %d", tr, se);
+        cbm_exec_command(fd_cbm, drive, cmd, 0);
+        rv = cbm_device_status(fd_cbm, drive, cmd, sizeof(cmd));
+    }
+    return rv;
+}
+
+static int open_disk(d64copy_disk *disk, CBM_FILE fd, d64copy_settings *settings,
+                     const void *arg, int for_writing,
+                     turbo_start start, d64copy_message_cb message_cb)
+{
+    d2d_disk *d;
+    char buf[48];
+    int rv;
+
+    *disk = NULL;
+
+    if(settings->end_track > STD_TRACKS && !settings->two_sided)
+    {
+        message_cb(0,
+                   "standard transfer doesn't handle extended track images");
+        return 99;
+    }
+
+    d = malloc(sizeof(*d));
+    if(d == NULL)
+    {
+        message_cb(0, "no memory");
+        return 1;
+    }
+
+    d->d2d = (d64copy_d2d *) arg;
+    d->drive = for_writing ? d->d2d->dst_drive : d->d2d->src_drive;
+    d->fd_cbm = fd;
+    d->d2d->valid = 0;
+
+    cbm_open(d->fd_cbm, d->drive, 2, "#", 1);
+
+    rv = cbm_device_status(d->fd_cbm, d->drive, buf, sizeof(buf));
+    if(rv)
+    {
+        message_cb(0, "drive %02d: %s", d->drive, buf);
+        cbm_close(d->fd_cbm, d->drive, 2);
+        free(d);
+        return rv;
+    }
+    *disk = d;
+    return 0;
+}
+
+static void close_disk(d64copy_disk disk)
+{
+    d2d_disk *d = disk;
+
+    cbm_close(d->fd_cbm, d->drive, 2);
+    free(d);
+}
+
+DECLARE_TRANSFER_FUNCS(d2d_transfer, 1, 0);
@@ -15,6 +15,10 @@
 
 #include "arch.h"
 
+#ifndef WIN32
+# include <pthread.h>
+#endif
+
 
 static const char d64_sector_map[MAX_TRACKS+1] =
 { 0,
@@ -94,33 +98,147 @@ static const struct drive_prog
 };
 
 
-static const int default_interleave[] = { -1, 17, 4, 13, 7, -1 };
-static const int warp_write_interleave[] = { -1, 0, 6, 12, 4, -1 };
+static const int default_interleave[] = { -1, 17, 4, 13, 7, 7, -1 };
+static const int warp_write_interleave[] = { -1, 0, 6, 12, 4, 4, -1 };
 
 
 /*
- * Variables to make sure writing a block is an atomary process
+ * The state of one copy. As every copy has its own, more than one disk
+ * can be copied at the same time (e.g., from different drives).
  */
-static int atom_mustcleanup = 0;
-static const transfer_funcs *atom_dst;
+typedef struct d64copy_job_s
+{
+    d64copy_message_cb message_cb;
+    d64copy_status_cb status_cb;
+
+    /*
+     * Variables to make sure writing a block is an atomary process
+     */
+    int must_cleanup;
+    const transfer_funcs *dst;
+    d64copy_disk dst_disk;
+    blockpipe *pipeline;
+
+    /* != NULL: only the blocks not set here are copied, as with update */
+    const char (*unchanged)[MAX_SECTORS+1];
+    /* != NULL: gets the state of every block when the copy is done */
+    char (*written)[MAX_SECTORS+1];
+
+    struct d64copy_job_s *next;
+} d64copy_job;
+
+/* the copies which must be cleaned up when interrupted */
+static d64copy_job *running_jobs = NULL;
+
+#ifdef WIN32
+
+static LONG volatile running_jobs_lock_flag = 0;
+
+static void running_jobs_lock(void)
+{
+    while(InterlockedExchange((LONG *) &running_jobs_lock_flag, 1) != 0)
+    {
+        Sleep(0);
+    }
+}
+
+static void running_jobs_unlock(void)
+{
+    InterlockedExchange((LONG *) &running_jobs_lock_flag, 0);
+}
+
+#else
+
+static pthread_mutex_t running_jobs_mutex = PTHREAD_MUTEX_INITIALIZER;
+
+static void running_jobs_lock(void)
+{
+    pthread_mutex_lock(&running_jobs_mutex);
+}
+
+static void running_jobs_unlock(void)
+{
+    pthread_mutex_unlock(&running_jobs_mutex);
+}
+
+#endif
+
+/* set by d64copy_abort(), which may run in a signal handler */
+static volatile int abort_requested = 0;
+
+void d64copy_abort(void)
+{
+    abort_requested = 1;
+}
+
+int d64copy_aborted(void)
+{
+    return abort_requested;
+}
+
+static void job_register(d64copy_job *job)
+{
+    running_jobs_lock();
+    job->next = running_jobs;
+    running_jobs = job;
+    running_jobs_unlock();
+}
+
+static void job_unregister(d64copy_job *job)
+{
+    d64copy_job **pj;
+
+    running_jobs_lock();
+    for(pj = &running_jobs; *pj; pj = &(*pj)->next)
+    {
+        if(*pj == job)
+        {
+            *pj = job->next;
+            break;
+        }
+    }
+    running_jobs_unlock();
+}
 
 
 #ifdef LIBD64COPY_DEBUG
-    volatile signed int DebugLineNumber=-1, DebugBlockCount=-1,
+    static const statedebug_tracepoint_t DebugTracePointStart = { "", -1 };
+
+    volatile signed int DebugBlockCount=-1,
                         DebugByteCount=-1,  DebugBitCount=-1;
-    volatile char *     DebugFileName   = "";
+    const statedebug_tracepoint_t * volatile DebugTracePoint = &DebugTracePointStart;
 
     void printDebugLibD64Counters(d64copy_message_cb msg_cb)
     {
+        const statedebug_tracepoint_t * tracepoint = DebugTracePoint;
+
         msg_cb( sev_info, "file: %s"
                           "\n\tversion: " OPENCBM_VERSION ", built: " __DATE__ " " __TIME__
                           "\n\tline=%d, blocks=%d, bytes=%d, bits=%d\n",
-                          DebugFileName, DebugLineNumber,
+                          tracepoint->FileName, tracepoint->LineNumber,
                           DebugBlockCount, DebugByteCount,
                           DebugBitCount);
     }
 #endif
 
+/*
+ * The turbo write of the 1541 runs in buffer 3 instead of buffer 2, so
+ * that it and the turbo read are both kept in the drive: switching
+ * between reading and writing on the same handle needs no upload then.
+ */
+static int turbo_address(int write, int warp, int drv_type)
+{
+    return (write && !warp && drv_type == 0) ? 0x600 : 0x500;
+}
+
+/*
+ * the turbo is sent packed, it is unpacked in buffers 0 and 1: these are
+ * not used while it is sent, the seek job of buffer 0 does not touch the
+ * buffer itself
+ */
+#define TURBO_UNPACK_MEM    0x0300
+#define TURBO_UNPACK_SIZE   0x0200
+
 static int send_turbo(CBM_FILE fd, unsigned char drv, int write, int warp, int drv_type)
 {
     const struct drive_prog *prog;
@@ -128,17 +246,81 @@ static int send_turbo(CBM_FILE fd, unsigned char drv, int write, int warp, int d
     prog = &drive_progs[drv_type * 4 + warp * 2 + write];
 
     SETSTATEDEBUG((void)0);
-    return cbm_upload(fd, drv, 0x500, prog->prog, prog->size);
+    return cbm_upload_packed(fd, drv, turbo_address(write, warp, drv_type),
+                             prog->prog, prog->size,
+                             TURBO_UNPACK_MEM, TURBO_UNPACK_SIZE);
+}
+
+/*
+ * move the head to the first track while the turbo is sent: the seek is a
+ * job of the disk controller, which runs on its own while the DOS takes
+ * the M-W commands. Buffer 0 is used, as the turbo is not there.
+ */
+#define SEEK_JOB        0xb0
+#define SEEK_WAIT_MS    10
+#define SEEK_WAIT_COUNT 200
+
+static void seek_ahead(CBM_FILE fd, unsigned char drv, unsigned char tr)
+{
+    unsigned char ts[2];
+    unsigned char job = SEEK_JOB;
+
+    ts[0] = tr;
+    ts[1] = 0;
+    SETSTATEDEBUG((void)0);
+    if(cbm_upload(fd, drv, 0x0006, ts, sizeof(ts)) == sizeof(ts))
+    {
+        cbm_upload(fd, drv, 0x0000, &job, 1);
+    }
+}
+
+/* the turbo must not start before the job is done, it uses the queue, too */
+static void seek_wait(CBM_FILE fd, unsigned char drv)
+{
+    unsigned char job;
+    int i;
+
+    for(i = 0; i < SEEK_WAIT_COUNT; i++)
+    {
+        SETSTATEDEBUG((void)0);
+        if(cbm_download(fd, drv, 0x0000, &job, 1) != 1 || job < 0x80)
+        {
+            break;
+        }
+        arch_sleep_ms(SEEK_WAIT_MS);
+    }
 }
 
 extern transfer_funcs d64copy_fs_transfer,
+                      d64copy_extract_transfer,
+                      d64copy_g64_transfer,
+                      d64copy_ddi_transfer,
+                      d64copy_d2d_transfer,
                       d64copy_std_transfer,
                       d64copy_pp_transfer,
+                      d64copy_p2_transfer,
                       d64copy_s1_transfer,
                       d64copy_s2_transfer;
 
-static d64copy_message_cb message_cb;
-static d64copy_status_cb status_cb;
+/*
+ * images named *.g64 hold the GCR data of the tracks instead of the blocks,
+ * images named *.ddi the numbers of the blocks in a shared block store
+ */
+const transfer_funcs *d64copy_image_transfer(const char *name)
+{
+    size_t len = strlen(name);
+
+    if(len > 4 && (arch_strcasecmp(name + len - 4, ".g64") == 0 ||
+                   arch_strcasecmp(name + len - 4, ".nib") == 0))
+    {
+        return &d64copy_g64_transfer;
+    }
+    if(len > 4 && arch_strcasecmp(name + len - 4, ".ddi") == 0)
+    {
+        return &d64copy_ddi_transfer;
+    }
+    return &d64copy_fs_transfer;
+}
 
 int d64copy_sector_count(int two_sided, int track)
 {
@@ -159,6 +341,23 @@ int d64copy_sector_count(int two_sided, int track)
     return -1;
 }
 
+int d64copy_next_track(int two_sided, int track)
+{
+    if(two_sided)
+    {
+        /* a 1571 switches between the heads without moving them */
+        if(track <= STD_TRACKS)
+        {
+            return track + STD_TRACKS;
+        }
+        if(track != D71_TRACKS)
+        {
+            return track - STD_TRACKS + 1;
+        }
+    }
+    return track + 1;
+}
+
 d64copy_settings *d64copy_get_default_settings(void)
 {
     d64copy_settings *settings;
@@ -176,6 +375,14 @@ d64copy_settings *d64copy_get_default_settings(void)
         settings->drive_type  = cbm_dt_unknown; /* auto detect later on */
         settings->two_sided   = 0;
         settings->error_mode  = em_on_error;
+        settings->resume      = 0;
+        settings->adaptive    = 0;
+        settings->update      = 0;
+        settings->defer_retries = 0;
+        settings->manifest    = NULL;
+        settings->container   = NULL;
+        settings->extract     = NULL;
+        settings->verify      = 0;
     }
     return settings;
 }
@@ -187,8 +394,213 @@ static int start_turbo(CBM_FILE fd, unsigned char drive)
     return cbm_exec_command(fd, drive, "U4:", 3);
 }
 
+static int start_turbo_buffer3(CBM_FILE fd, unsigned char drive)
+{
+    SETSTATEDEBUG((void)0);
+    return cbm_exec_command(fd, drive, "M-E\x03\x06", 5);
+}
 
-static int copy_disk(CBM_FILE fd_cbm, d64copy_settings *settings,
+
+/*
+ * get the block out of what read_gcr_raw() returned
+ */
+static int gcr_block(const unsigned char *gcr, unsigned char *block, int decode_st)
+{
+    if(decode_st == GCR_NOT_DECODED)
+    {
+        return gcr_decode(gcr, block);
+    }
+    memcpy(block, gcr, BLOCKSIZE);
+    return decode_st;
+}
+
+
+/*
+ * evaluate the result of copying one block
+ */
+static void finish_block(d64copy_job *job,
+                         d64copy_status *status, char *trackmap,
+                         unsigned char *errors, int retry_count, int *cnt,
+                         unsigned char tr, unsigned char se,
+                         int read_result, int write_result)
+{
+    status->read_result = read_result;
+    status->write_result = write_result;
+
+    if(status->read_result)
+    {
+        /* read error */
+        trackmap[se] = bs_error;
+        (*errors)++;
+        if(retry_count == 0)
+        {
+            status->sectors_processed++;
+            /* FIXME: shall we get rid of this? */
+            job->message_cb( 1, "read error: %02x/%02x: %d",
+                        tr, se, status->read_result );
+        }
+    }
+    else
+    {
+        /* successfull read */
+        if(status->write_result)
+        {
+            /* write error */
+            trackmap[se] = bs_error;
+            (*errors)++;
+            if(retry_count == 0)
+            {
+                status->sectors_processed++;
+                /* FIXME: shall we get rid of this? */
+                job->message_cb(1, "write error: %02x/%02x: %d",
+                           tr, se, status->write_result);
+            }
+        }
+        else
+        {
+            /* successfull read and write, mark sector */
+            trackmap[se] = bs_copied;
+            (*cnt)++;
+            status->sectors_processed++;
+        }
+    }
+
+    status->track = tr;
+    status->sector= se;
+
+    /* keep the map of the caller up to date */
+    status->bam[tr-1][se] = trackmap[se];
+
+    job->status_cb(status);
+}
+
+
+/*
+ * the pipeline callbacks: the context is the job, which knows the destination
+ */
+static int pipeline_write(void *context, blockpipe_block *blk)
+{
+    d64copy_job *job = context;
+
+    return job->dst->write_block(job->dst_disk, blk->tr, blk->se,
+                                 blk->data, blk->size, blk->read_result);
+}
+
+static int pipeline_decode(void *context, blockpipe_block *blk)
+{
+    unsigned char block[BLOCKSIZE];
+    int st;
+
+    /* decoding here lets the caller already read the next block */
+    st = gcr_decode(blk->data, block);
+    memcpy(blk->data, block, BLOCKSIZE);
+    blk->size = BLOCKSIZE;
+    return st;
+}
+
+
+/*
+ * evaluate the blocks written by the pipeline, until no more than
+ * max_pending blocks are left in there
+ */
+static void collect_blocks(d64copy_job *job, blockpipe *pipe, int max_pending,
+                           d64copy_status *status, char *trackmap,
+                           unsigned char *errors, int retry_count, int *cnt)
+{
+    blockpipe_block done;
+
+    while(blockpipe_get(pipe, &done, blockpipe_pending(pipe) > max_pending))
+    {
+        finish_block(job, status, trackmap, errors, retry_count, cnt,
+                     done.tr, done.se, done.read_result, done.write_result);
+    }
+}
+
+
+/*
+ * the time of one revolution, from the times the blocks of a track
+ * arrive in warp mode. The drive sends every block as soon as it has
+ * read it, so the time between two blocks is the angle between their
+ * sectors, plus the whole revolutions the drive and the host needed in
+ * between; these are counted from the nominal speed.
+ */
+#define NOMINAL_REVOLUTION_US 200000.0
+
+typedef struct
+{
+    int have_last;      /* != 0: the last block belongs to this pass */
+    int last_se;
+    double last_us;
+    double time_us;
+    double revolutions;
+} revolution_timer;
+
+static void revolution_track_start(revolution_timer *r)
+{
+    memset(r, 0, sizeof(*r));
+}
+
+static void revolution_pass_start(revolution_timer *r)
+{
+    /* the drive has been waiting for the trackmap in between */
+    r->have_last = 0;
+}
+
+static int revolution_block(revolution_timer *r, int se, int sectors)
+{
+    double now = arch_time_us();
+    double dt, angle, whole;
+
+    if(r->have_last)
+    {
+        dt = now - r->last_us;
+        angle = (double) ((se - r->last_se + sectors) % sectors) / sectors;
+        whole = dt / NOMINAL_REVOLUTION_US - angle + 0.5;
+        angle += whole < 0 ? -1 : (int) whole;
+
+        /* longer stalls cannot be counted reliably */
+        if(angle > 0 && dt < 4 * NOMINAL_REVOLUTION_US)
+        {
+            r->time_us += dt;
+            r->revolutions += angle;
+        }
+    }
+    r->have_last = 1;
+    r->last_se = se;
+    r->last_us = now;
+
+    return r->revolutions >= 0.5 ? (int) (r->time_us / r->revolutions + 0.5) : 0;
+}
+
+/*
+ * the track to go on with in copy_disk_session(). With deferred retries,
+ * the tracks are taken once more after the last one, for the retries of
+ * the blocks which have failed, if there are any.
+ */
+static int next_copy_track(const d64copy_settings *settings,
+                           const char *deferred, int max_tracks,
+                           int tr, int *retry_round,
+                           d64copy_message_cb message_cb)
+{
+    int t;
+
+    tr = d64copy_next_track(settings->two_sided, tr);
+    if(tr > max_tracks && !*retry_round)
+    {
+        for(t = 0; t < max_tracks; t++)
+        {
+            if(deferred[t])
+            {
+                message_cb(2, "retrying the blocks which have failed");
+                *retry_round = 1;
+                return 1;
+            }
+        }
+    }
+    return tr;
+}
+
+static int copy_disk_session(d64copy_job *job, CBM_FILE fd_cbm, d64copy_settings *settings,
               const transfer_funcs *src, const void *src_arg,
               const transfer_funcs *dst, const void *dst_arg, unsigned char cbm_drive)
 {
@@ -199,8 +611,16 @@ static int copy_disk(CBM_FILE fd_cbm, d64copy_settings *settings,
     unsigned char scnt = 0;
     unsigned char errors;
     int retry_count;
+    int pass, attempted;
+    int decode_st;
+    int decode_gcr = 0;
     int resend_trackmap;
     int max_tracks;
+    int last_sectors = 0;
+    int last_se = 0;
+    int retry_round = 0;
+    int deferring;
+    char deferred[MAX_TRACKS];
     char trackmap[MAX_SECTORS+1];
     char buf[40];
     unsigned const char *bam_ptr;
@@ -208,10 +628,25 @@ static int copy_disk(CBM_FILE fd_cbm, d64copy_settings *settings,
     unsigned char bam2[BLOCKSIZE];
     unsigned char block[BLOCKSIZE];
     unsigned char gcr[GCRBUFSIZE];
+    unsigned char track_gcr[MAX_SECTORS][GCRBUFSIZE];
+    int track_result[MAX_SECTORS];
+    int pre_encoded;
+    unsigned char i;
     const transfer_funcs *cbm_transf = NULL;
+    d64copy_disk src_disk, dst_disk;
+    blockpipe *pipe = NULL;
+    d64copy_adaptive adaptive;
+    revolution_timer revolution;
+    d64copy_message_cb message_cb = job->message_cb;
+    d64copy_status_cb status_cb = job->status_cb;
     d64copy_status status;
+    char unchanged[MAX_TRACKS][MAX_SECTORS+1];
+    int update = 0;
+    int default_interleave_used;
     const char *sector_map;
     const char *type_str = "*unknown*";
+    turbo_start dst_start = start_turbo;
+    int drv_type;
 
     if(settings->two_sided)
     {
@@ -246,6 +681,7 @@ static int copy_disk(CBM_FILE fd_cbm, d64copy_settings *settings,
         return -1;
     }
 
+    default_interleave_used = settings->interleave == -1;
     if(settings->interleave == -1)
     {
         settings->interleave = (dst->is_cbm_drive && settings->warp) ?
@@ -274,6 +710,9 @@ static int copy_disk(CBM_FILE fd_cbm, d64copy_settings *settings,
             case cbm_dt_cbm1581:
                 message_cb( 0, "1581 drives are not supported" );
                 return -1;
+            case cbm_dt_sd2iec:
+                /* fine, only without turbo */
+                break;
             default:
                 message_cb( 1, "Unknown drive, assuming 1541" );
                 settings->drive_type = cbm_dt_cbm1541;
@@ -294,6 +733,7 @@ static int copy_disk(CBM_FILE fd_cbm, d64copy_settings *settings,
         case cbm_dt_cbm1541: type_str = "1541"; break;
         case cbm_dt_cbm1570: type_str = "1570"; break;
         case cbm_dt_cbm1571: type_str = "1571"; break;
+        case cbm_dt_sd2iec:  type_str = "SD2IEC"; break;
         default: /* impossible */ break;
     }
 
@@ -325,7 +765,30 @@ static int copy_disk(CBM_FILE fd_cbm, d64copy_settings *settings,
     SETSTATEDEBUG((void)0);
     cbm_transf = src->is_cbm_drive ? src : dst;
 
-    if(settings->warp && (cbm_transf->read_gcr_block == NULL))
+    if(settings->drive_type == cbm_dt_sd2iec)
+    {
+        /*
+         * The SD2IEC runs no drive code, but it has no disk to wait
+         * for either: the blocks are read and written in their order.
+         */
+        if(cbm_transf->needs_turbo)
+        {
+            message_cb(0, "a SD2IEC needs the original transfer");
+            return -1;
+        }
+        if(settings->two_sided)
+        {
+            message_cb(0, ".d71 transfer requires a 1571 drive");
+            return -1;
+        }
+        if(default_interleave_used)
+        {
+            settings->interleave = 1;
+        }
+        settings->warp = 0;
+    }
+
+    if(settings->warp && (cbm_transf->read_gcr_raw == NULL))
     {
         if(settings->warp>0)
             message_cb(1, "`-w' for this transfer mode ignored");
@@ -334,15 +797,55 @@ static int copy_disk(CBM_FILE fd_cbm, d64copy_settings *settings,
 
     settings->warp = settings->warp ? 1 : 0;
 
+    if(settings->update)
+    {
+        memset(unchanged, 0, sizeof(unchanged));
+        if(src->is_cbm_drive && !dst->is_cbm_drive &&
+           strcmp((const char *) dst_arg, "-") != 0)
+        {
+            /* this needs the DOS, thus, before the turbo is there */
+            SETSTATEDEBUG((void)0);
+            update = d64copy_update_scan(fd_cbm, cbm_drive, settings,
+                                         (const char *) dst_arg, unchanged,
+                                         message_cb) > 0;
+        }
+        else if(dst->is_cbm_drive && !src->is_cbm_drive &&
+                strcmp((const char *) src_arg, "-") != 0)
+        {
+            /* the same the other way round: the disk is updated */
+            SETSTATEDEBUG((void)0);
+            update = d64copy_update_scan(fd_cbm, cbm_drive, settings,
+                                         (const char *) src_arg, unchanged,
+                                         message_cb) > 0;
+        }
+        else
+        {
+            message_cb(1, "only an image file and a disk in a drive can be updated");
+        }
+    }
+    if(job->unchanged)
+    {
+        /* the blocks to be written again after verifying */
+        memcpy(unchanged, job->unchanged, sizeof(unchanged));
+        update = 1;
+    }
+
     if(cbm_transf->needs_turbo)
     {
+        drv_type = settings->drive_type == cbm_dt_cbm1541 ? 0 : 1;
+        if(turbo_address(dst->is_cbm_drive, settings->warp, drv_type) == 0x600)
+        {
+            dst_start = start_turbo_buffer3;
+        }
+        seek_ahead(fd_cbm, cbm_drive, (unsigned char) settings->start_track);
         SETSTATEDEBUG((void)0);
         send_turbo(fd_cbm, cbm_drive, dst->is_cbm_drive, settings->warp,
-                   settings->drive_type == cbm_dt_cbm1541 ? 0 : 1);
+                   drv_type);
+        seek_wait(fd_cbm, cbm_drive);
     }
 
     SETSTATEDEBUG((void)0);
-    if(src->open_disk(fd_cbm, settings, src_arg, 0,
+    if(src->open_disk(&src_disk, fd_cbm, settings, src_arg, 0,
                       start_turbo, message_cb) == 0)
     {
         if(settings->end_track == -1)
@@ -351,12 +854,14 @@ static int copy_disk(CBM_FILE fd_cbm, d64copy_settings *settings,
                 settings->two_sided ? D71_TRACKS : STD_TRACKS;
         }
         SETSTATEDEBUG((void)0);
-        if(dst->open_disk(fd_cbm, settings, dst_arg, 1,
-                          start_turbo, message_cb) != 0)
+        if(dst->open_disk(&dst_disk, fd_cbm, settings, dst_arg, 1,
+                          dst_start, message_cb) != 0)
         {
             message_cb(0, "can't open destination");
+            src->close_disk(src_disk);
             return -1;
         }
+        job->dst_disk = dst_disk;
     }
     else
     {
@@ -374,20 +879,20 @@ static int copy_disk(CBM_FILE fd_cbm, d64copy_settings *settings,
             trackmap[0] = bs_must_copy;
             scnt = 1;
             SETSTATEDEBUG((void)0);
-            src->send_track_map(18, trackmap, scnt);
+            src->send_track_map(src_disk, 18, trackmap, scnt);
             SETSTATEDEBUG(DebugBlockCount=0);
-            st = src->read_gcr_block(&se, gcr);
+            st = src->read_gcr_raw(src_disk, &se, gcr, &decode_st);
             SETSTATEDEBUG(DebugBlockCount=-1);
-            if(st == 0) st = gcr_decode(gcr, bam);
+            if(st == 0) st = gcr_block(gcr, bam, decode_st);
         }
         else
         {
             SETSTATEDEBUG(DebugBlockCount=0);
-            st = src->read_block(18, 0, bam);
+            st = src->read_block(src_disk, 18, 0, bam);
             if(settings->two_sided && (st == 0))
             {
                 SETSTATEDEBUG(DebugBlockCount=1);
-                st = src->read_block(53, 0, bam2);
+                st = src->read_block(src_disk, 53, 0, bam2);
             }
             SETSTATEDEBUG(DebugBlockCount=-1);
         }
@@ -441,55 +946,200 @@ static int copy_disk(CBM_FILE fd_cbm, d64copy_settings *settings,
 
     status.settings = settings;
 
-    status_cb(status);
+    if(settings->resume && dst->block_done)
+    {
+        /* skip the blocks an earlier copy to this image has already done */
+        int done = 0;
+
+        for(tr = settings->start_track; tr <= settings->end_track; tr++)
+        {
+            for(se = 0; se < sector_map[tr]; se++)
+            {
+                if(status.bam[tr-1][se] == bs_must_copy &&
+                   dst->block_done(dst_disk, (unsigned char) tr, se))
+                {
+                    status.bam[tr-1][se] = bs_copied;
+                    status.sectors_processed++;
+                    done++;
+                }
+            }
+        }
+        cnt += done;
+        message_cb(2, "resuming: %d sectors already copied", done);
+    }
+
+    if(update)
+    {
+        /*
+         * the destination has these blocks already; an image gets them
+         * written again to mark them as good in its error map, a disk
+         * does not get them at all
+         */
+        for(tr = settings->start_track; tr <= settings->end_track; tr++)
+        {
+            for(se = 0; se < sector_map[tr]; se++)
+            {
+                if(status.bam[tr-1][se] == bs_must_copy && unchanged[tr-1][se] &&
+                   (dst->is_cbm_drive ||
+                    (dst->read_block(dst_disk, tr, se, block) == 0 &&
+                     dst->write_block(dst_disk, tr, se, block, BLOCKSIZE, 0) == 0)))
+                {
+                    status.bam[tr-1][se] = bs_copied;
+                    status.sectors_processed++;
+                    cnt++;
+                }
+            }
+        }
+    }
+
+    status_cb(&status);
 
     message_cb(2, "copying tracks %d-%d (%d sectors)",
             settings->start_track, settings->end_track, status.total_sectors);
 
+    if(!dst->is_cbm_drive)
+    {
+        /* write the image while the next blocks are read from the drive */
+        pipe = blockpipe_start(pipeline_write, pipeline_decode, job);
+        job->pipeline = pipe;
+    }
+
+    memset(deferred, 0, sizeof(deferred));
+
+    /* the interleave is not used when reading in warp mode */
+    d64copy_adaptive_init(&adaptive, settings,
+                          dst->is_cbm_drive || !settings->warp);
+
     SETSTATEDEBUG(DebugBlockCount=0);
-    for(tr = 1; tr <= max_tracks; tr++)
+    for(tr = 1; tr <= max_tracks;
+        tr = (unsigned char) next_copy_track(settings, deferred, max_tracks, tr,
+                                             &retry_round, message_cb))
     {
+        /*
+         * between two tracks, the drive waits for the next command, so
+         * the turbo can be ended the usual way below
+         */
+        if(d64copy_aborted())
+        {
+            message_cb(1, "aborted before track %d", tr);
+            cnt = -1;
+            break;
+        }
+
         if(tr >= settings->start_track && tr <= settings->end_track)
         {
             scnt = sector_map[tr];
             memcpy(trackmap, status.bam[tr-1], scnt);
-            if(settings->bam_mode != bm_ignore)
+            for(se = 0; se < sector_map[tr]; se++)
             {
-                for(se = 0; se < sector_map[tr]; se++)
+                if(!NEED_SECTOR(trackmap[se]))
                 {
-                    if(trackmap[se] != bs_must_copy)
-                    {
-                        scnt--;
-                    }
+                    scnt--;
                 }
             }
+            if(retry_round && !deferred[tr-1])
+            {
+                continue;
+            }
 
-            retry_count = settings->retries;
+            /*
+             * Without warp, the sectors are asked for one by one. Start
+             * where the last track has stopped in its rotation, scaled to
+             * the sectors of this one, instead of waiting for sector 0.
+             */
+            se = last_sectors ? (unsigned char) (last_se * sector_map[tr] / last_sectors) : 0;
+            if(se >= sector_map[tr])
+            {
+                se = (unsigned char) (sector_map[tr] - 1);
+            }
+            last_sectors = sector_map[tr];
+
+            revolution_track_start(&revolution);
+            status.revolution_us = 0;
+
+            retry_count = d64copy_adaptive_retries(&adaptive, settings->retries,
+                                                   message_cb);
+            pass = 0;
+            /* the retries come after the first pass of all tracks */
+            deferring = !retry_round && settings->defer_retries &&
+                        retry_count > 0;
+            if(retry_round)
+            {
+                /* the first pass has been done in the first round */
+                if(--retry_count < 0)
+                {
+                    status.sectors_processed += scnt;
+                    message_cb(1, "giving up...");
+                    continue;
+                }
+                pass = 1;
+                if(adaptive.interleave >= sector_map[tr])
+                {
+                    adaptive.interleave = sector_map[tr] - 1;
+                }
+            }
+            else
+            {
+                d64copy_adaptive_track_start(&adaptive, sector_map[tr]);
+            }
             do
             {
+                attempted = scnt;
                 errors = resend_trackmap = 0;
                 if(scnt && settings->warp && src->is_cbm_drive)
                 {
                     SETSTATEDEBUG((void)0);
-                    src->send_track_map(tr, trackmap, scnt);
+                    src->send_track_map(src_disk, tr, trackmap, scnt);
+                    revolution_pass_start(&revolution);
                 }
-                else
+                /*
+                 * else: a retry pass goes on from the sector after the
+                 * last one, the first of the failed ones to come by
+                 */
+
+                /*
+                 * Warp writing from an image: read and encode all blocks
+                 * of the track now, so the drive gets the next block as
+                 * soon as it asks for it.
+                 */
+                pre_encoded = settings->warp && dst->is_cbm_drive &&
+                              !src->is_cbm_drive;
+                for(i = 0; pre_encoded && i < sector_map[tr]; i++)
                 {
-                    se = 0;
+                    if(NEED_SECTOR(trackmap[i]))
+                    {
+                        track_result[i] = src->read_block(src_disk, tr, i, block);
+                        gcr_encode(block, track_gcr[i]);
+                    }
                 }
                 while(scnt && !resend_trackmap)
                 {
                     if(settings->warp && src->is_cbm_drive)
                     {
                         SETSTATEDEBUG((void)0);
-                        status.read_result = src->read_gcr_block(&se, gcr);
+                        status.read_result = src->read_gcr_raw(src_disk, &se, gcr, &decode_st);
                         if(status.read_result == 0)
                         {
+                            status.revolution_us =
+                                revolution_block(&revolution, se, sector_map[tr]);
                             SETSTATEDEBUG((void)0);
-                            status.read_result = gcr_decode(gcr, block);
+                            if(pipe && decode_st == GCR_NOT_DECODED)
+                            {
+                                /* the pipeline decodes it */
+                                decode_gcr = 1;
+                            }
+                            else
+                            {
+                                status.read_result = gcr_block(gcr, block, decode_st);
+                            }
                         }
                         else
                         {
+                            if(pipe)
+                            {
+                                collect_blocks(job, pipe, 0, &status, trackmap,
+                                               &errors, retry_count, &cnt);
+                            }
                             /* mark all sectors not received so far */
                             /* ugly */
                             errors = 0;
@@ -508,116 +1158,139 @@ static int copy_disk(CBM_FILE fd_cbm, d64copy_settings *settings,
                     {
                         while(!NEED_SECTOR(trackmap[se]))
                         {
+                            if(pipe && trackmap[se] == bs_invalid)
+                            {
+                                /* still in the pipeline, wait for the result */
+                                collect_blocks(job, pipe, 0, &status, trackmap,
+                                               &errors, retry_count, &cnt);
+                                continue;
+                            }
                             if(++se >= sector_map[tr]) se = 0;
                         }
                         SETSTATEDEBUG(DebugBlockCount++);
-                        status.read_result = src->read_block(tr, se, block);
+                        if(pre_encoded)
+                        {
+                            status.read_result = track_result[se];
+                        }
+                        else
+                        {
+                            status.read_result = src->read_block(src_disk, tr, se, block);
+                        }
+                        last_se = se;
                     }
 
-                    if(settings->warp && dst->is_cbm_drive)
-                    {
-                        SETSTATEDEBUG((void)0);
-                        gcr_encode(block, gcr);
-                        SETSTATEDEBUG(DebugBlockCount++);
-                        status.write_result =
-                            dst->write_block(tr, se, gcr, GCRBUFSIZE-1,
-                                             status.read_result);
-                    }
-                    else
+                    if(pipe)
                     {
                         SETSTATEDEBUG(DebugBlockCount++);
-                        status.write_result =
-                            dst->write_block(tr, se, block, BLOCKSIZE,
-                                             status.read_result);
-                    }
-                    SETSTATEDEBUG((void)0);
-
-                    if(status.read_result)
-                    {
-                        /* read error */
-                        trackmap[se] = bs_error;
-                        errors++;
-                        if(retry_count == 0)
+                        /* mark the sector as being in the pipeline */
+                        trackmap[se] = bs_invalid;
+                        if(decode_gcr)
+                        {
+                            blockpipe_put(pipe, tr, se, gcr, GCRBUFSIZE, 0, 1);
+                            decode_gcr = 0;
+                        }
+                        else
                         {
-                            status.sectors_processed++;
-                            /* FIXME: shall we get rid of this? */
-                            message_cb( 1, "read error: %02x/%02x: %d",
-                                        tr, se, status.read_result );
+                            blockpipe_put(pipe, tr, se, block, BLOCKSIZE,
+                                          status.read_result, 0);
                         }
+                        collect_blocks(job, pipe, D64COPY_PIPELINE_DEPTH - 1,
+                                       &status, trackmap, &errors,
+                                       retry_count, &cnt);
                     }
                     else
                     {
-                        /* successfull read */
-                        if(status.write_result)
+                        if(pre_encoded)
                         {
-                            /* write error */
-                            trackmap[se] = bs_error;
-                            errors++;
-                            if(retry_count == 0)
-                            {
-                                status.sectors_processed++;
-                                /* FIXME: shall we get rid of this? */
-                                message_cb(1, "write error: %02x/%02x: %d",
-                                           tr, se, status.write_result);
-                            }
+                            SETSTATEDEBUG(DebugBlockCount++);
+                            status.write_result =
+                                dst->write_block(dst_disk, tr, se, track_gcr[se],
+                                                 GCRBUFSIZE-1, status.read_result);
+                        }
+                        else if(settings->warp && dst->is_cbm_drive)
+                        {
+                            SETSTATEDEBUG((void)0);
+                            gcr_encode(block, gcr);
+                            SETSTATEDEBUG(DebugBlockCount++);
+                            status.write_result =
+                                dst->write_block(dst_disk, tr, se, gcr, GCRBUFSIZE-1,
+                                                 status.read_result);
                         }
                         else
                         {
-                            /* successfull read and write, mark sector */
-                            trackmap[se] = bs_copied;
-                            cnt++;
-                            status.sectors_processed++;
+                            SETSTATEDEBUG(DebugBlockCount++);
+                            status.write_result =
+                                dst->write_block(dst_disk, tr, se, block, BLOCKSIZE,
+                                                 status.read_result);
                         }
+                        SETSTATEDEBUG((void)0);
+
+                        finish_block(job, &status, trackmap, &errors, retry_count,
+                                     &cnt, tr, se, status.read_result,
+                                     status.write_result);
                     }
+
                     /* remaining sectors on this track */
                     if(!resend_trackmap)
                     {
                         scnt--;
                     }
 
-                    status.track = tr;
-                    status.sector= se;
-
-                    status_cb(status);
-
                     if(dst->is_cbm_drive || !settings->warp)
                     {
-                        se += (unsigned char) settings->interleave;
+                        se += (unsigned char) adaptive.interleave;
                         if(se >= sector_map[tr]) se -= sector_map[tr];
                     }
                 }
+                if(pipe)
+                {
+                    collect_blocks(job, pipe, 0, &status, trackmap,
+                                   &errors, retry_count, &cnt);
+                }
+                d64copy_adaptive_pass_done(&adaptive, attempted, errors);
                 if(errors > 0 && settings->retries >= 0)
                 {
-                    retry_count--;
+                    if(pass == 0 ||
+                       d64copy_adaptive_retry_done(&adaptive, attempted, errors))
+                    {
+                        retry_count--;
+                    }
                     scnt = errors;
                 }
+                pass++;
             }
-            while(retry_count >= 0 && errors > 0);
-            if(errors)
+            while(retry_count >= 0 && errors > 0 && !deferring);
+            if(errors && deferring)
             {
-                message_cb(1, "giving up...");
+                deferred[tr-1] = 1;
             }
-        }
-        if(settings->two_sided)
-        {
-            if(tr <= STD_TRACKS)
+            else if(errors)
             {
-                if(tr + STD_TRACKS <= D71_TRACKS)
-                {
-                    tr += (STD_TRACKS - 1);
-                }
+                message_cb(1, "giving up...");
             }
-            else if(tr != D71_TRACKS)
+            if(!retry_round)
             {
-                tr -= STD_TRACKS;
+                d64copy_adaptive_track_done(&adaptive, message_cb);
             }
         }
     }
     SETSTATEDEBUG(DebugBlockCount=-1);
 
-    dst->close_disk();
+    if(pipe)
+    {
+        job->pipeline = NULL;
+        blockpipe_stop(pipe);
+    }
+
+    job->dst_disk = NULL;
+    dst->close_disk(dst_disk);
     SETSTATEDEBUG((void)0);
-    src->close_disk();
+    src->close_disk(src_disk);
+
+    if(job->written)
+    {
+        memcpy(job->written, status.bam, sizeof(status.bam));
+    }
 
     SETSTATEDEBUG((void)0);
     return cnt;
@@ -636,6 +1309,7 @@ transfers[] =
     { &d64copy_s1_transfer, "serial1", "s1" },
     { &d64copy_s2_transfer, "serial2", "s2" },
     { &d64copy_pp_transfer, "parallel", "p%" },
+    { &d64copy_p2_transfer, "parallel2", "p2" },
     { NULL, NULL, NULL }
 };
 
@@ -669,6 +1343,33 @@ char *d64copy_get_transfer_modes()
 }
 
 
+/*
+ * copy the disk in one session on the handle: the many small
+ * operations of the transfer do not need to look it up again
+ */
+static int copy_disk(d64copy_job *job, CBM_FILE fd_cbm, d64copy_settings *settings,
+              const transfer_funcs *src, const void *src_arg,
+              const transfer_funcs *dst, const void *dst_arg, unsigned char cbm_drive)
+{
+    int session;
+    int ret;
+
+    if(d64copy_aborted())
+    {
+        return -1;
+    }
+
+    session = cbm_session_begin(fd_cbm) == 0;
+    ret = copy_disk_session(job, fd_cbm, settings, src, src_arg, dst, dst_arg, cbm_drive);
+
+    if(session)
+    {
+        cbm_session_end(fd_cbm);
+    }
+
+    return ret;
+}
+
 int d64copy_get_transfer_mode_index(const char *name)
 {
     const struct _transfers *t;
@@ -709,6 +1410,125 @@ int d64copy_get_transfer_mode_index(const char *name)
     return -1;
 }
 
+/* the number of blocks of track 18 read to measure a transfer mode */
+#define AUTO_MEASURE_BLOCKS 8
+
+static void measure_message_cb(int severity, const char *format, ...)
+{
+    /* a transfer mode which fails to measure is just not chosen */
+}
+
+/*
+ * read AUTO_MEASURE_BLOCKS blocks of track 18 with the given transfer
+ * mode, with its default interleave, and tell how long it took. If
+ * verify is set, the blocks have to match the ones in blocks, else,
+ * they are stored there.
+ */
+static int measure_transfer_mode(CBM_FILE fd, unsigned char drive, int mode,
+                                 enum cbm_device_type_e drive_type,
+                                 unsigned char blocks[][BLOCKSIZE],
+                                 int verify, double *us)
+{
+    const transfer_funcs *trf = transfers[mode].trf;
+    d64copy_settings settings;
+    d64copy_disk disk;
+    unsigned char block[BLOCKSIZE];
+    unsigned char se = 0;
+    double start;
+    int i, rv = 0;
+
+    memset(&settings, 0, sizeof(settings));
+    settings.end_track  = STD_TRACKS;
+    settings.drive_type = drive_type;
+
+    if(trf->needs_turbo)
+    {
+        SETSTATEDEBUG((void)0);
+        send_turbo(fd, drive, 0, 0, drive_type == cbm_dt_cbm1541 ? 0 : 1);
+    }
+
+    SETSTATEDEBUG((void)0);
+    if(trf->open_disk(&disk, fd, &settings, (void*)(ULONG_PTR)drive, 0,
+                      start_turbo, measure_message_cb) != 0)
+    {
+        return 1;
+    }
+
+    start = arch_time_us();
+    for(i = 0; i < AUTO_MEASURE_BLOCKS && rv == 0; i++)
+    {
+        SETSTATEDEBUG((void)0);
+        rv = trf->read_block(disk, 18, se, block);
+        if(rv == 0)
+        {
+            if(verify)
+                rv = memcmp(block, blocks[i], BLOCKSIZE) != 0;
+            else
+                memcpy(blocks[i], block, BLOCKSIZE);
+        }
+        se = (unsigned char) ((se + default_interleave[mode]) % d64_sector_map[18]);
+    }
+    *us = arch_time_us() - start;
+
+    SETSTATEDEBUG((void)0);
+    trf->close_disk(disk);
+
+    return rv;
+}
+
+/*
+ * measure the candidates on the disk in the drive, and return the one
+ * which read the test blocks correctly in the shortest time. If there
+ * is no disk which can be read, the first candidate is returned.
+ */
+static int measure_transfer_modes(CBM_FILE fd, unsigned char drive,
+                                  const int *candidates, int count)
+{
+    enum cbm_device_type_e drive_type;
+    unsigned char reference[AUTO_MEASURE_BLOCKS][BLOCKSIZE];
+    char buf[48];
+    double us, best_us;
+    int i, best;
+
+    SETSTATEDEBUG((void)0);
+    if(cbm_identify(fd, drive, &drive_type, NULL) != 0)
+        return candidates[0];
+
+    switch(drive_type)
+    {
+        case cbm_dt_cbm1541:
+        case cbm_dt_cbm1570:
+        case cbm_dt_cbm1571:
+            break;
+        default:
+            return candidates[0];
+    }
+
+    SETSTATEDEBUG((void)0);
+    cbm_exec_command(fd, drive, "I0:", 0);
+    if(cbm_device_status(fd, drive, buf, sizeof(buf)) != 0)
+        return candidates[0];
+
+    /* the original transfer reads the blocks the others must match */
+    best = d64copy_get_transfer_mode_index("original");
+    if(measure_transfer_mode(fd, drive, best, drive_type,
+                             reference, 0, &best_us) != 0)
+        return candidates[0];
+
+    for(i = 0; i < count; i++)
+    {
+        if(measure_transfer_mode(fd, drive, candidates[i], drive_type,
+                                 reference, 1, &us) == 0 && us < best_us)
+        {
+            best = candidates[i];
+            best_us = us;
+        }
+    }
+
+    SETSTATEDEBUG((void)0);
+    return best;
+}
+
 int d64copy_check_auto_transfer_mode(CBM_FILE cbm_fd, int auto_transfermode, int drive)
 {
     int transfermode = auto_transfermode;
@@ -718,6 +1538,18 @@ int d64copy_check_auto_transfer_mode(CBM_FILE cbm_fd, int auto_transfermode, int
 
     if (auto_transfermode == 0)
     {
+        int candidates[3];
+        int count = 0;
+        enum cbm_device_type_e drive_type;
+
+        /* a SD2IEC runs no drive code, there is nothing to choose */
+        SETSTATEDEBUG((void)0);
+        if (cbm_identify(cbm_fd, (unsigned char)drive, &drive_type, NULL) == 0
+            && drive_type == cbm_dt_sd2iec)
+        {
+            return d64copy_get_transfer_mode_index("original");
+        }
+
         do {
             enum cbm_cable_type_e cable_type;
             unsigned char testdrive;
@@ -732,10 +1564,10 @@ int d64copy_check_auto_transfer_mode(CBM_FILE cbm_fd, int auto_transfermode, int
                 if (cable_type == cbm_ct_xp1541)
                 {
                     /*
-                     * We have a parallel cable, use that
+                     * We have a parallel cable, that is a candidate
                      */
                     SETSTATEDEBUG((void)0);
-                    transfermode = d64copy_get_transfer_mode_index("parallel");
+                    candidates[count++] = d64copy_get_transfer_mode_index("parallel");
                     break;
                 }
             }
@@ -759,22 +1591,30 @@ int d64copy_check_auto_transfer_mode(CBM_FILE cbm_fd, int auto_transfermode, int
                     /*
                      * My bad, there is another drive -> only use serial1
                      */
-                    SETSTATEDEBUG((void)0);
-                    transfermode = d64copy_get_transfer_mode_index("serial1");
                     break;
                 }
             }
 
             /*
-             * If we reached here with transfermode 0, we are the only
-             * drive, thus, use serial2.
+             * If we did not find another drive, we can use serial2.
              */
             SETSTATEDEBUG((void)0);
-            if (transfermode == 0)
-                transfermode = d64copy_get_transfer_mode_index("serial2");
+            if (testdrive == 31)
+                candidates[count++] = d64copy_get_transfer_mode_index("serial2");
             SETSTATEDEBUG((void)0);
 
         } while (0);
+
+        /* serial1 works with every cable and every number of drives */
+        candidates[count++] = d64copy_get_transfer_mode_index("serial1");
+
+        /*
+         * The checks above only tell which modes can work. Which one
+         * is the fastest depends on the adapter and the drive, thus,
+         * measure them.
+         */
+        transfermode = measure_transfer_modes(cbm_fd, (unsigned char)drive,
+                                              candidates, count);
     }
 
     SETSTATEDEBUG((void)0);
@@ -790,22 +1630,117 @@ int d64copy_read_image(CBM_FILE cbm_fd,
 {
     const transfer_funcs *src;
     const transfer_funcs *dst;
+    d64copy_job job;
     int ret;
 
-    message_cb = msg_cb;
-    status_cb = stat_cb;
+    memset(&job, 0, sizeof(job));
+    job.message_cb = msg_cb;
+    job.status_cb = stat_cb;
 
     src = transfers[settings->transfer_mode].trf;
-    dst = &d64copy_fs_transfer;
+    dst = d64copy_image_transfer(dst_image);
 
-    atom_dst = dst;
-    atom_mustcleanup = 1;
+    if(dst != &d64copy_fs_transfer && settings->update)
+    {
+        msg_cb(1, "a .g64 or .ddi image cannot be updated, copying all blocks");
+        settings->update = 0;
+    }
+
+    if(settings->extract)
+    {
+        /* passes the blocks on to the transfer of the image */
+        dst = &d64copy_extract_transfer;
+    }
+
+    job.dst = dst;
+    job.must_cleanup = 1;
+    job_register(&job);
 
     SETSTATEDEBUG((void)0);
-    ret = copy_disk(cbm_fd, settings,
+    ret = copy_disk(&job, cbm_fd, settings,
             src, (void*)(ULONG_PTR)src_drive, dst, (void*)dst_image, (unsigned char) src_drive);
 
-    atom_mustcleanup = 0;
+    job_unregister(&job);
+
+    return ret;
+}
+
+/*
+ * writes the image, then has the drive verify every block written, from
+ * checksums of the blocks in the drive as with update. The blocks which
+ * differ are written and verified again, as often as the retry count
+ * says, but once at least.
+ */
+static int write_verified(d64copy_job *job, CBM_FILE cbm_fd,
+                          d64copy_settings *settings,
+                          const transfer_funcs *src, const char *src_image,
+                          const transfer_funcs *dst, unsigned char dst_drive)
+{
+    d64copy_settings s;
+    char check[MAX_TRACKS][MAX_SECTORS+1];
+    char same[MAX_TRACKS][MAX_SECTORS+1];
+    int tr, se, ret, bad, round;
+
+    memset(check, bs_invalid, sizeof(check));
+    job->written = check;
+    ret = copy_disk(job, cbm_fd, settings,
+            src, (void*)src_image, dst, (void*)(ULONG_PTR)dst_drive, dst_drive);
+    job->written = NULL;
+    if(ret < 0)
+    {
+        return ret;
+    }
+
+    for(tr = 0; tr < MAX_TRACKS; tr++)
+    {
+        for(se = 0; se <= MAX_SECTORS; se++)
+        {
+            check[tr][se] = check[tr][se] == bs_copied;
+        }
+    }
+
+    /* a block which is written again must not be looked for as unchanged */
+    s = *settings;
+    s.update = 0;
+    s.resume = 0;
+
+    job->message_cb(2, "verifying");
+    for(round = 0; !d64copy_aborted(); round++)
+    {
+        bad = d64copy_verify_scan(cbm_fd, dst_drive, settings, src_image,
+                                  check, job->message_cb);
+        if(bad <= 0)
+        {
+            if(bad == 0)
+            {
+                job->message_cb(2, "verify: all %d sectors fine", ret);
+            }
+            break;
+        }
+        if(round >= (settings->retries > 0 ? settings->retries : 1))
+        {
+            job->message_cb(1, "verify: %d sectors differ, giving up...", bad);
+            ret -= bad;
+            break;
+        }
+
+        job->message_cb(1, "verify: writing %d sectors again", bad);
+        for(tr = 0; tr < MAX_TRACKS; tr++)
+        {
+            for(se = 0; se <= MAX_SECTORS; se++)
+            {
+                same[tr][se] = !check[tr][se];
+            }
+        }
+        job->unchanged = (const char (*)[MAX_SECTORS+1]) same;
+        bad = copy_disk(job, cbm_fd, &s,
+                src, (void*)src_image, dst, (void*)(ULONG_PTR)dst_drive, dst_drive);
+        job->unchanged = NULL;
+        if(bad < 0)
+        {
+            return bad;
+        }
+    }
 
     return ret;
 }
@@ -819,27 +1754,115 @@ int d64copy_write_image(CBM_FILE cbm_fd,
 {
     const transfer_funcs *src;
     const transfer_funcs *dst;
+    d64copy_job job;
 
-    message_cb = msg_cb;
-    status_cb = stat_cb;
+    memset(&job, 0, sizeof(job));
+    job.message_cb = msg_cb;
+    job.status_cb = stat_cb;
 
-    src = &d64copy_fs_transfer;
+    src = d64copy_image_transfer(src_image);
     dst = transfers[settings->transfer_mode].trf;
 
+    if(src != &d64copy_fs_transfer && settings->update)
+    {
+        msg_cb(1, "a disk cannot be updated from a .g64 or .ddi image, copying all blocks");
+        settings->update = 0;
+    }
+
+    /* the blocks are compared with the file, which must not be a stream */
+    if(settings->verify &&
+       (src != &d64copy_fs_transfer || strcmp(src_image, "-") == 0 ||
+        (strlen(src_image) > 3 &&
+         arch_strcasecmp(src_image + strlen(src_image) - 3, ".gz") == 0)))
+    {
+        msg_cb(1, "only a disk written from a .d64 or .d71 file can be verified");
+        settings->verify = 0;
+    }
+
+    SETSTATEDEBUG((void)0);
+    if(!settings->verify)
+    {
+        return copy_disk(&job, cbm_fd, settings,
+                src, (void*)src_image, dst, (void*)(ULONG_PTR)dst_drive, (unsigned char) dst_drive);
+    }
+    return write_verified(&job, cbm_fd, settings, src, src_image, dst,
+                          (unsigned char) dst_drive);
+}
+
+int d64copy_copy_disk(CBM_FILE cbm_fd,
+                      d64copy_settings *settings,
+                      int src_drive,
+                      int dst_drive,
+                      d64copy_message_cb msg_cb,
+                      d64copy_status_cb stat_cb)
+{
+    d64copy_job job;
+    d64copy_d2d d2d;
+    char buf[40];
+
+    memset(&job, 0, sizeof(job));
+    job.message_cb = msg_cb;
+    job.status_cb = stat_cb;
+
+    if(src_drive == dst_drive)
+    {
+        msg_cb(0, "source and target must be different drives");
+        return -1;
+    }
+
+    if(settings->transfer_mode != d64copy_get_transfer_mode_index("auto") &&
+       settings->transfer_mode != d64copy_get_transfer_mode_index("original"))
+    {
+        msg_cb(1, "drive to drive copy uses the original transfer");
+    }
+    settings->transfer_mode = d64copy_get_transfer_mode_index("original");
+    settings->warp = 0;
+
+    memset(&d2d, 0, sizeof(d2d));
+    d2d.src_drive = (unsigned char) src_drive;
+    d2d.dst_drive = (unsigned char) dst_drive;
+
+    /* copy_disk() only prepares the source */
+    SETSTATEDEBUG((void)0);
+    cbm_exec_command(cbm_fd, d2d.dst_drive, "I0:", 0);
+    if(cbm_device_status(cbm_fd, d2d.dst_drive, buf, sizeof(buf)) != 0)
+    {
+        msg_cb(0, "drive %02d: %s", dst_drive, buf);
+        return -1;
+    }
+    if(settings->two_sided)
+    {
+        cbm_exec_command(cbm_fd, d2d.dst_drive, "U0>M1", 0);
+    }
+
     SETSTATEDEBUG((void)0);
-    return copy_disk(cbm_fd, settings,
-            src, (void*)src_image, dst, (void*)(ULONG_PTR)dst_drive, (unsigned char) dst_drive);
+    return copy_disk(&job, cbm_fd, settings,
+            &d64copy_d2d_transfer, &d2d, &d64copy_d2d_transfer, &d2d,
+            (unsigned char) src_drive);
 }
 
 void d64copy_cleanup(void)
 {
+    d64copy_job *job;
+
     /* if we were interrupted writing to the fs, make sure to
      * write anything that has already been started
      */
 
-    if (atom_mustcleanup)
+    running_jobs_lock();
+    for (job = running_jobs; job; job = job->next)
     {
-        atom_dst->close_disk();
-        atom_mustcleanup = 0;
+        if (job->must_cleanup && job->dst_disk)
+        {
+            if (job->pipeline)
+            {
+                blockpipe_stop(job->pipeline);
+                job->pipeline = NULL;
+            }
+            job->dst->close_disk(job->dst_disk);
+            job->dst_disk = NULL;
+        }
+        job->must_cleanup = 0;
     }
+    running_jobs_unlock();
 }
@@ -13,6 +13,7 @@
 #include "opencbm.h"
 #include "d64copy.h"
 #include "gcr.h"
+#include "blockpipe.h"
 
 #include "arch.h"
 
@@ -40,18 +41,40 @@
 
 typedef int(*turbo_start)(CBM_FILE,unsigned char);
 
+/*
+ * every transfer keeps its state in a disk handle: open_disk() allocates
+ * it, all other functions get it as their first parameter, and close_disk()
+ * frees it. Thus, more than one disk can be copied at the same time.
+ */
+typedef void *d64copy_disk;
+
 typedef struct {
-    int  (*open_disk)(CBM_FILE,d64copy_settings*,const void*,int,
+    int  (*open_disk)(d64copy_disk*,CBM_FILE,d64copy_settings*,const void*,int,
                       turbo_start,d64copy_message_cb);
-    int  (*read_block)(unsigned char,unsigned char,unsigned char*);
-    int  (*write_block)(unsigned char,unsigned char,const unsigned char*,int,int);
-    void (*close_disk)(void);
+    int  (*read_block)(d64copy_disk,unsigned char,unsigned char,unsigned char*);
+    int  (*write_block)(d64copy_disk,unsigned char,unsigned char,const unsigned char*,int,int);
+    void (*close_disk)(d64copy_disk);
     int  is_cbm_drive;
     int  needs_turbo;
-    int  (*send_track_map)(unsigned char,const char*,unsigned char);
-    int  (*read_gcr_block)(unsigned char*,unsigned char*);
+    int  (*send_track_map)(d64copy_disk,unsigned char,const char*,unsigned char);
+    int  (*read_gcr_raw)(d64copy_disk,unsigned char*,unsigned char*,int*);
+    int  (*block_done)(d64copy_disk,unsigned char,unsigned char);
 } transfer_funcs;
 
+/*
+ * block_done() tells if a block has already been copied successfully by
+ * an earlier, interrupted copy. It is only available for image files.
+ */
+
+/*
+ * read_gcr_raw() gets the next block of the track from the drive.
+ * If the adapter decodes the GCR data itself, the buffer contains the
+ * decoded block, and the decode result is set. Otherwise, the buffer
+ * contains the GCRBUFSIZE bytes of GCR data, and the decode result is
+ * set to GCR_NOT_DECODED. The caller must gcr_decode() them then.
+ */
+#define GCR_NOT_DECODED (-1)
+
 #define DECLARE_TRANSFER_FUNCS(x,c,t) \
     transfer_funcs d64copy_ ## x = {open_disk, \
                         read_block, \
@@ -60,8 +83,20 @@ typedef struct {
                         c, \
                         t, \
                         NULL, \
+                        NULL, \
                         NULL}
 
+#define DECLARE_TRANSFER_FUNCS_IMAGE(x) \
+    transfer_funcs d64copy_ ## x = {open_disk, \
+                        read_block, \
+                        write_block, \
+                        close_disk, \
+                        0, \
+                        0, \
+                        NULL, \
+                        NULL, \
+                        block_done}
+
 #define DECLARE_TRANSFER_FUNCS_EX(x,c,t) \
     transfer_funcs d64copy_ ## x = {open_disk, \
                         read_block, \
@@ -70,6 +105,111 @@ typedef struct {
                         c, \
                         t, \
                         send_track_map, \
-                        read_gcr_block}
+                        read_gcr_raw, \
+                        NULL}
+
+/* the transfer for an image file, by the name of the image */
+extern const transfer_funcs *d64copy_image_transfer(const char *name);
+
+/*
+ * a drive to drive copy: both transfers share this. A block read from
+ * the source is in the buffer of the destination, too, if valid is set.
+ */
+typedef struct {
+    unsigned char src_drive;
+    unsigned char dst_drive;
+    unsigned char tr;
+    unsigned char se;
+    int valid;
+} d64copy_d2d;
+
+/*
+ * the track to go on with after this one. On a two sided disk, both
+ * sides of a track come before the head steps: 1, 36, 2, 37, ...
+ */
+extern int d64copy_next_track(int two_sided, int track);
+
+/* != 0 after d64copy_abort() */
+extern int d64copy_aborted(void);
+
+/* the CRC-32 of zip and gzip, and the one of two buffers one after the other */
+extern unsigned long d64copy_crc32(unsigned long crc, const unsigned char *buf, size_t len);
+extern unsigned long d64copy_crc32_combine(unsigned long crc1, unsigned long crc2, long len2);
+
+/* adds the image file to the zip archive container; returns != 0 on error */
+extern int d64copy_container_add(const char *container, const char *image,
+                                 d64copy_message_cb message_cb);
+
+/* number of blocks which can be in the pipeline at the same time */
+#define D64COPY_PIPELINE_DEPTH MAX_SECTORS
+
+/*
+ * for updating an image: mark the blocks which are the same on the disk
+ * as in the image, from checksums computed by the drive. returns their
+ * number. Must be called before any turbo is uploaded.
+ */
+extern int d64copy_update_scan(CBM_FILE fd, unsigned char drive,
+                               const d64copy_settings *settings,
+                               const char *image,
+                               char unchanged[][MAX_SECTORS+1],
+                               d64copy_message_cb message_cb);
+
+/*
+ * for verifying a disk written: compares the blocks set in check with the
+ * image, from checksums computed by the drive. The blocks which are fine
+ * are cleared in check, the others are reported; returns their number, -1
+ * if the disk could not be verified. Must be called without a turbo.
+ */
+extern int d64copy_verify_scan(CBM_FILE fd, unsigned char drive,
+                               const d64copy_settings *settings,
+                               const char *image,
+                               char check[][MAX_SECTORS+1],
+                               d64copy_message_cb message_cb);
+
+/* takes (lock != 0) or gives back the bus shared with other drives */
+typedef int (*d64copy_bus_cb)(void *context, int lock);
+
+/* d64copy_wait_disk_change(), with the bus only taken while it is used */
+extern int d64copy_wait_disk_change_shared(CBM_FILE cbm_fd, int drive,
+                                           d64copy_message_cb msg_cb,
+                                           d64copy_bus_cb bus_cb,
+                                           void *context);
+
+/* statistics of the copy so far, for adapting retries and interleave */
+typedef struct {
+    int enabled;
+    int tune_interleave;
+    int interleave;         /* interleave to use for the current track */
+    int best_interleave;
+    double best_time;       /* us per block with best_interleave */
+    int step;               /* direction in which the interleave is searched */
+    int settled;            /* != 0: best interleave of this zone found */
+    int zone_sectors;
+    double start;           /* when the current track has been started */
+    double elapsed;         /* duration of its first pass */
+    int first_pass;
+    int blocks;             /* blocks in the first pass */
+    int extra;              /* free retry passes used on this track */
+    int failed;             /* sectors which failed in a first pass */
+    int recovered;          /* sectors recovered by retrying */
+    int hopeless;
+} d64copy_adaptive;
+
+extern void d64copy_adaptive_init(d64copy_adaptive *a,
+                                  const d64copy_settings *settings,
+                                  int tune_interleave);
+
+/* the retry count to use for the next track */
+extern int d64copy_adaptive_retries(d64copy_adaptive *a, int retries,
+                                    d64copy_message_cb message_cb);
+
+/* != 0 if the retry pass just done counts against the retry count */
+extern int d64copy_adaptive_retry_done(d64copy_adaptive *a, int errors_before,
+                                       int errors_after);
+
+extern void d64copy_adaptive_track_start(d64copy_adaptive *a, int sectors);
+extern void d64copy_adaptive_pass_done(d64copy_adaptive *a, int blocks, int errors);
+extern void d64copy_adaptive_track_done(d64copy_adaptive *a,
+                                        d64copy_message_cb message_cb);
 
 #endif
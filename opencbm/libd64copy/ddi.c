@@ -0,0 +1,673 @@
+/*
+ *  This program is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU General Public License
+ *  as published by the Free Software Foundation; either version
+ *  2 of the License, or (at your option) any later version.
+ *
+*/
+
+/*
+ * Images named *.ddi do not hold the blocks themselves, but the numbers
+ * of the blocks in a block store which all the .ddi images of a directory
+ * share. A block is added to the store only if it is not there yet, so
+ * an archive of many disks keeps every empty block, every copy of the
+ * same DOS and every file found on more than one disk only once.
+ *
+ * The store consists of two files in the directory of the image:
+ *   blocks.dds   the blocks, 256 bytes each, in the order they were added
+ *   blocks.ddx   the CRC-32 of every block, 4 bytes each (LSB first)
+ * The CRCs are only used to find a block quickly; a block is only taken
+ * as the same if its contents match.
+ *
+ * A .ddi image consists of:
+ *   "CBMDDI", 1 (version), number of tracks, number of blocks (LSB first),
+ *   flags (1: error map appended), 5 bytes 0
+ *   the number of the store block of every block, 4 bytes each (LSB first)
+ *   the error map, as in a .d64 image, if the flag is set
+ *
+ * Several copies in this process can write to the same store, as the
+ * blocks are added when an image is closed, one image at a time; other
+ * processes writing to the same store at the same time are not allowed.
+ */
+
+#include "d64copy_int.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "arch.h"
+
+#ifdef WIN32
+# include <windows.h>
+#else
+# include <pthread.h>
+#endif
+
+#define DDI_HEADER_SIZE 16
+#define DDI_VERSION     1
+#define DDI_ERROR_MAP   1
+
+static const char ddi_signature[6] = { 'C', 'B', 'M', 'D', 'D', 'I' };
+
+typedef struct
+{
+    d64copy_settings *settings;
+    d64copy_message_cb message_cb;
+
+    int for_writing;
+    FILE *the_file;
+    char *store_name;       /* blocks.dds; blocks.ddx differs in the last letter */
+    int tracks;
+    int block_count;
+    int track_start[D71_TRACKS + 2];
+
+    /* reading: the store, and the store block of every block */
+    FILE *store;
+    unsigned long *index;
+
+    /* writing: the blocks, and the status they have been read with */
+    unsigned char *blocks;
+    char *status;
+} ddi_disk;
+
+/* the copies in this process add their blocks to a store one at a time */
+#ifdef WIN32
+
+static LONG volatile store_lock_flag = 0;
+
+static void store_lock(void)
+{
+    while(InterlockedExchange((LONG *) &store_lock_flag, 1) != 0)
+    {
+        Sleep(0);
+    }
+}
+
+static void store_unlock(void)
+{
+    InterlockedExchange((LONG *) &store_lock_flag, 0);
+}
+
+#else
+
+static pthread_mutex_t store_mutex = PTHREAD_MUTEX_INITIALIZER;
+
+static void store_lock(void)
+{
+    pthread_mutex_lock(&store_mutex);
+}
+
+static void store_unlock(void)
+{
+    pthread_mutex_unlock(&store_mutex);
+}
+
+#endif
+
+static void put_le32(unsigned char *p, unsigned long value)
+{
+    p[0] = (unsigned char) value;
+    p[1] = (unsigned char) (value >> 8);
+    p[2] = (unsigned char) (value >> 16);
+    p[3] = (unsigned char) (value >> 24);
+}
+
+static unsigned long get_le32(const unsigned char *p)
+{
+    return p[0] | (p[1] << 8) | ((unsigned long) p[2] << 16) | ((unsigned long) p[3] << 24);
+}
+
+static void setup_track_start(ddi_disk *d, int two_sided)
+{
+    int tr, count;
+
+    d->track_start[1] = 0;
+    for(tr = 1; tr <= D71_TRACKS; tr++)
+    {
+        count = d64copy_sector_count(two_sided, tr);
+        d->track_start[tr + 1] = d->track_start[tr] + (count > 0 ? count : 0);
+    }
+}
+
+/* blocks.dds in the directory of the image */
+static char *make_store_name(const char *image)
+{
+    const char *base;
+    char *name;
+    size_t len;
+
+    base = strrchr(image, '/');
+#ifdef WIN32
+    {
+        const char *p = strrchr(image, '\\');
+
+        if(p != NULL && (base == NULL || p > base))
+        {
+            base = p;
+        }
+    }
+#endif
+    len = base ? (size_t)(base + 1 - image) : 0;
+
+    name = malloc(len + sizeof("blocks.dds"));
+    if(name != NULL)
+    {
+        memcpy(name, image, len);
+        strcpy(name + len, "blocks.dds");
+    }
+    return name;
+}
+
+static FILE *open_store_file(const char *name)
+{
+    FILE *f = fopen(name, "r+b");
+
+    return f ? f : fopen(name, "w+b");
+}
+
+static long file_size(FILE *f)
+{
+    if(fseek(f, 0, SEEK_END) != 0)
+    {
+        return -1;
+    }
+    return ftell(f);
+}
+
+/* != 0 if block n of the store holds blk */
+static int store_has_block(FILE *dds, long n, const unsigned char *blk)
+{
+    unsigned char block[BLOCKSIZE];
+
+    return fseek(dds, n * BLOCKSIZE, SEEK_SET) == 0 &&
+           fread(block, BLOCKSIZE, 1, dds) == 1 &&
+           memcmp(block, blk, BLOCKSIZE) == 0;
+}
+
+/*
+ * find every block of the image in the store, and add those which are
+ * not there yet; index gets the store block of every block
+ */
+static int store_add(ddi_disk *d, unsigned long *index)
+{
+    char *ddx_name = NULL;
+    FILE *dds = NULL, *ddx = NULL;
+    unsigned long *crc = NULL;
+    long *slot = NULL;
+    unsigned char buf[4];
+    long count, old_count, n, size, mask, h;
+    const unsigned char *blk;
+    unsigned long c;
+    int i, ret = 1;
+
+    do
+    {
+        ddx_name = malloc(strlen(d->store_name) + 1);
+        if(ddx_name == NULL)
+        {
+            d->message_cb(0, "no memory");
+            break;
+        }
+        strcpy(ddx_name, d->store_name);
+        ddx_name[strlen(ddx_name) - 1] = 'x';
+
+        dds = open_store_file(d->store_name);
+        ddx = open_store_file(ddx_name);
+        if(dds == NULL || ddx == NULL)
+        {
+            d->message_cb(0, "could not open the block store %s", d->store_name);
+            break;
+        }
+
+        /* what is in both files; a block after that has not been finished */
+        count = file_size(dds);
+        size = file_size(ddx);
+        if(count < 0 || size < 0)
+        {
+            d->message_cb(0, "could not read the block store %s", d->store_name);
+            break;
+        }
+        count /= BLOCKSIZE;
+        if(size / 4 < count)
+        {
+            count = size / 4;
+        }
+        old_count = count;
+
+        for(mask = 1; mask < 2 * (count + d->block_count); mask <<= 1)
+        {
+        }
+        crc = malloc((count + d->block_count) * sizeof(*crc));
+        slot = malloc(mask * sizeof(*slot));
+        if(crc == NULL || slot == NULL)
+        {
+            d->message_cb(0, "no memory for the block store");
+            break;
+        }
+        mask--;
+        for(h = 0; h <= mask; h++)
+        {
+            slot[h] = -1;
+        }
+
+        if(fseek(ddx, 0, SEEK_SET) != 0)
+        {
+            break;
+        }
+        for(n = 0; n < count; n++)
+        {
+            if(fread(buf, 4, 1, ddx) != 1)
+            {
+                break;
+            }
+            crc[n] = get_le32(buf);
+            for(h = crc[n] & mask; slot[h] >= 0; h = (h + 1) & mask)
+            {
+            }
+            slot[h] = n;
+        }
+        if(n < count)
+        {
+            d->message_cb(0, "could not read the block store %s", d->store_name);
+            break;
+        }
+
+        for(i = 0; i < d->block_count; i++)
+        {
+            blk = d->blocks + (size_t)i * BLOCKSIZE;
+            c = d64copy_crc32(0, blk, BLOCKSIZE);
+
+            for(h = c & mask; slot[h] >= 0; h = (h + 1) & mask)
+            {
+                if(crc[slot[h]] == c && store_has_block(dds, slot[h], blk))
+                {
+                    break;
+                }
+            }
+
+            if(slot[h] < 0)
+            {
+                if(fseek(dds, count * BLOCKSIZE, SEEK_SET) != 0 ||
+                   fwrite(blk, BLOCKSIZE, 1, dds) != 1)
+                {
+                    break;
+                }
+                crc[count] = c;
+                slot[h] = count++;
+            }
+            index[i] = (unsigned long) slot[h];
+        }
+        if(i < d->block_count)
+        {
+            d->message_cb(0, "could not write the block store %s", d->store_name);
+            break;
+        }
+
+        /* the CRCs last: a block is only in the store once it is there, too */
+        if(fflush(dds) != 0 || fseek(ddx, old_count * 4, SEEK_SET) != 0)
+        {
+            break;
+        }
+        for(n = old_count; n < count; n++)
+        {
+            put_le32(buf, crc[n]);
+            if(fwrite(buf, 4, 1, ddx) != 1)
+            {
+                break;
+            }
+        }
+        if(n < count)
+        {
+            d->message_cb(0, "could not write the block store %s", d->store_name);
+            break;
+        }
+
+        d->message_cb(2, "%ld of %d blocks added to %s",
+                      count - old_count, d->block_count, d->store_name);
+        ret = 0;
+    } while(0);
+
+    if(ddx && fclose(ddx) != 0)
+    {
+        ret = 1;
+    }
+    if(dds && fclose(dds) != 0)
+    {
+        ret = 1;
+    }
+    free(ddx_name);
+    free(crc);
+    free(slot);
+
+    return ret;
+}
+
+static int has_errors(ddi_disk *d)
+{
+    int i;
+
+    switch(d->settings->error_mode)
+    {
+        case em_always:
+            return 1;
+        case em_never:
+            return 0;
+        default:
+            for(i = 0; i < d->block_count; i++)
+            {
+                if(d->status[i] != 1)
+                {
+                    return 1;
+                }
+            }
+            return 0;
+    }
+}
+
+static int write_image(ddi_disk *d)
+{
+    unsigned char header[DDI_HEADER_SIZE];
+    unsigned char *entries;
+    unsigned long *index;
+    int i, errors, ret = 1;
+
+    index = malloc(d->block_count * sizeof(*index));
+    entries = malloc((size_t)d->block_count * 4);
+    if(index == NULL || entries == NULL)
+    {
+        d->message_cb(0, "no memory");
+        free(index);
+        free(entries);
+        return 1;
+    }
+
+    store_lock();
+    if(store_add(d, index) == 0)
+    {
+        errors = has_errors(d);
+
+        memset(header, 0, sizeof(header));
+        memcpy(header, ddi_signature, sizeof(ddi_signature));
+        header[6] = DDI_VERSION;
+        header[7] = (unsigned char) d->tracks;
+        header[8] = (unsigned char) d->block_count;
+        header[9] = (unsigned char) (d->block_count >> 8);
+        header[10] = errors ? DDI_ERROR_MAP : 0;
+
+        for(i = 0; i < d->block_count; i++)
+        {
+            put_le32(entries + i * 4, index[i]);
+        }
+
+        ret = fwrite(header, sizeof(header), 1, d->the_file) != 1 ||
+              fwrite(entries, (size_t)d->block_count * 4, 1, d->the_file) != 1 ||
+              (errors && fwrite(d->status, d->block_count, 1, d->the_file) != 1);
+    }
+    store_unlock();
+
+    free(index);
+    free(entries);
+    return ret;
+}
+
+static int read_block(d64copy_disk disk, unsigned char tr, unsigned char se, unsigned char *block)
+{
+    ddi_disk *d = disk;
+    int i;
+
+    if(d->for_writing || tr < 1 || tr > d->tracks)
+    {
+        return 1;
+    }
+
+    i = d->track_start[tr] + se;
+    if(se >= d->track_start[tr + 1] - d->track_start[tr] ||
+       fseek(d->store, (long)d->index[i] * BLOCKSIZE, SEEK_SET) != 0 ||
+       fread(block, BLOCKSIZE, 1, d->store) != 1)
+    {
+        return 1;
+    }
+
+    return 0;
+}
+
+static int write_block(d64copy_disk disk, unsigned char tr, unsigned char se, const unsigned char *blk, int size, int read_status)
+{
+    ddi_disk *d = disk;
+    int i;
+
+    if(!d->for_writing || tr < 1 || tr > d->tracks ||
+       se >= d->track_start[tr + 1] - d->track_start[tr] || size > BLOCKSIZE)
+    {
+        return 1;
+    }
+
+    i = d->track_start[tr] + se;
+    memcpy(d->blocks + (size_t)i * BLOCKSIZE, blk, size);
+    d->status[i] = (char) ((read_status == 0) ? 1 : read_status);
+
+    return 0;
+}
+
+static void free_disk(ddi_disk *d)
+{
+    if(d->the_file)
+    {
+        fclose(d->the_file);
+    }
+    if(d->store)
+    {
+        fclose(d->store);
+    }
+    free(d->store_name);
+    free(d->index);
+    free(d->blocks);
+    free(d->status);
+    free(d);
+}
+
+static int open_for_reading(ddi_disk *d, const char *name)
+{
+    d64copy_settings *settings = d->settings;
+    unsigned char header[DDI_HEADER_SIZE];
+    unsigned char *entries;
+    int i;
+
+    d->the_file = fopen(name, "rb");
+    if(d->the_file == NULL)
+    {
+        d->message_cb(0, "could not open %s", name);
+        return 1;
+    }
+
+    if(fread(header, sizeof(header), 1, d->the_file) != 1 ||
+       memcmp(header, ddi_signature, sizeof(ddi_signature)) != 0 ||
+       header[6] != DDI_VERSION)
+    {
+        d->message_cb(0, "%s is no .ddi image", name);
+        return 1;
+    }
+
+    d->tracks = header[7];
+    if(d->tracks == D71_TRACKS && !settings->two_sided)
+    {
+        d->message_cb(0, "%s holds a double sided disk", name);
+        return 1;
+    }
+    if(d->tracks != D71_TRACKS && (d->tracks < STD_TRACKS || d->tracks > TOT_TRACKS))
+    {
+        d->message_cb(0, "%s: invalid number of tracks: %d", name, d->tracks);
+        return 1;
+    }
+    setup_track_start(d, d->tracks == D71_TRACKS);
+
+    d->block_count = header[8] | (header[9] << 8);
+    if(d->block_count != d->track_start[d->tracks + 1])
+    {
+        d->message_cb(0, "%s: invalid number of blocks: %d", name, d->block_count);
+        return 1;
+    }
+    if(header[10] & DDI_ERROR_MAP)
+    {
+        d->message_cb(1, "image contains error information");
+    }
+
+    d->index = malloc(d->block_count * sizeof(*d->index));
+    entries = malloc((size_t)d->block_count * 4);
+    if(d->index == NULL || entries == NULL)
+    {
+        d->message_cb(0, "no memory for image");
+        free(entries);
+        return 1;
+    }
+    if(fread(entries, (size_t)d->block_count * 4, 1, d->the_file) != 1)
+    {
+        d->message_cb(0, "could not read %s", name);
+        free(entries);
+        return 1;
+    }
+    for(i = 0; i < d->block_count; i++)
+    {
+        d->index[i] = get_le32(entries + i * 4);
+    }
+    free(entries);
+
+    d->store = fopen(d->store_name, "rb");
+    if(d->store == NULL)
+    {
+        d->message_cb(0, "could not open the block store %s", d->store_name);
+        return 1;
+    }
+
+    if(d->tracks != STD_TRACKS && d->tracks != D71_TRACKS)
+    {
+        d->message_cb(1, "non-standard number or tracks: %d", d->tracks);
+    }
+    if(settings->end_track == -1)
+    {
+        settings->end_track = d->tracks;
+    }
+    else if(settings->end_track > d->tracks)
+    {
+        d->message_cb(1, "resetting end track to %d", d->tracks);
+        settings->end_track = d->tracks;
+    }
+
+    return 0;
+}
+
+static int open_for_writing(ddi_disk *d, const char *name)
+{
+    d64copy_settings *settings = d->settings;
+
+    if(settings->two_sided)
+    {
+        d->tracks = D71_TRACKS;
+    }
+    else if(settings->end_track <= STD_TRACKS)
+    {
+        d->tracks = STD_TRACKS;
+    }
+    else if(settings->end_track <= EXT_TRACKS)
+    {
+        d->tracks = EXT_TRACKS;
+    }
+    else
+    {
+        d->tracks = TOT_TRACKS;
+    }
+
+    if(settings->resume)
+    {
+        d->message_cb(1, "cannot resume a .ddi image");
+    }
+
+    setup_track_start(d, settings->two_sided);
+    d->block_count = d->track_start[d->tracks + 1];
+
+    /* the blocks which are not copied are empty */
+    d->blocks = calloc(d->block_count, BLOCKSIZE);
+    d->status = calloc(d->block_count, 1);
+    if(d->blocks == NULL || d->status == NULL)
+    {
+        d->message_cb(0, "no memory for image");
+        return 1;
+    }
+
+    d->the_file = fopen(name, "wb");
+    if(d->the_file == NULL)
+    {
+        d->message_cb(0, "could not open %s", name);
+        return 1;
+    }
+
+    return 0;
+}
+
+static int open_disk(d64copy_disk *disk, CBM_FILE fd, d64copy_settings *settings,
+                     const void *arg, int for_writing,
+                     turbo_start start, d64copy_message_cb message_cb)
+{
+    const char *name = arg;
+    ddi_disk *d;
+    int ret;
+
+    *disk = NULL;
+
+    d = calloc(1, sizeof(*d));
+    if(d == NULL)
+    {
+        message_cb(0, "no memory");
+        return 1;
+    }
+
+    d->settings = settings;
+    d->message_cb = message_cb;
+    d->for_writing = for_writing;
+
+    d->store_name = make_store_name(name);
+    if(d->store_name == NULL)
+    {
+        message_cb(0, "no memory");
+        free_disk(d);
+        return 1;
+    }
+
+    ret = for_writing ? open_for_writing(d, name) : open_for_reading(d, name);
+    if(ret)
+    {
+        if(d->the_file && for_writing)
+        {
+            fclose(d->the_file);
+            d->the_file = NULL;
+            arch_unlink(name);
+        }
+        free_disk(d);
+        return ret;
+    }
+
+    *disk = d;
+    return 0;
+}
+
+static void close_disk(d64copy_disk disk)
+{
+    ddi_disk *d = disk;
+
+    if(d->for_writing && write_image(d) != 0)
+    {
+        d->message_cb(0, "could not write the .ddi image");
+    }
+    free_disk(d);
+}
+
+transfer_funcs d64copy_ddi_transfer = {open_disk,
+                        read_block,
+                        write_block,
+                        close_disk,
+                        0,
+                        0,
+                        NULL,
+                        NULL,
+                        NULL};
@@ -0,0 +1,114 @@
+/*
+ *  This program is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU General Public License
+ *  as published by the Free Software Foundation; either version
+ *  2 of the License, or (at your option) any later version.
+ *
+*/
+
+/*
+ * CRC-32 (as used by zip, gzip and PNG) of the image files. The blocks
+ * arrive in the order they are read from the disk, not in the order of
+ * the image: every block gets its own CRC when it is written, and these
+ * are combined in the order of the image when it is closed.
+ */
+
+#include "d64copy_int.h"
+
+/* the CRC of the 4 bits, with the reversed polynomial 0xedb88320 */
+static const unsigned long crc_nibble[16] =
+{
+    0x00000000UL, 0x1db71064UL, 0x3b6e20c8UL, 0x26d930acUL,
+    0x76dc4190UL, 0x6b6b51f4UL, 0x4db26158UL, 0x5005713cUL,
+    0xedb88320UL, 0xf00f9344UL, 0xd6d6a3e8UL, 0xcb61b38cUL,
+    0x9b64c2b0UL, 0x86d3d2d4UL, 0xa00ae278UL, 0xbdbdf21cUL
+};
+
+unsigned long d64copy_crc32(unsigned long crc, const unsigned char *buf, size_t len)
+{
+    crc = ~crc & 0xffffffffUL;
+    while(len--)
+    {
+        crc ^= *buf++;
+        crc = (crc >> 4) ^ crc_nibble[crc & 0x0f];
+        crc = (crc >> 4) ^ crc_nibble[crc & 0x0f];
+    }
+    return ~crc & 0xffffffffUL;
+}
+
+/* multiply the 32x32 matrix over GF(2) with the vector */
+static unsigned long gf2_times(const unsigned long *mat, unsigned long vec)
+{
+    unsigned long sum = 0;
+
+    for(; vec; vec >>= 1, mat++)
+    {
+        if(vec & 1)
+        {
+            sum ^= *mat;
+        }
+    }
+    return sum;
+}
+
+static void gf2_square(unsigned long *square, const unsigned long *mat)
+{
+    int n;
+
+    for(n = 0; n < 32; n++)
+    {
+        square[n] = gf2_times(mat, mat[n]);
+    }
+}
+
+/*
+ * the CRC of A followed by B, from the CRC of A, the one of B and the
+ * length of B; the same as crc32_combine() of zlib
+ */
+unsigned long d64copy_crc32_combine(unsigned long crc1, unsigned long crc2, long len2)
+{
+    unsigned long even[32];     /* the operator for 2^n zero bits, n even */
+    unsigned long odd[32];      /* the same, n odd */
+    unsigned long row;
+    int n;
+
+    if(len2 <= 0)
+    {
+        return crc1;
+    }
+
+    /* the operator for one zero bit */
+    odd[0] = 0xedb88320UL;
+    for(n = 1, row = 1; n < 32; n++, row <<= 1)
+    {
+        odd[n] = row;
+    }
+
+    gf2_square(even, odd);      /* 2 zero bits */
+    gf2_square(odd, even);      /* 4 zero bits */
+
+    /* apply len2 zero bytes to crc1, the first one is 8 zero bits */
+    do
+    {
+        gf2_square(even, odd);
+        if(len2 & 1)
+        {
+            crc1 = gf2_times(even, crc1);
+        }
+        len2 >>= 1;
+        if(len2 == 0)
+        {
+            break;
+        }
+
+        gf2_square(odd, even);
+        if(len2 & 1)
+        {
+            crc1 = gf2_times(odd, crc1);
+        }
+        len2 >>= 1;
+    }
+    while(len2 != 0);
+
+    return crc1 ^ crc2;
+}
@@ -0,0 +1,140 @@
+/*
+ *  This program is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU General Public License
+ *  as published by the Free Software Foundation; either version
+ *  2 of the License, or (at your option) any later version.
+ *
+*/
+
+/*
+ * Waiting for the next disk in a drive. The write protect sensor of the
+ * 1541 and the 1571 is covered by the disk whenever one is taken out or
+ * put in, whether the disk has a notch or not; the host looks at it with
+ * M-R. When it has not changed for a while after that, the drive is asked
+ * to read the new disk.
+ */
+
+#include "opencbm.h"
+#include "d64copy_int.h"
+
+#include <stdio.h>
+
+/* port B of VIA 2: bit 4 is the write protect sensor, 0 = light blocked */
+#define VIA2_PB           0x1c00
+#define VIA2_PB_WPS       0x10
+
+/* the time between two looks at the sensor */
+#define DISKCHANGE_POLL_MS    200
+
+/* the time the sensor must not change before the disk is read */
+#define DISKCHANGE_SETTLE_MS  1500
+
+static int read_sensor(CBM_FILE fd, unsigned char drive, unsigned char *wps)
+{
+    unsigned char pb;
+
+    if(cbm_download(fd, drive, VIA2_PB, &pb, 1) != 1)
+    {
+        return -1;
+    }
+    *wps = pb & VIA2_PB_WPS;
+    return 0;
+}
+
+/*
+ * If bus_cb is given, the bus is only taken for the looks at the sensor
+ * and for reading the disk, so other drives on the bus can copy in
+ * between. bus_cb(context, 1) takes it, and returns != 0 if the waiting
+ * is to be given up instead; bus_cb(context, 0) gives it back.
+ */
+int d64copy_wait_disk_change_shared(CBM_FILE cbm_fd, int drive,
+                                    d64copy_message_cb msg_cb,
+                                    d64copy_bus_cb bus_cb, void *context)
+{
+    unsigned char dev = (unsigned char) drive;
+    unsigned char wps, last;
+    char buf[40] = "";
+    int changed = 0;
+    int stable = 0;
+    int rv;
+
+    if(bus_cb && bus_cb(context, 1) != 0)
+    {
+        return -1;
+    }
+    rv = read_sensor(cbm_fd, dev, &last);
+    if(bus_cb) bus_cb(context, 0);
+
+    if(rv != 0)
+    {
+        msg_cb(0, "drive %d does not answer", drive);
+        return -1;
+    }
+
+    msg_cb(2, "waiting for the next disk in drive %d", drive);
+
+    while(1)
+    {
+        arch_sleep_ms(DISKCHANGE_POLL_MS);
+
+        if(d64copy_aborted())
+        {
+            return -1;
+        }
+
+        if(bus_cb && bus_cb(context, 1) != 0)
+        {
+            return -1;
+        }
+        rv = read_sensor(cbm_fd, dev, &wps);
+        if(bus_cb) bus_cb(context, 0);
+
+        if(rv != 0)
+        {
+            msg_cb(0, "drive %d does not answer", drive);
+            return -1;
+        }
+
+        if(wps != last)
+        {
+            /* the disk is moving */
+            last = wps;
+            changed = 1;
+            stable = 0;
+            continue;
+        }
+
+        if(!changed)
+        {
+            continue;
+        }
+
+        stable += DISKCHANGE_POLL_MS;
+        if(stable < DISKCHANGE_SETTLE_MS)
+        {
+            continue;
+        }
+
+        /* the disk has been taken out only, or is in now */
+        changed = 0;
+        if(bus_cb && bus_cb(context, 1) != 0)
+        {
+            return -1;
+        }
+        rv = cbm_exec_command(cbm_fd, dev, "I0", 0) == 0 &&
+             cbm_device_status(cbm_fd, dev, buf, sizeof(buf)) == 0;
+        if(bus_cb) bus_cb(context, 0);
+
+        if(rv)
+        {
+            msg_cb(2, "new disk in drive %d", drive);
+            return 0;
+        }
+        msg_cb(3, "no disk in drive %d: %s", drive, buf);
+    }
+}
+
+int d64copy_wait_disk_change(CBM_FILE cbm_fd, int drive, d64copy_message_cb msg_cb)
+{
+    return d64copy_wait_disk_change_shared(cbm_fd, drive, msg_cb, NULL, NULL);
+}
@@ -0,0 +1,327 @@
+/*
+ *  This program is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU General Public License
+ *  as published by the Free Software Foundation; either version
+ *  2 of the License, or (at your option) any later version.
+ *
+*/
+
+/*
+ * Extracting the files of a disk while it is read to an image, without
+ * reading it a second time. This transfer sits in front of the one of the
+ * image: every block written to the image is kept, and when the image is
+ * closed, the directory is walked in these blocks and every file is
+ * written to the directory given. A block which has not come by, e.g. as
+ * it was already in the image of an interrupted copy, is read from the
+ * image then.
+ *
+ * Existing files are not overwritten: a file whose name is already taken,
+ * be it from another disk or by a file of the same name on this one, gets
+ * a number added.
+ */
+
+#include "d64copy_int.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "arch.h"
+
+#define DIR_TRACK       18
+#define DIR_SECTOR      1
+#define DIR_ENTRY_SIZE  32
+
+/* more than this many blocks cannot be on the disk */
+#define MAX_CHAIN       D71_BLOCKS
+
+typedef struct
+{
+    const transfer_funcs *image;
+    d64copy_disk image_disk;
+    d64copy_settings *settings;
+    d64copy_message_cb message_cb;
+
+    int tracks;
+    int track_start[D71_TRACKS + 2];
+
+    /* the blocks which have been written, if have is set */
+    unsigned char *blocks;
+    char *have;
+} extract_disk;
+
+static const unsigned char *get_block(extract_disk *x, int tr, int se)
+{
+    int index;
+
+    if(tr < 1 || tr > x->tracks ||
+       se < 0 || se >= d64copy_sector_count(x->settings->two_sided, tr))
+    {
+        return NULL;
+    }
+
+    index = x->track_start[tr] + se;
+    if(!x->have[index])
+    {
+        if(x->image->read_block(x->image_disk, (unsigned char) tr,
+                                (unsigned char) se,
+                                x->blocks + (size_t)index * BLOCKSIZE) != 0)
+        {
+            return NULL;
+        }
+        x->have[index] = 1;
+    }
+    return x->blocks + (size_t)index * BLOCKSIZE;
+}
+
+static int file_exists(const char *name)
+{
+    off_t size;
+
+    return arch_filesize(name, &size) == 0;
+}
+
+/* the name in the directory entry, as a file name in the directory given */
+static char *host_name(extract_disk *x, const unsigned char *entry)
+{
+    static const char * const ext[] = { "del", "seq", "prg", "usr", "rel" };
+    const char *dir = x->settings->extract;
+    char base[17], *name, *p;
+    int i, len, number;
+
+    for(len = 0; len < 16 && entry[5 + len] != 0xa0; len++)
+    {
+        base[len] = (char) entry[5 + len];
+    }
+    base[len] = '\0';
+    cbm_petscii2ascii(base);
+
+    for(p = base; *p; p++)
+    {
+        if(strchr("\\/\"<>|:?*", *p) || (unsigned char) *p < ' ')
+        {
+            *p = '_';
+        }
+    }
+    if(len == 0)
+    {
+        strcpy(base, "_");
+    }
+
+    name = malloc(strlen(dir) + sizeof(base) + 16);
+    if(name == NULL)
+    {
+        return NULL;
+    }
+
+    i = entry[2] & 0x07;
+    sprintf(name, "%s/%s.%s", dir, base, ext[i < 5 ? i : 2]);
+    for(number = 1; file_exists(name) && number < 1000; number++)
+    {
+        sprintf(name, "%s/%s-%d.%s", dir, base, number, ext[i < 5 ? i : 2]);
+    }
+    return name;
+}
+
+static int extract_file(extract_disk *x, const unsigned char *entry)
+{
+    const unsigned char *blk;
+    char *name;
+    FILE *f;
+    int tr = entry[3], se = entry[4];
+    int count = 0, ret = 0;
+
+    name = host_name(x, entry);
+    if(name == NULL)
+    {
+        x->message_cb(0, "no memory");
+        return 1;
+    }
+
+    f = fopen(name, "wb");
+    if(f == NULL)
+    {
+        x->message_cb(0, "could not open %s", name);
+        free(name);
+        return 1;
+    }
+
+    while(tr != 0)
+    {
+        blk = get_block(x, tr, se);
+        if(blk == NULL || ++count > MAX_CHAIN)
+        {
+            x->message_cb(1, "%s: broken chain at %d/%d", name, tr, se);
+            ret = 1;
+            break;
+        }
+        if(blk[0] == 0)
+        {
+            /* the last block: the second byte is the last one used */
+            if(blk[1] >= 2)
+            {
+                fwrite(blk + 2, blk[1] - 1, 1, f);
+            }
+            break;
+        }
+        fwrite(blk + 2, BLOCKSIZE - 2, 1, f);
+        tr = blk[0];
+        se = blk[1];
+    }
+
+    if(fclose(f) != 0)
+    {
+        x->message_cb(0, "could not write %s", name);
+        ret = 1;
+    }
+    else
+    {
+        x->message_cb(2, "extracted %s", name);
+    }
+    free(name);
+    return ret;
+}
+
+static int extract_files(extract_disk *x)
+{
+    const unsigned char *blk;
+    int tr = DIR_TRACK, se = DIR_SECTOR;
+    int i, count = 0, files = 0, errors = 0;
+
+    while(tr != 0)
+    {
+        blk = get_block(x, tr, se);
+        if(blk == NULL || ++count > MAX_CHAIN)
+        {
+            x->message_cb(1, "broken directory at %d/%d", tr, se);
+            errors++;
+            break;
+        }
+        for(i = 0; i < BLOCKSIZE; i += DIR_ENTRY_SIZE)
+        {
+            const unsigned char *entry = blk + i;
+
+            /* only closed files which have any data; no DEL entries */
+            if((entry[2] & 0x80) == 0 || (entry[2] & 0x07) == 0 || entry[3] == 0)
+            {
+                continue;
+            }
+            if(extract_file(x, entry) == 0)
+            {
+                files++;
+            }
+            else
+            {
+                errors++;
+            }
+        }
+        tr = blk[0];
+        se = blk[1];
+    }
+
+    x->message_cb(2, "%d files extracted to %s", files, x->settings->extract);
+    return errors;
+}
+
+static int open_disk(d64copy_disk *disk, CBM_FILE fd, d64copy_settings *settings,
+                     const void *arg, int for_writing,
+                     turbo_start start, d64copy_message_cb message_cb)
+{
+    extract_disk *x;
+    int tr, ret;
+
+    *disk = NULL;
+
+    x = calloc(1, sizeof(*x));
+    if(x == NULL)
+    {
+        message_cb(0, "no memory");
+        return 1;
+    }
+
+    x->image = d64copy_image_transfer(arg);
+    x->settings = settings;
+    x->message_cb = message_cb;
+    x->tracks = settings->two_sided ? D71_TRACKS : TOT_TRACKS;
+
+    x->track_start[1] = 0;
+    for(tr = 1; tr <= x->tracks; tr++)
+    {
+        x->track_start[tr + 1] = x->track_start[tr] +
+                                 d64copy_sector_count(settings->two_sided, tr);
+    }
+
+    x->blocks = malloc((size_t)x->track_start[x->tracks + 1] * BLOCKSIZE);
+    x->have = calloc(x->track_start[x->tracks + 1], 1);
+    if(x->blocks == NULL || x->have == NULL)
+    {
+        message_cb(0, "no memory for extracting the files");
+        free(x->blocks);
+        free(x->have);
+        free(x);
+        return 1;
+    }
+
+    ret = x->image->open_disk(&x->image_disk, fd, settings, arg, for_writing,
+                              start, message_cb);
+    if(ret)
+    {
+        free(x->blocks);
+        free(x->have);
+        free(x);
+        return ret;
+    }
+
+    *disk = x;
+    return 0;
+}
+
+static int read_block(d64copy_disk disk, unsigned char tr, unsigned char se, unsigned char *block)
+{
+    extract_disk *x = disk;
+
+    return x->image->read_block(x->image_disk, tr, se, block);
+}
+
+static int write_block(d64copy_disk disk, unsigned char tr, unsigned char se, const unsigned char *blk, int size, int read_status)
+{
+    extract_disk *x = disk;
+    int index;
+
+    /* only blocks which have been read fine are taken for the files */
+    if(read_status == 0 && size == BLOCKSIZE && tr >= 1 && tr <= x->tracks &&
+       se < d64copy_sector_count(x->settings->two_sided, tr))
+    {
+        index = x->track_start[tr] + se;
+        memcpy(x->blocks + (size_t)index * BLOCKSIZE, blk, BLOCKSIZE);
+        x->have[index] = 1;
+    }
+
+    return x->image->write_block(x->image_disk, tr, se, blk, size, read_status);
+}
+
+static int block_done(d64copy_disk disk, unsigned char tr, unsigned char se)
+{
+    extract_disk *x = disk;
+
+    return x->image->block_done ?
+        x->image->block_done(x->image_disk, tr, se) : 0;
+}
+
+static void close_disk(d64copy_disk disk)
+{
+    extract_disk *x = disk;
+
+    /* the files of a copy which has been stopped might be incomplete */
+    if(!d64copy_aborted() && extract_files(x) != 0)
+    {
+        x->message_cb(1, "not all files could be extracted");
+    }
+
+    x->image->close_disk(x->image_disk);
+    free(x->blocks);
+    free(x->have);
+    free(x);
+}
+
+DECLARE_TRANSFER_FUNCS_IMAGE(extract_transfer);
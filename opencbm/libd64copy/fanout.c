@@ -0,0 +1,297 @@
+/*
+ *  This program is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU General Public License
+ *  as published by the Free Software Foundation; either version
+ *  2 of the License, or (at your option) any later version.
+ *
+*/
+
+/*
+ * Writing one image to several drives at once. Every block is put into
+ * buffer 2 ($0500) of a drive with M-W, and then written by a job of its
+ * disk controller. While the controller seeks and waits for the sector,
+ * the bus is free, and the host hands the next blocks to the other
+ * drives: cbm_bus_schedule() takes the drives in turn, so all of them
+ * are writing at the same time.
+ *
+ * No turbo is used: a drive routine would own the bus while it runs.
+ */
+
+#include "opencbm.h"
+#include "d64copy_int.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define FANOUT_BUFFER     2
+#define FANOUT_BUFFER_MEM (0x0300 + FANOUT_BUFFER * 0x100)
+
+/* the job code for writing a sector on drive 0 */
+#define JOB_WRITE         0x90
+
+/* the time a drive needs for a write job, and between two looks at it */
+#define FANOUT_WRITE_MS   20
+#define FANOUT_POLL_MS    10
+
+typedef struct fanout_s fanout;
+
+typedef struct
+{
+    fanout *fo;
+    unsigned char drive;
+    int tr;
+    int se;
+    int running;
+    int retries;
+    int count;
+} fanout_drive;
+
+struct fanout_s
+{
+    const transfer_funcs *src;
+    d64copy_disk src_disk;
+    d64copy_settings *settings;
+    d64copy_message_cb message_cb;
+    d64copy_status_cb status_cb;
+    d64copy_status status;
+    int drives;
+    char done[MAX_TRACKS][MAX_SECTORS+1];   /* the drives which have the block */
+};
+
+extern transfer_funcs d64copy_g64_transfer;
+
+/* the block to write after tr/se, in the order of the copy; tr = 0 if none */
+static void next_block(const fanout *fo, int *tr, int *se)
+{
+    const d64copy_settings *settings = fo->settings;
+    int last = settings->two_sided ? D71_TRACKS : settings->end_track;
+
+    (*se)++;
+    while(*tr <= last)
+    {
+        if(*tr >= settings->start_track && *tr <= settings->end_track &&
+           *se < d64copy_sector_count(settings->two_sided, *tr))
+        {
+            return;
+        }
+        *tr = d64copy_next_track(settings->two_sided, *tr);
+        *se = 0;
+    }
+    *tr = 0;
+}
+
+static void block_finished(fanout_drive *d, int ok)
+{
+    fanout *fo = d->fo;
+    char *bs = &fo->status.bam[d->tr-1][d->se];
+
+    if(!ok)
+    {
+        *bs = bs_error;
+    }
+    else
+    {
+        d->count++;
+        if(++fo->done[d->tr-1][d->se] == fo->drives && *bs != bs_error)
+        {
+            *bs = bs_copied;
+        }
+    }
+
+    fo->status.track = d->tr;
+    fo->status.sector = d->se;
+    fo->status.write_result = !ok;
+    fo->status.sectors_processed++;
+    fo->status_cb(&fo->status);
+
+    d->retries = fo->settings->retries;
+    next_block(fo, &d->tr, &d->se);
+}
+
+static int CBMAPIDECL fanout_step(CBM_FILE fd, cbm_bus_task_t *task)
+{
+    fanout_drive *d = task->context;
+    fanout *fo = d->fo;
+    unsigned char block[BLOCKSIZE];
+    int result, retry = 0;
+
+    if(d->running)
+    {
+        result = cbm_drive_job_poll(fd, d->drive, FANOUT_BUFFER);
+        if(result == 0)
+        {
+            return FANOUT_POLL_MS;
+        }
+        if(result < 0)
+        {
+            fo->message_cb(0, "drive %d does not answer anymore", d->drive);
+            return -1;
+        }
+        d->running = 0;
+        if(result != 1 && d->retries-- > 0)
+        {
+            /* the block is still in the buffer */
+            retry = 1;
+        }
+        else
+        {
+            if(result != 1)
+            {
+                fo->message_cb(1, "write error on drive %d: %02d/%02d: %d",
+                               d->drive, d->tr, d->se, result);
+            }
+            block_finished(d, result == 1);
+        }
+    }
+
+    if(d->tr == 0)
+    {
+        return -1;
+    }
+
+    if(!retry)
+    {
+        if(fo->src->read_block(fo->src_disk, (unsigned char) d->tr,
+                               (unsigned char) d->se, block) != 0)
+        {
+            fo->message_cb(1, "read error in the image: %02d/%02d", d->tr, d->se);
+            block_finished(d, 0);
+            return 0;
+        }
+        if(cbm_upload(fd, d->drive, FANOUT_BUFFER_MEM, block, BLOCKSIZE) != BLOCKSIZE)
+        {
+            fo->message_cb(0, "drive %d does not answer anymore", d->drive);
+            return -1;
+        }
+    }
+
+    if(cbm_drive_job_start(fd, d->drive, FANOUT_BUFFER, JOB_WRITE,
+                           (unsigned char) d->tr, (unsigned char) d->se) != 0)
+    {
+        fo->message_cb(0, "drive %d does not answer anymore", d->drive);
+        return -1;
+    }
+
+    d->running = 1;
+    return FANOUT_WRITE_MS;
+}
+
+int d64copy_write_image_multi(CBM_FILE cbm_fd,
+                              d64copy_settings *settings,
+                              const char *src_image,
+                              const int *dst_drives,
+                              int count,
+                              d64copy_message_cb msg_cb,
+                              d64copy_status_cb stat_cb)
+{
+    fanout fo;
+    fanout_drive *drives;
+    cbm_bus_task_t *tasks;
+    char buf[40];
+    int i, tr, n = 0, blocks = 0;
+
+    memset(&fo, 0, sizeof(fo));
+    fo.settings = settings;
+    fo.message_cb = msg_cb;
+    fo.status_cb = stat_cb;
+
+    fo.src = d64copy_image_transfer(src_image);
+    if(fo.src == &d64copy_g64_transfer)
+    {
+        msg_cb(0, "a .g64 image cannot be written to several drives");
+        return -1;
+    }
+
+    if(settings->start_track < 1 ||
+       settings->start_track > (settings->two_sided ? D71_TRACKS : TOT_TRACKS))
+    {
+        msg_cb(0, "invalid value (%d) for start track", settings->start_track);
+        return -1;
+    }
+
+    if(fo.src->open_disk(&fo.src_disk, cbm_fd, settings,
+                         src_image, 0, NULL, msg_cb) != 0)
+    {
+        msg_cb(0, "can't open source");
+        return -1;
+    }
+
+    drives = calloc(count, sizeof(*drives));
+    tasks = calloc(count, sizeof(*tasks));
+    if(drives == NULL || tasks == NULL)
+    {
+        msg_cb(0, "no memory");
+        free(drives);
+        free(tasks);
+        fo.src->close_disk(fo.src_disk);
+        return -1;
+    }
+
+    /* the write jobs compare the ID of the disk in the drive */
+    for(i = 0; i < count; i++)
+    {
+        unsigned char drive = (unsigned char) dst_drives[i];
+
+        if(cbm_exec_command(cbm_fd, drive, "I0", 0) != 0)
+        {
+            msg_cb(1, "drive %d does not answer, not written", drive);
+            continue;
+        }
+        if(cbm_device_status(cbm_fd, drive, buf, sizeof(buf)) != 0)
+        {
+            msg_cb(1, "drive %d: %s, not written", drive, buf);
+            continue;
+        }
+        drives[n].fo = &fo;
+        drives[n].drive = drive;
+        drives[n].tr = 1;
+        drives[n].se = -1;  /* next_block() finds the first one */
+        drives[n].retries = settings->retries;
+        next_block(&fo, &drives[n].tr, &drives[n].se);
+        tasks[n].step = fanout_step;
+        tasks[n].context = &drives[n];
+        n++;
+    }
+    fo.drives = n;
+
+    if(n == 0)
+    {
+        free(tasks);
+        free(drives);
+        fo.src->close_disk(fo.src_disk);
+        return -1;
+    }
+
+    for(tr = settings->start_track; tr <= settings->end_track; tr++)
+    {
+        int sectors = d64copy_sector_count(settings->two_sided, tr);
+
+        if(sectors > 0)
+        {
+            memset(fo.status.bam[tr-1], bs_must_copy, sectors);
+            blocks += sectors;
+        }
+    }
+
+    fo.status.settings = settings;
+    fo.status.total_sectors = blocks * n;
+    stat_cb(&fo.status);
+
+    msg_cb(2, "writing tracks %d-%d to %d drives (%d sectors)",
+           settings->start_track, settings->end_track, n, blocks);
+
+    cbm_bus_schedule(cbm_fd, tasks, n);
+
+    blocks = 0;
+    for(i = 0; i < n; i++)
+    {
+        blocks += drives[i].count;
+    }
+
+    free(tasks);
+    free(drives);
+    fo.src->close_disk(fo.src_disk);
+
+    return blocks;
+}
@@ -15,85 +15,684 @@
 
 #include "arch.h"
 
-static d64copy_settings *fs_settings;
+#ifdef HAVE_ZLIB
+# include <zlib.h>
+#endif
 
-static FILE *the_file;
-static char *error_map;
-static int block_count;
+typedef struct
+{
+    d64copy_settings *settings;
+
+    FILE *the_file;
+    char *error_map;
+    int block_count;
+
+    /* the blocks of the image, if it could be mapped into memory */
+    unsigned char *the_map;
+    size_t map_size;
+
+    /* number of blocks in front of each track */
+    int track_start[D71_TRACKS + 2];
+
+    /* the blocks read without error are saved here after every track,
+     * for resuming; the error map cannot tell them from status 1
+     */
+    char *checkpoint_name;
+    char *done_map;
+    unsigned char last_tr;
+    int resumed;
+
+    /* the file cannot seek: the image is kept in the_map, and written
+     * out in order as soon as the blocks are final
+     */
+    int stream;
+    int flushed;        /* number of blocks written out so far */
+
+    /* the image is read from a pipe or a compressed file: it is kept
+     * in the_map as well, and read as far as the blocks are needed
+     */
+    int stream_in;
+    size_t filled;      /* number of bytes read so far */
+    int stream_end;
+
+    /* the file has been created or grown from here on: empty blocks
+     * are left as holes there, instead of writing them
+     */
+    long sparse_from;
+
+    /* for the manifest: the CRC of every block written, if crc_done is set */
+    char *image_name;
+    unsigned long *block_crc;
+    char *crc_done;
+    d64copy_message_cb message_cb;
+#ifdef HAVE_ZLIB
+    gzFile gz;          /* != NULL: the stream is compressed on the fly */
+#endif
+
+    /*
+     * Variables to make sure writing the block is an atomary process
+     */
+    int atom_execute;
+    unsigned char atom_tr;
+    unsigned char atom_se;
+    const unsigned char *atom_blk;
+    int atom_size;
+    int atom_read_status;
+} fs_disk;
 
 /* always use maximum size for error map */
 #define ERROR_MAP_LENGTH D71_BLOCKS
 
-static int block_offset(int tr, int se)
+static void setup_track_start(fs_disk *fs, int two_sided)
+{
+    int tr, count;
+
+    fs->track_start[1] = 0;
+    for(tr = 1; tr <= D71_TRACKS; tr++)
+    {
+        count = d64copy_sector_count(two_sided, tr);
+        fs->track_start[tr + 1] = fs->track_start[tr] + (count > 0 ? count : 0);
+    }
+}
+
+static long block_offset(fs_disk *fs, int tr, int se)
 {
-    int sectors = 0, i;
-    for(i = 1; i < tr; i++)
+    if(tr < 1 || tr > D71_TRACKS)
     {
-        sectors += d64copy_sector_count(fs_settings->two_sided, i);
+        return -1;
     }
-    return (sectors + se) * BLOCKSIZE;
+    return (long)(fs->track_start[tr] + se) * BLOCKSIZE;
+}
+
+static void map_image(fs_disk *fs, int writable, d64copy_message_cb message_cb)
+{
+    fs->map_size = (size_t)fs->block_count * BLOCKSIZE;
+
+    /* make sure nothing is left in the buffers of stdio */
+    fflush(fs->the_file);
+
+    /* only map what is already there, the file does not grow with the map */
+    if(fseek(fs->the_file, 0, SEEK_END) != 0 || ftell(fs->the_file) < (long)fs->map_size)
+    {
+        fs->the_map = NULL;
+        return;
+    }
+
+    fs->the_map = arch_map_file(arch_fileno(fs->the_file), fs->map_size, writable);
+    if(fs->the_map == NULL)
+    {
+        message_cb(3, "could not map image file, using plain file access");
+    }
+}
+
+static void unmap_image(fs_disk *fs)
+{
+    if(fs->the_map)
+    {
+        if(fs->stream || fs->stream_in)
+        {
+            free(fs->the_map);
+        }
+        else
+        {
+            arch_unmap_file(fs->the_map, fs->map_size);
+        }
+        fs->the_map = NULL;
+    }
+}
+
+/*
+ * images named *.gz are written gzip compressed
+ */
+static int is_compressed(const char *name)
+{
+    size_t len = strlen(name);
+
+    return len > 3 && arch_strcasecmp(name + len - 3, ".gz") == 0;
 }
 
-static int read_block(unsigned char tr, unsigned char se, unsigned char *block)
+static int start_compression(fs_disk *fs, d64copy_message_cb message_cb)
 {
-    if(fseek(the_file, block_offset(tr, se), SEEK_SET) == 0)
+#ifdef HAVE_ZLIB
+    int fd = arch_dup(arch_fileno(fs->the_file));
+
+    fs->gz = fd < 0 ? NULL : gzdopen(fd, "wb");
+    if(fs->gz == NULL)
+    {
+        message_cb(0, "could not start compression");
+        return 1;
+    }
+    return 0;
+#else
+    message_cb(0, "compressed images are not supported by this build");
+    return 1;
+#endif
+}
+
+static void stream_write(fs_disk *fs, const void *data, size_t size)
+{
+#ifdef HAVE_ZLIB
+    if(fs->gz)
+    {
+        gzwrite(fs->gz, data, (unsigned) size);
+        return;
+    }
+#endif
+    fwrite(data, size, 1, fs->the_file);
+}
+
+/*
+ * write out the blocks of the stream up to the given block count
+ */
+static void flush_stream(fs_disk *fs, int count)
+{
+    if(count > fs->block_count)
+    {
+        count = fs->block_count;
+    }
+    if(count > fs->flushed)
+    {
+        stream_write(fs, fs->the_map + (size_t)fs->flushed * BLOCKSIZE,
+                     (size_t)(count - fs->flushed) * BLOCKSIZE);
+        fs->flushed = count;
+    }
+}
+
+/*
+ * the tracks are copied in order, both sides alternately for .d71.
+ * thus, while track tr is copied, the blocks in front of what is
+ * returned here will not change anymore
+ */
+static int stream_final_blocks(fs_disk *fs, unsigned char tr)
+{
+    if(fs->settings->two_sided && tr > STD_TRACKS)
+    {
+        tr = tr - STD_TRACKS + 1;
+    }
+    return fs->track_start[tr];
+}
+
+static long stream_read(fs_disk *fs, void *data, size_t size)
+{
+#ifdef HAVE_ZLIB
+    if(fs->gz)
+    {
+        return gzread(fs->gz, data, (unsigned) size);
+    }
+#endif
+    return (long) fread(data, 1, size, fs->the_file);
+}
+
+/*
+ * read the stream up to the end of the given track. The write to the
+ * disk starts as soon as its first track has arrived, and a block read
+ * again, e.g. for a retry, is still there.
+ */
+static void fill_stream(fs_disk *fs, unsigned char tr)
+{
+    size_t want = (size_t)fs->track_start[tr + 1] * BLOCKSIZE;
+    long n;
+
+    if(want > fs->map_size)
+    {
+        want = fs->map_size;
+    }
+    while(!fs->stream_end && fs->filled < want)
+    {
+        n = stream_read(fs, fs->the_map + fs->filled, want - fs->filled);
+        if(n <= 0)
+        {
+            fs->stream_end = 1;
+            fs->message_cb(1, "the image ends after %d blocks",
+                           (int)(fs->filled / BLOCKSIZE));
+            break;
+        }
+        fs->filled += n;
+    }
+}
+
+static int read_block(d64copy_disk disk, unsigned char tr, unsigned char se, unsigned char *block)
+{
+    fs_disk *fs = disk;
+    long ofs = block_offset(fs, tr, se);
+
+    if(ofs < 0)
     {
-        return fread(block, BLOCKSIZE, 1, the_file) != 1;
+        return 1;
+    }
+    if(fs->stream_in)
+    {
+        fill_stream(fs, tr);
+        if((size_t)ofs + BLOCKSIZE > fs->filled)
+        {
+            return 1;
+        }
+        memcpy(block, fs->the_map + ofs, BLOCKSIZE);
+        return 0;
+    }
+    if(fs->the_map && (size_t)ofs + BLOCKSIZE <= fs->map_size)
+    {
+        memcpy(block, fs->the_map + ofs, BLOCKSIZE);
+        return 0;
+    }
+    if(fseek(fs->the_file, ofs, SEEK_SET) == 0)
+    {
+        return fread(block, BLOCKSIZE, 1, fs->the_file) != 1;
     }
     return 1;
 }
 
+static void write_checkpoint(fs_disk *fs)
+{
+    FILE *f;
+
+    /* the blocks must be in the file before the checkpoint says so */
+    fflush(fs->the_file);
+
+    f = fopen(fs->checkpoint_name, "wb");
+    if(f)
+    {
+        fwrite(fs->done_map, fs->block_count, 1, f);
+        fclose(f);
+    }
+}
+
+static int read_checkpoint(fs_disk *fs)
+{
+    off_t size;
+    FILE *f;
+    int ret = 1;
+
+    if(arch_filesize(fs->checkpoint_name, &size) != 0 || size != fs->block_count)
+    {
+        return 1;
+    }
+    f = fopen(fs->checkpoint_name, "rb");
+    if(f)
+    {
+        ret = fread(fs->done_map, fs->block_count, 1, f) != 1;
+        fclose(f);
+    }
+    return ret;
+}
+
+static int block_done(d64copy_disk disk, unsigned char tr, unsigned char se)
+{
+    fs_disk *fs = disk;
+    long ofs = block_offset(fs, tr, se);
+
+    return fs->resumed && ofs >= 0 &&
+        ofs / BLOCKSIZE < fs->block_count &&
+        fs->done_map[ofs / BLOCKSIZE];
+}
+
 /*
- * Variables to make sure writing the block is an atomary process
+ * an empty block need not be written if it has never been written
+ * before and lies where the file has been grown, it reads as 0 anyway
  */
-static int atom_execute = 0;
-static unsigned char atom_tr;
-static unsigned char atom_se;
-static const unsigned char *atom_blk;
-static int atom_size;
-static int atom_read_status;
-
-static int write_block(unsigned char tr, unsigned char se, const unsigned char *blk, int size, int read_status)
+static int leave_hole(fs_disk *fs, long ofs, const unsigned char *blk, int size)
 {
+    int i;
+
+    if(ofs < fs->sparse_from || fs->error_map[ofs / BLOCKSIZE] != 0)
+    {
+        return 0;
+    }
+    for(i = 0; i < size; i++)
+    {
+        if(blk[i] != 0)
+        {
+            return 0;
+        }
+    }
+    return 1;
+}
+
+static int write_block(d64copy_disk disk, unsigned char tr, unsigned char se, const unsigned char *blk, int size, int read_status)
+{
+    fs_disk *fs = disk;
     long ofs;
     int ret;
 
-    atom_tr = tr;
-    atom_se = se;
-    atom_blk = blk;
-    atom_size = size;
-    atom_read_status = read_status;
+    /* all blocks of a track are done before the next one is started */
+    if(fs->last_tr != tr)
+    {
+        if(fs->last_tr && fs->checkpoint_name)
+        {
+            write_checkpoint(fs);
+        }
+        fs->last_tr = tr;
+
+        if(fs->stream)
+        {
+            flush_stream(fs, stream_final_blocks(fs, tr));
+        }
+    }
+
+    fs->atom_tr = tr;
+    fs->atom_se = se;
+    fs->atom_blk = blk;
+    fs->atom_size = size;
+    fs->atom_read_status = read_status;
 
-    atom_execute = 1;
+    fs->atom_execute = 1;
 
-    ofs = block_offset(tr, se);
-    if(fseek(the_file, ofs, SEEK_SET) == 0)
+    ofs = block_offset(fs, tr, se);
+    if(ofs >= 0 && !fs->stream && (size_t)ofs + size <= (size_t)fs->block_count * BLOCKSIZE &&
+       leave_hole(fs, ofs, blk, size))
     {
-        error_map[ofs / BLOCKSIZE] = (char) ((read_status == 0) ? 1 : read_status);
-        ret = fwrite(blk, size, 1, the_file) != 1;
+        fs->error_map[ofs / BLOCKSIZE] = (char) ((read_status == 0) ? 1 : read_status);
+        if(fs->done_map)
+        {
+            fs->done_map[ofs / BLOCKSIZE] = read_status == 0;
+        }
+        ret = 0;
+    }
+    else if(ofs >= 0 && fs->the_map && (size_t)ofs + size <= fs->map_size)
+    {
+        fs->error_map[ofs / BLOCKSIZE] = (char) ((read_status == 0) ? 1 : read_status);
+        if(fs->done_map)
+        {
+            fs->done_map[ofs / BLOCKSIZE] = read_status == 0;
+        }
+        memcpy(fs->the_map + ofs, blk, size);
+        ret = 0;
+    }
+    else if(ofs >= 0 && fseek(fs->the_file, ofs, SEEK_SET) == 0)
+    {
+        fs->error_map[ofs / BLOCKSIZE] = (char) ((read_status == 0) ? 1 : read_status);
+        if(fs->done_map)
+        {
+            fs->done_map[ofs / BLOCKSIZE] = read_status == 0;
+        }
+        ret = fwrite(blk, size, 1, fs->the_file) != 1;
     }
     else
     {
         ret = 1;
     }
 
-    atom_execute = 0;
+    if(ret == 0 && fs->block_crc && size == BLOCKSIZE)
+    {
+        fs->block_crc[ofs / BLOCKSIZE] = d64copy_crc32(0, blk, BLOCKSIZE);
+        fs->crc_done[ofs / BLOCKSIZE] = 1;
+    }
+
+    fs->atom_execute = 0;
 
     return ret;
 }
 
-static int open_disk(CBM_FILE fd, d64copy_settings *settings,
+static void free_disk(fs_disk *fs)
+{
+    if(fs->error_map)
+    {
+        free(fs->error_map);
+    }
+    if(fs->checkpoint_name)
+    {
+        free(fs->checkpoint_name);
+    }
+    if(fs->done_map)
+    {
+        free(fs->done_map);
+    }
+    if(fs->image_name)
+    {
+        free(fs->image_name);
+    }
+    if(fs->block_crc)
+    {
+        free(fs->block_crc);
+    }
+    if(fs->crc_done)
+    {
+        free(fs->crc_done);
+    }
+#ifdef HAVE_ZLIB
+    if(fs->gz)
+    {
+        gzclose(fs->gz);
+    }
+#endif
+    free(fs);
+}
+
+/*
+ * prepare the CRC of the blocks for the manifest. Without the memory
+ * for it, the image is written anyway, but not added to the manifest.
+ */
+static void setup_digest(fs_disk *fs, const char *name,
+                         d64copy_message_cb message_cb)
+{
+    fs->message_cb = message_cb;
+    fs->image_name = malloc(strlen(name) + 1);
+    if(fs->image_name != NULL)
+    {
+        strcpy(fs->image_name, name);
+    }
+    fs->block_crc = calloc(ERROR_MAP_LENGTH, sizeof(*fs->block_crc));
+    fs->crc_done = calloc(ERROR_MAP_LENGTH, 1);
+    if(fs->image_name == NULL || fs->block_crc == NULL || fs->crc_done == NULL)
+    {
+        message_cb(1, "no memory for the digest, %s is not added to %s",
+                   name, fs->settings->manifest);
+        free(fs->block_crc);
+        fs->block_crc = NULL;
+    }
+}
+
+/*
+ * the CRC of the blocks of the image, in order. The blocks not written
+ * in this copy, e.g. with --update, are taken from the image file.
+ * Returns != 0 if one of them could not be read.
+ */
+static int image_digest(fs_disk *fs, unsigned long *crc)
+{
+    unsigned char block[BLOCKSIZE];
+    unsigned long block_crc;
+    int i;
+
+    *crc = 0;
+    for(i = 0; i < fs->block_count; i++)
+    {
+        if(fs->crc_done[i])
+        {
+            block_crc = fs->block_crc[i];
+        }
+        else if(fs->the_map && (size_t)(i + 1) * BLOCKSIZE <= fs->map_size)
+        {
+            block_crc = d64copy_crc32(0, fs->the_map + (size_t)i * BLOCKSIZE, BLOCKSIZE);
+        }
+        else if(!fs->stream &&
+                fseek(fs->the_file, (long)i * BLOCKSIZE, SEEK_SET) == 0 &&
+                fread(block, BLOCKSIZE, 1, fs->the_file) == 1)
+        {
+            block_crc = d64copy_crc32(0, block, BLOCKSIZE);
+        }
+        else
+        {
+            return 1;
+        }
+        *crc = d64copy_crc32_combine(*crc, block_crc, BLOCKSIZE);
+    }
+    return 0;
+}
+
+/* append the image to the manifest, in the format of a .sfv file */
+static void write_manifest(fs_disk *fs, unsigned long crc, int has_errors)
+{
+    FILE *f;
+    long size = (long)fs->block_count * BLOCKSIZE;
+    int i, errors = 0;
+
+    for(i = 0; i < fs->block_count; i++)
+    {
+        errors += fs->error_map[i] > 1;
+    }
+
+    if(has_errors)
+    {
+        crc = d64copy_crc32_combine(crc,
+                d64copy_crc32(0, (unsigned char *)fs->error_map, fs->block_count),
+                fs->block_count);
+        size += fs->block_count;
+    }
+
+    f = fopen(fs->settings->manifest, "a");
+    if(f == NULL)
+    {
+        fs->message_cb(1, "could not open manifest %s", fs->settings->manifest);
+        return;
+    }
+    fprintf(f, "; %s: %ld bytes, %d blocks with errors\n", fs->image_name, size, errors);
+    fprintf(f, "%s %08lX\n", fs->image_name, crc);
+    fclose(f);
+}
+
+static int open_stream(d64copy_disk *disk, fs_disk *fs, int tracks,
+                       d64copy_message_cb message_cb)
+{
+    fs->block_count = fs->track_start[tracks + 1];
+    fs->map_size = (size_t)fs->block_count * BLOCKSIZE;
+
+    /* the blocks which are not copied are empty */
+    fs->the_map = calloc(fs->map_size, 1);
+    if(fs->the_map == NULL)
+    {
+        message_cb(0, "no memory for image");
+        if(fs->the_file != stdout)
+        {
+            fclose(fs->the_file);
+        }
+        free_disk(fs);
+        return 1;
+    }
+
+    if(fs->settings->resume)
+    {
+        message_cb(1, "cannot resume a compressed image or a pipe");
+    }
+
+    *disk = fs;
+    return 0;
+}
+
+/*
+ * an image which is read from stdin, a pipe or a compressed file. Its
+ * size is not known beforehand: it has the tracks of the settings, 35
+ * if none are given. An error info at its end is not used.
+ */
+static int open_input_stream(d64copy_disk *disk, fs_disk *fs, const char *name,
+                             d64copy_message_cb message_cb)
+{
+    d64copy_settings *settings = fs->settings;
+    int tr;
+
+    if(strcmp(name, "-") == 0)
+    {
+        arch_setbinmode(arch_fileno(stdin));
+        fs->the_file = stdin;
+    }
+    else if(fs->the_file == NULL)
+    {
+        fs->the_file = fopen(name, "rb");
+        if(fs->the_file == NULL)
+        {
+            message_cb(0, "could not open %s", name);
+            free_disk(fs);
+            return 1;
+        }
+    }
+
+#ifdef HAVE_ZLIB
+    {
+        /* gzread() passes an image which is not compressed as it is */
+        int gz_fd = arch_dup(arch_fileno(fs->the_file));
+
+        fs->gz = gz_fd < 0 ? NULL : gzdopen(gz_fd, "rb");
+        fs->stream_in = fs->gz != NULL;
+        if(!fs->stream_in)
+        {
+            message_cb(0, "could not start decompression");
+        }
+    }
+#else
+    fs->stream_in = !is_compressed(name);
+    if(!fs->stream_in)
+    {
+        message_cb(0, "compressed images are not supported by this build");
+    }
+#endif
+
+    if(settings->two_sided)
+    {
+        tr = D71_TRACKS;
+    }
+    else if(settings->end_track <= STD_TRACKS)
+    {
+        tr = STD_TRACKS;
+    }
+    else if(settings->end_track <= EXT_TRACKS)
+    {
+        tr = EXT_TRACKS;
+    }
+    else
+    {
+        tr = TOT_TRACKS;
+    }
+    if(settings->end_track == -1)
+    {
+        settings->end_track = tr;
+    }
+
+    fs->message_cb = message_cb;
+    fs->block_count = fs->track_start[tr + 1];
+    fs->map_size = (size_t)fs->block_count * BLOCKSIZE;
+    fs->the_map = malloc(fs->map_size);
+    if(fs->the_map == NULL)
+    {
+        message_cb(0, "no memory for image");
+    }
+
+    if(!fs->stream_in || fs->the_map == NULL)
+    {
+        if(fs->the_file != stdin)
+        {
+            fclose(fs->the_file);
+        }
+        free(fs->the_map);
+        fs->the_map = NULL;
+        free_disk(fs);
+        return 1;
+    }
+
+    *disk = fs;
+    return 0;
+}
+
+static int open_disk(d64copy_disk *disk, CBM_FILE fd, d64copy_settings *settings,
                      const void *arg, int for_writing,
                      turbo_start start, d64copy_message_cb message_cb)
 {
     off_t filesize;
     int stat_ok, is_image, error_info;
-    int tr = 0;
+    int tr = 0, i;
     char *name = (char*)arg;
+    fs_disk *fs;
 
-    the_file = NULL;
-    fs_settings = settings;
-    block_count = 0;
+    *disk = NULL;
+
+    fs = calloc(1, sizeof(*fs));
+    if(fs == NULL)
+    {
+        message_cb(0, "no memory");
+        return 1;
+    }
+
+    fs->settings = settings;
+
+    setup_track_start(fs, settings->two_sided);
 
     stat_ok = arch_filesize(name, &filesize) == 0;
     is_image = error_info = 0;
@@ -103,30 +702,30 @@ static int open_disk(CBM_FILE fd, d64copy_settings *settings,
         if(filesize == D71_BLOCKS * BLOCKSIZE)
         {
             is_image = 1;
-            block_count = D71_BLOCKS;
+            fs->block_count = D71_BLOCKS;
             tr = D71_TRACKS;
         }
         else if(filesize == D71_BLOCKS * (BLOCKSIZE + 1))
         {
             is_image = 1;
             error_info = 1;
-            block_count = D71_BLOCKS;
+            fs->block_count = D71_BLOCKS;
             tr = D71_TRACKS;
         }
         else
         {
-            block_count = STD_BLOCKS;
+            fs->block_count = STD_BLOCKS;
             for( tr = STD_TRACKS; !is_image && tr <= TOT_TRACKS; )
             {
-                is_image = filesize == block_count * BLOCKSIZE;
+                is_image = filesize == fs->block_count * BLOCKSIZE;
                 if(!is_image)
                 {
                     error_info = is_image =
-                        filesize == block_count * (BLOCKSIZE + 1);
+                        filesize == fs->block_count * (BLOCKSIZE + 1);
                 }
                 if(!is_image)
                 {
-                    block_count += d64copy_sector_count( 0, tr++ );
+                    fs->block_count += d64copy_sector_count( 0, tr++ );
                 }
             }
             if( is_image && tr != STD_TRACKS )
@@ -138,12 +737,30 @@ static int open_disk(CBM_FILE fd, d64copy_settings *settings,
 
     if(!for_writing)
     {
+        if(strcmp(name, "-") == 0 || is_compressed(name))
+        {
+            return open_input_stream(disk, fs, name, message_cb);
+        }
+        if(stat_ok && !is_image)
+        {
+            /* a pipe or a FIFO, which cannot tell its size */
+            fs->the_file = fopen(name, "rb");
+            if(fs->the_file && fseek(fs->the_file, 0, SEEK_END) != 0)
+            {
+                return open_input_stream(disk, fs, name, message_cb);
+            }
+            if(fs->the_file)
+            {
+                fclose(fs->the_file);
+                fs->the_file = NULL;
+            }
+        }
         if(stat_ok)
         {
             if(is_image)
             {
-                the_file = fopen(name, "rb");
-                if(the_file == NULL)
+                fs->the_file = fopen(name, "rb");
+                if(fs->the_file == NULL)
                 {
                     message_cb(0, "could not open %s", name);
                 }
@@ -161,6 +778,10 @@ static int open_disk(CBM_FILE fd, d64copy_settings *settings,
                     settings->end_track = tr;
                 }
                 /* FIXME: error map */
+                if(fs->the_file)
+                {
+                    map_image(fs, 0, message_cb);
+                }
             }
             else
             {
@@ -174,8 +795,32 @@ static int open_disk(CBM_FILE fd, d64copy_settings *settings,
     }
     else
     {
-        the_file = fopen(name, is_image ? "r+b" : "wb");
-        if(the_file)
+        if(strcmp(name, "-") == 0)
+        {
+            arch_setbinmode(arch_fileno(stdout));
+            fs->the_file = stdout;
+            fs->stream = 1;
+        }
+        else if(is_compressed(name))
+        {
+            /* the image is compressed in order, just like a pipe */
+            fs->the_file = fopen(name, "wb");
+            fs->stream = 1;
+            if(fs->the_file && start_compression(fs, message_cb) != 0)
+            {
+                fclose(fs->the_file);
+                arch_unlink(name);
+                free_disk(fs);
+                return 1;
+            }
+        }
+        else
+        {
+            fs->the_file = fopen(name, is_image ? "r+b" : "w+b");
+            /* a pipe has to get the image in order */
+            fs->stream = fs->the_file && fseek(fs->the_file, 0, SEEK_SET) != 0;
+        }
+        if(fs->the_file)
         {
             /* check whether we must resize or create an image file */
             int new_tr;
@@ -197,83 +842,210 @@ static int open_disk(CBM_FILE fd, d64copy_settings *settings,
             }
 
             /* always use maximum size for error map */
-            error_map = calloc(ERROR_MAP_LENGTH, 1);
-            if(!error_map)
+            fs->error_map = calloc(ERROR_MAP_LENGTH, 1);
+            if(!fs->error_map)
             {
                 message_cb(0, "no memory for error map");
-                fclose(the_file);
-                if(!is_image)
+                if(fs->the_file != stdout)
+                {
+                    fclose(fs->the_file);
+                }
+                if(!is_image && !fs->stream)
                 {
                     arch_unlink(name);
                 }
+                free_disk(fs);
                 return 1;
             }
 
+            if(settings->manifest)
+            {
+                setup_digest(fs, name, message_cb);
+            }
+
+            /* an image in a pipe is gone when it is written */
+            if(settings->container && !fs->stream && fs->image_name == NULL)
+            {
+                fs->message_cb = message_cb;
+                fs->image_name = malloc(strlen(name) + 1);
+                if(fs->image_name != NULL)
+                {
+                    strcpy(fs->image_name, name);
+                }
+            }
+            if(settings->container && (fs->stream || fs->image_name == NULL))
+            {
+                message_cb(1, "%s is not added to %s", name, settings->container);
+            }
+
+            if(fs->stream)
+            {
+                return open_stream(disk, fs, new_tr, message_cb);
+            }
+
             if(is_image)
             {
                 if(error_info)
                 {
-                    if(fseek(the_file, block_count * BLOCKSIZE, SEEK_SET) != 0 ||
-                       fread(error_map, block_count, 1, the_file) != 1)
+                    if(fseek(fs->the_file, fs->block_count * BLOCKSIZE, SEEK_SET) != 0 ||
+                       fread(fs->error_map, fs->block_count, 1, fs->the_file) != 1)
                     {
                         message_cb(0, "%s: could not read error map", name);
-                        fclose(the_file);
+                        fclose(fs->the_file);
+                        free_disk(fs);
                         return 1;
                     }
                 }
-                if(fseek(the_file, block_count * BLOCKSIZE, SEEK_SET) != 0)
+                if(fseek(fs->the_file, fs->block_count * BLOCKSIZE, SEEK_SET) != 0)
                 {
                     message_cb(0, "%s: could not seek to end of file", name);
-                    fclose(the_file);
+                    fclose(fs->the_file);
+                    free_disk(fs);
                     return 1;
                 }
             }
 
+            if(settings->resume)
+            {
+                fs->checkpoint_name = malloc(strlen(name) + sizeof(".chk"));
+                fs->done_map = calloc(ERROR_MAP_LENGTH, 1);
+                if(fs->checkpoint_name == NULL || fs->done_map == NULL)
+                {
+                    message_cb(0, "no memory for checkpoint");
+                    fclose(fs->the_file);
+                    if(!is_image)
+                    {
+                        arch_unlink(name);
+                    }
+                    free_disk(fs);
+                    return 1;
+                }
+                strcpy(fs->checkpoint_name, name);
+                strcat(fs->checkpoint_name, ".chk");
+
+                if(is_image && read_checkpoint(fs) == 0)
+                {
+                    message_cb(2, "resuming from %s", fs->checkpoint_name);
+                    for(i = 0; i < fs->block_count; i++)
+                    {
+                        if(fs->done_map[i])
+                        {
+                            fs->error_map[i] = 1;
+                        }
+                    }
+                    fs->resumed = 1;
+                }
+                else if(is_image && error_info)
+                {
+                    message_cb(2, "resuming from the error map of %s", name);
+                    for(i = 0; i < fs->block_count; i++)
+                    {
+                        fs->done_map[i] = fs->error_map[i] == 1;
+                    }
+                    fs->resumed = 1;
+                }
+                else
+                {
+                    message_cb(1, "nothing to resume in %s", name);
+                }
+            }
+
+            /* what is not already in the image may be left as holes */
+            fs->sparse_from = is_image ? (long)fs->block_count * BLOCKSIZE : 0;
+
             if(new_tr > tr)
             {
                 /* grow image */
                 while(tr < new_tr)
                 {
-                    block_count += d64copy_sector_count(settings->two_sided, ++tr);
+                    fs->block_count += d64copy_sector_count(settings->two_sided, ++tr);
                 }
 
-                message_cb(1, "growing image file to %d blocks", block_count);
+                message_cb(1, "growing image file to %d blocks", fs->block_count);
 
-                if (arch_ftruncate(arch_fileno(the_file), block_count * BLOCKSIZE) != 0)
+                if (arch_ftruncate(arch_fileno(fs->the_file), fs->block_count * BLOCKSIZE) != 0)
                 {
                     message_cb(0, "%s: could not extend image file", name);
-                    fclose(the_file);
+                    fclose(fs->the_file);
                     if(!is_image)
                         arch_unlink(name);
+                    free_disk(fs);
                     return 1;
                 }
             }
+
+            map_image(fs, 1, message_cb);
         }
         else
         {
             message_cb(0, "could not open %s", name);
         }
     }
-    return the_file == NULL;
+    if(fs->the_file == NULL)
+    {
+        free_disk(fs);
+        return 1;
+    }
+    *disk = fs;
+    return 0;
 }
 
-static void close_disk(void)
+static void close_disk(d64copy_disk disk)
 {
+    fs_disk *fs = disk;
     int i, has_errors = 0;
+    int digest_ok = 0;
+    unsigned long crc = 0;
 
     /* if writing the block was interrupted, make sure it is
      * redone before closing the disk
      */
 
-    if (the_file && atom_execute)
+    if(fs->stream_in)
+    {
+#ifdef HAVE_ZLIB
+        if(fs->gz)
+        {
+            gzclose(fs->gz);
+            fs->gz = NULL;
+        }
+#endif
+        if(fs->the_file != stdin)
+        {
+            fclose(fs->the_file);
+        }
+        unmap_image(fs);
+        free_disk(fs);
+        return;
+    }
+
+    if (fs->the_file && fs->atom_execute)
     {
-        atom_execute = 0;
-        write_block(atom_tr, atom_se, atom_blk, atom_size, atom_read_status);
+        fs->atom_execute = 0;
+        write_block(fs, fs->atom_tr, fs->atom_se, fs->atom_blk, fs->atom_size, fs->atom_read_status);
     }
 
-    if (fs_settings)
+    if(fs->the_file && fs->stream)
     {
-        switch(fs_settings->error_mode)
+        flush_stream(fs, fs->block_count);
+    }
+
+    if(fs->the_file && fs->block_crc)
+    {
+        digest_ok = image_digest(fs, &crc) == 0;
+        if(!digest_ok)
+        {
+            fs->message_cb(1, "could not read %s back, it is not added to %s",
+                           fs->image_name, fs->settings->manifest);
+        }
+    }
+
+    /* the file cannot be truncated while it is mapped */
+    unmap_image(fs);
+
+    if (fs->settings)
+    {
+        switch(fs->settings->error_mode)
         {
             case em_always:
                 has_errors = 1;
@@ -282,45 +1054,93 @@ static void close_disk(void)
                 has_errors = 0;
                 break;
             default:
-                if(error_map)
+                if(fs->error_map)
                 {
-                    for(i = 0; !has_errors && i < block_count; i++)
+                    for(i = 0; !has_errors && i < fs->block_count; i++)
                     {
-                        has_errors = error_map[i] != 1;
+                        has_errors = fs->error_map[i] != 1;
                     }
                 }
                 break;
         }
     }
 
-    if(the_file)
+    if(fs->the_file && fs->checkpoint_name)
+    {
+        int complete = 1;
+
+        for(i = 0; complete && i < fs->block_count; i++)
+        {
+            complete = fs->done_map[i];
+        }
+
+        /* the error map appended to the image will do from now on */
+        if(complete || has_errors)
+        {
+            arch_unlink(fs->checkpoint_name);
+        }
+        else
+        {
+            write_checkpoint(fs);
+        }
+    }
+
+    if(fs->the_file && fs->stream)
     {
         if(has_errors)
         {
-            if(fseek(the_file, block_count * BLOCKSIZE, SEEK_SET) == 0)
+            stream_write(fs, fs->error_map, fs->block_count);
+        }
+#ifdef HAVE_ZLIB
+        if(fs->gz)
+        {
+            gzclose(fs->gz);
+            fs->gz = NULL;
+        }
+#endif
+    }
+    else if(fs->the_file)
+    {
+        if(has_errors)
+        {
+            if(fseek(fs->the_file, fs->block_count * BLOCKSIZE, SEEK_SET) == 0)
             {
-                fwrite(error_map, block_count, 1, the_file);
+                fwrite(fs->error_map, fs->block_count, 1, fs->the_file);
             }
         }
         else
         {
-            if (arch_ftruncate(arch_fileno(the_file), block_count * BLOCKSIZE) < 0)
+            if (arch_ftruncate(arch_fileno(fs->the_file), fs->block_count * BLOCKSIZE) < 0)
             {
                 /* ignore it */
             }
         }
     }
 
-    if(error_map)
+    if(fs->the_file == stdout)
     {
-        free(error_map);
-        error_map = NULL;
+        fflush(stdout);
     }
-    if(the_file)
+    else if(fs->the_file)
+    {
+        fclose(fs->the_file);
+    }
+
+    if(digest_ok)
     {
-        fclose(the_file);
-        the_file = NULL;
+        write_manifest(fs, crc, has_errors);
+    }
+
+    if(fs->the_file && !fs->stream && fs->image_name &&
+       fs->settings && fs->settings->container)
+    {
+        if(d64copy_container_add(fs->settings->container, fs->image_name,
+                                 fs->message_cb) == 0)
+        {
+            arch_unlink(fs->image_name);
+        }
     }
+    free_disk(fs);
 }
 
-DECLARE_TRANSFER_FUNCS(fs_transfer, 0, 0);
+DECLARE_TRANSFER_FUNCS_IMAGE(fs_transfer);
@@ -0,0 +1,557 @@
+/*
+ *  This program is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU General Public License
+ *  as published by the Free Software Foundation; either version
+ *  2 of the License, or (at your option) any later version.
+*/
+
+#include "d64copy_int.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "arch.h"
+
+/*
+ * .g64 images hold the GCR data of every track, as it is on the disk.
+ *
+ * When writing, the blocks are collected, and the tracks are built
+ * like the 1541 formats them when the image is closed. A block which
+ * could not be read is written with the error it has been read with,
+ * so that a copy protection which checks for it still finds it.
+ *
+ * When reading, the sectors are searched in the GCR data of the track.
+ * Only SYNCs which end on a byte boundary are found; this is what this
+ * file and most other tools write.
+ *
+ * .nib images, as nibread writes them, can be read, too: a track holds
+ * more than one revolution there, so every sector is found in one piece.
+ */
+
+/* halftracks in a .g64 image */
+#define G64_TRACKS       84
+/* the maximum size of a track */
+#define G64_TRACK_MAXLEN 7928
+/* signature, version, number of tracks, maximum size; offsets, speed zones */
+#define G64_HEADER_SIZE  (12 + G64_TRACKS * 8)
+
+/* signature, version, (halftrack, density) pairs; the tracks follow */
+#define NIB_HEADER_SIZE  0x100
+#define NIB_TRACK_LENGTH 0x2000
+#define NIB_TRACKS       ((NIB_HEADER_SIZE - 0x10) / 2)
+
+#define SYNC_LENGTH      5
+#define HEADER_GAP       9
+#define HEADER_GCR_SIZE  10
+#define DATA_GCR_SIZE    (GCRBUFSIZE - 1)
+
+/* how far behind its header the SYNC of a data block is searched */
+#define DATA_SYNC_DISTANCE 64
+
+/* the bytes of a track at 300 RPM, and the gaps between two sectors */
+static const int zone_capacity[4] = { 6250, 6666, 7142, 7692 };
+static const int zone_gap[4] = { 9, 12, 17, 8 };
+
+typedef struct
+{
+    d64copy_settings *settings;
+    d64copy_message_cb message_cb;
+
+    int for_writing;
+    int tracks;
+
+    /* writing: the blocks, and the status they have been read with */
+    FILE *the_file;
+    unsigned char *blocks;
+    char *status;
+    int track_start[TOT_TRACKS + 2];
+
+    /* reading: the whole image */
+    unsigned char *image;
+    size_t image_size;
+    int nib;
+} g64_disk;
+
+static int speed_zone(int tr)
+{
+    if(tr < 18) return 3;
+    if(tr < 25) return 2;
+    if(tr < 31) return 1;
+    return 0;
+}
+
+static void put_le16(unsigned char *p, unsigned int value)
+{
+    p[0] = (unsigned char) value;
+    p[1] = (unsigned char) (value >> 8);
+}
+
+static void put_le32(unsigned char *p, unsigned long value)
+{
+    put_le16(p, (unsigned int) (value & 0xffff));
+    put_le16(p + 2, (unsigned int) (value >> 16));
+}
+
+static unsigned long get_le32(const unsigned char *p)
+{
+    return p[0] | (p[1] << 8) | ((unsigned long) p[2] << 16) | ((unsigned long) p[3] << 24);
+}
+
+static void fill(unsigned char *track, int *n, unsigned char value, int count)
+{
+    memset(track + *n, value, count);
+    *n += count;
+}
+
+/*
+ * build a track like the 1541 formats it; the read status of a block
+ * decides which part of the sector is damaged on purpose
+ */
+static int build_track(g64_disk *g, int tr, unsigned char *track)
+{
+    const unsigned char *bam = g->blocks + (size_t)g->track_start[18] * BLOCKSIZE;
+    unsigned char header[8], data[GCRDECODEDSIZE];
+    int zone = speed_zone(tr);
+    int se, i, n = 0;
+
+    for(se = 0; se < d64copy_sector_count(0, tr); se++)
+    {
+        const unsigned char *blk = g->blocks + (size_t)(g->track_start[tr] + se) * BLOCKSIZE;
+        int status = g->status[g->track_start[tr] + se];
+        unsigned char sync = (status == 3) ? 0x55 : 0xff;
+
+        header[0] = (status == 2) ? 0x00 : 0x08;
+        header[2] = (unsigned char) se;
+        header[3] = (unsigned char) tr;
+        header[4] = bam[0xa3];
+        header[5] = bam[0xa2];
+        if(status == 11)
+        {
+            header[4] ^= 0xff;
+            header[5] ^= 0xff;
+        }
+        header[1] = header[2] ^ header[3] ^ header[4] ^ header[5];
+        if(status == 9)
+        {
+            header[1] ^= 0xff;
+        }
+        header[6] = header[7] = 0x0f;
+
+        data[0] = (status == 4) ? 0x00 : 0x07;
+        data[BLOCKSIZE + 1] = 0;
+        for(i = 0; i < BLOCKSIZE; i++)
+        {
+            data[i + 1] = blk[i];
+            data[BLOCKSIZE + 1] ^= blk[i];
+        }
+        if(status == 5)
+        {
+            data[BLOCKSIZE + 1] ^= 0xff;
+        }
+        data[BLOCKSIZE + 2] = data[BLOCKSIZE + 3] = 0;
+
+        fill(track, &n, sync, SYNC_LENGTH);
+        gcr_4_to_5_encode_track(header, track + n, sizeof(header), HEADER_GCR_SIZE);
+        n += HEADER_GCR_SIZE;
+        fill(track, &n, 0x55, HEADER_GAP);
+
+        fill(track, &n, sync, SYNC_LENGTH);
+        gcr_4_to_5_encode_track(data, track + n, sizeof(data), DATA_GCR_SIZE);
+        n += DATA_GCR_SIZE;
+        fill(track, &n, 0x55, zone_gap[zone]);
+    }
+
+    /* the tail gap up to the end of the track */
+    if(n < zone_capacity[zone])
+    {
+        fill(track, &n, 0x55, zone_capacity[zone] - n);
+    }
+
+    return n;
+}
+
+static int write_image(g64_disk *g)
+{
+    unsigned char header[G64_HEADER_SIZE];
+    unsigned char track[2 + G64_TRACK_MAXLEN];
+    unsigned long offset = sizeof(header);
+    int tr;
+
+    memset(header, 0, sizeof(header));
+    memcpy(header, "GCR-1541", 8);
+    header[9] = G64_TRACKS;
+    put_le16(&header[10], G64_TRACK_MAXLEN);
+
+    for(tr = 1; tr <= g->tracks; tr++)
+    {
+        put_le32(&header[12 + (tr - 1) * 2 * 4], offset);
+        put_le32(&header[12 + G64_TRACKS * 4 + (tr - 1) * 2 * 4], speed_zone(tr));
+        offset += sizeof(track);
+    }
+
+    if(fwrite(header, sizeof(header), 1, g->the_file) != 1)
+    {
+        return 1;
+    }
+
+    for(tr = 1; tr <= g->tracks; tr++)
+    {
+        memset(track, 0x55, sizeof(track));
+        put_le16(track, build_track(g, tr, track + 2));
+        if(fwrite(track, sizeof(track), 1, g->the_file) != 1)
+        {
+            return 1;
+        }
+    }
+
+    return 0;
+}
+
+/* the GCR data of a full track, NULL if it is not in the image */
+static const unsigned char *get_track(g64_disk *g, int tr, unsigned int *len)
+{
+    unsigned long offset;
+    int i;
+
+    if(g->nib)
+    {
+        /* the tracks are in the order of the table of halftracks */
+        for(i = 0; i < NIB_TRACKS && g->image[0x10 + i * 2] != 0; i++)
+        {
+            offset = NIB_HEADER_SIZE + (unsigned long)i * NIB_TRACK_LENGTH;
+            if(g->image[0x10 + i * 2] == tr * 2 &&
+               offset + NIB_TRACK_LENGTH <= g->image_size)
+            {
+                *len = NIB_TRACK_LENGTH;
+                return &g->image[offset];
+            }
+        }
+        return NULL;
+    }
+
+    offset = get_le32(&g->image[12 + (tr - 1) * 2 * 4]);
+
+    if(offset == 0 || offset + 2 > g->image_size)
+    {
+        return NULL;
+    }
+
+    *len = g->image[offset] | (g->image[offset + 1] << 8);
+    if(*len > G64_TRACK_MAXLEN || offset + 2 + *len > g->image_size)
+    {
+        return NULL;
+    }
+    return &g->image[offset + 2];
+}
+
+static int sync_ends_at(const unsigned char *track, unsigned int len, unsigned int i)
+{
+    return track[(i + len - 1) % len] == 0xff && track[i % len] != 0xff;
+}
+
+static void copy_circular(const unsigned char *track, unsigned int len,
+                          unsigned int from, unsigned char *dest, unsigned int count)
+{
+    unsigned int i;
+
+    for(i = 0; i < count; i++)
+    {
+        dest[i] = track[(from + i) % len];
+    }
+}
+
+/*
+ * search a sector in the GCR data of a track; returns the read status
+ * of the 1541 job codes: 0 if it is fine, 2 if the header is not found,
+ * 3 if there is no SYNC, 4 if the data block is not found, 5 for a
+ * checksum error in the data block, 9 for one in the header
+ */
+static int find_sector(const unsigned char *track, unsigned int len,
+                       unsigned char tr, unsigned char se, unsigned char *block)
+{
+    unsigned char gcr[GCRBUFSIZE], header[8];
+    unsigned int i, j;
+    int synced = 0;
+
+    for(i = 0; i < len; i++)
+    {
+        if(!sync_ends_at(track, len, i))
+        {
+            continue;
+        }
+        synced = 1;
+
+        copy_circular(track, len, i, gcr, HEADER_GCR_SIZE);
+        gcr_5_to_4_decode_track(gcr, header, HEADER_GCR_SIZE, sizeof(header));
+        if(header[0] != 0x08 || header[2] != se || header[3] != tr)
+        {
+            continue;
+        }
+        if((header[1] ^ header[2] ^ header[3] ^ header[4] ^ header[5]) != 0)
+        {
+            return 9;
+        }
+
+        for(j = HEADER_GCR_SIZE; j < HEADER_GCR_SIZE + DATA_SYNC_DISTANCE; j++)
+        {
+            if(sync_ends_at(track, len, i + j))
+            {
+                copy_circular(track, len, i + j, gcr, DATA_GCR_SIZE);
+                gcr[GCRBUFSIZE - 1] = 0;
+                return gcr_decode(gcr, block);
+            }
+        }
+        return 4;
+    }
+
+    return synced ? 2 : 3;
+}
+
+static int read_block(d64copy_disk disk, unsigned char tr, unsigned char se, unsigned char *block)
+{
+    g64_disk *g = disk;
+    const unsigned char *track;
+    unsigned int len;
+
+    if(g->for_writing || tr < 1 || tr > g->tracks)
+    {
+        return 1;
+    }
+
+    track = get_track(g, tr, &len);
+    if(track == NULL || len == 0)
+    {
+        return 3;
+    }
+
+    return find_sector(track, len, tr, se, block);
+}
+
+static int write_block(d64copy_disk disk, unsigned char tr, unsigned char se, const unsigned char *blk, int size, int read_status)
+{
+    g64_disk *g = disk;
+    int index;
+
+    if(!g->for_writing || tr < 1 || tr > g->tracks ||
+       se >= d64copy_sector_count(0, tr) || size > BLOCKSIZE)
+    {
+        return 1;
+    }
+
+    index = g->track_start[tr] + se;
+    memcpy(g->blocks + (size_t)index * BLOCKSIZE, blk, size);
+    g->status[index] = (char) read_status;
+
+    return 0;
+}
+
+static void free_disk(g64_disk *g)
+{
+    if(g->the_file)
+    {
+        fclose(g->the_file);
+    }
+    free(g->blocks);
+    free(g->status);
+    free(g->image);
+    free(g);
+}
+
+static int open_for_reading(g64_disk *g, const char *name)
+{
+    d64copy_settings *settings = g->settings;
+    off_t filesize;
+    FILE *f;
+    int tr;
+    unsigned int len;
+
+    if(arch_filesize(name, &filesize) != 0)
+    {
+        g->message_cb(0, "could not stat %s", name);
+        return 1;
+    }
+
+    g->image_size = (size_t)filesize;
+    g->image = malloc(g->image_size > 0 ? g->image_size : 1);
+    if(g->image == NULL)
+    {
+        g->message_cb(0, "no memory for image");
+        return 1;
+    }
+
+    f = fopen(name, "rb");
+    if(f == NULL)
+    {
+        g->message_cb(0, "could not open %s", name);
+        return 1;
+    }
+    if(fread(g->image, g->image_size, 1, f) != 1)
+    {
+        g->image_size = 0;
+    }
+    fclose(f);
+
+    if(g->image_size >= NIB_HEADER_SIZE &&
+       memcmp(g->image, "MNIB-1541-RAW", 13) == 0)
+    {
+        g->nib = 1;
+    }
+    else if(g->image_size < G64_HEADER_SIZE || memcmp(g->image, "GCR-1541", 8) != 0)
+    {
+        g->message_cb(0, "not a .g64 file: %s", name);
+        return 1;
+    }
+
+    for(tr = TOT_TRACKS; tr > 0 && get_track(g, tr, &len) == NULL; tr--)
+        ;
+    if(tr == 0)
+    {
+        g->message_cb(0, "%s holds no tracks", name);
+        return 1;
+    }
+    if(tr != STD_TRACKS)
+    {
+        g->message_cb(1, "non-standard number or tracks: %d", tr);
+    }
+    g->tracks = tr;
+
+    if(settings->end_track == -1)
+    {
+        settings->end_track = tr;
+    }
+    else if(settings->end_track > tr)
+    {
+        g->message_cb(1, "resetting end track to %d", tr);
+        settings->end_track = tr;
+    }
+
+    return 0;
+}
+
+static int open_for_writing(g64_disk *g, const char *name)
+{
+    d64copy_settings *settings = g->settings;
+    int tr;
+
+    if(settings->end_track <= STD_TRACKS)
+    {
+        g->tracks = STD_TRACKS;
+    }
+    else if(settings->end_track <= EXT_TRACKS)
+    {
+        g->tracks = EXT_TRACKS;
+    }
+    else
+    {
+        g->tracks = TOT_TRACKS;
+    }
+
+    if(settings->resume)
+    {
+        g->message_cb(1, "cannot resume a .g64 image");
+    }
+
+    g->track_start[1] = 0;
+    for(tr = 1; tr <= TOT_TRACKS; tr++)
+    {
+        g->track_start[tr + 1] = g->track_start[tr] + d64copy_sector_count(0, tr);
+    }
+
+    /* the blocks which are not copied are empty */
+    g->blocks = calloc(g->track_start[TOT_TRACKS + 1], BLOCKSIZE);
+    g->status = calloc(g->track_start[TOT_TRACKS + 1], 1);
+    if(g->blocks == NULL || g->status == NULL)
+    {
+        g->message_cb(0, "no memory for image");
+        return 1;
+    }
+
+    g->the_file = fopen(name, "wb");
+    if(g->the_file == NULL)
+    {
+        g->message_cb(0, "could not open %s", name);
+        return 1;
+    }
+
+    return 0;
+}
+
+static int is_nib_image(const char *name)
+{
+    size_t len = strlen(name);
+
+    return len > 4 && arch_strcasecmp(name + len - 4, ".nib") == 0;
+}
+
+static int open_disk(d64copy_disk *disk, CBM_FILE fd, d64copy_settings *settings,
+                     const void *arg, int for_writing,
+                     turbo_start start, d64copy_message_cb message_cb)
+{
+    const char *name = arg;
+    g64_disk *g;
+    int ret;
+
+    *disk = NULL;
+
+    if(settings->two_sided)
+    {
+        message_cb(0, ".g64 images cannot hold a double sided disk");
+        return 1;
+    }
+
+    g = calloc(1, sizeof(*g));
+    if(g == NULL)
+    {
+        message_cb(0, "no memory");
+        return 1;
+    }
+
+    g->settings = settings;
+    g->message_cb = message_cb;
+    g->for_writing = for_writing;
+
+    if(for_writing && is_nib_image(name))
+    {
+        message_cb(0, ".nib images can only be read: %s", name);
+        free_disk(g);
+        return 1;
+    }
+
+    ret = for_writing ? open_for_writing(g, name) : open_for_reading(g, name);
+    if(ret)
+    {
+        if(g->the_file)
+        {
+            fclose(g->the_file);
+            g->the_file = NULL;
+            arch_unlink(name);
+        }
+        free_disk(g);
+        return ret;
+    }
+
+    *disk = g;
+    return 0;
+}
+
+static void close_disk(d64copy_disk disk)
+{
+    g64_disk *g = disk;
+
+    if(g->for_writing && write_image(g) != 0)
+    {
+        g->message_cb(0, "could not write the .g64 image");
+    }
+    free_disk(g);
+}
+
+transfer_funcs d64copy_g64_transfer = {open_disk,
+                        read_block,
+                        write_block,
+                        close_disk,
+                        0,
+                        0,
+                        NULL,
+                        NULL,
+                        NULL};
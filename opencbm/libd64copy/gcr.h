@@ -13,6 +13,7 @@
 
 #define BLOCKSIZE   256
 #define GCRBUFSIZE  326
+#define GCRDECODEDSIZE  ((GCRBUFSIZE / 5) * 4)
 
 #include "opencbm.h"
 
@@ -21,6 +22,7 @@ extern "C" {
 #endif
 
 extern int gcr_decode(const unsigned char *gcr,   unsigned char *decoded);
+extern int gcr_check_decoded(const unsigned char *gcrdecoded, unsigned char *decoded);
 extern int gcr_encode(const unsigned char *block, unsigned char *encoded);
 
 #ifdef __cplusplus
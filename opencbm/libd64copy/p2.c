@@ -0,0 +1,309 @@
+/*
+ *  This program is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU General Public License
+ *  as published by the Free Software Foundation; either version
+ *  2 of the License, or (at your option) any later version.
+ *
+*/
+
+/*
+ * The parallel2 transfer: the XP1541 cable with one byte per handshake,
+ * as cbmcopy uses it (the P2 protocol of the xu1541 and xum1541). The
+ * bytes go one by one, so no byte is sent twice to fill a pair, and the
+ * adapter runs the whole transfer on its own.
+ */
+
+#include "opencbm.h"
+#include "d64copy_int.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "arch.h"
+
+#include "opencbm-plugin.h"
+
+enum p2_direction_e
+{
+    P2_READ, P2_WRITE
+};
+
+typedef struct
+{
+    CBM_FILE fd_cbm;
+    int two_sided;
+    enum p2_direction_e direction;
+
+    opencbm_plugin_pp_cc_read_n_t * opencbm_plugin_pp_cc_read_n;
+    opencbm_plugin_pp_cc_write_n_t * opencbm_plugin_pp_cc_write_n;
+} p2_disk;
+
+static const unsigned char p21541_drive_prog[] = {
+#include "p21541.inc"
+};
+
+static const unsigned char p21571_drive_prog[] = {
+#include "p21571.inc"
+};
+
+static void p2_check_direction(p2_disk *d, enum p2_direction_e dir)
+{
+    if(d->direction != dir)
+    {
+        arch_sleep_us(100);
+        d->direction = dir;
+    }
+}
+
+static void p2_write(p2_disk *d, unsigned char c)
+{
+    CBM_FILE fd = d->fd_cbm;
+                                                                        SETSTATEDEBUG((void)0);
+    cbm_pp_write(fd, c);
+                                                                        SETSTATEDEBUG((void)0);
+    cbm_iec_release(fd, IEC_CLOCK);
+                                                                        SETSTATEDEBUG((void)0);
+#ifndef USE_CBM_IEC_WAIT
+    while(cbm_iec_get(fd, IEC_DATA)) {
+    }
+#else
+    cbm_iec_wait(fd, IEC_DATA, 0);
+#endif
+                                                                        SETSTATEDEBUG((void)0);
+    cbm_iec_set(fd, IEC_CLOCK);
+                                                                        SETSTATEDEBUG((void)0);
+#ifndef USE_CBM_IEC_WAIT
+    while(!cbm_iec_get(fd, IEC_DATA)) {
+    }
+#else
+    cbm_iec_wait(fd, IEC_DATA, 1);
+#endif
+                                                                        SETSTATEDEBUG((void)0);
+}
+
+/* write_n redirects USB writes to the external reader if required */
+static void write_n(p2_disk *d, const unsigned char *data, int size)
+{
+    p2_check_direction(d, P2_WRITE);
+
+    if (d->opencbm_plugin_pp_cc_write_n)
+    {
+        d->opencbm_plugin_pp_cc_write_n(d->fd_cbm, data, size);
+        return;
+    }
+
+    while(size-- > 0)
+        p2_write(d, *data++);
+}
+
+static unsigned char p2_read(p2_disk *d)
+{
+    CBM_FILE fd = d->fd_cbm;
+    unsigned char c;
+                                                                        SETSTATEDEBUG((void)0);
+    cbm_iec_release(fd, IEC_CLOCK);
+                                                                        SETSTATEDEBUG((void)0);
+#ifndef USE_CBM_IEC_WAIT
+    while(cbm_iec_get(fd, IEC_DATA)) {
+    }
+#else
+    cbm_iec_wait(fd, IEC_DATA, 0);
+#endif
+                                                                        SETSTATEDEBUG((void)0);
+    c = cbm_pp_read(fd);
+                                                                        SETSTATEDEBUG((void)0);
+    cbm_iec_set(fd, IEC_CLOCK);
+                                                                        SETSTATEDEBUG((void)0);
+#ifndef USE_CBM_IEC_WAIT
+    while(!cbm_iec_get(fd, IEC_DATA)) {
+    }
+#else
+    cbm_iec_wait(fd, IEC_DATA, 1);
+#endif
+                                                                        SETSTATEDEBUG((void)0);
+    return c;
+}
+
+/* read_n redirects USB reads to the external reader if required */
+static void read_n(p2_disk *d, unsigned char *data, int size)
+{
+    if(d->direction != P2_READ)
+    {
+        p2_check_direction(d, P2_READ);
+        /* the port of the cable must not drive the lines anymore */
+        cbm_pp_read(d->fd_cbm);
+    }
+
+    if (d->opencbm_plugin_pp_cc_read_n)
+    {
+        d->opencbm_plugin_pp_cc_read_n(d->fd_cbm, data, size);
+        return;
+    }
+
+    while(size-- > 0)
+        *data++ = p2_read(d);
+}
+
+static int read_block(d64copy_disk disk, unsigned char tr, unsigned char se, unsigned char *block)
+{
+    p2_disk *d = disk;
+    unsigned char buf[1 + BLOCKSIZE];
+                                                                        SETSTATEDEBUG((void)0);
+
+    buf[0] = tr; buf[1] = se;
+    write_n(d, buf, 2);
+
+#ifndef USE_CBM_IEC_WAIT
+    arch_sleep_ms(20);
+#endif
+                                                                        SETSTATEDEBUG(DebugByteCount=0);
+    /* the drive always sends the status and the data: read them as one */
+    read_n(d, buf, sizeof(buf));
+    memcpy(block, buf + 1, BLOCKSIZE);
+                                                                        SETSTATEDEBUG(DebugByteCount=-1);
+
+                                                                        SETSTATEDEBUG((void)0);
+    return buf[0];
+}
+
+static int write_block(d64copy_disk disk, unsigned char tr, unsigned char se, const unsigned char *blk, int size, int read_status)
+{
+    p2_disk *d = disk;
+    unsigned char status[2];
+
+                                                                        SETSTATEDEBUG((void)0);
+    status[0] = tr; status[1] = se;
+    write_n(d, status, 2);
+
+                                                                        SETSTATEDEBUG(DebugByteCount=0);
+    write_n(d, blk, size);
+
+                                                                        SETSTATEDEBUG(DebugByteCount=-1);
+#ifndef USE_CBM_IEC_WAIT
+    if(size == BLOCKSIZE) {
+        arch_sleep_ms(20);
+    }
+#endif
+
+                                                                        SETSTATEDEBUG((void)0);
+    read_n(d, status, 1);
+
+                                                                        SETSTATEDEBUG((void)0);
+    return status[0];
+}
+
+static int open_disk(d64copy_disk *disk, CBM_FILE fd, d64copy_settings *settings,
+                     const void *arg, int for_writing,
+                     turbo_start start, d64copy_message_cb message_cb)
+{
+    unsigned char drv = (unsigned char)(ULONG_PTR)arg;
+    const unsigned char *drive_prog;
+    int prog_size;
+    p2_disk *d;
+
+    *disk = NULL;
+
+    d = malloc(sizeof(*d));
+    if(d == NULL)
+    {
+        message_cb(0, "no memory");
+        return 1;
+    }
+
+    d->fd_cbm    = fd;
+    d->two_sided = settings->two_sided;
+    d->direction = P2_READ;
+
+    d->opencbm_plugin_pp_cc_read_n = cbm_get_plugin_function_address("opencbm_plugin_pp_cc_read_n");
+
+    d->opencbm_plugin_pp_cc_write_n = cbm_get_plugin_function_address("opencbm_plugin_pp_cc_write_n");
+
+    if(settings->drive_type != cbm_dt_cbm1541)
+    {
+        drive_prog = p21571_drive_prog;
+        prog_size  = sizeof(p21571_drive_prog);
+    }
+    else
+    {
+        drive_prog = p21541_drive_prog;
+        prog_size  = sizeof(p21541_drive_prog);
+    }
+
+                                                                        SETSTATEDEBUG((void)0);
+    /* make sure the XP1541 portion of the cable is in input mode */
+    cbm_pp_read(d->fd_cbm);
+
+                                                                        SETSTATEDEBUG((void)0);
+    cbm_upload_resident(d->fd_cbm, drv, 0x700, drive_prog, prog_size);
+                                                                        SETSTATEDEBUG((void)0);
+    start(fd, drv);
+                                                                        SETSTATEDEBUG((void)0);
+    cbm_iec_set(d->fd_cbm, IEC_CLOCK);
+                                                                        SETSTATEDEBUG((void)0);
+    cbm_iec_wait(d->fd_cbm, IEC_DATA, 1);
+                                                                        SETSTATEDEBUG((void)0);
+    *disk = d;
+    return 0;
+}
+
+static void close_disk(d64copy_disk disk)
+{
+    p2_disk *d = disk;
+    unsigned char ts[2] = { 0, 0 };
+                                                                        SETSTATEDEBUG((void)0);
+    write_n(d, ts, 2);
+    arch_sleep_us(100);
+                                                                        SETSTATEDEBUG((void)0);
+    cbm_iec_wait(d->fd_cbm, IEC_DATA, 0);
+
+    /* make sure the XP1541 portion of the cable is in input mode */
+                                                                        SETSTATEDEBUG((void)0);
+    cbm_pp_read(d->fd_cbm);
+                                                                        SETSTATEDEBUG((void)0);
+
+    free(d);
+}
+
+static int send_track_map(d64copy_disk disk, unsigned char tr, const char *trackmap, unsigned char count)
+{
+    p2_disk *d = disk;
+    int i, size;
+    unsigned char data[2 + MAX_SECTORS];
+
+    size = d64copy_sector_count(d->two_sided, tr);
+
+    data[0] = tr;
+    data[1] = count;
+
+    /* build track map */
+    for(i = 0; i < size; i++)
+        data[2+i] = !NEED_SECTOR(trackmap[i]);
+
+    write_n(d, data, size+2);
+                                                                        SETSTATEDEBUG((void)0);
+    return 0;
+}
+
+static int read_gcr_raw(d64copy_disk disk, unsigned char *se, unsigned char *gcr, int *decode_result)
+{
+    p2_disk *d = disk;
+    unsigned char s[2];
+                                                                        SETSTATEDEBUG((void)0);
+    /* the sector and the status */
+    read_n(d, s, 2);
+    *se = s[0];
+
+    if(s[1]) {
+        return s[1];
+    }
+                                                                        SETSTATEDEBUG(DebugByteCount=0);
+    read_n(d, gcr, GCRBUFSIZE);
+                                                                        SETSTATEDEBUG(DebugByteCount=-1);
+    /* leave the decoding to the caller */
+    *decode_result = GCR_NOT_DECODED;
+
+                                                                        SETSTATEDEBUG((void)0);
+    return 0;
+}
+
+DECLARE_TRANSFER_FUNCS_EX(p2_transfer, 1, 1);
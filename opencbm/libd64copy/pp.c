@@ -12,22 +12,27 @@
 #include "d64copy_int.h"
 
 #include <stdlib.h>
+#include <string.h>
 
 #include "arch.h"
 
 #include "opencbm-plugin.h"
 
-static opencbm_plugin_pp_dc_read_n_t * opencbm_plugin_pp_dc_read_n = NULL;
-
-static opencbm_plugin_pp_dc_write_n_t * opencbm_plugin_pp_dc_write_n = NULL;
-
 enum pp_direction_e
 {
     PP_READ, PP_WRITE
 };
 
-static CBM_FILE fd_cbm;
-static int two_sided;
+typedef struct
+{
+    CBM_FILE fd_cbm;
+    int two_sided;
+    enum pp_direction_e direction;
+
+    opencbm_plugin_pp_dc_read_n_t * opencbm_plugin_pp_dc_read_n;
+    opencbm_plugin_pp_dc_write_n_t * opencbm_plugin_pp_dc_write_n;
+    opencbm_plugin_pp_dc_read_gcr_n_t * opencbm_plugin_pp_dc_read_gcr_n;
+} pp_disk;
 
 static const unsigned char pp1541_drive_prog[] = {
 #include "pp1541.inc"
@@ -37,20 +42,20 @@ static const unsigned char pp1571_drive_prog[] = {
 #include "pp1571.inc"
 };
 
-static void pp_check_direction(enum pp_direction_e dir)
+static void pp_check_direction(pp_disk *d, enum pp_direction_e dir)
 {
-    static enum pp_direction_e direction = PP_READ;
-    if(direction != dir)
+    if(d->direction != dir)
     {
         arch_sleep_us(100);
-        direction = dir;
+        d->direction = dir;
     }
 }
 
-static int pp_write(CBM_FILE fd, char c1, char c2)
+static int pp_write(pp_disk *d, char c1, char c2)
 {
+    CBM_FILE fd = d->fd_cbm;
                                                                         SETSTATEDEBUG((void)0);
-    pp_check_direction(PP_WRITE);
+    pp_check_direction(d, PP_WRITE);
                                                                         SETSTATEDEBUG((void)0);
 #ifndef USE_CBM_IEC_WAIT
     while(!cbm_iec_get(fd, IEC_DATA)) {
@@ -80,24 +85,25 @@ static int pp_write(CBM_FILE fd, char c1, char c2)
 }
 
 /* write_n redirects USB writes to the external reader if required */
-static void write_n(const unsigned char *data, int size)
+static void write_n(pp_disk *d, const unsigned char *data, int size)
 {
     int i;
 
-    if (opencbm_plugin_pp_dc_write_n)
+    if (d->opencbm_plugin_pp_dc_write_n)
     {
-        opencbm_plugin_pp_dc_write_n(fd_cbm, data, size);
+        d->opencbm_plugin_pp_dc_write_n(d->fd_cbm, data, size);
         return;
     }
 
     for(i=0;i<size/2;i++,data+=2)
-        pp_write(fd_cbm, data[0], data[1]);
+        pp_write(d, data[0], data[1]);
 }
 
-static int pp_read(CBM_FILE fd, unsigned char *c1, unsigned char *c2)
+static int pp_read(pp_disk *d, unsigned char *c1, unsigned char *c2)
 {
+    CBM_FILE fd = d->fd_cbm;
                                                                         SETSTATEDEBUG((void)0);
-    pp_check_direction(PP_READ);
+    pp_check_direction(d, PP_READ);
                                                                         SETSTATEDEBUG((void)0);
 #ifndef USE_CBM_IEC_WAIT
     while(!cbm_iec_get(fd, IEC_DATA)) {
@@ -127,59 +133,60 @@ static int pp_read(CBM_FILE fd, unsigned char *c1, unsigned char *c2)
 }
 
 /* read_n redirects USB reads to the external reader if required */
-static void read_n(unsigned char *data, int size)
+static void read_n(pp_disk *d, unsigned char *data, int size)
 {
     int i;
 
-    if (opencbm_plugin_pp_dc_read_n)
+    if (d->opencbm_plugin_pp_dc_read_n)
     {
-        opencbm_plugin_pp_dc_read_n(fd_cbm, data, size);
+        d->opencbm_plugin_pp_dc_read_n(d->fd_cbm, data, size);
         return;
     }
 
     for(i=0;i<size/2;i++,data+=2)
-        pp_read(fd_cbm, data, data+1);
+        pp_read(d, data, data+1);
 }
 
-static int read_block(unsigned char tr, unsigned char se, unsigned char *block)
+static int read_block(d64copy_disk disk, unsigned char tr, unsigned char se, unsigned char *block)
 {
-    unsigned char status[2];
+    pp_disk *d = disk;
+    unsigned char buf[2 + BLOCKSIZE];
                                                                         SETSTATEDEBUG((void)0);
 
-    status[0] = tr; status[1] = se;
-    write_n(status, 2);
+    buf[0] = tr; buf[1] = se;
+    write_n(d, buf, 2);
 
 #ifndef USE_CBM_IEC_WAIT
     arch_sleep_ms(20);
 #endif
-                                                                        SETSTATEDEBUG((void)0);
-    read_n(status, 2);
-
                                                                         SETSTATEDEBUG(DebugByteCount=0);
-    read_n(block, BLOCKSIZE);
+    /* the drive always sends the status and the data: read them as one */
+    read_n(d, buf, sizeof(buf));
+    memcpy(block, buf + 2, BLOCKSIZE);
                                                                         SETSTATEDEBUG(DebugByteCount=-1);
 
                                                                         SETSTATEDEBUG((void)0);
-    return status[1];
+    return buf[1];
 }
 
-static int write_block(unsigned char tr, unsigned char se, const unsigned char *blk, int size, int read_status)
+static int write_block(d64copy_disk disk, unsigned char tr, unsigned char se, const unsigned char *blk, int size, int read_status)
 {
+    pp_disk *d = disk;
     int i = 0;
     unsigned char status[2];
 
                                                                         SETSTATEDEBUG((void)0);
     status[0] = tr; status[1] = se;
-    write_n(status, 2);
+    write_n(d, status, 2);
 
                                                                         SETSTATEDEBUG((void)0);
     /* send first byte twice if length is odd */
     if(size % 2) {
-        write_n(blk, 2);
+        write_n(d, blk, 2);
         i = 1;
     }
                                                                         SETSTATEDEBUG(DebugByteCount=0);
-    write_n(blk+i, size-i);
+    write_n(d, blk+i, size-i);
 
                                                                         SETSTATEDEBUG(DebugByteCount=-1);
 #ifndef USE_CBM_IEC_WAIT
@@ -189,26 +196,39 @@ static int write_block(unsigned char tr, unsigned char se, const unsigned char *
 #endif
 
                                                                         SETSTATEDEBUG((void)0);
-    read_n(status, 2);
+    read_n(d, status, 2);
 
                                                                         SETSTATEDEBUG((void)0);
     return status[1];
 }
 
-static int open_disk(CBM_FILE fd, d64copy_settings *settings,
+static int open_disk(d64copy_disk *disk, CBM_FILE fd, d64copy_settings *settings,
                      const void *arg, int for_writing,
                      turbo_start start, d64copy_message_cb message_cb)
 {
-    unsigned char d = (unsigned char)(ULONG_PTR)arg;
+    unsigned char drv = (unsigned char)(ULONG_PTR)arg;
     const unsigned char *drive_prog;
     int prog_size;
+    pp_disk *d;
 
-    fd_cbm    = fd;
-    two_sided = settings->two_sided;
+    *disk = NULL;
 
-    opencbm_plugin_pp_dc_read_n = cbm_get_plugin_function_address("opencbm_plugin_pp_dc_read_n");
+    d = malloc(sizeof(*d));
+    if(d == NULL)
+    {
+        message_cb(0, "no memory");
+        return 1;
+    }
+
+    d->fd_cbm    = fd;
+    d->two_sided = settings->two_sided;
+    d->direction = PP_READ;
+
+    d->opencbm_plugin_pp_dc_read_n = cbm_get_plugin_function_address("opencbm_plugin_pp_dc_read_n");
+
+    d->opencbm_plugin_pp_dc_write_n = cbm_get_plugin_function_address("opencbm_plugin_pp_dc_write_n");
 
-    opencbm_plugin_pp_dc_write_n = cbm_get_plugin_function_address("opencbm_plugin_pp_dc_write_n");
+    d->opencbm_plugin_pp_dc_read_gcr_n = cbm_get_plugin_function_address("opencbm_plugin_pp_dc_read_gcr_n");
 
     if(settings->drive_type != cbm_dt_cbm1541)
     {
@@ -223,46 +243,47 @@ static int open_disk(CBM_FILE fd, d64copy_settings *settings,
 
                                                                         SETSTATEDEBUG((void)0);
     /* make sure the XP1541 portion of the cable is in input mode */
-    cbm_pp_read(fd_cbm);
+    cbm_pp_read(d->fd_cbm);
 
                                                                         SETSTATEDEBUG((void)0);
-    cbm_upload(fd_cbm, d, 0x700, drive_prog, prog_size);
+    cbm_upload_resident(d->fd_cbm, drv, 0x700, drive_prog, prog_size);
                                                                         SETSTATEDEBUG((void)0);
-    start(fd, d);
+    start(fd, drv);
                                                                         SETSTATEDEBUG((void)0);
-    pp_check_direction(PP_READ);
+    pp_check_direction(d, PP_READ);
                                                                         SETSTATEDEBUG((void)0);
-    cbm_iec_set(fd_cbm, IEC_CLOCK);
+    cbm_iec_set(d->fd_cbm, IEC_CLOCK);
                                                                         SETSTATEDEBUG((void)0);
-    cbm_iec_wait(fd_cbm, IEC_DATA, 1);
+    cbm_iec_wait(d->fd_cbm, IEC_DATA, 1);
                                                                         SETSTATEDEBUG((void)0);
+    *disk = d;
     return 0;
 }
 
-static void close_disk(void)
+static void close_disk(d64copy_disk disk)
 {
+    pp_disk *d = disk;
                                                                         SETSTATEDEBUG((void)0);
-    pp_write(fd_cbm, 0, 0);
+    pp_write(d, 0, 0);
     arch_sleep_us(100);
                                                                         SETSTATEDEBUG((void)0);
-    cbm_iec_wait(fd_cbm, IEC_DATA, 0);
+    cbm_iec_wait(d->fd_cbm, IEC_DATA, 0);
 
     /* make sure the XP1541 portion of the cable is in input mode */
                                                                         SETSTATEDEBUG((void)0);
-    cbm_pp_read(fd_cbm);
+    cbm_pp_read(d->fd_cbm);
                                                                         SETSTATEDEBUG((void)0);
 
-    opencbm_plugin_pp_dc_read_n = NULL;
-
-    opencbm_plugin_pp_dc_write_n = NULL;
+    free(d);
 }
 
-static int send_track_map(unsigned char tr, const char *trackmap, unsigned char count)
+static int send_track_map(d64copy_disk disk, unsigned char tr, const char *trackmap, unsigned char count)
 {
+    pp_disk *d = disk;
     int i, size;
     unsigned char *data;
 
-    size = d64copy_sector_count(two_sided, tr);
+    size = d64copy_sector_count(d->two_sided, tr);
     data = malloc(2+2*size);
 
     data[0] = tr;
@@ -272,27 +293,45 @@ static int send_track_map(unsigned char tr, const char *trackmap, unsigned char
     for(i = 0; i < size; i++)
         data[2+2*i] = data[2+2*i+1] = !NEED_SECTOR(trackmap[i]);
 
-    write_n(data, 2*size+2);
+    write_n(d, data, 2*size+2);
     free(data);
                                                                         SETSTATEDEBUG((void)0);
     return 0;
 }
 
-static int read_gcr_block(unsigned char *se, unsigned char *gcrbuf)
+static int read_gcr_raw(d64copy_disk disk, unsigned char *se, unsigned char *gcr, int *decode_result)
 {
+    pp_disk *d = disk;
+    unsigned char gcrbuf[GCRBUFSIZE];
     unsigned char s[2];
                                                                         SETSTATEDEBUG((void)0);
-    read_n(s, 2);
+    read_n(d, s, 2);
     *se = s[1];
                                                                         SETSTATEDEBUG((void)0);
-    read_n(s, 2);
+    read_n(d, s, 2);
 
     if(s[1]) {
         return s[1];
     }
                                                                         SETSTATEDEBUG(DebugByteCount=0);
-    read_n(gcrbuf, GCRBUFSIZE);
+    if (d->opencbm_plugin_pp_dc_read_gcr_n)
+    {
+        /* let the adapter decode the GCR data while it is transferred */
+        int ret = d->opencbm_plugin_pp_dc_read_gcr_n(d->fd_cbm, gcrbuf, GCRBUFSIZE);
+        if (ret >= 0)
+        {
+                                                                        SETSTATEDEBUG(DebugByteCount=-1);
+            *decode_result = (ret == GCRDECODEDSIZE)
+                ? gcr_check_decoded(gcrbuf, gcr) : 4;
+            return 0;
+        }
+        /* the adapter cannot decode GCR data, do it here from now on */
+        d->opencbm_plugin_pp_dc_read_gcr_n = NULL;
+    }
+    read_n(d, gcr, GCRBUFSIZE);
                                                                         SETSTATEDEBUG(DebugByteCount=-1);
+    /* leave the decoding to the caller */
+    *decode_result = GCR_NOT_DECODED;
 
                                                                         SETSTATEDEBUG((void)0);
     return 0;
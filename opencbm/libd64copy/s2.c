@@ -12,21 +12,26 @@
 #include "d64copy_int.h"
 
 #include <stdlib.h>
+#include <string.h>
 
 #include "arch.h"
 
 #include "opencbm-plugin.h"
 
-static opencbm_plugin_s2_read_n_t * opencbm_plugin_s2_read_n = NULL;
-
-static opencbm_plugin_s2_write_n_t * opencbm_plugin_s2_write_n = NULL;
 
 static const unsigned char s2_drive_prog[] = {
 #include "s2.inc"
 };
 
-static CBM_FILE fd_cbm;
-static int two_sided;
+typedef struct
+{
+    CBM_FILE fd_cbm;
+    int two_sided;
+
+    opencbm_plugin_s2_read_n_t * opencbm_plugin_s2_read_n;
+    opencbm_plugin_s2_write_n_t * opencbm_plugin_s2_write_n;
+    opencbm_plugin_s2_read_gcr_n_t * opencbm_plugin_s2_read_gcr_n;
+} s2_disk;
 
 static int s2_read_byte(CBM_FILE fd, unsigned char *c)
 {
@@ -94,18 +99,18 @@ static int s2_write_byte_nohs(CBM_FILE fd, unsigned char c)
 }
 
 /* read_n redirects USB reads to the external reader if required */
-static void read_n(unsigned char *data, int size)
+static void read_n(s2_disk *d, unsigned char *data, int size)
 {
     int i;
 
-    if (opencbm_plugin_s2_read_n)
+    if (d->opencbm_plugin_s2_read_n)
     {
-        opencbm_plugin_s2_read_n(fd_cbm, data, size);
+        d->opencbm_plugin_s2_read_n(d->fd_cbm, data, size);
         return;
     }
 
     for(i=0;i<size;i++)
-        s2_read_byte(fd_cbm, data++);
+        s2_read_byte(d->fd_cbm, data++);
 }
 
 static int s2_write_byte(CBM_FILE fd, unsigned char c)
@@ -126,49 +131,50 @@ static int s2_write_byte(CBM_FILE fd, unsigned char c)
 }
 
 /* write_n redirects USB writes to the external reader if required */
-static void write_n(const unsigned char *data, int size)
+static void write_n(s2_disk *d, const unsigned char *data, int size)
 {
     int i;
 
-    if (opencbm_plugin_s2_write_n)
+    if (d->opencbm_plugin_s2_write_n)
     {
-        opencbm_plugin_s2_write_n(fd_cbm, data, size);
+        d->opencbm_plugin_s2_write_n(d->fd_cbm, data, size);
         return;
     }
 
     for(i=0;i<size;i++)
-        s2_write_byte(fd_cbm, *data++);
+        s2_write_byte(d->fd_cbm, *data++);
 }
 
-static int read_block(unsigned char tr, unsigned char se, unsigned char *block)
+static int read_block(d64copy_disk disk, unsigned char tr, unsigned char se, unsigned char *block)
 {
-    unsigned char status;
+    s2_disk *d = disk;
+    unsigned char buf[1 + BLOCKSIZE];
 
                                                                         SETSTATEDEBUG((void)0);
-    write_n(&tr, 1);
-                                                                        SETSTATEDEBUG((void)0);
-    write_n(&se, 1);
+    buf[0] = tr; buf[1] = se;
+    write_n(d, buf, 2);
 #ifndef USE_CBM_IEC_WAIT
     arch_sleep_ms(20);
 #endif
-                                                                        SETSTATEDEBUG((void)0);
-    read_n(&status, 1);
                                                                         SETSTATEDEBUG(DebugByteCount=0);
-    read_n(block, BLOCKSIZE);
+    /* the drive always sends the status and the data: read them as one */
+    read_n(d, buf, sizeof(buf));
+    memcpy(block, buf + 1, BLOCKSIZE);
                                                                         SETSTATEDEBUG(DebugByteCount=-1);
 
-    return status;
+    return buf[0];
 }
 
-static int write_block(unsigned char tr, unsigned char se, const unsigned char *blk, int size, int read_status)
+static int write_block(d64copy_disk disk, unsigned char tr, unsigned char se, const unsigned char *blk, int size, int read_status)
 {
+    s2_disk *d = disk;
     unsigned char status;
                                                                         SETSTATEDEBUG((void)0);
-    write_n(&tr, 1);
+    write_n(d, &tr, 1);
                                                                         SETSTATEDEBUG((void)0);
-    write_n(&se, 1);
+    write_n(d, &se, 1);
                                                                         SETSTATEDEBUG(DebugByteCount=0);
-    write_n(blk, size);
+    write_n(d, blk, size);
                                                                         SETSTATEDEBUG(DebugByteCount=-1);
 #ifndef USE_CBM_IEC_WAIT
     if(size == BLOCKSIZE) {
@@ -176,69 +182,82 @@ static int write_block(unsigned char tr, unsigned char se, const unsigned char *
     }
 #endif
                                                                         SETSTATEDEBUG((void)0);
-    read_n(&status, 1);
+    read_n(d, &status, 1);
                                                                         SETSTATEDEBUG((void)0);
     return status;
 }
 
-static int open_disk(CBM_FILE fd, d64copy_settings *settings,
+static int open_disk(d64copy_disk *disk, CBM_FILE fd, d64copy_settings *settings,
                      const void *arg, int for_writing,
                      turbo_start start, d64copy_message_cb message_cb)
 {
-    unsigned char d = (unsigned char)(ULONG_PTR)arg;
+    unsigned char drv = (unsigned char)(ULONG_PTR)arg;
+    s2_disk *d;
 
-    fd_cbm = fd;
-    two_sided = settings->two_sided;
+    *disk = NULL;
 
-    opencbm_plugin_s2_read_n = cbm_get_plugin_function_address("opencbm_plugin_s2_read_n");
+    d = malloc(sizeof(*d));
+    if(d == NULL)
+    {
+        message_cb(0, "no memory");
+        return 1;
+    }
 
-    opencbm_plugin_s2_write_n = cbm_get_plugin_function_address("opencbm_plugin_s2_write_n");
+    d->fd_cbm = fd;
+    d->two_sided = settings->two_sided;
+
+    d->opencbm_plugin_s2_read_n = cbm_get_plugin_function_address("opencbm_plugin_s2_read_n");
+
+    d->opencbm_plugin_s2_write_n = cbm_get_plugin_function_address("opencbm_plugin_s2_write_n");
+
+    d->opencbm_plugin_s2_read_gcr_n = cbm_get_plugin_function_address("opencbm_plugin_s2_read_gcr_n");
 
                                                                         SETSTATEDEBUG((void)0);
-    cbm_upload(fd_cbm, d, 0x700, s2_drive_prog, sizeof(s2_drive_prog));
+    cbm_upload_resident(d->fd_cbm, drv, 0x700, s2_drive_prog, sizeof(s2_drive_prog));
                                                                         SETSTATEDEBUG((void)0);
-    start(fd, d);
+    start(fd, drv);
                                                                         SETSTATEDEBUG((void)0);
-    cbm_iec_release(fd_cbm, IEC_CLOCK);
+    cbm_iec_release(d->fd_cbm, IEC_CLOCK);
                                                                         SETSTATEDEBUG((void)0);
-    while(!cbm_iec_get(fd_cbm, IEC_CLOCK)) {
+    while(!cbm_iec_get(d->fd_cbm, IEC_CLOCK)) {
     }
                                                                         SETSTATEDEBUG((void)0);
-    cbm_iec_set(fd_cbm, IEC_ATN);
+    cbm_iec_set(d->fd_cbm, IEC_ATN);
     arch_sleep_ms(20);
 
                                                                         SETSTATEDEBUG((void)0);
+    *disk = d;
     return 0;
 }
 
-static void close_disk(void)
+static void close_disk(d64copy_disk disk)
 {
+    s2_disk *d = disk;
                                                                         SETSTATEDEBUG((void)0);
-    s2_write_byte(fd_cbm, 0);
+    s2_write_byte(d->fd_cbm, 0);
                                                                         SETSTATEDEBUG((void)0);
-    s2_write_byte_nohs(fd_cbm, 0);
+    s2_write_byte_nohs(d->fd_cbm, 0);
     arch_sleep_us(100);
                                                                         SETSTATEDEBUG(DebugBitCount=-1);
-    cbm_iec_release(fd_cbm, IEC_DATA);
+    cbm_iec_release(d->fd_cbm, IEC_DATA);
                                                                         SETSTATEDEBUG((void)0);
-    cbm_iec_release(fd_cbm, IEC_ATN);
+    cbm_iec_release(d->fd_cbm, IEC_ATN);
                                                                         SETSTATEDEBUG((void)0);
-    cbm_iec_set(fd_cbm, IEC_CLOCK);
+    cbm_iec_set(d->fd_cbm, IEC_CLOCK);
                                                                         SETSTATEDEBUG((void)0);
 
-    opencbm_plugin_s2_read_n = NULL;
-
-    opencbm_plugin_s2_write_n = NULL;
+    free(d);
 }
 
-static int send_track_map(unsigned char tr, const char *trackmap, unsigned char count)
+static int send_track_map(d64copy_disk disk, unsigned char tr, const char *trackmap, unsigned char count)
 {
+    s2_disk *d = disk;
     int i;
     int size;
     unsigned char *data;
 
                                                                         SETSTATEDEBUG((void)0);
-    size = d64copy_sector_count(two_sided, tr);
+    size = d64copy_sector_count(d->two_sided, tr);
     data = malloc(2+size);
 
     data[0] = tr;
@@ -248,28 +267,46 @@ static int send_track_map(unsigned char tr, const char *trackmap, unsigned char
     for(i = 0; i < size; i++)
         data[2+i] = !NEED_SECTOR(trackmap[i]);
 
-    write_n(data, size+2);
+    write_n(d, data, size+2);
     free(data);
                                                                         SETSTATEDEBUG((void)0);
     return 0;
 }
 
-static int read_gcr_block(unsigned char *se, unsigned char *gcrbuf)
+static int read_gcr_raw(d64copy_disk disk, unsigned char *se, unsigned char *gcr, int *decode_result)
 {
+    s2_disk *d = disk;
+    unsigned char gcrbuf[GCRBUFSIZE];
     unsigned char s;
 
                                                                         SETSTATEDEBUG((void)0);
-    read_n(&s, 1);
+    read_n(d, &s, 1);
     *se = s;
                                                                         SETSTATEDEBUG((void)0);
-    read_n(&s, 1);
+    read_n(d, &s, 1);
 
     if(s) {
         return s;
     }
                                                                         SETSTATEDEBUG(DebugByteCount=0);
-    read_n(gcrbuf, GCRBUFSIZE);
+    if (d->opencbm_plugin_s2_read_gcr_n)
+    {
+        /* let the adapter decode the GCR data while it is transferred */
+        int ret = d->opencbm_plugin_s2_read_gcr_n(d->fd_cbm, gcrbuf, GCRBUFSIZE);
+        if (ret >= 0)
+        {
+                                                                        SETSTATEDEBUG(DebugByteCount=-1);
+            *decode_result = (ret == GCRDECODEDSIZE)
+                ? gcr_check_decoded(gcrbuf, gcr) : 4;
+            return 0;
+        }
+        /* the adapter cannot decode GCR data, do it here from now on */
+        d->opencbm_plugin_s2_read_gcr_n = NULL;
+    }
+    read_n(d, gcr, GCRBUFSIZE);
                                                                         SETSTATEDEBUG(DebugByteCount=-1);
+    /* leave the decoding to the caller */
+    *decode_result = GCR_NOT_DECODED;
     return 0;
 }
 
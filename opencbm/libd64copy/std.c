@@ -13,14 +13,171 @@
 #include <stdio.h>
 #include <stdlib.h>
 
-static unsigned char drive = 0;
-static CBM_FILE fd_cbm = (CBM_FILE) -1;
+/*
+ * Reading a 1541 or a 1571 disk, two drive buffers are used: while one
+ * block is sent over the bus, the disk controller already reads the one
+ * expected next into the other buffer. The blocks are read with jobs of
+ * the controller, as "U1" does, but the job queue is written with M-W,
+ * which returns at once. The next block is guessed from the step between
+ * the last two sectors of the track; a wrong guess costs one job only.
+ */
+#define STD_PIPE_SLOTS  2
+
+/* the job queue of the controller, and the track and sector of every job */
+#define JOB_QUEUE       0x0000
+#define JOB_HEADER      0x0006
+#define JOB_READ        0x80
+#define JOB_OK          0x01
+
+/* the job results 2 to 11 are the DOS errors 20 to 29 */
+#define JOB_DOS_ERROR(j)  ((j) + 18)
+
+/* give up on a job after so many looks at the job queue */
+#define JOB_MAX_POLLS   2000
+
+typedef struct
+{
+    unsigned char channel;
+    unsigned char buffer;
+    unsigned char tr;
+    unsigned char se;
+    int busy;
+} std_slot;
+
+typedef struct
+{
+    unsigned char drive;
+    CBM_FILE fd_cbm;
+
+    int pipelined;
+    int two_sided;
+    std_slot slot[STD_PIPE_SLOTS];
+    unsigned char last_tr;
+    unsigned char last_se;
+    int step;
+} std_disk;
+
+static int job_submit(std_disk *d, std_slot *s, unsigned char tr, unsigned char se)
+{
+    unsigned char header[2];
+    unsigned char job = JOB_READ;
+
+    header[0] = tr;
+    header[1] = se;
+    if(cbm_upload(d->fd_cbm, d->drive, JOB_HEADER + 2 * s->buffer, header, 2) != 2 ||
+       cbm_upload(d->fd_cbm, d->drive, JOB_QUEUE + s->buffer, &job, 1) != 1)
+    {
+        return 1;
+    }
+    s->tr = tr;
+    s->se = se;
+    s->busy = 1;
+    return 0;
+}
+
+/* wait for the job of the slot, and tell its result as a DOS error */
+static int job_wait(std_disk *d, std_slot *s)
+{
+    unsigned char job = JOB_READ;
+    int polls;
+
+    if(!s->busy)
+    {
+        return 0;
+    }
+    s->busy = 0;
+
+    for(polls = 0; polls < JOB_MAX_POLLS; polls++)
+    {
+        if(cbm_download(d->fd_cbm, d->drive, JOB_QUEUE + s->buffer, &job, 1) != 1)
+        {
+            return 1;
+        }
+        if(job < 0x80)
+        {
+            return job == JOB_OK ? 0 : JOB_DOS_ERROR(job);
+        }
+    }
+    return 1;
+}
 
-static int read_block(unsigned char tr, unsigned char se, unsigned char *block)
+static int read_buffer(std_disk *d, std_slot *s, unsigned char *block)
 {
+    char cmd[16];
+    int rv = 1;
+
+    sprintf(cmd, "B-P%d 0", s->channel);
+    if(cbm_exec_command(d->fd_cbm, d->drive, cmd, 0) == 0) {
+        if(cbm_talk(d->fd_cbm, d->drive, s->channel) == 0) {
+                                                                        SETSTATEDEBUG(DebugByteCount=0);
+            rv = cbm_raw_read(d->fd_cbm, block, BLOCKSIZE) != BLOCKSIZE;
+                                                                        SETSTATEDEBUG(DebugByteCount=-1);
+            cbm_untalk(d->fd_cbm);
+        }
+    }
+    return rv;
+}
+
+static int read_block_pipelined(std_disk *d, unsigned char tr, unsigned char se, unsigned char *block)
+{
+    std_slot *cur = NULL;
+    std_slot *next;
+    int sectors = d64copy_sector_count(d->two_sided, tr);
+    int i, rv;
+
+    for(i = 0; i < STD_PIPE_SLOTS; i++)
+    {
+        if(d->slot[i].busy && d->slot[i].tr == tr && d->slot[i].se == se)
+        {
+            cur = &d->slot[i];
+        }
+    }
+    if(cur == NULL)
+    {
+        /* not guessed: take a buffer without a job, if there is one */
+        cur = d->slot[0].busy ? &d->slot[1] : &d->slot[0];
+        job_wait(d, cur);
+        if(job_submit(d, cur, tr, se) != 0)
+        {
+            return 1;
+        }
+    }
+    next = (cur == &d->slot[0]) ? &d->slot[1] : &d->slot[0];
+
+    rv = job_wait(d, cur);
+
+    /* learn the interleave the caller uses */
+    if(tr == d->last_tr && se != d->last_se)
+    {
+        d->step = (se + sectors - d->last_se) % sectors;
+    }
+    d->last_tr = tr;
+    d->last_se = se;
+
+    /* let the controller read the next block while this one is sent */
+    job_wait(d, next);
+    job_submit(d, next, tr, (unsigned char) ((se + d->step) % sectors));
+
+    if(rv == 0)
+    {
+        rv = read_buffer(d, cur, block);
+    }
+    return rv;
+}
+
+static int read_block(d64copy_disk disk, unsigned char tr, unsigned char se, unsigned char *block)
+{
+    std_disk *d = disk;
+    CBM_FILE fd_cbm = d->fd_cbm;
+    unsigned char drive = d->drive;
     char cmd[48];
     int rv = 1;
 
+    if(d->pipelined)
+    {
+        return read_block_pipelined(d, tr, se, block);
+    }
+
     sprintf(cmd, "U1:2 0 %d %d", tr, se);
     if(cbm_exec_command(fd_cbm, drive, cmd, 0) == 0) {
         rv = cbm_device_status(fd_cbm, drive, cmd, sizeof(cmd));
@@ -38,8 +195,11 @@ static int read_block(unsigned char tr, unsigned char se, unsigned char *block)
     return rv;
 }
 
-static int write_block(unsigned char tr, unsigned char se, const unsigned char *blk, int size, int read_status)
+static int write_block(d64copy_disk disk, unsigned char tr, unsigned char se, const unsigned char *blk, int size, int read_status)
 {
+    std_disk *d = disk;
+    CBM_FILE fd_cbm = d->fd_cbm;
+    unsigned char drive = d->drive;
     char cmd[48];
     int  rv = 1;
 
@@ -62,13 +222,55 @@ static int write_block(unsigned char tr, unsigned char se, const unsigned char *
     return rv;
 }
 
-static int open_disk(CBM_FILE fd, d64copy_settings *settings,
+/*
+ * open the channels of the pipelined read on buffers of their own, and
+ * tell if that worked out. Buffer 0 is left to the DOS, buffer 4 to the
+ * BAM and to the programs of the other transfers.
+ */
+static int open_pipelined(std_disk *d)
+{
+    char name[3];
+    char buf[48];
+    unsigned char buffer;
+    int i = 0;
+
+    for(buffer = 1; buffer <= 3 && i < STD_PIPE_SLOTS; buffer++)
+    {
+        d->slot[i].channel = (unsigned char) (2 + i);
+        sprintf(name, "#%d", buffer);
+        cbm_open(d->fd_cbm, d->drive, d->slot[i].channel, name, 2);
+        if(cbm_device_status(d->fd_cbm, d->drive, buf, sizeof(buf)) == 0)
+        {
+            d->slot[i].buffer = buffer;
+            d->slot[i].busy = 0;
+            i++;
+        }
+        else
+        {
+            cbm_close(d->fd_cbm, d->drive, d->slot[i].channel);
+        }
+    }
+    if(i < STD_PIPE_SLOTS)
+    {
+        while(i-- > 0)
+        {
+            cbm_close(d->fd_cbm, d->drive, d->slot[i].channel);
+        }
+        return 0;
+    }
+    return 1;
+}
+
+static int open_disk(d64copy_disk *disk, CBM_FILE fd, d64copy_settings *settings,
                      const void *arg, int for_writing,
                      turbo_start start, d64copy_message_cb message_cb)
 {
+    std_disk *d;
     char buf[48];
     int rv;
 
+    *disk = NULL;
+
     if(settings->end_track > STD_TRACKS && !settings->two_sided)
     {
         message_cb(0,
@@ -76,23 +278,66 @@ static int open_disk(CBM_FILE fd, d64copy_settings *settings,
         return 99;
     }
 
-    drive = (unsigned char)(ULONG_PTR)arg;
+    d = malloc(sizeof(*d));
+    if(d == NULL)
+    {
+        message_cb(0, "no memory");
+        return 1;
+    }
+
+    d->drive = (unsigned char)(ULONG_PTR)arg;
+    d->fd_cbm = fd;
+    d->two_sided = settings->two_sided;
+    d->last_tr = 0;
+    d->last_se = 0;
+    d->step = settings->interleave > 0 ? settings->interleave : 1;
 
-    fd_cbm = fd;
+    /* only the controller of the 1541 and the 1571 has this job queue */
+    d->pipelined = !for_writing &&
+                   (settings->drive_type == cbm_dt_cbm1541 ||
+                    settings->drive_type == cbm_dt_cbm1570 ||
+                    settings->drive_type == cbm_dt_cbm1571) &&
+                   open_pipelined(d);
+    if(d->pipelined)
+    {
+        message_cb(2, "reading with %d drive buffers", STD_PIPE_SLOTS);
+        *disk = d;
+        return 0;
+    }
 
-    cbm_open(fd_cbm, drive, 2, "#", 1);
+    cbm_open(d->fd_cbm, d->drive, 2, "#", 1);
 
-    rv = cbm_device_status(fd_cbm, drive, buf, sizeof(buf));
+    rv = cbm_device_status(d->fd_cbm, d->drive, buf, sizeof(buf));
     if(rv)
     {
-        message_cb(0, "drive %02d: %s", drive, buf);
+        message_cb(0, "drive %02d: %s", d->drive, buf);
+        cbm_close(d->fd_cbm, d->drive, 2);
+        free(d);
+        return rv;
     }
-    return rv;
+    *disk = d;
+    return 0;
 }
 
-static void close_disk(void)
+static void close_disk(d64copy_disk disk)
 {
-    cbm_close(fd_cbm, drive, 2);
+    std_disk *d = disk;
+    int i;
+
+    if(d->pipelined)
+    {
+        /* the buffers must not be given back while a job still uses them */
+        for(i = 0; i < STD_PIPE_SLOTS; i++)
+        {
+            job_wait(d, &d->slot[i]);
+            cbm_close(d->fd_cbm, d->drive, d->slot[i].channel);
+        }
+        free(d);
+        return;
+    }
+
+    cbm_close(d->fd_cbm, d->drive, 2);
+    free(d);
 }
 
 DECLARE_TRANSFER_FUNCS(std_transfer, 1, 0);
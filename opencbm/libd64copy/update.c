@@ -0,0 +1,252 @@
+/*
+ *  This program is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU General Public License
+ *  as published by the Free Software Foundation; either version
+ *  2 of the License, or (at your option) any later version.
+ *
+*/
+
+/*
+ * Updating an existing image or disk: before the copy, every block is
+ * read into a buffer of the drive, and a small routine computes a checksum
+ * of it there. Only these 3 bytes are transferred. If they match the
+ * checksum of the block in the image, the block does not need to be
+ * copied again, neither from the disk to the image nor the other way round.
+ *
+ * This is done with the standard DOS commands, before any turbo is
+ * uploaded: the block is read into buffer 3 ($0600), the routine runs
+ * in buffer 2 ($0500). The tracks are taken in the same order as by the
+ * copy, so on a 1571 the head does not go across the disk twice.
+ *
+ * The same checksums verify a disk after an image has been written to it:
+ * the blocks written are read back by the drive, but only their checksums
+ * come over the bus.
+ */
+
+#include "d64copy_int.h"
+
+#include <stdio.h>
+#include <string.h>
+
+#define SUM_CODE    0x0500
+#define SUM_RESULT  0x0540
+#define SUM_SIZE    3
+
+/*
+ * s1 = s1 + byte, s2 = s2 + s1 for all bytes of $0600-$06ff;
+ * s1 is stored at $0540, s2 (16 bit) at $0541/$0542
+ */
+static const unsigned char sum_code[] =
+{
+    0xa9, 0x00,             /*      lda #$00    */
+    0x8d, 0x40, 0x05,       /*      sta $0540   */
+    0x8d, 0x41, 0x05,       /*      sta $0541   */
+    0x8d, 0x42, 0x05,       /*      sta $0542   */
+    0xaa,                   /*      tax         */
+    0x18,                   /* l1:  clc         */
+    0xad, 0x40, 0x05,       /*      lda $0540   */
+    0x7d, 0x00, 0x06,       /*      adc $0600,x */
+    0x8d, 0x40, 0x05,       /*      sta $0540   */
+    0x18,                   /*      clc         */
+    0x6d, 0x41, 0x05,       /*      adc $0541   */
+    0x8d, 0x41, 0x05,       /*      sta $0541   */
+    0x90, 0x03,             /*      bcc l2      */
+    0xee, 0x42, 0x05,       /*      inc $0542   */
+    0xe8,                   /* l2:  inx         */
+    0xd0, 0xe7,             /*      bne l1      */
+    0x60                    /*      rts         */
+};
+
+/* the same as sum_code computes in the drive */
+static void block_sum(const unsigned char *block, unsigned char *sum)
+{
+    unsigned char s1 = 0;
+    unsigned int s2 = 0;
+    int i;
+
+    for(i = 0; i < BLOCKSIZE; i++)
+    {
+        s1 = (unsigned char) (s1 + block[i]);
+        s2 = (s2 + s1) & 0xffff;
+    }
+    sum[0] = s1;
+    sum[1] = (unsigned char) (s2 & 0xff);
+    sum[2] = (unsigned char) (s2 >> 8);
+}
+
+/* the offset of the first block of a track in the image */
+static long track_offset(int two_sided, int track)
+{
+    long ofs = 0;
+    int tr;
+
+    for(tr = 1; tr < track; tr++)
+    {
+        ofs += (long) d64copy_sector_count(two_sided, tr) * BLOCKSIZE;
+    }
+    return ofs;
+}
+
+static int drive_sum(CBM_FILE fd, unsigned char drive, int tr, int se,
+                     unsigned char *sum)
+{
+    char cmd[40];
+    static const char exec_cmd[] = { 'M', '-', 'E',
+                                     SUM_CODE & 0xff, SUM_CODE >> 8 };
+
+    sprintf(cmd, "U1:2 0 %d %d", tr, se);
+    if(cbm_exec_command(fd, drive, cmd, 0) != 0 ||
+       cbm_device_status(fd, drive, cmd, sizeof(cmd)) != 0)
+    {
+        return 1;
+    }
+    if(cbm_exec_command(fd, drive, exec_cmd, sizeof(exec_cmd)) != 0)
+    {
+        return 1;
+    }
+    return cbm_download(fd, drive, SUM_RESULT, sum, SUM_SIZE) != SUM_SIZE;
+}
+
+/*
+ * marks the blocks which are the same on the disk as in the image; with
+ * only != NULL, just the blocks set there are looked at. Returns their
+ * number, -1 if the drive or the image could not be used.
+ */
+static int scan_blocks(CBM_FILE fd, unsigned char drive,
+                       const d64copy_settings *settings, const char *image,
+                       const char only[][MAX_SECTORS+1],
+                       char unchanged[][MAX_SECTORS+1],
+                       const char *what, d64copy_message_cb message_cb)
+{
+    FILE *f;
+    char buf[40];
+    unsigned char block[BLOCKSIZE];
+    unsigned char sum[SUM_SIZE], image_sum[SUM_SIZE];
+    int tr, se, sectors, end_track, last_track;
+    long ofs;
+    int count = 0;
+
+    f = fopen(image, "rb");
+    if(f == NULL)
+    {
+        message_cb(1, "nothing to %s in %s", what, image);
+        return -1;
+    }
+
+    cbm_open(fd, drive, 2, "#3", 2);
+    if(cbm_device_status(fd, drive, buf, sizeof(buf)) != 0)
+    {
+        message_cb(1, "cannot %s, drive %02d: %s", what, drive, buf);
+        cbm_close(fd, drive, 2);
+        fclose(f);
+        return -1;
+    }
+
+    if(cbm_upload(fd, drive, SUM_CODE, sum_code, sizeof(sum_code)) !=
+       (int) sizeof(sum_code))
+    {
+        message_cb(1, "cannot %s, could not upload the checksum code", what);
+        cbm_close(fd, drive, 2);
+        fclose(f);
+        return -1;
+    }
+
+    end_track = settings->end_track;
+    if(end_track == -1)
+    {
+        end_track = settings->two_sided ? D71_TRACKS : STD_TRACKS;
+    }
+
+    /* the order of the sides visits the tracks up to the last one */
+    last_track = settings->two_sided ? D71_TRACKS : end_track;
+
+    for(tr = 1; tr <= last_track;
+        tr = d64copy_next_track(settings->two_sided, tr))
+    {
+        sectors = d64copy_sector_count(settings->two_sided, tr);
+        if(sectors <= 0 || tr < settings->start_track || tr > end_track)
+        {
+            continue;
+        }
+        ofs = track_offset(settings->two_sided, tr);
+        for(se = 0; se < sectors; se++, ofs += BLOCKSIZE)
+        {
+            if(only != NULL && !only[tr-1][se])
+            {
+                continue;
+            }
+            if(fseek(f, ofs, SEEK_SET) != 0 ||
+               fread(block, BLOCKSIZE, 1, f) != 1)
+            {
+                /* the image is shorter, the rest of the track must be copied */
+                break;
+            }
+            block_sum(block, image_sum);
+            if(drive_sum(fd, drive, tr, se, sum) == 0 &&
+               memcmp(sum, image_sum, SUM_SIZE) == 0)
+            {
+                unchanged[tr-1][se] = 1;
+                count++;
+            }
+        }
+    }
+
+    cbm_close(fd, drive, 2);
+    fclose(f);
+
+    /* the blocks read have replaced the turbo write kept in buffer 3 */
+    cbm_upload_cache_flush(fd);
+
+    return count;
+}
+
+int d64copy_update_scan(CBM_FILE fd, unsigned char drive,
+                        const d64copy_settings *settings, const char *image,
+                        char unchanged[][MAX_SECTORS+1],
+                        d64copy_message_cb message_cb)
+{
+    int count;
+
+    count = scan_blocks(fd, drive, settings, image, NULL, unchanged,
+                        "update", message_cb);
+    if(count < 0)
+    {
+        return 0;
+    }
+
+    message_cb(2, "update: %d sectors unchanged", count);
+    return count;
+}
+
+int d64copy_verify_scan(CBM_FILE fd, unsigned char drive,
+                        const d64copy_settings *settings, const char *image,
+                        char check[][MAX_SECTORS+1],
+                        d64copy_message_cb message_cb)
+{
+    char same[MAX_TRACKS][MAX_SECTORS+1];
+    int tr, se, bad = 0;
+
+    memset(same, 0, sizeof(same));
+    if(scan_blocks(fd, drive, settings, image, (const char (*)[MAX_SECTORS+1]) check,
+                   same, "verify", message_cb) < 0)
+    {
+        return -1;
+    }
+
+    for(tr = 0; tr < MAX_TRACKS; tr++)
+    {
+        for(se = 0; se <= MAX_SECTORS; se++)
+        {
+            if(check[tr][se] && same[tr][se])
+            {
+                check[tr][se] = 0;
+            }
+            else if(check[tr][se])
+            {
+                message_cb(1, "verify error at %d/%d", tr + 1, se);
+                bad++;
+            }
+        }
+    }
+    return bad;
+}
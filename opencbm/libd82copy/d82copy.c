@@ -10,6 +10,7 @@
 */
 
 #include "d82copy_int.h"
+#include "blockpipe.h"
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
@@ -75,6 +76,7 @@ static const int warp_write_interleave[] = { -1, 0,-1 };
  */
 static int atom_mustcleanup = 0;
 static const transfer_funcs *atom_dst;
+static blockpipe *atom_pipe;
 
 
 #ifdef LIBD82COPY_DEBUG
@@ -100,7 +102,7 @@ static int send_turbo(CBM_FILE fd, unsigned char drv, int write, int warp, int d
     prog = &drive_progs[drv_type * 4 + warp * 2 + write];
 
     SETSTATEDEBUG((void)0);
-    return cbm_upload(fd, drv, 0x500, prog->prog, prog->size);
+    return cbm_upload_resident(fd, drv, 0x500, prog->prog, prog->size);
 }
 
 extern transfer_funcs d82copy_fs_transfer,
@@ -233,6 +235,92 @@ int ReadBAM(d82copy_settings *settings, const transfer_funcs *src, unsigned char
     return st;
 }
 
+/*
+ * evaluate the result of copying one block
+ */
+static void finish_block(d82copy_status *status, char *trackmap,
+                         unsigned char *errors, int retry_count, int *cnt,
+                         unsigned char tr, unsigned char se,
+                         int read_result, int write_result)
+{
+    status->read_result = read_result;
+    status->write_result = write_result;
+
+    if(status->read_result)
+    {
+        /* read error */
+        trackmap[se] = bs_error;
+        (*errors)++;
+        if(retry_count == 0)
+        {
+            status->sectors_processed++;
+            /* FIXME: shall we get rid of this? */
+            message_cb( 1, "read error: %02x/%02x: %d",
+                        tr, se, status->read_result );
+        }
+    }
+    else
+    {
+        /* successfull read */
+        if(status->write_result)
+        {
+            /* write error */
+            trackmap[se] = bs_error;
+            (*errors)++;
+            if(retry_count == 0)
+            {
+                status->sectors_processed++;
+                /* FIXME: shall we get rid of this? */
+                message_cb(1, "write error: %02x/%02x: %d",
+                           tr, se, status->write_result);
+            }
+        }
+        else
+        {
+            /* successfull read and write, mark sector */
+            trackmap[se] = bs_copied;
+            (*cnt)++;
+            status->sectors_processed++;
+        }
+    }
+
+    status->track = tr;
+    status->sector= se;
+
+    status_cb(*status);
+}
+
+
+/*
+ * the pipeline writes the blocks to the destination given as context
+ */
+static int pipeline_write(void *context, blockpipe_block *blk)
+{
+    const transfer_funcs *dst = context;
+
+    return dst->write_block(blk->tr, blk->se, blk->data, blk->size,
+                            blk->read_result);
+}
+
+
+/*
+ * evaluate the blocks written by the pipeline, until no more than
+ * max_pending blocks are left in there
+ */
+static void collect_blocks(blockpipe *pipe, int max_pending,
+                           d82copy_status *status, char *trackmap,
+                           unsigned char *errors, int retry_count, int *cnt)
+{
+    blockpipe_block done;
+
+    while(blockpipe_get(pipe, &done, blockpipe_pending(pipe) > max_pending))
+    {
+        finish_block(status, trackmap, errors, retry_count, cnt,
+                     done.tr, done.se, done.read_result, done.write_result);
+    }
+}
+
+
 static int copy_disk(CBM_FILE fd_cbm, d82copy_settings *settings,
               const transfer_funcs *src, const void *src_arg,
               const transfer_funcs *dst, const void *dst_arg, unsigned char cbm_drive)
@@ -254,6 +342,7 @@ static int copy_disk(CBM_FILE fd_cbm, d82copy_settings *settings,
     unsigned char block[BLOCKSIZE];
     //unsigned char gcr[GCRBUFSIZE];
     const transfer_funcs *cbm_transf = NULL;
+    blockpipe *pipe = NULL;
     d82copy_status status;
     const char *sector_map;
     const char *type_str = "*unknown*";
@@ -488,6 +577,13 @@ static int copy_disk(CBM_FILE fd_cbm, d82copy_settings *settings,
     message_cb(2, "copying tracks %d-%d (%d sectors)",
             settings->start_track, settings->end_track, status.total_sectors);
 
+    if(!dst->is_cbm_drive)
+    {
+        /* write the image while the next blocks are read from the drive */
+        pipe = blockpipe_start(pipeline_write, NULL, (void *) dst);
+        atom_pipe = pipe;
+    }
+
     SETSTATEDEBUG(debugLibD82BlockCount=0);
     for(tr = 1; tr <= max_tracks; tr++)
     {
@@ -550,84 +646,71 @@ static int copy_disk(CBM_FILE fd_cbm, d82copy_settings *settings,
                     {
                         while(!NEED_SECTOR(trackmap[se]))
                         {
+                            if(pipe && trackmap[se] == bs_invalid)
+                            {
+                                /* still in the pipeline, wait for the result */
+                                collect_blocks(pipe, 0, &status, trackmap,
+                                               &errors, retry_count, &cnt);
+                                continue;
+                            }
                             if(++se >= sector_map[tr]) se = 0;
                         }
                         SETSTATEDEBUG(debugLibD82BlockCount++);
                         status.read_result = src->read_block(tr, se, block);
                     }
 
-                    /*if(settings->warp && dst->is_cbm_drive)
+                    if(pipe)
                     {
-                        SETSTATEDEBUG((void)0);
-                        gcr_encode(block, gcr);
                         SETSTATEDEBUG(debugLibD82BlockCount++);
-                        status.write_result =
-                            dst->write_block(tr, se, gcr, GCRBUFSIZE-1,
-                                             status.read_result);
-                    }
-                    else  */
-                    {
-                        SETSTATEDEBUG(debugLibD82BlockCount++);
-                        status.write_result =
-                            dst->write_block(tr, se, block, BLOCKSIZE,
-                                             status.read_result);
-                    }
-                    SETSTATEDEBUG((void)0);
-
-                    if(status.read_result)
-                    {
-                        /* read error */
-                        trackmap[se] = bs_error;
-                        errors++;
-                        if(retry_count == 0)
-                        {
-                            status.sectors_processed++;
-                            /* FIXME: shall we get rid of this? */
-                            message_cb( 1, "read error: %02x/%02x: %d",
-                                        tr, se, status.read_result );
-                        }
+                        /* mark the sector as being in the pipeline */
+                        trackmap[se] = bs_invalid;
+                        blockpipe_put(pipe, tr, se, block, BLOCKSIZE,
+                                      status.read_result, 0);
+                        collect_blocks(pipe, BLOCKPIPE_DEPTH - 1, &status,
+                                       trackmap, &errors, retry_count, &cnt);
                     }
                     else
                     {
-                        /* successfull read */
-                        if(status.write_result)
+                        /*if(settings->warp && dst->is_cbm_drive)
                         {
-                            /* write error */
-                            trackmap[se] = bs_error;
-                            errors++;
-                            if(retry_count == 0)
-                            {
-                                status.sectors_processed++;
-                                /* FIXME: shall we get rid of this? */
-                                message_cb(1, "write error: %02x/%02x: %d",
-                                           tr, se, status.write_result);
-                            }
+                            SETSTATEDEBUG((void)0);
+                            gcr_encode(block, gcr);
+                            SETSTATEDEBUG(debugLibD82BlockCount++);
+                            status.write_result =
+                                dst->write_block(tr, se, gcr, GCRBUFSIZE-1,
+                                                 status.read_result);
                         }
-                        else
+                        else  */
                         {
-                            /* successfull read and write, mark sector */
-                            trackmap[se] = bs_copied;
-                            cnt++;
-                            status.sectors_processed++;
+                            SETSTATEDEBUG(debugLibD82BlockCount++);
+                            status.write_result =
+                                dst->write_block(tr, se, block, BLOCKSIZE,
+                                                 status.read_result);
                         }
+                        SETSTATEDEBUG((void)0);
+
+                        finish_block(&status, trackmap, &errors, retry_count,
+                                     &cnt, tr, se, status.read_result,
+                                     status.write_result);
                     }
+
                     /* remaining sectors on this track */
                     if(!resend_trackmap)
                     {
                         scnt--;
                     }
 
-                    status.track = tr;
-                    status.sector= se;
-
-                    status_cb(status);
-
                     if(dst->is_cbm_drive || !settings->warp)
                     {
                         se += (unsigned char) settings->interleave;
                         if(se >= sector_map[tr]) se -= sector_map[tr];
                     }
                 }
+                if(pipe)
+                {
+                    collect_blocks(pipe, 0, &status, trackmap,
+                                   &errors, retry_count, &cnt);
+                }
                 if(errors > 0 && settings->retries >= 0)
                 {
                     retry_count--;
@@ -657,6 +740,12 @@ static int copy_disk(CBM_FILE fd_cbm, d82copy_settings *settings,
     }
     SETSTATEDEBUG(debugLibD82BlockCount=-1);
 
+    if(pipe)
+    {
+        atom_pipe = NULL;
+        blockpipe_stop(pipe);
+    }
+
     dst->close_disk();
     SETSTATEDEBUG((void)0);
     src->close_disk();
@@ -818,6 +907,83 @@ int d82copy_write_image(CBM_FILE cbm_fd,
             src, (void*)src_image, dst, (void*)(ULONG_PTR)dst_drive, (unsigned char) dst_drive);
 }
 
+int d82copy_duplicate_disk(CBM_FILE cbm_fd,
+                           d82copy_settings *settings,
+                           int src_unit,
+                           int dst_unit,
+                           d82copy_message_cb msg_cb)
+{
+    unsigned char drive = (unsigned char) (src_unit & 0x7f);
+    char cmd[8];
+    char buf[48];
+    int tr, blocks = 0;
+
+    message_cb = msg_cb;
+
+    if(drive != (dst_unit & 0x7f) || (src_unit & 0x80) == (dst_unit & 0x80))
+    {
+        msg_cb(0, "source and target must be the two drives of one unit");
+        return -1;
+    }
+
+    if(settings->start_track != 1 || settings->end_track != -1 ||
+       settings->bam_mode != bm_ignore)
+    {
+        msg_cb(0, "the DOS can only duplicate whole disks");
+        return -1;
+    }
+
+    if(settings->drive_type == cbm_dt_unknown &&
+       cbm_identify(cbm_fd, drive, &settings->drive_type, NULL) != 0)
+    {
+        msg_cb(0, "could not identify device");
+        return -1;
+    }
+
+    switch(settings->drive_type)
+    {
+        case cbm_dt_cbm8050:
+        case cbm_dt_cbm8250:
+            break;
+        default:
+            msg_cb(0, "drive is not a dual drive unit");
+            return -1;
+    }
+
+    if(settings->two_sided < 0)
+    {
+        settings->two_sided = settings->drive_type == cbm_dt_cbm8250;
+    }
+
+    for(tr = 1; d82copy_sector_count(settings->two_sided, tr) > 0; tr++)
+    {
+        blocks += d82copy_sector_count(settings->two_sided, tr);
+    }
+
+    /*
+     * The DOS formats the target and copies the disk on its own;
+     * nothing goes over the bus. Asking for the status waits until
+     * the unit is done.
+     */
+    sprintf(cmd, "D%d=%d", (dst_unit & 0x80) ? 1 : 0, (src_unit & 0x80) ? 1 : 0);
+    msg_cb(2, "duplicating the disk in drive %d:%d with the DOS",
+           drive, (src_unit & 0x80) ? 1 : 0);
+
+    SETSTATEDEBUG((void)0);
+    if(cbm_exec_command(cbm_fd, drive, cmd, 0) != 0)
+    {
+        msg_cb(0, "could not send the duplicate command");
+        return -1;
+    }
+    if(cbm_device_status(cbm_fd, drive, buf, sizeof(buf)) != 0)
+    {
+        msg_cb(0, "duplicate failed: %s", buf);
+        return -1;
+    }
+
+    return blocks;
+}
+
 void d82copy_cleanup(void)
 {
     /* if we were interrupted writing to the fs, make sure to
@@ -826,6 +992,11 @@ void d82copy_cleanup(void)
 
     if (atom_mustcleanup)
     {
+        if (atom_pipe)
+        {
+            blockpipe_stop(atom_pipe);
+            atom_pipe = NULL;
+        }
         atom_dst->close_disk();
         atom_mustcleanup = 0;
     }
@@ -61,6 +61,33 @@ static const unsigned char *atom_blk;
 static int atom_size;
 static int atom_read_status;
 
+/* the file has been created or grown from here on: empty blocks
+ * are left as holes there, instead of writing them
+ */
+static long sparse_from;
+
+/*
+ * an empty block need not be written if it has never been written
+ * before and lies where the file has been grown, it reads as 0 anyway
+ */
+static int leave_hole(long ofs, const unsigned char *blk, int size)
+{
+    int i;
+
+    if(ofs < sparse_from || error_map[ofs / BLOCKSIZE] != 0)
+    {
+        return 0;
+    }
+    for(i = 0; i < size; i++)
+    {
+        if(blk[i] != 0)
+        {
+            return 0;
+        }
+    }
+    return 1;
+}
+
 static int write_block(unsigned char tr, unsigned char se, const unsigned char *blk, int size, int read_status)
 {
     long ofs;
@@ -75,7 +102,12 @@ static int write_block(unsigned char tr, unsigned char se, const unsigned char *
     atom_execute = 1;
 
     ofs = block_offset(tr, se);
-    if(fseek(the_file, ofs, SEEK_SET) == 0)
+    if(ofs + size <= block_count * BLOCKSIZE && leave_hole(ofs, blk, size))
+    {
+        error_map[ofs / BLOCKSIZE] = (char) ((read_status == 0) ? 1 : read_status);
+        ret = 0;
+    }
+    else if(fseek(the_file, ofs, SEEK_SET) == 0)
     {
         error_map[ofs / BLOCKSIZE] = (char) ((read_status == 0) ? 1 : read_status);
         ret = fwrite(blk, size, 1, the_file) != 1;
@@ -241,6 +273,9 @@ static int open_disk(CBM_FILE fd, d82copy_settings *settings,
                 }
             }
 
+            /* what is not already in the image may be left as holes */
+            sparse_from = is_image ? (long)block_count * BLOCKSIZE : 0;
+
             if(new_tr > tr)
             {
                 /* grow image */
@@ -13,6 +13,7 @@
 
 #define BLOCKSIZE   256
 #define GCRBUFSIZE  326
+#define GCRDECODEDSIZE  ((GCRBUFSIZE / 5) * 4)
 
 #include "opencbm.h"
 
@@ -13,26 +13,75 @@
 
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 
 static unsigned char drive = 0;  // the "unit" in CBM speaking
 static unsigned char medium = 0; // 0 for drive 0, 1 for drive 1 on the floppy
 static CBM_FILE fd_cbm = (CBM_FILE) -1;
 
+/*
+ * U1 leaves the buffer pointer at 0, thus, the buffer can be read right
+ * away, without another B-P command for every block. As this saves one
+ * of the four bus transactions of every block, it is worth it; but it is
+ * not taken for granted: until a block which is not filled with one
+ * single value has been read both with and without the B-P, with the
+ * same result, the B-P is still sent.
+ */
+enum buffer_pointer_e { bp_unknown, bp_needed, bp_not_needed };
+static enum buffer_pointer_e buffer_pointer = bp_unknown;
+
+static int read_buffer(unsigned char *block)
+{
+    int rv = 1;
+
+    if(cbm_talk(fd_cbm, drive, 2) == 0) {
+                                                                        SETSTATEDEBUG(debugLibD82ByteCount=0);
+        rv = cbm_raw_read(fd_cbm, block, BLOCKSIZE) != BLOCKSIZE;
+                                                                        SETSTATEDEBUG(debugLibD82ByteCount=-1);
+        cbm_untalk(fd_cbm);
+    }
+    return rv;
+}
+
+static int is_uniform(const unsigned char *block)
+{
+    int i;
+
+    for(i = 1; i < BLOCKSIZE; i++) {
+        if(block[i] != block[0]) {
+            return 0;
+        }
+    }
+    return 1;
+}
+
 static int read_block(unsigned char tr, unsigned char se, unsigned char *block)
 {
     char cmd[48];
+    unsigned char probe[BLOCKSIZE];
+    int probe_rv = 1;
     int rv = 1;
 
     sprintf(cmd, "U1:2 %u %d %d", medium, tr, se);
     if(cbm_exec_command(fd_cbm, drive, cmd, 0) == 0) {
         rv = cbm_device_status(fd_cbm, drive, cmd, sizeof(cmd));
         if(rv == 0) {
+            if(buffer_pointer == bp_not_needed) {
+                return read_buffer(block);
+            }
+            if(buffer_pointer == bp_unknown) {
+                probe_rv = read_buffer(probe);
+            }
+            rv = 1;
             if(cbm_exec_command(fd_cbm, drive, "B-P2 0", 0) == 0) {
-                if(cbm_talk(fd_cbm, drive, 2) == 0) {
-                                                                        SETSTATEDEBUG(debugLibD82ByteCount=0);
-                    rv = cbm_raw_read(fd_cbm, block, BLOCKSIZE) != BLOCKSIZE;
-                                                                        SETSTATEDEBUG(debugLibD82ByteCount=-1);
-                    cbm_untalk(fd_cbm);
+                rv = read_buffer(block);
+            }
+            if(buffer_pointer == bp_unknown && rv == 0) {
+                if(probe_rv || memcmp(probe, block, BLOCKSIZE) != 0) {
+                    buffer_pointer = bp_needed;
+                }
+                else if(!is_uniform(block)) {
+                    buffer_pointer = bp_not_needed;
                 }
             }
         }
@@ -85,6 +134,7 @@ static int open_disk(CBM_FILE fd, d82copy_settings *settings,
     drive = drive & 0x7F;
 
     fd_cbm = fd;
+    buffer_pointer = bp_unknown;
 
     cbm_open(fd_cbm, drive, 2, "#", 1);
 
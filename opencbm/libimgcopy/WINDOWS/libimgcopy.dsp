@@ -93,6 +93,10 @@ SOURCE=..\imgcopy.c
 # End Source File
 # Begin Source File
 
+SOURCE=..\p2.c
+# End Source File
+# Begin Source File
+
 SOURCE=..\pp.c
 # End Source File
 # Begin Source File
@@ -133,6 +137,68 @@ SOURCE=..\imgcopy_int.h
 # PROP Default_Filter "a65"
 # Begin Source File
 
+SOURCE=..\p21541.a65
+
+!IF  "$(CFG)" == "libimgcopy - Win32 Release"
+
+# Begin Custom Build
+InputDir=\home\spiro\cbm\opencbm.git\opencbm\libimgcopy
+InputPath=..\p21541.a65
+InputName=p21541
+
+"$(InputDir)\$(InputName).inc" : $(SOURCE) "$(INTDIR)" "$(OUTDIR)"
+	..\..\WINDOWS\buildoneinc ..\.. $(InputPath)
+
+# End Custom Build
+
+!ELSEIF  "$(CFG)" == "libimgcopy - Win32 Debug"
+
+# Begin Custom Build
+InputDir=\home\spiro\cbm\opencbm.git\opencbm\libimgcopy
+InputPath=..\p21541.a65
+InputName=p21541
+
+"$(InputDir)\$(InputName).inc" : $(SOURCE) "$(INTDIR)" "$(OUTDIR)"
+	..\..\WINDOWS\buildoneinc ..\.. $(InputPath)
+
+# End Custom Build
+
+!ENDIF 
+
+# End Source File
+# Begin Source File
+
+SOURCE=..\p21571.a65
+
+!IF  "$(CFG)" == "libimgcopy - Win32 Release"
+
+# Begin Custom Build
+InputDir=\home\spiro\cbm\opencbm.git\opencbm\libimgcopy
+InputPath=..\p21571.a65
+InputName=p21571
+
+"$(InputDir)\$(InputName).inc" : $(SOURCE) "$(INTDIR)" "$(OUTDIR)"
+	..\..\WINDOWS\buildoneinc ..\.. $(InputPath)
+
+# End Custom Build
+
+!ELSEIF  "$(CFG)" == "libimgcopy - Win32 Debug"
+
+# Begin Custom Build
+InputDir=\home\spiro\cbm\opencbm.git\opencbm\libimgcopy
+InputPath=..\p21571.a65
+InputName=p21571
+
+"$(InputDir)\$(InputName).inc" : $(SOURCE) "$(INTDIR)" "$(OUTDIR)"
+	..\..\WINDOWS\buildoneinc ..\.. $(InputPath)
+
+# End Custom Build
+
+!ENDIF 
+
+# End Source File
+# Begin Source File
+
 SOURCE=..\pp1541.a65
 
 !IF  "$(CFG)" == "libimgcopy - Win32 Release"
@@ -16,12 +16,22 @@
 
 #include "arch.h"
 
+#ifdef HAVE_ZLIB
+# include <zlib.h>
+#endif
+
 static imgcopy_settings *fs_settings;
 
 static FILE *the_file;
 static char *error_map;
 static int block_count;
 
+/* a compressed image is collected here, and written out on close */
+static unsigned char *the_image;
+#ifdef HAVE_ZLIB
+static gzFile the_gz;
+#endif
+
 
 
 /* always use maximum size for error map */
@@ -57,6 +67,87 @@ static const unsigned char *atom_blk;
 static int atom_size;
 static int atom_read_status;
 
+/* the file has been created or grown from here on: empty blocks
+ * are left as holes there, instead of writing them
+ */
+static long sparse_from;
+
+/*
+ * an empty block need not be written if it has never been written
+ * before and lies where the file has been grown, it reads as 0 anyway
+ */
+static int leave_hole(long ofs, const unsigned char *blk, int size)
+{
+    int i;
+
+    if(ofs < sparse_from || error_map[ofs / BLOCKSIZE] != 0)
+    {
+        return 0;
+    }
+    for(i = 0; i < size; i++)
+    {
+        if(blk[i] != 0)
+        {
+            return 0;
+        }
+    }
+    return 1;
+}
+
+/*
+ * images named *.gz are written gzip compressed
+ */
+static int is_compressed(const char *name)
+{
+    size_t len = strlen(name);
+
+    return len > 3 && arch_strcasecmp(name + len - 3, ".gz") == 0;
+}
+
+static int start_compression(imgcopy_message_cb message_cb)
+{
+#ifdef HAVE_ZLIB
+    int fd = arch_dup(arch_fileno(the_file));
+
+    the_gz = fd < 0 ? NULL : gzdopen(fd, "wb");
+    if(the_gz == NULL)
+    {
+        message_cb(0, "could not start compression");
+        return 1;
+    }
+    the_image = calloc(block_count, BLOCKSIZE);
+    if(the_image == NULL)
+    {
+        message_cb(0, "no memory for image");
+        gzclose(the_gz);
+        the_gz = NULL;
+        return 1;
+    }
+    return 0;
+#else
+    message_cb(0, "compressed images are not supported by this build");
+    return 1;
+#endif
+}
+
+static void finish_compression(int has_errors)
+{
+#ifdef HAVE_ZLIB
+    if(the_gz)
+    {
+        gzwrite(the_gz, the_image, (unsigned) block_count * BLOCKSIZE);
+        if(has_errors)
+        {
+            gzwrite(the_gz, error_map, (unsigned) block_count);
+        }
+        gzclose(the_gz);
+        the_gz = NULL;
+    }
+#endif
+    free(the_image);
+    the_image = NULL;
+}
+
 static int write_block(unsigned char tr, unsigned char se, const unsigned char *blk, int size, int read_status)
 {
     long ofs;
@@ -71,7 +162,25 @@ static int write_block(unsigned char tr, unsigned char se, const unsigned char *
     atom_execute = 1;
 
     ofs = block_offset(tr, se);
-    if(fseek(the_file, ofs, SEEK_SET) == 0)
+    if(the_image)
+    {
+        if(ofs + size <= block_count * BLOCKSIZE)
+        {
+            error_map[ofs / BLOCKSIZE] = (char) ((read_status == 0) ? 1 : read_status);
+            memcpy(the_image + ofs, blk, size);
+            ret = 0;
+        }
+        else
+        {
+            ret = 1;
+        }
+    }
+    else if(ofs + size <= block_count * BLOCKSIZE && leave_hole(ofs, blk, size))
+    {
+        error_map[ofs / BLOCKSIZE] = (char) ((read_status == 0) ? 1 : read_status);
+        ret = 0;
+    }
+    else if(fseek(the_file, ofs, SEEK_SET) == 0)
     {
         error_map[ofs / BLOCKSIZE] = (char) ((read_status == 0) ? 1 : read_status);
         ret = fwrite(blk, size, 1, the_file) != 1;
@@ -181,6 +290,32 @@ static int open_disk(CBM_FILE fd, imgcopy_settings *settings,
             message_cb(0, "could not access imagefile: %s", name);
         }
     }
+    else if(is_compressed(name))
+    {
+        the_file = fopen(name, "wb");
+        if(the_file)
+        {
+            /* the image is kept in memory until it is complete */
+            error_map = calloc(block_count, 1);
+            if(!error_map || start_compression(message_cb) != 0)
+            {
+                if(!error_map)
+                {
+                    message_cb(0, "no memory for error map");
+                }
+                free(error_map);
+                error_map = NULL;
+                fclose(the_file);
+                the_file = NULL;
+                arch_unlink(name);
+                return 1;
+            }
+        }
+        else
+        {
+            message_cb(0, "could not open %s", name);
+        }
+    }
     else
     {
         the_file = fopen(name, is_image ? "r+b" : "wb");
@@ -224,6 +359,9 @@ static int open_disk(CBM_FILE fd, imgcopy_settings *settings,
                 }
             }
 
+            /* what is not already in the image may be left as holes */
+            sparse_from = is_image ? (long)block_count * BLOCKSIZE : 0;
+
             if(new_tr > tr)
             {
                 /* grow image */
@@ -284,7 +422,11 @@ static void close_disk(void)
         }
     }
 
-    if(the_file)
+    if(the_file && the_image)
+    {
+        finish_compression(has_errors);
+    }
+    else if(the_file)
     {
         if(has_errors)
         {
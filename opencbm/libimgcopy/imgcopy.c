@@ -15,6 +15,7 @@ static char *rcsid =
 #endif
 
 #include "imgcopy_int.h"
+#include "blockpipe.h"
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
@@ -157,8 +158,8 @@ static const struct drive_prog
 };
 
 
-static const int default_interleave[] = { -1, 22, -1 };
-static const int warp_write_interleave[] = { -1, 0,-1 };
+static const int default_interleave[] = { -1, 22, 4, 13, 13, 7, 7, -1 };
+static const int warp_write_interleave[] = { -1, 0, 6, 12, 12, 4, 4, -1 };
 
 
 /*
@@ -166,6 +167,7 @@ static const int warp_write_interleave[] = { -1, 0,-1 };
  */
 static int atom_mustcleanup = 0;
 static const transfer_funcs *atom_dst;
+static blockpipe *atom_pipe;
 
 
 #ifdef LIBIMGCOPY_DEBUG
@@ -229,7 +231,7 @@ static int send_turbo(imgcopy_settings *settings, CBM_FILE fd, unsigned char drv
     printf("uploading drivecode %d\n", idx);
     prog = &drive_progs[idx];
 
-    return cbm_upload(fd, drv, 0x500, prog->prog, prog->size) != prog->size;
+    return cbm_upload_resident(fd, drv, 0x500, prog->prog, prog->size) != prog->size;
 }
 
 extern transfer_funcs imgcopy_fs_transfer,
@@ -240,6 +242,17 @@ static imgcopy_status_cb status_cb;
 
 
 
+//
+// compare the file extension, a compressed image may add ".gz"
+//
+static int is_extension(const char *s, const char *ext)
+{
+    size_t len = strlen(ext);
+
+    return arch_strncasecmp(s, ext, len) == 0 &&
+        (s[len] == '\0' || arch_strcasecmp(s + len, ".gz") == 0);
+}
+
 //
 // calculate the image file type
 //
@@ -255,30 +268,30 @@ static int imgcopy_set_image_type(imgcopy_settings *settings, const char *filena
         {
             s++;
             //message_cb(0, "file extension: %s", s);
-            if(arch_strcasecmp(s, "d64") == 0)
+            if(is_extension(s, "d64"))
             {
                 settings->image_type = D64;
                 settings->two_sided = 0;
             }
-            else if(arch_strcasecmp(s, "d71") == 0)
+            else if(is_extension(s, "d71"))
             {
                 settings->image_type = D71;
                 settings->two_sided = 1;
                 message_cb(3, "imagetype D71 from file extension");
             }
-            else if(arch_strcasecmp(s, "d80") == 0)
+            else if(is_extension(s, "d80"))
             {
                 settings->image_type = D80;
                 settings->two_sided = 0;
                 message_cb(3, "imagetype D80 from file extension");
             }
-            else if(arch_strcasecmp(s, "d81") == 0)
+            else if(is_extension(s, "d81"))
             {
                 settings->image_type = D81;
                 settings->two_sided = 0;
                 message_cb(3, "imagetype D81 from file extension");
             }
-            else if(arch_strcasecmp(s, "d82") == 0)
+            else if(is_extension(s, "d82"))
             {
                 settings->image_type = D82;
                 settings->two_sided = 1;
@@ -318,6 +331,7 @@ static int imgcopy_set_image_type(imgcopy_settings *settings, const char *filena
            case cbm_dt_cbm3040:
                case cbm_dt_cbm4040:
            case cbm_dt_cbm4031:
+           case cbm_dt_sd2iec:
             settings->image_type_std = D64;
             break;
 
@@ -689,6 +703,91 @@ int ReadBAM(imgcopy_settings *settings, const transfer_funcs *src, unsigned char
 
 
 
+/*
+ * evaluate the result of copying one block
+ */
+static void finish_block(imgcopy_status *status, char *trackmap,
+                         unsigned char *errors, int retry_count, int *cnt,
+                         unsigned char tr, unsigned char se,
+                         int read_result, int write_result)
+{
+    status->read_result = read_result;
+    status->write_result = write_result;
+
+    if(status->read_result)
+    {
+        /* read error */
+        trackmap[se] = bs_error;
+        (*errors)++;
+        if(retry_count == 0)
+        {
+            status->sectors_processed++;
+            /* FIXME: shall we get rid of this? */
+            message_cb( 1, "read error: %02x/%02x: %d",
+                        tr, se, status->read_result );
+        }
+    }
+    else
+    {
+        /* successfull read */
+        if(status->write_result)
+        {
+            /* write error */
+            trackmap[se] = bs_error;
+            (*errors)++;
+            if(retry_count == 0)
+            {
+                status->sectors_processed++;
+                /* FIXME: shall we get rid of this? */
+                message_cb(1, "write error: %02x/%02x: %d",
+                           tr, se, status->write_result);
+            }
+        }
+        else
+        {
+            /* successfull read and write, mark sector */
+            trackmap[se] = bs_copied;
+            (*cnt)++;
+            status->sectors_processed++;
+        }
+    }
+
+    status->track = tr;
+    status->sector= se;
+    status_cb(*status);
+}
+
+
+/*
+ * the pipeline writes the blocks to the destination given as context
+ */
+static int pipeline_write(void *context, blockpipe_block *blk)
+{
+    const transfer_funcs *dst = context;
+
+    return dst->write_block(blk->tr, blk->se, blk->data, blk->size,
+                            blk->read_result);
+}
+
+
+/*
+ * evaluate the blocks written by the pipeline, until no more than
+ * max_pending blocks are left in there
+ */
+static void collect_blocks(blockpipe *pipe, int max_pending,
+                           imgcopy_status *status, char *trackmap,
+                           unsigned char *errors, int retry_count, int *cnt)
+{
+    blockpipe_block done;
+
+    while(blockpipe_get(pipe, &done, blockpipe_pending(pipe) > max_pending))
+    {
+        finish_block(status, trackmap, errors, retry_count, cnt,
+                     done.tr, done.se, done.read_result, done.write_result);
+    }
+}
+
+
 static int copy_disk(CBM_FILE fd_cbm, imgcopy_settings *settings,
               const transfer_funcs *src, const void *src_arg,
               const transfer_funcs *dst, const void *dst_arg, unsigned char cbm_drive)
@@ -709,6 +808,7 @@ static int copy_disk(CBM_FILE fd_cbm, imgcopy_settings *settings,
     unsigned char block[BLOCKSIZE];
     //unsigned char gcr[GCRBUFSIZE];
     const transfer_funcs *cbm_transf = NULL;
+    blockpipe *pipe = NULL;
     imgcopy_status status;
     const char *type_str = "*unknown*";
 
@@ -869,6 +969,8 @@ static int copy_disk(CBM_FILE fd_cbm, imgcopy_settings *settings,
         SETSTATEDEBUG((void)0);
     }
 
+    cbm_transf = src->is_cbm_drive ? src : dst;
+
     switch( settings->drive_type )
     {
         case cbm_dt_cbm1541:
@@ -877,8 +979,8 @@ static int copy_disk(CBM_FILE fd_cbm, imgcopy_settings *settings,
         {
             if(settings->warp>0) {
                 message_cb(1, "`-w' for this transfer mode ignored");
-                settings->warp = 0;
             }
+            settings->warp = 0;
         }
         break;
 
@@ -891,8 +993,8 @@ static int copy_disk(CBM_FILE fd_cbm, imgcopy_settings *settings,
             {
                 if(settings->warp>0) {
                     message_cb(1, "drive type doesn't support warp mode");
-                    settings->warp = 0;
                 }
+                settings->warp = 0;
             }
         break;
     }
@@ -908,7 +1010,6 @@ static int copy_disk(CBM_FILE fd_cbm, imgcopy_settings *settings,
 
     message_cb(2, "set transfer struc.");
     SETSTATEDEBUG((void)0);
-    cbm_transf = src->is_cbm_drive ? src : dst;
 
 
     settings->warp = settings->warp ? 1 : 0;
@@ -1015,6 +1116,12 @@ static int copy_disk(CBM_FILE fd_cbm, imgcopy_settings *settings,
     message_cb(2, "copying tracks %d-%d (%d sectors)",
             settings->start_track, settings->end_track, status.total_sectors);
 
+    if(!dst->is_cbm_drive)
+    {
+        /* write the image while the next blocks are read from the drive */
+        pipe = blockpipe_start(pipeline_write, NULL, (void *) dst);
+        atom_pipe = pipe;
+    }
 
     //
     // copy disk
@@ -1088,6 +1195,13 @@ static int copy_disk(CBM_FILE fd_cbm, imgcopy_settings *settings,
 
                         while(!NEED_SECTOR(trackmap[se]))
                         {
+                            if(pipe && trackmap[se] == bs_invalid)
+                            {
+                                /* still in the pipeline, wait for the result */
+                                collect_blocks(pipe, 0, &status, trackmap,
+                                               &errors, retry_count, &cnt);
+                                continue;
+                            }
                             if(++se >= sectorCount) se = 0;
                             if(se_max-- <= 0)   break;
                         }
@@ -1097,71 +1211,47 @@ static int copy_disk(CBM_FILE fd_cbm, imgcopy_settings *settings,
                         status.read_result = src->read_block(tr, se, block);
                     }
 
-                    /*if(settings->warp && dst->is_cbm_drive)
+                    if(pipe)
                     {
-                        SETSTATEDEBUG((void)0);
-                        gcr_encode(block, gcr);
                         SETSTATEDEBUG(debugLibImgBlockCount++);
-                        status.write_result =
-                            dst->write_block(tr, se, gcr, GCRBUFSIZE-1,
-                                             status.read_result);
-                    }
-                    else  */
-                    {
-                        SETSTATEDEBUG(debugLibImgBlockCount++);
-                        status.write_result =
-                            dst->write_block(tr, se, block, BLOCKSIZE,
-                                             status.read_result);
-                    }
-                    SETSTATEDEBUG((void)0);
-
-                    if(status.read_result)
-                    {
-                        /* read error */
-                        trackmap[se] = bs_error;
-                        errors++;
-                        if(retry_count == 0)
-                        {
-                            status.sectors_processed++;
-                            /* FIXME: shall we get rid of this? */
-                            message_cb( 1, "read error: %02x/%02x: %d",
-                                        tr, se, status.read_result );
-                        }
+                        /* mark the sector as being in the pipeline */
+                        trackmap[se] = bs_invalid;
+                        blockpipe_put(pipe, tr, se, block, BLOCKSIZE,
+                                      status.read_result, 0);
+                        collect_blocks(pipe, BLOCKPIPE_DEPTH - 1, &status,
+                                       trackmap, &errors, retry_count, &cnt);
                     }
                     else
                     {
-                        /* successfull read */
-                        if(status.write_result)
+                        /*if(settings->warp && dst->is_cbm_drive)
                         {
-                            /* write error */
-                            trackmap[se] = bs_error;
-                            errors++;
-                            if(retry_count == 0)
-                            {
-                                status.sectors_processed++;
-                                /* FIXME: shall we get rid of this? */
-                                message_cb(1, "write error: %02x/%02x: %d",
-                                           tr, se, status.write_result);
-                            }
+                            SETSTATEDEBUG((void)0);
+                            gcr_encode(block, gcr);
+                            SETSTATEDEBUG(debugLibImgBlockCount++);
+                            status.write_result =
+                                dst->write_block(tr, se, gcr, GCRBUFSIZE-1,
+                                                 status.read_result);
                         }
-                        else
+                        else  */
                         {
-                            /* successfull read and write, mark sector */
-                            trackmap[se] = bs_copied;
-                            cnt++;
-                            status.sectors_processed++;
+                            SETSTATEDEBUG(debugLibImgBlockCount++);
+                            status.write_result =
+                                dst->write_block(tr, se, block, BLOCKSIZE,
+                                                 status.read_result);
                         }
+                        SETSTATEDEBUG((void)0);
+
+                        finish_block(&status, trackmap, &errors, retry_count,
+                                     &cnt, tr, se, status.read_result,
+                                     status.write_result);
                     }
+
                     /* remaining sectors on this track */
                     if(!resend_trackmap)
                     {
                         scnt--;
                     }
 
-                    status.track = tr;
-                    status.sector= se;
-                    status_cb(status);
-
                     if(dst->is_cbm_drive || !settings->warp)
                     {
                         se += (unsigned char) settings->interleave;
@@ -1169,6 +1259,11 @@ static int copy_disk(CBM_FILE fd_cbm, imgcopy_settings *settings,
                     }
                 }
                 //if(tr == 77)  printf("after while\n");
+                if(pipe)
+                {
+                    collect_blocks(pipe, 0, &status, trackmap,
+                                   &errors, retry_count, &cnt);
+                }
 
                 if(errors > 0)
                 {
@@ -1205,6 +1300,11 @@ static int copy_disk(CBM_FILE fd_cbm, imgcopy_settings *settings,
 
     SETSTATEDEBUG(debugLibImgBlockCount=-1);
 
+    if(pipe)
+    {
+        atom_pipe = NULL;
+        blockpipe_stop(pipe);
+    }
 
     dst->close_disk();
     SETSTATEDEBUG((void)0);
@@ -1219,6 +1319,7 @@ static int copy_disk(CBM_FILE fd_cbm, imgcopy_settings *settings,
 extern transfer_funcs d64copy_fs_transfer,
                       imgcopy_std_transfer,
                       imgcopy_pp_transfer,
+                      imgcopy_p2_transfer,
                       imgcopy_s1_transfer,
                       imgcopy_s2_transfer,
                       imgcopy_s3_transfer;
@@ -1238,6 +1339,7 @@ transfers[] =
     { &imgcopy_s2_transfer, "serial2", "s2" },
     { &imgcopy_s3_transfer, "burst", "s3" },
     { &imgcopy_pp_transfer, "parallel", "p%" },
+    { &imgcopy_p2_transfer, "parallel2", "p2" },
     { NULL, NULL, NULL }
 };
 
@@ -1412,6 +1514,11 @@ void imgcopy_cleanup(void)
 
     if (atom_mustcleanup)
     {
+        if (atom_pipe)
+        {
+            blockpipe_stop(atom_pipe);
+            atom_pipe = NULL;
+        }
         atom_dst->close_disk();
         atom_mustcleanup = 0;
     }
@@ -0,0 +1,283 @@
+/*
+ *  This program is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU General Public License
+ *  as published by the Free Software Foundation; either version
+ *  2 of the License, or (at your option) any later version.
+ *
+*/
+
+/*
+ * The parallel2 transfer: the XP1541 cable with one byte per handshake,
+ * as cbmcopy uses it (the P2 protocol of the xu1541 and xum1541). The
+ * bytes go one by one, so no byte is sent twice to fill a pair, and the
+ * adapter runs the whole transfer on its own.
+ */
+
+#include "opencbm.h"
+#include "imgcopy_int.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "arch.h"
+
+#include "opencbm-plugin.h"
+
+static opencbm_plugin_pp_cc_read_n_t * opencbm_plugin_pp_cc_read_n = NULL;
+
+static opencbm_plugin_pp_cc_write_n_t * opencbm_plugin_pp_cc_write_n = NULL;
+
+enum p2_direction_e
+{
+    P2_READ, P2_WRITE
+};
+
+static CBM_FILE fd_cbm;
+static enum p2_direction_e direction;
+
+static const unsigned char p21541_drive_prog[] = {
+#include "p21541.inc"
+};
+
+static const unsigned char p21571_drive_prog[] = {
+#include "p21571.inc"
+};
+
+static void p2_check_direction(enum p2_direction_e dir)
+{
+    if(direction != dir)
+    {
+        arch_sleep_us(100);
+        direction = dir;
+    }
+}
+
+static void p2_write(CBM_FILE fd, unsigned char c)
+{
+                                                                        SETSTATEDEBUG((void)0);
+    cbm_pp_write(fd, c);
+                                                                        SETSTATEDEBUG((void)0);
+    cbm_iec_release(fd, IEC_CLOCK);
+                                                                        SETSTATEDEBUG((void)0);
+#ifndef USE_CBM_IEC_WAIT
+    while(cbm_iec_get(fd, IEC_DATA));
+#else
+    cbm_iec_wait(fd, IEC_DATA, 0);
+#endif
+                                                                        SETSTATEDEBUG((void)0);
+    cbm_iec_set(fd, IEC_CLOCK);
+                                                                        SETSTATEDEBUG((void)0);
+#ifndef USE_CBM_IEC_WAIT
+    while(!cbm_iec_get(fd, IEC_DATA));
+#else
+    cbm_iec_wait(fd, IEC_DATA, 1);
+#endif
+                                                                        SETSTATEDEBUG((void)0);
+}
+
+/* write_n redirects USB writes to the external reader if required */
+static void write_n(const unsigned char *data, int size)
+{
+    p2_check_direction(P2_WRITE);
+
+    if (opencbm_plugin_pp_cc_write_n)
+    {
+        opencbm_plugin_pp_cc_write_n(fd_cbm, data, size);
+        return;
+    }
+
+    while(size-- > 0)
+        p2_write(fd_cbm, *data++);
+}
+
+static unsigned char p2_read(CBM_FILE fd)
+{
+    unsigned char c;
+                                                                        SETSTATEDEBUG((void)0);
+    cbm_iec_release(fd, IEC_CLOCK);
+                                                                        SETSTATEDEBUG((void)0);
+#ifndef USE_CBM_IEC_WAIT
+    while(cbm_iec_get(fd, IEC_DATA));
+#else
+    cbm_iec_wait(fd, IEC_DATA, 0);
+#endif
+                                                                        SETSTATEDEBUG((void)0);
+    c = cbm_pp_read(fd);
+                                                                        SETSTATEDEBUG((void)0);
+    cbm_iec_set(fd, IEC_CLOCK);
+                                                                        SETSTATEDEBUG((void)0);
+#ifndef USE_CBM_IEC_WAIT
+    while(!cbm_iec_get(fd, IEC_DATA));
+#else
+    cbm_iec_wait(fd, IEC_DATA, 1);
+#endif
+                                                                        SETSTATEDEBUG((void)0);
+    return c;
+}
+
+/* read_n redirects USB reads to the external reader if required */
+static void read_n(unsigned char *data, int size)
+{
+    if(direction != P2_READ)
+    {
+        p2_check_direction(P2_READ);
+        /* the port of the cable must not drive the lines anymore */
+        cbm_pp_read(fd_cbm);
+    }
+
+    if (opencbm_plugin_pp_cc_read_n)
+    {
+        opencbm_plugin_pp_cc_read_n(fd_cbm, data, size);
+        return;
+    }
+
+    while(size-- > 0)
+        *data++ = p2_read(fd_cbm);
+}
+
+static int read_block(unsigned char tr, unsigned char se, unsigned char *block)
+{
+    unsigned char buf[1 + BLOCKSIZE];
+                                                                        SETSTATEDEBUG((void)0);
+
+    buf[0] = tr; buf[1] = se;
+    write_n(buf, 2);
+
+#ifndef USE_CBM_IEC_WAIT
+    arch_sleep_ms(20);
+#endif
+                                                                        SETSTATEDEBUG(debugLibImgByteCount=0);
+    /* the drive always sends the status and the data: read them as one */
+    read_n(buf, sizeof(buf));
+    memcpy(block, buf + 1, BLOCKSIZE);
+                                                                        SETSTATEDEBUG(debugLibImgByteCount=-1);
+
+                                                                        SETSTATEDEBUG((void)0);
+    return buf[0];
+}
+
+static int write_block(unsigned char tr, unsigned char se, const unsigned char *blk, int size, int read_status)
+{
+    unsigned char status[2];
+
+                                                                        SETSTATEDEBUG((void)0);
+    status[0] = tr; status[1] = se;
+    write_n(status, 2);
+
+                                                                        SETSTATEDEBUG(debugLibImgByteCount=0);
+    write_n(blk, size);
+
+                                                                        SETSTATEDEBUG(debugLibImgByteCount=-1);
+#ifndef USE_CBM_IEC_WAIT
+    if(size == BLOCKSIZE) {
+        arch_sleep_ms(20);
+    }
+#endif
+
+                                                                        SETSTATEDEBUG((void)0);
+    read_n(status, 1);
+
+                                                                        SETSTATEDEBUG((void)0);
+    return status[0];
+}
+
+static int open_disk(CBM_FILE fd, imgcopy_settings *settings,
+                     const void *arg, int for_writing,
+                     turbo_start start, imgcopy_message_cb message_cb)
+{
+    unsigned char d = (unsigned char)(ULONG_PTR)arg;
+    const unsigned char *drive_prog;
+    int prog_size;
+
+    fd_cbm    = fd;
+    direction = P2_READ;
+
+    opencbm_plugin_pp_cc_read_n = cbm_get_plugin_function_address("opencbm_plugin_pp_cc_read_n");
+
+    opencbm_plugin_pp_cc_write_n = cbm_get_plugin_function_address("opencbm_plugin_pp_cc_write_n");
+
+    if(settings->drive_type != cbm_dt_cbm1541)
+    {
+        drive_prog = p21571_drive_prog;
+        prog_size  = sizeof(p21571_drive_prog);
+    }
+    else
+    {
+        drive_prog = p21541_drive_prog;
+        prog_size  = sizeof(p21541_drive_prog);
+    }
+
+                                                                        SETSTATEDEBUG((void)0);
+    /* make sure the XP1541 portion of the cable is in input mode */
+    cbm_pp_read(fd_cbm);
+
+                                                                        SETSTATEDEBUG((void)0);
+    cbm_upload_resident(fd_cbm, d, 0x700, drive_prog, prog_size);
+                                                                        SETSTATEDEBUG((void)0);
+    start(fd, d);
+                                                                        SETSTATEDEBUG((void)0);
+    cbm_iec_set(fd_cbm, IEC_CLOCK);
+                                                                        SETSTATEDEBUG((void)0);
+    cbm_iec_wait(fd_cbm, IEC_DATA, 1);
+                                                                        SETSTATEDEBUG((void)0);
+    return 0;
+}
+
+static void close_disk(void)
+{
+    unsigned char ts[2] = { 0, 0 };
+                                                                        SETSTATEDEBUG((void)0);
+    write_n(ts, 2);
+    arch_sleep_us(100);
+                                                                        SETSTATEDEBUG((void)0);
+    cbm_iec_wait(fd_cbm, IEC_DATA, 0);
+
+    /* make sure the XP1541 portion of the cable is in input mode */
+                                                                        SETSTATEDEBUG((void)0);
+    cbm_pp_read(fd_cbm);
+                                                                        SETSTATEDEBUG((void)0);
+
+    opencbm_plugin_pp_cc_read_n = NULL;
+
+    opencbm_plugin_pp_cc_write_n = NULL;
+}
+
+static int send_track_map(imgcopy_settings *settings, unsigned char tr, const char *trackmap, unsigned char count)
+{
+    int i, size;
+    unsigned char data[2 + MAX_SECTORS];
+
+    size = imgcopy_sector_count(settings, tr);
+
+    data[0] = tr;
+    data[1] = count;
+
+    /* build track map */
+    for(i = 0; i < size; i++)
+        data[2+i] = !NEED_SECTOR(trackmap[i]);
+
+    write_n(data, size+2);
+                                                                        SETSTATEDEBUG((void)0);
+    return 0;
+}
+
+static int read_gcr_block(unsigned char *se, unsigned char *gcrbuf)
+{
+    unsigned char s[2];
+                                                                        SETSTATEDEBUG((void)0);
+    /* the sector and the status */
+    read_n(s, 2);
+    *se = s[0];
+
+    if(s[1]) {
+        return s[1];
+    }
+                                                                        SETSTATEDEBUG(debugLibImgByteCount=0);
+    read_n(gcrbuf, GCRBUFSIZE);
+                                                                        SETSTATEDEBUG(debugLibImgByteCount=-1);
+
+                                                                        SETSTATEDEBUG((void)0);
+    return 0;
+}
+
+DECLARE_TRANSFER_FUNCS_EX(p2_transfer, 1, 1);
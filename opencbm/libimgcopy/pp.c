@@ -12,6 +12,7 @@
 #include "imgcopy_int.h"
 
 #include <stdlib.h>
+#include <string.h>
 
 #include "arch.h"
 
@@ -139,24 +140,23 @@ static void read_n(unsigned char *data, int size)
 
 static int read_block(unsigned char tr, unsigned char se, unsigned char *block)
 {
-    unsigned char status[2];
+    unsigned char buf[2 + BLOCKSIZE];
                                                                         SETSTATEDEBUG((void)0);
 
-    status[0] = tr; status[1] = se;
-    write_n(status, 2);
+    buf[0] = tr; buf[1] = se;
+    write_n(buf, 2);
 
 #ifndef USE_CBM_IEC_WAIT
     arch_sleep_ms(20);
 #endif
-                                                                        SETSTATEDEBUG((void)0);
-    read_n(status, 2);
-
                                                                         SETSTATEDEBUG(debugLibImgByteCount=0);
-    read_n(block, BLOCKSIZE);
+    /* the drive always sends the status and the data: read them as one */
+    read_n(buf, sizeof(buf));
+    memcpy(block, buf + 2, BLOCKSIZE);
                                                                         SETSTATEDEBUG(debugLibImgByteCount=-1);
 
                                                                         SETSTATEDEBUG((void)0);
-    return status[1];
+    return buf[1];
 }
 
 static int write_block(unsigned char tr, unsigned char se, const unsigned char *blk, int size, int read_status)
@@ -222,7 +222,7 @@ static int open_disk(CBM_FILE fd, imgcopy_settings *settings,
     cbm_pp_read(fd_cbm);
 
                                                                         SETSTATEDEBUG((void)0);
-    cbm_upload(fd_cbm, d, 0x700, drive_prog, prog_size);
+    cbm_upload_resident(fd_cbm, d, 0x700, drive_prog, prog_size);
                                                                         SETSTATEDEBUG((void)0);
     start(fd, d);
                                                                         SETSTATEDEBUG((void)0);
@@ -12,6 +12,7 @@
 #include "imgcopy_int.h"
 
 #include <stdlib.h>
+#include <string.h>
 
 #include "arch.h"
 
@@ -37,6 +38,16 @@ static const unsigned char s2_drive_prog_1581[] = {
 static CBM_FILE fd_cbm;
 static int two_sided;
 
+/*
+ * the 1581 reads a whole track into its track cache with the first
+ * sector, all other sectors of the track come from the cache at once.
+ * Writing goes to the cache as well; it is written back to the disk as
+ * a whole before the head leaves the track. Thus, there is only need to
+ * give the drive time for the first sector of a track.
+ */
+static int track_cache;
+static int cached_track;
+
 static int s2_read_byte(CBM_FILE fd, unsigned char *c)
 {
     int i;
@@ -146,22 +157,25 @@ static void write_n(const unsigned char *data, int size)
 
 static int read_block(unsigned char tr, unsigned char se, unsigned char *block)
 {
-    unsigned char status;
+    unsigned char buf[1 + BLOCKSIZE];
 
                                                                         SETSTATEDEBUG((void)0);
-    write_n(&tr, 1);
-                                                                        SETSTATEDEBUG((void)0);
-    write_n(&se, 1);
+    buf[0] = tr; buf[1] = se;
+    write_n(buf, 2);
 #ifndef USE_CBM_IEC_WAIT
-    arch_sleep_ms(20);
+    if(!track_cache || tr != cached_track)
+    {
+        arch_sleep_ms(20);
+    }
 #endif
-                                                                        SETSTATEDEBUG((void)0);
-    read_n(&status, 1);
+    cached_track = tr;
                                                                         SETSTATEDEBUG(DebugByteCount=0);
-    read_n(block, BLOCKSIZE);
+    /* the drive always sends the status and the data: read them as one */
+    read_n(buf, sizeof(buf));
+    memcpy(block, buf + 1, BLOCKSIZE);
                                                                         SETSTATEDEBUG(DebugByteCount=-1);
 
-    return status;
+    return buf[0];
 }
 
 static int write_block(unsigned char tr, unsigned char se, const unsigned char *blk, int size, int read_status)
@@ -175,10 +189,11 @@ static int write_block(unsigned char tr, unsigned char se, const unsigned char *
     write_n(blk, size);
                                                                         SETSTATEDEBUG(DebugByteCount=-1);
 #ifndef USE_CBM_IEC_WAIT
-    if(size == BLOCKSIZE) {
+    if(size == BLOCKSIZE && (!track_cache || tr != cached_track)) {
         arch_sleep_ms(20);
     }
 #endif
+    cached_track = tr;
                                                                         SETSTATEDEBUG((void)0);
     read_n(&status, 1);
                                                                         SETSTATEDEBUG((void)0);
@@ -193,6 +208,8 @@ static int open_disk(CBM_FILE fd, imgcopy_settings *settings,
 
     fd_cbm = fd;
     two_sided = settings->two_sided;
+    track_cache = settings->drive_type == cbm_dt_cbm1581;
+    cached_track = 0;
 
     opencbm_plugin_s2_read_n = cbm_get_plugin_function_address("opencbm_plugin_s2_read_n");
 
@@ -204,11 +221,11 @@ static int open_disk(CBM_FILE fd, imgcopy_settings *settings,
        case cbm_dt_cbm1541:
        case cbm_dt_cbm1570:
        case cbm_dt_cbm1571:
-        cbm_upload(fd_cbm, d, 0x700, s2_drive_prog_1541, sizeof(s2_drive_prog_1541));
+        cbm_upload_resident(fd_cbm, d, 0x700, s2_drive_prog_1541, sizeof(s2_drive_prog_1541));
         break;
 
        case cbm_dt_cbm1581:
-        cbm_upload(fd_cbm, d, 0x700, s2_drive_prog_1581, sizeof(s2_drive_prog_1581));
+        cbm_upload_resident(fd_cbm, d, 0x700, s2_drive_prog_1581, sizeof(s2_drive_prog_1581));
         break;
 
        case cbm_dt_cbm2040:
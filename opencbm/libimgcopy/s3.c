@@ -147,11 +147,11 @@ static int open_disk(CBM_FILE fd, imgcopy_settings *settings,
         case cbm_dt_cbm1541:
         case cbm_dt_cbm1570:
         case cbm_dt_cbm1571:
-            cbm_upload(fd_cbm, d, 0x700, s3_drive_prog_1541, sizeof(s3_drive_prog_1541));
+            cbm_upload_resident(fd_cbm, d, 0x700, s3_drive_prog_1541, sizeof(s3_drive_prog_1541));
             break;
 
         case cbm_dt_cbm1581:
-            cbm_upload(fd_cbm, d, 0x700, s3_drive_prog_1581, sizeof(s3_drive_prog_1581));
+            cbm_upload_resident(fd_cbm, d, 0x700, s3_drive_prog_1581, sizeof(s3_drive_prog_1581));
             break;
 
         case cbm_dt_cbm2040:
@@ -37,6 +37,7 @@ usb_dll_t usb = {
     .open = libusb_open,
     .close = libusb_close,
     .bulk_transfer = libusb_bulk_transfer,
+    .interrupt_transfer = libusb_interrupt_transfer,
     .control_transfer = libusb_control_transfer,
     .set_configuration = libusb_set_configuration,
     .get_configuration = libusb_get_configuration,
@@ -54,11 +55,21 @@ usb_dll_t usb = {
     .free_device_list = libusb_free_device_list,
     .get_bus_number = libusb_get_bus_number,
     .get_device_address = libusb_get_device_address,
+    .alloc_transfer = libusb_alloc_transfer,
+    .submit_transfer = libusb_submit_transfer,
+    .cancel_transfer = libusb_cancel_transfer,
+    .free_transfer = libusb_free_transfer,
+    .handle_events_completed = libusb_handle_events_completed,
+#if defined(LIBUSB_API_VERSION) && (LIBUSB_API_VERSION >= 0x01000105)
+    .dev_mem_alloc = libusb_dev_mem_alloc,
+    .dev_mem_free = libusb_dev_mem_free,
+#endif
 #elif HAVE_LIBUSB0
     .open = usb_open,
     .close = usb_close,
     .bulk_write = usb_bulk_write,
     .bulk_read = usb_bulk_read,
+    .interrupt_read = usb_interrupt_read,
     .control_msg = usb_control_msg,
     .set_configuration = usb_set_configuration,
     .claim_interface = usb_claim_interface,
@@ -91,3 +102,56 @@ int dynlibusb_init(void) {
 
 void dynlibusb_uninit(void) {
 }
+
+#if HAVE_LIBUSB1
+
+#include <pthread.h>
+
+/*
+ * One libusb context is shared by all the handles which are open at
+ * the same time, instead of setting up one for every handle, with its
+ * own device list and event handling. It is freed when the last
+ * handle gives it back.
+ */
+static libusb_context * dynlibusb_context = NULL;
+static unsigned int     dynlibusb_context_users = 0;
+static pthread_mutex_t  dynlibusb_context_mutex = PTHREAD_MUTEX_INITIALIZER;
+
+int dynlibusb_context_get(libusb_context **Context) {
+    int error = 0;
+
+    pthread_mutex_lock(&dynlibusb_context_mutex);
+
+    if (dynlibusb_context_users == 0) {
+        error = usb.init(&dynlibusb_context);
+    }
+
+    if (error == 0) {
+        ++dynlibusb_context_users;
+        *Context = dynlibusb_context;
+    }
+    else {
+        dynlibusb_context = NULL;
+        *Context = NULL;
+    }
+
+    pthread_mutex_unlock(&dynlibusb_context_mutex);
+
+    return error;
+}
+
+void dynlibusb_context_release(libusb_context *Context) {
+
+    pthread_mutex_lock(&dynlibusb_context_mutex);
+
+    if (dynlibusb_context_users > 0 && Context == dynlibusb_context) {
+        if (--dynlibusb_context_users == 0) {
+            usb.exit(dynlibusb_context);
+            dynlibusb_context = NULL;
+        }
+    }
+
+    pthread_mutex_unlock(&dynlibusb_context_mutex);
+}
+
+#endif
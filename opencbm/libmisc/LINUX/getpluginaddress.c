@@ -35,7 +35,10 @@ plugin_load(const char * name)
     char * error;
 
     if (name != NULL) {
-       ret = dlopen(name, RTLD_NOW);
+       /* bind the functions the plugin uses (libusb, ...) on their first
+        * call only instead of all of them now; most are never needed
+        * by a short-running tool */
+       ret = dlopen(name, RTLD_LAZY);
        error = dlerror();
        if (error){
            fprintf(stderr, "%s\n", error);
@@ -29,6 +29,10 @@
 
 usb_dll_t usb = { NULL };
 
+/*! the number of dynlibusb_init() calls not yet balanced by dynlibusb_uninit();
+ *  the library is only loaded for the first one */
+static unsigned int dynlibusb_users = 0;
+
 #if HAVE_LIBUSB1
   #define LIBUSB_DLLNAME "libusb-1.0.dll"
   #define LIBUSB_DLLFUNCPREFIX "libusb"
@@ -43,6 +47,12 @@ int dynlibusb_init(void) {
     int error = 1;
 
     do {
+        if (dynlibusb_users > 0) {
+            ++dynlibusb_users;
+            error = 0;
+            break;
+        }
+
         usb.shared_object_handle = plugin_load(LIBUSB_DLLNAME);
         if ( ! usb.shared_object_handle ) {
             break;
@@ -62,8 +72,7 @@ int dynlibusb_init(void) {
 //        READ(get_descriptor_by_endpoint);
 //        READ(get_descriptor);
         READ(bulk_transfer);
-//        READ(interrupt_write);
-//        READ(interrupt_read);
+        READ(interrupt_transfer);
         READ(control_transfer);
         READ(set_configuration);
         READ(get_configuration);
@@ -84,6 +93,15 @@ int dynlibusb_init(void) {
         READ(free_device_list);
         READ(get_bus_number);
         READ(get_device_address);
+        READ(alloc_transfer);
+        READ(submit_transfer);
+        READ(cancel_transfer);
+        READ(free_transfer);
+        READ(handle_events_completed);
+
+        /* optional, older DLLs do not have them */
+        usb.dev_mem_alloc = plugin_get_address(usb.shared_object_handle, LIBUSB_DLLFUNCPREFIX "_dev_mem_alloc");
+        usb.dev_mem_free = plugin_get_address(usb.shared_object_handle, LIBUSB_DLLFUNCPREFIX "_dev_mem_free");
 #elif HAVE_LIBUSB0
         READ(open);
         READ(close);
@@ -94,7 +112,7 @@ int dynlibusb_init(void) {
         READ(bulk_write);
         READ(bulk_read);
 //        READ(interrupt_write);
-//        READ(interrupt_read);
+        READ(interrupt_read);
         READ(control_msg);
         READ(set_configuration);
         READ(claim_interface);
@@ -112,6 +130,7 @@ int dynlibusb_init(void) {
         READ(get_busses);
 #endif
 
+        ++dynlibusb_users;
         error = 0;
     } while (0);
 
@@ -125,6 +144,10 @@ void dynlibusb_uninit(void) {
             break;
         }
 
+        if (dynlibusb_users > 0 && --dynlibusb_users > 0) {
+            break;
+        }
+
         plugin_unload(usb.shared_object_handle);
 
         memset(&usb, 0, sizeof usb);
@@ -132,3 +155,70 @@ void dynlibusb_uninit(void) {
     } while (0);
 
 }
+
+#if HAVE_LIBUSB1
+
+#include <windows.h>
+
+/*
+ * One libusb context is shared by all the handles which are open at
+ * the same time, instead of setting up one for every handle, with its
+ * own device list and event handling. It is freed when the last
+ * handle gives it back.
+ */
+static libusb_context * dynlibusb_context = NULL;
+static unsigned int     dynlibusb_context_users = 0;
+static LONG volatile    dynlibusb_context_lock_flag = 0;
+
+static void
+dynlibusb_context_lock(void)
+{
+    while (InterlockedExchange((LONG *) &dynlibusb_context_lock_flag, 1) != 0) {
+        Sleep(0);
+    }
+}
+
+static void
+dynlibusb_context_unlock(void)
+{
+    InterlockedExchange((LONG *) &dynlibusb_context_lock_flag, 0);
+}
+
+int dynlibusb_context_get(libusb_context **Context) {
+    int error = 0;
+
+    dynlibusb_context_lock();
+
+    if (dynlibusb_context_users == 0) {
+        error = usb.init(&dynlibusb_context);
+    }
+
+    if (error == 0) {
+        ++dynlibusb_context_users;
+        *Context = dynlibusb_context;
+    }
+    else {
+        dynlibusb_context = NULL;
+        *Context = NULL;
+    }
+
+    dynlibusb_context_unlock();
+
+    return error;
+}
+
+void dynlibusb_context_release(libusb_context *Context) {
+
+    dynlibusb_context_lock();
+
+    if (dynlibusb_context_users > 0 && Context == dynlibusb_context) {
+        if (--dynlibusb_context_users == 0) {
+            usb.exit(dynlibusb_context);
+            dynlibusb_context = NULL;
+        }
+    }
+
+    dynlibusb_context_unlock();
+}
+
+#endif
@@ -85,6 +85,10 @@ LIB32=link.exe -lib
 # PROP Default_Filter "cpp;c;cxx;rc;def;r;odl;idl;hpj;bat"
 # Begin Source File
 
+SOURCE=..\blockpipe.c
+# End Source File
+# Begin Source File
+
 SOURCE=..\configuration.c
 # End Source File
 # Begin Source File
@@ -125,6 +129,10 @@ SOURCE=..\usbcommon0.c
 # PROP Default_Filter "h;hpp;hxx;hm;inl"
 # Begin Source File
 
+SOURCE=..\..\include\blockpipe.h
+# End Source File
+# Begin Source File
+
 SOURCE=..\..\include\configuration.h
 # End Source File
 # Begin Source File
@@ -0,0 +1,273 @@
+/*
+ *  This program is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU General Public License
+ *  as published by the Free Software Foundation; either version
+ *  2 of the License, or (at your option) any later version.
+ *
+*/
+
+/*
+ * Pipeline between reading the blocks from the drive and writing them
+ * to the destination: a worker thread writes the blocks that have been
+ * read, while the caller already fetches the next ones from the bus.
+ * The results are handed back to the caller in the order the blocks
+ * were put in, so it can evaluate them (and report the status) exactly
+ * as if it had written the blocks itself.
+ *
+ * d64copy, d82copy and imgcopy all use it; what writing (and decoding)
+ * a block means is up to the callbacks they give.
+ */
+
+#include "blockpipe.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef WIN32
+# include <windows.h>
+#else
+# include <pthread.h>
+#endif
+
+struct blockpipe_s
+{
+    blockpipe_write_t write;         /* writes a block to the destination */
+    blockpipe_decode_t decode;
+    void *context;
+    blockpipe_block slot[BLOCKPIPE_DEPTH];
+    unsigned int queued;             /* number of blocks put in */
+    unsigned int written;            /* number of blocks written by the worker */
+    unsigned int fetched;            /* number of results got back */
+    int stop;                        /* != 0: the worker ends when it has written all blocks */
+
+#ifdef WIN32
+    CRITICAL_SECTION lock;
+    HANDLE work_event;               /* set when there is a block to write */
+    HANDLE done_event;               /* set when a block has been written */
+    HANDLE thread;
+#else
+    pthread_mutex_t lock;
+    pthread_cond_t work_cond;        /* signalled when there is a block to write */
+    pthread_cond_t done_cond;        /* signalled when a block has been written */
+    pthread_t thread;
+#endif
+};
+
+#ifdef WIN32
+# define pipeline_lock(_p)   EnterCriticalSection(&(_p)->lock)
+# define pipeline_unlock(_p) LeaveCriticalSection(&(_p)->lock)
+#else
+# define pipeline_lock(_p)   pthread_mutex_lock(&(_p)->lock)
+# define pipeline_unlock(_p) pthread_mutex_unlock(&(_p)->lock)
+#endif
+
+#ifdef WIN32
+static DWORD WINAPI pipeline_worker(LPVOID arg)
+#else
+static void *pipeline_worker(void *arg)
+#endif
+{
+    blockpipe *p = arg;
+    blockpipe_block *blk;
+
+    pipeline_lock(p);
+
+    for(;;)
+    {
+        while(p->written == p->queued && !p->stop)
+        {
+#ifdef WIN32
+            pipeline_unlock(p);
+            WaitForSingleObject(p->work_event, INFINITE);
+            pipeline_lock(p);
+#else
+            pthread_cond_wait(&p->work_cond, &p->lock);
+#endif
+        }
+
+        if(p->written == p->queued)
+        {
+            break;
+        }
+
+        /* the slot belongs to the worker until written is incremented */
+        blk = &p->slot[p->written % BLOCKPIPE_DEPTH];
+
+        pipeline_unlock(p);
+
+        if(blk->decode)
+        {
+            /* decoding here lets the caller already read the next block */
+            blk->read_result = p->decode(p->context, blk);
+        }
+
+        blk->write_result = p->write(p->context, blk);
+
+        pipeline_lock(p);
+
+        p->written++;
+
+#ifdef WIN32
+        SetEvent(p->done_event);
+#else
+        pthread_cond_signal(&p->done_cond);
+#endif
+    }
+
+    pipeline_unlock(p);
+
+#ifdef WIN32
+    return 0;
+#else
+    return NULL;
+#endif
+}
+
+static void pipeline_free(blockpipe *p)
+{
+#ifdef WIN32
+    if(p->work_event)
+    {
+        CloseHandle(p->work_event);
+    }
+    if(p->done_event)
+    {
+        CloseHandle(p->done_event);
+    }
+    DeleteCriticalSection(&p->lock);
+#else
+    pthread_cond_destroy(&p->done_cond);
+    pthread_cond_destroy(&p->work_cond);
+    pthread_mutex_destroy(&p->lock);
+#endif
+    free(p);
+}
+
+blockpipe *blockpipe_start(blockpipe_write_t write, blockpipe_decode_t decode,
+                           void *context)
+{
+    blockpipe *p;
+    int error;
+
+    p = calloc(1, sizeof(*p));
+    if(p == NULL)
+    {
+        return NULL;
+    }
+
+    p->write = write;
+    p->decode = decode;
+    p->context = context;
+
+#ifdef WIN32
+    InitializeCriticalSection(&p->lock);
+    p->work_event = CreateEvent(NULL, FALSE, FALSE, NULL);
+    p->done_event = CreateEvent(NULL, FALSE, FALSE, NULL);
+    error = p->work_event == NULL || p->done_event == NULL;
+    if(!error)
+    {
+        p->thread = CreateThread(NULL, 0, pipeline_worker, p, 0, NULL);
+        error = p->thread == NULL;
+    }
+#else
+    pthread_mutex_init(&p->lock, NULL);
+    pthread_cond_init(&p->work_cond, NULL);
+    pthread_cond_init(&p->done_cond, NULL);
+    error = pthread_create(&p->thread, NULL, pipeline_worker, p) != 0;
+#endif
+
+    if(error)
+    {
+        pipeline_free(p);
+        return NULL;
+    }
+    return p;
+}
+
+int blockpipe_pending(blockpipe *p)
+{
+    int pending;
+
+    pipeline_lock(p);
+    pending = p->queued - p->fetched;
+    pipeline_unlock(p);
+
+    return pending;
+}
+
+void blockpipe_put(blockpipe *p, unsigned char tr, unsigned char se,
+                   const unsigned char *data, int size, int read_result,
+                   int decode)
+{
+    blockpipe_block *blk;
+
+    /* only the caller fills and frees slots, thus, no lock needed to find one */
+    blk = &p->slot[p->queued % BLOCKPIPE_DEPTH];
+
+    blk->tr = tr;
+    blk->se = se;
+    blk->size = size;
+    blk->decode = decode;
+    blk->read_result = read_result;
+    blk->write_result = 0;
+    memcpy(blk->data, data, size);
+
+    pipeline_lock(p);
+    p->queued++;
+#ifdef WIN32
+    SetEvent(p->work_event);
+#else
+    pthread_cond_signal(&p->work_cond);
+#endif
+    pipeline_unlock(p);
+}
+
+int blockpipe_get(blockpipe *p, blockpipe_block *done, int wait)
+{
+    int ret = 0;
+
+    pipeline_lock(p);
+
+    while(wait && p->fetched == p->written && p->fetched != p->queued)
+    {
+#ifdef WIN32
+        pipeline_unlock(p);
+        WaitForSingleObject(p->done_event, INFINITE);
+        pipeline_lock(p);
+#else
+        pthread_cond_wait(&p->done_cond, &p->lock);
+#endif
+    }
+
+    if(p->fetched != p->written)
+    {
+        *done = p->slot[p->fetched % BLOCKPIPE_DEPTH];
+        p->fetched++;
+        ret = 1;
+    }
+
+    pipeline_unlock(p);
+
+    return ret;
+}
+
+void blockpipe_stop(blockpipe *p)
+{
+    pipeline_lock(p);
+    p->stop = 1;
+#ifdef WIN32
+    SetEvent(p->work_event);
+#else
+    pthread_cond_signal(&p->work_cond);
+#endif
+    pipeline_unlock(p);
+
+#ifdef WIN32
+    WaitForSingleObject(p->thread, INFINITE);
+    CloseHandle(p->thread);
+#else
+    pthread_join(p->thread, NULL);
+#endif
+
+    pipeline_free(p);
+}
@@ -49,6 +49,7 @@ struct usb_dll_s {
     int (LIBUSB_APIDECL *open)(libusb_device *dev, libusb_device_handle **handle);
     void (LIBUSB_APIDECL *close)(libusb_device_handle *dev);
     int (LIBUSB_APIDECL *bulk_transfer)(libusb_device_handle *dev_handle, unsigned char endpoint, unsigned char *data, int length, int *actual_length, unsigned int timeout);
+    int (LIBUSB_APIDECL *interrupt_transfer)(libusb_device_handle *dev_handle, unsigned char endpoint, unsigned char *data, int length, int *actual_length, unsigned int timeout);
     int (LIBUSB_APIDECL *control_transfer)(libusb_device_handle *dev_handle, uint8_t request_type, uint8_t bRequest, uint16_t wValue, uint16_t wIndex, unsigned char *data, uint16_t wLength, unsigned int timeout);
 
     int (LIBUSB_APIDECL *set_configuration)(libusb_device_handle *dev, int configuration);
@@ -70,6 +71,16 @@ struct usb_dll_s {
     uint8_t (LIBUSB_APIDECL *get_device_address)(libusb_device *dev);
     libusb_device *(LIBUSB_APIDECL *get_device)(libusb_device_handle *devh);
 
+    struct libusb_transfer *(LIBUSB_APIDECL *alloc_transfer)(int iso_packets);
+    int (LIBUSB_APIDECL *submit_transfer)(struct libusb_transfer *transfer);
+    int (LIBUSB_APIDECL *cancel_transfer)(struct libusb_transfer *transfer);
+    void (LIBUSB_APIDECL *free_transfer)(struct libusb_transfer *transfer);
+    int (LIBUSB_APIDECL *handle_events_completed)(libusb_context *ctx, int *completed);
+
+    /* libusb >= 1.0.21; NULL if the libusb in use does not have them */
+    unsigned char *(LIBUSB_APIDECL *dev_mem_alloc)(libusb_device_handle *dev, size_t length);
+    int (LIBUSB_APIDECL *dev_mem_free)(libusb_device_handle *dev, unsigned char *buffer, size_t length);
+
 #elif HAVE_LIBUSB0
 
     /*
@@ -88,7 +99,7 @@ struct usb_dll_s {
     int (LIBUSB_APIDECL *bulk_write)(usb_dev_handle *dev, int ep, const char *bytes, int size, int timeout);
     int (LIBUSB_APIDECL *bulk_read)(usb_dev_handle *dev, int ep, char *bytes, int size, int timeout);
 //    int (LIBUSB_APIDECL *interrupt_write)(usb_dev_handle *dev, int ep, char *bytes, int size, int timeout);
-//    int (LIBUSB_APIDECL *interrupt_read)(usb_dev_handle *dev, int ep, char *bytes, int size, int timeout);
+    int (LIBUSB_APIDECL *interrupt_read)(usb_dev_handle *dev, int ep, char *bytes, int size, int timeout);
     int (LIBUSB_APIDECL *control_msg)(usb_dev_handle *dev, int requesttype, int request, int value, int index, char *bytes, int size, int timeout);
     int (LIBUSB_APIDECL *set_configuration)(usb_dev_handle *dev, int configuration);
     int (LIBUSB_APIDECL *claim_interface)(usb_dev_handle *dev, int interface);
@@ -118,4 +129,9 @@ extern usb_dll_t usb;
 extern int dynlibusb_init(void);
 extern void dynlibusb_uninit(void);
 
+#if HAVE_LIBUSB1
+extern int dynlibusb_context_get(libusb_context **Context);
+extern void dynlibusb_context_release(libusb_context *Context);
+#endif
+
 #endif /* #ifndef OPENCBM_LIBMISC_DYNLIBUSB_H */
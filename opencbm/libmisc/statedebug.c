@@ -21,16 +21,20 @@
 
 #include <stdio.h>
 
-volatile signed int DebugLineNumber=-1, DebugBlockCount=-1,
+static const statedebug_tracepoint_t DebugTracePointStart = { "", -1 };
+
+volatile signed int DebugBlockCount=-1,
                     DebugByteCount=-1, DebugBitCount=-1;
-volatile char * DebugFileName = "";
+const statedebug_tracepoint_t * volatile DebugTracePoint = &DebugTracePointStart;
 
 void DebugPrintDebugCounters(void)
 {
+    const statedebug_tracepoint_t * tracepoint = DebugTracePoint;
+
     fprintf(stderr, "file: %s"
                       "\n\tversion: " OPENCBM_VERSION_STRING ", built: " __DATE__ " " __TIME__
                       "\n\tline=%d, blocks=%d, bytes=%d, bits=%d\n",
-                      DebugFileName, DebugLineNumber,
+                      tracepoint->FileName, tracepoint->LineNumber,
                       DebugBlockCount, DebugByteCount,
                       DebugBitCount);
 }
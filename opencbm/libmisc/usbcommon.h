@@ -30,11 +30,21 @@ struct opencbm_usb_handle {
 #if HAVE_LIBUSB1
         libusb_context *ctx;
         libusb_device_handle *devh;
+        unsigned char pending_in[8]; /*!< \internal \brief bulk IN data caught by a queued transfer after a short read */
+        int pending_in_len;          /*!< \internal \brief number of valid bytes in pending_in */
+        unsigned char *dev_mem;      /*!< \internal \brief DMA-able buffers of the queued transfers, or NULL */
+        int dev_mem_failed;          /*!< \internal \brief dev_mem could not be allocated, don't try again */
 #elif HAVE_LIBUSB0
         usb_dev_handle *devh; /*!< \internal \brief handle to the xu1541 device */
 #else
 #error Could not find the libusb 1.0 development packages. Please install them and retry!
 #endif
+        unsigned int capabilities;      /*!< \internal \brief capabilities reported by the device on initialization */
+        int status_int;                 /*!< \internal \brief the status comes on the interrupt endpoint (XUM1541_CAP_STATUS_INT) */
+        int defer_status;               /*!< \internal \brief writes do not wait for their status */
+        int jiffy;                      /*!< \internal \brief probe for JiffyDOS with LISTEN and TALK (XUM1541_JIFFY set) */
+        unsigned int deferred_writes;   /*!< \internal \brief number of writes sent with deferred status since the last flush */
+        unsigned int deferred_failures; /*!< \internal \brief number of failed deferred writes collected, but not reported yet */
 };
 
 #if HAVE_LIBUSB0
@@ -59,4 +59,8 @@ extern transfer_funcs libopencbmtransfer_s1;
 extern transfer_funcs libopencbmtransfer_s2;
 extern transfer_funcs libopencbmtransfer_pp;
 
+extern int
+libopencbmtransfer_upload_resident(CBM_FILE HandleDevice, unsigned char DeviceAddress,
+                                   int DriveMemAddress, const void *Program, size_t Size);
+
 #endif /* #ifndef LIBTRANS_INT_H */
@@ -17,6 +17,10 @@
 
 #include "arch.h"
 
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
 #include "o65.h"
 #include "o65_int.h"
 
@@ -129,13 +133,21 @@ struct o65_symboltable_entry
     unsigned char *module;  /* name of the module which contains this symbol */
     unsigned char *name;    /* name of the symbol */
     uint16         address; /* address to where this symbol is located */
+    int            next;    /* next entry with the same hash value (index + 1), 0 if none */
 } o65_symbol;
 
 #define O65_SYMBOLTABLE_MAX 1000
 
+/* number of hash chains; must be a power of 2 */
+#define O65_SYMBOLTABLE_HASH_SIZE 256
+
 static o65_symbol o65_symboltable[O65_SYMBOLTABLE_MAX];
 static int        o65_symboltable_count = 0;
 
+/* first entry of every hash chain (index + 1), 0 if the chain is empty.
+   With this, a symbol is found without comparing it against all the others. */
+static int        o65_symboltable_hash[O65_SYMBOLTABLE_HASH_SIZE];
+
 
 static char *
 stralloc(const char * const String)
@@ -156,6 +168,41 @@ stralloc(const char * const String)
     FUNC_LEAVE_STRING(p);
 }
 
+static unsigned int
+o65_symbol_hash(const char * const Name)
+{
+    const unsigned char *p;
+    unsigned int hash = 0;
+
+    FUNC_ENTER();
+
+    for (p = (const unsigned char *) Name; *p; p++)
+    {
+        hash = hash * 31 + *p;
+    }
+
+    FUNC_LEAVE_UINT(hash & (O65_SYMBOLTABLE_HASH_SIZE - 1));
+}
+
+/* find the link which points to Entry in its hash chain */
+static int *
+o65_symbol_link(int Entry)
+{
+    int *link;
+
+    FUNC_ENTER();
+
+    link = &o65_symboltable_hash[o65_symbol_hash((const char *) o65_symboltable[Entry].name)];
+
+    while (*link != Entry + 1)
+    {
+        DBG_ASSERT(*link != 0);
+        link = &o65_symboltable[*link - 1].next;
+    }
+
+    FUNC_LEAVE_PTR(link, int *);
+}
+
 static int
 o65_symbol_search(const char * const Name)
 {
@@ -164,11 +211,11 @@ o65_symbol_search(const char * const Name)
 
     FUNC_ENTER();
 
-    for (i = 0; i < o65_symboltable_count; i++)
+    for (i = o65_symboltable_hash[o65_symbol_hash(Name)]; i != 0; i = o65_symboltable[i - 1].next)
     {
-        if (strcmp(o65_symboltable[i].name, Name) == 0)
+        if (strcmp(o65_symboltable[i - 1].name, Name) == 0)
         {
-            found = i;
+            found = i - 1;
             break;
         }
     }
@@ -197,16 +244,25 @@ o65_symbol_add(const char * const Name, uint16 Address, const char * const Modul
 
         entry = -1;
     }
+    else if (o65_symboltable_count >= O65_SYMBOLTABLE_MAX)
+    {
+        DBG_ERROR((DBG_PREFIX "No room for symbol %s, the symbol table is full!",
+            Name));
+    }
     else
     {
+        unsigned int hash = o65_symbol_hash(Name);
+
         /* advance the number of symbols in the table */
-        o65_symboltable[o65_symboltable_count].module = stralloc(Module);
-        o65_symboltable[o65_symboltable_count].name = stralloc(Name);
-        o65_symboltable[o65_symboltable_count].address = Address;
+        entry = o65_symboltable_count++;
 
-        o65_symboltable_count++;
+        o65_symboltable[entry].module = stralloc(Module);
+        o65_symboltable[entry].name = stralloc(Name);
+        o65_symboltable[entry].address = Address;
 
-        DBG_ASSERT(o65_symboltable_count < O65_SYMBOLTABLE_MAX);
+        /* put it at the start of its hash chain */
+        o65_symboltable[entry].next = o65_symboltable_hash[hash];
+        o65_symboltable_hash[hash] = entry + 1;
     }
 
     FUNC_LEAVE_INT(entry);
@@ -227,21 +283,32 @@ o65_symbol_delete(int Entry)
     DBG_O65_SHOW((DBG_PREFIX "Deleting symbol '%s'.",
         o65_symboltable[Entry].name));
 
+    /* remove the entry from its hash chain */
+    *o65_symbol_link(Entry) = o65_symboltable[Entry].next;
+
     /* free the allocated memory */
     free(o65_symboltable[Entry].module);
     free(o65_symboltable[Entry].name);
 
     --o65_symboltable_count;
 
-    /* now, copy the last item over the just removed item */
-    o65_symboltable[Entry].module  = o65_symboltable[o65_symboltable_count].module;
-    o65_symboltable[Entry].name    = o65_symboltable[o65_symboltable_count].name;
-    o65_symboltable[Entry].address = o65_symboltable[o65_symboltable_count].address;
+    if (Entry != o65_symboltable_count)
+    {
+        /* let the hash chain of the last item point to its new place */
+        *o65_symbol_link(o65_symboltable_count) = Entry + 1;
+
+        /* now, copy the last item over the just removed item */
+        o65_symboltable[Entry].module  = o65_symboltable[o65_symboltable_count].module;
+        o65_symboltable[Entry].name    = o65_symboltable[o65_symboltable_count].name;
+        o65_symboltable[Entry].address = o65_symboltable[o65_symboltable_count].address;
+        o65_symboltable[Entry].next    = o65_symboltable[o65_symboltable_count].next;
+    }
 
     /* clear the last entry */
     DBGDO(o65_symboltable[o65_symboltable_count].module  = NULL);
     DBGDO(o65_symboltable[o65_symboltable_count].name    = NULL);
     DBGDO(o65_symboltable[o65_symboltable_count].address = 0);
+    DBGDO(o65_symboltable[o65_symboltable_count].next    = 0);
 
     FUNC_LEAVE_INT(0);
 }
@@ -303,7 +370,7 @@ typedef
 struct o65_file_relocation_entry_s
 {
     uint32 relocAddress;
-    uint8  reference;
+    uint32 reference;
     uint8  segment;
     uint8  type;
     uint8  additional;
@@ -326,6 +393,10 @@ struct o65_file_s
     unsigned char              *pdata;
     linkedlist_node_t           text_relocation_list;
     linkedlist_node_t           data_relocation_list;
+    char                       *module;
+    unsigned char              *reloc_image;
+    unsigned int                reloc_address;
+    unsigned int                reloc_length;
 
 } o65_file_t;
 
@@ -1115,47 +1186,54 @@ o65_file_load_reloc(uint8 *Buffer, unsigned Length, unsigned *Ptr,
         }
 
 
-        po65_relocation_entry->type = *p & O65_FILE_RELOC_SEGMTYPEBYTE_TYPE_MASK;
+        /* only a relocation to an undefined reference
+           tells which reference is meant; it comes before the low byte */
 
-        switch (po65_relocation_entry->type)
+        if (!error && po65_relocation_entry->segment == O65_FILE_RELOC_SEGMTYPEBYTE_SEGM_UNDEF)
         {
-        case O65_FILE_RELOC_SEGMTYPEBYTE_TYPE_WORD:
-            if ((error = o65_read_byte(Buffer, Length, Ptr, "2 bytes from reloc table, 1", p+1, 2)) == 0)
+            error = o65_file_read_size(Buffer, Length, Ptr, "reference from reloc table",
+                O65file, &po65_relocation_entry->reference);
+
+            if (!error && po65_relocation_entry->reference >= O65file->references_count)
             {
-                po65_relocation_entry->reference = p[1];
-                po65_relocation_entry->additional = p[2];
+                DBG_ERROR((DBG_PREFIX "references illegal reference %u",
+                    po65_relocation_entry->reference));
+                error = O65ERR_UNDEFINED_REFERENCE;
+            }
 
-                DBG_O65_SHOW((DBG_PREFIX
-                    "    - Type WORD, %s(%u), additional data: $%04X",
-                    O65file->references[p[1]], p[1], p[2]));
-                p += 2;
+            if (!error)
+            {
+                DBG_O65_SHOW((DBG_PREFIX "    - Reference %s(%u)",
+                    O65file->references[po65_relocation_entry->reference].name,
+                    po65_relocation_entry->reference));
             }
+        }
+
+        po65_relocation_entry->type = *p & O65_FILE_RELOC_SEGMTYPEBYTE_TYPE_MASK;
+
+        switch (po65_relocation_entry->type)
+        {
+        case O65_FILE_RELOC_SEGMTYPEBYTE_TYPE_WORD:
+            DBG_O65_SHOW((DBG_PREFIX "    - Type WORD"));
             break;
 
         case O65_FILE_RELOC_SEGMTYPEBYTE_TYPE_HIGH:
-            if ((error = o65_read_byte(Buffer, Length, Ptr, "2 bytes from reloc table, 2", p+1, 2)) == 0)
+            /* the low byte is only needed if the relocation is not page-wise */
+            if ((O65file->header.mode & O65_FILE_HEADER_MODE_PAGERELOC) == 0)
             {
-                po65_relocation_entry->reference = p[1];
-                po65_relocation_entry->additional = p[2];
-
-                DBG_O65_SHOW((DBG_PREFIX
-                    "    - Type HIGH, %s, additional data: $%04X",
-                    O65file->references[p[1]], p[2]));
-                p += 2;
+                if ((error = o65_read_byte(Buffer, Length, Ptr, "low byte from reloc table", p+1, 1)) == 0)
+                {
+                    po65_relocation_entry->additional = p[1];
+                }
             }
+
+            DBG_O65_SHOW((DBG_PREFIX
+                "    - Type HIGH, low byte: $%02X",
+                po65_relocation_entry->additional));
             break;
 
         case O65_FILE_RELOC_SEGMTYPEBYTE_TYPE_LOW:
-            if ((error = o65_read_byte(Buffer, Length, Ptr, "2 bytes from reloc table, 3", p+1, 2)) == 0)
-            {
-                po65_relocation_entry->reference = p[1];
-                po65_relocation_entry->additional = p[2];
-
-                DBG_O65_SHOW((DBG_PREFIX
-                    "    - Type LOW, %s, additional data: $%04X",
-                    O65file->references[p[1]], p[2]));
-                p += 2;
-            }
+            DBG_O65_SHOW((DBG_PREFIX "    - Type LOW"));
             break;
 
         case O65_FILE_RELOC_SEGMTYPEBYTE_TYPE_SEGADR:
@@ -1180,13 +1258,6 @@ o65_file_load_reloc(uint8 *Buffer, unsigned Length, unsigned *Ptr,
 
         if (po65_relocation_entry)
         {
-            if (po65_relocation_entry->reference >= O65file->references_count)
-            {
-                DBG_ERROR((DBG_PREFIX "references illegal reference %u",
-                    po65_relocation_entry->reference));
-                error = O65ERR_UNDEFINED_REFERENCE;
-            }
-
             if (!error)
             {
                 linkedlist_insertafter(List, po65_relocation_entry);
@@ -1232,14 +1303,40 @@ o65_file_alloc(char *Buffer)
 }
 
 void
-o65_file_delete(o65_file_t *O65file)
+o65_file_delete(void *PO65file)
 {
+    o65_file_t *O65file = PO65file;
+    uint32 i;
+
     FUNC_ENTER();
 
     DBG_ASSERT(O65file != NULL);
 
     if (O65file)
     {
+        if (O65file->module)
+        {
+            o65_symbol_delete_module(O65file->module);
+            free(O65file->module);
+        }
+
+        if (O65file->references)
+        {
+            for (i = 0; i < O65file->references_count; i++)
+                free(O65file->references[i].name);
+
+            free(O65file->references);
+        }
+
+        if (O65file->globals)
+        {
+            for (i = 0; i < O65file->globals_count; i++)
+                free(O65file->globals[i].name);
+
+            free(O65file->globals);
+        }
+
+        free(O65file->reloc_image);
         free(O65file->ptext);
         free(O65file->pdata);
 
@@ -1260,7 +1357,7 @@ o65_file_delete(o65_file_t *O65file)
 }
 
 int
-o65_file_process(char *Buffer, unsigned Length, o65_file_t **PO65file)
+o65_file_process(char *Buffer, unsigned Length, void **PO65file)
 {
     o65_file_t *o65file = NULL;
     unsigned ptr = 0;
@@ -1359,7 +1456,7 @@ o65_file_process(char *Buffer, unsigned Length, o65_file_t **PO65file)
 }
 
 int
-o65_file_load(const char * const Filename, o65_file_t **PO65file)
+o65_file_load(const char * const Filename, void **PO65file)
 {
     FILE *f = NULL;
     char *buffer = NULL;
@@ -1420,6 +1517,11 @@ o65_file_load(const char * const Filename, o65_file_t **PO65file)
             break;
         }
 
+        /* the globals of the file are entered into the
+           symbol table under the name of the file */
+
+        ((o65_file_t *) *PO65file)->module = stralloc(Filename);
+
     } while (0);
 
     if (f != NULL) {
@@ -1433,12 +1535,260 @@ o65_file_load(const char * const Filename, o65_file_t **PO65file)
     FUNC_LEAVE_INT(error);
 }
 
+/* determine the value which has to be added to an address in Segment
+   if the file is relocated to Address. The data and bss segments are
+   placed directly behind the text segment, the zero page is not
+   relocated at all. */
+static int
+o65_file_reloc_offset(o65_file_t *O65file, unsigned int Address,
+                      uint8 Segment, uint32 Reference, uint32 *Offset)
+{
+    int error = O65ERR_NO_ERROR;
+    int entry;
+
+    FUNC_ENTER();
+
+    DBG_ASSERT(O65file != NULL);
+    DBG_ASSERT(Offset != NULL);
+
+    switch (Segment)
+    {
+    case O65_FILE_RELOC_SEGMTYPEBYTE_SEGM_UNDEF:
+        if (Reference >= O65file->references_count)
+        {
+            error = O65ERR_UNDEFINED_REFERENCE;
+            break;
+        }
+
+        entry = o65_symbol_search(O65file->references[Reference].name);
+
+        if (entry < 0)
+        {
+            DBG_ERROR((DBG_PREFIX "Symbol '%s' is not defined.",
+                O65file->references[Reference].name));
+            error = O65ERR_UNDEFINED_REFERENCE;
+        }
+        else
+        {
+            *Offset = o65_symboltable[entry].address;
+        }
+        break;
+
+    case O65_FILE_RELOC_SEGMTYPEBYTE_SEGM_TEXT:
+        *Offset = Address - O65file->header_32.tbase;
+        break;
+
+    case O65_FILE_RELOC_SEGMTYPEBYTE_SEGM_DATA:
+        *Offset = Address + O65file->header_32.tlen - O65file->header_32.dbase;
+        break;
+
+    case O65_FILE_RELOC_SEGMTYPEBYTE_SEGM_BSS:
+        *Offset = Address + O65file->header_32.tlen + O65file->header_32.dlen
+            - O65file->header_32.bbase;
+        break;
+
+    case O65_FILE_RELOC_SEGMTYPEBYTE_SEGM_ABS:
+    case O65_FILE_RELOC_SEGMTYPEBYTE_SEGM_ZERO:
+        *Offset = 0;
+        break;
+
+    default:
+        DBG_ERROR((DBG_PREFIX "Cannot relocate unknown segment $%02X", Segment));
+        error = O65ERR_UNKNOWN_SEGMENT;
+        break;
+    }
+
+    FUNC_LEAVE_INT(error);
+}
+
+static int
+o65_file_reloc_list(o65_file_t *O65file, unsigned int Address,
+                    linkedlist_node_t *List, unsigned char *Segment, uint32 SegmentLength)
+{
+    linkedlist_node_t *node;
+    int error = O65ERR_NO_ERROR;
+
+    FUNC_ENTER();
+
+    DBG_ASSERT(O65file != NULL);
+    DBG_ASSERT(List != NULL);
+
+    for (node = List->next; !error && !linkedlist_is_last(node); node = node->next)
+    {
+        o65_file_relocation_entry_t *entry = (o65_file_relocation_entry_t *) node->item;
+        unsigned char *p;
+        uint32 offset = 0;
+        uint32 size;
+        uint16 value;
+
+        error = o65_file_reloc_offset(O65file, Address, entry->segment,
+            entry->reference, &offset);
+
+        if (error)
+        {
+            break;
+        }
+
+        size = entry->type == O65_FILE_RELOC_SEGMTYPEBYTE_TYPE_WORD ? 2 : 1;
+
+        if (entry->relocAddress + size > SegmentLength)
+        {
+            DBG_ERROR((DBG_PREFIX "Relocation address $%04X is outside "
+                "of the segment", entry->relocAddress));
+            error = O65ERR_RELOCATION_OUTSIDE_SEGMENT;
+            break;
+        }
+
+        p = &Segment[entry->relocAddress];
+
+        switch (entry->type)
+        {
+        case O65_FILE_RELOC_SEGMTYPEBYTE_TYPE_WORD:
+            value = (uint16) (p[0] | (p[1] << 8)) + (uint16) offset;
+            p[0] = (unsigned char) value;
+            p[1] = (unsigned char) (value >> 8);
+            break;
+
+        case O65_FILE_RELOC_SEGMTYPEBYTE_TYPE_HIGH:
+            value = (uint16) ((p[0] << 8) | entry->additional) + (uint16) offset;
+            p[0] = (unsigned char) (value >> 8);
+            break;
+
+        case O65_FILE_RELOC_SEGMTYPEBYTE_TYPE_LOW:
+            p[0] = (unsigned char) (p[0] + offset);
+            break;
+        }
+    }
+
+    FUNC_LEAVE_INT(error);
+}
+
 int
-o65_file_reloc(o65_file_t *O65file, unsigned int Address)
+o65_file_reloc(void *PO65file, unsigned int Address)
 {
+    o65_file_t *O65file = PO65file;
+    unsigned char *image = NULL;
+    unsigned int length;
+    uint32 i;
     int error = O65ERR_NO_ERROR;
 
     FUNC_ENTER();
 
+    DBG_ASSERT(O65file != NULL);
+
+    do {
+        /* relocating to the same address as the last time
+           gives the same image; thus, it can be used again */
+
+        if (O65file->reloc_image && O65file->reloc_address == Address)
+        {
+            DBG_O65_SHOW((DBG_PREFIX "Using the image already relocated to $%04X",
+                Address));
+            break;
+        }
+
+        free(O65file->reloc_image);
+        O65file->reloc_image = NULL;
+
+        if (O65file->module)
+        {
+            o65_symbol_delete_module(O65file->module);
+        }
+
+        /* build the image: the data segment directly follows the text segment */
+
+        length = O65file->header_32.tlen + O65file->header_32.dlen;
+
+        image = malloc(length ? length : 1);
+        if (!image) {
+            error = O65ERR_OUT_OF_MEMORY;
+            break;
+        }
+
+        if (O65file->header_32.tlen) {
+            memcpy(image, O65file->ptext, O65file->header_32.tlen);
+        }
+
+        if (O65file->header_32.dlen) {
+            memcpy(image + O65file->header_32.tlen, O65file->pdata, O65file->header_32.dlen);
+        }
+
+        if ( O65ERR_NO_ERROR != (error = o65_file_reloc_list(O65file, Address,
+                                &O65file->text_relocation_list,
+                                image, O65file->header_32.tlen) ) ) {
+            break;
+        }
+
+        if ( O65ERR_NO_ERROR != (error = o65_file_reloc_list(O65file, Address,
+                                &O65file->data_relocation_list,
+                                image + O65file->header_32.tlen, O65file->header_32.dlen) ) ) {
+            break;
+        }
+
+        /* export the globals with their new addresses */
+
+        for (i = 0; O65file->module && i < O65file->globals_count; i++)
+        {
+            uint32 offset = 0;
+
+            /* a global cannot be in the undefined segment,
+               thus, there is no valid reference for it */
+
+            error = o65_file_reloc_offset(O65file, Address, O65file->globals[i].segmentid,
+                O65file->references_count, &offset);
+
+            if (error) {
+                break;
+            }
+
+            if (o65_symbol_add(O65file->globals[i].name,
+                    (uint16) (O65file->globals[i].value + offset), O65file->module) < 0)
+            {
+                error = O65ERR_DUPLICATE_SYMBOL;
+                break;
+            }
+        }
+
+        if (error) {
+            if (O65file->module) {
+                o65_symbol_delete_module(O65file->module);
+            }
+            break;
+        }
+
+        O65file->reloc_image   = image;
+        O65file->reloc_address = Address;
+        O65file->reloc_length  = length;
+        image = NULL;
+
+    } while (0);
+
+    free(image);
+
+    FUNC_LEAVE_INT(error);
+}
+
+int
+o65_file_image(void *PO65file, const unsigned char **Image, unsigned int *Length)
+{
+    o65_file_t *O65file = PO65file;
+    int error = O65ERR_NO_ERROR;
+
+    FUNC_ENTER();
+
+    DBG_ASSERT(O65file != NULL);
+    DBG_ASSERT(Image != NULL);
+    DBG_ASSERT(Length != NULL);
+
+    if (!O65file->reloc_image)
+    {
+        error = O65ERR_NO_DATA;
+    }
+    else
+    {
+        *Image  = O65file->reloc_image;
+        *Length = O65file->reloc_length;
+    }
+
     FUNC_LEAVE_INT(error);
 }
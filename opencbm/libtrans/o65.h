@@ -32,12 +32,16 @@ enum O65ERR {
     O65ERR_NO_O65_FILE                    = -17,
     O65ERR_UNKNOWN_VERSION                = -18,
     O65ERR_FILE_HANDLING_ERROR            = -19,
-    O65ERR_UNKNOWN_CPU_SPECIFICATION      = -20
+    O65ERR_UNKNOWN_CPU_SPECIFICATION      = -20,
+    O65ERR_UNKNOWN_SEGMENT                = -21,
+    O65ERR_RELOCATION_OUTSIDE_SEGMENT     = -22,
+    O65ERR_DUPLICATE_SYMBOL               = -23
 } O65ERR;
 
 extern int o65_file_process(char *Buffer, unsigned Length, void **PO65file);
 extern int o65_file_load(const char * const Filename, void **PO65file);
 extern int o65_file_reloc(void *O65file, unsigned int Address);
+extern int o65_file_image(void *O65file, const unsigned char **Image, unsigned int *Length);
 extern void o65_file_delete(void *O65file);
 
 #endif /* #ifndef O65_H */
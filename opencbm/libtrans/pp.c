@@ -154,7 +154,8 @@ upload(CBM_FILE fd, unsigned char drive)
         return 1;
     }
 
-    bytesWritten = cbm_upload(fd, drive, 0x700, pp_drive_prog, pp_drive_prog_length);
+    bytesWritten = libopencbmtransfer_upload_resident(fd, drive, 0x700,
+        pp_drive_prog, pp_drive_prog_length);
 
     if (bytesWritten != pp_drive_prog_length)
     {
@@ -188,7 +188,8 @@ upload(CBM_FILE fd, unsigned char drive)
         return 1;
     }
 
-    bytesWritten = cbm_upload(fd, drive, 0x700, s1_drive_prog, s1_drive_prog_length);
+    bytesWritten = libopencbmtransfer_upload_resident(fd, drive, 0x700,
+        s1_drive_prog, s1_drive_prog_length);
 
     if (bytesWritten != s1_drive_prog_length)
     {
@@ -11,6 +11,8 @@
 #include "libtrans_int.h"
 
 #include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
 
 static const unsigned char turbomain_1541_1571_drive_prog[] = {
 #include "turbomain-1541-1571.inc"
@@ -29,11 +31,36 @@ libopencbmtransfer_test()
 
 static transfer_funcs *current_transfer_funcs = &libopencbmtransfer_s1;
 
+/*! != 0 if the transfer is selected when the turbo routines are installed */
+static int auto_transfer = 0;
+
+/*! != 0 if the turbo routines are running in the drive */
+static int turbo_installed = 0;
+
+/*! Drive memory occupied by the turbo routines: the main loop
+ *  lives at $0500, the transfer routines at $0700 */
+#define TURBO_MAIN_START      0x500u
+#define TURBO_TRANSFER_START  0x700u
+#define TURBO_AREA_SIZE       0x100u
+
+/*! Executing this address lets the turbo routines return to the DOS */
+#define TURBO_QUIT            (TURBO_MAIN_START + 6u)
+
+/*! The number of bytes which are compared first to find out if a
+ *  drive program is still resident */
+#define RESIDENT_PROBE_SIZE   16u
+
 int
 libopencbmtransfer_set_transfer(opencbm_transfer_t TransferType)
 {
+    auto_transfer = 0;
+
     switch (TransferType)
     {
+    case opencbm_transfer_auto:
+        auto_transfer = 1;
+        break;
+
     case opencbm_transfer_serial1:
         current_transfer_funcs = &libopencbmtransfer_s1;
         break;
@@ -55,10 +82,108 @@ libopencbmtransfer_set_transfer(opencbm_transfer_t TransferType)
 }
 
 
+/*! \brief Select the fastest transfer which works with a drive
+
+ The parallel transfer is used if the drive is connected with
+ an XP1541 cable, serial2 if the drive is the only one on the
+ bus, and serial1 otherwise.
+
+ \param HandleDevice
+   A CBM_FILE which contains the file handle of the driver.
+
+ \param DeviceAddress
+   The address of the device on the IEC serial bus. This
+   is known as primary address, too.
+
+ \param DeviceType
+   The type of the drive, as returned by cbm_identify().
+
+ \return
+   The transfer functions to use.
+*/
+static transfer_funcs *
+select_transfer(CBM_FILE HandleDevice, unsigned char DeviceAddress,
+                enum cbm_device_type_e DeviceType)
+{
+    enum cbm_cable_type_e cableType;
+    enum cbm_device_type_e testType;
+    unsigned char testDevice;
+
+    if (DeviceType != cbm_dt_cbm1581
+        && cbm_identify_xp1541(HandleDevice, DeviceAddress, NULL, &cableType) == 0
+        && cableType == cbm_ct_xp1541)
+    {
+        DBG_PRINT((DBG_PREFIX "selected the parallel transfer."));
+        return &libopencbmtransfer_pp;
+    }
+
+    for (testDevice = 4; testDevice < 31; ++testDevice)
+    {
+        if (testDevice != DeviceAddress
+            && cbm_identify(HandleDevice, testDevice, &testType, NULL) == 0)
+        {
+            DBG_PRINT((DBG_PREFIX "device %u is on the bus, too, selected serial1.", testDevice));
+            return &libopencbmtransfer_s1;
+        }
+    }
+
+    DBG_PRINT((DBG_PREFIX "selected serial2."));
+    return &libopencbmtransfer_s2;
+}
+
+
+/*! \brief Upload a drive program, unless it is still resident
+
+ The turbo routines can stay in the drive's memory after a process
+ is done with them, see libopencbmtransfer_detach(). Thus, the
+ drive's memory is read back first, as "M-R" transfers far more
+ bytes per command than "M-W". Only the first bytes are read
+ before it is clear that the program is still there, so that a
+ drive which does not have it loses not much time.
+
+ The parameters and the return value are the same as for
+ cbm_upload().
+*/
+int
+libopencbmtransfer_upload_resident(CBM_FILE HandleDevice, unsigned char DeviceAddress,
+                                   int DriveMemAddress, const void *Program, size_t Size)
+{
+    const unsigned char *program = Program;
+    unsigned char *resident;
+    size_t probe = Size < RESIDENT_PROBE_SIZE ? Size : RESIDENT_PROBE_SIZE;
+    int isResident = 0;
+
+    resident = malloc(Size);
+
+    if (resident != NULL)
+    {
+        isResident =
+            cbm_download(HandleDevice, DeviceAddress, DriveMemAddress, resident, probe) == (int) probe
+            && memcmp(resident, program, probe) == 0
+            && (probe == Size
+                || (cbm_download(HandleDevice, DeviceAddress, DriveMemAddress + (int) probe,
+                        resident + probe, Size - probe) == (int) (Size - probe)
+                    && memcmp(resident + probe, program + probe, Size - probe) == 0));
+
+        free(resident);
+    }
+
+    if (isResident)
+    {
+        DBG_PRINT((DBG_PREFIX "drive program at $%04x is still resident", DriveMemAddress));
+        return (int) Size;
+    }
+
+    return cbm_upload(HandleDevice, DeviceAddress, DriveMemAddress, Program, Size);
+}
+
+
 /*! \brief Install the turbo routines into a drive
 
  This functions installs the turbo routines for later
- use in the drive.
+ use in the drive. If they have been left in the drive's
+ memory by libopencbmtransfer_detach(), they are only
+ started again, without uploading them.
 
  \param HandleDevice
    A CBM_FILE which contains the file handle of the driver.
@@ -83,6 +208,8 @@ libopencbmtransfer_install(CBM_FILE HandleDevice, unsigned char DeviceAddress)
     const unsigned char *turbomain_drive_prog = 0;
     unsigned int turbomain_drive_prog_length = 0;
 
+    turbo_installed = 0;
+
     if (cbm_identify(HandleDevice, DeviceAddress, &cbmDeviceType, &cbmDeviceString))
     {
         error = 1;
@@ -123,6 +250,11 @@ libopencbmtransfer_install(CBM_FILE HandleDevice, unsigned char DeviceAddress)
     }
 
 
+    if (auto_transfer)
+    {
+        current_transfer_funcs = select_transfer(HandleDevice, DeviceAddress, cbmDeviceType);
+    }
+
     // set device type for transfer routine
 
     if (current_transfer_funcs->set_device_type(cbmDeviceType)) {
@@ -143,8 +275,8 @@ libopencbmtransfer_install(CBM_FILE HandleDevice, unsigned char DeviceAddress)
 
         // Now, upload the main loop into the drive
 
-        bytesWritten = cbm_upload(HandleDevice, DeviceAddress, 0x500,
-            turbomain_drive_prog, turbomain_drive_prog_length);
+        bytesWritten = libopencbmtransfer_upload_resident(HandleDevice, DeviceAddress,
+            TURBO_MAIN_START, turbomain_drive_prog, turbomain_drive_prog_length);
 
         if (bytesWritten != turbomain_drive_prog_length)
         {
@@ -168,6 +300,8 @@ libopencbmtransfer_install(CBM_FILE HandleDevice, unsigned char DeviceAddress)
         //printf("... end\n");
     }
 
+    turbo_installed = !error;
+
     FUNC_LEAVE_INT(error);
 }
 
@@ -188,14 +322,74 @@ typedef int
 (*ll_read_write_mem)(CBM_FILE HandleDevice, unsigned char DeviceAddress,
                      unsigned char Buffer[], unsigned int MemoryAddress, unsigned int Length);
 
+/*
+ * The low-level functions transfer one block, from MemoryAddress + Length
+ * up to the end of the page at MemoryAddress.
+ *
+ * A block can be sent in runs of equal bytes, as pairs of the value and
+ * the length of the run (0 meaning 256). This is done whenever it is
+ * smaller than the block: for writing, the host decides this; for reading,
+ * the drive sends the number of runs - 1 first, and both sides decide it
+ * from that in the same way.
+ */
+
+/*! \brief Count the runs of equal bytes in a block */
+static unsigned int
+count_runs(const unsigned char Buffer[], unsigned int Count)
+{
+    unsigned int runs = 1;
+    unsigned int i;
+
+    for (i = 1; i < Count; i++)
+    {
+        if (Buffer[i] != Buffer[i - 1])
+        {
+            runs++;
+        }
+    }
+
+    return runs;
+}
+
+/*! \brief Test if the runs of a block starting at Start are smaller than the block */
+static int
+runs_are_smaller(unsigned int Runs, unsigned int Start)
+{
+    return 2 * Runs + Start < 0x100;
+}
+
 static int
 libopencbmtransfer_ll_write_mem(CBM_FILE HandleDevice, unsigned char DeviceAddress,
                                 unsigned char Buffer[], unsigned int MemoryAddress, unsigned int Length)
 {
+    unsigned int count = 0x100 - Length;
+    unsigned int i;
+    unsigned int run;
+
     FUNC_ENTER();
 
     DBG_ASSERT(Length < 0x100);
 
+    if (runs_are_smaller(count_runs(Buffer, count), Length))
+    {
+        current_transfer_funcs->write1byte(HandleDevice, 0x02);
+        current_transfer_funcs->write2byte(HandleDevice,
+            (unsigned char) (MemoryAddress & 0xFF),
+            (unsigned char) (MemoryAddress >> 8));
+        current_transfer_funcs->write1byte(HandleDevice, (unsigned char) Length);
+
+        for (i = 0; i < count; i += run)
+        {
+            for (run = 1; i + run < count && Buffer[i + run] == Buffer[i]; run++)
+            {
+            }
+            current_transfer_funcs->write1byte(HandleDevice, Buffer[i]);
+            current_transfer_funcs->write1byte(HandleDevice, (unsigned char) run);
+        }
+
+        FUNC_LEAVE_INT(0);
+    }
+
     current_transfer_funcs->write1byte(HandleDevice, 0x00);
     current_transfer_funcs->write2byte(HandleDevice,
         (unsigned char) (MemoryAddress & 0xFF),
@@ -211,16 +405,43 @@ static int
 libopencbmtransfer_ll_read_mem(CBM_FILE HandleDevice, unsigned char DeviceAddress,
                                unsigned char Buffer[], unsigned int MemoryAddress, unsigned int Length)
 {
+    unsigned int count = 0x100 - Length;
+    unsigned int i;
+    unsigned int run;
+    unsigned char runs;
+    unsigned char value;
+    unsigned char c;
+
     FUNC_ENTER();
 
     DBG_ASSERT(Length < 0x100);
 
-    current_transfer_funcs->write1byte(HandleDevice, 0x01);
+    current_transfer_funcs->write1byte(HandleDevice, 0x03);
     current_transfer_funcs->write2byte(HandleDevice,
         (unsigned char) (MemoryAddress & 0xFF),
         (unsigned char) (MemoryAddress >> 8));
     current_transfer_funcs->write1byte(HandleDevice, (unsigned char) Length);
-    current_transfer_funcs->readblock(HandleDevice, Buffer, Length);
+    current_transfer_funcs->read1byte(HandleDevice, &runs);
+
+    if (!runs_are_smaller(runs + 1u, Length))
+    {
+        current_transfer_funcs->readblock(HandleDevice, Buffer, Length);
+        FUNC_LEAVE_INT(0);
+    }
+
+    for (i = 0; i < count; i += run)
+    {
+        current_transfer_funcs->read1byte(HandleDevice, &value);
+        current_transfer_funcs->read1byte(HandleDevice, &c);
+
+        run = c ? c : 0x100;
+        if (run > count - i)
+        {
+            DBG_ERROR((DBG_PREFIX "run of %u bytes beyond the end of the block", run));
+            FUNC_LEAVE_INT(1);
+        }
+        memset(&Buffer[i], value, run);
+    }
 
     FUNC_LEAVE_INT(0);
 }
@@ -231,6 +452,7 @@ libopencbmtransfer_read_write_mem(CBM_FILE HandleDevice, unsigned char DeviceAdd
                                   ll_read_write_mem function)
 {
     const static char monkey[]={",oO*^!:;"};// for fast moves
+    int error = 0;
 
     FUNC_ENTER();
 
@@ -245,26 +467,30 @@ libopencbmtransfer_read_write_mem(CBM_FILE HandleDevice, unsigned char DeviceAdd
         fflush(stderr);
 
                                                                         SETSTATEDEBUG(DebugBlockCount++);
-        function(HandleDevice, DeviceAddress, Buffer, MemoryAddress, 0x00);
+        error = function(HandleDevice, DeviceAddress, Buffer, MemoryAddress, 0x00);
+        if (error)
+        {
+            break;
+        }
 
         Buffer += 0x100;
         MemoryAddress += 0x100;
         Length -= 0x100;
     }
 
-    if (Length > 0)
+    if (!error && Length > 0)
     {
         unsigned int remainder = 0x100 - Length;
                                                                         SETSTATEDEBUG(DebugBlockCount++);
         //fprintf(stderr, "."); fflush(stderr);
         fprintf(stderr, "\010.");
         fflush(stderr);
-        function(HandleDevice, DeviceAddress, Buffer, MemoryAddress - remainder, remainder);
+        error = function(HandleDevice, DeviceAddress, Buffer, MemoryAddress - remainder, remainder);
     }
                                                                         SETSTATEDEBUG(DebugBlockCount = -1);
     fprintf(stderr, "\010.\n");  // fflush(stderr);
 
-    FUNC_LEAVE_INT(0);
+    FUNC_LEAVE_INT(error);
 }
 
 int
@@ -283,11 +509,226 @@ libopencbmtransfer_write_mem(CBM_FILE HandleDevice, unsigned char DeviceAddress,
                                   Buffer, MemoryAddress, Length, libopencbmtransfer_ll_write_mem);
 }
 
+/*! \brief Test if a memory range collides with the turbo routines */
+static int
+turbo_area_overlaps(unsigned int MemoryAddress, unsigned int Length)
+{
+    unsigned int end = MemoryAddress + Length;
+
+    return (MemoryAddress < TURBO_MAIN_START + TURBO_AREA_SIZE && end > TURBO_MAIN_START)
+        || (MemoryAddress < TURBO_TRANSFER_START + TURBO_AREA_SIZE && end > TURBO_TRANSFER_START);
+}
+
+/*! \brief Upload a program into the drive in two stages
+
+ This function uploads a program into the drive's memory. The
+ first stage installs the turbo routines with slow "M-W"
+ commands, unless they are already running in the drive. The
+ second stage transfers the program itself through them, with
+ the transfer type selected by libopencbmtransfer_set_transfer().
+
+ If a plain upload is cheaper or the only option, this function
+ falls back to cbm_upload(): that is the case if the program is
+ smaller than the turbo routines which would have to be
+ installed first, or if it overlaps the drive memory used by
+ them ($0500-$05FF and $0700-$07FF).
+
+ \param HandleDevice
+   A CBM_FILE which contains the file handle of the driver.
+
+ \param DeviceAddress
+   The address of the device on the IEC serial bus. This
+   is known as primary address, too.
+
+ \param MemoryAddress
+   The address in the drive's memory where the program is to be
+   stored.
+
+ \param Program
+   Pointer to a byte buffer which holds the program.
+
+ \param Length
+   The size of the program, in bytes.
+
+ \return
+   0 means the program has been uploaded successfully.
+   Every other value denotes an error.
+
+ If the turbo routines have been used, they are still running
+ in the drive after this function returns; call
+ libopencbmtransfer_remove() when done with them.
+*/
+int
+libopencbmtransfer_upload(CBM_FILE HandleDevice, unsigned char DeviceAddress,
+                          unsigned int MemoryAddress, const unsigned char Program[],
+                          unsigned int Length)
+{
+    int error = 0;
+
+    FUNC_ENTER();
+
+    if (turbo_area_overlaps(MemoryAddress, Length)
+        || (!turbo_installed && Length < 2 * TURBO_AREA_SIZE))
+    {
+        DBG_PRINT((DBG_PREFIX "uploading %u bytes with M-W", Length));
+
+        if (cbm_upload(HandleDevice, DeviceAddress, MemoryAddress, Program, Length) != (int) Length)
+        {
+            DBG_ERROR((DBG_PREFIX "cbm_upload failed."));
+            error = 1;
+        }
+    }
+    else
+    {
+        if (!turbo_installed)
+        {
+            error = libopencbmtransfer_install(HandleDevice, DeviceAddress);
+        }
+
+        if (!error)
+        {
+            error = libopencbmtransfer_write_mem(HandleDevice, DeviceAddress,
+                (unsigned char *) Program, MemoryAddress, Length);
+        }
+    }
+
+    FUNC_LEAVE_INT(error);
+}
+
+/*! \brief Download the drive's memory in two stages
+
+ This function reads a part of the drive's memory. Just as
+ libopencbmtransfer_upload(), it installs the turbo routines
+ first, unless they are already running in the drive, and reads
+ the memory through them.
+
+ It falls back to cbm_download() if the range is smaller than
+ the turbo routines which would have to be installed first, or
+ if it overlaps the drive memory used by them ($0500-$05FF and
+ $0700-$07FF), as that would return the turbo routines instead
+ of the original contents.
+
+ \param HandleDevice
+   A CBM_FILE which contains the file handle of the driver.
+
+ \param DeviceAddress
+   The address of the device on the IEC serial bus. This
+   is known as primary address, too.
+
+ \param MemoryAddress
+   The address in the drive's memory where to start reading.
+
+ \param Buffer
+   Pointer to a byte buffer which will hold the memory contents.
+
+ \param Length
+   The number of bytes to read.
+
+ \return
+   0 means the memory has been read successfully.
+   Every other value denotes an error.
+
+ If the turbo routines have been used, they are still running
+ in the drive after this function returns; call
+ libopencbmtransfer_remove() when done with them.
+*/
+int
+libopencbmtransfer_download(CBM_FILE HandleDevice, unsigned char DeviceAddress,
+                            unsigned int MemoryAddress, unsigned char Buffer[],
+                            unsigned int Length)
+{
+    int error = 0;
+
+    FUNC_ENTER();
+
+    if (turbo_area_overlaps(MemoryAddress, Length)
+        || (!turbo_installed && Length < 2 * TURBO_AREA_SIZE))
+    {
+        DBG_PRINT((DBG_PREFIX "downloading %u bytes with M-R", Length));
+
+        if (cbm_download(HandleDevice, DeviceAddress, MemoryAddress, Buffer, Length) != (int) Length)
+        {
+            DBG_ERROR((DBG_PREFIX "cbm_download failed."));
+            error = 1;
+        }
+    }
+    else
+    {
+        if (!turbo_installed)
+        {
+            error = libopencbmtransfer_install(HandleDevice, DeviceAddress);
+        }
+
+        if (!error)
+        {
+            error = libopencbmtransfer_read_mem(HandleDevice, DeviceAddress,
+                Buffer, MemoryAddress, Length);
+        }
+    }
+
+    FUNC_LEAVE_INT(error);
+}
+
+/*! \brief Remove the turbo routines from a drive
+
+ If the turbo routines are not running in the drive, e.g. because
+ libopencbmtransfer_upload() or libopencbmtransfer_download()
+ did not need them, there is nothing to remove, and the drive
+ is left alone.
+*/
 int
 libopencbmtransfer_remove(CBM_FILE HandleDevice, unsigned char DeviceAddress)
 {
+    if (!turbo_installed)
+    {
+        return 0;
+    }
+
+    turbo_installed = 0;
+
     // TODO: does not work with 1581, only with 1541/1571!
     // better: write a JMP to the RESET routine, and execute that
     return cbm_reset(HandleDevice);
 //    return libopencbmtransfer_execute_command(HandleDevice, DeviceAddress, 0xEBE7);
 }
+
+/*! \brief Leave the turbo routines resident in a drive
+
+ This function gives the drive back to the DOS, but leaves the
+ turbo routines in its memory. Unless the DOS uses the buffers
+ at $0500 and $0700 in the meantime, the next
+ libopencbmtransfer_install() - even of another process - finds
+ them there and does not need to upload them again.
+
+ In contrast to libopencbmtransfer_remove(), the bus is not
+ reset. If the turbo routines are not running in the drive,
+ nothing is done.
+
+ \param HandleDevice
+   A CBM_FILE which contains the file handle of the driver.
+
+ \param DeviceAddress
+   The address of the device on the IEC serial bus. This
+   is known as primary address, too.
+
+ \return
+   0 on success, every other value denotes an error.
+*/
+int
+libopencbmtransfer_detach(CBM_FILE HandleDevice, unsigned char DeviceAddress)
+{
+    int error;
+
+    if (!turbo_installed)
+    {
+        return 0;
+    }
+
+    turbo_installed = 0;
+
+    error = libopencbmtransfer_execute_command(HandleDevice, DeviceAddress, TURBO_QUIT);
+
+    cbm_iec_release(HandleDevice, IEC_ATN | IEC_CLOCK | IEC_DATA);
+
+    return error;
+}
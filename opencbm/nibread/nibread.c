@@ -0,0 +1,1149 @@
+/*
+ *  This program is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU General Public License
+ *  as published by the Free Software Foundation; either version
+ *  2 of the License, or (at your option) any later version.
+*/
+
+/*
+ * Read the raw GCR data of a whole disk in a 1541 with an XP1541
+ * parallel cable, and store it as NIB or G64 image; or write such
+ * an image back to a disk.
+ *
+ * The drive routine sends every track with the handshaked parallel
+ * burst transfer; cbm_parallel_burst_read_tracks() already sends the
+ * command for the next track while the current one is processed.
+ * On a write, cbm_parallel_burst_write_tracks() lets the next track
+ * be taken from the image while the current one is sent, so that
+ * only two tracks are in memory.
+ */
+
+#include "opencbm.h"
+
+#include <getopt.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "arch.h"
+#include "libmisc.h"
+
+static unsigned char nibread[] = {
+#include "nibread.inc"
+};
+
+/* the start address of the drive routine */
+#define NIBREAD_ADDRESS 0x0500
+
+/* the commands of the drive routine */
+#define CMD_QUIT  0x00
+#define CMD_READ  0x01
+#define CMD_WRITE 0x02
+
+/* the number of bytes the drive sends for every track */
+#define TRACK_LENGTH 0x2000
+
+/* the maximum number of halftracks which are read, 2 .. 85 */
+#define MAX_HALFTRACKS 84
+
+/* the raw bytes a G64 track may have at most */
+#define G64_TRACK_MAXLEN 7928
+
+/* the minimum length of a SYNC in a G64 track, in bytes */
+#define G64_SYNC_LENGTH 5
+
+/* the bytes compared to find the start of the next revolution */
+#define REVOLUTION_WINDOW 32
+
+/* the bytes of one revolution at 300 RPM, for every density */
+static const unsigned int track_capacity[4] = { 6250, 6666, 7142, 7692 };
+
+/* the 16 valid 5 bit GCR codes */
+static const unsigned char gcr_codes[16] = {
+    0x0a, 0x0b, 0x12, 0x13, 0x0e, 0x0f, 0x16, 0x17,
+    0x09, 0x19, 0x1a, 0x1b, 0x0d, 0x1d, 0x1e, 0x15
+};
+
+/* the number of invalid GCR codes in every 10 bit pair of codes */
+static unsigned char gcr_bad_pair[1024];
+
+/* != 0 if one of the 4 bytes of the 32 bit word _w is $FF */
+#define HAS_FF(_w) ((~(_w) - 0x01010101u) & (_w) & 0x80808080u)
+
+static CBM_FILE fd_cbm;
+
+/* set by the CTRL-C handler to stop after the current track */
+static volatile int stop = 0;
+
+typedef struct
+{
+    int quiet;
+    unsigned int count;
+    unsigned char halftrack[MAX_HALFTRACKS];
+    unsigned char density[MAX_HALFTRACKS];
+    unsigned char command[MAX_HALFTRACKS][3];
+    unsigned char *data;
+    cbm_parallel_burst_track_t tracks[MAX_HALFTRACKS];
+} disk_t;
+
+/* an image which is written to a disk, one track after the other */
+typedef struct
+{
+    FILE *f;
+    int g64;
+    int quiet;
+    int error;
+    unsigned int count;
+    unsigned int shortened;
+    unsigned char halftrack[MAX_HALFTRACKS];
+    unsigned char density[MAX_HALFTRACKS];
+    unsigned long offset[MAX_HALFTRACKS];
+    unsigned char raw[TRACK_LENGTH];
+    unsigned char command[2][5];
+    unsigned char buffer[2][G64_TRACK_MAXLEN];
+    cbm_parallel_burst_track_t tracks[MAX_HALFTRACKS];
+} image_t;
+
+typedef struct
+{
+    unsigned int syncs;     /* the SYNCs in one revolution */
+    unsigned int length;    /* the bytes of one revolution, SYNCs restored */
+    unsigned int bad_gcr;   /* the GCR codes which are not valid */
+    unsigned char density;  /* the density which fits length best */
+    int exact;              /* the revolution has been found in the data */
+} track_analysis_t;
+
+static void help()
+{
+    printf(
+"Usage: nibread [OPTION]... DRIVE FILE\n"
+"       nibread -a FILE\n"
+"       nibread -w [OPTION]... DRIVE FILE\n"
+"Read the raw GCR data of a disk into a NIB or G64 image, or write\n"
+"such an image to a disk (XP1541 cable only)\n"
+"\n"
+"  -h, --help                 display this help and exit\n"
+"  -V, --version              display version information and exit\n"
+"  -@, --adapter=plugin:bus   tell OpenCBM which backend plugin and bus to use\n"
+"\n"
+"  -b, --begin-track=TRACK    set start track (1 <= start <= end, default 1)\n"
+"  -e, --end-track=TRACK      set end track (start <= end <= 42, default 35;\n"
+"                             on a write, the last track of the image)\n"
+"  -x, --extended             read a 40 track disk\n"
+"  -H, --halftracks           read the halftracks, too; on a write, write\n"
+"                             the halftracks of the image, too\n"
+"  -d, --density=DENSITY      read all tracks with this density (0..3)\n"
+"                             instead of the speed zone of the track\n"
+"  -f, --format=FORMAT        image format: `nib' or `g64'; by default,\n"
+"                             `g64' if FILE ends with .g64, `nib' otherwise\n"
+"  -q, --quiet                do not display progress information\n"
+"  -a, --analyze              display the SYNCs, the density and the GCR\n"
+"                             errors of every track; without DRIVE, of the\n"
+"                             tracks in the NIB image FILE\n"
+"  -w, --write                write the tracks of the NIB or G64 image FILE\n"
+"                             to the disk in DRIVE\n"
+"\n"
+);
+}
+
+static void hint(char *s)
+{
+    fprintf(stderr, "Try `%s' -h for more information.\n", s);
+}
+
+static void ARCH_SIGNALDECL
+handle_CTRL_C(int dummy)
+{
+    /*
+     * do not reset the bus while a track is transferred,
+     * let the drive finish it and return to the DOS instead
+     */
+    stop = 1;
+}
+
+/* the density of the speed zone of a track */
+static unsigned char
+zone_density(unsigned int track)
+{
+    if (track < 18)
+        return 3;
+    if (track < 25)
+        return 2;
+    if (track < 31)
+        return 1;
+    return 0;
+}
+
+static int CBMAPIDECL
+track_read(void *Context, cbm_parallel_burst_track_t *Track, unsigned int Index)
+{
+    disk_t *disk = Context;
+
+    (void) Track;
+
+    if (!disk->quiet)
+    {
+        unsigned int halftrack = disk->halftrack[Index];
+
+        printf("\rtrack %2u%s (density %u) %3u%%", halftrack / 2,
+            (halftrack & 1) ? ".5" : "  ", disk->density[Index],
+            (Index + 1) * 100 / disk->count);
+        fflush(stdout);
+    }
+
+    return stop;
+}
+
+/*
+ * Find one revolution in the raw data of a track: it starts with
+ * the first byte after a SYNC, and ends where the same bytes show up
+ * again. Returns 0 if there is no SYNC at all, that is, the track is
+ * not formatted; 2 if the bytes do not show up again, and the length
+ * is only estimated; 1 otherwise.
+ */
+static int
+find_revolution(const unsigned char *raw, unsigned int density,
+                unsigned int *start, unsigned int *length)
+{
+    unsigned int capacity = track_capacity[density];
+    unsigned int s, p, min, max;
+
+    for (s = 1; s < TRACK_LENGTH; s++)
+    {
+        if (raw[s - 1] == 0xff && raw[s] != 0xff)
+            break;
+    }
+    if (s >= TRACK_LENGTH)
+        return 0;
+
+    /* the drive skips most of every SYNC, and may run fast or slow */
+    min = capacity * 85 / 100;
+    max = capacity * 105 / 100;
+    if (max > TRACK_LENGTH - REVOLUTION_WINDOW - s)
+        max = TRACK_LENGTH - REVOLUTION_WINDOW - s;
+
+    *start = s;
+
+    for (p = min; p <= max; p++)
+    {
+        if (memcmp(raw + s, raw + s + p, REVOLUTION_WINDOW) == 0)
+        {
+            *length = p;
+            return 1;
+        }
+    }
+
+    /* no repetition found, take what should fit */
+    *length = TRACK_LENGTH - s < capacity ? TRACK_LENGTH - s : capacity;
+    return 2;
+}
+
+/*
+ * Count the SYNCs, that is, the runs of $FF bytes, and the bytes
+ * missing to make every one of them G64_SYNC_LENGTH long. Outside
+ * of a SYNC, 4 bytes are tested at once.
+ */
+static void
+scan_syncs(const unsigned char *raw, unsigned int length,
+           unsigned int *syncs, unsigned int *missing)
+{
+    unsigned int i = 0, run = 0;
+
+    *syncs = 0;
+    *missing = 0;
+
+    while (i < length)
+    {
+        if (run == 0 && i + 4 <= length)
+        {
+            unsigned int w;
+
+            memcpy(&w, raw + i, 4);
+            if (!HAS_FF(w))
+            {
+                i += 4;
+                continue;
+            }
+        }
+
+        if (raw[i] == 0xff)
+        {
+            run++;
+        }
+        else if (run > 0)
+        {
+            (*syncs)++;
+            if (run < G64_SYNC_LENGTH)
+                *missing += G64_SYNC_LENGTH - run;
+            run = 0;
+        }
+        i++;
+    }
+
+    if (run > 0)
+    {
+        (*syncs)++;
+        if (run < G64_SYNC_LENGTH)
+            *missing += G64_SYNC_LENGTH - run;
+    }
+}
+
+static void
+gcr_init(void)
+{
+    static int done = 0;
+    unsigned char valid[32];
+    unsigned int i;
+
+    if (done)
+        return;
+
+    memset(valid, 0, sizeof(valid));
+    for (i = 0; i < sizeof(gcr_codes); i++)
+        valid[gcr_codes[i]] = 1;
+
+    for (i = 0; i < 1024; i++)
+        gcr_bad_pair[i] = (unsigned char) (!valid[i >> 5] + !valid[i & 0x1f]);
+
+    done = 1;
+}
+
+/*
+ * Count the GCR codes which are not valid. The bytes after a SYNC
+ * are aligned; they are checked two codes at a time, up to the byte
+ * before the next SYNC, which already holds some of its bits.
+ */
+static unsigned int
+count_bad_gcr(const unsigned char *raw, unsigned int length)
+{
+    unsigned int i, acc = 0, bits = 0, bad = 0;
+
+    gcr_init();
+
+    for (i = 0; i + 1 < length; i++)
+    {
+        if (raw[i] == 0xff || raw[i + 1] == 0xff)
+        {
+            bits = 0;
+            continue;
+        }
+
+        acc = (acc << 8) | raw[i];
+        bits += 8;
+        if (bits >= 10)
+        {
+            bits -= 10;
+            bad += gcr_bad_pair[(acc >> bits) & 0x3ff];
+        }
+    }
+
+    return bad;
+}
+
+static unsigned int
+distance(unsigned int a, unsigned int b)
+{
+    return a > b ? a - b : b - a;
+}
+
+/* analyze one revolution of a track; returns 0 if it has no SYNC */
+static int
+analyze_track(const unsigned char *raw, unsigned int density, track_analysis_t *analysis)
+{
+    unsigned int start, length, missing, d;
+    int found;
+
+    memset(analysis, 0, sizeof(*analysis));
+
+    found = find_revolution(raw, density, &start, &length);
+    if (!found)
+        return 0;
+
+    scan_syncs(raw + start, length, &analysis->syncs, &missing);
+
+    analysis->exact = found == 1;
+    analysis->length = length + missing;
+    analysis->bad_gcr = count_bad_gcr(raw + start, length);
+
+    for (d = 1; d < 4; d++)
+    {
+        if (distance(analysis->length, track_capacity[d])
+            < distance(analysis->length, track_capacity[analysis->density]))
+            analysis->density = (unsigned char) d;
+    }
+
+    return 1;
+}
+
+static void
+print_analysis(const disk_t *disk)
+{
+    track_analysis_t analysis;
+    unsigned int i;
+    int estimated = 0, other_density = 0;
+
+    printf("track%7s  %6s  %7s  %10s\n", "syncs", "length", "density", "GCR errors");
+
+    for (i = 0; i < disk->count; i++)
+    {
+        unsigned int halftrack = disk->halftrack[i];
+
+        printf("%2u%s ", halftrack / 2, (halftrack & 1) ? ".5" : "  ");
+
+        if (!analyze_track(disk->data + i * TRACK_LENGTH, disk->density[i], &analysis))
+        {
+            printf("%7u  %5s   %6s   %10s  (no SYNC)\n", 0, "-", "-", "-");
+            continue;
+        }
+
+        printf("%7u  %5u%c  %6u%c  %10u\n", analysis.syncs, analysis.length,
+            analysis.exact ? ' ' : '?', analysis.density,
+            analysis.density != disk->density[i] ? '*' : ' ', analysis.bad_gcr);
+
+        estimated |= !analysis.exact;
+        other_density |= analysis.density != disk->density[i];
+    }
+
+    if (estimated)
+        printf("?: no revolution found in the data, the length is estimated\n");
+    if (other_density)
+        printf("*: the length fits this density, not the one the track was read with\n");
+}
+
+/*
+ * Make a G64 track from one revolution. Every run of $FF bytes is
+ * taken as SYNC, and is made as long as it has been on the disk at
+ * least, as the drive only sends the first byte of it.
+ */
+static unsigned int
+make_g64_track(const unsigned char *raw, unsigned int length, unsigned char *out)
+{
+    unsigned int i, n = 0, run = 0;
+
+    for (i = 0; i <= length; i++)
+    {
+        if (i < length && raw[i] == 0xff)
+        {
+            run++;
+        }
+        else
+        {
+            while (run > 0 && run < G64_SYNC_LENGTH && n < G64_TRACK_MAXLEN)
+            {
+                out[n++] = 0xff;
+                run++;
+            }
+            run = 0;
+        }
+
+        if (i < length && n < G64_TRACK_MAXLEN)
+            out[n++] = raw[i];
+    }
+
+    return n;
+}
+
+static void
+put_le32(unsigned char *p, unsigned long value)
+{
+    p[0] = (unsigned char) value;
+    p[1] = (unsigned char) (value >> 8);
+    p[2] = (unsigned char) (value >> 16);
+    p[3] = (unsigned char) (value >> 24);
+}
+
+/*
+ * NIB: a header of 0x100 bytes, "MNIB-1541-RAW" and the version 3,
+ * followed by the halftrack and the density of every track from 0x10
+ * on; then the raw data of the tracks, TRACK_LENGTH bytes each.
+ */
+static int
+write_nib(FILE *f, const disk_t *disk)
+{
+    unsigned char header[0x100];
+    unsigned int i;
+
+    memset(header, 0, sizeof(header));
+    memcpy(header, "MNIB-1541-RAW", 13);
+    header[13] = 3;
+
+    for (i = 0; i < disk->count; i++)
+    {
+        header[0x10 + 2 * i] = disk->halftrack[i];
+        header[0x11 + 2 * i] = disk->density[i];
+    }
+
+    if (fwrite(header, sizeof(header), 1, f) != 1)
+        return 1;
+
+    if (fwrite(disk->data, TRACK_LENGTH, disk->count, f) != disk->count)
+        return 1;
+
+    return 0;
+}
+
+/*
+ * G64: the signature "GCR-1541", the version 0, the number of
+ * halftracks and the maximum track size, followed by the offsets of
+ * the tracks and their speed zones. Every track is stored with its
+ * length, and padded to the maximum track size.
+ */
+static int
+write_g64(FILE *f, const disk_t *disk, int quiet)
+{
+    unsigned char header[12 + MAX_HALFTRACKS * 8];
+    unsigned char track[2 + G64_TRACK_MAXLEN];
+    unsigned long offset = sizeof(header);
+    unsigned int i, start, length, unformatted = 0;
+
+    memset(header, 0, sizeof(header));
+    memcpy(header, "GCR-1541", 8);
+    header[8] = 0;
+    header[9] = MAX_HALFTRACKS;
+    header[10] = G64_TRACK_MAXLEN & 0xff;
+    header[11] = G64_TRACK_MAXLEN >> 8;
+
+    for (i = 0; i < disk->count; i++)
+    {
+        unsigned int index = disk->halftrack[i] - 2;
+
+        if (!find_revolution(disk->data + i * TRACK_LENGTH, disk->density[i], &start, &length))
+        {
+            unformatted++;
+            continue;
+        }
+
+        put_le32(&header[12 + index * 4], offset);
+        put_le32(&header[12 + MAX_HALFTRACKS * 4 + index * 4], disk->density[i]);
+        offset += sizeof(track);
+    }
+
+    if (fwrite(header, sizeof(header), 1, f) != 1)
+        return 1;
+
+    for (i = 0; i < disk->count; i++)
+    {
+        const unsigned char *raw = disk->data + i * TRACK_LENGTH;
+
+        if (!find_revolution(raw, disk->density[i], &start, &length))
+            continue;
+
+        memset(track, 0x55, sizeof(track));
+        length = make_g64_track(raw + start, length, &track[2]);
+        track[0] = length & 0xff;
+        track[1] = length >> 8;
+
+        if (fwrite(track, sizeof(track), 1, f) != 1)
+            return 1;
+    }
+
+    if (unformatted && !quiet)
+        printf("%u track(s) without SYNC, not stored\n", unformatted);
+
+    return 0;
+}
+
+/* load a NIB image, as written by write_nib() */
+static int
+read_nib(const char *filename, disk_t *disk)
+{
+    unsigned char header[0x100];
+    FILE *f;
+    int rv = 1;
+
+    f = fopen(filename, "rb");
+    if (f == NULL)
+    {
+        arch_error(0, arch_get_errno(), "could not open %s", filename);
+        return 1;
+    }
+
+    do
+    {
+        if (fread(header, sizeof(header), 1, f) != 1
+            || memcmp(header, "MNIB-1541-RAW", 13) != 0)
+        {
+            fprintf(stderr, "%s is no NIB image\n", filename);
+            break;
+        }
+
+        while (disk->count < MAX_HALFTRACKS && header[0x10 + 2 * disk->count] != 0)
+        {
+            disk->halftrack[disk->count] = header[0x10 + 2 * disk->count];
+            disk->density[disk->count] = header[0x11 + 2 * disk->count] & 3;
+            disk->count++;
+        }
+
+        if (disk->count == 0)
+        {
+            fprintf(stderr, "%s holds no tracks\n", filename);
+            break;
+        }
+
+        disk->data = malloc(disk->count * TRACK_LENGTH);
+        if (disk->data == NULL)
+        {
+            fprintf(stderr, "Not enough memory\n");
+            break;
+        }
+
+        if (fread(disk->data, TRACK_LENGTH, disk->count, f) != disk->count)
+        {
+            fprintf(stderr, "%s is too short\n", filename);
+            break;
+        }
+
+        rv = 0;
+
+    } while (0);
+
+    fclose(f);
+    return rv;
+}
+
+static unsigned long
+get_le32(const unsigned char *p)
+{
+    return p[0] | ((unsigned long) p[1] << 8)
+        | ((unsigned long) p[2] << 16) | ((unsigned long) p[3] << 24);
+}
+
+/*
+ * Open a NIB or G64 image for writing it to a disk, and find the
+ * tracks from begintrack to endtrack in it; the data of the tracks
+ * is read by track_write() when they are written.
+ */
+static int
+open_image(const char *filename, image_t *image, unsigned char begintrack,
+           unsigned char endtrack, int halftracks)
+{
+    unsigned char header[12 + MAX_HALFTRACKS * 8];
+    unsigned int i, n, ht;
+
+    image->f = fopen(filename, "rb");
+    if (image->f == NULL)
+    {
+        arch_error(0, arch_get_errno(), "could not open %s", filename);
+        return 1;
+    }
+
+    if (fread(header, 12, 1, image->f) != 1)
+    {
+        fprintf(stderr, "%s is no NIB or G64 image\n", filename);
+        return 1;
+    }
+
+    if (memcmp(header, "GCR-1541", 8) == 0)
+    {
+        image->g64 = 1;
+        n = header[9] < MAX_HALFTRACKS ? header[9] : MAX_HALFTRACKS;
+
+        if (fread(&header[12], 8, header[9], image->f) != header[9])
+        {
+            fprintf(stderr, "%s is too short\n", filename);
+            return 1;
+        }
+
+        for (i = 0; i < n; i++)
+        {
+            unsigned long offset = get_le32(&header[12 + i * 4]);
+            unsigned long speed = get_le32(&header[12 + header[9] * 4 + i * 4]);
+
+            ht = i + 2;
+            if (offset == 0 || ht < begintrack * 2u || ht > endtrack * 2u
+                || ((ht & 1) && !halftracks))
+                continue;
+
+            image->halftrack[image->count] = (unsigned char) ht;
+            /* a speed zone map is not supported, take the zone of the track */
+            image->density[image->count] = (unsigned char) (speed < 4 ? speed : zone_density(ht / 2));
+            image->offset[image->count] = offset;
+            image->count++;
+        }
+    }
+    else if (memcmp(header, "MNIB-1541-RAW", 13) == 0)
+    {
+        image->g64 = 0;
+
+        if (fread(&header[12], 0x100 - 12, 1, image->f) != 1)
+        {
+            fprintf(stderr, "%s is too short\n", filename);
+            return 1;
+        }
+
+        for (i = 0; i < MAX_HALFTRACKS && header[0x10 + 2 * i] != 0; i++)
+        {
+            ht = header[0x10 + 2 * i];
+            if (ht < begintrack * 2u || ht > endtrack * 2u || ((ht & 1) && !halftracks))
+                continue;
+
+            image->halftrack[image->count] = (unsigned char) ht;
+            image->density[image->count] = header[0x11 + 2 * i] & 3;
+            image->offset[image->count] = 0x100 + (unsigned long) i * TRACK_LENGTH;
+            image->count++;
+        }
+    }
+    else
+    {
+        fprintf(stderr, "%s is no NIB or G64 image\n", filename);
+        return 1;
+    }
+
+    if (image->count == 0)
+    {
+        fprintf(stderr, "%s holds none of these tracks\n", filename);
+        return 1;
+    }
+
+    return 0;
+}
+
+/*
+ * Fill in the next track to be written: cbm_parallel_burst_write_tracks()
+ * calls this while the track before is still sent, so the two buffers
+ * of the image are used in turn. Every track is written as one
+ * revolution at 300 RPM: a longer one is cut, a shorter one is padded
+ * with gap bytes, so that nothing of the old track is left.
+ */
+static int CBMAPIDECL
+track_write(void *Context, cbm_parallel_burst_track_t *Track, unsigned int Index)
+{
+    image_t *image = Context;
+    unsigned char *out = image->buffer[Index & 1];
+    unsigned char *command = image->command[Index & 1];
+    unsigned int capacity = track_capacity[image->density[Index]];
+    unsigned int start, length = 0;
+
+    if (stop)
+        return 1;
+
+    if (!image->quiet)
+    {
+        unsigned int halftrack = image->halftrack[Index];
+
+        printf("\rtrack %2u%s (density %u) %3u%%", halftrack / 2,
+            (halftrack & 1) ? ".5" : "  ", image->density[Index],
+            Index * 100 / image->count);
+        fflush(stdout);
+    }
+
+    if (fseek(image->f, image->offset[Index], SEEK_SET) != 0)
+    {
+        image->error = 1;
+        return 1;
+    }
+
+    if (image->g64)
+    {
+        unsigned char size[2];
+
+        if (fread(size, sizeof(size), 1, image->f) != 1)
+        {
+            image->error = 1;
+            return 1;
+        }
+
+        length = size[0] | (size[1] << 8);
+        if (length > G64_TRACK_MAXLEN
+            || (length > 0 && fread(out, length, 1, image->f) != 1))
+        {
+            image->error = 1;
+            return 1;
+        }
+    }
+    else
+    {
+        if (fread(image->raw, TRACK_LENGTH, 1, image->f) != 1)
+        {
+            image->error = 1;
+            return 1;
+        }
+
+        /* a track without SYNC is erased with gap bytes */
+        if (find_revolution(image->raw, image->density[Index], &start, &length))
+            length = make_g64_track(image->raw + start, length, out);
+        else
+            length = 0;
+    }
+
+    if (length > capacity)
+    {
+        length = capacity;
+        image->shortened++;
+    }
+    memset(out + length, 0x55, capacity - length);
+
+    /* every capacity is even; count the pairs as the drive routine does */
+    command[0] = CMD_WRITE;
+    command[1] = image->halftrack[Index];
+    command[2] = image->density[Index];
+    command[3] = (unsigned char) ((capacity / 2) & 0xff);
+    command[4] = (unsigned char) ((capacity / 2 + 0xff) >> 8);
+
+    Track->command = command;
+    Track->command_length = sizeof(image->command[0]);
+    Track->buffer = out;
+    Track->length = capacity;
+
+    return 0;
+}
+
+int ARCH_MAINDECL main(int argc, char *argv[])
+{
+    unsigned char drive, begintrack = 1, endtrack = 0;
+    int halftracks = 0, density = -1, quiet = 0, g64 = -1, analyze = 0, write = 0;
+    char *adapter = NULL, *arg, *filename;
+    enum cbm_device_type_e device_type;
+    enum cbm_cable_type_e cable_type;
+    unsigned char quit = CMD_QUIT;
+    char status[40];
+    disk_t disk;
+    image_t *image = NULL;
+    unsigned int i, ht;
+    int option, rv = 1, count;
+    FILE *f;
+
+    struct option longopts[] =
+    {
+        { "help"       , no_argument      , NULL, 'h' },
+        { "version"    , no_argument      , NULL, 'V' },
+        { "adapter"    , required_argument, NULL, '@' },
+        { "begin-track", required_argument, NULL, 'b' },
+        { "end-track"  , required_argument, NULL, 'e' },
+        { "extended"   , no_argument      , NULL, 'x' },
+        { "halftracks" , no_argument      , NULL, 'H' },
+        { "density"    , required_argument, NULL, 'd' },
+        { "format"     , required_argument, NULL, 'f' },
+        { "quiet"      , no_argument      , NULL, 'q' },
+        { "analyze"    , no_argument      , NULL, 'a' },
+        { "write"      , no_argument      , NULL, 'w' },
+        { NULL         , 0                , NULL, 0   }
+    };
+
+    const char shortopts[] ="hV@:b:e:xHd:f:qaw";
+
+    while((option = getopt_long(argc, argv, shortopts, longopts, NULL)) != -1)
+    {
+        switch(option)
+        {
+            case 'h': help();
+                      return 0;
+            case 'V': printf("nibread %s\n", OPENCBM_VERSION);
+                      return 0;
+            case 'b': begintrack = arch_atoc(optarg);
+                      break;
+            case 'e': endtrack = arch_atoc(optarg);
+                      break;
+            case 'x': endtrack = 40;
+                      break;
+            case 'H': halftracks = 1;
+                      break;
+            case 'd': density = atoi(optarg);
+                      if (density < 0 || density > 3)
+                      {
+                          fprintf(stderr, "Invalid density (%s)\n", optarg);
+                          return 1;
+                      }
+                      break;
+            case 'f': if (arch_strcasecmp(optarg, "nib") == 0)
+                          g64 = 0;
+                      else if (arch_strcasecmp(optarg, "g64") == 0)
+                          g64 = 1;
+                      else
+                      {
+                          fprintf(stderr, "Unknown image format (%s)\n", optarg);
+                          hint(argv[0]);
+                          return 1;
+                      }
+                      break;
+            case 'q': quiet = 1;
+                      break;
+            case 'a': analyze = 1;
+                      break;
+            case 'w': write = 1;
+                      break;
+            case '@': if (adapter == NULL)
+                          adapter = cbmlibmisc_strdup(optarg);
+                      else
+                      {
+                          fprintf(stderr, "--adapter/-@ given more than once.");
+                          hint(argv[0]);
+                          return 1;
+                      }
+                      break;
+            default : hint(argv[0]);
+                      return 1;
+        }
+    }
+
+    memset(&disk, 0, sizeof(disk));
+    disk.quiet = quiet;
+
+    if(analyze && write)
+    {
+        fprintf(stderr, "--analyze/-a and --write/-w cannot be given together\n");
+        hint(argv[0]);
+        return 1;
+    }
+
+    if(analyze && optind + 1 == argc)
+    {
+        if(read_nib(argv[optind], &disk) == 0)
+        {
+            print_analysis(&disk);
+            rv = 0;
+        }
+        free(disk.data);
+        return rv;
+    }
+
+    if(optind + 2 != argc)
+    {
+        fprintf(stderr, "Usage: %s [OPTION]... DRIVE FILE\n", argv[0]);
+        hint(argv[0]);
+        return 1;
+    }
+
+    arg = argv[optind++];
+    drive = arch_atoc(arg);
+    if(drive < 8 || drive > 11)
+    {
+        fprintf(stderr, "Invalid drive number (%s)\n", arg);
+        return 1;
+    }
+
+    filename = argv[optind++];
+
+    if(endtrack == 0)
+        endtrack = write ? 42 : 35;
+
+    if(begintrack < 1 || begintrack > endtrack || endtrack > 42)
+    {
+        fprintf(stderr, "Invalid track range (%u - %u)\n", begintrack, endtrack);
+        return 1;
+    }
+
+    if(write)
+    {
+        image = calloc(1, sizeof(*image));
+        if(image == NULL)
+        {
+            fprintf(stderr, "Not enough memory\n");
+            return 1;
+        }
+        image->quiet = quiet;
+
+        if(open_image(filename, image, begintrack, endtrack, halftracks) != 0)
+        {
+            if(image->f)
+                fclose(image->f);
+            free(image);
+            return 1;
+        }
+    }
+
+    if(g64 < 0)
+    {
+        size_t len = strlen(filename);
+        g64 = len > 4 && arch_strcasecmp(filename + len - 4, ".g64") == 0;
+    }
+
+    for(ht = begintrack * 2; !write && ht <= endtrack * 2u; ht += halftracks ? 1 : 2)
+    {
+        disk.halftrack[disk.count] = (unsigned char) ht;
+        disk.density[disk.count] = (unsigned char) (density < 0 ? zone_density(ht / 2) : density);
+        disk.count++;
+    }
+
+    if(!write)
+    {
+        disk.data = malloc(disk.count * TRACK_LENGTH);
+        if(disk.data == NULL)
+        {
+            fprintf(stderr, "Not enough memory\n");
+            return 1;
+        }
+    }
+
+    for(i = 0; i < disk.count; i++)
+    {
+        disk.command[i][0] = CMD_READ;
+        disk.command[i][1] = disk.halftrack[i];
+        disk.command[i][2] = disk.density[i];
+
+        disk.tracks[i].command = disk.command[i];
+        disk.tracks[i].command_length = sizeof(disk.command[i]);
+        disk.tracks[i].buffer = disk.data + i * TRACK_LENGTH;
+        disk.tracks[i].length = TRACK_LENGTH;
+    }
+
+    if(cbm_driver_open_ex(&fd_cbm, adapter) != 0)
+    {
+        arch_error(0, arch_get_errno(), "%s", cbm_get_driver_name_ex(adapter));
+        cbmlibmisc_strfree(adapter);
+        free(disk.data);
+        if(image)
+        {
+            fclose(image->f);
+            free(image);
+        }
+        return 1;
+    }
+
+    do
+    {
+        if(cbm_identify(fd_cbm, drive, &device_type, NULL) != 0
+           || device_type != cbm_dt_cbm1541)
+        {
+            fprintf(stderr, "Drive %u is not a 1541\n", drive);
+            break;
+        }
+
+        if(cbm_identify_xp1541(fd_cbm, drive, &device_type, &cable_type) != 0
+           || cable_type != cbm_ct_xp1541)
+        {
+            fprintf(stderr, "Drive %u has no XP1541 parallel cable\n", drive);
+            break;
+        }
+
+        /*
+         * the drive routine steps from the track the DOS is on;
+         * reading the status waits until the initialisation is done.
+         * An error here is not fatal, the disk need not have a BAM.
+         */
+        cbm_exec_command(fd_cbm, drive, "I0", 2);
+        cbm_device_status(fd_cbm, drive, status, sizeof(status));
+
+        if(cbm_upload(fd_cbm, drive, NIBREAD_ADDRESS, nibread, sizeof(nibread))
+           != (int) sizeof(nibread))
+        {
+            fprintf(stderr, "Could not upload the drive routine\n");
+            break;
+        }
+
+        if(cbm_exec_command(fd_cbm, drive, "M-E" "\x00" "\x05", 5) != 0)
+        {
+            fprintf(stderr, "Could not start the drive routine\n");
+            break;
+        }
+
+        arch_set_ctrlbreak_handler(handle_CTRL_C);
+
+        if(write)
+        {
+            count = cbm_parallel_burst_write_tracks(fd_cbm, image->tracks, image->count,
+                                                    track_write, image);
+
+            if(!quiet && count == (int) image->count)
+                printf("\rtrack %2u%s (density %u) 100%%",
+                    image->halftrack[count - 1] / 2,
+                    (image->halftrack[count - 1] & 1) ? ".5" : "  ",
+                    image->density[count - 1]);
+            if(!quiet)
+                printf("\n");
+
+            cbm_parallel_burst_write(fd_cbm, quit);
+
+            if(count < 0)
+            {
+                fprintf(stderr, "Could not write the tracks with the parallel burst transfer\n");
+                break;
+            }
+
+            if(image->error)
+            {
+                fprintf(stderr, "Could not read %s, %d track(s) written\n", filename, count);
+                break;
+            }
+
+            if(stop)
+            {
+                fprintf(stderr, "Interrupted, %d track(s) written\n", count);
+                break;
+            }
+
+            /* the first track which has not been written is the one which failed */
+            if((unsigned int) count < image->count)
+            {
+                fprintf(stderr, "Could not write track %u%s\n", image->halftrack[count] / 2,
+                    (image->halftrack[count] & 1) ? ".5" : "");
+                break;
+            }
+
+            if(image->shortened && !quiet)
+                printf("%u track(s) longer than one revolution, shortened\n", image->shortened);
+
+            rv = 0;
+            break;
+        }
+
+        count = cbm_parallel_burst_read_tracks(fd_cbm, disk.tracks, disk.count, track_read, &disk);
+
+        if(!quiet)
+            printf("\n");
+
+        /* even after an error, the drive may still wait for a command */
+        cbm_parallel_burst_write(fd_cbm, quit);
+
+        if(count < 0)
+        {
+            fprintf(stderr, "Could not read the tracks with the parallel burst transfer\n");
+            break;
+        }
+
+        for(i = 0; i < (unsigned int) count; i++)
+        {
+            if(disk.tracks[i].result <= 0)
+            {
+                fprintf(stderr, "Could not read track %u%s\n", disk.halftrack[i] / 2,
+                    (disk.halftrack[i] & 1) ? ".5" : "");
+                break;
+            }
+        }
+        if(i < (unsigned int) count)
+            break;
+
+        if(stop || (unsigned int) count < disk.count)
+        {
+            fprintf(stderr, "Interrupted, %s not written\n", filename);
+            break;
+        }
+
+        f = fopen(filename, "wb");
+        if(f == NULL)
+        {
+            arch_error(0, arch_get_errno(), "could not open %s", filename);
+            break;
+        }
+
+        if((g64 ? write_g64(f, &disk, quiet) : write_nib(f, &disk)) != 0)
+        {
+            arch_error(0, arch_get_errno(), "could not write %s", filename);
+            fclose(f);
+            break;
+        }
+
+        if(fclose(f) != 0)
+        {
+            arch_error(0, arch_get_errno(), "could not write %s", filename);
+            break;
+        }
+
+        if(analyze)
+            print_analysis(&disk);
+
+        rv = 0;
+
+    } while (0);
+
+    cbm_driver_close(fd_cbm);
+    cbmlibmisc_strfree(adapter);
+    free(disk.data);
+    if(image)
+    {
+        fclose(image->f);
+        free(image);
+    }
+
+    return rv;
+}
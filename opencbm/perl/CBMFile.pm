@@ -52,10 +52,8 @@ sub READ {
     my $self   = shift;
     my $bufref = \$_[0];
     my $len    = $_[1];
-    OpenCBM::Talk( $self->{DEV}, $self->{SA} );
-    my $l = sysread ( OpenCBM::CBM_FD, $$bufref, $len );
-    OpenCBM::Untalk();
-    return $l;
+    my $offset = $_[2];
+    return OpenCBM::ReadBuffer( $self->{DEV}, $self->{SA}, $bufref, $len, $offset );
 }
 
 sub READLINE {
@@ -71,12 +69,9 @@ sub READLINE {
 }
 
 sub WRITE {
-    my $self  = shift;
-    my $r;
-    OpenCBM::Listen( $self->{DEV}, $self->{SA} );
-    $r = syswrite OpenCBM::CBM_FD, @_;
-    OpenCBM::Unlisten();
-    return $r;
+    my $self   = shift;
+    my $bufref = \$_[0];
+    return OpenCBM::WriteBuffer( $self->{DEV}, $self->{SA}, $bufref, $_[1], $_[2] );
 }
 
 sub PRINT {
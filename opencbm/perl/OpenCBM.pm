@@ -86,4 +86,105 @@ sub Reset()
     ioctl(CBM_FD, $CBMCTRL_RESET, 0);
 }
 
+# Bulk transfers: the data is read into or written from the scalar
+# referenced by $bufref in place, starting at $offset (default 0), so
+# that large buffers are not copied. One Talk or Listen is sent for
+# the whole buffer. The number of bytes transferred is returned, undef
+# on an error.
+
+sub ReadBuffer($$$$;$)
+{
+    my ($dev, $sa, $bufref, $len, $offset) = @_;
+    my $total = 0;
+    my $l = 0;
+
+    $offset = 0 unless defined $offset;
+
+    Talk($dev, $sa);
+    while($total < $len &&
+          ($l = sysread(CBM_FD, $$bufref, $len - $total, $offset + $total)))
+    {
+        $total += $l;
+        last if $total < $len;  # a short read ends with EOI
+    }
+    Untalk();
+    return defined($l) ? $total : undef;
+}
+
+sub WriteBuffer($$$;$$)
+{
+    my ($dev, $sa, $bufref, $len, $offset) = @_;
+    my $total = 0;
+    my $l = 0;
+
+    $offset = 0 unless defined $offset;
+    $len = length($$bufref) - $offset unless defined $len;
+
+    Listen($dev, $sa);
+    while($total < $len &&
+          ($l = syswrite(CBM_FD, $$bufref, $len - $total, $offset + $total)))
+    {
+        $total += $l;
+    }
+    Unlisten();
+    return defined($l) ? $total : undef;
+}
+
+# the most bytes one "M-R" or "M-W" command can transfer
+my $MAX_MEMORY_READ  = 0x100;
+my $MAX_MEMORY_WRITE = 0x23;
+
+# Read $len bytes of the drive memory at $addr into the scalar
+# referenced by $bufref, at $offset, with as few "M-R" as possible.
+
+sub MemoryRead($$$$;$)
+{
+    my ($dev, $addr, $bufref, $len, $offset) = @_;
+    my $total = 0;
+
+    $offset = 0 unless defined $offset;
+
+    while($total < $len)
+    {
+        my $n = $len - $total;
+        $n = $MAX_MEMORY_READ if $n > $MAX_MEMORY_READ;
+
+        Listen($dev, 15);
+        syswrite(CBM_FD, pack("a3vC", "M-R", $addr + $total, $n & 0xff));
+        Unlisten();
+
+        my $l = ReadBuffer($dev, 15, $bufref, $n, $offset + $total);
+        return undef unless defined $l;
+        $total += $l;
+        last if $l < $n;
+    }
+    return $total;
+}
+
+# Write $len bytes (default: all) from the scalar referenced by
+# $bufref, starting at $offset, into the drive memory at $addr.
+
+sub MemoryWrite($$$;$$)
+{
+    my ($dev, $addr, $bufref, $len, $offset) = @_;
+    my $total = 0;
+
+    $offset = 0 unless defined $offset;
+    $len = length($$bufref) - $offset unless defined $len;
+
+    while($total < $len)
+    {
+        my $n = $len - $total;
+        $n = $MAX_MEMORY_WRITE if $n > $MAX_MEMORY_WRITE;
+
+        my $l = WriteBuffer($dev, 15,
+            \(pack("a3vC", "M-W", $addr + $total, $n) .
+               substr($$bufref, $offset + $total, $n)));
+        return undef unless defined $l;
+        last if $l < $n + 6;
+        $total += $n;
+    }
+    return $total;
+}
+
 1;
@@ -51,6 +51,7 @@ struct cmdline_parameter_s {
     const char           *operationtype_text;
     unsigned char         drive;
     enum cbm_device_type_e drive_type;
+    int                   bam_only;
 };
 
 struct imageparameter_s {
@@ -90,9 +91,50 @@ static struct imageparameter_s imageparameter[IMAGETYPE_UNKNOWN] =
     "unknown CMD", \
     OPERATIONTYPE_UNKNOWN, \
     "unknown READ or WRITE", \
-    -1 \
+    -1, \
+    cbm_dt_unknown, \
+    0 \
 }
 
+/*
+ * With --bam-only, only the blocks which are in use are read. The image
+ * is partitioned: the partition directory is on the last track, and it
+ * tells where the partitions are. Blocks which are in no partition are
+ * not read at all.
+ *
+ * The BAM of a native partition is at its start, thus, it has already
+ * arrived when the copy gets to the blocks it tells about: it is applied
+ * lazily, one BAM block after the other as they are read, and there is
+ * nothing to read in advance but the partition directory. The other
+ * types of partitions are read completely.
+ *
+ * The blocks which are not read are left as holes in the image file.
+ */
+
+#define PARTITION_ENTRIES       32
+#define PARTITION_ENTRY_SIZE    32
+
+#define PARTITION_TYPE_NATIVE   0x01
+#define PARTITION_TYPE_SYSTEM   0xff
+
+/* blocks of 256 bytes on a track of a native partition */
+#define NATIVE_SECTORS          256
+/* the BAM of a native partition starts at block 1/1 */
+#define NATIVE_BAM_MAX          32
+
+struct native_partition_s {
+    long start;                 /* first block in the image */
+    long blocks;
+    int bam_blocks;
+};
+
+struct image_map_s {
+    unsigned char *need;        /* for every block of the image: read it */
+    long blocks;
+    struct native_partition_s native[PARTITION_ENTRIES];
+    int natives;
+};
+
 static void help()
 {
     printf(
@@ -109,6 +151,9 @@ static void help()
 "  -2, --d2m                  use a 2 MB disk image (FD2000, FD4000) (default)\n"
 "  -4, --d4m                  use a 4 MB disk image (FD4000 only)\n"
 "  -r, --read                 read the image from device to PC (default)\n"
+"  -b, --bam-only             only read the blocks which are in use, as told\n"
+"                             by the partition directory and the BAM of the\n"
+"                             native partitions; the others are left empty\n"
 /* "  -w, --write                write the image from PC to device (NOT SUPPORTED)\n" */
 "\n"
 );
@@ -130,13 +175,14 @@ static int process_cmdline(int argc, char *argv[], struct cmdline_parameter_s *c
         { "d2m"        , no_argument      , NULL, '2' },
         { "d4m"        , no_argument      , NULL, '4' },
         { "read"       , no_argument      , NULL, 'r' },
+        { "bam-only"   , no_argument      , NULL, 'b' },
 
         /* undocumented */
         { "write"      , no_argument      , NULL, 'w' },
         { NULL         , 0                , NULL, 0   }
     };
 
-    static const char shortopts[] ="hV@:124rw";
+    static const char shortopts[] ="hV@:124rbw";
 
     int option;
 
@@ -197,6 +243,8 @@ static int process_cmdline(int argc, char *argv[], struct cmdline_parameter_s *c
                       cmdline->operationtype = OPERATIONTYPE_READ;
                       cmdline->operationtype_text = "READ";
                       break;
+            case 'b': cmdline->bam_only = 1;
+                      break;
             case 'w': if ((cmdline->operationtype != OPERATIONTYPE_UNKNOWN) &&  (cmdline->operationtype != OPERATIONTYPE_WRITE))
                       {
                           fprintf(stderr, "operationtype (-r, -w) both specified, don't know what to do\n");
@@ -282,87 +330,356 @@ static int process_cmdline(int argc, char *argv[], struct cmdline_parameter_s *c
     return 0;
 }
 
-static int perform_action_read_data(struct cmdline_parameter_s *cmdline, CBM_FILE fd, const struct imageparameter_s * const imageparameter, FILE *image)
+static long block_index(const struct imageparameter_s * const imageparameter,
+                        int track, int side, int sector)
 {
-    int rv = 1;
+    return ((long) track * 2 + side) * imageparameter->max_sector + sector - 1;
+}
 
-    do {
-        int track;
-        int side;
-        int sector;
+/* read the next side of a track into the cache of the FDx000 */
+static int read_next_side(struct cmdline_parameter_s *cmdline, CBM_FILE fd)
+{
+    unsigned char jobresult[1];
+    int rv;
 
-        unsigned char jobresult[1];
+#if DUMMY_DRIVER_ACCESS
+    rv = 2;
+#else
+    rv = cbm_exec_command(fd, cmdline->drive, "U4", 2);
+#endif
 
-        for (track = 0; track <= imageparameter->max_track; ++track) {
-            for (side = 0; side < 2; ++side) {
+    if (rv < 0) {
+        fprintf(stderr, "\n\n Error executing U4, rv = %d!\n",rv);
+        return 1;
+    }
 
-                fprintf(stderr, "\rReading Track %d / Side %d ...                 ", track, side);
-                fflush(stderr);
+#if DUMMY_DRIVER_ACCESS
+    jobresult[0] = 0;
+    rv = 0;
+#else
+    /* read the return value from the drive code */
+    rv = cbm_download(fd, cmdline->drive, 0x0509, jobresult, sizeof jobresult);
+#endif
+    if (rv < 0) {
+        fprintf(stderr, "\n\nError getting JOBRESULT, rv = %d!\n",rv);
+        return 1;
+    }
+
+    if (jobresult[0]) {
+        fprintf(stderr, "\n\nJOBRESULT indicated an error: 0x%02x!\n", (unsigned int) jobresult[0]);
+        return 1;
+    }
+    return 0;
+}
+
+/* read a sector from the track cache */
+static int read_cached_sector(struct cmdline_parameter_s *cmdline, CBM_FILE fd,
+                              int track, int side, int sector, unsigned char *buffer)
+{
+    int rv;
 
 #if DUMMY_DRIVER_ACCESS
-                rv = 2;
+    memset(buffer, 0xAA, 256);
+    buffer[0] = track;
+    buffer[1] = side;
+    buffer[2] = sector;
+    buffer[3] = 0;
+    buffer[0xff] = 0xff;
+
+    rv = 0x100;
 #else
-                /* read the next track into the cache of the FDx000 */
-                rv = cbm_exec_command(fd, cmdline->drive, "U4", 2);
+    rv = cbm_download(fd, cmdline->drive, 0x5000 + (sector - 1) * 0x100, buffer, 256);
 #endif
 
-                if (rv < 0) {
-                    fprintf(stderr, "\n\n Error executing U4, rv = %d!\n",rv);
-                    goto error;
-                }
+    if (rv < 0) {
+        fprintf(stderr, "\n\nError reading data, rv = %d!\n", rv);
+        return 1;
+    }
+
+    if (rv != 256) {
+        fprintf(stderr, "\n\nShort read getting data, rv = %d!\n", rv);
+        return 1;
+    }
+    return 0;
+}
+
+/* let the next U4 read side 0 of track */
+static int seek_track(struct cmdline_parameter_s *cmdline, CBM_FILE fd, int track)
+{
+    unsigned char track_start = (unsigned char) track;
+    int rv;
 
 #if DUMMY_DRIVER_ACCESS
-                jobresult[0] = 0;
-                rv = 0;
+    rv = 0;
 #else
-                /* read the return value from the drive code */
-                rv = cbm_download(fd, cmdline->drive, 0x0509, jobresult, sizeof jobresult);
+    rv = cbm_upload(fd, cmdline->drive, 0x0506, &track_start, sizeof track_start);
+    if (rv >= 0) {
+        rv = cbm_exec_command(fd, cmdline->drive, "U3", 2);
+    }
 #endif
-                if (rv < 0) {
-                    fprintf(stderr, "\n\nError getting JOBRESULT, rv = %d!\n",rv);
+    if (rv < 0) {
+        fprintf(stderr, "\n\nError moving to track %d, rv = %d!\n", track, rv);
+        return 1;
+    }
+    return 0;
+}
+
+static long get_be24(const unsigned char *p)
+{
+    return ((long) p[0] << 16) | ((long) p[1] << 8) | p[2];
+}
+
+/*
+ * take the partitions from the partition directory which starts at dir;
+ * its start and size are given in blocks of 512 bytes. Returns 1 if the
+ * directory does not fit to the image.
+ */
+static int map_partitions(struct image_map_s *map, const unsigned char *dir, int entries)
+{
+    int i;
+
+    for (i = 0; i < entries; ++i) {
+        const unsigned char *entry = dir + i * PARTITION_ENTRY_SIZE;
+        long start = get_be24(&entry[0x15]) * 2;
+        long blocks = get_be24(&entry[0x1d]) * 2;
+
+        if (entry[2] == 0) {
+            continue;
+        }
+        if (start < 0 || blocks < 0 || start + blocks > map->blocks) {
+            return 1;
+        }
+
+        memset(map->need + start, 1, blocks);
+
+        if (entry[2] == PARTITION_TYPE_NATIVE && blocks >= NATIVE_SECTORS) {
+            struct native_partition_s *native = &map->native[map->natives++];
+            long tracks = blocks / NATIVE_SECTORS;
+
+            native->start = start;
+            native->blocks = blocks;
+            native->bam_blocks = (int) (tracks / 8 + 1);
+            if (native->bam_blocks > NATIVE_BAM_MAX) {
+                native->bam_blocks = NATIVE_BAM_MAX;
+            }
+        }
+    }
+    return 0;
+}
+
+/*
+ * read the last track, which holds the system partition, and find the
+ * partition directory there: its first entry is the system partition.
+ */
+static int read_partition_directory(struct cmdline_parameter_s *cmdline, CBM_FILE fd,
+                                    const struct imageparameter_s * const imageparameter,
+                                    struct image_map_s *map)
+{
+    int track = imageparameter->max_track;
+    int side;
+    int sector;
+    int found = 0;
+    unsigned char *data;
+
+    data = malloc((size_t) imageparameter->max_sector * 256);
+    if (data == NULL) {
+        fprintf(stderr, "no memory for the partition directory\n");
+        return 1;
+    }
+
+    if (seek_track(cmdline, fd, track)) {
+        free(data);
+        return 1;
+    }
+
+    for (side = 0; !found && side < 2; ++side) {
+        if (read_next_side(cmdline, fd)) {
+            free(data);
+            return 1;
+        }
+        for (sector = 1; sector <= imageparameter->max_sector; ++sector) {
+            if (read_cached_sector(cmdline, fd, track, side, sector, data + (sector - 1) * 256)) {
+                free(data);
+                return 1;
+            }
+        }
+        for (sector = 0; !found && sector < imageparameter->max_sector; ++sector) {
+            const unsigned char *dir = data + sector * 256;
+            int entries = (imageparameter->max_sector - sector) * 256 / PARTITION_ENTRY_SIZE;
+
+            if (dir[2] != PARTITION_TYPE_SYSTEM || memcmp(&dir[5], "SYSTEM", 6) != 0) {
+                continue;
+            }
+            if (entries > PARTITION_ENTRIES) {
+                entries = PARTITION_ENTRIES;
+            }
+            found = 1;
+            if (map_partitions(map, dir, entries)) {
+                fprintf(stderr, "The partition directory does not fit the image, reading all blocks.\n");
+                memset(map->need, 1, map->blocks);
+                map->natives = 0;
+            }
+        }
+    }
+    free(data);
+
+    if (!found) {
+        fprintf(stderr, "No partition directory found, reading all blocks.\n");
+        memset(map->need, 1, map->blocks);
+    }
+
+    /* the system partition is always read */
+    memset(map->need + block_index(imageparameter, track, 0, 1), 1, 2 * imageparameter->max_sector);
+
+    return seek_track(cmdline, fd, 0);
+}
+
+/*
+ * a block of the image has been read: if it is a BAM block of a native
+ * partition, the free blocks of the tracks it tells about are not read.
+ */
+static void apply_bam(struct image_map_s *map, long index, const unsigned char *buffer)
+{
+    int i;
+
+    for (i = 0; i < map->natives; ++i) {
+        const struct native_partition_s *native = &map->native[i];
+        long bam = index - native->start;
+        long first_track;
+        int t;
+
+        if (bam < 1 || bam > native->bam_blocks) {
+            continue;
+        }
+
+        /* BAM block 1/n tells about tracks 8*(n-1) to 8*(n-1)+7 */
+        first_track = (bam - 1) * 8;
+        for (t = 0; t < 8; ++t) {
+            long track = first_track + t;
+            int se;
+
+            if (track < 1 || track * NATIVE_SECTORS > native->blocks) {
+                continue;
+            }
+            for (se = 0; se < NATIVE_SECTORS; ++se) {
+                long block = native->start + (track - 1) * NATIVE_SECTORS + se;
+
+                /* the header and the BAM itself are always read */
+                if (block <= native->start + native->bam_blocks) {
+                    continue;
+                }
+                if (buffer[t * 32 + se / 8] & (0x80 >> (se & 7))) {
+                    map->need[block] = 0;
+                }
+            }
+        }
+    }
+}
+
+static int track_needed(const struct image_map_s *map,
+                        const struct imageparameter_s * const imageparameter, int track)
+{
+    long first = block_index(imageparameter, track, 0, 1);
+    long i;
+
+    for (i = 0; i < 2 * imageparameter->max_sector; ++i) {
+        if (map->need[first + i]) {
+            return 1;
+        }
+    }
+    return 0;
+}
+
+static int perform_action_read_data(struct cmdline_parameter_s *cmdline, CBM_FILE fd, const struct imageparameter_s * const imageparameter, FILE *image)
+{
+    struct image_map_s map;
+    struct image_map_s *use_map = NULL;
+    int rv = 1;
+    long skipped = 0;
+
+    memset(&map, 0, sizeof map);
+    map.blocks = block_index(imageparameter, imageparameter->max_track + 1, 0, 1);
+
+    do {
+        int track;
+        int side;
+        int sector;
+        int must_seek = 0;
+
+        if (cmdline->bam_only) {
+            map.need = calloc(map.blocks, 1);
+            if (map.need == NULL) {
+                fprintf(stderr, "no memory for the map of the image\n");
+                break;
+            }
+            if (read_partition_directory(cmdline, fd, imageparameter, &map)) {
+                break;
+            }
+            use_map = &map;
+        }
+
+        for (track = 0; track <= imageparameter->max_track; ++track) {
+
+            if (use_map && !track_needed(use_map, imageparameter, track)) {
+                skipped += 2 * imageparameter->max_sector;
+                must_seek = 1;
+                continue;
+            }
+            if (must_seek) {
+                if (seek_track(cmdline, fd, track)) {
                     goto error;
                 }
+                must_seek = 0;
+            }
+
+            for (side = 0; side < 2; ++side) {
 
-                if (jobresult[0]) {
-                    fprintf(stderr, "\n\nJOBRESULT indicated an error: 0x%02x!\n", (unsigned int) jobresult[0]);
+                fprintf(stderr, "\rReading Track %d / Side %d ...                 ", track, side);
+                fflush(stderr);
+
+                /* read the next track into the cache of the FDx000 */
+                if (read_next_side(cmdline, fd)) {
                     goto error;
                 }
 
                 /* read the sectors from the track cache */
                 for (sector = 1; sector <= imageparameter->max_sector; ++sector) {
-                    char buffer[256];
+                    unsigned char buffer[256];
+                    long index = block_index(imageparameter, track, side, sector);
+
+                    if (use_map && !use_map->need[index]) {
+                        ++skipped;
+                        continue;
+                    }
 
                     fprintf(stderr, "\rReading Track %d / Side %d / Sector %d ...     ", track, side, sector);
                     fflush(stderr);
 
-#if DUMMY_DRIVER_ACCESS
-                    memset(buffer, 0xAA, sizeof buffer);
-                    buffer[0] = track;
-                    buffer[1] = side;
-                    buffer[2] = sector;
-                    buffer[3] = 0;
-                    buffer[0xff] = 0xff;
-
-                    rv = 0x100;
-#else
-                    rv = cbm_download(fd, cmdline->drive, 0x5000 + (sector - 1) * 0x100, buffer, sizeof buffer);
-#endif
-
-                    if (rv < 0) {
-                        fprintf(stderr, "\n\nError reading data, rv = %d!\n", rv);
+                    if (read_cached_sector(cmdline, fd, track, side, sector, buffer)) {
                         goto error;
                     }
 
-                    if (rv != sizeof buffer) {
-                        fprintf(stderr, "\n\nShort read getting data, rv = %d!\n", rv);
-                        goto error;
+                    if (use_map) {
+                        apply_bam(use_map, index, buffer);
+                        fseek(image, index * 256, SEEK_SET);
                     }
-
                     fwrite(buffer, sizeof buffer, 1, image);
                 }
             }
         }
 
+        if (use_map) {
+            /* the blocks not read at the end are holes, too */
+            fflush(image);
+            if (arch_ftruncate(arch_fileno(image), map.blocks * 256) != 0) {
+                fprintf(stderr, "\n\nCould not extend the image file!\n");
+                goto error;
+            }
+            fseek(image, map.blocks * 256, SEEK_SET);
+            fprintf(stderr, "\n%ld of %ld blocks were not in use and have not been read.\n",
+                    skipped, map.blocks);
+        }
+
         for (sector = 0; sector < imageparameter->extra_blocks_at_end; ++sector) {
             static unsigned char buffer[256] = { 0 };
             fwrite(buffer, sizeof buffer, 1, image);
@@ -372,6 +689,7 @@ static int perform_action_read_data(struct cmdline_parameter_s *cmdline, CBM_FIL
     } while (0);
 
 error:
+    free(map.need);
     return rv;
 }
 
@@ -382,7 +700,7 @@ static int perform_action_read(struct cmdline_parameter_s *cmdline, CBM_FILE fd,
     FILE * image = NULL;
 
     do {
-        image = fopen(cmdline->image_filename, "w");
+        image = fopen(cmdline->image_filename, "wb");
         if (!image) {
             fprintf(stderr, "Could not open file '%s' for writing, aborting...\n", cmdline->image_filename);
             break;
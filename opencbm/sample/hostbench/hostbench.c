@@ -0,0 +1,222 @@
+/*
+ *  This program is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU General Public License
+ *  as published by the Free Software Foundation; either version
+ *  2 of the License, or (at your option) any later version.
+ */
+
+/*
+ * hostbench - measure the helpers the host runs for every block or
+ * byte of a transfer: the GCR codecs and the PETSCII conversion.
+ *
+ * No drive is needed; every benchmark runs on a fixed pseudo-random
+ * buffer until the given time has passed.
+ */
+
+#include "opencbm.h"
+
+#include <getopt.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "arch.h"
+#include "gcr.h"
+
+/* the size of the plain data of the track benchmarks: 16 blocks */
+#define TRACK_PLAIN_SIZE   (16 * BLOCKSIZE)
+#define TRACK_GCR_SIZE     (TRACK_PLAIN_SIZE / 4 * 5)
+
+/* the number of calls between two looks at the clock */
+#define CALLS_PER_BATCH    64
+
+static unsigned char plain[TRACK_PLAIN_SIZE];
+static unsigned char gcr_track[TRACK_GCR_SIZE];
+static unsigned char gcr_block[GCRBUFSIZE];
+static unsigned char output[TRACK_GCR_SIZE];
+
+/* makes sure the compiler cannot drop the results */
+static volatile unsigned int sink;
+
+typedef struct {
+    const char *name;
+    unsigned int bytes;         /* the bytes processed by one call */
+    void (*run)(void);
+} benchmark_t;
+
+static void bench_gcr_encode_track(void)
+{
+    sink += gcr_4_to_5_encode_track(plain, output, sizeof(plain), sizeof(gcr_track));
+}
+
+static void bench_gcr_decode_track(void)
+{
+    sink += gcr_5_to_4_decode_track(gcr_track, output, sizeof(gcr_track), sizeof(plain));
+}
+
+static void bench_gcr_encode_block(void)
+{
+    sink += gcr_encode(plain, output);
+}
+
+static void bench_gcr_decode_block(void)
+{
+    sink += gcr_decode(gcr_block, output);
+}
+
+static void bench_petscii2ascii(void)
+{
+    unsigned int i;
+
+    for (i = 0; i < BLOCKSIZE; i++)
+        output[i] = cbm_petscii2ascii_c(plain[i]);
+    sink += output[BLOCKSIZE - 1];
+}
+
+static void bench_ascii2petscii(void)
+{
+    unsigned int i;
+
+    for (i = 0; i < BLOCKSIZE; i++)
+        output[i] = cbm_ascii2petscii_c(plain[i]);
+    sink += output[BLOCKSIZE - 1];
+}
+
+static const benchmark_t benchmarks[] =
+{
+    { "gcr-encode-track", TRACK_PLAIN_SIZE, bench_gcr_encode_track },
+    { "gcr-decode-track", TRACK_PLAIN_SIZE, bench_gcr_decode_track },
+    { "gcr-encode-block", BLOCKSIZE,        bench_gcr_encode_block },
+    { "gcr-decode-block", BLOCKSIZE,        bench_gcr_decode_block },
+    { "petscii2ascii",    BLOCKSIZE,        bench_petscii2ascii    },
+    { "ascii2petscii",    BLOCKSIZE,        bench_ascii2petscii    },
+    { NULL,               0,                NULL                   }
+};
+
+static void prepare(void)
+{
+    unsigned int seed = 0x1541;
+    unsigned int i;
+
+    for (i = 0; i < sizeof(plain); i++)
+    {
+        seed = seed * 1103515245u + 12345u;
+        plain[i] = (unsigned char) (seed >> 16);
+    }
+
+    gcr_4_to_5_encode_track(plain, gcr_track, sizeof(plain), sizeof(gcr_track));
+    gcr_encode(plain, gcr_block);
+}
+
+static void run(const benchmark_t *bench, double duration_us)
+{
+    double start, elapsed;
+    unsigned long calls = 0;
+    unsigned int i;
+
+    /* one call to warm up the caches */
+    bench->run();
+
+    start = arch_time_us();
+    do
+    {
+        for (i = 0; i < CALLS_PER_BATCH; i++)
+            bench->run();
+        calls += CALLS_PER_BATCH;
+        elapsed = arch_time_us() - start;
+    } while (elapsed < duration_us);
+
+    printf("%-18s %10lu calls %10.1f ns/call %8.1f MB/s\n",
+        bench->name, calls, elapsed * 1000 / calls,
+        (double) bench->bytes * calls / elapsed);
+}
+
+static void help(void)
+{
+    printf(
+"Usage: hostbench [OPTION]... [BENCHMARK]...\n"
+"Measure the host-side codecs and helpers of OpenCBM.\n"
+"\n"
+"  -h, --help         display this help and exit\n"
+"  -V, --version      display version information and exit\n"
+"  -l, --list         list the benchmarks and exit\n"
+"  -t, --time=MS      run every benchmark for MS milliseconds (default 200)\n"
+"\n"
+"Without BENCHMARK, all of them are run.\n"
+"\n");
+}
+
+static void hint(char *s)
+{
+    fprintf(stderr, "Try `%s' -h for more information.\n", s);
+}
+
+int ARCH_MAINDECL main(int argc, char *argv[])
+{
+    const benchmark_t *bench;
+    double duration_ms = 200;
+    int option, rv = 0;
+
+    struct option longopts[] =
+    {
+        { "help"   , no_argument      , NULL, 'h' },
+        { "version", no_argument      , NULL, 'V' },
+        { "list"   , no_argument      , NULL, 'l' },
+        { "time"   , required_argument, NULL, 't' },
+        { NULL     , 0                , NULL, 0   }
+    };
+
+    const char shortopts[] ="hVlt:";
+
+    while((option = getopt_long(argc, argv, shortopts, longopts, NULL)) != -1)
+    {
+        switch(option)
+        {
+            case 'h': help();
+                      return 0;
+            case 'V': printf("hostbench %s\n", OPENCBM_VERSION);
+                      return 0;
+            case 'l': for (bench = benchmarks; bench->name; bench++)
+                          printf("%s\n", bench->name);
+                      return 0;
+            case 't': duration_ms = atof(optarg);
+                      if (duration_ms <= 0)
+                      {
+                          fprintf(stderr, "Invalid time (%s)\n", optarg);
+                          return 1;
+                      }
+                      break;
+            default : hint(argv[0]);
+                      return 1;
+        }
+    }
+
+    prepare();
+
+    if (optind == argc)
+    {
+        for (bench = benchmarks; bench->name; bench++)
+            run(bench, duration_ms * 1000);
+        return 0;
+    }
+
+    for (; optind < argc; optind++)
+    {
+        for (bench = benchmarks; bench->name; bench++)
+        {
+            if (strcmp(bench->name, argv[optind]) == 0)
+                break;
+        }
+
+        if (bench->name == NULL)
+        {
+            fprintf(stderr, "Unknown benchmark (%s)\n", argv[optind]);
+            rv = 1;
+            continue;
+        }
+
+        run(bench, duration_ms * 1000);
+    }
+
+    return rv;
+}
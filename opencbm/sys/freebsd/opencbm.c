@@ -461,6 +461,472 @@ cbm_read(struct cdev *dev, struct uio *uio, int ioflag __unused)
     return 0;
 }
 
+/*
+        The fast transfer protocols serial-1, serial-2 and parallel
+        (d64copy), and the micro-programs of IEC line operations, the
+        same as in the Linux driver. Running them here saves one ioctl
+        per line change.
+*/
+
+#define XFER_DELAY()    DELAY(2)    /* time for the IEC lines to change     */
+#define XFER_SPIN_US    1000        /* busy wait this long, then sleep      */
+
+/*
+ *  wait for a handshake line; if the drive is busy (e.g. reading
+ *  a sector), sleep instead of hogging the CPU. The ppbus lock is
+ *  dropped while sleeping.
+ */
+static int
+wait_line(struct cbm_data *sc, device_t ppbus, unsigned char line, int state)
+{
+        int i, rv;
+
+        state = state ? 1 : 0;
+
+        for (i = 0; GET(line) != state; i++) {
+                if (i < XFER_SPIN_US) {
+                        DELAY(1);
+                        continue;
+                }
+                rv = mtx_sleep(sc, ppb_get_lock(ppbus), PCATCH, CBM_NAME, 1);
+                if (rv != 0 && rv != EWOULDBLOCK)
+                        return -EINTR;
+        }
+        return 0;
+}
+
+#define xfer_wait(line, state)  wait_line(sc, ppbus, (line), (state))
+
+static unsigned char
+pp_read(struct cbm_data *sc, device_t ppbus)
+{
+        if (!sc->sc_data_reverse) {
+                XP_WRITE(0xff);
+                set_data_reverse();
+        }
+        return XP_READ();
+}
+
+static void
+pp_write(struct cbm_data *sc, device_t ppbus, unsigned char c)
+{
+        if (sc->sc_data_reverse)
+                set_data_forward();
+        XP_WRITE(c);
+}
+
+static int
+s1_write_byte(struct cbm_data *sc, device_t ppbus, unsigned char c)
+{
+        int i, bit;
+
+        for (i = 7; i >= 0; i--) {
+                bit = (c >> i) & 1;
+
+                /* send bit, release CLK and wait for drive to ack by setting CLK */
+                if (bit)
+                        SET(DATA_OUT);
+                else
+                        RELEASE(DATA_OUT);
+                XFER_DELAY();
+                RELEASE(CLK_OUT);
+                XFER_DELAY();
+                if (xfer_wait(CLK_IN, 1))
+                        return -EINTR;
+
+                /* send bit inverted, wait for drive to release CLK */
+                if (bit)
+                        RELEASE(DATA_OUT);
+                else
+                        SET(DATA_OUT);
+                if (xfer_wait(CLK_IN, 0))
+                        return -EINTR;
+
+                /* release DATA, set CLK and wait for drive to ack by setting DATA */
+                SET_RELEASE(CLK_OUT, DATA_OUT);
+                XFER_DELAY();
+                if (xfer_wait(DATA_IN, 1))
+                        return -EINTR;
+        }
+        return 0;
+}
+
+static int
+s1_read_byte(struct cbm_data *sc, device_t ppbus)
+{
+        int i, b, c = 0;
+
+        for (i = 0; i < 8; i++) {
+                if (xfer_wait(DATA_IN, 0))
+                        return -EINTR;
+                RELEASE(CLK_OUT);
+                XFER_DELAY();
+                b = GET(CLK_IN);
+                if (b)
+                        c |= 1 << i;
+                SET(DATA_OUT);
+                if (xfer_wait(CLK_IN, !b))
+                        return -EINTR;
+
+                RELEASE(DATA_OUT);
+                XFER_DELAY();
+                if (xfer_wait(DATA_IN, 1))
+                        return -EINTR;
+                SET(CLK_OUT);
+        }
+        return c;
+}
+
+static int
+s2_write_byte(struct cbm_data *sc, device_t ppbus, unsigned char c)
+{
+        int i;
+
+        for (i = 0; i < 8; i += 2) {
+                /* first bit: release ATN and wait for CLK release */
+                if ((c >> i) & 1)
+                        SET(DATA_OUT);
+                else
+                        RELEASE(DATA_OUT);
+                XFER_DELAY();
+                RELEASE(ATN_OUT);
+                if (xfer_wait(CLK_IN, 0))
+                        return -EINTR;
+
+                /* second bit: set ATN and wait for CLK set */
+                if ((c >> (i + 1)) & 1)
+                        SET(DATA_OUT);
+                else
+                        RELEASE(DATA_OUT);
+                XFER_DELAY();
+                SET(ATN_OUT);
+                if (xfer_wait(CLK_IN, 1))
+                        return -EINTR;
+        }
+        RELEASE(DATA_OUT);
+        XFER_DELAY();
+        return 0;
+}
+
+static int
+s2_read_byte(struct cbm_data *sc, device_t ppbus)
+{
+        int i, c = 0;
+
+        for (i = 0; i < 8; i += 2) {
+                /* first bit: wait for CLK release, ack by releasing ATN */
+                if (xfer_wait(CLK_IN, 0))
+                        return -EINTR;
+                XFER_DELAY();
+                if (GET(DATA_IN))
+                        c |= 1 << i;
+                RELEASE(ATN_OUT);
+
+                /* second bit: wait for CLK set, ack by setting ATN */
+                if (xfer_wait(CLK_IN, 1))
+                        return -EINTR;
+                XFER_DELAY();
+                if (GET(DATA_IN))
+                        c |= 1 << (i + 1);
+                SET(ATN_OUT);
+        }
+        return c;
+}
+
+static int
+pp_write_2_bytes(struct cbm_data *sc, device_t ppbus, const unsigned char *c)
+{
+        if (xfer_wait(DATA_IN, 1))
+                return -EINTR;
+        pp_write(sc, ppbus, c[0]);
+        DELAY(1);
+        RELEASE(CLK_OUT);
+
+        if (xfer_wait(DATA_IN, 0))
+                return -EINTR;
+        pp_write(sc, ppbus, c[1]);
+        DELAY(1);
+        SET(CLK_OUT);
+        return 0;
+}
+
+static int
+pp_read_2_bytes(struct cbm_data *sc, device_t ppbus, unsigned char *c)
+{
+        if (xfer_wait(DATA_IN, 1))
+                return -EINTR;
+        c[0] = pp_read(sc, ppbus);
+        RELEASE(CLK_OUT);
+
+        if (xfer_wait(DATA_IN, 0))
+                return -EINTR;
+        c[1] = pp_read(sc, ppbus);
+        SET(CLK_OUT);
+        return 0;
+}
+
+/*
+ *  transfer one chunk of the buffer,
+ *  returns the number of bytes transferred
+ */
+static int
+transfer_chunk(struct cbm_data *sc, device_t ppbus, u_long cmd,
+        unsigned char *chunk, int length)
+{
+        int i, c;
+
+        for (i = 0; i < length; i++) {
+                switch (cmd) {
+                case CBMCTRL_S1_READ_N:
+                        if ((c = s1_read_byte(sc, ppbus)) < 0)
+                                return i;
+                        chunk[i] = c;
+                        break;
+                case CBMCTRL_S1_WRITE_N:
+                        if (s1_write_byte(sc, ppbus, chunk[i]))
+                                return i;
+                        break;
+                case CBMCTRL_S2_READ_N:
+                        if ((c = s2_read_byte(sc, ppbus)) < 0)
+                                return i;
+                        chunk[i] = c;
+                        break;
+                case CBMCTRL_S2_WRITE_N:
+                        if (s2_write_byte(sc, ppbus, chunk[i]))
+                                return i;
+                        break;
+                case CBMCTRL_PP_DC_READ_N:
+                        if (pp_read_2_bytes(sc, ppbus, &chunk[i]))
+                                return i;
+                        i++;
+                        break;
+                case CBMCTRL_PP_DC_WRITE_N:
+                        if (pp_write_2_bytes(sc, ppbus, &chunk[i]))
+                                return i;
+                        i++;
+                        break;
+                }
+        }
+        return length;
+}
+
+/*
+ *  block transfer with one of the fast protocols, the data goes
+ *  through the buffer in chunks. As the ioctl cannot return a
+ *  count, a transfer interrupted by a signal fails with EINTR.
+ */
+static int
+cbm_transfer_n(struct cbm_data *sc, device_t ppbus, u_long cmd,
+        unsigned char *buffer, int length)
+{
+        int reading = (cmd == CBMCTRL_S1_READ_N) || (cmd == CBMCTRL_S2_READ_N)
+                   || (cmd == CBMCTRL_PP_DC_READ_N);
+        int done = 0, chunk, n, rv;
+
+        if (length < 0)
+                return EINVAL;
+
+        /* the parallel protocol transfers byte pairs */
+        if ((cmd == CBMCTRL_PP_DC_READ_N) || (cmd == CBMCTRL_PP_DC_WRITE_N)) {
+                if (length & 1)
+                        return EINVAL;
+
+                /* give the lines time to settle if their direction changes */
+                if (sc->sc_data_reverse != reading) {
+                        if (reading) {
+                                XP_WRITE(0xff);
+                                set_data_reverse();
+                        } else {
+                                set_data_forward();
+                        }
+                        DELAY(100);
+                }
+        }
+
+        DBGLOG("cbm_transfer_n: cmd=%08lx, %d bytes\n", cmd, length);
+
+        while (done < length) {
+                chunk = MIN(length - done, BUFFER_SIZE);
+
+                if (!reading) {
+                        ppb_unlock(ppbus);
+                        rv = copyin(buffer + done, sc->sc_buf, chunk);
+                        ppb_lock(ppbus);
+                        if (rv)
+                                return rv;
+                }
+
+                n = transfer_chunk(sc, ppbus, cmd,
+                        (unsigned char *)sc->sc_buf, chunk);
+
+                if (reading) {
+                        ppb_unlock(ppbus);
+                        rv = copyout(sc->sc_buf, buffer + done, n);
+                        ppb_lock(ppbus);
+                        if (rv)
+                                return rv;
+                }
+
+                done += n;
+                if (n < chunk)
+                        return EINTR;
+        }
+
+        return 0;
+}
+
+/*
+ *  map IEC_DATA, IEC_CLOCK, IEC_ATN and IEC_RESET to the lpt output lines
+ */
+static unsigned char
+iec_out_mask(unsigned char lines)
+{
+        unsigned char mask = 0;
+
+        if (lines & IEC_DATA)
+                mask |= DATA_OUT;
+        if (lines & IEC_CLOCK)
+                mask |= CLK_OUT;
+        if (lines & IEC_ATN)
+                mask |= ATN_OUT;
+        if (lines & IEC_RESET)
+                mask |= RESET;
+        return mask;
+}
+
+/*
+ *  map exactly one of IEC_DATA, IEC_CLOCK and IEC_ATN to its lpt input line
+ */
+static int
+iec_in_mask(unsigned char line)
+{
+        switch (line) {
+        case IEC_DATA:
+                return DATA_IN;
+        case IEC_CLOCK:
+                return CLK_IN;
+        case IEC_ATN:
+                return ATN_IN;
+        }
+        return -1;
+}
+
+/*
+ *  check a program before any of it is run
+ */
+static int
+iec_program_valid(const unsigned char *program, int length)
+{
+        const unsigned char lines = IEC_DATA | IEC_CLOCK | IEC_ATN | IEC_RESET;
+        int i;
+
+        for (i = 0; i < length; i += 2) {
+                switch (program[i]) {
+                case CBMCTRL_PROG_SET:
+                case CBMCTRL_PROG_RELEASE:
+                        if (program[i + 1] & ~lines)
+                                return 0;
+                        break;
+                case CBMCTRL_PROG_WAIT_SET:
+                case CBMCTRL_PROG_WAIT_RELEASE:
+                        if (iec_in_mask(program[i + 1]) < 0)
+                                return 0;
+                        break;
+                case CBMCTRL_PROG_SETRELEASE: /* both nibbles are valid line masks */
+                case CBMCTRL_PROG_POLL:
+                case CBMCTRL_PROG_DELAY:
+                case CBMCTRL_PROG_PP_READ:
+                case CBMCTRL_PROG_PP_WRITE:
+                        break;
+                default:
+                        return 0;
+                }
+        }
+        return 1;
+}
+
+/*
+ *  run a program of (opcode, argument) byte pairs,
+ *  the results of POLL and PP_READ replace their argument.
+ *  The number of operations run is returned in val->length.
+ */
+static int
+cbm_iec_program(struct cbm_data *sc, device_t ppbus, PARBURST_RW_VALUE *val)
+{
+        unsigned char *op;
+        int length = val->length;
+        int i, c, rv;
+
+        if (length < 0 || length > BUFFER_SIZE || (length & 1))
+                return EINVAL;
+
+        ppb_unlock(ppbus);
+        rv = copyin(val->buffer, sc->sc_buf, length);
+        ppb_lock(ppbus);
+        if (rv)
+                return rv;
+        if (!iec_program_valid((unsigned char *)sc->sc_buf, length))
+                return EINVAL;
+
+        DBGLOG("cbm_iec_program: %d operations\n", length / 2);
+
+        for (i = 0; i < length; i += 2) {
+                op = (unsigned char *)&sc->sc_buf[i];
+
+                switch (op[0]) {
+                case CBMCTRL_PROG_SET:
+                        SET(iec_out_mask(op[1]));
+                        break;
+                case CBMCTRL_PROG_RELEASE:
+                        RELEASE(iec_out_mask(op[1]));
+                        break;
+                case CBMCTRL_PROG_SETRELEASE:
+                        SET_RELEASE(iec_out_mask(op[1] >> 4),
+                                iec_out_mask(op[1] & 0x0f));
+                        break;
+                case CBMCTRL_PROG_WAIT_SET:
+                case CBMCTRL_PROG_WAIT_RELEASE:
+                        if (xfer_wait(iec_in_mask(op[1]),
+                                        op[0] == CBMCTRL_PROG_WAIT_SET))
+                                goto interrupted;
+                        break;
+                case CBMCTRL_PROG_POLL:
+                        c = POLL();
+                        op[1] = 0;
+                        if ((c & DATA_IN) == 0)
+                                op[1] |= IEC_DATA;
+                        if ((c & CLK_IN) == 0)
+                                op[1] |= IEC_CLOCK;
+                        if ((c & ATN_IN) == 0)
+                                op[1] |= IEC_ATN;
+                        break;
+                case CBMCTRL_PROG_DELAY:
+                        DELAY(op[1]);
+                        break;
+                case CBMCTRL_PROG_PP_READ:
+                        op[1] = pp_read(sc, ppbus);
+                        break;
+                case CBMCTRL_PROG_PP_WRITE:
+                        pp_write(sc, ppbus, op[1]);
+                        break;
+                }
+        }
+
+interrupted:
+        ppb_unlock(ppbus);
+        rv = copyout(sc->sc_buf, val->buffer, i);
+        ppb_lock(ppbus);
+        if (rv)
+                return rv;
+
+        /* interrupted by a signal before the first operation */
+        if (i == 0 && length > 0)
+                return EINTR;
+
+        val->length = i / 2;
+        return 0;
+}
+
 static int
 cbm_ioctl(struct cdev *dev, u_long cmd, caddr_t data, int fflag,
         struct thread *td)
@@ -725,6 +1191,20 @@ cbm_ioctl(struct cdev *dev, u_long cmd, caddr_t data, int fflag,
                         val->buffer, val->length);
                 break;
 
+        case CBMCTRL_S1_READ_N:
+        case CBMCTRL_S1_WRITE_N:
+        case CBMCTRL_S2_READ_N:
+        case CBMCTRL_S2_WRITE_N:
+        case CBMCTRL_PP_DC_READ_N:
+        case CBMCTRL_PP_DC_WRITE_N:
+                val = (PARBURST_RW_VALUE *)data;
+                rv = cbm_transfer_n(sc, ppbus, cmd, val->buffer, val->length);
+                break;
+
+        case CBMCTRL_IEC_PROGRAM:
+                rv = cbm_iec_program(sc, ppbus, (PARBURST_RW_VALUE *)data);
+                break;
+
         default:
                 rv = ENOTTY;
         }
@@ -279,6 +279,9 @@ CbmGetCurrentProcessorNumber(VOID);
 extern ULONG
 CbmGetNumberProcessors(VOID);
 
+extern PVOID
+CbmGetSystemRoutineAddress(IN PCWSTR RoutineName);
+
 extern VOID
 CLI(VOID);
 
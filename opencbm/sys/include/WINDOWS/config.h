@@ -22,6 +22,13 @@
 /*! Only define if performance evaluation is to be compiled in */
 #define PERFEVAL 1
 
+/*! Only define if the performance events should be sent to ETW.
+    On Windows Vista and above, they are then traced only while a
+    trace session has enabled the provider of the driver, e.g. with
+    "logman start opencbm -p {56EC1A74-870C-4F41-9CCF-5A421D3D9351} -ets".
+    On older systems, they are still written into timing.dat. */
+#define PERFEVAL_ETW 1
+
 /*! Only define if verbose performance evaluation is to be used. */
 /* #define PERFEVAL_VERBOSE 1 /**/
 
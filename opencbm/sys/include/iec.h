@@ -28,6 +28,18 @@ enum iec_checkdevice
     IEC_CHECKDEVICE_BUSBUSY = 2   /*!< the bus is still busy */
 } IEC_CHECKDEVICE;
 
+/*! protocol and direction of a block transfer with cbmiec_transfer_n() */
+typedef
+enum iec_transfer
+{
+    IEC_TRANSFER_S1_READ = 0,  /*!< serial-1, read from the drive */
+    IEC_TRANSFER_S1_WRITE = 1, /*!< serial-1, write to the drive */
+    IEC_TRANSFER_S2_READ = 2,  /*!< serial-2, read from the drive */
+    IEC_TRANSFER_S2_WRITE = 3, /*!< serial-2, write to the drive */
+    IEC_TRANSFER_PP_READ = 4,  /*!< parallel (d64copy), read from the drive */
+    IEC_TRANSFER_PP_WRITE = 5  /*!< parallel (d64copy), write to the drive */
+} IEC_TRANSFER;
+
 extern NTSTATUS
 cbmiec_wait_for_drives_ready(IN PDEVICE_EXTENSION Pdx);
 
@@ -133,6 +145,12 @@ cbmiec_parallel_burst_read_track_var(IN PDEVICE_EXTENSION Pdx, OUT UCHAR* Buffer
 extern NTSTATUS
 cbmiec_parallel_burst_write_track(IN PDEVICE_EXTENSION Pdx, IN UCHAR* Buffer, IN ULONG BufferLength);
 
+extern NTSTATUS
+cbmiec_iec_program(IN PDEVICE_EXTENSION Pdx, IN OUT PUCHAR Program, IN ULONG Length);
+
+extern NTSTATUS
+cbmiec_transfer_n(IN PDEVICE_EXTENSION Pdx, IN IEC_TRANSFER Protocol, IN OUT PUCHAR Buffer, IN ULONG BufferLength, OUT ULONG *Transferred);
+
 extern NTSTATUS
 cbmiec_test_irq(IN PDEVICE_EXTENSION Pdx, OUT PVOID Buffer, IN ULONG BufferLength);
 
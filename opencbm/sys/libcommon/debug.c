@@ -1042,131 +1042,33 @@ DebugNtStatus(NTSTATUS Value)
 
 #if DBG
 
-/*! \brief use a spinlock for the debugging buffer implementation */
-#define USE_SPINLOCK 1
+/*! \brief the size of the memory buffer used for the debugging buffer
 
-/* \brief use IRQL elevation for the debugging buffer implementation */
-// #define USE_IRQL_ELEVATION 1
-
-static volatile PCHAR DbgMemoryBuffer = NULL;
-static volatile ULONG DbgNextWriteMemoryBuffer = 0;
-
-#ifdef USE_SPINLOCK
-
-static KSPIN_LOCK DbgMemoryBufferSpinLock;
-static KIRQL DbgMemoryBufferSpinLockIrql;
-
-#else // #ifdef USE_SPINLOCK
-
-static LONG DbgMemoryBufferSpinLock = 0;
-static LONG DbgMemoryBufferUsageCounter = 0;
-
-#ifdef USE_IRQL_ELEVATION
-    static KIRQL DbgMemoryBufferIrql;
-#endif
-
-#endif // #ifdef USE_SPINLOCK
-
-/*! \brief the size of the memory buffer used for the debugging buffer */
-#define DBG_SIZE_MEMORY_BUFFER 0x20000u
-
-/*! \brief Start access to the debug memory buffer.
-
- This function synchronizes the access to the debug memory
- buffer. It obtains a lock which allows the caller to safely
- access the debug memory buffer.
-
- When the caller has completed, it has to call
- DbgBufferSynchronizeStop().
-
- \todo
-
-    If we do not use the spinlock for synchronizing
-    access, this function seems not to work at all!
-*/
-
-static VOID
-DbgBufferSynchronizeStart(VOID)
-{
-    LONG tmp;
-    KIRQL irql; // do not use Irql directly, but only indirectly,
-                // as suggested by Doron Holan at
-                // http://blogs.msdn.com/doronh/archive/2006/03/08/546934.aspx
-
-#ifdef USE_SPINLOCK
-
-    KeAcquireSpinLock(&DbgMemoryBufferSpinLock, &irql);
-    DbgMemoryBufferSpinLockIrql = irql;
-
-#else // #ifdef USE_SPINLOCK
-
-    #ifdef USE_IRQL_ELEVATION
-
-        if (DbgMemoryBufferIrql != PASSIVE_LEVEL)
-        {
-            REPORT_BUG(0x133, DbgMemoryBufferUsageCounter,
-                DbgMemoryBufferSpinLock, DbgMemoryBufferIrql, 0,
-                "Not IRQL == PASSIVE_LEVEL");
-        }
-
-        KeRaiseIrql(DISPATCH_LEVEL, &DbgMemoryBufferIrql);
-
-    #endif // #ifdef USE_IRQL_ELEVATION
-
-    while (InterlockedExchange(&DbgMemoryBufferSpinLock, 1) == 0)
-        ;
-
-    tmp = InterlockedIncrement(&DbgMemoryBufferUsageCounter);
-    if (tmp != 1)
-    {
-        REPORT_BUG(0x130, tmp, DbgMemoryBufferSpinLock, 0, 0,
-            "Usage counter bigger than 1 after incrementing!");
-    }
-
-#endif // #ifdef USE_SPINLOCK
-}
-
-/*! \brief End access to the debug memory buffer.
-
- This function ends the access to the debug memory
- buffer, which has previously been allocated by
- DbgBufferSynchronizeStart().
+ This has to be a power of 2, as the write position is not wrapped
+ around, but only masked with DBG_SIZE_MEMORY_BUFFER - 1 when it is
+ used.
 */
+#define DBG_SIZE_MEMORY_BUFFER 0x20000u
 
-static VOID
-DbgBufferSynchronizeStop(VOID)
-{
-    LONG tmp;
-
-#ifdef USE_SPINLOCK
-
-    KeReleaseSpinLock(&DbgMemoryBufferSpinLock, DbgMemoryBufferSpinLockIrql);
-
-#else // #ifdef USE_SPINLOCK
-
-    tmp = InterlockedDecrement(&DbgMemoryBufferUsageCounter);
-    if (tmp != 0)
-    {
-        REPORT_BUG(0x131, tmp, DbgMemoryBufferSpinLock, 0, 0,
-            "Usage counter not null after decrementing!");
-    }
-
-    tmp = InterlockedExchange(&DbgMemoryBufferSpinLock, 0);
-    if (tmp != 1)
-    {
-        REPORT_BUG(0x132, DbgMemoryBufferUsageCounter, tmp, 0, 0,
-            "(own) Spinlock not 1 before releasing.");
-    }
-
-    #ifdef USE_IRQL_ELEVATION
-
-        KeLowerIrql(DbgMemoryBufferIrql);
-        DbgMemoryBufferIrql = PASSIVE_LEVEL;
+/*! \brief the separator which is put after every string in the buffer */
+#define DBG_SEPARATOR 13
 
-    #endif // #ifdef USE_IRQL_ELEVATION
+/*
+ * The debugging buffer is written without any lock: every writer
+ * reserves the space for its string with one InterlockedExchangeAdd()
+ * on DbgNextWriteMemoryBuffer, and then copies the string into its
+ * own part of the buffer. Thus, DbgOutputMemoryBuffer() can be called
+ * at any IRQL, even from the ISR, and it never has to wait for another
+ * processor.
+ *
+ * As long as a string is copied, its part of the buffer might still
+ * contain older contents; the reader does not care about this, this
+ * is only a debugging aid.
+ */
 
-#endif // #ifdef USE_SPINLOCK
-}
+static PCHAR volatile DbgMemoryBuffer = NULL;
+static volatile LONG DbgNextWriteMemoryBuffer = 0;
+static volatile LONG DbgMemoryBufferWrapped = 0;
 
 /*! \brief Initialise debugging system
 
@@ -1176,11 +1078,6 @@ DbgBufferSynchronizeStop(VOID)
 VOID
 DbgInit(VOID)
 {
-#ifdef USE_SPINLOCK
-
-    KeInitializeSpinLock(&DbgMemoryBufferSpinLock);
-
-#endif // #ifdef USE_SPINLOCK
 }
 
 /*! \brief Get storage area for debugging output
@@ -1191,37 +1088,39 @@ DbgInit(VOID)
 VOID
 DbgAllocateMemoryBuffer(VOID)
 {
-    DbgBufferSynchronizeStart();
+    PCHAR buffer;
 
-    DbgMemoryBuffer = ExAllocatePoolWithTag(NonPagedPool,
-        DBG_SIZE_MEMORY_BUFFER + 1, MTAG_DBGBUFFER);
+    buffer = ExAllocatePoolWithTag(NonPagedPool,
+        DBG_SIZE_MEMORY_BUFFER, MTAG_DBGBUFFER);
 
-    if (DbgMemoryBuffer)
+    if (buffer)
     {
-        RtlZeroMemory(DbgMemoryBuffer, DBG_SIZE_MEMORY_BUFFER + 1);
+        RtlZeroMemory(buffer, DBG_SIZE_MEMORY_BUFFER);
     }
 
-    DbgNextWriteMemoryBuffer = 0;
-
-    DbgBufferSynchronizeStop();
+    InterlockedExchange(&DbgNextWriteMemoryBuffer, 0);
+    InterlockedExchange(&DbgMemoryBufferWrapped, 0);
+    InterlockedExchangePointer((PVOID volatile *) &DbgMemoryBuffer, buffer);
 }
 
 /*! \brief Free storage area for debugging output
 
  This function frees the memory of the debugging output.
+
+ It must only be called when no other thread can output
+ anything anymore, that is, when the driver is unloaded.
 */
 VOID
 DbgFreeMemoryBuffer(VOID)
 {
-    DbgBufferSynchronizeStart();
+    PCHAR buffer;
 
-    if (DbgMemoryBuffer)
+    buffer = InterlockedExchangePointer((PVOID volatile *) &DbgMemoryBuffer, NULL);
+
+    if (buffer)
     {
-        ExFreePool(DbgMemoryBuffer);
-        DbgMemoryBuffer = NULL;
+        ExFreePool(buffer);
     }
-
-    DbgBufferSynchronizeStop();
 }
 
 /*! \brief Output into the debugging buffer
@@ -1231,162 +1130,46 @@ DbgFreeMemoryBuffer(VOID)
 
  \param String:
     Pointer to the string which is to be output
-
- \todo
-    More debugging for the sanity checks to find the
-    cause why DbgBufferSynchronizeStart() does not work
-    without using the SpinLock.
 */
 VOID
 DbgOutputMemoryBuffer(const char *String)
 {
-    DbgBufferSynchronizeStart();
+    PCHAR buffer = DbgMemoryBuffer;
 
-    if (DbgMemoryBuffer)
+    if (buffer)
     {
-        PCHAR localMemoryBuffer;
-        ULONG localNextWriteMemoryBuffer;
         ULONG strLength;
+        ULONG position;
+        ULONG i;
 
-        localMemoryBuffer = DbgMemoryBuffer;
-        localNextWriteMemoryBuffer = DbgNextWriteMemoryBuffer;
-
-        if (DbgNextWriteMemoryBuffer > DBG_SIZE_MEMORY_BUFFER)
-        {
-            REPORT_BUG(0x123, DbgNextWriteMemoryBuffer, DBG_SIZE_MEMORY_BUFFER, -1, 0,
-                "DbgNextWriteMemoryBuffer already out of buffer!");
-        }
-
-        strLength = strlen(String) + 1;
+        strLength = strlen(String);
 
         if (strLength >= 200)
         {
             REPORT_BUG(0x123, DbgNextWriteMemoryBuffer, DBG_SIZE_MEMORY_BUFFER,
                 strLength, 0, "string too long");
-        }
-
-        // Sanity check
 
-        if ((localMemoryBuffer != DbgMemoryBuffer)
-            || (localNextWriteMemoryBuffer != DbgNextWriteMemoryBuffer))
-        {
-            REPORT_BUG(0x140, (ULONG_PTR) localMemoryBuffer, (ULONG_PTR) DbgMemoryBuffer,
-                localNextWriteMemoryBuffer, DbgNextWriteMemoryBuffer,
-                "local copies do not match the global ones (1)");
+            strLength = 199;
         }
 
-        // Does the string fit into the buffer?
+        // reserve our part of the buffer, including the separator
 
-        if (DbgNextWriteMemoryBuffer + strLength > DBG_SIZE_MEMORY_BUFFER)
-        {
-            if (DBG_SIZE_MEMORY_BUFFER - DbgNextWriteMemoryBuffer >= strLength)
-            {
-                REPORT_BUG(0x124, DbgNextWriteMemoryBuffer, DBG_SIZE_MEMORY_BUFFER,
-                    strLength, 0, "");
-            }
-
-            // Sanity check
-
-            if ((localMemoryBuffer != DbgMemoryBuffer)
-                || (localNextWriteMemoryBuffer != DbgNextWriteMemoryBuffer))
-            {
-                REPORT_BUG(0x141, (ULONG_PTR) localMemoryBuffer, (ULONG_PTR) DbgMemoryBuffer,
-                    localNextWriteMemoryBuffer, DbgNextWriteMemoryBuffer,
-                    "local copies do not match the global ones (2)");
-            }
-
-            RtlZeroMemory(&DbgMemoryBuffer[DbgNextWriteMemoryBuffer],
-                DBG_SIZE_MEMORY_BUFFER - DbgNextWriteMemoryBuffer);
-
-            // Sanity check
-
-            if ((localMemoryBuffer != DbgMemoryBuffer)
-                || (localNextWriteMemoryBuffer != DbgNextWriteMemoryBuffer))
-            {
-                REPORT_BUG(0x142, (ULONG_PTR) localMemoryBuffer, (ULONG_PTR) DbgMemoryBuffer,
-                    localNextWriteMemoryBuffer, DbgNextWriteMemoryBuffer,
-                    "local copies do not match the global ones (3)");
-            }
-
-            DbgNextWriteMemoryBuffer = 0;
-            localNextWriteMemoryBuffer = 0;
-        }
+        position = (ULONG) InterlockedExchangeAdd(&DbgNextWriteMemoryBuffer,
+            strLength + 1);
 
-        // Sanity check
-
-        if ((localMemoryBuffer != DbgMemoryBuffer)
-            || (localNextWriteMemoryBuffer != DbgNextWriteMemoryBuffer))
+        if (position + strLength + 1 >= DBG_SIZE_MEMORY_BUFFER
+            && !DbgMemoryBufferWrapped)
         {
-            REPORT_BUG(0x143, (ULONG_PTR) localMemoryBuffer, (ULONG_PTR) DbgMemoryBuffer,
-                localNextWriteMemoryBuffer, DbgNextWriteMemoryBuffer,
-                "local copies do not match the global ones (4)");
+            InterlockedExchange(&DbgMemoryBufferWrapped, 1);
         }
 
-        if (DbgNextWriteMemoryBuffer > DBG_SIZE_MEMORY_BUFFER)
+        for (i = 0; i < strLength; i++)
         {
-            REPORT_BUG(0x125, DbgNextWriteMemoryBuffer, DBG_SIZE_MEMORY_BUFFER,
-                strLength, 0,
-                "String does not fit in the buffer (but should have fitted!)");
+            buffer[(position + i) & (DBG_SIZE_MEMORY_BUFFER - 1)] = String[i];
         }
 
-        // Sanity check
-
-        if ((localMemoryBuffer != DbgMemoryBuffer)
-            || (localNextWriteMemoryBuffer != DbgNextWriteMemoryBuffer))
-        {
-            REPORT_BUG(0x144, (ULONG_PTR) localMemoryBuffer, (ULONG_PTR) DbgMemoryBuffer,
-                localNextWriteMemoryBuffer, DbgNextWriteMemoryBuffer,
-                "local copies do not match the global ones (5)");
-        }
-
-        if (DbgNextWriteMemoryBuffer > 0)
-        {
-            DbgMemoryBuffer[DbgNextWriteMemoryBuffer-1] = 13;
-        }
-
-        // Sanity check
-
-        if ((localMemoryBuffer != DbgMemoryBuffer)
-            || (localNextWriteMemoryBuffer != DbgNextWriteMemoryBuffer))
-        {
-            REPORT_BUG(0x145, (ULONG_PTR) localMemoryBuffer, (ULONG_PTR) DbgMemoryBuffer,
-                localNextWriteMemoryBuffer, DbgNextWriteMemoryBuffer,
-                "local copies do not match the global ones (6)");
-        }
-
-        RtlCopyMemory(&DbgMemoryBuffer[DbgNextWriteMemoryBuffer], String, strLength);
-        DbgNextWriteMemoryBuffer += strLength;
-        localNextWriteMemoryBuffer += strLength;
-
-        // Sanity check
-
-        if ((localMemoryBuffer != DbgMemoryBuffer)
-            || (localNextWriteMemoryBuffer != DbgNextWriteMemoryBuffer))
-        {
-            REPORT_BUG(0x146, (ULONG_PTR) localMemoryBuffer, (ULONG_PTR) DbgMemoryBuffer,
-                localNextWriteMemoryBuffer, DbgNextWriteMemoryBuffer,
-                "local copies do not match the global ones (7)");
-        }
-
-        if (DbgNextWriteMemoryBuffer > DBG_SIZE_MEMORY_BUFFER)
-        {
-            REPORT_BUG(0x126, DbgNextWriteMemoryBuffer, DBG_SIZE_MEMORY_BUFFER,
-                strLength, 0,
-                "DbgNextWriteMemoryBuffer out of buffer after write!");
-        }
-
-        // Sanity check
-
-        if ((localMemoryBuffer != DbgMemoryBuffer)
-            || (localNextWriteMemoryBuffer != DbgNextWriteMemoryBuffer))
-        {
-            REPORT_BUG(0x147, (ULONG_PTR) localMemoryBuffer, (ULONG_PTR) DbgMemoryBuffer,
-                localNextWriteMemoryBuffer, DbgNextWriteMemoryBuffer,
-                "local copies do not match the global ones (8)");
-        }
+        buffer[(position + strLength) & (DBG_SIZE_MEMORY_BUFFER - 1)] = DBG_SEPARATOR;
     }
-
-    DbgBufferSynchronizeStop();
 }
 
 /*! \brief Give the debug buffer contents to the installer
@@ -1410,80 +1193,44 @@ DbgOutputMemoryBuffer(const char *String)
    returns one of the error status values.
 
  This function copies the last ReturnLength bytes into the buffer.
+ Strings which are written while this function runs might be
+ incomplete.
 */
 
 NTSTATUS
 cbm_dbg_readbuffer(IN PDEVICE_EXTENSION Pdx, OUT PCHAR ReturnBuffer,
                    IN OUT PULONG ReturnLength)
 {
-    FUNC_ENTER();
+    PCHAR buffer = DbgMemoryBuffer;
 
-    DbgBufferSynchronizeStart();
+    FUNC_ENTER();
 
-    if (DbgMemoryBuffer)
+    if (buffer)
     {
-        PCHAR writePosition;
-        ULONG stillToWrite;
-        ULONG writtenBytes;
+        ULONG endPosition;
+        ULONG available;
+        ULONG lengthToCopy;
+        ULONG startOffset;
+        ULONG lengthBeforeWrapAround;
 
-        writePosition = ReturnBuffer;
-        stillToWrite = *ReturnLength;
-        writtenBytes = 0;
+        endPosition = (ULONG) DbgNextWriteMemoryBuffer;
 
+        available = DbgMemoryBufferWrapped
+            ? DBG_SIZE_MEMORY_BUFFER : min(endPosition, DBG_SIZE_MEMORY_BUFFER);
 
-        if (stillToWrite > DbgNextWriteMemoryBuffer)
-        {
-            ULONG lengthBeforeWrapAround;
-
-            //! \todo
-
-            // First of all, find out if there are any "old" entries
-            // from before the wrap-around
-
-            lengthBeforeWrapAround =
-                strlen(&DbgMemoryBuffer[DbgNextWriteMemoryBuffer+1]) + 1;
+        lengthToCopy = min(*ReturnLength, available);
 
-            if (lengthBeforeWrapAround > 1)
-            {
-                ULONG lengthToCopy;
+        startOffset = (endPosition - lengthToCopy) & (DBG_SIZE_MEMORY_BUFFER - 1);
 
-                lengthToCopy = stillToWrite - DbgNextWriteMemoryBuffer + 1;
+        lengthBeforeWrapAround = min(lengthToCopy, DBG_SIZE_MEMORY_BUFFER - startOffset);
 
-                lengthToCopy = min(lengthToCopy, lengthBeforeWrapAround);
+        RtlCopyMemory(ReturnBuffer, &buffer[startOffset], lengthBeforeWrapAround);
+        RtlCopyMemory(&ReturnBuffer[lengthBeforeWrapAround], buffer,
+            lengthToCopy - lengthBeforeWrapAround);
 
-                RtlCopyMemory(writePosition,
-                    &DbgMemoryBuffer[DbgNextWriteMemoryBuffer
-                                     + lengthBeforeWrapAround
-                                     - lengthToCopy],
-                    lengthToCopy);
-
-                writePosition += lengthToCopy;
-                writtenBytes += lengthToCopy;
-                stillToWrite -= lengthToCopy;
-
-                if (stillToWrite > 0)
-                {
-                    *writePosition++ = 13;
-                    ++writtenBytes;
-                    --stillToWrite;
-                }
-            }
-        }
-
-        stillToWrite = min(stillToWrite, DbgNextWriteMemoryBuffer);
-
-        RtlCopyMemory(writePosition,
-            &DbgMemoryBuffer[DbgNextWriteMemoryBuffer - stillToWrite],
-            stillToWrite);
-
-        writtenBytes += stillToWrite;
-
-
-        *ReturnLength = writtenBytes;
+        *ReturnLength = lengthToCopy;
     }
 
-    DbgBufferSynchronizeStop();
-
     FUNC_LEAVE_NTSTATUS_CONST(STATUS_SUCCESS);
 }
 
@@ -257,6 +257,47 @@ cbm_devicecontrol(IN PDEVICE_OBJECT Fdo, IN PIRP Irp)
             ntStatus = cbm_checkinputbuffer(irpSp, 1, STATUS_SUCCESS);
             break;
 
+        case CBMCTRL_S1_READ_N:
+            DBG_IRP(CBMCTRL_S1_READ_N);
+            ntStatus = cbm_checkoutputbuffer(irpSp, 1, STATUS_SUCCESS);
+            break;
+
+        case CBMCTRL_S1_WRITE_N:
+            DBG_IRP(CBMCTRL_S1_WRITE_N);
+            ntStatus = cbm_checkinputbuffer(irpSp, 1, STATUS_SUCCESS);
+            break;
+
+        case CBMCTRL_S2_READ_N:
+            DBG_IRP(CBMCTRL_S2_READ_N);
+            ntStatus = cbm_checkoutputbuffer(irpSp, 1, STATUS_SUCCESS);
+            break;
+
+        case CBMCTRL_S2_WRITE_N:
+            DBG_IRP(CBMCTRL_S2_WRITE_N);
+            ntStatus = cbm_checkinputbuffer(irpSp, 1, STATUS_SUCCESS);
+            break;
+
+        case CBMCTRL_PP_DC_READ_N:
+            DBG_IRP(CBMCTRL_PP_DC_READ_N);
+            ntStatus = cbm_checkoutputbuffer(irpSp, 1, STATUS_SUCCESS);
+            break;
+
+        case CBMCTRL_PP_DC_WRITE_N:
+            DBG_IRP(CBMCTRL_PP_DC_WRITE_N);
+            ntStatus = cbm_checkinputbuffer(irpSp, 1, STATUS_SUCCESS);
+            break;
+
+        case CBMCTRL_IEC_PROGRAM:
+            DBG_IRP(CBMCTRL_IEC_PROGRAM);
+            ntStatus = cbm_checkinputbuffer(irpSp, 2, STATUS_SUCCESS);
+            // the results are written back into the program
+            if (NT_SUCCESS(ntStatus) && irpSp->Parameters.DeviceIoControl.OutputBufferLength
+                < irpSp->Parameters.DeviceIoControl.InputBufferLength)
+            {
+                ntStatus = STATUS_BUFFER_TOO_SMALL;
+            }
+            break;
+
         case CBMCTRL_I_INSTALL:
             DBG_IRP(CBMCTRL_I_INSTALL);
             ntStatus = cbm_checkoutputbuffer(irpSp, sizeof(CBMT_I_INSTALL_OUT), STATUS_SUCCESS);
@@ -365,6 +406,7 @@ cbm_execute_devicecontrol(IN PDEVICE_EXTENSION Pdx, IN PIRP Irp)
     PPAR_SET_INFORMATION setInfo;
     PIO_STACK_LOCATION irpSp;
     ULONG_PTR returnLength;
+    ULONG transferred;
     NTSTATUS ntStatus;
 
     FUNC_ENTER();
@@ -515,6 +557,58 @@ cbm_execute_devicecontrol(IN PDEVICE_EXTENSION Pdx, IN PIRP Irp)
                 Irp->AssociatedIrp.SystemBuffer, (ULONG) returnLength);
             break;
 
+        case CBMCTRL_S1_READ_N:
+            DBG_IRP(CBMCTRL_S1_READ_N);
+            ntStatus = cbmiec_transfer_n(Pdx, IEC_TRANSFER_S1_READ,
+                Irp->AssociatedIrp.SystemBuffer,
+                irpSp->Parameters.DeviceIoControl.OutputBufferLength, &transferred);
+            returnLength = transferred;
+            break;
+
+        case CBMCTRL_S1_WRITE_N:
+            DBG_IRP(CBMCTRL_S1_WRITE_N);
+            ntStatus = cbmiec_transfer_n(Pdx, IEC_TRANSFER_S1_WRITE,
+                Irp->AssociatedIrp.SystemBuffer,
+                irpSp->Parameters.DeviceIoControl.InputBufferLength, &transferred);
+            break;
+
+        case CBMCTRL_S2_READ_N:
+            DBG_IRP(CBMCTRL_S2_READ_N);
+            ntStatus = cbmiec_transfer_n(Pdx, IEC_TRANSFER_S2_READ,
+                Irp->AssociatedIrp.SystemBuffer,
+                irpSp->Parameters.DeviceIoControl.OutputBufferLength, &transferred);
+            returnLength = transferred;
+            break;
+
+        case CBMCTRL_S2_WRITE_N:
+            DBG_IRP(CBMCTRL_S2_WRITE_N);
+            ntStatus = cbmiec_transfer_n(Pdx, IEC_TRANSFER_S2_WRITE,
+                Irp->AssociatedIrp.SystemBuffer,
+                irpSp->Parameters.DeviceIoControl.InputBufferLength, &transferred);
+            break;
+
+        case CBMCTRL_PP_DC_READ_N:
+            DBG_IRP(CBMCTRL_PP_DC_READ_N);
+            ntStatus = cbmiec_transfer_n(Pdx, IEC_TRANSFER_PP_READ,
+                Irp->AssociatedIrp.SystemBuffer,
+                irpSp->Parameters.DeviceIoControl.OutputBufferLength, &transferred);
+            returnLength = transferred;
+            break;
+
+        case CBMCTRL_PP_DC_WRITE_N:
+            DBG_IRP(CBMCTRL_PP_DC_WRITE_N);
+            ntStatus = cbmiec_transfer_n(Pdx, IEC_TRANSFER_PP_WRITE,
+                Irp->AssociatedIrp.SystemBuffer,
+                irpSp->Parameters.DeviceIoControl.InputBufferLength, &transferred);
+            break;
+
+        case CBMCTRL_IEC_PROGRAM:
+            DBG_IRP(CBMCTRL_IEC_PROGRAM);
+            returnLength = irpSp->Parameters.DeviceIoControl.InputBufferLength;
+            ntStatus = cbmiec_iec_program(Pdx, Irp->AssociatedIrp.SystemBuffer,
+                (ULONG) returnLength);
+            break;
+
         case CBMCTRL_I_INSTALL:
             DBG_IRP(CBMCTRL_I_INSTALL);
             returnLength = irpSp->Parameters.DeviceIoControl.OutputBufferLength;
@@ -98,6 +98,140 @@ __forceinline __int64 RDTSC(void)
 }
 #pragma warning(pop)
 
+#ifdef PERFEVAL_ETW
+
+/*! The GUID of the ETW provider of the driver,
+ * {56EC1A74-870C-4F41-9CCF-5A421D3D9351} */
+static const GUID PerfEtwProviderGuid =
+    { 0x56ec1a74, 0x870c, 0x4f41, { 0x9c, 0xcf, 0x5a, 0x42, 0x1d, 0x3d, 0x93, 0x51 } };
+
+/*! The level of the events: TRACE_LEVEL_INFORMATION */
+#define PERF_ETW_LEVEL 4
+
+/* The ETW types of the Vista WDK. They are duplicated here, as the
+ * older DDKs do not know them, and the driver finds the ETW routines
+ * at run-time anyway. */
+
+/*! ETW: the handle of a registered provider, see REGHANDLE */
+typedef ULONGLONG PERF_ETW_REGHANDLE;
+
+/*! ETW: the description of an event, see EVENT_DESCRIPTOR */
+typedef struct PERF_ETW_EVENT_DESCRIPTOR
+{
+    USHORT Id;          //!< the event id
+    UCHAR Version;      //!< the version of the event
+    UCHAR Channel;      //!< the channel of the event
+    UCHAR Level;        //!< the level of the event
+    UCHAR Opcode;       //!< the opcode of the event
+    USHORT Task;        //!< the task of the event
+    ULONGLONG Keyword;  //!< the keywords of the event
+} PERF_ETW_EVENT_DESCRIPTOR;
+
+/*! ETW: the description of a part of the payload of an event,
+ * see EVENT_DATA_DESCRIPTOR */
+typedef struct PERF_ETW_EVENT_DATA_DESCRIPTOR
+{
+    ULONGLONG Ptr;      //!< the address of the data
+    ULONG Size;         //!< the size of the data
+    ULONG Reserved;     //!< must be 0
+} PERF_ETW_EVENT_DATA_DESCRIPTOR;
+
+/*! ETW: called when a trace session enables or disables the provider */
+typedef VOID (NTAPI *PERF_ETW_ENABLECALLBACK)(IN const GUID *SourceId,
+    IN ULONG IsEnabled, IN UCHAR Level, IN ULONGLONG MatchAnyKeyword,
+    IN ULONGLONG MatchAllKeyword, IN PVOID FilterData, IN PVOID CallbackContext);
+
+/*! ETW: EtwRegister() */
+typedef NTSTATUS (NTAPI *PERF_ETW_REGISTER)(IN const GUID *ProviderId,
+    IN PERF_ETW_ENABLECALLBACK EnableCallback, IN PVOID CallbackContext,
+    OUT PERF_ETW_REGHANDLE *RegHandle);
+
+/*! ETW: EtwUnregister() */
+typedef NTSTATUS (NTAPI *PERF_ETW_UNREGISTER)(IN PERF_ETW_REGHANDLE RegHandle);
+
+/*! ETW: EtwWrite() */
+typedef NTSTATUS (NTAPI *PERF_ETW_WRITE)(IN PERF_ETW_REGHANDLE RegHandle,
+    IN const PERF_ETW_EVENT_DESCRIPTOR *EventDescriptor, IN const GUID *ActivityId,
+    IN ULONG UserDataCount, IN PERF_ETW_EVENT_DATA_DESCRIPTOR *UserData);
+
+/*! EtwUnregister(), if the provider is registered */
+static PERF_ETW_UNREGISTER PerfEtwUnregister = NULL;
+
+/*! EtwWrite(), if the provider is registered */
+static PERF_ETW_WRITE PerfEtwWrite = NULL;
+
+/*! The handle of the registered provider */
+static PERF_ETW_REGHANDLE PerfEtwRegHandle = 0;
+
+/*! FLAG: A trace session wants to get our events */
+static LONG PerfEtwEnabled = 0;
+
+/*! \brief Get informed if a trace session wants our events
+
+ This function is called by ETW whenever a trace session
+ enables or disables the provider of the driver.
+
+ For the parameters, see EtwRegister() and EtwEnableCallback
+ in the WDK.
+*/
+static VOID NTAPI
+PerfEtwEnableCallback(IN const GUID *SourceId, IN ULONG IsEnabled, IN UCHAR Level,
+                      IN ULONGLONG MatchAnyKeyword, IN ULONGLONG MatchAllKeyword,
+                      IN PVOID FilterData, IN PVOID CallbackContext)
+{
+    UNREFERENCED_PARAMETER(SourceId);
+    UNREFERENCED_PARAMETER(MatchAnyKeyword);
+    UNREFERENCED_PARAMETER(MatchAllKeyword);
+    UNREFERENCED_PARAMETER(FilterData);
+    UNREFERENCED_PARAMETER(CallbackContext);
+
+    InterlockedExchange(&PerfEtwEnabled,
+        IsEnabled && (Level == 0 || Level >= PERF_ETW_LEVEL));
+}
+
+/*! \brief Register the ETW provider of the driver
+
+ \return
+   TRUE if the provider has been registered, FALSE if this
+   system does not have ETW for drivers (that is, it is older
+   than Windows Vista).
+*/
+static BOOLEAN
+PerfEtwInit(VOID)
+{
+    PERF_ETW_REGISTER etwRegister;
+    PERF_ETW_UNREGISTER etwUnregister;
+    PERF_ETW_WRITE etwWrite;
+    BOOLEAN registered = FALSE;
+
+    FUNC_ENTER();
+
+    etwRegister   = (PERF_ETW_REGISTER)   CbmGetSystemRoutineAddress(L"EtwRegister");
+    etwUnregister = (PERF_ETW_UNREGISTER) CbmGetSystemRoutineAddress(L"EtwUnregister");
+    etwWrite      = (PERF_ETW_WRITE)      CbmGetSystemRoutineAddress(L"EtwWrite");
+
+    if (etwRegister && etwUnregister && etwWrite)
+    {
+        NTSTATUS ntStatus;
+
+        ntStatus = etwRegister(&PerfEtwProviderGuid, PerfEtwEnableCallback,
+            NULL, &PerfEtwRegHandle);
+
+        DBG_PRINT((DBG_PREFIX "EtwRegister() returned %s", DebugNtStatus(ntStatus)));
+
+        if (NT_SUCCESS(ntStatus))
+        {
+            PerfEtwUnregister = etwUnregister;
+            PerfEtwWrite = etwWrite;
+            registered = TRUE;
+        }
+    }
+
+    FUNC_LEAVE_BOOLEAN(registered);
+}
+
+#endif /* #ifdef PERFEVAL_ETW */
+
 /*! \brief Initialize the performance sampling library
 
  This function initializes the performance sampling library.
@@ -114,6 +248,18 @@ PerfInit(VOID)
     DBG_ASSERT(PerformanceEvalEntries == NULL);
     DBG_ASSERT(CurrentPerformanceEvalEntry == -1);
 
+#ifdef PERFEVAL_ETW
+
+    // If the system has ETW, the events go there, and
+    // there is no need for a buffer of our own
+
+    if (PerfEtwInit())
+    {
+        FUNC_LEAVE();
+    }
+
+#endif /* #ifdef PERFEVAL_ETW */
+
     // Allocate memory for the entries
 
     PerformanceEvalEntries = (PPERFORMANCE_EVAL_ENTRY) ExAllocatePoolWithTag(NonPagedPool,
@@ -200,9 +346,44 @@ VOID
 PerfEvent(IN ULONG_PTR Event, IN ULONG_PTR Data)
 {
     ULONG currentEntry;
+#ifdef PERFEVAL_ETW
+    PERF_ETW_WRITE etwWrite = PerfEtwWrite;
+#endif /* #ifdef PERFEVAL_ETW */
 
     FUNC_ENTER();
 
+#ifdef PERFEVAL_ETW
+
+    if (etwWrite)
+    {
+        // ETW timestamps the event and records the processor
+        // and the thread, thus, only Event and Data are sent.
+
+        if (PerfEtwEnabled)
+        {
+            PERF_ETW_EVENT_DESCRIPTOR eventDescriptor;
+            PERF_ETW_EVENT_DATA_DESCRIPTOR userData[2];
+            ULONGLONG event = Event;
+            ULONGLONG data = Data;
+
+            RtlZeroMemory(&eventDescriptor, sizeof(eventDescriptor));
+            eventDescriptor.Id = (USHORT) Event;
+            eventDescriptor.Level = PERF_ETW_LEVEL;
+
+            RtlZeroMemory(userData, sizeof(userData));
+            userData[0].Ptr = (ULONGLONG) (ULONG_PTR) &event;
+            userData[0].Size = sizeof(event);
+            userData[1].Ptr = (ULONGLONG) (ULONG_PTR) &data;
+            userData[1].Size = sizeof(data);
+
+            etwWrite(PerfEtwRegHandle, &eventDescriptor, NULL, 2, userData);
+        }
+
+        FUNC_LEAVE();
+    }
+
+#endif /* #ifdef PERFEVAL_ETW */
+
     // only try to write if we successfully allocated a buffer!
 
     if (PerformanceEvalEntries)
@@ -427,6 +608,22 @@ PerfSave(VOID)
 {
     FUNC_ENTER();
 
+#ifdef PERFEVAL_ETW
+
+    if (PerfEtwWrite)
+    {
+        // stop sending events before the provider goes away
+
+        InterlockedExchange(&PerfEtwEnabled, 0);
+        PerfEtwWrite = NULL;
+
+        PerfEtwUnregister(PerfEtwRegHandle);
+        PerfEtwUnregister = NULL;
+        PerfEtwRegHandle = 0;
+    }
+
+#endif /* #ifdef PERFEVAL_ETW */
+
     if (PerformanceEvalEntries)
     {
         PVOID buffer;
@@ -0,0 +1,182 @@
+/*
+ *  This program is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU General Public License
+ *  as published by the Free Software Foundation; either version
+ *  2 of the License, or (at your option) any later version.
+ */
+
+/*! **************************************************************
+** \file sys/libiec/program.c \n
+** \n
+** \brief Run a sequence of IEC line operations
+**
+** The sequence comes with one IRP, so the operations follow each
+** other without the round trip through the IRP queue for every one
+** of them.
+**
+****************************************************************/
+
+#include <wdm.h>
+#include "cbm_driver.h"
+#include "cbmioctl.h"
+#include "i_iec.h"
+
+/*! the lines a program is allowed to set and release */
+#define PROGRAM_LINES (IEC_LINE_DATA | IEC_LINE_CLOCK | IEC_LINE_ATN | IEC_LINE_RESET)
+
+/*! \internal \brief Check if a program can be run
+
+ \param Program
+   The operations, pairs of a CBMCTRL_PROG_* opcode and its argument.
+
+ \param Length
+   The length of Program in bytes.
+
+ \return
+   TRUE if all operations are known and have valid arguments,
+   FALSE otherwise.
+*/
+static BOOLEAN
+cbmiec_i_program_valid(IN const UCHAR *Program, IN ULONG Length)
+{
+    ULONG i;
+
+    FUNC_ENTER();
+
+    if (Length & 1)
+    {
+        FUNC_LEAVE_BOOLEAN(FALSE);
+    }
+
+    for (i = 0; i < Length; i += 2)
+    {
+        UCHAR arg = Program[i + 1];
+
+        switch (Program[i])
+        {
+        case CBMCTRL_PROG_SET:
+        case CBMCTRL_PROG_RELEASE:
+            if (arg & ~PROGRAM_LINES)
+            {
+                FUNC_LEAVE_BOOLEAN(FALSE);
+            }
+            break;
+
+        case CBMCTRL_PROG_SETRELEASE:
+            if ((arg >> 4) & (arg & 0x0f))
+            {
+                FUNC_LEAVE_BOOLEAN(FALSE);
+            }
+            break;
+
+        case CBMCTRL_PROG_WAIT_SET:
+        case CBMCTRL_PROG_WAIT_RELEASE:
+            if (arg != IEC_LINE_DATA && arg != IEC_LINE_CLOCK && arg != IEC_LINE_ATN)
+            {
+                FUNC_LEAVE_BOOLEAN(FALSE);
+            }
+            break;
+
+        case CBMCTRL_PROG_POLL:
+        case CBMCTRL_PROG_DELAY:
+        case CBMCTRL_PROG_PP_READ:
+        case CBMCTRL_PROG_PP_WRITE:
+            break;
+
+        default:
+            FUNC_LEAVE_BOOLEAN(FALSE);
+        }
+    }
+
+    FUNC_LEAVE_BOOLEAN(TRUE);
+}
+
+/*! \brief Run a sequence of IEC line operations
+
+ \param Pdx
+   Pointer to the device extension.
+
+ \param Program
+   The operations, pairs of a CBMCTRL_PROG_* opcode and its argument.
+   The results of CBMCTRL_PROG_POLL and CBMCTRL_PROG_PP_READ replace
+   their argument.
+
+ \param Length
+   The length of Program in bytes.
+
+ \return
+   If the routine succeeds, it returns STATUS_SUCCESS. Otherwise, it
+   returns one of the error status values: STATUS_INVALID_PARAMETER
+   if the program cannot be run, STATUS_TIMEOUT if the IRP was
+   cancelled while waiting for a line.
+*/
+NTSTATUS
+cbmiec_iec_program(IN PDEVICE_EXTENSION Pdx, IN OUT PUCHAR Program, IN ULONG Length)
+{
+    NTSTATUS ntStatus = STATUS_SUCCESS;
+    UCHAR result;
+    ULONG i;
+
+    FUNC_ENTER();
+
+    FUNC_PARAM((DBG_PREFIX "length = %u", Length));
+
+    if (!cbmiec_i_program_valid(Program, Length))
+    {
+        FUNC_LEAVE_NTSTATUS_CONST(STATUS_INVALID_PARAMETER);
+    }
+
+    for (i = 0; (i < Length) && NT_SUCCESS(ntStatus); i += 2)
+    {
+        UCHAR arg = Program[i + 1];
+
+        switch (Program[i])
+        {
+        case CBMCTRL_PROG_SET:
+            if (arg)
+                ntStatus = cbmiec_iec_setrelease(Pdx, arg, 0);
+            break;
+
+        case CBMCTRL_PROG_RELEASE:
+            if (arg)
+                ntStatus = cbmiec_iec_setrelease(Pdx, 0, arg);
+            break;
+
+        case CBMCTRL_PROG_SETRELEASE:
+            if (arg)
+                ntStatus = cbmiec_iec_setrelease(Pdx, arg >> 4, arg & 0x0f);
+            break;
+
+        case CBMCTRL_PROG_WAIT_SET:
+        case CBMCTRL_PROG_WAIT_RELEASE:
+            ntStatus = cbmiec_iec_wait(Pdx, arg,
+                (UCHAR) (Program[i] == CBMCTRL_PROG_WAIT_SET), &result);
+            break;
+
+        case CBMCTRL_PROG_POLL:
+            ntStatus = cbmiec_iec_poll(Pdx, &Program[i + 1]);
+            break;
+
+        case CBMCTRL_PROG_DELAY:
+            if (arg)
+                cbmiec_udelay(arg);
+            break;
+
+        case CBMCTRL_PROG_PP_READ:
+            ntStatus = cbmiec_pp_read(Pdx, &Program[i + 1]);
+            break;
+
+        case CBMCTRL_PROG_PP_WRITE:
+            ntStatus = cbmiec_pp_write(Pdx, arg);
+            break;
+        }
+    }
+
+    if (!NT_SUCCESS(ntStatus))
+    {
+        DBG_PRINT((DBG_PREFIX "program stopped after %u of %u operations",
+            i / 2 - 1, Length / 2));
+    }
+
+    FUNC_LEAVE_NTSTATUS(ntStatus);
+}
@@ -0,0 +1,459 @@
+/*
+ *  This program is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU General Public License
+ *  as published by the Free Software Foundation; either version
+ *  2 of the License, or (at your option) any later version.
+ *
+ *  Copyright 1999 Michael Klein <michael(dot)klein(at)puffin(dot)lb(dot)shuttle(dot)de>
+ *  Copyright 2008 Spiro Trikaliotis
+ *
+ */
+
+/*! **************************************************************
+** \file sys/libiec/s1_s2_pp.c \n
+** \authors Based on the transfer code of libd64copy, from
+**    Michael Klein <michael(dot)klein(at)puffin(dot)lb(dot)shuttle(dot)de>
+**    and Spiro Trikaliotis
+** \n
+** \brief Block transfers with the fast protocols serial-1, serial-2
+**        and parallel (d64copy)
+**
+** The handshakes are the same as the ones of the drive routines of
+** cbmcopy, d64copy and imgcopy. Running them here saves one IOCTL
+** for every change of an IEC line.
+**
+****************************************************************/
+
+#include <wdm.h>
+#include "cbm_driver.h"
+#include "i_iec.h"
+
+/*! time for the IEC lines to change, in us */
+#define XFER_DELAY()    cbmiec_udelay(2)
+
+/*! poll a line that often before sleeping between the polls */
+#define XFER_SPIN       1000
+
+/*! \internal \brief Wait for a line to have a specific value
+
+ \param Pdx
+   Pointer to the device extension.
+
+ \param Line
+   The line to be monitored (one of PP_DATA_IN, PP_CLK_IN, PP_ATN_IN)
+
+ \param State
+   =1: Wait until that line is set
+   =0: Wait until that line is unset
+
+ \return
+   If the line changed, it returns STATUS_SUCCESS. If the IRP
+   was cancelled while waiting, it returns STATUS_TIMEOUT.
+*/
+static NTSTATUS
+cbmiec_i_xfer_wait(IN PDEVICE_EXTENSION Pdx, IN UCHAR Line, IN int State)
+{
+    ULONG i;
+
+    FUNC_ENTER();
+
+    for (i = 0; CBMIEC_GET(Line) != State; i++)
+    {
+        if (i >= XFER_SPIN)
+        {
+            // the drive is busy (e.g., reading a sector): do not hog the CPU
+            cbmiec_schedule_timeout(libiec_global_timeouts.T_8_IEC_WAIT_LONG_DELAY);
+        }
+
+        if (QueueShouldCancelCurrentIrp(&Pdx->IrpQueue))
+        {
+            FUNC_LEAVE_NTSTATUS_CONST(STATUS_TIMEOUT);
+        }
+    }
+
+    FUNC_LEAVE_NTSTATUS_CONST(STATUS_SUCCESS);
+}
+
+/*! \internal \brief Write a byte with protocol serial-1
+
+ \param Pdx
+   Pointer to the device extension.
+
+ \param Byte
+   The byte to be written.
+
+ \return
+   If the routine succeeds, it returns STATUS_SUCCESS. Otherwise, it
+   returns one of the error status values.
+*/
+static NTSTATUS
+cbmiec_i_s1_write_byte(IN PDEVICE_EXTENSION Pdx, IN UCHAR Byte)
+{
+    NTSTATUS ntStatus = STATUS_SUCCESS;
+    int i;
+
+    FUNC_ENTER();
+
+    for (i = 7; (i >= 0) && NT_SUCCESS(ntStatus); i--)
+    {
+        int bit = (Byte >> i) & 1;
+
+        // send bit, release CLK and wait for the drive to ack by setting CLK
+
+        if (bit)
+            CBMIEC_SET(PP_DATA_OUT);
+        else
+            CBMIEC_RELEASE(PP_DATA_OUT);
+        XFER_DELAY();
+        CBMIEC_RELEASE(PP_CLK_OUT);
+        XFER_DELAY();
+        ntStatus = cbmiec_i_xfer_wait(Pdx, PP_CLK_IN, 1);
+
+        // send bit inverted, wait for the drive to release CLK
+
+        if (NT_SUCCESS(ntStatus))
+        {
+            if (bit)
+                CBMIEC_RELEASE(PP_DATA_OUT);
+            else
+                CBMIEC_SET(PP_DATA_OUT);
+            ntStatus = cbmiec_i_xfer_wait(Pdx, PP_CLK_IN, 0);
+        }
+
+        // release DATA, set CLK and wait for the drive to ack by setting DATA
+
+        if (NT_SUCCESS(ntStatus))
+        {
+            CBMIEC_SET_RELEASE(PP_CLK_OUT, PP_DATA_OUT);
+            XFER_DELAY();
+            ntStatus = cbmiec_i_xfer_wait(Pdx, PP_DATA_IN, 1);
+        }
+    }
+
+    FUNC_LEAVE_NTSTATUS(ntStatus);
+}
+
+/*! \internal \brief Read a byte with protocol serial-1
+
+ \param Pdx
+   Pointer to the device extension.
+
+ \param Byte
+   Pointer to an UCHAR where the read byte is written to.
+
+ \return
+   If the routine succeeds, it returns STATUS_SUCCESS. Otherwise, it
+   returns one of the error status values.
+*/
+static NTSTATUS
+cbmiec_i_s1_read_byte(IN PDEVICE_EXTENSION Pdx, OUT PUCHAR Byte)
+{
+    NTSTATUS ntStatus = STATUS_SUCCESS;
+    UCHAR value = 0;
+    int i;
+
+    FUNC_ENTER();
+
+    for (i = 0; (i < 8) && NT_SUCCESS(ntStatus); i++)
+    {
+        int bit;
+
+        ntStatus = cbmiec_i_xfer_wait(Pdx, PP_DATA_IN, 0);
+        if (!NT_SUCCESS(ntStatus))
+            break;
+
+        CBMIEC_RELEASE(PP_CLK_OUT);
+        XFER_DELAY();
+        bit = CBMIEC_GET(PP_CLK_IN);
+        if (bit)
+            value |= 1 << i;
+        CBMIEC_SET(PP_DATA_OUT);
+        ntStatus = cbmiec_i_xfer_wait(Pdx, PP_CLK_IN, !bit);
+
+        if (NT_SUCCESS(ntStatus))
+        {
+            CBMIEC_RELEASE(PP_DATA_OUT);
+            XFER_DELAY();
+            ntStatus = cbmiec_i_xfer_wait(Pdx, PP_DATA_IN, 1);
+            CBMIEC_SET(PP_CLK_OUT);
+        }
+    }
+
+    *Byte = value;
+
+    FUNC_LEAVE_NTSTATUS(ntStatus);
+}
+
+/*! \internal \brief Write a byte with protocol serial-2
+
+ \param Pdx
+   Pointer to the device extension.
+
+ \param Byte
+   The byte to be written.
+
+ \return
+   If the routine succeeds, it returns STATUS_SUCCESS. Otherwise, it
+   returns one of the error status values.
+*/
+static NTSTATUS
+cbmiec_i_s2_write_byte(IN PDEVICE_EXTENSION Pdx, IN UCHAR Byte)
+{
+    NTSTATUS ntStatus = STATUS_SUCCESS;
+    int i;
+
+    FUNC_ENTER();
+
+    for (i = 0; (i < 8) && NT_SUCCESS(ntStatus); i += 2)
+    {
+        // first bit: release ATN and wait for CLK release
+
+        if ((Byte >> i) & 1)
+            CBMIEC_SET(PP_DATA_OUT);
+        else
+            CBMIEC_RELEASE(PP_DATA_OUT);
+        XFER_DELAY();
+        CBMIEC_RELEASE(PP_ATN_OUT);
+        ntStatus = cbmiec_i_xfer_wait(Pdx, PP_CLK_IN, 0);
+
+        // second bit: set ATN and wait for CLK set
+
+        if (NT_SUCCESS(ntStatus))
+        {
+            if ((Byte >> (i + 1)) & 1)
+                CBMIEC_SET(PP_DATA_OUT);
+            else
+                CBMIEC_RELEASE(PP_DATA_OUT);
+            XFER_DELAY();
+            CBMIEC_SET(PP_ATN_OUT);
+            ntStatus = cbmiec_i_xfer_wait(Pdx, PP_CLK_IN, 1);
+        }
+    }
+
+    CBMIEC_RELEASE(PP_DATA_OUT);
+    XFER_DELAY();
+
+    FUNC_LEAVE_NTSTATUS(ntStatus);
+}
+
+/*! \internal \brief Read a byte with protocol serial-2
+
+ \param Pdx
+   Pointer to the device extension.
+
+ \param Byte
+   Pointer to an UCHAR where the read byte is written to.
+
+ \return
+   If the routine succeeds, it returns STATUS_SUCCESS. Otherwise, it
+   returns one of the error status values.
+*/
+static NTSTATUS
+cbmiec_i_s2_read_byte(IN PDEVICE_EXTENSION Pdx, OUT PUCHAR Byte)
+{
+    NTSTATUS ntStatus = STATUS_SUCCESS;
+    UCHAR value = 0;
+    int i;
+
+    FUNC_ENTER();
+
+    for (i = 0; (i < 8) && NT_SUCCESS(ntStatus); i += 2)
+    {
+        // first bit: wait for CLK release, ack by releasing ATN
+
+        ntStatus = cbmiec_i_xfer_wait(Pdx, PP_CLK_IN, 0);
+        if (!NT_SUCCESS(ntStatus))
+            break;
+
+        XFER_DELAY();
+        if (CBMIEC_GET(PP_DATA_IN))
+            value |= 1 << i;
+        CBMIEC_RELEASE(PP_ATN_OUT);
+
+        // second bit: wait for CLK set, ack by setting ATN
+
+        ntStatus = cbmiec_i_xfer_wait(Pdx, PP_CLK_IN, 1);
+        if (!NT_SUCCESS(ntStatus))
+            break;
+
+        XFER_DELAY();
+        if (CBMIEC_GET(PP_DATA_IN))
+            value |= 1 << (i + 1);
+        CBMIEC_SET(PP_ATN_OUT);
+    }
+
+    *Byte = value;
+
+    FUNC_LEAVE_NTSTATUS(ntStatus);
+}
+
+/*! \internal \brief Write two bytes with the parallel protocol
+
+ \param Pdx
+   Pointer to the device extension.
+
+ \param Bytes
+   Pointer to the two bytes to be written.
+
+ \return
+   If the routine succeeds, it returns STATUS_SUCCESS. Otherwise, it
+   returns one of the error status values.
+*/
+static NTSTATUS
+cbmiec_i_pp_write_2_bytes(IN PDEVICE_EXTENSION Pdx, IN const UCHAR *Bytes)
+{
+    NTSTATUS ntStatus;
+
+    FUNC_ENTER();
+
+    ntStatus = cbmiec_i_xfer_wait(Pdx, PP_DATA_IN, 1);
+
+    if (NT_SUCCESS(ntStatus))
+    {
+        cbmiec_pp_write(Pdx, Bytes[0]);
+        cbmiec_udelay(1);
+        CBMIEC_RELEASE(PP_CLK_OUT);
+
+        ntStatus = cbmiec_i_xfer_wait(Pdx, PP_DATA_IN, 0);
+    }
+
+    if (NT_SUCCESS(ntStatus))
+    {
+        cbmiec_pp_write(Pdx, Bytes[1]);
+        cbmiec_udelay(1);
+        CBMIEC_SET(PP_CLK_OUT);
+    }
+
+    FUNC_LEAVE_NTSTATUS(ntStatus);
+}
+
+/*! \internal \brief Read two bytes with the parallel protocol
+
+ \param Pdx
+   Pointer to the device extension.
+
+ \param Bytes
+   Pointer to the buffer where the two bytes read are written to.
+
+ \return
+   If the routine succeeds, it returns STATUS_SUCCESS. Otherwise, it
+   returns one of the error status values.
+*/
+static NTSTATUS
+cbmiec_i_pp_read_2_bytes(IN PDEVICE_EXTENSION Pdx, OUT UCHAR *Bytes)
+{
+    NTSTATUS ntStatus;
+
+    FUNC_ENTER();
+
+    ntStatus = cbmiec_i_xfer_wait(Pdx, PP_DATA_IN, 1);
+
+    if (NT_SUCCESS(ntStatus))
+        ntStatus = cbmiec_pp_read(Pdx, &Bytes[0]);
+
+    if (NT_SUCCESS(ntStatus))
+    {
+        CBMIEC_RELEASE(PP_CLK_OUT);
+        ntStatus = cbmiec_i_xfer_wait(Pdx, PP_DATA_IN, 0);
+    }
+
+    if (NT_SUCCESS(ntStatus))
+        ntStatus = cbmiec_pp_read(Pdx, &Bytes[1]);
+
+    if (NT_SUCCESS(ntStatus))
+        CBMIEC_SET(PP_CLK_OUT);
+
+    FUNC_LEAVE_NTSTATUS(ntStatus);
+}
+
+/*! \brief Transfer a block of data with one of the fast protocols
+
+ \param Pdx
+   Pointer to the device extension.
+
+ \param Protocol
+   The protocol and direction of the transfer.
+
+ \param Buffer
+   Pointer to the buffer with the data to be written, or which
+   will hold the data read.
+
+ \param BufferLength
+   The number of bytes to be transferred. For the parallel protocol,
+   it must be even.
+
+ \param Transferred
+   Pointer to a ULONG which will contain the number of bytes transferred.
+
+ \return
+   If the routine succeeds, it returns STATUS_SUCCESS. Otherwise, it
+   returns one of the error status values; then, *Transferred tells
+   how much of the block was transferred before.
+*/
+NTSTATUS
+cbmiec_transfer_n(IN PDEVICE_EXTENSION Pdx, IN IEC_TRANSFER Protocol,
+                  IN OUT PUCHAR Buffer, IN ULONG BufferLength, OUT ULONG *Transferred)
+{
+    NTSTATUS ntStatus = STATUS_SUCCESS;
+    ULONG i;
+
+    FUNC_ENTER();
+
+    FUNC_PARAM((DBG_PREFIX "protocol = %u, length = %u", Protocol, BufferLength));
+
+    if ((Protocol == IEC_TRANSFER_PP_READ || Protocol == IEC_TRANSFER_PP_WRITE)
+        && (BufferLength & 1))
+    {
+        *Transferred = 0;
+        FUNC_LEAVE_NTSTATUS_CONST(STATUS_INVALID_PARAMETER);
+    }
+
+    for (i = 0; (i < BufferLength) && NT_SUCCESS(ntStatus); )
+    {
+        switch (Protocol)
+        {
+        case IEC_TRANSFER_S1_READ:
+            ntStatus = cbmiec_i_s1_read_byte(Pdx, &Buffer[i]);
+            break;
+
+        case IEC_TRANSFER_S1_WRITE:
+            ntStatus = cbmiec_i_s1_write_byte(Pdx, Buffer[i]);
+            break;
+
+        case IEC_TRANSFER_S2_READ:
+            ntStatus = cbmiec_i_s2_read_byte(Pdx, &Buffer[i]);
+            break;
+
+        case IEC_TRANSFER_S2_WRITE:
+            ntStatus = cbmiec_i_s2_write_byte(Pdx, Buffer[i]);
+            break;
+
+        case IEC_TRANSFER_PP_READ:
+            ntStatus = cbmiec_i_pp_read_2_bytes(Pdx, &Buffer[i]);
+            break;
+
+        case IEC_TRANSFER_PP_WRITE:
+            ntStatus = cbmiec_i_pp_write_2_bytes(Pdx, &Buffer[i]);
+            break;
+
+        default:
+            ntStatus = STATUS_INVALID_PARAMETER;
+            break;
+        }
+
+        if (NT_SUCCESS(ntStatus))
+        {
+            i += (Protocol == IEC_TRANSFER_PP_READ || Protocol == IEC_TRANSFER_PP_WRITE) ? 2 : 1;
+        }
+    }
+
+    if (!NT_SUCCESS(ntStatus))
+    {
+        DBG_PRINT((DBG_PREFIX "transfer failure! Wanted to transfer %u, but only transferred %u",
+            BufferLength, i));
+    }
+
+    *Transferred = i;
+
+    FUNC_LEAVE_NTSTATUS(ntStatus);
+}
@@ -154,6 +154,10 @@ SOURCE=.\ppwrite.c
 # End Source File
 # Begin Source File
 
+SOURCE=.\program.c
+# End Source File
+# Begin Source File
+
 SOURCE=.\rawread.c
 # End Source File
 # Begin Source File
@@ -174,6 +178,10 @@ SOURCE=.\reset.c
 # End Source File
 # Begin Source File
 
+SOURCE=.\s1_s2_pp.c
+# End Source File
+# Begin Source File
+
 SOURCE=.\sendbyte.c
 # End Source File
 # Begin Source File
@@ -0,0 +1,54 @@
+/*
+ *  This program is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU General Public License
+ *  as published by the Free Software Foundation; either version
+ *  2 of the License, or (at your option) any later version.
+ */
+
+/*! **************************************************************
+** \file sys/libwin/systemroutine.c \n
+** \n
+** \brief Functions for finding kernel routines at run-time
+**
+****************************************************************/
+
+#include <ntddk.h>
+#include "cbm_driver.h"
+
+/*! \brief Wrapper for MmGetSystemRoutineAddress()
+
+ See MmGetSystemRoutineAddress()
+
+ \param RoutineName
+   The name of the routine to find.
+
+ \return
+   The address of the routine, or NULL if the running system
+   does not export it.
+
+ \remark
+    This function is necessary for using routines which only
+    exist on later versions of Windows, without making the driver
+    fail to load on the earlier ones.
+    On Windows 95/98/Me, MmGetSystemRoutineAddress() itself is not
+    available, thus, no routine is ever found there.
+*/
+PVOID
+CbmGetSystemRoutineAddress(IN PCWSTR RoutineName)
+{
+#ifdef COMPILE_W98_API
+
+    UNREFERENCED_PARAMETER(RoutineName);
+
+    return NULL;
+
+#else
+
+    UNICODE_STRING routineName;
+
+    RtlInitUnicodeString(&routineName, RoutineName);
+
+    return MmGetSystemRoutineAddress(&routineName);
+
+#endif
+}
@@ -48,11 +48,14 @@
 #endif
 
 #include <linux/delay.h>
+#include <linux/device.h>
 #include <linux/errno.h>
 #include <linux/fs.h>
 #include <linux/kernel.h>
 #include <linux/miscdevice.h>
+#include <linux/poll.h>
 #include <linux/sched.h>
+#include <linux/timer.h>
 #if LINUX_VERSION_CODE >= KERNEL_VERSION(4, 11, 0)
 #include <linux/sched/signal.h>
 #endif
@@ -251,27 +254,40 @@ static void cbmprocfs_cleanup(void)
 
 #endif
 
+struct cbm_port;
+
+/* forward references for the fast transfer protocols */
+static int cbm_transfer_n(struct cbm_port *cbm, unsigned int cmd, unsigned char *buffer, int length);
+static int cbm_iec_program(struct cbm_port *cbm, unsigned char *program, int length);
+
 /* forward references for parallel burst routines */
-int cbm_parallel_burst_read_track(unsigned char *buffer);
-int cbm_parallel_burst_read_track_var(unsigned char *buffer);
-int cbm_parallel_burst_write_track(unsigned char *buffer, int length);
-unsigned char cbm_parallel_burst_read(void);
-int cbm_parallel_burst_write(unsigned char c);
-int cbm_handshaked_read(int toggle);
-int cbm_handshaked_write(char data, int toggle);
+int cbm_parallel_burst_read_track(struct cbm_port *cbm, unsigned char *buffer);
+int cbm_parallel_burst_read_track_var(struct cbm_port *cbm, unsigned char *buffer);
+int cbm_parallel_burst_write_track(struct cbm_port *cbm, unsigned char *buffer, int length);
+unsigned char cbm_parallel_burst_read(struct cbm_port *cbm);
+int cbm_parallel_burst_write(struct cbm_port *cbm, unsigned char c);
+int cbm_handshaked_read(struct cbm_port *cbm, int toggle);
+int cbm_handshaked_write(struct cbm_port *cbm, char data, int toggle);
 
 /* Defines needed for parallel burst end */
 
+#define CBM_MAX_PORTS 4       /* parallel ports driven at the same time */
+
 #ifdef DIRECT_PORT_ACCESS
-unsigned int port = 0x378;    /* lpt port address             */
-unsigned int irq = 7;         /* lpt irq line                 */
+int port[CBM_MAX_PORTS] = { 0x378 };      /* lpt port addresses   */
+int port_num;
+int irq[CBM_MAX_PORTS] = { 7, 7, 7, 7 };  /* lpt irq lines        */
+int irq_num;
 #else
-unsigned int lp = 0;          /* parport number               */
+int lp[CBM_MAX_PORTS];        /* parport numbers              */
+int lp_num;
 #endif /* DIRECT_PORT_ACCESS */
 
-int cable = -1;               /* <0 => autodetect             */
+int cable[CBM_MAX_PORTS] = { -1, -1, -1, -1 };
+                              /* <0 => autodetect             */
                               /* =0 => non-inverted (XM1541)  */
                               /* >0 => inverted     (XA1541)  */
+int cable_num;
 
 #ifdef DIRECT_PORT_ACCESS
 int reset = -1;               /* <0 => smart reset            */
@@ -283,19 +299,19 @@ int hold_clk = 1;       /* >0 => strict C64 behaviour   */
                               /* =0 => release CLK when idle  */
 
 #ifdef DIRECT_PORT_ACCESS
-module_param(port, int, 0444);
-MODULE_PARM_DESC(port, "IO portnumber of parallel port. (default 0x378)");
+module_param_array(port, int, &port_num, 0444);
+MODULE_PARM_DESC(port, "IO portnumbers of the parallel ports, comma separated. (default 0x378)");
 
-module_param(irq, int, 0444);
-MODULE_PARM_DESC(irq, "IRQ number of parallel port. (default 7)");
+module_param_array(irq, int, &irq_num, 0444);
+MODULE_PARM_DESC(irq, "IRQ numbers of the parallel ports. (default 7)");
 #else
-module_param(lp, int, 0444);
-MODULE_PARM_DESC(lp, "parallel port number. (default 0)");
+module_param_array(lp, int, &lp_num, 0444);
+MODULE_PARM_DESC(lp, "parallel port numbers, comma separated. (default 0)");
 #endif /* DIRECT_PORT_ACCESS */
 
-module_param(cable, int, 0444);
+module_param_array(cable, int, &cable_num, 0444);
 MODULE_PARM_DESC(cable,
-             "cable type: <0=autodetect, 0=non-inverted (XM1541), >0=inverted (XA1541). (default -1)");
+             "cable types of the ports: <0=autodetect, 0=non-inverted (XM1541), >0=inverted (XA1541). (default -1)");
 
 module_param(reset, int, 0444);
 MODULE_PARM_DESC(reset,
@@ -346,52 +362,96 @@ MODULE_ALIAS_MISCDEV(CBM_MINOR);
 #define CLK_IN     0x20
 #define DATA_IN    0x40
 
-static unsigned char out_bits, out_eor;
-static int busy;
-static int data_reverse;
+/*
+ *  counters of a port, shown in /sys/class/misc/cbm<n>/statistics/;
+ *  they are not locked, an update lost to the interrupt does not matter
+ */
+struct cbm_statistics {
+    unsigned long opens;
+    unsigned long ioctls;
+    unsigned long resets;
+    unsigned long bytes_read;           /* standard IEC protocol       */
+    unsigned long bytes_written;
+    unsigned long fast_bytes_read;      /* S1, S2 and PP protocols     */
+    unsigned long fast_bytes_written;
+    unsigned long iec_program_ops;
+    unsigned long errors;               /* no device, I/O error        */
+    unsigned long interrupts;
+    unsigned long spurious_interrupts;
+    unsigned long line_sleeps;          /* wait_line() had to sleep    */
+    unsigned long irq_wakeups;          /* ... and the interrupt woke it */
+};
+
+/* one parallel port with a cable, that is, one /dev/cbm device */
+struct cbm_port {
+    struct miscdevice misc;
+    char name[8];               /* "cbm" for the first port, "cbm<n>" else */
+
+    unsigned char out_bits, out_eor;
+    int busy;
+    int data_reverse;
+    int cable;
 
 #ifdef DIRECT_PORT_ACCESS
-static int in_port;
-static int out_port;
+    int port;
+    int in_port;
+    int out_port;
+    int irq;
+#else
+    struct pardevice *device;
 #endif
 
-#ifndef DIRECT_PORT_ACCESS
-static struct pardevice *cbm_device;
-#endif
+    wait_queue_head_t wait_q;
+    struct timer_list poll_timer;   /* looks at CLK for cbm_poll()      */
+    volatile int eoi;
+    volatile int irq_count;
+    volatile int irq_waiting;   /* wait_line() sleeps until the next interrupt */
+
+    unsigned char *track_buffer;
 
+    struct cbm_statistics stats;
+};
+
+static struct cbm_port cbm_ports[CBM_MAX_PORTS];
+static int cbm_port_count;
+
+/*
+ *  The macros below access the port cbm, which every function
+ *  using them has as parameter
+ */
 #define GET(line)        ((POLL() & line) == 0 ? 1 : 0)
-#define SET(line)        (CTRL_WRITE(out_eor ^ (out_bits |= line)))
-#define RELEASE(line)    (CTRL_WRITE(out_eor ^ (out_bits &= ~(line))))
-#define SET_RELEASE(s,r) (CTRL_WRITE(out_eor ^ \
-                              (out_bits = (out_bits | (s)) & ~(r))))
+#define SET(line)        (CTRL_WRITE(cbm->out_eor ^ (cbm->out_bits |= line)))
+#define RELEASE(line)    (CTRL_WRITE(cbm->out_eor ^ (cbm->out_bits &= ~(line))))
+#define SET_RELEASE(s,r) (CTRL_WRITE(cbm->out_eor ^ \
+                              (cbm->out_bits = (cbm->out_bits | (s)) & ~(r))))
 
 #ifdef DIRECT_PORT_ACCESS
-# define POLL()           (inb(in_port))
-# define XP_READ()        (inb(port))
-# define XP_WRITE(c)      (outb(c,port))
-# define CTRL_READ()      (inb(out_port))
-# define CTRL_WRITE(c)    (outb(c,out_port))
+# define POLL()           (inb(cbm->in_port))
+# define XP_READ()        (inb(cbm->port))
+# define XP_WRITE(c)      (outb(c,cbm->port))
+# define CTRL_READ()      (inb(cbm->out_port))
+# define CTRL_WRITE(c)    (outb(c,cbm->out_port))
 #else
-# define POLL()           (parport_read_status(cbm_device->port))
-# define XP_READ()        (parport_read_data(cbm_device->port))
-# define XP_WRITE(c)      (parport_write_data(cbm_device->port,c))
-# define CTRL_READ()      (parport_read_control(cbm_device->port))
-# define CTRL_WRITE(c)    (parport_write_control(cbm_device->port,c))
+# define POLL()           (parport_read_status(cbm->device->port))
+# define XP_READ()        (parport_read_data(cbm->device->port))
+# define XP_WRITE(c)      (parport_write_data(cbm->device->port,c))
+# define CTRL_READ()      (parport_read_control(cbm->device->port))
+# define CTRL_WRITE(c)    (parport_write_control(cbm->device->port,c))
 #endif
 
 #ifdef FOUR_BIT_CONTROL
-# define set_data_forward() do { parport_data_forward(cbm_device->port); \
-                                 data_reverse = 0; } while (0)
-# define set_data_reverse() do { parport_data_reverse(cbm_device->port); \
-                                 data_reverse = 1; } while (0)
+# define set_data_forward() do { parport_data_forward(cbm->device->port); \
+                                 cbm->data_reverse = 0; } while (0)
+# define set_data_reverse() do { parport_data_reverse(cbm->device->port); \
+                                 cbm->data_reverse = 1; } while (0)
 #else
-# define set_data_forward() do { RELEASE(LP_BIDIR); data_reverse = 0; } while (0)
-# define set_data_reverse() do { SET(LP_BIDIR); data_reverse = 1; } while (0)
+# define set_data_forward() do { RELEASE(LP_BIDIR); cbm->data_reverse = 0; } while (0)
+# define set_data_reverse() do { SET(LP_BIDIR); cbm->data_reverse = 1; } while (0)
 #endif
 
 #ifdef DEBUG
 # define DPRINTK(fmt,args...)     printk(fmt, ## args)
-# define SHOW(str)                show(str)
+# define SHOW(str)                show(cbm, str)
 #else
 # define DPRINTK(fmt,args...)
 # define SHOW(str)
@@ -403,35 +463,110 @@ static struct pardevice *cbm_device;
 # define DPRINTK_INT(fmt,args...)
 #endif
 
-static wait_queue_head_t cbm_wait_q;
-static volatile int eoi;
-static volatile int cbm_irq_count;
-
 #if defined(DIRECT_PORT_ACCESS) && (LINUX_VERSION_CODE >= KERNEL_VERSION(2,6,18))
 # define SA_INTERRUPT IRQF_DISABLED
 #endif
 
 #define BUFFER_SIZE 0x2000
-static unsigned char *track_buffer;
 
 /*
  *  dump input lines
  */
 #ifdef DEBUG
-static void show(char *s)
+static void show(struct cbm_port *cbm, char *s)
 {
     printk("%s: data=%d, clk=%d, atn=%d\n", s,
            GET(DATA_IN), GET(CLK_IN), GET(ATN_IN));
 }
 #endif /* DEBUG */
 
+/*
+ *  sleep for some microseconds without keeping the CPU busy
+ */
+#if LINUX_VERSION_CODE >= KERNEL_VERSION(2,6,36)
+/* high resolution timer; the slack of 25% lets the kernel merge wakeups */
+# define SLEEP_US(us)     usleep_range((us), (us) + (us) / 4)
+#else
+# define SLEEP_US(us)     do { set_current_state(TASK_INTERRUPTIBLE); \
+                               schedule_timeout(1); } while (0)
+#endif
+
+#define WAIT_SLEEP_MIN_US 20    /* first sleep of wait_line()             */
+#define WAIT_SLEEP_MAX_US 1000  /* longest sleep of wait_line()           */
+
 static void timeout_us(int us)
 {
-    set_current_state(TASK_INTERRUPTIBLE);
-    schedule_timeout(HZ / 1000000 * us);
+    SLEEP_US(us);
+}
+
+/*
+ *  enable/disable the interrupt of the ACK line, which is DATA_IN
+ */
+static void irq_enable(struct cbm_port *cbm)
+{
+#ifdef FOUR_BIT_CONTROL
+    parport_enable_irq(cbm->device->port);
+#else
+    SET(LP_IRQ);
+#endif
 }
 
-static int check_if_bus_free(void)
+static void irq_disable(struct cbm_port *cbm)
+{
+#ifdef FOUR_BIT_CONTROL
+    parport_disable_irq(cbm->device->port);
+#else
+    RELEASE(LP_IRQ);
+#endif
+}
+
+/*
+ *  wait until line is set (state != 0) or released (state == 0)
+ *
+ *  Busy wait for spin_us first, as the drive answers quickly most of
+ *  the time. Then sleep, doubling the time up to WAIT_SLEEP_MAX_US.
+ *  When waiting for DATA to be released, which raises the ACK
+ *  interrupt, the interrupt ends the sleep right away.
+ */
+static int wait_line(struct cbm_port *cbm, unsigned char line, int state, int spin_us)
+{
+    int i, sleep = WAIT_SLEEP_MIN_US;
+    int use_irq = (line == DATA_IN) && !state;
+
+    state = state ? 1 : 0;
+
+    for (i = 0; GET(line) != state; i++) {
+        if (i < spin_us) {
+            udelay(1);
+            continue;
+        }
+
+        if (signal_pending(current))
+            return -EINTR;
+
+        cbm->stats.line_sleeps++;
+        if (use_irq) {
+            cbm->irq_waiting = 1;
+            irq_enable(cbm);
+            /* the timeout only matters if the interrupt got lost */
+            wait_event_interruptible_timeout(cbm->wait_q,
+                !cbm->irq_waiting || GET(line) == state,
+                usecs_to_jiffies(sleep) + 1);
+            irq_disable(cbm);
+            if (!cbm->irq_waiting)
+                cbm->stats.irq_wakeups++;
+            cbm->irq_waiting = 0;
+        } else {
+            SLEEP_US(sleep);
+        }
+
+        if (sleep < WAIT_SLEEP_MAX_US)
+            sleep = min(sleep * 2, WAIT_SLEEP_MAX_US);
+    }
+    return 0;
+}
+
+static int check_if_bus_free(struct cbm_port *cbm)
 {
     int ret = 0;
 
@@ -466,12 +601,12 @@ static int check_if_bus_free(void)
     return ret;
 }
 
-static void wait_for_free_bus(void)
+static void wait_for_free_bus(struct cbm_port *cbm)
 {
     int i = 1;
 
     while (1) {
-        if (check_if_bus_free()) {
+        if (check_if_bus_free(cbm)) {
             printk("cbm: bus is free!\n");
             break;
         }
@@ -486,30 +621,31 @@ static void wait_for_free_bus(void)
     }
 }
 
-static void do_reset(void)
+static void do_reset(struct cbm_port *cbm)
 {
     printk("cbm: resetting devices\n");
+    cbm->stats.resets++;
 #ifdef FOUR_BIT_CONTROL
     RELEASE(DATA_OUT | ATN_OUT | CLK_OUT);
-    parport_data_forward(cbm_device->port);
-    parport_disable_irq(cbm_device->port);
+    parport_data_forward(cbm->device->port);
+    parport_disable_irq(cbm->device->port);
 #else
     RELEASE(DATA_OUT | ATN_OUT | CLK_OUT | LP_BIDIR | LP_IRQ);
 #endif
-    data_reverse = 0;
+    cbm->data_reverse = 0;
     SET(RESET);
     set_current_state(TASK_INTERRUPTIBLE);
     schedule_timeout(HZ / 10);  /* 100ms */
     RELEASE(RESET);
 
     printk("cbm: waiting for free bus...\n");
-    wait_for_free_bus();
+    wait_for_free_bus(cbm);
 }
 
 /*
  *  send byte
  */
-static int send_byte(int b)
+static int send_byte(struct cbm_port *cbm, int b)
 {
     int i, ack = 0;
     unsigned long flags;
@@ -538,32 +674,44 @@ static int send_byte(int b)
 /*
  *  wait until listener is ready to receive
  */
-static void wait_for_listener(void)
+static void wait_for_listener(struct cbm_port *cbm)
 {
     DECLARE_WAITQUEUE(wait, current);
 
-#ifdef FOUR_BIT_CONTROL
-    parport_enable_irq(cbm_device->port);
-#else
-    SET(LP_IRQ);
-#endif
-    add_wait_queue(&cbm_wait_q, &wait);
+    irq_enable(cbm);
+    add_wait_queue(&cbm->wait_q, &wait);
     DPRINTK_INT("cbm: wait_for_listener() waits for interrupt\n");
     set_current_state(TASK_INTERRUPTIBLE);
     RELEASE(CLK_OUT);
-    while (cbm_irq_count && !signal_pending(current))
+    while (cbm->irq_count && !signal_pending(current))
         schedule();
-    remove_wait_queue(&cbm_wait_q, &wait);
-#ifdef FOUR_BIT_CONTROL
-    parport_disable_irq(cbm_device->port);
-#else
-    RELEASE(LP_IRQ);
-#endif
+    remove_wait_queue(&cbm->wait_q, &wait);
+    irq_disable(cbm);
     DPRINTK_INT("cbm: wait_for_listener() got an interrupt\n");
 }
 
+/*
+ *  read/write the parallel data lines, switching their direction if needed
+ */
+static unsigned char pp_read(struct cbm_port *cbm)
+{
+    if (!cbm->data_reverse) {
+        XP_WRITE(0xff);
+        set_data_reverse();
+    }
+    return XP_READ();
+}
+
+static void pp_write(struct cbm_port *cbm, unsigned char c)
+{
+    if (cbm->data_reverse)
+        set_data_forward();
+    XP_WRITE(c);
+}
+
 static ssize_t cbm_read(struct file *f, char *buf, size_t count, loff_t *ppos)
 {
+    struct cbm_port *cbm = f->private_data;
     size_t received = 0;
     int i, b, bit;
     int ok = 0;
@@ -571,29 +719,28 @@ static ssize_t cbm_read(struct file *f, char *buf, size_t count, loff_t *ppos)
 
     DPRINTK("cbm_read: %zu bytes\n", count);
 
-    if (eoi)
+    if (cbm->eoi)
         return 0;
 
     do {
-        i = 0;
-        while (GET(CLK_IN)) {
-            if (i >= 50) {
-                set_current_state(TASK_INTERRUPTIBLE);
-                schedule_timeout(HZ / 50);
-                if (signal_pending(current))
-                    return -EINTR;
-            } else {
-                i++;
-                udelay(20);
-            }
+        /* the talker holds CLK until it is ready to send */
+        if ((f->f_flags & O_NONBLOCK) && GET(CLK_IN)) {
+            if (received)
+                break;
+            return -EAGAIN;
         }
+
+        /* wait for the talker to be ready to send */
+        if (wait_line(cbm, CLK_IN, 0, 1000))
+            return -EINTR;
+
         local_irq_save(flags);
         RELEASE(DATA_OUT);
         for (i = 0; (i < 40) && !(ok = GET(CLK_IN)); i++)
             udelay(10);
         if (!ok) {
             /* device signals eoi */
-            eoi = 1;
+            cbm->eoi = 1;
             SET(DATA_OUT);
             udelay(70);
             RELEASE(DATA_OUT);
@@ -628,20 +775,23 @@ static ssize_t cbm_read(struct file *f, char *buf, size_t count, loff_t *ppos)
                 schedule();
         }
 
-    } while (received < count && ok && !eoi);
+    } while (received < count && ok && !cbm->eoi);
+
+    cbm->stats.bytes_read += received;
 
     if (!ok) {
         printk("cbm_read: I/O error\n");
+        cbm->stats.errors++;
         return -EIO;
     }
 
     DPRINTK("received=%zu, count=%zu, ok=%d, eoi=%d\n",
-        received, count, ok, eoi);
+        received, count, ok, cbm->eoi);
 
     return received;
 }
 
-static int cbm_raw_write(const char *buf, size_t cnt, int atn, int talk)
+static int cbm_raw_write(struct cbm_port *cbm, const char *buf, size_t cnt, int atn, int talk)
 {
     unsigned char c;
     int i;
@@ -649,7 +799,7 @@ static int cbm_raw_write(const char *buf, size_t cnt, int atn, int talk)
     size_t sent = 0;
     unsigned long flags;
 
-    eoi = cbm_irq_count = 0;
+    cbm->eoi = cbm->irq_count = 0;
 
     DPRINTK("cbm_write: %zu bytes, atn=%d\n", cnt, atn);
 
@@ -662,6 +812,7 @@ static int cbm_raw_write(const char *buf, size_t cnt, int atn, int talk)
     if (!GET(DATA_IN)) {
         printk("cbm_write: no devices found\n");
         RELEASE(CLK_OUT | ATN_OUT);
+        cbm->stats.errors++;
         return -ENODEV;
     }
 
@@ -675,14 +826,14 @@ static int cbm_raw_write(const char *buf, size_t cnt, int atn, int talk)
             c = *buf++;
         udelay(50);
         if (GET(DATA_IN)) {
-            cbm_irq_count = ((sent == (cnt - 1))
+            cbm->irq_count = ((sent == (cnt - 1))
                      && (atn == 0)) ? 2 : 1;
-            wait_for_listener();
+            wait_for_listener(cbm);
 
             if (signal_pending(current)) {
                 rv = -EINTR;
             } else {
-                if (send_byte(c)) {
+                if (send_byte(cbm, c)) {
                     sent++;
                     udelay(100);
                 } else {
@@ -697,6 +848,7 @@ static int cbm_raw_write(const char *buf, size_t cnt, int atn, int talk)
         IMPLANT_FAIL(FAILCOUNTER_WRITE, " cbm_raw_write", { rv = -EIO; printk("redoing: talk = %d, rv = %d, sent = %d", talk, rv, sent); break; })
     }
     DPRINTK("%zu bytes sent, rv=%d\n", sent, rv);
+    cbm->stats.bytes_written += sent;
 
     if (talk && (rv == 0)) {
         local_irq_save(flags);
@@ -717,23 +869,89 @@ static int cbm_raw_write(const char *buf, size_t cnt, int atn, int talk)
     }
     udelay(100);
 
+    if ((rv < 0) && (rv != -EINTR))
+        cbm->stats.errors++;
+
     return (rv < 0) ? rv : (int)sent;
 }
 
 static ssize_t cbm_write(struct file *f, const char *buf, size_t cnt,
              loff_t *ppos)
 {
-    return cbm_raw_write(buf, cnt, 0, 0);
+    struct cbm_port *cbm = f->private_data;
+
+    return cbm_raw_write(cbm, buf, cnt, 0, 0);
+}
+
+/*
+ *  poll()/select() support
+ *
+ *  A read does not block if the talker has released CLK, or after EOI;
+ *  with O_NONBLOCK, it returns -EAGAIN instead of waiting for the talker.
+ *  No interrupt tells when the talker does so, thus the poll timer looks
+ *  at CLK every jiffy while a poll() waits. A write always does the
+ *  complete handshake with the listener, so it is always possible.
+ */
+#if LINUX_VERSION_CODE < KERNEL_VERSION(4,16,0)
+typedef unsigned int __poll_t;
+# define CBM_POLLIN  (POLLIN | POLLRDNORM)
+# define CBM_POLLOUT (POLLOUT | POLLWRNORM)
+#else
+# define CBM_POLLIN  (EPOLLIN | EPOLLRDNORM)
+# define CBM_POLLOUT (EPOLLOUT | EPOLLWRNORM)
+#endif
+
+#if LINUX_VERSION_CODE < KERNEL_VERSION(6,2,0)
+# define timer_delete_sync(t) del_timer_sync(t)
+#endif
+
+static int talker_ready(struct cbm_port *cbm)
+{
+    return cbm->eoi || !GET(CLK_IN);
+}
+
+#if LINUX_VERSION_CODE >= KERNEL_VERSION(4,15,0)
+static void cbm_poll_timer(struct timer_list *t)
+{
+    struct cbm_port *cbm = container_of(t, struct cbm_port, poll_timer);
+#else
+static void cbm_poll_timer(unsigned long data)
+{
+    struct cbm_port *cbm = (struct cbm_port *) data;
+#endif
+
+    if (talker_ready(cbm))
+        wake_up_interruptible(&cbm->wait_q);
+    else
+        mod_timer(&cbm->poll_timer, jiffies + 1);
+}
+
+static __poll_t cbm_poll(struct file *f, poll_table *wait)
+{
+    struct cbm_port *cbm = f->private_data;
+    __poll_t mask = CBM_POLLOUT;
+
+    poll_wait(f, &cbm->wait_q, wait);
+
+    if (talker_ready(cbm))
+        mask |= CBM_POLLIN;
+    else
+        mod_timer(&cbm->poll_timer, jiffies + 1);
+
+    return mask;
 }
 
 static long cbm_unlocked_ioctl(struct file *f,
              unsigned int cmd, unsigned long arg)
 {
-    unsigned char buf[2], c, talk, mask, state, i;
+    struct cbm_port *cbm = f->private_data;
+    unsigned char buf[2], c, talk, mask;
     int rv = 0;
     int intarg = 0;
     PARBURST_RW_VALUE val;
 
+    cbm->stats.ioctls++;
+
     if (cmd == CBMCTRL_TALK
         || cmd == CBMCTRL_LISTEN
         || cmd == CBMCTRL_OPEN
@@ -749,7 +967,7 @@ static long cbm_unlocked_ioctl(struct file *f,
 
     switch (cmd) {
     case CBMCTRL_RESET:
-        do_reset();
+        do_reset(cbm);
         return 0;
 
     case CBMCTRL_TALK:
@@ -757,33 +975,33 @@ static long cbm_unlocked_ioctl(struct file *f,
         talk = (cmd == CBMCTRL_TALK);
         buf[0] |= talk ? 0x40 : 0x20;
         buf[1] |= 0x60;
-        rv = cbm_raw_write(buf, 2, 1, talk);
+        rv = cbm_raw_write(cbm, buf, 2, 1, talk);
         return rv > 0 ? 0 : rv;
 
     case CBMCTRL_UNTALK:
     case CBMCTRL_UNLISTEN:
         buf[0] = (cmd == CBMCTRL_UNTALK) ? 0x5f : 0x3f;
-        rv = cbm_raw_write(buf, 1, 1, 0);
+        rv = cbm_raw_write(cbm, buf, 1, 1, 0);
         return rv > 0 ? 0 : rv;
 
     case CBMCTRL_OPEN:
     case CBMCTRL_CLOSE:
         buf[0] |= 0x20;
         buf[1] |= (cmd == CBMCTRL_OPEN) ? 0xf0 : 0xe0;
-        rv = cbm_raw_write(buf, 2, 1, 0);
+        rv = cbm_raw_write(cbm, buf, 2, 1, 0);
         if ((cmd == CBMCTRL_CLOSE) && (rv == 0)) {
             /* issue an unlisten */
             buf[0] = 0x3f;
-            cbm_raw_write(buf, 1, 1, 0);
+            cbm_raw_write(cbm, buf, 1, 1, 0);
         }
         return rv > 0 ? 0 : rv;
 
     case CBMCTRL_GET_EOI:
-        put_user(eoi ? 1 : 0, (int *)arg);
+        put_user(cbm->eoi ? 1 : 0, (int *)arg);
         return 0;
 
     case CBMCTRL_CLEAR_EOI:
-        eoi = 0;
+        cbm->eoi = 0;
         return 0;
 
     case CBMCTRL_IEC_WAIT:
@@ -800,19 +1018,8 @@ static long cbm_unlocked_ioctl(struct file *f,
         default:
             return -EINVAL;
         }
-        state = (intarg & 0xff) ? mask : 0;
-        i = 0;
-        while ((POLL() & mask) == state) {
-            if (i >= 20) {
-                set_current_state(TASK_INTERRUPTIBLE);
-                schedule_timeout(HZ / 50);  /* 20ms */
-                if (signal_pending(current))
-                    return -EINTR;
-            } else {
-                i++;
-                udelay(10);
-            }
-        }
+        if (wait_line(cbm, mask, intarg & 0xff, 200))
+            return -EINTR;
         /* falls through */
 #if LINUX_VERSION_CODE >= KERNEL_VERSION(5, 4, 0)
         fallthrough;
@@ -915,43 +1122,37 @@ static long cbm_unlocked_ioctl(struct file *f,
         return 0;
 
     case CBMCTRL_PP_READ:
-        if (!data_reverse) {
-            XP_WRITE(0xff);
-            set_data_reverse();
-        }
-        put_user(XP_READ(), (unsigned char *)arg);
+        put_user(pp_read(cbm), (unsigned char *)arg);
         return 0;
 
     case CBMCTRL_PP_WRITE:
-        if (data_reverse)
-            set_data_forward();
-        XP_WRITE(intarg);
+        pp_write(cbm, intarg);
         return 0;
 
 /* and now the parallel burst-routines */
 
     case CBMCTRL_PARBURST_READ:
-        put_user(cbm_parallel_burst_read(), (unsigned char *)arg);
+        put_user(cbm_parallel_burst_read(cbm), (unsigned char *)arg);
         return 0;
 
     case CBMCTRL_PARBURST_WRITE:
         get_user(c, (unsigned char *)arg);
-        return cbm_parallel_burst_write(c);
+        return cbm_parallel_burst_write(cbm, c);
 
     case CBMCTRL_PARBURST_READ_TRACK:
         if (copy_from_user(&val, (PARBURST_RW_VALUE *) arg,
             sizeof(PARBURST_RW_VALUE))) return -EFAULT;
         if (val.length < BUFFER_SIZE) return -EFAULT;
-        rv = cbm_parallel_burst_read_track(track_buffer);
-        if (copy_to_user(val.buffer, track_buffer, BUFFER_SIZE)) return -EFAULT;
+        rv = cbm_parallel_burst_read_track(cbm, cbm->track_buffer);
+        if (copy_to_user(val.buffer, cbm->track_buffer, BUFFER_SIZE)) return -EFAULT;
         return rv;
 
     case CBMCTRL_PARBURST_READ_TRACK_VAR:
         if (copy_from_user(&val, (PARBURST_RW_VALUE *) arg,
             sizeof(PARBURST_RW_VALUE))) return -EFAULT;
         if (val.length < BUFFER_SIZE) return -EFAULT;
-        rv = cbm_parallel_burst_read_track_var(track_buffer);
-        if (copy_to_user(val.buffer, track_buffer, BUFFER_SIZE)) return -EFAULT;
+        rv = cbm_parallel_burst_read_track_var(cbm, cbm->track_buffer);
+        if (copy_to_user(val.buffer, cbm->track_buffer, BUFFER_SIZE)) return -EFAULT;
         return rv;
 
     case CBMCTRL_PARBURST_WRITE_TRACK:
@@ -959,18 +1160,49 @@ static long cbm_unlocked_ioctl(struct file *f,
             sizeof(PARBURST_RW_VALUE))) return -EFAULT;
         if (val.length > BUFFER_SIZE) return -EFAULT;
         if (copy_from_user(buf, val.buffer, val.length)) return -EFAULT;
-        return cbm_parallel_burst_write_track(buf, val.length);
+        return cbm_parallel_burst_write_track(cbm, buf, val.length);
+
+/* and the block transfers of the fast protocols */
+
+    case CBMCTRL_S1_READ_N:
+    case CBMCTRL_S1_WRITE_N:
+    case CBMCTRL_S2_READ_N:
+    case CBMCTRL_S2_WRITE_N:
+    case CBMCTRL_PP_DC_READ_N:
+    case CBMCTRL_PP_DC_WRITE_N:
+        if (copy_from_user(&val, (PARBURST_RW_VALUE *) arg,
+            sizeof(PARBURST_RW_VALUE))) return -EFAULT;
+        if (val.length < 0) return -EINVAL;
+        return cbm_transfer_n(cbm, cmd, val.buffer, val.length);
+
+    case CBMCTRL_IEC_PROGRAM:
+        if (copy_from_user(&val, (PARBURST_RW_VALUE *) arg,
+            sizeof(PARBURST_RW_VALUE))) return -EFAULT;
+        if ((val.length < 0) || (val.length > BUFFER_SIZE) || (val.length & 1))
+            return -EINVAL;
+        return cbm_iec_program(cbm, val.buffer, val.length);
     }
     return -EINVAL;
 }
 
 static int cbm_open(struct inode *inode, struct file *f)
 {
-    if (busy)
+    struct cbm_port *cbm = NULL;
+    int i;
+
+    for (i = 0; i < cbm_port_count; i++) {
+        if (cbm_ports[i].misc.minor == iminor(inode))
+            cbm = &cbm_ports[i];
+    }
+
+    if (cbm == NULL)
+        return -ENODEV;
+    if (cbm->busy)
         return -EBUSY;
 
-    init_waitqueue_head(&cbm_wait_q);
-    busy = 1;
+    cbm->busy = 1;
+    cbm->stats.opens++;
+    f->private_data = cbm;
     if (hold_clk)
         SET(CLK_OUT);
 
@@ -979,26 +1211,40 @@ static int cbm_open(struct inode *inode, struct file *f)
 
 static int cbm_release(struct inode *inode, struct file *f)
 {
+    struct cbm_port *cbm = f->private_data;
+
+    timer_delete_sync(&cbm->poll_timer);
     if (!hold_clk)
         RELEASE(CLK_OUT);
-    busy = 0;
+    cbm->busy = 0;
     return 0;
 }
 
 static irqreturn_t cbm_interrupt(int irq, void *dev_id)
 {
+    struct cbm_port *cbm = dev_id;
+
     DPRINTK_INT("cbm: cbm_interrupt()\n");
     POLL();         /* acknowledge interrupt */
+    cbm->stats.interrupts++;
 
-    if (cbm_irq_count == 0) {
+    if (cbm->irq_waiting) {
+        DPRINTK_INT("cbm: cbm_interrupt(): wake up wait_line()\n");
+        cbm->irq_waiting = 0;
+        wake_up_interruptible(&cbm->wait_q);
+        return IRQ_HANDLED;
+    }
+
+    if (cbm->irq_count == 0) {
         DPRINTK_INT("cbm: cbm_interrupt(): spurious interrupt\n");
+        cbm->stats.spurious_interrupts++;
         return IRQ_NONE;
     }
-    else if (--cbm_irq_count == 0) {
+    else if (--cbm->irq_count == 0) {
         DPRINTK_INT("cbm: cbm_interrupt(): can continue\n");
         DPRINTK("cbm: cbm_interrupt(): continue to send (no EOI)\n");
         SET(CLK_OUT);
-        wake_up_interruptible(&cbm_wait_q);
+        wake_up_interruptible(&cbm->wait_q);
     }
     else {
         DPRINTK_INT("cbm: cbm_interrupt(): must still wait\n");
@@ -1019,7 +1265,9 @@ static void cbm_interrupt_pp(void *dev_id)
 # if (LINUX_VERSION_CODE < KERNEL_VERSION(2,6,24))
     cbm_interrupt(irq, dev_id);
 # else
-    cbm_interrupt(cbm_device->port->irq, dev_id);
+    struct cbm_port *cbm = dev_id;
+
+    cbm_interrupt(cbm->device->port->irq, dev_id);
 # endif
 }
 #endif /* DIRECT_PORT_ACCESS */
@@ -1034,43 +1282,116 @@ static const struct file_operations cbm_fops = {
     .owner      = THIS_MODULE,
     .read       = cbm_read,
     .write      = cbm_write,
+    .poll       = cbm_poll,
     .unlocked_ioctl = cbm_unlocked_ioctl,
     .open       = cbm_open,
     .release    = cbm_release,
 };
 
-static struct miscdevice cbm_dev = {
-    .minor      = CBM_MINOR,
-    .name       = NAME,
-    .fops       = &cbm_fops,
+/*
+ *  The statistics of a port, one file per counter in
+ *  /sys/class/misc/cbm<n>/statistics/. Writing to "reset" clears them.
+ */
+#define dev_to_cbm(dev) \
+    container_of((struct miscdevice *)dev_get_drvdata(dev), struct cbm_port, misc)
+
+#define CBM_STAT_ATTR(_name) \
+static ssize_t _name##_show(struct device *dev, \
+                            struct device_attribute *attr, char *buf) \
+{ \
+    return sprintf(buf, "%lu\n", dev_to_cbm(dev)->stats._name); \
+} \
+static DEVICE_ATTR(_name, 0444, _name##_show, NULL)
+
+CBM_STAT_ATTR(opens);
+CBM_STAT_ATTR(ioctls);
+CBM_STAT_ATTR(resets);
+CBM_STAT_ATTR(bytes_read);
+CBM_STAT_ATTR(bytes_written);
+CBM_STAT_ATTR(fast_bytes_read);
+CBM_STAT_ATTR(fast_bytes_written);
+CBM_STAT_ATTR(iec_program_ops);
+CBM_STAT_ATTR(errors);
+CBM_STAT_ATTR(interrupts);
+CBM_STAT_ATTR(spurious_interrupts);
+CBM_STAT_ATTR(line_sleeps);
+CBM_STAT_ATTR(irq_wakeups);
+
+static ssize_t stats_reset_store(struct device *dev,
+                                 struct device_attribute *attr,
+                                 const char *buf, size_t count)
+{
+    memset(&dev_to_cbm(dev)->stats, 0, sizeof(struct cbm_statistics));
+    return count;
+}
+static DEVICE_ATTR(reset, 0200, NULL, stats_reset_store);
+
+static struct attribute *cbm_stats_attrs[] = {
+    &dev_attr_opens.attr,
+    &dev_attr_ioctls.attr,
+    &dev_attr_resets.attr,
+    &dev_attr_bytes_read.attr,
+    &dev_attr_bytes_written.attr,
+    &dev_attr_fast_bytes_read.attr,
+    &dev_attr_fast_bytes_written.attr,
+    &dev_attr_iec_program_ops.attr,
+    &dev_attr_errors.attr,
+    &dev_attr_interrupts.attr,
+    &dev_attr_spurious_interrupts.attr,
+    &dev_attr_line_sleeps.attr,
+    &dev_attr_irq_wakeups.attr,
+    &dev_attr_reset.attr,
+    NULL
 };
 
-static void cbm_cleanup(void)
+static const struct attribute_group cbm_stats_group = {
+    .name       = "statistics",
+    .attrs      = cbm_stats_attrs,
+};
+
+#if LINUX_VERSION_CODE >= KERNEL_VERSION(3,12,0)
+static const struct attribute_group *cbm_attr_groups[] = {
+    &cbm_stats_group,
+    NULL
+};
+#endif
+
+/*
+ *  release the parallel port of cbm and its track buffer
+ */
+static void cbm_port_release(struct cbm_port *cbm)
 {
-    kfree(track_buffer);
+    kfree(cbm->track_buffer);
 #ifdef DIRECT_PORT_ACCESS
-    free_irq(irq, NULL);
-    release_region(port, 3);
+    free_irq(cbm->irq, cbm);
+    release_region(cbm->port, 3);
 #else
     DPRINTK("releasing parallel port\n");
-    parport_release(cbm_device);
-    parport_unregister_device(cbm_device);
+    parport_release(cbm->device);
+    parport_unregister_device(cbm->device);
 #endif
-    misc_deregister(&cbm_dev);
+}
+
+static void cbm_cleanup(void)
+{
+    while (cbm_port_count > 0) {
+        struct cbm_port *cbm = &cbm_ports[--cbm_port_count];
+
+#if LINUX_VERSION_CODE < KERNEL_VERSION(3,12,0)
+        sysfs_remove_group(&cbm->misc.this_device->kobj, &cbm_stats_group);
+#endif
+        misc_deregister(&cbm->misc);
+        cbm_port_release(cbm);
+    }
 
     CBMPROCFS_CLEANUP
 }
 
-#ifdef HAVE_PARPORT_REGISTER_DEV_MODEL
-static const struct pardev_cb cbm_pardev_cb = {
-    NULL,             // int (*preempt)(void *);
-    NULL,             // void (*wakeup)(void *);
-    NULL,             // void *private;
-    cbm_interrupt_pp, // void (*irq_func)(void *);
-    PARPORT_DEV_EXCL  //unsigned int flags;
-};
-#endif
-static int cbm_init(void)
+/*
+ *  set up the port with the given index of the module parameters:
+ *  the first one is /dev/cbm, the others are /dev/cbm1, /dev/cbm2, ...
+ */
+static int cbm_port_init(struct cbm_port *cbm, int index)
 {
     unsigned char in, out;
     char *msg;
@@ -1080,86 +1401,116 @@ static int cbm_init(void)
     struct parport *pp;
 #endif
 
-    CBMPROCFS_INIT
+    if (index == 0) {
+        strcpy(cbm->name, NAME);
+        cbm->misc.minor = CBM_MINOR;
+    } else {
+        snprintf(cbm->name, sizeof cbm->name, NAME "%d", index);
+        cbm->misc.minor = MISC_DYNAMIC_MINOR;
+    }
+    cbm->misc.name = cbm->name;
+    cbm->misc.fops = &cbm_fops;
+#if LINUX_VERSION_CODE >= KERNEL_VERSION(3,12,0)
+    cbm->misc.groups = cbm_attr_groups;
+#endif
+    cbm->cable = cable[index];
+
+    init_waitqueue_head(&cbm->wait_q);
+#if LINUX_VERSION_CODE >= KERNEL_VERSION(4,15,0)
+    timer_setup(&cbm->poll_timer, cbm_poll_timer, 0);
+#else
+    setup_timer(&cbm->poll_timer, cbm_poll_timer, (unsigned long) cbm);
+#endif
 
 #ifdef DIRECT_PORT_ACCESS
-    if (check_region(port, 3)) {
-        printk("cbm_init: port already in use\n");
+    cbm->port = port[index];
+    cbm->irq = irq[index];
+
+    if (check_region(cbm->port, 3)) {
+        printk("cbm_init: port 0x%x already in use\n", cbm->port);
         return -EBUSY;
     }
-    if (request_irq(irq, cbm_interrupt, SA_INTERRUPT, NAME, NULL)) {
-        printk("cbm_init: irq already in use\n");
+    if (request_irq(cbm->irq, cbm_interrupt, SA_INTERRUPT, cbm->name, cbm)) {
+        printk("cbm_init: irq %d already in use\n", cbm->irq);
         return -EBUSY;
     }
-    request_region(port, 3, NAME);
+    request_region(cbm->port, 3, cbm->name);
 #else
-    pp = parport_find_number(lp);
+    pp = parport_find_number(lp[index]);
 
     if (pp == NULL) {
-        printk("cbm_init: non-existent port: %d\n", lp);
+        printk("cbm_init: non-existent port: %d\n", lp[index]);
         return -ENODEV;
     }
     if (pp->irq <= 0) {
-        printk("cbm_init: parallel port irq not configured: %d\n", lp);
+        printk("cbm_init: parallel port irq not configured: %d\n", lp[index]);
         return -ENODEV;
     }
 
 #ifdef HAVE_PARPORT_REGISTER_DEV_MODEL
-    cbm_device = parport_register_dev_model(pp, NAME, &cbm_pardev_cb, 123);
+    {
+        struct pardev_cb cbm_pardev_cb;
+
+        memset(&cbm_pardev_cb, 0, sizeof cbm_pardev_cb);
+        cbm_pardev_cb.irq_func = cbm_interrupt_pp;
+        cbm_pardev_cb.private = cbm;
+        cbm_pardev_cb.flags = PARPORT_DEV_EXCL;
+
+        cbm->device = parport_register_dev_model(pp, cbm->name, &cbm_pardev_cb, index);
+    }
 #else
-    cbm_device = parport_register_device(pp, NAME, NULL, NULL,
+    cbm->device = parport_register_device(pp, cbm->name, NULL, NULL,
                          cbm_interrupt_pp,
-                         PARPORT_DEV_EXCL, NULL);
+                         PARPORT_DEV_EXCL, cbm);
 #endif
-    if (cbm_device == NULL) {
+    if (cbm->device == NULL) {
         printk("cbm_init: could not register with parallel port\n");
         return -EBUSY;
     }
 
-    if (parport_claim(cbm_device)) {
-        parport_unregister_device(cbm_device);
+    if (parport_claim(cbm->device)) {
+        parport_unregister_device(cbm->device);
         printk("cbm_init: could not initialize\n");
         return -EBUSY;
     }
     DPRINTK("parallel port is mine now\n");
 #endif
-    misc_register(&cbm_dev);
-    track_buffer = kmalloc(BUFFER_SIZE, GFP_KERNEL);
+    cbm->track_buffer = kmalloc(BUFFER_SIZE, GFP_KERNEL);
 
 #ifdef DIRECT_PORT_ACCESS
-    in_port = port + 1;
-    out_port = port + 2;
+    cbm->in_port = cbm->port + 1;
+    cbm->out_port = cbm->port + 2;
 #endif
 
-    if (cable < 0) {
+    if (cbm->cable < 0) {
         in = GET(ATN_IN);
         out = (CTRL_READ() & ATN_OUT) ? 1 : 0;
-        cable = (in != out);
+        cbm->cable = (in != out);
         msg = " (auto)";
     } else {
         msg = "";
     }
 
-    out_eor = cable ? 0xcb : 0xc4;
+    cbm->out_eor = cbm->cable ? 0xcb : 0xc4;
 
-    printk("cbm_init: using %s cable%s, irq %d\n",
-           cable ? "active (XA1541)" : "passive (XM1541)", msg,
+    printk("cbm_init: %s: using %s cable%s, irq %d\n", cbm->name,
+           cbm->cable ? "active (XA1541)" : "passive (XM1541)", msg,
 #ifdef DIRECT_PORT_ACCESS
-           irq
+           cbm->irq
 #else
            pp->irq
 #endif
         );
 
-    cbm_irq_count = 0;
+    cbm->irq_count = 0;
 
-    out_bits = (CTRL_READ() ^ out_eor) &
+    cbm->out_bits = (CTRL_READ() ^ cbm->out_eor) &
         (DATA_OUT | CLK_OUT | ATN_OUT | RESET);
 
-    if ((reset < 0 && (out_bits & RESET)) || reset > 0)
-        do_reset();
+    if ((reset < 0 && (cbm->out_bits & RESET)) || reset > 0)
+        do_reset(cbm);
 
-    busy = 0;
+    cbm->busy = 0;
 
 #ifdef FOUR_BIT_CONTROL
     RELEASE(DATA_OUT | ATN_OUT | CLK_OUT);
@@ -1168,14 +1519,45 @@ static int cbm_init(void)
 #else
     RELEASE(RESET | DATA_OUT | ATN_OUT | LP_BIDIR | LP_IRQ);
 #endif
-    data_reverse = 0;
+    cbm->data_reverse = 0;
 
-    set_current_state(TASK_INTERRUPTIBLE);
-    schedule_timeout(HZ / 20);  /* 50ms */
+    if ((cbm->track_buffer == NULL) || misc_register(&cbm->misc)) {
+        printk("cbm_init: could not register %s\n", cbm->name);
+        cbm_port_release(cbm);
+        return -EBUSY;
+    }
 
-#ifndef DIRECT_PORT_ACCESS
+#if LINUX_VERSION_CODE < KERNEL_VERSION(3,12,0)
+    if (sysfs_create_group(&cbm->misc.this_device->kobj, &cbm_stats_group))
+        printk("cbm_init: %s: no statistics in sysfs\n", cbm->name);
+#endif
+
+    return 0;
+}
+
+static int cbm_init(void)
+{
+    int count, rv;
+
+    CBMPROCFS_INIT
+
+#ifdef DIRECT_PORT_ACCESS
+    count = port_num ? port_num : 1;
+#else
+    count = lp_num ? lp_num : 1;
 #endif
 
+    for (cbm_port_count = 0; cbm_port_count < count; cbm_port_count++) {
+        rv = cbm_port_init(&cbm_ports[cbm_port_count], cbm_port_count);
+        if (rv) {
+            cbm_cleanup();
+            return rv;
+        }
+    }
+
+    set_current_state(TASK_INTERRUPTIBLE);
+    schedule_timeout(HZ / 20);  /* 50ms */
+
     return 0;
 }
 
@@ -1187,7 +1569,7 @@ module_exit(cbm_cleanup);
         (they are all called by the ioctl-function)
 */
 
-int cbm_parallel_burst_read_track(unsigned char *buffer)
+int cbm_parallel_burst_read_track(struct cbm_port *cbm, unsigned char *buffer)
 {
     int i, byte;
     unsigned long flags;
@@ -1195,7 +1577,7 @@ int cbm_parallel_burst_read_track(unsigned char *buffer)
     local_irq_save(flags);
 
     for (i = 0; i < 0x2000; i += 1) {
-        byte = cbm_handshaked_read(i & 1);
+        byte = cbm_handshaked_read(cbm, i & 1);
         if (byte == -1) {
             local_irq_restore(flags);
             return 0;
@@ -1203,12 +1585,12 @@ int cbm_parallel_burst_read_track(unsigned char *buffer)
         buffer[i] = byte;
     }
 
-    cbm_parallel_burst_read();
+    cbm_parallel_burst_read(cbm);
     local_irq_restore(flags);
     return 1;
 }
 
-int cbm_parallel_burst_read_track_var(unsigned char *buffer)
+int cbm_parallel_burst_read_track_var(struct cbm_port *cbm, unsigned char *buffer)
 {
     int i, byte;
     unsigned long flags;
@@ -1216,7 +1598,7 @@ int cbm_parallel_burst_read_track_var(unsigned char *buffer)
     local_irq_save(flags);
 
     for (i = 0; i < 0x2000; i += 1) {
-        byte = cbm_handshaked_read(i & 1);
+        byte = cbm_handshaked_read(cbm, i & 1);
         if (byte == -1) {
             local_irq_restore(flags);
             return 0;
@@ -1226,12 +1608,12 @@ int cbm_parallel_burst_read_track_var(unsigned char *buffer)
             break;
     }
 
-    cbm_parallel_burst_read();
+    cbm_parallel_burst_read(cbm);
     local_irq_restore(flags);
     return 1;
 }
 
-int cbm_parallel_burst_write_track(unsigned char *buffer, int length)
+int cbm_parallel_burst_write_track(struct cbm_port *cbm, unsigned char *buffer, int length)
 {
     int i;
     unsigned long flags;
@@ -1239,19 +1621,19 @@ int cbm_parallel_burst_write_track(unsigned char *buffer, int length)
     local_irq_save(flags);
 
     for (i = 0; i < length; i++) {
-        if (cbm_handshaked_write(buffer[i], i & 1)) {
+        if (cbm_handshaked_write(cbm, buffer[i], i & 1)) {
             /* timeout */
             local_irq_restore(flags);
             return 0;
         }
     }
-    cbm_handshaked_write(0, i & 1);
-    cbm_parallel_burst_read();
+    cbm_handshaked_write(cbm, 0, i & 1);
+    cbm_parallel_burst_read(cbm);
     local_irq_restore(flags);
     return 1;
 }
 
-unsigned char cbm_parallel_burst_read(void)
+unsigned char cbm_parallel_burst_read(struct cbm_port *cbm)
 {
     int rv = 0;
 
@@ -1260,7 +1642,7 @@ unsigned char cbm_parallel_burst_read(void)
     udelay(20);     /* 200? */
     while (GET(DATA_IN)) ;
     /* linux rv = inportb(parport); */
-    if (!data_reverse) {
+    if (!cbm->data_reverse) {
         XP_WRITE(0xff);
         set_data_reverse();
     }
@@ -1272,14 +1654,14 @@ unsigned char cbm_parallel_burst_read(void)
     return rv;
 }
 
-int cbm_parallel_burst_write(unsigned char c)
+int cbm_parallel_burst_write(struct cbm_port *cbm, unsigned char c)
 {
     RELEASE(DATA_OUT | CLK_OUT);
     SET(ATN_OUT);
     udelay(20);
     while (GET(DATA_IN)) ;
     /* linux PARWRITE(); */
-    if (data_reverse)
+    if (cbm->data_reverse)
         set_data_forward();
     XP_WRITE(c);
     /* linux outportb(parport, arg); */
@@ -1288,7 +1670,7 @@ int cbm_parallel_burst_write(unsigned char c)
     udelay(20);
     while (!GET(DATA_IN)) ;
     /* linux PARREAD(); */
-    if (!data_reverse) {
+    if (!cbm->data_reverse) {
         XP_WRITE(0xff);
         set_data_reverse();
     }
@@ -1299,7 +1681,7 @@ int cbm_parallel_burst_write(unsigned char c)
 #define TO_HANDSHAKED_READ  3300000
 #define TO_HANDSHAKED_WRITE 3300000
 
-int cbm_handshaked_read(int toggle)
+int cbm_handshaked_read(struct cbm_port *cbm, int toggle)
 {
     static int oldvalue = -1;
     int returnvalue = 0;
@@ -1347,7 +1729,7 @@ int cbm_handshaked_read(int toggle)
     return returnvalue;
 }
 
-int cbm_handshaked_write(char data, int toggle)
+int cbm_handshaked_write(struct cbm_port *cbm, char data, int toggle)
 {
     int to = 0;
 
@@ -1363,8 +1745,407 @@ int cbm_handshaked_write(char data, int toggle)
                 return 1;
     }
     /* linux outportb(parport, data); */
-    if (data_reverse)
+    if (cbm->data_reverse)
         set_data_forward();
     XP_WRITE(data);
     return 1;
 }
+
+/*
+        And here are the fast transfer protocols serial-1, serial-2 and
+        parallel (d64copy), with the same handshakes as the drive routines
+        of cbmcopy/d64copy/imgcopy and the xum1541 firmware.
+        Running them here saves one ioctl per line change.
+*/
+
+#define XFER_DELAY()    udelay(2)   /* time for the IEC lines to change     */
+#define XFER_SPIN_US    1000        /* busy wait this long, then sleep      */
+
+/*
+ *  wait for a handshake line; if the drive is busy (e.g. reading
+ *  a sector), wait_line() sleeps instead of hogging the CPU
+ */
+#define xfer_wait(line, state)  wait_line(cbm, (line), (state), XFER_SPIN_US)
+
+static int s1_write_byte(struct cbm_port *cbm, unsigned char c)
+{
+    int i, bit;
+
+    for (i = 7; i >= 0; i--) {
+        bit = (c >> i) & 1;
+
+        /* send bit, release CLK and wait for drive to ack by setting CLK */
+        if (bit)
+            SET(DATA_OUT);
+        else
+            RELEASE(DATA_OUT);
+        XFER_DELAY();
+        RELEASE(CLK_OUT);
+        XFER_DELAY();
+        if (xfer_wait(CLK_IN, 1))
+            return -EINTR;
+
+        /* send bit inverted, wait for drive to release CLK */
+        if (bit)
+            RELEASE(DATA_OUT);
+        else
+            SET(DATA_OUT);
+        if (xfer_wait(CLK_IN, 0))
+            return -EINTR;
+
+        /* release DATA, set CLK and wait for drive to ack by setting DATA */
+        SET_RELEASE(CLK_OUT, DATA_OUT);
+        XFER_DELAY();
+        if (xfer_wait(DATA_IN, 1))
+            return -EINTR;
+    }
+    return 0;
+}
+
+static int s1_read_byte(struct cbm_port *cbm)
+{
+    int i, b, c = 0;
+
+    for (i = 0; i < 8; i++) {
+        if (xfer_wait(DATA_IN, 0))
+            return -EINTR;
+        RELEASE(CLK_OUT);
+        XFER_DELAY();
+        b = GET(CLK_IN);
+        if (b)
+            c |= 1 << i;
+        SET(DATA_OUT);
+        if (xfer_wait(CLK_IN, !b))
+            return -EINTR;
+
+        RELEASE(DATA_OUT);
+        XFER_DELAY();
+        if (xfer_wait(DATA_IN, 1))
+            return -EINTR;
+        SET(CLK_OUT);
+    }
+    return c;
+}
+
+static int s2_write_byte(struct cbm_port *cbm, unsigned char c)
+{
+    int i;
+
+    for (i = 0; i < 8; i += 2) {
+        /* first bit: release ATN and wait for CLK release */
+        if ((c >> i) & 1)
+            SET(DATA_OUT);
+        else
+            RELEASE(DATA_OUT);
+        XFER_DELAY();
+        RELEASE(ATN_OUT);
+        if (xfer_wait(CLK_IN, 0))
+            return -EINTR;
+
+        /* second bit: set ATN and wait for CLK set */
+        if ((c >> (i + 1)) & 1)
+            SET(DATA_OUT);
+        else
+            RELEASE(DATA_OUT);
+        XFER_DELAY();
+        SET(ATN_OUT);
+        if (xfer_wait(CLK_IN, 1))
+            return -EINTR;
+    }
+    RELEASE(DATA_OUT);
+    XFER_DELAY();
+    return 0;
+}
+
+static int s2_read_byte(struct cbm_port *cbm)
+{
+    int i, c = 0;
+
+    for (i = 0; i < 8; i += 2) {
+        /* first bit: wait for CLK release, ack by releasing ATN */
+        if (xfer_wait(CLK_IN, 0))
+            return -EINTR;
+        XFER_DELAY();
+        if (GET(DATA_IN))
+            c |= 1 << i;
+        RELEASE(ATN_OUT);
+
+        /* second bit: wait for CLK set, ack by setting ATN */
+        if (xfer_wait(CLK_IN, 1))
+            return -EINTR;
+        XFER_DELAY();
+        if (GET(DATA_IN))
+            c |= 1 << (i + 1);
+        SET(ATN_OUT);
+    }
+    return c;
+}
+
+static int pp_write_2_bytes(struct cbm_port *cbm, const unsigned char *c)
+{
+    if (xfer_wait(DATA_IN, 1))
+        return -EINTR;
+    pp_write(cbm, c[0]);
+    udelay(1);
+    RELEASE(CLK_OUT);
+
+    if (xfer_wait(DATA_IN, 0))
+        return -EINTR;
+    pp_write(cbm, c[1]);
+    udelay(1);
+    SET(CLK_OUT);
+    return 0;
+}
+
+static int pp_read_2_bytes(struct cbm_port *cbm, unsigned char *c)
+{
+    if (xfer_wait(DATA_IN, 1))
+        return -EINTR;
+    c[0] = pp_read(cbm);
+    RELEASE(CLK_OUT);
+
+    if (xfer_wait(DATA_IN, 0))
+        return -EINTR;
+    c[1] = pp_read(cbm);
+    SET(CLK_OUT);
+    return 0;
+}
+
+/*
+ *  transfer one chunk of the track buffer,
+ *  returns the number of bytes transferred
+ */
+static int transfer_chunk(struct cbm_port *cbm, unsigned int cmd, unsigned char *chunk, int length)
+{
+    int i, c;
+
+    for (i = 0; i < length; i++) {
+        switch (cmd) {
+        case CBMCTRL_S1_READ_N:
+            if ((c = s1_read_byte(cbm)) < 0)
+                return i;
+            chunk[i] = c;
+            break;
+        case CBMCTRL_S1_WRITE_N:
+            if (s1_write_byte(cbm, chunk[i]))
+                return i;
+            break;
+        case CBMCTRL_S2_READ_N:
+            if ((c = s2_read_byte(cbm)) < 0)
+                return i;
+            chunk[i] = c;
+            break;
+        case CBMCTRL_S2_WRITE_N:
+            if (s2_write_byte(cbm, chunk[i]))
+                return i;
+            break;
+        case CBMCTRL_PP_DC_READ_N:
+            if (pp_read_2_bytes(cbm, &chunk[i]))
+                return i;
+            i++;
+            break;
+        case CBMCTRL_PP_DC_WRITE_N:
+            if (pp_write_2_bytes(cbm, &chunk[i]))
+                return i;
+            i++;
+            break;
+        }
+    }
+    return length;
+}
+
+/*
+ *  block transfer with one of the fast protocols,
+ *  the data goes through the track buffer in chunks
+ */
+static int cbm_transfer_n(struct cbm_port *cbm, unsigned int cmd, unsigned char *buffer, int length)
+{
+    int reading = (cmd == CBMCTRL_S1_READ_N) || (cmd == CBMCTRL_S2_READ_N)
+               || (cmd == CBMCTRL_PP_DC_READ_N);
+    int done = 0, chunk, n;
+
+    /* the parallel protocol transfers byte pairs */
+    if ((cmd == CBMCTRL_PP_DC_READ_N) || (cmd == CBMCTRL_PP_DC_WRITE_N)) {
+        if (length & 1)
+            return -EINVAL;
+
+        /* give the lines time to settle if their direction changes */
+        if (cbm->data_reverse != reading) {
+            if (reading) {
+                XP_WRITE(0xff);
+                set_data_reverse();
+            } else {
+                set_data_forward();
+            }
+            udelay(100);
+        }
+    }
+
+    DPRINTK("cbm_transfer_n: cmd=%08x, %d bytes\n", cmd, length);
+
+    while (done < length) {
+        chunk = min(length - done, BUFFER_SIZE);
+
+        if (!reading && copy_from_user(cbm->track_buffer, buffer + done, chunk))
+            return -EFAULT;
+
+        n = transfer_chunk(cbm, cmd, cbm->track_buffer, chunk);
+
+        if (reading && copy_to_user(buffer + done, cbm->track_buffer, n))
+            return -EFAULT;
+
+        done += n;
+        if (reading)
+            cbm->stats.fast_bytes_read += n;
+        else
+            cbm->stats.fast_bytes_written += n;
+
+        if (n < chunk) {
+            /* interrupted by a signal */
+            return done ? done : -EINTR;
+        }
+
+        schedule();
+    }
+
+    return done;
+}
+
+/*
+        Micro-programs: a sequence of IEC line operations, run here in
+        one go instead of one ioctl per operation.
+*/
+
+/*
+ *  map IEC_DATA, IEC_CLOCK, IEC_ATN and IEC_RESET to the lpt output lines
+ */
+static unsigned char iec_out_mask(unsigned char lines)
+{
+    unsigned char mask = 0;
+
+    if (lines & IEC_DATA)
+        mask |= DATA_OUT;
+    if (lines & IEC_CLOCK)
+        mask |= CLK_OUT;
+    if (lines & IEC_ATN)
+        mask |= ATN_OUT;
+    if (lines & IEC_RESET)
+        mask |= RESET;
+    return mask;
+}
+
+/*
+ *  map exactly one of IEC_DATA, IEC_CLOCK and IEC_ATN to its lpt input line
+ */
+static int iec_in_mask(unsigned char line)
+{
+    switch (line) {
+    case IEC_DATA:
+        return DATA_IN;
+    case IEC_CLOCK:
+        return CLK_IN;
+    case IEC_ATN:
+        return ATN_IN;
+    }
+    return -1;
+}
+
+/*
+ *  check a program before any of it is run
+ */
+static int iec_program_valid(const unsigned char *program, int length)
+{
+    const unsigned char lines = IEC_DATA | IEC_CLOCK | IEC_ATN | IEC_RESET;
+    int i;
+
+    for (i = 0; i < length; i += 2) {
+        switch (program[i]) {
+        case CBMCTRL_PROG_SET:
+        case CBMCTRL_PROG_RELEASE:
+            if (program[i + 1] & ~lines)
+                return 0;
+            break;
+        case CBMCTRL_PROG_WAIT_SET:
+        case CBMCTRL_PROG_WAIT_RELEASE:
+            if (iec_in_mask(program[i + 1]) < 0)
+                return 0;
+            break;
+        case CBMCTRL_PROG_SETRELEASE: /* both nibbles are valid line masks */
+        case CBMCTRL_PROG_POLL:
+        case CBMCTRL_PROG_DELAY:
+        case CBMCTRL_PROG_PP_READ:
+        case CBMCTRL_PROG_PP_WRITE:
+            break;
+        default:
+            return 0;
+        }
+    }
+    return 1;
+}
+
+/*
+ *  run a program of (opcode, argument) byte pairs,
+ *  the results of POLL and PP_READ replace their argument.
+ *  Returns the number of operations run
+ */
+static int cbm_iec_program(struct cbm_port *cbm, unsigned char *program, int length)
+{
+    unsigned char *op;
+    int i, c;
+
+    if (copy_from_user(cbm->track_buffer, program, length))
+        return -EFAULT;
+    if (!iec_program_valid(cbm->track_buffer, length))
+        return -EINVAL;
+
+    DPRINTK("cbm_iec_program: %d operations\n", length / 2);
+
+    for (i = 0; i < length; i += 2) {
+        op = &cbm->track_buffer[i];
+
+        switch (op[0]) {
+        case CBMCTRL_PROG_SET:
+            SET(iec_out_mask(op[1]));
+            break;
+        case CBMCTRL_PROG_RELEASE:
+            RELEASE(iec_out_mask(op[1]));
+            break;
+        case CBMCTRL_PROG_SETRELEASE:
+            SET_RELEASE(iec_out_mask(op[1] >> 4), iec_out_mask(op[1] & 0x0f));
+            break;
+        case CBMCTRL_PROG_WAIT_SET:
+        case CBMCTRL_PROG_WAIT_RELEASE:
+            if (xfer_wait(iec_in_mask(op[1]), op[0] == CBMCTRL_PROG_WAIT_SET))
+                goto interrupted;
+            break;
+        case CBMCTRL_PROG_POLL:
+            c = POLL();
+            op[1] = 0;
+            if ((c & DATA_IN) == 0)
+                op[1] |= IEC_DATA;
+            if ((c & CLK_IN) == 0)
+                op[1] |= IEC_CLOCK;
+            if ((c & ATN_IN) == 0)
+                op[1] |= IEC_ATN;
+            break;
+        case CBMCTRL_PROG_DELAY:
+            udelay(op[1]);
+            break;
+        case CBMCTRL_PROG_PP_READ:
+            op[1] = pp_read(cbm);
+            break;
+        case CBMCTRL_PROG_PP_WRITE:
+            pp_write(cbm, op[1]);
+            break;
+        }
+    }
+
+interrupted:
+    cbm->stats.iec_program_ops += i / 2;
+
+    if (copy_to_user(program, cbm->track_buffer, i))
+        return -EFAULT;
+
+    /* interrupted by a signal if not all of the program was run */
+    return (i == length || i > 0) ? i / 2 : -EINTR;
+}
@@ -842,6 +842,82 @@ vdd_iec_get(CBM_FILE HandleDevice)
 }
 
 
+/*! \brief Execute several line calls with one trap
+
+ Every call of the DOS portion into the VDD is a trap which costs far
+ more than most of the calls themselves. Programs which drive the bus
+ lines on their own can hand over a whole sequence of calls at once.
+
+ \param HandleDevice (BX)
+   A CBM_FILE which contains the file handle of the driver.
+
+ \param Calls (ES:SI)
+   Pointer to an array of VDD_BATCH_ENTRY. Each one holds a function
+   code and the values of CH, CL and CX this call would get if it was
+   made on its own. On return, its Ax holds the AX it returned.
+   Only FC_PP_READ, FC_PP_WRITE, FC_IEC_POLL, FC_IEC_GET, FC_IEC_SET,
+   FC_IEC_RELEASE, FC_IEC_SETRELEASE, FC_IEC_WAIT and FC_VDD_USLEEP
+   can be batched.
+
+ \param Count (CX)
+   The number of entries in Calls.
+
+ \return (AX)
+   The number of calls executed. If this is less than Count, the
+   entry after the last one executed has a function code which
+   cannot be batched, and CF is set.
+
+ If vdd_driver_open() did not succeed, it is illegal to
+ call this function.
+*/
+
+BOOLEAN
+vdd_batch(CBM_FILE HandleDevice)
+{
+    VDD_BATCH_ENTRY *entry;
+    WORD count;
+
+    FUNC_CHECKEDBUFFERACCESS(getSI(), (WORD) (getCX() * sizeof(VDD_BATCH_ENTRY)));
+
+    count = getCX();
+    if (count > 0xFFFF / sizeof(VDD_BATCH_ENTRY))
+    {
+        count = 0xFFFF / sizeof(VDD_BATCH_ENTRY);
+        length = (WORD) (count * sizeof(VDD_BATCH_ENTRY));
+    }
+
+    CHECKEDBUFFERACCESS_PROLOG();
+
+    for (ret = 0, entry = buffer; ret < count && !error; entry++)
+    {
+        switch (entry->FunctionCode)
+        {
+        case FC_PP_READ:        entry->Ax = cbm_pp_read(HandleDevice);                       break;
+        case FC_PP_WRITE:       cbm_pp_write(HandleDevice, entry->Cl);                       break;
+        case FC_IEC_POLL:       entry->Ax = cbm_iec_poll(HandleDevice);                      break;
+        case FC_IEC_GET:        entry->Ax = cbm_iec_get(HandleDevice, entry->Cl);            break;
+        case FC_IEC_SET:        cbm_iec_set(HandleDevice, entry->Cl);                        break;
+        case FC_IEC_RELEASE:    cbm_iec_release(HandleDevice, entry->Cl);                    break;
+        case FC_IEC_SETRELEASE: cbm_iec_setrelease(HandleDevice, entry->Ch, entry->Cl);      break;
+        case FC_IEC_WAIT:       entry->Ax = cbm_iec_wait(HandleDevice, entry->Cl, entry->Ch); break;
+        case FC_VDD_USLEEP:     arch_sleep_us(entry->Cx);                                    break;
+
+        default:
+            DBG_ERROR((DBG_PREFIX "function code %02x cannot be batched", entry->FunctionCode));
+            error = TRUE;
+            break;
+        }
+
+        if (!error)
+        {
+            ret++;
+        }
+    }
+
+    CHECKEDBUFFERACCESS_EPILOG();
+}
+
+
 /*-------------------------------------------------------------------*/
 /*--------- HELPER FUNCTIONS ----------------------------------------*/
 
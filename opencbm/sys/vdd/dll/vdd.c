@@ -208,6 +208,7 @@ VDDDispatch(VOID)
         case FC_EXEC_COMMAND:    error = vdd_exec_command(cbmfile);  break;
         case FC_IDENTIFY:        error = vdd_identify(cbmfile);      break;
         case FC_IDENTIFY_XP1541: error = vdd_identify_xp1541(cbmfile); break;
+        case FC_BATCH:           error = vdd_batch(cbmfile);         break;
         case FC_GET_DRIVER_NAME: error = vdd_get_driver_name();      break;
 
         case FC_VDD_USLEEP:      error = vdd_usleep();               break;
@@ -53,9 +53,26 @@ enum FUNCTIONCODE
     FC_VDD_UNINSTALL_IOHOOK, /*!< call vdd_uninstall_iohook() */
     FC_VDD_USLEEP,           /*!< call vdd_usleep() */
     FC_IEC_SETRELEASE,       /*!< call vdd_setrelease() */
-    FC_IDENTIFY_XP1541       /*!< call vdd_identify_xp1541() */
+    FC_IDENTIFY_XP1541,      /*!< call vdd_identify_xp1541() */
+    FC_BATCH                 /*!< call vdd_batch() */
 } FUNCTIONCODE;
 
+#include <pshpack1.h>
+
+/*! one call in the buffer given to vdd_batch(), as the DOS portion lays it out */
+typedef
+struct VDD_BATCH_ENTRY
+{
+    BYTE FunctionCode;       /*!< the function code of the call */
+    BYTE Ch;                 /*!< the value of CH for the call */
+    BYTE Cl;                 /*!< the value of CL for the call */
+    BYTE Reserved;           /*!< must be 0 */
+    WORD Cx;                 /*!< the value of CX for the call */
+    WORD Ax;                 /*!< the AX the call returned */
+} VDD_BATCH_ENTRY;
+
+#include <poppack.h>
+
 extern HANDLE vdd_handle;
 
 extern BOOLEAN vdd_driver_open(VOID);
@@ -85,6 +102,7 @@ extern BOOLEAN vdd_exec_command(CBM_FILE);
 extern BOOLEAN vdd_identify(CBM_FILE);
 extern BOOLEAN vdd_identify_xp1541(CBM_FILE);
 extern BOOLEAN vdd_get_driver_name(VOID);
+extern BOOLEAN vdd_batch(CBM_FILE);
 
 extern BOOLEAN vdd_install_iohook(CBM_FILE);
 extern BOOLEAN vdd_uninstall_iohook(CBM_FILE);
@@ -0,0 +1,353 @@
+/*
+ *  CBM 1530/1531 tape routines.
+ *  Decode the programs of a CAP image to PRG files or a T64 archive.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <arch.h>
+#include "cap.h"
+#include "misc.h"
+#include "cbmdecode.h"
+
+// T64 archive layout
+#define T64_Header_Size 64
+#define T64_Entry_Size  32
+
+// Where the decoded programs go.
+typedef struct
+{
+    BOOL           bT64;
+    CBMDecode_File *pFiles;   // T64: all programs decoded, written at the end.
+    __int32        iNumFiles, iMaxFiles;
+} OUTPUT;
+
+
+void usage(void)
+{
+    printf("\nUsage:   cap2prg <input.cap> [<output.t64>]\n\n");
+    printf("  Decodes the programs saved by the standard C64/VC20 kernal tape routines.\n");
+    printf("  Without <output.t64>, every program is written to <name>.prg\n");
+    printf("  (existing files are not overwritten).\n\n");
+    printf("Example: cap2prg myfile.cap\n");
+    printf("         cap2prg myfile.cap myfile.t64\n");
+}
+
+
+static BOOL FileExists(const __int8 *pcFilename)
+{
+    FILE *fd = fopen(pcFilename, "rb");
+    if (fd == NULL)
+        return FALSE;
+
+    fclose(fd);
+    return TRUE;
+}
+
+
+// PRG file name from tape file name, characters not allowed in file names replaced.
+static void PRGFilename(const CBMDecode_File *pFile, __int8 pcOutput[_MAX_PATH])
+{
+    __int8  pcName[17], pcBase[17];
+    __int32 i, n;
+
+    CBMDecode_GetName(pFile->ucName, pcName);
+    for (i = 0; pcName[i] != '\0'; i++)
+        pcBase[i] = (strchr("\\/:*?\"<>|", pcName[i]) != NULL) ? '_' : pcName[i];
+    pcBase[i] = '\0';
+    if (i == 0)
+        strcpy(pcBase, "noname");
+
+    sprintf(pcOutput, "%s.prg", pcBase);
+    for (n = 2; FileExists(pcOutput) && (n < 100); n++)
+        sprintf(pcOutput, "%s_%d.prg", pcBase, n);
+}
+
+
+// Write a program with its load address.
+static __int32 WritePRG(const CBMDecode_File *pFile)
+{
+    FILE            *fd;
+    __int8          pcOutput[_MAX_PATH];
+    unsigned __int8 ucAddress[2];
+
+    PRGFilename(pFile, pcOutput);
+    if (FileExists(pcOutput))
+    {
+        printf("Skipping: %s already exists.\n", pcOutput);
+        return 0;
+    }
+
+    fd = fopen(pcOutput, "wb");
+    if (fd == NULL)
+    {
+        printf("Error: Could not create %s.\n", pcOutput);
+        return -1;
+    }
+
+    ucAddress[0] = pFile->uiStart & 0xff;
+    ucAddress[1] = (pFile->uiStart >> 8) & 0xff;
+    if ((fwrite(ucAddress, 2, 1, fd) != 1) ||
+        (fwrite(pFile->pucData, pFile->uiLength, 1, fd) != 1))
+    {
+        printf("Error: Could not write %s.\n", pcOutput);
+        fclose(fd);
+        return -1;
+    }
+
+    if (fclose(fd) != 0)
+    {
+        printf("Error: Closing %s failed.\n", pcOutput);
+        return -1;
+    }
+
+    printf("  -> %s\n", pcOutput);
+    return 0;
+}
+
+
+// Output callback of the decoder.
+static __int32 OutputProgram(void *pContext, const CBMDecode_File *pFile)
+{
+    OUTPUT         *pOutput = (OUTPUT *) pContext;
+    CBMDecode_File *pNew;
+
+    if (!pOutput->bT64)
+        return WritePRG(pFile);
+
+    // Keep a copy for the archive.
+    if (pOutput->iNumFiles == pOutput->iMaxFiles)
+    {
+        pNew = realloc(pOutput->pFiles, (pOutput->iMaxFiles + 16) * sizeof(CBMDecode_File));
+        if (pNew == NULL)
+        {
+            printf("Error: Could not allocate memory for program list.\n");
+            return -1;
+        }
+        pOutput->pFiles = pNew;
+        pOutput->iMaxFiles += 16;
+    }
+
+    pNew = &(pOutput->pFiles[pOutput->iNumFiles]);
+    *pNew = *pFile;
+    pNew->pucData = malloc(pFile->uiLength);
+    if (pNew->pucData == NULL)
+    {
+        printf("Error: Could not allocate memory for program.\n");
+        return -1;
+    }
+    memcpy(pNew->pucData, pFile->pucData, pFile->uiLength);
+    pOutput->iNumFiles++;
+
+    return 0;
+}
+
+
+// Store 16/32bit values: LSB first, MSB last.
+static void Put16(unsigned __int8 *pucDest, unsigned __int32 uiValue)
+{
+    pucDest[0] = uiValue & 0xff;
+    pucDest[1] = (uiValue >> 8) & 0xff;
+}
+
+static void Put32(unsigned __int8 *pucDest, unsigned __int32 uiValue)
+{
+    Put16(pucDest, uiValue & 0xffff);
+    Put16(pucDest + 2, uiValue >> 16);
+}
+
+
+// Write all programs decoded to a T64 archive named after the input file.
+static __int32 WriteT64(const OUTPUT *pOutput, const __int8 *pcInput, const __int8 *pcT64)
+{
+    FILE             *fd;
+    unsigned __int8  ucHeader[T64_Header_Size], ucEntry[T64_Entry_Size];
+    unsigned __int32 uiOffset;
+    const __int8     *pcBase, *pc;
+    __int32          i;
+
+    fd = fopen(pcT64, "wb");
+    if (fd == NULL)
+    {
+        printf("Error: Could not create %s.\n", pcT64);
+        return -1;
+    }
+
+    // Archive header: signature, version, directory size, tape name.
+    memset(ucHeader, 0x00, sizeof(ucHeader));
+    strcpy((char *) ucHeader, "C64 tape image file");
+    Put16(ucHeader + 0x20, 0x0101);
+    Put16(ucHeader + 0x22, pOutput->iNumFiles);
+    Put16(ucHeader + 0x24, pOutput->iNumFiles);
+    memset(ucHeader + 0x28, 0x20, 24);
+    pcBase = pcInput;
+    for (pc = pcInput; *pc != '\0'; pc++)
+        if ((*pc == '\\') || (*pc == '/') || (*pc == ':'))
+            pcBase = pc + 1;
+    for (i = 0; (i < 24) && (pcBase[i] != '\0') && (pcBase[i] != '.'); i++)
+        ucHeader[0x28 + i] = (unsigned __int8) (((pcBase[i] >= 'a') && (pcBase[i] <= 'z')) ? pcBase[i] - 'a' + 'A' : pcBase[i]);
+
+    if (fwrite(ucHeader, sizeof(ucHeader), 1, fd) != 1)
+        goto write_error;
+
+    // Directory: one entry per program.
+    uiOffset = T64_Header_Size + pOutput->iNumFiles * T64_Entry_Size;
+    for (i = 0; i < pOutput->iNumFiles; i++)
+    {
+        memset(ucEntry, 0x00, sizeof(ucEntry));
+        ucEntry[0] = 1;    // Normal tape file
+        ucEntry[1] = 0x82; // PRG
+        Put16(ucEntry + 2, pOutput->pFiles[i].uiStart);
+        Put16(ucEntry + 4, pOutput->pFiles[i].uiEnd);
+        Put32(ucEntry + 8, uiOffset);
+        memcpy(ucEntry + 16, pOutput->pFiles[i].ucName, 16);
+        uiOffset += pOutput->pFiles[i].uiLength;
+
+        if (fwrite(ucEntry, sizeof(ucEntry), 1, fd) != 1)
+            goto write_error;
+    }
+
+    for (i = 0; i < pOutput->iNumFiles; i++)
+        if (fwrite(pOutput->pFiles[i].pucData, pOutput->pFiles[i].uiLength, 1, fd) != 1)
+            goto write_error;
+
+    if (fclose(fd) != 0)
+    {
+        printf("Error: Closing %s failed.\n", pcT64);
+        return -1;
+    }
+
+    printf("\n%d programs written to %s\n", pOutput->iNumFiles, pcT64);
+    return 0;
+
+    write_error:
+    printf("Error: Could not write %s.\n", pcT64);
+    fclose(fd);
+    return -1;
+}
+
+
+// Decode all programs of the image file.
+static __int32 DecodeCaptureFile(HANDLE hCAP, OUTPUT *pOutput, CBMDecode_Stream *pStream)
+{
+    unsigned __int64 ui64Delta;
+    unsigned __int8  CAP_Machine;
+    __int32          FuncRes;
+
+    // Seek to start of image file and read image header, extract & verify header contents, seek to start of image data.
+    FuncRes = CAP_ReadHeader(hCAP);
+    if (FuncRes != CAP_Status_OK)
+    {
+        CAP_OutputError(FuncRes);
+        return -1;
+    }
+
+    // Get target machine type from header.
+    FuncRes = CAP_GetHeader_Machine(hCAP, &CAP_Machine);
+    if (FuncRes != CAP_Status_OK)
+    {
+        CAP_OutputError(FuncRes);
+        return -1;
+    }
+
+    if ((CAP_Machine != CAP_Machine_C64) && (CAP_Machine != CAP_Machine_VC20))
+    {
+        printf("Error: Only C64 and VC20 tapes can be decoded.\n");
+        return -1;
+    }
+
+    CBMDecode_Begin(pStream, OutputProgram, pOutput);
+
+    while ((FuncRes = CAP_ReadSignal(hCAP, &ui64Delta, NULL)) == CAP_Status_OK)
+    {
+        if (CBMDecode_Signal(pStream, ui64Delta) == -1)
+            return -1;
+    }
+
+    if (FuncRes == CAP_Status_Error_Reading_data)
+    {
+        CAP_OutputError(FuncRes);
+        return -1;
+    }
+
+    return CBMDecode_End(pStream);
+}
+
+
+// Main routine.
+//   Return values:
+//    0: all programs decoded ok
+//   -1: an error occurred, or no program found
+int ARCH_MAINDECL main(int argc, char *argv[])
+{
+    HANDLE           hCAP;
+    OUTPUT           Output;
+    CBMDecode_Stream *pStream;
+    __int32          i, FuncRes, RetVal = -1;
+
+    printf("\nCAP2PRG v1.00 - ZoomTape CAP image to PRG/T64 decoder\n\n");
+
+    if ((argc < 2) || (argc > 3))
+    {
+        usage();
+        printf("\n");
+        return -1;
+    }
+
+    memset(&Output, 0, sizeof(Output));
+    Output.bT64 = (argc == 3);
+
+    if (Output.bT64 && FileExists(argv[2]))
+    {
+        printf("Overwrite existing file? (y/N)");
+        if (getchar() != 'y')
+        {
+            printf("\n");
+            return -1;
+        }
+        printf("\n");
+    }
+
+    // The decoder keeps a whole block, don't put it on the stack.
+    pStream = malloc(sizeof(CBMDecode_Stream));
+    if (pStream == NULL)
+    {
+        printf("Error: Could not allocate memory for decoder.\n\n");
+        return -1;
+    }
+
+    // Open specified image file for reading.
+    FuncRes = CAP_OpenFile(&hCAP, argv[1]);
+    if (FuncRes != CAP_Status_OK)
+    {
+        CAP_OutputError(FuncRes);
+        goto exit;
+    }
+
+    printf("Decoding: %s\n\n", argv[1]);
+
+    RetVal = DecodeCaptureFile(hCAP, &Output, pStream);
+
+    CAP_CloseFile(&hCAP);
+
+    if (RetVal == 0)
+    {
+        printf("\n%d programs decoded, %d errors.\n", pStream->iNumFiles, pStream->iNumErrors);
+        if ((pStream->iNumFiles == 0) || (pStream->iNumErrors != 0))
+            RetVal = -1;
+    }
+
+    if (Output.bT64 && (Output.iNumFiles > 0))
+        if (WriteT64(&Output, argv[1], argv[2]) != 0)
+            RetVal = -1;
+
+    exit:
+    for (i = 0; i < Output.iNumFiles; i++)
+        free(Output.pFiles[i].pucData);
+    if (Output.pFiles != NULL) free(Output.pFiles);
+    free(pStream);
+    printf("\n");
+    return RetVal;
+}
@@ -0,0 +1,417 @@
+/*
+ *  CBM 1530/1531 tape routines.
+ *  Decoder for files saved by the standard CBM kernal tape routines.
+*/
+
+// Every byte is a new-data marker (long, medium pulse) followed by 8 data
+// bits (LSB first) and an odd parity bit. A 0 bit is a short and a medium
+// pulse, a 1 bit a medium and a short one. A block ends with a long and a
+// short pulse. A block starts with the countdown $89..$81 (first copy) or
+// $09..$01 (repeat) and ends with the XOR checksum of its data.
+//
+// The signals are decoded as they are read, the capture never has to be in
+// memory. The pulse lengths are learned from the leader before each file,
+// so the decoder does not depend on machine, video standard or tape speed.
+
+#include <stdio.h>
+#include <string.h>
+#include "tapearch.h"
+
+#include "cbmdecode.h"
+
+// Pulse classes
+#define Pulse_Short   0
+#define Pulse_Medium  1
+#define Pulse_Long    2
+#define Pulse_Invalid 3
+
+// Byte decoding states
+#define State_Marker  0 // Waiting for long pulse of new-data or end-of-data marker.
+#define State_Marker2 1 // Long pulse seen.
+#define State_Bits    2 // Reading data and parity bits.
+
+// Similar pulses in a row recognized as leader.
+#define Leader_Min_Run 32
+
+// Block of the current file the next repeat belongs to
+#define Repeat_None   0
+#define Repeat_Header 1
+#define Repeat_Data   2
+
+// Size of a header block
+#define Header_Size 192
+
+
+// Printable form of a tape file name, trailing spaces removed.
+void CBMDecode_GetName(const unsigned __int8 ucName[16], __int8 pcName[17])
+{
+    __int32 i, len = 16;
+
+    while ((len > 0) && ((ucName[len-1] == 0x20) || (ucName[len-1] == 0xa0) || (ucName[len-1] == 0x00)))
+        len--;
+
+    for (i = 0; i < len; i++)
+        pcName[i] = ((ucName[i] >= 0x20) && (ucName[i] < 0x7f)) ? ucName[i] : '?';
+    pcName[len] = '\0';
+}
+
+
+// Classify a pulse by the short pulse length learned from the leader.
+// Nominal lengths are 1 : 1.375 : 1.79, the limits are halfway in between.
+static unsigned __int8 ClassifyPulse(const CBMDecode_Stream *pStream, unsigned __int64 ui64Pulse)
+{
+    unsigned __int64 ui64Short = pStream->ui64Short;
+
+    if ((ui64Pulse < ui64Short/2) || (ui64Pulse > ui64Short*5/2))
+        return Pulse_Invalid;
+    if (ui64Pulse < ui64Short*19/16)
+        return Pulse_Short;
+    if (ui64Pulse < ui64Short*19/12)
+        return Pulse_Medium;
+    return Pulse_Long;
+}
+
+
+// Learn the short pulse length from runs of similar pulses (leader).
+static void TrackLeader(CBMDecode_Stream *pStream, unsigned __int64 ui64Pulse)
+{
+    if ((pStream->uiRun > 0) &&
+        (ui64Pulse > pStream->ui64Average - pStream->ui64Average/5) &&
+        (ui64Pulse < pStream->ui64Average + pStream->ui64Average/5))
+    {
+        pStream->ui64Average = (pStream->ui64Average*15 + ui64Pulse)/16;
+        pStream->uiRun++;
+    }
+    else
+    {
+        pStream->ui64Average = ui64Pulse;
+        pStream->uiRun = 1;
+    }
+
+    // Only learn between blocks, data could look like a leader.
+    if ((pStream->uiRun >= Leader_Min_Run) && (pStream->iBlockLen == 0))
+        pStream->ui64Short = pStream->ui64Average;
+}
+
+
+// Hand a decoded program to the output.
+static __int32 OutputFile(CBMDecode_Stream *pStream, unsigned __int8 *pucData)
+{
+    __int8 pcName[17];
+
+    CBMDecode_GetName(pStream->File.ucName, pcName);
+    printf("Found: \"%s\" $%.4X-$%.4X\n", pcName, pStream->File.uiStart, pStream->File.uiEnd);
+
+    pStream->File.pucData = pucData;
+    pStream->bExpectData = FALSE;
+    pStream->iNumFiles++;
+
+    return pStream->Output(pStream->pContext, &(pStream->File));
+}
+
+
+// A program header is not followed by its data.
+static void ReportMissingData(CBMDecode_Stream *pStream)
+{
+    __int8 pcName[17];
+
+    CBMDecode_GetName(pStream->File.ucName, pcName);
+    printf("Error: Data of \"%s\" not found.\n", pcName);
+    pStream->bExpectData = FALSE;
+    pStream->iNumErrors++;
+}
+
+
+// Take over a header block.
+static void HandleHeader(CBMDecode_Stream *pStream, const unsigned __int8 *pucData)
+{
+    __int8 pcName[17];
+
+    if (pStream->bExpectData)
+        ReportMissingData(pStream);
+
+    pStream->File.ucType = pucData[0];
+    pStream->File.uiStart = pucData[1] | (pucData[2] << 8);
+    pStream->File.uiEnd = pucData[3] | (pucData[4] << 8);
+    memcpy(pStream->File.ucName, pucData + 5, 16);
+    pStream->bHeaderFailed = FALSE;
+    pStream->bDataFailed = FALSE;
+
+    CBMDecode_GetName(pStream->File.ucName, pcName);
+
+    switch (pStream->File.ucType)
+    {
+        case CBMDecode_Type_Relocatable_Program:
+        case CBMDecode_Type_Program:
+            if (pStream->File.uiEnd <= pStream->File.uiStart)
+            {
+                printf("Error: \"%s\" has an invalid address range.\n", pcName);
+                pStream->iNumErrors++;
+                break;
+            }
+            pStream->File.uiLength = pStream->File.uiEnd - pStream->File.uiStart;
+            pStream->bExpectData = TRUE;
+            break;
+        case CBMDecode_Type_SEQ_Header:
+            printf("Skipping data file \"%s\" (not supported).\n", pcName);
+            break;
+        case CBMDecode_Type_End_Of_Tape:
+            printf("End-of-tape marker found.\n");
+            break;
+        case CBMDecode_Type_Data_Block:
+            break;
+        default:
+            printf("Skipping header of unknown type %u.\n", pStream->File.ucType);
+            break;
+    }
+}
+
+
+// Handle a complete block, sort out the two copies.
+static __int32 HandleBlock(CBMDecode_Stream *pStream, BOOL bRepeat, BOOL bValid, unsigned __int8 *pucData, __int32 iLen)
+{
+    BOOL bIsData, bIsHeader;
+    __int8 pcName[17];
+
+    bIsData = bValid && pStream->bExpectData && ((unsigned __int32) iLen == pStream->File.uiLength);
+    bIsHeader = bValid && !bIsData && (iLen == Header_Size);
+
+    if (bRepeat && (pStream->iPendingRepeat != Repeat_None))
+    {
+        if (pStream->iPendingRepeat == Repeat_Header)
+        {
+            // Only needed if the first copy was damaged.
+            if (pStream->bHeaderFailed)
+            {
+                if (bIsHeader)
+                    HandleHeader(pStream, pucData);
+                else
+                {
+                    printf("Error: Header damaged in both copies.\n");
+                    pStream->bHeaderFailed = FALSE;
+                    pStream->iNumErrors++;
+                }
+            }
+        }
+        else if (pStream->iPendingRepeat == Repeat_Data)
+        {
+            // Only needed if the first copy was damaged.
+            if (pStream->bDataFailed)
+            {
+                pStream->bDataFailed = FALSE;
+                if (bIsData)
+                {
+                    if (OutputFile(pStream, pucData) != 0)
+                        return -1;
+                }
+                else
+                {
+                    CBMDecode_GetName(pStream->File.ucName, pcName);
+                    printf("Error: Data of \"%s\" damaged in both copies.\n", pcName);
+                    pStream->bExpectData = FALSE;
+                    pStream->iNumErrors++;
+                }
+            }
+        }
+        pStream->iPendingRepeat = Repeat_None;
+        return 0;
+    }
+
+    // First copy, or repeat of a block whose first copy was not found at all.
+    if (bIsData)
+    {
+        pStream->iPendingRepeat = bRepeat ? Repeat_None : Repeat_Data;
+        return OutputFile(pStream, pucData);
+    }
+
+    if (bIsHeader)
+    {
+        pStream->iPendingRepeat = bRepeat ? Repeat_None : Repeat_Header;
+        HandleHeader(pStream, pucData);
+        return 0;
+    }
+
+    if (bRepeat)
+    {
+        printf("Warning: Skipping damaged block of %d bytes.\n", iLen);
+        pStream->iNumErrors++;
+        return 0;
+    }
+
+    if (pStream->bExpectData)
+    {
+        pStream->iPendingRepeat = Repeat_Data;
+        CBMDecode_GetName(pStream->File.ucName, pcName);
+        printf("Warning: First copy of \"%s\" damaged, using repeat.\n", pcName);
+        pStream->bDataFailed = TRUE;
+        return 0;
+    }
+
+    if (bValid)
+    {
+        printf("Warning: Skipping block of %d bytes without header.\n", iLen);
+        pStream->iPendingRepeat = Repeat_None;
+        return 0;
+    }
+
+    pStream->iPendingRepeat = Repeat_Header;
+    printf("Warning: First copy of header damaged, using repeat.\n");
+    pStream->bHeaderFailed = TRUE;
+    return 0;
+}
+
+
+// End of a block: check countdown and checksum.
+static __int32 EndBlock(CBMDecode_Stream *pStream, BOOL bBroken)
+{
+    unsigned __int8 *pucBlock = pStream->ucBlock, ucCheck = 0;
+    __int32         i, iLen = pStream->iBlockLen;
+    BOOL            bRepeat;
+
+    pStream->iBlockLen = 0;
+    pStream->bBlockBroken = FALSE;
+    pStream->iState = State_Marker;
+
+    // Just noise: no countdown sequence.
+    if (iLen < 10)
+        return 0;
+
+    if ((pucBlock[0] != 0x89) && (pucBlock[0] != 0x09))
+        return 0;
+    bRepeat = (pucBlock[0] == 0x09);
+    for (i = 1; i < 9; i++)
+        if (pucBlock[i] != pucBlock[0]-i)
+            return 0;
+
+    for (i = 9; i < iLen-1; i++)
+        ucCheck ^= pucBlock[i];
+    if (ucCheck != pucBlock[iLen-1])
+        bBroken = TRUE;
+
+    return HandleBlock(pStream, bRepeat, !bBroken, pucBlock + 9, iLen - 10);
+}
+
+
+// Decode the next pulse.
+static __int32 DecodePulse(CBMDecode_Stream *pStream, unsigned __int8 ucPulse)
+{
+    unsigned __int8 ucBit;
+
+    switch (pStream->iState)
+    {
+        case State_Marker:
+            if (ucPulse == Pulse_Long)
+                pStream->iState = State_Marker2;
+            else if (pStream->iBlockLen > 0)
+                return EndBlock(pStream, TRUE); // Marker missing.
+            break;
+
+        case State_Marker2:
+            if (ucPulse == Pulse_Medium)
+            {
+                pStream->iState = State_Bits;
+                pStream->ucBit = 0;
+                pStream->ucByte = 0;
+            }
+            else if (ucPulse == Pulse_Short)
+                return EndBlock(pStream, pStream->bBlockBroken); // End-of-data marker.
+            else if (pStream->iBlockLen > 0)
+                return EndBlock(pStream, TRUE);
+            else
+                pStream->iState = State_Marker;
+            break;
+
+        case State_Bits:
+            // First pulse of a bit.
+            if ((pStream->ucBit & 0x80) == 0)
+            {
+                pStream->ucFirstPulse = ucPulse;
+                pStream->ucBit |= 0x80;
+                break;
+            }
+            pStream->ucBit &= 0x7f;
+
+            if ((pStream->ucFirstPulse == Pulse_Short) && (ucPulse == Pulse_Medium))
+                ucBit = 0;
+            else if ((pStream->ucFirstPulse == Pulse_Medium) && (ucPulse == Pulse_Short))
+                ucBit = 1;
+            else
+                return EndBlock(pStream, TRUE);
+
+            if (pStream->ucBit < 8)
+            {
+                pStream->ucByte |= (ucBit << pStream->ucBit);
+                pStream->ucBit++;
+                break;
+            }
+
+            // Parity bit: odd parity of data bits and parity bit.
+            ucPulse = pStream->ucByte;
+            ucPulse ^= ucPulse >> 4;
+            ucPulse ^= ucPulse >> 2;
+            ucPulse ^= ucPulse >> 1;
+            if (((ucPulse ^ ucBit) & 1) != 1)
+                pStream->bBlockBroken = TRUE;
+
+            if (pStream->iBlockLen == CBMDecode_Max_Block_Size)
+                return EndBlock(pStream, TRUE);
+            pStream->ucBlock[pStream->iBlockLen++] = pStream->ucByte;
+            pStream->iState = State_Marker;
+            break;
+    }
+
+    return 0;
+}
+
+
+// Start a decoding, Output is called for every program decoded.
+void CBMDecode_Begin(CBMDecode_Stream *pStream, CBMDecode_Output_t Output, void *pContext)
+{
+    memset(pStream, 0, sizeof(*pStream));
+    pStream->Output = Output;
+    pStream->pContext = pContext;
+    pStream->iPendingRepeat = Repeat_None;
+}
+
+
+// Decode the next CAP signal. Returns -1 if Output failed.
+__int32 CBMDecode_Signal(CBMDecode_Stream *pStream, unsigned __int64 ui64Delta)
+{
+    pStream->uiNumSignals++;
+
+    // Skip first halfwave (time until first pulse starts).
+    if (pStream->uiNumSignals == 1)
+        return 0;
+
+    // A pulse consists of two halfwaves.
+    if (!pStream->bHaveHalfwave)
+    {
+        pStream->ui64Halfwave = ui64Delta;
+        pStream->bHaveHalfwave = TRUE;
+        return 0;
+    }
+    pStream->bHaveHalfwave = FALSE;
+    ui64Delta += pStream->ui64Halfwave;
+
+    TrackLeader(pStream, ui64Delta);
+
+    // Nothing to decode before the first leader.
+    if (pStream->ui64Short == 0)
+        return 0;
+
+    return DecodePulse(pStream, ClassifyPulse(pStream, ui64Delta));
+}
+
+
+// Finish the decoding, report a program whose data is missing.
+__int32 CBMDecode_End(CBMDecode_Stream *pStream)
+{
+    if (pStream->iBlockLen > 0)
+        if (EndBlock(pStream, TRUE) != 0)
+            return -1;
+
+    if (pStream->bExpectData)
+        ReportMissingData(pStream);
+
+    return 0;
+}
@@ -0,0 +1,78 @@
+/*
+ *  CBM 1530/1531 tape routines.
+ *  Decoder for files saved by the standard CBM kernal tape routines.
+*/
+
+#ifndef __CBMDECODE_H_
+#define __CBMDECODE_H_
+
+#include "tapearch.h"
+
+// Header types of the kernal tape format
+#define CBMDecode_Type_Relocatable_Program 1
+#define CBMDecode_Type_Data_Block          2
+#define CBMDecode_Type_Program             3
+#define CBMDecode_Type_SEQ_Header          4
+#define CBMDecode_Type_End_Of_Tape         5
+
+// Longest block: a program of 64KB, countdown sequence and checksum.
+#define CBMDecode_Max_Block_Size (65536 + 10)
+
+// A decoded program file.
+typedef struct
+{
+    unsigned __int8  ucType;
+    unsigned __int32 uiStart, uiEnd; // End address is exclusive.
+    unsigned __int8  ucName[16];     // PETSCII, padded with spaces.
+    unsigned __int8  *pucData;
+    unsigned __int32 uiLength;
+} CBMDecode_File;
+
+// Called for every program decoded with a valid checksum, returns 0 on success.
+typedef __int32 (*CBMDecode_Output_t)(void *pContext, const CBMDecode_File *pFile);
+
+// State of a decoding fed signal by signal.
+typedef struct
+{
+    CBMDecode_Output_t Output;
+    void               *pContext;
+
+    // Pulses
+    unsigned __int32 uiNumSignals;     // CAP signals fed so far.
+    BOOL             bHaveHalfwave;    // First half of a pulse seen.
+    unsigned __int64 ui64Halfwave;
+    unsigned __int64 ui64Average;      // Running average of similar pulses.
+    unsigned __int32 uiRun;            // Number of similar pulses in a row.
+    unsigned __int64 ui64Short;        // Short pulse length learned from leader, 0 = none yet.
+
+    // Bytes and blocks
+    __int32          iState;
+    unsigned __int8  ucFirstPulse, ucByte, ucBit;
+    unsigned __int8  ucBlock[CBMDecode_Max_Block_Size];
+    __int32          iBlockLen;
+    BOOL             bBlockBroken;
+
+    // Current file
+    BOOL             bExpectData;      // Program header decoded, data not yet.
+    __int32          iPendingRepeat;   // Block the next repeat belongs to.
+    BOOL             bHeaderFailed;    // First copy of a header damaged.
+    BOOL             bDataFailed;      // First copy of the data damaged.
+    CBMDecode_File   File;
+
+    // Statistics
+    __int32          iNumFiles, iNumErrors;
+} CBMDecode_Stream;
+
+// Start a decoding, Output is called for every program decoded.
+void CBMDecode_Begin(CBMDecode_Stream *pStream, CBMDecode_Output_t Output, void *pContext);
+
+// Decode the next CAP signal. Returns -1 if Output failed.
+__int32 CBMDecode_Signal(CBMDecode_Stream *pStream, unsigned __int64 ui64Delta);
+
+// Finish the decoding, report a program whose data is missing.
+__int32 CBMDecode_End(CBMDecode_Stream *pStream);
+
+// Printable form of a tape file name, trailing spaces removed.
+void CBMDecode_GetName(const unsigned __int8 ucName[16], __int8 pcName[17]);
+
+#endif
@@ -5,11 +5,13 @@
 
 #include <stdio.h>
 #include <stdlib.h>
-#include <Windows.h>
+#include <string.h>
+#include "tapearch.h"
 
 #include "cap.h"
 #include "tap-cbm.h"
 #include "misc.h"
+#include "cap2cbmtap.h"
 
 #define FREQ_C64_PAL    985248
 #define FREQ_C64_NTSC  1022727
@@ -27,7 +29,6 @@
 __int32 HandlePause(HANDLE hTAP, unsigned __int64 ui64Len, unsigned __int8 uiNeededSplit, unsigned __int8 TAPv, unsigned __int32 *puiCounter)
 {
     unsigned __int32 numsplits, i;
-    __int32          FuncRes;
 
     if (TAPv == TAPv2)
     {
@@ -100,34 +101,15 @@ __int32 HandlePause(HANDLE hTAP, unsigned __int64 ui64Len, unsigned __int8 uiNee
 }
 
 
-__int32 Initialize_TAP_header_and_return_frequencies(HANDLE hCAP, HANDLE hTAP, unsigned __int32 *puiTimer_Precision_MHz, unsigned __int32 *puiFreq)
+// Set TAP header from CAP machine and video type, and start a conversion fed signal by signal.
+__int32 CBMTAP_StreamBegin(CBMTAP_Stream *pStream, HANDLE hTAP, unsigned __int8 CAP_Machine, unsigned __int8 CAP_Video, unsigned __int32 uiTimer_Precision_MHz)
 {
-    unsigned __int8 CAP_Machine, CAP_Video, TAP_Machine, TAP_Video, TAP_Version;
+    unsigned __int8 TAP_Machine, TAP_Video, TAP_Version;
     __int32         FuncRes;
 
-    // Seek to start of image file and read image header, extract & verify header contents, seek to start of image data.
-    FuncRes = CAP_ReadHeader(hCAP);
-    if (FuncRes != CAP_Status_OK)
-    {
-        CAP_OutputError(FuncRes);
-        return -1;
-    }
-
-    // Return target machine type from header.
-    FuncRes = CAP_GetHeader_Machine(hCAP, &CAP_Machine);
-    if (FuncRes != CAP_Status_OK)
-    {
-        CAP_OutputError(FuncRes);
-        return -1;
-    }
-
-    // Return target video type from header.
-    FuncRes = CAP_GetHeader_Video(hCAP, &CAP_Video);
-    if (FuncRes != CAP_Status_OK)
-    {
-        CAP_OutputError(FuncRes);
-        return -1;
-    }
+    memset(pStream, 0, sizeof(*pStream));
+    pStream->hTAP = hTAP;
+    pStream->uiTimer_Precision_MHz = uiTimer_Precision_MHz;
 
     if (CAP_Machine == CAP_Machine_C64)
     {
@@ -177,126 +159,130 @@ __int32 Initialize_TAP_header_and_return_frequencies(HANDLE hCAP, HANDLE hTAP, u
         return -1;
     }
 
-    // Determine frequencies.
-
-    // Return timestamp precision from header.
-    FuncRes = CAP_GetHeader_Precision(hCAP, puiTimer_Precision_MHz);
-    if (FuncRes != CAP_Status_OK)
+    // Get target TAP version from header.
+    FuncRes = TAP_CBM_GetHeader_TAPversion(hTAP, &(pStream->TAPv));
+    if (FuncRes != TAP_CBM_Status_OK)
     {
-        CAP_OutputError(FuncRes);
+        TAP_CBM_OutputError(FuncRes);
         return -1;
     }
 
+    // Determine frequencies.
     if (     (CAP_Machine == CAP_Machine_C64)  && (CAP_Video == CAP_Video_PAL))
-        *puiFreq = FREQ_C64_PAL;
+        pStream->uiFreq = FREQ_C64_PAL;
     else if ((CAP_Machine == CAP_Machine_C64)  && (CAP_Video == CAP_Video_NTSC))
-        *puiFreq = FREQ_C64_NTSC;
+        pStream->uiFreq = FREQ_C64_NTSC;
     else if ((CAP_Machine == CAP_Machine_VC20) && (CAP_Video == CAP_Video_PAL))
-        *puiFreq = FREQ_VIC_PAL;
+        pStream->uiFreq = FREQ_VIC_PAL;
     else if ((CAP_Machine == CAP_Machine_VC20) && (CAP_Video == CAP_Video_NTSC))
-        *puiFreq = FREQ_VIC_NTSC;
+        pStream->uiFreq = FREQ_VIC_NTSC;
     else if ((CAP_Machine == CAP_Machine_C16)  && (CAP_Video == CAP_Video_PAL))
-        *puiFreq = FREQ_C16_PAL;
+        pStream->uiFreq = FREQ_C16_PAL;
     else if ((CAP_Machine == CAP_Machine_C16)  && (CAP_Video == CAP_Video_NTSC))
-        *puiFreq = FREQ_C16_NTSC;
+        pStream->uiFreq = FREQ_C16_NTSC;
     else
     {
         printf("Error: Can't determine machine frequency.\n");
         return -1;
     }
 
+    // (Delta*Freq/Precision + 500000) / 1000000 machine cycles.
+    PulseQuantizer_Init(&(pStream->Quant), pStream->uiFreq, (unsigned __int64)uiTimer_Precision_MHz*1000000);
+
     printf("\n");
 
     return 0;
 }
 
 
-// Convert CAP to CBM TAP format.
-__int32 CAP2CBMTAP(HANDLE hCAP, HANDLE hTAP)
+// Convert the next uiCount CAP signals to CBM TAP format.
+__int32 CBMTAP_StreamSignals(CBMTAP_Stream *pStream, const unsigned __int64 *pui64Deltas, unsigned __int32 uiCount)
 {
-    unsigned __int64 ui64Delta, ui64Delta2, ui64Len;
-    unsigned __int32 Timer_Precision_MHz, uiFreq;
-    unsigned __int8  TAPv; // TAP file format version.
-    unsigned __int8  ch;   // Single TAP data byte.
-    __int32          TAP_Counter = 0; // CAP & TAP file byte counters.
-    __int32          FuncRes, ReadFuncRes; // Function call results.
-
-    if (Initialize_TAP_header_and_return_frequencies(hCAP, hTAP, &Timer_Precision_MHz, &uiFreq) != 0)
-        return -1;
-
-    // Start conversion CAP->TAP.
+    unsigned __int64 ui64Pulses[CBMTAP_Chunk_Signals]; // Pulse lengths in CAP ticks.
+    unsigned __int64 ui64Lens[CBMTAP_Chunk_Signals];   // Pulse lengths in machine cycles.
+    unsigned __int64 ui64Delta, ui64Len;
+    unsigned __int32 uiNumPulses, i;
+    unsigned __int8  ch; // Single TAP data byte.
 
-    // Get target TAP version from header.
-    FuncRes = TAP_CBM_GetHeader_TAPversion(hTAP, &TAPv);
-    if (FuncRes != TAP_CBM_Status_OK)
+    while (uiCount > 0)
     {
-        TAP_CBM_OutputError(FuncRes);
-        return -1;
-    }
+        // Collect the pulses of the next chunk.
+        uiNumPulses = 0;
+        while ((uiCount > 0) && (uiNumPulses < CBMTAP_Chunk_Signals))
+        {
+            ui64Delta = *pui64Deltas++;
+            uiCount--;
 
-    // Skip first halfwave (time until first pulse starts).
-    FuncRes = CAP_ReadSignal(hCAP, &ui64Delta, NULL);
-    if (FuncRes == CAP_Status_OK_End_of_file)
-    {
-        printf("Error: Empty image file.");
-        return -1;
-    }
-    else if (FuncRes == CAP_Status_Error_Reading_data)
-    {
-        CAP_OutputError(FuncRes);
-        return -1;
-    }
+            pStream->uiNumSignals++;
 
-    // Convert while CAP file signal available.
-    while ((ReadFuncRes = CAP_ReadSignal(hCAP, &ui64Delta, NULL)) == CAP_Status_OK)
-    {
-        if ((TAPv == TAPv0) || (TAPv == TAPv1))
-        {
-            // Get and add timestamp of falling edge.
-            FuncRes = CAP_ReadSignal(hCAP, &ui64Delta2, NULL);
-            if (FuncRes == CAP_Status_Error_Reading_data)
+            // Skip first halfwave (time until first pulse starts).
+            if (pStream->uiNumSignals == 1)
+                continue;
+
+            if ((pStream->TAPv == TAPv0) || (pStream->TAPv == TAPv1))
             {
-                CAP_OutputError(FuncRes);
-                return -1;
+                // Wait for the timestamp of the falling edge and add it.
+                if (!pStream->bHaveRisingEdge)
+                {
+                    pStream->ui64RisingEdge = ui64Delta;
+                    pStream->bHaveRisingEdge = TRUE;
+                    continue;
+                }
+                pStream->bHaveRisingEdge = FALSE;
+                ui64Delta += pStream->ui64RisingEdge;
             }
-            else if (FuncRes == CAP_Status_OK_End_of_file)
-                break;
 
-            ui64Delta += ui64Delta2;
+            ui64Pulses[uiNumPulses++] = ui64Delta;
         }
 
-        ui64Len = (ui64Delta*uiFreq/Timer_Precision_MHz+500000)/1000000;
+        // Convert all of them to machine cycles at once.
+        PulseQuantizer_Run(&(pStream->Quant), ui64Pulses, ui64Lens, uiNumPulses);
 
-        if (ui64Len > 2040) // 8*0xff=2040
+        for (i = 0; i < uiNumPulses; i++)
         {
-            // We have a pause.
-            if ((TAPv == TAPv0) || (TAPv == TAPv1))
+            ui64Len = ui64Lens[i];
+
+            if (ui64Len > 2040) // 8*0xff=2040
             {
-                if (HandlePause(hTAP, ui64Len, NeedEvenSplitNumber, TAPv, &TAP_Counter) == -1)
-                    return -1;
+                // We have a pause.
+                if ((pStream->TAPv == TAPv0) || (pStream->TAPv == TAPv1))
+                {
+                    if (HandlePause(pStream->hTAP, ui64Len, NeedEvenSplitNumber, pStream->TAPv, &(pStream->TAP_Counter)) == -1)
+                        return -1;
+                }
+                else
+                {
+                    if (HandlePause(pStream->hTAP, ui64Len, NeedOddSplitNumber, pStream->TAPv, &(pStream->TAP_Counter)) == -1)
+                        return -1;
+                }
             }
             else
             {
-                if (HandlePause(hTAP, ui64Len, NeedOddSplitNumber, TAPv, &TAP_Counter) == -1)
-                    return -1;
+                // We have a data byte.
+                ch = (unsigned __int8) ((ui64Len+4)/8);
+                Check_TAP_CBM_Error_TextRetM1(TAP_CBM_WriteSignal_1Byte(pStream->hTAP, ch, &(pStream->TAP_Counter)));
             }
         }
-        else
-        {
-            // We have a data byte.
-            ch = (unsigned __int8) ((ui64Len+4)/8);
-            Check_TAP_CBM_Error_TextRetM1(TAP_CBM_WriteSignal_1Byte(hTAP, ch, &TAP_Counter));
-        }
-    } // Convert while CAP file signal available.
-
-    if (ReadFuncRes == CAP_Status_Error_Reading_data)
-    {
-        CAP_OutputError(ReadFuncRes);
-        return -1;
     }
 
+    return 0;
+}
+
+
+// Convert the next CAP signal to CBM TAP format.
+__int32 CBMTAP_StreamSignal(CBMTAP_Stream *pStream, unsigned __int64 ui64Delta)
+{
+    return CBMTAP_StreamSignals(pStream, &ui64Delta, 1);
+}
+
+
+// Finish the conversion: set signal byte count in header.
+__int32 CBMTAP_StreamEnd(CBMTAP_Stream *pStream)
+{
+    __int32 FuncRes;
+
     // Set signal byte count in header (sum of all signal bytes).
-    FuncRes = TAP_CBM_SetHeader_ByteCount(hTAP, TAP_Counter);
+    FuncRes = TAP_CBM_SetHeader_ByteCount(pStream->hTAP, pStream->TAP_Counter);
     if (FuncRes != TAP_CBM_Status_OK)
     {
         TAP_CBM_OutputError(FuncRes);
@@ -304,7 +290,7 @@ __int32 CAP2CBMTAP(HANDLE hCAP, HANDLE hTAP)
     }
 
     // Seek to start of file & write image header.
-    FuncRes = TAP_CBM_WriteHeader(hTAP);
+    FuncRes = TAP_CBM_WriteHeader(pStream->hTAP);
     if (FuncRes != TAP_CBM_Status_OK)
     {
         TAP_CBM_OutputError(FuncRes);
@@ -313,3 +299,72 @@ __int32 CAP2CBMTAP(HANDLE hCAP, HANDLE hTAP)
 
     return 0;
 }
+
+
+// Convert CAP to CBM TAP format.
+__int32 CAP2CBMTAP(HANDLE hCAP, HANDLE hTAP)
+{
+    CBMTAP_Stream    Stream;
+    unsigned __int64 ui64Deltas[CBMTAP_Chunk_Signals];
+    unsigned __int32 Timer_Precision_MHz, uiNumRead;
+    unsigned __int8  CAP_Machine, CAP_Video;
+    __int32          FuncRes, ReadFuncRes; // Function call results.
+
+    // Seek to start of image file and read image header, extract & verify header contents, seek to start of image data.
+    FuncRes = CAP_ReadHeader(hCAP);
+    if (FuncRes != CAP_Status_OK)
+    {
+        CAP_OutputError(FuncRes);
+        return -1;
+    }
+
+    // Return target machine type from header.
+    FuncRes = CAP_GetHeader_Machine(hCAP, &CAP_Machine);
+    if (FuncRes != CAP_Status_OK)
+    {
+        CAP_OutputError(FuncRes);
+        return -1;
+    }
+
+    // Return target video type from header.
+    FuncRes = CAP_GetHeader_Video(hCAP, &CAP_Video);
+    if (FuncRes != CAP_Status_OK)
+    {
+        CAP_OutputError(FuncRes);
+        return -1;
+    }
+
+    // Return timestamp precision from header.
+    FuncRes = CAP_GetHeader_Precision(hCAP, &Timer_Precision_MHz);
+    if (FuncRes != CAP_Status_OK)
+    {
+        CAP_OutputError(FuncRes);
+        return -1;
+    }
+
+    if (CBMTAP_StreamBegin(&Stream, hTAP, CAP_Machine, CAP_Video, Timer_Precision_MHz) != 0)
+        return -1;
+
+    // Start conversion CAP->TAP.
+
+    // Convert while CAP file signals available, a chunk at a time.
+    while ((ReadFuncRes = CAP_ReadSignals(hCAP, ui64Deltas, CBMTAP_Chunk_Signals, &uiNumRead)) == CAP_Status_OK)
+    {
+        if (CBMTAP_StreamSignals(&Stream, ui64Deltas, uiNumRead) == -1)
+            return -1;
+    }
+
+    if (ReadFuncRes == CAP_Status_Error_Reading_data)
+    {
+        CAP_OutputError(ReadFuncRes);
+        return -1;
+    }
+
+    if (Stream.uiNumSignals == 0)
+    {
+        printf("Error: Empty image file.");
+        return -1;
+    }
+
+    return CBMTAP_StreamEnd(&Stream);
+}
@@ -6,7 +6,36 @@
 #ifndef __CAP2CBMTAP_H_
 #define __CAP2CBMTAP_H_
 
-#include <Windows.h>
+#include "tapearch.h"
+#include "quantize.h"
+
+// Most signals converted at once.
+#define CBMTAP_Chunk_Signals 1024
+
+// State of a CAP to CBM TAP conversion fed signal by signal.
+typedef struct
+{
+    HANDLE           hTAP;
+    unsigned __int32 uiTimer_Precision_MHz, uiFreq;
+    unsigned __int8  TAPv;             // TAP file format version.
+    unsigned __int32 TAP_Counter;      // TAP file byte counter.
+    unsigned __int32 uiNumSignals;     // CAP signals converted so far.
+    BOOL             bHaveRisingEdge;  // TAPv0/TAPv1: first half of a pulse seen.
+    unsigned __int64 ui64RisingEdge;
+    PulseQuantizer   Quant;            // CAP signal to machine cycles.
+} CBMTAP_Stream;
+
+// Set TAP header from CAP machine and video type, and start a conversion fed signal by signal.
+__int32 CBMTAP_StreamBegin(CBMTAP_Stream *pStream, HANDLE hTAP, unsigned __int8 CAP_Machine, unsigned __int8 CAP_Video, unsigned __int32 uiTimer_Precision_MHz);
+
+// Convert the next CAP signal to CBM TAP format.
+__int32 CBMTAP_StreamSignal(CBMTAP_Stream *pStream, unsigned __int64 ui64Delta);
+
+// Convert the next uiCount CAP signals to CBM TAP format.
+__int32 CBMTAP_StreamSignals(CBMTAP_Stream *pStream, const unsigned __int64 *pui64Deltas, unsigned __int32 uiCount);
+
+// Finish the conversion: set signal byte count in header.
+__int32 CBMTAP_StreamEnd(CBMTAP_Stream *pStream);
 
 // Convert CAP to CBM TAP format.
 __int32 CAP2CBMTAP(HANDLE hCAP, HANDLE hTAP);
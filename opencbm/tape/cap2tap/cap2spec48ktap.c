@@ -6,9 +6,13 @@
 #include <stdio.h>
 #include <string.h>
 #include <stdlib.h>
-#include <Windows.h>
+#include "tapearch.h"
 
 #include "cap.h"
+#include "quantize.h"
+
+// Most signals converted at once.
+#define Chunk_Signals 1024
 
 // Define pulses.
 #define ShortPulse 1
@@ -30,7 +34,9 @@ __int32 CAP2SPEC48KTAP(HANDLE hCAP, FILE *TapFile)
     unsigned __int8  *zb; // Spectrum48K TAP image buffer.
     unsigned __int8  ch = 0;
     unsigned __int64 ui64Delta, ui64Len;
-    unsigned __int32 Timer_Precision_MHz;
+    unsigned __int64 ui64Deltas[Chunk_Signals], ui64Lens[Chunk_Signals];
+    unsigned __int32 Timer_Precision_MHz, uiNumRead, uiIndex;
+    PulseQuantizer   Quant;
     __int32          FuncRes;    // Function call result.
     __int32          RetVal = 0; // Default return value.
 
@@ -76,6 +82,9 @@ __int32 CAP2SPEC48KTAP(HANDLE hCAP, FILE *TapFile)
         goto exit;
     }
 
+    // (Delta + Precision/2) / Precision microseconds.
+    PulseQuantizer_Init(&Quant, 1, Timer_Precision_MHz);
+
     // Skip first halfwave (time until first pulse occurs).
     FuncRes = CAP_ReadSignal(hCAP, &ui64Delta, NULL);
     if (FuncRes == CAP_Status_OK_End_of_file)
@@ -91,124 +100,129 @@ __int32 CAP2SPEC48KTAP(HANDLE hCAP, FILE *TapFile)
         goto exit;
     }
 
-    // While CAP 5-byte timestamp available.
-    while ((FuncRes = CAP_ReadSignal(hCAP, &ui64Delta, NULL)) == CAP_Status_OK)
+    // While CAP 5-byte timestamps available, convert them a chunk at a time.
+    while ((FuncRes = CAP_ReadSignals(hCAP, ui64Deltas, Chunk_Signals, &uiNumRead)) == CAP_Status_OK)
     {
-        ui64Len = (ui64Delta+(Timer_Precision_MHz/2))/Timer_Precision_MHz;
-
-        if (DBGFLAG == 1) printf("%I64u ", ui64Len);
-
-        LastPulse = Pulse;
-
-        // Evaluate current pulse width.
-        if ((150 <= ui64Len) && (ui64Len <= 360))
-        {
-            Pulse = ShortPulse;
-            if (DBGFLAG == 1) printf("(SP) ");
-        }
-        else if ((360 < ui64Len) && (ui64Len < 550))
-        {
-            Pulse = LongPulse;
-            if (DBGFLAG == 1) printf("(LP) ");
-        }
-        else // <150 or >550
-        {
-            Pulse = PausePulse;
-            if (DBGFLAG == 1) printf("(PP) ");
-        }
+        PulseQuantizer_Run(&Quant, ui64Deltas, ui64Lens, uiNumRead);
 
-
-        if (Pulse == PausePulse)
+        for (uiIndex = 0; uiIndex < uiNumRead; uiIndex++)
         {
-            DataPulseCounter = 0;
-            BlockByteCounter = 0;
-
-            if (ByteCount > 0)
-            {
-                // Calculate block size and write to TAP image.
-                zb[BlockStart  ] = ByteCount & 0xff;
-                zb[BlockStart+1] = (ByteCount >> 8) & 0xff;
-                if (DBGFLAG == 1) printf("Block size = %u", ByteCount);
-                BlockStart = BlockPos;
-                BlockPos += 2;
-            }
-            ByteCount = 0;
-            BitCount = 0;
+            ui64Len = ui64Lens[uiIndex];
 
-        }
-        else DataPulseCounter++;
+            if (DBGFLAG == 1) printf("%" PRI64u " ", ui64Len);
 
+            LastPulse = Pulse;
 
-        // Evaluate waveform after every second data pulse.
-        if ((DataPulseCounter > 0) && ((DataPulseCounter % 2) == 0))
-        {
-
-            if ((LastPulse == ShortPulse) && (Pulse == ShortPulse))
+            // Evaluate current pulse width.
+            if ((150 <= ui64Len) && (ui64Len <= 360))
             {
-                Wave = ShortWave;
-                if (DBGFLAG == 1) printf("(SW) ");
+                Pulse = ShortPulse;
+                if (DBGFLAG == 1) printf("(SP) ");
             }
-            else if ((LastPulse == LongPulse) && (Pulse == LongPulse))
+            else if ((360 < ui64Len) && (ui64Len < 550))
             {
-                Wave = LongWave;
-                if (DBGFLAG == 1) printf("(LW) ");
+                Pulse = LongPulse;
+                if (DBGFLAG == 1) printf("(LP) ");
             }
-            else
+            else // <150 or >550
             {
-                Wave = ErrorWave;
-                if (DBGFLAG == 1) printf("(EW) ");
+                Pulse = PausePulse;
+                if (DBGFLAG == 1) printf("(PP) ");
             }
 
-            if ((Wave == ShortWave) || (Wave == LongWave))
-                BlockByteCounter++;
-            else
+
+            if (Pulse == PausePulse)
+            {
+                DataPulseCounter = 0;
                 BlockByteCounter = 0;
 
+                if (ByteCount > 0)
+                {
+                    // Calculate block size and write to TAP image.
+                    zb[BlockStart  ] = ByteCount & 0xff;
+                    zb[BlockStart+1] = (ByteCount >> 8) & 0xff;
+                    if (DBGFLAG == 1) printf("Block size = %u", ByteCount);
+                    BlockStart = BlockPos;
+                    BlockPos += 2;
+                }
+                ByteCount = 0;
+                BitCount = 0;
+
+            }
+            else DataPulseCounter++;
 
-            if (BlockByteCounter > 1)
+
+            // Evaluate waveform after every second data pulse.
+            if ((DataPulseCounter > 0) && ((DataPulseCounter % 2) == 0))
             {
-                // We found a bit.
-                BitCount++;
 
-                // Evaluate wave.
-                if (Wave == ShortWave)
+                if ((LastPulse == ShortPulse) && (Pulse == ShortPulse))
+                {
+                    Wave = ShortWave;
+                    if (DBGFLAG == 1) printf("(SW) ");
+                }
+                else if ((LastPulse == LongPulse) && (Pulse == LongPulse))
                 {
-                    ch = (ch << 1);
-                    if (DBGFLAG == 1) printf("(0)");
+                    Wave = LongWave;
+                    if (DBGFLAG == 1) printf("(LW) ");
                 }
-                else if (Wave == LongWave)
+                else
                 {
-                    ch = (ch << 1) + 1;
-                    if (DBGFLAG == 1) printf("(1)");
+                    Wave = ErrorWave;
+                    if (DBGFLAG == 1) printf("(EW) ");
                 }
 
-                if (BitCount == 8)
+                if ((Wave == ShortWave) || (Wave == LongWave))
+                    BlockByteCounter++;
+                else
+                    BlockByteCounter = 0;
+
+
+                if (BlockByteCounter > 1)
                 {
-                    ByteCount++; // Increase byte counter.
-                    BitCount = 0; // Reset bit counter.
+                    // We found a bit.
+                    BitCount++;
 
-                    zb[BlockPos++] = ch; // Store byte to image.
-                    if (DBGFLAG == 1) printf(" -----> 0x%.2x <%c>", ch, ch);
+                    // Evaluate wave.
+                    if (Wave == ShortWave)
+                    {
+                        ch = (ch << 1);
+                        if (DBGFLAG == 1) printf("(0)");
+                    }
+                    else if (Wave == LongWave)
+                    {
+                        ch = (ch << 1) + 1;
+                        if (DBGFLAG == 1) printf("(1)");
+                    }
 
-                    if (ByteCount == 1)
+                    if (BitCount == 8)
                     {
-                        // Evaluate first block byte.
-                        if (DBGFLAG == 1)
+                        ByteCount++; // Increase byte counter.
+                        BitCount = 0; // Reset bit counter.
+
+                        zb[BlockPos++] = ch; // Store byte to image.
+                        if (DBGFLAG == 1) printf(" -----> 0x%.2x <%c>", ch, ch);
+
+                        if (ByteCount == 1)
                         {
-                            if (ch == 0)
-                                printf(" [Header]");
-                            else if (ch == 0xff)
-                                printf(" [Data]");
-                            else
-                                printf(" [Unknown block!]");
+                            // Evaluate first block byte.
+                            if (DBGFLAG == 1)
+                            {
+                                if (ch == 0)
+                                    printf(" [Header]");
+                                else if (ch == 0xff)
+                                    printf(" [Data]");
+                                else
+                                    printf(" [Unknown block!]");
+                            }
                         }
-                    }
-                } // if (BitCount == 8)
+                    } // if (BitCount == 8)
 
-            } // if (BlockCounter > 1)
-            else if (DBGFLAG == 1) printf("(x)");
-        } // if ((DataPulseCounter > 0) && ((DataPulseCounter % 2) == 0))
-    } // While CAP 5-byte timestamp available.
+                } // if (BlockCounter > 1)
+                else if (DBGFLAG == 1) printf("(x)");
+            } // if ((DataPulseCounter > 0) && ((DataPulseCounter % 2) == 0))
+        } // For all signals of the chunk.
+    } // While CAP 5-byte timestamps available.
 
     if (FuncRes == CAP_Status_Error_Reading_data)
     {
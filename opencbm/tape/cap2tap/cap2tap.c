@@ -5,6 +5,7 @@
 
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 
 #include <arch.h>
 #include "cap2cbmtap.h"
@@ -16,44 +17,63 @@
 
 void usage(void)
 {
-    printf("\nUsage:   cap2tap <input.cap> <output.tap>\n\n");
+    printf("\nUsage:   cap2tap <input.cap> <output.tap>\n");
+    printf("         cap2tap -b [-j<threads>] <input.cap> [<input.cap> ...]\n\n");
+    printf("  -b         : batch mode, convert every <name>.cap to <name>.tap\n");
+    printf("               (existing TAP files are not overwritten)\n");
+    printf("  -j<threads>: number of files converted at the same time\n");
+    printf("               (default: one per processor)\n\n");
     printf("Example: cap2tap myfile.cap myfile.tap\n");
+    printf("         cap2tap -b -j4 *.cap\n");
 }
 
 
-__int32 Evaluate_Commandline_Params(__int32 argc, __int8 *argv[])
+__int32 Evaluate_Commandline_Params(__int32 argc, __int8 *argv[], BOOL *pbBatch, __int32 *piThreads, __int32 *piFirstFile)
 {
+    __int32 i = 1;
+
+    *pbBatch = FALSE;
+    *piThreads = 0;
+
+    if ((argc > 1) && (strcmp(argv[1], "-b") == 0))
+    {
+        *pbBatch = TRUE;
+        i++;
+        if ((argc > i) && (strncmp(argv[i], "-j", 2) == 0))
+        {
+            *piThreads = atoi(argv[i] + 2);
+            if (*piThreads <= 0)
+                return -1;
+            i++;
+        }
+        *piFirstFile = i;
+        return (argc > i) ? 0 : -1;
+    }
+
+    *piFirstFile = 1;
     if (argc == 3) return 0;
     else return -1;
 }
 
 
-// Main routine.
+// Convert one CAP image file to TAP.
+// If bAsk is not set, an existing TAP file is left alone instead of asking.
 //   Return values:
 //    0: conversion finished ok
 //   -1: an error occurred
-int ARCH_MAINDECL main(int argc, char *argv[])
+__int32 ConvertFile(__int8 *pcInput, __int8 *pcOutput, BOOL bAsk)
 {
     HANDLE          hCAP, hTAP;
-    FILE            *fd; // Experimental Spectrum48K support.
+    FILE            *fd = NULL; // Experimental Spectrum48K support.
     unsigned __int8 CAP_Machine;
     __int32         FuncRes, RetVal = -1;
 
-    printf("\nCAP2TAP v1.00 - ZoomTape CAP image to TAP image conversion\n");
-    printf("Copyright 2012 Arnd Menge\n\n");
-
-    if (Evaluate_Commandline_Params(argc, argv) == -1)
-    {
-        usage();
-        goto exit;
-    }
-
     // Open specified image file for reading.
-    FuncRes = CAP_OpenFile(&hCAP, argv[1]);
+    FuncRes = CAP_OpenFile(&hCAP, pcInput);
     if (FuncRes != CAP_Status_OK)
     {
         CAP_OutputError(FuncRes);
-        goto exit;
+        return -1;
     }
 
     // Seek to start of image file and read image header, extract & verify header contents, seek to start of image data.
@@ -62,7 +82,7 @@ int ARCH_MAINDECL main(int argc, char *argv[])
     {
         CAP_OutputError(FuncRes);
         CAP_CloseFile(&hCAP);
-        goto exit;
+        return -1;
     }
 
     // Get target machine type from header.
@@ -71,17 +91,24 @@ int ARCH_MAINDECL main(int argc, char *argv[])
     {
         CAP_OutputError(FuncRes);
         CAP_CloseFile(&hCAP);
-        goto exit;
+        return -1;
     }
 
     // Check if specified TAP image file is already existing.
-    if (TAP_CBM_isFilePresent(argv[2]) == TAP_CBM_Status_OK)
+    if (TAP_CBM_isFilePresent(pcOutput) == TAP_CBM_Status_OK)
     {
+        if (!bAsk)
+        {
+            printf("Skipping %s: %s already exists.\n", pcInput, pcOutput);
+            CAP_CloseFile(&hCAP);
+            return -1;
+        }
+
         printf("Overwrite existing file? (y/N)");
         if (getchar() != 'y')
         {
             CAP_CloseFile(&hCAP);
-            goto exit;
+            return -1;
         }
         printf("\n");
     }
@@ -90,26 +117,26 @@ int ARCH_MAINDECL main(int argc, char *argv[])
     if (CAP_Machine == CAP_Machine_Spec48K)
     {
         // Spectrum48K support is *EXPERIMENTAL*
-        fd = fopen(argv[2], "wb");
+        fd = fopen(pcOutput, "wb");
         if (fd == NULL)
         {
             printf("Error creating TAP file.");
             CAP_CloseFile(&hCAP);
-            goto exit;
+            return -1;
         }
     }
     else
     {
-        FuncRes = TAP_CBM_CreateFile(&hTAP, argv[2]);
+        FuncRes = TAP_CBM_CreateFile(&hTAP, pcOutput);
         if (FuncRes != CAP_Status_OK)
         {
             CAP_OutputError(FuncRes);
             CAP_CloseFile(&hCAP);
-            goto exit;
+            return -1;
         }
     }
 
-    printf("Converting: %s -> %s\n\n", argv[1], argv[2]);
+    printf("Converting: %s -> %s\n\n", pcInput, pcOutput);
 
     if (CAP_Machine == CAP_Machine_Spec48K)
     {
@@ -139,6 +166,44 @@ int ARCH_MAINDECL main(int argc, char *argv[])
         }
     }
 
+    return RetVal;
+}
+
+
+// Batch mode conversion of one file.
+__int32 ConvertBatchFile(__int8 *pcInput, __int8 *pcOutput)
+{
+    return ConvertFile(pcInput, pcOutput, FALSE);
+}
+
+
+// Main routine.
+//   Return values:
+//    0: conversion finished ok
+//   -1: an error occurred
+int ARCH_MAINDECL main(int argc, char *argv[])
+{
+    BOOL    bBatch;
+    __int32 iThreads, iFirstFile, RetVal = -1;
+
+    printf("\nCAP2TAP v1.00 - ZoomTape CAP image to TAP image conversion\n");
+    printf("Copyright 2012 Arnd Menge\n\n");
+
+    if (Evaluate_Commandline_Params(argc, argv, &bBatch, &iThreads, &iFirstFile) == -1)
+    {
+        usage();
+        goto exit;
+    }
+
+    if (bBatch)
+    {
+        // Convert all files, several at the same time.
+        RetVal = RunBatchConversion(argc - iFirstFile, argv + iFirstFile, ".tap", iThreads, ConvertBatchFile);
+        goto exit;
+    }
+
+    RetVal = ConvertFile(argv[1], argv[2], TRUE);
+
     if (RetVal == 0)
         printf("Conversion successful.");
 
@@ -0,0 +1,509 @@
+/*
+ *  CBM 1530/1531 tape routines.
+ *  Signal quality and jitter statistics of a CAP image.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+#include <arch.h>
+#include "cap.h"
+#include "misc.h"
+
+#define MaxWave       2000 // Longest full wave in histogram (us)
+#define PauseLen      2000 // Halfwaves this long (us) are pauses, pairing starts anew after them
+#define GlitchLen       20 // Halfwaves shorter than this (us) are glitches
+#define SmoothRadius     4 // Histogram smoothed over +-4us for finding peaks
+#define PeakRadius      16 // A peak is the highest point within +-16us
+#define MinPeakShare   200 // A peak holds at least 1/200 of all waves
+#define ValleyDepth      2 // Between two classes the histogram falls below 1/2 of the lower peak
+#define MaxClusters      8
+#define MinWindowWaves 100 // Speed windows with fewer waves are not rated
+#define DefaultWindow   10 // Speed window length (s)
+
+// Full waves of one pulse class (e.g. short, medium, long).
+typedef struct
+{
+    unsigned __int32 uiLow, uiHigh; // Waves of uiLow..uiHigh-1 us
+    unsigned __int32 uiPeak;
+    unsigned __int64 ui64Count;
+    double           dSum, dSumSq, dMin, dMax;
+    double           dAsymSum;      // Sum of |first-second| / wave
+} CLUSTER;
+
+// Waves of the most frequent class within a speed window.
+typedef struct
+{
+    double           dSum;
+    unsigned __int32 uiCount;
+} WINDOW;
+
+typedef struct
+{
+    unsigned __int32 uiPrecision;
+    double           dWindowLen;    // us
+    BOOL             bVerbose;
+
+    // First pass
+    unsigned __int32 uiHist[MaxWave];
+    unsigned __int64 ui64Halfwaves, ui64Waves, ui64Glitches, ui64Pauses;
+    double           dTapeTime;     // us
+
+    // Second pass
+    CLUSTER          Clusters[MaxClusters];
+    __int32          iNumClusters, iMain;
+    unsigned __int64 ui64Outliers;
+    WINDOW           *pWindows;
+    __int32          iNumWindows;
+} STATS;
+
+
+void usage(void)
+{
+    printf("\nUsage:   capstat [-v] [-w<seconds>] <input.cap>\n\n");
+    printf("  Shows the pulse classes of a capture with their jitter, the margin between\n");
+    printf("  them and the tape speed variation over time.\n\n");
+    printf("  -v         : also show the wave length histogram and the speed of every window\n");
+    printf("  -w<seconds>: length of the windows the tape speed is compared in (default: %d)\n\n", DefaultWindow);
+    printf("Example: capstat -v myfile.cap\n");
+}
+
+
+__int32 Evaluate_Commandline_Params(__int32 argc, __int8 *argv[], STATS *pStats, __int32 *piFile)
+{
+    __int32 i, iWindow = DefaultWindow;
+
+    pStats->bVerbose = FALSE;
+
+    for (i = 1; (i < argc) && (argv[i][0] == '-'); i++)
+    {
+        if (strcmp(argv[i], "-v") == 0)
+            pStats->bVerbose = TRUE;
+        else if (strncmp(argv[i], "-w", 2) == 0)
+        {
+            iWindow = atoi(argv[i] + 2);
+            if (iWindow <= 0)
+                return -1;
+        }
+        else
+            return -1;
+    }
+
+    pStats->dWindowLen = iWindow * 1000000.0;
+    *piFile = i;
+
+    return (argc == i + 1) ? 0 : -1;
+}
+
+
+// Time in seconds as hh:mm:ss.
+static void FormatTime(double dSeconds, __int8 pcTime[16])
+{
+    unsigned __int32 uiSecs = (unsigned __int32) dSeconds;
+
+    sprintf(pcTime, "%.2u:%.2u:%.2u", uiSecs/3600, (uiSecs/60)%60, uiSecs%60);
+}
+
+
+// Class of a wave, -1 if it belongs to none.
+static __int32 FindCluster(const STATS *pStats, double dWave)
+{
+    __int32 i;
+
+    for (i = 0; i < pStats->iNumClusters; i++)
+        if ((dWave >= pStats->Clusters[i].uiLow) && (dWave < pStats->Clusters[i].uiHigh))
+            return i;
+
+    return -1;
+}
+
+
+// Second pass: statistics of a wave within its class, speed over time from the main class.
+static __int32 AddWave(STATS *pStats, double dFirst, double dSecond, double dTime)
+{
+    double  dWave = dFirst + dSecond;
+    CLUSTER *pCluster;
+    WINDOW  *pNew;
+    __int32 i, iCluster, iWindow;
+
+    iCluster = FindCluster(pStats, dWave);
+    if (iCluster == -1)
+    {
+        pStats->ui64Outliers++;
+        return 0;
+    }
+
+    pCluster = &(pStats->Clusters[iCluster]);
+    if ((pCluster->ui64Count == 0) || (dWave < pCluster->dMin)) pCluster->dMin = dWave;
+    if ((pCluster->ui64Count == 0) || (dWave > pCluster->dMax)) pCluster->dMax = dWave;
+    pCluster->ui64Count++;
+    pCluster->dSum += dWave;
+    pCluster->dSumSq += dWave*dWave;
+    pCluster->dAsymSum += fabs(dFirst - dSecond) / dWave;
+
+    if (iCluster != pStats->iMain)
+        return 0;
+
+    iWindow = (__int32) (dTime / pStats->dWindowLen);
+    if (iWindow >= pStats->iNumWindows)
+    {
+        pNew = realloc(pStats->pWindows, (iWindow + 64) * sizeof(WINDOW));
+        if (pNew == NULL)
+        {
+            printf("Error: Could not allocate memory for speed windows.\n");
+            return -1;
+        }
+        for (i = pStats->iNumWindows; i < iWindow + 64; i++)
+        {
+            pNew[i].dSum = 0;
+            pNew[i].uiCount = 0;
+        }
+        pStats->pWindows = pNew;
+        pStats->iNumWindows = iWindow + 64;
+    }
+    pStats->pWindows[iWindow].dSum += dWave;
+    pStats->pWindows[iWindow].uiCount++;
+
+    return 0;
+}
+
+
+// Read all signals of the image and pair halfwaves to full waves.
+// Pass 1 builds the histogram, pass 2 the class statistics.
+static __int32 ScanWaves(HANDLE hCAP, STATS *pStats, __int32 iPass)
+{
+    unsigned __int64 ui64Delta;
+    double           dHalf, dFirst = 0, dTime;
+    BOOL             bHaveFirst = FALSE;
+    __int32          FuncRes;
+
+    // Seek to start of image file and read image header, seek to start of image data.
+    FuncRes = CAP_ReadHeader(hCAP);
+    Check_CAP_Error_TextRetM1(FuncRes);
+
+    // Initial pause (until first falling edge).
+    FuncRes = CAP_ReadSignal(hCAP, &ui64Delta, NULL);
+    if (FuncRes != CAP_Status_OK)
+    {
+        printf("Error: Image contains no signals.\n");
+        return -1;
+    }
+    dTime = (double) ui64Delta / pStats->uiPrecision;
+
+    while ((FuncRes = CAP_ReadSignal(hCAP, &ui64Delta, NULL)) == CAP_Status_OK)
+    {
+        dHalf = (double) ui64Delta / pStats->uiPrecision;
+        dTime += dHalf;
+
+        if (iPass == 1)
+        {
+            pStats->ui64Halfwaves++;
+            if (dHalf < GlitchLen)
+                pStats->ui64Glitches++;
+        }
+
+        if (dHalf >= PauseLen)
+        {
+            if (iPass == 1)
+                pStats->ui64Pauses++;
+            bHaveFirst = FALSE;
+            continue;
+        }
+
+        if (!bHaveFirst)
+        {
+            dFirst = dHalf;
+            bHaveFirst = TRUE;
+            continue;
+        }
+        bHaveFirst = FALSE;
+
+        if (iPass == 1)
+        {
+            if (dFirst + dHalf < MaxWave)
+            {
+                pStats->uiHist[(unsigned __int32) (dFirst + dHalf)]++;
+                pStats->ui64Waves++;
+            }
+        }
+        else if (AddWave(pStats, dFirst, dHalf, dTime) == -1)
+            return -1;
+    }
+
+    if (FuncRes == CAP_Status_Error_Reading_data)
+    {
+        CAP_OutputError(FuncRes);
+        return -1;
+    }
+
+    if (iPass == 1)
+        pStats->dTapeTime = dTime;
+
+    return 0;
+}
+
+
+// Lowest bin of the smoothed histogram between two peaks.
+static __int32 FindValley(const unsigned __int32 *puiSmooth, __int32 iFrom, __int32 iTo)
+{
+    __int32 i, iValley = iFrom;
+
+    for (i = iFrom; i < iTo; i++)
+        if (puiSmooth[i] < puiSmooth[iValley])
+            iValley = i;
+
+    return iValley;
+}
+
+
+// Find pulse classes as peaks of the smoothed histogram, split at the minimum between two peaks.
+static void FindClusters(STATS *pStats)
+{
+    unsigned __int32 uiSmooth[MaxWave], uiPeaks[MaxWave], uiMainCount = 0, uiCount;
+    __int32          i, j, k, iNumPeaks = 0;
+    BOOL             bPeak;
+
+    for (i = 0; i < MaxWave; i++)
+    {
+        uiSmooth[i] = 0;
+        for (j = max(0, i - SmoothRadius); j <= min(MaxWave - 1, i + SmoothRadius); j++)
+            uiSmooth[i] += pStats->uiHist[j];
+    }
+
+    for (i = 1; i < MaxWave; i++)
+    {
+        if ((uiSmooth[i] == 0) || ((unsigned __int64) uiSmooth[i]*MinPeakShare < pStats->ui64Waves))
+            continue;
+
+        // Highest point around, first bin of a plateau.
+        bPeak = (uiSmooth[i] > uiSmooth[i-1]);
+        for (j = max(0, i - PeakRadius); bPeak && (j <= min(MaxWave - 1, i + PeakRadius)); j++)
+            if (uiSmooth[j] > uiSmooth[i])
+                bPeak = FALSE;
+
+        if (bPeak)
+            uiPeaks[iNumPeaks++] = i;
+    }
+
+    // Jitter leaves several peaks within one class, keep the highest if they are not separated by a valley.
+    for (k = 0; k < iNumPeaks - 1; )
+    {
+        if ((unsigned __int64) uiSmooth[FindValley(uiSmooth, uiPeaks[k], uiPeaks[k+1])]*ValleyDepth <
+            min(uiSmooth[uiPeaks[k]], uiSmooth[uiPeaks[k+1]]))
+        {
+            k++;
+            continue;
+        }
+
+        if (uiSmooth[uiPeaks[k+1]] > uiSmooth[uiPeaks[k]])
+            uiPeaks[k] = uiPeaks[k+1];
+        for (j = k+1; j < iNumPeaks - 1; j++)
+            uiPeaks[j] = uiPeaks[j+1];
+        iNumPeaks--;
+        if (k > 0) k--;
+    }
+
+    pStats->iNumClusters = min(iNumPeaks, MaxClusters);
+    for (k = 0; k < pStats->iNumClusters; k++)
+    {
+        CLUSTER *pCluster = &(pStats->Clusters[k]);
+
+        memset(pCluster, 0, sizeof(CLUSTER));
+        pCluster->uiPeak = uiPeaks[k];
+        pCluster->uiLow = (k == 0) ? uiPeaks[0]/2 : pStats->Clusters[k-1].uiHigh;
+        if (k == pStats->iNumClusters - 1)
+            pCluster->uiHigh = min(MaxWave, uiPeaks[k]*3/2);
+        else
+            pCluster->uiHigh = FindValley(uiSmooth, uiPeaks[k], uiPeaks[k+1]);
+
+        // The class with most waves gives the tape speed.
+        uiCount = 0;
+        for (j = pCluster->uiLow; j < (__int32) pCluster->uiHigh; j++)
+            uiCount += pStats->uiHist[j];
+        if (uiCount > uiMainCount)
+        {
+            uiMainCount = uiCount;
+            pStats->iMain = k;
+        }
+    }
+}
+
+
+static void PrintHistogram(const STATS *pStats)
+{
+    unsigned __int32 uiBins[MaxWave/8], uiMaxBin = 0;
+    __int32          i, iFirst = -1, iLast = -1;
+    __int8           pcBar[51];
+
+    for (i = 0; i < MaxWave/8; i++)
+    {
+        uiBins[i] = pStats->uiHist[i*8] + pStats->uiHist[i*8+1] + pStats->uiHist[i*8+2] + pStats->uiHist[i*8+3] +
+                    pStats->uiHist[i*8+4] + pStats->uiHist[i*8+5] + pStats->uiHist[i*8+6] + pStats->uiHist[i*8+7];
+        if (uiBins[i] > 0)
+        {
+            if (iFirst == -1) iFirst = i;
+            iLast = i;
+        }
+        if (uiBins[i] > uiMaxBin) uiMaxBin = uiBins[i];
+    }
+
+    printf("\nFull wave histogram (8us bins):\n");
+    for (i = iFirst; (i != -1) && (i <= iLast); i++)
+    {
+        __int32 iLen = (__int32) ((unsigned __int64) uiBins[i]*50/uiMaxBin);
+
+        memset(pcBar, '#', iLen);
+        pcBar[iLen] = '\0';
+        printf("  %4d-%4dus %9u %s\n", i*8, i*8+7, uiBins[i], pcBar);
+    }
+}
+
+
+static void PrintStatistics(const STATS *pStats)
+{
+    const CLUSTER *pCluster;
+    double        dMean[MaxClusters], dDev[MaxClusters], dMainMean, dSpeed, dMinSpeed = 0, dMaxSpeed = 0, dSumSq = 0;
+    __int32       i, iRated = 0;
+    __int8        pcTime[16];
+
+    FormatTime(pStats->dTapeTime/1000000, pcTime);
+    printf("Tape time   : %s\n", pcTime);
+    printf("Halfwaves   : %" PRI64u "\n", pStats->ui64Halfwaves);
+    printf("Glitches    : %" PRI64u " (halfwaves < %dus)\n", pStats->ui64Glitches, GlitchLen);
+    printf("Pauses      : %" PRI64u " (halfwaves >= %dus)\n", pStats->ui64Pauses, PauseLen);
+    printf("Full waves  : %" PRI64u " (< %dus), %" PRI64u " in no pulse class\n", pStats->ui64Waves, MaxWave, pStats->ui64Outliers);
+
+    if (pStats->bVerbose)
+        PrintHistogram(pStats);
+
+    if (pStats->iNumClusters == 0)
+    {
+        printf("\nNo pulse classes found.\n");
+        return;
+    }
+
+    // Jitter: standard deviation relative to mean wave length of the class.
+    // Asymmetry: mean difference between both halfwaves relative to the wave.
+    printf("\nPulse classes (full waves):\n");
+    printf("  Class  Range(us)       Waves   Mean(us) StdDev(us)  Jitter  Min(us)  Max(us)  Asym\n");
+    for (i = 0; i < pStats->iNumClusters; i++)
+    {
+        pCluster = &(pStats->Clusters[i]);
+        dMean[i] = dDev[i] = 0;
+        if (pCluster->ui64Count == 0)
+            continue;
+
+        dMean[i] = pCluster->dSum / pCluster->ui64Count;
+        dDev[i] = sqrt(max(0, pCluster->dSumSq / pCluster->ui64Count - dMean[i]*dMean[i]));
+        printf("  %c%-4d %4u-%-4u %12" PRI64u " %10.1f %10.1f %6.2f%% %8.1f %8.1f %5.1f%%\n",
+            (i == pStats->iMain) ? '*' : ' ', i+1, pCluster->uiLow, pCluster->uiHigh, pCluster->ui64Count,
+            dMean[i], dDev[i], 100*dDev[i]/dMean[i], pCluster->dMin, pCluster->dMax,
+            100*pCluster->dAsymSum/pCluster->ui64Count);
+    }
+
+    // Margin: distance between two class means in sums of their standard deviations.
+    // Waves are misclassified more and more often below ~3.
+    for (i = 0; i < pStats->iNumClusters - 1; i++)
+        if ((dDev[i] + dDev[i+1]) > 0)
+            printf("  Margin %d/%d: %.1f\n", i+1, i+2, (dMean[i+1] - dMean[i]) / (dDev[i] + dDev[i+1]));
+
+    // Tape speed: mean wave length of main class per window relative to whole tape.
+    dMainMean = dMean[pStats->iMain];
+    if (pStats->bVerbose)
+        printf("\nSpeed per window (class %d):\n", pStats->iMain+1);
+    for (i = 0; i < pStats->iNumWindows; i++)
+    {
+        if (pStats->pWindows[i].uiCount < MinWindowWaves)
+            continue;
+
+        // Longer waves mean slower tape.
+        dSpeed = 100*(dMainMean / (pStats->pWindows[i].dSum / pStats->pWindows[i].uiCount) - 1);
+        if ((iRated == 0) || (dSpeed < dMinSpeed)) dMinSpeed = dSpeed;
+        if ((iRated == 0) || (dSpeed > dMaxSpeed)) dMaxSpeed = dSpeed;
+        dSumSq += dSpeed*dSpeed;
+        iRated++;
+
+        if (pStats->bVerbose)
+        {
+            FormatTime(i*pStats->dWindowLen/1000000, pcTime);
+            printf("  %s %9u waves %+6.2f%%\n", pcTime, pStats->pWindows[i].uiCount, dSpeed);
+        }
+    }
+
+    if (iRated > 0)
+        printf("\nSpeed variation (class %d, %d windows of %.0fs): %+.2f%% .. %+.2f%%, rms %.2f%%\n",
+            pStats->iMain+1, iRated, pStats->dWindowLen/1000000, dMinSpeed, dMaxSpeed, sqrt(dSumSq/iRated));
+    else
+        printf("\nSpeed variation: no window with %d waves of class %d.\n", MinWindowWaves, pStats->iMain+1);
+}
+
+
+// Main routine.
+//   Return values:
+//    0: statistics shown
+//   -1: an error occurred
+int ARCH_MAINDECL main(int argc, char *argv[])
+{
+    HANDLE  hCAP;
+    STATS   *pStats;
+    __int32 iFile, FuncRes, RetVal = -1;
+
+    printf("\nCAPSTAT v1.00 - ZoomTape CAP image signal statistics\n\n");
+
+    // The histogram is large, don't put it on the stack.
+    pStats = malloc(sizeof(STATS));
+    if (pStats == NULL)
+    {
+        printf("Error: Could not allocate memory for statistics.\n\n");
+        return -1;
+    }
+    memset(pStats, 0, sizeof(STATS));
+
+    if (Evaluate_Commandline_Params(argc, argv, pStats, &iFile) == -1)
+    {
+        usage();
+        printf("\n");
+        free(pStats);
+        return -1;
+    }
+
+    // Open specified image file for reading.
+    FuncRes = CAP_OpenFile(&hCAP, argv[iFile]);
+    if (FuncRes != CAP_Status_OK)
+    {
+        CAP_OutputError(FuncRes);
+        free(pStats);
+        return -1;
+    }
+
+    FuncRes = CAP_ReadHeader(hCAP);
+    if (FuncRes == CAP_Status_OK)
+        FuncRes = CAP_GetHeader_Precision(hCAP, &(pStats->uiPrecision));
+    if (FuncRes != CAP_Status_OK)
+    {
+        CAP_OutputError(FuncRes);
+        goto exit;
+    }
+
+    printf("Analyzing: %s\n\n", argv[iFile]);
+
+    if (ScanWaves(hCAP, pStats, 1) == -1)
+        goto exit;
+
+    FindClusters(pStats);
+
+    if (ScanWaves(hCAP, pStats, 2) == -1)
+        goto exit;
+
+    PrintStatistics(pStats);
+    RetVal = 0;
+
+    exit:
+    CAP_CloseFile(&hCAP);
+    if (pStats->pWindows != NULL) free(pStats->pWindows);
+    free(pStats);
+    printf("\n");
+    return RetVal;
+}
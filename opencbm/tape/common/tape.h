@@ -35,6 +35,15 @@
 #define XUM1541_TAP_WRITE_STARTFALLEDGE 0x20 // start writing with falling edge (1 = true)
 #define XUM1541_TAP_READ_STARTFALLEDGE  0x40 // start reading with falling edge (1 = true)
 
+// Optional second tape configuration byte (must match xum1541 firmware value in xum1541.h).
+// Older firmware ignores it and sends the plain 2/5-byte timestamps.
+#define XUM1541_TAP_CONFIG_DELTA        0x01 // delta-compressed capture timestamps
+#define XUM1541_TAP_CONFIG_TAP          0x02 // C64 TAP v1 data encoded by the adapter
+#define XUM1541_TAP_CONFIG_CLOCK_MASK   0x0c // machine clock of the TAP data
+#define XUM1541_TAP_CLOCK_C64_PAL       0x00
+#define XUM1541_TAP_CLOCK_NTSC          0x04 // C64 and VIC-20 NTSC
+#define XUM1541_TAP_CLOCK_VIC_PAL       0x08
+
 // Tape/disk mode error return values for xum1541_ioctl, xum1541_read, xum1541_write.
 #define XUM1541_Error_NoTapeSupport      -100
 #define XUM1541_Error_NoDiskTapeMode     -101
@@ -0,0 +1,96 @@
+/*
+ *  CBM 1530/1531 tape routines.
+ *  Windows types and functions used by the tape tools, for POSIX systems.
+*/
+
+#ifndef __TAPE_ARCH_H_
+#define __TAPE_ARCH_H_
+
+#ifdef WIN32
+
+#include <Windows.h>
+
+// printf() format of unsigned __int64 values.
+#define PRI64u "I64u"
+#define PRI64X "I64X"
+
+#else
+
+#include <stddef.h>
+#include <limits.h>
+#include <strings.h>
+#include <pthread.h>
+
+#include "arch.h" // BOOL, TRUE, FALSE
+
+#define __int8  char
+#define __int16 short
+#define __int32 int
+#define __int64 long long
+
+#define PRI64u "llu"
+#define PRI64X "llX"
+
+typedef void          *HANDLE;
+typedef void          *LPVOID;
+typedef unsigned int  DWORD;
+typedef long          LONG;
+
+#define WINAPI
+
+#define _MAX_PATH PATH_MAX
+#define _stricmp(_a, _b) strcasecmp(_a, _b)
+
+#ifndef min
+#define min(_a, _b) (((_a) < (_b)) ? (_a) : (_b))
+#endif
+#ifndef max
+#define max(_a, _b) (((_a) > (_b)) ? (_a) : (_b))
+#endif
+
+// Critical sections: recursive mutexes, as on Windows.
+typedef pthread_mutex_t CRITICAL_SECTION;
+
+void InitializeCriticalSection(CRITICAL_SECTION *pCritSec);
+#define DeleteCriticalSection(_p)   pthread_mutex_destroy(_p)
+#define EnterCriticalSection(_p)    pthread_mutex_lock(_p)
+#define LeaveCriticalSection(_p)    pthread_mutex_unlock(_p)
+#define TryEnterCriticalSection(_p) (pthread_mutex_trylock(_p) == 0)
+
+#define InterlockedIncrement(_p)    __sync_add_and_fetch(_p, 1)
+
+// Events and threads. Waits are only supported without timeout,
+// WaitForMultipleObjects() only waits for all objects.
+#define INFINITE      0xFFFFFFFF
+#define WAIT_OBJECT_0 0
+#define WAIT_FAILED   0xFFFFFFFF
+
+typedef DWORD (WINAPI *LPTHREAD_START_ROUTINE)(LPVOID lpParameter);
+
+HANDLE CreateEvent(void *pAttributes, BOOL bManualReset, BOOL bInitialState, const char *pcName);
+BOOL   SetEvent(HANDLE hEvent);
+BOOL   ResetEvent(HANDLE hEvent);
+HANDLE CreateThread(void *pAttributes, size_t StackSize, LPTHREAD_START_ROUTINE StartAddress, LPVOID lpParameter, DWORD dwCreationFlags, DWORD *pdwThreadId);
+DWORD  WaitForSingleObject(HANDLE hHandle, DWORD dwMilliseconds);
+DWORD  WaitForMultipleObjects(DWORD nCount, const HANDLE *phHandles, BOOL bWaitAll, DWORD dwMilliseconds);
+BOOL   CloseHandle(HANDLE hObject);
+
+// Number of processors.
+typedef struct
+{
+    DWORD dwNumberOfProcessors;
+} SYSTEM_INFO;
+
+void GetSystemInfo(SYSTEM_INFO *pSysInfo);
+
+// Ctrl-C handler: called from a thread of its own for SIGINT and SIGTERM, as on Windows.
+// Only one handler, it must be installed before any other thread is started.
+#define CTRL_C_EVENT 0
+
+typedef BOOL (WINAPI *PHANDLER_ROUTINE)(DWORD dwCtrlType);
+
+BOOL SetConsoleCtrlHandler(PHANDLER_ROUTINE HandlerRoutine, BOOL bAdd);
+
+#endif // WIN32
+
+#endif
@@ -6,8 +6,7 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
-#include <Windows.h>
-#include <malloc.h>
+#include "tapearch.h"
 
 #include "cap.h"
 
@@ -20,9 +19,14 @@
 
 #define ASSERT(x, rv) {if (!x) {DETAILED_INFO(rv); return rv;}}
 
+// stdio buffer of an image file: large enough that reading or writing
+// a tape image signal by signal does not end up in a system call each time.
+#define IO_Buffer_Size (256*1024)
+
 typedef struct _INFOBLOCK {
     unsigned int  MemTag;
     FILE          *fd;
+    char          *IOBuffer;
     char          header[Default_CAP_Header_Size+1]; // + 0-termination
     unsigned char Machine, Video, StartEdge, SignalFormat;
     unsigned int  Precision, SignalWidth, StartOfs;
@@ -55,6 +59,11 @@ int CAP_CreateFile(HANDLE *hHandle, char *pcFilename)
         return CAP_Status_Error_Creating_file;
     }
 
+    // Use a large buffer if available, the default one is used otherwise.
+    pInfoBlock->IOBuffer = (char *)malloc(IO_Buffer_Size);
+    if (pInfoBlock->IOBuffer != NULL)
+        setvbuf(pInfoBlock->fd, pInfoBlock->IOBuffer, _IOFBF, IO_Buffer_Size);
+
     pInfoBlock->StartOfs = 0;
     *hHandle = (HANDLE) pInfoBlock;
 
@@ -87,6 +96,11 @@ int CAP_OpenFile(HANDLE *hHandle, char *pcFilename)
         return CAP_Status_Error_File_not_found;
     }
 
+    // Use a large buffer if available, the default one is used otherwise.
+    pInfoBlock->IOBuffer = (char *)malloc(IO_Buffer_Size);
+    if (pInfoBlock->IOBuffer != NULL)
+        setvbuf(pInfoBlock->fd, pInfoBlock->IOBuffer, _IOFBF, IO_Buffer_Size);
+
     pInfoBlock->StartOfs = 0;
     *hHandle = (HANDLE) pInfoBlock;
 
@@ -110,6 +124,9 @@ int CAP_CloseFile(HANDLE *hHandle)
         if (fclose(pInfoBlock->fd) != 0)
             return CAP_Status_Error_Closing_file;
 
+    if (pInfoBlock->IOBuffer != NULL)
+        free(pInfoBlock->IOBuffer);
+
     free(pInfoBlock);
 
     *hHandle = NULL;
@@ -434,6 +451,51 @@ int CAP_ReadSignal(HANDLE hHandle, unsigned __int64 *pui64Signal, int *piCounter
 }
 
 
+// Exported function.
+// Read up to uiMaxSignals signals from image at once, *puiNumSignals is 0 at the end.
+int CAP_ReadSignals(HANDLE hHandle, unsigned __int64 *pui64Signals, unsigned int uiMaxSignals, unsigned int *puiNumSignals)
+{
+    unsigned char    buf[5*256]; // Compatible with 40bit signal width.
+    unsigned char    *p;
+    unsigned int     uiRead, uiChunk;
+    size_t           num;
+
+    PINFOBLOCK pInfoBlock = (struct _INFOBLOCK*)hHandle;
+
+    ASSERT(pInfoBlock != 0, CAP_Status_Error_Invalid_Handle);
+    ASSERT(pInfoBlock->fd != 0, CAP_Status_Error_File_not_open);
+    ASSERT(pui64Signals != 0, CAP_Status_Error_Invalid_pointer);
+    ASSERT(puiNumSignals != 0, CAP_Status_Error_Invalid_pointer);
+
+    *puiNumSignals = 0;
+
+    for (uiRead = 0; uiRead < uiMaxSignals; uiRead += (unsigned int) num)
+    {
+        uiChunk = uiMaxSignals - uiRead;
+        if (uiChunk > sizeof(buf)/5)
+            uiChunk = sizeof(buf)/5;
+
+        // A trailing partial signal is dropped, as by CAP_ReadSignal().
+        num = fread(buf, 5, uiChunk, pInfoBlock->fd);
+        for (p = buf; p < buf + 5*num; p += 5)
+        {
+            *pui64Signals++ = ((unsigned __int64)p[0] << 32) | ((unsigned __int64)p[1] << 24) |
+                              ((unsigned __int64)p[2] << 16) | ((unsigned __int64)p[3] << 8) | p[4];
+        }
+        *puiNumSignals += (unsigned int) num;
+
+        if (num < uiChunk)
+        {
+            if (feof(pInfoBlock->fd) == 0)
+                return CAP_Status_Error_Reading_data;
+            break;
+        }
+    }
+
+    return (*puiNumSignals > 0) ? CAP_Status_OK : CAP_Status_OK_End_of_file;
+}
+
+
 // Internal function.
 // Write a single byte to image, increment counter.
 int CAP_WriteSingleByte(HANDLE hHandle, unsigned char ucByte, int *piCounter)
@@ -458,21 +520,114 @@ int CAP_WriteSingleByte(HANDLE hHandle, unsigned char ucByte, int *piCounter)
 // Write a signal to image, increment counter for each written byte.
 int CAP_WriteSignal(HANDLE hHandle, unsigned __int64 ui64Signal, int *piCounter)
 {
-    if (CAP_WriteSingleByte( hHandle, (unsigned char) ((ui64Signal >> 32) & 0xff), piCounter ) != CAP_Status_OK)
-        return CAP_Status_Error_Writing_data;
+    unsigned char buf5[5]; // Compatible with 40bit signal width.
 
-    if (CAP_WriteSingleByte( hHandle, (unsigned char) ((ui64Signal >> 24) & 0xff), piCounter ) != CAP_Status_OK)
-        return CAP_Status_Error_Writing_data;
+    PINFOBLOCK pInfoBlock = (struct _INFOBLOCK*)hHandle;
 
-    if (CAP_WriteSingleByte( hHandle, (unsigned char) ((ui64Signal >> 16) & 0xff), piCounter ) != CAP_Status_OK)
-        return CAP_Status_Error_Writing_data;
+    ASSERT(pInfoBlock != 0, CAP_Status_Error_Invalid_Handle);
 
-    if (CAP_WriteSingleByte( hHandle, (unsigned char) ((ui64Signal >> 8) & 0xff), piCounter ) != CAP_Status_OK)
-        return CAP_Status_Error_Writing_data;
+    if (pInfoBlock->fd == NULL)
+        return CAP_Status_Error_File_not_open;
 
-    if (CAP_WriteSingleByte( hHandle, (unsigned char) ((ui64Signal) & 0xff), piCounter ) != CAP_Status_OK)
+    buf5[0] = (unsigned char) ((ui64Signal >> 32) & 0xff);
+    buf5[1] = (unsigned char) ((ui64Signal >> 24) & 0xff);
+    buf5[2] = (unsigned char) ((ui64Signal >> 16) & 0xff);
+    buf5[3] = (unsigned char) ((ui64Signal >> 8) & 0xff);
+    buf5[4] = (unsigned char) ((ui64Signal) & 0xff);
+
+    // All 5 bytes at once, a call for each byte costs more than the copying.
+    if (fwrite(buf5, 5, 1, pInfoBlock->fd) != 1)
         return CAP_Status_Error_Writing_data;
 
+    if (piCounter != NULL)
+        (*piCounter)+=5;
+
+    return CAP_Status_OK;
+}
+
+
+// Exported function.
+// Seek to signal uiSignal of the image data, the image header must have been read.
+int CAP_SeekSignal(HANDLE hHandle, unsigned int uiSignal)
+{
+    PINFOBLOCK pInfoBlock = (struct _INFOBLOCK*)hHandle;
+
+    ASSERT(pInfoBlock != 0, CAP_Status_Error_Invalid_Handle);
+    ASSERT(pInfoBlock->fd != 0, CAP_Status_Error_File_not_open);
+
+    if (pInfoBlock->StartOfs < Default_CAP_Header_Size)
+        return CAP_Status_Error_Seek_wrong_destination;
+
+    // All signals have the same size, 40 bits.
+    if (fseek(pInfoBlock->fd, pInfoBlock->StartOfs + 5 * (long) uiSignal, SEEK_SET) != 0)
+        return CAP_Status_Error_Seek_failed;
+
+    return CAP_Status_OK;
+}
+
+
+// Exported function.
+// Read all signals of the image data and split them into blocks at the pauses,
+// the index is allocated, free() it. Moves file pointer.
+int CAP_BuildBlockIndex(HANDLE hHandle, unsigned __int64 ui64MinPause, CAP_Block **ppBlocks, unsigned int *puiNumBlocks)
+{
+    CAP_Block        *pBlocks = NULL, *pNew, *pBlock = NULL;
+    unsigned int     uiNumBlocks = 0, uiMaxBlocks = 0, uiSignal = 0;
+    unsigned __int64 ui64Signal, ui64Time = 0;
+    int              ret;
+
+    ASSERT(ppBlocks != 0, CAP_Status_Error_Invalid_pointer);
+    ASSERT(puiNumBlocks != 0, CAP_Status_Error_Invalid_pointer);
+
+    // Seek to start of image data.
+    if ((ret = CAP_ReadHeader(hHandle)) != CAP_Status_OK)
+        return ret;
+
+    while ((ret = CAP_ReadSignal(hHandle, &ui64Signal, NULL)) == CAP_Status_OK)
+    {
+        if ((pBlock != NULL) && (ui64Signal >= ui64MinPause) && (pBlock->ui64Length == 0))
+        {
+            // Still in the pause, e.g. one written as several signals.
+            pBlock->ui64Pause += ui64Signal;
+        }
+        else if ((pBlock == NULL) || (ui64Signal >= ui64MinPause))
+        {
+            if (uiNumBlocks == uiMaxBlocks)
+            {
+                uiMaxBlocks = (uiMaxBlocks == 0) ? 64 : (2 * uiMaxBlocks);
+                pNew = (CAP_Block *)realloc(pBlocks, uiMaxBlocks * sizeof(CAP_Block));
+                if (pNew == NULL)
+                {
+                    free(pBlocks);
+                    return CAP_Status_Error_Out_of_memory;
+                }
+                pBlocks = pNew;
+            }
+
+            pBlock = &pBlocks[uiNumBlocks++];
+            pBlock->uiFirstSignal = uiSignal;
+            pBlock->uiNumSignals = 0;
+            pBlock->ui64Start = ui64Time;
+            pBlock->ui64Pause = ui64Signal;
+            pBlock->ui64Length = 0;
+        }
+        else
+            pBlock->ui64Length += ui64Signal;
+
+        pBlock->uiNumSignals++;
+        ui64Time += ui64Signal;
+        uiSignal++;
+    }
+
+    if (ret != CAP_Status_OK_End_of_file)
+    {
+        free(pBlocks);
+        return ret;
+    }
+
+    *ppBlocks = pBlocks;
+    *puiNumBlocks = uiNumBlocks;
+
     return CAP_Status_OK;
 }
 
@@ -6,7 +6,7 @@
 #ifndef __CAP_H_
 #define __CAP_H_
 
-#include <Windows.h>
+#include "tapearch.h"
 
 // Status results from exported functions
 #define CAP_Status_OK                              0
@@ -66,6 +66,18 @@
 // Default data start offset for tape image
 #define CAP_Default_Data_Start_Offset 0xA0
 
+// A block of the tape image: a pause (signals at least as long as the
+// minimum pause) and all signals up to the next one; the first block starts
+// with the first signal. Times are in image file resolution.
+typedef struct
+{
+    unsigned int     uiFirstSignal; // Number of the first signal in the image data
+    unsigned int     uiNumSignals;  // Number of signals, including the pause
+    unsigned __int64 ui64Start;     // Start time of the pause
+    unsigned __int64 ui64Pause;     // Length of the pause
+    unsigned __int64 ui64Length;    // Length of the block after the pause
+} CAP_Block;
+
 // Create (overwrite) an image file for writing.
 int CAP_CreateFile(HANDLE *hHandle, char *pcFilename);
 
@@ -93,9 +105,19 @@ int CAP_WriteHeaderAddon(HANDLE hHandle, unsigned char *pucString, unsigned int
 // Read a signal from image, increment byte counter.
 int CAP_ReadSignal(HANDLE hHandle, unsigned __int64 *pui64Signal, int *piCounter);
 
+// Read up to uiMaxSignals signals from image at once, *puiNumSignals is 0 at the end.
+int CAP_ReadSignals(HANDLE hHandle, unsigned __int64 *pui64Signals, unsigned int uiMaxSignals, unsigned int *puiNumSignals);
+
 // Write a signal to image, increment counter for each written byte.
 int CAP_WriteSignal(HANDLE hHandle, unsigned __int64 ui64Signal, int *piCounter);
 
+// Seek to signal uiSignal of the image data, the image header must have been read.
+int CAP_SeekSignal(HANDLE hHandle, unsigned int uiSignal);
+
+// Read all signals of the image data and split them into blocks at the pauses,
+// the index is allocated, free() it. Moves file pointer.
+int CAP_BuildBlockIndex(HANDLE hHandle, unsigned __int64 ui64MinPause, CAP_Block **ppBlocks, unsigned int *puiNumBlocks);
+
 // Verify header contents (Signature, Version, Precision, Machine, Video, StartEdge, SignalFormat, SignalWidth, StartOfs).
 int CAP_isValidHeader(HANDLE hHandle);
 
@@ -0,0 +1,255 @@
+/*
+ *  CBM 1530/1531 tape routines.
+ *  Windows functions used by the tape tools, implemented with POSIX threads.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <signal.h>
+#include <unistd.h>
+
+#include "tapearch.h"
+
+#define HandleType_Event  1
+#define HandleType_Thread 2
+
+// Object behind an event or thread HANDLE.
+typedef struct
+{
+    __int32                iType;
+
+    // Event
+    pthread_mutex_t        Mutex;
+    pthread_cond_t         Cond;
+    BOOL                   bManualReset, bSignaled;
+
+    // Thread
+    pthread_t              Thread;
+    LPTHREAD_START_ROUTINE StartAddress;
+    LPVOID                 lpParameter;
+    BOOL                   bJoined;
+} TAPE_HANDLE;
+
+static PHANDLER_ROUTINE CtrlHandler = NULL;
+
+
+void InitializeCriticalSection(CRITICAL_SECTION *pCritSec)
+{
+    pthread_mutexattr_t Attr;
+
+    pthread_mutexattr_init(&Attr);
+    pthread_mutexattr_settype(&Attr, PTHREAD_MUTEX_RECURSIVE);
+    pthread_mutex_init(pCritSec, &Attr);
+    pthread_mutexattr_destroy(&Attr);
+}
+
+
+HANDLE CreateEvent(void *pAttributes, BOOL bManualReset, BOOL bInitialState, const char *pcName)
+{
+    TAPE_HANDLE *pHandle = calloc(1, sizeof(TAPE_HANDLE));
+
+    if (pHandle == NULL)
+        return NULL;
+
+    pHandle->iType = HandleType_Event;
+    pHandle->bManualReset = bManualReset;
+    pHandle->bSignaled = bInitialState;
+    pthread_mutex_init(&pHandle->Mutex, NULL);
+    pthread_cond_init(&pHandle->Cond, NULL);
+
+    return (HANDLE) pHandle;
+}
+
+
+BOOL SetEvent(HANDLE hEvent)
+{
+    TAPE_HANDLE *pHandle = (TAPE_HANDLE *) hEvent;
+
+    if ((pHandle == NULL) || (pHandle->iType != HandleType_Event))
+        return FALSE;
+
+    pthread_mutex_lock(&pHandle->Mutex);
+    pHandle->bSignaled = TRUE;
+    if (pHandle->bManualReset)
+        pthread_cond_broadcast(&pHandle->Cond);
+    else
+        pthread_cond_signal(&pHandle->Cond);
+    pthread_mutex_unlock(&pHandle->Mutex);
+
+    return TRUE;
+}
+
+
+BOOL ResetEvent(HANDLE hEvent)
+{
+    TAPE_HANDLE *pHandle = (TAPE_HANDLE *) hEvent;
+
+    if ((pHandle == NULL) || (pHandle->iType != HandleType_Event))
+        return FALSE;
+
+    pthread_mutex_lock(&pHandle->Mutex);
+    pHandle->bSignaled = FALSE;
+    pthread_mutex_unlock(&pHandle->Mutex);
+
+    return TRUE;
+}
+
+
+static void *ThreadFunction(void *pParam)
+{
+    TAPE_HANDLE *pHandle = (TAPE_HANDLE *) pParam;
+
+    pHandle->StartAddress(pHandle->lpParameter);
+
+    return NULL;
+}
+
+
+HANDLE CreateThread(void *pAttributes, size_t StackSize, LPTHREAD_START_ROUTINE StartAddress, LPVOID lpParameter, DWORD dwCreationFlags, DWORD *pdwThreadId)
+{
+    TAPE_HANDLE *pHandle = calloc(1, sizeof(TAPE_HANDLE));
+
+    if (pHandle == NULL)
+        return NULL;
+
+    pHandle->iType = HandleType_Thread;
+    pHandle->StartAddress = StartAddress;
+    pHandle->lpParameter = lpParameter;
+
+    if (pthread_create(&pHandle->Thread, NULL, ThreadFunction, pHandle) != 0)
+    {
+        free(pHandle);
+        return NULL;
+    }
+
+    if (pdwThreadId != NULL)
+        *pdwThreadId = 0;
+
+    return (HANDLE) pHandle;
+}
+
+
+// Wait until event is signaled (and reset auto-reset event), or thread has ended.
+DWORD WaitForSingleObject(HANDLE hHandle, DWORD dwMilliseconds)
+{
+    TAPE_HANDLE *pHandle = (TAPE_HANDLE *) hHandle;
+
+    if ((pHandle == NULL) || (dwMilliseconds != INFINITE))
+        return WAIT_FAILED;
+
+    if (pHandle->iType == HandleType_Thread)
+    {
+        if (!pHandle->bJoined)
+        {
+            if (pthread_join(pHandle->Thread, NULL) != 0)
+                return WAIT_FAILED;
+            pHandle->bJoined = TRUE;
+        }
+        return WAIT_OBJECT_0;
+    }
+
+    pthread_mutex_lock(&pHandle->Mutex);
+    while (!pHandle->bSignaled)
+        pthread_cond_wait(&pHandle->Cond, &pHandle->Mutex);
+    if (!pHandle->bManualReset)
+        pHandle->bSignaled = FALSE;
+    pthread_mutex_unlock(&pHandle->Mutex);
+
+    return WAIT_OBJECT_0;
+}
+
+
+DWORD WaitForMultipleObjects(DWORD nCount, const HANDLE *phHandles, BOOL bWaitAll, DWORD dwMilliseconds)
+{
+    DWORD i;
+
+    if (!bWaitAll)
+        return WAIT_FAILED;
+
+    for (i = 0; i < nCount; i++)
+        if (WaitForSingleObject(phHandles[i], dwMilliseconds) != WAIT_OBJECT_0)
+            return WAIT_FAILED;
+
+    return WAIT_OBJECT_0;
+}
+
+
+BOOL CloseHandle(HANDLE hObject)
+{
+    TAPE_HANDLE *pHandle = (TAPE_HANDLE *) hObject;
+
+    if (pHandle == NULL)
+        return FALSE;
+
+    if (pHandle->iType == HandleType_Thread)
+    {
+        // Thread keeps running if not waited for, as on Windows.
+        if (!pHandle->bJoined)
+            pthread_detach(pHandle->Thread);
+    }
+    else
+    {
+        pthread_cond_destroy(&pHandle->Cond);
+        pthread_mutex_destroy(&pHandle->Mutex);
+    }
+
+    free(pHandle);
+    return TRUE;
+}
+
+
+void GetSystemInfo(SYSTEM_INFO *pSysInfo)
+{
+    long lProcessors = sysconf(_SC_NPROCESSORS_ONLN);
+
+    pSysInfo->dwNumberOfProcessors = (lProcessors > 0) ? (DWORD) lProcessors : 1;
+}
+
+
+// Receives SIGINT and SIGTERM, so the handler may take locks and call the driver.
+// If the handler does not handle the event, the process ends.
+static void *CtrlThreadFunction(void *pParam)
+{
+    sigset_t *pSignals = (sigset_t *) pParam;
+    int      iSignal;
+
+    for (;;)
+    {
+        if (sigwait(pSignals, &iSignal) != 0)
+            continue;
+
+        if (!CtrlHandler(CTRL_C_EVENT))
+            exit(EXIT_FAILURE);
+    }
+
+    return NULL;
+}
+
+
+BOOL SetConsoleCtrlHandler(PHANDLER_ROUTINE HandlerRoutine, BOOL bAdd)
+{
+    static sigset_t Signals;
+    pthread_t       Thread;
+
+    if (!bAdd || (CtrlHandler != NULL))
+        return FALSE;
+
+    // Block signals in this thread and all threads started later,
+    // only the handler thread receives them.
+    sigemptyset(&Signals);
+    sigaddset(&Signals, SIGINT);
+    sigaddset(&Signals, SIGTERM);
+    if (pthread_sigmask(SIG_BLOCK, &Signals, NULL) != 0)
+        return FALSE;
+
+    CtrlHandler = HandlerRoutine;
+    if (pthread_create(&Thread, NULL, CtrlThreadFunction, &Signals) != 0)
+    {
+        CtrlHandler = NULL;
+        pthread_sigmask(SIG_UNBLOCK, &Signals, NULL);
+        return FALSE;
+    }
+    pthread_detach(Thread);
+
+    return TRUE;
+}
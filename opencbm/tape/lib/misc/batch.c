@@ -0,0 +1,120 @@
+/*
+ *  CBM 1530/1531 tape routines.
+ *  Batch conversion of several image files at the same time.
+*/
+
+#include "tapearch.h"
+#include <stdio.h>
+#include <string.h>
+
+#include "misc.h"
+
+// Most conversion threads run at the same time.
+#define MAX_BATCH_THREADS 64
+
+// Shared by all conversion threads.
+typedef struct
+{
+    __int32         iNumFiles;
+    __int8          **ppcFiles;
+    const __int8    *pcOutExt;
+    BatchConvert_t  Convert;
+    volatile LONG   lNextFile;  // Next input file to be converted.
+    volatile LONG   lNumFailed;
+} BATCHJOB;
+
+
+// Output file name: input file name with its extension replaced by pcOutExt.
+void BatchOutputFilename(const __int8 *pcInput, const __int8 *pcOutExt, __int8 pcOutput[_MAX_PATH])
+{
+    const __int8 *pcDot, *pcSlash;
+    size_t       len;
+
+    pcDot = strrchr(pcInput, '.');
+    pcSlash = strrchr(pcInput, '\\');
+    if (pcSlash == NULL)
+        pcSlash = strrchr(pcInput, '/');
+
+    len = ((pcDot != NULL) && ((pcSlash == NULL) || (pcDot > pcSlash))) ? (size_t)(pcDot - pcInput) : strlen(pcInput);
+    if (len + strlen(pcOutExt) >= _MAX_PATH)
+        len = _MAX_PATH - 1 - strlen(pcOutExt);
+
+    memcpy(pcOutput, pcInput, len);
+    strcpy(pcOutput + len, pcOutExt);
+}
+
+
+// Conversion thread: takes the next input file until there is none left.
+static DWORD WINAPI BatchThread(LPVOID lpParam)
+{
+    BATCHJOB *pJob = (BATCHJOB *) lpParam;
+    __int8   pcOutput[_MAX_PATH];
+    LONG     i;
+
+    while ((i = InterlockedIncrement(&pJob->lNextFile) - 1) < pJob->iNumFiles)
+    {
+        BatchOutputFilename(pJob->ppcFiles[i], pJob->pcOutExt, pcOutput);
+
+        if (pJob->Convert(pJob->ppcFiles[i], pcOutput) != 0)
+        {
+            printf("Conversion failed: %s\n", pJob->ppcFiles[i]);
+            InterlockedIncrement(&pJob->lNumFailed);
+        }
+    }
+
+    return 0;
+}
+
+
+// Convert all input files, with up to iNumThreads of them at the same time.
+//   Return values:
+//    0: all conversions finished ok
+//   -1: at least one conversion failed
+__int32 RunBatchConversion(__int32 iNumFiles, __int8 *ppcFiles[], const __int8 *pcOutExt, __int32 iNumThreads, BatchConvert_t Convert)
+{
+    HANDLE      hThreads[MAX_BATCH_THREADS];
+    BATCHJOB    Job;
+    SYSTEM_INFO SysInfo;
+    __int32     i, iStarted = 0;
+
+    Job.iNumFiles  = iNumFiles;
+    Job.ppcFiles   = ppcFiles;
+    Job.pcOutExt   = pcOutExt;
+    Job.Convert    = Convert;
+    Job.lNextFile  = 0;
+    Job.lNumFailed = 0;
+
+    if (iNumThreads <= 0)
+    {
+        // Default: one thread per processor.
+        GetSystemInfo(&SysInfo);
+        iNumThreads = SysInfo.dwNumberOfProcessors;
+    }
+    if (iNumThreads > iNumFiles)
+        iNumThreads = iNumFiles;
+    if (iNumThreads > MAX_BATCH_THREADS)
+        iNumThreads = MAX_BATCH_THREADS;
+
+    for (i = 0; i < iNumThreads; i++)
+    {
+        hThreads[iStarted] = CreateThread(NULL, 0, BatchThread, &Job, 0, NULL);
+        if (hThreads[iStarted] != NULL)
+            iStarted++;
+    }
+
+    if (iStarted == 0)
+    {
+        // No thread could be started, convert here.
+        BatchThread(&Job);
+    }
+    else
+    {
+        WaitForMultipleObjects(iStarted, hThreads, TRUE, INFINITE);
+        for (i = 0; i < iStarted; i++)
+            CloseHandle(hThreads[i]);
+    }
+
+    printf("\n%d of %d files converted.\n", iNumFiles - (__int32) Job.lNumFailed, iNumFiles);
+
+    return (Job.lNumFailed == 0) ? 0 : -1;
+}
@@ -3,7 +3,7 @@
  *  Copyright 2012 Arnd Menge, arnd(at)jonnz(dot)de
 */
 
-#include <Windows.h>
+#include "tapearch.h"
 #include <stdio.h>
 
 #include "tape.h"
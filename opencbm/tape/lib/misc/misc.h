@@ -6,7 +6,7 @@
 #ifndef __TAP_MISC_H_
 #define __TAP_MISC_H_
 
-#include <Windows.h>
+#include "tapearch.h"
 
 // Macro to handle errors of called exported functions.
 #define Check_CAP_Error_TextRetM1(FuncRes) \
@@ -31,4 +31,14 @@
 __int32 OutputError(__int32 Status);
 __int32 OutputFuncError(__int32 Status);
 
+// Converts one image file for RunBatchConversion(), returns 0 on success.
+// It is called by several threads at the same time.
+typedef __int32 (*BatchConvert_t)(__int8 *pcInput, __int8 *pcOutput);
+
+// Output file name: input file name with its extension replaced by pcOutExt.
+void BatchOutputFilename(const __int8 *pcInput, const __int8 *pcOutExt, __int8 pcOutput[_MAX_PATH]);
+
+// Convert all input files, with up to iNumThreads (0: one per processor) of them at the same time.
+__int32 RunBatchConversion(__int32 iNumFiles, __int8 *ppcFiles[], const __int8 *pcOutExt, __int32 iNumThreads, BatchConvert_t Convert);
+
 #endif
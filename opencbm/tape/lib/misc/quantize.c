@@ -0,0 +1,88 @@
+/*
+ *  CBM 1530/1531 tape routines.
+ *  Conversion of CAP signals to the time unit of a target format.
+*/
+
+#include "tapearch.h"
+
+#include "quantize.h"
+
+
+static unsigned __int64 GCD(unsigned __int64 a, unsigned __int64 b)
+{
+    unsigned __int64 t;
+
+    while (b != 0)
+    {
+        t = a % b;
+        a = b;
+        b = t;
+    }
+    return a;
+}
+
+
+// Prepare the conversion of signals to units of ui64Num/ui64Den signal ticks.
+void PulseQuantizer_Init(PulseQuantizer *pQuant, unsigned __int64 ui64Num, unsigned __int64 ui64Den)
+{
+    unsigned __int64 ui64Div = GCD(ui64Num, ui64Den);
+
+    // Cancel the fraction, the rounding stays the same: floor(floor(x/g)/(d/g)) = floor(x/d).
+    if (ui64Div == 0)
+        ui64Div = 1;
+    pQuant->ui64Num  = ui64Num/ui64Div;
+    pQuant->ui64Den  = ui64Den/ui64Div;
+    pQuant->ui64Bias = (ui64Den/2)/ui64Div;
+
+    // With n = signal*ui64Num + ui64Bias < 2^32 and the reciprocal rounded
+    // down to less than 2^32, (n*ui64Recip) >> uiShift is the quotient or
+    // one less; a single correction step makes it exact.
+    if ((pQuant->ui64Den == 0) || (pQuant->ui64Den > 0x80000000) || (pQuant->ui64Num == 0))
+    {
+        pQuant->uiShift     = 0;
+        pQuant->ui64Recip   = 0;
+        pQuant->ui64FastMax = 0;
+        return;
+    }
+
+    pQuant->uiShift = 31;
+    while (((unsigned __int64)1 << (pQuant->uiShift-31)) < pQuant->ui64Den)
+        pQuant->uiShift++;
+    pQuant->ui64Recip = ((unsigned __int64)1 << pQuant->uiShift) / pQuant->ui64Den;
+
+    if (pQuant->ui64Bias > 0xffffffff)
+        pQuant->ui64FastMax = 0;
+    else
+        pQuant->ui64FastMax = (0xffffffff - pQuant->ui64Bias) / pQuant->ui64Num;
+}
+
+
+// Convert uiCount signals at once, pui64Units must not overlap pui64Signals.
+void PulseQuantizer_Run(const PulseQuantizer *pQuant, const unsigned __int64 *pui64Signals, unsigned __int64 *pui64Units, unsigned __int32 uiCount)
+{
+    const unsigned __int64 ui64Num = pQuant->ui64Num, ui64Den = pQuant->ui64Den, ui64Bias = pQuant->ui64Bias;
+    const unsigned __int64 ui64Recip = pQuant->ui64Recip;
+    const unsigned __int32 uiShift = pQuant->uiShift;
+    unsigned __int64       n, q;
+    unsigned __int32       i;
+
+    if (ui64Den == 0)
+        return;
+
+    // No branches and no division: the compiler may process several signals per instruction.
+    for (i = 0; i < uiCount; i++)
+    {
+        // The long signals are masked to keep the product in 64 bits, they are redone below.
+        n = ((pui64Signals[i]*ui64Num + ui64Bias) & 0xffffffff);
+        q = (n*ui64Recip) >> uiShift;
+        q += ((n - q*ui64Den) >= ui64Den);
+        pui64Units[i] = q;
+    }
+
+    // Signals too long for the reciprocal, usually pauses, take the division.
+    for (i = 0; i < uiCount; i++)
+    {
+        if (pui64Signals[i] > pQuant->ui64FastMax)
+            pui64Units[i] = (pui64Signals[i]*ui64Num + ui64Bias) / ui64Den;
+    }
+}
@@ -0,0 +1,27 @@
+/*
+ *  CBM 1530/1531 tape routines.
+ *  Conversion of CAP signals to the time unit of a target format.
+*/
+
+#ifndef __TAP_QUANTIZE_H_
+#define __TAP_QUANTIZE_H_
+
+#include "tapearch.h"
+
+// Converts CAP signals to units, rounded to nearest:
+// units = (signal*ui64Num + ui64Den/2) / ui64Den.
+typedef struct
+{
+    unsigned __int64 ui64Num, ui64Den, ui64Bias;
+    unsigned __int64 ui64Recip;    // floor(2^uiShift / ui64Den), replaces the division.
+    unsigned __int32 uiShift;
+    unsigned __int64 ui64FastMax;  // Longest signal the reciprocal is exact for.
+} PulseQuantizer;
+
+// Prepare the conversion of signals to units of ui64Num/ui64Den signal ticks.
+void PulseQuantizer_Init(PulseQuantizer *pQuant, unsigned __int64 ui64Num, unsigned __int64 ui64Den);
+
+// Convert uiCount signals at once, pui64Units must not overlap pui64Signals.
+void PulseQuantizer_Run(const PulseQuantizer *pQuant, const unsigned __int64 *pui64Signals, unsigned __int64 *pui64Units, unsigned __int32 uiCount);
+
+#endif
@@ -6,8 +6,7 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
-#include <Windows.h>
-#include <malloc.h>
+#include "tapearch.h"
 
 #include "tap-cbm.h"
 
@@ -20,9 +19,14 @@
 
 #define ASSERT(x, rv) {if (!x) {DETAILED_INFO(rv); return rv;}}
 
+// stdio buffer of an image file: large enough that reading or writing
+// a tape image signal by signal does not end up in a system call each time.
+#define IO_Buffer_Size (256*1024)
+
 typedef struct _INFOBLOCK {
     unsigned int  MemTag;
     FILE          *fd;
+    char          *IOBuffer;
     char          header[Header_Size_TAP_CBM+1]; // + 0-termination
     unsigned char Machine, Video, TAPversion;
     unsigned int  ByteCount;
@@ -55,6 +59,11 @@ int TAP_CBM_CreateFile(HANDLE *hHandle, char *pcFilename)
         return TAP_CBM_Status_Error_Creating_file;
     }
 
+    // Use a large buffer if available, the default one is used otherwise.
+    pInfoBlock->IOBuffer = (char *)malloc(IO_Buffer_Size);
+    if (pInfoBlock->IOBuffer != NULL)
+        setvbuf(pInfoBlock->fd, pInfoBlock->IOBuffer, _IOFBF, IO_Buffer_Size);
+
     *hHandle = (HANDLE) pInfoBlock;
 
     return TAP_CBM_Status_OK;
@@ -86,6 +95,11 @@ int TAP_CBM_OpenFile(HANDLE *hHandle, char *pcFilename)
         return TAP_CBM_Status_Error_File_not_found;
     }
 
+    // Use a large buffer if available, the default one is used otherwise.
+    pInfoBlock->IOBuffer = (char *)malloc(IO_Buffer_Size);
+    if (pInfoBlock->IOBuffer != NULL)
+        setvbuf(pInfoBlock->fd, pInfoBlock->IOBuffer, _IOFBF, IO_Buffer_Size);
+
     *hHandle = (HANDLE) pInfoBlock;
 
     return TAP_CBM_Status_OK;
@@ -108,6 +122,9 @@ int TAP_CBM_CloseFile(HANDLE *hHandle)
         if (fclose(pInfoBlock->fd) != 0)
             return TAP_CBM_Status_Error_Closing_file;
 
+    if (pInfoBlock->IOBuffer != NULL)
+        free(pInfoBlock->IOBuffer);
+
     free(pInfoBlock);
 
     *hHandle = NULL;
@@ -391,19 +408,23 @@ int TAP_CBM_WriteSignal_1Byte(HANDLE hHandle, unsigned char ucByte, unsigned int
 // Write 32bit unsigned integer to image file: LSB first, MSB last.
 int TAP_CBM_WriteSignal_4Bytes(HANDLE hHandle, unsigned int uiSignal, unsigned int *puiCounter)
 {
-    int ret;
+    unsigned char buf4[4];
 
-    if ((ret = TAP_CBM_WriteSignal_1Byte(hHandle, (uiSignal      ) & 0xff, puiCounter)) != TAP_CBM_Status_OK)
-        return ret;
+    PINFOBLOCK pInfoBlock = (struct _INFOBLOCK*)hHandle;
 
-    if ((ret = TAP_CBM_WriteSignal_1Byte(hHandle, (uiSignal >>  8) & 0xff, puiCounter)) != TAP_CBM_Status_OK)
-        return ret;
+    ASSERT(pInfoBlock != 0, TAP_CBM_Status_Error_Invalid_Handle);
+    ASSERT(pInfoBlock->fd != 0, TAP_CBM_Status_Error_File_not_open);
+    ASSERT(puiCounter != 0, TAP_CBM_Status_Error_Invalid_pointer);
 
-    if ((ret = TAP_CBM_WriteSignal_1Byte(hHandle, (uiSignal >> 16) & 0xff, puiCounter)) != TAP_CBM_Status_OK)
-        return ret;
+    buf4[0] = (unsigned char) ((uiSignal      ) & 0xff);
+    buf4[1] = (unsigned char) ((uiSignal >>  8) & 0xff);
+    buf4[2] = (unsigned char) ((uiSignal >> 16) & 0xff);
+    buf4[3] = (unsigned char) ((uiSignal >> 24) & 0xff);
 
-    if ((ret = TAP_CBM_WriteSignal_1Byte(hHandle, (uiSignal >> 24) & 0xff, puiCounter)) != TAP_CBM_Status_OK)
-        return ret;
+    if (fwrite(buf4, 4, 1, pInfoBlock->fd) != 1)
+        return TAP_CBM_Status_Error_Writing_data;
+
+    (*puiCounter)+=4;
 
     return TAP_CBM_Status_OK;
 }
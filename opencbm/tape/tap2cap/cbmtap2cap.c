@@ -5,7 +5,7 @@
 
 #include <stdio.h>
 #include <stdlib.h>
-#include <Windows.h>
+#include "tapearch.h"
 
 #include <arch.h>
 #include "cap.h"
@@ -22,17 +22,13 @@
 #define NeedSplit            2
 #define NoSplit              3
 
-// Global variables
-unsigned __int8   CAP_Machine, CAP_Video, CAP_StartEdge, CAP_SignalFormat;
-unsigned __int32  CAP_Precision, CAP_SignalWidth, CAP_StartOfs;
-unsigned __int8   TAP_Machine, TAP_Video, TAPv;
-unsigned __int32  TAP_ByteCount;
+// CAP signal precision of the conversion: 1us.
+#define CAP_Precision 1
 
 
 __int32 HandleDeltaAndWriteToCAP(HANDLE hCAP, unsigned __int64 ui64Delta, unsigned __int8 uiSplit)
 {
     unsigned __int64 ui64SplitLen;
-    __int32          FuncRes;
 
     if (uiSplit == NeedSplit)
     {
@@ -52,9 +48,11 @@ __int32 HandleDeltaAndWriteToCAP(HANDLE hCAP, unsigned __int64 ui64Delta, unsign
 }
 
 
-__int32 Initialize_CAP_header_and_return_frequency(HANDLE hCAP, HANDLE hTAP, unsigned __int32 *puiFreq)
+__int32 Initialize_CAP_header_and_return_frequency(HANDLE hCAP, unsigned __int8 TAP_Machine, unsigned __int8 TAP_Video, unsigned __int32 *puiFreq)
 {
-    __int32 FuncRes;
+    unsigned __int8  CAP_Machine, CAP_Video, CAP_StartEdge, CAP_SignalFormat;
+    unsigned __int32 CAP_SignalWidth, CAP_StartOfs;
+    __int32          FuncRes;
 
     // Determine target machine & video.
 
@@ -89,7 +87,6 @@ __int32 Initialize_CAP_header_and_return_frequency(HANDLE hCAP, HANDLE hTAP, uns
 
     // Initialize & write CAP image header.
 
-    CAP_Precision    = 1;                         // Default: 1us signal precision.
     CAP_StartEdge    = CAP_StartEdge_Falling;     // Default: Start with falling signal edge.
     CAP_SignalFormat = CAP_SignalFormat_Relative; // Default: Relative timings instead of absolute.
     CAP_SignalWidth  = CAP_SignalWidth_40bit;     // Default: 40bit.
@@ -109,7 +106,7 @@ __int32 Initialize_CAP_header_and_return_frequency(HANDLE hCAP, HANDLE hTAP, uns
         return -1;
     }
 
-    FuncRes = CAP_WriteHeaderAddon(hCAP, "   Created by       TAP2CAP     ----------------", 0x30);
+    FuncRes = CAP_WriteHeaderAddon(hCAP, (unsigned __int8 *) "   Created by       TAP2CAP     ----------------", 0x30);
     if (FuncRes != CAP_Status_OK)
     {
         CAP_OutputError(FuncRes);
@@ -148,7 +145,8 @@ __int32 CBMTAP2CAP(HANDLE hCAP, HANDLE hTAP)
     unsigned __int64 ui64Delta;
     unsigned __int32 uiDelta, uiFreq;
     unsigned __int32 TAP_Counter = 0; // CAP & TAP file byte counters.
-    unsigned __int8  ch;
+    unsigned __int32 TAP_ByteCount;
+    unsigned __int8  TAP_Machine, TAP_Video, TAPv;
     __int32          FuncRes;
 
     // Seek to & read image header, extract & verify header contents.
@@ -167,7 +165,7 @@ __int32 CBMTAP2CAP(HANDLE hCAP, HANDLE hTAP)
         return -1;
     }
 
-    if (Initialize_CAP_header_and_return_frequency(hCAP, hTAP, &uiFreq) != 0)
+    if (Initialize_CAP_header_and_return_frequency(hCAP, TAP_Machine, TAP_Video, &uiFreq) != 0)
         return -1;
 
     // Start conversion TAP->CAP.
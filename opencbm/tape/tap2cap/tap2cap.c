@@ -5,6 +5,7 @@
 
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 
 #include <arch.h>
 #include "cbmtap2cap.h"
@@ -15,66 +16,92 @@
 
 void usage(void)
 {
-    printf("\nUsage:   tap2cap <input.tap> <output.cap>\n\n");
+    printf("\nUsage:   tap2cap <input.tap> <output.cap>\n");
+    printf("         tap2cap -b [-j<threads>] <input.tap> [<input.tap> ...]\n\n");
+    printf("  -b         : batch mode, convert every <name>.tap to <name>.cap\n");
+    printf("               (existing CAP files are not overwritten)\n");
+    printf("  -j<threads>: number of files converted at the same time\n");
+    printf("               (default: one per processor)\n\n");
     printf("Example: tap2cap myfile.tap myfile.cap\n");
+    printf("         tap2cap -b -j4 *.tap\n");
 }
 
 
-__int32 Evaluate_Commandline_Params(__int32 argc, __int8 *argv[])
+__int32 Evaluate_Commandline_Params(__int32 argc, __int8 *argv[], BOOL *pbBatch, __int32 *piThreads, __int32 *piFirstFile)
 {
+    __int32 i = 1;
+
+    *pbBatch = FALSE;
+    *piThreads = 0;
+
+    if ((argc > 1) && (strcmp(argv[1], "-b") == 0))
+    {
+        *pbBatch = TRUE;
+        i++;
+        if ((argc > i) && (strncmp(argv[i], "-j", 2) == 0))
+        {
+            *piThreads = atoi(argv[i] + 2);
+            if (*piThreads <= 0)
+                return -1;
+            i++;
+        }
+        *piFirstFile = i;
+        return (argc > i) ? 0 : -1;
+    }
+
+    *piFirstFile = 1;
     if (argc == 3) return 0;
     else return -1;
 }
 
 
-// Main routine.
+// Convert one TAP image file to CAP.
+// If bAsk is not set, an existing CAP file is left alone instead of asking.
 //   Return values:
 //    0: conversion finished ok
 //   -1: an error occurred
-int ARCH_MAINDECL main(int argc, char *argv[])
+__int32 ConvertFile(__int8 *pcInput, __int8 *pcOutput, BOOL bAsk)
 {
     HANDLE  hCAP, hTAP;
     __int32 FuncRes, RetVal = -1;
 
-    printf("\nTAP2CAP v1.00 - TAP image to ZoomTape CAP image conversion\n");
-    printf("Copyright 2012 Arnd Menge\n\n");
-
-    if (Evaluate_Commandline_Params(argc, argv) == -1)
-    {
-        usage();
-        goto exit;
-    }
-
     // Open specified TAP image file for reading.
-    FuncRes = TAP_CBM_OpenFile(&hTAP, argv[1]);
+    FuncRes = TAP_CBM_OpenFile(&hTAP, pcInput);
     if (FuncRes != TAP_CBM_Status_OK)
     {
         TAP_CBM_OutputError(FuncRes);
-        goto exit;
+        return -1;
     }
 
     // Check if specified CAP image file is already existing.
-    if (CAP_isFilePresent(argv[2]) == CAP_Status_OK)
+    if (CAP_isFilePresent(pcOutput) == CAP_Status_OK)
     {
+        if (!bAsk)
+        {
+            printf("Skipping %s: %s already exists.\n", pcInput, pcOutput);
+            TAP_CBM_CloseFile(&hTAP);
+            return -1;
+        }
+
         printf("Overwrite existing file? (y/N)");
         if (getchar() != 'y')
         {
             TAP_CBM_CloseFile(&hTAP);
-            goto exit;
+            return -1;
         }
         printf("\n");
     }
 
     // Create specified CAP image file for writing.
-    FuncRes = CAP_CreateFile(&hCAP, argv[2]);
+    FuncRes = CAP_CreateFile(&hCAP, pcOutput);
     if (FuncRes != CAP_Status_OK)
     {
         CAP_OutputError(FuncRes);
         TAP_CBM_CloseFile(&hTAP);
-        goto exit;
+        return -1;
     }
 
-    printf("Converting: %s -> %s\n\n", argv[1], argv[2]);
+    printf("Converting: %s -> %s\n\n", pcInput, pcOutput);
 
     // Convert CBM TAP to CAP format.
     RetVal = CBMTAP2CAP(hCAP, hTAP);
@@ -85,6 +112,44 @@ int ARCH_MAINDECL main(int argc, char *argv[])
     if (FuncRes != CAP_Status_OK)
         CAP_OutputError(FuncRes);
 
+    return RetVal;
+}
+
+
+// Batch mode conversion of one file.
+__int32 ConvertBatchFile(__int8 *pcInput, __int8 *pcOutput)
+{
+    return ConvertFile(pcInput, pcOutput, FALSE);
+}
+
+
+// Main routine.
+//   Return values:
+//    0: conversion finished ok
+//   -1: an error occurred
+int ARCH_MAINDECL main(int argc, char *argv[])
+{
+    BOOL    bBatch;
+    __int32 iThreads, iFirstFile, RetVal = -1;
+
+    printf("\nTAP2CAP v1.00 - TAP image to ZoomTape CAP image conversion\n");
+    printf("Copyright 2012 Arnd Menge\n\n");
+
+    if (Evaluate_Commandline_Params(argc, argv, &bBatch, &iThreads, &iFirstFile) == -1)
+    {
+        usage();
+        goto exit;
+    }
+
+    if (bBatch)
+    {
+        // Convert all files, several at the same time.
+        RetVal = RunBatchConversion(argc - iFirstFile, argv + iFirstFile, ".cap", iThreads, ConvertBatchFile);
+        goto exit;
+    }
+
+    RetVal = ConvertFile(argv[1], argv[2], TRUE);
+
     if (RetVal == 0)
         printf("Conversion successful.");
 
@@ -6,27 +6,32 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
-#include <malloc.h>
 
 #include <opencbm.h>
 #include <arch.h>
 #include "cap.h"
+#include "tap-cbm.h"
+#include "cap2cbmtap.h"
 #include "tape.h"
 #include "misc.h"
 
 // Global variables
 unsigned __int8  CAP_Machine, CAP_Video, CAP_StartEdge, CAP_SignalFormat;
 unsigned __int32 CAP_Precision, CAP_SignalWidth, CAP_StartOfs;
-CBM_FILE         fd;
+BOOL             bConvertToTAP = FALSE;
+BOOL             bAdapterTAP = FALSE; // The adapter encodes the TAP file, no CAP file.
+
+// Maximum number of tape decks read at the same time.
+#define MAX_DECKS 8
 
 // Break handling variables
 CRITICAL_SECTION CritSec_fd, CritSec_BreakHandler;
-BOOL             fd_Initialized = FALSE, AbortTapeOps = FALSE;
+BOOL             AbortTapeOps = FALSE;
 
 
 void usage(void)
 {
-    printf("Usage: tapread <type> [buffer size] [sampling rate] <filename.cap>\n");
+    printf("Usage: tapread <type> [sampling rate] [-tap|-atap] [<adapter>=]<filename.cap> [...]\n");
     printf("\n");
     printf("Please specify the tape type:\n\n");
     printf("  -c64pal : C64 PAL     \n");
@@ -38,34 +43,37 @@ void usage(void)
     printf("  -spec48k: Spectrum48K \n");
     printf("  -x      : custom/unknown\n");
     printf("\n");
-    printf("You can specify the buffer size for the capture data (optional):\n\n");
-    printf("  -b10 :  10 Megabyte\n");
-    printf("  -b25 :  25 Megabyte (default)\n");
-    printf("  -b50 :  50 Megabyte\n");
-    printf("  -b100: 100 Megabyte\n");
-    printf("\n");
     printf("You can specify the sampling rate (optional):\n\n");
     printf("  -s1 :  1 MHz (default)\n");
     printf("  -s16: 16 MHz (maximum precision)\n");
     printf("\n");
+    printf("You can convert the capture to a TAP file while reading (optional):\n\n");
+    printf("  -tap: also write <filename.tap> (C64, C16 and VIC-20 only)\n");
+    printf("  -atap: only write <filename.tap>, encoded by the adapter (C64 and VIC-20 only)\n");
+    printf("\n");
+    printf("To read up to %d tapes at the same time, give one image file per adapter:\n\n", MAX_DECKS);
+    printf("  <adapter>=<filename.cap>: read the tape deck on <adapter> to <filename.cap>\n");
+    printf("\n");
     printf("Examples:\n");
     printf("  tapread -c64pal myfile.cap\n");
-    printf("  tapread -c64pal -b50 -s16 myfile.cap");
+    printf("  tapread -c64pal -s16 myfile.cap\n");
+    printf("  tapread -c64pal -tap myfile.cap\n");
+    printf("  tapread -c64pal -atap myfile.cap\n");
+    printf("  tapread -c64pal xum1541:0=tape1.cap xum1541:1=tape2.cap");
 }
 
 
-__int32 EvaluateCommandlineParams(__int32 argc, __int8 *argv[], __int32 *piTapeBufferSize, __int8 filename[_MAX_PATH])
+__int32 EvaluateCommandlineParams(__int32 argc, __int8 *argv[], __int8 *ppcDeckSpecs[MAX_DECKS], __int32 *piNumDecks)
 {
-    unsigned __int8 bTapeType = 0, bBufferSize = 0, bSamplingRate = 0; // Commandline flag counters.
+    unsigned __int8 bTapeType = 0, bSamplingRate = 0, bTAP = 0; // Commandline flag counters.
+    __int32         i;
 
-    if ((argc < 3) || (5 < argc))
+    if ((argc < 3) || (4 + MAX_DECKS < argc))
     {
         printf("Error: invalid number of commandline parameters.\n\n");
         return -1;
     }
 
-    *piTapeBufferSize = 1024*1024*25; // Default buffer size: 25MB.
-
     // Evaluate flags.
     while (--argc && (*(++argv)[0] == '-'))
     {
@@ -125,30 +133,6 @@ __int32 EvaluateCommandlineParams(__int32 argc, __int8 *argv[], __int32 *piTapeB
             CAP_Video = CAP_Video_CUSTOM;
             bTapeType++;
         }
-        else if (strcmp(*argv,"-b10") == 0)
-        {
-            *piTapeBufferSize = 1024*1024*10;
-            printf("* Buffer size: 10 MB\n");
-            bBufferSize++;
-        }
-        else if (strcmp(*argv,"-b25") == 0)
-        {
-            *piTapeBufferSize = 1024*1024*25;
-            printf("* Buffer size: 25 MB\n");
-            bBufferSize++;
-        }
-        else if (strcmp(*argv,"-b50") == 0)
-        {
-            *piTapeBufferSize = 1024*1024*50;
-            printf("* Buffer size: 50 MB\n");
-            bBufferSize++;
-        }
-        else if (strcmp(*argv,"-b100") == 0)
-        {
-            *piTapeBufferSize = 1024*1024*100;
-            printf("* Buffer size: 100 MB\n");
-            bBufferSize++;
-        }
         else if (strcmp(*argv,"-s1") == 0)
         {
             CAP_Precision = 1;
@@ -161,6 +145,19 @@ __int32 EvaluateCommandlineParams(__int32 argc, __int8 *argv[], __int32 *piTapeB
             printf("* Sampling rate: %d MHz\n", CAP_Precision);
             bSamplingRate++;
         }
+        else if (strcmp(*argv,"-tap") == 0)
+        {
+            printf("* Converting to TAP while reading\n");
+            bConvertToTAP = TRUE;
+            bTAP++;
+        }
+        else if (strcmp(*argv,"-atap") == 0)
+        {
+            printf("* Encoding TAP on the adapter while reading\n");
+            bConvertToTAP = TRUE;
+            bAdapterTAP = TRUE;
+            bTAP++;
+        }
         else
         {
             printf("\nError: invalid commandline parameter.\n\n");
@@ -179,39 +176,105 @@ __int32 EvaluateCommandlineParams(__int32 argc, __int8 *argv[], __int32 *piTapeB
         return -1;
     }
 
-    if (bBufferSize == 0)
+    if (bSamplingRate == 0)
     {
-        printf("* Buffer size: 25 MB\n"); // use default value
+        printf("* Sampling rate: %d MHz\n", CAP_Precision); // use default value
     }
-    else if (bBufferSize > 1)
+    else if (bSamplingRate > 1)
     {
-        printf("\nError: [buffer size] specified more than once.\n\n");
+        printf("\nError: [sampling rate] specified more than once.\n\n");
         return -1;
     }
 
-    if (bSamplingRate == 0)
+    if (bTAP > 1)
     {
-        printf("* Sampling rate: %d MHz\n", CAP_Precision); // use default value
+        printf("\nError: -tap or -atap specified more than once.\n\n");
+        return -1;
     }
-    else if (bSamplingRate > 1)
+
+    if (bConvertToTAP && (CAP_Machine != CAP_Machine_C64) && (CAP_Machine != CAP_Machine_C16) && (CAP_Machine != CAP_Machine_VC20))
     {
-        printf("\nError: [sampling rate] specified more than once.\n\n");
+        printf("\nError: -tap needs a C64, C16 or VIC-20 tape type.\n\n");
+        return -1;
+    }
+
+    // The adapter only writes TAP v1, the C16 one is v2.
+    if (bAdapterTAP && (CAP_Machine == CAP_Machine_C16))
+    {
+        printf("\nError: -atap needs a C64 or VIC-20 tape type.\n\n");
         return -1;
     }
 
-    if (strlen(argv[0]) >= _MAX_PATH)
+    if (argc == 0)
+    {
+        printf("\nError: <filename.cap> not specified.\n\n");
+        return -1;
+    }
+    if (argc > MAX_DECKS)
     {
-        printf("\nError: Filename too long.\n\n");
+        printf("\nError: More than %d tape decks specified.\n\n", MAX_DECKS);
         return -1;
     }
 
-    strcpy(filename, argv[0]);
+    for (i = 0; i < argc; i++)
+    {
+        if (strlen(argv[i]) >= _MAX_PATH)
+        {
+            printf("\nError: Filename too long.\n\n");
+            return -1;
+        }
+
+        // Each deck needs its own adapter.
+        if ((argc > 1) && (strchr(argv[i], '=') == NULL))
+        {
+            printf("\nError: <adapter> not specified for %s.\n\n", argv[i]);
+            return -1;
+        }
+
+        ppcDeckSpecs[i] = argv[i];
+    }
+
+    *piNumDecks = argc;
 
     return 0;
 }
 
 
-// Allocate memory for tape image.
+// Size of the chunks in which the capture data is read and written to the CAP file.
+#define CAPTURE_CHUNK_SIZE (64*1024)
+
+// Conversion state while the capture data streams in.
+typedef struct
+{
+    HANDLE           hCAP;        // NULL if no CAP file is written.
+    unsigned __int8  Pending[5];  // Start of the stream, or of a timestamp split between two chunks.
+    __int32          iPendingLen;
+    BOOL             bStarted, bDelta, bTAPData, bError;
+    CBMTAP_Stream    *pTAP;       // Live TAP conversion, NULL if none.
+    unsigned __int64 ui64LastDelta, ui64TotalTapeTime;
+    unsigned __int32 uiNumSignals;
+} CaptureStream;
+
+// A tape deck and the image files its capture is written to.
+typedef struct
+{
+    __int8          pcAdapter[_MAX_PATH];               // Empty: default adapter.
+    __int8          pcLabel[_MAX_PATH+3];               // Prefix of the deck's messages, empty if only one deck.
+    __int8          filename[_MAX_PATH], TAPfilename[_MAX_PATH+4];
+    CBM_FILE        fd;
+    BOOL            fd_Initialized, bFilesOpen;
+    HANDLE          hCAP, hTAP;
+    CaptureStream   Stream;
+    CBMTAP_Stream   TAPStream;
+    unsigned __int8 *pucTapeBuffer;
+    __int32         iCaptureLen, RetVal;
+} TapeDeck;
+
+TapeDeck         Decks[MAX_DECKS];
+__int32          iNumDecks = 0;
+
+
+// Allocate memory for one chunk of capture data.
 __int32 AllocateImageBuffer(void **ppucTapeBuffer, __int32 iTapeBufferSize)
 {
     if (iTapeBufferSize < 0)
@@ -220,7 +283,7 @@ __int32 AllocateImageBuffer(void **ppucTapeBuffer, __int32 iTapeBufferSize)
         return -1;
     }
 
-    // Allocate memory for tape image.
+    // Allocate memory for capture data.
     *ppucTapeBuffer = malloc(iTapeBufferSize);
     if (*ppucTapeBuffer == NULL)
     {
@@ -228,9 +291,6 @@ __int32 AllocateImageBuffer(void **ppucTapeBuffer, __int32 iTapeBufferSize)
         return -1;
     }
 
-    // Initialize memory for tape image.
-    memset(*ppucTapeBuffer, 0x00, iTapeBufferSize);
-
     return 0;
 }
 
@@ -250,63 +310,185 @@ void OutputTapeLength(unsigned __int32 uiTotalTapeTimeSeconds, unsigned __int32
 }
 
 
-// Convert timestamps to 5 bytes, downscale precision to 1us if requested and write to CAP file.
-__int32 ConvertAndWriteCaptureData(HANDLE hCAP, unsigned __int8 *pucTapeBuffer, __int32 iCaptureLen, unsigned __int32 *puiTotalTapeTimeSeconds, unsigned __int32 *puiNumSignals)
+// Decode the next timestamp of a capture buffer.
+// The buffer starts with 80 00 00 00 00 if the firmware sent delta-compressed
+// timestamps (XUM1541_TAP_CONFIG_DELTA), else it holds 2- and 5-byte timestamps.
+// Returns the number of bytes used, 0 if the buffer ends within a timestamp.
+static __int32 DecodeTimestamp(const unsigned __int8 *p, __int32 iLen, BOOL bDelta, unsigned __int64 *pui64LastDelta, unsigned __int64 *pui64Delta)
 {
-    unsigned __int64 ui64Delta, ui64TotalTapeTime = 0;
-    __int32          FuncRes, i = 0;
+    __int32 n, j;
 
-    *puiTotalTapeTimeSeconds = 0;
-    *puiNumSignals = 0;
+    if (!bDelta)
+    {
+        n = ((p[0] & 0x80) == 0) ? 2 : 5;
+        if (iLen < n)
+            return 0;
+
+        *pui64Delta = p[0] & 0x7f;
+        for (j = 1; j < n; j++)
+            *pui64Delta = (*pui64Delta << 8) + p[j];
+        return n;
+    }
 
-    while (i < iCaptureLen)
+    if ((p[0] & 0x80) == 0)
     {
-        ui64Delta = pucTapeBuffer[i];
-        ui64Delta = (ui64Delta << 8) + pucTapeBuffer[i+1];
+        // Signed 7-bit difference to the previous timestamp
+        *pui64Delta = *pui64LastDelta + ((p[0] & 0x40) ? (__int32)p[0] - 0x80 : p[0]);
+        *pui64LastDelta = *pui64Delta;
+        return 1;
+    }
+
+    n = ((p[0] & 0x40) == 0) ? 2 : 5;
+    if (iLen < n)
+        return 0;
+
+    *pui64Delta = p[0] & 0x3f;
+    for (j = 1; j < n; j++)
+        *pui64Delta = (*pui64Delta << 8) + p[j];
+    *pui64LastDelta = (n == 2) ? *pui64Delta : 0x8000;
+    return n;
+}
+
+
+// Downscale precision to 1us if requested and write timestamp to CAP file.
+static __int32 WriteCaptureSignal(CaptureStream *pStream, unsigned __int64 ui64Delta)
+{
+    __int32 FuncRes;
+
+    pStream->ui64TotalTapeTime += ui64Delta;
+    pStream->uiNumSignals++;
+
+    if (CAP_Precision == 1) ui64Delta = (ui64Delta + 8) >> 4; // downscale by 16
 
-        if (ui64Delta < 0x8000)
+    if (pStream->hCAP != NULL)
+    {
+        FuncRes = CAP_WriteSignal(pStream->hCAP, ui64Delta, NULL);
+        if (FuncRes != CAP_Status_OK)
         {
-            // Short signal (<2ms)
-            i += 2;
+            CAP_OutputError(FuncRes);
+            return -1;
         }
-        else
+    }
+
+    // Convert the signal to TAP as if it was read back from the CAP file.
+    if (pStream->pTAP != NULL)
+        return CBMTAP_StreamSignal(pStream->pTAP, ui64Delta);
+
+    return 0;
+}
+
+
+// Append TAP data encoded by the adapter (XUM1541_TAP_CONFIG_TAP) to the TAP file.
+static __int32 WriteTAPData(CaptureStream *pStream, const unsigned __int8 *pucData, __int32 iLen)
+{
+    __int32 i;
+
+    for (i = 0; i < iLen; i++)
+        Check_TAP_CBM_Error_TextRetM1(TAP_CBM_WriteSignal_1Byte(pStream->pTAP->hTAP, pucData[i], &(pStream->pTAP->TAP_Counter)));
+
+    pStream->uiNumSignals += iLen;
+    return 0;
+}
+
+
+// Convert the timestamps of the next chunk of capture data to 5 bytes and write them to CAP file.
+// A timestamp split between two chunks is kept until the rest of it arrives.
+static __int32 ConvertAndWriteCaptureData(CaptureStream *pStream, const unsigned __int8 *pucData, __int32 iLen)
+{
+    static const unsigned __int8 DeltaMarker[5] = { 0x80, 0, 0, 0, 0 };
+    static const unsigned __int8 TAPMarker[5] = { 0x80, 0, 0, 0, 1 };
+    unsigned __int8  Joined[10];
+    unsigned __int64 ui64Delta;
+    __int32          n, i = 0, j, k;
+
+    if (!pStream->bStarted)
+    {
+        // The first 5 bytes tell if the timestamps are delta-compressed.
+        while ((pStream->iPendingLen < 5) && (i < iLen))
+            pStream->Pending[pStream->iPendingLen++] = pucData[i++];
+        if (pStream->iPendingLen < 5)
+            return 0;
+
+        pStream->bStarted = TRUE;
+        if (memcmp(pStream->Pending, DeltaMarker, 5) == 0)
+        {
+            pStream->bDelta = TRUE;
+            pStream->iPendingLen = 0;
+        }
+        else if ((pStream->pTAP != NULL) && (memcmp(pStream->Pending, TAPMarker, 5) == 0))
         {
-            // Long signal (>=2ms)
-            ui64Delta &= 0x7fff;
-            ui64Delta = (ui64Delta << 8) + pucTapeBuffer[i+2];
-            ui64Delta = (ui64Delta << 8) + pucTapeBuffer[i+3];
-            ui64Delta = (ui64Delta << 8) + pucTapeBuffer[i+4];
-            i += 5;
+            pStream->bTAPData = TRUE;
+            pStream->iPendingLen = 0;
         }
+        pucData += i;
+        iLen -= i;
+        i = 0;
+    }
 
-        ui64TotalTapeTime += ui64Delta;
-        (*puiNumSignals)++;
+    if (pStream->bTAPData)
+        return WriteTAPData(pStream, pucData, iLen);
 
-        if (CAP_Precision == 1) ui64Delta = (ui64Delta + 8) >> 4; // downscale by 16
+    if (pStream->iPendingLen > 0)
+    {
+        // Complete the timestamps which started in the previous chunk.
+        j = (iLen < 5) ? iLen : 5;
+        memcpy(Joined, pStream->Pending, pStream->iPendingLen);
+        memcpy(Joined + pStream->iPendingLen, pucData, j);
 
-        FuncRes = CAP_WriteSignal(hCAP, ui64Delta, NULL);
-        if (FuncRes != CAP_Status_OK)
+        for (k = 0; k < pStream->iPendingLen; k += n)
         {
-            CAP_OutputError(FuncRes);
-            return -1;
+            n = DecodeTimestamp(Joined + k, pStream->iPendingLen + j - k, pStream->bDelta, &pStream->ui64LastDelta, &ui64Delta);
+            if (n == 0)
+            {
+                // Still incomplete, this chunk is too short.
+                memmove(pStream->Pending, Joined + k, pStream->iPendingLen + j - k);
+                pStream->iPendingLen += j - k;
+                return 0;
+            }
+            if (WriteCaptureSignal(pStream, ui64Delta) == -1)
+                return -1;
         }
+        i = k - pStream->iPendingLen;
+        pStream->iPendingLen = 0;
     }
 
-    // Calculate tape length in seconds.
-    *puiTotalTapeTimeSeconds = (unsigned __int32) (((ui64TotalTapeTime + 8000000) >> 10)/15625); //16000000;
+    while (i < iLen)
+    {
+        n = DecodeTimestamp(pucData + i, iLen - i, pStream->bDelta, &pStream->ui64LastDelta, &ui64Delta);
+        if (n == 0)
+        {
+            memcpy(pStream->Pending, pucData + i, iLen - i);
+            pStream->iPendingLen = iLen - i;
+            break;
+        }
+        i += n;
+
+        if (WriteCaptureSignal(pStream, ui64Delta) == -1)
+            return -1;
+    }
 
     return 0;
 }
 
 
-// Write tape image to specified image file.
-__int32 WriteTapeBufferToCaptureFile(HANDLE hCAP, unsigned __int8 *pucTapeBuffer, __int32 iCaptureLen)
+// Called for every chunk of capture data while the tape is read.
+static int CBMAPIDECL CaptureChunk(void *Context, const unsigned char *Buffer, unsigned int Length)
 {
-    unsigned __int32 uiTotalTapeTimeSeconds, uiNumSignals;
-    __int32          FuncRes;
+    CaptureStream *pStream = (CaptureStream *) Context;
+
+    if (ConvertAndWriteCaptureData(pStream, Buffer, Length) == -1)
+    {
+        pStream->bError = TRUE;
+        return 1; // Break off the capture.
+    }
+    return 0;
+}
 
-    if (iCaptureLen == 0)
-        printf("Empty capture file.\n");
+
+// Write the header of the specified image file, the capture data follows while reading.
+__int32 WriteCaptureFileHeader(HANDLE hCAP)
+{
+    __int32 FuncRes;
 
     FuncRes = CAP_SetHeader(hCAP, CAP_Precision, CAP_Machine, CAP_Video, CAP_StartEdge, CAP_SignalFormat, CAP_SignalWidth, CAP_StartOfs);
     if (FuncRes != CAP_Status_OK)
@@ -322,27 +504,57 @@ __int32 WriteTapeBufferToCaptureFile(HANDLE hCAP, unsigned __int8 *pucTapeBuffer
         return -1;
     }
 
-    FuncRes = CAP_WriteHeaderAddon(hCAP, "   Created by       ZoomTape    ----------------", 0x30);
+    FuncRes = CAP_WriteHeaderAddon(hCAP, (unsigned __int8 *) "   Created by       ZoomTape    ----------------", 0x30);
     if (FuncRes != CAP_Status_OK)
     {
         CAP_OutputError(FuncRes);
         return -1;
     }
 
-    // Convert timestamps to 5 bytes, downscale precision to 1us if requested and write to CAP file.
-    if (ConvertAndWriteCaptureData(hCAP, pucTapeBuffer, iCaptureLen, &uiTotalTapeTimeSeconds, &uiNumSignals) == -1)
-        return -1;
+    return 0;
+}
+
+
+// Write what is left of the capture data and print tape length.
+__int32 FinishCaptureFile(CaptureStream *pStream, __int32 iCaptureLen)
+{
+    unsigned __int8 Rest[5];
+    __int32         iRestLen;
+
+    if (iCaptureLen == 0)
+        printf("Empty capture file.\n");
+
+    if (!pStream->bStarted && (pStream->iPendingLen > 0))
+    {
+        // Less than 5 bytes captured, no delta-compressed timestamps.
+        iRestLen = pStream->iPendingLen;
+        memcpy(Rest, pStream->Pending, iRestLen);
+        pStream->bStarted = TRUE;
+        pStream->iPendingLen = 0;
+        if (ConvertAndWriteCaptureData(pStream, Rest, iRestLen) == -1)
+            return -1;
+    }
+    // A truncated last timestamp is dropped.
+
+    if (pStream->bTAPData)
+    {
+        printf("TAP data encoded by the adapter: %u bytes.\n", pStream->uiNumSignals);
+        return 0;
+    }
+    if (pStream->hCAP == NULL)
+        printf("Older firmware sent timestamps, TAP data converted here.\n");
 
     // Print tape length to console.
-    OutputTapeLength(uiTotalTapeTimeSeconds, uiNumSignals, iCaptureLen);
+    OutputTapeLength((unsigned __int32) (((pStream->ui64TotalTapeTime + 8000000) >> 10)/15625), //16000000;
+                     pStream->uiNumSignals, iCaptureLen);
 
     return 0;
 }
 
 
-__int32 CaptureTape(CBM_FILE fd, unsigned __int8 *pucTapeBuffer, __int32 iTapeBufferSize, __int32 *piCaptureLen)
+__int32 CaptureTape(const __int8 *pcDeck, CBM_FILE fd, unsigned __int8 *pucTapeBuffer, __int32 iTapeBufferSize, CaptureStream *pStream, __int32 *piCaptureLen)
 {
-    unsigned __int8 ReadConfig, ReadConfig2;
+    unsigned __int8 ReadConfig[2], ReadConfig2;
     __int32         Status, BytesRead, BytesWritten, FuncRes;
 
     // Check abort flag.
@@ -358,12 +570,12 @@ __int32 CaptureTape(CBM_FILE fd, unsigned __int8 *pucTapeBuffer, __int32 iTapeBu
     FuncRes = cbm_tap_get_ver(fd, &Status);
     if (FuncRes != 1)
     {
-        printf("\nReturned error [get_ver]: %d\n", FuncRes);
+        printf("\n%sReturned error [get_ver]: %d\n", pcDeck, FuncRes);
         return -1;
     }
     if (Status < 0)
     {
-        printf("\nReturned error [get_ver]: ");
+        printf("\n%sReturned error [get_ver]: ", pcDeck);
         if (OutputError(Status) < 0)
             if (OutputFuncError(Status) < 0)
                 printf("%d\n", Status);
@@ -371,16 +583,30 @@ __int32 CaptureTape(CBM_FILE fd, unsigned __int8 *pucTapeBuffer, __int32 iTapeBu
     }
     if (Status != TapeFirmwareVersion)
     {
-        printf("\nError [get_ver]: ");
+        printf("\n%sError [get_ver]: ", pcDeck);
         OutputError(Tape_Status_ERROR_Wrong_Tape_Firmware);
         return -1;
     }
 
     // Prepare tape read configuration.
     if (CAP_StartEdge == CAP_StartEdge_Falling)
-        ReadConfig = (unsigned __int8)XUM1541_TAP_READ_STARTFALLEDGE; // Start reading with falling edge.
+        ReadConfig[0] = (unsigned __int8)XUM1541_TAP_READ_STARTFALLEDGE; // Start reading with falling edge.
     else
-        ReadConfig = ~(unsigned __int8)XUM1541_TAP_READ_STARTFALLEDGE; // Start reading with rising edge.
+        ReadConfig[0] = ~(unsigned __int8)XUM1541_TAP_READ_STARTFALLEDGE; // Start reading with rising edge.
+
+    // Ask for delta-compressed timestamps, this roughly halves the USB traffic and buffer use.
+    ReadConfig[1] = XUM1541_TAP_CONFIG_DELTA;
+
+    // Ask the adapter to encode the TAP data itself. Older firmware sends timestamps, they are converted here.
+    if (bAdapterTAP)
+    {
+        if (CAP_Video == CAP_Video_NTSC)
+            ReadConfig[1] |= XUM1541_TAP_CONFIG_TAP | XUM1541_TAP_CLOCK_NTSC;
+        else if (CAP_Machine == CAP_Machine_VC20)
+            ReadConfig[1] |= XUM1541_TAP_CONFIG_TAP | XUM1541_TAP_CLOCK_VIC_PAL;
+        else
+            ReadConfig[1] |= XUM1541_TAP_CONFIG_TAP | XUM1541_TAP_CLOCK_C64_PAL;
+    }
 
     // Check abort flag.
     if (AbortTapeOps)
@@ -394,24 +620,24 @@ __int32 CaptureTape(CBM_FILE fd, unsigned __int8 *pucTapeBuffer, __int32 iTapeBu
     //   - XUM1541_Error_NoTapeSupport
     //   - XUM1541_Error_NoDiskTapeMode
     //   - XUM1541_Error_TapeCmdInDiskMode
-    FuncRes = cbm_tap_upload_config(fd, &ReadConfig, 1, &Status, &BytesWritten);
+    FuncRes = cbm_tap_upload_config(fd, ReadConfig, sizeof(ReadConfig), &Status, &BytesWritten);
     if (FuncRes < 0)
     {
-        printf("\nReturned error [upload_config]: ");
+        printf("\n%sReturned error [upload_config]: ", pcDeck);
         if (OutputFuncError(FuncRes) < 0)
             printf("%d\n", FuncRes);
         return -1;
     }
     if (Status != Tape_Status_OK_Config_Uploaded)
     {
-        printf("\nReturned error [upload_config]: ");
+        printf("\n%sReturned error [upload_config]: ", pcDeck);
         if (OutputError(Status) < 0)
             printf("%d\n", Status);
         return -1;
     }
-    if (BytesWritten != 1)
+    if (BytesWritten != sizeof(ReadConfig))
     {
-        printf("\nError [upload_config]: Invalid data size (%d).\n", BytesWritten);
+        printf("\n%sError [upload_config]: Invalid data size (%d).\n", pcDeck, BytesWritten);
         return -1;
     }
 
@@ -430,26 +656,26 @@ __int32 CaptureTape(CBM_FILE fd, unsigned __int8 *pucTapeBuffer, __int32 iTapeBu
     FuncRes = cbm_tap_download_config(fd, &ReadConfig2, 1, &Status, &BytesRead);
     if (FuncRes < 0)
     {
-        printf("\nReturned error [download_config]: ");
+        printf("\n%sReturned error [download_config]: ", pcDeck);
         if (OutputFuncError(FuncRes) < 0)
             printf("%d\n", FuncRes);
         return -1;
     }
     if (Status != Tape_Status_OK_Config_Downloaded)
     {
-        printf("\nReturned error [download_config]: ");
+        printf("\n%sReturned error [download_config]: ", pcDeck);
         if (OutputError(Status) < 0)
             printf("%d\n", Status);
         return -1;
     }
     if (BytesRead != 1)
     {
-        printf("\nError [download_config]: Invalid data size (%d).\n", BytesRead);
+        printf("\n%sError [download_config]: Invalid data size (%d).\n", pcDeck, BytesRead);
         return -1;
     }
-    if ((ReadConfig & 0x60) != (ReadConfig2 & 0x60))
+    if ((ReadConfig[0] & 0x60) != (ReadConfig2 & 0x60))
     {
-        printf("\nError [download_config]: Configuration mismatch.\n");
+        printf("\n%sError [download_config]: Configuration mismatch.\n", pcDeck);
         return -1;
     }
 
@@ -469,14 +695,14 @@ __int32 CaptureTape(CBM_FILE fd, unsigned __int8 *pucTapeBuffer, __int32 iTapeBu
     FuncRes = cbm_tap_prepare_capture(fd, &Status);
     if (FuncRes < 0)
     {
-        printf("\nReturned error [prepare_capture]: ");
+        printf("\n%sReturned error [prepare_capture]: ", pcDeck);
         if (OutputFuncError(FuncRes) < 0)
             printf("%d\n", FuncRes);
         return -1;
     }
     if (Status != Tape_Status_OK_Device_Configured_for_Read)
     {
-        printf("\nReturned error [prepare_capture]: ");
+        printf("\n%sReturned error [prepare_capture]: ", pcDeck);
         if (OutputError(Status) < 0)
             printf("%d\n", Status);
         return -1;
@@ -499,12 +725,12 @@ __int32 CaptureTape(CBM_FILE fd, unsigned __int8 *pucTapeBuffer, __int32 iTapeBu
     FuncRes = cbm_tap_get_sense(fd, &Status);
     if (FuncRes != 1)
     {
-        printf("\nReturned error [get_sense]: %d\n", FuncRes);
+        printf("\n%sReturned error [get_sense]: %d\n", pcDeck, FuncRes);
         return -1;
     }
     if ((Status != Tape_Status_OK_Sense_On_Play) && (Status != Tape_Status_OK_Sense_On_Stop))
     {
-        printf("\nReturned error [get_sense]: ");
+        printf("\n%sReturned error [get_sense]: ", pcDeck);
         if (OutputError(Status) < 0)
             if (OutputFuncError(Status) < 0)
                 printf("%d\n", Status);
@@ -517,7 +743,7 @@ __int32 CaptureTape(CBM_FILE fd, unsigned __int8 *pucTapeBuffer, __int32 iTapeBu
         if (AbortTapeOps)
             return -1;
 
-        printf("Please <STOP> the tape.\n");
+        printf("%sPlease <STOP> the tape.\n", pcDeck);
         //   Status values:
         //   - Tape_Status_OK_Sense_On_Stop
         //   - Tape_Status_ERROR_Device_Not_Configured
@@ -529,12 +755,12 @@ __int32 CaptureTape(CBM_FILE fd, unsigned __int8 *pucTapeBuffer, __int32 iTapeBu
         FuncRes = cbm_tap_wait_for_stop_sense(fd, &Status);
         if (FuncRes != 1)
         {
-            printf("\nReturned error [wait_for_stop_sense]: %d\n", FuncRes);
+            printf("\n%sReturned error [wait_for_stop_sense]: %d\n", pcDeck, FuncRes);
             return -1;
         }
         if (Status != Tape_Status_OK_Sense_On_Stop)
         {
-            printf("\nReturned error [wait_for_stop_sense]: ");
+            printf("\n%sReturned error [wait_for_stop_sense]: ", pcDeck);
             if (OutputError(Status) < 0)
                 if (OutputFuncError(Status) < 0)
                     printf("%d\n", Status);
@@ -546,7 +772,7 @@ __int32 CaptureTape(CBM_FILE fd, unsigned __int8 *pucTapeBuffer, __int32 iTapeBu
     if (AbortTapeOps)
         return -1;
 
-    printf("Press <PLAY> on tape.\n");
+    printf("%sPress <PLAY> on tape.\n", pcDeck);
 
     //   Status values:
     //   - Tape_Status_OK_Sense_On_Play
@@ -559,12 +785,12 @@ __int32 CaptureTape(CBM_FILE fd, unsigned __int8 *pucTapeBuffer, __int32 iTapeBu
     FuncRes = cbm_tap_wait_for_play_sense(fd, &Status);
     if (FuncRes != 1)
     {
-        printf("\nReturned error [wait_for_play_sense]: %d\n", FuncRes);
+        printf("\n%sReturned error [wait_for_play_sense]: %d\n", pcDeck, FuncRes);
         return -1;
     }
     if (Status != Tape_Status_OK_Sense_On_Play)
     {
-        printf("\nReturned error [wait_for_play_sense]: ");
+        printf("\n%sReturned error [wait_for_play_sense]: ", pcDeck);
         if (OutputError(Status) < 0)
             if (OutputFuncError(Status) < 0)
                 printf("%d\n", Status);
@@ -575,7 +801,7 @@ __int32 CaptureTape(CBM_FILE fd, unsigned __int8 *pucTapeBuffer, __int32 iTapeBu
     if (AbortTapeOps)
         return -1;
 
-    printf("\nReading tape...\n");
+    printf("\n%sReading tape...\n", pcDeck);
 
     //   Status values:
     //   - Tape_Status_OK_Capture_Finished
@@ -586,23 +812,24 @@ __int32 CaptureTape(CBM_FILE fd, unsigned __int8 *pucTapeBuffer, __int32 iTapeBu
     //   - XUM1541_Error_NoTapeSupport
     //   - XUM1541_Error_NoDiskTapeMode
     //   - XUM1541_Error_TapeCmdInDiskMode
-    FuncRes = cbm_tap_start_capture(fd, pucTapeBuffer, iTapeBufferSize, &Status, &BytesRead);
+    // The capture data is written to the CAP file chunk by chunk while reading.
+    FuncRes = cbm_tap_capture(fd, pucTapeBuffer, iTapeBufferSize, CaptureChunk, pStream, &Status, &BytesRead);
     if (FuncRes < 0)
     {
-        printf("\nReturned error [capture]: ");
+        printf("\n%sReturned error [capture]: ", pcDeck);
         if (OutputFuncError(FuncRes) < 0)
             printf("%d\n", FuncRes);
         return -1;
     }
     *piCaptureLen = BytesRead;
-    if (*piCaptureLen >= iTapeBufferSize)
+    if (pStream->bError)
     {
-        printf("\nError [capture]: Buffer full, use larger buffer size!\n");
+        printf("\n%sError [capture]: Could not write capture data.\n", pcDeck);
         return -1;
     }
     if (Status != Tape_Status_OK_Capture_Finished)
     {
-        printf("\nReturned error [capture]: ");
+        printf("\n%sReturned error [capture]: ", pcDeck);
         if (OutputError(Status) < 0)
             printf("%d\n", Status);
         return -1;
@@ -612,16 +839,31 @@ __int32 CaptureTape(CBM_FILE fd, unsigned __int8 *pucTapeBuffer, __int32 iTapeBu
     if (AbortTapeOps)
         return -1;
 
-    printf("\nReading finished OK.\n");
+    printf("\n%sReading finished OK.\n", pcDeck);
 
     return 0;
 }
 
 
+// Ask if an existing file may be overwritten, the rest of the answer line is skipped.
+BOOL AskOverwrite(const char *filename)
+{
+    int answer, c;
+
+    printf("\nOverwrite existing file %s? (y/N)", filename);
+    answer = getchar();
+    for (c = answer; (c != '\n') && (c != EOF); c = getchar());
+    return (answer == 'y');
+}
+
+
 // Break handler.
 // Initialized by SetConsoleCtrlHandler() after critical sections initialized.
 BOOL BreakHandler(DWORD fdwCtrlType)
 {
+    BOOL    bBreak = FALSE;
+    __int32 i;
+
     if (fdwCtrlType == CTRL_C_EVENT)
     {
         printf("\nAborting...\n");
@@ -632,30 +874,227 @@ BOOL BreakHandler(DWORD fdwCtrlType)
 
         EnterCriticalSection(&CritSec_fd); // Acquire handle flag access.
 
-        if (fd_Initialized)
-        {
-            cbm_tap_break(fd); // Handle valid.
-            LeaveCriticalSection(&CritSec_fd); // Release handle flag access.
-            return TRUE;
-        }
+        // Break off the captures of all decks.
+        for (i = 0; i < iNumDecks; i++)
+            if (Decks[i].fd_Initialized)
+            {
+                cbm_tap_break(Decks[i].fd); // Handle valid.
+                bBreak = TRUE;
+            }
 
         LeaveCriticalSection(&CritSec_fd); // Release handle flag access.
+
+        if (bBreak)
+            return TRUE;
     }
     return FALSE;
 }
 
 
+// Split "[<adapter>=]<filename.cap>" into adapter and image file names.
+void SetupDeck(TapeDeck *pDeck, const __int8 *pcDeckSpec)
+{
+    const __int8 *pcFilename = strchr(pcDeckSpec, '=');
+
+    memset(pDeck, 0, sizeof(TapeDeck));
+    pDeck->RetVal = -1;
+
+    if (pcFilename == NULL)
+        pcFilename = pcDeckSpec; // Default adapter.
+    else
+    {
+        memcpy(pDeck->pcAdapter, pcDeckSpec, pcFilename - pcDeckSpec);
+        pDeck->pcAdapter[pcFilename - pcDeckSpec] = 0;
+        pcFilename++;
+    }
+    strcpy(pDeck->filename, pcFilename);
+
+    // Tell the decks apart in the messages.
+    if (iNumDecks > 1)
+        sprintf(pDeck->pcLabel, "%s: ", pDeck->pcAdapter);
+
+    if (bConvertToTAP)
+    {
+        // TAP file name: CAP file name with .tap extension.
+        strcpy(pDeck->TAPfilename, pDeck->filename);
+        if ((strlen(pDeck->TAPfilename) > 4) && (_stricmp(pDeck->TAPfilename + strlen(pDeck->TAPfilename) - 4, ".cap") == 0))
+            pDeck->TAPfilename[strlen(pDeck->TAPfilename) - 4] = 0;
+        strcat(pDeck->TAPfilename, ".tap");
+    }
+}
+
+
+// Create the image files of a deck and write their headers, the capture data is appended while reading.
+__int32 OpenDeckFiles(TapeDeck *pDeck)
+{
+    __int32 FuncRes;
+
+    memset(&pDeck->Stream, 0, sizeof(pDeck->Stream));
+    pDeck->Stream.ui64LastDelta = 0x8000;
+
+    if (!bAdapterTAP)
+    {
+        // Create specified image file for writing.
+        FuncRes = CAP_CreateFile(&pDeck->hCAP, pDeck->filename);
+        if (FuncRes != CAP_Status_OK)
+        {
+            CAP_OutputError(FuncRes);
+            return -1;
+        }
+
+        // Write the header now, the capture data is appended while reading.
+        if (WriteCaptureFileHeader(pDeck->hCAP) == -1)
+        {
+            CAP_CloseFile(&pDeck->hCAP);
+            return -1;
+        }
+        pDeck->Stream.hCAP = pDeck->hCAP;
+    }
+
+    if (bConvertToTAP)
+    {
+        // Create TAP file, the converted signals are appended while reading.
+        FuncRes = TAP_CBM_CreateFile(&pDeck->hTAP, pDeck->TAPfilename);
+        if (FuncRes != TAP_CBM_Status_OK)
+        {
+            TAP_CBM_OutputError(FuncRes);
+            if (!bAdapterTAP) CAP_CloseFile(&pDeck->hCAP);
+            return -1;
+        }
+        if (CBMTAP_StreamBegin(&pDeck->TAPStream, pDeck->hTAP, CAP_Machine, CAP_Video, CAP_Precision) != 0)
+        {
+            TAP_CBM_CloseFile(&pDeck->hTAP);
+            if (!bAdapterTAP) CAP_CloseFile(&pDeck->hCAP);
+            return -1;
+        }
+        pDeck->Stream.pTAP = &pDeck->TAPStream;
+    }
+
+    pDeck->bFilesOpen = TRUE;
+    return 0;
+}
+
+
+// Write the rest of the capture data if the tape was read ok, and close the image files of a deck.
+__int32 CloseDeckFiles(TapeDeck *pDeck)
+{
+    __int32 FuncRes, RetVal = pDeck->RetVal;
+
+    if (!pDeck->bFilesOpen)
+        return -1;
+    pDeck->bFilesOpen = FALSE;
+
+    if (RetVal != 0)
+    {
+        if (bConvertToTAP) TAP_CBM_CloseFile(&pDeck->hTAP);
+        if (!bAdapterTAP) CAP_CloseFile(&pDeck->hCAP);
+        return -1;
+    }
+
+    // Write the rest of the capture data to specified image file.
+    RetVal = FinishCaptureFile(&pDeck->Stream, pDeck->iCaptureLen);
+
+    if (bConvertToTAP)
+    {
+        // Set signal byte count in TAP header.
+        if ((RetVal == 0) && (CBMTAP_StreamEnd(&pDeck->TAPStream) != 0))
+            RetVal = -1;
+
+        FuncRes = TAP_CBM_CloseFile(&pDeck->hTAP);
+        if (FuncRes != TAP_CBM_Status_OK)
+        {
+            TAP_CBM_OutputError(FuncRes);
+            RetVal = -1;
+        }
+        else if (RetVal == 0)
+            printf("TAP file successfully created.\n");
+    }
+
+    if (bAdapterTAP)
+        return RetVal;
+
+    FuncRes = CAP_CloseFile(&pDeck->hCAP);
+    if (FuncRes != CAP_Status_OK)
+    {
+        CAP_OutputError(FuncRes);
+        return -1;
+    }
+
+    if (RetVal == 0)
+        printf("Capture file successfully created.\n");
+
+    return RetVal;
+}
+
+
+// Capture the tape of one deck, called by a thread of its own if several decks are read.
+DWORD WINAPI DeckThread(LPVOID lpParam)
+{
+    TapeDeck *pDeck = (TapeDeck *) lpParam;
+
+    EnterCriticalSection(&CritSec_fd); // Acquire handle flag access.
+
+    if (cbm_driver_open_ex(&pDeck->fd, (pDeck->pcAdapter[0] != 0) ? pDeck->pcAdapter : NULL) != 0)
+    {
+        printf("%sDriver error.\n", pDeck->pcLabel);
+        LeaveCriticalSection(&CritSec_fd);
+        pDeck->RetVal = -1;
+        return 0;
+    }
+
+    pDeck->fd_Initialized = TRUE;
+    LeaveCriticalSection(&CritSec_fd); // Release handle flag access.
+
+    pDeck->RetVal = CaptureTape(pDeck->pcLabel, pDeck->fd, pDeck->pucTapeBuffer, CAPTURE_CHUNK_SIZE, &pDeck->Stream, &pDeck->iCaptureLen);
+
+    EnterCriticalSection(&CritSec_fd); // Acquire handle flag access.
+    cbm_driver_close(pDeck->fd);
+    pDeck->fd_Initialized = FALSE;
+    LeaveCriticalSection(&CritSec_fd); // Release handle flag access.
+
+    return 0;
+}
+
+
+// Read the tapes of all decks at the same time.
+void CaptureAllDecks(void)
+{
+    HANDLE  hThreads[MAX_DECKS];
+    __int32 i, iStarted = 0;
+
+    if (iNumDecks == 1)
+    {
+        DeckThread(&Decks[0]);
+        return;
+    }
+
+    for (i = 0; i < iNumDecks; i++)
+    {
+        hThreads[iStarted] = CreateThread(NULL, 0, DeckThread, &Decks[i], 0, NULL);
+        if (hThreads[iStarted] != NULL)
+            iStarted++;
+        else
+            printf("%sError: Could not start capture thread.\n", Decks[i].pcLabel);
+    }
+
+    if (iStarted > 0)
+    {
+        WaitForMultipleObjects(iStarted, hThreads, TRUE, INFINITE);
+        for (i = 0; i < iStarted; i++)
+            CloseHandle(hThreads[i]);
+    }
+}
+
+
 // Main routine.
 //   Return values:
-//    0: tape reading finished ok
+//    0: tape reading finished ok (all decks)
 //   -1: an error occurred
 int ARCH_MAINDECL main(int argc, char *argv[])
 {
-    HANDLE          hCAP;
-    unsigned __int8 *pucTapeBuffer = NULL;
-    __int8          filename[_MAX_PATH];
-    __int32         iCaptureLen, iTapeBufferSize = 0;
-    __int32         FuncRes, RetVal = -1;
+    __int8  *ppcDeckSpecs[MAX_DECKS];
+    __int32 i, j, iNumOK = 0;
+    __int32 RetVal = -1;
 
     printf("\ntapread v1.00 - Commodore 1530/1531 tape image creator\n");
     printf("Copyright 2012 Arnd Menge\n\n");
@@ -673,76 +1112,81 @@ int ARCH_MAINDECL main(int argc, char *argv[])
     CAP_SignalWidth  = CAP_SignalWidth_40bit;     // Default: 40bit.
     CAP_StartOfs     = CAP_Default_Data_Start_Offset+0x30; // Text addon after standard header.
 
-    if (EvaluateCommandlineParams(argc, argv, &iTapeBufferSize, filename) == -1)
+    if (EvaluateCommandlineParams(argc, argv, ppcDeckSpecs, &i) == -1)
     {
         usage();
         goto exit;
     }
 
-    // Allocate memory for tape image.
-    if (AllocateImageBuffer(&pucTapeBuffer, iTapeBufferSize) == -1)
-        goto exit;
-
-    // Check if specified image file is already existing.
-    if (CAP_isFilePresent(filename) == CAP_Status_OK)
+    iNumDecks = i;
+    for (i = 0; i < iNumDecks; i++)
     {
-        printf("\nOverwrite existing file? (y/N)");
-        if (getchar() != 'y')
-            goto exit;
+        SetupDeck(&Decks[i], ppcDeckSpecs[i]);
+
+        for (j = 0; j < i; j++)
+            if ((strcmp(Decks[i].filename, Decks[j].filename) == 0) || (strcmp(Decks[i].pcAdapter, Decks[j].pcAdapter) == 0))
+            {
+                printf("\nError: Adapter or image file of %s used twice.\n\n", ppcDeckSpecs[i]);
+                usage();
+                goto exit;
+            }
     }
 
-    printf("\n");
-
-    // Create specified image file for writing.
-    FuncRes = CAP_CreateFile(&hCAP, filename);
-    if (FuncRes != CAP_Status_OK)
+    for (i = 0; i < iNumDecks; i++)
     {
-        CAP_OutputError(FuncRes);
-        goto exit;
-    }
+        // Allocate memory for one chunk of capture data.
+        if (AllocateImageBuffer((void **) &Decks[i].pucTapeBuffer, CAPTURE_CHUNK_SIZE) == -1)
+            goto exit;
 
-    EnterCriticalSection(&CritSec_fd); // Acquire handle flag access.
+        // Check if specified image file is already existing.
+        if (!bAdapterTAP && (CAP_isFilePresent(Decks[i].filename) == CAP_Status_OK))
+        {
+            if (!AskOverwrite(Decks[i].filename))
+                goto exit;
+        }
 
-    if (cbm_driver_open_ex(&fd, NULL) != 0)
-    {
-        printf("Driver error.\n");
-        CAP_CloseFile(&hCAP);
-        LeaveCriticalSection(&CritSec_fd);
-        goto exit;
+        if (bConvertToTAP && (TAP_CBM_isFilePresent(Decks[i].TAPfilename) == TAP_CBM_Status_OK))
+        {
+            if (!AskOverwrite(Decks[i].TAPfilename))
+                goto exit;
+        }
     }
 
-    fd_Initialized = TRUE;
-    LeaveCriticalSection(&CritSec_fd); // Release handle flag access.
-
-    RetVal = CaptureTape(fd, pucTapeBuffer, iTapeBufferSize, &iCaptureLen);
+    printf("\n");
 
-    EnterCriticalSection(&CritSec_fd); // Acquire handle flag access.
-    cbm_driver_close(fd);
-    fd_Initialized = FALSE;
-    LeaveCriticalSection(&CritSec_fd); // Release handle flag access.
+    for (i = 0; i < iNumDecks; i++)
+        if (OpenDeckFiles(&Decks[i]) == -1)
+            goto exit;
 
-    if (RetVal != 0)
-    {
-        CAP_CloseFile(&hCAP);
-        goto exit;
-    }
+    if (iNumDecks > 1)
+        printf("Reading %d tape decks.\n\n", iNumDecks);
 
-    // Write tape image to specified image file.
-    RetVal = WriteTapeBufferToCaptureFile(hCAP, pucTapeBuffer, iCaptureLen);
+    CaptureAllDecks();
 
-    FuncRes = CAP_CloseFile(&hCAP);
-    if (FuncRes != CAP_Status_OK)
+    // Finish the image files one deck after the other, keeps the reports together.
+    for (i = 0; i < iNumDecks; i++)
     {
-        CAP_OutputError(FuncRes);
-        goto exit;
+        if (iNumDecks > 1)
+            printf("\n%s%s\n", Decks[i].pcLabel, Decks[i].filename);
+        if (CloseDeckFiles(&Decks[i]) == 0)
+            iNumOK++;
     }
 
-    printf("Capture file successfully created.\n");
+    if (iNumDecks > 1)
+        printf("\n%d of %d tapes read.\n", iNumOK, iNumDecks);
+
+    if (iNumOK == iNumDecks)
+        RetVal = 0;
 
     exit:
+    // Image files left open by an error before the capture.
+    for (i = 0; i < iNumDecks; i++)
+        CloseDeckFiles(&Decks[i]);
+
     DeleteCriticalSection(&CritSec_fd);
     DeleteCriticalSection(&CritSec_BreakHandler);
-    if (pucTapeBuffer != NULL) free(pucTapeBuffer);
+    for (i = 0; i < iNumDecks; i++)
+        if (Decks[i].pucTapeBuffer != NULL) free(Decks[i].pucTapeBuffer);
     printf("\n");
     return RetVal;
 }
@@ -12,9 +12,10 @@
 #define IDM_OPENCAPIMAGE                        120
 #define IDM_SHOW_HALFWAVES                      122
 #define IDM_FIRST_HALFWAVE_IN_DARK_GREEN        123
-#define IDM_USE_2H_BUFFER                       40000
 #define IDS_APP_TITLE                           40000
-#define IDM_USE_5H_BUFFER                       40001
-#define IDM_USE_1H_BUFFER                       40002
 #define IDM_DOUBLE_SCREEN_HEIGHT                40003
 #define IDM_DOUBLE_SCREEN_WIDTH                 40004
+#define IDM_ZOOM_10MS                           40005
+#define IDM_ZOOM_100MS                          40006
+#define IDM_ZOOM_1S                             40007
+#define IDM_ZOOM_10S                            40008
@@ -15,12 +15,38 @@
 
 #define Tape_Status_OK 1 // from tape.h
 
+#define BaseMSperLine  10    // Time per line of the pulse index
+#define LinesPerChunk  4096  // Index lines allocated at once
+#define MaxChunks      65536 // 745h at 10ms per line
+#define LODBins        500   // Pulse lengths 0..999us, 2us per bin
+#define LODBytes       ((LODBins+7)/8)
+
+// Pulse index: one line per 10ms, points to the first pulse on that line.
 typedef struct sLineInfo {
     unsigned __int8  Info; // [1bit Empty/Data | 1bit FirstHW]
     unsigned __int32 SigOfs;
-} *sLineInfo;
+} sLineInfo;
+
+// Level-of-detail index: one line per 100ms, 1s or 10s, flags which pulse
+// lengths occur on that line. Painting such a line takes at most LODBins
+// pixels, however many pulses it covers.
+typedef struct sLODLine {
+    unsigned __int8 Half[LODBytes]; // Halfwave lengths
+    unsigned __int8 Full[LODBytes]; // Full wave lengths
+} sLODLine;
+
+// Index lines of every zoom level, allocated in chunks which never move,
+// so the window can paint while the loader thread is still adding lines.
+void *LineChunks[ZoomLevels][MaxChunks];
 
-sLineInfo LineInfo;
+// Zoom levels: index lines per screen line, and lines between time marks.
+const __int32    ZoomFactor[ZoomLevels]   = {1, 10, 100, 1000};
+const __int32    LinesPerMark[ZoomLevels] = {100, 100, 60, 60}; // 1s, 10s, 1min, 10min
+__int32          ZoomLevel = 0;
+
+// Loading progress, read by the window while loading.
+volatile __int32 LastLine = -1;  // Last pulse index line filled
+volatile __int32 SigCount = 0;   // Number of pulses in CAPbuf
 
 // Global Variables
 extern BOOL   TerminateThreadsSignal;
@@ -42,10 +68,7 @@ unsigned __int16 *CAPbuf = NULL;
 extern BOOL isDoubleWindowWidth,
             isDoubleWindowHeight,
             isHalfwavesChecked,
-            isFirstHalfwaveDarkGreenChecked,
-            isUse1hBufferChecked,
-            isUse2hBufferChecked,
-            isUse5hBufferChecked;
+            isFirstHalfwaveDarkGreenChecked;
 
 // Visual settings
 extern unsigned __int32 MSperLine;
@@ -76,6 +99,89 @@ void CopyDC(HDC hSourceDC, HDC hTargetDC);
 void PaintRaster(int ScrollPos);
 
 
+// Get index line of a zoom level, allocate its chunk if requested.
+// Returns NULL if the line does not exist (yet).
+static void *GetLine(__int32 Level, unsigned __int32 Line, BOOL Create)
+{
+    unsigned __int32 Chunk = Line/LinesPerChunk;
+    size_t           Size = (Level == 0) ? sizeof(sLineInfo) : sizeof(sLODLine);
+    void             *pChunk;
+
+    if (Chunk >= MaxChunks)
+        return NULL;
+
+    pChunk = LineChunks[Level][Chunk];
+    if ((pChunk == NULL) && Create)
+    {
+        pChunk = calloc(LinesPerChunk, Size);
+        if (pChunk == NULL)
+            return NULL;
+        InterlockedExchangePointer(&LineChunks[Level][Chunk], pChunk);
+    }
+    if (pChunk == NULL)
+        return NULL;
+
+    return (unsigned __int8 *) pChunk + (Line % LinesPerChunk)*Size;
+}
+
+
+// Free index lines of all zoom levels.
+static void FreeLines(void)
+{
+    __int32 Level, Chunk;
+
+    for (Level=0;Level<ZoomLevels;Level++)
+        for (Chunk=0;Chunk<MaxChunks;Chunk++)
+            if (LineChunks[Level][Chunk])
+            {
+                free(LineChunks[Level][Chunk]);
+                LineChunks[Level][Chunk] = NULL;
+            }
+}
+
+
+// Flag pulse length on the level-of-detail lines covering a pulse index line.
+static BOOL MarkLOD(unsigned __int32 Line, unsigned __int32 Len, BOOL Full)
+{
+    __int32  Level;
+    sLODLine *LOD;
+
+    for (Level=1;Level<ZoomLevels;Level++)
+    {
+        LOD = GetLine(Level, Line/ZoomFactor[Level], TRUE);
+        if (LOD == NULL)
+            return FALSE;
+        if (Full)
+            LOD->Full[Len/2/8] |= 1 << (Len/2%8);
+        else
+            LOD->Half[Len/2/8] |= 1 << (Len/2%8);
+    }
+    return TRUE;
+}
+
+
+// Switch zoom level, keep the time shown at top of the window.
+void SetZoomLevel(__int32 Level)
+{
+    si2.cbSize = sizeof(SCROLLINFO);
+    si2.fMask = SIF_POS;
+    GetScrollInfo(hScroll, SB_CTL, &si2);
+    si2.nPos = (__int32) ((__int64) si2.nPos*ZoomFactor[ZoomLevel]/ZoomFactor[Level]);
+
+    ZoomLevel = Level;
+    MSperLine = BaseMSperLine*ZoomFactor[Level];
+
+    siMax = max(0, LastLine/ZoomFactor[Level]);
+    if (si2.nPos > (siMax-PulseBitmapHeight+1)) si2.nPos = siMax-PulseBitmapHeight+1;
+    if (si2.nPos < 0) si2.nPos = 0;
+    si2.fMask = SIF_POS | SIF_RANGE | SIF_PAGE;
+    si2.nMin = 0;
+    si2.nMax = siMax;
+    si2.nPage = PulseBitmapHeight;
+    SetScrollInfo(hScroll, SB_CTL, &si2, TRUE);
+}
+
+
 void UpdateBitmapMetrics(void)
 {
     HBITMAP hBaseBitmap, hBlackBitmap, hBlackHeaderBitmap;
@@ -156,11 +262,11 @@ void PaintVerticalRaster(HDC hRasterDC, HDC hHeaderDC)
 // Updates scrollbar while loading so user can immediately start scrolling pulse visualization.
 DWORD WINAPI LoaderThreadFunction(LPVOID lpParam)
 {
-    __int32          i, iFileSize, NumLines, Counter = 0, NewPos, OldPos = 0, MAX_RANGE = 0;
-    unsigned __int64 ui64Delta, ui64Len, ui64Abs, ui64Rel;
-    unsigned __int32 ui32Len, ui32Line = 0;
+    __int32          iFileSize, Counter = 0, NewPos, OldPos = 0, MAX_RANGE = 0;
+    unsigned __int64 ui64Delta, ui64Len, ui64Abs, ui64Rel, ui64PrevRel = 0;
+    unsigned __int32 ui32Len, ui32Line = 0, l;
     unsigned __int32 Timer_Precision_MHz;
-    unsigned __int32 SigCount = 0;
+    sLineInfo        *LineInfo;
     BOOL             FirstHW = FALSE, DCCopy = FALSE;
 
     // Cleanup
@@ -180,8 +286,11 @@ DWORD WINAPI LoaderThreadFunction(LPVOID lpParam)
     SetWindowText(hStatus, szFile);
 
     // Cleanup
+    LastLine = -1;
+    SigCount = 0;
     if (CAPbuf) free(CAPbuf);
-    if (LineInfo) free(LineInfo);
+    CAPbuf = NULL;
+    FreeLines();
 
     // Get CAP file precision.
     CAP_GetHeader_Precision(hCAP, &Timer_Precision_MHz);
@@ -203,25 +312,6 @@ DWORD WINAPI LoaderThreadFunction(LPVOID lpParam)
     isScrollBarEnabled = TRUE;
     EnableScrollBar(hScroll, SB_CTL, ESB_ENABLE_BOTH);
 
-    // Allocate data buffer for indexing CAP file data.
-    // Each visualized line on screen corresponds to specific timespan (10ms by default).
-    // As we don't know the total time of the CAP file before we finished loading,
-    // we need to rely on the user menu setting.
-    if (isUse1hBufferChecked)
-        NumLines = 360000; // 360000 lines @ 10ms = 1h, x5 = 1.8MB
-    else if (isUse2hBufferChecked)
-        NumLines = 2*360000;
-    else
-        NumLines = 5*360000;
-    LineInfo = malloc(sizeof(struct sLineInfo)*NumLines);
-    if (LineInfo == NULL)
-    {
-        MessageBox(0, "Memory allocation failed (#1).", "Tapview", MB_SYSTEMMODAL | MB_ICONERROR);
-        return FALSE;
-    }
-    for (i=0;i<NumLines;i++)
-        LineInfo[i].Info = 0;
-
     // Allocate data buffer for CAP file data.
     // Only pulse lenghts between ~25us and 1000us are to be shown,
     // hence 2 bytes per pulse are sufficient (instead of 5 bytes).
@@ -268,13 +358,13 @@ DWORD WINAPI LoaderThreadFunction(LPVOID lpParam)
 
             // Calculate line on which to paint pulse.
             // Each line corresponds to specific timespan (10ms by default).
-            ui32Line = (unsigned __int32) ui64Len/1000/MSperLine;
+            ui32Line = (unsigned __int32) (ui64Len/1000/BaseMSperLine);
 
             ui32Len = (unsigned __int32) ui64Rel;
 
             // Prepare immediate visual for user, set flag and copy to hPulseDC if ready to show to user.
-            if (abs(ui32Line) <= PulseBitmapHeight)
-                SetPixel(hBaseDC, ui32Len/HorizontalDivFact, ui32Line, (FirstHW & isFirstHalfwaveDarkGreenChecked) ? 0x00007F00 : 0x0000FF00 );
+            if (ui32Line/ZoomFactor[ZoomLevel] <= (unsigned __int32) PulseBitmapHeight)
+                SetPixel(hBaseDC, ui32Len/HorizontalDivFact, ui32Line/ZoomFactor[ZoomLevel], (FirstHW & isFirstHalfwaveDarkGreenChecked) ? 0x00007F00 : 0x0000FF00 );
             else if (!DCCopy)
             {
                 DCCopy = TRUE;
@@ -284,10 +374,23 @@ DWORD WINAPI LoaderThreadFunction(LPVOID lpParam)
             // Store signal to buffer for later lookup (user navigation through mouse and scrollbar).
             CAPbuf[SigCount] = (unsigned __int16) ui32Len;
 
-            // Check if index buffer is still large enough.
-            if (abs(ui32Line) >= NumLines)
+            // Empty lines passed since the last pulse point to this pulse,
+            // so the pulses of a line always end where the next line starts.
+            for (l=LastLine+1;l<ui32Line;l++)
+            {
+                LineInfo = GetLine(0, l, TRUE);
+                if (LineInfo == NULL)
+                    break;
+                LineInfo->SigOfs = SigCount;
+            }
+
+            // Flag pulse length on the level-of-detail lines, full waves end with the second halfwave.
+            LineInfo = GetLine(0, ui32Line, TRUE);
+            if ((LineInfo == NULL) ||
+                !MarkLOD(ui32Line, ui32Len, FALSE) ||
+                (!FirstHW && (ui64PrevRel+ui64Rel < 1000) && !MarkLOD(ui32Line, (unsigned __int32) (ui64PrevRel+ui64Rel), TRUE)))
             {
-                MessageBox(0, "Buffer full.\nPlease select larger buffer in menu and reload.", "Tapview", MB_SYSTEMMODAL | MB_ICONERROR);
+                MessageBox(0, "Memory allocation failed (#1).", "Tapview", MB_SYSTEMMODAL | MB_ICONERROR);
                 break;
             }
 
@@ -298,16 +401,21 @@ DWORD WINAPI LoaderThreadFunction(LPVOID lpParam)
             // hence only first pulse on each line is indexed.
             // If corresponding visualized line is empty .Info MSB is zero.
             // Second highest .Info bit flags if corresponding pulse is first or second half wave.
-            if (LineInfo[ui32Line].Info == 0)
+            // Empty lines point to the next pulse.
+            if (LineInfo->Info == 0)
             {
-                LineInfo[ui32Line].Info = 0x80 | (FirstHW ? 0x40 : 0);
-                LineInfo[ui32Line].SigOfs = SigCount;
+                LineInfo->Info = 0x80 | (FirstHW ? 0x40 : 0);
+                LineInfo->SigOfs = SigCount;
             }
 
-            // Keep track of number of signals.
+            // Keep track of number of signals, publish line after its pulse.
             SigCount++;
+            LastLine = ui32Line;
         }
 
+        // Keep first halfwave for full wave length.
+        ui64PrevRel = ui64Rel;
+
         // Update ProgressBar and ScrollBar if necessary.
         // iFileSize is divided into iProgressSteps steps (100 steps by default).
         // Update if signal counter passes a step.
@@ -321,7 +429,7 @@ DWORD WINAPI LoaderThreadFunction(LPVOID lpParam)
 
             // Update ScrollBar
             si2.fMask = SIF_RANGE | SIF_PAGE;
-            siMax = max(0, (__int32)(((__int32) 0) + ui32Line));
+            siMax = max(0, LastLine/ZoomFactor[ZoomLevel]);
             si2.nMax = siMax;
             SetScrollInfo(hScroll, SB_CTL, &si2, TRUE);
         }
@@ -341,7 +449,7 @@ DWORD WINAPI LoaderThreadFunction(LPVOID lpParam)
         CopyDC(hBaseDC, hPulseDC);
 
     // Final ScrollBar update.
-    MAX_RANGE = (__int32) (((__int32) 0) + (unsigned __int32) (ui64Abs/Timer_Precision_MHz/1000/MSperLine));
+    MAX_RANGE = (__int32) (LastLine/ZoomFactor[ZoomLevel]);
     si2.fMask = SIF_RANGE | SIF_PAGE;
     siMax = max(0, MAX_RANGE);
     si2.nMax = siMax;
@@ -363,24 +471,29 @@ DWORD WINAPI LoaderThreadFunction(LPVOID lpParam)
 // If corresponding visualized line is empty .Info MSB is zero.
 // Second highest .Info bit flags if corresponding pulse is first or second halfwave.
 // By default first halfwave is painted in dark green, second in light green.
-void PaintPulses(int ScrollPos)
+static void PaintPulseLines(int ScrollPos)
 {
     unsigned __int16 Pulse;
     __int32          Line, i, SigStart, SigEnd;
+    sLineInfo        *LineInfo, *NextLineInfo;
     BOOL             FirstHW;
 
     // Loop through all pulse picture lines.
-    for (Line=0;Line<PulseBitmapHeight;Line++)
+    for (Line=0;(Line<PulseBitmapHeight) && (ScrollPos+Line<=LastLine);Line++)
     {
+        LineInfo = GetLine(0, ScrollPos+Line, FALSE);
+
         // Line has pulses if .Info MSB is one.
-        if (LineInfo[ScrollPos+Line].Info & 0x80)
+        if ((LineInfo != NULL) && (LineInfo->Info & 0x80))
         {
             // All pulses between two indexes are painted onto the same line on screen.
-            SigStart = LineInfo[ScrollPos+Line  ].SigOfs;
-            SigEnd   = LineInfo[ScrollPos+Line+1].SigOfs;
+            // Pulses of the last line loaded end with the pulse buffer.
+            NextLineInfo = (ScrollPos+Line < LastLine) ? GetLine(0, ScrollPos+Line+1, FALSE) : NULL;
+            SigStart = LineInfo->SigOfs;
+            SigEnd   = (NextLineInfo != NULL) ? NextLineInfo->SigOfs : SigCount;
 
             // Second highest .Info bit flags if corresponding pulse is first or second halfwave.
-            FirstHW = (LineInfo[ScrollPos+Line].Info & 0x40) ? TRUE : FALSE;
+            FirstHW = (LineInfo->Info & 0x40) ? TRUE : FALSE;
 
             // Get first half wave if ScrollPos happens to point to a second halfwave.
             if (!FirstHW)
@@ -415,6 +528,46 @@ void PaintPulses(int ScrollPos)
 }
 
 
+// Paint pulse lengths of the level-of-detail lines to hBaseDC, starting at line ScrollPos of current zoom level.
+// Each line flags the lengths found in 2us steps, so at most LODBins pixels are painted per line.
+// First and second halfwaves are not told apart, all are painted in light green.
+static void PaintLODLines(int ScrollPos)
+{
+    __int32         Line, Bin;
+    sLODLine        *LOD;
+    unsigned __int8 *Bits;
+
+    for (Line=0;(Line<PulseBitmapHeight) && ((ScrollPos+Line)*ZoomFactor[ZoomLevel]<=LastLine);Line++)
+    {
+        LOD = GetLine(ZoomLevel, ScrollPos+Line, FALSE);
+        if (LOD == NULL)
+            continue;
+
+        Bits = isHalfwavesChecked ? LOD->Half : LOD->Full;
+        for (Bin=0;Bin<LODBins;Bin++)
+        {
+            if ((Bits[Bin/8] & (1 << (Bin%8))) == 0)
+                continue;
+
+            // HorizontalDivFact is 2 for normal window width, and 1 for double/enlarged window width.
+            SetPixel(hBaseDC, Bin*2/HorizontalDivFact, Line, 0x0000FF00);
+            if (HorizontalDivFact == 1)
+                SetPixel(hBaseDC, Bin*2+1, Line, 0x0000FF00);
+        }
+    }
+}
+
+
+// Paint pulses of current zoom level to hBaseDC.
+void PaintPulses(int ScrollPos)
+{
+    if (ZoomLevel == 0)
+        PaintPulseLines(ScrollPos);
+    else
+        PaintLODLines(ScrollPos);
+}
+
+
 // Creates and starts the CAP file loading thread.
 // CAP file loading thread
 // - loads chosen CAP file data into memory structure and indexes it for fast lookup (user navigation through mouse and scrollbar).
@@ -440,41 +593,30 @@ BOOL StartLoaderThread(void)
 // Spacings depend on chosen window size (PulseBitmapWidth).
 void PaintRaster(int ScrollPos)
 {
-    __int32 Line, j;
-    __int32 hrs = 0, mins = 0, secs = 0;
-    char    timecode[12];
-    __int32 numsecs;
-    RECT    rt = {PulseBitmapWidth-70, 0, PulseBitmapWidth, 0};
-
-    numsecs = ScrollPos*MSperLine/1000;
-    secs = numsecs % 60;
-    hrs  = numsecs/3600;
-    mins = (numsecs - hrs*3600)/60;
+    __int32          Line, j;
+    __int32          hrs = 0, mins = 0, secs = 0;
+    char             timecode[12];
+    unsigned __int32 numsecs;
+    RECT             rt = {PulseBitmapWidth-70, 0, PulseBitmapWidth, 0};
 
-    Line = (1000/MSperLine-1) - (ScrollPos % (1000/MSperLine));
+    // Time marks every LinesPerMark lines (1s at 10ms per line), time is at end of mark line.
+    Line = (LinesPerMark[ZoomLevel]-1) - (ScrollPos % LinesPerMark[ZoomLevel]);
 
     while (Line < PulseBitmapHeight)
     {
         for (j=0;j<PulseBitmapWidth;j++)
             SetPixel(hBaseDC, j, Line, 0x000000FF);
-        secs++;
-        if (secs == 60)
-        {
-            mins++;
-            secs = 0;
-            if (mins == 60)
-            {
-                hrs++;
-                mins = 0;
-            }
-        }
+        numsecs = (unsigned __int32) ((unsigned __int64) (ScrollPos+Line+1)*MSperLine/1000);
+        secs = numsecs % 60;
+        hrs  = numsecs/3600;
+        mins = (numsecs - hrs*3600)/60;
         sprintf(timecode, "%.2u:%.2u:%.2u", hrs, mins, secs);
         rt.top = Line+1;
         rt.bottom = Line+1+16;
         SetTextColor(hBaseDC, 0x00FFFFFF);
         SetBkMode(hBaseDC, TRANSPARENT);
         DrawText(hBaseDC, timecode, 8, &rt, DT_TOP | DT_RIGHT | DT_SINGLELINE);
-        Line += 1000/MSperLine;
+        Line += LinesPerMark[ZoomLevel];
     }
 }
 
@@ -3,7 +3,10 @@
  *  Copyright 2012 Arnd Menge, arnd(at)jonnz(dot)de
 */
 
+#define ZoomLevels 4 // 10ms, 100ms, 1s, 10s per line
+
 void UpdateBitmapMetrics(void);
 BOOL OpenFileDialog(HWND hWnd);
 BOOL StartLoaderThread(void);
 void RepaintPic(int ScrollPos);
+void SetZoomLevel(__int32 Level);
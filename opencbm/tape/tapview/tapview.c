@@ -37,13 +37,12 @@ HDC  hMainDC, hPulseDC, hHeaderDC;
 BOOL isDoubleWindowWidth,
      isDoubleWindowHeight,
      isHalfwavesChecked,
-     isFirstHalfwaveDarkGreenChecked,
-     isUse1hBufferChecked,
-     isUse2hBufferChecked,
-     isUse5hBufferChecked;
+     isFirstHalfwaveDarkGreenChecked;
 
 // Visual settings
-unsigned __int32 MSperLine = 10;
+unsigned __int32     MSperLine = 10;
+extern __int32       ZoomLevel;
+extern const __int32 LinesPerMark[];
 
 // Bitmap metrics
 __int32 PulseBitmapWidth,
@@ -227,7 +226,6 @@ BOOL InitInstance(HINSTANCE hInstance, int nCmdShow)
 //  ReadConfig();
     isDoubleWindowWidth = FALSE; isDoubleWindowHeight = FALSE;
     isHalfwavesChecked = TRUE; isFirstHalfwaveDarkGreenChecked = TRUE;
-    isUse1hBufferChecked = TRUE; isUse2hBufferChecked = FALSE; isUse5hBufferChecked = FALSE;
 
     PulseBitmapWidth  = (isDoubleWindowWidth  ? DoublePulseBitmapWidth  : NormalPulseBitmapWidth);
     PulseBitmapHeight = (isDoubleWindowHeight ? DoublePulseBitmapHeight : NormalPulseBitmapHeight);
@@ -249,9 +247,7 @@ BOOL InitInstance(HINSTANCE hInstance, int nCmdShow)
     CheckMenuItem(GetMenu(hWnd), IDM_DOUBLE_SCREEN_HEIGHT, (isDoubleWindowHeight ? MF_CHECKED : MF_UNCHECKED));
     CheckMenuItem(GetMenu(hWnd), IDM_SHOW_HALFWAVES, (isHalfwavesChecked ? MF_CHECKED : MF_UNCHECKED));
     CheckMenuItem(GetMenu(hWnd), IDM_FIRST_HALFWAVE_IN_DARK_GREEN, (isFirstHalfwaveDarkGreenChecked ? MF_CHECKED : MF_UNCHECKED));
-    CheckMenuItem(GetMenu(hWnd), IDM_USE_1H_BUFFER, (isUse1hBufferChecked ? MF_CHECKED : MF_UNCHECKED));
-    CheckMenuItem(GetMenu(hWnd), IDM_USE_2H_BUFFER, (isUse2hBufferChecked ? MF_CHECKED : MF_UNCHECKED));
-    CheckMenuItem(GetMenu(hWnd), IDM_USE_5H_BUFFER, (isUse5hBufferChecked ? MF_CHECKED : MF_UNCHECKED));
+    CheckMenuRadioItem(GetMenu(hWnd), IDM_ZOOM_10MS, IDM_ZOOM_10S, IDM_ZOOM_10MS+ZoomLevel, MF_BYCOMMAND);
 
     ShowWindow(hWnd, nCmdShow);
     UpdateWindow(hWnd);
@@ -400,32 +396,20 @@ LRESULT CALLBACK WndProc(HWND hWnd, UINT message, WPARAM wParam, LPARAM lParam)
             UpdateWindow(hWnd);
             InvalidateRect(hWnd, NULL, FALSE);
             break;
-        case IDM_USE_1H_BUFFER:
-            isUse1hBufferChecked = TRUE;
-            isUse2hBufferChecked = FALSE;
-            isUse5hBufferChecked = FALSE;
-            CheckMenuItem(GetMenu(hWnd), IDM_USE_1H_BUFFER, MF_CHECKED);
-            CheckMenuItem(GetMenu(hWnd), IDM_USE_2H_BUFFER, MF_UNCHECKED);
-            CheckMenuItem(GetMenu(hWnd), IDM_USE_5H_BUFFER, MF_UNCHECKED);
-            //SaveConfig();
-            break;
-        case IDM_USE_2H_BUFFER:
-            isUse1hBufferChecked = FALSE;
-            isUse2hBufferChecked = TRUE;
-            isUse5hBufferChecked = FALSE;
-            CheckMenuItem(GetMenu(hWnd), IDM_USE_1H_BUFFER, MF_UNCHECKED);
-            CheckMenuItem(GetMenu(hWnd), IDM_USE_2H_BUFFER, MF_CHECKED);
-            CheckMenuItem(GetMenu(hWnd), IDM_USE_5H_BUFFER, MF_UNCHECKED);
-            //SaveConfig();
-            break;
-        case IDM_USE_5H_BUFFER:
-            isUse1hBufferChecked = FALSE;
-            isUse2hBufferChecked = FALSE;
-            isUse5hBufferChecked = TRUE;
-            CheckMenuItem(GetMenu(hWnd), IDM_USE_1H_BUFFER, MF_UNCHECKED);
-            CheckMenuItem(GetMenu(hWnd), IDM_USE_2H_BUFFER, MF_UNCHECKED);
-            CheckMenuItem(GetMenu(hWnd), IDM_USE_5H_BUFFER, MF_CHECKED);
+        case IDM_ZOOM_10MS:
+        case IDM_ZOOM_100MS:
+        case IDM_ZOOM_1S:
+        case IDM_ZOOM_10S:
+            CheckMenuRadioItem(GetMenu(hWnd), IDM_ZOOM_10MS, IDM_ZOOM_10S, wmId, MF_BYCOMMAND);
+            SetZoomLevel(wmId-IDM_ZOOM_10MS);
             //SaveConfig();
+            if (isCAPloaded)
+            {
+                GetScrollInfo(hScroll, SB_CTL, &si);
+                RepaintPic(si.nPos);
+            }
+            UpdateWindow(hWnd);
+            InvalidateRect(hWnd, NULL, FALSE);
             break;
         case IDM_ABOUT:
             DialogBox(hInst, MAKEINTRESOURCE(IDD_ABOUTBOX), hWnd, About);
@@ -462,7 +446,7 @@ LRESULT CALLBACK WndProc(HWND hWnd, UINT message, WPARAM wParam, LPARAM lParam)
         if (!isScrollBarEnabled)
             return DefWindowProc(hWnd, message, wParam, lParam);
         wParam = MAKEWPARAM( ((short)HIWORD(wParam)<0) ? SB_LINEDOWN : SB_LINEUP, HIWORD(wParam));
-        iScrollDelta = 1000/MSperLine;
+        iScrollDelta = LinesPerMark[ZoomLevel];
     case WM_VSCROLL:
         si.fMask = SIF_ALL;
         GetScrollInfo(hScroll, SB_CTL, &si);
@@ -28,28 +28,68 @@ BOOL             StartDelayActivated = FALSE,
 unsigned __int32 StartDelay = 0, // Write start delay (replaces first timestamp)
                  StopDelay = 0;  // Motor stop delay after last signal edge was written
 
+// Minimum signal lengths in image file resolution
+unsigned __int64 ShortWarning, ShortError;
+
+// Block index: list the blocks, or write only some of them
+BOOL             ListBlocks = FALSE,
+                 BlockRangeActivated = FALSE;
+unsigned __int32 FirstBlock = 1, LastBlock = 0, // Blocks to write, counted from 1
+                 MinPause = 100;                // Minimum pause between two blocks in ms
+
+// Size of each of the two write buffers
+#define WRITE_CHUNK_SIZE (64*1024)
+
+// Double buffering: the fill thread converts the image file into one
+// buffer while the other one is being written to tape.
+typedef struct
+{
+    HANDLE           hCAP;
+    __int32          iCaptureLen;      // Number of bytes to be sent, including length header
+    unsigned __int32 uiFirstSignal;    // First signal of the image data to be sent
+    unsigned __int32 uiNumSignals;     // Number of signals to be sent
+    unsigned __int8  *pucBuffer[2];
+    __int32          iLength[2];       // Bytes in filled buffer, 0 = end of data, -1 = error
+    HANDLE           hFree[2];         // Buffer may be filled
+    HANDLE           hFilled[2];       // Buffer may be sent
+    HANDLE           hThread;
+    __int32          iFill, iPos;      // Buffer being filled and fill position
+    __int32          iSend;            // Buffer being sent
+    BOOL             bSending;
+    volatile BOOL    bStop, bError;
+} WriteStream;
+
+void StopWriteStream(WriteStream *pStream);
+
 
 void usage(void)
 {
-    printf("Usage: tapwrite [-aX] [-bY] [-bz] <filename.cap>\n");
+    printf("Usage: tapwrite [-aX] [-bY] [-bz] [-sM[-N]] [-pZ] <filename.cap>\n");
+    printf("       tapwrite -l [-pZ] <filename.cap>\n");
     printf("\n");
     printf("  -aX: wait X seconds before writing first signal (optional)\n");
     printf("  -bY: keep on record Y seconds after last signal (optional)\n");
     printf("  -bz: keep on record max time after last signal (optional)\n");
+    printf("  -sM[-N]: write only blocks M to N, or from M on (optional)\n");
+    printf("  -pZ: a pause of Z ms or more starts a new block (optional, default 100)\n");
+    printf("  -l: list the blocks of the image file\n");
     printf("\n");
     printf("Examples:\n");
     printf("  tapwrite myfile.cap\n");
     printf("  tapwrite -a15 myfile.cap\n");
     printf("  tapwrite -a15 -b30 myfile.cap\n");
     printf("  tapwrite -a15 -bz myfile.cap\n");
+    printf("  tapwrite -l myfile.cap\n");
+    printf("  tapwrite -a5 -s3-4 myfile.cap\n");
 }
 
 
 __int32 EvaluateCommandlineParams(__int32 argc, __int8 *argv[], __int8 filename[_MAX_PATH])
 {
     unsigned __int8 bStartDelay = 0, bStopDelay = 0, bMaxStopDelay = 0;
+    __int8          *pcEnd;
 
-    if ((argc < 2) || (4 < argc))
+    if ((argc < 2) || (7 < argc))
     {
         printf("Error: invalid number of commandline parameters.\n\n");
         return -1;
@@ -76,6 +116,32 @@ __int32 EvaluateCommandlineParams(__int32 argc, __int8 *argv[], __int8 filename[
             if (StopDelay > 0) StopDelayActivated = TRUE;
             bStopDelay++;
         }
+        else if ((*argv)[1] == 's')
+        {
+            FirstBlock = strtoul(&(argv[0][2]), &pcEnd, 10);
+            LastBlock = 0;
+            if (*pcEnd == '-')
+                LastBlock = strtoul(pcEnd + 1, &pcEnd, 10);
+            if ((*pcEnd != 0) || (FirstBlock == 0) || ((LastBlock != 0) && (LastBlock < FirstBlock)))
+            {
+                printf("\nError: invalid block range.\n\n");
+                return -1;
+            }
+            BlockRangeActivated = TRUE;
+        }
+        else if ((*argv)[1] == 'p')
+        {
+            MinPause = atoi(&(argv[0][2]));
+            if (MinPause == 0)
+            {
+                printf("\nError: invalid minimum pause.\n\n");
+                return -1;
+            }
+        }
+        else if (strcmp(*argv,"-l") == 0)
+        {
+            ListBlocks = TRUE;
+        }
         else
         {
             printf("\nError: invalid commandline parameter.\n\n");
@@ -90,7 +156,7 @@ __int32 EvaluateCommandlineParams(__int32 argc, __int8 *argv[], __int8 filename[
     else if (bStartDelay == 1)
     {
         if (StartDelay == 0)
-            printf("* Start delay: minimum / 100us\n", StartDelay);
+            printf("* Start delay: minimum / 100us\n");
         else if (StartDelay == 1)
             printf("* Start delay: %u second\n", StartDelay);
         else
@@ -127,6 +193,14 @@ __int32 EvaluateCommandlineParams(__int32 argc, __int8 *argv[], __int8 filename[
             printf("* Stop delay: %u seconds\n", StopDelay);
     }
 
+    if (BlockRangeActivated == TRUE)
+    {
+        if (LastBlock == 0)
+            printf("* Blocks: %u to last\n", FirstBlock);
+        else
+            printf("* Blocks: %u to %u\n", FirstBlock, LastBlock);
+    }
+
     if (strlen(argv[0]) >= _MAX_PATH)
     {
         printf("\nError: Filename too long.\n\n");
@@ -141,58 +215,159 @@ __int32 EvaluateCommandlineParams(__int32 argc, __int8 *argv[], __int8 filename[
 }
 
 
-__int32 AllocateImageBuffer(HANDLE hCAP, void **ppucTapeBuffer, __int32 *piTapeBufferSize)
+// Print tape length to console.
+void OutputTapeLength(unsigned __int32 uiTotalTapeTimeSeconds)
+{
+    unsigned __int32 hours, mins, secs;
+
+    hours = (uiTotalTapeTimeSeconds/3600);
+    printf("Tape recording time: %uh", hours);
+    mins = ((uiTotalTapeTimeSeconds - hours*3600)/60);
+    printf(" %um", mins);
+    secs = ((uiTotalTapeTimeSeconds - hours*3600) - mins*60);
+    printf(" %us\n\n", secs);
+}
+
+
+// Read the next signal of the image file, converted to 16MHz hardware resolution.
+// The first one is replaced by the start delay if requested, too short ones by the minimum length.
+__int32 ReadTapeSignal(HANDLE hCAP, BOOL *pbFirstSignal, unsigned __int64 *pui64Delta, BOOL bWarn)
 {
     __int32 FuncRes;
 
-    // Return file size of image file (moves file pointer).
-    FuncRes = CAP_GetFileSize(hCAP, piTapeBufferSize);
+    FuncRes = CAP_ReadSignal(hCAP, pui64Delta, NULL);
     if (FuncRes != CAP_Status_OK)
+        return FuncRes;
+
+    if (*pbFirstSignal)
     {
-        CAP_OutputError(FuncRes);
-        return -1;
+        // Replace first timestamp with start delay if requested
+        if (StartDelayActivated == TRUE)
+        {
+            if (StartDelay == 0)
+                *pui64Delta = 1600; // 100us minimum
+            else
+            {
+                *pui64Delta = StartDelay;
+                *pui64Delta *= 15625; //16000000;
+                *pui64Delta <<= 10;
+            }
+        }
+        *pbFirstSignal = FALSE;
     }
+    else
+        if (CAP_Precision == 1) *pui64Delta <<= 4; // Convert from 1MHz to 16MHz.
 
-    if (*piTapeBufferSize < 0)
+    if (bWarn && (*pui64Delta < ShortWarning)) printf("Warning - Short signal length detected: 0x%.10" PRI64X "\n", *pui64Delta);
+    if (*pui64Delta < ShortError)
     {
-        printf("Error: Illegal tape image buffer size.\n");
-        return -1;
+        if (bWarn) printf("Warning - Replaced by minimum signal length.\n");
+        *pui64Delta = ShortError;
     }
 
-    // Allocate memory for tape image.
-    *ppucTapeBuffer = malloc(*piTapeBufferSize);
-    if (*ppucTapeBuffer == NULL)
+    return CAP_Status_OK;
+}
+
+
+// Final timestamp for stop delay.
+unsigned __int64 GetStopDelaySignal(void)
+{
+    unsigned __int64 ui64Delta;
+
+    if (StopDelay == 0xffffffff)
+        ui64Delta = 0xffffffffff;
+    else
     {
-        printf("Error: Could not allocate memory for capture data.\n");
-        return -1;
+        ui64Delta = StopDelay;
+        ui64Delta *= 15625;
+        ui64Delta <<= 10; //16000000;
     }
 
-    // Initialize memory for tape image.
-    memset(*ppucTapeBuffer, 0x00, *piTapeBufferSize);
+    return ui64Delta;
+}
 
-    return 0;
+
+// Convert timestamp to the 2 or 5 bytes sent to the hardware, return their number.
+__int32 EncodeTapeSignal(unsigned __int64 ui64Delta, unsigned __int8 *pucData)
+{
+    if (ui64Delta < 0x8000)
+    {
+        // Short signal (<2ms)
+        pucData[0] = (unsigned __int8) ((ui64Delta >>  8) & 0xff);
+        pucData[1] = (unsigned __int8) (ui64Delta & 0xff);
+        return 2;
+    }
+
+    // Long signal (>=2ms)
+    pucData[0] = (unsigned __int8) (((ui64Delta >> 32) & 0x7f) | 0x80); // MSB must be 1.
+    pucData[1] = (unsigned __int8)  ((ui64Delta >> 24) & 0xff);
+    pucData[2] = (unsigned __int8)  ((ui64Delta >> 16) & 0xff);
+    pucData[3] = (unsigned __int8)  ((ui64Delta >>  8) & 0xff);
+    pucData[4] = (unsigned __int8)  (ui64Delta & 0xff);
+    return 5;
 }
 
 
-// Print tape length to console.
-void OutputTapeLength(unsigned __int32 uiTotalTapeTimeSeconds)
+// Convert a time in image file resolution to seconds.
+static double Seconds(unsigned __int64 ui64Time)
 {
-    unsigned __int32 hours, mins, secs;
+    return (double) ui64Time / (CAP_Precision * 1000000.0);
+}
 
-    hours = (uiTotalTapeTimeSeconds/3600);
-    printf("Tape recording time: %uh", hours);
-    mins = ((uiTotalTapeTimeSeconds - hours*3600)/60);
-    printf(" %um", mins);
-    secs = ((uiTotalTapeTimeSeconds - hours*3600) - mins*60);
-    printf(" %us\n\n", secs);
+
+// Print the block index to console.
+void OutputBlockIndex(const CAP_Block *pBlocks, unsigned __int32 uiNumBlocks)
+{
+    unsigned __int32 i;
+
+    printf("Block     Start     Pause    Length   Signals\n");
+    for (i = 0; i < uiNumBlocks; i++)
+        printf("%5u  %7.2fs  %7.2fs  %7.2fs  %8u\n", i + 1, Seconds(pBlocks[i].ui64Start),
+               Seconds(pBlocks[i].ui64Pause), Seconds(pBlocks[i].ui64Length), pBlocks[i].uiNumSignals);
+    printf("\n");
+}
+
+
+// Find the signals of the blocks to be written, list the blocks if requested.
+__int32 SelectBlocks(HANDLE hCAP, unsigned __int32 *puiFirstSignal, unsigned __int32 *puiNumSignals)
+{
+    CAP_Block        *pBlocks;
+    unsigned __int32 uiNumBlocks, uiLast;
+    __int32          FuncRes;
+
+    FuncRes = CAP_BuildBlockIndex(hCAP, (unsigned __int64) MinPause * 1000 * CAP_Precision, &pBlocks, &uiNumBlocks);
+    if (FuncRes != CAP_Status_OK)
+    {
+        CAP_OutputError(FuncRes);
+        return -1;
+    }
+
+    if (ListBlocks == TRUE)
+        OutputBlockIndex(pBlocks, uiNumBlocks);
+
+    uiLast = ((LastBlock == 0) || (LastBlock > uiNumBlocks)) ? uiNumBlocks : LastBlock;
+    if (FirstBlock > uiLast)
+    {
+        printf("Error: The image file has only %u block(s).\n", uiNumBlocks);
+        free(pBlocks);
+        return -1;
+    }
+
+    *puiFirstSignal = pBlocks[FirstBlock-1].uiFirstSignal;
+    *puiNumSignals = pBlocks[uiLast-1].uiFirstSignal + pBlocks[uiLast-1].uiNumSignals - *puiFirstSignal;
+
+    free(pBlocks);
+    return 0;
 }
 
 
-// Read tape image into memory.
-__int32 ReadCaptureFile(HANDLE hCAP, unsigned __int8 *pucTapeBuffer, __int32 *piCaptureLen)
+// Read image header and check all signals of the image file, return number of bytes to be sent.
+// Only the signals of the blocks selected are sent.
+__int32 ScanCaptureFile(HANDLE hCAP, __int32 *piCaptureLen, unsigned __int32 *puiFirstSignal, unsigned __int32 *puiNumSignals)
 {
-    unsigned __int64 ui64Delta = 0, ShortWarning, ShortError, MinLength, ui64TotalTapeTime = 0;
-    unsigned __int32 uiTotalTapeTimeSeconds;
+    unsigned __int64 ui64Delta = 0, ui64TotalTapeTime = 0;
+    unsigned __int32 uiTotalTapeTimeSeconds, uiLeft;
+    unsigned __int8  ucData[5];
     __int32          FuncRes;
     BOOL             FirstSignal = TRUE;
 
@@ -223,55 +398,32 @@ __int32 ReadCaptureFile(HANDLE hCAP, unsigned __int8 *pucTapeBuffer, __int32 *pi
         ShortError = 60;   // 60us
     }
 
-    // Keep space for leading number of deltas.
-    *piCaptureLen = 5;
+    // The whole image, unless only some blocks are written.
+    *puiFirstSignal = 0;
+    *puiNumSignals = 0xffffffff;
+    if ((BlockRangeActivated == TRUE) || (ListBlocks == TRUE))
+    {
+        if (SelectBlocks(hCAP, puiFirstSignal, puiNumSignals) == -1)
+            return -1;
+        if (ListBlocks == TRUE)
+            return 0;
+    }
 
-    // Read timestamps, convert to 16MHz hardware resolution if necessary.
-    while ((FuncRes = CAP_ReadSignal(hCAP, &ui64Delta, NULL)) == CAP_Status_OK)
+    FuncRes = CAP_SeekSignal(hCAP, *puiFirstSignal);
+    if (FuncRes != CAP_Status_OK)
     {
-        if (FirstSignal)
-        {
-            // Replace first timestamp with start delay if requested
-            if (StartDelayActivated == TRUE)
-            {
-                if (StartDelay == 0)
-                    ui64Delta = 1600; // 100us minimum
-                else
-                {
-                    ui64Delta = StartDelay;
-                    ui64Delta *= 15625; //16000000;
-                    ui64Delta <<= 10;
-                }
-            }
-            FirstSignal = FALSE;
-        }
-        else
-            if (CAP_Precision == 1) ui64Delta <<= 4; // Convert from 1MHz to 16MHz.
+        CAP_OutputError(FuncRes);
+        return -1;
+    }
 
-        if (ui64Delta < ShortWarning) printf("Warning - Short signal length detected: 0x%.10X\n", ui64Delta);
-        if (ui64Delta < ShortError)
-        {
-            printf("Warning - Replaced by minimum signal length.\n");
-            ui64Delta = ShortError;
-        }
+    // Keep space for leading number of deltas.
+    *piCaptureLen = 5;
 
+    uiLeft = *puiNumSignals;
+    while ((uiLeft-- > 0) && ((FuncRes = ReadTapeSignal(hCAP, &FirstSignal, &ui64Delta, TRUE)) == CAP_Status_OK))
+    {
         ui64TotalTapeTime += ui64Delta;
-
-        if (ui64Delta < 0x8000)
-        {
-            // Short signal (<2ms)
-            (*piCaptureLen) += 2;
-        }
-        else
-        {
-            // Long signal (>=2ms)
-            (*piCaptureLen) += 5;
-            pucTapeBuffer[*piCaptureLen-5] = (unsigned __int8) (((ui64Delta >> 32) & 0x7f) | 0x80); // MSB must be 1.
-            pucTapeBuffer[*piCaptureLen-4] = (unsigned __int8)  ((ui64Delta >> 24) & 0xff);
-            pucTapeBuffer[*piCaptureLen-3] = (unsigned __int8)  ((ui64Delta >> 16) & 0xff);
-        }
-        pucTapeBuffer[*piCaptureLen-2] = (unsigned __int8) ((ui64Delta >>  8) & 0xff);
-        pucTapeBuffer[*piCaptureLen-1] = (unsigned __int8) (ui64Delta & 0xff);
+        (*piCaptureLen) += EncodeTapeSignal(ui64Delta, ucData);
     }
 
     if (FuncRes == CAP_Status_Error_Reading_data)
@@ -280,44 +432,13 @@ __int32 ReadCaptureFile(HANDLE hCAP, unsigned __int8 *pucTapeBuffer, __int32 *pi
         return -1;
     }
 
-    // Add final timestamp for stop delay
     if (StopDelayActivated == TRUE)
     {
-        if (StopDelay == 0xffffffff)
-            ui64Delta = 0xffffffffff;
-        else
-        {
-            ui64Delta = StopDelay;
-            ui64Delta *= 15625;
-            ui64Delta <<= 10; //16000000;
-        }
-
+        ui64Delta = GetStopDelaySignal();
         ui64TotalTapeTime += ui64Delta;
-
-        if (ui64Delta < 0x8000)
-        {
-            // Short signal (<2ms)
-            (*piCaptureLen) += 2;
-        }
-        else
-        {
-            // Long signal (>=2ms)
-            (*piCaptureLen) += 5;
-            pucTapeBuffer[*piCaptureLen-5] = (unsigned __int8) (((ui64Delta >> 32) & 0x7f) | 0x80); // MSB must be 1.
-            pucTapeBuffer[*piCaptureLen-4] = (unsigned __int8)  ((ui64Delta >> 24) & 0xff);
-            pucTapeBuffer[*piCaptureLen-3] = (unsigned __int8)  ((ui64Delta >> 16) & 0xff);
-        }
-        pucTapeBuffer[*piCaptureLen-2] = (unsigned __int8) ((ui64Delta >>  8) & 0xff);
-        pucTapeBuffer[*piCaptureLen-1] = (unsigned __int8) (ui64Delta & 0xff);
+        (*piCaptureLen) += EncodeTapeSignal(ui64Delta, ucData);
     }
 
-    // Send number of delta bytes first.
-    pucTapeBuffer[0] = 0x80;
-    pucTapeBuffer[1] = ((*piCaptureLen-5) >> 24) & 0xff;
-    pucTapeBuffer[2] = ((*piCaptureLen-5) >> 16) & 0xff;
-    pucTapeBuffer[3] = ((*piCaptureLen-5) >>  8) & 0xff;
-    pucTapeBuffer[4] =  (*piCaptureLen-5) & 0xff;
-
     // Calculate tape recording length.
     uiTotalTapeTimeSeconds = (unsigned __int32) ((ui64TotalTapeTime >> 10)/15625); //16000000;
     OutputTapeLength(uiTotalTapeTimeSeconds);
@@ -326,7 +447,182 @@ __int32 ReadCaptureFile(HANDLE hCAP, unsigned __int8 *pucTapeBuffer, __int32 *pi
 }
 
 
-__int32 WriteTape(CBM_FILE fd, unsigned __int8 *pucTapeBuffer, unsigned __int32 uiCaptureLen)
+// Hand the filled buffer to the tape write, wait until the other one has been sent.
+static __int32 NextFillBuffer(WriteStream *pStream)
+{
+    pStream->iLength[pStream->iFill] = pStream->iPos;
+    SetEvent(pStream->hFilled[pStream->iFill]);
+
+    pStream->iFill ^= 1;
+    pStream->iPos = 0;
+    WaitForSingleObject(pStream->hFree[pStream->iFill], INFINITE);
+
+    return pStream->bStop ? -1 : 0;
+}
+
+
+// Append bytes to the buffer being filled.
+static __int32 PutBytes(WriteStream *pStream, const unsigned __int8 *pucData, __int32 iLen)
+{
+    __int32 n;
+
+    while (iLen > 0)
+    {
+        if ((pStream->iPos == WRITE_CHUNK_SIZE) && (NextFillBuffer(pStream) == -1))
+            return -1;
+
+        n = WRITE_CHUNK_SIZE - pStream->iPos;
+        if (n > iLen) n = iLen;
+        memcpy(pStream->pucBuffer[pStream->iFill] + pStream->iPos, pucData, n);
+        pStream->iPos += n;
+        pucData += n;
+        iLen -= n;
+    }
+
+    return 0;
+}
+
+
+// Fill thread: converts the image file into one buffer while the other one is being sent.
+static DWORD WINAPI FillThread(LPVOID lpParam)
+{
+    WriteStream      *pStream = (WriteStream *) lpParam;
+    unsigned __int64 ui64Delta;
+    unsigned __int8  ucData[5];
+    unsigned __int32 uiLeft = pStream->uiNumSignals;
+    __int32          FuncRes = CAP_Status_OK;
+    BOOL             FirstSignal = TRUE;
+
+    WaitForSingleObject(pStream->hFree[0], INFINITE);
+    if (pStream->bStop)
+        return 0;
+
+    // Send number of delta bytes first.
+    ucData[0] = 0x80;
+    ucData[1] = ((pStream->iCaptureLen-5) >> 24) & 0xff;
+    ucData[2] = ((pStream->iCaptureLen-5) >> 16) & 0xff;
+    ucData[3] = ((pStream->iCaptureLen-5) >>  8) & 0xff;
+    ucData[4] =  (pStream->iCaptureLen-5) & 0xff;
+    if (PutBytes(pStream, ucData, 5) == -1)
+        return 0;
+
+    // Seek back to the first signal to be sent.
+    if (CAP_SeekSignal(pStream->hCAP, pStream->uiFirstSignal) != CAP_Status_OK)
+        FuncRes = CAP_Status_Error_Reading_data;
+
+    while ((FuncRes == CAP_Status_OK) && (uiLeft-- > 0) && ((FuncRes = ReadTapeSignal(pStream->hCAP, &FirstSignal, &ui64Delta, FALSE)) == CAP_Status_OK))
+    {
+        if (PutBytes(pStream, ucData, EncodeTapeSignal(ui64Delta, ucData)) == -1)
+            return 0;
+    }
+
+    if (FuncRes == CAP_Status_Error_Reading_data)
+    {
+        printf("\nError: Could not read image file while writing.\n");
+        pStream->bError = TRUE;
+    }
+    else if (StopDelayActivated == TRUE)
+    {
+        if (PutBytes(pStream, ucData, EncodeTapeSignal(GetStopDelaySignal(), ucData)) == -1)
+            return 0;
+    }
+
+    // Hand over the last data, then mark the end (or the error).
+    if ((pStream->iPos > 0) && (NextFillBuffer(pStream) == -1))
+        return 0;
+    pStream->iPos = pStream->bError ? -1 : 0;
+    pStream->iLength[pStream->iFill] = pStream->iPos;
+    SetEvent(pStream->hFilled[pStream->iFill]);
+
+    return 0;
+}
+
+
+// Tape write callback: release the chunk just sent, return the next one.
+static int CBMAPIDECL NextChunk(void *Context, const unsigned char **Buffer)
+{
+    WriteStream *pStream = (WriteStream *) Context;
+
+    if (pStream->bSending)
+    {
+        SetEvent(pStream->hFree[pStream->iSend]);
+        pStream->iSend ^= 1;
+    }
+    pStream->bSending = TRUE;
+
+    if (AbortTapeOps)
+        return -1;
+
+    WaitForSingleObject(pStream->hFilled[pStream->iSend], INFINITE);
+    *Buffer = pStream->pucBuffer[pStream->iSend];
+    return pStream->iLength[pStream->iSend];
+}
+
+
+// Allocate both buffers and start the fill thread.
+__int32 StartWriteStream(WriteStream *pStream, HANDLE hCAP, __int32 iCaptureLen, unsigned __int32 uiFirstSignal, unsigned __int32 uiNumSignals)
+{
+    __int32 i;
+
+    memset(pStream, 0, sizeof(WriteStream));
+    pStream->hCAP = hCAP;
+    pStream->iCaptureLen = iCaptureLen;
+    pStream->uiFirstSignal = uiFirstSignal;
+    pStream->uiNumSignals = uiNumSignals;
+
+    for (i = 0; i < 2; i++)
+    {
+        pStream->pucBuffer[i] = malloc(WRITE_CHUNK_SIZE);
+        pStream->hFree[i] = CreateEvent(NULL, FALSE, TRUE, NULL);
+        pStream->hFilled[i] = CreateEvent(NULL, FALSE, FALSE, NULL);
+        if ((pStream->pucBuffer[i] == NULL) || (pStream->hFree[i] == NULL) || (pStream->hFilled[i] == NULL))
+        {
+            printf("Error: Could not allocate write buffers.\n");
+            StopWriteStream(pStream);
+            return -1;
+        }
+    }
+
+    pStream->hThread = CreateThread(NULL, 0, FillThread, pStream, 0, NULL);
+    if (pStream->hThread == NULL)
+    {
+        printf("Error: Could not start fill thread.\n");
+        StopWriteStream(pStream);
+        return -1;
+    }
+
+    return 0;
+}
+
+
+// End the fill thread, free both buffers.
+void StopWriteStream(WriteStream *pStream)
+{
+    __int32 i;
+
+    pStream->bStop = TRUE;
+
+    if (pStream->hThread != NULL)
+    {
+        SetEvent(pStream->hFree[0]);
+        SetEvent(pStream->hFree[1]);
+        WaitForSingleObject(pStream->hThread, INFINITE);
+        CloseHandle(pStream->hThread);
+        pStream->hThread = NULL;
+    }
+
+    for (i = 0; i < 2; i++)
+    {
+        if (pStream->hFree[i] != NULL) CloseHandle(pStream->hFree[i]);
+        if (pStream->hFilled[i] != NULL) CloseHandle(pStream->hFilled[i]);
+        if (pStream->pucBuffer[i] != NULL) free(pStream->pucBuffer[i]);
+        pStream->hFree[i] = pStream->hFilled[i] = NULL;
+        pStream->pucBuffer[i] = NULL;
+    }
+}
+
+
+__int32 WriteTape(CBM_FILE fd, WriteStream *pStream)
 {
     __int32         Status, BytesRead, BytesWritten, FuncRes;
     unsigned __int8 WriteConfig, WriteConfig2;
@@ -575,7 +871,7 @@ __int32 WriteTape(CBM_FILE fd, unsigned __int8 *pucTapeBuffer, unsigned __int32
     //   - XUM1541_Error_NoTapeSupport
     //   - XUM1541_Error_NoDiskTapeMode
     //   - XUM1541_Error_TapeCmdInDiskMode
-    FuncRes = cbm_tap_start_write(fd, pucTapeBuffer, uiCaptureLen, &Status, &BytesWritten);
+    FuncRes = cbm_tap_write(fd, NextChunk, pStream, &Status, &BytesWritten);
     if (FuncRes < 0)
     {
         printf("\nReturned error [write]: ");
@@ -590,7 +886,9 @@ __int32 WriteTape(CBM_FILE fd, unsigned __int8 *pucTapeBuffer, unsigned __int32
             printf("%d\n", Status);
         return -1;
     }
-    if (uiCaptureLen != BytesWritten)
+    if (pStream->bError)
+        return -1;
+    if (pStream->iCaptureLen != BytesWritten)
     {
         printf("\nError [write]: Short write.\n");
         return -1;
@@ -639,9 +937,10 @@ BOOL BreakHandler(DWORD fdwCtrlType)
 int ARCH_MAINDECL main(int argc, char *argv[])
 {
     HANDLE          hCAP;
-    unsigned __int8 *pucTapeBuffer = NULL;
+    WriteStream     Stream;
     __int8          filename[_MAX_PATH];
-    __int32         iCaptureLen = 0, iTapeBufferSize;
+    __int32         iCaptureLen = 0;
+    unsigned __int32 uiFirstSignal, uiNumSignals;
     __int32         FuncRes, RetVal = -1;
 
     printf("\ntapwrite v1.00 - Commodore 1530/1531 tape mastering software\n");
@@ -667,20 +966,20 @@ int ARCH_MAINDECL main(int argc, char *argv[])
         goto exit;
     }
 
-    // Allocate memory for tape image.
-    if (AllocateImageBuffer(hCAP, &pucTapeBuffer, &iTapeBufferSize) == -1)
+    // Check image file, get number of bytes to be sent.
+    if (ScanCaptureFile(hCAP, &iCaptureLen, &uiFirstSignal, &uiNumSignals) == -1)
     {
         CAP_CloseFile(&hCAP);
         goto exit;
     }
 
-    // Read tape image into memory.
-    RetVal = ReadCaptureFile(hCAP, pucTapeBuffer, &iCaptureLen);
-
-    CAP_CloseFile(&hCAP);
-
-    if (RetVal == -1)
+    // Only the block index was requested.
+    if (ListBlocks == TRUE)
+    {
+        CAP_CloseFile(&hCAP);
+        RetVal = 0;
         goto exit;
+    }
 
     EnterCriticalSection(&CritSec_fd); // Acquire handle flag access.
 
@@ -688,13 +987,21 @@ int ARCH_MAINDECL main(int argc, char *argv[])
     {
         printf("Driver error.\n");
         LeaveCriticalSection(&CritSec_fd);
+        CAP_CloseFile(&hCAP);
         goto exit;
     }
 
     fd_Initialized = TRUE;
     LeaveCriticalSection(&CritSec_fd); // Release handle flag access.
 
-    RetVal = WriteTape(fd, pucTapeBuffer, iCaptureLen);
+    // Start converting the image file into the write buffers.
+    if (StartWriteStream(&Stream, hCAP, iCaptureLen, uiFirstSignal, uiNumSignals) == 0)
+    {
+        RetVal = WriteTape(fd, &Stream);
+        StopWriteStream(&Stream);
+    }
+
+    CAP_CloseFile(&hCAP);
 
     EnterCriticalSection(&CritSec_fd); // Acquire handle flag access.
     cbm_driver_close(fd);
@@ -704,7 +1011,6 @@ int ARCH_MAINDECL main(int argc, char *argv[])
     exit:
     DeleteCriticalSection(&CritSec_fd);
     DeleteCriticalSection(&CritSec_BreakHandler);
-    if (pucTapeBuffer != NULL) free(pucTapeBuffer);
     printf("\n");
     return RetVal;
 }
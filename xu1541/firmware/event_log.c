@@ -8,20 +8,27 @@
  */
 
 #include <string.h>  // for memset
+#include <avr/io.h>
 #include "xu1541_event_log.h"
 
 #ifdef ENABLE_EVENT_LOG
 
 static unsigned char log[EVENT_LOG_LEN];
+static unsigned short log_time[EVENT_LOG_LEN];
 static unsigned char cur;
 
 void event_log_init(void) {
   memset(log, EVENT_NONE, EVENT_LOG_LEN);
   cur = 0;
+
+  /* timer 1 is free running as time base, prescaler 1024 */
+  TCCR1A = 0;
+  TCCR1B = _BV(CS12) | _BV(CS10);
 }
 
 /* just store in buffer and wrap if necessary */
 void event_log_add(unsigned char event) {
+  log_time[cur] = TCNT1;
   log[cur++] = event;
 
   if(cur == EVENT_LOG_LEN)
@@ -33,4 +40,9 @@ unsigned char event_log_get(unsigned char index) {
   return log[(cur+index) % EVENT_LOG_LEN];
 }
 
+/* get the timestamp of a log entry */
+unsigned short event_log_get_time(unsigned char index) {
+  return log_time[(cur+index) % EVENT_LOG_LEN];
+}
+
 #endif
@@ -86,7 +86,13 @@ uchar   usbFunctionSetup(uchar data[8], byte_t *replyBuf) {
     DEBUGF("get ev\n");
     replyBuf[0] = EVENT_LOG_LEN;
     replyBuf[1] = event_log_get(len);
-    return 2;
+    /* old hosts only ask for the first two bytes */
+    {
+      unsigned short t = event_log_get_time(len);
+      replyBuf[2] = t & 0xff;
+      replyBuf[3] = t >> 8;
+    }
+    return 4;
 #endif
 
     /* ----- Basic I/O ----- */
@@ -469,6 +475,11 @@ int     main(void) {
 
 void init(void)
 {
+#ifdef ENABLE_EVENT_LOG
+  event_log_init();
+  EVENT(EVENT_START);
+#endif
+
   cbm_init();
 
   LED_OFF();
@@ -393,9 +393,11 @@ void xu1541_handle(void) {
   if(io_request == XU1541_IO_ASYNC) {
     DEBUGF("h-as\n");
     LED_ON();
+    EVENT(EVENT_IO_ASYNC);
     /* write async cmd byte(s) used for (un)talk/(un)listen, open and close */
     io_result = !cbm_raw_write(io_buffer+2, io_buffer_fill,
                                io_buffer[0], io_buffer[1]);
+    EVENT(EVENT_IO_DONE);
     LED_OFF();
 
     io_request = XU1541_IO_RESULT;
@@ -404,7 +406,9 @@ void xu1541_handle(void) {
   if(io_request == XU1541_IO_WRITE) {
     DEBUGF("h-wr %d\n", io_buffer_fill);
     LED_ON();
+    EVENT(EVENT_IO_WRITE);
     io_result = cbm_raw_write(io_buffer, io_buffer_fill, 0, 0);
+    EVENT(EVENT_IO_DONE);
     LED_OFF();
 
     io_request = XU1541_IO_RESULT;
@@ -420,6 +424,7 @@ void xu1541_handle(void) {
     io_offset = 0;
 
     LED_ON();
+    EVENT(EVENT_IO_READ);
 
     do {
       to = 0;
@@ -445,6 +450,7 @@ void xu1541_handle(void) {
 
       if (eoi) {
           /* re-enable interrupts and return */
+          EVENT(EVENT_IO_DONE);
           io_request = XU1541_IO_READ_DONE;
           io_buffer_fill = received;
           LED_OFF();
@@ -514,6 +520,7 @@ void xu1541_handle(void) {
     }
 
     /* re-enable interrupts and return */
+    EVENT(EVENT_IO_DONE);
     io_request = XU1541_IO_READ_DONE;
     io_buffer_fill = received;
 
@@ -11,7 +11,12 @@
 
 #ifdef ENABLE_EVENT_LOG
 
-#define EVENT_LOG_LEN  64
+/* each entry takes 3 bytes of RAM: the event and its 16 bit timestamp */
+#define EVENT_LOG_LEN  48
+
+/* the timestamps count in units of 1024 CPU cycles (85.3 us at 12 MHz)
+   and wrap around after 65536 of them (5.6 s) */
+#define EVENT_LOG_TICK_CYCLES  1024
 
 /* all events that can be generated by the xu1541 */
 #define EVENT_NONE                    0
@@ -29,9 +34,16 @@
 #define EVENT_READ_ERROR             12
 #define EVENT_TIMEOUT_IEC_WAIT       13
 
+/* start and end of the queued IEC transfers, for timing traces */
+#define EVENT_IO_ASYNC               14
+#define EVENT_IO_WRITE               15
+#define EVENT_IO_READ                16
+#define EVENT_IO_DONE                17
+
 void event_log_init(void);
 void event_log_add(unsigned char event);
 unsigned char event_log_get(unsigned char index);
+unsigned short event_log_get_time(unsigned char index);
 
 #define EVENT(a) event_log_add(a)
 #else
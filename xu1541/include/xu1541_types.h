@@ -89,4 +89,10 @@
 #define XU1541_W4L_TIMEOUT        20  /* seconds, max. 60 possible here */
 #define XU1541_IO_BUFFER_SIZE    128
 
+/* max size of one S1/S2/PP/P2 control transfer. These are streamed by
+   usbFunctionRead()/usbFunctionWrite() instead of going through the io
+   buffer. The USB driver only takes the low byte of wLength for IN
+   transfers, and 0xff is reserved there. Keep it even for PP. */
+#define XU1541_SPECIAL_XFER_SIZE 254
+
 #endif /* XU1541_TYPES_H */
@@ -21,8 +21,10 @@ libusb_device_handle *handle = NULL;
 
 void dump_event_log(void) {
 
-  int nBytes, i, log_len;
-  unsigned char ret[2];
+  int nBytes, i, log_len, have_time;
+  unsigned char ret[4];
+  unsigned int now, last = 0;
+  int first = 1;
 
   nBytes = libusb_control_transfer(handle,
            LIBUSB_REQUEST_TYPE_VENDOR | LIBUSB_RECIPIENT_DEVICE | LIBUSB_ENDPOINT_IN,
@@ -31,11 +33,13 @@ void dump_event_log(void) {
   if(nBytes < 0) {
     fprintf(stderr, "USB request failed: %s!\n", libusb_error_name(nBytes));
     return;
-  } else if(nBytes != sizeof(ret)) {
+  } else if(nBytes != 2 && nBytes != sizeof(ret)) {
     fprintf(stderr, "Unexpected number of bytes (%d) returned\n", nBytes);
     return;
   }
 
+  /* newer firmware adds a timestamp to each event */
+  have_time = (nBytes == sizeof(ret));
   log_len = ret[0];
 
   printf("Event log buffer size: %d\n", log_len);
@@ -49,15 +53,24 @@ void dump_event_log(void) {
     if(nBytes < 0) {
       fprintf(stderr, "USB request failed: %s!\n", libusb_error_name(nBytes));
       return;
-    } else if(nBytes != sizeof(ret)) {
+    } else if(nBytes < 2) {
       fprintf(stderr, "Unexpected number of bytes (%d) returned\n", nBytes);
       return;
     }
 
-    switch(ret[1]) {
-    case EVENT_NONE:      /* ignore unused entries */
-      break;
+    if(ret[1] == EVENT_NONE)  /* ignore unused entries */
+      continue;
+
+    /* time since the previous event (the xu1541 runs at 12 MHz) */
+    if(have_time) {
+      now = ret[2] | (ret[3] << 8);
+      printf("%+10.2f ms", first ? 0.0 :
+             (double)((now - last) & 0xffff) * EVENT_LOG_TICK_CYCLES / 12000.0);
+      last = now;
+    }
+    first = 0;
 
+    switch(ret[1]) {
     case EVENT_START:
       printf("  system started\n");
       break;
@@ -110,6 +123,22 @@ void dump_event_log(void) {
       printf("  timeout in iec wait\n");
       break;
 
+    case EVENT_IO_ASYNC:
+      printf("  start of async command write\n");
+      break;
+
+    case EVENT_IO_WRITE:
+      printf("  start of write\n");
+      break;
+
+    case EVENT_IO_READ:
+      printf("  start of read\n");
+      break;
+
+    case EVENT_IO_DONE:
+      printf("  transfer done\n");
+      break;
+
     default:
       printf("  Unknown event!\n");
       break;
@@ -75,12 +75,6 @@ board_init_iec(void)
   PAR_PORT1_PORT &= ~PAR_PORT1_MASK;
 }
 
-uint8_t
-iec_poll_pins(void)
-{
-    return IEC_PIN & (IO_DATA | IO_CLK | IO_ATN | IO_SRQ | IO_RESET);
-}
-
 /*
  * Callback for when the timer fires.
  * Update LEDs or do other tasks that should be done about every ~100 ms
@@ -82,16 +82,6 @@ board_init_iec(void)
   PAR_PORT1_PORT &= ~PAR_PORT1_MASK;
 }
 
-uint8_t
-iec_poll_pins(void)
-{
-    return ((PIND & IO_SRQ_IN) << 1) |
-           ((PINB & IO_CLK_IN)  << 2) |
-           ((PINC & IO_DATA_IN) >> 4) |
-           ((PINE & IO_ATN_IN)  >> 2) |
-           ((PIND & IO_RESET_IN) >> 1);
-}
-
 /*
  * Callback for when the timer fires.
  * Update LEDs or do other tasks that should be done about every ~100 ms.
@@ -69,12 +69,6 @@ board_init_iec(void)
 	PAR_PORT_PORT = 0;
 }
 
-uint8_t
-iec_poll_pins(void)
-{
-    return PINF & (IO_DATA | IO_CLK | IO_ATN | IO_SRQ | IO_RESET);
-}
-
 /*
  * Callback for when the timer fires.
  * Update LEDs or do other tasks that should be done about every ~100 ms
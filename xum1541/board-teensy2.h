@@ -151,8 +151,15 @@ iec_srq_write(uint8_t data)
     }
 }
 
-// Since this is called with a runtime-specified mask, inlining doesn't help.
-uint8_t iec_poll_pins(void);
+/*
+ * Inline as well: the polling loops need no call then, and the timed
+ * samples (e.g. of JiffyDOS) are taken right when their delay ends.
+ */
+INLINE uint8_t
+iec_poll_pins(void)
+{
+    return PINF & (IO_DATA | IO_CLK | IO_ATN | IO_SRQ | IO_RESET);
+}
 
 // Status indicators (LEDs)
 void board_update_display(uint8_t status);
@@ -69,16 +69,6 @@ board_init_iec(void)
     PAR_PORT_DDR = 0;
 }
 
-uint8_t
-iec_poll_pins(void)
-{
-    return ((PIND & IO_SRQ_IN)  >> 1) |
-           ((PIND & IO_CLK_IN)  >> 1) |
-           ((PIND & IO_DATA_IN) << 1) |
-           ((PINC & IO_ATN_IN)  << 1) |
-           ((PINC & IO_RESET_IN) >> 1);
-}
-
 /*
  * Callback for when the timer fires.
  * Update LEDs or do other tasks that should be done about every ~100 ms.
@@ -248,8 +248,19 @@ iec_srq_write(uint8_t data)
     }
 }
 
-// Since this is called with a runtime-specified mask, inlining doesn't help.
-uint8_t iec_poll_pins(void);
+/*
+ * Inline as well: the polling loops need no call then, and the timed
+ * samples (e.g. of JiffyDOS) are taken right when their delay ends.
+ */
+INLINE uint8_t
+iec_poll_pins(void)
+{
+    return ((PIND & IO_SRQ_IN)  >> 1) |
+           ((PIND & IO_CLK_IN)  >> 1) |
+           ((PIND & IO_DATA_IN) << 1) |
+           ((PINC & IO_ATN_IN)  << 1) |
+           ((PINC & IO_RESET_IN) >> 1);
+}
 
 // Status indicators (LEDs)
 void board_update_display(uint8_t status);
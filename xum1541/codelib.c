@@ -0,0 +1,69 @@
+/*
+ * Drive code library kept in the flash of the device
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version
+ * 2 of the License, or (at your option) any later version.
+ */
+#include <avr/pgmspace.h>
+
+#include "xum1541.h"
+
+#ifdef XUM1541_CODELIB
+
+/*
+ * The drive code is built into the firmware: the Makefile generates
+ * codelib-data.h from the .inc files of the opencbm drive code listed in
+ * CODELIB. The flash cannot be written while the firmware runs, so the
+ * library is fixed for a firmware image. For XUM1541_CODEUPLOAD, the host
+ * names the code it wants to upload by its length and CRC-32, so only
+ * these are sent over USB instead of the code itself.
+ */
+struct CodeLibEntry {
+    const uint8_t *data;
+    uint16_t len;
+};
+
+#include "codelib-data.h"
+
+#define CODELIB_ENTRIES (sizeof(codeLib) / sizeof(codeLib[0]))
+
+// CRC-32 with the reversed polynomial 0xedb88320, as used by zip
+static uint32_t
+codelibCrc(const uint8_t *data, uint16_t len)
+{
+    uint32_t crc = 0xffffffff;
+    uint8_t bit;
+
+    while (len-- != 0) {
+        crc ^= pgm_read_byte(data++);
+        for (bit = 0; bit < 8; bit++)
+            crc = (crc >> 1) ^ ((crc & 1) ? 0xedb88320 : 0);
+    }
+    return ~crc;
+}
+
+/*
+ * Find the drive code with this length and CRC-32. Returns its address in
+ * the flash, or NULL if it is not in the library. The CRC of an entry is
+ * only computed if the length matches, which takes about 1 ms per 150
+ * bytes at 16 MHz.
+ */
+const uint8_t *
+codelib_find(uint16_t len, uint32_t crc)
+{
+    const uint8_t *data;
+    uint8_t i;
+
+    for (i = 0; i < CODELIB_ENTRIES; i++) {
+        if (pgm_read_word(&codeLib[i].len) != len)
+            continue;
+        data = (const uint8_t *)pgm_read_word(&codeLib[i].data);
+        if (codelibCrc(data, len) == crc)
+            return data;
+    }
+    return NULL;
+}
+
+#endif // XUM1541_CODELIB
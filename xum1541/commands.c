@@ -23,6 +23,10 @@ typedef void (*Write2Fn_t)(uint8_t *data);
 static uint16_t usbDataLen;
 static uint8_t usbDataDir = XUM_DATA_DIR_NONE;
 
+// Bytes handed out by usbRecvByte() before the host data, see usbInjectData()
+static const uint8_t *usbInjectPtr;
+static uint8_t usbInjectLen;
+
 // Are we in the middle of a command sequence (XUM1541_INIT .. SHUTDOWN)?
 #define XUM1541_CMD_IN_PROGRESS 0x80
 static uint8_t cmdSeqInProgress;
@@ -30,6 +34,9 @@ static uint8_t cmdSeqInProgress;
 // Current device state for the XUM1541_INIT response
 static uint8_t currState;
 
+// Number of failed writes that were run with XUM_WRITE_DEFER
+static uint8_t deferredFailures;
+
 // Nibtools command state. See nib_parburst_read/write_checked()
 static bool suppressNibCmd;
 static uint8_t savedNibWrites[4], *savedNibWritePtr;
@@ -100,14 +107,25 @@ usbInitIo(uint16_t len, uint8_t dir)
     usbDataLen = len;
     usbDataDir = dir;
 
+    // Injected bytes are part of len, but do not come from the host
+    if (dir == ENDPOINT_DIR_OUT) {
+        usbDataLen -= usbInjectLen;
+
+        // Nothing to wait for if the host does not send anything
+        if (usbDataLen == 0)
+            return;
+    }
+
     /*
      * Wait until endpoint is ready before continuing. It is critical
      * that we do this so that the transfer routines have somewhat
      * minimal latency when accessing the endpoint buffers. Otherwise,
      * timing could be violated.
      */
+    profile_wait_begin();
     while (!Endpoint_IsReadWriteAllowed())
         ;
+    profile_wait_end();
 }
 
 void
@@ -144,6 +162,21 @@ usbIoDone(void)
     }
     usbDataDir = XUM_DATA_DIR_NONE;
     usbDataLen = 0;
+    usbInjectLen = 0;
+}
+
+/*
+ * Let the next transfer from the host start with len bytes from data
+ * instead. This allows firmware commands to run the protocol write
+ * handlers (CBM_PROTO(raw_write)()) on data built by the firmware itself,
+ * for example the "M-W" command header in front of the host's data.
+ * The injected bytes count towards the length given to usbInitIo().
+ */
+void
+usbInjectData(const uint8_t *data, uint8_t len)
+{
+    usbInjectPtr = data;
+    usbInjectLen = len;
 }
 
 int8_t
@@ -164,8 +197,7 @@ usbSendByte(uint8_t data)
     // If the endpoint is now full, flush the block to the host
     if (!Endpoint_IsReadWriteAllowed()) {
         Endpoint_ClearIN();
-        while (!Endpoint_IsReadWriteAllowed() && !doDeviceReset)
-            ;
+        usbWaitEndpoint();
     }
 
     // Check if the current command is being aborted by the host
@@ -188,6 +220,13 @@ usbRecvByte(uint8_t *data)
     }
 #endif
 
+    // Hand out the bytes from usbInjectData() first
+    if (usbInjectLen != 0) {
+        *data = *usbInjectPtr++;
+        usbInjectLen--;
+        return 0;
+    }
+
     /*
      * Check if the endpoint is currently empty.
      * If so, clear the endpoint bank to get more data from host and
@@ -195,8 +234,7 @@ usbRecvByte(uint8_t *data)
      */
     if (!Endpoint_IsReadWriteAllowed()) {
         Endpoint_ClearOUT();
-        while (!Endpoint_IsReadWriteAllowed() && !doDeviceReset)
-            ;
+        usbWaitEndpoint();
     }
 
     // Check if the current command is being aborted by the host
@@ -212,47 +250,257 @@ usbRecvByte(uint8_t *data)
     return 0;
 }
 
+/*
+ * Send a block of data to the host. Each endpoint bank is filled with a
+ * tight loop and the endpoint state is only checked once the bank is
+ * full, instead of after every byte like usbSendByte() does.
+ */
+int8_t
+usbSendBlock(const uint8_t *data, uint16_t len)
+{
+    uint8_t room;
+
+#ifdef DEBUG
+    if (usbDataDir != ENDPOINT_DIR_IN) {
+        DEBUGF(DBG_ERROR, "ERR: usbSendBlock when dir was %d\n", usbDataDir);
+        return -1;
+    }
+#endif
+
+    while (len != 0) {
+        room = XUM_ENDPOINT_BULK_SIZE - (uint8_t)Endpoint_BytesInEndpoint();
+        if (room > len)
+            room = len;
+        len -= room;
+        usbDataLen -= room;
+        while (room-- != 0)
+            Endpoint_Write_Byte(*data++);
+
+        // If the endpoint is now full, flush the block to the host
+        if (!Endpoint_IsReadWriteAllowed()) {
+            Endpoint_ClearIN();
+            usbWaitEndpoint();
+        }
+
+        // Check if the current command is being aborted by the host
+        if (doDeviceReset) {
+            DEBUGF(DBG_ERROR, "sndrst\n");
+            return -1;
+        }
+    }
+
+    return 0;
+}
+
+/*
+ * Receive a block of data from the host, copying each endpoint bank
+ * out with a tight loop. This is the counterpart of usbSendBlock().
+ */
+int8_t
+usbRecvBlock(uint8_t *data, uint16_t len)
+{
+    uint8_t avail;
+
+#ifdef DEBUG
+    if (usbDataDir != ENDPOINT_DIR_OUT) {
+        DEBUGF(DBG_ERROR, "ERR: usbRecvBlock when dir was %d\n", usbDataDir);
+        return -1;
+    }
+#endif
+
+    while (len != 0) {
+        // If the endpoint is empty, get the next bank from the host
+        if (!Endpoint_IsReadWriteAllowed()) {
+            Endpoint_ClearOUT();
+            usbWaitEndpoint();
+        }
+
+        // Check if the current command is being aborted by the host
+        if (doDeviceReset) {
+            DEBUGF(DBG_ERROR, "rcvrst\n");
+            return -1;
+        }
+
+        avail = (uint8_t)Endpoint_BytesInEndpoint();
+        if (avail > len)
+            avail = len;
+        len -= avail;
+        usbDataLen -= avail;
+        while (avail-- != 0)
+            *data++ = Endpoint_Read_Byte();
+    }
+
+    return 0;
+}
+
+/*
+ * Ring buffer between the drive and the IN endpoint for the generic read
+ * loops. The drive is read whenever there is room in the ring, and the
+ * ring is drained into the endpoint whenever a bank is free. Thus, the
+ * drive does not have to wait while the host is slow to pick up a full
+ * bank, as long as the ring does not fill up.
+ */
+static uint8_t ringBuf[XUM_RINGBUF_SIZE];
+static uint8_t ringHead, ringTail;
+static uint16_t ringUsed;
+
+#define RING_NEXT(idx)  (uint8_t)(((idx) + 1) & (XUM_RINGBUF_SIZE - 1))
+
+/*
+ * Move as much of the ring as fits into the IN endpoint without blocking.
+ * Returns -1 if the host aborted the transfer.
+ */
+static int8_t
+ringDrain(void)
+{
+    uint8_t room;
+
+    while (ringUsed != 0 && Endpoint_IsReadWriteAllowed()) {
+        room = XUM_ENDPOINT_BULK_SIZE - (uint8_t)Endpoint_BytesInEndpoint();
+        if (room > ringUsed)
+            room = ringUsed;
+        ringUsed -= room;
+        usbDataLen -= room;
+        while (room-- != 0) {
+            Endpoint_Write_Byte(ringBuf[ringTail]);
+            ringTail = RING_NEXT(ringTail);
+        }
+
+        // Hand a full bank to the host, but do not wait for the next one
+        if (!Endpoint_IsReadWriteAllowed())
+            Endpoint_ClearIN();
+    }
+
+    if (doDeviceReset) {
+        DEBUGF(DBG_ERROR, "sndrst\n");
+        return -1;
+    }
+    return 0;
+}
+
+static inline void
+ringPut(uint8_t data)
+{
+    ringBuf[ringHead] = data;
+    ringHead = RING_NEXT(ringHead);
+    ringUsed++;
+}
+
+/*
+ * GCR decoding for XUM_READ_GCR. The read loops collect 5 GCR bytes and
+ * put the 4 decoded bytes into the ring, so the host gets (and the USB
+ * carries) only the decoded data.
+ */
+static const uint8_t gcrDecodeTab[32] = {
+    0xf, 0xf, 0xf, 0xf, 0xf, 0xf, 0xf, 0xf, 0xf, 0x8, 0x0, 0x1, 0xf, 0xc, 0x4, 0x5,
+    0xf, 0xf, 0x2, 0x3, 0xf, 0xf, 0x6, 0x7, 0xf, 0x9, 0xa, 0xb, 0xf, 0xd, 0xe, 0xf,
+};
+static uint8_t gcrIn[5], gcrCount;
+
+#define GCR_NIBBLES(hi, lo) \
+    (uint8_t)((gcrDecodeTab[(hi) & 0x1f] << 4) | gcrDecodeTab[(lo) & 0x1f])
+
+static void
+gcrPut(uint8_t data)
+{
+    uint8_t *g = gcrIn;
+
+    g[gcrCount++] = data;
+    if (gcrCount != sizeof(gcrIn))
+        return;
+    gcrCount = 0;
+
+    // 8 quintets in 40 bits: 00000111 11222223 33334444 45555566 66677777
+    ringPut(GCR_NIBBLES(g[0] >> 3, (g[0] << 2) | (g[1] >> 6)));
+    ringPut(GCR_NIBBLES(g[1] >> 1, (g[1] << 4) | (g[2] >> 4)));
+    ringPut(GCR_NIBBLES((g[2] << 1) | (g[3] >> 7), g[3] >> 2));
+    ringPut(GCR_NIBBLES((g[3] << 3) | (g[4] >> 5), g[4]));
+}
+
+// Number of bytes the host gets for len bytes from the drive
+static uint16_t
+ioReadSize(uint16_t len, bool gcr)
+{
+    return gcr ? (len / 5) * 4 : len;
+}
+
 static uint8_t
-ioReadLoop(ReadFn_t readFn, uint16_t len)
+ioReadLoop(ReadFn_t readFn, uint16_t len, bool gcr)
 {
     uint8_t data;
 
-    usbInitIo(len, ENDPOINT_DIR_IN);
-    while (len-- != 0) {
-        data = readFn();
-        if (usbSendByte(data) != 0)
+    usbInitIo(ioReadSize(len, gcr), ENDPOINT_DIR_IN);
+    ringHead = ringTail = 0;
+    ringUsed = gcrCount = 0;
+    while (len != 0) {
+        // Leave room for the 4 bytes a GCR group decodes to
+        if (ringUsed <= XUM_RINGBUF_SIZE - 4) {
+            data = readFn();
+            if (gcr)
+                gcrPut(data);
+            else
+                ringPut(data);
+            len--;
+        }
+        if (ringDrain() != 0)
             break;
     }
+
+    // Send whatever is still in the ring
+    while (ringUsed != 0 && ringDrain() == 0)
+        ;
     usbIoDone();
     return 0;
 }
 
 static uint8_t
-ioWriteLoop(WriteFn_t writeFn, uint16_t len)
+ioRead2Loop(Read2Fn_t readFn, uint16_t len, bool gcr)
 {
-    uint8_t data;
+    uint8_t data[2];
 
-    usbInitIo(len, ENDPOINT_DIR_OUT);
-    while (len-- != 0) {
-        if (usbRecvByte(&data) != 0)
+    usbInitIo(ioReadSize(len, gcr), ENDPOINT_DIR_IN);
+    ringHead = ringTail = 0;
+    ringUsed = gcrCount = 0;
+    while (len != 0) {
+        if (ringUsed <= XUM_RINGBUF_SIZE - 8) {
+            readFn(data);
+            if (gcr) {
+                gcrPut(data[0]);
+                gcrPut(data[1]);
+            } else {
+                ringPut(data[0]);
+                ringPut(data[1]);
+            }
+            len -= 2;
+        }
+        if (ringDrain() != 0)
             break;
-        writeFn(data);
     }
+
+    // Send whatever is still in the ring
+    while (ringUsed != 0 && ringDrain() == 0)
+        ;
     usbIoDone();
     return 0;
 }
 
+/*
+ * The generic write loops fetch up to one endpoint bank of data with
+ * usbRecvBlock() and then write it to the drive byte by byte.
+ */
 static uint8_t
-ioRead2Loop(Read2Fn_t readFn, uint16_t len)
+ioWriteLoop(WriteFn_t writeFn, uint16_t len)
 {
-    uint8_t data[2];
+    uint8_t buf[XUM_ENDPOINT_BULK_SIZE], i, n;
 
-    usbInitIo(len, ENDPOINT_DIR_IN);
+    usbInitIo(len, ENDPOINT_DIR_OUT);
     while (len != 0) {
-        readFn(data);
-        if (usbSendByte(data[0]) != 0 || usbSendByte(data[1]) != 0)
+        n = len > sizeof(buf) ? sizeof(buf) : len;
+        if (usbRecvBlock(buf, n) != 0)
             break;
-        len -= 2;
+        for (i = 0; i < n; i++)
+            writeFn(buf[i]);
+        len -= n;
     }
     usbIoDone();
     return 0;
@@ -261,14 +509,16 @@ ioRead2Loop(Read2Fn_t readFn, uint16_t len)
 static uint8_t
 ioWrite2Loop(Write2Fn_t writeFn, uint16_t len)
 {
-    uint8_t data[2];
+    uint8_t buf[XUM_ENDPOINT_BULK_SIZE], i, n;
 
     usbInitIo(len, ENDPOINT_DIR_OUT);
     while (len != 0) {
-        if (usbRecvByte(&data[0]) != 0 || usbRecvByte(&data[1]) != 0)
+        n = len > sizeof(buf) ? sizeof(buf) : len;
+        if (usbRecvBlock(buf, n) != 0)
             break;
-        writeFn(data);
-        len -= 2;
+        for (i = 0; i < n; i += 2)
+            writeFn(&buf[i]);
+        len -= n;
     }
     usbIoDone();
     return 0;
@@ -552,6 +802,250 @@ nib_check_write(uint8_t data)
     return true;
 }
 
+// Count a failed write that was run with XUM_WRITE_DEFER
+static void
+deferredFailure(void)
+{
+    if (deferredFailures != 0xff)
+        deferredFailures++;
+}
+
+/*
+ * Run the entries of a XUM1541_BATCH command, see xum1541_types.h for
+ * the format. Returns 0 if all entries succeeded, else the number of the
+ * first one that failed.
+ */
+static uint16_t
+ioBatchLoop(uint16_t len)
+{
+    uint8_t entry[XUM_CMDBUF_SIZE], i, flags;
+    uint16_t entryLen, done, count, failed;
+
+    count = failed = 0;
+    while (len >= XUM_CMDBUF_SIZE && !doDeviceReset) {
+        // Fetch the next command block from the data phase
+        usbInitIo(XUM_CMDBUF_SIZE, ENDPOINT_DIR_OUT);
+        i = usbRecvBlock(entry, XUM_CMDBUF_SIZE);
+        usbIoDone();
+        if (i != 0)
+            return count + 1;
+
+        len -= XUM_CMDBUF_SIZE;
+        count++;
+        entryLen = *(uint16_t *)&entry[2];
+        flags = XUM_RW_FLAGS(entry[1]) & ~XUM_WRITE_DEFER;
+
+        if (XUM_RW_PROTO(entry[1]) != XUM1541_CBM ||
+            (entry[0] != XUM1541_READ && entry[0] != XUM1541_WRITE) ||
+            (entry[0] == XUM1541_WRITE && entryLen > len)) {
+            DEBUGF(DBG_ERROR, "batch: bad entry %d\n", count);
+            if (failed == 0)
+                failed = count;
+            break;
+        }
+
+        if (entry[0] == XUM1541_WRITE) {
+            len -= entryLen;
+            if (failed != 0 && (flags & XUM_WRITE_ATN) == 0) {
+                // Skip the data, but keep the closing unlisten/untalk
+                if (entryLen != 0) {
+                    usbInitIo(entryLen, ENDPOINT_DIR_OUT);
+                    usbIoDone();
+                }
+                continue;
+            }
+            done = CBM_PROTO(raw_write)(entryLen, flags);
+            if (done != entryLen && failed == 0)
+                failed = count;
+        } else {
+            // The host does not wait for empty reads
+            if (entryLen == 0)
+                continue;
+            if (failed != 0) {
+                // The host waits for this transfer, end it with no data
+                usbInitIo(entryLen, ENDPOINT_DIR_IN);
+                usbIoDone();
+                continue;
+            }
+            done = CBM_PROTO(raw_read)(entryLen);
+            // A short read (EOI) is fine, getting nothing at all is not
+            if (done == 0 && entryLen != 0)
+                failed = count;
+        }
+    }
+
+    // Discard whatever is left of a malformed list
+    if (len != 0) {
+        usbInitIo(len, ENDPOINT_DIR_OUT);
+        usbIoDone();
+    }
+
+    return failed;
+}
+
+/*
+ * Helpers for XUM1541_MEMWRITE and XUM1541_MEMREAD, see xum1541_types.h.
+ * They send IEC/IEEE bytes built by the firmware through the regular
+ * write handler, by injecting them in front of the host data (if any).
+ */
+static bool
+memSendAtn(uint8_t cmd, uint8_t sa, uint8_t flags)
+{
+    uint8_t buf[2], len;
+
+    buf[0] = cmd;
+    buf[1] = sa;
+    len = (sa != 0) ? 2 : 1;
+    usbInjectData(buf, len);
+    return CBM_PROTO(raw_write)(len, XUM_WRITE_ATN | flags) == len;
+}
+
+/*
+ * Send a DOS memory command ("M-W" or "M-R") to the command channel of
+ * the device. For "M-W", dataLen bytes of host data follow the header.
+ * They are always consumed, even if the command fails. If flashData is
+ * given instead, the count bytes of the "M-W" are taken from the flash.
+ */
+static bool
+memSendCommand(uint8_t device, uint8_t op, uint16_t addr, uint8_t count,
+    uint8_t dataLen, const uint8_t *flashData)
+{
+    uint8_t hdr[6 + XUM_MEM_WRITE_CHUNK], hdrLen;
+    bool ok;
+
+    if (!memSendAtn(0x20 | device, 0x6f, 0)) {
+        if (dataLen != 0) {
+            usbInitIo(dataLen, ENDPOINT_DIR_OUT);
+            usbIoDone();
+        }
+        return false;
+    }
+
+    hdr[0] = 'M';
+    hdr[1] = '-';
+    hdr[2] = op;
+    hdr[3] = addr & 0xff;
+    hdr[4] = addr >> 8;
+    hdr[5] = count;
+    hdrLen = 6;
+    if (flashData != NULL) {
+        memcpy_P(hdr + hdrLen, flashData, count);
+        hdrLen += count;
+    }
+    usbInjectData(hdr, hdrLen);
+    ok = CBM_PROTO(raw_write)(hdrLen + dataLen, 0) == hdrLen + dataLen;
+
+    // Always unlisten so the bus is left in a sane state
+    memSendAtn(0x3f, 0, 0);
+    return ok;
+}
+
+/*
+ * Write len bytes from the host to the memory of a drive. The data phase
+ * starts with the 16-bit drive address. Returns the number of bytes that
+ * were written.
+ */
+static uint16_t
+ioMemWrite(uint8_t device, uint16_t len)
+{
+    uint8_t addr[2], n;
+    uint16_t done, consumed, mem;
+    int8_t ok;
+
+    usbInitIo(2, ENDPOINT_DIR_OUT);
+    ok = usbRecvBlock(addr, 2);
+    usbIoDone();
+    if (ok != 0)
+        return 0;
+    mem = *(uint16_t *)addr;
+
+    done = consumed = 0;
+    while (consumed < len && !doDeviceReset) {
+        n = (len - consumed > XUM_MEM_WRITE_CHUNK) ?
+            XUM_MEM_WRITE_CHUNK : len - consumed;
+        consumed += n;
+        if (!memSendCommand(device, 'W', mem + done, n, n, NULL))
+            break;
+        done += n;
+    }
+
+    // Discard the data we did not get to
+    if (consumed != len) {
+        usbInitIo(len - consumed, ENDPOINT_DIR_OUT);
+        usbIoDone();
+    }
+    return done;
+}
+
+/*
+ * Read len bytes from the memory of a drive with a single "M-R" command
+ * and send them to the host. The 16-bit drive address is sent by the
+ * host before. The drives cannot cross a page with "M-R", so neither
+ * can this. Returns the number of bytes that were read.
+ */
+static uint16_t
+ioMemRead(uint8_t device, uint16_t len)
+{
+    uint8_t addr[2];
+    uint16_t got;
+    int8_t ok;
+
+    usbInitIo(2, ENDPOINT_DIR_OUT);
+    ok = usbRecvBlock(addr, 2);
+    usbIoDone();
+
+    got = 0;
+    if (ok == 0 && len != 0 && addr[0] + len <= XUM_MEM_READ_CHUNK &&
+        memSendCommand(device, 'R', *(uint16_t *)addr, len & 0xff, 0, NULL) &&
+        memSendAtn(0x40 | device, 0x6f, XUM_WRITE_TALK)) {
+        got = CBM_PROTO(raw_read)(len);
+        memSendAtn(0x5f, 0, 0);
+        return got;
+    }
+
+    // End the transfer the host is waiting for
+    usbInitIo(len, ENDPOINT_DIR_IN);
+    usbIoDone();
+    return got;
+}
+
+#ifdef XUM1541_CODELIB
+/*
+ * Write drive code from the flash to the memory of a drive, see
+ * XUM1541_CODEUPLOAD. Returns the number of bytes that were written,
+ * 0 if the code is not in the library.
+ */
+static uint16_t
+ioCodeUpload(uint8_t device, uint16_t len)
+{
+    uint8_t req[XUM_CODEUPLOAD_SIZE], n;
+    const uint8_t *code;
+    uint16_t done, mem;
+    int8_t ok;
+
+    usbInitIo(sizeof(req), ENDPOINT_DIR_OUT);
+    ok = usbRecvBlock(req, sizeof(req));
+    usbIoDone();
+    if (ok != 0)
+        return 0;
+    mem = *(uint16_t *)req;
+
+    code = codelib_find(len, *(uint32_t *)(req + 2));
+    if (code == NULL)
+        return 0;
+
+    done = 0;
+    while (done < len && !doDeviceReset) {
+        n = (len - done > XUM_MEM_WRITE_CHUNK) ?
+            XUM_MEM_WRITE_CHUNK : len - done;
+        if (!memSendCommand(device, 'W', mem + done, n, 0, code + done))
+            break;
+        done += n;
+    }
+    return done;
+}
+#endif
+
 /*
  * Delay a little (required), shutdown USB, disable watchdog and interrupts,
  * and jump to the bootloader.
@@ -589,10 +1083,10 @@ static const char libcVersion[] PROGMEM = __AVR_LIBC_VERSION_STRING__;
  * delayed execution) and it may not take additional input from the host
  * (data direction set as host to device).
  *
- * The replyBuf is 8 bytes long.
+ * The value is the wValue of the request, the replyBuf is 8 bytes long.
  */
 int8_t
-usbHandleControl(uint8_t cmd, uint8_t *replyBuf)
+usbHandleControl(uint8_t cmd, uint16_t value, uint8_t *replyBuf)
 {
     DEBUGF(DBG_INFO, "cmd %d (%d)\n", cmd, cmd - XUM1541_IOCTL);
 
@@ -605,6 +1099,7 @@ usbHandleControl(uint8_t cmd, uint8_t *replyBuf)
         return 1;
     case XUM1541_INIT:
         savedNibWritePtr = savedNibWrites;
+        deferredFailures = 0;
         set_status(STATUS_ACTIVE);
 
         // First time: init IO pins and probe for IEC or IEEE devices
@@ -614,20 +1109,32 @@ usbHandleControl(uint8_t cmd, uint8_t *replyBuf)
         if (cmds == NULL)
             return -1;
 
+        statusOnInterrupt = (value & XUM1541_INIT_STATUS_INT) != 0;
+
         replyBuf[0] = XUM1541_VERSION;
-        replyBuf[1] = XUM1541_CAPABILITIES;
+        replyBuf[1] = XUM1541_CAPABILITIES & 0xff;
         replyBuf[2] = currState;
+        replyBuf[3] = XUM1541_CAPABILITIES >> 8;
 
         /*
          * Our previous transaction was interrupted in the middle, say by
          * the user pressing ^C. Reset the IEC bus and then enter the
          * stalled state. The host will clear the stall and continue
          * their new transaction.
+         *
+         * With XUM1541_INIT_NO_RESET, the host only wants the bus
+         * released. The stall is the same, and as the drives were not
+         * reset, a following XUM1541_RESET is not skipped.
          */
         if (cmdSeqInProgress) {
             replyBuf[2] |= XUM1541_DOING_RESET;
-            cmdSeqInProgress = XUM1541_DOING_RESET;
-            cmds->cbm_reset(false);
+            if ((value & XUM1541_INIT_NO_RESET) != 0) {
+                cmdSeqInProgress = 0;
+                CBM_PROTO(setrelease)(0, IEC_DATA | IEC_CLOCK | IEC_ATN);
+            } else {
+                cmdSeqInProgress = XUM1541_DOING_RESET;
+                CBM_PROTO(reset)(false);
+            }
             SetAbortState();
         }
         cmdSeqInProgress |= XUM1541_CMD_IN_PROGRESS;
@@ -640,11 +1147,11 @@ usbHandleControl(uint8_t cmd, uint8_t *replyBuf)
     case XUM1541_RESET:
         // Only do reset if we didn't just reset in INIT (above).
         if ((cmdSeqInProgress & XUM1541_DOING_RESET) == 0)
-            cmds->cbm_reset(false);
+            CBM_PROTO(reset)(false);
         return 0;
 #ifdef TAPE_SUPPORT
     case XUM1541_TAP_BREAK:
-        cmds->cbm_reset(false);
+        CBM_PROTO(reset)(false);
         return 0;
 #endif // TAPE_SUPPORT
     case XUM1541_GITREV:
@@ -671,7 +1178,7 @@ usbHandleBulk(uint8_t *request, uint8_t *status)
     uint8_t cmd, proto;
     int8_t ret;
     uint16_t len;
-    bool nibEarlyExit;
+    bool nibEarlyExit, gcr;
 
     // Clear off "just did reset" flag each time a different cmd is run.
     cmdSeqInProgress &= ~XUM1541_DOING_RESET;
@@ -688,27 +1195,28 @@ usbHandleBulk(uint8_t *request, uint8_t *status)
             proto = XUM_RW_PROTO(request[1]);
         else
             proto = XUM1541_CBM;
+        gcr = (request[1] & XUM_READ_GCR) != 0;
         DEBUGF(DBG_INFO, "rd:%d %d\n", proto, len);
         // loop to read all the bytes now, sending back each as we get it
         switch (proto) {
         case XUM1541_CBM:
-            cmds->cbm_raw_read(len);
+            CBM_PROTO(raw_read)(len);
             ret = 0;
             break;
         case XUM1541_S1:
-            ioReadLoop(s1_read_byte, len);
+            ioReadLoop(s1_read_byte, len, gcr);
             ret = 0;
             break;
         case XUM1541_S2:
-            ioReadLoop(s2_read_byte, len);
+            ioReadLoop(s2_read_byte, len, gcr);
             ret = 0;
             break;
         case XUM1541_PP:
-            ioRead2Loop(pp_read_2_bytes, len);
+            ioRead2Loop(pp_read_2_bytes, len, gcr);
             ret = 0;
             break;
         case XUM1541_P2:
-            ioReadLoop(p2_read_byte, len);
+            ioReadLoop(p2_read_byte, len, false);
             ret = 0;
             break;
         case XUM1541_NIB:
@@ -718,7 +1226,7 @@ usbHandleBulk(uint8_t *request, uint8_t *status)
             ret = 0;
             break;
         case XUM1541_NIB_COMMAND:
-            ioReadLoop(nib_parburst_read_checked, len);
+            ioReadLoop(nib_parburst_read_checked, len, false);
             ret = 0;
             break;
 #ifdef SRQ_NIB_SUPPORT
@@ -727,7 +1235,7 @@ usbHandleBulk(uint8_t *request, uint8_t *status)
             ret = 0;
             break;
         case XUM1541_NIB_SRQ_COMMAND:
-            ioReadLoop(nib_srqburst_read_checked, len);
+            ioReadLoop(nib_srqburst_read_checked, len, false);
             ret = 0;
             break;
 #endif // SRQ_NIB_SUPPORT
@@ -754,7 +1262,14 @@ usbHandleBulk(uint8_t *request, uint8_t *status)
         // loop to fetch each byte and write it as we get it
         switch (proto) {
         case XUM1541_CBM:
-            len = cmds->cbm_raw_write(len, XUM_RW_FLAGS(request[1]));
+            len = CBM_PROTO(raw_write)(len,
+                XUM_RW_FLAGS(request[1]) & ~XUM_WRITE_DEFER);
+            if ((request[1] & XUM_WRITE_DEFER) != 0) {
+                if (len != *(uint16_t *)&request[2])
+                    deferredFailure();
+                ret = 0;
+                break;
+            }
             XUM_SET_STATUS_VAL(status, len);
             break;
         case XUM1541_S1:
@@ -805,6 +1320,61 @@ usbHandleBulk(uint8_t *request, uint8_t *status)
         }
         break;
 
+    case XUM1541_BATCH:
+        // Disallow if in tape mode.
+        if ((currState & XUM1541_TAPE_PRESENT)) {
+            ret = -1;
+            break;
+        }
+        DEBUGF(DBG_INFO, "batch:%d\n", len);
+        len = ioBatchLoop(len);
+        if ((request[1] & XUM_WRITE_DEFER) != 0) {
+            if (len != 0)
+                deferredFailure();
+            ret = 0;
+            break;
+        }
+        XUM_SET_STATUS_VAL(status, len);
+        break;
+
+    case XUM1541_MEMWRITE:
+    case XUM1541_MEMREAD:
+        // Disallow if in tape mode.
+        if ((currState & XUM1541_TAPE_PRESENT)) {
+            ret = -1;
+            break;
+        }
+        DEBUGF(DBG_INFO, "mem:%d %d %d\n", cmd, request[1], len);
+        if (cmd == XUM1541_MEMWRITE)
+            len = ioMemWrite(request[1] & 0x1f, len);
+        else
+            len = ioMemRead(request[1] & 0x1f, len);
+        XUM_SET_STATUS_VAL(status, len);
+        break;
+
+#ifdef XUM1541_CODELIB
+    case XUM1541_CODEUPLOAD:
+        // Disallow if in tape mode.
+        if ((currState & XUM1541_TAPE_PRESENT)) {
+            ret = -1;
+            break;
+        }
+        DEBUGF(DBG_INFO, "codeup:%d %d\n", request[1], len);
+        len = ioCodeUpload(request[1] & 0x1f, len);
+        XUM_SET_STATUS_VAL(status, len);
+        break;
+#endif
+
+#ifdef PROFILE_SUPPORT
+    case XUM1541_GET_PROFILE:
+        if (profile_send(len, (request[1] & XUM_PROFILE_CLEAR) != 0) < 0) {
+            ret = -1;
+            break;
+        }
+        XUM_SET_STATUS_VAL(status, len < XUM_PROFILE_SIZE ? len : XUM_PROFILE_SIZE);
+        break;
+#endif
+
     /* Low-level port access */
     case XUM1541_GET_EOI:
         XUM_SET_STATUS_VAL(status, eoi ? 1 : 0);
@@ -812,18 +1382,23 @@ usbHandleBulk(uint8_t *request, uint8_t *status)
     case XUM1541_CLEAR_EOI:
         eoi = 0;
         break;
+    case XUM1541_GET_DEFERRED:
+        XUM_SET_STATUS_VAL(status, deferredFailures);
+        deferredFailures = 0;
+        break;
     case XUM1541_IEC_WAIT:
-        if (!cmds->cbm_wait(/*line*/request[1], /*state*/request[2])) {
+        if (!CBM_PROTO(wait)(/*line*/request[1], /*state*/request[2],
+            /*timeout*/request[3])) {
             ret = 0;
             break;
         }
         /* FALLTHROUGH */
     case XUM1541_IEC_POLL:
-        XUM_SET_STATUS_VAL(status, cmds->cbm_poll());
+        XUM_SET_STATUS_VAL(status, CBM_PROTO(poll)());
         DEBUGF(DBG_INFO, "poll=%x\n", XUM_GET_STATUS_VAL(status));
         break;
     case XUM1541_IEC_SETRELEASE:
-        cmds->cbm_setrelease(/*set*/request[1], /*release*/request[2]);
+        CBM_PROTO(setrelease)(/*set*/request[1], /*release*/request[2]);
         break;
     case XUM1541_PP_READ:
         // Disallow if in IEEE mode.
@@ -876,6 +1451,14 @@ usbHandleBulk(uint8_t *request, uint8_t *status)
         // Sets suppressNibCmd if we're doing a read/write track.
         nib_srqburst_write_checked(request[1]);
         break;
+    case XUM1541_IEC_FAST_SERIAL:
+        // Disallow if in IEEE mode.
+        if ((currState & XUM1541_IEEE488_PRESENT)) {
+            ret = -1;
+            break;
+        }
+        iec_set_fast_serial(request[1] != 0);
+        break;
 #endif // SRQ_NIB_SUPPORT
 #ifdef TAPE_SUPPORT
     case XUM1541_TAP_PREPARE_CAPTURE:
@@ -45,6 +45,8 @@ cpu_bootloader_start(void)
     // Disable timer and then jump to bootloader address
     TCCR1B = 0;
     OCR1A = 0;
+    TIMSK3 = 0;
+    TCCR3B = 0;
 
     // pretend that there was already a previous reset
     *bootKeyPtr = bootKey;
@@ -57,6 +59,9 @@ cpu_bootloader_start(void)
         ;
 }
 
+// Timer3 is not used otherwise, so it can count cycles for the profiler
+#define PROFILE_SUPPORT 1
+
 // Timer and delay functions
 #define DELAY_MS(x) _delay_ms(x)
 #define DELAY_US(x) _delay_us(x)
@@ -28,11 +28,16 @@ cpu_bootloader_start(void)
     // Disable timer and then jump to bootloader address
     TCCR1B = 0;
     OCR1A = 0;
+    TIMSK3 = 0;
+    TCCR3B = 0;
 
     // Jump to Teensy's HalfKay bootloader
     __asm__ __volatile__ ("jmp 0x3F00" "\n\t");
 }
 
+// Timer3 is not used otherwise, so it can count cycles for the profiler
+#define PROFILE_SUPPORT 1
+
 // Timer and delay functions
 #define DELAY_MS(x) _delay_ms(x)
 #define DELAY_US(x) _delay_us(x)
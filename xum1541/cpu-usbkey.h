@@ -28,9 +28,14 @@ cpu_bootloader_start(void)
     clock_prescale_set(clock_div_8);
     TCCR1B = 0;
     OCR1A = 0;
+    TIMSK3 = 0;
+    TCCR3B = 0;
     __asm__ __volatile__ ("jmp 0xf000" "\n\t");
 }
 
+// Timer3 is not used otherwise, so it can count cycles for the profiler
+#define PROFILE_SUPPORT 1
+
 // Timer and delay functions
 #define DELAY_MS(x) _delay_ms(x)
 #define DELAY_US(x) _delay_us(x)
@@ -46,6 +46,7 @@ typedef struct {
     USB_Descriptor_Interface_t            Interface;
     USB_Descriptor_Endpoint_t             DataInEndpoint;
     USB_Descriptor_Endpoint_t             DataOutEndpoint;
+    USB_Descriptor_Endpoint_t             StatusInEndpoint;
 } USB_Descriptor_Configuration_t;
 
 const USB_Descriptor_Configuration_t PROGMEM ConfigurationDescriptor =
@@ -72,7 +73,7 @@ const USB_Descriptor_Configuration_t PROGMEM ConfigurationDescriptor =
 
         InterfaceNumber:   0,
         AlternateSetting:  0,
-        TotalEndpoints:    2,
+        TotalEndpoints:    3,
         Class:             0xff,
         SubClass:          0x00,
         Protocol:          0x00,
@@ -102,6 +103,18 @@ const USB_Descriptor_Configuration_t PROGMEM ConfigurationDescriptor =
         EndpointSize:      XUM_ENDPOINT_BULK_SIZE,
         PollingIntervalMS: 0x00,
     },
+
+    StatusInEndpoint: {
+        Header: {
+            Size: sizeof(USB_Descriptor_Endpoint_t),
+            Type: DTYPE_Endpoint,
+        },
+
+        EndpointAddress:  (ENDPOINT_DESCRIPTOR_DIR_IN | XUM_INT_IN_ENDPOINT),
+        Attributes:        EP_TYPE_INTERRUPT,
+        EndpointSize:      XUM_ENDPOINT_INT_SIZE,
+        PollingIntervalMS: XUM_ENDPOINT_INT_INTERVAL,
+    },
 };
 
 const USB_Descriptor_String_t PROGMEM LanguageString = {
@@ -37,12 +37,51 @@
 #define IEC_T_DA    80   // Min talk-attention ack hold time (us)
 #define IEC_T_FR    60   // Min EOI acknowledge time (us)
 
-static void iec_reset(bool forever);
-static uint16_t iec_raw_write(uint16_t len, uint8_t flags);
-static uint16_t iec_raw_read(uint16_t len);
-static bool iec_wait(uint8_t line, uint8_t state);
-static uint8_t iec_poll(void);
-static void iec_setrelease(uint8_t set, uint8_t release);
+/*
+ * JiffyDOS timing. A JiffyDOS drive answers if the controller waits
+ * before the last bit of the LISTEN or TALK byte under ATN by pulling
+ * DATA for a short while. After that, the data bytes of this transaction
+ * are sent as four timed bit pairs on CLK and DATA instead of eight
+ * handshaked bits. A released line is a 1 bit. The offsets below are
+ * relative to the start edge of each byte.
+ */
+#define JIFFY_T_PROBE   400  // Probe delay before the last ATN bit
+#define JIFFY_T_ACK     200  // Max time the drive holds DATA to answer it
+
+// Host to drive: bits 4/5, 6/7, 3/1, 2/0 and EOI are sampled at
+// 13, 24, 37, 48 and 59 us. Each pair is put on the lines 5 us before.
+#define JIFFY_TX_T1     8
+#define JIFFY_TX_T2     11
+#define JIFFY_TX_T3     13
+#define JIFFY_TX_T4     11
+#define JIFFY_TX_T5     11
+#define JIFFY_TX_HOLD   6    // Hold time of the EOI flag before busy
+
+// Drive to host: bits 0/1, 2/3, 4/5, 6/7 and the status are put on the
+// lines by the drive at fixed times; they are sampled at these offsets.
+#define JIFFY_RX_T1     15
+#define JIFFY_RX_T2     10
+#define JIFFY_RX_T3     11
+#define JIFFY_RX_T4     10
+#define JIFFY_RX_T5     11
+
+/*
+ * The device addressed by the last ATN write answered the JiffyDOS
+ * probe, so bytes to and from it use the JiffyDOS protocol. Any ATN
+ * write clears it, so UNTALK/UNLISTEN end a JiffyDOS transaction.
+ */
+static bool jiffyActive;
+
+#ifdef SRQ_NIB_SUPPORT
+// 1571/1581 fast serial is enabled, see XUM1541_IEC_FAST_SERIAL
+static bool fastSerial;
+
+void
+iec_set_fast_serial(bool enable)
+{
+    fastSerial = enable;
+}
+#endif // SRQ_NIB_SUPPORT
 
 static struct ProtocolFunctions iecFunctions = {
     .cbm_reset = iec_reset,
@@ -188,10 +227,11 @@ wait_for_free_bus(bool forever)
     DEBUGF(DBG_ERROR, "wait4free bus to\n");
 }
 
-static void
+void
 iec_reset(bool forever)
 {
     DEBUGF(DBG_ALL, "reset\n");
+    jiffyActive = false;
     iec_release(IO_DATA | IO_ATN | IO_CLK | IO_SRQ);
 
     /*
@@ -231,14 +271,150 @@ iec_wait_timeout_2ms(uint8_t mask, uint8_t state)
     return ((iec_poll_pins() & mask) != state);
 }
 
-// Wait up to 400 us for CLK to be pulled by the drive.
-static void
+/*
+ * Wait up to 400 us for CLK to be pulled by the drive. In fast serial
+ * mode, returns true if the drive starts clocking a byte out on SRQ
+ * instead. Its pulses are only a few us long, so we poll without delay
+ * then, at about 8 cycles per iteration.
+ */
+static bool
 iec_wait_clk(void)
 {
     uint8_t count = 200;
+#ifdef SRQ_NIB_SUPPORT
+    uint16_t fastCount;
+
+    if (fastSerial) {
+        for (fastCount = 400 * (F_CPU / 1000000) / 8; fastCount != 0;
+            fastCount--) {
+            if (iec_get(IO_SRQ))
+                return true;
+            if (iec_get(IO_CLK))
+                break;
+        }
+        return false;
+    }
+#endif
 
     while (iec_get(IO_CLK) == 0 && count-- != 0)
         DELAY_US(2);
+    return false;
+}
+
+/*
+ * Wait before the last bit of a byte under ATN, with CLK held and DATA
+ * released. A JiffyDOS drive detects the delay and pulls DATA for about
+ * 100 us. Returns true if it did and released DATA again in time.
+ */
+static bool
+jiffy_probe(void)
+{
+    uint8_t count;
+
+    for (count = JIFFY_T_PROBE / 2; count != 0; count--) {
+        if (iec_get(IO_DATA)) {
+            count = JIFFY_T_ACK / 2;
+            while (iec_get(IO_DATA) && count-- != 0)
+                DELAY_US(2);
+            return !iec_get(IO_DATA);
+        }
+        DELAY_US(2);
+    }
+    return false;
+}
+
+// Put one JiffyDOS bit pair on CLK and DATA, a 1 releases the line.
+static inline void
+jiffy_put_pair(uint8_t clk, uint8_t data)
+{
+    uint8_t set;
+
+    set = (clk ? 0 : IO_CLK) | (data ? 0 : IO_DATA);
+    iec_set_release(set, (IO_CLK | IO_DATA) & ~set);
+}
+
+/*
+ * Send a byte to a JiffyDOS listener. We hold CLK between bytes and
+ * wait for the listener to release DATA. Releasing CLK then starts the
+ * timed transfer, during which interrupts must be off. The listener
+ * acknowledges the byte by pulling DATA again.
+ */
+static bool
+jiffy_send_byte(uint8_t b, bool last)
+{
+    while (iec_get(IO_DATA)) {
+        if (!TimerWorker())
+            return false;
+    }
+
+    cli();
+    iec_release(IO_CLK);
+    DELAY_US(JIFFY_TX_T1);
+    jiffy_put_pair(b & 0x10, b & 0x20);
+    DELAY_US(JIFFY_TX_T2);
+    jiffy_put_pair(b & 0x40, b & 0x80);
+    DELAY_US(JIFFY_TX_T3);
+    jiffy_put_pair(b & 0x08, b & 0x02);
+    DELAY_US(JIFFY_TX_T4);
+    jiffy_put_pair(b & 0x04, b & 0x01);
+    DELAY_US(JIFFY_TX_T5);
+
+    // A released CLK flags the last byte (EOI)
+    jiffy_put_pair(last, 1);
+    DELAY_US(JIFFY_TX_HOLD);
+    iec_set(IO_CLK);
+    sei();
+
+    return iec_wait_timeout_2ms(IO_DATA, IO_DATA);
+}
+
+/*
+ * Receive a byte from a JiffyDOS talker. We hold DATA between bytes and
+ * wait for the talker to release CLK. Releasing DATA starts the timed
+ * transfer. Returns the byte, or -1 on timeout or abort.
+ */
+static int16_t
+jiffy_recv_byte(void)
+{
+    uint8_t b, p1, p2, p3, p4, st;
+    uint16_t to;
+
+    // Same 1 second timeout as for the standard protocol
+    for (to = 0; iec_get(IO_CLK); to++) {
+        if (to >= 50000 || !TimerWorker())
+            return -1;
+        DELAY_US(20);
+    }
+
+    cli();
+    iec_release(IO_DATA);
+    DELAY_US(JIFFY_RX_T1);
+    p1 = iec_poll_pins();
+    DELAY_US(JIFFY_RX_T2);
+    p2 = iec_poll_pins();
+    DELAY_US(JIFFY_RX_T3);
+    p3 = iec_poll_pins();
+    DELAY_US(JIFFY_RX_T4);
+    p4 = iec_poll_pins();
+    DELAY_US(JIFFY_RX_T5);
+    st = iec_poll_pins();
+    iec_set(IO_DATA);
+    sei();
+
+    b = 0;
+    if (p1 & IO_CLK)  b |= 0x01;
+    if (p1 & IO_DATA) b |= 0x02;
+    if (p2 & IO_CLK)  b |= 0x04;
+    if (p2 & IO_DATA) b |= 0x08;
+    if (p3 & IO_CLK)  b |= 0x10;
+    if (p3 & IO_DATA) b |= 0x20;
+    if (p4 & IO_CLK)  b |= 0x40;
+    if (p4 & IO_DATA) b |= 0x80;
+
+    // The talker releases CLK in the status slot for the last byte
+    if (st & IO_CLK)
+        eoi = 1;
+    return b;
 }
 
 /*
@@ -258,11 +434,15 @@ iec_wait_clk(void)
  * hold time to 15 us still worked fine.
  */
 static uint8_t
-send_byte(uint8_t b)
+send_byte(uint8_t b, bool *jiffy)
 {
     uint8_t i, ack = 0;
 
     for (i = 8; i != 0; i--) {
+        // Probe for JiffyDOS before the last bit, if asked to
+        if (i == 1 && jiffy != NULL)
+            *jiffy = jiffy_probe();
+
         // Wait for Ts (setup) with additional padding
         DELAY_US(IEC_T_S + 55);
 
@@ -319,16 +499,20 @@ wait_for_listener(void)
  * Write bytes to the drive via the CBM default protocol.
  * Returns number of successful written bytes or 0 on error.
  */
-static uint16_t
+uint16_t
 iec_raw_write(uint16_t len, uint8_t flags)
 {
-    uint8_t atn, talk, data;
+    uint8_t atn, talk, jiffy, data, ok;
     uint16_t rv;
+    bool found;
 
     rv = len;
     atn = flags & XUM_WRITE_ATN;
     talk = flags & XUM_WRITE_TALK;
+    jiffy = flags & XUM_WRITE_JIFFY;
     eoi = 0;
+    if (atn)
+        jiffyActive = false;
 
     DEBUGF(DBG_INFO, "cwr %d, atn %d, talk %d\n", len, atn, talk);
     if (len == 0)
@@ -349,6 +533,19 @@ iec_raw_write(uint16_t len, uint8_t flags)
     }
 
     iec_release(IO_DATA);
+#ifdef SRQ_NIB_SUPPORT
+    /*
+     * Announce a fast serial controller like the C128 does: a byte
+     * clocked out on SRQ while ATN is held. A 1571 or 1581 then sends
+     * the bytes as talker in fast serial mode, see iec_raw_read().
+     * This is done before we set CLK since iec_srq_write() releases it.
+     */
+    if (atn && fastSerial) {
+        iec_set(IO_ATN);
+        iec_srq_write(0xff);
+        iec_release(IO_DATA);
+    }
+#endif
     iec_set(IO_CLK | (atn ? IO_ATN : 0));
     IEC_DELAY();
 
@@ -379,6 +576,18 @@ iec_raw_write(uint16_t len, uint8_t flags)
             break;
         }
 
+        // A JiffyDOS listener does its own handshake for each byte
+        if (jiffyActive && !atn) {
+            if (usbRecvByte(&data) != 0 || !jiffy_send_byte(data, len == 1)) {
+                DEBUGF(DBG_ERROR, "write: jiffy err\n");
+                rv = 0;
+                break;
+            }
+            len--;
+            wdt_reset();
+            continue;
+        }
+
         // Release CLK and wait forever for listener to release data.
         if (!wait_for_listener()) {
             DEBUGF(DBG_ERROR, "write: w4l abrt\n");
@@ -405,7 +614,21 @@ iec_raw_write(uint16_t len, uint8_t flags)
             rv = 0;
             break;
         }
-        if (send_byte(data)) {
+        /*
+         * Probe for JiffyDOS with LISTEN or TALK, if asked to. UNLISTEN
+         * and UNTALK have device number 31 and are not probed.
+         */
+        found = false;
+        if (jiffy && atn && (data & 0x1f) != 0x1f &&
+            ((data & 0xe0) == 0x20 || (data & 0xe0) == 0x40))
+            ok = send_byte(data, &found);
+        else
+            ok = send_byte(data, NULL);
+        if (ok) {
+            if (found) {
+                DEBUGF(DBG_INFO, "jiffy %x\n", data);
+                jiffyActive = true;
+            }
             len--;
             DELAY_US(IEC_T_BB);
         } else {
@@ -457,13 +680,43 @@ iec_raw_write(uint16_t len, uint8_t flags)
     return rv;
 }
 
+// Read bytes from a JiffyDOS talker, see iec_raw_read()
 static uint16_t
+jiffy_raw_read(uint16_t len)
+{
+    int16_t b;
+    uint16_t count;
+
+    usbInitIo(len, ENDPOINT_DIR_IN);
+    for (count = 0; count != len && !eoi; count++) {
+        b = jiffy_recv_byte();
+        if (b < 0) {
+            DEBUGF(DBG_ERROR, "jiffy rd to\n");
+            count = 0;
+            break;
+        }
+
+        // Send the data byte to host, quitting if it signalled an abort.
+        if (usbSendByte(b))
+            break;
+        wdt_reset();
+    }
+
+    DEBUGF(DBG_INFO, "rv=%d\n", count);
+    usbIoDone();
+    return count;
+}
+
+uint16_t
 iec_raw_read(uint16_t len)
 {
     uint8_t ok, bit, b;
     uint16_t to, count;
+    bool fast;
 
     DEBUGF(DBG_INFO, "crd %d\n", len);
+    if (jiffyActive)
+        return jiffy_raw_read(len);
     usbInitIo(len, ENDPOINT_DIR_IN);
     count = 0;
     do {
@@ -492,14 +745,15 @@ iec_raw_read(uint16_t len)
         iec_release(IO_DATA);
 
         /* use special "timer with wait for clock" */
-        iec_wait_clk();
+        fast = iec_wait_clk();
 
         // Is the talking device signalling EOI?
-        if (iec_get(IO_CLK) == 0) {
+        if (!fast && iec_get(IO_CLK) == 0) {
             eoi = 1;
             iec_set(IO_DATA);
             DELAY_US(70);
             iec_release(IO_DATA);
+            fast = iec_wait_clk();
         }
 
         /*
@@ -509,20 +763,29 @@ iec_raw_read(uint16_t len)
          */
         cli();
 
-        // Wait up to 2 ms for CLK to be asserted
-        ok = iec_wait_timeout_2ms(IO_CLK, IO_CLK);
-
-        // Read all 8 bits of a byte
-        for (bit = b = 0; bit < 8 && ok; bit++) {
-            // Wait up to 2 ms for CLK to be released
-            ok = iec_wait_timeout_2ms(IO_CLK, 0);
-            if (ok) {
-                b >>= 1;
-                if (iec_get(IO_DATA) == 0)
-                    b |= 0x80;
-
-                // Wait up to 2 ms for CLK to be asserted
-                ok = iec_wait_timeout_2ms(IO_CLK, IO_CLK);
+#ifdef SRQ_NIB_SUPPORT
+        if (fast) {
+            // A fast serial talker clocks the whole byte out on SRQ
+            b = iec_srq_read();
+            ok = 1;
+        } else
+#endif
+        {
+            // Wait up to 2 ms for CLK to be asserted
+            ok = iec_wait_timeout_2ms(IO_CLK, IO_CLK);
+
+            // Read all 8 bits of a byte
+            for (bit = b = 0; bit < 8 && ok; bit++) {
+                // Wait up to 2 ms for CLK to be released
+                ok = iec_wait_timeout_2ms(IO_CLK, 0);
+                if (ok) {
+                    b >>= 1;
+                    if (iec_get(IO_DATA) == 0)
+                        b |= 0x80;
+
+                    // Wait up to 2 ms for CLK to be asserted
+                    ok = iec_wait_timeout_2ms(IO_CLK, IO_CLK);
+                }
             }
         }
 
@@ -552,11 +815,16 @@ iec_raw_read(uint16_t len)
     return count;
 }
 
-/* wait forever for a specific line to reach a certain state */
-static bool
-iec_wait(uint8_t line, uint8_t state)
+/*
+ * Wait for a specific line to reach a certain state. Gives up after
+ * (at least) timeout * 10 ms, or waits forever if timeout is 0; the
+ * host tells a timeout from the bus state returned afterwards.
+ */
+bool
+iec_wait(uint8_t line, uint8_t state, uint8_t timeout)
 {
     uint8_t hw_mask, hw_state;
+    uint16_t count = 0;
 
     /* calculate hw mask and expected state */
     hw_mask = iec2hw(line);
@@ -566,12 +834,19 @@ iec_wait(uint8_t line, uint8_t state)
         if (!TimerWorker())
             return false;
         DELAY_US(10);
+
+        // 1000 polls of at least 10 us make up 10 ms
+        if (timeout != 0 && ++count == 1000) {
+            count = 0;
+            if (--timeout == 0)
+                break;
+        }
     }
 
     return true;
 }
 
-static uint8_t
+uint8_t
 iec_poll(void)
 {
     uint8_t iec_state, rv = 0;
@@ -589,7 +864,7 @@ iec_poll(void)
     return rv;
 }
 
-static void
+void
 iec_setrelease(uint8_t set, uint8_t release)
 {
     if (release == 0)
@@ -138,7 +138,7 @@ static uint8_t IeeeBasin(void);
 static void ieee_reset(bool forever);
 static uint16_t ieee_raw_write(uint16_t len, uint8_t flags);
 static uint16_t ieee_raw_read(uint16_t len);
-static bool ieee_wait(uint8_t line, uint8_t state);
+static bool ieee_wait(uint8_t line, uint8_t state, uint8_t timeout);
 static uint8_t ieee_poll(void);
 static void ieee_setrelease(uint8_t set, uint8_t release);
 
@@ -390,7 +390,7 @@ static uint8_t ieee_poll(void)
     return rv;
 }
 
-static bool ieee_wait(uint8_t line, uint8_t state)
+static bool ieee_wait(uint8_t line, uint8_t state, uint8_t timeout)
 {
     return true;
 }
@@ -20,6 +20,9 @@ volatile bool doDeviceReset;
 // Flag for whether we are in EOI state
 volatile uint8_t eoi;
 
+// Send the command status on the interrupt endpoint (XUM1541_INIT_STATUS_INT)
+bool statusOnInterrupt;
+
 // Board status which controls the status indicators (e.g. LEDs)
 static volatile uint8_t statusValue;
 
@@ -47,6 +50,7 @@ main(void)
 
     // Indicate device not ready
     board_init();
+    profile_init();
     set_status(STATUS_INIT);
     doDeviceReset = false;
 
@@ -111,14 +115,19 @@ EVENT_USB_Device_ConfigurationChanged(void)
     USB_ResetConfig();
 
     /*
-     * Setup and enable the two bulk endpoints. This must be done in
-     * increasing order of endpoints (3, 4) to avoid fragmentation of
-     * the USB RAM.
+     * Setup and enable the status endpoint and the two bulk endpoints.
+     * This must be done in increasing order of endpoints (2, 3, 4) to
+     * avoid fragmentation of the USB RAM.
      */
+    Endpoint_ConfigureEndpoint(XUM_INT_IN_ENDPOINT, EP_TYPE_INTERRUPT,
+        ENDPOINT_DIR_IN, XUM_ENDPOINT_INT_SIZE, ENDPOINT_BANK_SINGLE);
     Endpoint_ConfigureEndpoint(XUM_BULK_IN_ENDPOINT, EP_TYPE_BULK,
         ENDPOINT_DIR_IN, XUM_ENDPOINT_BULK_SIZE, ENDPOINT_BANK_DOUBLE);
     Endpoint_ConfigureEndpoint(XUM_BULK_OUT_ENDPOINT, EP_TYPE_BULK,
         ENDPOINT_DIR_OUT, XUM_ENDPOINT_BULK_SIZE, ENDPOINT_BANK_DOUBLE);
+
+    // A new host session starts with the status on the bulk endpoint
+    statusOnInterrupt = false;
 }
 
 void
@@ -140,7 +149,8 @@ EVENT_USB_Device_UnhandledControlRequest(void)
 
     // Process the command and get any returned data
     memset(replyBuf, 0, sizeof(replyBuf));
-    len = usbHandleControl(USB_ControlRequest.bRequest, replyBuf);
+    len = usbHandleControl(USB_ControlRequest.bRequest,
+        USB_ControlRequest.wValue, replyBuf);
     if (len == -1) {
         DEBUGF(DBG_ERROR, "ctrl req err\n");
         set_status(STATUS_ERROR);
@@ -214,10 +224,12 @@ USB_BulkWorker()
      *    0: completed ok, don't send any status
      *   -1: error, no status
      */
+    profile_start();
     status = usbHandleBulk(cmdBuf, statusBuf);
+    profile_end(cmdBuf);
     if (status > 0) {
         statusBuf[0] = status;
-        USB_WriteBlock(statusBuf, sizeof(statusBuf));
+        USB_WriteStatus(statusBuf, sizeof(statusBuf));
     } else if (status < 0) {
         DEBUGF(DBG_ERROR, "usbblk err\n");
         set_status(STATUS_ERROR);
@@ -242,6 +254,8 @@ SetAbortState()
     Endpoint_StallTransaction();
     Endpoint_SelectEndpoint(XUM_BULK_IN_ENDPOINT);
     Endpoint_StallTransaction();
+    Endpoint_SelectEndpoint(XUM_INT_IN_ENDPOINT);
+    Endpoint_StallTransaction();
 
     Endpoint_SelectEndpoint(origEndpoint);
 }
@@ -280,7 +294,7 @@ void
 USB_ResetConfig()
 {
     static uint8_t endpoints[] = {
-        XUM_BULK_IN_ENDPOINT, XUM_BULK_OUT_ENDPOINT, 0,
+        XUM_INT_IN_ENDPOINT, XUM_BULK_IN_ENDPOINT, XUM_BULK_OUT_ENDPOINT, 0,
     };
     uint8_t lastEndpoint, *endp;
 
@@ -333,6 +347,26 @@ USB_WriteBlock(uint8_t *buf, uint8_t len)
     return true;
 }
 
+/*
+ * Send the status of a command, on the interrupt endpoint if the host
+ * asked for it in XUM1541_INIT, else behind the data on the bulk one.
+ */
+bool
+USB_WriteStatus(uint8_t *buf, uint8_t len)
+{
+    if (!statusOnInterrupt)
+        return USB_WriteBlock(buf, len);
+
+    Endpoint_SelectEndpoint(XUM_INT_IN_ENDPOINT);
+    Endpoint_Write_Stream_LE(buf, len, AbortOnReset);
+
+    if (doDeviceReset)
+        return false;
+
+    Endpoint_ClearIN();
+    return true;
+}
+
 /*
  * Callback for the Endpoint_Read/Write_Stream functions. We abort the
  * current stream transfer if the user sent a reset message to the
@@ -0,0 +1,171 @@
+/*
+ * Cycle counting firmware profiler for XUM1541_GET_PROFILE
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version
+ * 2 of the License, or (at your option) any later version.
+ */
+#include <avr/interrupt.h>
+
+#include "xum1541.h"
+
+#ifdef PROFILE_SUPPORT
+
+/*
+ * Timer3 runs at F_CPU without a prescaler, so one tick is one CPU cycle.
+ * Its overflow interrupt extends it to 32 bits, which wrap after about
+ * 268 seconds at 16 MHz. That is plenty for the length of one command.
+ */
+static volatile uint16_t profOverflows;
+
+// Accounting for each profile slot
+struct ProfileSlot {
+    uint32_t cycles;    // cycles spent running the commands
+    uint32_t usbWait;   // part of it spent waiting for the USB endpoint
+    uint16_t count;     // number of commands
+};
+
+static struct ProfileSlot profSlots[XUM_PROF_SLOTS];
+
+// State of the command and endpoint wait currently measured
+static uint32_t profCmdStart, profWaitStart, profWait;
+
+ISR(TIMER3_OVF_vect)
+{
+    profOverflows++;
+}
+
+void
+profile_init(void)
+{
+    TCCR3A = 0;
+    TCCR3B = (1 << CS30);
+    TIMSK3 = (1 << TOIE3);
+    profile_clear();
+}
+
+void
+profile_clear(void)
+{
+    memset(profSlots, 0, sizeof(profSlots));
+}
+
+// Current cycle count, extended to 32 bits
+static uint32_t
+profile_now(void)
+{
+    uint8_t sreg;
+    uint16_t lo, hi;
+
+    sreg = SREG;
+    cli();
+    lo = TCNT3;
+    hi = profOverflows;
+
+    // The counter wrapped, but the interrupt did not run yet
+    if ((TIFR3 & (1 << TOV3)) != 0 && lo < 0x8000)
+        hi++;
+    SREG = sreg;
+
+    return ((uint32_t)hi << 16) | lo;
+}
+
+// Add without wrapping around, the host clears the slots now and then
+static inline uint32_t
+profile_add(uint32_t total, uint32_t delta)
+{
+    total += delta;
+    return (total < delta) ? 0xffffffff : total;
+}
+
+void
+profile_start(void)
+{
+    profWait = 0;
+    profCmdStart = profile_now();
+}
+
+void
+profile_end(const uint8_t *request)
+{
+    struct ProfileSlot *slot;
+    uint32_t cycles;
+    uint8_t idx;
+
+    cycles = profile_now() - profCmdStart;
+
+    switch (request[0]) {
+    case XUM1541_READ:
+        idx = XUM_PROF_SLOT_READ(request[1]);
+        break;
+    case XUM1541_WRITE:
+        idx = XUM_PROF_SLOT_WRITE(request[1]);
+        break;
+    case XUM1541_BATCH:
+        idx = XUM_PROF_SLOT_BATCH;
+        break;
+    case XUM1541_MEMWRITE:
+#ifdef XUM1541_CODELIB
+    case XUM1541_CODEUPLOAD:
+#endif
+        idx = XUM_PROF_SLOT_MEMWRITE;
+        break;
+    case XUM1541_MEMREAD:
+        idx = XUM_PROF_SLOT_MEMREAD;
+        break;
+    case XUM1541_GET_PROFILE:
+        // Don't disturb the numbers by reading them
+        return;
+    default:
+        idx = XUM_PROF_SLOT_IOCTL;
+        break;
+    }
+
+    slot = &profSlots[idx];
+    slot->cycles = profile_add(slot->cycles, cycles);
+    slot->usbWait = profile_add(slot->usbWait, profWait);
+    if (slot->count != 0xffff)
+        slot->count++;
+}
+
+void
+profile_wait_begin(void)
+{
+    profWaitStart = profile_now();
+}
+
+void
+profile_wait_end(void)
+{
+    profWait += profile_now() - profWaitStart;
+}
+
+/*
+ * Send the profile to the host for XUM1541_GET_PROFILE: the CPU clock
+ * in kHz (16-bit) followed by the slots, all little-endian like the
+ * AVR itself. Returns the number of bytes sent, or -1 on reset.
+ */
+int16_t
+profile_send(uint16_t len, bool clear)
+{
+    uint16_t clock = F_CPU / 1000;
+
+    if (len > XUM_PROFILE_SIZE)
+        len = XUM_PROFILE_SIZE;
+
+    usbInitIo(len, ENDPOINT_DIR_IN);
+    if (len >= sizeof(clock) &&
+        (usbSendBlock((const uint8_t *)&clock, sizeof(clock)) != 0 ||
+        usbSendBlock((const uint8_t *)profSlots, len - sizeof(clock)) != 0)) {
+        usbIoDone();
+        return -1;
+    }
+    usbIoDone();
+
+    if (clear)
+        profile_clear();
+    return len;
+}
+
+#endif // PROFILE_SUPPORT
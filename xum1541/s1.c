@@ -13,80 +13,100 @@
 
 #include "xum1541.h"
 
+/*
+ * The byte loops are unrolled: each bit is a separate inline call with a
+ * constant mask, so there is no loop counter and no shifting of the byte
+ * between the handshakes. The lines are polled with IO_SPIN_WHILE().
+ */
+
+// Send one bit (twice, as the protocol wants). Returns false on abort.
+INLINE bool
+s1_write_bit(uint8_t bit)
+{
+    // Send first bit, releasing CLK and waiting for drive to ack by
+    // setting CLK.
+    if (bit != 0)
+        iec_set(IO_DATA);
+    else
+        iec_release(IO_DATA);
+    IEC_DELAY();
+
+    // Be sure DATA is stable before CLK is released. Also, delay after
+    // releasing CLK before polling for the drive setting it.
+    iec_release(IO_CLK);
+    IEC_DELAY();
+    IO_SPIN_WHILE(!iec_get(IO_CLK), return false);
+
+    // Send bit a second time. First, wait for drive to release CLK.
+    // Then, release DATA and set CLK and wait for drive to ack by
+    // setting DATA.
+    if (bit != 0)
+        iec_release(IO_DATA);
+    else
+        iec_set(IO_DATA);
+    IO_SPIN_WHILE(iec_get(IO_CLK), return false);
+
+    // Delay after releasing DATA before polling for the drive setting it.
+    iec_set_release(IO_CLK, IO_DATA);
+    IEC_DELAY();
+    IO_SPIN_WHILE(!iec_get(IO_DATA), return false);
+    return true;
+}
+
 void
 s1_write_byte(uint8_t c)
 {
-    uint8_t i;
-
-    for (i = 8; i != 0; i--, c <<= 1) {
-        // Send first bit, releasing CLK and waiting for drive to ack by
-        // setting CLK.
-        if ((c & 0x80) != 0)
-            iec_set(IO_DATA);
-        else
-            iec_release(IO_DATA);
-        IEC_DELAY();
+    // MSB first; stops at the first bit that was aborted
+    (void)(s1_write_bit(c & 0x80) && s1_write_bit(c & 0x40) &&
+        s1_write_bit(c & 0x20) && s1_write_bit(c & 0x10) &&
+        s1_write_bit(c & 0x08) && s1_write_bit(c & 0x04) &&
+        s1_write_bit(c & 0x02) && s1_write_bit(c & 0x01));
+}
 
-        // Be sure DATA is stable before CLK is released. Also, delay after
-        // releasing CLK before polling for the drive setting it.
-        iec_release(IO_CLK);
-        IEC_DELAY();
-        while (!iec_get(IO_CLK)) {
-            if (!TimerWorker())
-                return;
-        }
+// Receive one bit: returns 0 or 1, or -1 on abort.
+INLINE int8_t
+s1_read_bit(void)
+{
+    uint8_t b;
 
-        // Send bit a second time. First, wait for drive to release CLK.
-        // Then, release DATA and set CLK and wait for drive to ack by
-        // setting DATA.
-        if ((c & 0x80) != 0)
-            iec_release(IO_DATA);
-        else
-            iec_set(IO_DATA);
-        while (iec_get(IO_CLK)) {
-            if (!TimerWorker())
-                return;
-        }
+    IO_SPIN_WHILE(iec_get(IO_DATA), return -1);
+    iec_release(IO_CLK);
+    IEC_DELAY();
+    b = iec_get(IO_CLK);
+    iec_set(IO_DATA);
+    IO_SPIN_WHILE(b == iec_get(IO_CLK), return -1);
 
-        // Delay after releasing DATA before polling for the drive setting it.
-        iec_set_release(IO_CLK, IO_DATA);
-        IEC_DELAY();
-        while (!iec_get(IO_DATA)) {
-            if (!TimerWorker())
-                return;
-        }
-    }
+    iec_release(IO_DATA);
+    IEC_DELAY();
+    IO_SPIN_WHILE(!iec_get(IO_DATA), return -1);
+    iec_set(IO_CLK);
+    return b ? 1 : 0;
 }
 
+// Receive the bit for mask into c (LSB first), or return -1 on abort.
+#define S1_READ_BIT(c, mask)                \
+    do {                                    \
+        int8_t bit_ = s1_read_bit();        \
+        if (bit_ < 0)                       \
+            return -1;                      \
+        if (bit_ != 0)                      \
+            c |= (mask);                    \
+    } while (0)
+
 uint8_t
 s1_read_byte(void)
 {
-    uint8_t i, b, c;
+    uint8_t c;
 
     c = 0;
-    for (i = 8; i != 0; i--) {
-        while (iec_get(IO_DATA)) {
-            if (!TimerWorker())
-                return -1;
-        }
-        iec_release(IO_CLK);
-        IEC_DELAY();
-        b = iec_get(IO_CLK);
-        c = (c >> 1) | (b ? 0x80 : 0);
-        iec_set(IO_DATA);
-        while (b == iec_get(IO_CLK)) {
-            if (!TimerWorker())
-                return -1;
-        }
-
-        iec_release(IO_DATA);
-        IEC_DELAY();
-        while (!iec_get(IO_DATA)) {
-            if (!TimerWorker())
-                return -1;
-        }
-        iec_set(IO_CLK);
-    }
+    S1_READ_BIT(c, 0x01);
+    S1_READ_BIT(c, 0x02);
+    S1_READ_BIT(c, 0x04);
+    S1_READ_BIT(c, 0x08);
+    S1_READ_BIT(c, 0x10);
+    S1_READ_BIT(c, 0x20);
+    S1_READ_BIT(c, 0x40);
+    S1_READ_BIT(c, 0x80);
 
     return c;
 }
@@ -13,71 +13,78 @@
 
 #include "xum1541.h"
 
-void
-s2_write_byte(uint8_t c)
+/*
+ * The byte loops are unrolled into bit pairs like in s1.c, with the
+ * lines polled by IO_SPIN_WHILE().
+ */
+
+// Send two bits (LSB first). Returns false on abort.
+INLINE bool
+s2_write_pair(uint8_t bit0, uint8_t bit1)
 {
-    uint8_t i;
+    // Send first bit, releasing ATN and waiting for CLK release ack.
+    if (bit0 != 0)
+        iec_set(IO_DATA);
+    else
+        iec_release(IO_DATA);
+    IEC_DELAY();
+    iec_release(IO_ATN);
+    IO_SPIN_WHILE(iec_get(IO_CLK), return false);
 
-    for (i = 4; i != 0; i--) {
-        // Send first bit, releasing ATN and waiting for CLK release ack.
-        if ((c & 1) != 0)
-            iec_set(IO_DATA);
-        else
-            iec_release(IO_DATA);
-        IEC_DELAY();
-        c >>= 1;
-        iec_release(IO_ATN);
-        while (iec_get(IO_CLK)) {
-            if (!TimerWorker())
-                return;
-        }
+    // Send second bit, setting ATN and waiting for CLK set ack.
+    if (bit1 != 0)
+        iec_set(IO_DATA);
+    else
+        iec_release(IO_DATA);
+    IEC_DELAY();
+    iec_set(IO_ATN);
+    IO_SPIN_WHILE(!iec_get(IO_CLK), return false);
+    return true;
+}
 
-        // Send second bit, setting ATN and waiting for CLK set ack.
-        if ((c & 1) != 0)
-            iec_set(IO_DATA);
-        else
-            iec_release(IO_DATA);
-        IEC_DELAY();
-        c >>= 1;
-        iec_set(IO_ATN);
-        while (!iec_get(IO_CLK)) {
-            if (!TimerWorker())
-                return;
-        }
-    }
+void
+s2_write_byte(uint8_t c)
+{
+    // Stops at the first pair that was aborted
+    (void)(s2_write_pair(c & 0x01, c & 0x02) &&
+        s2_write_pair(c & 0x04, c & 0x08) &&
+        s2_write_pair(c & 0x10, c & 0x20) &&
+        s2_write_pair(c & 0x40, c & 0x80));
 
     iec_release(IO_DATA);
     IEC_DELAY();
 }
 
+// Receive two bits into c (LSB first), or return -1 on abort.
+#define S2_READ_PAIR(c, mask0, mask1)                               \
+    do {                                                            \
+        /* Receive first bit, waiting for CLK and releasing ATN to ack. */ \
+        IO_SPIN_WHILE(iec_get(IO_CLK), return -1);                  \
+        /* Pause each time CLK changes to be sure DATA is stable. */ \
+        IEC_DELAY();                                                \
+        if (iec_get(IO_DATA))                                       \
+            c |= (mask0);                                           \
+        iec_release(IO_ATN);                                        \
+                                                                    \
+        /* Receive second bit, waiting for CLK to be released and */ \
+        /* setting ATN to ack. */                                   \
+        IO_SPIN_WHILE(!iec_get(IO_CLK), return -1);                 \
+        IEC_DELAY();                                                \
+        if (iec_get(IO_DATA))                                       \
+            c |= (mask1);                                           \
+        iec_set(IO_ATN);                                            \
+    } while (0)
+
 uint8_t
 s2_read_byte(void)
 {
-    uint8_t c, i;
+    uint8_t c;
 
     c = 0;
-    for (i = 4; i != 0; i--) {
-        // Receive first bit, waiting for CLK and releasing ATN to ack.
-        while (iec_get(IO_CLK)) {
-            if (!TimerWorker())
-                return -1;
-        }
-        // Pause each time CLK changes to be sure DATA is stable.
-        IEC_DELAY();
-        c = (c >> 1) | (iec_get(IO_DATA) ? 0x80 : 0);
-        iec_release(IO_ATN);
-
-        // Receive second bit, waiting for CLK to be released and setting ATN
-        // to ack.
-        while (!iec_get(IO_CLK)) {
-            if (!TimerWorker())
-                return -1;
-        }
-        // Pause each time CLK changes to be sure DATA is stable.
-        IEC_DELAY();
-        c = (c >> 1) | (iec_get(IO_DATA) ? 0x80 : 0);
-        iec_set(IO_ATN);
-    }
+    S2_READ_PAIR(c, 0x01, 0x02);
+    S2_READ_PAIR(c, 0x04, 0x08);
+    S2_READ_PAIR(c, 0x10, 0x20);
+    S2_READ_PAIR(c, 0x40, 0x80);
 
     return c;
 }
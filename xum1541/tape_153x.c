@@ -20,6 +20,14 @@ volatile uint8_t TSR = 0;
 static volatile uint32_t Tape_Timer1Ovf   = 0; // Timer1 overflow counter.
 static volatile uint16_t Tape_Timer1Stamp = 0; // Timer1-ICR1 timestamp.
 static volatile uint16_t Tape_Timer1Stamp_last = 0; // Last Timer1-ICR1 timestamp.
+static bool              Tape_DeltaStamps = false; // Send delta-compressed timestamps.
+static uint16_t          Tape_LastDelta = 0; // Last 14-bit timestamp, for delta compression.
+static uint16_t          Tape_TAPScale = 0; // TAP encoding: machine cycles per 2^19 timer ticks, 0 if off.
+static uint8_t           Tape_TAPHalfWaves = 0; // TAP encoding: halfwaves seen, the first one is skipped.
+static uint64_t          Tape_TAPHalfWave; // TAP encoding: first half of the current full wave.
+
+// Machine cycles per 2^19 ticks of the 16MHz timer, by XUM1541_TAP_CONFIG_CLOCK_MASK.
+static const uint16_t    Tape_TAPScales[4] = { 32285, 33513, 36320, 0 };
 
 // Global variables (write)
 static volatile uint32_t HiDelta;
@@ -452,6 +460,22 @@ uint16_t Tape_UploadConfig(void)
     TSR &= (uint8_t)~(XUM1541_TAP_READ_STARTFALLEDGE | XUM1541_TAP_WRITE_STARTFALLEDGE);
     TSR |= (uint8_t)(data & (XUM1541_TAP_READ_STARTFALLEDGE | XUM1541_TAP_WRITE_STARTFALLEDGE));
 
+    // Optional second configuration byte. Older hosts only send one.
+    Tape_DeltaStamps = false;
+    Tape_TAPScale = 0;
+    if (Endpoint_BytesInEndpoint() != 0)
+    {
+        if (usbRecvByte(&data) != 0)
+        {
+            usbIoDone();
+            SREG = oldSREG; // Restore Global Interrupt Enable state.
+            return Tape_Status_ERROR_usbRecvByte;
+        }
+        Tape_DeltaStamps = ((data & XUM1541_TAP_CONFIG_DELTA) != 0);
+        if (data & XUM1541_TAP_CONFIG_TAP)
+            Tape_TAPScale = Tape_TAPScales[(data & XUM1541_TAP_CONFIG_CLOCK_MASK) >> 2];
+    }
+
     usbIoDone();
     SREG = oldSREG; // Restore Global Interrupt Enable state.
     return Tape_Status_OK_Config_Uploaded;
@@ -970,11 +994,96 @@ void Tape_StopWrite(void)
 }
 
 
+// Encode HiDelta/LoDelta as delta-compressed timestamp (XUM1541_TAP_CONFIG_DELTA).
+// Returns the number of bytes stored to stamp (1, 2 or 5).
+static uint8_t Tape_EncodeDeltaStamp(uint8_t *stamp)
+{
+    int16_t diff;
+
+    if ((HiDelta != 0) || (LoDelta >= 0x4000))
+    {
+        // Long signal (>=1ms)
+        stamp[0] = ((HiDelta >> 16) & 0x3f) | 0xc0;
+        stamp[1] = (HiDelta >> 8) & 0xff;
+        stamp[2] = HiDelta & 0xff;
+        stamp[3] = LoDelta >> 8;
+        stamp[4] = LoDelta & 0xff;
+        Tape_LastDelta = 0x8000; // Too far off for a difference.
+        return 5;
+    }
+
+    // Most signals are about as long as the one before.
+    diff = (int16_t)(LoDelta - Tape_LastDelta);
+    Tape_LastDelta = LoDelta;
+    if ((diff >= -64) && (diff < 64))
+    {
+        stamp[0] = (uint8_t)diff & 0x7f;
+        return 1;
+    }
+
+    stamp[0] = (LoDelta >> 8) | 0x80;
+    stamp[1] = LoDelta & 0xff;
+    return 2;
+}
+
+
+// Encode HiDelta/LoDelta as TAP v1 data (XUM1541_TAP_CONFIG_TAP) and send it.
+// Two halfwaves make one TAP signal, so only every second call sends something.
+// Returns the result of usbSendBlock, 0 if nothing was sent.
+static int8_t Tape_usbSendTAPSignal(void)
+{
+    static const uint8_t longest[4] = { 0, 0xff, 0xff, 0xff };
+    uint64_t ticks, cycles;
+    uint8_t  signal[4];
+
+    ticks = ((uint64_t)HiDelta << 16) | LoDelta;
+
+    if (Tape_TAPHalfWaves < 2)
+    {
+        // Skip the time until the first pulse starts, keep the first half of a full wave.
+        if (Tape_TAPHalfWaves++ != 0)
+            Tape_TAPHalfWave = ticks;
+        return 0;
+    }
+    Tape_TAPHalfWaves = 1;
+    ticks += Tape_TAPHalfWave;
+
+    // Round to machine cycles, in 32 bits for all but pauses.
+    if (ticks < 0x10000)
+        cycles = ((uint32_t)ticks * Tape_TAPScale + 0x40000UL) >> 19;
+    else
+        cycles = (ticks * Tape_TAPScale + 0x40000UL) >> 19;
+
+    if (cycles <= 2040) // 8*0xff=2040
+    {
+        signal[0] = (uint8_t)((cycles + 4) >> 3);
+        if (signal[0] == 0)
+            signal[0] = 1; // 0 starts a pause.
+        return usbSendBlock(signal, 1);
+    }
+
+    // Pause: 00 and 3 bytes of cycles, as often as needed.
+    while (cycles > 0x00ffffff)
+    {
+        if (usbSendBlock(longest, sizeof(longest)) != 0)
+            return -1;
+        cycles -= 0x00ffffff;
+    }
+    signal[0] = 0;
+    signal[1] = cycles & 0xff;
+    signal[2] = (cycles >> 8) & 0xff;
+    signal[3] = (cycles >> 16) & 0xff;
+    return usbSendBlock(signal, sizeof(signal));
+}
+
+
 // Send timestamp to host. Stop tape capture on error.
 // Executed from ISR while interrupts disabled.
 // Flags "Tape_Status_ERROR_usbSendByte" on USB transfer error.
 void Tape_usbSendTimeStamp(void)
 {
+    uint8_t stamp[5], n = 0;
+
     // Calculate delta
     HiDelta = Tape_Timer1Ovf;
     LoDelta = Tape_Timer1Stamp - Tape_Timer1Stamp_last;
@@ -983,44 +1092,37 @@ void Tape_usbSendTimeStamp(void)
     Tape_Timer1Ovf = 0;
     Tape_Timer1Stamp_last = Tape_Timer1Stamp;
 
-    if ((HiDelta != 0) || (LoDelta >= 0x8000))
+    if (Tape_TAPScale != 0)
     {
-        // Long signal (>=2ms)
-        // MSB of 5-byte timestamp must be 1 (restricts deltas to max 9.5 hours).
-        if (usbSendByte(((HiDelta >> 16) & 0xff) | 0x80) != 0)
-        {
-            Tape_StopCapture();
-            TapeStatus = Tape_Status_ERROR_usbSendByte;
-            return;
-        }
-
-        if (usbSendByte((HiDelta >> 8) & 0xff) != 0)
+        if (Tape_usbSendTAPSignal() != 0)
         {
             Tape_StopCapture();
             TapeStatus = Tape_Status_ERROR_usbSendByte;
-            return;
-        }
-
-        if (usbSendByte(HiDelta & 0xff) != 0)
-        {
-            Tape_StopCapture();
-            TapeStatus = Tape_Status_ERROR_usbSendByte;
-            return;
         }
+        return;
     }
 
-    if (usbSendByte(LoDelta >> 8) != 0)
+    if (Tape_DeltaStamps)
+        n = Tape_EncodeDeltaStamp(stamp);
+    else
     {
-        Tape_StopCapture();
-        TapeStatus = Tape_Status_ERROR_usbSendByte;
-        return;
+        if ((HiDelta != 0) || (LoDelta >= 0x8000))
+        {
+            // Long signal (>=2ms)
+            // MSB of 5-byte timestamp must be 1 (restricts deltas to max 9.5 hours).
+            stamp[n++] = ((HiDelta >> 16) & 0xff) | 0x80;
+            stamp[n++] = (HiDelta >> 8) & 0xff;
+            stamp[n++] = HiDelta & 0xff;
+        }
+        stamp[n++] = LoDelta >> 8;
+        stamp[n++] = LoDelta & 0xff;
     }
 
-    if (usbSendByte(LoDelta & 0xff) != 0)
+    // Hand the whole timestamp to the endpoint at once.
+    if (usbSendBlock(stamp, n) != 0)
     {
         Tape_StopCapture();
         TapeStatus = Tape_Status_ERROR_usbSendByte;
-        return;
     }
 }
 
@@ -1237,6 +1339,23 @@ uint16_t Tape_Capture(void)
     DELAY_MS(10);
     DELAY_MS(30); // Avoid SENSE signal noise.
 
+    // Tell the host that TAP data or delta-compressed timestamps follow.
+    if ((Tape_TAPScale != 0) || Tape_DeltaStamps)
+    {
+        static const uint8_t marker[5] = { 0x80, 0, 0, 0, 0 };
+        static const uint8_t TAPmarker[5] = { 0x80, 0, 0, 0, 1 };
+
+        Tape_LastDelta = 0x8000;
+        Tape_TAPHalfWaves = 0;
+        if (usbSendBlock((Tape_TAPScale != 0) ? TAPmarker : marker, sizeof(marker)) != 0)
+        {
+            usbIoDone();
+            Tape_SetBasicConfig(TAPE_CONFIG_OPTION_BASIC); // Clear config flags, set basic configuration, motor off.
+            SREG = oldSREG; // Restore Global Interrupt Enable state.
+            return Tape_Status_ERROR_usbSendByte;
+        }
+    }
+
     //   Return values:
     //   - Tape_Status_OK
     //   - Tape_Status_ERROR_Sense_Not_On_Play
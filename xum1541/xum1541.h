@@ -89,6 +89,14 @@
 #define XUM_ENDPOINT_BULK_SIZE  32
 #endif
 
+// Size of the SRAM ring buffer between drive reads and the IN endpoint.
+// Must be a power of 2 and no bigger than 256.
+#if defined (__AVR_AT90USB1287__) || defined (__AVR_ATmega32U4__)
+#define XUM_RINGBUF_SIZE        256
+#else
+#define XUM_RINGBUF_SIZE        128
+#endif
+
 // Status levels to notify the user (e.g. LEDS)
 #define STATUS_INIT             0
 #define STATUS_READY            1
@@ -110,6 +118,30 @@ extern volatile uint8_t TSR;
 #define XUM1541_TAP_READ_STARTFALLEDGE  0x40 // start reading with falling edge (1 = true)
 #define XUM1541_TAP_DISCONNECTED        0x80 // tape device was disconnected (1 = true)
 
+/*
+ * Optional second byte of the tape configuration (must match the value in
+ * OpenCBM tape applications). If XUM1541_TAP_CONFIG_DELTA is set, the capture
+ * stream starts with the marker 80 00 00 00 00 (never a valid timestamp)
+ * and the timestamps are sent as:
+ *   0ddddddd                 signed 7-bit difference to the previous one
+ *   10dddddd dddddddd        14-bit timestamp (< 1 ms at 16 MHz)
+ *   11dddddd + 4 bytes       38-bit timestamp
+ */
+#define XUM1541_TAP_CONFIG_DELTA        0x01 // delta-compressed capture timestamps
+
+/*
+ * If XUM1541_TAP_CONFIG_TAP is set, the adapter encodes the signals itself
+ * and the capture stream starts with the marker 80 00 00 00 01, followed by
+ * the data of a C64 TAP v1 file: a byte of cycles/8 per full wave, or 00 and
+ * 3 bytes of cycles (LSB first) for a longer one. The first halfwave is not
+ * sent. The cycles are those of the machine chosen by the clock bits.
+ */
+#define XUM1541_TAP_CONFIG_TAP          0x02 // TAP v1 data instead of timestamps
+#define XUM1541_TAP_CONFIG_CLOCK_MASK   0x0c
+#define XUM1541_TAP_CLOCK_C64_PAL       0x00 //  985248 Hz
+#define XUM1541_TAP_CLOCK_NTSC          0x04 // 1022727 Hz, C64 and VIC-20 NTSC
+#define XUM1541_TAP_CLOCK_VIC_PAL       0x08 // 1108405 Hz
+
 // Restore options after CBM 153x tape operation finished
 #define TAPE_CONFIG_OPTION_BASIC      1 // Basic configuration is restored, motor off.
 #define TAPE_CONFIG_OPTION_KEEP_MOTOR 2 // Basic configuration is restored, last tape MOTOR CONTROL setting remains active
@@ -166,35 +198,90 @@ enum {
 
 extern volatile uint8_t eoi;
 extern volatile bool doDeviceReset;
+extern bool statusOnInterrupt;
 
 // Board status handling
 uint8_t get_status(void);
 void set_status(uint8_t status);
 
 // USB IO functions and command handlers
-int8_t usbHandleControl(uint8_t cmd, uint8_t *replyBuf);
+int8_t usbHandleControl(uint8_t cmd, uint16_t value, uint8_t *replyBuf);
 int8_t usbHandleBulk(uint8_t *request, uint8_t *status);
 bool TimerWorker(void);
 void SetAbortState(void);
 void USB_ResetConfig(void);
 bool USB_ReadBlock(uint8_t *buf, uint8_t len);
 bool USB_WriteBlock(uint8_t *buf, uint8_t len);
+bool USB_WriteStatus(uint8_t *buf, uint8_t len);
 uint8_t AbortOnReset(void);
 void usbInitIo(uint16_t len, uint8_t dir);
 void usbIoDone(void);
 int8_t usbSendByte(uint8_t data);
 int8_t usbRecvByte(uint8_t *data);
+int8_t usbSendBlock(const uint8_t *data, uint16_t len);
+int8_t usbRecvBlock(uint8_t *data, uint16_t len);
 void Set_usbDataLen(uint16_t Len);
+void usbInjectData(const uint8_t *data, uint8_t len);
+
+// Drive code library in the flash, see XUM1541_CODEUPLOAD
+#ifdef XUM1541_CODELIB
+const uint8_t *codelib_find(uint16_t len, uint32_t crc);
+#endif
+
+// Firmware profiling, see XUM1541_GET_PROFILE
+#ifdef PROFILE_SUPPORT
+void profile_init(void);
+void profile_clear(void);
+void profile_start(void);
+void profile_end(const uint8_t *request);
+void profile_wait_begin(void);
+void profile_wait_end(void);
+int16_t profile_send(uint16_t len, bool clear);
+#else
+#define profile_init()
+#define profile_start()
+#define profile_end(request)
+#define profile_wait_begin()
+#define profile_wait_end()
+#endif
+
+/*
+ * Busy-wait until the selected endpoint can be accessed or the host
+ * aborts, accounting the time in the profile.
+ */
+#define usbWaitEndpoint()                                       \
+    do {                                                        \
+        profile_wait_begin();                                   \
+        while (!Endpoint_IsReadWriteAllowed() && !doDeviceReset) \
+            ;                                                   \
+        profile_wait_end();                                     \
+    } while (0)
 
 // IEC functions
 #define IEC_DELAY()             DELAY_US(2) // Time for IEC lines to change
 
+/*
+ * Spin while cond holds, running onAbort if the host aborts. This is for
+ * the bit handshakes of the S1/S2 protocols: polling a line takes a few
+ * cycles, but TimerWorker() is a call, so it is only run every 256 polls
+ * (well below 1 ms, so the watchdog and abort checks still keep up).
+ */
+#define IO_SPIN_WHILE(cond, onAbort)                            \
+    do {                                                        \
+        uint8_t spin_ = 0;                                      \
+        while (cond) {                                          \
+            if (++spin_ == 0 && !TimerWorker()) {               \
+                onAbort;                                        \
+            }                                                   \
+        }                                                       \
+    } while (0)
+
 // IEC or IEEE handlers for protocols
 struct ProtocolFunctions {
     void (*cbm_reset)(bool forever);
     uint16_t (*cbm_raw_write)(uint16_t len, uint8_t flags);
     uint16_t (*cbm_raw_read)(uint16_t len);
-    bool (*cbm_wait)(uint8_t line, uint8_t state);
+    bool (*cbm_wait)(uint8_t line, uint8_t state, uint8_t timeout);
     uint8_t (*cbm_poll)(void);
     void (*cbm_setrelease)(uint8_t set, uint8_t release);
 };
@@ -202,6 +289,25 @@ struct ProtocolFunctions {
 // Global pointer to protocol, set by cbm_init()
 extern struct ProtocolFunctions *cmds;
 
+/*
+ * The handler fn of the protocol. Only the boards with IEEE-488 or tape
+ * support choose the protocol at runtime; the others always use IEC and
+ * call its handlers directly, without going through cmds.
+ */
+#if defined(IEEE_SUPPORT) || defined(TAPE_SUPPORT)
+#define CBM_PROTO(fn)   (cmds->cbm_ ## fn)
+#else
+#define CBM_PROTO(fn)   iec_ ## fn
+#endif
+
+// The IEC handlers
+void iec_reset(bool forever);
+uint16_t iec_raw_write(uint16_t len, uint8_t flags);
+uint16_t iec_raw_read(uint16_t len);
+bool iec_wait(uint8_t line, uint8_t state, uint8_t timeout);
+uint8_t iec_poll(void);
+void iec_setrelease(uint8_t set, uint8_t release);
+
 // Initializers for each protocol
 struct ProtocolFunctions *cbm_init(void);
 struct ProtocolFunctions *iec_init(void);
@@ -235,6 +341,7 @@ int8_t nib_write_handshaked(uint8_t data, uint8_t toggle);
 uint8_t nib_srqburst_read(void);
 void nib_srqburst_write(uint8_t data);
 uint8_t nib_srq_write_handshaked(uint8_t data, uint8_t toggle);
+void iec_set_fast_serial(bool enable);
 #endif // SRQ_NIB_SUPPORT
 #ifdef TAPE_SUPPORT
 uint16_t Tape_GetTapeFirmwareVersion(void); // Return tape firmware version for compatibility check.
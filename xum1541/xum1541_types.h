@@ -23,6 +23,17 @@
 #define XUM_BULK_OUT_ENDPOINT       4
 #define XUM_ENDPOINT_0_SIZE         8
 
+/*
+ * Interrupt IN endpoint for the status of commands (XUM1541_CAP_STATUS_INT,
+ * if XUM1541_INIT_STATUS_INT was set). The host waits for it with a
+ * pending interrupt transfer instead of reading the bulk IN endpoint,
+ * where it would be mixed up with the data of the command. Endpoint 2
+ * is used as the series-2 AVRs (e.g. at90usb162) only have 0 to 4.
+ */
+#define XUM_INT_IN_ENDPOINT         2
+#define XUM_ENDPOINT_INT_SIZE       8
+#define XUM_ENDPOINT_INT_INTERVAL   1 // ms
+
 // control transactions
 #define XUM1541_ECHO                0
 #define XUM1541_INIT                (XUM1541_ECHO + 1)
@@ -48,17 +59,67 @@
 #else
 #define XUM1541_CAP_TAP             0
 #endif
+#define XUM1541_CAP_BATCH           0x20 // XUM1541_BATCH compound command
+#define XUM1541_CAP_DEFER           0x40 // XUM_WRITE_DEFER, deferred status
+#define XUM1541_CAP_MEMRW           0x80 // XUM1541_MEMWRITE/MEMREAD commands
+
+// Sent in byte 3 of the XUM1541_INIT reply, as bits 8-15
+#define XUM1541_CAP_GCR             0x100 // XUM_READ_GCR for S1/S2/PP reads
+#ifdef PROFILE_SUPPORT
+#define XUM1541_CAP_PROFILE         0x200 // XUM1541_GET_PROFILE command
+#else
+#define XUM1541_CAP_PROFILE         0
+#endif
+#define XUM1541_CAP_JIFFY           0x400 // XUM_WRITE_JIFFY for IEC transfers
+#ifdef SRQ_NIB_SUPPORT
+#define XUM1541_CAP_FAST_SERIAL     0x800 // XUM1541_IEC_FAST_SERIAL command
+#else
+#define XUM1541_CAP_FAST_SERIAL     0
+#endif
+#define XUM1541_CAP_WAIT_TIMEOUT    0x1000 // timeout for XUM1541_IEC_WAIT
+#define XUM1541_CAP_STATUS_INT      0x2000 // status on XUM_INT_IN_ENDPOINT
+#ifdef XUM1541_CODELIB
+#define XUM1541_CAP_CODELIB         0x4000 // XUM1541_CODEUPLOAD command
+#else
+#define XUM1541_CAP_CODELIB         0
+#endif
 
 #define XUM1541_CAPABILITIES        (XUM1541_CAP_CBM |      \
                                      XUM1541_CAP_NIB |      \
                                      XUM1541_CAP_TAP |      \
-                                     XUM1541_CAP_IEEE488)
+                                     XUM1541_CAP_IEEE488 |  \
+                                     XUM1541_CAP_BATCH |    \
+                                     XUM1541_CAP_DEFER |    \
+                                     XUM1541_CAP_MEMRW |    \
+                                     XUM1541_CAP_GCR |      \
+                                     XUM1541_CAP_PROFILE |  \
+                                     XUM1541_CAP_JIFFY |    \
+                                     XUM1541_CAP_FAST_SERIAL |  \
+                                     XUM1541_CAP_WAIT_TIMEOUT | \
+                                     XUM1541_CAP_STATUS_INT | \
+                                     XUM1541_CAP_CODELIB)
 
 // Actual auto-detected status
 #define XUM1541_DOING_RESET         0x01 // no clean shutdown, will reset now
 #define XUM1541_IEEE488_PRESENT     0x10 // IEEE-488 device connected
 #define XUM1541_TAPE_PRESENT        0x20 // 153x tape device connected
 
+/*
+ * wValue of XUM1541_INIT. If the previous session was interrupted, only
+ * release the bus lines instead of resetting the drives. This saves the
+ * second or so a drive needs to boot, but a drive still running its own
+ * code is not brought back. Older firmware ignores it and resets.
+ */
+#define XUM1541_INIT_NO_RESET       0x01
+
+/*
+ * wValue of XUM1541_INIT. Send the status of the commands of this session
+ * on XUM_INT_IN_ENDPOINT instead of the bulk IN endpoint. Older firmware
+ * ignores it; the host must only use it if the reply has
+ * XUM1541_CAP_STATUS_INT set.
+ */
+#define XUM1541_INIT_STATUS_INT     0x02
+
 // Sizes for commands and responses in bytes
 #define XUM_CMDBUF_SIZE             4 // Command block (out)
 #define XUM_STATUSBUF_SIZE          3 // Waiting status value (in)
@@ -77,6 +138,71 @@
 #define XUM1541_READ                8
 #define XUM1541_WRITE               (XUM1541_READ + 1)
 
+/*
+ * Compound command. Its data phase (length in bytes 2-3 of the command
+ * block) is a list of XUM1541_READ and XUM1541_WRITE command blocks for
+ * the XUM1541_CBM protocol, each write followed by its data. The device
+ * runs them back to back, sending the data of each read as a separate
+ * transfer, and then returns a single status. Its value is 0 if all
+ * entries succeeded, else the number (starting at 1) of the first one
+ * that failed. After a failure, only the ATN writes are still run so the
+ * bus is left with a clean unlisten/untalk. Reads are limited to
+ * XUM_MAX_XFER_SIZE bytes each. If XUM_WRITE_DEFER is set in byte 1 of
+ * the command block, the list must only contain writes.
+ */
+#define XUM1541_BATCH               (XUM1541_READ + 2)
+
+/*
+ * Drive memory access run by the device itself. Byte 1 of the command
+ * block is the device number, bytes 2-3 the number of bytes to transfer.
+ * The data phase from the host starts with the 16-bit drive memory
+ * address (little-endian). For XUM1541_MEMWRITE, the data to write follows
+ * it; the device sends it with as many "M-W" commands as needed. For
+ * XUM1541_MEMREAD, the device runs one "M-R" command and sends the data
+ * as one transfer; the range must not cross a page of the drive memory.
+ * The status value is the number of bytes transferred.
+ */
+#define XUM1541_MEMWRITE            (XUM1541_READ + 3)
+#define XUM1541_MEMREAD             (XUM1541_READ + 4)
+#define XUM_MEM_WRITE_CHUNK         0x23 // bytes per "M-W" command
+#define XUM_MEM_READ_CHUNK          0x100 // max. bytes per XUM1541_MEMREAD
+
+/*
+ * Firmware profile, counted in CPU cycles. Every bulk command is accounted
+ * in a slot: reads and writes per protocol, the other commands by type.
+ * Byte 1 of the command block holds flags, bytes 2-3 the number of bytes
+ * the host wants. The device sends up to XUM_PROFILE_SIZE bytes: the CPU
+ * clock in kHz (16-bit), then for each slot the cycles spent in its
+ * commands (32-bit), the part of these spent waiting for the host to
+ * serve the USB endpoint (32-bit) and the number of commands (16-bit),
+ * all little-endian. The cycle counts saturate instead of wrapping.
+ * The status value is the number of bytes sent.
+ */
+#define XUM1541_GET_PROFILE         (XUM1541_READ + 5)
+#define XUM_PROFILE_CLEAR           (1 << 0) // clear the slots after sending
+#define XUM_PROF_SLOT_READ(mode)    (XUM_RW_PROTO(mode) >> 4)
+#define XUM_PROF_SLOT_WRITE(mode)   (16 + (XUM_RW_PROTO(mode) >> 4))
+#define XUM_PROF_SLOT_BATCH         32
+#define XUM_PROF_SLOT_MEMWRITE      33
+#define XUM_PROF_SLOT_MEMREAD       34
+#define XUM_PROF_SLOT_IOCTL         35 // all XUM1541_IOCTL commands
+#define XUM_PROF_SLOTS              36
+#define XUM_PROF_SLOT_SIZE          10
+#define XUM_PROFILE_SIZE            (2 + XUM_PROF_SLOTS * XUM_PROF_SLOT_SIZE)
+
+/*
+ * Upload of drive code kept in the flash of the device, see codelib.c.
+ * Byte 1 of the command block is the device number, bytes 2-3 the length
+ * of the drive code. The data phase from the host is the 16-bit drive
+ * memory address and the CRC-32 (as used by zip) of the drive code, both
+ * little-endian. If the device has this drive code, it writes it to the
+ * drive with "M-W" commands as XUM1541_MEMWRITE does. The status value is
+ * the number of bytes written, 0 if the device does not have the code;
+ * the host then sends it with XUM1541_MEMWRITE itself.
+ */
+#define XUM1541_CODEUPLOAD          (XUM1541_READ + 6)
+#define XUM_CODEUPLOAD_SIZE         6 // bytes in the data phase
+
 /*
  * Maximum size for USB transfers (read/write commands, all protocols).
  * This should be ok for the raw USB protocol. I haven't tested this much
@@ -101,6 +227,16 @@
 #define XUM1541_PARBURST_WRITE      (XUM1541_IOCTL + 15)
 #define XUM1541_SRQBURST_READ       (XUM1541_IOCTL + 16)
 #define XUM1541_SRQBURST_WRITE      (XUM1541_IOCTL + 17)
+#define XUM1541_GET_DEFERRED        (XUM1541_IOCTL + 18)
+
+/*
+ * Enable (byte 1 non-zero) or disable 1571/1581 fast serial for the
+ * XUM1541_CBM protocol. If enabled, the device announces itself as a
+ * fast serial controller by clocking a byte out on SRQ while sending
+ * LISTEN or TALK, and accepts bytes a talker sends with SRQ as clock.
+ * Bytes to a listener are still sent the standard way.
+ */
+#define XUM1541_IEC_FAST_SERIAL     (XUM1541_IOCTL + 19)
 #define XUM1541_TAP_MOTOR_ON            (XUM1541_IOCTL + 50)
 #define XUM1541_TAP_GET_VER             (XUM1541_IOCTL + 51)
 #define XUM1541_TAP_PREPARE_CAPTURE     (XUM1541_IOCTL + 52)
@@ -155,6 +291,31 @@
 #define XUM_WRITE_TALK              (1 << 0)
 #define XUM_WRITE_ATN               (1 << 1)
 
+/*
+ * Don't send a status for this write (or XUM1541_BATCH) but count a
+ * failure. XUM1541_GET_DEFERRED returns the count (saturating at 255)
+ * and clears it. This lets the host queue writes without waiting for
+ * each one.
+ */
+#define XUM_WRITE_DEFER             (1 << 2)
+
+/*
+ * Probe for JiffyDOS while sending LISTEN or TALK with XUM_WRITE_ATN. If
+ * the device answers, the following XUM1541_CBM reads and writes use the
+ * JiffyDOS protocol until the next write with XUM_WRITE_ATN. Other
+ * devices are not affected. This flag is ignored in IEEE-488 mode.
+ */
+#define XUM_WRITE_JIFFY             (1 << 3)
+
+/*
+ * Flag for use with read and the XUM1541_S1, XUM1541_S2 and XUM1541_PP
+ * protocols: The length is the number of GCR bytes to read from the
+ * drive. The device decodes every 5 of them into 4 bytes and sends only
+ * these (a remainder of less than 5 bytes is read and dropped). Invalid
+ * GCR codes are decoded as 0xf nibbles.
+ */
+#define XUM_READ_GCR                (1 << 0)
+
 // Request an early exit from nib read via burst_read_track_var()
 #define XUM1541_NIB_READ_VAR        0x8000
 
@@ -39,6 +39,7 @@
 #include "dfu-device.h"
 #include "dfu.h"
 #include "arguments.h"
+#include "atmel.h"
 #include "intel_hex.h"
 
 // Mapping of common name to Atmel CPU names
@@ -95,9 +96,13 @@ static int CheckFirmwareVersion(usb_dev_handle *usbHandle, int fileModel,
 static int CheckFirmwareVersion(libusb_device_handle *usbHandle, libusb_device *usbDevice,
     int fileModel, int fileVersion);
 #endif
+static int LoadFlashImage(struct programmer_arguments *args,
+    char *firmwareFile, int16_t **image);
+static int FlashDiffers(dfu_device_t *dev, struct programmer_arguments *args,
+    int16_t *image);
 static int EraseFlash(dfu_device_t *dev, struct programmer_arguments *args);
 static int UpdateFlash(dfu_device_t *dev, struct programmer_arguments *args,
-    char *firmwareFile);
+    int16_t *image);
 static int StartDevice(dfu_device_t *dev, struct programmer_arguments *args);
 static struct XumDevice *FindDeviceByName(const char *commonName);
 static int16_t *ihex_search(int16_t *buf, int bufSize,
@@ -155,6 +160,7 @@ RunUpdate(dfu_device_t *devHandle, char *firmwareFile, char *deviceType,
     libusb_device *usbDevice;
 #endif
     struct programmer_arguments args;
+    int16_t *image;
 
     // phase 1: prepare
 
@@ -208,19 +214,39 @@ RunUpdate(dfu_device_t *devHandle, char *firmwareFile, char *deviceType,
 
     // phase 3: do update
 
-    // Perform the update and restart the device
-    fprintf(stderr, "updating firmware...\n");
-    ret = EraseFlash(devHandle, &args);
-    if (ret != 0) {
-        fprintf(stderr, "error: flash erase failed\n");
+    ret = LoadFlashImage(&args, firmwareFile, &image);
+    if (ret != 0)
         return ret;
-    }
-    ret = UpdateFlash(devHandle, &args, firmwareFile);
-    if (ret != 0) {
-        fprintf(stderr, "error: flash update failed\n");
+
+    // Read back the flash first. If it already holds the firmware (e.g.,
+    // with -f and the same version), the erase and write are skipped.
+    ret = FlashDiffers(devHandle, &args, image);
+    if (ret < 0) {
+        fprintf(stderr, "error: flash read failed\n");
+        free(image);
         return ret;
     }
 
+    if (ret == 0) {
+        fprintf(stderr, "device already has this firmware, not updating\n");
+    } else {
+        // Perform the update and restart the device
+        fprintf(stderr, "updating firmware...\n");
+        ret = EraseFlash(devHandle, &args);
+        if (ret != 0) {
+            fprintf(stderr, "error: flash erase failed\n");
+            free(image);
+            return ret;
+        }
+        ret = UpdateFlash(devHandle, &args, image);
+        if (ret != 0) {
+            fprintf(stderr, "error: flash update failed\n");
+            free(image);
+            return ret;
+        }
+    }
+    free(image);
+
     // phase 4: cleanup
     ret = StartDevice(devHandle, &args);
     if (ret != 0) {
@@ -571,6 +597,68 @@ CheckFirmwareVersion(libusb_device_handle *usbHandle, libusb_device *usbDevice,
     return 0;
 }
 
+// Load the firmware as it is written to the flash: indexed by the flash
+// address, -1 for every byte which is not set, and nothing in the bootloader.
+static int
+LoadFlashImage(struct programmer_arguments *args, char *firmwareFile,
+    int16_t **image)
+{
+    int16_t *buf;
+    uint32_t i;
+    int usage;
+
+    buf = intel_hex_to_buffer(firmwareFile, args->memory_address_top + 1,
+        &usage);
+    if (buf == NULL) {
+        fprintf(stderr, "\"%s\" is not a valid Intel hex firmware file\n",
+            firmwareFile);
+        return -1;
+    }
+
+    for (i = args->bootloader_bottom; i <= args->bootloader_top; i++)
+        buf[i] = -1;
+
+    *image = buf;
+    return 0;
+}
+
+// Compare the flash with the image. Returns 1 if a byte of the image
+// differs, 0 if the flash already holds the image, or -1 on error.
+static int
+FlashDiffers(dfu_device_t *dev, struct programmer_arguments *args,
+    int16_t *image)
+{
+    uint8_t *flash;
+    uint32_t i, bottom, top;
+    int ret;
+
+    bottom = args->flash_address_bottom;
+    top = args->flash_address_top + 1;
+
+    flash = malloc(top - bottom);
+    if (flash == NULL)
+        return -1;
+
+    if (atmel_read_flash(dev, bottom, top, flash, top - bottom,
+        false, false) != (int32_t)(top - bottom)) {
+        free(flash);
+        return -1;
+    }
+
+    ret = 0;
+    for (i = bottom; i < top; i++) {
+        if (image[i] >= 0 && image[i] <= UINT8_MAX &&
+            (uint8_t)image[i] != flash[i - bottom]) {
+            verbose_print("flash differs from firmware at 0x%05x\n", i);
+            ret = 1;
+            break;
+        }
+    }
+
+    free(flash);
+    return ret;
+}
+
 // Erase the current firmware and verify it succeeded (is blank).
 static int
 EraseFlash(dfu_device_t *dev, struct programmer_arguments *args)
@@ -580,19 +668,62 @@ EraseFlash(dfu_device_t *dev, struct programmer_arguments *args)
     return execute_command(dev, args);
 }
 
-// Download new firmware to the device
+// Download new firmware to the erased device and verify it.
+// Pages which only hold 0xff are already like that after the erase, so
+// they are not sent at all; in the middle of a page, a run of 0xff is
+// sent anyway, since every extra block costs more than the bytes saved.
 static int
 UpdateFlash(dfu_device_t *dev, struct programmer_arguments *args,
-    char *firmwareFile)
+    int16_t *image)
 {
-    args->command = com_flash;
-    args->com_flash_data.suppress_validation = 0;
-    args->com_flash_data.file = firmwareFile;
-    args->com_flash_data.original_first_char = *firmwareFile;
+    uint32_t i, page, bottom, top, pageSize;
+    uint8_t *flash;
+    int ret;
 
-    // XXX If failed, retry 3 times. Verify download succeeded
-    // If failed, try download again.
-    return execute_command(dev, args);
+    bottom = args->flash_address_bottom;
+    top = args->flash_address_top + 1;
+    pageSize = args->flash_page_size ? args->flash_page_size : 128;
+
+    for (page = bottom; page < top; page += pageSize) {
+        for (i = page; i < page + pageSize && i < top; i++) {
+            if (image[i] >= 0 && image[i] < UINT8_MAX)
+                break;
+        }
+        if (i == page + pageSize || i == top) {
+            for (i = page; i < page + pageSize && i < top; i++)
+                image[i] = -1;
+        }
+    }
+
+    // XXX If failed, retry 3 times.
+    if (atmel_flash(dev, image, bottom, top, args->flash_page_size,
+        false) < 0) {
+        fprintf(stderr, "Error while flashing.\n");
+        return -1;
+    }
+
+    flash = malloc(top - bottom);
+    if (flash == NULL)
+        return -1;
+
+    ret = 0;
+    if (atmel_read_flash(dev, bottom, top, flash, top - bottom,
+        false, false) != (int32_t)(top - bottom)) {
+        fprintf(stderr, "Error while validating.\n");
+        ret = -1;
+    } else {
+        for (i = bottom; i < top; i++) {
+            if (image[i] >= 0 && image[i] <= UINT8_MAX &&
+                (uint8_t)image[i] != flash[i - bottom]) {
+                fprintf(stderr, "Image did not validate at 0x%05x.\n", i);
+                ret = -1;
+                break;
+            }
+        }
+    }
+
+    free(flash);
+    return ret;
 }
 
 // Reset device so it will go back to normal execution